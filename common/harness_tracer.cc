@@ -19,9 +19,12 @@
 #include <sys/uio.h>
 #include <sys/user.h>
 
+#include <cerrno>
 #include <csignal>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <optional>
 #include <thread>
@@ -52,6 +55,29 @@ inline bool LooksLikeBogusTrap(const siginfo_t& info) {
 #endif
 }
 
+#if defined(__aarch64__)
+// Layout of the NT_ARM_HW_BREAK regset up to the first breakpoint slot, see
+// struct user_hwdebug_state in arch/arm64/include/uapi/asm/ptrace.h. Writing
+// a prefix of the regset leaves the other slots alone.
+struct ArmHwBreakpointSlot0 {
+  uint32_t dbg_info;
+  uint32_t pad;
+  uint64_t addr;
+  uint32_t ctrl;
+  uint32_t ctrl_pad;
+};
+
+// Sets breakpoint slot 0 of `pid` to `addr` with control value `ctrl`.
+// Returns false if the kernel rejects it.
+bool SetArmHwBreakpoint(pid_t pid, uint64_t addr, uint32_t ctrl) {
+  ArmHwBreakpointSlot0 regs = {.addr = addr, .ctrl = ctrl};
+  struct iovec io;
+  io.iov_base = &regs;
+  io.iov_len = sizeof(regs);
+  return ptrace(PTRACE_SETREGSET, pid, (void*)NT_ARM_HW_BREAK, &io) != -1;
+}
+#endif
+
 }  // namespace
 
 HarnessTracer::HarnessTracer(pid_t pid, Mode mode, Callback callback)
@@ -108,15 +134,83 @@ void HarnessTracer::GetRegSet(struct user_regs_struct& regs) const {
   CHECK_EQ(io.iov_len, sizeof(regs));
 }
 
-bool HarnessTracer::Trace(int status, bool is_active) const {
-  VLOG_INFO(2, "Trace: ", HexStr(status), " active = ", is_active);
+uint64_t HarnessTracer::GetTraceeInstructionPointer() const {
+#if defined(__x86_64__)
+  // PEEKUSER returns the value so failure is only reported through errno.
+  errno = 0;
+  uint64_t ip = ptrace(PTRACE_PEEKUSER, pid_,
+                       (void*)offsetof(struct user_regs_struct, rip), nullptr);
+  if (errno != 0) {
+    LOG_FATAL("PTRACE_PEEKUSER on ", pid_, " failed: ", strerror(errno));
+  }
+  return ip;
+#else
+  // aarch64 has no PTRACE_PEEKUSER, fetch the whole register set.
+  struct user_regs_struct regs;
+  GetRegSet(regs);
+  return GetInstructionPointer(regs);
+#endif
+}
+
+bool HarnessTracer::ArmStartBreakpoint() const {
+#if defined(__x86_64__)
+  // DR0 holds the address, enable it as a local execution breakpoint in DR7.
+  // The kernel rejects breakpoints it cannot install, e.g. in some VMs.
+  constexpr uint64_t kDr7LocalEnable0 = 1;
+  return ptrace(PTRACE_POKEUSER, pid_,
+                (void*)offsetof(struct user, u_debugreg[0]),
+                *single_step_start_address_) != -1 &&
+         ptrace(PTRACE_POKEUSER, pid_,
+                (void*)offsetof(struct user, u_debugreg[7]),
+                kDr7LocalEnable0) != -1;
+#elif defined(__aarch64__)
+  // An enabled EL0 execution breakpoint on the 4 bytes of an A64 instruction.
+  // See arch/arm64/include/asm/hw_breakpoint.h for the control encoding:
+  // byte address select in bits 5-12, type (0 is execute) in bits 3-4 and
+  // privilege (2 is EL0) in bits 1-2.
+  constexpr uint32_t kCtrlExecuteEl0Len4 = (0xf << 5) | (2 << 1) | 1;
+  // The kernel rejects breakpoints it cannot install, e.g. without debug
+  // hardware in a VM.
+  return SetArmHwBreakpoint(pid_, *single_step_start_address_,
+                            kCtrlExecuteEl0Len4);
+#else
+  return false;
+#endif
+}
+
+void HarnessTracer::DisarmStartBreakpoint() const {
+#if defined(__x86_64__)
+  PTraceOrDie(PTRACE_POKEUSER, pid_,
+              (void*)offsetof(struct user, u_debugreg[7]), 0);
+#elif defined(__aarch64__)
+  // The breakpoint was set, so clearing it cannot be rejected.
+  CHECK(SetArmHwBreakpoint(pid_, 0, 0));
+#endif
+}
+
+HarnessTracer::State HarnessTracer::Trace(int status, State state) const {
+  VLOG_INFO(2, "Trace: ", HexStr(status), " state = ", static_cast<int>(state));
   if (WSTOPSIG(status) == SIGSTOP) {
     // The tracee requested to toggle tracing mode.
     VLOG_INFO(2, "PID ", pid_, " raised SIGSTOP");
 
-    if (!is_active) {
+    if (state == kInactive) {
       // entering active state.
+      if (activation_callback_) {
+        activation_callback_();
+      }
+      if (mode_ == kSingleStep && single_step_start_address_.has_value() &&
+          ArmStartBreakpoint()) {
+        ContinueTraceeWithSignal();
+        return kWaitingForStart;
+      }
       Step();
+      return kActive;
+    } else if (state == kWaitingForStart) {
+      // Leaving the active state without reaching the start address. Nothing
+      // was single-stepped.
+      DisarmStartBreakpoint();
+      ContinueTraceeWithSignal();
     } else {
       // else, we are leaving the active state. The tracer keeps itself attached
       // but won't receive syscall/singlestep events only signals until the
@@ -150,28 +244,38 @@ bool HarnessTracer::Trace(int status, bool is_active) const {
 #endif
       ContinueTraceeWithSignal();
     }
-    return !is_active;
+    return kInactive;
   }
 
   // Not active, be as transparent as possible and keep injecting signals.
-  if (!is_active) {
+  if (state == kInactive) {
     siginfo_t info;
     PTraceOrDie(PTRACE_GETSIGINFO, pid_, 0, &info);
     ContinueTraceeWithSignal(info.si_signo);
-    return false;
+    return kInactive;
   }
 
-  struct user_regs_struct regs;
-  GetRegSet(regs);
-
   siginfo_t info;
   PTraceOrDie(PTRACE_GETSIGINFO, pid_, 0, &info);
 
+  if (state == kWaitingForStart) {
+    if (info.si_signo != SIGTRAP || info.si_code != TRAP_HWBKPT ||
+        GetTraceeInstructionPointer() != single_step_start_address_) {
+      // Stay transparent until the start address is reached.
+      ContinueTraceeWithSignal(info.si_signo);
+      return kWaitingForStart;
+    }
+    // The breakpoint stops before the instruction executes, single-stepping
+    // starts with it.
+    DisarmStartBreakpoint();
+  }
+
   // The tracee is now in ptrace-stopped state and the tracer is active.
   CallbackReason reason = [&]() {
+    if (state == kWaitingForStart) {
+      return kSingleStepStop;
+    }
     if (WSTOPSIG(status) == (SI_KERNEL | SIGTRAP)) {
-      VLOG_INFO(2, "system call at ", HexStr(GetInstructionPointer(regs)),
-                ", number = ", GetSyscallNumber(regs));
       return kSyscallStop;
     }
     switch (info.si_signo) {
@@ -204,6 +308,19 @@ bool HarnessTracer::Trace(int status, bool is_active) const {
     }
   }();
 
+  if (reason == kSingleStepStop && step_filter_ &&
+      !step_filter_(GetTraceeInstructionPointer())) {
+    Step();
+    return kActive;
+  }
+
+  struct user_regs_struct regs;
+  GetRegSet(regs);
+  if (reason == kSyscallStop) {
+    VLOG_INFO(2, "system call at ", HexStr(GetInstructionPointer(regs)),
+              ", number = ", GetSyscallNumber(regs));
+  }
+
   int signal = reason == kSignalStop ? info.si_signo : 0;
   ContinuationMode m = callback_(pid_, regs, reason);
   switch (m) {
@@ -221,7 +338,7 @@ bool HarnessTracer::Trace(int status, bool is_active) const {
       ContinueTraceeWithSignal(SIGUSR1);
       break;
   }
-  return true;
+  return kActive;
 }
 
 std::optional<int> HarnessTracer::EventLoop() const {
@@ -232,14 +349,14 @@ std::optional<int> HarnessTracer::EventLoop() const {
   }  // else fallthrough to the following WaitpidToStop() to get the status
 
   std::optional<int> status;
-  bool is_active = false;
+  State state = kInactive;
   bool has_set_opts = false;
   while (WaitpidToStop(pid_, &status)) {
     if (!has_set_opts) {
       PTraceOrDie(PTRACE_SETOPTIONS, pid_, 0, PTRACE_O_TRACESYSGOOD);
       has_set_opts = true;
     }
-    is_active = Trace(status.value(), is_active);
+    state = Trace(status.value(), state);
   }
   return status;
 }
@@ -18,10 +18,12 @@
 #include <sys/types.h>
 #include <sys/user.h>
 
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <optional>
 #include <thread>  // NOLINT
+#include <utility>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/synchronization/mutex.h"
@@ -149,6 +151,10 @@ class HarnessTracer {
   using Callback = std::function<ContinuationMode(
       pid_t, const user_regs_struct&, CallbackReason reason)>;
 
+  // Decides from the instruction pointer alone whether the callback wants to
+  // see a single-step stop. See SetSingleStepFilter().
+  using StepFilter = std::function<bool(uint64_t instruction_pointer)>;
+
   // Create a tracer for the given process `pid` in the specified tracing
   // `mode`. `callback` will be invoked for every intersting event as defined by
   // `mode`.
@@ -178,18 +184,68 @@ class HarnessTracer {
   // Whether or not Attach() has been called.
   bool is_attached() const { return tracer_thread_ != nullptr; }
 
+  // In kSingleStep mode, lets the tracee run at full speed after it activates
+  // the tracer until it reaches `address`, and only starts single-stepping
+  // there. The callback is not invoked for the skipped instructions, e.g. the
+  // harness code that leads into a snapshot. Uses a hardware breakpoint and
+  // falls back to single-stepping everything when one cannot be set, e.g.
+  // when the kernel has no debug registers to offer.
+  // Takes effect at the next activation. May be called from the callback.
+  void SetSingleStepStartAddress(uint64_t address) {
+    single_step_start_address_ = address;
+  }
+
+  // In kSingleStep mode, only reads the instruction pointer of the tracee at
+  // each single-step stop and skips the callback, stepping on, when `filter`
+  // returns false for it. The full register set is fetched only for the
+  // stops the callback is invoked for, which saves a ptrace(PTRACE_GETREGSET)
+  // per skipped instruction on x86_64. Other stops always reach the callback.
+  // Must be called before Attach().
+  void SetSingleStepFilter(StepFilter filter) {
+    CHECK(!is_attached());
+    step_filter_ = std::move(filter);
+  }
+
+  // Invokes `callback` each time the tracee activates the tracer, before any
+  // other event of that activation. This tells apart the traced regions of a
+  // tracee that toggles the tracer many times, e.g. once per snapshot.
+  // `callback` may call SetSingleStepStartAddress() to choose where
+  // single-stepping starts in the activation it is invoked for.
+  // Must be called before Attach().
+  void SetActivationCallback(std::function<void()> callback) {
+    CHECK(!is_attached());
+    activation_callback_ = std::move(callback);
+  }
+
  private:
+  // Activation state of the tracer, see class-level comment.
+  enum State {
+    kInactive,
+
+    // Active, but the tracee runs freely until it hits the breakpoint at
+    // single_step_start_address_.
+    kWaitingForStart,
+
+    kActive,
+  };
+
   // Runs the ptrace event loop. See class-level comment for details.
   // Returns the tracee exit status or nullopt if we missed it.
   // REQUIRES: is_attached().
   std::optional<int> EventLoop() const;
 
   // Processes a given ptrace stop event identified by `status`.
-  // `status` is the waitpid's wstatus of the tracee. `is_active` is the current
-  // state of the tracer (active or inactive).
-  // Returns active state of the tracer after processsing the current stop
-  // event.
-  bool Trace(int status, bool is_active) const;
+  // `status` is the waitpid's wstatus of the tracee. `state` is the current
+  // state of the tracer.
+  // Returns the state of the tracer after processsing the current stop event.
+  State Trace(int status, State state) const;
+
+  // Sets a hardware execution breakpoint at single_step_start_address_.
+  // Returns false if the breakpoint could not be set.
+  bool ArmStartBreakpoint() const;
+
+  // Clears the breakpoint set by ArmStartBreakpoint().
+  void DisarmStartBreakpoint() const;
 
   // Releases the tracee until the next ptrace-stop event (see class-level
   // comment). If `signal` is >0 injects the corresponding signal.
@@ -205,11 +261,24 @@ class HarnessTracer {
   // Gets the register state of the tracee.
   void GetRegSet(struct user_regs_struct& regs) const;
 
+  // Gets just the instruction pointer of the tracee. Cheaper than GetRegSet()
+  // where a single register can be read.
+  uint64_t GetTraceeInstructionPointer() const;
+
   // c-tor parameters
   pid_t pid_;
   Mode mode_;
   Callback callback_;
 
+  // See SetSingleStepStartAddress().
+  std::optional<uint64_t> single_step_start_address_;
+
+  // See SetSingleStepFilter(). Empty if every stop reaches the callback.
+  StepFilter step_filter_;
+
+  // See SetActivationCallback(). May be empty.
+  std::function<void()> activation_callback_;
+
   // Handle for the fiber running the ptrace event loop. Nullptr when
   // the tracer is not attached.
   std::unique_ptr<std::thread> tracer_thread_;
@@ -118,6 +118,134 @@ TEST(HarnessTracerTest, SingleStep) {
   EXPECT_EQ(n_loop_head_seen, 100);
 }
 
+TEST(HarnessTracerTest, SingleStepFromStartAddress) {
+  // The loop of DoWork() in harness_tracer_test_helper.cc, see SingleStep.
+#if defined(__x86_64__)
+  const uint32_t kLoopHeadInstruction = 0xdb8748;
+  const uint64_t kLoopHeadMask = 0xffffff;
+  const int kLoopSize = 3;
+#elif defined(__aarch64__)
+  const uint32_t kLoopHeadInstruction = 0xf100054a;
+  const uint64_t kLoopHeadMask = 0xffffffff;
+  const int kLoopSize = 2;
+#else
+#error "Unsupported architecture"
+#endif
+  // Single-steps the helper and returns the number of callbacks. With
+  // `fast_forward`, the first loop head seen becomes the start address, so the
+  // second active window runs freely up to the loop.
+  auto count_steps = [](bool fast_forward) {
+    std::unique_ptr<Subprocess> helper_process =
+        StartHelperProcess("test-singlestep");
+    int n_steps = 0;
+    std::optional<uint64_t> loop_head;
+    HarnessTracer* tracer_ptr = nullptr;
+    HarnessTracer tracer(
+        helper_process->pid(), HarnessTracer::kSingleStep,
+        [&](pid_t pid, const struct user_regs_struct& regs,
+            HarnessTracer::CallbackReason reason) {
+          ++n_steps;
+          uint64_t data = ptrace(PTRACE_PEEKTEXT, pid,
+                                 GetInstructionPointer(regs), nullptr);
+          CHECK_EQ(errno, 0);
+          if ((data & kLoopHeadMask) == kLoopHeadInstruction &&
+              !loop_head.has_value()) {
+            loop_head = GetInstructionPointer(regs);
+            if (fast_forward) {
+              tracer_ptr->SetSingleStepStartAddress(*loop_head);
+            }
+          }
+          return HarnessTracer::kKeepTracing;
+        });
+    tracer_ptr = &tracer;
+    tracer.Attach();
+    EXPECT_THAT(tracer.Join(), Optional(0));
+    std::string stdout_str;
+    helper_process->Communicate(&stdout_str);
+    EXPECT_TRUE(loop_head.has_value());
+    return n_steps;
+  };
+
+  int n_all_steps = count_steps(false);
+  int n_fast_forward_steps = count_steps(true);
+  // The loop itself is still stepped through, only the code leading into it
+  // is skipped.
+  EXPECT_GT(n_fast_forward_steps, 2 * 50 * kLoopSize);
+  EXPECT_LT(n_fast_forward_steps, n_all_steps);
+}
+
+TEST(HarnessTracerTest, SingleStepFilter) {
+  std::unique_ptr<Subprocess> helper_process =
+      StartHelperProcess("test-singlestep");
+
+  // Accepts every other instruction pointer and checks the callback sees
+  // exactly the accepted ones.
+  int n_filtered = 0;
+  int n_callbacks = 0;
+  std::optional<uint64_t> last_accepted;
+  HarnessTracer tracer(
+      helper_process->pid(), HarnessTracer::kSingleStep,
+      [&](pid_t pid, const struct user_regs_struct& regs,
+          HarnessTracer::CallbackReason reason) {
+        if (reason == HarnessTracer::kSingleStepStop) {
+          ++n_callbacks;
+          EXPECT_THAT(last_accepted, Optional(GetInstructionPointer(regs)));
+          last_accepted.reset();
+        }
+        return HarnessTracer::kKeepTracing;
+      });
+  tracer.SetSingleStepFilter([&](uint64_t instruction_pointer) {
+    if (n_filtered++ % 2 != 0) return false;
+    last_accepted = instruction_pointer;
+    return true;
+  });
+  tracer.Attach();
+  EXPECT_THAT(tracer.Join(), Optional(0));
+  std::string stdout_str;
+  helper_process->Communicate(&stdout_str);
+  EXPECT_GT(n_callbacks, 0);
+  EXPECT_EQ(n_callbacks, (n_filtered + 1) / 2);
+}
+
+TEST(HarnessTracerTest, ActivationCallback) {
+  std::unique_ptr<Subprocess> helper_process =
+      StartHelperProcess("test-singlestep");
+
+  // The helper activates the tracer twice and runs the loop 50 times in each
+  // active window. Attribute every loop head to the window it was seen in.
+  int n_activations = 0;
+  int n_loop_heads_seen[2] = {0, 0};
+  HarnessTracer tracer(
+      helper_process->pid(), HarnessTracer::kSingleStep,
+      [&](pid_t pid, const struct user_regs_struct& regs,
+          HarnessTracer::CallbackReason reason) {
+        uint64_t data = ptrace(PTRACE_PEEKTEXT, pid,
+                               GetInstructionPointer(regs), nullptr);
+        CHECK_EQ(errno, 0);
+#if defined(__x86_64__)
+        // 48 87 db     xchg   rbx,rbx, see SingleStep above.
+        const bool is_loop_head = (data & 0xffffff) == 0xdb8748;
+#elif defined(__aarch64__)
+        // f100054a        subs    x10, x10, #0x1
+        const bool is_loop_head = (data & 0xffffffff) == 0xf100054a;
+#else
+#error "Unsupported architecture"
+#endif
+        CHECK_GT(n_activations, 0);
+        CHECK_LE(n_activations, 2);
+        if (is_loop_head) ++n_loop_heads_seen[n_activations - 1];
+        return HarnessTracer::kKeepTracing;
+      });
+  tracer.SetActivationCallback([&n_activations] { ++n_activations; });
+  tracer.Attach();
+  EXPECT_THAT(tracer.Join(), Optional(0));
+  std::string stdout_str;
+  helper_process->Communicate(&stdout_str);
+  EXPECT_EQ(n_activations, 2);
+  EXPECT_EQ(n_loop_heads_seen[0], 50);
+  EXPECT_EQ(n_loop_heads_seen[1], 50);
+}
+
 TEST(HarnessTracerTest, Syscall) {
   std::unique_ptr<Subprocess> helper_process =
       StartHelperProcess("test-syscall");
@@ -147,4 +147,53 @@ std::string MappedMemoryMap::DebugString() const {
   return result;
 }
 
+// ----------------------------------------------------------------------- //
+
+bool FlatMappedMemoryMap::Contains(Address address) const {
+  return rep_.FindAt(address) != rep_.end();
+}
+
+MemoryPerms FlatMappedMemoryMap::PermsAt(Address address) const {
+  auto it = rep_.FindAt(address);
+  return it != rep_.end() ? it.value() : MemoryPerms::None();
+}
+
+std::optional<MemoryMapping> FlatMappedMemoryMap::MappingAt(
+    Address address) const {
+  auto it = rep_.FindAt(address);
+  if (it == rep_.end()) return std::nullopt;
+  MemoryPerms perms = it.value();
+  perms.Clear(MemoryPerms::kMapped);
+  return MemoryMapping::MakeRanged(it.start(), it.limit(), perms);
+}
+
+bool FlatMappedMemoryMap::Contains(Address start_address,
+                                   Address limit_address) const {
+  return rep_.Covers(start_address, limit_address,
+                     [](Rep::const_iterator i) { return true; });
+}
+
+bool FlatMappedMemoryMap::Overlaps(Address start_address,
+                                   Address limit_address) const {
+  auto range = rep_.Find(start_address, limit_address);
+  return range.first != range.second;
+}
+
+MemoryPerms FlatMappedMemoryMap::Perms(Address start_address,
+                                       Address limit_address,
+                                       MemoryPerms::JoinMode mode) const {
+  DCHECK_LE(start_address, limit_address);
+  if (start_address >= limit_address) return MemoryPerms::None();
+  MemoryPerms r = mode == MemoryPerms::kOr ? MemoryPerms::None()
+                                           : MemoryPerms::AllPlusMapped();
+  if (!rep_.Covers(start_address, limit_address,
+                   [&r, mode](Rep::const_iterator i) {
+                     r.Join(i.value(), mode);
+                     return true;
+                   })) {
+    r.Join(MemoryPerms::None(), mode);
+  }
+  return r;
+}
+
 }  // namespace silifuzz
@@ -17,7 +17,6 @@
 
 #include <stddef.h>
 
-#include <functional>
 #include <optional>
 #include <string>
 #include <utility>
@@ -25,6 +24,7 @@
 #include "./common/memory_mapping.h"
 #include "./common/memory_perms.h"
 #include "./common/snapshot_enums.h"
+#include "./util/flat_range_map.h"
 #include "./util/range_map.h"
 
 namespace silifuzz {
@@ -157,21 +157,36 @@ class MappedMemoryMap {
   MemoryPerms Perms(Address start_address, Address limit_address,
                     MemoryPerms::JoinMode mode) const;
 
-  // Runs `func` for every element of *this.
+  // Runs `func(start, limit, perms)` for every element of *this.
   // A poor man's iterator interface.
-  void Iterate(
-      std::function<void(Address start, Address limit, MemoryPerms perms)> func)
-      const;
+  template <typename Func>
+  void Iterate(Func func) const;
 
   // Like above but only for elements overlapping with the given address range.
-  void Iterate(
-      std::function<void(Address start, Address limit, MemoryPerms perms)> func,
-      Address start, Address limit) const;
+  template <typename Func>
+  void Iterate(Func func, Address start, Address limit) const;
+
+  // Runs `func(index, start, limit, perms)` for every element of *this
+  // overlapping `mappings[index]`, for all of `mappings` in order. The element
+  // is passed whole even if it extends beyond the mapping. Stops and returns
+  // false as soon as `func` returns false, returns true otherwise.
+  //
+  // This is a batch version of the range Iterate() above for checking all
+  // mappings of a snapshot at once. When `mappings` are sorted by address,
+  // as they are in a normalized snapshot, each mapping is found by walking
+  // forward from the previous one instead of with a lookup.
+  //
+  // `Mappings` is a container of objects with start_address() and
+  // limit_address(), e.g. Snapshot::MemoryMappingList.
+  template <typename Mappings, typename Func>
+  bool IterateOverlapping(const Mappings& mappings, Func func) const;
 
   // For logging.
   std::string DebugString() const;
 
  private:
+  friend class FlatMappedMemoryMap;
+
   // Methods to define a RangeMap<> instance below that maps the Address ranges
   // to the MemoryPerms covering those ranges.
   //
@@ -249,24 +264,91 @@ class MappedMemoryMap {
   Rep rep_;
 };
 
+// An immutable copy of a MappedMemoryMap with its lookups backed by
+// FlatRangeMap<>. Meant for maps that are built once and then queried on
+// every step of a hot loop, e.g. while tracing.
+//
+// This class is thread-compatible.
+class FlatMappedMemoryMap {
+ public:
+  using Address = MappedMemoryMap::Address;
+
+  FlatMappedMemoryMap() = default;
+  explicit FlatMappedMemoryMap(const MappedMemoryMap& map) : rep_(map.rep_) {}
+
+  // Copyable and movable.
+  FlatMappedMemoryMap(const FlatMappedMemoryMap&) = default;
+  FlatMappedMemoryMap(FlatMappedMemoryMap&&) = default;
+  FlatMappedMemoryMap& operator=(const FlatMappedMemoryMap&) = default;
+  FlatMappedMemoryMap& operator=(FlatMappedMemoryMap&&) = default;
+
+  bool IsEmpty() const { return rep_.empty(); }
+  size_t size() const { return rep_.size(); }
+
+  // Same as the MappedMemoryMap methods of the same names.
+  bool Contains(Address address) const;
+  MemoryPerms PermsAt(Address address) const;
+  std::optional<MemoryMapping> MappingAt(Address address) const;
+  bool Contains(Address start_address, Address limit_address) const;
+  bool Overlaps(Address start_address, Address limit_address) const;
+  MemoryPerms Perms(Address start_address, Address limit_address,
+                    MemoryPerms::JoinMode mode) const;
+
+ private:
+  using Rep = FlatRangeMap<MappedMemoryMap::MemoryPermsMethods::Key,
+                           MappedMemoryMap::MemoryPermsMethods::Value,
+                           MappedMemoryMap::MemoryPermsMethods>;
+  Rep rep_;
+};
+
 // ----------------------------------------------------------------------- //
 
 // Inline to help compiler optimize it away.
-inline void MappedMemoryMap::Iterate(
-    std::function<void(Address start, Address limit, MemoryPerms perms)> func)
-    const {
+template <typename Func>
+inline void MappedMemoryMap::Iterate(Func func) const {
   for (auto i = rep_.begin(); i != rep_.end(); ++i) {
     func(i.start(), i.limit(), i.value());
   }
 }
 
-inline void MappedMemoryMap::Iterate(
-    std::function<void(Address start, Address limit, MemoryPerms perms)> func,
-    Address start, Address limit) const {
-  rep_.Covers(start, limit, [&func](Rep::const_iterator i) {
+template <typename Func>
+inline void MappedMemoryMap::Iterate(Func func, Address start,
+                                     Address limit) const {
+  auto range = rep_.Find(start, limit);
+  for (auto i = range.first; i != range.second; ++i) {
     func(i.start(), i.limit(), i.value());
-    return true;
-  });
+  }
+}
+
+template <typename Mappings, typename Func>
+inline bool MappedMemoryMap::IterateOverlapping(const Mappings& mappings,
+                                                Func func) const {
+  // Walking forward past more elements than this is slower than a lookup.
+  constexpr int kMaxElementsToSkip = 8;
+  // The first element that ends after the start of the previous mapping.
+  Rep::const_iterator i = rep_.end();
+  Address previous_start = 0;
+  size_t index = 0;
+  for (const auto& mapping : mappings) {
+    const Address start = mapping.start_address();
+    const Address limit = mapping.limit_address();
+    if (index == 0 || start < previous_start) {
+      i = rep_.LowerBound(start);
+    } else {
+      for (int skipped = 0; i != rep_.end() && i.limit() <= start; ++i) {
+        if (++skipped > kMaxElementsToSkip) {
+          i = rep_.LowerBound(start);
+          break;
+        }
+      }
+    }
+    for (auto j = i; j != rep_.end() && j.start() < limit; ++j) {
+      if (!func(index, j.start(), j.limit(), j.value())) return false;
+    }
+    previous_start = start;
+    ++index;
+  }
+  return true;
 }
 
 }  // namespace silifuzz
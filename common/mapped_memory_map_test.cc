@@ -14,8 +14,10 @@
 
 #include "./common/mapped_memory_map.h"
 
+#include <cstddef>
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "absl/strings/str_cat.h"
@@ -252,5 +254,76 @@ TEST_F(MappedMemoryMapTest, MappingAt) {
   EXPECT_EQ(IntDebugString(mapping3.value()), "10..25:rw--");
 }
 
+TEST_F(MappedMemoryMapTest, IterateOverlapping) {
+  struct Range {
+    Address start_address() const { return start; }
+    Address limit_address() const { return limit; }
+    Address start;
+    Address limit;
+  };
+
+  MappedMemoryMap m;
+  m.AddNew(3, 5, r_perms);
+  m.AddNew(10, 25, rw_perms);
+  m.AddNew(30, 40, x_perms);
+  // Enough elements between the mappings below to need a lookup.
+  for (Address a = 100; a < 140; a += 2) {
+    m.AddNew(a, a + 1, r_perms);
+  }
+  m.AddNew(200, 210, rw_perms);
+
+  auto overlapping = [&m](const std::vector<Range>& ranges) {
+    std::string r;
+    m.IterateOverlapping(ranges, [&r](size_t index, Address start,
+                                      Address limit, MemoryPerms perms) {
+      absl::StrAppend(&r, index, ":", start, "..", limit, " ");
+      return true;
+    });
+    return r;
+  };
+  EXPECT_EQ(overlapping({}), "");
+  EXPECT_EQ(overlapping({{0, 3}, {5, 10}, {25, 30}}), "");
+  EXPECT_EQ(overlapping({{0, 4}, {20, 31}, {35, 36}}),
+            "0:3..5 1:10..25 1:30..40 2:30..40 ");
+  EXPECT_EQ(overlapping({{101, 102}, {138, 139}, {205, 206}}),
+            "1:138..139 2:200..210 ");
+  // Out of order.
+  EXPECT_EQ(overlapping({{200, 201}, {4, 11}}), "0:200..210 1:3..5 1:10..25 ");
+
+  // Stops early.
+  std::vector<Range> ranges = {{0, 4}, {20, 21}};
+  size_t num_calls = 0;
+  EXPECT_FALSE(m.IterateOverlapping(
+      ranges, [&num_calls](size_t, Address, Address, MemoryPerms) {
+        ++num_calls;
+        return false;
+      }));
+  EXPECT_EQ(num_calls, 1);
+}
+
+TEST_F(MappedMemoryMapTest, Flat) {
+  MappedMemoryMap m;
+  m.AddNew(3, 5, r_perms);
+  m.AddNew(10, 20, rw_perms);
+  m.Add(15, 25, x_perms);
+  FlatMappedMemoryMap f(m);
+  EXPECT_EQ(f.size(), m.size());
+  for (Address a = 0; a < 30; ++a) {
+    EXPECT_EQ(f.Contains(a), m.Contains(a)) << a;
+    EXPECT_EQ(f.PermsAt(a), m.PermsAt(a)) << a;
+    EXPECT_EQ(f.MappingAt(a), m.MappingAt(a)) << a;
+    for (Address l = a; l < 30; ++l) {
+      EXPECT_EQ(f.Contains(a, l), m.Contains(a, l)) << a << ".." << l;
+      EXPECT_EQ(f.Overlaps(a, l), m.Overlaps(a, l)) << a << ".." << l;
+      EXPECT_EQ(f.Perms(a, l, MemoryPerms::kOr),
+                m.Perms(a, l, MemoryPerms::kOr))
+          << a << ".." << l;
+      EXPECT_EQ(f.Perms(a, l, MemoryPerms::kAnd),
+                m.Perms(a, l, MemoryPerms::kAnd))
+          << a << ".." << l;
+    }
+  }
+}
+
 }  // namespace
 }  // namespace silifuzz
@@ -14,40 +14,300 @@
 
 #include "./common/memory_bytes_set.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
 #include <utility>
 
 #include "./util/itoa.h"
 
 namespace silifuzz {
 
+namespace {
+
+constexpr size_t kBitsPerWord = 64;
+
+// Returns a mask of the bits [begin, end) of a word.
+// REQUIRES: begin < end <= kBitsPerWord.
+uint64_t WordMask(size_t begin, size_t end) {
+  const uint64_t high = end == kBitsPerWord ? ~uint64_t{0}
+                                            : (uint64_t{1} << end) - 1;
+  return high & ~((uint64_t{1} << begin) - 1);
+}
+
+// Calls `func(word, mask)` for every word of a bitmap that has bits in
+// [begin, end) with the mask of those bits.
+template <typename Func>
+void ForEachWord(size_t begin, size_t end, Func func) {
+  while (begin < end) {
+    const size_t word = begin / kBitsPerWord;
+    const size_t word_end = std::min(end, (word + 1) * kBitsPerWord);
+    func(word, WordMask(begin % kBitsPerWord,
+                        word_end - word * kBitsPerWord));
+    begin = word_end;
+  }
+}
+
+// Returns the index of the first bit at or after `from` in `bits` that equals
+// `value` or the number of bits in `bits` if there is none.
+template <typename Bitmap>
+size_t FindBit(const Bitmap& bits, size_t from, bool value) {
+  const size_t num_bits = bits.size() * kBitsPerWord;
+  while (from < num_bits) {
+    const size_t word = from / kBitsPerWord;
+    uint64_t w = value ? bits[word] : ~bits[word];
+    w &= ~uint64_t{0} << (from % kBitsPerWord);
+    if (w != 0) return word * kBitsPerWord + __builtin_ctzll(w);
+    from = (word + 1) * kBitsPerWord;
+  }
+  return num_bits;
+}
+
+// Calls `func(begin, end)` for every run [begin, end) of set bits in `bits`.
+template <typename Bitmap, typename Func>
+void ForEachRun(const Bitmap& bits, Func func) {
+  const size_t num_bits = bits.size() * kBitsPerWord;
+  size_t begin = FindBit(bits, 0, true);
+  while (begin < num_bits) {
+    const size_t end = FindBit(bits, begin, false);
+    func(begin, end);
+    begin = FindBit(bits, end, true);
+  }
+}
+
+template <typename Bitmap>
+bool AllBitsEqual(const Bitmap& bits, uint64_t word) {
+  return std::all_of(bits.begin(), bits.end(),
+                     [word](uint64_t w) { return w == word; });
+}
+
+}  // namespace
+
+MemoryBytesSet::ByteSize MemoryBytesSet::size() const {
+  ByteSize size = 0;
+  Iterate([&size](Address, Address) { ++size; });
+  return size;
+}
+
 MemoryBytesSet::ByteSize MemoryBytesSet::byte_size() const {
   ByteSize size = 0;
   for (auto i = rep_.begin(); i != rep_.end(); ++i) {
     size += i.limit() - i.start();
   }
+  for (const auto& [block, bits] : partial_blocks_) {
+    for (uint64_t word : bits) {
+      size += __builtin_popcountll(word);
+    }
+  }
   return size;
 }
 
+// static
+MemoryBytesSet::SplitRange MemoryBytesSet::Split(Address start_address,
+                                                 Address limit_address) {
+  // Work with block indices so that nothing overflows at the top of the
+  // address space.
+  const Address first_block = start_address / kBlockSize;
+  const Address last_block = (limit_address - 1) / kBlockSize;
+  const size_t begin = start_address % kBlockSize;
+  const size_t end = limit_address - last_block * kBlockSize;
+  SplitRange split;
+  if (first_block == last_block) {
+    if (begin == 0 && end == kBlockSize) {
+      split.whole_start = start_address;
+      split.whole_limit = limit_address;
+    } else {
+      split.parts[split.num_parts++] = {first_block * kBlockSize, begin, end};
+    }
+    return split;
+  }
+  split.whole_start = start_address;
+  split.whole_limit = limit_address;
+  if (begin != 0) {
+    split.parts[split.num_parts++] = {first_block * kBlockSize, begin,
+                                      kBlockSize};
+    split.whole_start = (first_block + 1) * kBlockSize;
+  }
+  if (end != kBlockSize) {
+    split.parts[split.num_parts++] = {last_block * kBlockSize, 0, end};
+    split.whole_limit = last_block * kBlockSize;
+  }
+  return split;
+}
+
+bool MemoryBytesSet::IsWholeBlock(Address block) const {
+  // Ranges in rep_ are block-aligned, so any overlap covers the block.
+  auto range = rep_.Find(block, block + 1);
+  return range.first != range.second;
+}
+
+void MemoryBytesSet::AddToBlock(Address block, const Block& bits) {
+  if (IsWholeBlock(block)) return;
+  Block& block_bits = partial_blocks_[block];
+  for (size_t i = 0; i < block_bits.size(); ++i) {
+    block_bits[i] |= bits[i];
+  }
+  if (AllBitsEqual(block_bits, ~uint64_t{0})) {
+    partial_blocks_.erase(block);
+    rep_.Add(block, block + kBlockSize, kDummyMappedValue);
+  }
+}
+
+void MemoryBytesSet::RemoveFromBlock(Address block, size_t begin, size_t end) {
+  auto it = partial_blocks_.find(block);
+  if (it == partial_blocks_.end()) {
+    if (!IsWholeBlock(block)) return;
+    rep_.Remove(block, block + kBlockSize, false /* value does not matter */);
+    Block all_bits;
+    all_bits.fill(~uint64_t{0});
+    it = partial_blocks_.emplace(block, all_bits).first;
+  }
+  Block& bits = it->second;
+  ForEachWord(begin, end,
+              [&bits](size_t word, uint64_t mask) { bits[word] &= ~mask; });
+  if (AllBitsEqual(bits, 0)) {
+    partial_blocks_.erase(it);
+  }
+}
+
 void MemoryBytesSet::Add(Address start_address, Address limit_address) {
-  rep_.Add(start_address, limit_address, kDummyMappedValue);
+  if (start_address >= limit_address) return;
+  const SplitRange split = Split(start_address, limit_address);
+  if (split.whole_start < split.whole_limit) {
+    rep_.Add(split.whole_start, split.whole_limit, kDummyMappedValue);
+    partial_blocks_.erase(partial_blocks_.lower_bound(split.whole_start),
+                          partial_blocks_.lower_bound(split.whole_limit));
+  }
+  for (int i = 0; i < split.num_parts; ++i) {
+    const BlockPart& part = split.parts[i];
+    Block bits = {};
+    ForEachWord(part.begin, part.end,
+                [&bits](size_t word, uint64_t mask) { bits[word] |= mask; });
+    AddToBlock(part.block, bits);
+  }
 }
 
-void MemoryBytesSet::Add(const MemoryBytesSet& y) { rep_.AddRangeMap(y.rep_); }
+void MemoryBytesSet::Add(const MemoryBytesSet& y) {
+  rep_.AddRangeMap(y.rep_);
+  for (auto i = y.rep_.begin(); i != y.rep_.end(); ++i) {
+    partial_blocks_.erase(partial_blocks_.lower_bound(i.start()),
+                          partial_blocks_.lower_bound(i.limit()));
+  }
+  for (const auto& [block, bits] : y.partial_blocks_) {
+    AddToBlock(block, bits);
+  }
+}
 
 void MemoryBytesSet::Remove(Address start_address, Address limit_address) {
-  rep_.Remove(start_address, limit_address, false /* value does not matter */);
+  if (start_address >= limit_address) return;
+  const SplitRange split = Split(start_address, limit_address);
+  if (split.whole_start < split.whole_limit) {
+    rep_.Remove(split.whole_start, split.whole_limit,
+                false /* value does not matter */);
+    partial_blocks_.erase(partial_blocks_.lower_bound(split.whole_start),
+                          partial_blocks_.lower_bound(split.whole_limit));
+  }
+  for (int i = 0; i < split.num_parts; ++i) {
+    const BlockPart& part = split.parts[i];
+    RemoveFromBlock(part.block, part.begin, part.end);
+  }
 }
 
 void MemoryBytesSet::Intersect(const MemoryBytesSet& y) {
   Rep intersection;
   intersection.AddIntersectionOf(rep_, y.rep_);
+  // The intersection of two partial blocks is never full, so partial blocks
+  // stay partial or go away.
+  absl::btree_map<Address, Block> partial_intersection;
+  for (const auto& [block, bits] : partial_blocks_) {
+    if (y.IsWholeBlock(block)) {
+      partial_intersection.emplace(block, bits);
+      continue;
+    }
+    auto it = y.partial_blocks_.find(block);
+    if (it == y.partial_blocks_.end()) continue;
+    Block common;
+    for (size_t i = 0; i < common.size(); ++i) {
+      common[i] = bits[i] & it->second[i];
+    }
+    if (!AllBitsEqual(common, 0)) {
+      partial_intersection.emplace(block, common);
+    }
+  }
+  for (const auto& [block, bits] : y.partial_blocks_) {
+    if (IsWholeBlock(block)) {
+      partial_intersection.emplace(block, bits);
+    }
+  }
   rep_ = std::move(intersection);
+  partial_blocks_ = std::move(partial_intersection);
 }
 
 bool MemoryBytesSet::IsDisjoint(Address start_address,
                                 Address limit_address) const {
   auto range = rep_.Find(start_address, limit_address);
-  return range.first == range.second;  // empty overlap
+  if (range.first != range.second) return false;
+  for (auto it = partial_blocks_.lower_bound(start_address -
+                                             start_address % kBlockSize);
+       it != partial_blocks_.end() && it->first < limit_address; ++it) {
+    const Address block = it->first;
+    const size_t begin = std::max(start_address, block) - block;
+    const size_t end = std::min<Address>(limit_address - block, kBlockSize);
+    bool overlaps = false;
+    ForEachWord(begin, end, [&](size_t word, uint64_t mask) {
+      overlaps |= (it->second[word] & mask) != 0;
+    });
+    if (overlaps) return false;
+  }
+  return true;
+}
+
+void MemoryBytesSet::Iterate(
+    std::function<void(Address start, Address limit)> func) const {
+  // The last byte of the address space cannot be in a right-opened range.
+  IterateIn(0, ~Address{0}, func);
+}
+
+void MemoryBytesSet::IterateIn(
+    Address start_address, Address limit_address,
+    std::function<void(Address start, Address limit)> func) const {
+  // Ranges of rep_ and runs of bytes in partial_blocks_ are visited in
+  // address order. Touching ones are coalesced before calling `func`.
+  std::optional<std::pair<Address, Address>> pending;
+  auto visit = [&](Address start, Address limit) {
+    start = std::max(start, start_address);
+    limit = std::min(limit, limit_address);
+    if (start >= limit) return;
+    if (pending.has_value() && pending->second == start) {
+      pending->second = limit;
+      return;
+    }
+    if (pending.has_value()) func(pending->first, pending->second);
+    pending.emplace(start, limit);
+  };
+  auto range = rep_.Find(start_address, limit_address);
+  auto i = range.first;
+  auto it = partial_blocks_.lower_bound(start_address -
+                                        start_address % kBlockSize);
+  while (true) {
+    const bool has_range = i != range.second;
+    const bool has_block =
+        it != partial_blocks_.end() && it->first < limit_address;
+    if (!has_range && !has_block) break;
+    if (has_range && (!has_block || i.start() < it->first)) {
+      visit(i.start(), i.limit());
+      ++i;
+    } else {
+      const Address block = it->first;
+      ForEachRun(it->second, [&visit, block](size_t begin, size_t end) {
+        visit(block + begin, block + end);
+      });
+      ++it;
+    }
+  }
+  if (pending.has_value()) func(pending->first, pending->second);
 }
 
 }  // namespace silifuzz
@@ -15,10 +15,13 @@
 #ifndef THIRD_PARTY_SILIFUZZ_MEMORY_BYTES_SET_H_
 #define THIRD_PARTY_SILIFUZZ_MEMORY_BYTES_SET_H_
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
-#include <optional>
 #include <utility>
 
+#include "absl/container/btree_map.h"
 #include "./common/snapshot_enums.h"
 #include "./util/range_map.h"
 
@@ -28,6 +31,12 @@ namespace silifuzz {
 // [start, limit) that are guaranteed to be minimal, i.e. any touching address
 // ranges are coalesced into a single range.
 //
+// The address space is split into aligned blocks of kBlockSize bytes. Blocks
+// that are entirely in the set are kept as ranges while blocks that are only
+// partially in the set are kept as byte-granular bitmaps. Snapshots typically
+// have a few pages of memory bytes with small holes or fragments in them,
+// which this makes a few word operations per block.
+//
 // This class is thread-unsafe.
 class MemoryBytesSet {
  public:
@@ -44,19 +53,25 @@ class MemoryBytesSet {
   MemoryBytesSet& operator=(MemoryBytesSet&&) = default;
 
   // Whether *this has no data.
-  bool empty() const { return rep_.empty(); }
+  bool empty() const { return rep_.empty() && partial_blocks_.empty(); }
 
   // Resets *this to post-construction empty() state.
-  void clear() { rep_.clear(); }
+  void clear() {
+    rep_.clear();
+    partial_blocks_.clear();
+  }
 
   // Size of the set as the number of non-touching memory ranges.
-  ByteSize size() const { return rep_.size(); }
+  // This takes time linear in the size of the set.
+  ByteSize size() const;
 
   // Number of bytes represented by *this.
   ByteSize byte_size() const;
 
   // Comparison operators.
-  bool operator==(const MemoryBytesSet& y) const { return rep_ == y.rep_; }
+  bool operator==(const MemoryBytesSet& y) const {
+    return rep_ == y.rep_ && partial_blocks_ == y.partial_blocks_;
+  }
   bool operator!=(const MemoryBytesSet& y) const { return !(*this == y); }
 
   // Adds memory address range [start_address, limit_address). If the range
@@ -80,7 +95,49 @@ class MemoryBytesSet {
   // A poor man's iterator interface.
   void Iterate(std::function<void(Address start, Address limit)> func) const;
 
+  // Like Iterate(), but only for the parts of the address ranges of *this
+  // inside [start_address, limit_address).
+  void IterateIn(Address start_address, Address limit_address,
+                 std::function<void(Address start, Address limit)> func) const;
+
  private:
+  // Size and alignment of the blocks that are kept as bitmaps.
+  static constexpr ByteSize kBlockSize = 4096;
+
+  // Bitmap of the bytes of a block that are in the set, one bit per byte.
+  using Block = std::array<uint64_t, kBlockSize / 64>;
+
+  // A part of [start, limit) that covers the bytes [begin, end) of the block
+  // at `block`, but not all of it.
+  struct BlockPart {
+    Address block;
+    size_t begin;
+    size_t end;
+  };
+
+  // [start, limit) split into whole blocks and the parts of at most two
+  // blocks at its ends.
+  struct SplitRange {
+    // [whole_start, whole_limit) is block-aligned and may be empty.
+    Address whole_start = 0;
+    Address whole_limit = 0;
+    BlockPart parts[2];
+    int num_parts = 0;
+  };
+
+  // Returns [start_address, limit_address) split as above.
+  // REQUIRES: start_address < limit_address.
+  static SplitRange Split(Address start_address, Address limit_address);
+
+  // Whether the block at `block` is entirely in the set.
+  bool IsWholeBlock(Address block) const;
+
+  // Adds the bytes in `bits` of the block at `block`.
+  void AddToBlock(Address block, const Block& bits);
+
+  // Removes the bytes [begin, end) of the block at `block`.
+  void RemoveFromBlock(Address block, size_t begin, size_t end);
+
   // We use a map to simulate a set and we do not care about what mapped
   // values are.
   static constexpr bool kDummyMappedValue = false;
@@ -157,18 +214,15 @@ class MemoryBytesSet {
 
   using Rep = RangeMap<MemoryBytesSetMethods::Key, MemoryBytesSetMethods::Value,
                        MemoryBytesSetMethods>;
-  Rep rep_;
-};
 
-// ----------------------------------------------------------------------- //
+  // Blocks entirely in the set. All ranges are block-aligned.
+  Rep rep_;
 
-// Inline to help compiler optimize it away.
-inline void MemoryBytesSet::Iterate(
-    std::function<void(Address start, Address limit)> func) const {
-  for (auto i = rep_.begin(); i != rep_.end(); ++i) {
-    func(i.start(), i.limit());
-  }
-}
+  // Bitmaps of the blocks partially in the set keyed by block address. No
+  // bitmap is empty or full and no block is also in rep_, so each set has
+  // exactly one representation.
+  absl::btree_map<Address, Block> partial_blocks_;
+};
 
 }  // namespace silifuzz
 
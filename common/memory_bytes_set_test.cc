@@ -14,7 +14,9 @@
 
 #include "./common/memory_bytes_set.h"
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "absl/strings/str_cat.h"
@@ -37,9 +39,10 @@ class MemoryBytesSetTest : public testing::Test {
   }
 };
 
-// Most of MemoryBytesSet is a thin wrapper around a class with its own proper
+// Whole blocks of MemoryBytesSet are kept in a class with its own proper
 // tests, so we do some basic tests for those to exercise things and make sure
-// we don't have simple bugs like a misplaced negation.
+// we don't have simple bugs like a misplaced negation. The tests below cover
+// the bitmaps of partial blocks.
 TEST_F(MemoryBytesSetTest, Basics) {
   MemoryBytesSet m;
   EXPECT_TRUE(m.empty());
@@ -93,5 +96,105 @@ TEST_F(MemoryBytesSetTest, Intersect) {
   EXPECT_EQ(IntDebugString(m1), "15..20 35..40 ");
 }
 
+TEST_F(MemoryBytesSetTest, PartialBlocks) {
+  MemoryBytesSet m;
+  m.Add(4000, 4196);
+  EXPECT_EQ(m.size(), 1);
+  EXPECT_EQ(m.byte_size(), 196);
+  EXPECT_EQ(IntDebugString(m), "4000..4196 ");
+
+  // Fill the rest of the second block, which then becomes whole.
+  m.Add(4196, 8192);
+  EXPECT_EQ(IntDebugString(m), "4000..8192 ");
+  m.Add(8192, 8200);
+  EXPECT_EQ(IntDebugString(m), "4000..8200 ");
+
+  // Punch a hole into the whole block.
+  m.Remove(5000, 5001);
+  EXPECT_EQ(m.size(), 2);
+  EXPECT_EQ(m.byte_size(), 4199);
+  EXPECT_EQ(IntDebugString(m), "4000..5000 5001..8200 ");
+  EXPECT_TRUE(m.IsDisjoint(5000, 5001));
+  EXPECT_FALSE(m.IsDisjoint(4999, 5001));
+  EXPECT_FALSE(m.IsDisjoint(8199, 10000));
+  EXPECT_TRUE(m.IsDisjoint(8200, 10000));
+
+  std::string r;
+  m.IterateIn(4500, 6000, [&r](Address start, Address limit) {
+    absl::StrAppend(&r, start, "..", limit, " ");
+  });
+  EXPECT_EQ(r, "4500..5000 5001..6000 ");
+
+  // The same set built differently compares equal.
+  MemoryBytesSet other;
+  other.Add(8199, 8200);
+  other.Add(5001, 8199);
+  other.Add(4000, 5000);
+  EXPECT_EQ(other, m);
+
+  m.Remove(0, 10000);
+  EXPECT_TRUE(m.empty());
+  EXPECT_EQ(m, MemoryBytesSet());
+}
+
+TEST_F(MemoryBytesSetTest, PartialBlocksSetOperations) {
+  MemoryBytesSet m1;
+  m1.Add(100, 200);
+  m1.Add(4096, 8192);
+  MemoryBytesSet m2;
+  m2.Add(0, 4096);
+  m2.Add(5000, 5100);
+  m2.Add(9000, 9100);
+
+  MemoryBytesSet intersection = m1;
+  intersection.Intersect(m2);
+  EXPECT_EQ(IntDebugString(intersection), "100..200 5000..5100 ");
+
+  MemoryBytesSet sum = m1;
+  sum.Add(m2);
+  EXPECT_EQ(IntDebugString(sum), "0..8192 9000..9100 ");
+  EXPECT_EQ(sum.size(), 2);
+}
+
+// Checks a sequence of operations on a few blocks against a bitmap of all the
+// bytes.
+TEST_F(MemoryBytesSetTest, PartialBlocksMatchBitmap) {
+  constexpr Address kLimit = 3 * 4096;
+  MemoryBytesSet m;
+  std::vector<bool> expected(kLimit);
+  uint64_t seed = 1;
+  auto next = [&seed](uint64_t bound) {
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (seed >> 33) % bound;
+  };
+  for (int i = 0; i < 1000; ++i) {
+    const Address start = next(kLimit);
+    const Address limit = start + 1 + next(kLimit - start);
+    const bool add = next(2) == 0;
+    if (add) {
+      m.Add(start, limit);
+    } else {
+      m.Remove(start, limit);
+    }
+    for (Address a = start; a < limit; ++a) expected[a] = add;
+
+    std::string expected_ranges;
+    MemoryBytesSet from_bitmap;
+    for (Address a = 0; a < kLimit;) {
+      if (!expected[a]) {
+        ++a;
+        continue;
+      }
+      Address run_limit = a;
+      while (run_limit < kLimit && expected[run_limit]) ++run_limit;
+      absl::StrAppend(&expected_ranges, a, "..", run_limit, " ");
+      from_bitmap.Add(a, run_limit);
+      a = run_limit;
+    }
+    ASSERT_EQ(IntDebugString(m), expected_ranges) << i;
+    ASSERT_EQ(m, from_bitmap) << i;
+  }
+}
+
 }  // namespace
 }  // namespace silifuzz
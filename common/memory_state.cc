@@ -16,6 +16,9 @@
 
 #include <stddef.h>
 
+#include <algorithm>
+#include <cstring>
+#include <memory>
 #include <optional>
 #include <string>
 #include <utility>
@@ -23,6 +26,7 @@
 #include "absl/base/attributes.h"
 #include "absl/strings/str_cat.h"
 #include "./util/checks.h"
+#include "./util/page_util.h"
 
 namespace silifuzz {
 
@@ -68,7 +72,7 @@ MemoryState MemoryState::MakeEnd(const Snapshot& snapshot, int end_state_index,
 // ----------------------------------------------------------------------- //
 
 MemoryState::MemoryState()
-    : mapped_memory_map_(), written_memory_set_(), written_memory_bytes_() {}
+    : mapped_memory_map_(), written_memory_set_(), written_pages_() {}
 
 MemoryState::~MemoryState() {}
 
@@ -76,24 +80,63 @@ MemoryState MemoryState::Copy() const {
   MemoryState r;
   r.mapped_memory_map_ = mapped_memory_map_.Copy();
   r.written_memory_set_ = written_memory_set_;
-  r.written_memory_bytes_ = written_memory_bytes_;
+  r.written_pages_ = written_pages_;  // shares the pages
   return r;
 }
 
 bool MemoryState::operator==(const MemoryState& y) const {
-  return mapped_memory_map_ == y.mapped_memory_map_ &&
-         written_memory_bytes_ ==
-             y.written_memory_bytes_;  // covers written_memory_set_
+  return mapped_memory_map_ == y.mapped_memory_map_ && MemoryBytesEq(y);
 }
 
 bool MemoryState::MemoryBytesEq(const MemoryState& y) const {
-  return written_memory_bytes_ == y.written_memory_bytes_;
+  if (written_pages_.size() != y.written_pages_.size() ||
+      written_memory_set_ != y.written_memory_set_) {
+    return false;
+  }
+  // Unwritten bytes are 0 in both, so it is enough to compare whole pages.
+  auto y_it = y.written_pages_.begin();
+  for (const auto& [address, page] : written_pages_) {
+    if (address != y_it->first) return false;
+    if (page != y_it->second && *page != *y_it->second) return false;
+    ++y_it;
+  }
+  return true;
 }
 
 bool MemoryState::IsEmpty() const {
   // mapped_memory_map_.IsEmpty() actually implies the rest.
   return mapped_memory_map_.IsEmpty() && written_memory_set_.empty() &&
-         written_memory_bytes_.empty();
+         written_pages_.empty();
+}
+
+MemoryState::BytesPage& MemoryState::MutablePage(Address page_address) {
+  DCHECK(IsPageAligned(page_address));
+  std::shared_ptr<BytesPage>& page = written_pages_[page_address];
+  if (page == nullptr) {
+    page = std::make_shared<BytesPage>();  // zero-initialized
+  } else if (page.use_count() > 1) {
+    page = std::make_shared<BytesPage>(*page);
+  }
+  return *page;
+}
+
+void MemoryState::ClearBytes(Address start_address, Address limit_address) {
+  auto it = written_pages_.lower_bound(
+      RoundDownToPageAlignment(start_address));
+  while (it != written_pages_.end() && it->first < limit_address) {
+    const Address page_address = it->first;
+    const Address page_limit = page_address + kPageSize;
+    if (written_memory_set_.IsDisjoint(page_address, page_limit)) {
+      it = written_pages_.erase(it);
+      continue;
+    }
+    const Address start = std::max(start_address, page_address);
+    const Address limit = std::min(limit_address, page_limit);
+    // MutablePage() does not invalidate `it` as the page already exists.
+    BytesPage& page = MutablePage(page_address);
+    memset(page.data() + (start - page_address), 0, limit - start);
+    ++it;
+  }
 }
 
 // ----------------------------------------------------------------------- //
@@ -122,7 +165,7 @@ void MemoryState::RemoveMemoryMapping(Address start_address,
                                       Address limit_address) {
   mapped_memory_map_.Remove(start_address, limit_address);
   written_memory_set_.Remove(start_address, limit_address);
-  written_memory_bytes_.Remove(start_address, limit_address, ByteData());
+  ClearBytes(start_address, limit_address);
 }
 
 void MemoryState::RemoveMemoryMappingsNotIn(const Snapshot& snapshot) {
@@ -147,13 +190,22 @@ void MemoryState::SetMemoryBytes(const MemoryBytes& bytes) {
   DCHECK(mapped_memory_map_.Contains(bytes.start_address(),
                                      bytes.limit_address()));
   written_memory_set_.Add(bytes.start_address(), bytes.limit_address());
-  written_memory_bytes_.Add(bytes.start_address(), bytes.limit_address(),
-                            bytes.byte_values());
+  const ByteData& byte_values = bytes.byte_values();
+  for (Address addr = bytes.start_address(); addr < bytes.limit_address();) {
+    const Address page_address = RoundDownToPageAlignment(addr);
+    const Address limit =
+        std::min<Address>(bytes.limit_address(), page_address + kPageSize);
+    BytesPage& page = MutablePage(page_address);
+    memcpy(page.data() + (addr - page_address),
+           byte_values.data() + (addr - bytes.start_address()), limit - addr);
+    addr = limit;
+  }
 }
 
 void MemoryState::ForgetMemoryBytes(Address start_address,
                                     Address limit_address) {
-  written_memory_bytes_.Remove(start_address, limit_address, ByteData());
+  written_memory_set_.Remove(start_address, limit_address);
+  ClearBytes(start_address, limit_address);
 }
 
 void MemoryState::SetMemoryBytes(const Snapshot& snapshot) {
@@ -225,17 +277,26 @@ char MemoryState::memory_byte(Address address) const {
 
 MemoryState::ByteData MemoryState::memory_bytes(Address start_address,
                                                 ByteSize num_bytes) const {
-  const auto limit_address = start_address + num_bytes;
-  auto iters = written_memory_bytes_.Find(start_address, limit_address);
-  // Precondition: exactly one range covers the request:
-  DCHECK(iters.first != written_memory_bytes_.end());
-  auto it = iters.first;
-  if (DEBUG_MODE) ++iters.first;  // for the next DCHECK
-  DCHECK(iters.first == iters.second);
-  // Precondition: it covers the request fully:
-  DCHECK_LE(it.start(), start_address);
-  DCHECK_LE(limit_address, it.limit());
-  return ByteData(it.value().data() + start_address - it.start(), num_bytes);
+  const Address limit_address = start_address + num_bytes;
+  if (DEBUG_MODE) {
+    // Precondition: the request is fully inside written memory.
+    MemoryBytesSet written;
+    written.Add(start_address, limit_address);
+    written.Intersect(written_memory_set_);
+    DCHECK_EQ(written.byte_size(), num_bytes);
+  }
+  ByteData result;
+  result.reserve(num_bytes);
+  for (Address addr = start_address; addr < limit_address;) {
+    const Address page_address = RoundDownToPageAlignment(addr);
+    const Address limit =
+        std::min<Address>(limit_address, page_address + kPageSize);
+    auto it = written_pages_.find(page_address);
+    DCHECK(it != written_pages_.end());
+    result.append(it->second->data() + (addr - page_address), limit - addr);
+    addr = limit;
+  }
+  return result;
 }
 
 MemoryState::MemoryBytesList MemoryState::memory_bytes_list(
@@ -418,26 +479,18 @@ MemoryState::MemoryBytesList MemoryState::DeltaMemoryBytes(
                                        bytes.limit_address()));
   }
 
-  if (written_memory_bytes_.empty()) return {bytes};
+  if (written_pages_.empty()) return {bytes};
 
   // Let's do the work to pass-through parts of `bytes` that differ or missing
-  // from written_memory_bytes_.
-
-  auto iters =
-      written_memory_bytes_.Find(bytes.start_address(), bytes.limit_address());
-  auto it = iters.first;
-  const auto end_it = iters.second;
-  if (it == written_memory_bytes_.end()) {
-    // `bytes` is comletely not in written_memory_bytes_
+  // from the written memory.
+
+  if (written_memory_set_.IsDisjoint(bytes.start_address(),
+                                     bytes.limit_address())) {
+    // `bytes` is comletely not in the written memory
     return {bytes};
   }
   const auto& byte_values = bytes.byte_values();
 
-  // TODO(ksteuck): [perf] Should be more efficient to compare `bytes` to
-  // written_memory_bytes_ int64_t-at-a-time in this function to begin with.
-  // Can probably make all MemoryBytes int64_t-aligned and
-  // multiple-of-int64_t-sized for this.
-
   // TODO(ksteuck): [perf] Even more efficient would be a separate range-based
   // representation for the subset of MemoryBytesList-s where all byte values
   // are 0. For the current corpus 99.98% of equal bytes evaluated by
@@ -466,33 +519,40 @@ MemoryState::MemoryBytesList MemoryState::DeltaMemoryBytes(
   MemoryBytesList result;
   std::optional<MemoryBytes> chunk  // next candidate to add to `result`
       = std::nullopt;
-  for (Address addr = bytes.start_address(); addr < bytes.limit_address();) {
-    // Loop invariant: `it` is the range in written_memory_bytes_ that
-    // covers `addr` if any such range exists.
-    std::optional<Byte> old_byte =
-        (it.start() <= addr && addr < it.limit())
-            ? std::optional<Byte>(it.value().data()[addr - it.start()])
-            : std::nullopt;
-    Byte new_byte = byte_values[addr - bytes.start_address()];
-    if (!old_byte.has_value() || old_byte.value() != new_byte) {
-      // Pass new_byte through: append to existing chunk or start a new chunk.
-      GrowResultChunk(bytes, addr, 1, chunk, result);
+  // Start of the part of `bytes` not yet processed.
+  Address addr = bytes.start_address();
+  auto process_written = [&](Address start, Address limit) {
+    // Bytes not in the written memory are passed through.
+    if (addr < start) {
+      GrowResultChunk(bytes, addr, start - addr, chunk, result);
     }
-    // Advance `addr` and if necessay `it`:
-    ++addr;
-    if (addr >= it.limit()) {
-      DCHECK_EQ(addr, it.limit());
-      ++it;
-      if (it == end_it) {
-        // Nothing else overlaps with written_memory_bytes_, so we pass the
-        // remainder of `bytes` through.
-        auto tail_size = byte_values.size() - (addr - bytes.start_address());
-        if (tail_size != 0) {
-          GrowResultChunk(bytes, addr, tail_size, chunk, result);
+    // Written bytes are compared a page at a time, so that equal parts of
+    // pages are skipped with one memcmp().
+    for (addr = start; addr < limit;) {
+      const Address page_address = RoundDownToPageAlignment(addr);
+      const Address segment_limit =
+          std::min<Address>(limit, page_address + kPageSize);
+      const char* old_bytes =
+          written_pages_.at(page_address)->data() + (addr - page_address);
+      const char* new_bytes =
+          byte_values.data() + (addr - bytes.start_address());
+      const size_t size = segment_limit - addr;
+      if (memcmp(old_bytes, new_bytes, size) != 0) {
+        for (size_t i = 0; i < size; ++i) {
+          if (old_bytes[i] != new_bytes[i]) {
+            // Pass the byte through: append to existing chunk or start a new
+            // chunk.
+            GrowResultChunk(bytes, addr + i, 1, chunk, result);
+          }
         }
-        break;
       }
+      addr = segment_limit;
     }
+  };
+  written_memory_set_.IterateIn(bytes.start_address(), bytes.limit_address(),
+                                process_written);
+  if (addr < bytes.limit_address()) {
+    GrowResultChunk(bytes, addr, bytes.limit_address() - addr, chunk, result);
   }
   if (chunk.has_value()) {
     result.push_back(std::move(chunk).value());
@@ -17,18 +17,21 @@
 
 #include <stddef.h>
 
+#include <array>
+#include <memory>
 #include <optional>
 #include <set>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "absl/container/btree_map.h"
 #include "./common/mapped_memory_map.h"
 #include "./common/snapshot.h"
 #include "./common/snapshot_types.h"
 #include "./util/checks.h"
 #include "./util/itoa.h"
-#include "./util/range_map.h"
+#include "./util/page_util.h"
 
 namespace silifuzz {
 
@@ -36,6 +39,10 @@ namespace silifuzz {
 // in a process playing a snapshot.
 // It also provides utilities for accessing and utilizing that info.
 //
+// The written byte values are kept in page-sized blocks that are shared
+// copy-on-write between the results of Copy(), so copying a state costs
+// a pointer per page and comparing states skips the shared pages.
+//
 // This class is thread-compatible.
 class MemoryState : private SnapshotTypeNames {
  public:
@@ -97,6 +104,7 @@ class MemoryState : private SnapshotTypeNames {
   MemoryState& operator=(MemoryState&&) = default;
 
   // Returns a copy of *this - for when we actually need to copy.
+  // The byte values are not copied until either state writes to them.
   MemoryState Copy() const;
 
   bool operator==(const MemoryState& y) const;
@@ -154,14 +162,8 @@ class MemoryState : private SnapshotTypeNames {
   }
 
   // Remove any existing record of previous SetMemoryBytes() for the
-  // [start_address, limit_address) range.
-  // This is necessary to do for performance reasons before updating
-  // previously-known MemoryBytes via a long sequence of SetMemoryBytes()
-  // chunks. Without such pre-removal the iterative overwriting results in
-  // a bad n^2 performace as the ByteData blob for the overall range gets
-  // repeatedly split-up into three parts, middle chunk overwrittend, and
-  // then the three parts merged back. Whereas with the pre-removal the added
-  // chunks are appended to a growing ByteData blob.
+  // [start_address, limit_address) range, i.e. removes the range from
+  // written_memory().
   void ForgetMemoryBytes(Address start_address, Address limit_address);
 
   // SetMemoryBytes() for all snapshot.memory_bytes()
@@ -258,84 +260,17 @@ class MemoryState : private SnapshotTypeNames {
   MemoryBytesList DeltaMemoryBytes(const Snapshot& snapshot) const;
 
  private:
-  // Methods to define a RangeMap<> instance (see MemoryBytesMap below)
-  // that maps the Address ranges to the ByteData blobs written into those
-  // ranges.
-  //
-  // See RangeMap<> for the requirements on the "Methods" class needed by it.
-  class MemoryBytesMethods {
-   public:
-    using Key = Address;
-    using Value = ByteData;
-    using Size = int;
-
-    // Map will be in the Address order.
-    static int Compare(const Key& x, const Key& y) {
-      // Key=Address is unsigned, so simply x-y does not work:
-      return x == y ? 0 : (x < y ? -1 : 1);
-    }
-
-    // We don't use this, but it needs to be defined, so we define it to count
-    // reasonably accurate byte usage in the RangeMap<>.
-    static Size Usage(
-        const std::pair<const std::pair<Key, Key>, Value>* range) {
-      return sizeof(*range) + range->second.size();
-    }
-
-    // Slices ByteData `v` in the [start, limit) range for the [s,l) subrange.
-    static Value Slice(const Key& start, const Key& limit, const Value& v,
-                       const Key& s, const Key& l) {
-      // Sanity checks on RangeMap<>:
-      DCHECK_LE(start, s);
-      DCHECK_LT(s, l);
-      DCHECK_LE(l, limit);
-      // Support empty ByteData as the special removal value, that is
-      // idempotent wrt extraction:
-      if (v.empty()) return v;
-      // Otherwise we slice the ByteData blob:
-      DCHECK_EQ(v.size(), limit - start);  // sanity check on RangeMap<>
-      return v.substr(s - start, l - s);
-    }
-
-    // It's a plain overwrite.
-    template <typename ValueT>
-    static bool AddTo(Value* dest, ValueT&& v, bool* empty) {
-      bool change = *dest != v;
-      if (change) *dest = std::forward<ValueT>(v);
-      return change;
-    }
-
-    // We only support blind removal with empty ByteData as the special
-    // removal value.
-    static bool RemoveFrom(Value* dest, const Value& v, bool* empty) {
-      DCHECK(v.empty());
-      *empty = true;
-      return true;
-    }
-
-    // RangeMap<> only asks this for adjacent ranges ...
-    static bool CanMerge(const Value& v1, const Value& v2) { return true; }
-
-    // ... where we can always concatenate the ByteData.
-    template <typename ValueT>
-    static void Merge(Value* dest, ValueT&& v) {
-      dest->append(std::forward<ValueT>(v));
-    }
-
-    // We only support intersection for the map with empty ByteData v2 that
-    // gets ignored. This way intersection only operates on the address ranges,
-    // while values from the first intersection arg get processed through
-    // Slice() and ignored for the second intersection arg.
-    static void MakeIntersection(Value* dest, const Value& v1, const Value& v2,
-                                 bool* empty) {
-      DCHECK(v2.empty() && !v1.empty());
-      *dest = v1;
-    }
-  };
+  // A block of the copy-on-write byte store, see written_pages_.
+  using BytesPage = std::array<char, kPageSize>;
+
+  // Returns the page at `page_address` for writing. Creates a zeroed page
+  // if there is none and makes a private copy if the page is shared.
+  BytesPage& MutablePage(Address page_address);
 
-  using MemoryBytesMap =
-      RangeMap<MemoryBytesMethods::Key, MemoryBytesMethods::Value,
-               MemoryBytesMethods>;
+  // Zeroes the bytes in [start_address, limit_address) and drops pages left
+  // without written bytes. Must be called after removing the range from
+  // written_memory_set_.
+  void ClearBytes(Address start_address, Address limit_address);
 
   // Helper for DeltaMemoryBytes(): see .cc for the spec.
   // Declared here only to get short type names for MemoryBytes and such.
@@ -350,9 +285,11 @@ class MemoryState : private SnapshotTypeNames {
   // Present only to support the written_memory() accessor.
   MemoryBytesSet written_memory_set_;
 
-  // The memory bytes in the set of known (written) memory.
-  // Same set of address ranges as written_memory_set_.
-  MemoryBytesMap written_memory_bytes_;
+  // The memory bytes in the set of known (written) memory, by page address.
+  // Bytes not in written_memory_set_ are 0 and there are no pages without
+  // written bytes, so equal states have equal pages. A page may be shared
+  // with other MemoryState instances, see MutablePage().
+  absl::btree_map<Address, std::shared_ptr<BytesPage>> written_pages_;
 };
 
 // EnumStr() works for MemoryState::MemoryMappingCmd::Action.
@@ -14,6 +14,7 @@
 
 #include "./common/memory_state.h"
 
+#include <cstddef>
 #include <string>
 
 #include "benchmark/benchmark.h"
@@ -23,6 +24,7 @@
 namespace silifuzz {
 namespace {
 
+using MemoryBytes = SnapshotTypeNames::MemoryBytes;
 using MemoryBytesList = SnapshotTypeNames::MemoryBytesList;
 
 MemoryBytesList MakeSequence(int step, int width, int n) {
@@ -58,5 +60,23 @@ BENCHMARK(BM_SetMemoryBytes<MakeDisjoint>);
 BENCHMARK(BM_SetMemoryBytes<MakeOverlapping>);
 BENCHMARK(BM_SetMemoryBytes<MakeReplacing>);
 
+// Copies a state with 256 pages of bytes, writes a few bytes to the copy and
+// compares it to the original.
+void BM_CopyWriteCompare(benchmark::State& state) {
+  constexpr size_t kNumBytes = 256 * 4096;
+  MemoryState memory_state;
+  memory_state.SetMemoryMappingEmptyPermsOk(
+      MemoryMapping::MakeSized(0, kNumBytes, MemoryPerms::None()));
+  memory_state.SetMemoryBytes(MemoryBytes(0, std::string(kNumBytes, ' ')));
+  const MemoryBytes update(kNumBytes / 2, std::string(8, 'x'));
+  for (const auto _ : state) {
+    MemoryState copy = memory_state.Copy();
+    copy.SetMemoryBytes(update);
+    benchmark::DoNotOptimize(copy.MemoryBytesEq(memory_state));
+  }
+}
+
+BENCHMARK(BM_CopyWriteCompare);
+
 }  // namespace
 }  // namespace silifuzz
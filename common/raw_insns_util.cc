@@ -19,6 +19,7 @@
 #include <cstdint>
 #include <cstring>
 #include <string>
+#include <utility>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
@@ -33,6 +34,7 @@
 #include "./util/arch.h"
 #include "./util/arch_mem.h"
 #include "./util/checks.h"
+#include "./util/ucontext/serialize.h"
 #include "./util/ucontext/ucontext_types.h"
 
 namespace silifuzz {
@@ -69,15 +71,11 @@ uint64_t InstructionsToCodeAddress(const absl::string_view& code,
 }  // namespace
 
 template <>
-absl::StatusOr<Snapshot> InstructionsToSnapshot<X86_64>(
-    absl::string_view code, const FuzzingConfig<X86_64>& config) {
-  if (!StaticInstructionFilter<X86_64>(code)) {
-    return absl::InvalidArgumentError(
-        "code snippet contains problematic instructions.");
-  }
-
-  Snapshot snapshot(Snapshot::Architecture::kX86_64);
-  const uint64_t page_size = snapshot.page_size();
+InstructionsSnapshotTemplate<X86_64>::InstructionsSnapshotTemplate(
+    const FuzzingConfig<X86_64>& config)
+    : config_(config) {
+  const uint64_t page_size =
+      Snapshot(Snapshot::Architecture::kX86_64).page_size();
 
   // All must be page-aligned.
   CHECK_EQ(config.data1_range.start_address % page_size, 0);
@@ -85,38 +83,12 @@ absl::StatusOr<Snapshot> InstructionsToSnapshot<X86_64>(
   CHECK_EQ(config.data2_range.start_address % page_size, 0);
   CHECK_EQ(config.data2_range.num_bytes % page_size, 0);
 
-  // Leave this many bytes at the end of the code page for the exit sequence.
-  constexpr auto kPaddingSizeBytes = 32;
-  if (code.size() > snapshot.page_size() - kPaddingSizeBytes) {
-    return absl::InvalidArgumentError(
-        "code snippet + the exit sequence must fit into a single page.");
-  }
-
-  const uint64_t code_start_addr =
-      InstructionsToCodeAddress(code, config.code_range.start_address,
-                                config.code_range.num_bytes, page_size);
-
-  if (code_start_addr == kSnapExitAddress) {
-    return absl::InvalidArgumentError(
-        "derived code address collides with exit sequence address.");
-  }
-
-  auto code_page_mapping = Snapshot::MemoryMapping::MakeSized(
-      code_start_addr, page_size, MemoryPerms::XR());
-  snapshot.add_memory_mapping(code_page_mapping);
-  std::string code_with_traps = std::string(code);
-  // Fill the codepage with traps. This is to help the generated snapshot exit
-  // ASAP in case if we happen to "fixup" an invalid instruction to a valid one
-  // by adding an endpoint trap.
-  PadToSizeWithTraps<X86_64>(code_with_traps, page_size);
-  snapshot.add_memory_bytes(
-      Snapshot::MemoryBytes(code_start_addr, code_with_traps));
-
   MemoryMapping data_page_mapping = Snapshot::MemoryMapping::MakeSized(
       config.data1_range.start_address, page_size, MemoryPerms::RW());
-  snapshot.add_memory_mapping(data_page_mapping);
+  data_mappings_.push_back(data_page_mapping);
 
-  UContext<X86_64> current = {};
+  UContext<X86_64>& current = registers_;
+  current = {};
 
   // These are the values of %cs and %ss kernel sets for userspace programs.
   // RestoreUContext does not modify the two but the runner still verifies
@@ -132,7 +104,6 @@ absl::StatusOr<Snapshot> InstructionsToSnapshot<X86_64>(
 
   // RSP points to the bottom of the writable page.
   current.gregs.rsp = data_page_mapping.limit_address();
-  current.gregs.rip = code_page_mapping.start_address();
 
   memset(&current.fpregs, 0, sizeof(current.fpregs));
   // Initialize FCW and MXCSR to sensible defaults that mask as many exceptions
@@ -146,7 +117,54 @@ absl::StatusOr<Snapshot> InstructionsToSnapshot<X86_64>(
   // Area". See https://www.amd.com/system/files/TechDocs/56683-PUB-1.07.pdf
   current.fpregs.xmm[0] = 0xcafebabe;
 
-  snapshot.set_registers(ConvertRegsToSnapshot(current.gregs, current.fpregs));
+  CHECK(SerializeFPRegs(current.fpregs, &fpregs_bytes_));
+}
+
+template <>
+absl::StatusOr<Snapshot> InstructionsSnapshotTemplate<X86_64>::ToSnapshot(
+    absl::string_view code) const {
+  if (!StaticInstructionFilter<X86_64>(code)) {
+    return absl::InvalidArgumentError(
+        "code snippet contains problematic instructions.");
+  }
+
+  Snapshot snapshot(Snapshot::Architecture::kX86_64);
+  const uint64_t page_size = snapshot.page_size();
+
+  // Leave this many bytes at the end of the code page for the exit sequence.
+  constexpr auto kPaddingSizeBytes = 32;
+  if (code.size() > snapshot.page_size() - kPaddingSizeBytes) {
+    return absl::InvalidArgumentError(
+        "code snippet + the exit sequence must fit into a single page.");
+  }
+
+  const uint64_t code_start_addr =
+      InstructionsToCodeAddress(code, config_.code_range.start_address,
+                                config_.code_range.num_bytes, page_size);
+
+  if (code_start_addr == kSnapExitAddress) {
+    return absl::InvalidArgumentError(
+        "derived code address collides with exit sequence address.");
+  }
+
+  auto code_page_mapping = Snapshot::MemoryMapping::MakeSized(
+      code_start_addr, page_size, MemoryPerms::XR());
+  snapshot.add_memory_mapping(code_page_mapping);
+  std::string code_with_traps = std::string(code);
+  // Fill the codepage with traps. This is to help the generated snapshot exit
+  // ASAP in case if we happen to "fixup" an invalid instruction to a valid one
+  // by adding an endpoint trap.
+  PadToSizeWithTraps<X86_64>(code_with_traps, page_size);
+  snapshot.add_memory_bytes(
+      Snapshot::MemoryBytes(code_start_addr, std::move(code_with_traps)));
+
+  for (const MemoryMapping& mapping : data_mappings_) {
+    snapshot.add_memory_mapping(mapping);
+  }
+
+  GRegSet<X86_64> gregs = registers_.gregs;
+  gregs.rip = code_page_mapping.start_address();
+  snapshot.set_registers(SnapshotRegisters(gregs));
 
   snapshot.add_expected_end_state(Snapshot::EndState(
       Snapshot::Endpoint(code_page_mapping.start_address() + code.length())));
@@ -154,15 +172,47 @@ absl::StatusOr<Snapshot> InstructionsToSnapshot<X86_64>(
 }
 
 template <>
-absl::StatusOr<Snapshot> InstructionsToSnapshot<AArch64>(
-    absl::string_view code, const FuzzingConfig<AArch64>& config) {
+InstructionsSnapshotTemplate<AArch64>::InstructionsSnapshotTemplate(
+    const FuzzingConfig<AArch64>& config)
+    : config_(config) {
+  // Create mapping for the stack.
+  MemoryMapping stack_mapping = Snapshot::MemoryMapping::MakeSized(
+      config.stack_range.start_address, config.stack_range.num_bytes,
+      MemoryPerms::RW());
+  data_mappings_.push_back(stack_mapping);
+
+  // Note: data page mappings are not added to the snapshot here. We are
+  // currently relying on the SnapMaker discovering the minimum set of pages
+  // that are actually used.
+  // TODO(ncbray): specify the data pages here and ignore them later?
+
+  // Setup register state
+  UContext<AArch64>& uctx = registers_;
+  uctx = {};
+
+  // sp points off the end of the stack.
+  uctx.gregs.sp =
+      config.stack_range.start_address + config.stack_range.num_bytes;
+
+  // HACK seed the addresses of the memory regions in registers.
+  uctx.gregs.x[6] = config.data1_range.start_address;
+  uctx.gregs.x[7] = config.data2_range.start_address;
+
+  // Note: FPCR of zero means round towards nearest and no exceptions enabled.
+
+  CHECK(SerializeFPRegs(uctx.fpregs, &fpregs_bytes_));
+}
+
+template <>
+absl::StatusOr<Snapshot> InstructionsSnapshotTemplate<AArch64>::ToSnapshot(
+    absl::string_view code) const {
   if (code.size() % 4 != 0) {
     return absl::InvalidArgumentError(
         "code snippet size must be a multiple of 4 to contain complete aarch64 "
         "instructions.");
   }
 
-  if (!StaticInstructionFilter<AArch64>(code, config.instruction_filter)) {
+  if (!StaticInstructionFilter<AArch64>(code, config_.instruction_filter)) {
     return absl::InvalidArgumentError(
         "code snippet contains problematic instructions.");
   }
@@ -179,8 +229,8 @@ absl::StatusOr<Snapshot> InstructionsToSnapshot<AArch64>(
   }
 
   const uint64_t code_start_addr =
-      InstructionsToCodeAddress(code, config.code_range.start_address,
-                                config.code_range.num_bytes, page_size);
+      InstructionsToCodeAddress(code, config_.code_range.start_address,
+                                config_.code_range.num_bytes, page_size);
 
   if (code_start_addr == kSnapExitAddress) {
     return absl::InvalidArgumentError(
@@ -206,37 +256,17 @@ absl::StatusOr<Snapshot> InstructionsToSnapshot<AArch64>(
   std::string code_with_traps = std::string(code);
   PadToSizeWithTraps<AArch64>(code_with_traps, page_size);
   snapshot.add_memory_bytes(
-      Snapshot::MemoryBytes(code_start_addr, code_with_traps));
-
-  // Create mapping for the stack.
-  MemoryMapping stack_mapping = Snapshot::MemoryMapping::MakeSized(
-      config.stack_range.start_address, config.stack_range.num_bytes,
-      MemoryPerms::RW());
-  snapshot.add_memory_mapping(stack_mapping);
+      Snapshot::MemoryBytes(code_start_addr, std::move(code_with_traps)));
 
-  // Note: data page mappings are not added to the snapshot here. We are
-  // currently relying on the SnapMaker discovering the minimum set of pages
-  // that are actually used.
-  // TODO(ncbray): specify the data pages here and ignore them later?
-
-  // Setup register state
-  UContext<AArch64> uctx = {};
+  for (const MemoryMapping& mapping : data_mappings_) {
+    snapshot.add_memory_mapping(mapping);
+  }
 
+  GRegSet<AArch64> gregs = registers_.gregs;
   // x30 will be aliased to pc as an artifact of how we jump into the code.
-  uctx.gregs.x[30] = code_start_addr;
-  uctx.gregs.pc = code_start_addr;
-
-  // sp points off the end of the stack.
-  uctx.gregs.sp =
-      config.stack_range.start_address + config.stack_range.num_bytes;
-
-  // HACK seed the addresses of the memory regions in registers.
-  uctx.gregs.x[6] = config.data1_range.start_address;
-  uctx.gregs.x[7] = config.data2_range.start_address;
-
-  // Note: FPCR of zero means round towards nearest and no exceptions enabled.
-
-  snapshot.set_registers(ConvertRegsToSnapshot(uctx.gregs, uctx.fpregs));
+  gregs.x[30] = code_start_addr;
+  gregs.pc = code_start_addr;
+  snapshot.set_registers(SnapshotRegisters(gregs));
 
   // Code should execute off the end of the instruction sequence.
   snapshot.add_expected_end_state(
@@ -245,6 +275,25 @@ absl::StatusOr<Snapshot> InstructionsToSnapshot<AArch64>(
   return snapshot;
 }
 
+template <typename Arch>
+Snapshot::RegisterState InstructionsSnapshotTemplate<Arch>::SnapshotRegisters(
+    const GRegSet<Arch>& gregs) const {
+  Snapshot::ByteData gregs_bytes;
+  CHECK(SerializeGRegs(gregs, &gregs_bytes));
+  return Snapshot::RegisterState(std::move(gregs_bytes), fpregs_bytes_);
+}
+
+template <typename Arch>
+absl::StatusOr<Snapshot> InstructionsToSnapshot(
+    absl::string_view code, const FuzzingConfig<Arch>& config) {
+  return InstructionsSnapshotTemplate<Arch>(config).ToSnapshot(code);
+}
+
+template absl::StatusOr<Snapshot> InstructionsToSnapshot(
+    absl::string_view code, const FuzzingConfig<X86_64>& config);
+template absl::StatusOr<Snapshot> InstructionsToSnapshot(
+    absl::string_view code, const FuzzingConfig<AArch64>& config);
+
 std::string InstructionsToSnapshotId(absl::string_view code) {
   uint8_t sha1_digest[SHA_DIGEST_LENGTH];
   SHA1(reinterpret_cast<const uint8_t*>(code.data()), code.size(), sha1_digest);
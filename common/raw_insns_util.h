@@ -22,6 +22,7 @@
 #include "absl/strings/string_view.h"
 #include "./common/proxy_config.h"
 #include "./common/snapshot.h"
+#include "./util/ucontext/ucontext_types.h"
 
 namespace silifuzz {
 
@@ -43,6 +44,40 @@ absl::StatusOr<Snapshot> InstructionsToSnapshot(
     absl::string_view code,
     const FuzzingConfig<Arch>& config = DEFAULT_FUZZING_CONFIG<Arch>);
 
+// The parts of the Snapshots made by InstructionsToSnapshot() that depend
+// only on the fuzzing config, built once. Only the code page and the
+// registers pointing to it are made per code snippet, so converting many
+// snippets with the same config through one template is cheaper than calling
+// InstructionsToSnapshot() for each of them.
+//
+// This class is thread-compatible.
+template <typename Arch>
+class InstructionsSnapshotTemplate {
+ public:
+  explicit InstructionsSnapshotTemplate(
+      const FuzzingConfig<Arch>& config = DEFAULT_FUZZING_CONFIG<Arch>);
+
+  // Returns the same as InstructionsToSnapshot(code, config()).
+  absl::StatusOr<Snapshot> ToSnapshot(absl::string_view code) const;
+
+  const FuzzingConfig<Arch>& config() const { return config_; }
+
+ private:
+  // Returns `gregs` and the serialized fpregs of `registers_`.
+  Snapshot::RegisterState SnapshotRegisters(const GRegSet<Arch>& gregs) const;
+
+  FuzzingConfig<Arch> config_;
+
+  // Mappings added after the code page mapping.
+  Snapshot::MemoryMappingList data_mappings_;
+
+  // Initial registers without the ones that point to the code.
+  UContext<Arch> registers_;
+
+  // Serialized registers_.fpregs, the same for every snippet.
+  Snapshot::ByteData fpregs_bytes_;
+};
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_COMMON_RAW_INSNS_UTIL_H_
@@ -22,6 +22,7 @@
 #include "gtest/gtest.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "./proto/snapshot.pb.h"
 #include "./util/arch.h"
 #include "./util/testing/status_macros.h"
@@ -57,6 +58,20 @@ TEST(RawInsnsUtil, InstructionsToSnapshot_X86_64_Stable) {
             snapshot_3->ExtractRip(snapshot_3->registers()));
 }
 
+TEST(RawInsnsUtil, InstructionsSnapshotTemplate_X86_64) {
+  const InstructionsSnapshotTemplate<X86_64> snapshot_template;
+  // Reusing the template must not leak anything from one snippet to the next.
+  for (absl::string_view code : {"\xAA", "\xCC", "\xAA"}) {
+    ASSERT_OK_AND_ASSIGN(Snapshot snapshot, snapshot_template.ToSnapshot(code));
+    ASSERT_OK_AND_ASSIGN(Snapshot expected,
+                         InstructionsToSnapshot<X86_64>(code));
+    EXPECT_EQ(snapshot, expected);
+    EXPECT_EQ(snapshot.memory_mappings(), expected.memory_mappings());
+  }
+  EXPECT_THAT(snapshot_template.ToSnapshot(std::string(4096, '\x90')),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
 TEST(RawInsnsUtil, InstructionsToSnapshotId) {
   EXPECT_EQ(InstructionsToSnapshotId("Silifuzz"),
             "679016f223a6925ba69f055f513ea8aa0e0720ed");
@@ -92,6 +107,19 @@ TEST(RawInsnsUtil, InstructionsToSnapshot_AArch64_Stable) {
             snapshot_3->ExtractRip(snapshot_3->registers()));
 }
 
+TEST(RawInsnsUtil, InstructionsSnapshotTemplate_AArch64) {
+  const InstructionsSnapshotTemplate<AArch64> snapshot_template;
+  // nop and movk w0, #0x8600, lsl #16
+  for (const std::string& code : {std::string({0x1f, 0x20, 0x03, 0xd5}),
+                                  std::string({0x0, 0xc0, 0xb0, 0x72})}) {
+    ASSERT_OK_AND_ASSIGN(Snapshot snapshot, snapshot_template.ToSnapshot(code));
+    ASSERT_OK_AND_ASSIGN(Snapshot expected,
+                         InstructionsToSnapshot<AArch64>(code));
+    EXPECT_EQ(snapshot, expected);
+    EXPECT_EQ(snapshot.memory_mappings(), expected.memory_mappings());
+  }
+}
+
 TEST(RawInsnsUtil, InstructionsToSnapshot_AArch64_Filter) {
   // sqdecb    x11, vl8, mul #16
   std::string sve_insn({0x0b, 0xf9, 0x3f, 0x04});
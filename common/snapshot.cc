@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <string>
@@ -24,12 +25,14 @@
 
 #include "absl/algorithm/container.h"
 #include "absl/base/attributes.h"
+#include "absl/numeric/int128.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/ascii.h"
 #include "absl/strings/escaping.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "third_party/cityhash/city.h"
 #include "./common/mapped_memory_map.h"
 #include "./common/memory_perms.h"
 #include "./util/arch.h"
@@ -144,6 +147,7 @@ Snapshot::Snapshot(Architecture arch, const Id& id)
       memory_bytes_(),
       registers_(nullptr),
       expected_end_states_(),
+      end_state_index_(),
       metadata_(new Metadata()),
       trace_metadata_() {
   DCHECK_STATUS(IsValidId(id_));
@@ -168,7 +172,182 @@ bool VectorsEqualAsSet(const std::vector<T>& a, const std::vector<T>& b) {
          });
 }
 
+namespace {
+
+// Accumulates a fingerprint by hashing each added value with
+// CityHash128WithSeed() seeded with the fingerprint of the values before it.
+class FingerprintHasher {
+ public:
+  void AddBytes(absl::string_view bytes) {
+    state_ = CityHash128WithSeed(bytes.data(), bytes.size(), state_);
+  }
+
+  // Integers are hashed as little-endian bytes so that the fingerprint does
+  // not depend on the host.
+  void AddInt(uint64_t value) {
+    char bytes[sizeof(value)];
+    for (size_t i = 0; i < sizeof(value); ++i) {
+      bytes[i] = static_cast<char>(value >> (8 * i));
+    }
+    AddBytes(absl::string_view(bytes, sizeof(bytes)));
+  }
+
+  void AddFingerprint(absl::uint128 fingerprint) {
+    AddInt(absl::Uint128High64(fingerprint));
+    AddInt(absl::Uint128Low64(fingerprint));
+  }
+
+  // Adds the fingerprints of the elements of a list compared as a set, i.e.
+  // regardless of their order and duplicates, and the size of the list.
+  void AddUnordered(std::vector<absl::uint128> fingerprints) {
+    const size_t size = fingerprints.size();
+    absl::c_sort(fingerprints);
+    fingerprints.erase(std::unique(fingerprints.begin(), fingerprints.end()),
+                       fingerprints.end());
+    for (absl::uint128 fingerprint : fingerprints) {
+      AddFingerprint(fingerprint);
+    }
+    AddInt(size);
+  }
+
+  // Adds the ranges of `memory_map` followed by their number, which keeps
+  // consecutive maps apart.
+  void AddMappedMemoryMap(const MappedMemoryMap& memory_map) {
+    uint64_t num_ranges = 0;
+    memory_map.Iterate([this, &num_ranges](Snapshot::Address start,
+                                           Snapshot::Address limit,
+                                           MemoryPerms perms) {
+      AddInt(start);
+      AddInt(limit);
+      AddInt(perms.ToMProtect());
+      AddInt(perms.Has(MemoryPerms::kMapped));
+      ++num_ranges;
+    });
+    AddInt(num_ranges);
+  }
+
+  void AddMemoryBytesList(const Snapshot::MemoryBytesList& memory_bytes_list) {
+    std::vector<absl::uint128> fingerprints;
+    fingerprints.reserve(memory_bytes_list.size());
+    for (const Snapshot::MemoryBytes& memory_bytes : memory_bytes_list) {
+      FingerprintHasher hasher;
+      hasher.AddInt(memory_bytes.start_address());
+      hasher.AddBytes(memory_bytes.byte_values());
+      fingerprints.push_back(hasher.Finish());
+    }
+    AddUnordered(std::move(fingerprints));
+  }
+
+  void AddRegisterState(const Snapshot::RegisterState& registers) {
+    AddBytes(registers.gregs());
+    AddBytes(registers.fpregs());
+  }
+
+  void AddPlatforms(const std::vector<PlatformId>& platforms) {
+    for (PlatformId platform : platforms) {
+      AddInt(ToInt(platform));
+    }
+    AddInt(platforms.size());
+  }
+
+  absl::uint128 Finish() const {
+    return absl::MakeUint128(Uint128High64(state_), Uint128Low64(state_));
+  }
+
+ private:
+  // CityHash's own 128-bit type.
+  ::uint128 state_ = {0, 0};
+};
+
+// Adds everything Snapshot::EndState::DataEquals() compares.
+void AddEndStateData(const Snapshot::EndState& end_state,
+                     FingerprintHasher& hasher) {
+  const Snapshot::Endpoint& endpoint = end_state.endpoint();
+  hasher.AddInt(ToInt(endpoint.type()));
+  if (endpoint.type() == Snapshot::Endpoint::kInstruction) {
+    hasher.AddInt(endpoint.instruction_address());
+  } else {
+    hasher.AddInt(ToInt(endpoint.sig_num()));
+    hasher.AddInt(ToInt(endpoint.sig_cause()));
+    hasher.AddInt(endpoint.sig_address());
+    hasher.AddInt(endpoint.sig_instruction_address());
+  }
+  hasher.AddRegisterState(end_state.registers());
+  hasher.AddBytes(end_state.register_checksum());
+  hasher.AddMemoryBytesList(end_state.memory_bytes());
+}
+
+absl::uint128 EndStateFingerprint(const Snapshot::EndState& end_state) {
+  FingerprintHasher hasher;
+  AddEndStateData(end_state, hasher);
+  hasher.AddPlatforms(end_state.platforms());
+  return hasher.Finish();
+}
+
+// Like EndStateFingerprint() but ignores platforms like DataEquals() does.
+absl::uint128 EndStateDataFingerprint(const Snapshot::EndState& end_state) {
+  FingerprintHasher hasher;
+  AddEndStateData(end_state, hasher);
+  return hasher.Finish();
+}
+
+absl::uint128 TraceDataFingerprint(const Snapshot::TraceData& trace_data) {
+  FingerprintHasher hasher;
+  hasher.AddInt(trace_data.num_instructions());
+  hasher.AddBytes(trace_data.human_readable_disassembly());
+  hasher.AddPlatforms(trace_data.platforms());
+  return hasher.Finish();
+}
+
+}  // namespace
+
+absl::uint128 Snapshot::ComputeFingerprint() const {
+  FingerprintHasher hasher;
+  hasher.AddBytes(id_);
+  hasher.AddInt(ToInt(architecture_));
+  hasher.AddMappedMemoryMap(mapped_memory_map_);
+  hasher.AddMappedMemoryMap(negative_mapped_memory_map_);
+  hasher.AddMemoryBytesList(memory_bytes_);
+  hasher.AddInt(registers_ != nullptr);
+  if (registers_ != nullptr) {
+    hasher.AddRegisterState(*registers_);
+  }
+  std::vector<absl::uint128> fingerprints;
+  for (const EndState& end_state : expected_end_states_) {
+    fingerprints.push_back(EndStateFingerprint(end_state));
+  }
+  hasher.AddUnordered(std::move(fingerprints));
+  hasher.AddInt(metadata_ != nullptr);
+  if (metadata_ != nullptr) {
+    hasher.AddInt(ToInt(metadata_->origin()));
+    hasher.AddBytes(metadata_->origin_string());
+  }
+  fingerprints.clear();
+  for (const TraceData& trace_data : trace_metadata_) {
+    fingerprints.push_back(TraceDataFingerprint(trace_data));
+  }
+  hasher.AddUnordered(std::move(fingerprints));
+  return hasher.Finish();
+}
+
+absl::uint128 Snapshot::Fingerprint() const {
+  if (std::optional<absl::uint128> cached = fingerprint_cache_.Get();
+      cached.has_value()) {
+    return *cached;
+  }
+  const absl::uint128 fingerprint = ComputeFingerprint();
+  fingerprint_cache_.Set(fingerprint);
+  return fingerprint;
+}
+
 bool Snapshot::operator==(const Snapshot& y) const {
+  const std::optional<absl::uint128> fingerprint = fingerprint_cache_.Get();
+  const std::optional<absl::uint128> y_fingerprint =
+      y.fingerprint_cache_.Get();
+  if (fingerprint.has_value() && y_fingerprint.has_value() &&
+      *fingerprint != *y_fingerprint) {
+    return false;
+  }
   bool expected_end_states_eq =
       VectorsEqualAsSet(expected_end_states_, y.expected_end_states_);
   bool metadata_eq = (metadata_ == nullptr && y.metadata_ == nullptr) ||
@@ -206,6 +385,7 @@ Snapshot Snapshot::Copy() const {
     r.registers_.reset(new RegisterState(*registers_));
   }
   r.expected_end_states_ = expected_end_states_;
+  r.end_state_index_ = end_state_index_;
   r.metadata_.reset(new Metadata(*metadata_));
   r.trace_metadata_ = trace_metadata_;
   return r;
@@ -315,6 +495,7 @@ absl::Status Snapshot::can_add_memory_mapping(const MemoryMapping& x) const {
 }
 
 void Snapshot::add_memory_mapping(const MemoryMapping& x) {
+  fingerprint_cache_.Invalidate();
   DCHECK_STATUS(can_add_memory_mapping(x));
   mapped_memory_map_.AddNew(x.start_address(), x.limit_address(), x.perms());
   memory_mappings_.push_back(x);
@@ -322,6 +503,7 @@ void Snapshot::add_memory_mapping(const MemoryMapping& x) {
 
 void Snapshot::set_memory_mapping_perms(const MemoryMapping& x,
                                         int memory_mappings_index) {
+  fingerprint_cache_.Invalidate();
   DCHECK(!x.perms().IsEmpty());
   DCHECK(0 <= memory_mappings_index &&
          memory_mappings_index < memory_mappings_.size());
@@ -361,6 +543,7 @@ absl::Status Snapshot::can_set_memory_mappings(
 }
 
 void Snapshot::set_memory_mappings(const MemoryMappingList& x) {
+  fingerprint_cache_.Invalidate();
   DCHECK_STATUS(can_set_memory_mappings(x));
   mapped_memory_map_.Clear();
   for (const auto& m : x) {
@@ -409,6 +592,7 @@ absl::Status Snapshot::can_add_negative_memory_mapping(const MemoryMapping& x,
 }
 
 void Snapshot::add_negative_memory_mapping(const MemoryMapping& x) {
+  fingerprint_cache_.Invalidate();
   DCHECK_STATUS(can_add_negative_memory_mapping(x));
   negative_mapped_memory_map_.AddNew(x.start_address(), x.limit_address(),
                                      x.perms());
@@ -416,6 +600,7 @@ void Snapshot::add_negative_memory_mapping(const MemoryMapping& x) {
 }
 
 void Snapshot::add_negative_memory_mapping_overlap_ok(const MemoryMapping& x) {
+  fingerprint_cache_.Invalidate();
   DCHECK_STATUS(can_add_negative_memory_mapping(x, true));
   if (negative_mapped_memory_map_.Overlaps(x.start_address(),
                                            x.limit_address())) {
@@ -432,10 +617,22 @@ void Snapshot::add_negative_memory_mapping_overlap_ok(const MemoryMapping& x) {
     negative_mapped_memory_map_.AddNew(x.start_address(), x.limit_address(),
                                        x.perms());
     negative_memory_mappings_.push_back(x);
+    // `x` was merged with adjacent mappings of the same permissions, e.g.
+    // for end states faulting on neighboring pages.
+    if (negative_mapped_memory_map_.size() < negative_memory_mappings_.size()) {
+      CompactNegativeMemoryMappings();
+    }
   }
 }
 
+void Snapshot::CompactNegativeMemoryMappings() {
+  fingerprint_cache_.Invalidate();
+  negative_memory_mappings_ =
+      SortedMemoryMappingList(negative_mapped_memory_map_);
+}
+
 void Snapshot::set_negative_memory_mappings(const MemoryMappingList& xs) {
+  fingerprint_cache_.Invalidate();
   negative_mapped_memory_map_.Clear();
   negative_memory_mappings_.clear();
   for (auto& x : xs) {
@@ -522,12 +719,14 @@ void Snapshot::add_memory_bytes(const MemoryBytes& x) {
 }
 
 void Snapshot::add_memory_bytes(MemoryBytes&& x) {
+  fingerprint_cache_.Invalidate();
   DCHECK_STATUS(can_add_memory_bytes(x));
   written_memory_set_.Add(x.start_address(), x.limit_address());
   memory_bytes_.emplace_back(std::move(x));
 }
 
 absl::Status Snapshot::ReplaceMemoryBytes(MemoryBytesList&& xs) {
+  fingerprint_cache_.Invalidate();
   written_memory_set_.clear();
   memory_bytes_.clear();
   for (auto&& x : xs) {
@@ -548,6 +747,7 @@ bool Snapshot::MappedMemoryIsDefined() const {
 bool Snapshot::has_registers() const { return registers_ != nullptr; }
 
 void Snapshot::set_id(const Id& id) {
+  fingerprint_cache_.Invalidate();
   DCHECK_STATUS(IsValidId(id));
   id_ = id;
 }
@@ -615,6 +815,7 @@ bool Snapshot::registers_match_arch(const Snapshot::RegisterState& x) const {
 }
 
 void Snapshot::set_registers(const RegisterState& x) {
+  fingerprint_cache_.Invalidate();
   // registers_match_arch should always be true if can_set_registers is true,
   // but it's lighter weight so we can run it all the time.
   CHECK(registers_match_arch(x));
@@ -713,28 +914,45 @@ absl::Status Snapshot::can_add_expected_end_state(const EndState& x,
     return absl::InvalidArgumentError("Bad register checksum");
   }
   if (!duplicate_ok) {
-    for (int i = 0; i < expected_end_states_.size(); ++i) {
-      if (x.DataEquals(expected_end_states_[i])) {
-        return absl::InvalidArgumentError(
-            absl::StrCat("Is a dup of ", i, "-th existing EndState"));
-      }
+    if (int i = FindExpectedEndState(x); i != -1) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Is a dup of ", i, "-th existing EndState"));
     }
   }
   return absl::OkStatus();
 }
 
+int Snapshot::FindExpectedEndState(const EndState& x) const {
+  auto it = end_state_index_.find(EndStateDataFingerprint(x));
+  if (it == end_state_index_.end()) return -1;
+  if (x.DataEquals(expected_end_states_[it->second])) return it->second;
+  // A fingerprint collision. Fall back to comparing everything.
+  for (int i = 0; i < expected_end_states_.size(); ++i) {
+    if (x.DataEquals(expected_end_states_[i])) return i;
+  }
+  return -1;
+}
+
 void Snapshot::add_expected_end_state(const EndState& x,
                                       bool unmapped_endpoint_ok) {
+  add_expected_end_state(EndState(x), unmapped_endpoint_ok);
+}
+
+void Snapshot::add_expected_end_state(EndState&& x, bool unmapped_endpoint_ok) {
+  fingerprint_cache_.Invalidate();
   DCHECK_STATUS(can_add_expected_end_state(x, unmapped_endpoint_ok));
-  EndState copy(x);
-  expected_end_states_.emplace_back(std::move(copy));
+  end_state_index_.try_emplace(EndStateDataFingerprint(x),
+                               expected_end_states_.size());
+  expected_end_states_.emplace_back(std::move(x));
 }
 
 void Snapshot::add_platform_to_expected_end_state(int i, PlatformId platform) {
+  fingerprint_cache_.Invalidate();
   expected_end_states_[i].add_platform(platform);
 }
 
 void Snapshot::add_platforms_to_expected_end_state(int i, const EndState& x) {
+  fingerprint_cache_.Invalidate();
   auto& s = expected_end_states_[i];
   DCHECK(s.DataEquals(x));
   for (int p = 0; p < s.platforms_.size(); ++p) {
@@ -743,17 +961,21 @@ void Snapshot::add_platforms_to_expected_end_state(int i, const EndState& x) {
 }
 
 void Snapshot::set_expected_end_states(const EndStateList& xs) {
+  fingerprint_cache_.Invalidate();
   expected_end_states_.clear();
+  end_state_index_.clear();
   for (auto& x : xs) {
     add_expected_end_state(x);
   }
 }
 
 void Snapshot::remove_expected_end_state(const EndState* x) {
+  fingerprint_cache_.Invalidate();
   for (auto it = expected_end_states_.begin(); it != expected_end_states_.end();
        ++it) {
     if (&(*it) == x) {
       expected_end_states_.erase(it);
+      RebuildEndStateIndex();
       return;
     }
   }
@@ -774,16 +996,26 @@ Snapshot::MemoryMappingList Snapshot::SortedMemoryMappingList(
 }
 
 void Snapshot::NormalizeMemoryMappings() {
+  fingerprint_cache_.Invalidate();
   memory_mappings_ = SortedMemoryMappingList(mapped_memory_map_);
-  negative_memory_mappings_ =
-      SortedMemoryMappingList(negative_mapped_memory_map_);
+  CompactNegativeMemoryMappings();
 }
 
 void Snapshot::NormalizeMemoryBytes() {
+  fingerprint_cache_.Invalidate();
   NormalizeMemoryBytes(mapped_memory_map_, &memory_bytes_);
   for (auto& es : expected_end_states_) {
     NormalizeMemoryBytes(mapped_memory_map_, &es.memory_bytes_);
   }
+  RebuildEndStateIndex();
+}
+
+void Snapshot::RebuildEndStateIndex() {
+  end_state_index_.clear();
+  for (int i = 0; i < expected_end_states_.size(); ++i) {
+    end_state_index_.try_emplace(
+        EndStateDataFingerprint(expected_end_states_[i]), i);
+  }
 }
 
 // static
@@ -858,6 +1090,7 @@ void Snapshot::NormalizeAll() {
 }
 
 bool Snapshot::TryRemoveUndefinedEndStates() {
+  fingerprint_cache_.Invalidate();
   auto& states = expected_end_states_;
   auto before_size = states.size();
   if (std::find_if(states.begin(), states.end(), [](const EndState& x) {
@@ -869,6 +1102,7 @@ bool Snapshot::TryRemoveUndefinedEndStates() {
                          return x.IsComplete(Snapshot::kUndefinedEndState).ok();
                        }),
         states.end());
+    RebuildEndStateIndex();
   }
   return before_size != states.size();
 }
@@ -1015,6 +1249,9 @@ Snapshot::RegisterState::RegisterState(const ByteData& gregs,
                                        const ByteData& fpregs)
     : gregs_(gregs), fpregs_(fpregs) {}
 
+Snapshot::RegisterState::RegisterState(ByteData&& gregs, ByteData&& fpregs)
+    : gregs_(std::move(gregs)), fpregs_(std::move(fpregs)) {}
+
 bool Snapshot::RegisterState::operator==(const RegisterState& y) const {
   return gregs_ == y.gregs_ && fpregs_ == y.fpregs_;
 }
@@ -1153,12 +1390,14 @@ const Snapshot::Metadata& Snapshot::metadata() const {
 }
 
 void Snapshot::set_metadata(const Metadata& metadata) {
+  fingerprint_cache_.Invalidate();
   metadata_.reset(new Metadata(metadata));
 }
 
 // ========================================================================= //
 
 void Snapshot::set_trace_data(const std::vector<TraceData>& trace_data) {
+  fingerprint_cache_.Invalidate();
   trace_metadata_ = trace_data;
 }
 
@@ -26,11 +26,15 @@
 
 #include <stdint.h>
 
+#include <atomic>
 #include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include "absl/base/attributes.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/numeric/int128.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
@@ -143,9 +147,22 @@ class Snapshot final {
   // Returns a copy of *this - for when we actually need to copy.
   Snapshot Copy() const;
 
+  // If both fingerprints are already cached, snapshots with different
+  // fingerprints compare unequal without looking at their contents.
   bool operator==(const Snapshot& y) const;
   bool operator!=(const Snapshot& y) const { return !(*this == y); }
 
+  // Returns a 128-bit fingerprint of everything operator== compares. Equal
+  // snapshots have equal fingerprints and different snapshots have different
+  // ones with overwhelming probability, so deduplication can key hash sets
+  // with fingerprints instead of comparing snapshots pairwise. The value does
+  // not depend on the order of memory_bytes(), expected_end_states() or
+  // trace_data() and is the same in every process on every host.
+  //
+  // The fingerprint is computed on the first call and cached until *this is
+  // modified. Concurrent calls on a const Snapshot are safe.
+  absl::uint128 Fingerprint() const;
+
   // Equality that disregards expected_end_states() and
   // negative_memory_mappings() (derived from expected_end_states()).
   // NOTE: both *this and y should be normalized according to NormalizeAll()
@@ -257,6 +274,14 @@ class Snapshot final {
   absl::Status AddNegativeMemoryMappingsFor(const EndState& x)
       ABSL_MUST_USE_RESULT;
 
+  // Replaces negative_memory_mappings() with the minimal list of mappings
+  // that covers the same addresses with the same permissions, ordered by
+  // address. AddNegativeMemoryMappingsFor() keeps the list compact already,
+  // but add_negative_memory_mapping() and set_negative_memory_mappings()
+  // keep the mappings they are given. SnapshotProto::ToProto() always
+  // serializes the compacted list.
+  void CompactNegativeMemoryMappings();
+
   // All the memory state that exists at the start of the snapshot.
   // Guaranteed to be disjoint and inside memory_mappings().
   // IMPORTANT: See comments on proto.Snapshot.memory_bytes for a non-trivial
@@ -332,6 +357,12 @@ class Snapshot final {
   // PROVIDES: x is *expected_end_states().back()
   void add_expected_end_state(const EndState& x,
                               bool unmapped_endpoint_ok = false);
+  void add_expected_end_state(EndState&& x, bool unmapped_endpoint_ok = false);
+
+  // Returns the index of the first of expected_end_states() that DataEquals()
+  // `x`, or -1 if there is none. Takes one hash lookup and, typically, one
+  // comparison regardless of the number of expected_end_states().
+  int FindExpectedEndState(const EndState& x) const;
 
   // Does add_platform(platform) on expected_end_states()[i].
   // REQUIRES: i must be in-range
@@ -469,6 +500,47 @@ class Snapshot final {
   // Check that the RegisterState matches the architecture of the Snapshot.
   bool registers_match_arch(const Snapshot::RegisterState& x) const;
 
+  // Rebuilds end_state_index_ from scratch. Must be called by every method
+  // that removes expected_end_states() or changes their data other than by
+  // appending.
+  void RebuildEndStateIndex();
+
+  // Computes Fingerprint() without the cache.
+  absl::uint128 ComputeFingerprint() const;
+
+  // Cached value of Fingerprint(). Copies and moves start out empty, so that
+  // Snapshot keeps its default copy and move operations. Concurrent Set()
+  // calls store the same value, which makes them benign.
+  class FingerprintCache {
+   public:
+    FingerprintCache() = default;
+    FingerprintCache(const FingerprintCache&) {}
+    FingerprintCache& operator=(const FingerprintCache&) {
+      Invalidate();
+      return *this;
+    }
+
+    std::optional<absl::uint128> Get() const {
+      if (!valid_.load(std::memory_order_acquire)) return std::nullopt;
+      return absl::MakeUint128(high_.load(std::memory_order_relaxed),
+                               low_.load(std::memory_order_relaxed));
+    }
+
+    void Set(absl::uint128 fingerprint) const {
+      high_.store(absl::Uint128High64(fingerprint), std::memory_order_relaxed);
+      low_.store(absl::Uint128Low64(fingerprint), std::memory_order_relaxed);
+      valid_.store(true, std::memory_order_release);
+    }
+
+    // Must be called by every method that modifies the Snapshot.
+    void Invalidate() { valid_.store(false, std::memory_order_relaxed); }
+
+   private:
+    mutable std::atomic<bool> valid_ = false;
+    mutable std::atomic<uint64_t> high_ = 0;
+    mutable std::atomic<uint64_t> low_ = 0;
+  };
+
   // ----------------------------------------------------------------------- //
 
   // See id().
@@ -504,11 +576,19 @@ class Snapshot final {
   // See expected_end_states().
   std::vector<EndState> expected_end_states_;
 
+  // Index of expected_end_states_ by a fingerprint of the data DataEquals()
+  // compares. Maps to the position of the first end state with that
+  // fingerprint. See FindExpectedEndState().
+  absl::flat_hash_map<absl::uint128, int> end_state_index_;
+
   // See metadata().
   std::unique_ptr<Metadata> metadata_;
 
   // See trace_metadata().
   std::vector<TraceData> trace_metadata_;
+
+  // See Fingerprint().
+  FingerprintCache fingerprint_cache_;
 };
 
 // ========================================================================= //
@@ -650,6 +730,7 @@ class Snapshot::RegisterState final {
   // See ./snapshot_util.h on how to convert between RegisterState and
   // the usual GRegSet plus FPRegSet in Snapshot::CurrentArchitecture().
   RegisterState(const ByteData& gregs, const ByteData& fpregs);
+  RegisterState(ByteData&& gregs, ByteData&& fpregs);
 
   // Intentionally movable and copyable.
 
@@ -0,0 +1,209 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./common/snapshot_container.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "./common/snapshot.h"
+#include "./common/snapshot_proto.h"
+#include "./proto/snapshot.pb.h"
+#include "./util/checks.h"
+#include "./util/mmapped_memory_ptr.h"
+#include "./util/owned_file_descriptor.h"
+
+namespace silifuzz {
+
+SnapshotContainerWriter::~SnapshotContainerWriter() {
+  if (fd_ != -1) close(fd_);
+}
+
+absl::Status SnapshotContainerWriter::Open(absl::string_view filename) {
+  if (fd_ != -1) {
+    return absl::FailedPreconditionError("Container is already open");
+  }
+  fd_ = open(std::string(filename).c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+             0644);
+  if (fd_ == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", filename, ")"));
+  }
+  file_size_ = 0;
+  record_offsets_.clear();
+  // Placeholder, Finish() writes the real header.
+  SnapshotContainerHeader header = {};
+  return Write(absl::string_view(reinterpret_cast<const char*>(&header),
+                                 sizeof(header)));
+}
+
+absl::Status SnapshotContainerWriter::Add(const Snapshot& snapshot) {
+  proto::Snapshot proto;
+  SnapshotProto::ToProto(snapshot, &proto);
+  std::string serialized;
+  if (!proto.SerializeToString(&serialized)) {
+    return absl::InternalError("Cannot serialize Snapshot");
+  }
+  return AddSerialized(serialized);
+}
+
+absl::Status SnapshotContainerWriter::AddSerialized(
+    absl::string_view serialized_snapshot) {
+  if (fd_ == -1) return absl::FailedPreconditionError("Container is not open");
+  record_offsets_.push_back(file_size_);
+  // All supported architectures are little-endian.
+  const uint64_t size = serialized_snapshot.size();
+  RETURN_IF_NOT_OK(Write(
+      absl::string_view(reinterpret_cast<const char*>(&size), sizeof(size))));
+  return Write(serialized_snapshot);
+}
+
+absl::Status SnapshotContainerWriter::Finish() {
+  if (fd_ == -1) return absl::FailedPreconditionError("Container is not open");
+  const std::string padding((sizeof(uint64_t) - file_size_ % sizeof(uint64_t)) %
+                                sizeof(uint64_t),
+                            '\0');
+  RETURN_IF_NOT_OK(Write(padding));
+  const SnapshotContainerHeader header = {
+      .magic = kSnapshotContainerMagic,
+      .num_records = record_offsets_.size(),
+      .index_offset = file_size_,
+  };
+  RETURN_IF_NOT_OK(Write(absl::string_view(
+      reinterpret_cast<const char*>(record_offsets_.data()),
+      record_offsets_.size() * sizeof(record_offsets_[0]))));
+  if (pwrite(fd_, &header, sizeof(header), 0) != sizeof(header)) {
+    return absl::ErrnoToStatus(errno, "Cannot write container header");
+  }
+  const int fd = fd_;
+  fd_ = -1;
+  if (close(fd) != 0) {
+    return absl::ErrnoToStatus(errno, "Cannot close container");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status SnapshotContainerWriter::Write(absl::string_view data) {
+  while (!data.empty()) {
+    const ssize_t bytes_written = write(fd_, data.data(), data.size());
+    if (bytes_written == -1) {
+      if (errno == EINTR) continue;
+      return absl::ErrnoToStatus(errno, "Cannot write container");
+    }
+    data.remove_prefix(bytes_written);
+    file_size_ += bytes_written;
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<SnapshotContainerReader> SnapshotContainerReader::Open(
+    absl::string_view filename) {
+  OwnedFileDescriptor fd(open(std::string(filename).c_str(), O_RDONLY));
+  if (fd.borrow() == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", filename, ")"));
+  }
+  const off_t file_size = lseek(fd.borrow(), 0, SEEK_END);
+  if (file_size == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("lseek(", filename, ")"));
+  }
+  if (static_cast<uint64_t>(file_size) < sizeof(SnapshotContainerHeader)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat(filename, " is too small for a snapshot container"));
+  }
+  void* ptr =
+      mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd.borrow(), 0);
+  if (ptr == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("mmap(", filename, ")"));
+  }
+  MmappedMemoryPtr<const char> mapping =
+      MakeMmappedMemoryPtr<const char>(static_cast<const char*>(ptr),
+                                       file_size);
+
+  // Validate everything once here so that Get() cannot read out of bounds.
+  // Offsets are compared with subtraction to avoid overflow.
+  SnapshotContainerHeader header;
+  memcpy(&header, mapping.get(), sizeof(header));
+  auto corrupt = [&filename](absl::string_view what) {
+    return absl::InvalidArgumentError(
+        absl::StrCat(filename, ": corrupt snapshot container: ", what));
+  };
+  if (header.magic != kSnapshotContainerMagic) return corrupt("bad magic");
+  const uint64_t size = file_size;
+  if (header.index_offset < sizeof(header) || header.index_offset > size ||
+      header.index_offset % sizeof(uint64_t) != 0 ||
+      header.num_records != (size - header.index_offset) / sizeof(uint64_t) ||
+      (size - header.index_offset) % sizeof(uint64_t) != 0) {
+    return corrupt("bad index");
+  }
+  const uint64_t* index =
+      reinterpret_cast<const uint64_t*>(mapping.get() + header.index_offset);
+  for (uint64_t i = 0; i < header.num_records; ++i) {
+    const uint64_t offset = index[i];
+    if (offset < sizeof(header) || offset > header.index_offset ||
+        header.index_offset - offset < sizeof(uint64_t)) {
+      return corrupt(absl::StrCat("bad offset of record ", i));
+    }
+    uint64_t record_size;
+    memcpy(&record_size, mapping.get() + offset, sizeof(record_size));
+    if (record_size > header.index_offset - offset - sizeof(uint64_t) ||
+        record_size > std::numeric_limits<int>::max()) {
+      return corrupt(absl::StrCat("bad size of record ", i));
+    }
+  }
+  return SnapshotContainerReader(std::move(mapping), header.num_records,
+                                 index);
+}
+
+bool SnapshotContainerReader::IsSnapshotContainer(absl::string_view filename) {
+  OwnedFileDescriptor fd(open(std::string(filename).c_str(), O_RDONLY));
+  if (fd.borrow() == -1) return false;
+  uint64_t magic;
+  return pread(fd.borrow(), &magic, sizeof(magic), 0) == sizeof(magic) &&
+         magic == kSnapshotContainerMagic;
+}
+
+absl::string_view SnapshotContainerReader::GetSerialized(size_t i) const {
+  CHECK_LT(i, num_records_);
+  const char* record = mapping_.get() + index_[i];
+  uint64_t size;
+  memcpy(&size, record, sizeof(size));
+  return absl::string_view(record + sizeof(size), size);
+}
+
+absl::StatusOr<Snapshot> SnapshotContainerReader::Get(size_t i) const {
+  absl::string_view serialized = GetSerialized(i);
+  proto::Snapshot proto;
+  if (!proto.ParseFromArray(serialized.data(), serialized.size())) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Cannot parse record ", i, " as proto.Snapshot"));
+  }
+  auto snapshot_or = SnapshotProto::FromProto(std::move(proto));
+  RETURN_IF_NOT_OK_PLUS(snapshot_or.status(),
+                        "Could not parse Snapshot from proto: ");
+  return snapshot_or;
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,144 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_COMMON_SNAPSHOT_CONTAINER_H_
+#define THIRD_PARTY_SILIFUZZ_COMMON_SNAPSHOT_CONTAINER_H_
+
+// A snapshot container is a single file holding many binary proto.Snapshot
+// records. Reading millions of Snapshots from one container avoids the
+// per-file open/read syscalls and buffer copies of ReadSnapshotFromFile().
+//
+// Layout, all integers are 64-bit little-endian:
+//
+//   header:  magic, number of records, file offset of the index
+//   records: for each record, its size followed by the serialized proto
+//   padding: zero bytes up to the next multiple of 8
+//   index:   for each record, the file offset of its size field
+//
+// The index comes last so that records can be streamed out before their
+// number is known.
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "./common/snapshot.h"
+#include "./util/mmapped_memory_ptr.h"
+
+namespace silifuzz {
+
+// "SFSNPCT1" when read as a little-endian uint64_t.
+inline constexpr uint64_t kSnapshotContainerMagic = 0x315443504e534653ULL;
+
+struct SnapshotContainerHeader {
+  uint64_t magic;
+  uint64_t num_records;
+  uint64_t index_offset;
+};
+
+// Writes a snapshot container. Usage:
+//
+//   SnapshotContainerWriter writer;
+//   RETURN_IF_NOT_OK(writer.Open(filename));
+//   for (...) RETURN_IF_NOT_OK(writer.Add(snapshot));
+//   RETURN_IF_NOT_OK(writer.Finish());
+//
+// The file is not a valid container until Finish() succeeds.
+// This class is not thread-safe.
+class SnapshotContainerWriter {
+ public:
+  SnapshotContainerWriter() = default;
+  ~SnapshotContainerWriter();
+
+  // Not copyable or movable.
+  SnapshotContainerWriter(const SnapshotContainerWriter&) = delete;
+  SnapshotContainerWriter& operator=(const SnapshotContainerWriter&) = delete;
+
+  // Creates or truncates `filename`.
+  absl::Status Open(absl::string_view filename) ABSL_MUST_USE_RESULT;
+
+  // Appends `snapshot` to the container.
+  absl::Status Add(const Snapshot& snapshot) ABSL_MUST_USE_RESULT;
+
+  // Appends an already serialized proto.Snapshot, e.g. the contents of a
+  // file written by WriteSnapshotToFile(), without parsing it.
+  absl::Status AddSerialized(absl::string_view serialized_snapshot)
+      ABSL_MUST_USE_RESULT;
+
+  // Writes the index and the header and closes the file.
+  absl::Status Finish() ABSL_MUST_USE_RESULT;
+
+ private:
+  absl::Status Write(absl::string_view data);
+
+  int fd_ = -1;
+
+  // Current size of the file.
+  uint64_t file_size_ = 0;
+
+  // File offsets of the records written so far.
+  std::vector<uint64_t> record_offsets_;
+};
+
+// Reads a snapshot container through a read-only mapping of the file.
+// Records are parsed only when asked for. All const methods are thread-safe,
+// so threads can share a reader to parse different records concurrently.
+class SnapshotContainerReader {
+ public:
+  // Maps `filename` and validates its header and index.
+  static absl::StatusOr<SnapshotContainerReader> Open(
+      absl::string_view filename) ABSL_MUST_USE_RESULT;
+
+  // Returns true if `filename` starts with the container magic. Lets tools
+  // accept containers and single Snapshot files interchangeably.
+  static bool IsSnapshotContainer(absl::string_view filename);
+
+  // Movable, not copyable.
+  SnapshotContainerReader(SnapshotContainerReader&&) = default;
+  SnapshotContainerReader& operator=(SnapshotContainerReader&&) = default;
+
+  // Number of records in the container.
+  size_t size() const { return num_records_; }
+
+  // Returns the serialized proto.Snapshot of record `i`. Points into the
+  // mapping and is valid as long as this reader.
+  // REQUIRES: i < size().
+  absl::string_view GetSerialized(size_t i) const;
+
+  // Parses record `i`.
+  // REQUIRES: i < size().
+  absl::StatusOr<Snapshot> Get(size_t i) const ABSL_MUST_USE_RESULT;
+
+ private:
+  SnapshotContainerReader(MmappedMemoryPtr<const char> mapping,
+                          size_t num_records, const uint64_t* index)
+      : mapping_(std::move(mapping)),
+        num_records_(num_records),
+        index_(index) {}
+
+  MmappedMemoryPtr<const char> mapping_;
+  size_t num_records_;
+
+  // The index inside `mapping_`.
+  const uint64_t* index_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_COMMON_SNAPSHOT_CONTAINER_H_
@@ -0,0 +1,118 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./common/snapshot_container.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "./common/snapshot.h"
+#include "./common/snapshot_file_util.h"
+#include "./common/snapshot_test_enum.h"
+#include "./common/snapshot_test_util.h"
+#include "./util/arch.h"
+#include "./util/file_util.h"
+#include "./util/path_util.h"
+#include "./util/testing/status_macros.h"
+#include "./util/testing/status_matchers.h"
+#include "./util/tool_util.h"
+
+namespace silifuzz {
+namespace {
+
+using ::silifuzz::testing::StatusIs;
+
+TEST(SnapshotContainer, Roundtrip) {
+  ASSERT_OK_AND_ASSIGN(std::string filename, CreateTempFile("container"));
+  std::vector<Snapshot> snapshots;
+  snapshots.push_back(CreateTestSnapshot<X86_64>(TestSnapshot::kEmpty));
+  snapshots.push_back(
+      CreateTestSnapshot<X86_64>(TestSnapshot::kEndsAsExpected));
+  snapshots.push_back(
+      CreateTestSnapshot<AArch64>(TestSnapshot::kEndsAsExpected));
+  SnapshotContainerWriter writer;
+  ASSERT_OK(writer.Open(filename));
+  for (const Snapshot& snapshot : snapshots) {
+    ASSERT_OK(writer.Add(snapshot));
+  }
+  ASSERT_OK(writer.Finish());
+
+  EXPECT_TRUE(SnapshotContainerReader::IsSnapshotContainer(filename));
+  ASSERT_OK_AND_ASSIGN(SnapshotContainerReader reader,
+                       SnapshotContainerReader::Open(filename));
+  ASSERT_EQ(reader.size(), snapshots.size());
+  // Read out of order to check that records are independent.
+  for (int i = snapshots.size() - 1; i >= 0; --i) {
+    ASSERT_OK_AND_ASSIGN(Snapshot snapshot, reader.Get(i));
+    EXPECT_EQ(snapshot, snapshots[i]);
+  }
+}
+
+TEST(SnapshotContainer, Empty) {
+  ASSERT_OK_AND_ASSIGN(std::string filename, CreateTempFile("container"));
+  SnapshotContainerWriter writer;
+  ASSERT_OK(writer.Open(filename));
+  ASSERT_OK(writer.Finish());
+  ASSERT_OK_AND_ASSIGN(SnapshotContainerReader reader,
+                       SnapshotContainerReader::Open(filename));
+  EXPECT_EQ(reader.size(), 0);
+}
+
+TEST(SnapshotContainer, AddSerialized) {
+  ASSERT_OK_AND_ASSIGN(std::string snapshot_file, CreateTempFile("snapshot"));
+  ASSERT_OK_AND_ASSIGN(std::string filename, CreateTempFile("container"));
+  const Snapshot snapshot =
+      CreateTestSnapshot<X86_64>(TestSnapshot::kEndsAsExpected);
+  ASSERT_OK(WriteSnapshotToFile(snapshot, snapshot_file));
+  ASSERT_OK_AND_ASSIGN(std::string serialized, GetFileContents(snapshot_file));
+
+  SnapshotContainerWriter writer;
+  ASSERT_OK(writer.Open(filename));
+  ASSERT_OK(writer.AddSerialized(serialized));
+  ASSERT_OK(writer.Finish());
+  ASSERT_OK_AND_ASSIGN(SnapshotContainerReader reader,
+                       SnapshotContainerReader::Open(filename));
+  ASSERT_EQ(reader.size(), 1);
+  EXPECT_EQ(reader.GetSerialized(0), serialized);
+  ASSERT_OK_AND_ASSIGN(Snapshot read_snapshot, reader.Get(0));
+  EXPECT_EQ(read_snapshot, snapshot);
+}
+
+TEST(SnapshotContainer, RejectsOtherFiles) {
+  ASSERT_OK_AND_ASSIGN(std::string filename, CreateTempFile("snapshot"));
+  ASSERT_OK(WriteSnapshotToFile(
+      CreateTestSnapshot<X86_64>(TestSnapshot::kEndsAsExpected), filename));
+  EXPECT_FALSE(SnapshotContainerReader::IsSnapshotContainer(filename));
+  EXPECT_THAT(SnapshotContainerReader::Open(filename),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(SnapshotContainer, RejectsTruncated) {
+  ASSERT_OK_AND_ASSIGN(std::string filename, CreateTempFile("container"));
+  SnapshotContainerWriter writer;
+  ASSERT_OK(writer.Open(filename));
+  ASSERT_OK(writer.Add(CreateTestSnapshot<X86_64>(TestSnapshot::kEmpty)));
+  ASSERT_OK(writer.Finish());
+  ASSERT_OK_AND_ASSIGN(std::string contents, GetFileContents(filename));
+  contents.resize(contents.size() - 1);
+  ASSERT_TRUE(SetContents(filename, contents));
+  EXPECT_THAT(SnapshotContainerReader::Open(filename),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+}  // namespace
+}  // namespace silifuzz
@@ -43,7 +43,7 @@ absl::StatusOr<Snapshot> ReadSnapshotFromFile(absl::string_view filename) {
   auto s = ReadFromFile(filename, &snap_proto);
   RETURN_IF_NOT_OK(s);
 
-  auto snapshot_or = SnapshotProto::FromProto(snap_proto);
+  auto snapshot_or = SnapshotProto::FromProto(std::move(snap_proto));
   RETURN_IF_NOT_OK_PLUS(snapshot_or.status(),
                         "Could not parse Snapshot from proto: ");
   return snapshot_or;
@@ -115,22 +115,28 @@ void SnapshotPrinter::LogDebugString(const Snapshot& snapshot,
 // ========================================================================= //
 
 void SnapshotPrinter::PrintByteData(const ByteData& bytes, int64_t limit) {
+  // Bytes are formatted into a reused line buffer with a digit table rather
+  // than with a StrCat() per byte, which dominated printing large snapshots.
   static constexpr int kLineSize = 100;
-  std::string hex;
-  int i = 0;
-  for (char byte : bytes) {
-    if (limit >= 0 && i >= limit) {
-      hex.append("... (data ommited)");
-      break;
-    }
-    hex.append(absl::StrCat(absl::Hex(byte, absl::kZeroPad2)));
-    if (hex.size() >= kLineSize) {
-      Line(hex);
-      hex.clear();
+  static constexpr char kHexDigits[] = "0123456789abcdef";
+  const size_t num_bytes =
+      limit >= 0 ? std::min<size_t>(bytes.size(), limit) : bytes.size();
+  char line[kLineSize];
+  int line_size = 0;
+  for (size_t i = 0; i < num_bytes; ++i) {
+    const uint8_t byte = bytes[i];
+    line[line_size++] = kHexDigits[byte >> 4];
+    line[line_size++] = kHexDigits[byte & 0xf];
+    if (line_size == kLineSize) {
+      Line(absl::string_view(line, line_size));
+      line_size = 0;
     }
-    ++i;
   }
-  Line(hex);
+  if (num_bytes < bytes.size()) {
+    Line(absl::string_view(line, line_size), "... (data ommited)");
+  } else {
+    Line(absl::string_view(line, line_size));
+  }
 }
 
 void SnapshotPrinter::PrintCompleteness(const Snapshot& snapshot) {
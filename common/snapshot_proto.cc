@@ -14,6 +14,7 @@
 
 #include "./common/snapshot_proto.h"
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <utility>
@@ -151,16 +152,67 @@ absl::StatusOr<Snapshot::MemoryMapping> SnapshotProto::FromProto(
                                   perms);
 }
 
+namespace {
+
+// ToProto() writes MemoryBytes filled with a single byte value of at least
+// this size as a proto::MemoryBytes::ByteRun. Shorter ones are not worth it.
+constexpr size_t kMinByteRunSize = 64;
+
+// Returns the MemoryBytes described by `proto`.byte_run.
+// REQUIRES: proto.has_start_address() && proto.has_byte_run()
+absl::StatusOr<Snapshot::MemoryBytes> MemoryBytesFromByteRun(
+    const proto::MemoryBytes& proto) {
+  if (proto.has_byte_values()) {
+    return absl::InvalidArgumentError("Both byte_values and byte_run are set");
+  }
+  const proto::MemoryBytes::ByteRun& byte_run = proto.byte_run();
+  PROTO_MUST_HAVE_FIELD(byte_run, value);
+  PROTO_MUST_HAVE_FIELD(byte_run, size);
+  if (byte_run.value() > 0xff) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Bad byte_run value: ", byte_run.value()));
+  }
+  // Checked against the address space before allocating the bytes.
+  if (byte_run.size() == 0 || byte_run.size() > ~proto.start_address()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Bad byte_run size: ", byte_run.size()));
+  }
+  Snapshot::ByteData byte_values(byte_run.size(),
+                                 static_cast<char>(byte_run.value()));
+  RETURN_IF_NOT_OK(Snapshot::MemoryBytes::CanConstruct(proto.start_address(),
+                                                       byte_values));
+  return Snapshot::MemoryBytes(proto.start_address(), std::move(byte_values));
+}
+
+}  // namespace
+
 // static
 absl::StatusOr<Snapshot::MemoryBytes> SnapshotProto::FromProto(
     const proto::MemoryBytes& proto) {
   PROTO_MUST_HAVE_FIELD(proto, start_address);
+  if (proto.has_byte_run()) {
+    return MemoryBytesFromByteRun(proto);
+  }
   PROTO_MUST_HAVE_FIELD(proto, byte_values);
   RETURN_IF_NOT_OK(
       MemoryBytes::CanConstruct(proto.start_address(), proto.byte_values()));
   return MemoryBytes(proto.start_address(), proto.byte_values());
 }
 
+// static
+absl::StatusOr<Snapshot::MemoryBytes> SnapshotProto::FromProto(
+    proto::MemoryBytes&& proto) {
+  PROTO_MUST_HAVE_FIELD(proto, start_address);
+  if (proto.has_byte_run()) {
+    return MemoryBytesFromByteRun(proto);
+  }
+  PROTO_MUST_HAVE_FIELD(proto, byte_values);
+  RETURN_IF_NOT_OK(
+      MemoryBytes::CanConstruct(proto.start_address(), proto.byte_values()));
+  return MemoryBytes(proto.start_address(),
+                     std::move(*proto.mutable_byte_values()));
+}
+
 // static
 absl::StatusOr<Snapshot::RegisterState> SnapshotProto::FromProto(
     const proto::RegisterState& proto) {
@@ -169,6 +221,15 @@ absl::StatusOr<Snapshot::RegisterState> SnapshotProto::FromProto(
   return RegisterState(proto.gregs(), proto.fpregs());
 }
 
+// static
+absl::StatusOr<Snapshot::RegisterState> SnapshotProto::FromProto(
+    proto::RegisterState&& proto) {
+  PROTO_MUST_HAVE_FIELD(proto, gregs);
+  PROTO_MUST_HAVE_FIELD(proto, fpregs);
+  return RegisterState(std::move(*proto.mutable_gregs()),
+                       std::move(*proto.mutable_fpregs()));
+}
+
 // static
 absl::StatusOr<Snapshot::Endpoint> SnapshotProto::FromProto(
     const proto::Endpoint& proto) {
@@ -205,15 +266,22 @@ absl::StatusOr<Snapshot::Endpoint> SnapshotProto::FromProto(
 // static
 absl::StatusOr<Snapshot::EndState> SnapshotProto::FromProto(
     const proto::EndState& proto) {
+  proto::EndState copy = proto;
+  return FromProto(std::move(copy));
+}
+
+// static
+absl::StatusOr<Snapshot::EndState> SnapshotProto::FromProto(
+    proto::EndState&& proto) {
   PROTO_MUST_HAVE_FIELD(proto, endpoint);
   PROTO_MUST_HAVE_FIELD(proto, registers);
   auto e = FromProto(proto.endpoint());
   RETURN_IF_NOT_OK_PLUS(e.status(), "Bad Endpoint: ");
-  auto r = FromProto(proto.registers());
+  auto r = FromProto(std::move(*proto.mutable_registers()));
   RETURN_IF_NOT_OK_PLUS(r.status(), "Bad RegisterState: ");
   EndState end_state(e.value(), r.value());
-  for (const proto::MemoryBytes& p : proto.memory_bytes()) {
-    auto b = FromProto(p);
+  for (proto::MemoryBytes& p : *proto.mutable_memory_bytes()) {
+    auto b = FromProto(std::move(p));
     RETURN_IF_NOT_OK_PLUS(b.status(), "Bad MemoryBytes: ");
     RETURN_IF_NOT_OK_PLUS(end_state.can_add_memory_bytes(b.value()),
                           "Can't add MemoryBytes: ");
@@ -263,6 +331,12 @@ absl::StatusOr<Snapshot::TraceData> SnapshotProto::FromProto(
 // static
 absl::StatusOr<Snapshot> SnapshotProto::FromProto(
     const proto::Snapshot& proto) {
+  proto::Snapshot copy = proto;
+  return FromProto(std::move(copy));
+}
+
+// static
+absl::StatusOr<Snapshot> SnapshotProto::FromProto(proto::Snapshot&& proto) {
   PROTO_MUST_HAVE_FIELD(proto, architecture);
   PROTO_MUST_HAVE_FIELD(proto, registers);
   const Id& id = proto.has_id() ? proto.id() : Snapshot::UnsetId();
@@ -286,26 +360,26 @@ absl::StatusOr<Snapshot> SnapshotProto::FromProto(
                           "Can't add negative MemoryMapping: ");
     snap.add_negative_memory_mapping(s.value());
   }
-  for (const proto::MemoryBytes& p : proto.memory_bytes()) {
-    auto s = FromProto(p);
+  for (proto::MemoryBytes& p : *proto.mutable_memory_bytes()) {
+    auto s = FromProto(std::move(p));
     RETURN_IF_NOT_OK_PLUS(s.status(), "Bad MemoryBytes: ");
     RETURN_IF_NOT_OK_PLUS(snap.can_add_memory_bytes(s.value()),
                           "Can't add MemoryBytes: ");
     snap.add_memory_bytes(std::move(s).value());
   }
   {
-    auto s = FromProto(proto.registers());
+    auto s = FromProto(std::move(*proto.mutable_registers()));
     RETURN_IF_NOT_OK_PLUS(s.status(), "Bad RegisterState: ");
     RETURN_IF_NOT_OK_PLUS(snap.can_set_registers(s.value()),
                           "Can't set RegisterState: ");
     snap.set_registers(s.value());
   }
-  for (const proto::EndState& p : proto.expected_end_states()) {
-    auto s = FromProto(p);
+  for (proto::EndState& p : *proto.mutable_expected_end_states()) {
+    auto s = FromProto(std::move(p));
     RETURN_IF_NOT_OK_PLUS(s.status(), "Bad EndState: ");
     RETURN_IF_NOT_OK_PLUS(snap.can_add_expected_end_state(s.value()),
                           "Can't add EndState: ");
-    snap.add_expected_end_state(s.value());
+    snap.add_expected_end_state(std::move(s).value());
   }
   {
     auto s = FromProto(proto.metadata());
@@ -346,7 +420,16 @@ void SnapshotProto::ToProto(const MemoryMapping& snap,
 void SnapshotProto::ToProto(const MemoryBytes& snap,
                             proto::MemoryBytes* proto) {
   proto->set_start_address(snap.start_address());
-  proto->set_byte_values(snap.byte_values());
+  const Snapshot::ByteData& byte_values = snap.byte_values();
+  if (byte_values.size() >= kMinByteRunSize &&
+      byte_values.find_first_not_of(byte_values[0]) ==
+          Snapshot::ByteData::npos) {
+    proto::MemoryBytes::ByteRun* byte_run = proto->mutable_byte_run();
+    byte_run->set_value(static_cast<uint8_t>(byte_values[0]));
+    byte_run->set_size(byte_values.size());
+  } else {
+    proto->set_byte_values(byte_values);
+  }
 }
 
 // static
@@ -433,9 +516,14 @@ void SnapshotProto::ToProto(const Snapshot& snap, proto::Snapshot* proto) {
   for (const MemoryMapping& s : snap.memory_mappings()) {
     ToProto(s, proto->add_memory_mappings());
   }
-  for (const MemoryMapping& s : snap.negative_memory_mappings()) {
-    ToProto(s, proto->add_negative_memory_mappings());
-  }
+  // Negative mappings added for many end states may be fragmented, so write
+  // out the compacted list of negative_memory_mappings().
+  snap.negative_mapped_memory_map().Iterate(
+      [proto](Snapshot::Address start, Snapshot::Address limit,
+              MemoryPerms perms) {
+        ToProto(MemoryMapping::MakeRanged(start, limit, perms),
+                proto->add_negative_memory_mappings());
+      });
   for (const MemoryBytes& s : snap.memory_bytes()) {
     ToProto(s, proto->add_memory_bytes());
   }
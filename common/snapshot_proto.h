@@ -32,6 +32,11 @@ class SnapshotProto : private SnapshotTypeNames {
   // PROVIDES: Snapshot::IsCompleteSomeState() for the returned snapshot.
   static absl::StatusOr<Snapshot> FromProto(const proto::Snapshot& proto);
 
+  // Like the above but moves byte data out of `proto` instead of copying it.
+  // Use this when `proto` is not needed afterwards, e.g. when it has just been
+  // parsed from a file. `proto` is left in a valid but unspecified state.
+  static absl::StatusOr<Snapshot> FromProto(proto::Snapshot&& proto);
+
   // Returns true iff the given snapshot proto is valid
   // (a Snapshot can be made from it with FromProto()).
   // A convenience helper: is as expensive as FromProto().
@@ -43,14 +48,17 @@ class SnapshotProto : private SnapshotTypeNames {
 
   // Like the above but for EndState submessage. Used by PlayerResultProto.
   static absl::StatusOr<EndState> FromProto(const proto::EndState& proto);
+  static absl::StatusOr<EndState> FromProto(proto::EndState&& proto);
   static void ToProto(const EndState& snap, proto::EndState* proto);
 
   // FromProto() overloads for snapshot submessage types.
   static absl::StatusOr<MemoryMapping> FromProto(
       const proto::MemoryMapping& proto);
   static absl::StatusOr<MemoryBytes> FromProto(const proto::MemoryBytes& proto);
+  static absl::StatusOr<MemoryBytes> FromProto(proto::MemoryBytes&& proto);
   static absl::StatusOr<RegisterState> FromProto(
       const proto::RegisterState& proto);
+  static absl::StatusOr<RegisterState> FromProto(proto::RegisterState&& proto);
   static absl::StatusOr<Endpoint> FromProto(const proto::Endpoint& proto);
   static absl::StatusOr<Metadata> FromProto(
       const proto::SnapshotMetadata& proto);
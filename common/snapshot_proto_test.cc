@@ -15,6 +15,7 @@
 #include "./common/snapshot_proto.h"
 
 #include <string>
+#include <utility>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -115,5 +116,54 @@ TEST(SnapshotProto, TraceMetadataRoundtrip) {
               ::testing::UnorderedElementsAreArray(snapshot.trace_data()));
 }
 
+TEST(SnapshotProto, MoveFromProto) {
+  Snapshot snapshot = CreateTestSnapshot<Host>(TestSnapshot::kEndsAsExpected);
+  proto::Snapshot proto;
+  SnapshotProto::ToProto(snapshot, &proto);
+  ASSERT_OK_AND_ASSIGN(Snapshot copied, SnapshotProto::FromProto(proto));
+  ASSERT_OK_AND_ASSIGN(Snapshot moved,
+                       SnapshotProto::FromProto(std::move(proto)));
+  EXPECT_EQ(copied, snapshot);
+  EXPECT_EQ(moved, snapshot);
+}
+
+TEST(SnapshotProto, MemoryBytesByteRunRoundtrip) {
+  const Snapshot::MemoryBytes zeros(0x10000, std::string(4096, '\0'));
+  proto::MemoryBytes proto;
+  SnapshotProto::ToProto(zeros, &proto);
+  EXPECT_FALSE(proto.has_byte_values());
+  EXPECT_EQ(proto.byte_run().value(), 0);
+  EXPECT_EQ(proto.byte_run().size(), 4096);
+  ASSERT_OK_AND_ASSIGN(Snapshot::MemoryBytes got,
+                       SnapshotProto::FromProto(proto));
+  EXPECT_EQ(got, zeros);
+
+  // Short and mixed ranges keep their bytes.
+  const Snapshot::MemoryBytes mixed(0x10000, std::string(4095, '\xff') + "a");
+  proto.Clear();
+  SnapshotProto::ToProto(mixed, &proto);
+  EXPECT_FALSE(proto.has_byte_run());
+  EXPECT_EQ(proto.byte_values(), mixed.byte_values());
+  const Snapshot::MemoryBytes short_run(0x10000, "\0\0");
+  proto.Clear();
+  SnapshotProto::ToProto(short_run, &proto);
+  EXPECT_FALSE(proto.has_byte_run());
+}
+
+TEST(SnapshotProto, BadMemoryBytesByteRun) {
+  proto::MemoryBytes proto;
+  proto.set_start_address(0x10000);
+  proto.mutable_byte_run()->set_value(0x100);
+  proto.mutable_byte_run()->set_size(16);
+  EXPECT_FALSE(SnapshotProto::FromProto(proto).ok());
+  proto.mutable_byte_run()->set_value(0);
+  proto.mutable_byte_run()->set_size(0);
+  EXPECT_FALSE(SnapshotProto::FromProto(proto).ok());
+  proto.mutable_byte_run()->set_size(16);
+  EXPECT_TRUE(SnapshotProto::FromProto(proto).ok());
+  proto.set_byte_values("x");
+  EXPECT_FALSE(SnapshotProto::FromProto(proto).ok());
+}
+
 }  // namespace
 }  // namespace silifuzz
@@ -20,6 +20,7 @@
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/numeric/int128.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "./common/memory_perms.h"
@@ -117,6 +118,38 @@ TYPED_TEST(SnapshotTest, IsComplete) {
                        HasSubstr("Missing negative_memory_mappings")));
 }
 
+TYPED_TEST(SnapshotTest, CompactNegativeMemoryMappings) {
+  Snapshot s(Snapshot::ArchitectureTypeToEnum<TypeParam>());
+  const Snapshot::Address page_size = s.page_size();
+  const Snapshot::Address base = 0x100 * page_size;
+  // End states faulting on adjacent pages get a single negative mapping.
+  for (Snapshot::Address page : {base, base + page_size, base + 3 * page_size,
+                                 base + 2 * page_size}) {
+    Snapshot::Endpoint ep(Snapshot::Endpoint::kSigSegv,
+                          Snapshot::Endpoint::kSegvCantRead, page + 8,
+                          0x10000);
+    ASSERT_OK(s.AddNegativeMemoryMappingsFor(Snapshot::EndState(ep)));
+  }
+  ASSERT_EQ(s.negative_memory_mappings().size(), 1);
+  EXPECT_EQ(s.negative_memory_mappings()[0].start_address(), base);
+  EXPECT_EQ(s.negative_memory_mappings()[0].num_bytes(), 4 * page_size);
+
+  // Mappings added directly are kept as they are until compacted.
+  const MemoryPerms perms = MemoryPerms::W();
+  s.set_negative_memory_mappings({});
+  s.add_negative_memory_mapping(Snapshot::MemoryMapping::MakeSized(
+      base + page_size, page_size, perms));
+  s.add_negative_memory_mapping(
+      Snapshot::MemoryMapping::MakeSized(base, page_size, perms));
+  Snapshot expected = s.Copy();
+  EXPECT_EQ(s.negative_memory_mappings().size(), 2);
+  s.CompactNegativeMemoryMappings();
+  ASSERT_EQ(s.negative_memory_mappings().size(), 1);
+  EXPECT_EQ(s.negative_memory_mappings()[0],
+            Snapshot::MemoryMapping::MakeSized(base, 2 * page_size, perms));
+  EXPECT_EQ(s, expected);
+}
+
 TYPED_TEST(SnapshotTest, EndStatePlatform) {
   Snapshot s = CreateTestSnapshot<TypeParam>(TestSnapshot::kEndsAsExpected);
   Snapshot::EndState es = s.expected_end_states()[0];
@@ -137,6 +170,36 @@ TYPED_TEST(SnapshotTest, EndStatePlatform) {
                             PlatformId::kIntelSapphireRapids}));
 }
 
+TYPED_TEST(SnapshotTest, FindExpectedEndState) {
+  Snapshot s = CreateTestSnapshot<TypeParam>(TestSnapshot::kEndsAsExpected);
+  ASSERT_EQ(s.expected_end_states().size(), 1);
+  Snapshot::EndState es = s.expected_end_states()[0];
+
+  // Platforms are ignored.
+  es.add_platform(PlatformId::kIntelIcelake);
+  EXPECT_EQ(s.FindExpectedEndState(es), 0);
+  EXPECT_FALSE(s.can_add_expected_end_state(es).ok());
+
+  Snapshot::EndState other(
+      Snapshot::Endpoint(es.endpoint().instruction_address() + 1),
+      es.registers());
+  other.add_platform(TestSnapshotPlatform<TypeParam>());
+  EXPECT_EQ(s.FindExpectedEndState(other), -1);
+  ASSERT_OK(s.can_add_expected_end_state(other, true));
+  s.add_expected_end_state(other, true);
+  EXPECT_EQ(s.FindExpectedEndState(other), 1);
+  EXPECT_EQ(s.Copy().FindExpectedEndState(other), 1);
+
+  // Removal shifts the index.
+  s.remove_expected_end_state(&s.expected_end_states()[0]);
+  EXPECT_EQ(s.FindExpectedEndState(es), -1);
+  EXPECT_EQ(s.FindExpectedEndState(other), 0);
+
+  s.set_expected_end_states({es});
+  EXPECT_EQ(s.FindExpectedEndState(es), 0);
+  EXPECT_EQ(s.FindExpectedEndState(other), -1);
+}
+
 TYPED_TEST(SnapshotTest, UndefinedPlatformAllowed) {
   Snapshot s = CreateTestSnapshot<TypeParam>(TestSnapshot::kEndsAsExpected);
   ASSERT_FALSE(s.expected_end_states().empty());
@@ -370,6 +433,43 @@ TYPED_TEST(SnapshotTest, ReplaceMemoryBytes) {
               StatusIs(absl::StatusCode::kInvalidArgument));
 }
 
+TYPED_TEST(SnapshotTest, Fingerprint) {
+  Snapshot s = CreateTestSnapshot<TypeParam>(TestSnapshot::kEndsAsExpected);
+  Snapshot copy = s.Copy();
+  EXPECT_EQ(s.Fingerprint(), copy.Fingerprint());
+  EXPECT_EQ(s, copy);
+
+  // The order of memory bytes does not matter.
+  Snapshot::MemoryBytesList reversed(copy.memory_bytes().rbegin(),
+                                     copy.memory_bytes().rend());
+  ASSERT_OK(copy.ReplaceMemoryBytes(std::move(reversed)));
+  EXPECT_EQ(s.Fingerprint(), copy.Fingerprint());
+
+  // Modifications invalidate the cached fingerprint.
+  copy.set_id("other_id");
+  EXPECT_NE(s.Fingerprint(), copy.Fingerprint());
+  EXPECT_NE(s, copy);
+  copy.set_id(s.id());
+  EXPECT_EQ(s.Fingerprint(), copy.Fingerprint());
+
+  ASSERT_FALSE(copy.expected_end_states().empty());
+  copy.add_platform_to_expected_end_state(0, PlatformId::kIntelIcelake);
+  if (!s.expected_end_states()[0].has_platform(PlatformId::kIntelIcelake)) {
+    EXPECT_NE(s.Fingerprint(), copy.Fingerprint());
+    EXPECT_NE(s, copy);
+  }
+
+  // Moving keeps the contents and so the fingerprint.
+  const absl::uint128 fingerprint = s.Fingerprint();
+  Snapshot moved = std::move(s);
+  EXPECT_EQ(moved.Fingerprint(), fingerprint);
+
+  // Different snapshots have different fingerprints even with the same ID.
+  Snapshot other = CreateTestSnapshot<TypeParam>(TestSnapshot::kRegsMismatch);
+  other.set_id(moved.id());
+  EXPECT_NE(moved.Fingerprint(), other.Fingerprint());
+}
+
 TEST(MemoryBytes, Range) {
   Snapshot::MemoryBytes mb(42, "foobar");
   Snapshot::MemoryBytes left = mb.Range(42, 45);
@@ -16,6 +16,7 @@
 
 #include <stddef.h>
 
+#include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
@@ -33,7 +34,8 @@ Snapshot::RegisterState ConvertRegsToSnapshot(const GRegSet<Arch>& gregs,
   Snapshot::ByteData gregs_bytes, fpregs_bytes;
   CHECK(SerializeGRegs(gregs, &gregs_bytes));
   CHECK(SerializeFPRegs(fpregs, &fpregs_bytes));
-  return Snapshot::RegisterState(gregs_bytes, fpregs_bytes);
+  return Snapshot::RegisterState(std::move(gregs_bytes),
+                                 std::move(fpregs_bytes));
 }
 
 template Snapshot::RegisterState ConvertRegsToSnapshot(
@@ -0,0 +1,75 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./fuzzer/mutation_op_scheduler.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <random>
+
+#include "./fuzzer/program.h"
+
+namespace silifuzz {
+
+double MutationOpScheduler::SuccessRate(size_t op) const {
+  // Laplace's rule of succession: an untried op is estimated to succeed half
+  // of the time.
+  return (successes_[op] + 1.0) / (uses_[op] + 2.0);
+}
+
+double MutationOpScheduler::Weight(MutationOp op) const {
+  double total_rate = 0.0;
+  for (size_t i = 0; i < kNumMutationOps; ++i) {
+    total_rate += SuccessRate(i);
+  }
+  return kExplorationShare / kNumMutationOps +
+         (1.0 - kExplorationShare) * SuccessRate(static_cast<size_t>(op)) /
+             total_rate;
+}
+
+MutationOp MutationOpScheduler::Choose(MutatorRng& rng) const {
+  double weights[kNumMutationOps];
+  for (size_t i = 0; i < kNumMutationOps; ++i) {
+    weights[i] = Weight(static_cast<MutationOp>(i));
+  }
+  std::discrete_distribution<size_t> d(std::begin(weights), std::end(weights));
+  return static_cast<MutationOp>(d(rng));
+}
+
+void MutationOpScheduler::RecordUse(MutationOpSet ops) {
+  for (size_t i = 0; i < kNumMutationOps; ++i) {
+    if (ops & MutationOpBit(static_cast<MutationOp>(i))) ++uses_[i];
+  }
+  if (++uses_since_decay_ >= kDecayInterval) {
+    for (size_t i = 0; i < kNumMutationOps; ++i) {
+      uses_[i] /= 2;
+      successes_[i] /= 2;
+    }
+    uses_since_decay_ = 0;
+  }
+}
+
+void MutationOpScheduler::RecordSuccess(MutationOpSet ops) {
+  for (size_t i = 0; i < kNumMutationOps; ++i) {
+    // A mutant can be credited after the counts were halved, don't let
+    // successes exceed uses.
+    if ((ops & MutationOpBit(static_cast<MutationOp>(i))) &&
+        successes_[i] < uses_[i]) {
+      ++successes_[i];
+    }
+  }
+}
+
+}  // namespace silifuzz
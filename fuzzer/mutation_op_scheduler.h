@@ -0,0 +1,97 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_FUZZER_MUTATION_OP_SCHEDULER_H_
+#define THIRD_PARTY_SILIFUZZ_FUZZER_MUTATION_OP_SCHEDULER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "./fuzzer/program.h"
+
+namespace silifuzz {
+
+// The mutation operations the ProgramMutator chooses between.
+enum class MutationOp {
+  kInsert = 0,
+  kMutate,
+  kRemove,
+  kSwap,
+  kCrossover,
+  kNumOps,  // Must be last.
+};
+
+inline constexpr size_t kNumMutationOps =
+    static_cast<size_t>(MutationOp::kNumOps);
+
+// A set of MutationOps, one bit per op.
+using MutationOpSet = uint32_t;
+
+inline constexpr MutationOpSet MutationOpBit(MutationOp op) {
+  return MutationOpSet{1} << static_cast<size_t>(op);
+}
+
+// Picks mutation operations in proportion to how often mutants they were
+// applied to turned out to be interesting, i.e. were added to the corpus.
+// Each op's success rate is estimated with a uniform prior so that untried
+// ops look promising, and a fixed share of picks is spread uniformly so that
+// no op is starved. Counts are halved periodically so that the weights track
+// the changing needs of a fuzzing campaign.
+//
+// This class is thread-compatible.
+class MutationOpScheduler {
+ public:
+  MutationOpScheduler() = default;
+  ~MutationOpScheduler() = default;
+
+  // Copyable and movable by default.
+
+  // Returns a randomly chosen op.
+  MutationOp Choose(MutatorRng& rng) const;
+
+  // Records that a mutant was produced using `ops`.
+  void RecordUse(MutationOpSet ops);
+
+  // Records that a mutant produced using `ops` was interesting.
+  void RecordSuccess(MutationOpSet ops);
+
+  // Returns the relative probability of Choose() returning `op`. The weights
+  // of all ops add up to 1.
+  double Weight(MutationOp op) const;
+
+  uint64_t uses(MutationOp op) const {
+    return uses_[static_cast<size_t>(op)];
+  }
+  uint64_t successes(MutationOp op) const {
+    return successes_[static_cast<size_t>(op)];
+  }
+
+ private:
+  // Share of picks spread uniformly across all ops.
+  static constexpr double kExplorationShare = 0.1;
+
+  // Number of RecordUse() calls after which all counts are halved.
+  static constexpr uint64_t kDecayInterval = uint64_t{1} << 16;
+
+  // Returns the estimated success rate of `op`.
+  double SuccessRate(size_t op) const;
+
+  uint64_t uses_[kNumMutationOps] = {};
+  uint64_t successes_[kNumMutationOps] = {};
+  uint64_t uses_since_decay_ = 0;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_FUZZER_MUTATION_OP_SCHEDULER_H_
@@ -17,7 +17,6 @@
 #include <cmath>
 #include <cstdint>
 #include <cstring>
-#include <limits>
 #include <random>
 #include <vector>
 
@@ -69,23 +68,32 @@ void Program<Arch>::FixupInvariants() {
     insn.offset = offset;
     offset += insn.encoded.size();
   }
+  CHECK_LE(offset, kMaxProgramByteLen);
   byte_len_ = offset;
 }
 
 template <typename Arch>
 size_t Program<Arch>::FindClosestInstructionBoundary(int64_t program_offset) {
-  size_t closest_boundary = kInvalidInstructionBoundary;
-  int64_t smallest_diff = std::numeric_limits<int64_t>::max();
-  // TODO(ncbray): binary search
-  for (size_t i = 0; i < NumInstructionBoundaries(); i++) {
-    int64_t boundary_offset = InstructionBoundaryToProgramByteOffset(i);
-    int64_t diff = std::abs(boundary_offset - program_offset);
-    if (diff < smallest_diff) {
-      smallest_diff = diff;
-      closest_boundary = i;
+  // Boundary offsets strictly increase with the boundary index, so binary
+  // search for the first boundary at or after `program_offset`.
+  size_t low = 0;
+  size_t high = NumInstructionBoundaries() - 1;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    if (InstructionBoundaryToProgramByteOffset(mid) < program_offset) {
+      low = mid + 1;
+    } else {
+      high = mid;
     }
   }
-  return closest_boundary;
+  // The boundary before it may be closer. Prefer it on a tie.
+  if (low > 0 &&
+      program_offset - InstructionBoundaryToProgramByteOffset(low - 1) <=
+          std::abs(InstructionBoundaryToProgramByteOffset(low) -
+                   program_offset)) {
+    return low - 1;
+  }
+  return low;
 }
 
 template <typename Arch>
@@ -107,8 +115,8 @@ void Program<Arch>::ResolveDisplacements(bool strict) {
   for (Instruction<Arch>& insn : instructions_) {
     if (insn.direct_branch.valid() && insn.direct_branch.instruction_boundary ==
                                           kInvalidInstructionBoundary) {
-      int64_t program_offset =
-          insn.offset + insn.direct_branch.encoded_byte_displacement;
+      int64_t program_offset = static_cast<int64_t>(insn.offset) +
+                               insn.direct_branch.encoded_byte_displacement;
       size_t boundary = FindClosestInstructionBoundary(program_offset);
       if (strict) {
         CHECK_EQ(InstructionBoundaryToProgramByteOffset(boundary),
@@ -166,8 +174,8 @@ bool Program<Arch>::SyncByteDisplacement(const Instruction<Arch>& insn,
     // Already in sync.
     return false;
   }
-  // Sync required.
-  info.encoded_byte_displacement = target_displacement;
+  // Sync required. The target is inside the program, so it fits.
+  info.encoded_byte_displacement = static_cast<int32_t>(target_displacement);
   return true;
 }
 
@@ -324,10 +332,9 @@ void Program<Arch>::InsertInstruction(size_t boundary, bool steal_displacements,
   instructions_.insert(instructions_.begin() + boundary, insn);
 
   // Displacements may require fixup.
+  // Instruction offsets are left out of sync until then, see
+  // Instruction::offset.
   encodings_may_be_invalid = true;
-
-  // TODO(ncbray): Do we really need to stay in sync?
-  FixupInvariants();
 }
 
 template <typename Arch>
@@ -344,10 +351,9 @@ void Program<Arch>::RemoveInstruction(size_t index) {
   instructions_.erase(instructions_.begin() + index);
 
   // Displacements may require fixup.
+  // Instruction offsets are left out of sync until then, see
+  // Instruction::offset.
   encodings_may_be_invalid = true;
-
-  // TODO(ncbray): Do we really need to stay in sync?
-  FixupInvariants();
 }
 
 template <typename Arch>
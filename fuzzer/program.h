@@ -15,6 +15,7 @@
 #ifndef THIRD_PARTY_SILIFUZZ_FUZZER_PROGRAM_H_
 #define THIRD_PARTY_SILIFUZZ_FUZZER_PROGRAM_H_
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <limits>
@@ -32,15 +33,30 @@ using MutatorRng = std::mt19937_64;
 // `size` must be greater than zero.
 size_t RandomIndex(MutatorRng& rng, size_t size);
 
+// Instructions are kept compact so that the instructions of a program being
+// mutated stay in cache. Byte offsets, byte displacements and instruction
+// boundaries are therefore 32-bit, which limits programs to less than 2 GiB.
+constexpr uint64_t kMaxProgramByteLen = std::numeric_limits<int32_t>::max();
+
 // An out-of-range displacement value, to be used when the displacement does not
 // exist.
-constexpr int64_t kInvalidByteDisplacement =
-    std::numeric_limits<int64_t>::max();
+constexpr int32_t kInvalidByteDisplacement =
+    std::numeric_limits<int32_t>::max();
 
 // An out-of-range instruction boundary, to be used when the boundary does not
 // exist.
-constexpr size_t kInvalidInstructionBoundary =
-    std::numeric_limits<size_t>::max();
+constexpr uint32_t kInvalidInstructionBoundary =
+    std::numeric_limits<uint32_t>::max();
+
+// Returns a displacement decoded from an instruction as the 32-bit value kept
+// in InstructionDisplacementInfo. A displacement beyond the 32-bit range points
+// far outside of any program, so saturating it does not change the closest
+// instruction boundary.
+inline int32_t SaturateByteDisplacement(int64_t displacement) {
+  return std::clamp<int64_t>(displacement,
+                             std::numeric_limits<int32_t>::min(),
+                             kInvalidByteDisplacement - 1);
+}
 
 // Information about a PC-relative displacement contained in an instruction that
 // points to another instruction.
@@ -51,7 +67,7 @@ struct InstructionDisplacementInfo {
   // x86_64 defines displacements as relative to the end of the instruction, but
   // we do that conversion in arch-specific code and leave this arch-neutral
   // value relative to the start of the instruction because it's simpler.
-  int64_t encoded_byte_displacement = kInvalidByteDisplacement;
+  int32_t encoded_byte_displacement = kInvalidByteDisplacement;
 
   // The instruction boundary the displacement should point to.
   // As instruction "instruction boundary" is a number in the range
@@ -63,7 +79,7 @@ struct InstructionDisplacementInfo {
   // is where the encoded instruction _is_ pointing. We let these get out of
   // sync while mutating the program and fix up the encoded instruction at the
   // end.
-  size_t instruction_boundary = kInvalidInstructionBoundary;
+  uint32_t instruction_boundary = kInvalidInstructionBoundary;
 
   // Indicates if the displacement information is valid for the instruction it
   // is assosiated. For example, an unconditional direct branch will have a
@@ -153,9 +169,13 @@ struct Instruction {
   // We allow this to get out of sync while the program is mutated, and then
   // recalculate it while we do the final branch fixup before outputting the
   // mutated program.
-  uint64_t offset;
+  uint32_t offset;
 };
 
+// Two x86_64 instructions fit in a cache line.
+static_assert(sizeof(Instruction<X86_64>) == 32);
+static_assert(sizeof(Instruction<AArch64>) == 20);
+
 // A program is a linear sequence of instructions that may execute in a very
 // non-linear way.
 // This structure is designed to be copied.
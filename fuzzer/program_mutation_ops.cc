@@ -14,6 +14,8 @@
 
 #include "./fuzzer/program_mutation_ops.h"
 
+#include <algorithm>
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -68,6 +70,71 @@ void RandomizeBuffer(MutatorRng& rng, uint8_t (&buffer)[N]) {
   }
 }
 
+// Index of the byte that selects the encoding class of an instruction: the
+// first opcode or prefix byte on x86_64 and the most significant byte of the
+// little-endian instruction word on aarch64.
+template <typename Arch>
+constexpr size_t kEncodingClassByte = 0;
+
+template <>
+constexpr size_t kEncodingClassByte<AArch64> = 3;
+
+// Table of how often random bytes decode to an acceptable instruction, for
+// each value of the encoding class byte. Large parts of the encoding space
+// never decode (unallocated aarch64 encodings, opcodes that are invalid in
+// 64-bit mode) or are filtered by InstructionFromBytes(), so picking the class
+// byte in proportion to its acceptance rate instead of uniformly wastes far
+// fewer decode attempts on generating a random instruction.
+//
+// The table is computed by sampling the decoder the first time it is needed
+// rather than generated offline, so it always reflects the decoder and the
+// instruction filters linked into the binary.
+template <typename Arch>
+class EncodingClassTable {
+ public:
+  static const EncodingClassTable& Get() {
+    static const EncodingClassTable* const table = new EncodingClassTable();
+    return *table;
+  }
+
+  // Returns a random class byte value, weighted by acceptance rate.
+  uint8_t Sample(MutatorRng& rng) const {
+    const uint32_t total = cumulative_weights_.back();
+    // Nothing was accepted while sampling, fall back to a uniform choice.
+    if (total == 0) return RandomIndex(rng, cumulative_weights_.size());
+    const uint32_t r = RandomIndex(rng, total);
+    return std::upper_bound(cumulative_weights_.begin(),
+                            cumulative_weights_.end(), r) -
+           cumulative_weights_.begin();
+  }
+
+ private:
+  // Number of random encodings decoded for each class byte value. Classes
+  // accepting fewer than about 1 in kProbesPerClass encodings are likely to
+  // be left out of the table.
+  static constexpr size_t kProbesPerClass = 64;
+
+  EncodingClassTable() {
+    // A fixed seed keeps the table, and so the mutator, deterministic.
+    MutatorRng rng(0);
+    InstructionByteBuffer<Arch> bytes;
+    Instruction<Arch> instruction;
+    uint32_t total = 0;
+    for (size_t c = 0; c < cumulative_weights_.size(); ++c) {
+      for (size_t i = 0; i < kProbesPerClass; ++i) {
+        RandomizeBuffer(rng, bytes);
+        bytes[kEncodingClassByte<Arch>] = c;
+        total += InstructionFromBytes(bytes, sizeof(bytes), instruction);
+      }
+      cumulative_weights_[c] = total;
+    }
+  }
+
+  // Running sum of the number of accepted probes for class byte values up to
+  // and including the index.
+  std::array<uint32_t, 256> cumulative_weights_;
+};
+
 void CopyOrRandomizeInstructionDisplacementBoundary(
     MutatorRng& rng, const InstructionDisplacementInfo& original,
     InstructionDisplacementInfo& mutated, size_t num_boundaries) {
@@ -163,11 +230,13 @@ template <typename Arch>
 bool GenerateRandomInstruction(MutatorRng& rng,
                                Instruction<Arch>& instruction) {
   InstructionByteBuffer<Arch> bytes;
+  const EncodingClassTable<Arch>& classes = EncodingClassTable<Arch>::Get();
   // It may take us a few tries to find a random set of bytes that decompile.
   // In theory this could be an infinite loop, but it's implemented as a finite
   // loop to limit the worst case behavior.
   for (size_t i = 0; i < 64; ++i) {
     RandomizeBuffer(rng, bytes);
+    bytes[kEncodingClassByte<Arch>] = classes.Sample(rng);
     if (InstructionFromBytes(bytes, sizeof(bytes), instruction)) return true;
   }
   return false;
@@ -242,6 +311,62 @@ template bool RemoveRandomInstruction(MutatorRng& rng,
 template bool RemoveRandomInstruction(MutatorRng& rng,
                                       Program<AArch64>& program);
 
+template <typename Arch>
+bool SwapRandomInstructions(MutatorRng& rng, Program<Arch>& program) {
+  if (program.NumInstructions() < 2) return false;
+
+  size_t a = program.RandomInstructionIndex(rng);
+  // Pick a different instruction without bias.
+  size_t b = RandomIndex(rng, program.NumInstructions() - 1);
+  if (b >= a) ++b;
+
+  // Branches keep pointing at the same instruction boundaries.
+  Instruction<Arch> insn_a = program.GetInstruction(a);
+  Instruction<Arch> insn_b = program.GetInstruction(b);
+  program.SetInstruction(a, insn_b);
+  program.SetInstruction(b, insn_a);
+  return true;
+}
+
+template bool SwapRandomInstructions(MutatorRng& rng,
+                                     Program<X86_64>& program);
+template bool SwapRandomInstructions(MutatorRng& rng,
+                                     Program<AArch64>& program);
+
+template <typename Arch>
+bool CrossoverRandomInstructions(MutatorRng& rng, const Program<Arch>& donor,
+                                 Program<Arch>& program) {
+  if (donor.NumInstructions() == 0) return false;
+
+  // Short runs keep this a mutation rather than a concatenation of programs.
+  constexpr size_t kMaxRunLength = 8;
+  size_t begin = RandomIndex(rng, donor.NumInstructions());
+  size_t max_length = std::min(kMaxRunLength, donor.NumInstructions() - begin);
+  size_t length = RandomIndex(rng, max_length) + 1;
+
+  size_t insert_boundary = program.RandomInstructionBoundary(rng);
+  bool steal_displacements = RandomIndex(rng, 2);
+  for (size_t i = 0; i < length; ++i) {
+    Instruction<Arch> insn = donor.GetInstruction(begin + i);
+    // The donor's instruction boundaries mean nothing in this program.
+    RandomizeInstructionDisplacementBoundaries(
+        rng, insn, program.NumInstructionBoundaries() + 1);
+    // Only the first instruction of the run may steal displacements. The rest
+    // are inserted before the instruction that originally followed the
+    // boundary and must leave displacements to it alone.
+    program.InsertInstruction(insert_boundary + i,
+                              steal_displacements && i == 0, insn);
+  }
+  return true;
+}
+
+template bool CrossoverRandomInstructions(MutatorRng& rng,
+                                          const Program<X86_64>& donor,
+                                          Program<X86_64>& program);
+template bool CrossoverRandomInstructions(MutatorRng& rng,
+                                          const Program<AArch64>& donor,
+                                          Program<AArch64>& program);
+
 // Throw away instruction until we're under the length limit.
 template <typename Arch>
 bool LimitProgramLength(MutatorRng& rng, Program<Arch>& program,
@@ -38,6 +38,21 @@ bool MutateRandomInstruction(MutatorRng& rng, Program<Arch>& program);
 template <typename Arch>
 bool RemoveRandomInstruction(MutatorRng& rng, Program<Arch>& program);
 
+// Swap two random, distinct instructions in the program.
+// Returns `true` if successful, returns `false` if the program contains fewer
+// than two instructions.
+template <typename Arch>
+bool SwapRandomInstructions(MutatorRng& rng, Program<Arch>& program);
+
+// Copy a random run of consecutive instructions from `donor` to a random
+// boundary in the program. The branches in the copied instructions are pointed
+// at random boundaries in the program.
+// Returns `true` if successful, returns `false` if `donor` contains no
+// instructions.
+template <typename Arch>
+bool CrossoverRandomInstructions(MutatorRng& rng, const Program<Arch>& donor,
+                                 Program<Arch>& program);
+
 // Remove instructions until `program.NumBytes()` <= `max_len`.
 // Returns `true` if the program was modified.
 template <typename Arch>
@@ -14,36 +14,38 @@
 
 #include "./fuzzer/program_mutator.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <memory>
 #include <random>
+#include <string>
 #include <vector>
 
+#include "absl/hash/hash.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/types/span.h"
+#include "./fuzzer/mutation_op_scheduler.h"
 #include "./fuzzer/program.h"
 #include "./fuzzer/program_mutation_ops.h"
 #include "./util/arch.h"
+#include "./util/thread_pool.h"
 
 namespace silifuzz {
 
 namespace {
 
 template <typename Arch>
-bool TrySingleMutation(MutatorRng& rng, Program<Arch>& program) {
-  // TODO(ncbray): swap instructions.
-  // TODO(ncbray): copy instruction from other program.
+bool TrySingleMutation(MutatorRng& rng, MutationOp op,
+                       const Program<Arch>& donor, Program<Arch>& program) {
   // TODO(ncbray): copy instruction from dictionary.
-  // TODO(ncbray): crossover.
-
-  // TODO(ncbray): how should these be weighted?
-  std::discrete_distribution<> d({10, 10, 10});
-
-  switch (d(rng)) {
-    case 0:
+  switch (op) {
+    case MutationOp::kInsert:
       return InsertRandomInstruction(rng, program);
-    case 1:
+    case MutationOp::kMutate:
       return MutateRandomInstruction(rng, program);
-    case 2:
+    case MutationOp::kRemove:
       // TODO(ncbray): consider what the best policy is for randomly removing
       // instructions.
       // Removing instructions is tricky to get right.
@@ -59,20 +61,30 @@ bool TrySingleMutation(MutatorRng& rng, Program<Arch>& program) {
         return false;
       }
       return RemoveRandomInstruction(rng, program);
+    case MutationOp::kSwap:
+      return SwapRandomInstructions(rng, program);
+    case MutationOp::kCrossover:
+      return CrossoverRandomInstructions(rng, donor, program);
     default:
       return false;
   }
 }
 
+// Returns the op that was applied, or an empty set if every try failed.
 template <typename Arch>
-void ApplySingleMutation(MutatorRng& rng, Program<Arch>& program) {
+MutationOpSet ApplySingleMutation(MutatorRng& rng,
+                                  const MutationOpScheduler& scheduler,
+                                  const Program<Arch>& donor,
+                                  Program<Arch>& program) {
   // Mutation operations may fail, retry a few times until we succeed.
   for (size_t i = 0; i < 64; i++) {
-    if (TrySingleMutation(rng, program)) {
+    MutationOp op = scheduler.Choose(rng);
+    if (TrySingleMutation(rng, op, donor, program)) {
       program.CheckConsistency();
-      return;
+      return MutationOpBit(op);
     }
   }
+  return 0;
 }
 
 // Centipede expects that mutators will never produce outputs that are zero
@@ -107,44 +119,135 @@ void FinalizeProgram(MutatorRng& rng, Program<Arch>& program, size_t max_len) {
 
 }  // namespace
 
+template <typename Arch>
+const Program<Arch>& ProgramMutator<Arch>::DecodedProgram(
+    const std::vector<uint8_t>& input) {
+  auto [it, inserted] = decoded_programs_.try_emplace(
+      std::string(input.begin(), input.end()));
+  if (inserted) {
+    it->second = Program<Arch>(input);
+  }
+  return it->second;
+}
+
 template <typename Arch>
 void ProgramMutator<Arch>::GenerateSingleOutput(const Program<Arch>& input,
+                                                const Program<Arch>& donor,
                                                 std::vector<uint8_t>& output) {
   // Copy
-  Program<Arch> program = input;
+  Program<Arch>& program = scratch_;
+  program = input;
 
   // Mutate
+  MutationOpSet ops = 0;
   size_t num_mutations = std::uniform_int_distribution<size_t>{1, 3}(rng_);
   for (size_t i = 0; i < num_mutations; ++i) {
-    ApplySingleMutation(rng_, program);
+    ops |= ApplySingleMutation(rng_, scheduler_, donor, program);
   }
 
   // Output
   FinalizeProgram(rng_, program, max_len_);
   program.ToBytes(output);
+
+  // Remember which ops produced the output so they can be credited if it
+  // shows up as an input later.
+  scheduler_.RecordUse(ops);
+  if (mutant_ops_.size() >= kMaxPendingMutants) {
+    mutant_ops_.clear();
+  }
+  mutant_ops_[absl::HashOf(output)] = ops;
+}
+
+template <typename Arch>
+void ProgramMutator<Arch>::CreditInterestingInputs(
+    const std::vector<const std::vector<uint8_t>*>& inputs) {
+  for (const std::vector<uint8_t>* input : inputs) {
+    auto it = mutant_ops_.find(absl::HashOf(*input));
+    if (it == mutant_ops_.end()) continue;
+    scheduler_.RecordSuccess(it->second);
+    // Credit each mutant once, no matter how often it is mutated.
+    mutant_ops_.erase(it);
+  }
 }
 
 template <typename Arch>
 void ProgramMutator<Arch>::Mutate(
     const std::vector<const std::vector<uint8_t>*>& inputs, size_t num_mutants,
     std::vector<std::vector<uint8_t>>& mutants) {
+  Mutate(inputs, absl::MakeSpan(mutants).first(num_mutants));
+}
+
+template <typename Arch>
+void ProgramMutator<Arch>::Mutate(
+    const std::vector<const std::vector<uint8_t>*>& inputs,
+    absl::Span<std::vector<uint8_t>> mutants) {
+  CreditInterestingInputs(inputs);
+
   // Extract the programs from the inputs.
   // Copying a program should be cheaper that re-parsing each instruction for
-  // each mutant.
-  std::vector<Program<Arch>> programs;
+  // each mutant. Start over when the cache is full rather than tracking use;
+  // hot inputs are decoded again soon enough.
+  if (decoded_programs_.size() + inputs.size() > kMaxDecodedPrograms) {
+    decoded_programs_.clear();
+  }
+  std::vector<const Program<Arch>*> programs;
   programs.reserve(inputs.size());
   for (const std::vector<uint8_t>* input : inputs) {
-    programs.push_back(Program<Arch>(*input));
+    programs.push_back(&DecodedProgram(*input));
   }
 
   // Generate the requested mutants.
-  for (size_t i = 0; i < num_mutants; ++i) {
+  for (size_t i = 0; i < mutants.size(); ++i) {
     size_t base = RandomIndex(rng_, inputs.size());
-    GenerateSingleOutput(programs[base], mutants[i]);
+    size_t donor = RandomIndex(rng_, inputs.size());
+    GenerateSingleOutput(*programs[base], *programs[donor], mutants[i]);
   }
 }
 
 template class ProgramMutator<X86_64>;
 template class ProgramMutator<AArch64>;
 
+template <typename Arch>
+ParallelProgramMutator<Arch>::ParallelProgramMutator(uint64_t seed,
+                                                     size_t max_len,
+                                                     int num_threads) {
+  num_threads = std::max(1, num_threads);
+  mutators_.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    mutators_.emplace_back(seed + i, max_len);
+  }
+  if (num_threads > 1) {
+    pool_ = std::make_unique<ThreadPool>(num_threads);
+  }
+}
+
+template <typename Arch>
+void ParallelProgramMutator<Arch>::Mutate(
+    const std::vector<const std::vector<uint8_t>*>& inputs, size_t num_mutants,
+    std::vector<std::vector<uint8_t>>& mutants) {
+  absl::Span<std::vector<uint8_t>> all = absl::MakeSpan(mutants);
+  if (pool_ == nullptr) {
+    mutators_[0].Mutate(inputs, all.first(num_mutants));
+    return;
+  }
+
+  // Each mutator always produces the same slice of the batch, so the output
+  // does not depend on how the threads are scheduled.
+  const size_t num_shards = mutators_.size();
+  absl::BlockingCounter done(num_shards);
+  for (size_t i = 0; i < num_shards; ++i) {
+    size_t begin = num_mutants * i / num_shards;
+    size_t end = num_mutants * (i + 1) / num_shards;
+    absl::Span<std::vector<uint8_t>> shard = all.subspan(begin, end - begin);
+    pool_->Schedule([this, i, &inputs, shard, &done]() {
+      if (!shard.empty()) mutators_[i].Mutate(inputs, shard);
+      done.DecrementCount();
+    });
+  }
+  done.Wait();
+}
+
+template class ParallelProgramMutator<X86_64>;
+template class ParallelProgramMutator<AArch64>;
+
 }  // namespace silifuzz
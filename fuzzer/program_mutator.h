@@ -16,11 +16,19 @@
 #define THIRD_PARTY_SILIFUZZ_FUZZER_PROGRAM_MUTATOR_H_
 
 #include <cstddef>
+#include <cstdint>
 #include <limits>
+#include <memory>
 #include <random>
+#include <string>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/types/span.h"
+#include "./fuzzer/mutation_op_scheduler.h"
 #include "./fuzzer/program.h"
+#include "./util/thread_pool.h"
 
 namespace silifuzz {
 
@@ -31,15 +39,84 @@ class ProgramMutator {
                  size_t max_len = std::numeric_limits<size_t>::max())
       : rng_(seed), max_len_(max_len) {}
 
+  // Generates `num_mutants` mutants of `inputs` into `mutants`, reusing the
+  // buffers of `mutants`. Inputs are decoded once and the decoded programs
+  // are kept across calls, as the same inputs tend to be mutated many times.
+  //
+  // Mutation ops are scheduled adaptively. Centipede only passes inputs from
+  // its corpus to Mutate(), so a mutant showing up as an input means it added
+  // coverage and the ops that produced it are chosen more often from then on.
   void Mutate(const std::vector<const std::vector<uint8_t> *> &inputs,
               size_t num_mutants, std::vector<std::vector<uint8_t>> &mutants);
 
+  // Like above, but generates as many mutants as `mutants` holds.
+  void Mutate(const std::vector<const std::vector<uint8_t> *> &inputs,
+              absl::Span<std::vector<uint8_t>> mutants);
+
+  const MutationOpScheduler &scheduler() const { return scheduler_; }
+
  private:
+  // Maximum number of decoded programs kept across calls to Mutate().
+  static constexpr size_t kMaxDecodedPrograms = 4096;
+
+  // Maximum number of recent mutants remembered for crediting their ops.
+  static constexpr size_t kMaxPendingMutants = 1 << 16;
+
+  // Returns the decoded program of `input`, decoding it if it is not cached.
+  const Program<Arch> &DecodedProgram(const std::vector<uint8_t> &input);
+
+  // Credits the ops that produced any of `inputs` with a success.
+  void CreditInterestingInputs(
+      const std::vector<const std::vector<uint8_t> *> &inputs);
+
+  // Mutates `input` into `output`, using `donor` for crossover.
   void GenerateSingleOutput(const Program<Arch> &input,
+                            const Program<Arch> &donor,
                             std::vector<uint8_t> &output);
 
   MutatorRng rng_;
   size_t max_len_;
+
+  // Decoded programs keyed by their input bytes. Node-based so that programs
+  // stay in place while more inputs are decoded.
+  absl::node_hash_map<std::string, Program<Arch>> decoded_programs_;
+
+  MutationOpScheduler scheduler_;
+
+  // Ops used to produce recent mutants, keyed by the hash of the mutant.
+  absl::flat_hash_map<size_t, MutationOpSet> mutant_ops_;
+
+  // Program being mutated. Kept to reuse its memory for the next mutant.
+  Program<Arch> scratch_;
+};
+
+// Splits each batch of mutants between `num_threads` ProgramMutators, one per
+// thread. Mutator i is seeded with `seed` + i and always produces the same
+// slice of the batch, so the output is deterministic for a given seed and
+// number of threads. With a single thread this behaves exactly like a
+// ProgramMutator seeded with `seed`.
+//
+// This class is thread-compatible.
+template <typename Arch>
+class ParallelProgramMutator {
+ public:
+  ParallelProgramMutator(uint64_t seed,
+                         size_t max_len = std::numeric_limits<size_t>::max(),
+                         int num_threads = 1);
+
+  // Not copyable or movable, the worker threads refer to the mutators.
+  ParallelProgramMutator(const ParallelProgramMutator &) = delete;
+  ParallelProgramMutator &operator=(const ParallelProgramMutator &) = delete;
+
+  // See ProgramMutator::Mutate().
+  void Mutate(const std::vector<const std::vector<uint8_t> *> &inputs,
+              size_t num_mutants, std::vector<std::vector<uint8_t>> &mutants);
+
+ private:
+  std::vector<ProgramMutator<Arch>> mutators_;
+
+  // Null if there is a single mutator, which then runs on the calling thread.
+  std::unique_ptr<ThreadPool> pool_;
 };
 
 }  // namespace silifuzz
@@ -0,0 +1,146 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures Program<Arch> operations and ProgramMutator::Mutate() on random
+// programs of varying numbers of instructions.
+//
+// To run:
+//
+// bazel run -c opt third_party/silifuzz/fuzzer:program_mutator_benchmark
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "./fuzzer/program.h"
+#include "./fuzzer/program_mutation_ops.h"
+#include "./fuzzer/program_mutator.h"
+#include "./util/arch.h"
+
+namespace silifuzz {
+namespace {
+
+// Mutants generated per call of Mutate(), as for a typical Centipede batch.
+constexpr size_t kMutantsPerBatch = 64;
+
+// Inputs passed to each call of Mutate().
+constexpr size_t kInputsPerBatch = 16;
+
+// Returns the bytes of a random program with `num_instructions`
+// instructions. The program is the same for a given `seed`.
+template <typename Arch>
+std::vector<uint8_t> RandomProgramBytes(size_t num_instructions,
+                                        uint64_t seed = 0) {
+  MutatorRng rng(seed);
+  Program<Arch> program;
+  while (program.NumInstructions() < num_instructions) {
+    InsertRandomInstruction(rng, program);
+  }
+  program.FixupEncodedDisplacements(rng);
+  std::vector<uint8_t> bytes;
+  program.ToBytes(bytes);
+  return bytes;
+}
+
+template <typename Arch>
+void BM_ProgramFromBytes(benchmark::State& state) {
+  const std::vector<uint8_t> bytes = RandomProgramBytes<Arch>(state.range(0));
+  for (auto _ : state) {
+    Program<Arch> program(bytes.data(), bytes.size());
+    benchmark::DoNotOptimize(program);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * bytes.size());
+}
+BENCHMARK_TEMPLATE(BM_ProgramFromBytes, X86_64)->Range(16, 1024);
+BENCHMARK_TEMPLATE(BM_ProgramFromBytes, AArch64)->Range(16, 1024);
+
+// Inserts an instruction and removes it again, so that the program keeps its
+// length.
+template <typename Arch>
+void BM_InsertRemoveInstruction(benchmark::State& state) {
+  const std::vector<uint8_t> bytes = RandomProgramBytes<Arch>(state.range(0));
+  Program<Arch> program(bytes.data(), bytes.size());
+  const Instruction<Arch> insn = program.GetInstruction(0);
+  MutatorRng rng(0);
+  for (auto _ : state) {
+    const size_t boundary = program.RandomInstructionBoundary(rng);
+    program.InsertInstruction(boundary, rng() & 1, insn);
+    program.RemoveInstruction(boundary);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_InsertRemoveInstruction, X86_64)->Range(16, 1024);
+BENCHMARK_TEMPLATE(BM_InsertRemoveInstruction, AArch64)->Range(16, 1024);
+
+// Fixes up a program after a random instruction was inserted, as after most
+// mutations. Only FixupEncodedDisplacements() is timed.
+template <typename Arch>
+void BM_FixupEncodedDisplacements(benchmark::State& state) {
+  const std::vector<uint8_t> bytes = RandomProgramBytes<Arch>(state.range(0));
+  const Program<Arch> original(bytes.data(), bytes.size());
+  MutatorRng rng(0);
+  for (auto _ : state) {
+    state.PauseTiming();
+    Program<Arch> program = original;
+    InsertRandomInstruction(rng, program);
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(program.FixupEncodedDisplacements(rng));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_FixupEncodedDisplacements, X86_64)->Range(16, 1024);
+BENCHMARK_TEMPLATE(BM_FixupEncodedDisplacements, AArch64)->Range(16, 1024);
+
+template <typename Arch>
+void BM_ToBytes(benchmark::State& state) {
+  const std::vector<uint8_t> bytes = RandomProgramBytes<Arch>(state.range(0));
+  const Program<Arch> program(bytes.data(), bytes.size());
+  std::vector<uint8_t> output;
+  for (auto _ : state) {
+    program.ToBytes(output);
+    benchmark::DoNotOptimize(output.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(state.iterations() * bytes.size());
+}
+BENCHMARK_TEMPLATE(BM_ToBytes, X86_64)->Range(16, 1024);
+BENCHMARK_TEMPLATE(BM_ToBytes, AArch64)->Range(16, 1024);
+
+// Generates batches of mutants from the same inputs, like repeated calls from
+// Centipede do. items_per_second is mutants per second.
+template <typename Arch>
+void BM_Mutate(benchmark::State& state) {
+  std::vector<std::vector<uint8_t>> input_bytes;
+  for (size_t i = 0; i < kInputsPerBatch; ++i) {
+    input_bytes.push_back(RandomProgramBytes<Arch>(state.range(0), i));
+  }
+  std::vector<const std::vector<uint8_t>*> inputs;
+  for (const std::vector<uint8_t>& input : input_bytes) {
+    inputs.push_back(&input);
+  }
+  ProgramMutator<Arch> mutator(0);
+  std::vector<std::vector<uint8_t>> mutants;
+  for (auto _ : state) {
+    mutator.Mutate(inputs, kMutantsPerBatch, mutants);
+    benchmark::DoNotOptimize(mutants.data());
+  }
+  state.SetItemsProcessed(state.iterations() * kMutantsPerBatch);
+}
+BENCHMARK_TEMPLATE(BM_Mutate, X86_64)->Range(16, 1024);
+BENCHMARK_TEMPLATE(BM_Mutate, AArch64)->Range(16, 1024);
+
+}  // namespace
+}  // namespace silifuzz
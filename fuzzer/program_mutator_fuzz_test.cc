@@ -42,7 +42,7 @@ template <typename Arch>
 void DumpProgram(const Program<Arch> &program) {
   for (size_t i = 0; i < program.NumInstructions(); ++i) {
     const Instruction<Arch> &insn = program.GetInstruction(i);
-    printf("%03zu %04lx", i, insn.offset);
+    printf("%03zu %04x", i, insn.offset);
     DumpData(insn.encoded.data(), insn.encoded.size());
   }
 }
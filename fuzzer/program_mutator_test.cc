@@ -20,9 +20,11 @@
 #include <vector>
 
 #include "gtest/gtest.h"
+#include "./fuzzer/mutation_op_scheduler.h"
 #include "./fuzzer/program.h"
 #include "./fuzzer/program_arch.h"
 #include "./fuzzer/program_mutation_ops.h"
+#include "./fuzzer/program_mutator.h"
 #include "./util/arch.h"
 
 namespace silifuzz {
@@ -898,6 +900,164 @@ TEST(Program_X86_64, ModifiedNonCanonicalJNSCrosslink) {
   EXPECT_EQ(ToBytes(p), expected);
 }
 
+TEST(ProgramMutationOps_X86_64, InsertRandomInstruction) {
+  MutatorRng rng(0);
+  Program<X86_64> p;
+  for (size_t i = 0; i < 100; ++i) {
+    EXPECT_TRUE(InsertRandomInstruction(rng, p));
+  }
+  EXPECT_EQ(p.NumInstructions(), 100);
+}
+
+TEST(ProgramMutationOps_AArch64, InsertRandomInstruction) {
+  MutatorRng rng(0);
+  Program<AArch64> p;
+  for (size_t i = 0; i < 100; ++i) {
+    EXPECT_TRUE(InsertRandomInstruction(rng, p));
+  }
+  EXPECT_EQ(p.NumInstructions(), 100);
+}
+
+TEST(ProgramMutationOps_AArch64, SwapRandomInstructions) {
+  MutatorRng rng(0);
+  std::vector<uint8_t> bytes = FromInts({kAArch64NOP, kAArch64TbzNext});
+  Program<AArch64> p(bytes, true);
+  EXPECT_TRUE(SwapRandomInstructions(rng, p));
+  p.CheckConsistency();
+  EXPECT_EQ(p.NumInstructions(), 2);
+
+  p.RemoveInstruction(0);
+  EXPECT_FALSE(SwapRandomInstructions(rng, p));
+}
+
+TEST(ProgramMutationOps_AArch64, CrossoverRandomInstructions) {
+  MutatorRng rng(0);
+  std::vector<uint8_t> donor_bytes = FromInts({kAArch64TbzNext, kAArch64NOP});
+  Program<AArch64> donor(donor_bytes, true);
+  Program<AArch64> p;
+  for (size_t i = 0; i < 10; ++i) {
+    size_t old_size = p.NumInstructions();
+    EXPECT_TRUE(CrossoverRandomInstructions(rng, donor, p));
+    p.CheckConsistency();
+    EXPECT_GT(p.NumInstructions(), old_size);
+    EXPECT_LE(p.NumInstructions(), old_size + donor.NumInstructions());
+  }
+
+  Program<AArch64> empty;
+  EXPECT_FALSE(CrossoverRandomInstructions(rng, empty, p));
+}
+
+TEST(MutationOpScheduler, Weights) {
+  MutationOpScheduler scheduler;
+  for (size_t i = 0; i < kNumMutationOps; ++i) {
+    // Untried ops are equally likely.
+    EXPECT_DOUBLE_EQ(scheduler.Weight(static_cast<MutationOp>(i)),
+                     1.0 / kNumMutationOps);
+  }
+
+  for (size_t i = 0; i < 100; ++i) {
+    scheduler.RecordUse(MutationOpBit(MutationOp::kInsert) |
+                        MutationOpBit(MutationOp::kSwap));
+    scheduler.RecordUse(MutationOpBit(MutationOp::kRemove));
+  }
+  for (size_t i = 0; i < 50; ++i) {
+    scheduler.RecordSuccess(MutationOpBit(MutationOp::kInsert));
+  }
+  EXPECT_EQ(scheduler.uses(MutationOp::kInsert), 100);
+  EXPECT_EQ(scheduler.successes(MutationOp::kInsert), 50);
+  EXPECT_EQ(scheduler.successes(MutationOp::kSwap), 0);
+
+  // Successful ops are preferred over unsuccessful ones, but nothing is
+  // starved.
+  EXPECT_GT(scheduler.Weight(MutationOp::kInsert),
+            scheduler.Weight(MutationOp::kSwap));
+  EXPECT_GT(scheduler.Weight(MutationOp::kSwap), 0.0);
+  EXPECT_DOUBLE_EQ(scheduler.Weight(MutationOp::kSwap),
+                   scheduler.Weight(MutationOp::kRemove));
+  double total = 0.0;
+  for (size_t i = 0; i < kNumMutationOps; ++i) {
+    total += scheduler.Weight(static_cast<MutationOp>(i));
+  }
+  EXPECT_DOUBLE_EQ(total, 1.0);
+
+  // Successes never exceed uses.
+  for (size_t i = 0; i < 100; ++i) {
+    scheduler.RecordSuccess(MutationOpBit(MutationOp::kCrossover));
+  }
+  EXPECT_EQ(scheduler.successes(MutationOp::kCrossover), 0);
+}
+
+TEST(ProgramMutator_AArch64, CreditsInterestingMutants) {
+  constexpr size_t kMaxLen = 64;
+  ProgramMutator<AArch64> mutator(0, kMaxLen);
+  const std::vector<uint8_t> two_nops = FromInts({kAArch64NOP, kAArch64NOP});
+  std::vector<std::vector<uint8_t>> mutants(10);
+  mutator.Mutate({&two_nops}, mutants.size(), mutants);
+
+  auto total_successes = [&mutator]() {
+    uint64_t total = 0;
+    for (size_t i = 0; i < kNumMutationOps; ++i) {
+      total += mutator.scheduler().successes(static_cast<MutationOp>(i));
+    }
+    return total;
+  };
+  EXPECT_EQ(total_successes(), 0);
+
+  // Pretend the first mutant was added to the corpus.
+  const std::vector<uint8_t> interesting = mutants[0];
+  std::vector<std::vector<uint8_t>> more_mutants(10);
+  mutator.Mutate({&interesting}, more_mutants.size(), more_mutants);
+  EXPECT_GT(total_successes(), 0);
+}
+
+TEST(ProgramMutator_AArch64, MutateRepeatedInputs) {
+  constexpr size_t kMaxLen = 64;
+  ProgramMutator<AArch64> mutator(0, kMaxLen);
+  const std::vector<uint8_t> one_nop = FromInts({kAArch64NOP});
+  const std::vector<uint8_t> two_nops = FromInts({kAArch64NOP, kAArch64NOP});
+  const std::vector<const std::vector<uint8_t>*> inputs = {&one_nop, &two_nops};
+
+  // The second and later calls mutate cached programs.
+  std::vector<std::vector<uint8_t>> mutants(10);
+  for (int i = 0; i < 3; ++i) {
+    mutator.Mutate(inputs, mutants.size(), mutants);
+    for (const std::vector<uint8_t>& mutant : mutants) {
+      EXPECT_GT(mutant.size(), 0);
+      EXPECT_LE(mutant.size(), kMaxLen);
+      EXPECT_EQ(mutant.size() % 4, 0);
+    }
+  }
+}
+
+TEST(ParallelProgramMutator_AArch64, Deterministic) {
+  constexpr size_t kMaxLen = 64;
+  constexpr size_t kNumMutants = 100;
+  const std::vector<uint8_t> one_nop = FromInts({kAArch64NOP});
+  const std::vector<uint8_t> two_nops = FromInts({kAArch64NOP, kAArch64NOP});
+  const std::vector<const std::vector<uint8_t>*> inputs = {&one_nop, &two_nops};
+
+  auto generate = [&](int num_threads) {
+    ParallelProgramMutator<AArch64> mutator(0, kMaxLen, num_threads);
+    std::vector<std::vector<uint8_t>> mutants(kNumMutants);
+    mutator.Mutate(inputs, mutants.size(), mutants);
+    return mutants;
+  };
+
+  // A single thread matches the sequential mutator.
+  ProgramMutator<AArch64> sequential(0, kMaxLen);
+  std::vector<std::vector<uint8_t>> expected(kNumMutants);
+  sequential.Mutate(inputs, expected.size(), expected);
+  EXPECT_EQ(generate(1), expected);
+
+  std::vector<std::vector<uint8_t>> parallel = generate(4);
+  EXPECT_EQ(generate(4), parallel);
+  for (const std::vector<uint8_t>& mutant : parallel) {
+    EXPECT_GT(mutant.size(), 0);
+    EXPECT_LE(mutant.size(), kMaxLen);
+    EXPECT_EQ(mutant.size() % 4, 0);
+  }
+}
+
 }  // namespace
 
 }  // namespace silifuzz
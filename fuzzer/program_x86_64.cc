@@ -14,10 +14,12 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <optional>
 
 #include "absl/log/check.h"
 #include "./fuzzer/program.h"
 #include "./fuzzer/program_arch.h"  // IWYU pragma: keep
+#include "./fuzzer/x86_64_fast_decode.h"
 #include "./instruction/xed_util.h"
 #include "./util/arch.h"
 
@@ -43,9 +45,9 @@ InstructionDisplacementInfo GetDirectBranchInfo(
   InstructionDisplacementInfo info{};
   if (xed_decoded_inst_get_branch_displacement_width(&xedd) > 0) {
     // Arch-specific displacements are relative to the end of the instruction.
-    info.encoded_byte_displacement =
-        xed_decoded_inst_get_branch_displacement(&xedd) +
-        xed_decoded_inst_get_length(&xedd);
+    info.encoded_byte_displacement = SaturateByteDisplacement(
+        static_cast<int64_t>(xed_decoded_inst_get_branch_displacement(&xedd)) +
+        xed_decoded_inst_get_length(&xedd));
     // The instruction index will be resolved later.
   }
   return info;
@@ -106,6 +108,19 @@ template <>
 bool InstructionFromBytes(const uint8_t* bytes, size_t num_bytes,
                           Instruction<X86_64>& instruction,
                           bool must_decode_everything) {
+  // Most instructions of a fuzzed program are simple enough to decode without
+  // XED.
+  if (std::optional<X86_64FastDecodeResult> fast =
+          FastDecodeX86_64(bytes, num_bytes)) {
+    instruction.encoded.Copy(bytes, fast->length);
+    instruction.direct_branch = InstructionDisplacementInfo{};
+    if (fast->branch_displacement_size > 0) {
+      instruction.direct_branch.encoded_byte_displacement =
+          SaturateByteDisplacement(fast->branch_displacement + fast->length);
+    }
+    return !must_decode_everything || fast->length == num_bytes;
+  }
+
   // On decode failure, we want the length to be zero.
   instruction.encoded.Clear();
 
@@ -33,6 +33,9 @@
 
 ABSL_FLAG(silifuzz::ArchitectureId, arch, silifuzz::ArchitectureId::kUndefined,
           "Architecture for instruction-aware fuzzing.");
+ABSL_FLAG(int, mutator_threads, 1,
+          "Number of threads used to generate each batch of mutants. The "
+          "mutants are deterministic for a given seed and number of threads.");
 
 namespace silifuzz {
 
@@ -43,8 +46,10 @@ class SilifuzzCentipedeCallbacks : public centipede::CentipedeDefaultCallbacks {
   SilifuzzCentipedeCallbacks(const centipede::Environment &env)
       : CentipedeDefaultCallbacks(env),
         arch_(absl::GetFlag(FLAGS_arch)),
-        x86_64_mutator_(centipede::GetRandomSeed(env.seed), env.max_len),
-        aarch64_mutator_(centipede::GetRandomSeed(env.seed), env.max_len) {}
+        x86_64_mutator_(centipede::GetRandomSeed(env.seed), env.max_len,
+                        absl::GetFlag(FLAGS_mutator_threads)),
+        aarch64_mutator_(centipede::GetRandomSeed(env.seed), env.max_len,
+                         absl::GetFlag(FLAGS_mutator_threads)) {}
 
   void Mutate(const std::vector<centipede::MutationInputRef> &inputs,
               size_t num_mutants, std::vector<centipede::ByteArray> &mutants) {
@@ -80,8 +85,8 @@ class SilifuzzCentipedeCallbacks : public centipede::CentipedeDefaultCallbacks {
 
  private:
   ArchitectureId arch_;
-  ProgramMutator<X86_64> x86_64_mutator_;
-  ProgramMutator<AArch64> aarch64_mutator_;
+  ParallelProgramMutator<X86_64> x86_64_mutator_;
+  ParallelProgramMutator<AArch64> aarch64_mutator_;
 };
 
 }  // namespace silifuzz
@@ -0,0 +1,215 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_FUZZER_X86_64_FAST_DECODE_H_
+#define THIRD_PARTY_SILIFUZZ_FUZZER_X86_64_FAST_DECODE_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+
+namespace silifuzz {
+
+// What FastDecodeX86_64() knows about an instruction.
+struct X86_64FastDecodeResult {
+  // Length of the instruction in bytes.
+  uint8_t length;
+
+  // Size in bytes of the relative branch displacement, 0 if there is none.
+  // The displacement is the last `branch_displacement_size` bytes of the
+  // instruction.
+  uint8_t branch_displacement_size;
+
+  // The branch displacement relative to the end of the instruction, as XED
+  // reports it. 0 if branch_displacement_size is 0.
+  int64_t branch_displacement;
+};
+
+namespace x86_64_fast_decode_internal {
+
+struct OpcodeInfo {
+  // The opcode is handled by FastDecodeX86_64().
+  bool supported = false;
+
+  // A ModRM byte follows the opcode.
+  bool has_modrm = false;
+
+  // Size of the immediate in bytes.
+  uint8_t imm_size = 0;
+
+  // The immediate is 8 bytes with REX.W (mov r64, imm64).
+  bool imm_size_8_with_rex_w = false;
+
+  // The immediate is a relative branch displacement.
+  bool imm_is_branch_displacement = false;
+};
+
+using OpcodeTable = std::array<OpcodeInfo, 256>;
+
+// Opcodes of the one-byte map that are valid in 64-bit mode, are
+// deterministic user space instructions and have no opcode extension in the
+// ModRM byte. ALU ops, push/pop, mov, xchg, test, jcc, jmp, call and ret.
+constexpr OpcodeTable MakeOneByteOpcodeTable() {
+  OpcodeTable table{};
+  // add, or, adc, sbb, and, sub, xor, cmp.
+  for (int op = 0x00; op <= 0x38; op += 0x08) {
+    for (int i = 0; i < 4; ++i) {
+      table[op + i] = {.supported = true, .has_modrm = true};
+    }
+    table[op + 4] = {.supported = true, .imm_size = 1};
+    table[op + 5] = {.supported = true, .imm_size = 4};
+  }
+  // push r64, pop r64.
+  for (int op = 0x50; op <= 0x5f; ++op) {
+    table[op] = {.supported = true};
+  }
+  // jcc rel8.
+  for (int op = 0x70; op <= 0x7f; ++op) {
+    table[op] = {.supported = true,
+                 .imm_size = 1,
+                 .imm_is_branch_displacement = true};
+  }
+  // test, xchg, mov r/m.
+  for (int op = 0x84; op <= 0x8b; ++op) {
+    table[op] = {.supported = true, .has_modrm = true};
+  }
+  // nop, xchg rax.
+  for (int op = 0x90; op <= 0x97; ++op) {
+    table[op] = {.supported = true};
+  }
+  // mov r8, imm8 and mov r, imm.
+  for (int op = 0xb0; op <= 0xb7; ++op) {
+    table[op] = {.supported = true, .imm_size = 1};
+  }
+  for (int op = 0xb8; op <= 0xbf; ++op) {
+    table[op] = {
+        .supported = true, .imm_size = 4, .imm_size_8_with_rex_w = true};
+  }
+  // ret.
+  table[0xc3] = {.supported = true};
+  // call rel32, jmp rel32, jmp rel8.
+  table[0xe8] = {.supported = true,
+                 .imm_size = 4,
+                 .imm_is_branch_displacement = true};
+  table[0xe9] = {.supported = true,
+                 .imm_size = 4,
+                 .imm_is_branch_displacement = true};
+  table[0xeb] = {.supported = true,
+                 .imm_size = 1,
+                 .imm_is_branch_displacement = true};
+  return table;
+}
+
+// Opcodes of the 0x0f map, see MakeOneByteOpcodeTable(). cmovcc, jcc rel32,
+// movzx and movsx.
+constexpr OpcodeTable MakeTwoByteOpcodeTable() {
+  OpcodeTable table{};
+  for (int op = 0x40; op <= 0x4f; ++op) {
+    table[op] = {.supported = true, .has_modrm = true};
+  }
+  for (int op = 0x80; op <= 0x8f; ++op) {
+    table[op] = {.supported = true,
+                 .imm_size = 4,
+                 .imm_is_branch_displacement = true};
+  }
+  for (int op : {0xb6, 0xb7, 0xbe, 0xbf}) {
+    table[op] = {.supported = true, .has_modrm = true};
+  }
+  return table;
+}
+
+inline constexpr OpcodeTable kOneByteOpcodes = MakeOneByteOpcodeTable();
+inline constexpr OpcodeTable kTwoByteOpcodes = MakeTwoByteOpcodeTable();
+
+}  // namespace x86_64_fast_decode_internal
+
+// Decodes the most common x86_64 instructions without XED: an optional REX
+// prefix followed by an opcode from the tables above. Every instruction it
+// decodes decodes the same with XED and passes the filters in
+// InstructionFromBytes<X86_64>().
+// Returns nullopt when the bytes are anything else, including other prefixes
+// and truncated instructions, in which case the caller must use XED.
+constexpr std::optional<X86_64FastDecodeResult> FastDecodeX86_64(
+    const uint8_t* bytes, size_t num_bytes) {
+  using x86_64_fast_decode_internal::kOneByteOpcodes;
+  using x86_64_fast_decode_internal::kTwoByteOpcodes;
+  using x86_64_fast_decode_internal::OpcodeInfo;
+  using x86_64_fast_decode_internal::OpcodeTable;
+
+  size_t pos = 0;
+  bool rex_w = false;
+  if (pos < num_bytes && (bytes[pos] & 0xf0) == 0x40) {
+    rex_w = bytes[pos] & 0x08;
+    ++pos;
+  }
+  if (pos >= num_bytes) return std::nullopt;
+  const OpcodeTable* table = &kOneByteOpcodes;
+  if (bytes[pos] == 0x0f) {
+    table = &kTwoByteOpcodes;
+    ++pos;
+    if (pos >= num_bytes) return std::nullopt;
+  }
+  const OpcodeInfo& info = (*table)[bytes[pos]];
+  if (!info.supported) return std::nullopt;
+  ++pos;
+
+  if (info.has_modrm) {
+    if (pos >= num_bytes) return std::nullopt;
+    const uint8_t modrm = bytes[pos++];
+    const uint8_t mod = modrm >> 6;
+    const uint8_t rm = modrm & 7;
+    if (mod != 3) {
+      if (rm == 4) {
+        if (pos >= num_bytes) return std::nullopt;
+        const uint8_t sib = bytes[pos++];
+        // No base register, disp32 instead.
+        if (mod == 0 && (sib & 7) == 5) pos += 4;
+      } else if (mod == 0 && rm == 5) {
+        // RIP-relative disp32.
+        pos += 4;
+      }
+      if (mod == 1) pos += 1;
+      if (mod == 2) pos += 4;
+    }
+  }
+
+  const size_t imm_size =
+      rex_w && info.imm_size_8_with_rex_w ? 8 : info.imm_size;
+  pos += imm_size;
+  if (pos > num_bytes) return std::nullopt;
+
+  X86_64FastDecodeResult result = {
+      .length = static_cast<uint8_t>(pos),
+      .branch_displacement_size = 0,
+      .branch_displacement = 0,
+  };
+  if (info.imm_is_branch_displacement) {
+    // Little endian, sign-extended.
+    uint64_t displacement = 0;
+    for (size_t i = 0; i < imm_size; ++i) {
+      displacement |= uint64_t{bytes[pos - imm_size + i]} << (8 * i);
+    }
+    const int shift = 64 - 8 * imm_size;
+    result.branch_displacement_size = imm_size;
+    result.branch_displacement =
+        static_cast<int64_t>(displacement << shift) >> shift;
+  }
+  return result;
+}
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_FUZZER_X86_64_FAST_DECODE_H_
@@ -0,0 +1,150 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./fuzzer/x86_64_fast_decode.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./instruction/xed_util.h"
+
+extern "C" {
+#include "third_party/libxed/xed-address-width-enum.h"
+#include "third_party/libxed/xed-decode.h"
+#include "third_party/libxed/xed-decoded-inst-api.h"
+#include "third_party/libxed/xed-decoded-inst.h"
+#include "third_party/libxed/xed-error-enum.h"
+#include "third_party/libxed/xed-machine-mode-enum.h"
+}
+
+namespace silifuzz {
+
+namespace {
+
+// Checks that FastDecodeX86_64() either declines `bytes` or agrees with XED.
+// Sets `decoded` if FastDecodeX86_64() did decode.
+void CheckAgainstXed(const std::vector<uint8_t>& bytes, bool& decoded) {
+  std::optional<X86_64FastDecodeResult> fast =
+      FastDecodeX86_64(bytes.data(), bytes.size());
+  decoded = fast.has_value();
+  if (!decoded) return;
+
+  xed_decoded_inst_t xedd;
+  xed_decoded_inst_zero(&xedd);
+  xed_decoded_inst_set_mode(&xedd, XED_MACHINE_MODE_LONG_64,
+                            XED_ADDRESS_WIDTH_64b);
+  ASSERT_EQ(xed_decode(&xedd, bytes.data(), bytes.size()), XED_ERROR_NONE);
+  EXPECT_EQ(fast->length, xed_decoded_inst_get_length(&xedd));
+  EXPECT_EQ(fast->branch_displacement_size,
+            xed_decoded_inst_get_branch_displacement_width(&xedd));
+  if (fast->branch_displacement_size > 0) {
+    EXPECT_EQ(fast->branch_displacement,
+              xed_decoded_inst_get_branch_displacement(&xedd));
+  }
+  EXPECT_TRUE(InstructionIsDeterministicInRunner(xedd));
+  EXPECT_TRUE(InstructionCanRunInUserSpace(xedd));
+  EXPECT_FALSE(InstructionRequiresIOPrivileges(xedd));
+}
+
+TEST(FastDecodeX86_64, AgreesWithXedOnSupportedOpcodes) {
+  InitXedIfNeeded();
+  // ModRM forms: register, [reg], [rip+disp32], [reg+disp8], [reg+disp32],
+  // SIB, SIB without base, SIB with disp8.
+  const std::vector<std::vector<uint8_t>> kModRMs = {
+      {0xc1}, {0x00}, {0x05}, {0x41}, {0x81},
+      {0x04, 0x48}, {0x04, 0x25}, {0x44, 0x48},
+  };
+  // Enough bytes for any displacement and immediate, with the sign bit set
+  // to check sign extension.
+  const std::vector<uint8_t> kTail(12, 0xf8);
+  int num_decoded = 0;
+  for (std::optional<uint8_t> rex :
+       {std::optional<uint8_t>(), std::optional<uint8_t>(0x40),
+        std::optional<uint8_t>(0x48), std::optional<uint8_t>(0x4d)}) {
+    for (bool two_byte : {false, true}) {
+      for (int opcode = 0; opcode < 256; ++opcode) {
+        for (const std::vector<uint8_t>& modrm : kModRMs) {
+          std::vector<uint8_t> bytes;
+          if (rex.has_value()) bytes.push_back(*rex);
+          if (two_byte) bytes.push_back(0x0f);
+          bytes.push_back(opcode);
+          bytes.insert(bytes.end(), modrm.begin(), modrm.end());
+          bytes.insert(bytes.end(), kTail.begin(), kTail.end());
+          SCOPED_TRACE(testing::PrintToString(bytes));
+          bool decoded = false;
+          CheckAgainstXed(bytes, decoded);
+          num_decoded += decoded;
+        }
+      }
+    }
+  }
+  EXPECT_GT(num_decoded, 0);
+}
+
+TEST(FastDecodeX86_64, Truncated) {
+  // jmp rel32 without the last displacement byte.
+  const uint8_t kJmp[] = {0xe9, 0x00, 0x00, 0x00};
+  EXPECT_EQ(FastDecodeX86_64(kJmp, sizeof(kJmp)), std::nullopt);
+  // add [rax+disp32], eax without the displacement.
+  const uint8_t kAdd[] = {0x48, 0x01, 0x80};
+  EXPECT_EQ(FastDecodeX86_64(kAdd, sizeof(kAdd)), std::nullopt);
+  EXPECT_EQ(FastDecodeX86_64(kAdd, 0), std::nullopt);
+}
+
+TEST(FastDecodeX86_64, Branches) {
+  // jmp .-2
+  const uint8_t kJmpSelf[] = {0xeb, 0xfe};
+  std::optional<X86_64FastDecodeResult> result =
+      FastDecodeX86_64(kJmpSelf, sizeof(kJmpSelf));
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(result->length, 2);
+  EXPECT_EQ(result->branch_displacement_size, 1);
+  EXPECT_EQ(result->branch_displacement, -2);
+
+  // jz rel32 +0x100
+  const uint8_t kJz[] = {0x0f, 0x84, 0x00, 0x01, 0x00, 0x00};
+  result = FastDecodeX86_64(kJz, sizeof(kJz));
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(result->length, 6);
+  EXPECT_EQ(result->branch_displacement_size, 4);
+  EXPECT_EQ(result->branch_displacement, 0x100);
+
+  // movabs rax, imm64 is not a branch.
+  const uint8_t kMovAbs[] = {0x48, 0xb8, 1, 2, 3, 4, 5, 6, 7, 8};
+  result = FastDecodeX86_64(kMovAbs, sizeof(kMovAbs));
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(result->length, 10);
+  EXPECT_EQ(result->branch_displacement_size, 0);
+}
+
+TEST(FastDecodeX86_64, AgreesWithXedOnRandomBytes) {
+  InitXedIfNeeded();
+  std::mt19937_64 rng(0);
+  std::uniform_int_distribution<int> byte_dist(0, 255);
+  for (int i = 0; i < 100000; ++i) {
+    std::vector<uint8_t> bytes(16);
+    for (uint8_t& b : bytes) b = byte_dist(rng);
+    SCOPED_TRACE(testing::PrintToString(bytes));
+    bool decoded = false;
+    CheckAgainstXed(bytes, decoded);
+  }
+}
+
+}  // namespace
+
+}  // namespace silifuzz
@@ -166,6 +166,30 @@ bool CapstoneDisassembler<Arch>::Disassemble(uint64_t address,
   return valid_;
 }
 
+template <typename Arch>
+size_t CapstoneDisassembler<Arch>::DisassembleMany(uint64_t address,
+                                                   const uint8_t* buffer,
+                                                   size_t buffer_size,
+                                                   InstructionSizeAndID* out,
+                                                   size_t max_instructions) {
+  // Sizes and IDs do not need the operand details, which are the expensive
+  // part of decoding. Capstone always formats the mnemonic and operands.
+  CHECK_EQ(cs_option(capstone_handle_, CS_OPT_DETAIL, CS_OPT_OFF), CS_ERR_OK);
+  size_t n = 0;
+  while (n < max_instructions && buffer_size > 0) {
+    // cs_disasm_iter advances `buffer`, `buffer_size` and `address`.
+    if (!cs_disasm_iter(capstone_handle_, &buffer, &buffer_size, &address,
+                        decoded_insn_)) {
+      out[n++] = {.size = 0, .id = InvalidInstructionID()};
+      break;
+    }
+    out[n++] = {.size = decoded_insn_->size, .id = decoded_insn_->id};
+  }
+  CHECK_EQ(cs_option(capstone_handle_, CS_OPT_DETAIL, CS_OPT_ON), CS_ERR_OK);
+  valid_ = false;
+  return n;
+}
+
 template <typename Arch>
 size_t CapstoneDisassembler<Arch>::InstructionSize() const {
   return valid_ ? decoded_insn_->size : 0;
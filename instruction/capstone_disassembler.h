@@ -53,6 +53,10 @@ class CapstoneDisassembler : public Disassembler {
   // How much data was consumed by the last call to Disassemble.
   [[nodiscard]] size_t InstructionSize() const override;
 
+  size_t DisassembleMany(uint64_t address, const uint8_t* buffer,
+                         size_t buffer_size, InstructionSizeAndID* out,
+                         size_t max_instructions) override;
+
   [[nodiscard]] virtual bool CanBranch() const override;
   [[nodiscard]] virtual bool CanLoad() const override;
   [[nodiscard]] virtual bool CanStore() const override;
@@ -90,6 +90,22 @@ bool DecodedInsn::is_rep_byte_store() const {
   return iclass == XED_ICLASS_REP_MOVSB || iclass == XED_ICLASS_REP_STOSB;
 }
 
+bool DecodedInsn::may_branch() const {
+  DCHECK_STATUS(status_);
+  switch (xed_decoded_inst_get_category(&xed_insn_)) {
+    case XED_CATEGORY_COND_BR:
+    case XED_CATEGORY_UNCOND_BR:
+    case XED_CATEGORY_CALL:
+    case XED_CATEGORY_RET:
+    case XED_CATEGORY_SYSCALL:
+    case XED_CATEGORY_SYSRET:
+    case XED_CATEGORY_INTERRUPT:
+      return true;
+    default:
+      return false;
+  }
+}
+
 uint8_t DecodedInsn::rex_bits() const {
   DCHECK_STATUS(status_);
   if (xed3_operand_get_rex(&xed_insn_) != 0) {
@@ -116,6 +116,12 @@ class DecodedInsn {
     return xed_decoded_inst_number_of_memory_operands(&xed_insn_) != 0;
   }
 
+  // Tells if the instruction may transfer control anywhere other than to the
+  // next instruction, e.g. a branch, call, return or syscall. Repeated string
+  // instructions are not considered branches.
+  // REQUIRES: is_valid().
+  bool may_branch() const;
+
   // Returns textual representation of the instruction in Intel syntax.
   // REQUIRES: is_valid().
   absl::string_view DebugString() const {
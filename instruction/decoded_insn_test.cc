@@ -554,5 +554,31 @@ TEST(DecodedInsn, may_access_memory) {
   EXPECT_EQ(absl::StripAsciiWhitespace(insn3.DebugString()), "ret");
   EXPECT_TRUE(insn3.may_access_memory());
 }
+
+TEST(DecodedInsn, may_branch) {
+  DecodedInsn nop("\x90");
+  ASSERT_TRUE(nop.is_valid());
+  EXPECT_FALSE(nop.may_branch());
+
+  DecodedInsn rep_stosb("\xf3\xaa");
+  ASSERT_TRUE(rep_stosb.is_valid());
+  EXPECT_FALSE(rep_stosb.may_branch());
+
+  DecodedInsn jz("\x74\x00");
+  ASSERT_TRUE(jz.is_valid());
+  EXPECT_TRUE(jz.may_branch());
+
+  DecodedInsn call("\xff\xd0");
+  ASSERT_TRUE(call.is_valid());
+  EXPECT_TRUE(call.may_branch());
+
+  DecodedInsn ret("\xc3");
+  ASSERT_TRUE(ret.is_valid());
+  EXPECT_TRUE(ret.may_branch());
+
+  DecodedInsn syscall("\x0f\x05");
+  ASSERT_TRUE(syscall.is_valid());
+  EXPECT_TRUE(syscall.may_branch());
+}
 }  // namespace
 }  // namespace silifuzz
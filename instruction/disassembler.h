@@ -28,6 +28,14 @@ inline constexpr const char* kInvalidInstructionName = "unknown";
 // inferface should assume it is not thread safe.
 class Disassembler {
  public:
+  // The result of disassembling one instruction with DisassembleMany().
+  struct InstructionSizeAndID {
+    // Number of bytes consumed, 0 if the instruction is invalid.
+    uint32_t size;
+    // See InstructionID().
+    uint32_t id;
+  };
+
   Disassembler() = default;
   virtual ~Disassembler() = default;
 
@@ -51,6 +59,33 @@ class Disassembler {
   // How much data was consumed by the last call to Disassemble.
   [[nodiscard]] virtual size_t InstructionSize() const = 0;
 
+  // Disassembles consecutive instructions starting at `address` into `out`,
+  // without producing any text. Stops after `max_instructions` instructions,
+  // at the end of `buffer` or after the first invalid instruction, which is
+  // recorded with size 0 and InvalidInstructionID().
+  // Returns the number of entries written to `out`.
+  // Subclasses override this to avoid a virtual call per instruction. The
+  // accessors for the last instruction are unspecified afterwards.
+  virtual size_t DisassembleMany(uint64_t address, const uint8_t* buffer,
+                                 size_t buffer_size,
+                                 InstructionSizeAndID* out,
+                                 size_t max_instructions) {
+    size_t n = 0;
+    size_t offset = 0;
+    while (n < max_instructions && offset < buffer_size) {
+      if (!Disassemble(address + offset, buffer + offset,
+                       buffer_size - offset) ||
+          InstructionSize() == 0) {
+        out[n++] = {.size = 0, .id = InvalidInstructionID()};
+        break;
+      }
+      out[n++] = {.size = static_cast<uint32_t>(InstructionSize()),
+                  .id = InstructionID()};
+      offset += InstructionSize();
+    }
+    return n;
+  }
+
   // Can this instruction modify the instruction pointer, in some way?
   // Includes direct jumps, indirect jumps, calls, returns, etc.
   [[nodiscard]] virtual bool CanBranch() const = 0;
@@ -14,6 +14,7 @@
 
 #include "./instruction/disassembler.h"
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -173,6 +174,45 @@ void RunDisassemblerTest(Disassembler& disasm, const DisassemblerTest& test,
   }
 }
 
+// Disassembles all of `tests` in one DisassembleMany() call followed by a
+// truncated instruction and checks the result matches Disassemble().
+void RunDisassembleManyTest(Disassembler& disasm,
+                            const std::vector<DisassemblerTest>& tests,
+                            const std::string& truncated) {
+  std::string bytes;
+  for (const DisassemblerTest& test : tests) {
+    bytes += test.bytes;
+  }
+  bytes += truncated;
+  std::vector<Disassembler::InstructionSizeAndID> insns(tests.size() + 2);
+  constexpr uint64_t kArbitraryAddress = 0x10000;
+  size_t n = disasm.DisassembleMany(
+      kArbitraryAddress, reinterpret_cast<const uint8_t*>(bytes.data()),
+      bytes.size(), insns.data(), insns.size());
+  ASSERT_EQ(n, tests.size() + 1);
+  uint64_t offset = 0;
+  for (size_t i = 0; i < tests.size(); ++i) {
+    SCOPED_TRACE(tests[i].opcode);
+    ASSERT_TRUE(disasm.Disassemble(
+        kArbitraryAddress + offset,
+        reinterpret_cast<const uint8_t*>(tests[i].bytes.data()),
+        tests[i].bytes.size()));
+    EXPECT_EQ(insns[i].size, disasm.InstructionSize());
+    EXPECT_EQ(insns[i].id, disasm.InstructionID());
+    offset += insns[i].size;
+  }
+  EXPECT_EQ(insns[tests.size()].size, 0);
+  EXPECT_EQ(insns[tests.size()].id, disasm.InvalidInstructionID());
+
+  // Stops after `max_instructions`.
+  EXPECT_EQ(disasm.DisassembleMany(
+                kArbitraryAddress,
+                reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size(),
+                insns.data(), 1),
+            1);
+  EXPECT_EQ(insns[0].size, tests[0].bytes.size());
+}
+
 TEST(DisassemblerTest, Xed) {
   XedDisassembler disasm;
   const std::vector<DisassemblerTest> tests = DisassemblerTests_X86_64();
@@ -181,6 +221,12 @@ TEST(DisassemblerTest, Xed) {
   }
 }
 
+TEST(DisassemblerTest, XedDisassembleMany) {
+  XedDisassembler disasm;
+  // jmp rel32 without its displacement.
+  RunDisassembleManyTest(disasm, DisassemblerTests_X86_64(), {'\xe9'});
+}
+
 TEST(DisassemblerTest, Capstone_x86_64) {
   CapstoneDisassembler<X86_64> disasm;
   const std::vector<DisassemblerTest> tests = DisassemblerTests_X86_64();
@@ -189,6 +235,11 @@ TEST(DisassemblerTest, Capstone_x86_64) {
   }
 }
 
+TEST(DisassemblerTest, CapstoneDisassembleMany_x86_64) {
+  CapstoneDisassembler<X86_64> disasm;
+  RunDisassembleManyTest(disasm, DisassemblerTests_X86_64(), {'\xe9'});
+}
+
 TEST(DisassemblerTest, Capstone_AArch64) {
   CapstoneDisassembler<AArch64> disasm;
   const std::vector<DisassemblerTest> tests = DisassemblerTests_AArch64();
@@ -197,6 +248,12 @@ TEST(DisassemblerTest, Capstone_AArch64) {
   }
 }
 
+TEST(DisassemblerTest, CapstoneDisassembleMany_AArch64) {
+  CapstoneDisassembler<AArch64> disasm;
+  // Half an instruction.
+  RunDisassembleManyTest(disasm, DisassemblerTests_AArch64(), {'\0', '\0'});
+}
+
 }  // namespace
 
 }  // namespace silifuzz
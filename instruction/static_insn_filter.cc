@@ -14,9 +14,13 @@
 
 #include "./instruction/static_insn_filter.h"
 
+#include <array>
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <iterator>
 
+#include "absl/numeric/bits.h"
 #include "absl/strings/string_view.h"
 #include "./util/arch.h"
 #include "./util/bit_matcher.h"
@@ -457,8 +461,12 @@ constexpr uint32_t kBannedSysregs[] = {
     sysreg(0b11, 0b011, 0b1110, 0b0011, 0b000),
 };
 
-constexpr bool InstructionIsOK(uint32_t insn,
-                               const InstructionFilterConfig<AArch64>& config) {
+}  // namespace
+
+namespace static_insn_filter_internal {
+
+bool AArch64InstructionIsOKSlow(
+    uint32_t insn, const InstructionFilterConfig<AArch64>& config) {
   for (const BitMatcher<uint32_t>& bits : kBannedInstructions) {
     if (bits.matches(insn)) {
       return false;
@@ -484,6 +492,127 @@ constexpr bool InstructionIsOK(uint32_t insn,
   return true;
 }
 
+}  // namespace static_insn_filter_internal
+
+namespace {
+
+// The classifier below looks up the top kPrefixBits of an instruction to find
+// the few rules that can apply to it, most of them only depend on these bits.
+constexpr int kPrefixBits = 10;
+constexpr int kPrefixShift = 32 - kPrefixBits;
+constexpr uint32_t kPrefixMask = ~uint32_t{0} << kPrefixShift;
+
+static_assert(std::size(kBannedInstructions) <= 32);
+static_assert(std::size(kRequiredInstructionBits) <= 32);
+
+// Can `m` match an instruction that starts with `prefix`?
+constexpr bool MayMatch(const BitMatcher<uint32_t>& m, uint32_t prefix) {
+  return ((prefix << kPrefixShift) & m.mask & kPrefixMask) ==
+         (m.bits & kPrefixMask);
+}
+
+// Does `m` match every instruction that starts with `prefix`?
+constexpr bool MustMatch(const BitMatcher<uint32_t>& m, uint32_t prefix) {
+  return MayMatch(m, prefix) && (m.mask & ~kPrefixMask) == 0;
+}
+
+struct PrefixClass {
+  enum Flags : uint8_t {
+    // Some rule rejects every instruction with this prefix.
+    kAlwaysRejected = 1 << 0,
+    // See is_load_store_insn().
+    kLoadStore = 1 << 1,
+    // See kSVEInstruction.
+    kSVE = 1 << 2,
+    // The instruction may be a system register move.
+    kMaybeSysreg = 1 << 3,
+  };
+  uint8_t flags = 0;
+
+  // Bit i is set if kBannedInstructions[i] must be checked.
+  uint32_t banned_candidates = 0;
+
+  // Bit i is set if kRequiredInstructionBits[i] must be checked.
+  uint32_t required_candidates = 0;
+};
+
+constexpr std::array<PrefixClass, 1 << kPrefixBits> MakePrefixClasses() {
+  std::array<PrefixClass, 1 << kPrefixBits> classes{};
+  for (uint32_t prefix = 0; prefix < classes.size(); ++prefix) {
+    PrefixClass& c = classes[prefix];
+    for (size_t i = 0; i < std::size(kBannedInstructions); ++i) {
+      if (MustMatch(kBannedInstructions[i], prefix)) {
+        c.flags |= PrefixClass::kAlwaysRejected;
+      } else if (MayMatch(kBannedInstructions[i], prefix)) {
+        c.banned_candidates |= uint32_t{1} << i;
+      }
+    }
+    for (size_t i = 0; i < std::size(kRequiredInstructionBits); ++i) {
+      const RequiredBits<uint32_t>& r = kRequiredInstructionBits[i];
+      if (!MayMatch(r.pattern, prefix) || MustMatch(r.expect, prefix)) {
+        continue;
+      }
+      if (MustMatch(r.pattern, prefix) && !MayMatch(r.expect, prefix)) {
+        c.flags |= PrefixClass::kAlwaysRejected;
+      } else {
+        c.required_candidates |= uint32_t{1} << i;
+      }
+    }
+    // These are fully determined by the prefix.
+    static_assert((kLoadStoreInstruction.mask & ~kPrefixMask) == 0);
+    static_assert((kSMEMemoryOperationInstruction.mask & ~kPrefixMask) == 0);
+    static_assert((kSVEMemoryOperationInstruction.mask & ~kPrefixMask) == 0);
+    static_assert((kSVEInstruction.mask & ~kPrefixMask) == 0);
+    if (MayMatch(kLoadStoreInstruction, prefix) ||
+        MayMatch(kSMEMemoryOperationInstruction, prefix) ||
+        MayMatch(kSVEMemoryOperationInstruction, prefix)) {
+      c.flags |= PrefixClass::kLoadStore;
+    }
+    if (MayMatch(kSVEInstruction, prefix)) {
+      c.flags |= PrefixClass::kSVE;
+    }
+    if (MayMatch(kSysregInstruction, prefix)) {
+      c.flags |= PrefixClass::kMaybeSysreg;
+    }
+  }
+  return classes;
+}
+
+constexpr std::array<PrefixClass, 1 << kPrefixBits> kPrefixClasses =
+    MakePrefixClasses();
+
+// Same as AArch64InstructionIsOKSlow() but only checks the rules that can
+// apply to the prefix of `insn`.
+inline bool InstructionIsOK(uint32_t insn,
+                            const InstructionFilterConfig<AArch64>& config) {
+  const PrefixClass& c = kPrefixClasses[insn >> kPrefixShift];
+  if (c.flags & PrefixClass::kAlwaysRejected) return false;
+  if (!config.load_store_instructions_allowed &&
+      (c.flags & PrefixClass::kLoadStore)) {
+    return false;
+  }
+  if (!config.sve_instructions_allowed && (c.flags & PrefixClass::kSVE)) {
+    return false;
+  }
+  for (uint32_t m = c.banned_candidates; m != 0; m &= m - 1) {
+    if (kBannedInstructions[absl::countr_zero(m)].matches(insn)) return false;
+  }
+  for (uint32_t m = c.required_candidates; m != 0; m &= m - 1) {
+    if (kRequiredInstructionBits[absl::countr_zero(m)].violates_requirements(
+            insn)) {
+      return false;
+    }
+  }
+  if ((c.flags & PrefixClass::kMaybeSysreg) &&
+      kSysregInstruction.matches(insn)) {
+    if (!kUserspaceSysreg.matches(insn)) return false;
+    for (uint32_t sysreg : kBannedSysregs) {
+      if ((insn & kSysregMask) == sysreg) return false;
+    }
+  }
+  return true;
+}
+
 }  // namespace
 
 // For aarch64 we filter out any instruction sequence that contains a
@@ -15,6 +15,8 @@
 #ifndef THIRD_PARTY_SILIFUZZ_INSTRUCTION_STATIC_INSN_FILTER_H_
 #define THIRD_PARTY_SILIFUZZ_INSTRUCTION_STATIC_INSN_FILTER_H_
 
+#include <cstdint>
+
 #include "absl/strings/string_view.h"
 #include "./util/arch.h"
 
@@ -45,6 +47,16 @@ template <typename Arch>
 bool StaticInstructionFilter(absl::string_view code,
                              const InstructionFilterConfig<Arch>& config = {});
 
+namespace static_insn_filter_internal {
+
+// Checks a single aarch64 instruction against every filter rule in turn.
+// StaticInstructionFilter<AArch64>() uses lookup tables generated from the
+// same rules and must agree with this. Exposed for testing.
+bool AArch64InstructionIsOKSlow(uint32_t insn,
+                                const InstructionFilterConfig<AArch64>& config);
+
+}  // namespace static_insn_filter_internal
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_INSTRUCTION_STATIC_INSN_FILTER_H_
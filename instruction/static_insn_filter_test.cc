@@ -17,6 +17,7 @@
 #include <stdint.h>
 
 #include <ios>
+#include <random>
 #include <string>
 #include <vector>
 
@@ -320,6 +321,34 @@ TEST(StaticInsnFilter, FloatingPointImmediate) {
   EXPECT_AARCH64_FILTER_REJECT({0x9e38b2d0});
 }
 
+TEST(StaticInsnFilter, TablesAgreeWithRules) {
+  using static_insn_filter_internal::AArch64InstructionIsOKSlow;
+  std::vector<InstructionFilterConfig<AArch64>> configs(4);
+  configs[1].sve_instructions_allowed = true;
+  configs[2].load_store_instructions_allowed = false;
+  configs[3].sve_instructions_allowed = true;
+  configs[3].load_store_instructions_allowed = false;
+
+  // Every prefix with a few different low bits, plus random words.
+  std::vector<uint32_t> insns;
+  for (uint32_t prefix = 0; prefix < 1024; ++prefix) {
+    for (uint32_t low : {0x0u, 0x3fffffu, 0x155555u, 0x2aaaaau, 0x07c000u}) {
+      insns.push_back(prefix << 22 | low);
+    }
+  }
+  std::mt19937 rng(0);
+  for (int i = 0; i < 200000; ++i) {
+    insns.push_back(rng());
+  }
+  for (const InstructionFilterConfig<AArch64>& config : configs) {
+    for (uint32_t insn : insns) {
+      ASSERT_EQ(StaticInstructionFilter<AArch64>(FromInts({insn}), config),
+                AArch64InstructionIsOKSlow(insn, config))
+          << std::hex << insn;
+    }
+  }
+}
+
 }  // namespace
 
 }  // namespace silifuzz
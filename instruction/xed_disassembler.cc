@@ -47,6 +47,34 @@ bool XedDisassembler::Disassemble(uint64_t address, const uint8_t* buffer,
   return valid_;
 }
 
+size_t XedDisassembler::DisassembleMany(uint64_t address,
+                                        const uint8_t* buffer,
+                                        size_t buffer_size,
+                                        InstructionSizeAndID* out,
+                                        size_t max_instructions) {
+  // Decode into xedd_ so no second decoder state is needed, the mode is set
+  // once for all the instructions.
+  xed_decoded_inst_zero(&xedd_);
+  xed_decoded_inst_set_mode(&xedd_, XED_MACHINE_MODE_LONG_64,
+                            XED_ADDRESS_WIDTH_64b);
+  size_t n = 0;
+  size_t offset = 0;
+  while (n < max_instructions && offset < buffer_size) {
+    xed_decoded_inst_zero_keep_mode(&xedd_);
+    if (xed_decode(&xedd_, buffer + offset, buffer_size - offset) !=
+        XED_ERROR_NONE) {
+      out[n++] = {.size = 0, .id = InvalidInstructionID()};
+      break;
+    }
+    const uint32_t size = xed_decoded_inst_get_length(&xedd_);
+    out[n++] = {.size = size, .id = xed_decoded_inst_get_iclass(&xedd_)};
+    offset += size;
+  }
+  address_ = address + offset;
+  valid_ = false;
+  return n;
+}
+
 size_t XedDisassembler::InstructionSize() const {
   return valid_ ? xed_decoded_inst_get_length(&xedd_) : 0;
 }
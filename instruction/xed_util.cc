@@ -20,12 +20,15 @@
 #include "absl/base/call_once.h"
 
 extern "C" {
+#include "third_party/libxed/xed-address-width-enum.h"
 #include "third_party/libxed/xed-category-enum.h"
+#include "third_party/libxed/xed-decode.h"
 #include "third_party/libxed/xed-decoded-inst-api.h"
 #include "third_party/libxed/xed-decoded-inst.h"
 #include "third_party/libxed/xed-iclass-enum.h"
 #include "third_party/libxed/xed-init.h"
 #include "third_party/libxed/xed-inst.h"
+#include "third_party/libxed/xed-machine-mode-enum.h"
 #include "third_party/libxed/xed-print-info.h"
 #include "third_party/libxed/xed-syntax-enum.h"
 }
@@ -166,4 +169,71 @@ bool InstructionRequiresIOPrivileges(const xed_decoded_inst_t& instruction) {
   return category == XED_CATEGORY_IO || category == XED_CATEGORY_IOSTRINGOP;
 }
 
+bool InstructionUsesAVX512State(const xed_decoded_inst_t& instruction) {
+  return xed_classify_avx512(&instruction) ||
+         xed_classify_avx512_maskop(&instruction);
+}
+
+bool DecodedInstructionBuffer::AllDecoded() const {
+  for (uint8_t l : length) {
+    if (l == 0) return false;
+  }
+  return true;
+}
+
+void DecodedInstructionBuffer::Clear() {
+  offset.clear();
+  length.clear();
+  iclass.clear();
+  attributes.clear();
+  num_memory_operands.clear();
+}
+
+void DecodeInstructionBuffer(const uint8_t* data, size_t num_bytes,
+                             DecodedInstructionBuffer& out) {
+  out.Clear();
+  // The mode is set once, each instruction only resets the decoded fields.
+  xed_decoded_inst_t xedd;
+  xed_decoded_inst_zero(&xedd);
+  xed_decoded_inst_set_mode(&xedd, XED_MACHINE_MODE_LONG_64,
+                            XED_ADDRESS_WIDTH_64b);
+  size_t offset = 0;
+  while (offset < num_bytes) {
+    xed_decoded_inst_zero_keep_mode(&xedd);
+    out.offset.push_back(offset);
+    if (xed_decode(&xedd, data + offset, num_bytes - offset) !=
+        XED_ERROR_NONE) {
+      out.length.push_back(0);
+      out.iclass.push_back(XED_ICLASS_INVALID);
+      out.attributes.push_back(0);
+      out.num_memory_operands.push_back(0);
+      ++offset;
+      continue;
+    }
+    const uint8_t length = xed_decoded_inst_get_length(&xedd);
+    uint8_t attributes = 0;
+    if (InstructionIsDeterministicInRunner(xedd)) {
+      attributes |= kInsnDeterministicInRunner;
+    }
+    if (InstructionCanRunInUserSpace(xedd)) {
+      attributes |= kInsnCanRunInUserSpace;
+    }
+    if (InstructionRequiresIOPrivileges(xedd)) {
+      attributes |= kInsnRequiresIOPrivileges;
+    }
+    if (xed_decoded_inst_get_branch_displacement_width(&xedd) > 0) {
+      attributes |= kInsnHasBranchDisplacement;
+    }
+    if (InstructionUsesAVX512State(xedd)) {
+      attributes |= kInsnUsesAVX512State;
+    }
+    out.length.push_back(length);
+    out.iclass.push_back(xed_decoded_inst_get_iclass(&xedd));
+    out.attributes.push_back(attributes);
+    out.num_memory_operands.push_back(
+        xed_decoded_inst_number_of_memory_operands(&xedd));
+    offset += length;
+  }
+}
+
 }  // namespace silifuzz
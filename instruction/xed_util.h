@@ -17,6 +17,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 extern "C" {
 #include "third_party/libxed/xed-interface.h"
@@ -51,6 +52,66 @@ bool InstructionCanRunInUserSpace(const xed_decoded_inst_t& instruction);
 // runner does not have the privilege to do so.
 bool InstructionRequiresIOPrivileges(const xed_decoded_inst_t& instruction);
 
+// Does this instruction access AVX-512 state, i.e. zmm registers, the upper 16
+// vector registers or opmask registers? Switching between code that does and
+// code that does not can change the core frequency license on some CPUs.
+bool InstructionUsesAVX512State(const xed_decoded_inst_t& instruction);
+
+// Attribute bits of an instruction in DecodedInstructionBuffer.
+enum DecodedInstructionAttributes : uint8_t {
+  // See InstructionIsDeterministicInRunner().
+  kInsnDeterministicInRunner = 1 << 0,
+  // See InstructionCanRunInUserSpace().
+  kInsnCanRunInUserSpace = 1 << 1,
+  // See InstructionRequiresIOPrivileges().
+  kInsnRequiresIOPrivileges = 1 << 2,
+  // The instruction has a direct branch displacement.
+  kInsnHasBranchDisplacement = 1 << 3,
+  // See InstructionUsesAVX512State().
+  kInsnUsesAVX512State = 1 << 4,
+};
+
+// The instructions of a buffer decoded by DecodeInstructionBuffer(), one
+// array element per instruction in struct-of-arrays layout so that filters
+// only touch the fields they need.
+//
+// Undecodable bytes are represented by an entry with length 0 and all other
+// fields 0, see DecodeInstructionBuffer().
+struct DecodedInstructionBuffer {
+  // Offset of the first byte of the instruction in the buffer.
+  std::vector<uint32_t> offset;
+
+  // Length of the instruction in bytes, 0 if it did not decode.
+  std::vector<uint8_t> length;
+
+  // xed_iclass_enum_t of the instruction.
+  std::vector<uint16_t> iclass;
+
+  // Bitwise-or of DecodedInstructionAttributes.
+  std::vector<uint8_t> attributes;
+
+  // Number of memory operands of the instruction.
+  std::vector<uint8_t> num_memory_operands;
+
+  size_t size() const { return offset.size(); }
+
+  // Tells if every instruction decoded.
+  bool AllDecoded() const;
+
+  // Removes all instructions but keeps the allocated storage.
+  void Clear();
+};
+
+// Decodes `data` of `num_bytes` as back-to-back 64-bit mode instructions into
+// `out`, replacing its contents but reusing its storage, so decoding many
+// buffers with the same `out` does not allocate in the steady state.
+// When the bytes at some offset do not decode, records an entry with length
+// 0 and resumes at the next byte, which is how Program<X86_64> resyncs.
+// Much cheaper than decoding each instruction with a fresh decoder state.
+// REQUIRES: InitXedIfNeeded() was called. `num_bytes` fits in uint32_t.
+void DecodeInstructionBuffer(const uint8_t* data, size_t num_bytes,
+                             DecodedInstructionBuffer& out);
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_INSTRUCTION_XED_UTIL_H_
@@ -14,6 +14,7 @@
 
 #include "./instruction/xed_util.h"
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -26,6 +27,7 @@ extern "C" {
 #include "third_party/libxed/xed-decoded-inst-api.h"
 #include "third_party/libxed/xed-decoded-inst.h"
 #include "third_party/libxed/xed-error-enum.h"
+#include "third_party/libxed/xed-iclass-enum.h"
 #include "third_party/libxed/xed-machine-mode-enum.h"
 }
 
@@ -39,6 +41,7 @@ struct XedTest {
   bool not_deterministic;
   bool not_userspace;
   bool is_io;
+  bool uses_avx512;
 };
 
 std::vector<XedTest> MakeXedTests() {
@@ -89,6 +92,20 @@ std::vector<XedTest> MakeXedTests() {
           .bytes = {0x0F, 0x31},
           .not_deterministic = true,
       },
+      {
+          .text = "vpxor ymm0, ymm0, ymm0",
+          .bytes = {0xc5, 0xfd, 0xef, 0xc0},
+      },
+      {
+          .text = "vpxord zmm0, zmm0, zmm0",
+          .bytes = {0x62, 0xf1, 0x7d, 0x48, 0xef, 0xc0},
+          .uses_avx512 = true,
+      },
+      {
+          .text = "kmovw k1, eax",
+          .bytes = {0xc5, 0xf8, 0x92, 0xc8},
+          .uses_avx512 = true,
+      },
   };
 }
 
@@ -121,10 +138,64 @@ TEST(XedUtilTest, All) {
       EXPECT_EQ(test.not_userspace, !InstructionCanRunInUserSpace(xedd))
           << test.text;
       EXPECT_EQ(test.is_io, InstructionRequiresIOPrivileges(xedd)) << test.text;
+      EXPECT_EQ(test.uses_avx512, InstructionUsesAVX512State(xedd))
+          << test.text;
     }
   }
 }
 
+TEST(XedUtilTest, DecodeInstructionBuffer) {
+  InitXedIfNeeded();
+
+  std::vector<uint8_t> bytes;
+  std::vector<XedTest> tests = MakeXedTests();
+  for (const XedTest& test : tests) {
+    bytes.insert(bytes.end(), test.bytes.begin(), test.bytes.end());
+  }
+  DecodedInstructionBuffer decoded;
+  DecodeInstructionBuffer(bytes.data(), bytes.size(), decoded);
+  ASSERT_EQ(decoded.size(), tests.size());
+  EXPECT_TRUE(decoded.AllDecoded());
+  uint32_t offset = 0;
+  for (size_t i = 0; i < tests.size(); ++i) {
+    const XedTest& test = tests[i];
+    EXPECT_EQ(decoded.offset[i], offset) << test.text;
+    EXPECT_EQ(decoded.length[i], test.bytes.size()) << test.text;
+    EXPECT_NE(decoded.iclass[i], XED_ICLASS_INVALID) << test.text;
+    EXPECT_EQ(test.not_deterministic,
+              !(decoded.attributes[i] & kInsnDeterministicInRunner))
+        << test.text;
+    EXPECT_EQ(test.not_userspace,
+              !(decoded.attributes[i] & kInsnCanRunInUserSpace))
+        << test.text;
+    EXPECT_EQ(test.is_io,
+              (decoded.attributes[i] & kInsnRequiresIOPrivileges) != 0)
+        << test.text;
+    EXPECT_EQ(test.uses_avx512,
+              (decoded.attributes[i] & kInsnUsesAVX512State) != 0)
+        << test.text;
+    offset += test.bytes.size();
+  }
+  // invlpg byte ptr [rdi]
+  EXPECT_EQ(decoded.num_memory_operands[2], 1);
+
+  // A truncated jmp rel32 does not decode, resync at the next byte which is a
+  // nop. Reusing `decoded` replaces its contents.
+  const uint8_t truncated[] = {0xe9, 0x90};
+  DecodeInstructionBuffer(truncated, sizeof(truncated), decoded);
+  ASSERT_EQ(decoded.size(), 2);
+  EXPECT_FALSE(decoded.AllDecoded());
+  EXPECT_EQ(decoded.length[0], 0);
+  EXPECT_EQ(decoded.offset[1], 1);
+  EXPECT_EQ(decoded.length[1], 1);
+  EXPECT_EQ(decoded.iclass[1], XED_ICLASS_NOP);
+
+  const uint8_t jmp[] = {0xeb, 0x00};
+  DecodeInstructionBuffer(jmp, sizeof(jmp), decoded);
+  ASSERT_EQ(decoded.size(), 1);
+  EXPECT_TRUE(decoded.attributes[0] & kInsnHasBranchDisplacement);
+}
+
 }  // namespace
 
 }  // namespace silifuzz
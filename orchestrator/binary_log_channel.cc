@@ -15,13 +15,19 @@
 #include "./orchestrator/binary_log_channel.h"
 
 #include <fcntl.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
 #include <csignal>  // IWYU pragma: keep
 #include <string>
+#include <thread>  // NOLINT
+#include <utility>
+#include <vector>
 
 #include "absl/base/internal/endian.h"
 #include "absl/status/status.h"
@@ -65,10 +71,58 @@ absl::Status WrapConstructorError(absl::Status s) {
   return absl::InternalError(absl::StrCat("Constructor failed: ", s.message()));
 }
 
+// Returns `entry` serialized and prefixed with its size as described by the
+// binary log stream format.
+std::string FrameEntry(const proto::BinaryLogEntry& entry) {
+  const size_t proto_size = entry.ByteSizeLong();
+  std::string frame(sizeof(uint64_t) + proto_size, '\0');
+  absl::little_endian::Store64(frame.data(), proto_size);
+  entry.SerializeToArray(frame.data() + sizeof(uint64_t), proto_size);
+  return frame;
+}
+
+// Writes all of `frames` to `fd` with as few writev() calls as possible.
+absl::Status WriteFrames(int fd, const std::vector<std::string>& frames) {
+  std::vector<iovec> iov;
+  iov.reserve(std::min<size_t>(frames.size(), IOV_MAX));
+  size_t next_frame = 0;
+  while (next_frame < frames.size()) {
+    iov.clear();
+    for (size_t i = next_frame; i < frames.size() && iov.size() < IOV_MAX;
+         ++i) {
+      iov.push_back({const_cast<char*>(frames[i].data()), frames[i].size()});
+    }
+    next_frame += iov.size();
+    iovec* first = iov.data();
+    size_t count = iov.size();
+    while (count > 0) {
+      const ssize_t written = writev(fd, first, count);
+      if (written < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EPIPE) return EndOfChannelError();
+        return absl::ErrnoToStatus(errno, "Cannot write BinaryLogEntry batch");
+      }
+      // Skip fully written buffers and adjust a partially written one.
+      size_t remaining = written;
+      while (count > 0 && remaining >= first->iov_len) {
+        remaining -= first->iov_len;
+        ++first;
+        --count;
+      }
+      if (count > 0) {
+        first->iov_base = static_cast<char*>(first->iov_base) + remaining;
+        first->iov_len -= remaining;
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace
 
-BinaryLogProducer::BinaryLogProducer(int fd, bool take_ownership)
-    : fd_(fd), take_ownership_(take_ownership) {
+BinaryLogProducer::BinaryLogProducer(int fd, bool take_ownership,
+                                     const Options& options)
+    : fd_(fd), take_ownership_(take_ownership), options_(options) {
   // Ignore SIGPIPE globally so that we do not get a signal when writing
   // to a pipe with closed reading end. Signal state is global so there is
   // no guarantee that SIGPIPE handling will not be changed after this.
@@ -76,9 +130,27 @@ BinaryLogProducer::BinaryLogProducer(int fd, bool take_ownership)
 
   // We need a non-blocking file descriptor.
   constructor_status_ = WrapConstructorError(ClearFlags(fd, O_NONBLOCK));
+
+  if (options_.async && constructor_status_.ok()) {
+    writer_ = std::thread(&BinaryLogProducer::WriterThread, this);
+  }
 }
 
 BinaryLogProducer::~BinaryLogProducer() {
+  if (writer_.joinable()) {
+    {
+      absl::MutexLock l(&lock_);
+      stopping_ = true;
+    }
+    writer_.join();
+    absl::MutexLock l(&lock_);
+    if (!writer_status_.ok() && !IsEndOfChannelError(writer_status_)) {
+      LOG_ERROR("Binary log writer failed: ", writer_status_.message());
+    }
+    if (num_dropped_ > 0) {
+      LOG_ERROR("Dropped ", num_dropped_, " binary log entries");
+    }
+  }
   if (take_ownership_ && close(fd_) < 0) {
     LOG_ERROR("Cannot close channel descriptor: ", ErrnoStr(errno));
   }
@@ -89,6 +161,23 @@ BinaryLogProducer::~BinaryLogProducer() {
 absl::Status BinaryLogProducer::Send(const proto::BinaryLogEntry& entry) {
   RETURN_IF_NOT_OK(constructor_status_);
 
+  if (options_.async) {
+    std::string frame = FrameEntry(entry);
+    absl::MutexLock l(&lock_);
+    RETURN_IF_NOT_OK(writer_status_);
+    // Always accept an entry into an empty queue so that entries larger than
+    // the limit still get through.
+    if (buffered_bytes_ > 0 &&
+        buffered_bytes_ + frame.size() > options_.max_buffered_bytes) {
+      ++num_dropped_;
+      return absl::ResourceExhaustedError(
+          "Binary log queue is full, entry dropped");
+    }
+    buffered_bytes_ += frame.size();
+    pending_.push_back(std::move(frame));
+    return absl::OkStatus();
+  }
+
   const std::string serialized_proto = entry.SerializeAsString();
   const uint64_t proto_size = serialized_proto.size();
   char le_proto_size[sizeof(uint64_t)];
@@ -110,6 +199,58 @@ absl::Status BinaryLogProducer::Send(const proto::BinaryLogEntry& entry) {
   return absl::OkStatus();
 }
 
+absl::Status BinaryLogProducer::Flush() {
+  if (!options_.async) {
+    return absl::OkStatus();
+  }
+  absl::MutexLock l(&lock_);
+  lock_.Await(absl::Condition(this, &BinaryLogProducer::IsFlushed));
+  return writer_status_;
+}
+
+uint64_t BinaryLogProducer::num_dropped() const {
+  absl::MutexLock l(&lock_);
+  return num_dropped_;
+}
+
+void BinaryLogProducer::WriterThread() {
+  std::vector<std::string> batch;
+  while (true) {
+    size_t batch_bytes = 0;
+    {
+      absl::MutexLock l(&lock_);
+      lock_.Await(
+          absl::Condition(this, &BinaryLogProducer::WriterShouldWakeUp));
+      if (pending_.empty()) {
+        // Stopping and everything has been written.
+        return;
+      }
+      // Take everything queued so far and write it out in one go.
+      batch.swap(pending_);
+      for (const std::string& frame : batch) {
+        batch_bytes += frame.size();
+      }
+      writing_ = true;
+    }
+
+    absl::Status s = WriteFrames(fd_, batch);
+    batch.clear();
+
+    absl::MutexLock l(&lock_);
+    buffered_bytes_ -= batch_bytes;
+    writing_ = false;
+    if (!s.ok()) {
+      // The channel is unusable. Drop whatever is still queued; later Send()s
+      // report the error.
+      writer_status_ = s;
+      num_dropped_ += pending_.size();
+      buffered_bytes_ = 0;
+      pending_.clear();
+      return;
+    }
+  }
+}
+
 absl::Status BinaryLogProducer::SendSnapshotExecutionResult(
     const proto::SnapshotExecutionResult& result) {
   proto::BinaryLogEntry entry;
@@ -15,8 +15,13 @@
 #ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_LOG_CHANNEL_H_
 #define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_LOG_CHANNEL_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <thread>  // NOLINT
+#include <vector>
 
+#include "absl/base/thread_annotations.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
@@ -50,12 +55,26 @@ inline bool IsEndOfChannelError(const absl::Status& s) {
 // This class is thread-safe.
 class BinaryLogProducer {
  public:
+  struct Options {
+    // If true, Send() only queues the entry and a dedicated writer thread
+    // writes queued entries to the channel in batches. Otherwise Send() writes
+    // the entry before returning.
+    bool async = false;
+
+    // In async mode, the maximum number of bytes of queued entries. Entries
+    // that do not fit are dropped.
+    size_t max_buffered_bytes = 64 << 20;
+  };
+
   // Constructs a BinaryLogProducer object using file descriptor 'fd'.  If
   // 'take_ownership' is true, the object takes ownerships of the descriptor.
-  explicit BinaryLogProducer(int fd, bool take_ownership = true);
+  explicit BinaryLogProducer(int fd, bool take_ownership = true)
+      : BinaryLogProducer(fd, take_ownership, Options()) {}
+  BinaryLogProducer(int fd, bool take_ownership, const Options& options);
 
-  // Closes the file descriptor if this owns it. Any error reported by close()
-  // is logged but ignored as it is not recoverable.
+  // Writes out any queued entries and closes the file descriptor if this owns
+  // it. Any error reported by close() is logged but ignored as it is not
+  // recoverable.
   ~BinaryLogProducer();
 
   // This cannot be copied or moved.
@@ -67,8 +86,19 @@ class BinaryLogProducer {
   // Sends a binary log entry proto and returns a status to indicate any errors.
   // In particular if the consumer closed its end of channel already before we
   // write to the channel, an OutOfRangeError("EOC") status is reported.
+  //
+  // In async mode errors of earlier writes are reported by later calls and
+  // a ResourceExhaustedError is returned if the entry is dropped because the
+  // queue is full.
   absl::Status Send(const proto::BinaryLogEntry& entry);
 
+  // Waits until all entries queued by Send() have been written and returns the
+  // status of the writes. Returns immediately in synchronous mode.
+  absl::Status Flush();
+
+  // Number of entries dropped because the queue was full.
+  uint64_t num_dropped() const;
+
   // Helpers to send different types of messages.
 
   // Send a message containing 'result' via log channel.
@@ -82,11 +112,35 @@ class BinaryLogProducer {
   // Whether this takes over ownership of fd_.
   bool take_ownership_;
 
+  // Writes framed entries from `pending_` until asked to stop.
+  void WriterThread();
+
+  // Await() conditions.
+  bool IsFlushed() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    return (pending_.empty() && !writing_) || !writer_status_.ok();
+  }
+  bool WriterShouldWakeUp() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    return !pending_.empty() || stopping_;
+  }
+
+  // C-tor parameters.
+  const Options options_;
+
   // The channel is protected by a lock to avoid interleaving messages.
-  absl::Mutex lock_;
+  // In async mode it also guards the queue below.
+  mutable absl::Mutex lock_;
 
   // error status set by constructor.
   absl::Status constructor_status_;
+
+  // Async mode state. Entries are stored with their size prefix.
+  std::vector<std::string> pending_ ABSL_GUARDED_BY(lock_);
+  size_t buffered_bytes_ ABSL_GUARDED_BY(lock_) = 0;
+  bool writing_ ABSL_GUARDED_BY(lock_) = false;
+  bool stopping_ ABSL_GUARDED_BY(lock_) = false;
+  absl::Status writer_status_ ABSL_GUARDED_BY(lock_);
+  uint64_t num_dropped_ ABSL_GUARDED_BY(lock_) = 0;
+  std::thread writer_;
 };
 
 // This class is thread-safe.
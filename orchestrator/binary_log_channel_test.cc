@@ -22,6 +22,7 @@
 #include <csignal>
 #include <cstdint>
 #include <cstdlib>
+#include <string>
 #include <thread>  // NOLINT
 
 #include "gmock/gmock.h"
@@ -29,6 +30,7 @@
 #include "absl/log/log.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/time/time.h"
 #include "./proto/binary_log_entry.pb.h"
 #include "./proto/player_result.pb.h"
@@ -215,5 +217,75 @@ TEST_F(BinaryLogChannelTest, IgnoreSIGPIPE) {
       ::testing::ExitedWithCode(0), "Success");
 }
 
+TEST_F(BinaryLogChannelTest, AsyncBatches) {
+  constexpr int kNumEntries = 1000;
+  absl::Status producer_status;
+  std::thread producer_thread([this, &producer_status]() {
+    BinaryLogProducer producer(ReleaseFD(WRITE_FD), /*take_ownership=*/true,
+                               {.async = true});
+    for (int i = 0; i < kNumEntries; ++i) {
+      proto::BinaryLogEntry e;
+      e.mutable_snapshot_execution_result()->set_snapshot_id(
+          absl::StrCat("snapshot_", i));
+      if (absl::Status s = producer.Send(e); !s.ok()) {
+        producer_status = s;
+        return;
+      }
+    }
+    producer_status = producer.Flush();
+    EXPECT_EQ(producer.num_dropped(), 0);
+  });
+  // The consumer sees the entries in order and with the usual framing.
+  BinaryLogConsumer consumer(ReleaseFD(READ_FD));
+  for (int i = 0; i < kNumEntries; ++i) {
+    ASSERT_OK_AND_ASSIGN(proto::BinaryLogEntry entry, consumer.Receive());
+    EXPECT_EQ(entry.snapshot_execution_result().snapshot_id(),
+              absl::StrCat("snapshot_", i));
+  }
+  producer_thread.join();
+  ASSERT_OK(producer_status);
+  EXPECT_TRUE(IsEndOfChannelError(consumer.Receive().status()));
+}
+
+TEST_F(BinaryLogChannelTest, AsyncDropsWhenFull) {
+  proto::BinaryLogEntry e;
+  e.mutable_snapshot_execution_result()->set_snapshot_id(
+      std::string(1000, 'x'));
+  // Nobody reads the pipe. Fill it so that the writer thread blocks.
+  const int write_fd = GetFD(WRITE_FD);
+  ASSERT_OK(SetsDescriptorFlags(write_fd, O_NONBLOCK));
+  const std::string filler(4096, 'f');
+  while (write(write_fd, filler.data(), filler.size()) > 0) {
+  }
+  {
+    BinaryLogProducer producer(ReleaseFD(WRITE_FD), /*take_ownership=*/true,
+                               {.async = true, .max_buffered_bytes = 4096});
+    int num_dropped = 0;
+    for (int i = 0; i < 100; ++i) {
+      absl::Status s = producer.Send(e);
+      if (!s.ok()) {
+        EXPECT_THAT(s, StatusIs(absl::StatusCode::kResourceExhausted));
+        ++num_dropped;
+      }
+    }
+    EXPECT_GT(num_dropped, 0);
+    EXPECT_EQ(producer.num_dropped(), num_dropped);
+    // Let the writer finish so that the producer can be destroyed.
+    CloseFD(READ_FD);
+    EXPECT_TRUE(IsEndOfChannelError(producer.Flush()));
+  }
+}
+
+TEST_F(BinaryLogChannelTest, AsyncConsumerShutdown) {
+  BinaryLogProducer producer(ReleaseFD(WRITE_FD), /*take_ownership=*/true,
+                             {.async = true});
+  CloseFD(READ_FD);
+  proto::BinaryLogEntry e;
+  e.mutable_snapshot_execution_result()->set_snapshot_id("some_snapshot");
+  ASSERT_OK(producer.Send(e));
+  EXPECT_TRUE(IsEndOfChannelError(producer.Flush()));
+  EXPECT_TRUE(IsEndOfChannelError(producer.Send(e)));
+}
+
 }  // namespace
 }  // namespace silifuzz
@@ -0,0 +1,346 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/binary_log_index.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "google/protobuf/timestamp.pb.h"
+#include "absl/base/internal/endian.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "./orchestrator/binary_log_channel.h"
+#include "./proto/binary_log_entry.pb.h"
+#include "./proto/binary_log_index.pb.h"
+#include "./util/byte_io.h"
+#include "./util/checks.h"
+#include "./util/itoa.h"
+#include "./util/zstd_util.h"
+
+namespace silifuzz {
+
+namespace {
+
+// Size of the trailer following the index.
+constexpr size_t kTrailerSize =
+    sizeof(uint64_t) + kIndexedBinaryLogMagic.size();
+
+absl::Time TimestampToTime(const google::protobuf::Timestamp& timestamp) {
+  return absl::FromUnixSeconds(timestamp.seconds()) +
+         absl::Nanoseconds(timestamp.nanos());
+}
+
+// Appends `entry` serialized and prefixed with its size as described by the
+// binary log stream format to `out`.
+void AppendFramedEntry(const proto::BinaryLogEntry& entry, std::string* out) {
+  const size_t proto_size = entry.ByteSizeLong();
+  const size_t frame_offset = out->size();
+  out->resize(frame_offset + sizeof(uint64_t) + proto_size);
+  char* frame = out->data() + frame_offset;
+  absl::little_endian::Store64(frame, proto_size);
+  entry.SerializeToArray(frame + sizeof(uint64_t), proto_size);
+}
+
+// Parses the binary log stream in `stream` and calls `func` on each entry.
+absl::Status ParseStream(
+    absl::string_view stream,
+    absl::FunctionRef<void(proto::BinaryLogEntry&)> func) {
+  while (!stream.empty()) {
+    if (stream.size() < sizeof(uint64_t)) {
+      return absl::DataLossError("Truncated BinaryLogEntry size");
+    }
+    const uint64_t proto_size = absl::little_endian::Load64(stream.data());
+    stream.remove_prefix(sizeof(uint64_t));
+    if (proto_size > stream.size()) {
+      return absl::DataLossError("Truncated BinaryLogEntry");
+    }
+    proto::BinaryLogEntry entry;
+    if (!entry.ParseFromArray(stream.data(), proto_size)) {
+      return absl::DataLossError("Cannot deserialize BinaryLogEntry");
+    }
+    stream.remove_prefix(proto_size);
+    func(entry);
+  }
+  return absl::OkStatus();
+}
+
+// Reads exactly `size` bytes at `offset` of `fd`.
+absl::StatusOr<std::string> ReadAt(int fd, uint64_t offset, size_t size) {
+  std::string buffer(size, '\0');
+  size_t bytes_read = 0;
+  while (bytes_read < size) {
+    const ssize_t n = pread(fd, buffer.data() + bytes_read, size - bytes_read,
+                            offset + bytes_read);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return absl::ErrnoToStatus(errno, "Cannot read indexed binary log");
+    }
+    if (n == 0) {
+      return absl::DataLossError("Unexpected end of indexed binary log");
+    }
+    bytes_read += n;
+  }
+  return buffer;
+}
+
+}  // namespace
+
+IndexedBinaryLogWriter::IndexedBinaryLogWriter(int fd, bool take_ownership,
+                                               const Options& options)
+    : fd_(fd), take_ownership_(take_ownership), options_(options) {
+  status_ = WriteAll(kIndexedBinaryLogMagic);
+}
+
+IndexedBinaryLogWriter::~IndexedBinaryLogWriter() {
+  if (take_ownership_ && close(fd_) < 0) {
+    LOG_ERROR("Cannot close indexed binary log descriptor: ", ErrnoStr(errno));
+  }
+}
+
+absl::Status IndexedBinaryLogWriter::WriteAll(absl::string_view data) {
+  if (Write(fd_, data.data(), data.size()) != data.size()) {
+    return absl::ErrnoToStatus(errno, "Cannot write indexed binary log");
+  }
+  offset_ += data.size();
+  return absl::OkStatus();
+}
+
+absl::Status IndexedBinaryLogWriter::Append(
+    const proto::BinaryLogEntry& entry) {
+  RETURN_IF_NOT_OK(status_);
+  AppendFramedEntry(entry, &block_);
+  block_info_.set_num_entries(block_info_.num_entries() + 1);
+  if (!entry.session_id().empty()) {
+    block_session_ids_.insert(entry.session_id());
+  }
+  if (entry.has_snapshot_execution_result() &&
+      entry.snapshot_execution_result().has_snapshot_id()) {
+    block_snapshot_ids_.insert(
+        entry.snapshot_execution_result().snapshot_id());
+  }
+  if (entry.has_timestamp()) {
+    const absl::Time time = TimestampToTime(entry.timestamp());
+    if (!block_info_.has_min_timestamp() ||
+        time < TimestampToTime(block_info_.min_timestamp())) {
+      *block_info_.mutable_min_timestamp() = entry.timestamp();
+    }
+    if (!block_info_.has_max_timestamp() ||
+        time > TimestampToTime(block_info_.max_timestamp())) {
+      *block_info_.mutable_max_timestamp() = entry.timestamp();
+    }
+  }
+  if (block_.size() >= options_.block_bytes) {
+    status_ = WriteBlock();
+  }
+  return status_;
+}
+
+absl::Status IndexedBinaryLogWriter::WriteBlock() {
+  if (block_info_.num_entries() == 0) {
+    return absl::OkStatus();
+  }
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      std::string compressed,
+      ZstdCompress(block_, options_.compression_level));
+  block_info_.set_offset(offset_);
+  block_info_.set_compressed_size(compressed.size());
+  RETURN_IF_NOT_OK(WriteAll(compressed));
+
+  block_info_.mutable_session_ids()->Add(block_session_ids_.begin(),
+                                         block_session_ids_.end());
+  block_info_.mutable_snapshot_ids()->Add(block_snapshot_ids_.begin(),
+                                          block_snapshot_ids_.end());
+  *index_.add_blocks() = std::move(block_info_);
+  block_.clear();
+  block_info_.Clear();
+  block_session_ids_.clear();
+  block_snapshot_ids_.clear();
+  return absl::OkStatus();
+}
+
+absl::Status IndexedBinaryLogWriter::Finish() {
+  RETURN_IF_NOT_OK(status_);
+  status_ = WriteBlock();
+  RETURN_IF_NOT_OK(status_);
+
+  std::string footer = index_.SerializeAsString();
+  const size_t index_size = footer.size();
+  footer.resize(index_size + sizeof(uint64_t));
+  absl::little_endian::Store64(footer.data() + index_size, index_size);
+  footer.append(kIndexedBinaryLogMagic.data(), kIndexedBinaryLogMagic.size());
+  status_ = WriteAll(footer);
+  RETURN_IF_NOT_OK(status_);
+  status_ = absl::FailedPreconditionError("Indexed binary log is finished");
+  return absl::OkStatus();
+}
+
+absl::Status CompactBinaryLog(BinaryLogConsumer& consumer,
+                              IndexedBinaryLogWriter& writer) {
+  while (true) {
+    absl::StatusOr<proto::BinaryLogEntry> entry = consumer.Receive();
+    if (!entry.ok()) {
+      if (IsEndOfChannelError(entry.status())) break;
+      return entry.status();
+    }
+    RETURN_IF_NOT_OK(writer.Append(*entry));
+  }
+  return writer.Finish();
+}
+
+absl::StatusOr<std::unique_ptr<IndexedBinaryLogReader>>
+IndexedBinaryLogReader::Open(int fd, bool take_ownership) {
+  // Construct the reader first so that it owns `fd` on all paths.
+  std::unique_ptr<IndexedBinaryLogReader> reader(
+      new IndexedBinaryLogReader(fd, take_ownership, proto::BinaryLogIndex()));
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return absl::ErrnoToStatus(errno, "Cannot stat indexed binary log");
+  }
+  const uint64_t file_size = st.st_size;
+  const size_t magic_size = kIndexedBinaryLogMagic.size();
+  if (file_size < magic_size + kTrailerSize) {
+    return absl::DataLossError("Indexed binary log is too small");
+  }
+  ASSIGN_OR_RETURN_IF_NOT_OK(std::string magic, ReadAt(fd, 0, magic_size));
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      std::string trailer,
+      ReadAt(fd, file_size - kTrailerSize, kTrailerSize));
+  if (magic != kIndexedBinaryLogMagic ||
+      absl::string_view(trailer).substr(sizeof(uint64_t)) !=
+          kIndexedBinaryLogMagic) {
+    return absl::DataLossError("Not an indexed binary log");
+  }
+
+  const uint64_t index_size = absl::little_endian::Load64(trailer.data());
+  const uint64_t blocks_end = file_size - kTrailerSize - magic_size;
+  if (index_size > blocks_end) {
+    return absl::DataLossError("Malformed indexed binary log index size");
+  }
+  const uint64_t index_offset = file_size - kTrailerSize - index_size;
+  ASSIGN_OR_RETURN_IF_NOT_OK(std::string serialized_index,
+                             ReadAt(fd, index_offset, index_size));
+  if (!reader->index_.ParseFromString(serialized_index)) {
+    return absl::DataLossError("Cannot deserialize BinaryLogIndex");
+  }
+  for (const proto::BinaryLogBlock& block : reader->index_.blocks()) {
+    if (block.offset() < magic_size || block.offset() > index_offset ||
+        block.compressed_size() > index_offset - block.offset()) {
+      return absl::DataLossError(
+          absl::StrCat("Block at offset ", block.offset(), " of size ",
+                       block.compressed_size(), " is out of bounds"));
+    }
+  }
+  return reader;
+}
+
+IndexedBinaryLogReader::~IndexedBinaryLogReader() {
+  if (take_ownership_ && close(fd_) < 0) {
+    LOG_ERROR("Cannot close indexed binary log descriptor: ", ErrnoStr(errno));
+  }
+}
+
+absl::StatusOr<std::vector<proto::BinaryLogEntry>>
+IndexedBinaryLogReader::ReadBlock(size_t block) const {
+  CHECK_LT(block, static_cast<size_t>(index_.blocks_size()));
+  std::vector<proto::BinaryLogEntry> entries;
+  RETURN_IF_NOT_OK(ReadMatchingEntries(
+      block, [](const proto::BinaryLogEntry&) { return true; }, entries));
+  return entries;
+}
+
+absl::Status IndexedBinaryLogReader::ReadMatchingEntries(
+    size_t block,
+    absl::FunctionRef<bool(const proto::BinaryLogEntry&)> predicate,
+    std::vector<proto::BinaryLogEntry>& entries) const {
+  const proto::BinaryLogBlock& info = index_.blocks(block);
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      std::string compressed,
+      ReadAt(fd_, info.offset(), info.compressed_size()));
+  ASSIGN_OR_RETURN_IF_NOT_OK(std::string stream, ZstdDecompress(compressed));
+  return ParseStream(stream, [&](proto::BinaryLogEntry& entry) {
+    if (predicate(entry)) entries.push_back(std::move(entry));
+  });
+}
+
+absl::StatusOr<std::vector<proto::BinaryLogEntry>>
+IndexedBinaryLogReader::FindEntries(
+    absl::FunctionRef<bool(const proto::BinaryLogBlock&)> block_predicate,
+    absl::FunctionRef<bool(const proto::BinaryLogEntry&)> entry_predicate)
+    const {
+  std::vector<proto::BinaryLogEntry> entries;
+  for (int i = 0; i < index_.blocks_size(); ++i) {
+    if (block_predicate(index_.blocks(i))) {
+      RETURN_IF_NOT_OK(ReadMatchingEntries(i, entry_predicate, entries));
+    }
+  }
+  return entries;
+}
+
+absl::StatusOr<std::vector<proto::BinaryLogEntry>>
+IndexedBinaryLogReader::FindBySessionId(absl::string_view session_id) const {
+  return FindEntries(
+      [session_id](const proto::BinaryLogBlock& block) {
+        return std::binary_search(block.session_ids().begin(),
+                                  block.session_ids().end(), session_id);
+      },
+      [session_id](const proto::BinaryLogEntry& entry) {
+        return entry.session_id() == session_id;
+      });
+}
+
+absl::StatusOr<std::vector<proto::BinaryLogEntry>>
+IndexedBinaryLogReader::FindBySnapshotId(absl::string_view snapshot_id) const {
+  return FindEntries(
+      [snapshot_id](const proto::BinaryLogBlock& block) {
+        return std::binary_search(block.snapshot_ids().begin(),
+                                  block.snapshot_ids().end(), snapshot_id);
+      },
+      [snapshot_id](const proto::BinaryLogEntry& entry) {
+        return entry.has_snapshot_execution_result() &&
+               entry.snapshot_execution_result().snapshot_id() == snapshot_id;
+      });
+}
+
+absl::StatusOr<std::vector<proto::BinaryLogEntry>>
+IndexedBinaryLogReader::FindByTimeRange(absl::Time begin,
+                                        absl::Time end) const {
+  return FindEntries(
+      [begin, end](const proto::BinaryLogBlock& block) {
+        return block.has_min_timestamp() &&
+               TimestampToTime(block.min_timestamp()) < end &&
+               TimestampToTime(block.max_timestamp()) >= begin;
+      },
+      [begin, end](const proto::BinaryLogEntry& entry) {
+        if (!entry.has_timestamp()) return false;
+        const absl::Time time = TimestampToTime(entry.timestamp());
+        return time >= begin && time < end;
+      });
+}
+
+}  // namespace silifuzz
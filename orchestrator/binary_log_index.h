@@ -0,0 +1,207 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_BINARY_LOG_INDEX_H_
+#define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_BINARY_LOG_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/btree_set.h"
+#include "absl/functional/function_ref.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "./orchestrator/binary_log_channel.h"
+#include "./proto/binary_log_entry.pb.h"
+#include "./proto/binary_log_index.pb.h"
+
+namespace silifuzz {
+
+// Indexed binary log file format:
+//
+// An indexed binary log stores the entries of a binary log stream (see
+// binary_log_channel.h) in zstd compressed blocks followed by an index of the
+// blocks, so that readers can find entries of a session or a snapshot without
+// decompressing the whole log.
+//
+//    a) 8 bytes of kIndexedBinaryLogMagic.
+//    b) zero or more blocks. Each block is a single zstd frame containing a
+//       binary log stream.
+//    c) a serialized BinaryLogIndex proto describing the blocks.
+//    d) a 64-bit little endian integer representing the byte size of c).
+//    e) 8 bytes of kIndexedBinaryLogMagic.
+//
+// The index is at the end so that the file can be written in one pass. An
+// incomplete file, e.g. one written by a crashed process, has no valid
+// trailer and is rejected by the reader.
+inline constexpr absl::string_view kIndexedBinaryLogMagic = "SFBLIDX1";
+
+// Writes an indexed binary log to a file descriptor. Entries are buffered
+// until a block is full. Finish() must be called to write the last block and
+// the index.
+//
+// This class is thread-compatible.
+class IndexedBinaryLogWriter {
+ public:
+  struct Options {
+    // Uncompressed size of a block. A block is written once its entries
+    // reach this size. Smaller blocks make lookups cheaper and compression
+    // worse.
+    size_t block_bytes = 1 << 20;
+
+    // zstd compression level of the blocks.
+    int compression_level = 3;
+  };
+
+  // Constructs an IndexedBinaryLogWriter writing to file descriptor 'fd',
+  // which must be positioned at the start of the output. If 'take_ownership'
+  // is true, the object takes ownerships of the descriptor.
+  IndexedBinaryLogWriter(int fd, bool take_ownership, const Options& options);
+  explicit IndexedBinaryLogWriter(int fd, bool take_ownership = true)
+      : IndexedBinaryLogWriter(fd, take_ownership, Options()) {}
+
+  // Closes the file descriptor if this owns it. Does not call Finish().
+  ~IndexedBinaryLogWriter();
+
+  // This cannot be copied or moved.
+  IndexedBinaryLogWriter(const IndexedBinaryLogWriter&) = delete;
+  IndexedBinaryLogWriter& operator=(const IndexedBinaryLogWriter&) = delete;
+  IndexedBinaryLogWriter(IndexedBinaryLogWriter&&) = delete;
+  IndexedBinaryLogWriter& operator=(IndexedBinaryLogWriter&&) = delete;
+
+  // Appends `entry` to the log. Returns an error if a block cannot be
+  // written. The writer is unusable after an error.
+  absl::Status Append(const proto::BinaryLogEntry& entry);
+
+  // Writes the pending block and the index. Nothing can be appended after
+  // this.
+  absl::Status Finish();
+
+ private:
+  // Compresses and writes the entries in `block_`, then adds the block to
+  // `index_`.
+  absl::Status WriteBlock();
+
+  // Writes all of `data` to fd_ and advances `offset_`.
+  absl::Status WriteAll(absl::string_view data);
+
+  // File descriptor of the output.
+  int fd_;
+
+  // Whether this takes over ownership of fd_.
+  bool take_ownership_;
+
+  // C-tor parameters.
+  const Options options_;
+
+  // Sticky error status. Set when a write fails or after Finish().
+  absl::Status status_;
+
+  // Number of bytes written so far.
+  uint64_t offset_ = 0;
+
+  // Framed entries of the pending block and the index data of the entries.
+  std::string block_;
+  proto::BinaryLogBlock block_info_;
+  absl::btree_set<std::string> block_session_ids_;
+  absl::btree_set<std::string> block_snapshot_ids_;
+
+  proto::BinaryLogIndex index_;
+};
+
+// Reads a binary log stream from `consumer` until the end of channel and
+// writes its entries to `writer`, then finishes `writer`. This converts a
+// binary log saved from a channel into an indexed binary log.
+absl::Status CompactBinaryLog(BinaryLogConsumer& consumer,
+                              IndexedBinaryLogWriter& writer);
+
+// Random access reader of an indexed binary log. The index is read by
+// Open(), blocks are read with pread() on demand.
+//
+// This class is thread-safe.
+class IndexedBinaryLogReader {
+ public:
+  // Opens the indexed binary log in file descriptor `fd`. If 'take_ownership'
+  // is true, the reader takes ownerships of the descriptor.
+  static absl::StatusOr<std::unique_ptr<IndexedBinaryLogReader>> Open(
+      int fd, bool take_ownership = true);
+
+  // Closes the file descriptor if this owns it.
+  ~IndexedBinaryLogReader();
+
+  // This cannot be copied or moved.
+  IndexedBinaryLogReader(const IndexedBinaryLogReader&) = delete;
+  IndexedBinaryLogReader& operator=(const IndexedBinaryLogReader&) = delete;
+  IndexedBinaryLogReader(IndexedBinaryLogReader&&) = delete;
+  IndexedBinaryLogReader& operator=(IndexedBinaryLogReader&&) = delete;
+
+  const proto::BinaryLogIndex& index() const { return index_; }
+
+  // Returns the entries of block `block` in log order.
+  // REQUIRES: block < index().blocks_size().
+  absl::StatusOr<std::vector<proto::BinaryLogEntry>> ReadBlock(
+      size_t block) const;
+
+  // Returns entries of session `session_id` in log order. Only blocks
+  // containing the session are read.
+  absl::StatusOr<std::vector<proto::BinaryLogEntry>> FindBySessionId(
+      absl::string_view session_id) const;
+
+  // Returns snapshot execution results of `snapshot_id` in log order. Only
+  // blocks containing the snapshot are read.
+  absl::StatusOr<std::vector<proto::BinaryLogEntry>> FindBySnapshotId(
+      absl::string_view snapshot_id) const;
+
+  // Returns entries with timestamps in [`begin`, `end`) in log order. Only
+  // blocks overlapping the range are read.
+  absl::StatusOr<std::vector<proto::BinaryLogEntry>> FindByTimeRange(
+      absl::Time begin, absl::Time end) const;
+
+ private:
+  IndexedBinaryLogReader(int fd, bool take_ownership,
+                         proto::BinaryLogIndex index)
+      : fd_(fd), take_ownership_(take_ownership), index_(std::move(index)) {}
+
+  // Reads block `block` and appends its entries matching `predicate` to
+  // `entries`.
+  absl::Status ReadMatchingEntries(
+      size_t block,
+      absl::FunctionRef<bool(const proto::BinaryLogEntry&)> predicate,
+      std::vector<proto::BinaryLogEntry>& entries) const;
+
+  // Returns entries matching `entry_predicate` in blocks matching
+  // `block_predicate`.
+  absl::StatusOr<std::vector<proto::BinaryLogEntry>> FindEntries(
+      absl::FunctionRef<bool(const proto::BinaryLogBlock&)> block_predicate,
+      absl::FunctionRef<bool(const proto::BinaryLogEntry&)> entry_predicate)
+      const;
+
+  // File descriptor of the log.
+  int fd_;
+
+  // Whether this takes ownership of fd_.
+  bool take_ownership_;
+
+  proto::BinaryLogIndex index_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_BINARY_LOG_INDEX_H_
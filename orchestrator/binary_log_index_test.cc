@@ -0,0 +1,176 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/binary_log_index.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "./orchestrator/binary_log_channel.h"
+#include "./proto/binary_log_entry.pb.h"
+#include "./util/checks.h"
+#include "./util/testing/status_macros.h"
+#include "./util/testing/status_matchers.h"
+#include "./util/time_proto_util.h"
+
+namespace silifuzz {
+namespace {
+
+using silifuzz::testing::StatusIs;
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+const absl::Time kEpoch = absl::FromUnixSeconds(1700000000);
+
+proto::BinaryLogEntry MakeEntry(int session, int snapshot, int seconds) {
+  proto::BinaryLogEntry entry;
+  entry.set_session_id(absl::StrCat("session", session));
+  CHECK_STATUS(EncodeGoogleApiProto(kEpoch + absl::Seconds(seconds),
+                                    entry.mutable_timestamp()));
+  entry.mutable_snapshot_execution_result()->set_snapshot_id(
+      absl::StrCat("snap", snapshot));
+  return entry;
+}
+
+// Returns snapshot IDs of `entries`.
+std::vector<std::string> SnapshotIds(
+    const std::vector<proto::BinaryLogEntry>& entries) {
+  std::vector<std::string> ids;
+  for (const proto::BinaryLogEntry& entry : entries) {
+    ids.push_back(entry.snapshot_execution_result().snapshot_id());
+  }
+  return ids;
+}
+
+// Returns a descriptor of a new unlinked temporary file.
+int TempFile() {
+  FILE* file = tmpfile();
+  CHECK(file != nullptr);
+  const int fd = dup(fileno(file));
+  fclose(file);
+  return fd;
+}
+
+// Writes 10 entries into blocks of 2 entries each. Entry i belongs to
+// session i / 5, has snapshot i % 3 and a timestamp of i seconds.
+int WriteTestLog() {
+  const int fd = TempFile();
+  IndexedBinaryLogWriter::Options options;
+  options.block_bytes = 2 * MakeEntry(0, 0, 0).ByteSizeLong() + 1;
+  IndexedBinaryLogWriter writer(fd, /*take_ownership=*/false, options);
+  for (int i = 0; i < 10; ++i) {
+    CHECK_STATUS(writer.Append(MakeEntry(i / 5, i % 3, i)));
+  }
+  CHECK_STATUS(writer.Finish());
+  return fd;
+}
+
+TEST(IndexedBinaryLog, Index) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<IndexedBinaryLogReader> reader,
+                       IndexedBinaryLogReader::Open(WriteTestLog()));
+  const proto::BinaryLogIndex& index = reader->index();
+  ASSERT_EQ(index.blocks_size(), 5);
+  // Block 2 has entries 4 and 5.
+  const proto::BinaryLogBlock& block = index.blocks(2);
+  EXPECT_EQ(block.num_entries(), 2);
+  EXPECT_THAT(block.session_ids(), ElementsAre("session0", "session1"));
+  EXPECT_THAT(block.snapshot_ids(), ElementsAre("snap1", "snap2"));
+  EXPECT_EQ(block.min_timestamp().seconds(), absl::ToUnixSeconds(kEpoch) + 4);
+  EXPECT_EQ(block.max_timestamp().seconds(), absl::ToUnixSeconds(kEpoch) + 5);
+
+  ASSERT_OK_AND_ASSIGN(std::vector<proto::BinaryLogEntry> entries,
+                       reader->ReadBlock(2));
+  EXPECT_THAT(SnapshotIds(entries), ElementsAre("snap1", "snap2"));
+}
+
+TEST(IndexedBinaryLog, Find) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<IndexedBinaryLogReader> reader,
+                       IndexedBinaryLogReader::Open(WriteTestLog()));
+  ASSERT_OK_AND_ASSIGN(std::vector<proto::BinaryLogEntry> entries,
+                       reader->FindBySessionId("session1"));
+  EXPECT_THAT(SnapshotIds(entries),
+              ElementsAre("snap2", "snap0", "snap1", "snap2", "snap0"));
+
+  ASSERT_OK_AND_ASSIGN(entries, reader->FindBySnapshotId("snap1"));
+  ASSERT_EQ(entries.size(), 3);
+  EXPECT_EQ(entries[0].session_id(), "session0");
+  EXPECT_EQ(entries[2].session_id(), "session1");
+
+  ASSERT_OK_AND_ASSIGN(entries, reader->FindByTimeRange(
+                                    kEpoch + absl::Seconds(3),
+                                    kEpoch + absl::Seconds(6)));
+  EXPECT_THAT(SnapshotIds(entries), ElementsAre("snap0", "snap1", "snap2"));
+
+  ASSERT_OK_AND_ASSIGN(entries, reader->FindBySessionId("session2"));
+  EXPECT_THAT(entries, IsEmpty());
+}
+
+TEST(IndexedBinaryLog, CompactBinaryLog) {
+  int pipefd[2];
+  ASSERT_EQ(pipe(pipefd), 0);
+  {
+    BinaryLogProducer producer(pipefd[1]);
+    for (int i = 0; i < 3; ++i) {
+      ASSERT_OK(producer.Send(MakeEntry(0, i, i)));
+    }
+  }
+  const int fd = TempFile();
+  {
+    BinaryLogConsumer consumer(pipefd[0]);
+    IndexedBinaryLogWriter writer(fd, /*take_ownership=*/false);
+    ASSERT_OK(CompactBinaryLog(consumer, writer));
+  }
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<IndexedBinaryLogReader> reader,
+                       IndexedBinaryLogReader::Open(fd));
+  ASSERT_EQ(reader->index().blocks_size(), 1);
+  ASSERT_OK_AND_ASSIGN(std::vector<proto::BinaryLogEntry> entries,
+                       reader->ReadBlock(0));
+  EXPECT_THAT(SnapshotIds(entries), ElementsAre("snap0", "snap1", "snap2"));
+}
+
+TEST(IndexedBinaryLog, Empty) {
+  const int fd = TempFile();
+  {
+    IndexedBinaryLogWriter writer(fd, /*take_ownership=*/false);
+    ASSERT_OK(writer.Finish());
+    EXPECT_THAT(writer.Append(MakeEntry(0, 0, 0)),
+                StatusIs(absl::StatusCode::kFailedPrecondition));
+  }
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<IndexedBinaryLogReader> reader,
+                       IndexedBinaryLogReader::Open(fd));
+  EXPECT_EQ(reader->index().blocks_size(), 0);
+}
+
+TEST(IndexedBinaryLog, Unfinished) {
+  const int fd = TempFile();
+  {
+    IndexedBinaryLogWriter writer(fd, /*take_ownership=*/false);
+    ASSERT_OK(writer.Append(MakeEntry(0, 0, 0)));
+  }
+  EXPECT_THAT(IndexedBinaryLogReader::Open(fd),
+              StatusIs(absl::StatusCode::kDataLoss));
+}
+
+}  // namespace
+}  // namespace silifuzz
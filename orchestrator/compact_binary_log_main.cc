@@ -0,0 +1,81 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Converts a binary log stream saved from a binary log channel into an
+// indexed binary log. See orchestrator/binary_log_index.h.
+//
+// Usage: compact_binary_log [flags] <input binary log> <output indexed log>
+
+#include <fcntl.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "./orchestrator/binary_log_channel.h"
+#include "./orchestrator/binary_log_index.h"
+#include "./util/itoa.h"
+
+ABSL_FLAG(size_t, block_bytes,
+          silifuzz::IndexedBinaryLogWriter::Options().block_bytes,
+          "Uncompressed size of a block of the indexed binary log.");
+ABSL_FLAG(int, compression_level,
+          silifuzz::IndexedBinaryLogWriter::Options().compression_level,
+          "zstd compression level of the blocks.");
+
+namespace silifuzz {
+
+int ToolMain(std::vector<char*>& positional_args) {
+  if (positional_args.size() != 3) {
+    std::cerr << "Usage: " << positional_args[0]
+              << " [flags] <input binary log> <output indexed log>" << '\n';
+    return EXIT_FAILURE;
+  }
+  const int input_fd = open(positional_args[1], O_RDONLY | O_CLOEXEC);
+  if (input_fd < 0) {
+    std::cerr << "Cannot open " << positional_args[1] << ": "
+              << ErrnoStr(errno) << '\n';
+    return EXIT_FAILURE;
+  }
+  const int output_fd = open(positional_args[2],
+                             O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (output_fd < 0) {
+    std::cerr << "Cannot open " << positional_args[2] << ": "
+              << ErrnoStr(errno) << '\n';
+    return EXIT_FAILURE;
+  }
+
+  BinaryLogConsumer consumer(input_fd);
+  IndexedBinaryLogWriter::Options options;
+  options.block_bytes = absl::GetFlag(FLAGS_block_bytes);
+  options.compression_level = absl::GetFlag(FLAGS_compression_level);
+  IndexedBinaryLogWriter writer(output_fd, /*take_ownership=*/true, options);
+  if (absl::Status s = CompactBinaryLog(consumer, writer); !s.ok()) {
+    std::cerr << s.message() << '\n';
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+}  // namespace silifuzz
+
+int main(int argc, char* argv[]) {
+  std::vector<char*> positional_args = absl::ParseCommandLine(argc, argv);
+  return silifuzz::ToolMain(positional_args);
+}
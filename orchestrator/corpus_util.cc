@@ -19,68 +19,181 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cerrno>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <thread>  // NOLINT
 #include <utility>
 #include <vector>
 
 #include "absl/cleanup/cleanup.h"
+#include "absl/functional/function_ref.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/cord.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
-#include "absl/types/span.h"
+#include "absl/strings/strip.h"
 #include "third_party/liblzma/lzma.h"
+#include "zstd.h"
 #include "./snap/snap.h"
 #include "./snap/snap_checksum.h"
+#include "./snap/snap_relocator.h"
+#include "./util/arch.h"
 #include "./util/byte_io.h"
 #include "./util/checks.h"
 #include "./util/itoa.h"
+#include "./util/mmapped_memory_ptr.h"
 #include "./util/owned_file_descriptor.h"
 #include "./util/path_util.h"
-#include "./util/span_util.h"
+#include "./util/zstd_util.h"
 
 namespace silifuzz {
 
 namespace {
 
+// Writes `chunk` to file with descriptor `fd` and returns status.
+absl::Status WriteChunk(absl::string_view chunk, int fd) {
+  if (Write(fd, chunk.data(), chunk.size()) != chunk.size()) {
+    // Write() handles EINTR, so it is an error if it cannot complete.
+    return absl::ErrnoToStatus(errno, "write()");
+  }
+  return absl::OkStatus();
+}
+
 // Writes data in `cord` to file with descriptor `fd` and returns status.
 absl::Status WriteCord(const absl::Cord& cord, int fd) {
-  for (const auto& chunk : cord.Chunks()) {
-    if (Write(fd, chunk.data(), chunk.size()) != chunk.size()) {
-      // Write() handles EINTR, so it is an error if it cannot complete.
-      return absl::ErrnoToStatus(errno, "write()");
-    }
+  for (absl::string_view chunk : cord.Chunks()) {
+    RETURN_IF_NOT_OK(WriteChunk(chunk, fd));
   }
   return absl::OkStatus();
 }
 
-// Returns contents for file with descriptor `fd` as a Cord or a status.
-// This reads starting from the current file offset.
-absl::StatusOr<absl::Cord> ReadCord(int fd) {
+// Like WriteCord() but writes through a shared mapping of `fd` advised with
+// MADV_HUGEPAGE. For a memfd, this makes the kernel allocate transparent huge
+// pages for the file contents where shmem huge pages are enabled, including
+// the "advise" setting of /sys/kernel/mm/transparent_hugepage/shmem_enabled.
+absl::Status WriteCordUsingHugePages(const absl::Cord& cord, int fd) {
+  const size_t size = cord.size();
+  if (size == 0) {
+    return absl::OkStatus();
+  }
+  if (ftruncate(fd, size) != 0) {
+    return absl::ErrnoToStatus(errno, "ftruncate()");
+  }
+  void* mapping =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "mmap()");
+  }
+  absl::Cleanup unmapper = [mapping, size] { munmap(mapping, size); };
+  // This fails only if the kernel does not support transparent huge pages.
+  // The contents are still written correctly, so ignore the error.
+  madvise(mapping, size, MADV_HUGEPAGE);
+  char* dest = static_cast<char*>(mapping);
+  for (absl::string_view chunk : cord.Chunks()) {
+    memcpy(dest, chunk.data(), chunk.size());
+    dest += chunk.size();
+  }
+  return absl::OkStatus();
+}
+
+// Consumer of file contents produced in chunks. A chunk is only valid during
+// the call.
+using ChunkSink = absl::FunctionRef<absl::Status(absl::string_view)>;
+
+// Reads contents of file with descriptor `fd` and passes them to `sink` in
+// chunks. This reads starting from the current file offset.
+absl::Status ReadChunks(int fd, ChunkSink sink) {
   constexpr size_t kChunkSize = 1 << 20;  // 1MB
   std::string buffer(kChunkSize, 0);
   ssize_t bytes_read;
-  absl::Cord cord;
   while ((bytes_read = Read(fd, buffer.data(), buffer.size())) > 0) {
-    cord.Append(absl::string_view(buffer.data(), bytes_read));
+    RETURN_IF_NOT_OK(sink(absl::string_view(buffer.data(), bytes_read)));
   }
   if (bytes_read < 0) {
     // If Read() returns a negative number, there is an error.
     return absl::ErrnoToStatus(errno, "read()");
   }
-  return cord;
+  return absl::OkStatus();
 }
 
-}  // namespace
+// Creates a mem file for WriteSharedMemoryFile() and returns its descriptor.
+absl::StatusOr<OwnedFileDescriptor> CreateSharedMemoryFile(
+    absl::string_view name) {
+  int memfd = memfd_create(std::string(name).c_str(),
+                           O_RDWR | MFD_ALLOW_SEALING | MFD_CLOEXEC);
+  if (memfd == -1) {
+    return absl::ErrnoToStatus(errno, "memfd_create()");
+  }
+  return OwnedFileDescriptor(memfd);
+}
 
-absl::StatusOr<absl::Cord> ReadXzipFile(const std::string& path) {
+// Seals a mem file with descriptor `fd` after it has been written and moves
+// the file offset back to the beginning.
+absl::Status SealSharedMemoryFile(int fd, absl::string_view name) {
+  // Seal file after write to prevent modification of its contents and seals.
+  // There appears to be a kernel bug that happens with large enough number of
+  // concurrent threads calling fcntl(2). The bug manifests as fcntl returning
+  // errno=EBUSY when passed F_SEAL_WRITE.
+  if (fcntl(fd, F_ADD_SEALS, F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
+    return absl::ErrnoToStatus(errno,
+                               absl::StrCat("fcntl(F_ADD_SEALS): ", name));
+  }
+
+  // Move file descriptor to beginning of file.
+  if (lseek(fd, 0, SEEK_SET) != 0) {
+    return absl::ErrnoToStatus(errno, "lseek()");
+  }
+  return absl::OkStatus();
+}
+
+// Relocates the corpus in file `fd` of `size` bytes in place to an address at
+// which the file can be mapped and updates the corpus checksum to match the
+// relocated contents. Runners can then map the file shared at that address
+// without relocating a private copy. The address is picked by mapping the file
+// here. It is usually also free in a runner, which falls back to relocating
+// privately otherwise.
+//
+// RETURNS the address the corpus has been relocated to or an error status.
+absl::StatusOr<uintptr_t> RelocateSharedMemoryFile(int fd, size_t size) {
+  void* mapping =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "mmap()");
+  }
+  const uintptr_t load_address = reinterpret_cast<uintptr_t>(mapping);
+  SnapRelocatorError error;
+  MmappedMemoryPtr<const SnapCorpus<Host>> corpus =
+      SnapRelocator<Host>::RelocateCorpus(
+          MakeMmappedMemoryPtr<char>(static_cast<char*>(mapping), size),
+          /* verify = */ true, &error);
+  if (error != SnapRelocatorError::kOk) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Failed to relocate corpus, error = ",
+                     static_cast<int>(error)));
+  }
+
+  CorpusChecksumCalculator checksum;
+  checksum.AddData(corpus.get(), size);
+  // RelocateCorpus() leaves the corpus read-only.
+  if (mprotect(mapping, size, PROT_READ | PROT_WRITE) != 0) {
+    return absl::ErrnoToStatus(errno, "mprotect()");
+  }
+  const_cast<SnapCorpusHeader&>(corpus->header).checksum = checksum.Checksum();
+  return load_address;
+}
+
+// Decompresses an lzma compressed file in `path` and passes the decompressed
+// contents to `sink` in chunks. Returns an error status if decompression
+// fails or if `sink` returns an error.
+absl::Status DecompressXzipFile(const std::string& path, ChunkSink sink) {
   lzma_stream decompressed_stream = LZMA_STREAM_INIT;
   lzma_ret ret = lzma_stream_decoder(
       &decompressed_stream, lzma_easy_decoder_memusage(9 /* level */), 0);
@@ -110,7 +223,6 @@ absl::StatusOr<absl::Cord> ReadXzipFile(const std::string& path) {
         absl::StrCat("Failed to open compressed file ", path));
   }
 
-  absl::Cord decompressed_data;
   bool input_eof_seen = false;
   do {
     // Refill input buffer if empty.
@@ -133,13 +245,13 @@ absl::StatusOr<absl::Cord> ReadXzipFile(const std::string& path) {
     ret = lzma_code(&decompressed_stream,
                     input_eof_seen ? LZMA_FINISH : LZMA_RUN);
 
-    // Append data to cord if output buffer is full or if decompressed stream
+    // Pass data to sink if output buffer is full or if decompressed stream
     // ends.
     if (decompressed_stream.avail_out == 0 || ret == LZMA_STREAM_END) {
       absl::string_view chunk(
           reinterpret_cast<char*>(output_buffer.data()),
           output_buffer.size() - decompressed_stream.avail_out);
-      decompressed_data.Append(chunk);
+      RETURN_IF_NOT_OK(sink(chunk));
       decompressed_stream.avail_out = output_buffer.size();
       decompressed_stream.next_out = output_buffer.data();
     }
@@ -173,34 +285,88 @@ absl::StatusOr<absl::Cord> ReadXzipFile(const std::string& path) {
   }
 
   // Data looks OK.
-  return decompressed_data;
+  return absl::OkStatus();
 }
 
-absl::StatusOr<OwnedFileDescriptor> WriteSharedMemoryFile(
-    const absl::Cord& contents, absl::string_view name) {
-  int memfd = memfd_create(std::string(name).c_str(),
-                           O_RDWR | MFD_ALLOW_SEALING | MFD_CLOEXEC);
-  if (memfd == -1) {
-    return absl::ErrnoToStatus(errno, "memfd_create()");
+// Decompresses a zstd compressed file in `path` and passes the decompressed
+// contents to `sink` in chunks. The file may consist of multiple frames.
+// Returns an error status if decompression fails or if `sink` returns an
+// error.
+absl::Status DecompressZstdFile(const std::string& path, ChunkSink sink) {
+  const int input_fd = open(path.c_str(), O_RDONLY);
+  if (input_fd < 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(): ", path));
+  }
+  ZSTD_DCtx* dctx = ZSTD_createDCtx();
+  absl::Cleanup clean_up([dctx, input_fd]() {
+    ZSTD_freeDCtx(dctx);
+    close(input_fd);
+  });
+  if (dctx == nullptr) {
+    return absl::InternalError("Failed to create zstd decompression context");
   }
-  OwnedFileDescriptor owned_fd(memfd);
-  int fd = owned_fd.borrow();
-  RETURN_IF_NOT_OK(WriteCord(contents, fd));
 
-  // Seal file after write to prevent modification of its contents and seals.
-  // There appears to be a kernel bug that happens with large enough number of
-  // concurrent threads calling fcntl(2). The bug manifests as fcntl returning
-  // errno=EBUSY when passed F_SEAL_WRITE.
-  if (fcntl(fd, F_ADD_SEALS, F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
-    return absl::ErrnoToStatus(errno,
-                               absl::StrCat("fcntl(F_ADD_SEALS): ", name));
+  std::vector<char> input_buffer(ZSTD_DStreamInSize());
+  std::vector<char> output_buffer(ZSTD_DStreamOutSize());
+  // 0 once a frame is completely decoded and flushed.
+  size_t ret = 1;
+  ssize_t bytes_read;
+  while ((bytes_read = Read(input_fd, input_buffer.data(),
+                            input_buffer.size())) > 0) {
+    ZSTD_inBuffer input = {input_buffer.data(),
+                           static_cast<size_t>(bytes_read), 0};
+    while (input.pos < input.size) {
+      ZSTD_outBuffer output = {output_buffer.data(), output_buffer.size(), 0};
+      ret = ZSTD_decompressStream(dctx, &output, &input);
+      if (ZSTD_isError(ret)) {
+        return absl::InternalError(absl::StrCat(
+            "Failed to decompress data ", path, ": ", ZSTD_getErrorName(ret)));
+      }
+      RETURN_IF_NOT_OK(
+          sink(absl::string_view(output_buffer.data(), output.pos)));
+    }
+  }
+  if (bytes_read < 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("read(): ", path));
   }
 
-  // Move file descriptor to beginning of file.
-  if (lseek(fd, 0, SEEK_SET) != 0) {
-    return absl::ErrnoToStatus(errno, "lseek()");
+  // A frame may be fully consumed but not yet flushed.
+  while (ret != 0) {
+    ZSTD_inBuffer input = {nullptr, 0, 0};
+    ZSTD_outBuffer output = {output_buffer.data(), output_buffer.size(), 0};
+    ret = ZSTD_decompressStream(dctx, &output, &input);
+    if (ZSTD_isError(ret) || output.pos == 0) {
+      return absl::InternalError(
+          absl::StrCat("Truncated zstd compressed file ", path));
+    }
+    RETURN_IF_NOT_OK(sink(absl::string_view(output_buffer.data(), output.pos)));
   }
+  return absl::OkStatus();
+}
 
+}  // namespace
+
+absl::StatusOr<absl::Cord> ReadXzipFile(const std::string& path) {
+  absl::Cord decompressed_data;
+  RETURN_IF_NOT_OK(
+      DecompressXzipFile(path, [&decompressed_data](absl::string_view chunk) {
+        decompressed_data.Append(chunk);
+        return absl::OkStatus();
+      }));
+  return decompressed_data;
+}
+
+absl::StatusOr<OwnedFileDescriptor> WriteSharedMemoryFile(
+    const absl::Cord& contents, absl::string_view name, bool huge_pages) {
+  ASSIGN_OR_RETURN_IF_NOT_OK(OwnedFileDescriptor owned_fd,
+                             CreateSharedMemoryFile(name));
+  int fd = owned_fd.borrow();
+  if (huge_pages) {
+    RETURN_IF_NOT_OK(WriteCordUsingHugePages(contents, fd));
+  } else {
+    RETURN_IF_NOT_OK(WriteCord(contents, fd));
+  }
+  RETURN_IF_NOT_OK(SealSharedMemoryFile(fd, name));
   return owned_fd;
 }
 
@@ -210,51 +376,210 @@ std::string FilePathForFD(const OwnedFileDescriptor& fd) {
 
 constexpr const absl::string_view kXzExtension = ".xz";
 
-absl::StatusOr<InMemoryShard> LoadCorpus(const std::string& path) {
-  std::string name = absl::StrCat(Basename(path));
-
-  absl::Cord contents;
-  if (absl::EndsWith(path, kXzExtension)) {
-    // Clip .xz the extension from the file name.
-    name = name.substr(0, name.size() - kXzExtension.size());
-    ASSIGN_OR_RETURN_IF_NOT_OK(contents, ReadXzipFile(path));
-  } else {
-    // Assume this is an uncompressed corpus.
-    int fd = open(path.c_str(), O_RDONLY);
-    if (fd < 0) {
-      return absl::ErrnoToStatus(errno, absl::StrCat("open(): ", path));
-    }
-    absl::Cleanup file_closer = absl::MakeCleanup([fd] { close(fd); });
-    ASSIGN_OR_RETURN_IF_NOT_OK(contents, ReadCord(fd));
+std::string ShardName(absl::string_view path) {
+  absl::string_view name = Basename(path);
+  // Clip the compression extension from the file name.
+  if (!absl::ConsumeSuffix(&name, kXzExtension)) {
+    absl::ConsumeSuffix(&name, kZstdExtension);
   }
+  return std::string(name);
+}
 
-  // Will be truncated if the contents are too short.
-  std::string header_bytes(contents.Subcord(0, sizeof(SnapCorpusHeader)));
+namespace {
 
-  // Calculate checksum.
+// Produces the uncompressed contents of a shard and passes them to a sink.
+using ChunkReader = absl::FunctionRef<absl::Status(ChunkSink)>;
+
+// Writes the contents produced by `read_contents` to a sealed mem file for
+// the shard `name`. See LoadCorpus() for `huge_pages` and `prerelocate`.
+absl::StatusOr<InMemoryShard> LoadShardContents(const std::string& name,
+                                                ChunkReader read_contents,
+                                                bool huge_pages,
+                                                bool prerelocate) {
+  // Will be truncated if the contents are too short.
+  std::string header_bytes;
+  uint64_t file_size = 0;
   CorpusChecksumCalculator checksum;
-  for (absl::string_view chunk : contents.Chunks()) {
+  auto add_chunk = [&header_bytes, &file_size,
+                    &checksum](absl::string_view chunk) {
+    if (header_bytes.size() < sizeof(SnapCorpusHeader)) {
+      absl::string_view header_chunk =
+          chunk.substr(0, sizeof(SnapCorpusHeader) - header_bytes.size());
+      header_bytes.append(header_chunk.data(), header_chunk.size());
+    }
+    file_size += chunk.size();
     checksum.AddData(chunk);
-  }
+  };
 
   // Set linked name in /proc/self/fd/ for ease of debugging.
   ASSIGN_OR_RETURN_IF_NOT_OK(OwnedFileDescriptor owned_fd,
-                             WriteSharedMemoryFile(contents, name));
+                             CreateSharedMemoryFile(name));
+  const int fd = owned_fd.borrow();
+  if (huge_pages) {
+    // Writing through a huge page mapping needs the size up front, so collect
+    // the contents first.
+    absl::Cord contents;
+    RETURN_IF_NOT_OK(read_contents([&](absl::string_view chunk) {
+      add_chunk(chunk);
+      contents.Append(chunk);
+      return absl::OkStatus();
+    }));
+    RETURN_IF_NOT_OK(WriteCordUsingHugePages(contents, fd));
+  } else {
+    // Stream the contents directly into the file without an intermediate
+    // copy of the whole corpus.
+    RETURN_IF_NOT_OK(read_contents([&](absl::string_view chunk) {
+      add_chunk(chunk);
+      return WriteChunk(chunk, fd);
+    }));
+  }
+  RETURN_IF_NOT_OK(SealSharedMemoryFile(fd, name));
+
+  uintptr_t load_address = 0;
+  if (prerelocate) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(load_address,
+                               RelocateSharedMemoryFile(fd, file_size));
+  }
 
   std::string file_path = FilePathForFD(owned_fd);
 
   return InMemoryShard{
       .file_descriptor = std::move(owned_fd),
       .file_path = std::move(file_path),
-      .name = std::move(name),
+      .name = name,
       .header_bytes = std::move(header_bytes),
-      .file_size = contents.size(),
+      .file_size = file_size,
       .checksum = checksum.Checksum(),
+      .load_address = load_address,
   };
 }
 
+// Returns the SnapCorpusHeader at the start of the contents produced by
+// `read_contents`. Stops reading as soon as the header is complete, so only
+// the first chunk of a compressed shard is decompressed.
+absl::StatusOr<SnapCorpusHeader> PeekCorpusHeader(ChunkReader read_contents) {
+  std::string header_bytes;
+  absl::Status status =
+      read_contents([&header_bytes](absl::string_view chunk) {
+        header_bytes.append(
+            chunk.substr(0, sizeof(SnapCorpusHeader) - header_bytes.size()));
+        return header_bytes.size() < sizeof(SnapCorpusHeader)
+                   ? absl::OkStatus()
+                   : absl::CancelledError("Header complete");
+      });
+  if (header_bytes.size() < sizeof(SnapCorpusHeader)) {
+    return status.ok() ? absl::OutOfRangeError("Too small for a corpus header")
+                       : status;
+  }
+  SnapCorpusHeader header;
+  memcpy(&header, header_bytes.data(), sizeof(header));
+  return header;
+}
+
+// Returns true if `shard` has the contents described by `header`.
+bool ShardMatchesHeader(const InMemoryShard& shard,
+                        const SnapCorpusHeader& header) {
+  return shard.checksum == header.checksum &&
+         shard.file_size == header.num_bytes;
+}
+
+}  // namespace
+
+std::string ShardCachePath(absl::string_view shard_cache_dir,
+                           absl::string_view name, uint32_t checksum,
+                           uint64_t num_bytes) {
+  return absl::StrCat(shard_cache_dir, "/", name, "-",
+                      absl::Hex(checksum, absl::kZeroPad8), "-", num_bytes);
+}
+
+absl::StatusOr<InMemoryShard> LoadCorpus(const std::string& path,
+                                         bool huge_pages, bool prerelocate,
+                                         const std::string& shard_cache_dir) {
+  const std::string name = ShardName(path);
+  const bool xz_compressed = absl::EndsWith(path, kXzExtension);
+  const bool zstd_compressed = absl::EndsWith(path, kZstdExtension);
+
+  // Passes the uncompressed contents to `sink` in chunks.
+  auto read_source = [&path, xz_compressed,
+                      zstd_compressed](ChunkSink sink) -> absl::Status {
+    if (xz_compressed) {
+      return DecompressXzipFile(path, sink);
+    }
+    if (zstd_compressed) {
+      return DecompressZstdFile(path, sink);
+    }
+    // Assume this is an uncompressed corpus.
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return absl::ErrnoToStatus(errno, absl::StrCat("open(): ", path));
+    }
+    absl::Cleanup file_closer = absl::MakeCleanup([fd] { close(fd); });
+    return ReadChunks(fd, sink);
+  };
+
+  // A cached copy of an uncompressed shard would not save any work.
+  if (shard_cache_dir.empty() || !(xz_compressed || zstd_compressed)) {
+    return LoadShardContents(name, read_source, huge_pages, prerelocate);
+  }
+  absl::StatusOr<SnapCorpusHeader> header = PeekCorpusHeader(read_source);
+  if (!header.ok()) {
+    // Load it anyway so that the caller sees the same error or a shard that
+    // fails ValidateShard() as without a cache.
+    return LoadShardContents(name, read_source, huge_pages, prerelocate);
+  }
+  const std::string cache_path = ShardCachePath(
+      shard_cache_dir, name, header->checksum, header->num_bytes);
+
+  if (int cache_fd = open(cache_path.c_str(), O_RDONLY | O_CLOEXEC);
+      cache_fd >= 0) {
+    absl::Cleanup cache_closer = absl::MakeCleanup([cache_fd] {
+      close(cache_fd);
+    });
+    absl::StatusOr<InMemoryShard> shard = LoadShardContents(
+        name,
+        [cache_fd](ChunkSink sink) { return ReadChunks(cache_fd, sink); },
+        huge_pages, prerelocate);
+    if (shard.ok() && ShardMatchesHeader(*shard, *header)) {
+      VLOG_INFO(1, "Loaded corpus ", name, " from ", cache_path);
+      return shard;
+    }
+    LOG_ERROR("Discarding bad shard cache entry ", cache_path);
+    unlink(cache_path.c_str());
+  }
+
+  // Fill the cache while loading from the source. Entries are renamed into
+  // place when complete, so concurrent sessions never see partial entries.
+  std::string temp_path = absl::StrCat(cache_path, ".XXXXXX");
+  const int temp_fd = mkostemp(temp_path.data(), O_CLOEXEC);
+  if (temp_fd < 0) {
+    LOG_ERROR("Cannot create shard cache entry ", temp_path, ": ",
+              ErrnoStr(errno));
+    return LoadShardContents(name, read_source, huge_pages, prerelocate);
+  }
+  absl::Cleanup temp_closer = absl::MakeCleanup([temp_fd] { close(temp_fd); });
+  // A failure to write the cache entry does not fail the load.
+  bool stored = true;
+  absl::StatusOr<InMemoryShard> shard = LoadShardContents(
+      name,
+      [&read_source, temp_fd, &stored](ChunkSink sink) {
+        return read_source([&sink, temp_fd, &stored](absl::string_view chunk) {
+          stored = stored && WriteChunk(chunk, temp_fd).ok();
+          return sink(chunk);
+        });
+      },
+      huge_pages, prerelocate);
+  if (shard.ok() && stored && ShardMatchesHeader(*shard, *header) &&
+      rename(temp_path.c_str(), cache_path.c_str()) == 0) {
+    VLOG_INFO(1, "Stored corpus ", name, " in ", cache_path);
+  } else {
+    unlink(temp_path.c_str());
+  }
+  return shard;
+}
+
 absl::StatusOr<InMemoryCorpora> LoadCorpora(
-    const std::vector<std::string>& corpus_paths) {
+    const std::vector<std::string>& corpus_paths, bool huge_pages,
+    bool prerelocate, const std::string& shard_cache_dir) {
   // Cannot use construct owner_fds(size, init_value) because element type is
   // not copyable.
   std::vector<absl::StatusOr<InMemoryShard>> shards(corpus_paths.size());
@@ -264,25 +589,22 @@ absl::StatusOr<InMemoryCorpora> LoadCorpora(
                                         corpus_paths.size());
   CHECK_GT(num_threads, 0);
 
-  // Thread function to load a portion of corpus_paths and store
-  // results in the corresponding portion of owned_fds.
-  auto load_corpus_span =
-      [](absl::Span<const std::string> corpus_paths,
-         absl::Span<absl::StatusOr<InMemoryShard>> results) {
-        CHECK_EQ(corpus_paths.size(), results.size());
-        for (size_t i = 0; i < corpus_paths.size(); ++i) {
-          results[i] = LoadCorpus(corpus_paths[i]);
-        }
-      };
+  // Thread function to load corpus_paths not yet claimed by other threads
+  // and store results in the corresponding elements of shards. Shards are
+  // claimed one at a time so that threads stay busy when shard sizes differ.
+  std::atomic<size_t> next_shard = 0;
+  auto load_corpus_shards = [&corpus_paths, &shards, &next_shard, huge_pages,
+                             prerelocate, &shard_cache_dir]() {
+    for (size_t i = next_shard++; i < corpus_paths.size(); i = next_shard++) {
+      shards[i] = LoadCorpus(corpus_paths[i], huge_pages, prerelocate,
+                             shard_cache_dir);
+    }
+  };
 
-  // Distribute corpus paths evenly over corpus loader threads.
   std::vector<std::thread> loader_threads;
-  auto corpus_path_spans = PartitionEvenly(corpus_paths, num_threads);
-  auto shard_spans = PartitionEvenly(shards, num_threads);
   loader_threads.reserve(num_threads);
   for (size_t i = 0; i < num_threads; ++i) {
-    loader_threads.emplace_back(load_corpus_span, corpus_path_spans[i],
-                                shard_spans[i]);
+    loader_threads.emplace_back(load_corpus_shards);
   }
 
   for (auto& thread : loader_threads) {
@@ -339,6 +661,24 @@ absl::Status ValidateShard(const InMemoryShard& shard) {
   return absl::OkStatus();
 }
 
+void PrefetchShard(const InMemoryShard& shard) {
+  if (shard.file_size == 0) return;
+  // The shard is a memfd, for which readahead(2) and posix_fadvise(2) do
+  // nothing. MADV_WILLNEED on a shared mapping of it does start swap-in.
+  void* contents = mmap(nullptr, shard.file_size, PROT_READ, MAP_SHARED,
+                        shard.file_descriptor.borrow(), 0);
+  if (contents == MAP_FAILED) {
+    LOG_ERROR("Cannot map ", shard.name, " for prefetching: ",
+              strerror(errno));
+    return;
+  }
+  if (madvise(contents, shard.file_size, MADV_WILLNEED) != 0) {
+    LOG_ERROR("madvise(MADV_WILLNEED) failed for ", shard.name, ": ",
+              strerror(errno));
+  }
+  munmap(contents, shard.file_size);
+}
+
 absl::Status ValidateCorpus(const InMemoryCorpora& corpora) {
   size_t error_count = 0;
   size_t shard_count = 0;
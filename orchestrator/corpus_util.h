@@ -48,7 +48,13 @@ struct InMemoryShard {
   uint64_t file_size;
 
   // The checksum of the file.
+  // This is the checksum of the original contents, which matches the one in
+  // `header_bytes` even if the file has been relocated.
   uint32_t checksum;
+
+  // If not 0, the corpus in the file has been relocated to this address and
+  // runners should be told to map it there. See LoadCorpus().
+  uintptr_t load_address = 0;
 };
 
 struct InMemoryCorpora {
@@ -63,6 +69,12 @@ absl::Status ValidateCorpus(const InMemoryCorpora& corpora);
 // Exposed for testing.
 absl::Status ValidateShard(const InMemoryShard& shard);
 
+// Asks the kernel to bring the contents of `shard` into memory, e.g. after
+// they have been swapped out, so that the next runner mapping the shard does
+// not wait for them. This starts reading without waiting for it. It is only a
+// hint: errors are logged and otherwise ignored.
+void PrefetchShard(const InMemoryShard& shard);
+
 // Reads an lzma compressed file into memory.  Returns its contents in a cord or
 // an error status.
 absl::StatusOr<absl::Cord> ReadXzipFile(const std::string& path);
@@ -71,19 +83,47 @@ absl::StatusOr<absl::Cord> ReadXzipFile(const std::string& path);
 // to protect it from modification. The `name` for the file is optional and is
 // purely for debugging. WriteSharedMemoryFile() always creates a new file
 // for each call regardless of `name`.  See man page of memfd_create() for
-// details.
+// details. If `huge_pages` is true, the contents are written through a
+// MADV_HUGEPAGE mapping so that the file is backed by transparent huge pages
+// where the kernel allows it.
 //
 // RETURNS a file descriptor for the file, which remains opened at return.
 //
 // Caller owns the returned descriptor.
 absl::StatusOr<OwnedFileDescriptor> WriteSharedMemoryFile(
-    const absl::Cord& contents, absl::string_view = "SharedMemoryFile");
+    const absl::Cord& contents, absl::string_view = "SharedMemoryFile",
+    bool huge_pages = false);
+
+// Returns the InMemoryShard::name of the shard at `path`: its base name with
+// any compression extension stripped off.
+std::string ShardName(absl::string_view path);
+
+// Returns the path of the entry for the shard `name` with the given corpus
+// `checksum` and size in `shard_cache_dir`. See LoadCorpus().
+std::string ShardCachePath(absl::string_view shard_cache_dir,
+                           absl::string_view name, uint32_t checksum,
+                           uint64_t num_bytes);
 
 // Loads a compressed relocatable Snap corpus in `path` and returns an owned
 // file descriptor of a temp file containing uncompressed corpus contents in
 // RAM. LoadCorpus determines the decompression algorithm to use based on
-// suffix of `path`. Currently only .xz is recognized.
-absl::StatusOr<InMemoryShard> LoadCorpus(const std::string& path);
+// suffix of `path`. Currently .xz and .zst are recognized. See
+// WriteSharedMemoryFile() for `huge_pages`.
+//
+// If `prerelocate` is true, the corpus is also relocated in the file to an
+// address recorded in InMemoryShard::load_address, so that runners on the host
+// can share one relocated image instead of each relocating a private copy.
+//
+// If `shard_cache_dir` is not empty, it is a host-local directory of
+// uncompressed shards that persists across sessions. Entries are keyed by
+// the name, checksum and size in the corpus header, so only the start of a
+// compressed shard is decompressed to find its entry. On a hit, the shard is
+// read from the entry and the source is not read any further. On a miss, the
+// entry is written while the shard is loaded from `path`. Entries that do not
+// match their key are discarded. Nothing is ever evicted.
+absl::StatusOr<InMemoryShard> LoadCorpus(
+    const std::string& path, bool huge_pages = false, bool prerelocate = false,
+    const std::string& shard_cache_dir = "");
 
 // Reads and decompresses gzipped relocatable Snap corpora whose paths are in
 // `corpus_path`. Contents of each corpus are written in a file created in RAM.
@@ -92,9 +132,15 @@ absl::StatusOr<InMemoryShard> LoadCorpus(const std::string& path);
 // descriptors and a vector of paths or an error status. See above for details
 // about InMemoryCorpora.
 //
+// If `huge_pages` is true, the files are backed by transparent huge pages where
+// the kernel allows it. See WriteSharedMemoryFile().
+// If `prerelocate` is true, the corpora are relocated for sharing. See
+// LoadCorpus(), also for `shard_cache_dir`.
+//
 // REQUIRES: corpus_paths not empty.
 absl::StatusOr<InMemoryCorpora> LoadCorpora(
-    const std::vector<std::string>& corpus_paths);
+    const std::vector<std::string>& corpus_paths, bool huge_pages = false,
+    bool prerelocate = false, const std::string& shard_cache_dir = "");
 
 }  // namespace silifuzz
 
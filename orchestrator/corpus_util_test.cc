@@ -24,8 +24,10 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "gmock/gmock.h"
@@ -35,11 +37,14 @@
 #include "absl/strings/cord.h"
 #include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "./snap/snap.h"
+#include "./snap/snap_checksum.h"
 #include "./util/byte_io.h"
 #include "./util/owned_file_descriptor.h"
 #include "./util/testing/status_macros.h"
 #include "./util/testing/status_matchers.h"
+#include "./util/zstd_util.h"
 
 namespace silifuzz {
 namespace {
@@ -130,27 +135,54 @@ TEST(CorpusUtil, WriteSharedMemoryFile) {
   contents.Append(big_string_1);
   contents.Append(big_string_2);
 
-  ASSERT_OK_AND_ASSIGN(OwnedFileDescriptor owned_fd,
-                       WriteSharedMemoryFile(contents));
-  struct stat stat_buf;
-  ASSERT_EQ(fstat(owned_fd.borrow(), &stat_buf), 0);
-  EXPECT_EQ(stat_buf.st_size, contents.size());
+  for (bool huge_pages : {false, true}) {
+    SCOPED_TRACE(absl::StrCat("huge_pages=", huge_pages));
+    ASSERT_OK_AND_ASSIGN(
+        OwnedFileDescriptor owned_fd,
+        WriteSharedMemoryFile(contents, "SharedMemoryFile", huge_pages));
+    struct stat stat_buf;
+    ASSERT_EQ(fstat(owned_fd.borrow(), &stat_buf), 0);
+    EXPECT_EQ(stat_buf.st_size, contents.size());
+
+    // Check that file is correctly sealed.
+    int seals = fcntl(owned_fd.borrow(), F_GET_SEALS);
+    EXPECT_NE(seals, -1);
+    constexpr int kExpectedSeals = F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW;
+    EXPECT_EQ(seals & kExpectedSeals, kExpectedSeals);
+
+    EXPECT_EQ(ftruncate(owned_fd.borrow(), 0), -1);
+    EXPECT_EQ(ftruncate(owned_fd.borrow(), stat_buf.st_size + 1), -1);
+
+    // Check that contents are correctly written.
+    std::string buffer(stat_buf.st_size, 0);
+    EXPECT_EQ(lseek(owned_fd.borrow(), 0, SEEK_SET), 0);
+    EXPECT_EQ(Read(owned_fd.borrow(), buffer.data(), buffer.size()),
+              buffer.size());
+    EXPECT_EQ(buffer, contents);
+  }
+}
 
-  // Check that file is correctly sealed.
-  int seals = fcntl(owned_fd.borrow(), F_GET_SEALS);
-  EXPECT_NE(seals, -1);
-  constexpr int kExpectedSeals = F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW;
-  EXPECT_EQ(seals & kExpectedSeals, kExpectedSeals);
+TEST(CorpusUtil, PrefetchShard) {
+  const std::string contents(1 << 20, 42);
+  ASSERT_OK_AND_ASSIGN(OwnedFileDescriptor owned_fd,
+                       WriteSharedMemoryFile(absl::Cord(contents)));
+  InMemoryShard shard{
+      .file_descriptor = std::move(owned_fd),
+      .name = "prefetched",
+      .file_size = contents.size(),
+  };
+  PrefetchShard(shard);
+  EXPECT_OK(CheckFileContents(shard.file_descriptor.borrow(), contents));
 
-  EXPECT_EQ(ftruncate(owned_fd.borrow(), 0), -1);
-  EXPECT_EQ(ftruncate(owned_fd.borrow(), stat_buf.st_size + 1), -1);
+  // Empty shards are skipped.
+  shard.file_size = 0;
+  PrefetchShard(shard);
+}
 
-  // Check that contents are correctly written.
-  std::string buffer(stat_buf.st_size, 0);
-  EXPECT_EQ(lseek(owned_fd.borrow(), 0, SEEK_SET), 0);
-  EXPECT_EQ(Read(owned_fd.borrow(), buffer.data(), buffer.size()),
-            buffer.size());
-  EXPECT_EQ(buffer, contents);
+TEST(CorpusUtil, ShardName) {
+  EXPECT_EQ(ShardName("/path/to/corpus.00001.xz"), "corpus.00001");
+  EXPECT_EQ(ShardName("/path/to/corpus.00001.zst"), "corpus.00001");
+  EXPECT_EQ(ShardName("corpus.00001"), "corpus.00001");
 }
 
 TEST(CorpusUtil, LoadCorpora) {
@@ -217,6 +249,64 @@ TEST(CorpusUtil, LoadCorpora) {
   }
 }
 
+TEST(CorpusUtil, LoadCorporaZstd) {
+  // Large enough to span several zstd stream buffers.
+  std::string large_contents;
+  for (int i = 0; large_contents.size() < (1 << 20); ++i) {
+    absl::StrAppend(&large_contents, i, "\n");
+  }
+  const std::vector<std::string> corpus_contents{"one\n", large_contents};
+
+  std::vector<std::string> corpus_paths;
+  for (size_t i = 0; i < corpus_contents.size(); ++i) {
+    corpus_paths.push_back(
+        absl::StrCat(TempDir(), "/LoadCorporaZstdTest_", i, ".zst"));
+    // Compress the contents as two frames to test multi-frame files.
+    const absl::string_view contents = corpus_contents[i];
+    const size_t half = contents.size() / 2;
+    ASSERT_OK_AND_ASSIGN(std::string first,
+                         ZstdCompress(contents.substr(0, half), 3));
+    ASSERT_OK_AND_ASSIGN(std::string second,
+                         ZstdCompress(contents.substr(half), 3));
+    const std::string compressed = first + second;
+    const int fd = open(corpus_paths[i].c_str(), O_CREAT | O_TRUNC | O_WRONLY,
+                        S_IRUSR | S_IWUSR);
+    ASSERT_NE(fd, -1);
+    ASSERT_EQ(Write(fd, compressed.data(), compressed.size()),
+              compressed.size());
+    ASSERT_EQ(close(fd), 0);
+  }
+
+  ASSERT_OK_AND_ASSIGN(InMemoryCorpora load_corpora_result,
+                       LoadCorpora(corpus_paths));
+
+  EXPECT_EQ(load_corpora_result.shards.size(), corpus_contents.size());
+  for (size_t i = 0; i < corpus_contents.size(); ++i) {
+    const InMemoryShard& shard = load_corpora_result.shards[i];
+    EXPECT_EQ(shard.name, absl::StrCat("LoadCorporaZstdTest_", i));
+    EXPECT_EQ(shard.file_size, corpus_contents[i].size());
+    EXPECT_OK(
+        CheckFileContents(shard.file_descriptor.borrow(), corpus_contents[i]));
+  }
+}
+
+TEST(CorpusUtil, LoadCorporaTruncatedZstd) {
+  ASSERT_OK_AND_ASSIGN(std::string compressed,
+                       ZstdCompress("Hello World.\n", 3));
+  compressed.resize(compressed.size() - 1);
+  const std::string path =
+      absl::StrCat(TempDir(), "/LoadCorporaTruncatedZstdTest.zst");
+  const int fd =
+      open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(Write(fd, compressed.data(), compressed.size()),
+            compressed.size());
+  ASSERT_EQ(close(fd), 0);
+
+  EXPECT_THAT(LoadCorpora({path}).status(),
+              StatusIs(absl::StatusCode::kInternal, HasSubstr("zstd")));
+}
+
 TEST(CorpusUtil, LoadCorporaFileNotFound) {
   std::vector<std::string> corpus_paths{"This does not exist.xz"};
   absl::StatusOr<InMemoryCorpora> load_corpora_result_or =
@@ -257,6 +347,121 @@ TEST(CorpusUtil, LoadCorporaUncompressed) {
   }
 }
 
+// Returns the contents of a fake corpus of `size` bytes with a valid header.
+std::string FakeCorpusContents(size_t size) {
+  std::string contents(size, 0);
+  for (size_t i = sizeof(SnapCorpusHeader); i < size; ++i) {
+    contents[i] = static_cast<char>(i % 251);
+  }
+  SnapCorpusHeader header{
+      .magic = kSnapCorpusMagic,
+      .header_size = sizeof(SnapCorpusHeader),
+      .num_bytes = size,
+  };
+  memcpy(contents.data(), &header, sizeof(header));
+  CorpusChecksumCalculator checksum;
+  checksum.AddData(contents);
+  header.checksum = checksum.Checksum();
+  memcpy(contents.data(), &header, sizeof(header));
+  return contents;
+}
+
+// Writes `contents` zstd compressed to `path`, with the header in a frame of
+// its own.
+void WriteZstdCorpus(const std::string& path, absl::string_view contents) {
+  ASSERT_OK_AND_ASSIGN(
+      std::string compressed,
+      ZstdCompress(contents.substr(0, sizeof(SnapCorpusHeader)), 3));
+  ASSERT_OK_AND_ASSIGN(
+      std::string rest,
+      ZstdCompress(contents.substr(sizeof(SnapCorpusHeader)), 3));
+  compressed += rest;
+  const int fd =
+      open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, S_IRUSR | S_IWUSR);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(Write(fd, compressed.data(), compressed.size()),
+            compressed.size());
+  ASSERT_EQ(close(fd), 0);
+}
+
+// Returns the contents of the file at `path`.
+std::string ReadFileContents(const std::string& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) return "";
+  std::string contents;
+  char buffer[4096];
+  ssize_t bytes_read;
+  while ((bytes_read = Read(fd, buffer, sizeof(buffer))) > 0) {
+    contents.append(buffer, bytes_read);
+  }
+  close(fd);
+  return contents;
+}
+
+TEST(CorpusUtil, ShardCacheHit) {
+  const std::string cache_dir = absl::StrCat(TempDir(), "/ShardCacheHit");
+  ASSERT_EQ(mkdir(cache_dir.c_str(), S_IRWXU), 0);
+  const std::string contents = FakeCorpusContents(100000);
+  const std::string path = absl::StrCat(TempDir(), "/ShardCacheHit.zst");
+  WriteZstdCorpus(path, contents);
+
+  // The first load fills the cache.
+  ASSERT_OK_AND_ASSIGN(InMemoryShard shard,
+                       LoadCorpus(path, false, false, cache_dir));
+  EXPECT_OK(ValidateShard(shard));
+  EXPECT_OK(CheckFileContents(shard.file_descriptor.borrow(), contents));
+  const SnapCorpusHeader& header =
+      *reinterpret_cast<const SnapCorpusHeader*>(contents.data());
+  EXPECT_EQ(ReadFileContents(ShardCachePath(cache_dir, "ShardCacheHit",
+                                            header.checksum,
+                                            header.num_bytes)),
+            contents);
+
+  // Leave only the frame with the header in the source. The cache provides
+  // the rest.
+  ASSERT_OK_AND_ASSIGN(
+      std::string header_frame,
+      ZstdCompress(absl::string_view(contents).substr(
+                       0, sizeof(SnapCorpusHeader)),
+                   3));
+  ASSERT_EQ(truncate(path.c_str(), header_frame.size()), 0);
+  ASSERT_OK_AND_ASSIGN(InMemoryShard cached,
+                       LoadCorpus(path, false, false, cache_dir));
+  EXPECT_OK(ValidateShard(cached));
+  EXPECT_OK(CheckFileContents(cached.file_descriptor.borrow(), contents));
+}
+
+TEST(CorpusUtil, ShardCacheDiscardsBadEntry) {
+  const std::string cache_dir =
+      absl::StrCat(TempDir(), "/ShardCacheDiscardsBadEntry");
+  ASSERT_EQ(mkdir(cache_dir.c_str(), S_IRWXU), 0);
+  const std::string contents = FakeCorpusContents(4096);
+  const std::string path =
+      absl::StrCat(TempDir(), "/ShardCacheDiscardsBadEntry.zst");
+  WriteZstdCorpus(path, contents);
+  const SnapCorpusHeader& header =
+      *reinterpret_cast<const SnapCorpusHeader*>(contents.data());
+  const std::string cache_path =
+      ShardCachePath(cache_dir, "ShardCacheDiscardsBadEntry", header.checksum,
+                     header.num_bytes);
+
+  // Plant a corrupted entry.
+  std::string corrupted = contents;
+  corrupted.back() ^= 1;
+  const int fd = open(cache_path.c_str(), O_CREAT | O_TRUNC | O_WRONLY,
+                      S_IRUSR | S_IWUSR);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(Write(fd, corrupted.data(), corrupted.size()), corrupted.size());
+  ASSERT_EQ(close(fd), 0);
+
+  ASSERT_OK_AND_ASSIGN(InMemoryShard shard,
+                       LoadCorpus(path, false, false, cache_dir));
+  EXPECT_OK(ValidateShard(shard));
+  EXPECT_OK(CheckFileContents(shard.file_descriptor.borrow(), contents));
+  // The entry is replaced with the correct contents.
+  EXPECT_EQ(ReadFileContents(cache_path), contents);
+}
+
 class ValidateShardTest : public ::testing::Test {
  protected:
   void SetUp() override {
@@ -0,0 +1,173 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "./orchestrator/cpu_topology.h"
+
+#include <algorithm>
+#include <filesystem>  // NOLINT
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "./util/checks.h"
+#include "./util/tool_util.h"
+
+namespace silifuzz {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Reads a file containing a single integer. Returns `default_value` if the
+// file cannot be read or parsed.
+int ReadIntOr(const fs::path &path, int default_value) {
+  absl::StatusOr<std::string> contents = GetFileContents(path.string());
+  int value;
+  if (!contents.ok() ||
+      !absl::SimpleAtoi(absl::StripAsciiWhitespace(*contents), &value)) {
+    return default_value;
+  }
+  return value;
+}
+
+// Maps CPUs to NUMA nodes according to /sys/devices/system/node/node*/cpulist.
+absl::flat_hash_map<int, int> ReadNumaNodes(const fs::path &node_dir) {
+  absl::flat_hash_map<int, int> cpu_to_node;
+  std::error_code ec;
+  for (const fs::directory_entry &entry :
+       fs::directory_iterator(node_dir, ec)) {
+    std::string name = entry.path().filename().string();
+    int node;
+    if (!absl::StartsWith(name, "node") ||
+        !absl::SimpleAtoi(absl::string_view(name).substr(4), &node)) {
+      continue;
+    }
+    absl::StatusOr<std::string> contents =
+        GetFileContents((entry.path() / "cpulist").string());
+    if (!contents.ok()) {
+      continue;
+    }
+    absl::StatusOr<std::vector<int>> cpus =
+        ParseCpuList(absl::StripAsciiWhitespace(*contents));
+    if (!cpus.ok()) {
+      LOG_ERROR(cpus.status().message());
+      continue;
+    }
+    for (int cpu : *cpus) {
+      cpu_to_node[cpu] = node;
+    }
+  }
+  return cpu_to_node;
+}
+
+}  // namespace
+
+absl::StatusOr<std::vector<int>> ParseCpuList(absl::string_view cpu_list) {
+  std::vector<int> cpus;
+  if (cpu_list.empty()) {
+    return cpus;
+  }
+  for (absl::string_view range : absl::StrSplit(cpu_list, ',')) {
+    std::pair<absl::string_view, absl::string_view> bounds =
+        absl::StrSplit(range, absl::MaxSplits('-', 1));
+    int first, last;
+    if (!absl::SimpleAtoi(bounds.first, &first)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Bad CPU list: ", cpu_list));
+    }
+    last = first;
+    if (!bounds.second.empty() && !absl::SimpleAtoi(bounds.second, &last)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Bad CPU list: ", cpu_list));
+    }
+    if (first < 0 || last < first) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Bad CPU list: ", cpu_list));
+    }
+    for (int cpu = first; cpu <= last; ++cpu) {
+      cpus.push_back(cpu);
+    }
+  }
+  return cpus;
+}
+
+std::vector<CpuLocation> ReadCpuTopology(const std::vector<int> &cpus,
+                                         const std::string &sysfs_root) {
+  const fs::path root(sysfs_root);
+  absl::flat_hash_map<int, int> cpu_to_node = ReadNumaNodes(root / "node");
+  std::vector<CpuLocation> topology;
+  topology.reserve(cpus.size());
+  for (int cpu : cpus) {
+    const fs::path topology_dir =
+        root / "cpu" / absl::StrCat("cpu", cpu) / "topology";
+    auto node = cpu_to_node.find(cpu);
+    topology.push_back({
+        .cpu = cpu,
+        .numa_node = node == cpu_to_node.end() ? 0 : node->second,
+        .package_id = ReadIntOr(topology_dir / "physical_package_id", 0),
+        // Without topology information treat every CPU as a separate core.
+        .core_id = ReadIntOr(topology_dir / "core_id", cpu),
+    });
+  }
+  return topology;
+}
+
+absl::StatusOr<SmtPolicy> ParseSmtPolicy(absl::string_view policy) {
+  if (policy == "all") {
+    return SmtPolicy::kAllSiblings;
+  }
+  if (policy == "one_per_core") {
+    return SmtPolicy::kOnePerCore;
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat("Unknown SMT policy: ", policy));
+}
+
+std::vector<CpuLocation> SelectCpus(const std::vector<CpuLocation> &topology,
+                                    SmtPolicy policy) {
+  if (policy == SmtPolicy::kAllSiblings) {
+    return topology;
+  }
+  std::vector<CpuLocation> selected;
+  std::set<std::pair<int, int>> seen_cores;
+  for (const CpuLocation &location : topology) {
+    if (seen_cores.insert({location.package_id, location.core_id}).second) {
+      selected.push_back(location);
+    }
+  }
+  return selected;
+}
+
+std::vector<int> NumaNodes(const std::vector<CpuLocation> &topology) {
+  std::vector<int> nodes;
+  for (const CpuLocation &location : topology) {
+    nodes.push_back(location.numa_node);
+  }
+  std::sort(nodes.begin(), nodes.end());
+  nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+  return nodes;
+}
+
+}  // namespace silifuzz
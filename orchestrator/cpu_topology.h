@@ -0,0 +1,77 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_CPU_TOPOLOGY_H_
+#define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_CPU_TOPOLOGY_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+// Helpers for placing orchestrator workers and corpus memory according to the
+// NUMA and SMT topology of the machine.
+
+namespace silifuzz {
+
+// Location of a single logical CPU.
+struct CpuLocation {
+  // Logical CPU number as used by sched_setaffinity(2).
+  int cpu = 0;
+
+  // NUMA node the CPU belongs to.
+  int numa_node = 0;
+
+  // Physical package (socket) and core within the package. Logical CPUs with
+  // equal (package_id, core_id) are SMT siblings.
+  int package_id = 0;
+  int core_id = 0;
+};
+
+// Parses a Linux CPU list such as "0-3,8,10-11" into {0,1,2,3,8,10,11}.
+absl::StatusOr<std::vector<int>> ParseCpuList(absl::string_view cpu_list);
+
+// Reads topology information of `cpus` from `sysfs_root` (normally
+// /sys/devices/system). Information that the kernel does not provide, e.g.
+// NUMA nodes on non-NUMA kernels, defaults to node 0 and one core per CPU.
+std::vector<CpuLocation> ReadCpuTopology(
+    const std::vector<int> &cpus,
+    const std::string &sysfs_root = "/sys/devices/system");
+
+// How workers are placed on SMT siblings.
+enum class SmtPolicy {
+  // Use every logical CPU. Siblings compete for the core, which exercises
+  // shared core resources.
+  kAllSiblings,
+
+  // Use the first logical CPU of each core only. Runners get a core to
+  // themselves.
+  kOnePerCore,
+};
+
+// Parses "all" or "one_per_core".
+absl::StatusOr<SmtPolicy> ParseSmtPolicy(absl::string_view policy);
+
+// Returns the subset of `topology` selected by `policy`, in the original order.
+std::vector<CpuLocation> SelectCpus(const std::vector<CpuLocation> &topology,
+                                    SmtPolicy policy);
+
+// Returns the sorted, distinct NUMA nodes of `topology`.
+std::vector<int> NumaNodes(const std::vector<CpuLocation> &topology);
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_CPU_TOPOLOGY_H_
@@ -0,0 +1,122 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "./orchestrator/cpu_topology.h"
+
+#include <filesystem>  // NOLINT
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "./util/testing/status_matchers.h"
+
+namespace silifuzz {
+namespace {
+
+namespace fs = std::filesystem;
+
+using silifuzz::testing::IsOkAndHolds;
+using silifuzz::testing::StatusIs;
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::TempDir;
+
+void WriteFile(const fs::path &path, const std::string &contents) {
+  fs::create_directories(path.parent_path());
+  std::ofstream(path) << contents;
+}
+
+TEST(CpuTopology, ParseCpuList) {
+  EXPECT_THAT(ParseCpuList(""), IsOkAndHolds(IsEmpty()));
+  EXPECT_THAT(ParseCpuList("3"), IsOkAndHolds(ElementsAre(3)));
+  EXPECT_THAT(ParseCpuList("0-3,8,10-11"),
+              IsOkAndHolds(ElementsAre(0, 1, 2, 3, 8, 10, 11)));
+  EXPECT_THAT(ParseCpuList("3-1"), StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseCpuList("a"), StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+// Two packages with one NUMA node each, two cores per package and two SMT
+// siblings per core. CPUs 0-3 are the first siblings, 4-7 the second ones.
+std::string MakeFakeSysfs() {
+  const fs::path root = fs::path(TempDir()) / "fake_sysfs";
+  fs::remove_all(root);
+  for (int cpu = 0; cpu < 8; ++cpu) {
+    const fs::path topology =
+        root / "cpu" / absl::StrCat("cpu", cpu) / "topology";
+    const int core = cpu % 4;
+    WriteFile(topology / "physical_package_id", absl::StrCat(core / 2, "\n"));
+    WriteFile(topology / "core_id", absl::StrCat(core % 2, "\n"));
+  }
+  WriteFile(root / "node" / "node0" / "cpulist", "0-1,4-5\n");
+  WriteFile(root / "node" / "node1" / "cpulist", "2-3,6-7\n");
+  WriteFile(root / "node" / "possible", "0-1\n");
+  return root.string();
+}
+
+TEST(CpuTopology, ReadCpuTopology) {
+  std::vector<CpuLocation> topology =
+      ReadCpuTopology({0, 1, 2, 3, 4, 5, 6, 7}, MakeFakeSysfs());
+  ASSERT_EQ(topology.size(), 8);
+  std::vector<int> nodes, packages, cores;
+  for (const CpuLocation &location : topology) {
+    nodes.push_back(location.numa_node);
+    packages.push_back(location.package_id);
+    cores.push_back(location.core_id);
+  }
+  EXPECT_THAT(nodes, ElementsAre(0, 0, 1, 1, 0, 0, 1, 1));
+  EXPECT_THAT(packages, ElementsAre(0, 0, 1, 1, 0, 0, 1, 1));
+  EXPECT_THAT(cores, ElementsAre(0, 1, 0, 1, 0, 1, 0, 1));
+  EXPECT_THAT(NumaNodes(topology), ElementsAre(0, 1));
+}
+
+TEST(CpuTopology, MissingSysfs) {
+  std::vector<CpuLocation> topology =
+      ReadCpuTopology({2, 5}, "/this does not exist");
+  ASSERT_EQ(topology.size(), 2);
+  EXPECT_EQ(topology[0].numa_node, 0);
+  EXPECT_EQ(topology[1].numa_node, 0);
+  EXPECT_NE(topology[0].core_id, topology[1].core_id);
+}
+
+TEST(CpuTopology, SelectCpus) {
+  std::vector<CpuLocation> topology =
+      ReadCpuTopology({0, 1, 2, 3, 4, 5, 6, 7}, MakeFakeSysfs());
+  auto cpus_of = [](const std::vector<CpuLocation> &locations) {
+    std::vector<int> cpus;
+    for (const CpuLocation &location : locations) {
+      cpus.push_back(location.cpu);
+    }
+    return cpus;
+  };
+  EXPECT_THAT(cpus_of(SelectCpus(topology, SmtPolicy::kAllSiblings)),
+              ElementsAre(0, 1, 2, 3, 4, 5, 6, 7));
+  EXPECT_THAT(cpus_of(SelectCpus(topology, SmtPolicy::kOnePerCore)),
+              ElementsAre(0, 1, 2, 3));
+}
+
+TEST(CpuTopology, ParseSmtPolicy) {
+  EXPECT_THAT(ParseSmtPolicy("all"), IsOkAndHolds(SmtPolicy::kAllSiblings));
+  EXPECT_THAT(ParseSmtPolicy("one_per_core"),
+              IsOkAndHolds(SmtPolicy::kOnePerCore));
+  EXPECT_THAT(ParseSmtPolicy("some"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+}  // namespace
+}  // namespace silifuzz
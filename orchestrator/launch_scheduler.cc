@@ -0,0 +1,65 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/launch_scheduler.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "./util/checks.h"
+
+namespace silifuzz {
+
+RunnerLaunchScheduler::RunnerLaunchScheduler(const Options &options,
+                                             uint64_t seed)
+    : options_(options),
+      launches_(options.max_startups, absl::InfinitePast()),
+      random_(seed) {
+  CHECK_GE(options_.max_startups, 0);
+  CHECK_GE(options_.budget_jitter, 0);
+  CHECK_LT(options_.budget_jitter, 1);
+}
+
+absl::Time RunnerLaunchScheduler::ReserveLaunch(absl::Time now) {
+  if (options_.max_startups == 0) return now;
+  absl::MutexLock l(&mu_);
+  const absl::Time newest =
+      launches_[(next_launch_ + launches_.size() - 1) % launches_.size()];
+  const absl::Time oldest = launches_[next_launch_];
+  const absl::Time launch =
+      std::max({now, newest, oldest + options_.startup_window});
+  launches_[next_launch_] = launch;
+  next_launch_ = (next_launch_ + 1) % launches_.size();
+  return launch;
+}
+
+absl::Duration RunnerLaunchScheduler::JitterBudget(absl::Duration budget) {
+  if (options_.budget_jitter == 0 || budget == absl::InfiniteDuration()) {
+    return budget;
+  }
+  double factor;
+  {
+    absl::MutexLock l(&mu_);
+    factor = std::uniform_real_distribution<double>(
+        1 - options_.budget_jitter, 1 + options_.budget_jitter)(random_);
+  }
+  return std::max(absl::Seconds(1),
+                  absl::Trunc(budget * factor, absl::Seconds(1)));
+}
+
+}  // namespace silifuzz
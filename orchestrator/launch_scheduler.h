@@ -0,0 +1,87 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_LAUNCH_SCHEDULER_H_
+#define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_LAUNCH_SCHEDULER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace silifuzz {
+
+// Spreads runner startups (exec, corpus loading and mapping) over time.
+//
+// Runners whose budgets expire together would otherwise restart together and
+// cause bursts of page cache and memory bandwidth use. Each launch reserves a
+// startup slot and at most `max_startups` launches fall into any
+// `startup_window`. CPU time budgets are jittered so that runners started
+// together drift apart.
+//
+// This class is thread-safe.
+class RunnerLaunchScheduler {
+ public:
+  struct Options {
+    // Maximum number of launches within any `startup_window`. 0 means no
+    // limit.
+    int max_startups = 0;
+
+    // Expected duration of a runner startup.
+    absl::Duration startup_window = absl::Seconds(1);
+
+    // CPU time budgets are scaled by a uniformly random factor in
+    // [1 - budget_jitter, 1 + budget_jitter]. Must be in [0, 1).
+    double budget_jitter = 0;
+  };
+
+  RunnerLaunchScheduler(const Options &options, uint64_t seed);
+
+  // Not copyable or moveable -- shared between threads.
+  RunnerLaunchScheduler(const RunnerLaunchScheduler &) = delete;
+  RunnerLaunchScheduler(RunnerLaunchScheduler &&) = delete;
+  RunnerLaunchScheduler &operator=(const RunnerLaunchScheduler &) = delete;
+  RunnerLaunchScheduler &operator=(RunnerLaunchScheduler &&) = delete;
+
+  // Reserves a slot for a runner that is ready to launch at `now` and returns
+  // the time at which it may launch, which is no earlier than `now`. The
+  // slot counts against the limit whether or not the runner is launched.
+  absl::Time ReserveLaunch(absl::Time now);
+
+  // Returns `budget` with jitter applied, rounded down to whole seconds, the
+  // granularity of RLIMIT_CPU, and at least 1 second. An infinite budget is
+  // returned as is.
+  absl::Duration JitterBudget(absl::Duration budget);
+
+ private:
+  const Options options_;
+
+  absl::Mutex mu_;
+
+  // The last `max_startups` reserved launch times, in a ring. Reservations
+  // are handed out in non-decreasing order so the element at `next_launch_`
+  // is the oldest one.
+  std::vector<absl::Time> launches_ ABSL_GUARDED_BY(mu_);
+  size_t next_launch_ ABSL_GUARDED_BY(mu_) = 0;
+
+  std::mt19937_64 random_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_LAUNCH_SCHEDULER_H_
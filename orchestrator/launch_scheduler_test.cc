@@ -0,0 +1,73 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/launch_scheduler.h"
+
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+
+namespace silifuzz {
+namespace {
+
+TEST(RunnerLaunchScheduler, NoLimit) {
+  RunnerLaunchScheduler scheduler({}, 0);
+  const absl::Time now = absl::UnixEpoch();
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(scheduler.ReserveLaunch(now), now);
+  }
+}
+
+TEST(RunnerLaunchScheduler, RateLimit) {
+  RunnerLaunchScheduler scheduler(
+      {.max_startups = 2, .startup_window = absl::Seconds(1)}, 0);
+  const absl::Time now = absl::UnixEpoch();
+  EXPECT_EQ(scheduler.ReserveLaunch(now), now);
+  EXPECT_EQ(scheduler.ReserveLaunch(now), now);
+  EXPECT_EQ(scheduler.ReserveLaunch(now), now + absl::Seconds(1));
+  EXPECT_EQ(scheduler.ReserveLaunch(now), now + absl::Seconds(1));
+  EXPECT_EQ(scheduler.ReserveLaunch(now), now + absl::Seconds(2));
+  // Launches that are ready later are not held back by old reservations.
+  EXPECT_EQ(scheduler.ReserveLaunch(now + absl::Seconds(10)),
+            now + absl::Seconds(10));
+  // Reservations never go back in time.
+  EXPECT_EQ(scheduler.ReserveLaunch(now + absl::Seconds(5)),
+            now + absl::Seconds(10));
+  EXPECT_EQ(scheduler.ReserveLaunch(now + absl::Seconds(5)),
+            now + absl::Seconds(11));
+}
+
+TEST(RunnerLaunchScheduler, JitterBudget) {
+  RunnerLaunchScheduler no_jitter({}, 0);
+  EXPECT_EQ(no_jitter.JitterBudget(absl::Milliseconds(10500)),
+            absl::Milliseconds(10500));
+
+  RunnerLaunchScheduler scheduler({.budget_jitter = 0.5}, 0);
+  EXPECT_EQ(scheduler.JitterBudget(absl::InfiniteDuration()),
+            absl::InfiniteDuration());
+  bool saw_lower = false, saw_higher = false;
+  for (int i = 0; i < 100; ++i) {
+    const absl::Duration budget = scheduler.JitterBudget(absl::Seconds(100));
+    EXPECT_GE(budget, absl::Seconds(50));
+    EXPECT_LE(budget, absl::Seconds(150));
+    EXPECT_EQ(budget, absl::Trunc(budget, absl::Seconds(1)));
+    saw_lower |= budget < absl::Seconds(100);
+    saw_higher |= budget > absl::Seconds(100);
+  }
+  EXPECT_TRUE(saw_lower);
+  EXPECT_TRUE(saw_higher);
+  EXPECT_GE(scheduler.JitterBudget(absl::Seconds(1)), absl::Seconds(1));
+}
+
+}  // namespace
+}  // namespace silifuzz
@@ -0,0 +1,203 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/metrics_page.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "absl/cleanup/cleanup.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "./util/checks.h"
+
+namespace silifuzz {
+
+// Readers in other processes access the counters through their own mapping.
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+
+namespace {
+
+// Workers start at the first cache line after the header.
+constexpr size_t kWorkersOffset =
+    (sizeof(MetricsPage::Header) + alignof(WorkerMetrics) - 1) /
+    alignof(WorkerMetrics) * alignof(WorkerMetrics);
+
+}  // namespace
+
+void WorkerMetrics::StartRun(absl::string_view shard_name) {
+  char name[kMaxShardNameSize] = {};
+  memcpy(name, shard_name.data(), std::min(shard_name.size(), sizeof(name)));
+  // Sequence lock with a single writer.
+  const uint64_t sequence = shard_sequence.load(std::memory_order_relaxed);
+  shard_sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  for (size_t i = 0; i < std::size(current_shard); ++i) {
+    uint64_t word;
+    memcpy(&word, name + i * sizeof(word), sizeof(word));
+    current_shard[i].store(word, std::memory_order_relaxed);
+  }
+  shard_sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void WorkerMetrics::EndRun(bool failed, uint64_t snaps_executed,
+                           absl::Duration startup) {
+  // Only the owning worker writes, so load and store need not be atomic
+  // together.
+  auto add = [](std::atomic<uint64_t> &counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  };
+  add(num_runs, 1);
+  add(num_snaps_executed, snaps_executed);
+  add(num_failures, failed);
+  add(startup_time_ns, absl::ToInt64Nanoseconds(startup));
+}
+
+WorkerMetrics::Values WorkerMetrics::Read() const {
+  Values values = {
+      .num_runs = num_runs.load(std::memory_order_relaxed),
+      .num_snaps_executed = num_snaps_executed.load(std::memory_order_relaxed),
+      .num_failures = num_failures.load(std::memory_order_relaxed),
+      .startup_time = absl::Nanoseconds(
+          startup_time_ns.load(std::memory_order_relaxed)),
+  };
+  char name[kMaxShardNameSize];
+  while (true) {
+    const uint64_t sequence = shard_sequence.load(std::memory_order_acquire);
+    if (sequence % 2 != 0) continue;
+    for (size_t i = 0; i < std::size(current_shard); ++i) {
+      const uint64_t word = current_shard[i].load(std::memory_order_relaxed);
+      memcpy(name + i * sizeof(word), &word, sizeof(word));
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (shard_sequence.load(std::memory_order_relaxed) == sequence) break;
+  }
+  values.current_shard.assign(name, strnlen(name, sizeof(name)));
+  return values;
+}
+
+// static
+absl::StatusOr<std::unique_ptr<MetricsPage>> MetricsPage::Create(
+    const std::string &path, size_t num_workers, absl::Time start_time) {
+  const size_t size = kWorkersOffset + num_workers * sizeof(WorkerMetrics);
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+  if (fd == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(): ", path));
+  }
+  absl::Cleanup fd_closer = [fd] { close(fd); };
+  if (ftruncate(fd, size) != 0) {
+    return absl::ErrnoToStatus(errno, "ftruncate()");
+  }
+  void *mapping =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "mmap()");
+  }
+
+  // The file is zero-filled, which is the initial value of all counters.
+  char *base = static_cast<char *>(mapping);
+  for (size_t i = 0; i < num_workers; ++i) {
+    new (base + kWorkersOffset + i * sizeof(WorkerMetrics)) WorkerMetrics{};
+  }
+  Header *header = reinterpret_cast<Header *>(base);
+  header->version = Header::kVersion;
+  header->num_workers = num_workers;
+  header->workers_offset = kWorkersOffset;
+  header->worker_size = sizeof(WorkerMetrics);
+  header->start_time_ns = absl::ToUnixNanos(start_time);
+  // Readers that see the magic see a complete header.
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = Header::kMagic;
+  return std::unique_ptr<MetricsPage>(
+      new MetricsPage(mapping, size, num_workers));
+}
+
+// static
+absl::StatusOr<std::vector<WorkerMetrics::Values>> MetricsPage::Read(
+    const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(): ", path));
+  }
+  absl::Cleanup fd_closer = [fd] { close(fd); };
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return absl::ErrnoToStatus(errno, "fstat()");
+  }
+  const size_t size = st.st_size;
+  if (size < sizeof(Header)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Metrics page too small: ", path));
+  }
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "mmap()");
+  }
+  absl::Cleanup unmapper = [mapping, size] { munmap(mapping, size); };
+
+  const char *base = static_cast<const char *>(mapping);
+  const Header *header = reinterpret_cast<const Header *>(base);
+  if (header->magic != Header::kMagic) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Not a metrics page: ", path));
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (header->version != Header::kVersion ||
+      header->worker_size != sizeof(WorkerMetrics) ||
+      header->workers_offset % alignof(WorkerMetrics) != 0 ||
+      header->workers_offset > size ||
+      header->num_workers >
+          (size - header->workers_offset) / sizeof(WorkerMetrics)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Unsupported metrics page layout: ", path));
+  }
+  std::vector<WorkerMetrics::Values> values;
+  values.reserve(header->num_workers);
+  const WorkerMetrics *workers = reinterpret_cast<const WorkerMetrics *>(
+      base + header->workers_offset);
+  for (size_t i = 0; i < header->num_workers; ++i) {
+    values.push_back(workers[i].Read());
+  }
+  return values;
+}
+
+MetricsPage::~MetricsPage() { CHECK_EQ(munmap(mapping_, size_), 0); }
+
+WorkerMetrics *MetricsPage::worker(size_t i) {
+  CHECK_LT(i, num_workers_);
+  return reinterpret_cast<WorkerMetrics *>(static_cast<char *>(mapping_) +
+                                           kWorkersOffset) +
+         i;
+}
+
+}  // namespace silifuzz
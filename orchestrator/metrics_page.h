@@ -0,0 +1,136 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_METRICS_PAGE_H_
+#define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_METRICS_PAGE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+
+namespace silifuzz {
+
+// Counters of one orchestrator worker in a MetricsPage.
+//
+// Only the owning worker thread updates the counters. Any thread or process
+// that maps the page may read them at any time. The counters use relaxed
+// atomics and are consistent with each other only approximately; the
+// current shard name is read consistently through a sequence counter.
+struct alignas(64) WorkerMetrics {
+  // Shard names are truncated to this many bytes.
+  static constexpr size_t kMaxShardNameSize = 64;
+
+  // Plain copy of the counters.
+  struct Values {
+    uint64_t num_runs = 0;
+    uint64_t num_snaps_executed = 0;
+    uint64_t num_failures = 0;
+    absl::Duration startup_time;
+    std::string current_shard;
+  };
+
+  // Records the start of a runner playing `shard_name`.
+  void StartRun(absl::string_view shard_name);
+
+  // Records the end of a runner invocation that executed `snaps_executed`
+  // snaps and spent `startup` in its startup phases.
+  void EndRun(bool failed, uint64_t snaps_executed, absl::Duration startup);
+
+  // Returns a copy of the counters.
+  Values Read() const;
+
+  // Runner invocations completed.
+  std::atomic<uint64_t> num_runs;
+
+  // Snap executions reported by the runners. Runners report them only when
+  // they collect snap latency histograms.
+  std::atomic<uint64_t> num_snaps_executed;
+
+  // Runner invocations that failed.
+  std::atomic<uint64_t> num_failures;
+
+  // Sum of the startup phases reported by the runners in nanoseconds.
+  std::atomic<uint64_t> startup_time_ns;
+
+  // Odd while `current_shard` is being written.
+  std::atomic<uint64_t> shard_sequence;
+
+  // NUL-padded name of the shard played by the current or latest runner.
+  std::atomic<uint64_t> current_shard[kMaxShardNameSize / sizeof(uint64_t)];
+};
+
+// Fixed-layout page of per-worker counters in a file, typically in /dev/shm,
+// for local monitoring agents to poll. Agents map the file read-only and read
+// it without interacting with the orchestrator.
+//
+// The file starts with a Header followed by Header::num_workers WorkerMetrics
+// at Header::workers_offset.
+//
+// This class is thread-safe.
+class MetricsPage {
+ public:
+  struct Header {
+    static constexpr uint64_t kMagic = 0x53494c494d455452;  // "SILIMETR"
+    static constexpr uint64_t kVersion = 1;
+
+    uint64_t magic;
+    uint64_t version;
+    uint64_t num_workers;
+    uint64_t workers_offset;
+    uint64_t worker_size;
+    // Orchestrator start time in nanoseconds since the Unix epoch.
+    int64_t start_time_ns;
+  };
+
+  // Creates or truncates the file at `path` and maps a page with
+  // `num_workers` zeroed counters.
+  static absl::StatusOr<std::unique_ptr<MetricsPage>> Create(
+      const std::string &path, size_t num_workers, absl::Time start_time);
+
+  // Reads the counters of all workers from the page at `path`.
+  static absl::StatusOr<std::vector<WorkerMetrics::Values>> Read(
+      const std::string &path);
+
+  ~MetricsPage();
+
+  // Not copyable or moveable -- shared between threads.
+  MetricsPage(const MetricsPage &) = delete;
+  MetricsPage(MetricsPage &&) = delete;
+  MetricsPage &operator=(const MetricsPage &) = delete;
+  MetricsPage &operator=(MetricsPage &&) = delete;
+
+  size_t num_workers() const { return num_workers_; }
+
+  // Returns the counters of worker `i`.
+  WorkerMetrics *worker(size_t i);
+
+ private:
+  MetricsPage(void *mapping, size_t size, size_t num_workers)
+      : mapping_(mapping), size_(size), num_workers_(num_workers) {}
+
+  void *const mapping_;
+  const size_t size_;
+  const size_t num_workers_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_METRICS_PAGE_H_
@@ -0,0 +1,112 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/metrics_page.h"
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./util/testing/status_macros.h"
+#include "./util/testing/status_matchers.h"
+
+namespace silifuzz {
+namespace {
+
+using ::silifuzz::testing::StatusIs;
+using ::testing::SizeIs;
+using ::testing::TempDir;
+
+TEST(MetricsPage, RecordAndRead) {
+  const std::string path = absl::StrCat(TempDir(), "/RecordAndRead");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<MetricsPage> page,
+                       MetricsPage::Create(path, 2, absl::Now()));
+  EXPECT_EQ(page->num_workers(), 2);
+
+  ASSERT_OK_AND_ASSIGN(std::vector<WorkerMetrics::Values> values,
+                       MetricsPage::Read(path));
+  ASSERT_THAT(values, SizeIs(2));
+  EXPECT_EQ(values[0].num_runs, 0);
+  EXPECT_EQ(values[0].current_shard, "");
+
+  WorkerMetrics *worker = page->worker(1);
+  worker->StartRun("shard_a");
+  worker->EndRun(/*failed=*/false, 10, absl::Milliseconds(2));
+  worker->StartRun("shard_b");
+  worker->EndRun(/*failed=*/true, 5, absl::Milliseconds(3));
+
+  ASSERT_OK_AND_ASSIGN(values, MetricsPage::Read(path));
+  ASSERT_THAT(values, SizeIs(2));
+  EXPECT_EQ(values[0].num_runs, 0);
+  EXPECT_EQ(values[1].num_runs, 2);
+  EXPECT_EQ(values[1].num_snaps_executed, 15);
+  EXPECT_EQ(values[1].num_failures, 1);
+  EXPECT_EQ(values[1].startup_time, absl::Milliseconds(5));
+  EXPECT_EQ(values[1].current_shard, "shard_b");
+}
+
+TEST(MetricsPage, LongShardName) {
+  const std::string path = absl::StrCat(TempDir(), "/LongShardName");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<MetricsPage> page,
+                       MetricsPage::Create(path, 1, absl::Now()));
+  const std::string name(WorkerMetrics::kMaxShardNameSize + 10, 'x');
+  page->worker(0)->StartRun(name);
+  EXPECT_EQ(page->worker(0)->Read().current_shard,
+            name.substr(0, WorkerMetrics::kMaxShardNameSize));
+}
+
+TEST(MetricsPage, ConcurrentReads) {
+  const std::string path = absl::StrCat(TempDir(), "/ConcurrentReads");
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<MetricsPage> page,
+                       MetricsPage::Create(path, 1, absl::Now()));
+  WorkerMetrics *worker = page->worker(0);
+  worker->StartRun("aaaaaaaaaaaaaaaa");
+  std::thread writer([worker] {
+    for (int i = 0; i < 10000; ++i) {
+      worker->StartRun(i % 2 == 0 ? "bbbbbbbbbbbbbbbb" : "aaaaaaaaaaaaaaaa");
+      worker->EndRun(/*failed=*/false, 1, absl::ZeroDuration());
+    }
+  });
+  for (int i = 0; i < 1000; ++i) {
+    const std::string shard = worker->Read().current_shard;
+    // A torn read would mix the two names.
+    ASSERT_TRUE(shard == "aaaaaaaaaaaaaaaa" || shard == "bbbbbbbbbbbbbbbb")
+        << shard;
+  }
+  writer.join();
+  EXPECT_EQ(worker->Read().num_runs, 10000);
+}
+
+TEST(MetricsPage, ReadInvalidFile) {
+  const std::string path = absl::StrCat(TempDir(), "/ReadInvalidFile");
+  FILE *file = fopen(path.c_str(), "w");
+  ASSERT_NE(file, nullptr);
+  fputs("not a metrics page, but long enough to hold a header", file);
+  fclose(file);
+  EXPECT_THAT(MetricsPage::Read(path),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(MetricsPage::Read(absl::StrCat(TempDir(), "/NoSuchFile")),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
+}  // namespace
+}  // namespace silifuzz
@@ -0,0 +1,143 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_MPSC_RING_BUFFER_H_
+#define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_MPSC_RING_BUFFER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace silifuzz {
+
+// A bounded, lock-free multi-producer single-consumer queue.
+//
+// Each cell carries a sequence number that tells producers and the consumer
+// whose turn it is to access the cell (D. Vyukov's bounded queue). Producers
+// claim cells with a CAS on the enqueue position, the consumer owns the
+// dequeue position.
+//
+// TryPush() may be called from any thread. TryPop() must only be called from
+// one thread at a time. empty() and size() may be called from any thread and
+// are exact only when no push or pop is in progress.
+template <typename T>
+class MpscRingBuffer {
+ public:
+  // Creates a buffer holding at least `min_capacity` elements. The capacity is
+  // rounded up to a power of two and is at least 2, the sequence numbers cannot
+  // tell a full cell from an empty one in a ring of one.
+  explicit MpscRingBuffer(size_t min_capacity)
+      : capacity_(RoundUpToPowerOfTwo(std::max<size_t>(min_capacity, 2))),
+        mask_(capacity_ - 1),
+        cells_(new Cell[capacity_]) {
+    for (size_t i = 0; i < capacity_; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Not copyable or moveable -- shared between threads.
+  MpscRingBuffer(const MpscRingBuffer &) = delete;
+  MpscRingBuffer(MpscRingBuffer &&) = delete;
+  MpscRingBuffer &operator=(const MpscRingBuffer &) = delete;
+  MpscRingBuffer &operator=(MpscRingBuffer &&) = delete;
+
+  // Appends `value` to the queue. Returns false and leaves `value` untouched
+  // if the queue is full.
+  bool TryPush(T &&value) {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    Cell *cell;
+    while (true) {
+      cell = &cells_[pos & mask_];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        // The consumer has not released this cell from the previous lap.
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value.emplace(std::move(value));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Removes and returns the oldest element, or nullopt if there is none.
+  std::optional<T> TryPop() {
+    const size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    Cell &cell = cells_[pos & mask_];
+    if (cell.sequence.load(std::memory_order_acquire) != pos + 1) {
+      return std::nullopt;
+    }
+    std::optional<T> value = std::move(cell.value);
+    cell.value.reset();
+    dequeue_pos_.store(pos + 1, std::memory_order_relaxed);
+    cell.sequence.store(pos + capacity_, std::memory_order_release);
+    return value;
+  }
+
+  // Returns true if there is no element ready to be popped.
+  bool empty() const {
+    const size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    return cells_[pos & mask_].sequence.load(std::memory_order_acquire) !=
+           pos + 1;
+  }
+
+  // Number of elements pushed or being pushed but not popped yet.
+  size_t size() const {
+    const size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+    const size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+  size_t capacity() const { return capacity_; }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    std::optional<T> value;
+  };
+
+  static size_t RoundUpToPowerOfTwo(size_t n) {
+    size_t result = 1;
+    while (result < n) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  const size_t capacity_;
+  const size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+
+  // Producers and the consumer update these independently; keep them on
+  // separate cache lines.
+  alignas(64) std::atomic<size_t> enqueue_pos_ = 0;
+  alignas(64) std::atomic<size_t> dequeue_pos_ = 0;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_MPSC_RING_BUFFER_H_
@@ -0,0 +1,93 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "./orchestrator/mpsc_ring_buffer.h"
+
+#include <optional>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace silifuzz {
+namespace {
+
+using ::testing::Each;
+
+TEST(MpscRingBuffer, Capacity) {
+  EXPECT_EQ(MpscRingBuffer<int>(1).capacity(), 2);
+  EXPECT_EQ(MpscRingBuffer<int>(5).capacity(), 8);
+  EXPECT_EQ(MpscRingBuffer<int>(16).capacity(), 16);
+}
+
+TEST(MpscRingBuffer, Fifo) {
+  MpscRingBuffer<int> q(4);
+  EXPECT_TRUE(q.empty());
+  EXPECT_EQ(q.TryPop(), std::nullopt);
+  // Go around the ring a few times.
+  for (int lap = 0; lap < 3; ++lap) {
+    for (int i = 0; i < 4; ++i) {
+      ASSERT_TRUE(q.TryPush(lap * 10 + i));
+    }
+    EXPECT_FALSE(q.TryPush(42));
+    EXPECT_EQ(q.size(), 4);
+    EXPECT_FALSE(q.empty());
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_EQ(q.TryPop(), lap * 10 + i);
+    }
+    EXPECT_TRUE(q.empty());
+    EXPECT_EQ(q.size(), 0);
+  }
+}
+
+TEST(MpscRingBuffer, MultipleProducers) {
+  constexpr int kNumProducers = 4;
+  constexpr int kPerProducer = 10000;
+  MpscRingBuffer<int> q(64);
+  std::vector<std::thread> producers;
+  for (int p = 0; p < kNumProducers; ++p) {
+    producers.emplace_back([&q, p]() {
+      for (int i = 0; i < kPerProducer; ++i) {
+        while (!q.TryPush(p * kPerProducer + i)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  std::vector<int> seen(kNumProducers * kPerProducer, 0);
+  // Values of each producer must come out in the order they were pushed.
+  std::vector<int> last(kNumProducers, -1);
+  for (int n = 0; n < kNumProducers * kPerProducer;) {
+    std::optional<int> v = q.TryPop();
+    if (!v.has_value()) {
+      std::this_thread::yield();
+      continue;
+    }
+    ++seen[*v];
+    const int producer = *v / kPerProducer;
+    EXPECT_GT(*v, last[producer]);
+    last[producer] = *v;
+    ++n;
+  }
+  for (std::thread &t : producers) {
+    t.join();
+  }
+  EXPECT_THAT(seen, Each(1));
+  EXPECT_TRUE(q.empty());
+}
+
+}  // namespace
+}  // namespace silifuzz
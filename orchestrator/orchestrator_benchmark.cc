@@ -0,0 +1,258 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// End-to-end throughput benchmark of the orchestrator.
+//
+// Generates synthetic relocatable shards, then runs the real reading runner
+// under RunnerThread() workers, as silifuzz_orchestrator_main does, for a
+// fixed duration per configuration. Each combination of --shard_sizes and
+// --num_threads is one configuration. Prints one CSV row per configuration:
+//
+//   shard_size      Snapshots per shard.
+//   num_threads     Worker threads, i.e. concurrent runners.
+//   num_runs        Runner invocations that ended during the run.
+//   num_failures    Invocations that failed. Should be 0.
+//   snaps_per_sec   Snapshots executed per second per worker thread.
+//   startup_frac    Fraction of runner wall time spent in startup.
+//   max_rss_kb      Largest peak RSS of a single runner.
+//
+// Usage: orchestrator_benchmark [flags] > results.csv
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./common/snapshot.h"
+#include "./common/snapshot_test_enum.h"
+#include "./orchestrator/corpus_util.h"
+#include "./orchestrator/silifuzz_orchestrator.h"
+#include "./orchestrator/throughput_telemetry.h"
+#include "./proto/session_summary.pb.h"
+#include "./runner/driver/runner_driver.h"
+#include "./runner/driver/runner_options.h"
+#include "./runner/runner_provider.h"
+#include "./snap/gen/relocatable_snap_generator.h"
+#include "./snap/gen/snap_generator.h"
+#include "./snap/testing/snap_test_snapshots.h"
+#include "./util/arch.h"
+#include "./util/path_util.h"
+
+ABSL_FLAG(std::string, runner, "",
+          "Path to the reading runner. Defaults to the runner built with the "
+          "benchmark.");
+ABSL_FLAG(std::vector<std::string>, shard_sizes,
+          std::vector<std::string>({"100", "10000"}),
+          "Numbers of snapshots per shard to benchmark.");
+ABSL_FLAG(std::vector<std::string>, num_threads,
+          std::vector<std::string>({"1", "4"}),
+          "Numbers of worker threads to benchmark.");
+ABSL_FLAG(int, num_shards, 4, "Number of shards of each size.");
+ABSL_FLAG(absl::Duration, duration, absl::Seconds(10),
+          "How long to run each configuration.");
+ABSL_FLAG(absl::Duration, per_runner_cpu_time_budget, absl::Seconds(1),
+          "CPU time budget of each runner invocation.");
+
+namespace silifuzz {
+
+namespace {
+
+// Parses a list of positive numbers from a flag.
+absl::StatusOr<std::vector<int>> ParsePositiveInts(
+    const std::vector<std::string> &values, absl::string_view flag_name) {
+  std::vector<int> result;
+  for (const std::string &value : values) {
+    int n;
+    if (!absl::SimpleAtoi(value, &n) || n <= 0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("--", flag_name, ": bad value ", value));
+    }
+    result.push_back(n);
+  }
+  return result;
+}
+
+// Writes `num_shards` relocatable shards of `shard_size` copies of
+// `snapshot` each to temporary files and loads them. Snapshot IDs are unique
+// across shards. The temporary files are removed once loaded.
+absl::StatusOr<InMemoryCorpora> MakeSyntheticCorpora(const Snapshot &snapshot,
+                                                     int shard_size,
+                                                     int num_shards) {
+  std::vector<std::string> paths;
+  absl::Status status = absl::OkStatus();
+  for (int shard = 0; shard < num_shards && status.ok(); ++shard) {
+    std::vector<Snapshot> snapshots;
+    snapshots.reserve(shard_size);
+    for (int i = 0; i < shard_size; ++i) {
+      snapshots.push_back(snapshot.Copy());
+      snapshots.back().set_id(absl::StrCat("bench_", shard, "_", i));
+    }
+    absl::StatusOr<std::string> path =
+        CreateTempFile(absl::StrCat("bench_shard_", shard_size, "_"));
+    if (!path.ok()) {
+      status = path.status();
+      break;
+    }
+    paths.push_back(*path);
+    const int fd = open(path->c_str(), O_RDWR | O_TRUNC | O_CLOEXEC);
+    if (fd < 0) {
+      status = absl::ErrnoToStatus(errno, absl::StrCat("open ", *path));
+      break;
+    }
+    status = GenerateRelocatableSnapsToFile(Host::architecture_id, snapshots,
+                                            fd)
+                 .status();
+    close(fd);
+  }
+  absl::StatusOr<InMemoryCorpora> corpora =
+      status.ok() ? LoadCorpora(paths) : status;
+  for (const std::string &path : paths) {
+    unlink(path.c_str());
+  }
+  return corpora;
+}
+
+// Sum of `column`.
+uint64_t Total(const google::protobuf::RepeatedField<uint64_t> &column) {
+  uint64_t total = 0;
+  for (uint64_t value : column) total += value;
+  return total;
+}
+
+// Runs the runner on `corpora` with `num_threads` workers for --duration and
+// prints the CSV row of the configuration.
+void RunConfiguration(const std::string &runner,
+                      const InMemoryCorpora &corpora, int shard_size,
+                      int num_threads) {
+  const absl::Time start_time = absl::Now();
+  ThroughputTelemetry telemetry(start_time);
+  absl::BitGen seed_gen;
+  ShardScheduler scheduler(corpora.shards.size(), false,
+                           absl::Uniform<uint64_t>(seed_gen));
+  ExecutionContext ctx(start_time + absl::GetFlag(FLAGS_duration), num_threads,
+                       [](const RunnerDriver::RunResult &) { return false; });
+
+  RunnerOptions runner_options = RunnerOptions::Default();
+  runner_options
+      .set_cpu_time_budget(absl::GetFlag(FLAGS_per_runner_cpu_time_budget))
+      .set_extra_argv({"--num_iterations=1000000000", "--collect_snap_latency",
+                       "--report_startup_timings"});
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads);
+  for (int thread_idx = 0; thread_idx < num_threads; ++thread_idx) {
+    threads.emplace_back(RunnerThread, &ctx,
+                         RunnerThreadArgs{.thread_idx = thread_idx,
+                                          .runner = runner,
+                                          .corpora = &corpora,
+                                          .scheduler = &scheduler,
+                                          .telemetry = &telemetry,
+                                          .runner_options = runner_options});
+  }
+  ctx.EventLoop();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  ctx.ProcessResultQueue();
+  const absl::Time end_time = absl::Now();
+
+  // Runner threads are not pinned, so all runs are keyed by the same CPU.
+  const proto::logging::ThroughputColumns cpus =
+      telemetry.Take(end_time).cpus();
+  const uint64_t wall_time_us = Total(cpus.wall_time_ms()) * 1000;
+  const uint64_t startup_time_us =
+      Total(cpus.exec_time_us()) + Total(cpus.load_corpus_time_us()) +
+      Total(cpus.map_corpus_time_us()) + Total(cpus.verify_checksums_time_us());
+  const double snaps_per_sec =
+      Total(cpus.num_snaps_executed()) /
+      absl::ToDoubleSeconds(end_time - start_time) / num_threads;
+  const uint64_t max_rss_kb =
+      cpus.max_rss_kb().empty()
+          ? 0
+          : *std::max_element(cpus.max_rss_kb().begin(),
+                              cpus.max_rss_kb().end());
+  std::cout << shard_size << "," << num_threads << ","
+            << Total(cpus.num_runs()) << "," << Total(cpus.num_failures())
+            << "," << static_cast<uint64_t>(snaps_per_sec) << ","
+            << (wall_time_us == 0
+                    ? 0.0
+                    : static_cast<double>(startup_time_us) / wall_time_us)
+            << "," << max_rss_kb << std::endl;
+}
+
+}  // namespace
+
+int BenchmarkMain() {
+  absl::StatusOr<std::vector<int>> shard_sizes =
+      ParsePositiveInts(absl::GetFlag(FLAGS_shard_sizes), "shard_sizes");
+  absl::StatusOr<std::vector<int>> thread_counts =
+      ParsePositiveInts(absl::GetFlag(FLAGS_num_threads), "num_threads");
+  const int num_shards = absl::GetFlag(FLAGS_num_shards);
+  if (!shard_sizes.ok() || !thread_counts.ok() || num_shards <= 0) {
+    std::cerr << "Bad --shard_sizes, --num_threads or --num_shards" << '\n';
+    return EXIT_FAILURE;
+  }
+  std::string runner = absl::GetFlag(FLAGS_runner);
+  if (runner.empty()) {
+    runner = RunnerLocation();
+  }
+
+  Snapshot snapshot =
+      MakeSnapRunnerTestSnapshot<Host>(TestSnapshot::kEndsAsExpected);
+  absl::StatusOr<Snapshot> snapified =
+      Snapify(snapshot, SnapifyOptions::V2InputRunOpts(Host::architecture_id));
+  if (!snapified.ok()) {
+    std::cerr << snapified.status().message() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "shard_size,num_threads,num_runs,num_failures,snaps_per_sec,"
+               "startup_frac,max_rss_kb"
+            << std::endl;
+  for (int shard_size : *shard_sizes) {
+    absl::StatusOr<InMemoryCorpora> corpora =
+        MakeSyntheticCorpora(*snapified, shard_size, num_shards);
+    if (!corpora.ok()) {
+      std::cerr << corpora.status().message() << '\n';
+      return EXIT_FAILURE;
+    }
+    for (int num_threads : *thread_counts) {
+      RunConfiguration(runner, *corpora, shard_size, num_threads);
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+}  // namespace silifuzz
+
+int main(int argc, char *argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  return silifuzz::BenchmarkMain();
+}
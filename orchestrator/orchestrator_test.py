@@ -161,6 +161,40 @@ class OrchestratorTest(absltest.TestCase):
         ],
     )
 
+  def test_event_loop(self):
+    (err_log, returncode) = self.run_orchestrator(
+        ['short_output'], max_cpus=3, extra_args=['--event_loop']
+    )
+    self.assertEqual(returncode, 0)
+    self.assertStrSeqContainsAll(
+        err_log,
+        [
+            'T0 started',
+            'ShortOutput',
+            'T0.*exit_status: ok',
+            'T1.*exit_status: ok',
+            'T2.*exit_status: ok',
+            'T2 stopped',
+        ],
+    )
+
+  def test_persistent_runner(self):
+    (err_log, returncode) = self.run_orchestrator(
+        ['short_output'], extra_args=['--persistent_runner_batch_size=10']
+    )
+    self.assertEqual(returncode, 0)
+    self.assertStrSeqContainsAll(
+        err_log,
+        [
+            'ShortOutput',
+            'TEST RUNNER persistent batch 10',
+            'T0.*exit_status: ok',
+            'T0 stopped',
+        ],
+    )
+    # The runner is started once and serves many batches.
+    self.assertEqual(err_log.count('ShortOutput'), 1)
+
   def test_exit7(self):
     (err_log, returncode) = self.run_orchestrator(['short_loop', 'exit7'])
     self.assertEqual(returncode, 0)
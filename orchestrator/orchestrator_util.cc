@@ -23,6 +23,7 @@
 #include <filesystem>  // NOLINT
 #include <fstream>
 #include <memory>
+#include <numeric>
 #include <string>
 #include <system_error>  // NOLINT
 #include <vector>
@@ -36,6 +37,7 @@
 #include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "./orchestrator/corpus_util.h"
+#include "./proto/corpus_metadata.pb.h"
 #include "./util/checks.h"
 
 namespace silifuzz {
@@ -94,9 +96,13 @@ absl::StatusOr<Statm> ProcessStatm(pid_t pid) {
   return statm;
 }
 
-uint64_t MaxRunnerRssSizeBytes(pid_t pid, absl::string_view runner_name) {
+namespace {
+
+// Calls `fn` with the Statm of each immediate child of `pid` whose executable
+// path contains `runner_name`.
+template <typename Fn>
+void ForEachRunnerStatm(pid_t pid, absl::string_view runner_name, Fn fn) {
   std::vector<pid_t> pids = ListChildrenPids(pid);
-  uint64_t value = 0;
   for (pid_t child_pid : pids) {
     std::error_code ec;
     fs::path exe =
@@ -105,7 +111,7 @@ uint64_t MaxRunnerRssSizeBytes(pid_t pid, absl::string_view runner_name) {
       continue;
     }
     if (absl::StatusOr<Statm> s = ProcessStatm(child_pid); s.ok()) {
-      value = std::max(value, s->rss_bytes);
+      fn(*s);
     } else {
       // Processes come and go regularly. An error returned from ProcessStatm()
       // doesn't indicate a problem for the purposes of this function and
@@ -113,6 +119,22 @@ uint64_t MaxRunnerRssSizeBytes(pid_t pid, absl::string_view runner_name) {
       VLOG_INFO(2, s.status().message());
     }
   }
+}
+
+}  // namespace
+
+uint64_t MaxRunnerRssSizeBytes(pid_t pid, absl::string_view runner_name) {
+  uint64_t value = 0;
+  ForEachRunnerStatm(pid, runner_name, [&value](const Statm &statm) {
+    value = std::max(value, statm.rss_bytes);
+  });
+  return value;
+}
+
+uint64_t TotalRunnerRssSizeBytes(pid_t pid, absl::string_view runner_name) {
+  uint64_t value = 0;
+  ForEachRunnerStatm(pid, runner_name,
+                     [&value](const Statm &statm) { value += statm.rss_bytes; });
   return value;
 }
 
@@ -140,14 +162,98 @@ absl::StatusOr<uint64_t> AvailableMemoryMb() {
   return absl::NotFoundError("No MemAvailable entry in /proc/meminfo");
 }
 
+namespace {
+
+uint64_t BytesToMbRoundUp(uint64_t bytes) {
+  constexpr uint64_t kMb = 1024 * 1024;
+  return (bytes + kMb - 1) / kMb;
+}
+
+// CapShardsToMemLimit() for shards described by `shard_metadata`.
+absl::StatusOr<std::vector<std::string>> CapShardsToMemLimitWithMetadata(
+    const std::vector<std::string> &shards,
+    const std::vector<const proto::ShardMetadata *> &shard_metadata,
+    int64_t memory_usage_limit_mb, uint64_t max_cpus,
+    uint64_t num_corpus_replicas) {
+  // Any runner may run any shard, so budget for the largest one.
+  uint64_t runner_memory_usage_mb = 0;
+  for (const proto::ShardMetadata *m : shard_metadata) {
+    runner_memory_usage_mb =
+        std::max(runner_memory_usage_mb,
+                 BytesToMbRoundUp(m->expected_runner_rss_bytes()));
+  }
+
+  int64_t memory_budget_mb = memory_usage_limit_mb;
+  VLOG_INFO(0, "Initial mem budget is ", memory_budget_mb, "MB");
+  memory_budget_mb -= runner_memory_usage_mb * max_cpus;
+  if (memory_budget_mb <= 0) {
+    return absl::ResourceExhaustedError(absl::StrCat(
+        "Not enough memory to run ", max_cpus, " runners of ",
+        runner_memory_usage_mb, "MB with the given budget of ",
+        memory_usage_limit_mb, "MB"));
+  }
+
+  // Take shards in random order as long as they fit.
+  std::vector<size_t> order(shards.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::shuffle(order.begin(), order.end(), absl::BitGen());
+  std::vector<std::string> rv;
+  for (size_t i : order) {
+    const int64_t shard_size_mb =
+        std::max<uint64_t>(
+            1, BytesToMbRoundUp(shard_metadata[i]->uncompressed_size_bytes())) *
+        num_corpus_replicas;
+    if (shard_size_mb <= memory_budget_mb) {
+      memory_budget_mb -= shard_size_mb;
+      rv.push_back(shards[i]);
+    }
+  }
+  if (rv.empty()) {
+    return absl::ResourceExhaustedError(absl::StrCat(
+        "Cannot load any shards given the remaining memory budget ",
+        memory_budget_mb, "MB"));
+  }
+  VLOG_INFO(0, "With a runner size of ", runner_memory_usage_mb,
+            "MB we can fit ", rv.size(), " of ", shards.size(), " shards");
+  VLOG_INFO(0, "Total expected memory usage of SiliFuzz is ",
+            memory_usage_limit_mb - memory_budget_mb, "MB");
+  return rv;
+}
+
+}  // namespace
+
+const proto::ShardMetadata *FindShardMetadata(
+    const proto::CorpusMetadata &metadata, absl::string_view path) {
+  const std::string name = ShardName(path);
+  for (const proto::ShardMetadata &shard : metadata.shards()) {
+    if (shard.name() == name) {
+      return &shard;
+    }
+  }
+  return nullptr;
+}
+
 absl::StatusOr<std::vector<std::string>> CapShardsToMemLimit(
     const std::vector<std::string> &shards, int64_t memory_usage_limit_mb,
-    uint64_t max_cpus) {
-  // How much memory a single runner uses. 512Mb works the current corpus but
-  // ideally the value should be computed on the fly by either loading a single
-  // shard into the runner or precomputing the value and recording it in the
-  // metadata file.
-  // TODO(ksteuck): Fix
+    uint64_t max_cpus, const proto::CorpusMetadata &metadata,
+    uint64_t num_corpus_replicas) {
+  std::vector<const proto::ShardMetadata *> shard_metadata;
+  for (const std::string &shard : shards) {
+    const proto::ShardMetadata *m = FindShardMetadata(metadata, shard);
+    if (m == nullptr) {
+      shard_metadata.clear();
+      break;
+    }
+    shard_metadata.push_back(m);
+  }
+  if (!shard_metadata.empty()) {
+    return CapShardsToMemLimitWithMetadata(shards, shard_metadata,
+                                           memory_usage_limit_mb, max_cpus,
+                                           num_corpus_replicas);
+  }
+
+  // How much memory a single runner uses without corpus metadata. 512Mb works
+  // for the current corpus.
   constexpr uint64_t kSingleRunnerMemoryUsageMb = 512;
 
   int64_t memory_budget_mb = memory_usage_limit_mb;
@@ -172,18 +278,21 @@ absl::StatusOr<std::vector<std::string>> CapShardsToMemLimit(
         // Round up to 1 meg.
         return std::max<uint64_t>(1, top_shard_size / (1024 * 1024));
       }());
+  // Every replica of a shard takes memory.
+  const uint64_t shard_cost_mb = top_shard_size_mb * num_corpus_replicas;
   int max_shards =
-      std::min<int>(shards.size(), memory_budget_mb / top_shard_size_mb);
+      std::min<int>(shards.size(), memory_budget_mb / shard_cost_mb);
   if (max_shards <= 0) {
     return absl::ResourceExhaustedError(absl::StrCat(
         "Cannot load any shards given the remaining memory budget ",
         memory_budget_mb, "MB. Shard size = ", top_shard_size_mb, "MB"));
   }
 
-  VLOG_INFO(0, "Shard 0 size is ", top_shard_size_mb,
-            "MB. With the remaining budget of ", memory_budget_mb,
-            "MB we can fit ", max_shards, " of ", shards.size());
-  memory_budget_mb -= top_shard_size_mb * max_shards;
+  VLOG_INFO(0, "Shard 0 size is ", top_shard_size_mb, "MB x ",
+            num_corpus_replicas, " replicas. With the remaining budget of ",
+            memory_budget_mb, "MB we can fit ", max_shards, " of ",
+            shards.size());
+  memory_budget_mb -= shard_cost_mb * max_shards;
   VLOG_INFO(0, "Total expected memory usage of SiliFuzz is ",
             memory_usage_limit_mb - memory_budget_mb, "MB");
   std::vector<std::string> rv = shards;
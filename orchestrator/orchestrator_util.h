@@ -23,6 +23,7 @@
 
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "./proto/corpus_metadata.pb.h"
 
 namespace silifuzz {
 
@@ -39,6 +40,12 @@ struct Statm {
 uint64_t MaxRunnerRssSizeBytes(
     pid_t pid, absl::string_view runner_name = "reading_runner");
 
+// Like MaxRunnerRssSizeBytes() but returns the sum of the RSS of the runners.
+// Pages shared between runners, e.g. those of a shared corpus, are counted
+// once per runner.
+uint64_t TotalRunnerRssSizeBytes(
+    pid_t pid, absl::string_view runner_name = "reading_runner");
+
 // Returns the `pid`s VmSize as reported by /proc/pid/statm
 absl::StatusOr<Statm> ProcessStatm(pid_t pid);
 
@@ -51,15 +58,27 @@ std::vector<pid_t> ListChildrenPids(pid_t pid);
 // containerized. Any cgroup limits won't be reflected in the result.
 absl::StatusOr<uint64_t> AvailableMemoryMb();
 
+// Returns the entry of the shard at `path` in `metadata`, or nullptr if there
+// is none. Entries are matched by ShardName().
+const proto::ShardMetadata *FindShardMetadata(
+    const proto::CorpusMetadata &metadata, absl::string_view path);
+
 // Caps the number of `shards` such that the entire process fits in the
 // supplied `memory_usage_limit_mb`. `max_cpus` is the number of runner
-// processes that will be run in parallel.
-// NOTE: This function relies on the shard size and a guessestimate of how much
-// memory (max) a runner can use. The caller may want to apply a fudge factor of
-// 0.8 to the limit value to reduce memory pressure.
+// processes that will be run in parallel. `num_corpus_replicas` is the number
+// of copies of each shard kept in memory, e.g. one per NUMA node with
+// --numa_local_corpus.
+// If `metadata` describes all of `shards`, the recorded shard sizes and
+// expected runner RSS are used. Otherwise, this function relies on the size of
+// the first shard and a guessestimate of how much memory (max) a runner can
+// use.
+// NOTE: The caller may want to apply a fudge factor of 0.8 to the limit value
+// to reduce memory pressure.
 absl::StatusOr<std::vector<std::string>> CapShardsToMemLimit(
     const std::vector<std::string> &shards, int64_t memory_usage_limit_mb,
-    uint64_t max_cpus);
+    uint64_t max_cpus,
+    const proto::CorpusMetadata &metadata = proto::CorpusMetadata(),
+    uint64_t num_corpus_replicas = 1);
 
 }  // namespace silifuzz
 
@@ -17,6 +17,7 @@
 #include <unistd.h>
 
 #include <csignal>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -24,6 +25,8 @@
 #include "gtest/gtest.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "./proto/corpus_metadata.pb.h"
 #include "./util/data_dependency.h"
 #include "./util/subprocess.h"
 #include "./util/testing/status_macros.h"
@@ -75,6 +78,23 @@ TEST(OrchestratorUtil, MaxRunnerRssSizeBytes) {
   s.Communicate(&out);
 }
 
+TEST(OrchestratorUtil, TotalRunnerRssSizeBytes) {
+#if defined(ABSL_HAVE_THREAD_SANITIZER)
+  GTEST_SKIP() << "This test does not work under TSAN";
+#endif
+  Subprocess s1, s2;
+  ASSERT_OK(s1.Start({"/bin/sleep", "3600"}));
+  ASSERT_OK(s2.Start({"/bin/sleep", "3600"}));
+  EXPECT_GE(TotalRunnerRssSizeBytes(getpid(), ""),
+            MaxRunnerRssSizeBytes(getpid(), ""));
+  EXPECT_GT(TotalRunnerRssSizeBytes(getpid(), ""), 0);
+  kill(s1.pid(), SIGKILL);
+  kill(s2.pid(), SIGKILL);
+  std::string out;
+  s1.Communicate(&out);
+  s2.Communicate(&out);
+}
+
 TEST(OrchestratorUtil, AvailableMemoryMb) {
   EXPECT_THAT(AvailableMemoryMb(), IsOkAndHolds(Gt(0)));
 }
@@ -103,5 +123,45 @@ TEST(OrchestratorUtil, CapShardsToMemLimit) {
   EXPECT_THAT(capped_shards, StatusIs(absl::StatusCode::kResourceExhausted));
 }
 
+TEST(OrchestratorUtil, CapShardsToMemLimitWithMetadata) {
+  constexpr uint64_t kMb = 1024 * 1024;
+  proto::CorpusMetadata metadata;
+  std::vector<std::string> shards;
+  for (int i = 0; i < 4; ++i) {
+    proto::ShardMetadata *shard = metadata.add_shards();
+    shard->set_name(absl::StrCat("corpus.0000", i));
+    shard->set_num_snaps(100);
+    shard->set_uncompressed_size_bytes(100 * kMb);
+    shard->set_expected_runner_rss_bytes(200 * kMb);
+    shards.push_back(absl::StrCat("/path/to/corpus.0000", i, ".xz"));
+  }
+  EXPECT_EQ(FindShardMetadata(metadata, shards[2]), &metadata.shards(2));
+  EXPECT_EQ(FindShardMetadata(metadata, "/path/to/other.00000.xz"), nullptr);
+
+  // The shards do not exist, so these only work with the metadata.
+  EXPECT_THAT(CapShardsToMemLimit(shards, /* runners */ 2 * 200 + 1000, 2,
+                                  metadata),
+              IsOkAndHolds(SizeIs(4)));
+  EXPECT_THAT(CapShardsToMemLimit(shards, /* runners */ 2 * 200 + 250, 2,
+                                  metadata),
+              IsOkAndHolds(SizeIs(2)));
+  EXPECT_THAT(CapShardsToMemLimit(shards, /* runners */ 2 * 200 + 50, 2,
+                                  metadata),
+              StatusIs(absl::StatusCode::kResourceExhausted));
+  EXPECT_THAT(CapShardsToMemLimit(shards, /* runners */ 2 * 200, 2, metadata),
+              StatusIs(absl::StatusCode::kResourceExhausted));
+
+  // Each shard is loaded once per replica.
+  EXPECT_THAT(CapShardsToMemLimit(shards, /* runners */ 2 * 200 + 1000, 2,
+                                  metadata, /* replicas */ 2),
+              IsOkAndHolds(SizeIs(4)));
+  EXPECT_THAT(CapShardsToMemLimit(shards, /* runners */ 2 * 200 + 500, 2,
+                                  metadata, /* replicas */ 2),
+              IsOkAndHolds(SizeIs(2)));
+  EXPECT_THAT(CapShardsToMemLimit(shards, /* runners */ 2 * 200 + 150, 2,
+                                  metadata, /* replicas */ 2),
+              StatusIs(absl::StatusCode::kResourceExhausted));
+}
+
 }  // namespace
 }  // namespace silifuzz
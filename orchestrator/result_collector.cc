@@ -24,10 +24,13 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "google/protobuf/duration.pb.h"
 #include "google/protobuf/timestamp.pb.h"
 #include "absl/flags/flag.h"
+#include "absl/hash/hash.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
@@ -171,19 +174,78 @@ ResultCollector::ResultCollector(int binary_log_channel_fd,
                                  absl::Time start_time, const Options &options)
     : binary_log_producer_(nullptr),
       start_time_(start_time),
-      options_(options) {
+      options_(options),
+      last_telemetry_log_time_(start_time) {
   binary_log_producer_ =
       binary_log_channel_fd >= 0
-          ? std::make_unique<BinaryLogProducer>(binary_log_channel_fd)
+          ? std::make_unique<BinaryLogProducer>(
+                binary_log_channel_fd, /*take_ownership=*/true,
+                BinaryLogProducer::Options{.async = options.async_binary_log})
           : nullptr;
   session_id_ =
       absl::StrCat(ShortHostname(), "/", absl::ToUnixNanos(start_time_));
 }
 
+ResultCollector::~ResultCollector() { FlushAggregates(absl::Now()); }
+
+void ResultCollector::SendEntry(const proto::BinaryLogEntry &entry) {
+  if (binary_log_producer_) {
+    if (absl::Status s = binary_log_producer_->Send(entry); !s.ok()) {
+      LOG_ERROR(s.message());
+    }
+  }
+}
+
+void ResultCollector::AggregateEntry(const proto::BinaryLogEntry &entry,
+                                     absl::Time now) {
+  const proto::SnapshotExecutionResult &result =
+      entry.snapshot_execution_result();
+  const proto::PlayerResult &player_result = result.player_result();
+  AggregationKey key(
+      result.snapshot_id(), player_result.cpu_id(), player_result.outcome(),
+      absl::HashOf(player_result.actual_end_state().SerializeAsString()));
+  auto [it, inserted] = aggregates_.try_emplace(std::move(key));
+  if (inserted) {
+    proto::BinaryLogEntry &update = it->second.update;
+    update.set_session_id(entry.session_id());
+    proto::SnapshotExecutionResult *update_result =
+        update.mutable_snapshot_execution_result();
+    update_result->set_snapshot_id(result.snapshot_id());
+    update_result->set_hostname(result.hostname());
+    proto::PlayerResult *update_player_result =
+        update_result->mutable_player_result();
+    update_player_result->set_outcome(player_result.outcome());
+    if (player_result.has_end_state_index()) {
+      update_player_result->set_end_state_index(
+          player_result.end_state_index());
+    }
+    update_player_result->set_cpu_id(player_result.cpu_id());
+    SendEntry(entry);
+  } else {
+    ++it->second.pending_count;
+  }
+}
+
+void ResultCollector::FlushAggregates(absl::Time now) {
+  last_aggregate_flush_time_ = now;
+  for (auto &[key, aggregate] : aggregates_) {
+    if (aggregate.pending_count == 0) continue;
+    *aggregate.update.mutable_timestamp() = TimeToProto(now);
+    aggregate.update.mutable_snapshot_execution_result()->set_repeat_count(
+        aggregate.pending_count);
+    SendEntry(aggregate.update);
+    aggregate.pending_count = 0;
+  }
+}
+
 // Processes a single execution result.
 bool ResultCollector::operator()(const RunnerDriver::RunResult &result) {
   ++summary_.play_count;
-  max_rss_kb_ = std::max(max_rss_kb_, MaxRunnerRssSizeBytes(getpid()) / 1024);
+  const uint64_t rss_bytes =
+      options_.runner_cgroups != nullptr
+          ? options_.runner_cgroups->MaxWorkerMemoryCurrentBytes()
+          : MaxRunnerRssSizeBytes(getpid());
+  max_rss_kb_ = std::max(max_rss_kb_, rss_bytes / 1024);
   bool should_stop = false;
   if (!result.success()) {
     if (result.player_result().outcome ==
@@ -193,29 +255,68 @@ bool ResultCollector::operator()(const RunnerDriver::RunResult &result) {
     }
     ++summary_.num_failed_snapshots;
     LogV1SingleSnapFailure(result);
+    absl::Time now = absl::Now();
     absl::StatusOr<proto::BinaryLogEntry> entry_or =
-        RunResultToSnapshotExecutionResult(result, absl::Now(), session_id_);
-    if (entry_or.ok()) {
-      if (binary_log_producer_) {
-        if (absl::Status s = binary_log_producer_->Send(*entry_or); !s.ok()) {
-          LOG_ERROR(s.message());
-        }
-      }
-    } else {
+        RunResultToSnapshotExecutionResult(result, now, session_id_);
+    if (!entry_or.ok()) {
       LOG_ERROR(entry_or.status().message());
+    } else if (options_.aggregation_interval > absl::ZeroDuration()) {
+      AggregateEntry(*entry_or, now);
+    } else {
+      SendEntry(*entry_or);
     }
     should_stop = (--options_.fail_after_n_errors <= 0);
   }
+  if (options_.aggregation_interval > absl::ZeroDuration()) {
+    absl::Time now = absl::Now();
+    if (now >= last_aggregate_flush_time_ + options_.aggregation_interval) {
+      FlushAggregates(now);
+    }
+  }
   LogSummary();
   return should_stop;
 }
 
+void ResultCollector::LogTelemetry(absl::Time now) {
+  last_telemetry_log_time_ = now;
+  proto::logging::ThroughputTelemetry telemetry =
+      options_.telemetry->Take(now);
+  if (binary_log_producer_ == nullptr) return;
+  proto::BinaryLogEntry entry;
+  entry.set_session_id(session_id_);
+  *entry.mutable_timestamp() = TimeToProto(now);
+  *entry.mutable_throughput_telemetry() = std::move(telemetry);
+  SendEntry(entry);
+}
+
 void ResultCollector::LogSummary(bool always) {
   absl::Time now = absl::Now();
+  if (options_.telemetry != nullptr &&
+      (always ||
+       now >= last_telemetry_log_time_ + options_.telemetry_interval)) {
+    LogTelemetry(now);
+  }
   if (always || now > last_summary_log_time_ + log_interval_) {
     LogV1CompatSummary(summary_,
                        absl::Trunc(now - start_time_, absl::Seconds(1)),
                        max_rss_kb_);
+    VLOG_INFO(1, "Result queue: waits = ", summary_.num_result_queue_waits,
+              ", dropped = ", summary_.num_dropped_results,
+              ", max depth = ", summary_.max_result_queue_depth);
+    for (const Summary::CoreCoverage &coverage : summary_.core_coverage) {
+      VLOG_INFO(1, "CPU ", coverage.cpu, ": runs = ", coverage.num_runs,
+                ", shards visited = ", coverage.num_shards_visited);
+    }
+    if (!summary_.shard_completion.empty()) {
+      size_t num_ranges = 0;
+      size_t num_completed = 0;
+      for (const Summary::ShardCompletion &shard : summary_.shard_completion) {
+        num_ranges += shard.completed_ranges.size();
+        num_completed += std::count(shard.completed_ranges.begin(),
+                                    shard.completed_ranges.end(), true);
+      }
+      LOG_INFO("Snap ranges completed: ", num_completed, " of ", num_ranges);
+    }
     last_summary_log_time_ = now;
     log_interval_ = std::min(log_interval_ * 2, absl::Minutes(1));
   }
@@ -244,6 +345,17 @@ absl::Status ResultCollector::LogSessionSummary(
   playback_summary->set_num_failed_snapshots(summary_.num_failed_snapshots);
   playback_summary->set_play_count(summary_.play_count);
   playback_summary->set_num_runaway_snapshots(summary_.num_runaway_snapshots);
+  for (const Summary::ShardCompletion &shard : summary_.shard_completion) {
+    proto::logging::PlaybackSummary::ShardCompletion *completion =
+        playback_summary->add_shard_completion();
+    completion->set_shard_name(shard.shard_name);
+    completion->set_num_ranges(shard.completed_ranges.size());
+    std::string bitmap((shard.completed_ranges.size() + 7) / 8, '\0');
+    for (size_t i = 0; i < shard.completed_ranges.size(); ++i) {
+      if (shard.completed_ranges[i]) bitmap[i / 8] |= 1 << (i % 8);
+    }
+    completion->set_completed_ranges(std::move(bitmap));
+  }
 
   *entry.mutable_session_summary()->mutable_duration() =
       DurationToProto(now - start_time_);
@@ -259,7 +371,9 @@ absl::Status ResultCollector::LogSessionSummary(
 
   *entry.mutable_session_summary()->mutable_corpus_metadata() = corpus_metadata;
 
-  return binary_log_producer_->Send(entry);
+  FlushAggregates(now);
+  RETURN_IF_NOT_OK(binary_log_producer_->Send(entry));
+  return binary_log_producer_->Flush();
 }
 
 }  // namespace silifuzz
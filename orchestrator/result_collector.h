@@ -20,11 +20,18 @@
 #include <limits>
 #include <memory>
 #include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
 #include "./orchestrator/binary_log_channel.h"
+#include "./orchestrator/runner_cgroups.h"
+#include "./orchestrator/throughput_telemetry.h"
+#include "./proto/binary_log_entry.pb.h"
 #include "./proto/corpus_metadata.pb.h"
 #include "./runner/driver/runner_driver.h"
 
@@ -40,6 +47,28 @@ struct Summary {
 
   // Number of runaways detected.
   uint64_t num_runaway_snapshots = 0;
+
+  // Result queue backpressure. See ExecutionContext::ResultQueueStats.
+  uint64_t num_result_queue_waits = 0;
+  uint64_t num_dropped_results = 0;
+  uint64_t max_result_queue_depth = 0;
+
+  // Shards run per CPU when shards are rotated across CPUs. See
+  // CoreRotationScheduler.
+  struct CoreCoverage {
+    int cpu = -1;
+    uint64_t num_runs = 0;
+    uint64_t num_shards_visited = 0;
+  };
+  std::vector<CoreCoverage> core_coverage;
+
+  // Snap ranges of each shard that ran completely in sequential mode. See
+  // SequentialWorkQueue.
+  struct ShardCompletion {
+    std::string shard_name;
+    std::vector<bool> completed_ranges;
+  };
+  std::vector<ShardCompletion> shard_completion;
 };
 
 // ResultCollector handles execution results produced by worker threads. When
@@ -54,6 +83,26 @@ class ResultCollector {
 
     // Fail after seeing this many errors.
     int fail_after_n_errors = std::numeric_limits<int>::max();
+
+    // Write the binary log from a dedicated thread so that a slow consumer
+    // does not stall result processing. See BinaryLogProducer::Options.
+    bool async_binary_log = false;
+
+    // When non-zero, only the first occurrence of a failure is logged in
+    // full. Repeats with the same snapshot, CPU, outcome and end state are
+    // counted and logged as SnapshotExecutionResult.repeat_count updates at
+    // most once per this interval. Zero logs every failure in full.
+    absl::Duration aggregation_interval = absl::ZeroDuration();
+
+    // If not null, LogSummary() logs the runner throughput accumulated here
+    // at most once per `telemetry_interval`.
+    ThroughputTelemetry *telemetry = nullptr;
+    absl::Duration telemetry_interval = absl::Seconds(5);
+
+    // If not null, the max RSS in the summary is the largest memory.current
+    // of the per-worker runner cgroups instead of the largest RSS of the
+    // runners in /proc.
+    const RunnerCgroups *runner_cgroups = nullptr;
   };
 
   // If `binary_log_fd_channel` >= 0, will also log each result to the said
@@ -62,13 +111,35 @@ class ResultCollector {
   ResultCollector(int binary_log_channel_fd, absl::Time start_time,
                   const Options &options);
 
+  // Logs any pending repeat counts.
+  ~ResultCollector();
+
   // Processes a single execution result. Returns true if the orchestrator
   // should stop.
   bool operator()(const RunnerDriver::RunResult &result);
   // Current execution summary.
   const Summary &summary() const { return summary_; }
 
-  // Logs the current execution summary to stderr. When `always` is true,
+  // Records the result queue backpressure metrics in the summary.
+  void SetResultQueueStats(uint64_t num_waits, uint64_t num_dropped,
+                           uint64_t max_depth) {
+    summary_.num_result_queue_waits = num_waits;
+    summary_.num_dropped_results = num_dropped;
+    summary_.max_result_queue_depth = max_depth;
+  }
+
+  // Records the per-CPU shard coverage in the summary.
+  void SetCoreCoverage(std::vector<Summary::CoreCoverage> core_coverage) {
+    summary_.core_coverage = std::move(core_coverage);
+  }
+
+  // Records the completion bitmap of sequential mode in the summary.
+  void SetShardCompletion(std::vector<Summary::ShardCompletion> completion) {
+    summary_.shard_completion = std::move(completion);
+  }
+
+  // Logs the current execution summary to stderr and, when configured, the
+  // runner throughput telemetry to the binary log. When `always` is true,
   // disables time-based throttling.
   void LogSummary(bool always = false);
 
@@ -77,6 +148,31 @@ class ResultCollector {
                                  absl::string_view orchestrator_version);
 
  private:
+  // Identifies repeats of the same failure: snapshot id, CPU, outcome and a
+  // hash of the serialized actual end state.
+  using AggregationKey = std::tuple<std::string, int64_t, int, size_t>;
+
+  struct Aggregate {
+    // Entry logged for count updates. Carries no end state.
+    proto::BinaryLogEntry update;
+
+    // Number of repeats not yet logged.
+    uint64_t pending_count = 0;
+  };
+
+  // Logs `entry` to the binary log, if any.
+  void SendEntry(const proto::BinaryLogEntry &entry);
+
+  // Logs the failure in `entry` unless it repeats an earlier one, in which
+  // case only counts it.
+  void AggregateEntry(const proto::BinaryLogEntry &entry, absl::Time now);
+
+  // Logs a count update for every failure with pending repeats.
+  void FlushAggregates(absl::Time now);
+
+  // Logs the throughput accumulated in options_.telemetry.
+  void LogTelemetry(absl::Time now);
+
   std::unique_ptr<BinaryLogProducer> binary_log_producer_;
   absl::Time last_summary_log_time_ = absl::InfinitePast();
   absl::Duration log_interval_ = absl::Seconds(1);
@@ -85,6 +181,9 @@ class ResultCollector {
   Options options_;
   std::string session_id_;
   uint64_t max_rss_kb_ = 0;
+  absl::flat_hash_map<AggregationKey, Aggregate> aggregates_;
+  absl::Time last_aggregate_flush_time_ = absl::InfinitePast();
+  absl::Time last_telemetry_log_time_;
 };
 
 }  // namespace silifuzz
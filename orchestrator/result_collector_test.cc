@@ -18,8 +18,10 @@
 
 #include "gtest/gtest.h"
 #include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "./common/snapshot_enums.h"
 #include "./orchestrator/binary_log_channel.h"
+#include "./orchestrator/throughput_telemetry.h"
 #include "./proto/binary_log_entry.pb.h"
 #include "./proto/snapshot_execution_result.pb.h"
 #include "./runner/driver/runner_driver.h"
@@ -59,6 +61,57 @@ TEST(ResultCollector, BinaryLogging) {
   ASSERT_EQ(fd_log_entry.snapshot_execution_result().snapshot_id(), "snap_id");
 }
 
+TEST(ResultCollector, Aggregation) {
+  int pipefd[2] = {-1, -1};
+  ASSERT_EQ(pipe(pipefd), 0);
+  {
+    ResultCollector collector(pipefd[1], absl::Now(),
+                              {.aggregation_interval = absl::Hours(1)});
+    RunnerDriver::PlayerResult result = {
+        .outcome = PlaybackOutcome::kExecutionMisbehave, .cpu_id = 1};
+    for (int i = 0; i < 3; ++i) {
+      collector(RunnerDriver::RunResult(result, "snap_id"));
+    }
+    result.cpu_id = 2;
+    collector(RunnerDriver::RunResult(result, "snap_id"));
+    ASSERT_EQ(collector.summary().num_failed_snapshots, 4);
+    // Pending repeats are logged when the collector goes out of scope.
+  }
+  BinaryLogConsumer consumer(pipefd[0]);
+  ASSERT_OK_AND_ASSIGN(proto::BinaryLogEntry first, consumer.Receive());
+  EXPECT_EQ(first.snapshot_execution_result().player_result().cpu_id(), 1);
+  EXPECT_FALSE(first.snapshot_execution_result().has_repeat_count());
+  ASSERT_OK_AND_ASSIGN(proto::BinaryLogEntry other_cpu, consumer.Receive());
+  EXPECT_EQ(other_cpu.snapshot_execution_result().player_result().cpu_id(), 2);
+  EXPECT_FALSE(other_cpu.snapshot_execution_result().has_repeat_count());
+  ASSERT_OK_AND_ASSIGN(proto::BinaryLogEntry update, consumer.Receive());
+  EXPECT_EQ(update.snapshot_execution_result().snapshot_id(), "snap_id");
+  EXPECT_EQ(update.snapshot_execution_result().player_result().cpu_id(), 1);
+  EXPECT_EQ(update.snapshot_execution_result().repeat_count(), 2);
+  EXPECT_FALSE(consumer.Receive().ok());
+}
+
+TEST(ResultCollector, Telemetry) {
+  int pipefd[2] = {-1, -1};
+  ASSERT_EQ(pipe(pipefd), 0);
+  {
+    absl::Time start_time = absl::Now();
+    ThroughputTelemetry telemetry(start_time);
+    ResultCollector collector(pipefd[1], start_time,
+                              {.telemetry = &telemetry,
+                               .telemetry_interval = absl::Hours(1)});
+    telemetry.Record("shard", 1, {.wall_time = absl::Seconds(1)});
+    collector(RunnerDriver::RunResult::Successful());
+    collector.LogSummary(/*always=*/true);
+  }
+  BinaryLogConsumer consumer(pipefd[0]);
+  ASSERT_OK_AND_ASSIGN(proto::BinaryLogEntry entry, consumer.Receive());
+  ASSERT_TRUE(entry.has_throughput_telemetry());
+  EXPECT_EQ(entry.throughput_telemetry().shards().shard_name_size(), 1);
+  EXPECT_EQ(entry.throughput_telemetry().cpus().num_runs(0), 1);
+  EXPECT_FALSE(consumer.Receive().ok());
+}
+
 }  // namespace
 
 }  // namespace silifuzz
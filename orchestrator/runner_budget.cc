@@ -0,0 +1,57 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/runner_budget.h"
+
+#include <algorithm>
+
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "./util/checks.h"
+
+namespace silifuzz {
+
+RunnerBudgetController::RunnerBudgetController(const Options &options)
+    : options_(options) {
+  CHECK_GT(options_.overhead_target, 0);
+  CHECK_LE(options_.overhead_target, 1);
+  CHECK_GT(options_.smoothing, 0);
+  CHECK_LE(options_.smoothing, 1);
+  CHECK_LE(options_.min_budget, options_.max_budget);
+}
+
+absl::Duration RunnerBudgetController::BudgetFor(
+    absl::string_view shard_name) const {
+  absl::Duration startup;
+  {
+    absl::MutexLock l(&mu_);
+    auto it = startup_by_shard_.find(shard_name);
+    if (it == startup_by_shard_.end()) return options_.min_budget;
+    startup = it->second;
+  }
+  return std::clamp(startup / options_.overhead_target, options_.min_budget,
+                    options_.max_budget);
+}
+
+void RunnerBudgetController::RecordStartup(absl::string_view shard_name,
+                                           absl::Duration startup) {
+  absl::MutexLock l(&mu_);
+  auto [it, inserted] = startup_by_shard_.try_emplace(shard_name, startup);
+  if (!inserted) {
+    it->second += (startup - it->second) * options_.smoothing;
+  }
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,79 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_RUNNER_BUDGET_H_
+#define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_RUNNER_BUDGET_H_
+
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+
+namespace silifuzz {
+
+// Picks the CPU time budget of each runner invocation per shard so that the
+// runner startup cost (exec, corpus loading and mapping) stays below a target
+// fraction of the budget. Shards that start quickly keep the minimum budget
+// and therefore rotate often, expensive shards get longer budgets up to a
+// maximum.
+//
+// This class is thread-safe.
+class RunnerBudgetController {
+ public:
+  struct Options {
+    // Budget of shards that have not been observed yet or start quickly.
+    absl::Duration min_budget = absl::Seconds(10);
+
+    // Budgets are never larger than this so that shards still rotate.
+    absl::Duration max_budget = absl::Seconds(60);
+
+    // Target startup cost as a fraction of the budget. Must be in (0, 1].
+    double overhead_target = 0.05;
+
+    // Weight of the newest startup measurement in the per-shard moving
+    // average. Must be in (0, 1].
+    double smoothing = 0.25;
+  };
+
+  explicit RunnerBudgetController(const Options &options);
+
+  // Not copyable or moveable -- not just a data holder.
+  RunnerBudgetController(const RunnerBudgetController &) = delete;
+  RunnerBudgetController(RunnerBudgetController &&) = delete;
+  RunnerBudgetController &operator=(const RunnerBudgetController &) = delete;
+  RunnerBudgetController &operator=(RunnerBudgetController &&) = delete;
+
+  // Returns the CPU time budget for the next runner invocation of
+  // `shard_name`.
+  absl::Duration BudgetFor(absl::string_view shard_name) const;
+
+  // Records that a runner invocation of `shard_name` took `startup` before it
+  // started playing snapshots.
+  void RecordStartup(absl::string_view shard_name, absl::Duration startup);
+
+ private:
+  const Options options_;
+
+  mutable absl::Mutex mu_;
+  // Moving average of the startup cost by shard name.
+  absl::flat_hash_map<std::string, absl::Duration> startup_by_shard_
+      ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_RUNNER_BUDGET_H_
@@ -0,0 +1,54 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/runner_budget.h"
+
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+
+namespace silifuzz {
+namespace {
+
+RunnerBudgetController::Options TestOptions() {
+  return {.min_budget = absl::Seconds(10),
+          .max_budget = absl::Seconds(60),
+          .overhead_target = 0.1,
+          .smoothing = 0.5};
+}
+
+TEST(RunnerBudgetController, UnknownShardGetsMinBudget) {
+  RunnerBudgetController controller(TestOptions());
+  EXPECT_EQ(controller.BudgetFor("shard"), absl::Seconds(10));
+}
+
+TEST(RunnerBudgetController, ScalesWithStartup) {
+  RunnerBudgetController controller(TestOptions());
+  controller.RecordStartup("fast", absl::Milliseconds(100));
+  controller.RecordStartup("slow", absl::Seconds(2));
+  controller.RecordStartup("very_slow", absl::Seconds(30));
+  EXPECT_EQ(controller.BudgetFor("fast"), absl::Seconds(10));
+  EXPECT_EQ(controller.BudgetFor("slow"), absl::Seconds(20));
+  EXPECT_EQ(controller.BudgetFor("very_slow"), absl::Seconds(60));
+}
+
+TEST(RunnerBudgetController, Smoothing) {
+  RunnerBudgetController controller(TestOptions());
+  controller.RecordStartup("shard", absl::Seconds(2));
+  controller.RecordStartup("shard", absl::Seconds(4));
+  // (2s + 4s) / 2 = 3s of startup.
+  EXPECT_EQ(controller.BudgetFor("shard"), absl::Seconds(30));
+}
+
+}  // namespace
+}  // namespace silifuzz
@@ -0,0 +1,212 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/runner_cgroups.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/cleanup/cleanup.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "./util/checks.h"
+#include "./util/itoa.h"
+
+namespace silifuzz {
+
+namespace {
+
+// Reads an entire cgroup interface file from offset 0. Cgroup files are
+// generated on every read, so pread() at 0 returns fresh values.
+absl::StatusOr<std::string> ReadCgroupFile(int fd) {
+  // Large enough for memory.current and cpu.stat.
+  char buffer[1024];
+  const ssize_t n = pread(fd, buffer, sizeof(buffer), 0);
+  if (n == -1) {
+    return absl::ErrnoToStatus(errno, "pread()");
+  }
+  return std::string(buffer, n);
+}
+
+// Writes `value` to the existing cgroup file `name` in `cgroup_path`.
+absl::Status WriteCgroupFile(const std::string &cgroup_path,
+                             absl::string_view name, absl::string_view value) {
+  const std::string path = absl::StrCat(cgroup_path, "/", name);
+  const int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+  if (fd == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(): ", path));
+  }
+  absl::Cleanup fd_closer = [fd] { close(fd); };
+  if (write(fd, value.data(), value.size()) !=
+      static_cast<ssize_t>(value.size())) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("write(): ", path));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<absl::Duration> ParseCgroupCpuUsage(absl::string_view cpu_stat) {
+  for (absl::string_view line : absl::StrSplit(cpu_stat, '\n')) {
+    std::pair<absl::string_view, absl::string_view> key_value =
+        absl::StrSplit(line, ' ');
+    if (key_value.first != "usage_usec") continue;
+    uint64_t usage_usec;
+    if (!absl::SimpleAtoi(key_value.second, &usage_usec)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Bad usage_usec in cpu.stat: ", line));
+    }
+    return absl::Microseconds(usage_usec);
+  }
+  return absl::NotFoundError("No usage_usec in cpu.stat");
+}
+
+// static
+absl::StatusOr<std::unique_ptr<RunnerCgroups>> RunnerCgroups::Create(
+    const std::string &path, size_t num_workers) {
+  std::unique_ptr<RunnerCgroups> cgroups(new RunnerCgroups());
+  // The destructor removes whatever has been created so far on failure.
+  cgroups->root_.path = path;
+  if (mkdir(path.c_str(), 0755) == 0) {
+    cgroups->created_root_ = true;
+  } else if (errno != EEXIST) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("mkdir(): ", path));
+  }
+  RETURN_IF_NOT_OK(OpenFiles(&cgroups->root_));
+  // Runners live in the leaves only, so the root may distribute memory
+  // accounting to its children. CPU usage is available in cpu.stat of every
+  // cgroup without enabling the cpu controller.
+  RETURN_IF_NOT_OK(WriteCgroupFile(path, "cgroup.subtree_control", "+memory"));
+
+  cgroups->workers_.reserve(num_workers);
+  for (size_t i = 0; i < num_workers; ++i) {
+    Files &worker = cgroups->workers_.emplace_back();
+    worker.path = absl::StrCat(path, "/w", i);
+    if (mkdir(worker.path.c_str(), 0755) != 0 && errno != EEXIST) {
+      return absl::ErrnoToStatus(errno,
+                                 absl::StrCat("mkdir(): ", worker.path));
+    }
+    RETURN_IF_NOT_OK(OpenFiles(&worker));
+  }
+  return cgroups;
+}
+
+RunnerCgroups::~RunnerCgroups() {
+  for (const Files &worker : workers_) {
+    CloseFiles(worker, /*remove=*/true);
+  }
+  CloseFiles(root_, created_root_);
+}
+
+// static
+absl::Status RunnerCgroups::OpenFiles(Files *files) {
+  struct File {
+    const char *name;
+    int flags;
+    int *fd;
+  };
+  for (const File &file : {
+           File{"cgroup.procs", O_WRONLY, &files->procs_fd},
+           File{"memory.current", O_RDONLY, &files->memory_current_fd},
+           File{"cpu.stat", O_RDONLY, &files->cpu_stat_fd},
+       }) {
+    const std::string path = absl::StrCat(files->path, "/", file.name);
+    // Runners join the cgroup before exec, so cgroup.procs can be O_CLOEXEC.
+    *file.fd = open(path.c_str(), file.flags | O_CLOEXEC);
+    if (*file.fd == -1) {
+      return absl::ErrnoToStatus(errno, absl::StrCat("open(): ", path));
+    }
+  }
+  return absl::OkStatus();
+}
+
+// static
+void RunnerCgroups::CloseFiles(const Files &files, bool remove) {
+  for (int fd :
+       {files.procs_fd, files.memory_current_fd, files.cpu_stat_fd}) {
+    if (fd != -1) close(fd);
+  }
+  if (remove && rmdir(files.path.c_str()) != 0) {
+    LOG_ERROR("rmdir(", files.path, "): ", ErrnoStr(errno));
+  }
+}
+
+int RunnerCgroups::procs_fd(size_t i) const {
+  CHECK_LT(i, workers_.size());
+  return workers_[i].procs_fd;
+}
+
+absl::StatusOr<uint64_t> RunnerCgroups::MemoryCurrentBytes() const {
+  return ReadMemoryCurrent(root_);
+}
+
+absl::StatusOr<uint64_t> RunnerCgroups::WorkerMemoryCurrentBytes(
+    size_t i) const {
+  CHECK_LT(i, workers_.size());
+  return ReadMemoryCurrent(workers_[i]);
+}
+
+uint64_t RunnerCgroups::MaxWorkerMemoryCurrentBytes() const {
+  uint64_t value = 0;
+  for (const Files &worker : workers_) {
+    absl::StatusOr<uint64_t> bytes = ReadMemoryCurrent(worker);
+    if (bytes.ok()) value = std::max(value, *bytes);
+  }
+  return value;
+}
+
+absl::StatusOr<absl::Duration> RunnerCgroups::CpuUsage() const {
+  return ReadCpuUsage(root_);
+}
+
+absl::StatusOr<absl::Duration> RunnerCgroups::WorkerCpuUsage(size_t i) const {
+  CHECK_LT(i, workers_.size());
+  return ReadCpuUsage(workers_[i]);
+}
+
+// static
+absl::StatusOr<uint64_t> RunnerCgroups::ReadMemoryCurrent(const Files &files) {
+  ASSIGN_OR_RETURN_IF_NOT_OK(std::string contents,
+                             ReadCgroupFile(files.memory_current_fd));
+  uint64_t bytes;
+  if (!absl::SimpleAtoi(contents, &bytes)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Bad memory.current in ", files.path, ": ", contents));
+  }
+  return bytes;
+}
+
+// static
+absl::StatusOr<absl::Duration> RunnerCgroups::ReadCpuUsage(
+    const Files &files) {
+  ASSIGN_OR_RETURN_IF_NOT_OK(std::string contents,
+                             ReadCgroupFile(files.cpu_stat_fd));
+  return ParseCgroupCpuUsage(contents);
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,118 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_RUNNER_CGROUPS_H_
+#define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_RUNNER_CGROUPS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+
+namespace silifuzz {
+
+// Returns the usage_usec entry of the contents of a cgroup v2 cpu.stat file.
+absl::StatusOr<absl::Duration> ParseCgroupCpuUsage(absl::string_view cpu_stat);
+
+// A cgroup v2 subtree that holds the runners of an orchestrator, with one
+// child cgroup per worker for attribution.
+//
+// The kernel maintains memory and CPU aggregates for every cgroup, so reading
+// them costs a pread() each, independent of the number of runners, and unlike
+// walking /proc the result does not miss runners that start or exit
+// concurrently. Memory is charged to the cgroup that first touches a page:
+// pages of a shared corpus mapped from a memfd created by the orchestrator
+// are charged to the orchestrator and not to the runners, so they are not
+// counted once per runner.
+//
+// The parent of the subtree must have the memory controller enabled in its
+// cgroup.subtree_control and must be writable by the orchestrator, e.g. a
+// delegated subtree of a systemd unit.
+//
+// This class is thread-safe.
+class RunnerCgroups {
+ public:
+  // Creates the cgroup at `path`, if it does not exist already, with child
+  // cgroups for `num_workers` workers.
+  static absl::StatusOr<std::unique_ptr<RunnerCgroups>> Create(
+      const std::string &path, size_t num_workers);
+
+  // Removes the child cgroups, and the cgroup at `path` if Create() made it.
+  // Removal fails for cgroups that still hold runners.
+  ~RunnerCgroups();
+
+  // Not copyable or moveable -- shared between threads.
+  RunnerCgroups(const RunnerCgroups &) = delete;
+  RunnerCgroups(RunnerCgroups &&) = delete;
+  RunnerCgroups &operator=(const RunnerCgroups &) = delete;
+  RunnerCgroups &operator=(RunnerCgroups &&) = delete;
+
+  size_t num_workers() const { return workers_.size(); }
+
+  // Returns an fd of the cgroup.procs file of worker `i` for
+  // RunnerOptions::set_cgroup_procs_fd(). The fd is owned by this object.
+  int procs_fd(size_t i) const;
+
+  // Returns the memory charged to the runners of all workers.
+  absl::StatusOr<uint64_t> MemoryCurrentBytes() const;
+
+  // Returns the memory charged to the runners of worker `i`.
+  absl::StatusOr<uint64_t> WorkerMemoryCurrentBytes(size_t i) const;
+
+  // Returns the maximum of WorkerMemoryCurrentBytes() over all workers, or 0
+  // if none can be read.
+  uint64_t MaxWorkerMemoryCurrentBytes() const;
+
+  // Returns the CPU time consumed by the runners of all workers, including
+  // runners that already exited.
+  absl::StatusOr<absl::Duration> CpuUsage() const;
+
+  // Returns the CPU time consumed by the runners of worker `i`.
+  absl::StatusOr<absl::Duration> WorkerCpuUsage(size_t i) const;
+
+ private:
+  // Open files of one cgroup.
+  struct Files {
+    std::string path;
+    int procs_fd = -1;
+    int memory_current_fd = -1;
+    int cpu_stat_fd = -1;
+  };
+
+  RunnerCgroups() = default;
+
+  // Opens the files of the existing cgroup at `files->path`.
+  static absl::Status OpenFiles(Files *files);
+
+  // Closes the files of `files` and removes the cgroup if `remove` is true.
+  static void CloseFiles(const Files &files, bool remove);
+
+  static absl::StatusOr<uint64_t> ReadMemoryCurrent(const Files &files);
+  static absl::StatusOr<absl::Duration> ReadCpuUsage(const Files &files);
+
+  Files root_;
+  // True if Create() made the cgroup at root_.path.
+  bool created_root_ = false;
+  std::vector<Files> workers_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_RUNNER_CGROUPS_H_
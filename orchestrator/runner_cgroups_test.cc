@@ -0,0 +1,51 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/runner_cgroups.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "./util/testing/status_matchers.h"
+
+namespace silifuzz {
+namespace {
+
+using ::silifuzz::testing::IsOkAndHolds;
+using ::silifuzz::testing::StatusIs;
+using ::testing::TempDir;
+
+TEST(RunnerCgroups, ParseCgroupCpuUsage) {
+  EXPECT_THAT(ParseCgroupCpuUsage("usage_usec 1500\n"
+                                  "user_usec 1000\n"
+                                  "system_usec 500\n"),
+              IsOkAndHolds(absl::Microseconds(1500)));
+  EXPECT_THAT(ParseCgroupCpuUsage("user_usec 1000\n"),
+              StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_THAT(ParseCgroupCpuUsage("usage_usec x\n"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(RunnerCgroups, NotACgroup) {
+  // A plain directory has no cgroup.subtree_control.
+  const std::string path = absl::StrCat(TempDir(), "/NotACgroup");
+  EXPECT_THAT(RunnerCgroups::Create(path, 2),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
+}  // namespace
+}  // namespace silifuzz
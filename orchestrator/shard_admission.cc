@@ -0,0 +1,380 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "./orchestrator/shard_admission.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./orchestrator/corpus_util.h"
+#include "./orchestrator/orchestrator_util.h"
+#include "./util/checks.h"
+
+namespace silifuzz {
+
+DynamicCorpora::DynamicCorpora(const std::vector<std::string> &shard_paths,
+                               const Options &options)
+    : options_(options), shard_paths_(shard_paths), random_(getpid()) {
+  listed_.assign(shard_paths_.size(), true);
+  unloaded_.resize(shard_paths_.size());
+  std::iota(unloaded_.begin(), unloaded_.end(), 0);
+}
+
+bool DynamicCorpora::IsLoaded(size_t index) const {
+  return std::any_of(
+      loaded_.begin(), loaded_.end(),
+      [index](const LoadedShard &loaded) { return loaded.index == index; });
+}
+
+std::shared_ptr<const InMemoryShard> DynamicCorpora::PickShard(
+    uint64_t random) const {
+  absl::ReaderMutexLock l(&mu_);
+  if (loaded_.empty()) {
+    return nullptr;
+  }
+  return loaded_[random % loaded_.size()].shard;
+}
+
+absl::Status DynamicCorpora::LoadInitialShards(size_t count) {
+  std::vector<size_t> indices;
+  std::vector<std::string> paths;
+  {
+    absl::MutexLock l(&mu_);
+    count = std::min(count, shard_paths_.size());
+    for (size_t index = 0; index < count; ++index) {
+      auto it = std::find(unloaded_.begin(), unloaded_.end(), index);
+      if (it != unloaded_.end()) {
+        unloaded_.erase(it);
+        indices.push_back(index);
+        paths.push_back(shard_paths_[index]);
+      }
+    }
+  }
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      InMemoryCorpora corpora,
+      LoadCorpora(paths, options_.huge_pages, options_.prerelocate,
+                  options_.shard_cache_dir));
+  RETURN_IF_NOT_OK(ValidateCorpus(corpora));
+
+  absl::MutexLock l(&mu_);
+  for (size_t i = 0; i < indices.size(); ++i) {
+    loaded_bytes_ += corpora.shards[i].file_size;
+    loaded_.push_back(
+        {.index = indices[i],
+         .shard = std::make_shared<const InMemoryShard>(
+             std::move(corpora.shards[i]))});
+  }
+  return absl::OkStatus();
+}
+
+absl::Status DynamicCorpora::LoadShard() {
+  size_t index;
+  std::string path;
+  int num_failures = 0;
+  {
+    absl::MutexLock l(&mu_);
+    // Shards never tried go first, then failed ones whose retry time came.
+    auto retry = std::min_element(
+        failed_.begin(), failed_.end(),
+        [](const FailedShard &a, const FailedShard &b) {
+          return a.retry_time < b.retry_time;
+        });
+    if (!unloaded_.empty()) {
+      // Claim the shard so that concurrent calls do not load it twice.
+      std::swap(unloaded_[random_() % unloaded_.size()], unloaded_.back());
+      index = unloaded_.back();
+      unloaded_.pop_back();
+    } else if (retry != failed_.end() && retry->retry_time <= absl::Now()) {
+      index = retry->index;
+      num_failures = retry->num_failures;
+      failed_.erase(retry);
+    } else {
+      return absl::NotFoundError("No shard to load");
+    }
+    loading_.push_back(index);
+    path = shard_paths_[index];
+  }
+  auto load = [&]() -> absl::StatusOr<InMemoryShard> {
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        InMemoryShard shard,
+        LoadCorpus(path, options_.huge_pages, options_.prerelocate,
+                   options_.shard_cache_dir));
+    RETURN_IF_NOT_OK(ValidateShard(shard));
+    return shard;
+  };
+
+  // Decompression takes a while, do it without holding the lock.
+  absl::StatusOr<InMemoryShard> shard = load();
+  absl::MutexLock l(&mu_);
+  loading_.erase(std::find(loading_.begin(), loading_.end(), index));
+  if (!shard.ok()) {
+    if (listed_[index]) {
+      // Failures are often transient, e.g. the shard file is still being
+      // copied, so the shard is retried with exponential backoff.
+      absl::Duration delay = options_.load_retry_delay;
+      for (int i = 0; i < num_failures && delay < options_.max_load_retry_delay;
+           ++i) {
+        delay *= 2;
+      }
+      delay = std::min(delay, options_.max_load_retry_delay);
+      failed_.push_back({.index = index,
+                         .num_failures = num_failures + 1,
+                         .retry_time = absl::Now() + delay});
+      VLOG_INFO(0, "Retrying ", path, " in ", absl::FormatDuration(delay));
+    }
+    return shard.status();
+  }
+  if (!listed_[index]) {
+    // SetShardPaths() dropped the shard while it was loading.
+    VLOG_INFO(0, "Discarding unlisted shard ", shard->name);
+    return absl::OkStatus();
+  }
+  VLOG_INFO(0, "Loaded shard ", shard->name);
+  loaded_bytes_ += shard->file_size;
+  loaded_.push_back(
+      {.index = index,
+       .shard = std::make_shared<const InMemoryShard>(*std::move(shard))});
+  return absl::OkStatus();
+}
+
+bool DynamicCorpora::UnloadShard() {
+  absl::MutexLock l(&mu_);
+  if (loaded_.size() <= 1) {
+    return false;
+  }
+  auto unlisted = std::find_if(
+      loaded_.begin(), loaded_.end(),
+      [this](const LoadedShard &loaded) ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+        return !listed_[loaded.index];
+      });
+  if (unlisted != loaded_.end()) {
+    std::swap(*unlisted, loaded_.back());
+  } else {
+    std::swap(loaded_[random_() % loaded_.size()], loaded_.back());
+  }
+  LoadedShard &victim = loaded_.back();
+  VLOG_INFO(0, "Unloading shard ", victim.shard->name);
+  loaded_bytes_ -= victim.shard->file_size;
+  if (listed_[victim.index]) {
+    unloaded_.push_back(victim.index);
+  }
+  // The memfd is closed once the last runner using the shard is done.
+  loaded_.pop_back();
+  return true;
+}
+
+void DynamicCorpora::SetShardPaths(
+    const std::vector<std::string> &shard_paths) {
+  absl::MutexLock l(&mu_);
+  absl::flat_hash_map<std::string, size_t> indices;
+  for (size_t index = 0; index < shard_paths_.size(); ++index) {
+    indices.emplace(shard_paths_[index], index);
+  }
+  std::vector<bool> listed(shard_paths_.size(), false);
+  for (const std::string &path : shard_paths) {
+    auto [it, inserted] = indices.emplace(path, shard_paths_.size());
+    if (inserted) {
+      shard_paths_.push_back(path);
+      listed.push_back(true);
+    } else {
+      listed[it->second] = true;
+    }
+  }
+  listed_ = std::move(listed);
+
+  // Rebuild `unloaded_` from the new list. Shards that failed to load before
+  // are retried right away if they are listed again.
+  unloaded_.clear();
+  failed_.clear();
+  for (size_t index = 0; index < shard_paths_.size(); ++index) {
+    if (listed_[index] && !IsLoaded(index) &&
+        std::find(loading_.begin(), loading_.end(), index) == loading_.end()) {
+      unloaded_.push_back(index);
+    }
+  }
+  VLOG_INFO(0, "Shard list updated: ", shard_paths.size(), " listed, ",
+            unloaded_.size(), " to load");
+}
+
+bool DynamicCorpora::RetireShard() {
+  absl::MutexLock l(&mu_);
+  if (loaded_.size() <= 1) {
+    return false;
+  }
+  auto unlisted = std::find_if(
+      loaded_.begin(), loaded_.end(),
+      [this](const LoadedShard &loaded) ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+        return !listed_[loaded.index];
+      });
+  if (unlisted == loaded_.end()) {
+    return false;
+  }
+  VLOG_INFO(0, "Retiring shard ", unlisted->shard->name);
+  loaded_bytes_ -= unlisted->shard->file_size;
+  // The memfd is closed once the last runner using the shard is done.
+  loaded_.erase(unlisted);
+  return true;
+}
+
+size_t DynamicCorpora::num_loaded() const {
+  absl::ReaderMutexLock l(&mu_);
+  return loaded_.size();
+}
+
+size_t DynamicCorpora::num_retiring() const {
+  absl::ReaderMutexLock l(&mu_);
+  return std::count_if(
+      loaded_.begin(), loaded_.end(),
+      [this](const LoadedShard &loaded) ABSL_SHARED_LOCKS_REQUIRED(mu_) {
+        return !listed_[loaded.index];
+      });
+}
+
+size_t DynamicCorpora::num_shards() const {
+  absl::ReaderMutexLock l(&mu_);
+  return std::count(listed_.begin(), listed_.end(), true);
+}
+
+uint64_t DynamicCorpora::loaded_bytes() const {
+  absl::ReaderMutexLock l(&mu_);
+  return loaded_bytes_;
+}
+
+// ==================================================================
+
+void ReloadShards(DynamicCorpora &corpora,
+                  const std::vector<std::string> &shard_paths, bool load_all,
+                  const std::function<bool()> &should_stop) {
+  corpora.SetShardPaths(shard_paths);
+  // Load before retiring so that the number of loaded shards never drops.
+  while (!should_stop() && (load_all || corpora.num_retiring() > 0)) {
+    absl::Status s = corpora.LoadShard();
+    if (!s.ok() && !absl::IsNotFound(s)) {
+      LOG_ERROR("Cannot load shard: ", s.message());
+    }
+    const bool retired = corpora.RetireShard();
+    if (absl::IsNotFound(s) && !retired) {
+      break;
+    }
+  }
+  VLOG_INFO(0, "Reloaded shards: ", corpora.num_loaded(), " loaded, ",
+            corpora.num_retiring(), " retiring");
+}
+
+// ==================================================================
+
+ShardAdmission DecideShardAdmission(const MemoryUsageSample &sample,
+                                    uint64_t memory_limit_bytes,
+                                    uint64_t shard_bytes) {
+  const uint64_t used = sample.runner_rss_bytes + sample.loaded_shard_bytes;
+  if (used > memory_limit_bytes || sample.available_bytes < shard_bytes) {
+    return ShardAdmission::kUnload;
+  }
+  if (used + 2 * shard_bytes <= memory_limit_bytes &&
+      sample.available_bytes >= 2 * shard_bytes) {
+    return ShardAdmission::kLoad;
+  }
+  return ShardAdmission::kKeep;
+}
+
+// ==================================================================
+
+uint64_t ShardAdmissionController::RunnerMemoryBytes() const {
+  if (options_.runner_cgroups != nullptr) {
+    // Shard memfds are filled by the orchestrator, so their pages are charged
+    // to the orchestrator's cgroup and are not counted twice here.
+    absl::StatusOr<uint64_t> bytes =
+        options_.runner_cgroups->MemoryCurrentBytes();
+    if (bytes.ok()) return *bytes;
+    LOG_ERROR("Failed to read runner cgroup memory: ",
+              bytes.status().message());
+  }
+  return TotalRunnerRssSizeBytes(getpid());
+}
+
+ShardAdmission ShardAdmissionController::Step() {
+  absl::StatusOr<uint64_t> available_mb = AvailableMemoryMb();
+  if (!available_mb.ok()) {
+    LOG_ERROR("Failed to get available memory: ",
+              available_mb.status().message());
+    return ShardAdmission::kKeep;
+  }
+  MemoryUsageSample sample = {
+      .runner_rss_bytes = RunnerMemoryBytes(),
+      .loaded_shard_bytes = corpora_->loaded_bytes(),
+      .available_bytes = *available_mb * 1024 * 1024,
+  };
+  // Shards are assumed to be of similar size.
+  const size_t num_loaded = corpora_->num_loaded();
+  const uint64_t shard_bytes =
+      num_loaded > 0 ? sample.loaded_shard_bytes / num_loaded : 0;
+
+  ShardAdmission decision =
+      DecideShardAdmission(sample, options_.memory_limit_bytes, shard_bytes);
+  VLOG_INFO(1, "Shard admission: runner RSS ", sample.runner_rss_bytes,
+            " loaded shards ", num_loaded, "/", sample.loaded_shard_bytes,
+            " available ", sample.available_bytes, " decision ",
+            static_cast<int>(decision));
+  switch (decision) {
+    case ShardAdmission::kLoad:
+      if (absl::Status s = corpora_->LoadShard(); !s.ok()) {
+        if (!absl::IsNotFound(s)) {
+          LOG_ERROR("Cannot load shard: ", s.message());
+        }
+        return ShardAdmission::kKeep;
+      }
+      break;
+    case ShardAdmission::kUnload:
+      if (!corpora_->UnloadShard()) {
+        return ShardAdmission::kKeep;
+      }
+      break;
+    case ShardAdmission::kKeep:
+      break;
+  }
+  return decision;
+}
+
+void ShardAdmissionController::Run(const std::function<bool()> &should_stop) {
+  while (!should_stop()) {
+    const absl::Time next_step = absl::Now() + options_.interval;
+    for (absl::Time now = absl::Now(); now < next_step; now = absl::Now()) {
+      if (should_stop()) {
+        return;
+      }
+      absl::SleepFor(std::min(absl::Seconds(1), next_step - now));
+    }
+    if (!should_stop()) {
+      Step();
+    }
+  }
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,247 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_SHARD_ADMISSION_H_
+#define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_SHARD_ADMISSION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "./orchestrator/corpus_util.h"
+#include "./orchestrator/runner_cgroups.h"
+
+// Dynamic shard admission: loads and unloads in-memory corpus shards while
+// the orchestrator runs so that the set of loaded shards tracks the amount of
+// memory actually available on the machine.
+
+namespace silifuzz {
+
+// A thread-safe set of corpus shards of which only a subset is loaded in
+// memory at any given time.
+class DynamicCorpora {
+ public:
+  struct Options {
+    // Passed through to LoadCorpus().
+    bool huge_pages = false;
+    bool prerelocate = false;
+    std::string shard_cache_dir;
+
+    // A shard that fails to load is retried by LoadShard() after this delay,
+    // which doubles with each consecutive failure up to
+    // `max_load_retry_delay`.
+    absl::Duration load_retry_delay = absl::Seconds(30);
+    absl::Duration max_load_retry_delay = absl::Minutes(30);
+  };
+
+  // Constructs an instance that can load any of `shard_paths`. No shard is
+  // loaded initially.
+  DynamicCorpora(const std::vector<std::string> &shard_paths,
+                 const Options &options);
+
+  // Not copyable or moveable -- not just a data holder.
+  DynamicCorpora(const DynamicCorpora &) = delete;
+  DynamicCorpora(DynamicCorpora &&) = delete;
+  DynamicCorpora &operator=(const DynamicCorpora &) = delete;
+  DynamicCorpora &operator=(DynamicCorpora &&) = delete;
+
+  // Returns one of the loaded shards selected by `random`, or nullptr if no
+  // shard is loaded. The shard stays open for as long as the caller holds
+  // the returned pointer even if it is unloaded in the meantime.
+  std::shared_ptr<const InMemoryShard> PickShard(uint64_t random) const;
+
+  // Loads and validates a randomly chosen shard that is not loaded yet.
+  // Returns a NotFound error if all shards are already loaded or the shards
+  // that are not have failed to load and are waiting for their retry time,
+  // see Options::load_retry_delay.
+  absl::Status LoadShard();
+
+  // Loads and validates the first `count` shards of `shard_paths` in
+  // parallel. Used to populate the instance before runners start.
+  absl::Status LoadInitialShards(size_t count);
+
+  // Unloads a randomly chosen shard, preferring shards that are no longer
+  // listed. Does nothing and returns false when at most one shard is loaded so
+  // that runners always have work.
+  bool UnloadShard();
+
+  // Replaces the list of shards this instance can load with `shard_paths`.
+  // New paths become available to LoadShard(). Loaded shards whose path is
+  // not in `shard_paths` keep serving runners until RetireShard() or
+  // UnloadShard() removes them. Paths are compared literally, so a shard file
+  // that is modified in place is not reloaded.
+  void SetShardPaths(const std::vector<std::string> &shard_paths);
+
+  // Unloads a loaded shard that is no longer listed. Does nothing and returns
+  // false if there is no such shard or if it is the only one loaded.
+  bool RetireShard();
+
+  // Number of shards currently loaded.
+  size_t num_loaded() const;
+
+  // Number of loaded shards that are no longer listed.
+  size_t num_retiring() const;
+
+  // Total number of listed shards, loaded or not.
+  size_t num_shards() const;
+
+  // Sum of the sizes of the loaded shards, in bytes.
+  uint64_t loaded_bytes() const;
+
+ private:
+  struct LoadedShard {
+    size_t index;
+    std::shared_ptr<const InMemoryShard> shard;
+  };
+
+  // A shard that failed to load.
+  struct FailedShard {
+    size_t index;
+    // Number of consecutive failures.
+    int num_failures;
+    // LoadShard() does not try the shard again before this time.
+    absl::Time retry_time;
+  };
+
+  // Returns true if shard `index` is loaded.
+  bool IsLoaded(size_t index) const ABSL_SHARED_LOCKS_REQUIRED(mu_);
+
+  // C-tor parameters.
+  const Options options_;
+
+  // Mutex guarding all mutable state of this class.
+  mutable absl::Mutex mu_;
+
+  // Every path this instance has ever been told about. Only ever appended to
+  // so that indices stay valid across SetShardPaths().
+  std::vector<std::string> shard_paths_ ABSL_GUARDED_BY(mu_);
+
+  // listed_[i] is true if shard_paths_[i] is in the current list.
+  std::vector<bool> listed_ ABSL_GUARDED_BY(mu_);
+
+  // Indices into `shard_paths_` that are listed and not loaded.
+  std::vector<size_t> unloaded_ ABSL_GUARDED_BY(mu_);
+
+  // Indices into `shard_paths_` that LoadShard() is loading.
+  std::vector<size_t> loading_ ABSL_GUARDED_BY(mu_);
+
+  // Listed shards that failed to load and are neither loaded nor loading.
+  std::vector<FailedShard> failed_ ABSL_GUARDED_BY(mu_);
+
+  // Loaded shards.
+  std::vector<LoadedShard> loaded_ ABSL_GUARDED_BY(mu_);
+
+  // Sum of the file sizes of `loaded_`.
+  uint64_t loaded_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Picks shards to load.
+  std::mt19937_64 random_ ABSL_GUARDED_BY(mu_);
+};
+
+// Makes `corpora` serve `shard_paths` instead of its current shard list.
+// Loads new shards and retires unlisted ones one at a time so that runners
+// always have a shard to run. When `load_all` is true, all listed shards are
+// loaded. Otherwise only as many are loaded as are retired and the shard
+// admission controller is expected to adjust the rest. Stops early if
+// `should_stop` returns true.
+void ReloadShards(DynamicCorpora &corpora,
+                  const std::vector<std::string> &shard_paths, bool load_all,
+                  const std::function<bool()> &should_stop);
+
+// A point-in-time view of the memory situation used to make shard admission
+// decisions.
+struct MemoryUsageSample {
+  // Sum of the RSS of all runner processes, or the memory charged to their
+  // cgroup when the runners run in RunnerCgroups.
+  uint64_t runner_rss_bytes = 0;
+
+  // Sum of the sizes of all loaded shards.
+  uint64_t loaded_shard_bytes = 0;
+
+  // MemAvailable from /proc/meminfo.
+  uint64_t available_bytes = 0;
+};
+
+enum class ShardAdmission {
+  kKeep,
+  kLoad,
+  kUnload,
+};
+
+// Decides what to do given the memory usage `sample`, a budget of
+// `memory_limit_bytes` for the runners and loaded shards combined and the
+// expected size of one more shard `shard_bytes`.
+//
+// Shards are unloaded as soon as the budget is exceeded or the machine runs low
+// on memory but are only loaded when there is room for two more. The gap
+// between the two thresholds keeps the controller from oscillating.
+//
+// Runner RSS includes the pages of the shard a runner maps, so shard memory is
+// counted twice. This errs on the side of using less memory.
+ShardAdmission DecideShardAdmission(const MemoryUsageSample &sample,
+                                    uint64_t memory_limit_bytes,
+                                    uint64_t shard_bytes);
+
+// Periodically samples memory usage of the orchestrator's runners and
+// /proc/meminfo and loads or unloads shards of `corpora` accordingly.
+class ShardAdmissionController {
+ public:
+  struct Options {
+    // Memory budget for runners and loaded shards combined.
+    uint64_t memory_limit_bytes = 0;
+
+    // Time between two consecutive Step()s in Run().
+    absl::Duration interval = absl::Seconds(30);
+
+    // If not null, runner memory is read from the memory.current of these
+    // cgroups instead of summing the RSS of the runners in /proc.
+    const RunnerCgroups *runner_cgroups = nullptr;
+  };
+
+  ShardAdmissionController(DynamicCorpora *corpora, const Options &options)
+      : corpora_(corpora), options_(options) {}
+
+  // Not copyable or moveable.
+  ShardAdmissionController(const ShardAdmissionController &) = delete;
+  ShardAdmissionController &operator=(const ShardAdmissionController &) =
+      delete;
+
+  // Samples memory usage and loads or unloads at most one shard.
+  // Returns the decision taken.
+  ShardAdmission Step();
+
+  // Calls Step() every `options.interval` until `should_stop` returns true.
+  // `should_stop` is polled at least once a second.
+  void Run(const std::function<bool()> &should_stop);
+
+ private:
+  // Returns the memory used by all runners.
+  uint64_t RunnerMemoryBytes() const;
+
+  DynamicCorpora *corpora_;
+  const Options options_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_SHARD_ADMISSION_H_
@@ -0,0 +1,279 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "./orchestrator/shard_admission.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "./orchestrator/corpus_util.h"
+#include "./snap/snap.h"
+#include "./snap/snap_checksum.h"
+#include "./util/checks.h"
+#include "./util/testing/status_macros.h"
+#include "./util/testing/status_matchers.h"
+#include "./util/zstd_util.h"
+
+namespace silifuzz {
+namespace {
+
+using silifuzz::testing::StatusIs;
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+using ::testing::TempDir;
+
+constexpr uint64_t kMb = 1024 * 1024;
+
+TEST(DecideShardAdmission, Load) {
+  EXPECT_EQ(DecideShardAdmission({.runner_rss_bytes = 100 * kMb,
+                                  .loaded_shard_bytes = 100 * kMb,
+                                  .available_bytes = 1000 * kMb},
+                                 1000 * kMb, 100 * kMb),
+            ShardAdmission::kLoad);
+}
+
+TEST(DecideShardAdmission, Keep) {
+  // One more shard fits the budget but two do not.
+  EXPECT_EQ(DecideShardAdmission({.runner_rss_bytes = 400 * kMb,
+                                  .loaded_shard_bytes = 450 * kMb,
+                                  .available_bytes = 1000 * kMb},
+                                 1000 * kMb, 100 * kMb),
+            ShardAdmission::kKeep);
+  // Two more shards fit the budget but the machine is short on memory.
+  EXPECT_EQ(DecideShardAdmission({.runner_rss_bytes = 100 * kMb,
+                                  .loaded_shard_bytes = 100 * kMb,
+                                  .available_bytes = 150 * kMb},
+                                 1000 * kMb, 100 * kMb),
+            ShardAdmission::kKeep);
+}
+
+TEST(DecideShardAdmission, Unload) {
+  // Over budget.
+  EXPECT_EQ(DecideShardAdmission({.runner_rss_bytes = 600 * kMb,
+                                  .loaded_shard_bytes = 500 * kMb,
+                                  .available_bytes = 1000 * kMb},
+                                 1000 * kMb, 100 * kMb),
+            ShardAdmission::kUnload);
+  // Under budget but the machine is about to run out of memory.
+  EXPECT_EQ(DecideShardAdmission({.runner_rss_bytes = 100 * kMb,
+                                  .loaded_shard_bytes = 100 * kMb,
+                                  .available_bytes = 50 * kMb},
+                                 1000 * kMb, 100 * kMb),
+            ShardAdmission::kUnload);
+}
+
+// Writes `n` small, valid, zstd-compressed corpus shards to TempDir() and
+// returns their paths.
+std::vector<std::string> WriteShards(absl::string_view prefix, size_t n) {
+  std::vector<std::string> paths;
+  for (size_t i = 0; i < n; ++i) {
+    std::string contents(4096, static_cast<char>(i));
+    SnapCorpusHeader header = {
+        .magic = kSnapCorpusMagic,
+        .header_size = sizeof(SnapCorpusHeader),
+        .checksum = 0,
+        .num_bytes = contents.size(),
+    };
+    memcpy(contents.data(), &header, sizeof(header));
+    CorpusChecksumCalculator checksum;
+    checksum.AddData(contents);
+    header.checksum = checksum.Checksum();
+    memcpy(contents.data(), &header, sizeof(header));
+
+    absl::StatusOr<std::string> compressed = ZstdCompress(contents, 1);
+    CHECK_STATUS(compressed.status());
+    std::string path =
+        absl::StrCat(TempDir(), "/", prefix, "_", i, kZstdExtension);
+    FILE *f = fopen(path.c_str(), "w");
+    CHECK(f != nullptr);
+    CHECK_EQ(fwrite(compressed->data(), 1, compressed->size(), f),
+             compressed->size());
+    CHECK_EQ(fclose(f), 0);
+    paths.push_back(path);
+  }
+  return paths;
+}
+
+TEST(DynamicCorpora, LoadAndUnload) {
+  constexpr size_t kNumShards = 4;
+  DynamicCorpora corpora(WriteShards("LoadAndUnload", kNumShards), {});
+  EXPECT_EQ(corpora.num_shards(), kNumShards);
+  EXPECT_EQ(corpora.num_loaded(), 0);
+  EXPECT_EQ(corpora.PickShard(0), nullptr);
+
+  ASSERT_OK(corpora.LoadInitialShards(1));
+  EXPECT_EQ(corpora.num_loaded(), 1);
+  EXPECT_EQ(corpora.loaded_bytes(), 4096);
+  std::shared_ptr<const InMemoryShard> first = corpora.PickShard(0);
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ(first->name, "LoadAndUnload_0");
+
+  // The last shard is never unloaded.
+  EXPECT_FALSE(corpora.UnloadShard());
+
+  for (size_t i = 1; i < kNumShards; ++i) {
+    ASSERT_OK(corpora.LoadShard());
+  }
+  EXPECT_THAT(corpora.LoadShard(), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_EQ(corpora.num_loaded(), kNumShards);
+  EXPECT_EQ(corpora.loaded_bytes(), kNumShards * 4096);
+
+  std::set<std::string> names;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    names.insert(corpora.PickShard(i)->name);
+  }
+  EXPECT_EQ(names.size(), kNumShards);
+
+  // Shards picked before being unloaded stay usable.
+  std::vector<std::shared_ptr<const InMemoryShard>> picked;
+  for (size_t i = 0; i < kNumShards; ++i) {
+    picked.push_back(corpora.PickShard(i));
+  }
+  for (size_t i = 1; i < kNumShards; ++i) {
+    EXPECT_TRUE(corpora.UnloadShard());
+  }
+  EXPECT_FALSE(corpora.UnloadShard());
+  EXPECT_EQ(corpora.num_loaded(), 1);
+  EXPECT_EQ(corpora.loaded_bytes(), 4096);
+  for (const auto &shard : picked) {
+    EXPECT_OK(ValidateShard(*shard));
+    EXPECT_GE(shard->file_descriptor.borrow(), 0);
+  }
+
+  // Unloaded shards can be loaded again.
+  ASSERT_OK(corpora.LoadShard());
+  EXPECT_EQ(corpora.num_loaded(), 2);
+}
+
+TEST(DynamicCorpora, BadShard) {
+  std::vector<std::string> paths = WriteShards("BadShard", 1);
+  paths.push_back("/this does not exist.xz");
+  DynamicCorpora corpora(paths, {});
+  EXPECT_FALSE(corpora.LoadInitialShards(2).ok());
+
+  DynamicCorpora corpora2(paths, {});
+  ASSERT_OK(corpora2.LoadInitialShards(1));
+  EXPECT_FALSE(corpora2.LoadShard().ok());
+  // A shard that failed to load is not retried before its retry delay.
+  EXPECT_THAT(corpora2.LoadShard(), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_EQ(corpora2.num_loaded(), 1);
+}
+
+TEST(DynamicCorpora, RetriesFailedShard) {
+  std::vector<std::string> written = WriteShards("RetriesFailedShard", 2);
+  const std::string missing = absl::StrCat(written[1], ".missing");
+  ASSERT_EQ(rename(written[1].c_str(), missing.c_str()), 0);
+  DynamicCorpora corpora(
+      written, {.load_retry_delay = absl::ZeroDuration(),
+                .max_load_retry_delay = absl::ZeroDuration()});
+  ASSERT_OK(corpora.LoadInitialShards(1));
+  EXPECT_FALSE(corpora.LoadShard().ok());
+  EXPECT_FALSE(corpora.LoadShard().ok());
+  EXPECT_EQ(corpora.num_loaded(), 1);
+
+  // The shard loads once the file is there.
+  ASSERT_EQ(rename(missing.c_str(), written[1].c_str()), 0);
+  ASSERT_OK(corpora.LoadShard());
+  EXPECT_EQ(corpora.num_loaded(), 2);
+  EXPECT_THAT(corpora.LoadShard(), StatusIs(absl::StatusCode::kNotFound));
+}
+
+TEST(DynamicCorpora, SetShardPaths) {
+  std::vector<std::string> old_paths = WriteShards("SetShardPathsOld", 2);
+  std::vector<std::string> new_paths = WriteShards("SetShardPathsNew", 2);
+  DynamicCorpora corpora(old_paths, {});
+  ASSERT_OK(corpora.LoadInitialShards(2));
+  std::shared_ptr<const InMemoryShard> picked = corpora.PickShard(0);
+
+  corpora.SetShardPaths({old_paths[1], new_paths[0], new_paths[1]});
+  EXPECT_EQ(corpora.num_shards(), 3);
+  EXPECT_EQ(corpora.num_loaded(), 2);
+  EXPECT_EQ(corpora.num_retiring(), 1);
+
+  ASSERT_OK(corpora.LoadShard());
+  ASSERT_OK(corpora.LoadShard());
+  EXPECT_THAT(corpora.LoadShard(), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_TRUE(corpora.RetireShard());
+  EXPECT_FALSE(corpora.RetireShard());
+  EXPECT_EQ(corpora.num_retiring(), 0);
+  EXPECT_EQ(corpora.num_loaded(), 3);
+  EXPECT_EQ(corpora.loaded_bytes(), 3 * 4096);
+
+  std::set<std::string> names;
+  for (size_t i = 0; i < 3; ++i) {
+    names.insert(corpora.PickShard(i)->name);
+  }
+  EXPECT_THAT(names, ElementsAre("SetShardPathsNew_0", "SetShardPathsNew_1",
+                                 "SetShardPathsOld_1"));
+  // A retired shard stays usable by runners that picked it.
+  EXPECT_OK(ValidateShard(*picked));
+
+  // Unlisted shards are not loaded again after being unloaded.
+  corpora.SetShardPaths({new_paths[0]});
+  EXPECT_EQ(corpora.num_retiring(), 2);
+  EXPECT_TRUE(corpora.UnloadShard());
+  EXPECT_TRUE(corpora.UnloadShard());
+  EXPECT_FALSE(corpora.UnloadShard());
+  EXPECT_EQ(corpora.PickShard(0)->name, "SetShardPathsNew_0");
+  EXPECT_THAT(corpora.LoadShard(), StatusIs(absl::StatusCode::kNotFound));
+}
+
+TEST(DynamicCorpora, RetireKeepsLastShard) {
+  std::vector<std::string> old_paths = WriteShards("RetireKeepsLastOld", 1);
+  DynamicCorpora corpora(old_paths, {});
+  ASSERT_OK(corpora.LoadInitialShards(1));
+  corpora.SetShardPaths({"/this does not exist.xz"});
+  EXPECT_FALSE(corpora.LoadShard().ok());
+  EXPECT_FALSE(corpora.RetireShard());
+  EXPECT_EQ(corpora.num_loaded(), 1);
+}
+
+TEST(ReloadShards, ReplacesShards) {
+  std::vector<std::string> old_paths = WriteShards("ReloadOld", 2);
+  std::vector<std::string> new_paths = WriteShards("ReloadNew", 3);
+  auto never_stop = []() { return false; };
+
+  DynamicCorpora corpora(old_paths, {});
+  ASSERT_OK(corpora.LoadInitialShards(2));
+  ReloadShards(corpora, new_paths, true, never_stop);
+  EXPECT_EQ(corpora.num_loaded(), 3);
+  EXPECT_EQ(corpora.num_retiring(), 0);
+
+  // Without `load_all` only as many shards are loaded as are retired.
+  DynamicCorpora corpora2(old_paths, {});
+  ASSERT_OK(corpora2.LoadInitialShards(2));
+  ReloadShards(corpora2, new_paths, false, never_stop);
+  EXPECT_EQ(corpora2.num_loaded(), 2);
+  EXPECT_EQ(corpora2.num_retiring(), 0);
+  for (size_t i = 0; i < 2; ++i) {
+    EXPECT_THAT(corpora2.PickShard(i)->name, HasSubstr("ReloadNew"));
+  }
+}
+
+}  // namespace
+}  // namespace silifuzz
@@ -14,13 +14,26 @@
 
 #include "./orchestrator/silifuzz_orchestrator.h"
 
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
 #include <functional>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <random>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/base/log_severity.h"
+#include "absl/functional/function_ref.h"
 #include "absl/log/check.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
@@ -29,8 +42,11 @@
 #include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "./orchestrator/corpus_util.h"
+#include "./orchestrator/shard_admission.h"
 #include "./runner/driver/runner_driver.h"
+#include "./runner/driver/runner_options.h"
 #include "./util/checks.h"
 
 namespace silifuzz {
@@ -52,7 +68,6 @@ std::string RunResultToDebugString(
 }  // namespace
 
 ExecutionContext::~ExecutionContext() {
-  absl::MutexLock l(&mu_);
   if (!invocation_results_.empty()) {
     absl::string_view error =
         "The result queue is not empty. Did you call ProcessResultQueue()?";
@@ -68,50 +83,91 @@ ExecutionContext::~ExecutionContext() {
 // was added, false otherwise.
 bool ExecutionContext::OfferRunResult(
     absl::StatusOr<RunnerDriver::RunResult> &&result) {
-  absl::MutexLock l(&mu_);
   if (!result.ok()) {
     // Currently, no-Ok() results are not reported to the result queue. It is
-    // important however this code executed with mu_ held b/c this allows
-    // EventLoop() to wake up and catch deadline events sooner.
+    // important however to wake up EventLoop() b/c this allows it to catch
+    // deadline events sooner.
+    WakeUpEventLoop();
     return true;
   }
 
-  // Allow at most 1 result slot per thread.
-  if (invocation_results_.size() >= num_threads_) {
-    return false;
+  if (!invocation_results_.TryPush(std::move(*result))) {
+    // Backpressure: wait for EventLoop() to make room rather than dropping
+    // the result right away.
+    num_waits_.fetch_add(1, std::memory_order_relaxed);
+    const absl::Time give_up = absl::Now() + max_offer_wait_;
+    absl::Duration backoff = absl::Microseconds(100);
+    do {
+      WakeUpEventLoop();
+      if (ShouldStop() || absl::Now() >= give_up) {
+        num_dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      absl::SleepFor(backoff);
+      backoff = std::min(backoff * 2, absl::Milliseconds(100));
+    } while (!invocation_results_.TryPush(std::move(*result)));
+  }
+
+  const uint64_t depth = invocation_results_.size();
+  uint64_t max_depth = max_depth_.load(std::memory_order_relaxed);
+  while (depth > max_depth &&
+         !max_depth_.compare_exchange_weak(max_depth, depth,
+                                           std::memory_order_relaxed)) {
   }
-  invocation_results_.emplace_back(*result);
+  WakeUpEventLoop();
   return true;
 }
 
+ExecutionContext::ResultQueueStats ExecutionContext::result_queue_stats()
+    const {
+  return {.num_waits = num_waits_.load(std::memory_order_relaxed),
+          .num_dropped = num_dropped_.load(std::memory_order_relaxed),
+          .max_depth = max_depth_.load(std::memory_order_relaxed)};
+}
+
+void ExecutionContext::WakeUpEventLoop() {
+  // Pairs with the fence in EventLoop(): either EventLoop() sees the new
+  // result before blocking or we see consumer_waiting_ and cycle the mutex,
+  // which makes it re-evaluate ShouldWakeUp().
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (consumer_waiting_.load(std::memory_order_relaxed)) {
+    mu_.Lock();
+    mu_.Unlock();
+  }
+}
+
+void ExecutionContext::DrainResultQueue() {
+  std::vector<RunnerDriver::RunResult> current_results;
+  current_results.reserve(invocation_results_.capacity());
+  while (std::optional<RunnerDriver::RunResult> result =
+             invocation_results_.TryPop()) {
+    current_results.push_back(std::move(*result));
+  }
+  ProcessResultQueueImpl(current_results);
+}
+
 // Runs the orchestrator event loop.
 // NOTE: This method is not reentrant. Must be called by the main thread.
 void ExecutionContext::EventLoop() {
   constexpr absl::Duration kTimeout = absl::Seconds(10);
   while (!ShouldStop()) {
-    std::vector<RunnerDriver::RunResult> current_results;
-    current_results.reserve(num_threads_);
-    {
-      bool timed_out = mu_.LockWhenWithTimeout(
-          absl::Condition(this, &ExecutionContext::ShouldWakeUp), kTimeout);
-      VLOG_INFO(2, "Result processor woke up, queue size = ",
-                invocation_results_.size(), " due to timeout? = ", timed_out);
-      invocation_results_.swap(current_results);
-      mu_.Unlock();
-    }
+    consumer_waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool woken_up = mu_.LockWhenWithTimeout(
+        absl::Condition(this, &ExecutionContext::ShouldWakeUp), kTimeout);
+    mu_.Unlock();
+    consumer_waiting_.store(false, std::memory_order_relaxed);
+    VLOG_INFO(2, "Result processor woke up, queue size = ",
+              invocation_results_.size(), " due to timeout? = ", !woken_up);
 
-    ProcessResultQueueImpl(current_results);
+    DrainResultQueue();
   }
 }
 
 // Processes the event queue on the calling thread.
 // This method needs to be called to process any late-arriving events after
 // all worker thread have been joined.
-void ExecutionContext::ProcessResultQueue() {
-  absl::MutexLock l(&mu_);
-  ProcessResultQueueImpl(invocation_results_);
-  invocation_results_.clear();
-}
+void ExecutionContext::ProcessResultQueue() { DrainResultQueue(); }
 
 void ExecutionContext::ProcessResultQueueImpl(
     const std::vector<RunnerDriver::RunResult> &results) {
@@ -124,78 +180,574 @@ void ExecutionContext::ProcessResultQueueImpl(
 
 // ==================================================================
 
-NextCorpusGenerator::NextCorpusGenerator(int size, bool sequential_mode,
-                                         int seed)
+namespace {
+
+// SplitMix64 finalizer. A cheap, stateless way to turn a counter into a
+// well-mixed 64-bit value.
+uint64_t Mix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+}  // namespace
+
+ShardScheduler::ShardScheduler(int size, bool sequential_mode, uint64_t seed)
     : size_(size),
       sequential_mode_(sequential_mode),
-      random_(seed),
-      next_index_(0) {
-  CHECK_GT(size_, 0);
+      seed_(seed),
+      next_ticket_(0) {
+  CHECK_GT(size, 0);
+}
+
+int ShardScheduler::Next() {
+  return ShardAt(next_ticket_.fetch_add(1, std::memory_order_relaxed));
 }
 
-int NextCorpusGenerator::operator()() {
+int ShardScheduler::Peek() const {
+  return ShardAt(next_ticket_.load(std::memory_order_relaxed));
+}
+
+int ShardScheduler::ShardAt(uint64_t ticket) const {
   if (sequential_mode_) {
-    return next_index_ < size_ ? next_index_++ : kEndOfStream;
-  } else {
-    return random_() % size_;
+    return ticket < size_ ? ticket : kEndOfStream;
+  }
+  // Within an epoch, map positions to shards with the affine permutation
+  // pos -> (a * pos + b) % size, where a is coprime with size. Picking a new
+  // (a, b) per epoch reshuffles the order without any shared state beyond the
+  // ticket counter.
+  const uint64_t epoch = ticket / size_;
+  const uint64_t pos = ticket % size_;
+  const uint64_t h1 = Mix64(seed_ ^ Mix64(epoch));
+  const uint64_t h2 = Mix64(h1);
+  uint64_t a = h1 % size_;
+  while (std::gcd(a, size_) != 1) {
+    a = (a + 1) % size_;
+  }
+  const uint64_t b = h2 % size_;
+  // size_ fits in an int so the product cannot overflow.
+  return static_cast<int>((a * pos + b) % size_);
+}
+
+CoreRotationScheduler::CoreRotationScheduler(int num_shards, int num_slots,
+                                             uint64_t seed)
+    : num_shards_(num_shards),
+      num_slots_(num_slots),
+      seed_(seed),
+      num_runs_(std::make_unique<std::atomic<uint64_t>[]>(num_slots)) {
+  CHECK_GT(num_shards, 0);
+  CHECK_GT(num_slots, 0);
+  for (int slot = 0; slot < num_slots; ++slot) {
+    num_runs_[slot].store(0, std::memory_order_relaxed);
+  }
+}
+
+int CoreRotationScheduler::Next(int slot) {
+  CHECK_GE(slot, 0);
+  CHECK_LT(slot, num_slots_);
+  return ShardAt(slot,
+                 num_runs_[slot].fetch_add(1, std::memory_order_relaxed));
+}
+
+int CoreRotationScheduler::Peek(int slot) const {
+  CHECK_GE(slot, 0);
+  CHECK_LT(slot, num_slots_);
+  return ShardAt(slot, num_runs_[slot].load(std::memory_order_relaxed));
+}
+
+int CoreRotationScheduler::ShardAt(int slot, uint64_t run) const {
+  // Same affine permutation per epoch as ShardScheduler::Next(). The offset
+  // spreads the slots evenly over the permutation.
+  const uint64_t epoch = run / num_shards_;
+  const uint64_t offset = slot * num_shards_ / num_slots_;
+  const uint64_t pos = (run + offset) % num_shards_;
+  const uint64_t h1 = Mix64(seed_ ^ Mix64(epoch));
+  const uint64_t h2 = Mix64(h1);
+  uint64_t a = h1 % num_shards_;
+  while (std::gcd(a, num_shards_) != 1) {
+    a = (a + 1) % num_shards_;
+  }
+  const uint64_t b = h2 % num_shards_;
+  return static_cast<int>((a * pos + b) % num_shards_);
+}
+
+uint64_t CoreRotationScheduler::num_runs(int slot) const {
+  CHECK_GE(slot, 0);
+  CHECK_LT(slot, num_slots_);
+  return num_runs_[slot].load(std::memory_order_relaxed);
+}
+
+uint64_t CoreRotationScheduler::num_shards_visited(int slot) const {
+  // Every epoch visits all shards, so the first `num_shards_` runs are
+  // distinct.
+  return std::min(num_runs(slot), num_shards_);
+}
+
+SequentialWorkQueue::SequentialWorkQueue(int num_shards,
+                                         int num_ranges_per_shard)
+    : num_shards_(num_shards),
+      num_ranges_per_shard_(num_ranges_per_shard),
+      next_range_(0),
+      completed_(static_cast<size_t>(num_shards) * num_ranges_per_shard) {
+  CHECK_GT(num_shards, 0);
+  CHECK_GT(num_ranges_per_shard, 0);
+}
+
+std::optional<SequentialWorkQueue::SnapRange> SequentialWorkQueue::Next() {
+  const uint64_t range = next_range_.fetch_add(1, std::memory_order_relaxed);
+  if (range >= completed_.size()) {
+    return std::nullopt;
+  }
+  return SnapRange{.shard = static_cast<int>(range / num_ranges_per_shard_),
+                   .index = static_cast<int>(range % num_ranges_per_shard_)};
+}
+
+void SequentialWorkQueue::Complete(
+    const SnapRange &range, bool completed,
+    absl::StatusOr<RunnerDriver::RunResult> result,
+    absl::FunctionRef<void(absl::StatusOr<RunnerDriver::RunResult> &&)>
+        publish) {
+  const uint64_t r =
+      static_cast<uint64_t>(range.shard) * num_ranges_per_shard_ + range.index;
+  absl::MutexLock l(&mu_);
+  CHECK_LT(r, completed_.size());
+  completed_[r] = completed;
+  pending_.emplace(r, std::move(result));
+  for (auto it = pending_.begin();
+       it != pending_.end() && it->first == next_to_publish_;
+       it = pending_.erase(it)) {
+    publish(std::move(it->second));
+    ++next_to_publish_;
   }
 }
 
+std::vector<bool> SequentialWorkQueue::CompletedRanges(int shard) const {
+  CHECK_GE(shard, 0);
+  CHECK_LT(shard, num_shards_);
+  absl::MutexLock l(&mu_);
+  const auto begin = completed_.begin() + shard * num_ranges_per_shard_;
+  return std::vector<bool>(begin, begin + num_ranges_per_shard_);
+}
+
 // ==================================================================
-//
-// The main worker thread. Each such thread executes runners with corpora in a
-// loop until it is told to stop.
-void RunnerThread(ExecutionContext *ctx, const RunnerThreadArgs &args) {
-  VLOG_INFO(0, "T", args.thread_idx, " started");
-  NextCorpusGenerator next_corpus_generator(
-      args.corpora->shards.size(), args.runner_options.sequential_mode(),
-      args.thread_idx);
-
-  while (!ctx->ShouldStop()) {
-    absl::Time start_time = absl::Now();
-    absl::Duration time_budget = ctx->deadline() - start_time;
-    if (time_budget <= absl::ZeroDuration()) {
-      break;
-    }
-    RunnerOptions runner_options = args.runner_options;
-    runner_options.set_wall_time_budget(time_budget);
-    VLOG_INFO(1, "T", args.thread_idx, " time budget ",
-              absl::FormatDuration(time_budget));
-    int shard_idx = next_corpus_generator();
-
-    if (shard_idx == NextCorpusGenerator::kEndOfStream) {
+
+namespace {
+
+// One runner invocation of a worker.
+struct RunnerInvocation {
+  absl::Time start_time;
+  RunnerOptions runner_options;
+  // Keeps a dynamically loaded shard open until the runner is done with it.
+  std::shared_ptr<const InMemoryShard> dynamic_shard;
+  const InMemoryShard *shard;
+  std::optional<SequentialWorkQueue::SnapRange> snap_range;
+};
+
+// How long a worker waits before trying again when no dynamically loaded
+// shard is available.
+constexpr absl::Duration kNoShardRetryDelay = absl::Seconds(1);
+
+// Picks the next shard for the worker described by `args` and prepares the
+// options of its runner. Returns std::nullopt when the worker should stop.
+// Returns an Unavailable error if there is no shard to run right now, in which
+// case the worker should try again after kNoShardRetryDelay.
+absl::StatusOr<std::optional<RunnerInvocation>> NextInvocation(
+    ExecutionContext *ctx, const RunnerThreadArgs &args,
+    std::mt19937_64 &random) {
+  if (ctx->ShouldStop()) {
+    return std::nullopt;
+  }
+  RunnerInvocation invocation = {.start_time = absl::Now(),
+                                 .runner_options = args.runner_options};
+  absl::Duration time_budget = ctx->deadline() - invocation.start_time;
+  if (time_budget <= absl::ZeroDuration()) {
+    return std::nullopt;
+  }
+  RunnerOptions &runner_options = invocation.runner_options;
+  runner_options.set_wall_time_budget(time_budget);
+  VLOG_INFO(1, "T", args.thread_idx, " time budget ",
+            absl::FormatDuration(time_budget));
+  if (args.sequential_queue != nullptr) {
+    invocation.snap_range = args.sequential_queue->Next();
+    if (!invocation.snap_range.has_value()) {
       VLOG_INFO(0, "T", args.thread_idx,
                 " Reached end of stream in sequential mode");
-      break;
+      return std::nullopt;
     }
+    invocation.shard = &args.corpora->shards[invocation.snap_range->shard];
+    runner_options.set_snap_range(
+        invocation.snap_range->index,
+        args.sequential_queue->num_ranges_per_shard());
+  } else if (args.core_rotation != nullptr) {
+    invocation.shard =
+        &args.corpora->shards[args.core_rotation->Next(args.rotation_slot)];
+  } else if (args.dynamic_corpora == nullptr) {
+    int shard_idx = args.scheduler->Next();
 
-    const InMemoryShard &shard = args.corpora->shards[shard_idx];
-    RunnerDriver driver =
-        RunnerDriver::ReadingRunner(args.runner, shard.file_path, shard.name);
-    absl::StatusOr<RunnerDriver::RunResult> run_result_or =
-        driver.Run(runner_options);
+    if (shard_idx == ShardScheduler::kEndOfStream) {
+      VLOG_INFO(0, "T", args.thread_idx,
+                " Reached end of stream in sequential mode");
+      return std::nullopt;
+    }
+    invocation.shard = &args.corpora->shards[shard_idx];
+  } else {
+    invocation.dynamic_shard = args.dynamic_corpora->PickShard(random());
+    if (invocation.dynamic_shard == nullptr) {
+      // All shards may have failed to load. The admission controller or a
+      // shard list reload can still load one.
+      return absl::UnavailableError("No shard is loaded");
+    }
+    invocation.shard = invocation.dynamic_shard.get();
+  }
 
-    absl::Duration elapsed_time = absl::Now() - start_time;
+  const InMemoryShard &shard = *invocation.shard;
+  if (args.metrics != nullptr) {
+    args.metrics->StartRun(shard.name);
+  }
+  runner_options.set_corpus_load_address(shard.load_address);
+  if (args.budget_controller != nullptr) {
+    runner_options.set_cpu_time_budget(
+        args.budget_controller->BudgetFor(shard.name));
+  }
+  if (args.launch_scheduler != nullptr) {
+    runner_options.set_cpu_time_budget(args.launch_scheduler->JitterBudget(
+        runner_options.cpu_time_budget()));
+  }
+  return invocation;
+}
 
-    std::string log_msg = absl::StrCat(
-        "T", args.thread_idx, " cpu: ", args.runner_options.cpu(),
-        " corpus: ", shard.name, " time: ", absl::ToInt64Seconds(elapsed_time),
-        " exit_status: ", RunResultToDebugString(run_result_or));
-    if (!run_result_or.ok()) {
-      LOG_ERROR(log_msg, " error: ", run_result_or.status().message());
-    } else {
-      VLOG_INFO(0, log_msg);
+// Prefetches the shard that the worker described by `args` will likely run
+// after `invocation` if args.prefetch_next_shard is set.
+void MaybePrefetchNextShard(const RunnerThreadArgs &args,
+                            const RunnerInvocation &invocation) {
+  if (!args.prefetch_next_shard || args.sequential_queue != nullptr ||
+      args.dynamic_corpora != nullptr) {
+    return;
+  }
+  const int shard_idx = args.core_rotation != nullptr
+                            ? args.core_rotation->Peek(args.rotation_slot)
+                            : args.scheduler->Peek();
+  if (shard_idx == ShardScheduler::kEndOfStream) return;
+  const InMemoryShard &next_shard = args.corpora->shards[shard_idx];
+  // The current shard has just been mapped by its runner.
+  if (&next_shard != invocation.shard) {
+    PrefetchShard(next_shard);
+  }
+}
+
+// Returns a driver for the runner of `invocation`.
+RunnerDriver InvocationDriver(const RunnerThreadArgs &args,
+                              const RunnerInvocation &invocation) {
+  return RunnerDriver::ReadingRunner(args.runner, invocation.shard->file_path,
+                                     invocation.shard->name);
+}
+
+// A persistent mode runner that a worker keeps across invocations.
+struct PersistentRunner {
+  // Shard the runner runs and, if it was loaded dynamically, the reference
+  // keeping it open.
+  const InMemoryShard *shard = nullptr;
+  std::shared_ptr<const InMemoryShard> dynamic_shard;
+  // Declared before `session`, which must not outlive it.
+  std::optional<RunnerDriver> driver;
+  std::unique_ptr<RunnerDriver::PersistentSession> session;
+};
+
+// Runs args.persistent_batch_size snaps of the shard of `invocation` in
+// `runner`. Starts a new runner if `runner` has exited or runs another shard.
+absl::StatusOr<RunnerDriver::RunResult> RunPersistentBatch(
+    const RunnerThreadArgs &args, const RunnerInvocation &invocation,
+    std::mt19937_64 &random, PersistentRunner &runner) {
+  if (runner.session == nullptr || !runner.session->alive() ||
+      runner.shard != invocation.shard) {
+    runner.session.reset();
+    runner.shard = invocation.shard;
+    runner.dynamic_shard = invocation.dynamic_shard;
+    runner.driver = InvocationDriver(args, invocation);
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        runner.session,
+        runner.driver->StartPersistentSession(invocation.runner_options));
+    VLOG_INFO(1, "T", args.thread_idx, " started persistent runner for ",
+              invocation.shard->name);
+  }
+  return runner.session->Run(args.persistent_batch_size, random());
+}
+
+// Records `run_result_or` of `invocation` and publishes it to `ctx`.
+void CompleteInvocation(ExecutionContext *ctx, const RunnerThreadArgs &args,
+                        const RunnerInvocation &invocation,
+                        absl::StatusOr<RunnerDriver::RunResult> run_result_or) {
+  const InMemoryShard &shard = *invocation.shard;
+  absl::Duration elapsed_time = absl::Now() - invocation.start_time;
+  if (args.budget_controller != nullptr && run_result_or.ok() &&
+      run_result_or->startup_timings().has_value()) {
+    const RunnerDriver::RunResult::StartupTimings &timings =
+        *run_result_or->startup_timings();
+    args.budget_controller->RecordStartup(
+        shard.name, timings.exec + timings.load_corpus + timings.map_corpus +
+                        timings.verify_checksums);
+  }
+  if (args.telemetry != nullptr || args.metrics != nullptr) {
+    const ThroughputTelemetry::RunSample sample =
+        ThroughputTelemetry::MakeRunSample(run_result_or, elapsed_time);
+    if (args.telemetry != nullptr) {
+      args.telemetry->Record(shard.name, args.runner_options.cpu(), sample);
     }
+    if (args.metrics != nullptr) {
+      const RunnerDriver::RunResult::StartupTimings &timings =
+          sample.startup_timings;
+      args.metrics->EndRun(sample.failed, sample.num_snaps_executed,
+                           timings.exec + timings.load_corpus +
+                               timings.map_corpus + timings.verify_checksums);
+    }
+  }
+
+  std::string log_msg = absl::StrCat(
+      "T", args.thread_idx, " cpu: ", args.runner_options.cpu(),
+      " corpus: ", shard.name, " time: ", absl::ToInt64Seconds(elapsed_time),
+      " exit_status: ", RunResultToDebugString(run_result_or));
+  if (!run_result_or.ok()) {
+    LOG_ERROR(log_msg, " error: ", run_result_or.status().message());
+  } else {
+    VLOG_INFO(0, log_msg);
+  }
 
-    if (!ctx->OfferRunResult(std::move(run_result_or))) {
+  auto offer_one = [ctx, &args](
+                       absl::StatusOr<RunnerDriver::RunResult> &&run_result) {
+    if (!ctx->OfferRunResult(std::move(run_result))) {
       LOG_ERROR(
           "T", args.thread_idx,
           " Result processing queue is stuck, some results won't be logged");
     }
+  };
+  // A runner with a failure budget may report several failures. The
+  // earlier ones are results of their own.
+  auto offer = [&offer_one](
+                   absl::StatusOr<RunnerDriver::RunResult> &&run_result) {
+    if (run_result.ok()) {
+      for (const RunnerDriver::RunResult &failure :
+           run_result->earlier_failures()) {
+        offer_one(failure);
+      }
+    }
+    offer_one(std::move(run_result));
+  };
+  if (invocation.snap_range.has_value()) {
+    const bool completed = run_result_or.ok() && run_result_or->success();
+    args.sequential_queue->Complete(*invocation.snap_range, completed,
+                                    std::move(run_result_or), offer);
+  } else {
+    offer(std::move(run_result_or));
+  }
+}
+
+void CheckRunnerThreadArgs(const RunnerThreadArgs &args) {
+  if (args.dynamic_corpora == nullptr) {
+    CHECK(args.scheduler != nullptr || args.sequential_queue != nullptr);
+  } else {
+    CHECK(!args.runner_options.sequential_mode());
+  }
+  if (args.persistent_batch_size != 0) {
+    CHECK(args.sequential_queue == nullptr);
+  }
+}
+
+}  // namespace
+
+// The main worker thread. Each such thread executes runners with corpora in a
+// loop until it is told to stop.
+void RunnerThread(ExecutionContext *ctx, const RunnerThreadArgs &args) {
+  VLOG_INFO(0, "T", args.thread_idx, " started");
+  std::mt19937_64 random(args.thread_idx);
+  CheckRunnerThreadArgs(args);
+  PersistentRunner persistent_runner;
+
+  while (true) {
+    if (args.launch_scheduler != nullptr) {
+      // Wait for the launch slot in short steps to notice a stop request.
+      const absl::Time launch = std::min(
+          args.launch_scheduler->ReserveLaunch(absl::Now()), ctx->deadline());
+      while (!ctx->ShouldStop() && absl::Now() < launch) {
+        absl::SleepFor(
+            std::min(launch - absl::Now(), absl::Milliseconds(100)));
+      }
+    }
+    absl::StatusOr<std::optional<RunnerInvocation>> next_invocation =
+        NextInvocation(ctx, args, random);
+    if (!next_invocation.ok()) {
+      LOG_ERROR("T", args.thread_idx, " ", next_invocation.status().message(),
+                ", retrying in ", absl::FormatDuration(kNoShardRetryDelay));
+      const absl::Time retry = absl::Now() + kNoShardRetryDelay;
+      while (!ctx->ShouldStop() && absl::Now() < retry) {
+        absl::SleepFor(std::min(retry - absl::Now(), absl::Milliseconds(100)));
+      }
+      continue;
+    }
+    std::optional<RunnerInvocation> &invocation = *next_invocation;
+    if (!invocation.has_value()) break;
+    MaybePrefetchNextShard(args, *invocation);
+    if (args.persistent_batch_size != 0) {
+      CompleteInvocation(
+          ctx, args, *invocation,
+          RunPersistentBatch(args, *invocation, random, persistent_runner));
+      continue;
+    }
+    RunnerDriver driver = InvocationDriver(args, *invocation);
+    CompleteInvocation(ctx, args, *invocation,
+                       driver.Run(invocation->runner_options));
   }
 
   ctx->Stop();
   VLOG_INFO(0, "T", args.thread_idx, " stopped");
 }
 
+void RunnerEventLoop(ExecutionContext *ctx,
+                     absl::Span<const RunnerThreadArgs> args,
+                     absl::Duration staggering_delay) {
+  // State of the worker of one element of `args`.
+  struct Worker {
+    std::mt19937_64 random;
+    // The worker starts its next runner no earlier than this.
+    absl::Time next_start;
+    // Whether `next_start` is a slot reserved with the launch scheduler.
+    bool launch_reserved = false;
+    bool stopped = false;
+    // The following are set while a runner is running.
+    std::optional<RunnerInvocation> invocation;
+    std::optional<RunnerDriver> driver;
+    std::unique_ptr<RunnerDriver::AsyncRun> run;
+    bool output_done = false;
+    bool exited = false;
+  };
+
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  CHECK_NE(epoll_fd, -1);
+  // Event data is the worker index shifted left by one. The low bit tells
+  // whether the event is for the pidfd or for stdout.
+  auto watch = [epoll_fd](int fd, uint64_t data) {
+    struct epoll_event event = {.events = EPOLLIN, .data = {.u64 = data}};
+    CHECK_EQ(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event), 0);
+  };
+  auto unwatch = [epoll_fd](int fd) {
+    CHECK_EQ(epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr), 0);
+  };
+
+  std::vector<Worker> workers(args.size());
+  absl::Time next_start = absl::Now();
+  for (size_t i = 0; i < args.size(); ++i) {
+    CheckRunnerThreadArgs(args[i]);
+    CHECK_EQ(args[i].persistent_batch_size, 0);
+    VLOG_INFO(0, "T", args[i].thread_idx, " started");
+    workers[i].random.seed(args[i].thread_idx);
+    workers[i].next_start = next_start;
+    next_start += staggering_delay;
+  }
+
+  // Starts the next runner of worker `i` or stops the worker.
+  size_t num_stopped = 0;
+  auto start_next = [&](size_t i) {
+    Worker &worker = workers[i];
+    while (true) {
+      absl::StatusOr<std::optional<RunnerInvocation>> next_invocation =
+          NextInvocation(ctx, args[i], worker.random);
+      if (!next_invocation.ok()) {
+        // Stay idle until the retry time like a staggered worker.
+        LOG_ERROR("T", args[i].thread_idx, " ",
+                  next_invocation.status().message(), ", retrying in ",
+                  absl::FormatDuration(kNoShardRetryDelay));
+        worker.next_start = absl::Now() + kNoShardRetryDelay;
+        worker.launch_reserved = false;
+        return;
+      }
+      worker.invocation = *std::move(next_invocation);
+      if (!worker.invocation.has_value()) {
+        // Like RunnerThread(), the first worker to stop stops all others.
+        ctx->Stop();
+        worker.stopped = true;
+        ++num_stopped;
+        VLOG_INFO(0, "T", args[i].thread_idx, " stopped");
+        return;
+      }
+      worker.driver = InvocationDriver(args[i], *worker.invocation);
+      absl::StatusOr<std::unique_ptr<RunnerDriver::AsyncRun>> run_or =
+          worker.driver->StartRun(worker.invocation->runner_options);
+      if (run_or.ok()) {
+        worker.run = *std::move(run_or);
+        MaybePrefetchNextShard(args[i], *worker.invocation);
+        break;
+      }
+      CompleteInvocation(ctx, args[i], *worker.invocation, run_or.status());
+    }
+    worker.launch_reserved = false;
+    worker.output_done = false;
+    watch(worker.run->stdout_fd(), i << 1);
+    // Without a pidfd the exit is noticed by EOF on stdout.
+    worker.exited = worker.run->pidfd() == -1;
+    if (!worker.exited) {
+      watch(worker.run->pidfd(), (i << 1) | 1);
+    }
+  };
+
+  constexpr int kMaxEvents = 64;
+  struct epoll_event events[kMaxEvents];
+  while (num_stopped < workers.size()) {
+    // Start the next runner of idle workers whose start time has come.
+    const absl::Time now = absl::Now();
+    absl::Duration timeout = absl::InfiniteDuration();
+    for (size_t i = 0; i < workers.size(); ++i) {
+      Worker &worker = workers[i];
+      if (worker.stopped || worker.run != nullptr) continue;
+      if (worker.next_start <= now && !worker.launch_reserved &&
+          args[i].launch_scheduler != nullptr && !ctx->ShouldStop()) {
+        worker.next_start = std::min(
+            args[i].launch_scheduler->ReserveLaunch(now), ctx->deadline());
+        worker.launch_reserved = true;
+      }
+      if (worker.next_start <= now || ctx->ShouldStop()) {
+        start_next(i);
+      } else {
+        // Wake up in short steps to notice a stop request.
+        timeout = std::min(
+            {timeout, worker.next_start - now, absl::Milliseconds(100)});
+      }
+    }
+    if (num_stopped == workers.size()) break;
+
+    const int timeout_ms =
+        timeout == absl::InfiniteDuration()
+            ? -1
+            : static_cast<int>(absl::ToInt64Milliseconds(timeout) + 1);
+    int num_events = epoll_wait(epoll_fd, events, kMaxEvents, timeout_ms);
+    if (num_events == -1) {
+      if (errno == EINTR) continue;
+      LOG_FATAL("epoll_wait: ", strerror(errno));
+    }
+    for (int e = 0; e < num_events; ++e) {
+      const size_t i = events[e].data.u64 >> 1;
+      Worker &worker = workers[i];
+      // Skip events of a runner that was finished earlier in this batch.
+      if (worker.run == nullptr) continue;
+      if (events[e].data.u64 & 1) {
+        unwatch(worker.run->pidfd());
+        worker.exited = true;
+      } else if (!worker.run->ReadOutput()) {
+        unwatch(worker.run->stdout_fd());
+        worker.output_done = true;
+      }
+      if (worker.output_done && worker.exited) {
+        // Publishing may block on a full result queue like in RunnerThread().
+        CompleteInvocation(ctx, args[i], *worker.invocation,
+                           worker.run->Finish());
+        worker.run.reset();
+        worker.driver.reset();
+        worker.invocation.reset();
+        worker.next_start = absl::Now();
+      }
+    }
+  }
+
+  close(epoll_fd);
+}
+
 }  // namespace silifuzz
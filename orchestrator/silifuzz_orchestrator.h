@@ -16,22 +16,199 @@
 #define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_SILIFUZZ_ORCHESTRATOR_H_
 
 #include <atomic>
+#include <cstdint>
 #include <functional>
-#include <random>
+#include <map>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
+#include "absl/functional/function_ref.h"
 #include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "./orchestrator/corpus_util.h"
+#include "./orchestrator/launch_scheduler.h"
+#include "./orchestrator/metrics_page.h"
+#include "./orchestrator/mpsc_ring_buffer.h"
+#include "./orchestrator/runner_budget.h"
+#include "./orchestrator/shard_admission.h"
+#include "./orchestrator/throughput_telemetry.h"
 #include "./runner/driver/runner_driver.h"
 #include "./runner/driver/runner_options.h"
 
 namespace silifuzz {
 
+// Hands out shard indices to all RunnerThread workers.
+//
+// In random mode the sequence of indices is split into epochs of `size`
+// elements and each epoch is a pseudo-random permutation of all shards, so
+// that every shard is visited equally often no matter how many threads pull
+// from the scheduler or how long each run takes.
+//
+// In sequential mode every shard is handed out exactly once, in order. Workers
+// pull the next shard as soon as they are done with the previous one, so
+// shards are balanced across any number of threads.
+//
+// This class is thread-safe and lock-free.
+class ShardScheduler {
+ public:
+  ShardScheduler(int size, bool sequential_mode, uint64_t seed);
+
+  // Not copyable or moveable -- shared between threads.
+  ShardScheduler(const ShardScheduler &) = delete;
+  ShardScheduler(ShardScheduler &&) = delete;
+  ShardScheduler &operator=(const ShardScheduler &) = delete;
+  ShardScheduler &operator=(ShardScheduler &&) = delete;
+
+  // Returns the index of the next shard to run or kEndOfStream to stop.
+  int Next();
+
+  // Returns what Next() would return if called now, without consuming it.
+  // Another thread may take that shard first, so this is only a hint.
+  int Peek() const;
+
+  static constexpr int kEndOfStream = -1;
+
+ private:
+  // Returns the shard handed out for `ticket`.
+  int ShardAt(uint64_t ticket) const;
+
+  const uint64_t size_;
+  const bool sequential_mode_;
+  const uint64_t seed_;
+
+  // Number of indices handed out so far.
+  std::atomic<uint64_t> next_ticket_;
+};
+
+// Hands out shard indices to workers pinned to CPUs so that every shard
+// runs on every CPU within a bounded time.
+//
+// Each worker has a slot. A slot runs the shards in epochs of `num_shards`
+// runs, and each epoch visits every shard exactly once. So every shard visits
+// the CPU of a slot within any `2 * num_shards - 1` consecutive runs of the
+// slot. All slots use the same pseudo-random shard order per epoch, rotated by
+// an offset per slot. Slots that are at the same run count therefore run
+// different shards when there are at most `num_shards` slots.
+//
+// This class is thread-safe and lock-free. Each slot must be used by one
+// thread at a time.
+class CoreRotationScheduler {
+ public:
+  CoreRotationScheduler(int num_shards, int num_slots, uint64_t seed);
+
+  // Not copyable or moveable -- shared between threads.
+  CoreRotationScheduler(const CoreRotationScheduler &) = delete;
+  CoreRotationScheduler(CoreRotationScheduler &&) = delete;
+  CoreRotationScheduler &operator=(const CoreRotationScheduler &) = delete;
+  CoreRotationScheduler &operator=(CoreRotationScheduler &&) = delete;
+
+  // Returns the index of the next shard to run in `slot`.
+  // REQUIRES: 0 <= slot < num_slots.
+  int Next(int slot);
+
+  // Returns what Next(slot) would return if called now, without consuming it.
+  // REQUIRES: 0 <= slot < num_slots.
+  int Peek(int slot) const;
+
+  // Number of shards handed out to `slot` so far.
+  uint64_t num_runs(int slot) const;
+
+  // Number of distinct shards handed out to `slot` so far.
+  uint64_t num_shards_visited(int slot) const;
+
+  int num_slots() const { return num_slots_; }
+
+ private:
+  // Returns the shard handed out for the `run`-th run of `slot`.
+  int ShardAt(int slot, uint64_t run) const;
+
+  const uint64_t num_shards_;
+  const int num_slots_;
+  const uint64_t seed_;
+
+  // Number of indices handed out so far, per slot.
+  std::unique_ptr<std::atomic<uint64_t>[]> num_runs_;
+};
+
+// Hands out the snap ranges of all shards to RunnerThread workers in
+// sequential mode and publishes their results in a deterministic order.
+//
+// Every shard is split into `num_ranges_per_shard` ranges of snaps, see
+// RunnerOptions::set_snap_range(). Ranges are handed out in order of shard and
+// range index to any number of workers, so one shard is played by several
+// runners in parallel. Complete() holds back the result of a range until the
+// results of all earlier ranges have been published, so results come out in
+// the same order no matter how many workers there are or which one finishes
+// first.
+//
+// This class is thread-safe.
+class SequentialWorkQueue {
+ public:
+  struct SnapRange {
+    int shard;
+    int index;
+  };
+
+  // REQUIRES: num_shards > 0 and num_ranges_per_shard > 0.
+  SequentialWorkQueue(int num_shards, int num_ranges_per_shard);
+
+  // Not copyable or moveable -- shared between threads.
+  SequentialWorkQueue(const SequentialWorkQueue &) = delete;
+  SequentialWorkQueue(SequentialWorkQueue &&) = delete;
+  SequentialWorkQueue &operator=(const SequentialWorkQueue &) = delete;
+  SequentialWorkQueue &operator=(SequentialWorkQueue &&) = delete;
+
+  // Returns the next range to run or std::nullopt when all ranges have been
+  // handed out.
+  std::optional<SnapRange> Next();
+
+  // Records `result` of `range`, which was returned by Next(). `completed`
+  // tells whether all snaps of the range ran. Then calls `publish` with the
+  // results that are next in order, if any, in order. Every range returned by
+  // Next() must be completed exactly once, or the results of later ranges are
+  // never published.
+  //
+  // `publish` is called with an internal lock held to keep the order across
+  // threads. It may block, which holds back other workers in Complete().
+  void Complete(
+      const SnapRange &range, bool completed,
+      absl::StatusOr<RunnerDriver::RunResult> result,
+      absl::FunctionRef<void(absl::StatusOr<RunnerDriver::RunResult> &&)>
+          publish);
+
+  int num_ranges_per_shard() const { return num_ranges_per_shard_; }
+
+  // Completion bitmap of `shard`: element i tells whether all snaps of range
+  // i of the shard ran.
+  std::vector<bool> CompletedRanges(int shard) const;
+
+ private:
+  const int num_shards_;
+  const int num_ranges_per_shard_;
+
+  // Number of ranges handed out so far. Range r is index r %
+  // num_ranges_per_shard_ of shard r / num_ranges_per_shard_.
+  std::atomic<uint64_t> next_range_;
+
+  mutable absl::Mutex mu_;
+
+  // Indexed like next_range_.
+  std::vector<bool> completed_ ABSL_GUARDED_BY(mu_);
+
+  // Results held back by Complete() until all earlier results are published.
+  std::map<uint64_t, absl::StatusOr<RunnerDriver::RunResult>> pending_
+      ABSL_GUARDED_BY(mu_);
+
+  // The range whose result is published next.
+  uint64_t next_to_publish_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
 // Arguments for RunnerThread.
 struct RunnerThreadArgs {
   // Opaque thread identifier. Must be unique.
@@ -43,6 +220,51 @@ struct RunnerThreadArgs {
   // All available corpora.
   const InMemoryCorpora *corpora = nullptr;
 
+  // Picks shards of `corpora`. Shared between all threads.
+  ShardScheduler *scheduler = nullptr;
+
+  // If not null, snap ranges of the shards of `corpora` are picked from here
+  // instead of `scheduler` and their results are published through it.
+  SequentialWorkQueue *sequential_queue = nullptr;
+
+  // If not null, shards of `corpora` are picked from slot `rotation_slot` of
+  // this instead of `scheduler`.
+  CoreRotationScheduler *core_rotation = nullptr;
+  int rotation_slot = 0;
+
+  // If not null, corpora are picked from here instead of `corpora` and
+  // `scheduler` is not used.
+  // Only supported when not in sequential mode.
+  const DynamicCorpora *dynamic_corpora = nullptr;
+
+  // If not null, every runner invocation is recorded here.
+  ThroughputTelemetry *telemetry = nullptr;
+
+  // If not null, the counters of this thread in the shared metrics page.
+  // Owned by the caller and updated only by this thread.
+  WorkerMetrics *metrics = nullptr;
+
+  // If not null, overrides the CPU time budget in `runner_options` per shard
+  // and is fed the startup timings reported by the runner.
+  RunnerBudgetController *budget_controller = nullptr;
+
+  // If not null, every runner launch waits for a slot reserved here and the
+  // CPU time budget is jittered by it. Shared between all threads.
+  RunnerLaunchScheduler *launch_scheduler = nullptr;
+
+  // If true, the shard likely to run next is prefetched with PrefetchShard()
+  // when a runner starts, so that it is resident by the time the next runner
+  // maps it. Only shards picked by `scheduler` or `core_rotation` are known
+  // in advance.
+  bool prefetch_next_shard = false;
+
+  // If not zero, RunnerThread() keeps its runner alive in persistent mode and
+  // each invocation runs this many snaps in it. The runner is restarted when
+  // the worker picks a different shard or the runner exits, e.g. because its
+  // CPU time budget, which covers the whole session, is used up. Not
+  // supported in sequential mode or by RunnerEventLoop().
+  size_t persistent_batch_size = 0;
+
   // Additional parameters passed to each runner binary.
   RunnerOptions runner_options = RunnerOptions::Default();
 };
@@ -67,16 +289,19 @@ class ExecutionContext {
   // num_threads is a hint used to size internal data structures.
   // The `result_cb` callback will be invoked by EventLoop() for each RunResult
   // produced by any of the worker threads.
+  // OfferRunResult() waits at most `max_offer_wait` for room in the result
+  // queue.
   ExecutionContext(absl::Time deadline, int num_threads,
-                   const ResultCallback &result_cb)
+                   const ResultCallback &result_cb,
+                   absl::Duration max_offer_wait = absl::Seconds(10))
       : deadline_(deadline),
         num_threads_(num_threads),
         result_cb_(result_cb),
+        max_offer_wait_(max_offer_wait),
         mu_(),
         stop_execution_(false),
-        invocation_results_() {
-    invocation_results_.reserve(num_threads);
-  }
+        consumer_waiting_(false),
+        invocation_results_(2 * num_threads) {}
 
   // Not copyable or moveable -- not just a data holder.
   ExecutionContext(const ExecutionContext &) = delete;
@@ -88,8 +313,23 @@ class ExecutionContext {
 
   // Attempts to post RunResult on the result queue. Returns true if the element
   // was added, false otherwise.
+  // When the queue is full the caller is blocked until the event loop makes
+  // room, the execution stops or `max_offer_wait` passes.
   bool OfferRunResult(absl::StatusOr<RunnerDriver::RunResult> &&result);
 
+  // Result queue backpressure metrics.
+  struct ResultQueueStats {
+    // Number of OfferRunResult() calls that found the queue full.
+    uint64_t num_waits = 0;
+
+    // Number of results that could not be queued.
+    uint64_t num_dropped = 0;
+
+    // Largest number of results observed in the queue.
+    uint64_t max_depth = 0;
+  };
+  ResultQueueStats result_queue_stats() const;
+
   // Returns true if the execution should stop.
   bool ShouldStop() const { return stop_execution_ || absl::Now() > deadline_; }
 
@@ -112,8 +352,15 @@ class ExecutionContext {
   void ProcessResultQueueImpl(
       const std::vector<RunnerDriver::RunResult> &results);
 
+  // Pops all queued results and processes them.
+  void DrainResultQueue();
+
+  // Wakes up EventLoop() if it is waiting for results.
+  void WakeUpEventLoop();
+
   // EventLoop() helper. Returns true iif the EventLoop() should wake up.
-  bool ShouldWakeUp() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+  // May be evaluated by any thread releasing `mu_`.
+  bool ShouldWakeUp() const {
     return !invocation_results_.empty() || ShouldStop();
   }
 
@@ -121,40 +368,42 @@ class ExecutionContext {
   const absl::Time deadline_;
   const int num_threads_;
   ResultCallback result_cb_;
+  const absl::Duration max_offer_wait_;
 
-  // Mutex guarding all mutable state of this class.
+  // EventLoop() waits on this mutex for ShouldWakeUp(). It guards no data,
+  // producers only cycle it to make EventLoop() re-evaluate the condition.
   mutable absl::Mutex mu_;
 
   // Global atomic flag to indicate that the orchestrator should stop.
   std::atomic<bool> stop_execution_;
 
-  // A queue of execution results.
-  std::vector<RunnerDriver::RunResult> invocation_results_ ABSL_GUARDED_BY(mu_);
-};
-
-// Helper class to generate the next corpus file name.
-class NextCorpusGenerator {
- public:
-  NextCorpusGenerator(int size, bool sequential_mode, int seed);
-  NextCorpusGenerator(const NextCorpusGenerator &) = default;
-  NextCorpusGenerator(NextCorpusGenerator &&) = default;
-  NextCorpusGenerator &operator=(const NextCorpusGenerator &) = default;
-  NextCorpusGenerator &operator=(NextCorpusGenerator &&) = default;
-  // Returns the next index corpus file name or "" to stop.
-  int operator()();
+  // True while EventLoop() may be blocked on `mu_`. Producers skip locking
+  // `mu_` when it is false.
+  std::atomic<bool> consumer_waiting_;
 
-  static constexpr int kEndOfStream = -1;
+  // A queue of execution results.
+  MpscRingBuffer<RunnerDriver::RunResult> invocation_results_;
 
- private:
-  int size_;
-  bool sequential_mode_;
-  std::mt19937_64 random_;
-  int next_index_;
+  // See ResultQueueStats.
+  std::atomic<uint64_t> num_waits_ = 0;
+  std::atomic<uint64_t> num_dropped_ = 0;
+  std::atomic<uint64_t> max_depth_ = 0;
 };
 
 // Worker thread main function.
 void RunnerThread(ExecutionContext *ctx, const RunnerThreadArgs &args);
 
+// Runs the workers described by `args` on the calling thread. Each worker
+// behaves like a RunnerThread() with the same args, but instead of a thread
+// blocked on each runner, the runners of all workers are waited for with
+// epoll(7) on their stdout and pidfds. So the cost of managing runners does
+// not grow with the number of threads. Worker i starts its first runner
+// `i * staggering_delay` after the call.
+// Returns after all workers have stopped.
+void RunnerEventLoop(ExecutionContext *ctx,
+                     absl::Span<const RunnerThreadArgs> args,
+                     absl::Duration staggering_delay = absl::ZeroDuration());
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_SILIFUZZ_ORCHESTRATOR_H_
@@ -39,10 +39,13 @@
 // Assumption: Runner closes stdin.
 
 #include <errno.h>
+#include <linux/perf_event.h>
 #include <sched.h>
 #include <stdint.h>
+#include <sys/resource.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <csignal>
 #include <cstddef>
 #include <cstdlib>
@@ -50,11 +53,16 @@
 #include <fstream>
 #include <iostream>
 #include <limits>
+#include <list>
+#include <memory>
 #include <string>
+#include <system_error>
 #include <thread>  // NOLINT
 #include <utility>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/functional/bind_front.h"
@@ -69,12 +77,21 @@
 #include "absl/strings/string_view.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "google/protobuf/text_format.h"
 #include "./orchestrator/corpus_util.h"
+#include "./orchestrator/cpu_topology.h"
+#include "./orchestrator/launch_scheduler.h"
+#include "./orchestrator/metrics_page.h"
 #include "./orchestrator/orchestrator_util.h"
 #include "./orchestrator/result_collector.h"
+#include "./orchestrator/runner_cgroups.h"
+#include "./orchestrator/runner_budget.h"
+#include "./orchestrator/shard_admission.h"
 #include "./orchestrator/silifuzz_orchestrator.h"
+#include "./orchestrator/throughput_telemetry.h"
 #include "./proto/corpus_metadata.pb.h"
+#include "./proxies/pmu_event_proxy/pmu_events.h"
 #include "./runner/driver/runner_options.h"
 #include "./util/checks.h"
 #include "./util/itoa.h"
@@ -86,8 +103,29 @@ ABSL_FLAG(size_t, max_cpus, 0,
           "Number of concurrent jobs. When 0 (default) use all available CPUs");
 ABSL_FLAG(absl::Duration, per_runner_cpu_time_budget, absl::Seconds(10),
           "Per-runner cpu time budget");
+ABSL_FLAG(bool, adaptive_runner_budget, false,
+          "If true, raise the per-runner cpu time budget of shards with a "
+          "large runner startup cost so that startup stays below "
+          "--runner_startup_overhead_target of the budget. "
+          "--per_runner_cpu_time_budget is the minimum budget. Ignored in "
+          "--sequential_mode.");
+ABSL_FLAG(double, runner_startup_overhead_target, 0.05,
+          "Target fraction of the runner cpu time budget spent in runner "
+          "startup with --adaptive_runner_budget.");
+ABSL_FLAG(absl::Duration, max_per_runner_cpu_time_budget, absl::Seconds(60),
+          "Maximum per-runner cpu time budget with --adaptive_runner_budget.");
 ABSL_FLAG(absl::Duration, worker_thread_delay, absl::ZeroDuration(),
           "Delay between starting consecutive worker threads.");
+ABSL_FLAG(int, max_runner_startups, 0,
+          "If not 0, at most this many runners start within any "
+          "--runner_startup_window, so that runners whose budgets expire "
+          "together do not all exec and map their corpus at once.");
+ABSL_FLAG(absl::Duration, runner_startup_window, absl::Seconds(1),
+          "Expected duration of a runner startup for --max_runner_startups.");
+ABSL_FLAG(double, runner_budget_jitter, 0,
+          "Scale each per-runner cpu time budget by a random factor in "
+          "[1 - jitter, 1 + jitter] so that runners started together drift "
+          "apart. Must be in [0, 1).");
 ABSL_FLAG(std::string, runner, "",
           "A reading runner binary. The orchestrator executes this with one of "
           "the corpora randomly.  This must not be empty.");
@@ -99,11 +137,39 @@ ABSL_FLAG(
     "If non-negative, a writable file descriptor for streaming out a binary "
     "log. The file descriptor should be valid when the orchestrator starts.");
 ABSL_FLAG(bool, sequential_mode, false,
-          "If true, enumerate snapshots one by one in single-threaded mode and "
-          "exit. Ignores --max_cpus.");
+          "If true, enumerate snapshots one by one and exit. Ignores "
+          "--max_cpus, see --sequential_mode_threads.");
+ABSL_FLAG(size_t, sequential_mode_threads, 0,
+          "Number of concurrent jobs in --sequential_mode, 0 for one per "
+          "available CPU. Snap ranges of the shards are distributed across "
+          "the jobs, each range is run exactly once and results are reported "
+          "in shard and range order.");
+ABSL_FLAG(size_t, sequential_ranges_per_shard, 0,
+          "Number of snap ranges each shard is split into in "
+          "--sequential_mode, 0 for the number of jobs.");
 ABSL_FLAG(std::string, corpus_metadata_file, "",
           "A file containing description of the corpus formatted as "
           "silifuzz.proto.CorpusMetadata text proto");
+ABSL_FLAG(bool, async_binary_log, false,
+          "If true, write --binary_log_fd from a dedicated thread in batches. "
+          "Entries are dropped rather than stalling the orchestrator when the "
+          "reader falls behind.");
+ABSL_FLAG(absl::Duration, result_aggregation_interval, absl::ZeroDuration(),
+          "If non-zero, log only the first occurrence of a repeated failure "
+          "(same snapshot, CPU, outcome and end state) in full and log the "
+          "number of repeats at most once per this interval.");
+ABSL_FLAG(absl::Duration, telemetry_interval, absl::ZeroDuration(),
+          "If non-zero, log per-shard and per-CPU runner throughput and "
+          "startup latency to --binary_log_fd about once per this interval.");
+ABSL_FLAG(std::string, metrics_page, "",
+          "If set, create a file at this path, e.g. in /dev/shm, with "
+          "per-worker counters that local monitoring agents can map and "
+          "poll.");
+ABSL_FLAG(std::string, runner_cgroup, "",
+          "If set, run the runners of each worker in a child of the cgroup v2 "
+          "at this path, creating it if needed, and read runner memory and "
+          "CPU usage from the cgroups instead of walking /proc. The parent "
+          "cgroup must have the memory controller enabled.");
 ABSL_FLAG(double, log_session_summary_probability, 0,
           "A probability (between 0 and 1) indicating a chance of this "
           "execution to log full summary at the end (only when "
@@ -126,6 +192,77 @@ ABSL_FLAG(bool, report_runaways_as_errors, false,
           "Whether runaway snapshot should be reported as errors");
 ABSL_FLAG(int, fail_after_n_errors, std::numeric_limits<int>::max(),
           "Fail soon after detecting this many errors.");
+ABSL_FLAG(uint64_t, runner_max_failures, 1,
+          "Number of failed snapshots after which a runner stops. With a "
+          "value greater than 1 a runner goes on after a failure and each "
+          "failure is reported as a result of its own. Ignored in "
+          "sequential mode.");
+ABSL_FLAG(bool, huge_page_corpus, false,
+          "If true, back in-memory corpus files with transparent huge pages "
+          "where the kernel allows it to reduce TLB misses in runners.");
+ABSL_FLAG(bool, share_relocated_corpus, false,
+          "If true, relocate in-memory corpus files once so that runners can "
+          "map them shared instead of each relocating a private copy.");
+ABSL_FLAG(std::string, shard_cache_dir, "",
+          "If not empty, a host-local directory where uncompressed shards are "
+          "kept across sessions, keyed by their corpus checksum. Compressed "
+          "shards found there are not decompressed again.");
+ABSL_FLAG(bool, dynamic_shard_admission, false,
+          "If true, periodically sample the memory usage of the runners and "
+          "/proc/meminfo and load or unload shards so that the orchestrator "
+          "stays within --limit_memory_usage_mb while using as many shards as "
+          "fit. Requires --limit_memory_usage_mb and is incompatible with "
+          "--sequential_mode.");
+ABSL_FLAG(std::string, smt_policy, "all",
+          "How workers are placed on SMT siblings when --max_cpus is 0. "
+          "`all` runs a worker on every available logical CPU so siblings "
+          "compete for shared core resources. `one_per_core` runs one worker "
+          "on each physical core.");
+ABSL_FLAG(bool, numa_local_corpus, false,
+          "If true and the workers span several NUMA nodes, load a copy of the "
+          "corpora on each node and let workers use the local copy. Multiplies "
+          "corpus memory usage by the number of nodes. Only effective when "
+          "--max_cpus is 0 and --dynamic_shard_admission is not set.");
+ABSL_FLAG(bool, rotate_shards_across_cpus, false,
+          "If true, each worker runs every shard once per epoch of "
+          "num_shards runs so that every shard runs on every CPU within a "
+          "bounded time, instead of all workers drawing from one random "
+          "sequence. Only effective when --max_cpus is 0, "
+          "--dynamic_shard_admission is not set and not in sequential mode.");
+ABSL_FLAG(bool, prefetch_next_shard, false,
+          "If true, each worker asks the kernel to bring the shard it will "
+          "likely run next into memory while its current runner runs. Helps "
+          "when shards get swapped out. Not effective in sequential mode or "
+          "with --dynamic_shard_admission.");
+ABSL_FLAG(absl::Duration, shard_admission_interval, absl::Seconds(30),
+          "Time between two shard admission decisions when "
+          "--dynamic_shard_admission is set.");
+ABSL_FLAG(absl::Duration, corpus_reload_interval, absl::ZeroDuration(),
+          "If not zero, check --shard_list_file for changes this often and "
+          "switch to the new list of shards without restarting the session. "
+          "New shards are loaded in the background and shards that are no "
+          "longer listed are retired once no runner uses them. Replace the "
+          "file atomically, e.g. by rename(2), so that a partially written "
+          "list is never read. Incompatible with --sequential_mode.");
+ABSL_FLAG(bool, event_loop, false,
+          "If true, a single thread manages all runners and waits for them "
+          "with epoll(7) instead of one thread per worker blocking on its "
+          "runner. Reduces the orchestrator overhead on hosts with many "
+          "CPUs. Requires Linux 5.3+ for pidfd_open(2) to notice runner "
+          "exits right away.");
+ABSL_FLAG(size_t, persistent_runner_batch_size, 0,
+          "If not zero, each worker keeps its runner alive in persistent "
+          "mode and runs batches of this many snaps in it, restarting it "
+          "only when switching shards or when the runner exits, e.g. at the "
+          "end of its CPU time budget. Saves the runner startup and corpus "
+          "mapping costs. Incompatible with --sequential_mode and "
+          "--event_loop.");
+ABSL_FLAG(std::vector<std::string>, perf_events, {},
+          "Comma-separated libpfm4 names of PMU events that the runners "
+          "count in user space while playing snapshots. The counts are "
+          "logged per shard and per CPU in the throughput telemetry, so "
+          "--telemetry_interval and --binary_log_fd must be set. At most 8 "
+          "events, which should fit in the general purpose counters.");
 
 namespace silifuzz {
 
@@ -152,6 +289,39 @@ std::vector<int> AvailableCpus() {
   return available_cpus;
 }
 
+// Returns the CPUs to pin workers to: all available CPUs filtered by
+// `smt_policy`.
+std::vector<CpuLocation> WorkerCpus(SmtPolicy smt_policy) {
+  std::vector<CpuLocation> cpus =
+      SelectCpus(ReadCpuTopology(AvailableCpus()), smt_policy);
+  CHECK(!cpus.empty());
+  return cpus;
+}
+
+// Loads `corpora` from a thread restricted to `cpus`. The kernel allocates
+// memfd pages on the NUMA node of the CPU that first touches them, so the
+// corpora end up local to the node of `cpus`.
+absl::StatusOr<InMemoryCorpora> LoadCorporaOnCpus(
+    const std::vector<std::string> &corpora, const std::vector<int> &cpus,
+    bool huge_pages, bool prerelocate, const std::string &shard_cache_dir) {
+  absl::StatusOr<InMemoryCorpora> result;
+  std::thread loader([&]() {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : cpus) {
+      CPU_SET(cpu, &cpu_set);
+    }
+    // Threads spawned by LoadCorpora() inherit this affinity.
+    if (sched_setaffinity(0 /* this thread */, sizeof(cpu_set), &cpu_set) !=
+        0) {
+      LOG_ERROR("Cannot set loader CPU affinity: ", ErrnoStr(errno));
+    }
+    result = LoadCorpora(corpora, huge_pages, prerelocate, shard_cache_dir);
+  });
+  loader.join();
+  return result;
+}
+
 // Initializes the orchestrator environment.
 ExecutionContext *OrchestratorInit(
     absl::Time deadline, int num_threads,
@@ -199,7 +369,98 @@ absl::Status LogSessionSummary(ResultCollector &result_collector) {
   return result_collector.LogSessionSummary(metadata, version);
 }
 
+// Workers are placed on CPUs according to `smt_policy`.
+// Encodes the libpfm4 event names in `perf_events` for the runner. The
+// runner only takes the event type and config, so events that need more are
+// rejected.
+absl::StatusOr<std::vector<RunnerOptions::PerfCounter>> EncodePerfCounters(
+    const std::vector<std::string> &perf_events) {
+  // See kMaxPerfCounters in runner/perf_counters.h.
+  constexpr size_t kMaxPerfEvents = 8;
+  if (perf_events.size() > kMaxPerfEvents) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Too many --perf_events, at most ", kMaxPerfEvents));
+  }
+  std::vector<RunnerOptions::PerfCounter> perf_counters;
+  for (const std::string &event : perf_events) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(perf_event_attr attr, EncodePMUEvent(event));
+    if (attr.config1 != 0 || attr.config2 != 0) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unsupported extended PMU event ", event));
+    }
+    perf_counters.push_back({.type = attr.type, .config = attr.config});
+  }
+  return perf_counters;
+}
+
+std::vector<std::string> LoadShardFilenames(
+    const std::filesystem::path &shard_list_file) {
+  std::ifstream ifs;
+  ifs.open(shard_list_file);
+  VLOG_INFO(0, "Loading shards from ", shard_list_file.c_str());
+  if (!ifs.good()) {
+    LOG_ERROR("Error opening ", shard_list_file.c_str());
+    return {};
+  }
+  std::vector<std::string> shards;
+  std::string line;
+  while (std::getline(ifs, line)) {
+    absl::StripAsciiWhitespace(&line);
+    if (!line.empty() && line[0] != '#') {
+      shards.emplace_back(std::move(line));
+    }
+  }
+  if (ifs.bad()) {
+    LOG_ERROR("Error reading ", shard_list_file.c_str());
+    return {};
+  }
+  ifs.close();
+  return shards;
+}
+
+// Polls the modification time of --shard_list_file every `interval` and
+// makes `corpora` serve the listed shards whenever it changes, until `ctx`
+// stops. See ReloadShards() for `load_all`.
+void WatchShardListFile(ExecutionContext *ctx, DynamicCorpora &corpora,
+                        bool load_all, absl::Duration interval) {
+  const std::filesystem::path shard_list_file =
+      absl::GetFlag(FLAGS_shard_list_file);
+  std::error_code ec;
+  std::filesystem::file_time_type last_write_time =
+      std::filesystem::last_write_time(shard_list_file, ec);
+  auto should_stop = [ctx]() { return ctx->ShouldStop(); };
+  while (!should_stop()) {
+    const absl::Time next_check = absl::Now() + interval;
+    for (absl::Time now = absl::Now(); now < next_check; now = absl::Now()) {
+      if (should_stop()) {
+        return;
+      }
+      absl::SleepFor(std::min(absl::Seconds(1), next_check - now));
+    }
+    std::filesystem::file_time_type write_time =
+        std::filesystem::last_write_time(shard_list_file, ec);
+    if (ec || write_time == last_write_time) {
+      continue;
+    }
+    last_write_time = write_time;
+    std::vector<std::string> shards = LoadShardFilenames(shard_list_file);
+    if (shards.empty()) {
+      LOG_ERROR("Ignoring empty shard list ", shard_list_file.c_str());
+      continue;
+    }
+    LOG_INFO("Reloading ", shards.size(), " shards from ",
+             shard_list_file.c_str());
+    ReloadShards(corpora, shards, load_all, should_stop);
+  }
+}
+
+// When `memory_limit_bytes` is not 0 the first `corpora.size()` shards of
+// `all_corpora` are loaded initially and a shard admission controller adjusts
+// the set of loaded shards to the budget during the session. Otherwise only
+// `corpora` are loaded, and only once unless --corpus_reload_interval is set.
 int OrchestratorMain(const std::vector<std::string> &corpora,
+                     const std::vector<std::string> &all_corpora,
+                     uint64_t memory_limit_bytes, SmtPolicy smt_policy,
                      const std::string &runner,
                      const std::vector<std::string> &runner_extra_argv) {
   LOG_INFO("SiliFuzz Orchestrator started");
@@ -207,42 +468,216 @@ int OrchestratorMain(const std::vector<std::string> &corpora,
   const absl::Time start_time = absl::Now();
   absl::Time deadline = start_time + absl::GetFlag(FLAGS_duration);
 
+  size_t num_threads = absl::GetFlag(FLAGS_max_cpus);
+  const absl::Duration runner_cpu_time_budget =
+      absl::GetFlag(FLAGS_per_runner_cpu_time_budget);
+  bool sequential_mode = absl::GetFlag(FLAGS_sequential_mode);
+  size_t num_ranges_per_shard = 1;
+  if (sequential_mode) {
+    num_threads = absl::GetFlag(FLAGS_sequential_mode_threads);
+    if (num_threads == 0) {
+      num_threads = std::max<size_t>(1, AvailableCpus().size());
+    }
+    num_ranges_per_shard = absl::GetFlag(FLAGS_sequential_ranges_per_shard);
+    if (num_ranges_per_shard == 0) {
+      num_ranges_per_shard = num_threads;
+    }
+    LOG_INFO("Running in sequential mode with ", num_threads, " threads and ",
+             num_ranges_per_shard, " snap ranges per shard");
+  }
+  // When --max_cpus is 0 every worker is pinned to one of these CPUs.
+  std::vector<CpuLocation> worker_cpus;
+  if (num_threads == 0) {
+    worker_cpus = WorkerCpus(smt_policy);
+  }
+
   // Load corpora and exit if there is any error.
   // File descriptors of the uncompressed corpora are kept open
   // until this struct goes out of scope.
-  const absl::StatusOr<InMemoryCorpora> in_memory_corpora =
-      LoadCorpora(corpora);
-  if (!in_memory_corpora.ok()) {
-    LOG_ERROR("Cannot load corpora: ", in_memory_corpora.status().message());
-    return EXIT_FAILURE;
+  absl::StatusOr<InMemoryCorpora> in_memory_corpora = InMemoryCorpora{};
+  std::unique_ptr<DynamicCorpora> dynamic_corpora;
+  // With --numa_local_corpus, one copy of the corpora per NUMA node of
+  // `worker_cpus`. Workers use the copy of their node.
+  std::list<InMemoryCorpora> numa_replicas;
+  absl::flat_hash_map<int, const InMemoryCorpora *> corpora_by_node;
+  std::vector<int> numa_nodes = NumaNodes(worker_cpus);
+  const bool dynamic_shard_admission = memory_limit_bytes != 0;
+  const absl::Duration corpus_reload_interval =
+      absl::GetFlag(FLAGS_corpus_reload_interval);
+  const bool hot_reload = corpus_reload_interval > absl::ZeroDuration();
+  // Hot reload swaps shards under running workers, which DynamicCorpora
+  // supports. Without admission control all listed shards stay loaded.
+  const bool use_dynamic_corpora = dynamic_shard_admission || hot_reload;
+  const bool huge_pages = absl::GetFlag(FLAGS_huge_page_corpus);
+  const bool prerelocate = absl::GetFlag(FLAGS_share_relocated_corpus);
+  const std::string shard_cache_dir = absl::GetFlag(FLAGS_shard_cache_dir);
+  if (use_dynamic_corpora) {
+    dynamic_corpora = std::make_unique<DynamicCorpora>(
+        dynamic_shard_admission ? all_corpora : corpora,
+        DynamicCorpora::Options{.huge_pages = huge_pages,
+                                .prerelocate = prerelocate,
+                                .shard_cache_dir = shard_cache_dir});
+    absl::Status load_status =
+        dynamic_corpora->LoadInitialShards(corpora.size());
+    if (!load_status.ok()) {
+      LOG_ERROR("Cannot load corpora: ", load_status.message());
+      return EXIT_FAILURE;
+    }
+  } else if (absl::GetFlag(FLAGS_numa_local_corpus) && numa_nodes.size() > 1) {
+    for (int node : numa_nodes) {
+      std::vector<int> node_cpus;
+      for (const CpuLocation &location : worker_cpus) {
+        if (location.numa_node == node) {
+          node_cpus.push_back(location.cpu);
+        }
+      }
+      absl::StatusOr<InMemoryCorpora> replica =
+          LoadCorporaOnCpus(corpora, node_cpus, huge_pages, prerelocate,
+                            shard_cache_dir);
+      if (!replica.ok()) {
+        LOG_ERROR("Cannot load corpora on NUMA node ", node, ": ",
+                  replica.status().message());
+        return EXIT_FAILURE;
+      }
+      absl::Status validation_status = ValidateCorpus(*replica);
+      if (!validation_status.ok()) {
+        LOG_ERROR(validation_status.message());
+        return EXIT_FAILURE;
+      }
+      VLOG_INFO(0, "Loaded corpora on NUMA node ", node);
+      corpora_by_node[node] = &numa_replicas.emplace_back(std::move(*replica));
+    }
+  } else {
+    in_memory_corpora =
+        LoadCorpora(corpora, huge_pages, prerelocate, shard_cache_dir);
+    if (!in_memory_corpora.ok()) {
+      LOG_ERROR("Cannot load corpora: ",
+                in_memory_corpora.status().message());
+      return EXIT_FAILURE;
+    }
+
+    absl::Status validation_status = ValidateCorpus(*in_memory_corpora);
+    if (!validation_status.ok()) {
+      LOG_ERROR(validation_status.message());
+      return EXIT_FAILURE;
+    }
   }
 
-  absl::Status validation_status = ValidateCorpus(*in_memory_corpora);
-  if (!validation_status.ok()) {
-    LOG_ERROR(validation_status.message());
+  // One scheduler shared by all threads so that shards are balanced across
+  // them. All NUMA replicas list the shards in the same order.
+  std::unique_ptr<ShardScheduler> scheduler;
+  std::unique_ptr<SequentialWorkQueue> sequential_queue;
+  if (sequential_mode && !use_dynamic_corpora) {
+    sequential_queue = std::make_unique<SequentialWorkQueue>(
+        corpora.size(), num_ranges_per_shard);
+  } else if (!use_dynamic_corpora) {
+    absl::BitGen seed_gen;
+    scheduler = std::make_unique<ShardScheduler>(
+        corpora.size(), false, absl::Uniform<uint64_t>(seed_gen));
+  }
+  // Shards rotate across the pinned worker CPUs in order of `worker_cpus`.
+  std::unique_ptr<CoreRotationScheduler> core_rotation;
+  if (absl::GetFlag(FLAGS_rotate_shards_across_cpus) && !worker_cpus.empty() &&
+      !use_dynamic_corpora && !sequential_mode) {
+    absl::BitGen seed_gen;
+    core_rotation = std::make_unique<CoreRotationScheduler>(
+        corpora.size(), worker_cpus.size(), absl::Uniform<uint64_t>(seed_gen));
+  }
+  std::unique_ptr<ThroughputTelemetry> telemetry;
+  const absl::Duration telemetry_interval =
+      absl::GetFlag(FLAGS_telemetry_interval);
+  const std::vector<std::string> perf_events = absl::GetFlag(FLAGS_perf_events);
+  if (telemetry_interval > absl::ZeroDuration() &&
+      absl::GetFlag(FLAGS_binary_log_fd) >= 0) {
+    telemetry = std::make_unique<ThroughputTelemetry>(start_time, perf_events);
+  } else if (!perf_events.empty()) {
+    LOG_ERROR(
+        "--perf_events requires --telemetry_interval and --binary_log_fd");
     return EXIT_FAILURE;
   }
-
-  size_t num_threads = absl::GetFlag(FLAGS_max_cpus);
-  const absl::Duration runner_cpu_time_budget =
-      absl::GetFlag(FLAGS_per_runner_cpu_time_budget);
-  bool sequential_mode = absl::GetFlag(FLAGS_sequential_mode);
-  if (sequential_mode) {
-    LOG_INFO("Running in sequential mode");
-    num_threads = 1;
+  absl::StatusOr<std::vector<RunnerOptions::PerfCounter>> perf_counters =
+      EncodePerfCounters(perf_events);
+  if (!perf_counters.ok()) {
+    LOG_ERROR(perf_counters.status().message());
+    return EXIT_FAILURE;
+  }
+  std::unique_ptr<RunnerBudgetController> budget_controller;
+  if (absl::GetFlag(FLAGS_adaptive_runner_budget) && !sequential_mode) {
+    const RunnerBudgetController::Options budget_options = {
+        .min_budget = runner_cpu_time_budget,
+        .max_budget = absl::GetFlag(FLAGS_max_per_runner_cpu_time_budget),
+        .overhead_target = absl::GetFlag(FLAGS_runner_startup_overhead_target),
+    };
+    if (budget_options.max_budget < budget_options.min_budget ||
+        budget_options.overhead_target <= 0 ||
+        budget_options.overhead_target > 1) {
+      LOG_ERROR(
+          "--max_per_runner_cpu_time_budget must not be less than "
+          "--per_runner_cpu_time_budget and "
+          "--runner_startup_overhead_target must be in (0, 1]");
+      return EXIT_FAILURE;
+    }
+    budget_controller =
+        std::make_unique<RunnerBudgetController>(budget_options);
+  }
+  std::unique_ptr<RunnerLaunchScheduler> launch_scheduler;
+  if (absl::GetFlag(FLAGS_max_runner_startups) != 0 ||
+      absl::GetFlag(FLAGS_runner_budget_jitter) != 0) {
+    const RunnerLaunchScheduler::Options launch_options = {
+        .max_startups = absl::GetFlag(FLAGS_max_runner_startups),
+        .startup_window = absl::GetFlag(FLAGS_runner_startup_window),
+        .budget_jitter = absl::GetFlag(FLAGS_runner_budget_jitter),
+    };
+    if (launch_options.max_startups < 0 ||
+        launch_options.budget_jitter < 0 ||
+        launch_options.budget_jitter >= 1) {
+      LOG_ERROR(
+          "--max_runner_startups must not be negative and "
+          "--runner_budget_jitter must be in [0, 1)");
+      return EXIT_FAILURE;
+    }
+    absl::BitGen seed_gen;
+    launch_scheduler = std::make_unique<RunnerLaunchScheduler>(
+        launch_options, absl::Uniform<uint64_t>(seed_gen));
+  }
+  const bool prefetch_next_shard = absl::GetFlag(FLAGS_prefetch_next_shard);
+  const size_t persistent_batch_size =
+      absl::GetFlag(FLAGS_persistent_runner_batch_size);
+  if (persistent_batch_size != 0 &&
+      (sequential_mode || absl::GetFlag(FLAGS_event_loop))) {
+    LOG_ERROR(
+        "--persistent_runner_batch_size is incompatible with "
+        "--sequential_mode and --event_loop");
+    return EXIT_FAILURE;
   }
   std::vector<RunnerThreadArgs> thread_args;
   if (num_threads == 0) {
-    std::vector<int> cpus = AvailableCpus();
-    num_threads = cpus.size();
-    for (int cpu : cpus) {
+    num_threads = worker_cpus.size();
+    for (int slot = 0; slot < worker_cpus.size(); ++slot) {
+      const CpuLocation &location = worker_cpus[slot];
       RunnerOptions runner_options = RunnerOptions::Default();
-      runner_options.set_cpu(cpu)
+      runner_options.set_cpu(location.cpu)
           .set_cpu_time_budget(runner_cpu_time_budget)
-          .set_extra_argv(runner_extra_argv);
-      thread_args.push_back({.thread_idx = cpu,
+          .set_extra_argv(runner_extra_argv)
+          .set_perf_counters(*perf_counters)
+          .set_pass_cpu_features(true)
+          .set_pass_platform_id(true)
+          .set_max_failures(absl::GetFlag(FLAGS_runner_max_failures));
+      auto node_corpora = corpora_by_node.find(location.numa_node);
+      thread_args.push_back({.thread_idx = location.cpu,
                              .runner = runner,
-                             .corpora = &*in_memory_corpora,
+                             .corpora = node_corpora == corpora_by_node.end()
+                                            ? &*in_memory_corpora
+                                            : node_corpora->second,
+                             .scheduler = scheduler.get(),
+                             .core_rotation = core_rotation.get(),
+                             .rotation_slot = slot,
+                             .dynamic_corpora = dynamic_corpora.get(),
+                             .telemetry = telemetry.get(),
+                             .budget_controller = budget_controller.get(),
+                             .launch_scheduler = launch_scheduler.get(),
+                             .prefetch_next_shard = prefetch_next_shard,
+                             .persistent_batch_size = persistent_batch_size,
                              .runner_options = runner_options});
     }
   } else {
@@ -250,19 +685,67 @@ int OrchestratorMain(const std::vector<std::string> &corpora,
       RunnerOptions runner_options = RunnerOptions::Default();
       runner_options.set_cpu_time_budget(runner_cpu_time_budget)
           .set_sequential_mode(sequential_mode)
-          .set_extra_argv(runner_extra_argv);
+          .set_extra_argv(runner_extra_argv)
+          .set_perf_counters(*perf_counters)
+          .set_pass_cpu_features(true)
+          .set_pass_platform_id(true);
       thread_args.push_back({.thread_idx = thread_idx,
                              .runner = runner,
                              .corpora = &*in_memory_corpora,
+                             .scheduler = scheduler.get(),
+                             .sequential_queue = sequential_queue.get(),
+                             .dynamic_corpora = dynamic_corpora.get(),
+                             .telemetry = telemetry.get(),
+                             .budget_controller = budget_controller.get(),
+                             .launch_scheduler = launch_scheduler.get(),
+                             .prefetch_next_shard = prefetch_next_shard,
+                             .persistent_batch_size = persistent_batch_size,
                              .runner_options = runner_options});
     }
   }
 
+  std::unique_ptr<MetricsPage> metrics_page;
+  if (const std::string metrics_page_path = absl::GetFlag(FLAGS_metrics_page);
+      !metrics_page_path.empty()) {
+    absl::StatusOr<std::unique_ptr<MetricsPage>> page_or =
+        MetricsPage::Create(metrics_page_path, thread_args.size(), start_time);
+    if (!page_or.ok()) {
+      LOG_ERROR(page_or.status().message());
+      return EXIT_FAILURE;
+    }
+    metrics_page = *std::move(page_or);
+    for (size_t i = 0; i < thread_args.size(); ++i) {
+      thread_args[i].metrics = metrics_page->worker(i);
+    }
+  }
+
+  std::unique_ptr<RunnerCgroups> runner_cgroups;
+  if (const std::string runner_cgroup = absl::GetFlag(FLAGS_runner_cgroup);
+      !runner_cgroup.empty()) {
+    absl::StatusOr<std::unique_ptr<RunnerCgroups>> cgroups_or =
+        RunnerCgroups::Create(runner_cgroup, thread_args.size());
+    if (!cgroups_or.ok()) {
+      LOG_ERROR(cgroups_or.status().message());
+      return EXIT_FAILURE;
+    }
+    runner_cgroups = *std::move(cgroups_or);
+    for (size_t i = 0; i < thread_args.size(); ++i) {
+      thread_args[i].runner_options.set_cgroup_procs_fd(
+          runner_cgroups->procs_fd(i));
+    }
+  }
+
   ResultCollector result_collector(
       absl::GetFlag(FLAGS_binary_log_fd), start_time,
       {.report_runaways_as_errors =
            absl::GetFlag(FLAGS_report_runaways_as_errors),
-       .fail_after_n_errors = absl::GetFlag(FLAGS_fail_after_n_errors)});
+       .fail_after_n_errors = absl::GetFlag(FLAGS_fail_after_n_errors),
+       .async_binary_log = absl::GetFlag(FLAGS_async_binary_log),
+       .aggregation_interval =
+           absl::GetFlag(FLAGS_result_aggregation_interval),
+       .telemetry = telemetry.get(),
+       .telemetry_interval = telemetry_interval,
+       .runner_cgroups = runner_cgroups.get()});
   ExecutionContext *ctx = OrchestratorInit(
       deadline, num_threads,
       absl::bind_front(&ResultCollector::operator(), &result_collector));
@@ -270,13 +753,49 @@ int OrchestratorMain(const std::vector<std::string> &corpora,
   absl::Duration staggering_delay = absl::GetFlag(FLAGS_worker_thread_delay);
   // Create worker threads.
   std::vector<std::thread> threads;
-  threads.reserve(num_threads);
-  for (const RunnerThreadArgs &args : thread_args) {
-    if (ctx->ShouldStop()) {
-      break;
+  if (absl::GetFlag(FLAGS_event_loop)) {
+    // Each runner takes a stdout pipe, a pidfd and a result file, which may
+    // exceed the default soft limit of open files with many workers.
+    struct rlimit nofile;
+    if (getrlimit(RLIMIT_NOFILE, &nofile) == 0 &&
+        nofile.rlim_cur < nofile.rlim_max) {
+      nofile.rlim_cur = nofile.rlim_max;
+      if (setrlimit(RLIMIT_NOFILE, &nofile) != 0) {
+        LOG_ERROR("Cannot raise RLIMIT_NOFILE: ", ErrnoStr(errno));
+      }
+    }
+    threads.emplace_back(RunnerEventLoop, ctx,
+                         absl::MakeConstSpan(thread_args), staggering_delay);
+  } else {
+    threads.reserve(num_threads);
+    for (const RunnerThreadArgs &args : thread_args) {
+      if (ctx->ShouldStop()) {
+        break;
+      }
+      threads.emplace_back(RunnerThread, ctx, args);
+      absl::SleepFor(staggering_delay);
     }
-    threads.emplace_back(RunnerThread, ctx, args);
-    absl::SleepFor(staggering_delay);
+  }
+
+  std::thread admission_thread;
+  if (dynamic_shard_admission) {
+    admission_thread = std::thread([ctx, &dynamic_corpora, &runner_cgroups,
+                                    memory_limit_bytes]() {
+      ShardAdmissionController controller(
+          dynamic_corpora.get(),
+          {.memory_limit_bytes = memory_limit_bytes,
+           .interval = absl::GetFlag(FLAGS_shard_admission_interval),
+           .runner_cgroups = runner_cgroups.get()});
+      controller.Run([ctx]() { return ctx->ShouldStop(); });
+    });
+  }
+  std::thread reload_thread;
+  if (hot_reload) {
+    reload_thread = std::thread([ctx, &dynamic_corpora, dynamic_shard_admission,
+                                 corpus_reload_interval]() {
+      WatchShardListFile(ctx, *dynamic_corpora, !dynamic_shard_admission,
+                         corpus_reload_interval);
+    });
   }
 
   ctx->EventLoop();
@@ -288,7 +807,41 @@ int OrchestratorMain(const std::vector<std::string> &corpora,
       threads[thread_idx].join();
     }
   }
+  if (admission_thread.joinable()) {
+    admission_thread.join();
+  }
+  if (reload_thread.joinable()) {
+    reload_thread.join();
+  }
+  if (runner_cgroups != nullptr) {
+    if (absl::StatusOr<absl::Duration> cpu_usage = runner_cgroups->CpuUsage();
+        cpu_usage.ok()) {
+      LOG_INFO("Runner CPU usage: ", absl::FormatDuration(*cpu_usage));
+    }
+  }
   ctx->ProcessResultQueue();
+  ExecutionContext::ResultQueueStats queue_stats = ctx->result_queue_stats();
+  result_collector.SetResultQueueStats(
+      queue_stats.num_waits, queue_stats.num_dropped, queue_stats.max_depth);
+  if (core_rotation != nullptr) {
+    std::vector<Summary::CoreCoverage> core_coverage;
+    for (int slot = 0; slot < core_rotation->num_slots(); ++slot) {
+      core_coverage.push_back(
+          {.cpu = worker_cpus[slot].cpu,
+           .num_runs = core_rotation->num_runs(slot),
+           .num_shards_visited = core_rotation->num_shards_visited(slot)});
+    }
+    result_collector.SetCoreCoverage(std::move(core_coverage));
+  }
+  if (sequential_queue != nullptr) {
+    std::vector<Summary::ShardCompletion> shard_completion;
+    for (size_t shard = 0; shard < in_memory_corpora->shards.size(); ++shard) {
+      shard_completion.push_back(
+          {.shard_name = in_memory_corpora->shards[shard].name,
+           .completed_ranges = sequential_queue->CompletedRanges(shard)});
+    }
+    result_collector.SetShardCompletion(std::move(shard_completion));
+  }
   result_collector.LogSummary(true);
   Summary summary = result_collector.summary();
   double log_session_summary_probability =
@@ -307,31 +860,6 @@ int OrchestratorMain(const std::vector<std::string> &corpora,
   return EXIT_SUCCESS;
 }
 
-std::vector<std::string> LoadShardFilenames(
-    const std::filesystem::path &shard_list_file) {
-  std::ifstream ifs;
-  ifs.open(shard_list_file);
-  VLOG_INFO(0, "Loading shards from ", shard_list_file.c_str());
-  if (!ifs.good()) {
-    LOG_ERROR("Error opening ", shard_list_file.c_str());
-    return {};
-  }
-  std::vector<std::string> shards;
-  std::string line;
-  while (std::getline(ifs, line)) {
-    absl::StripAsciiWhitespace(&line);
-    if (!line.empty() && line[0] != '#') {
-      shards.emplace_back(std::move(line));
-    }
-  }
-  if (ifs.bad()) {
-    LOG_ERROR("Error reading ", shard_list_file.c_str());
-    return {};
-  }
-  ifs.close();
-  return shards;
-}
-
 }  // namespace
 }  // namespace silifuzz
 
@@ -358,6 +886,29 @@ int main(int argc, char **argv) {
     return EXIT_FAILURE;
   }
   const int total_shards = shards.size();
+  absl::StatusOr<silifuzz::SmtPolicy> smt_policy =
+      silifuzz::ParseSmtPolicy(absl::GetFlag(FLAGS_smt_policy));
+  if (!smt_policy.ok()) {
+    std::cerr << smt_policy.status().message() << '\n';
+    return EXIT_FAILURE;
+  }
+  const bool dynamic_shard_admission =
+      absl::GetFlag(FLAGS_dynamic_shard_admission);
+  if (dynamic_shard_admission && absl::GetFlag(FLAGS_sequential_mode)) {
+    std::cerr << "--dynamic_shard_admission is incompatible with "
+                 "--sequential_mode"
+              << '\n';
+    return EXIT_FAILURE;
+  }
+  if (absl::GetFlag(FLAGS_corpus_reload_interval) > absl::ZeroDuration() &&
+      absl::GetFlag(FLAGS_sequential_mode)) {
+    std::cerr << "--corpus_reload_interval is incompatible with "
+                 "--sequential_mode"
+              << '\n';
+    return EXIT_FAILURE;
+  }
+  std::vector<std::string> all_shards;
+  uint64_t memory_limit_bytes = 0;
 
   std::string limit_memory_usage_mb =
       absl::GetFlag(FLAGS_limit_memory_usage_mb);
@@ -379,21 +930,69 @@ int main(int argc, char **argv) {
     }
     uint64_t max_cpus = absl::GetFlag(FLAGS_max_cpus);
     if (max_cpus == 0) {
-      max_cpus = silifuzz::AvailableCpus().size();
+      max_cpus = silifuzz::WorkerCpus(*smt_policy).size();
+    }
+    // Shard sizes and expected runner RSS from the corpus metadata make the
+    // cap exact. Without them, CapShardsToMemLimit() falls back to estimates.
+    silifuzz::proto::CorpusMetadata corpus_metadata;
+    const std::string corpus_metadata_file =
+        absl::GetFlag(FLAGS_corpus_metadata_file);
+    if (!corpus_metadata_file.empty()) {
+      if (absl::Status s = silifuzz::ReadProtoFromTextFile(
+              corpus_metadata_file, &corpus_metadata);
+          !s.ok()) {
+        LOG_ERROR(s.message());
+        corpus_metadata.Clear();
+      }
+    }
+    // OrchestratorMain() loads one copy of the shards per NUMA node of the
+    // pinned workers with --numa_local_corpus unless shards are dynamic.
+    uint64_t num_corpus_replicas = 1;
+    if (absl::GetFlag(FLAGS_numa_local_corpus) &&
+        absl::GetFlag(FLAGS_max_cpus) == 0 &&
+        !absl::GetFlag(FLAGS_sequential_mode) && !dynamic_shard_admission &&
+        absl::GetFlag(FLAGS_corpus_reload_interval) <= absl::ZeroDuration()) {
+      num_corpus_replicas = std::max<size_t>(
+          1, silifuzz::NumaNodes(silifuzz::WorkerCpus(*smt_policy)).size());
     }
     absl::StatusOr<std::vector<std::string>> capped_shards =
         silifuzz::CapShardsToMemLimit(shards, limit_memory_usage_mb_as_int,
-                                      max_cpus);
+                                      max_cpus, corpus_metadata,
+                                      num_corpus_replicas);
     if (!capped_shards.ok()) {
       LOG_ERROR(capped_shards.status().message());
       return EXIT_FAILURE;
     }
+    if (dynamic_shard_admission) {
+      // Start with the capped random subset and let the shard admission
+      // controller bring in the rest as memory permits.
+      all_shards = *capped_shards;
+      absl::flat_hash_set<std::string> capped_set(capped_shards->begin(),
+                                                  capped_shards->end());
+      for (const std::string &shard : shards) {
+        if (!capped_set.contains(shard)) {
+          all_shards.push_back(shard);
+        }
+      }
+      memory_limit_bytes = limit_memory_usage_mb_as_int * 1024 * 1024;
+    }
     shards = std::move(*capped_shards);
+  } else if (dynamic_shard_admission) {
+    std::cerr << "--dynamic_shard_admission requires --limit_memory_usage_mb"
+              << '\n';
+    return EXIT_FAILURE;
   }
 
   std::vector<std::string> runner_extra_argv;
   runner_extra_argv.push_back(
       absl::StrCat("--num_iterations=", absl::GetFlag(FLAGS_num_iterations)));
+  if (absl::GetFlag(FLAGS_telemetry_interval) > absl::ZeroDuration() ||
+      absl::GetFlag(FLAGS_adaptive_runner_budget) ||
+      !absl::GetFlag(FLAGS_metrics_page).empty()) {
+    // Startup phase timings are reported in the throughput telemetry and the
+    // metrics page and drive the adaptive runner budget.
+    runner_extra_argv.push_back("--report_startup_timings");
+  }
   // Collect runner arguments.
   for (size_t i = 1; i < remaining_args.size(); ++i) {
     runner_extra_argv.push_back(remaining_args[i]);
@@ -403,5 +1002,6 @@ int main(int argc, char **argv) {
            " LOADABLE SHARDS: ", shards.size(), " TOTAL SHARDS: ", total_shards,
            " CPUS: ", silifuzz::AvailableCpus().size());
 
-  return silifuzz::OrchestratorMain(shards, runner, runner_extra_argv);
+  return silifuzz::OrchestratorMain(shards, all_shards, memory_limit_bytes,
+                                    *smt_policy, runner, runner_extra_argv);
 }
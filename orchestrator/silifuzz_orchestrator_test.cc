@@ -16,18 +16,29 @@
 
 #include <string>
 #include <thread>  // NOLINT
+#include <utility>
 #include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/log/check.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "./orchestrator/shard_admission.h"
 #include "./runner/driver/runner_driver.h"
 
 namespace silifuzz {
 namespace {
+using testing::Each;
 using testing::ElementsAre;
+using testing::IsEmpty;
 using testing::IsSupersetOf;
+using testing::Le;
 
 TEST(ExecutionContext, Simple) {
   int results_processed = 0;
@@ -59,11 +70,54 @@ TEST(ExecutionContext, StopFast) {
 }
 
 TEST(ExecutionContext, QueueSizeLimit) {
-  ExecutionContext ctx(absl::InfiniteFuture(), 1,
-                       [](const RunnerDriver::RunResult& r) { return false; });
+  ExecutionContext ctx(
+      absl::InfiniteFuture(), 1,
+      [](const RunnerDriver::RunResult& r) { return false; },
+      absl::Milliseconds(10));
+  // Two result slots per thread.
+  ASSERT_TRUE(ctx.OfferRunResult(RunnerDriver::RunResult::Successful()));
   ASSERT_TRUE(ctx.OfferRunResult(RunnerDriver::RunResult::Successful()));
   ASSERT_FALSE(ctx.OfferRunResult(RunnerDriver::RunResult::Successful()));
+  ExecutionContext::ResultQueueStats stats = ctx.result_queue_stats();
+  EXPECT_EQ(stats.num_waits, 1);
+  EXPECT_EQ(stats.num_dropped, 1);
+  EXPECT_EQ(stats.max_depth, 2);
+  ctx.ProcessResultQueue();
+}
+
+TEST(ExecutionContext, Backpressure) {
+  constexpr int kNumProducers = 8;
+  constexpr int kResultsPerProducer = 200;
+  int results_processed = 0;
+  ExecutionContext ctx(absl::InfiniteFuture(), 2,
+                       [&results_processed](const RunnerDriver::RunResult& r) {
+                         results_processed++;
+                         return false;
+                       });
+  std::vector<std::thread> producers;
+  for (int i = 0; i < kNumProducers; ++i) {
+    producers.emplace_back([&ctx]() {
+      for (int j = 0; j < kResultsPerProducer; ++j) {
+        ASSERT_TRUE(ctx.OfferRunResult(RunnerDriver::RunResult::Successful()));
+      }
+    });
+  }
+  std::thread stopper([&ctx, &producers]() {
+    for (std::thread& t : producers) {
+      t.join();
+    }
+    ctx.Stop();
+    // Make EventLoop() notice the stop without waiting for its timeout.
+    ctx.OfferRunResult(absl::InternalError("stop"));
+  });
+  ctx.EventLoop();
+  stopper.join();
   ctx.ProcessResultQueue();
+  // A full queue slows producers down instead of losing results.
+  EXPECT_EQ(results_processed, kNumProducers * kResultsPerProducer);
+  ExecutionContext::ResultQueueStats stats = ctx.result_queue_stats();
+  EXPECT_EQ(stats.num_dropped, 0);
+  EXPECT_LE(stats.max_depth, 4);
 }
 
 TEST(ExecutionContext, Multithreaded) {
@@ -95,22 +149,22 @@ TEST(ExecutionContext, Multithreaded) {
   ASSERT_GT(posted, 0);
 }
 
-TEST(NextCorpusGenerator, Sequential) {
-  NextCorpusGenerator gen(3, true, 0);
+TEST(ShardScheduler, Sequential) {
+  ShardScheduler gen(3, true, 0);
   std::vector<int> actual;
   for (int i = 0; i < 5; ++i) {
-    actual.push_back(gen());
+    actual.push_back(gen.Next());
   }
   ASSERT_THAT(actual, ElementsAre(0, 1, 2, -1, -1));
 }
 
-TEST(NextCorpusGenerator, Random) {
+TEST(ShardScheduler, Random) {
   std::vector<std::string> src = {"1", "2", "3"};
   std::vector<std::string> result;
-  NextCorpusGenerator gen(src.size(), false, 0);
+  ShardScheduler gen(src.size(), false, 0);
   std::vector<std::string> actual;
   for (int i = 0; i < 100; ++i) {
-    int idx = gen();
+    int idx = gen.Next();
     ASSERT_GE(idx, 0);
     ASSERT_LT(idx, src.size());
     result.push_back(src[idx]);
@@ -120,6 +174,232 @@ TEST(NextCorpusGenerator, Random) {
          "of the source at least once";
 }
 
+TEST(ShardScheduler, Balanced) {
+  for (int size : {1, 2, 6, 7, 64, 1000}) {
+    SCOPED_TRACE(size);
+    ShardScheduler gen(size, false, 42);
+    for (int epoch = 0; epoch < 5; ++epoch) {
+      // Each window of `size` consecutive indices covers every shard once.
+      std::vector<int> counts(size, 0);
+      for (int i = 0; i < size; ++i) {
+        int idx = gen.Next();
+        ASSERT_GE(idx, 0);
+        ASSERT_LT(idx, size);
+        ++counts[idx];
+      }
+      EXPECT_THAT(counts, Each(1));
+    }
+  }
+}
+
+TEST(ShardScheduler, EpochsDiffer) {
+  ShardScheduler gen(64, false, 1);
+  std::vector<int> first, second;
+  for (int i = 0; i < 64; ++i) {
+    first.push_back(gen.Next());
+  }
+  for (int i = 0; i < 64; ++i) {
+    second.push_back(gen.Next());
+  }
+  EXPECT_NE(first, second);
+}
+
+TEST(ShardScheduler, PeekMatchesNext) {
+  for (bool sequential_mode : {true, false}) {
+    ShardScheduler gen(7, sequential_mode, 3);
+    for (int i = 0; i < 20; ++i) {
+      const int peeked = gen.Peek();
+      EXPECT_EQ(gen.Peek(), peeked);
+      EXPECT_EQ(gen.Next(), peeked);
+    }
+  }
+}
+
+TEST(CoreRotationScheduler, PeekMatchesNext) {
+  CoreRotationScheduler gen(7, 3, 3);
+  for (int i = 0; i < 20; ++i) {
+    for (int slot = 0; slot < 3; ++slot) {
+      const int peeked = gen.Peek(slot);
+      EXPECT_EQ(gen.Next(slot), peeked);
+    }
+  }
+  EXPECT_EQ(gen.num_runs(0), 20);
+}
+
+TEST(CoreRotationScheduler, EverySlotVisitsEveryShard) {
+  for (int num_shards : {1, 2, 6, 7, 64}) {
+    for (int num_slots : {1, 3, 8}) {
+      SCOPED_TRACE(absl::StrCat(num_shards, " shards, ", num_slots, " slots"));
+      CoreRotationScheduler gen(num_shards, num_slots, 42);
+      for (int epoch = 0; epoch < 3; ++epoch) {
+        for (int slot = 0; slot < num_slots; ++slot) {
+          std::vector<int> counts(num_shards, 0);
+          for (int i = 0; i < num_shards; ++i) {
+            int idx = gen.Next(slot);
+            ASSERT_GE(idx, 0);
+            ASSERT_LT(idx, num_shards);
+            ++counts[idx];
+          }
+          EXPECT_THAT(counts, Each(1));
+        }
+      }
+      for (int slot = 0; slot < num_slots; ++slot) {
+        EXPECT_EQ(gen.num_runs(slot), 3 * num_shards);
+        EXPECT_EQ(gen.num_shards_visited(slot), num_shards);
+      }
+    }
+  }
+}
+
+TEST(CoreRotationScheduler, SlotsRunDifferentShards) {
+  constexpr int kNumShards = 16;
+  constexpr int kNumSlots = 4;
+  CoreRotationScheduler gen(kNumShards, kNumSlots, 1);
+  for (int run = 0; run < 2 * kNumShards; ++run) {
+    std::vector<int> counts(kNumShards, 0);
+    for (int slot = 0; slot < kNumSlots; ++slot) {
+      ++counts[gen.Next(slot)];
+    }
+    EXPECT_THAT(counts, Each(Le(1)));
+  }
+}
+
+TEST(CoreRotationScheduler, ShardsVisited) {
+  CoreRotationScheduler gen(10, 2, 0);
+  EXPECT_EQ(gen.num_shards_visited(0), 0);
+  for (int i = 0; i < 4; ++i) {
+    gen.Next(0);
+  }
+  EXPECT_EQ(gen.num_runs(0), 4);
+  EXPECT_EQ(gen.num_shards_visited(0), 4);
+  EXPECT_EQ(gen.num_runs(1), 0);
+}
+
+TEST(ShardScheduler, ParallelSequential) {
+  constexpr int kNumShards = 1000;
+  constexpr int kNumThreads = 4;
+  ShardScheduler gen(kNumShards, true, 0);
+  std::vector<std::vector<int>> per_thread(kNumThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&gen, &per_thread, t]() {
+      for (int idx = gen.Next(); idx != ShardScheduler::kEndOfStream;
+           idx = gen.Next()) {
+        per_thread[t].push_back(idx);
+      }
+    });
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  std::vector<int> counts(kNumShards, 0);
+  for (const std::vector<int>& indices : per_thread) {
+    for (int idx : indices) {
+      ++counts[idx];
+    }
+  }
+  EXPECT_THAT(counts, Each(1));
+}
+
+TEST(SequentialWorkQueue, HandsOutRangesInOrder) {
+  SequentialWorkQueue queue(2, 3);
+  std::vector<std::pair<int, int>> actual;
+  for (auto range = queue.Next(); range.has_value(); range = queue.Next()) {
+    actual.emplace_back(range->shard, range->index);
+  }
+  EXPECT_THAT(actual, ElementsAre(std::pair(0, 0), std::pair(0, 1),
+                                  std::pair(0, 2), std::pair(1, 0),
+                                  std::pair(1, 1), std::pair(1, 2)));
+  EXPECT_FALSE(queue.Next().has_value());
+}
+
+TEST(SequentialWorkQueue, PublishesInOrder) {
+  SequentialWorkQueue queue(1, 3);
+  std::vector<SequentialWorkQueue::SnapRange> ranges;
+  for (auto range = queue.Next(); range.has_value(); range = queue.Next()) {
+    ranges.push_back(*range);
+  }
+  ASSERT_EQ(ranges.size(), 3);
+  std::vector<std::string> published;
+  auto publish = [&published](
+                     absl::StatusOr<RunnerDriver::RunResult>&& result) {
+    published.push_back(std::string(result.status().message()));
+  };
+  // Results are identified by their error messages.
+  queue.Complete(ranges[2], true, absl::InternalError("2"), publish);
+  EXPECT_THAT(published, IsEmpty());
+  queue.Complete(ranges[0], false, absl::InternalError("0"), publish);
+  EXPECT_THAT(published, ElementsAre("0"));
+  queue.Complete(ranges[1], true, absl::InternalError("1"), publish);
+  EXPECT_THAT(published, ElementsAre("0", "1", "2"));
+  EXPECT_THAT(queue.CompletedRanges(0), ElementsAre(false, true, true));
+}
+
+TEST(SequentialWorkQueue, ParallelPublishesInOrder) {
+  constexpr int kNumShards = 50;
+  constexpr int kNumRangesPerShard = 8;
+  constexpr int kNumThreads = 4;
+  SequentialWorkQueue queue(kNumShards, kNumRangesPerShard);
+  absl::Mutex mu;
+  std::vector<int> published;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; ++t) {
+    threads.emplace_back([&queue, &mu, &published]() {
+      for (auto range = queue.Next(); range.has_value(); range = queue.Next()) {
+        const int r = range->shard * kNumRangesPerShard + range->index;
+        queue.Complete(*range, r % 3 != 0,
+                       absl::InternalError(absl::StrCat(r)),
+                       [&mu, &published](
+                           absl::StatusOr<RunnerDriver::RunResult>&& result) {
+                         int value;
+                         CHECK(absl::SimpleAtoi(result.status().message(),
+                                                &value));
+                         absl::MutexLock l(&mu);
+                         published.push_back(value);
+                       });
+      }
+    });
+  }
+  for (std::thread& t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(published.size(), kNumShards * kNumRangesPerShard);
+  for (size_t r = 0; r < published.size(); ++r) {
+    EXPECT_EQ(published[r], r);
+  }
+  std::vector<bool> completed = queue.CompletedRanges(1);
+  for (int i = 0; i < kNumRangesPerShard; ++i) {
+    EXPECT_EQ(completed[i], (kNumRangesPerShard + i) % 3 != 0);
+  }
+}
+
+// Workers wait for a dynamically loaded shard instead of crashing when there
+// is none and stop at the deadline.
+TEST(RunnerThread, NoDynamicShardLoaded) {
+  DynamicCorpora corpora({"/this does not exist.xz"}, {});
+  RunnerThreadArgs args;
+  args.thread_idx = 0;
+  args.dynamic_corpora = &corpora;
+  int results_processed = 0;
+  ExecutionContext ctx(absl::Now() + absl::Seconds(2), 1,
+                       [&results_processed](const RunnerDriver::RunResult& r) {
+                         results_processed++;
+                         return false;
+                       });
+  RunnerThread(&ctx, args);
+  EXPECT_TRUE(ctx.ShouldStop());
+
+  ExecutionContext event_loop_ctx(
+      absl::Now() + absl::Seconds(2), 1,
+      [&results_processed](const RunnerDriver::RunResult& r) {
+        results_processed++;
+        return false;
+      });
+  RunnerEventLoop(&event_loop_ctx, {args}, absl::ZeroDuration());
+  EXPECT_TRUE(event_loop_ctx.ShouldStop());
+  EXPECT_EQ(results_processed, 0);
+}
+
 }  // namespace
 
 }  // namespace silifuzz
@@ -25,6 +25,7 @@
 #include <csignal>
 #include <string>
 
+#include "./runner/stdout_markers.h"
 #include "./snap/snap.h"
 #include "./snap/snap_corpus_util.h"
 #include "./util/arch.h"
@@ -70,6 +71,10 @@ int main(int argc, char** argv) {
   // runner opens these files and prints the ID of the first Snap in the file.
   bool print_first_snap_id = false;
 
+  // If true, the test runner acknowledges persistent mode commands read from
+  // stdin after running the commands from the command line.
+  bool persistent = false;
+
   // Run commands supplied from the command line, one by one.
   for (int i = 1; i < argc; i++) {
     std::string cmd(argv[i]);
@@ -109,6 +114,8 @@ int main(int argc, char** argv) {
       return 1;
     } else if (cmd == "print_first_snap_id") {
       print_first_snap_id = true;
+    } else if (cmd == "--persistent") {
+      persistent = true;
     } else if (cmd == "--sequential_mode") {
       LogHumanReadable("TEST RUNNER sequential_mode\n");
     } else if (cmd == "ignore_alarm") {
@@ -124,5 +131,16 @@ int main(int argc, char** argv) {
     }
   }
 
+  if (persistent) {
+    size_t num_iterations;
+    uint64_t seed;
+    while (scanf("%zu %lu", &num_iterations, &seed) == 2) {
+      LogHumanReadable("TEST RUNNER persistent batch %zu\n", num_iterations);
+      usleep(100000);
+      fprintf(stdout, "\n%s0\n", silifuzz::kPersistentModeEndMarker);
+      fflush(stdout);
+    }
+  }
+
   return 0;
 }
@@ -0,0 +1,159 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/throughput_telemetry.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "./proto/session_summary.pb.h"
+#include "./proto/snapshot_execution_result.pb.h"
+#include "./runner/driver/runner_driver.h"
+#include "./util/checks.h"
+#include "./util/time_proto_util.h"
+
+namespace silifuzz {
+
+// static
+ThroughputTelemetry::RunSample ThroughputTelemetry::MakeRunSample(
+    const absl::StatusOr<RunnerDriver::RunResult> &run_result,
+    absl::Duration wall_time) {
+  RunSample sample = {.wall_time = wall_time};
+  if (!run_result.ok()) {
+    sample.failed = true;
+    return sample;
+  }
+  sample.failed = !run_result->success();
+  sample.cpu_time = run_result->runner_cpu_time();
+  sample.max_rss_kb = run_result->runner_max_rss_kb();
+  if (run_result->startup_timings().has_value()) {
+    sample.startup_timings = *run_result->startup_timings();
+  }
+  sample.perf_counter_values = run_result->perf_counter_values();
+  sample.perf_counter_missed_batches =
+      run_result->perf_counter_missed_batches();
+  for (const proto::SnapLatencyHistogram &histogram :
+       run_result->snap_latency_histograms()) {
+    for (uint64_t count : histogram.bucket_counts()) {
+      sample.num_snaps_executed += count;
+    }
+  }
+  return sample;
+}
+
+void ThroughputTelemetry::Counters::Add(const RunSample &sample) {
+  ++num_runs;
+  num_failures += sample.failed;
+  num_snaps_executed += sample.num_snaps_executed;
+  wall_time += sample.wall_time;
+  cpu_time += sample.cpu_time;
+  max_rss_kb = std::max(max_rss_kb, sample.max_rss_kb);
+  startup_timings.exec += sample.startup_timings.exec;
+  startup_timings.load_corpus += sample.startup_timings.load_corpus;
+  startup_timings.map_corpus += sample.startup_timings.map_corpus;
+  startup_timings.verify_checksums += sample.startup_timings.verify_checksums;
+  if (perf_counter_values.size() < sample.perf_counter_values.size()) {
+    perf_counter_values.resize(sample.perf_counter_values.size());
+  }
+  for (size_t i = 0; i < sample.perf_counter_values.size(); ++i) {
+    perf_counter_values[i] += sample.perf_counter_values[i];
+  }
+  perf_counter_missed_batches += sample.perf_counter_missed_batches;
+}
+
+void ThroughputTelemetry::Counters::AppendTo(
+    proto::logging::ThroughputColumns &columns) const {
+  columns.add_num_runs(num_runs);
+  columns.add_num_failures(num_failures);
+  columns.add_num_snaps_executed(num_snaps_executed);
+  columns.add_wall_time_ms(absl::ToInt64Milliseconds(wall_time));
+  columns.add_cpu_time_ms(absl::ToInt64Milliseconds(cpu_time));
+  columns.add_max_rss_kb(max_rss_kb);
+  columns.add_exec_time_us(absl::ToInt64Microseconds(startup_timings.exec));
+  columns.add_load_corpus_time_us(
+      absl::ToInt64Microseconds(startup_timings.load_corpus));
+  columns.add_map_corpus_time_us(
+      absl::ToInt64Microseconds(startup_timings.map_corpus));
+  columns.add_verify_checksums_time_us(
+      absl::ToInt64Microseconds(startup_timings.verify_checksums));
+  if (columns.perf_counters().empty()) return;
+  for (int i = 0; i < columns.perf_counters_size(); ++i) {
+    columns.mutable_perf_counters(i)->add_values(
+        static_cast<size_t>(i) < perf_counter_values.size()
+            ? perf_counter_values[i]
+            : 0);
+  }
+  columns.add_perf_counter_missed_batches(perf_counter_missed_batches);
+}
+
+void ThroughputTelemetry::AddPerfCounterColumns(
+    proto::logging::ThroughputColumns &columns) const {
+  for (const std::string &event : perf_events_) {
+    columns.add_perf_counters()->set_event(event);
+  }
+}
+
+void ThroughputTelemetry::Record(absl::string_view shard_name, int cpu,
+                                 const RunSample &sample) {
+  absl::MutexLock l(&mu_);
+  auto it = by_shard_.find(shard_name);
+  if (it == by_shard_.end()) {
+    it = by_shard_.emplace(std::string(shard_name), Counters{}).first;
+  }
+  it->second.Add(sample);
+  by_cpu_[cpu].Add(sample);
+}
+
+proto::logging::ThroughputTelemetry ThroughputTelemetry::Take(absl::Time now) {
+  std::map<std::string, Counters, std::less<>> by_shard;
+  std::map<int, Counters> by_cpu;
+  absl::Duration interval;
+  {
+    absl::MutexLock l(&mu_);
+    by_shard.swap(by_shard_);
+    by_cpu.swap(by_cpu_);
+    interval = now - last_take_time_;
+    last_take_time_ = now;
+  }
+  proto::logging::ThroughputTelemetry telemetry;
+  if (absl::Status s =
+          EncodeGoogleApiProto(interval, telemetry.mutable_interval());
+      !s.ok()) {
+    LOG_ERROR(s.message());
+  }
+  proto::logging::ThroughputColumns *shards = telemetry.mutable_shards();
+  AddPerfCounterColumns(*shards);
+  for (const auto &[shard_name, counters] : by_shard) {
+    shards->add_shard_name(shard_name);
+    counters.AppendTo(*shards);
+  }
+  proto::logging::ThroughputColumns *cpus = telemetry.mutable_cpus();
+  AddPerfCounterColumns(*cpus);
+  for (const auto &[cpu, counters] : by_cpu) {
+    cpus->add_cpu(cpu);
+    counters.AppendTo(*cpus);
+  }
+  return telemetry;
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,113 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_THROUGHPUT_TELEMETRY_H_
+#define THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_THROUGHPUT_TELEMETRY_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "./proto/session_summary.pb.h"
+#include "./runner/driver/runner_driver.h"
+
+namespace silifuzz {
+
+// Accumulates per-shard and per-CPU runner throughput counters between
+// periodic telemetry reports.
+//
+// This class is thread-safe.
+class ThroughputTelemetry {
+ public:
+  // Counters for a single runner invocation.
+  struct RunSample {
+    absl::Duration wall_time;
+    absl::Duration cpu_time;
+    uint64_t max_rss_kb = 0;
+    uint64_t num_snaps_executed = 0;
+    bool failed = false;
+    // Zero unless the runner reported its startup timings.
+    RunnerDriver::RunResult::StartupTimings startup_timings;
+    // Empty unless the runner counted PMU events.
+    std::vector<uint64_t> perf_counter_values;
+    uint64_t perf_counter_missed_batches = 0;
+  };
+
+  // Builds a RunSample from the outcome of a runner invocation that took
+  // `wall_time`.
+  static RunSample MakeRunSample(
+      const absl::StatusOr<RunnerDriver::RunResult> &run_result,
+      absl::Duration wall_time);
+
+  // Starts accumulating at `start_time`. `perf_events` names the PMU events
+  // the runners count, in the order of RunSample::perf_counter_values.
+  explicit ThroughputTelemetry(absl::Time start_time,
+                               std::vector<std::string> perf_events = {})
+      : perf_events_(std::move(perf_events)), last_take_time_(start_time) {}
+
+  // Not copyable or moveable -- not just a data holder.
+  ThroughputTelemetry(const ThroughputTelemetry &) = delete;
+  ThroughputTelemetry(ThroughputTelemetry &&) = delete;
+  ThroughputTelemetry &operator=(const ThroughputTelemetry &) = delete;
+  ThroughputTelemetry &operator=(ThroughputTelemetry &&) = delete;
+
+  // Adds `sample` for a runner invocation that played `shard_name` on `cpu`.
+  void Record(absl::string_view shard_name, int cpu, const RunSample &sample);
+
+  // Returns the counters accumulated since the previous call (or since
+  // construction) up to `now` and resets them.
+  proto::logging::ThroughputTelemetry Take(absl::Time now);
+
+ private:
+  struct Counters {
+    uint64_t num_runs = 0;
+    uint64_t num_failures = 0;
+    uint64_t num_snaps_executed = 0;
+    absl::Duration wall_time;
+    absl::Duration cpu_time;
+    uint64_t max_rss_kb = 0;
+    RunnerDriver::RunResult::StartupTimings startup_timings;
+    std::vector<uint64_t> perf_counter_values;
+    uint64_t perf_counter_missed_batches = 0;
+
+    void Add(const RunSample &sample);
+
+    // Appends the counters as one row of `columns`. The perf counter columns
+    // must already exist.
+    void AppendTo(proto::logging::ThroughputColumns &columns) const;
+  };
+
+  // Adds an empty column for each of `perf_events_` to `columns`.
+  void AddPerfCounterColumns(proto::logging::ThroughputColumns &columns) const;
+
+  const std::vector<std::string> perf_events_;
+
+  absl::Mutex mu_;
+  // Ordered so that the columns come out in a stable order.
+  std::map<std::string, Counters, std::less<>> by_shard_ ABSL_GUARDED_BY(mu_);
+  std::map<int, Counters> by_cpu_ ABSL_GUARDED_BY(mu_);
+  absl::Time last_take_time_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_ORCHESTRATOR_THROUGHPUT_TELEMETRY_H_
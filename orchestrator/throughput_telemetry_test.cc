@@ -0,0 +1,135 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./orchestrator/throughput_telemetry.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "./proto/session_summary.pb.h"
+#include "./proto/snapshot_execution_result.pb.h"
+#include "./runner/driver/runner_driver.h"
+
+namespace silifuzz {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+TEST(ThroughputTelemetry, MakeRunSample) {
+  RunnerDriver::RunResult result = RunnerDriver::RunResult::Successful();
+  result.set_runner_usage(absl::Milliseconds(30), 1024);
+  proto::SnapLatencyHistogram histogram;
+  histogram.add_bucket_counts(2);
+  histogram.add_bucket_counts(3);
+  result.set_snap_latency_histograms({histogram, histogram});
+  result.set_startup_timings({.exec = absl::Microseconds(700),
+                              .load_corpus = absl::Microseconds(300)});
+  result.set_perf_counters({5, 6}, 1);
+  ThroughputTelemetry::RunSample sample =
+      ThroughputTelemetry::MakeRunSample(result, absl::Milliseconds(50));
+  EXPECT_EQ(sample.wall_time, absl::Milliseconds(50));
+  EXPECT_EQ(sample.cpu_time, absl::Milliseconds(30));
+  EXPECT_EQ(sample.max_rss_kb, 1024);
+  EXPECT_EQ(sample.num_snaps_executed, 10);
+  EXPECT_FALSE(sample.failed);
+  EXPECT_EQ(sample.startup_timings.exec, absl::Microseconds(700));
+  EXPECT_EQ(sample.startup_timings.load_corpus, absl::Microseconds(300));
+  EXPECT_THAT(sample.perf_counter_values, ElementsAre(5, 6));
+  EXPECT_EQ(sample.perf_counter_missed_batches, 1);
+
+  sample = ThroughputTelemetry::MakeRunSample(absl::InternalError("crash"),
+                                              absl::Milliseconds(5));
+  EXPECT_EQ(sample.wall_time, absl::Milliseconds(5));
+  EXPECT_TRUE(sample.failed);
+}
+
+TEST(ThroughputTelemetry, Take) {
+  absl::Time start = absl::FromUnixSeconds(1000);
+  ThroughputTelemetry telemetry(start);
+  telemetry.Record("b", 3,
+                   {.wall_time = absl::Seconds(2),
+                    .cpu_time = absl::Seconds(1),
+                    .max_rss_kb = 10,
+                    .num_snaps_executed = 5});
+  telemetry.Record("a", 3,
+                   {.wall_time = absl::Seconds(1),
+                    .cpu_time = absl::Seconds(1),
+                    .max_rss_kb = 20,
+                    .failed = true});
+  telemetry.Record("b", 1,
+                   {.wall_time = absl::Seconds(4),
+                    .max_rss_kb = 5,
+                    .startup_timings = {.exec = absl::Microseconds(10),
+                                        .map_corpus = absl::Microseconds(20)}});
+
+  proto::logging::ThroughputTelemetry t =
+      telemetry.Take(start + absl::Seconds(5));
+  EXPECT_EQ(t.interval().seconds(), 5);
+  EXPECT_THAT(t.shards().shard_name(), ElementsAre("a", "b"));
+  EXPECT_THAT(t.shards().cpu(), IsEmpty());
+  EXPECT_THAT(t.shards().num_runs(), ElementsAre(1, 2));
+  EXPECT_THAT(t.shards().num_failures(), ElementsAre(1, 0));
+  EXPECT_THAT(t.shards().num_snaps_executed(), ElementsAre(0, 5));
+  EXPECT_THAT(t.shards().wall_time_ms(), ElementsAre(1000, 6000));
+  EXPECT_THAT(t.shards().cpu_time_ms(), ElementsAre(1000, 1000));
+  EXPECT_THAT(t.shards().max_rss_kb(), ElementsAre(20, 10));
+  EXPECT_THAT(t.shards().exec_time_us(), ElementsAre(0, 10));
+  EXPECT_THAT(t.shards().load_corpus_time_us(), ElementsAre(0, 0));
+  EXPECT_THAT(t.shards().map_corpus_time_us(), ElementsAre(0, 20));
+  EXPECT_THAT(t.shards().verify_checksums_time_us(), ElementsAre(0, 0));
+  EXPECT_THAT(t.cpus().cpu(), ElementsAre(1, 3));
+  EXPECT_THAT(t.cpus().num_runs(), ElementsAre(1, 2));
+  EXPECT_THAT(t.cpus().wall_time_ms(), ElementsAre(4000, 3000));
+
+  // Counters are reset by Take().
+  t = telemetry.Take(start + absl::Seconds(7));
+  EXPECT_EQ(t.interval().seconds(), 2);
+  EXPECT_THAT(t.shards().shard_name(), IsEmpty());
+  EXPECT_THAT(t.cpus().cpu(), IsEmpty());
+}
+
+TEST(ThroughputTelemetry, PerfCounters) {
+  absl::Time start = absl::FromUnixSeconds(1000);
+  ThroughputTelemetry telemetry(start, {"CYCLES", "INSTRUCTIONS"});
+  telemetry.Record("a", 1, {.perf_counter_values = {10, 20}});
+  telemetry.Record("a", 2,
+                   {.perf_counter_values = {1, 2},
+                    .perf_counter_missed_batches = 3});
+  // A runner that did not report the counters, e.g. after a timeout.
+  telemetry.Record("b", 2, {});
+
+  proto::logging::ThroughputTelemetry t =
+      telemetry.Take(start + absl::Seconds(1));
+  ASSERT_EQ(t.shards().perf_counters_size(), 2);
+  EXPECT_EQ(t.shards().perf_counters(0).event(), "CYCLES");
+  EXPECT_THAT(t.shards().perf_counters(0).values(), ElementsAre(11, 0));
+  EXPECT_EQ(t.shards().perf_counters(1).event(), "INSTRUCTIONS");
+  EXPECT_THAT(t.shards().perf_counters(1).values(), ElementsAre(22, 0));
+  EXPECT_THAT(t.shards().perf_counter_missed_batches(), ElementsAre(3, 0));
+  ASSERT_EQ(t.cpus().perf_counters_size(), 2);
+  EXPECT_THAT(t.cpus().perf_counters(0).values(), ElementsAre(10, 1));
+  EXPECT_THAT(t.cpus().perf_counter_missed_batches(), ElementsAre(0, 3));
+
+  // Without events, there are no perf counter columns.
+  ThroughputTelemetry no_events(start);
+  no_events.Record("a", 1, {.perf_counter_values = {10}});
+  t = no_events.Take(start + absl::Seconds(1));
+  EXPECT_THAT(t.shards().perf_counters(), IsEmpty());
+  EXPECT_THAT(t.shards().perf_counter_missed_batches(), IsEmpty());
+}
+
+}  // namespace
+}  // namespace silifuzz
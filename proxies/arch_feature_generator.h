@@ -15,8 +15,13 @@
 #ifndef THIRD_PARTY_SILIFUZZ_PROXIES_ARCH_FEATURE_GENERATOR_H_
 #define THIRD_PARTY_SILIFUZZ_PROXIES_ARCH_FEATURE_GENERATOR_H_
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <limits>
 #include <type_traits>
+#include <vector>
 
 #include "./proxies/user_features.h"
 #include "./util/bitops.h"
@@ -61,6 +66,35 @@ EmitToggleBitFeatures(uint64_t zero_one_domain, uint64_t one_zero_domain,
   return base + NumBits<T>();
 }
 
+// Granularity of the hashed memory features, see
+// ArchFeatureGenerator::FinalMemoryHashed().
+inline constexpr size_t kMemFeatureLineSize = 64;
+
+// Returns true iff the kMemFeatureLineSize bytes at `a` and `b` differ. This
+// is a branch-free OR reduction over 64-bit words that compilers vectorize.
+inline bool MemoryLineDiffers(const uint8_t *a, const uint8_t *b) {
+  uint64_t diff = 0;
+  for (size_t i = 0; i < kMemFeatureLineSize; i += sizeof(uint64_t)) {
+    uint64_t a_word, b_word;
+    memcpy(&a_word, a + i, sizeof(a_word));
+    memcpy(&b_word, b + i, sizeof(b_word));
+    diff |= a_word ^ b_word;
+  }
+  return diff != 0;
+}
+
+// Returns a hash of the kMemFeatureLineSize bytes at `line` and `address`.
+inline uint64_t HashMemoryLine(uint64_t address, const uint8_t *line) {
+  uint64_t hash = address * 0x9e3779b97f4a7c15ULL;
+  for (size_t i = 0; i < kMemFeatureLineSize; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, line + i, sizeof(word));
+    hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
 // Use this instruction ID to indicate than the disassembler failed to make
 // sense of the instruction. This isn't considered a hard failure since
 // disassemblers may be buggy, but any coverage related to the instruction ID
@@ -83,6 +117,7 @@ class ArchFeatureGenerator {
     kOpRegToggleZeroOneDomain = 5,
     kOpRegToggleOneZeroDomain = 6,
     kMemDifferenceDomain = 7,
+    kMemLineHashDomain = 8,
   };
 
   // An internal bookkeeping structure for tracking formation associated with
@@ -118,7 +153,10 @@ class ArchFeatureGenerator {
   void BeforeBatch(uint32_t num_instruction_ids) {
     CHECK_EQ(op_info_, nullptr);
     num_instruction_ids_ = num_instruction_ids;
-    op_info_ = new OpInfo[num_instruction_ids_];
+    // Zeroed once here, after that only the entries of executed instruction
+    // IDs are reset.
+    op_info_ = new OpInfo[num_instruction_ids_]();
+    executed_ids_.reserve(num_instruction_ids_);
   }
 
   // Called before processing each input.
@@ -138,7 +176,10 @@ class ArchFeatureGenerator {
     prev_registers_ = current_registers;
     ClearBits(zero_one_);
     ClearBits(one_zero_);
-    memset(op_info_, 0, sizeof(OpInfo) * num_instruction_ids_);
+    for (uint32_t instruction_id : executed_ids_) {
+      memset(&op_info_[instruction_id], 0, sizeof(OpInfo));
+    }
+    executed_ids_.clear();
   }
 
   // Called after each instruction has been executed.
@@ -148,11 +189,12 @@ class ArchFeatureGenerator {
   void AfterInstruction(uint32_t instruction_id,
                         UContext<Arch> &current_registers) {
     if (instruction_id != kInvalidInstructionId) {
-      CHECK_LT(instruction_id, num_instruction_ids_);
-      op_info_[instruction_id].count++;
+      CountInstruction(instruction_id);
 
       // Defer (instruction X toggle) features because they can be fairly high
       // volume unless deduped.
+      // The simple toggle coverage is the union of the per-op toggles, it is
+      // folded in by AfterExecution() rather than accumulated twice here.
       AccumulateToggle(prev_registers_, current_registers,
                        op_info_[instruction_id].zero_one,
                        op_info_[instruction_id].one_zero);
@@ -164,21 +206,57 @@ class ArchFeatureGenerator {
             kOpPairDomain,
             prev_instruction_id_ * num_instruction_ids_ + instruction_id);
       }
+    } else {
+      // Defer emitting the simple toggle coverage.
+      // The can ~halve the number of features we emit by eliminating
+      // redundancy.
+      AccumulateToggle(prev_registers_, current_registers, zero_one_,
+                       one_zero_);
     }
 
-    // Defer emitting the simple toggle coverage.
-    // The can ~halve the number of features we emit by eliminating redundancy.
-    AccumulateToggle(prev_registers_, current_registers, zero_one_, one_zero_);
-
     // Prepare for the next instruction.
     prev_instruction_id_ = instruction_id;
     prev_registers_ = current_registers;
   }
 
+  // Like AfterInstruction(), but for a run of `num_instructions` instructions
+  // of which only the register state after the last one is known, as when
+  // tracing basic blocks rather than instructions.
+  // Register toggles are observed between runs rather than between
+  // instructions and are not attributed to instruction IDs, so no per-op
+  // register toggle features are emitted for these instructions.
+  // May emit user features.
+  void AfterInstructions(const uint32_t *instruction_ids,
+                         size_t num_instructions,
+                         UContext<Arch> &current_registers) {
+    for (size_t i = 0; i < num_instructions; ++i) {
+      uint32_t instruction_id = instruction_ids[i];
+      if (instruction_id != kInvalidInstructionId) {
+        CountInstruction(instruction_id);
+        if (prev_instruction_id_ != kInvalidInstructionId) {
+          user_features_.EmitFeature(
+              kOpPairDomain,
+              prev_instruction_id_ * num_instruction_ids_ + instruction_id);
+        }
+      }
+      prev_instruction_id_ = instruction_id;
+    }
+
+    AccumulateToggle(prev_registers_, current_registers, zero_one_, one_zero_);
+    prev_registers_ = current_registers;
+  }
+
   // Called after the instruction snippet has stopped executing.
   // Will emit user features based on information that we accumulated during
   // execution.
   void AfterExecution() {
+    // Emit features in instruction ID order, as if all IDs were scanned.
+    std::sort(executed_ids_.begin(), executed_ids_.end());
+    for (uint32_t instruction_id : executed_ids_) {
+      BitOr(zero_one_, op_info_[instruction_id].zero_one, zero_one_);
+      BitOr(one_zero_, op_info_[instruction_id].one_zero, one_zero_);
+    }
+
     // Did the register bit toggle at any point during the execution?
     EmitSetBitFeatures(kRegToggleZeroOneDomain, 0, zero_one_, user_features_);
     EmitSetBitFeatures(kRegToggleOneZeroDomain, 0, one_zero_, user_features_);
@@ -188,19 +266,16 @@ class ArchFeatureGenerator {
                         prev_registers_, user_features_);
 
     // Emit per-op features.
-    for (size_t instruction_id = 0; instruction_id < num_instruction_ids_;
-         ++instruction_id) {
-      if (op_info_[instruction_id].count > 0) {
-        user_features_.EmitFeature(kOpDomain, instruction_id);
-        EmitSetBitFeatures(
-            kOpRegToggleZeroOneDomain,
-            instruction_id * NumBits(op_info_[instruction_id].zero_one),
-            op_info_[instruction_id].zero_one, user_features_);
-        EmitSetBitFeatures(
-            kOpRegToggleOneZeroDomain,
-            instruction_id * NumBits(op_info_[instruction_id].one_zero),
-            op_info_[instruction_id].one_zero, user_features_);
-      }
+    for (uint32_t instruction_id : executed_ids_) {
+      user_features_.EmitFeature(kOpDomain, instruction_id);
+      EmitSetBitFeatures(
+          kOpRegToggleZeroOneDomain,
+          instruction_id * NumBits(op_info_[instruction_id].zero_one),
+          op_info_[instruction_id].zero_one, user_features_);
+      EmitSetBitFeatures(
+          kOpRegToggleOneZeroDomain,
+          instruction_id * NumBits(op_info_[instruction_id].one_zero),
+          op_info_[instruction_id].one_zero, user_features_);
     }
   }
 
@@ -210,14 +285,45 @@ class ArchFeatureGenerator {
   // Note: the type of this function parameter must be declared carefully to
   // avoid type decay. Fixed-sized array parameters can silently decay to
   // pointers and cause problems for the templated bit iterators.
-  // TODO(ncbray): make this a hashed domain with a specified address.
   template <size_t N>
-  void FinalMemory(uint8_t (&page)[N]) {
+  void FinalMemory(const uint8_t (&page)[N]) {
     current_memory_feature_ = EmitSetBitFeatures(
         kMemDifferenceDomain, current_memory_feature_, page, user_features_);
   }
 
+  // A cheaper alternative to FinalMemory(). Compares the final memory `page`
+  // at `address` with its `initial` contents a cache line at a time and emits
+  // one feature for each line that changed, hashed from the address and the
+  // final contents of the line. Unchanged lines cost a few vector compares
+  // and emit nothing, and a changed line emits one feature instead of one
+  // per set bit. Clients should use one of the two functions consistently.
+  template <size_t N>
+  void FinalMemoryHashed(uint64_t address, const uint8_t (&initial)[N],
+                         const uint8_t (&page)[N]) {
+    static_assert(N % kMemFeatureLineSize == 0);
+    for (size_t offset = 0; offset < N; offset += kMemFeatureLineSize) {
+      if (!MemoryLineDiffers(initial + offset, page + offset)) continue;
+      const uint64_t hash = HashMemoryLine(address + offset, page + offset);
+      user_features_.EmitFeature(kMemLineHashDomain,
+                                 hash & ((1ULL << 27) - 1));
+    }
+  }
+
+  // Number of features emitted for the current input so far.
+  size_t num_emitted_features() const {
+    return user_features_.num_emitted_features();
+  }
+
  private:
+  // Counts an execution of `instruction_id`, remembering the IDs that have
+  // been executed so that only their OpInfo needs to be visited.
+  void CountInstruction(uint32_t instruction_id) {
+    CHECK_LT(instruction_id, num_instruction_ids_);
+    if (op_info_[instruction_id].count++ == 0) {
+      executed_ids_.push_back(instruction_id);
+    }
+  }
+
   // Raw user features.
   UserFeatures user_features_;
 
@@ -225,6 +331,10 @@ class ArchFeatureGenerator {
   uint32_t num_instruction_ids_;
   OpInfo *op_info_;
 
+  // IDs with a non-zero count in `op_info_`, in no particular order until
+  // AfterExecution() sorts them.
+  std::vector<uint32_t> executed_ids_;
+
   // Initial register state.
   UContext<Arch> initial_registers_;
 
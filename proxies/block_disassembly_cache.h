@@ -0,0 +1,99 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_PROXIES_BLOCK_DISASSEMBLY_CACHE_H_
+#define THIRD_PARTY_SILIFUZZ_PROXIES_BLOCK_DISASSEMBLY_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "./instruction/disassembler.h"
+#include "./proxies/arch_feature_generator.h"
+#include "./util/checks.h"
+
+namespace silifuzz {
+
+// Caches the instruction IDs of the basic blocks executed by a code snippet,
+// so that a block is disassembled once per input rather than every time it is
+// executed. The cache must be cleared whenever the code may have changed.
+//
+// This class is thread-compatible.
+class BlockDisassemblyCache {
+ public:
+  struct Block {
+    // IDs of the instructions in the block. If an instruction fails to
+    // disassemble, its ID is kInvalidInstructionId and it is the last one
+    // since the size of the instruction is unknown.
+    std::vector<uint32_t> instruction_ids;
+
+    // Number of bytes covered by the disassembled instructions.
+    size_t num_bytes = 0;
+  };
+
+  explicit BlockDisassemblyCache(Disassembler& disasm) : disasm_(disasm) {}
+
+  // Not copyable or movable, refers to the disassembler.
+  BlockDisassemblyCache(const BlockDisassemblyCache&) = delete;
+  BlockDisassemblyCache& operator=(const BlockDisassemblyCache&) = delete;
+
+  void Clear() { blocks_.clear(); }
+
+  // Returns the block of `size` bytes at `address`, disassembling it if it is
+  // not cached. `read_memory(address, buffer, size)` must copy the bytes of
+  // the block into `buffer`.
+  // The returned reference is valid until the next call.
+  template <typename F>
+  const Block& Get(uint64_t address, size_t size, F&& read_memory) {
+    auto [it, inserted] = blocks_.try_emplace(address);
+    Block& block = it->second;
+    if (!inserted) return block;
+
+    bytes_.resize(size);
+    read_memory(address, bytes_.data(), size);
+    // Every instruction is at least one byte long.
+    insns_.resize(size);
+    const size_t num_insns = disasm_.DisassembleMany(
+        address, bytes_.data(), size, insns_.data(), insns_.size());
+    block.instruction_ids.reserve(num_insns);
+    for (size_t i = 0; i < num_insns; ++i) {
+      const Disassembler::InstructionSizeAndID& insn = insns_[i];
+      if (insn.size == 0) {
+        block.instruction_ids.push_back(kInvalidInstructionId);
+        break;
+      }
+      CHECK_LT(insn.id, disasm_.NumInstructionIDs());
+      block.instruction_ids.push_back(insn.id);
+      block.num_bytes += insn.size;
+    }
+    return block;
+  }
+
+ private:
+  Disassembler& disasm_;
+
+  // Blocks keyed by their start address.
+  absl::flat_hash_map<uint64_t, Block> blocks_;
+
+  // Scratch buffer for the bytes of a block.
+  std::vector<uint8_t> bytes_;
+
+  // Scratch buffer for the instructions of a block.
+  std::vector<Disassembler::InstructionSizeAndID> insns_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_PROXIES_BLOCK_DISASSEMBLY_CACHE_H_
@@ -0,0 +1,84 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_PROXIES_INSTRUCTION_ID_CACHE_H_
+#define THIRD_PARTY_SILIFUZZ_PROXIES_INSTRUCTION_ID_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace silifuzz {
+
+// A direct-mapped cache of the disassembly of executed instructions, keyed by
+// address. Loops execute the same instructions many times and disassembling
+// each of them every time is a large part of the cost of tracing.
+// Snippets live in a single page, so indexing by the low bits of the address
+// means the instructions of a snippet never evict each other.
+//
+// This class is thread-compatible.
+class InstructionIdCache {
+ public:
+  struct Entry {
+    uint64_t address;
+    // Entries from an older generation are empty.
+    uint64_t generation;
+    // kInvalidInstructionId if the instruction failed to disassemble.
+    uint32_t instruction_id;
+    // Size of the instruction in bytes.
+    uint32_t size;
+  };
+
+  InstructionIdCache() : entries_(kNumEntries) {}
+
+  // Not copyable, large.
+  InstructionIdCache(const InstructionIdCache&) = delete;
+  InstructionIdCache& operator=(const InstructionIdCache&) = delete;
+
+  // Forgets every instruction. Must be called whenever the code may have been
+  // written, e.g. before running a new snippet.
+  void Clear() { ++generation_; }
+
+  // Returns the cached instruction at `address` or nullptr if there is none.
+  const Entry* Find(uint64_t address) const {
+    const Entry& entry = entries_[address % kNumEntries];
+    if (entry.generation != generation_ || entry.address != address) {
+      return nullptr;
+    }
+    return &entry;
+  }
+
+  // Caches the instruction at `address`, possibly evicting another one.
+  void Insert(uint64_t address, uint32_t instruction_id, uint32_t size) {
+    entries_[address % kNumEntries] = {
+        .address = address,
+        .generation = generation_,
+        .instruction_id = instruction_id,
+        .size = size,
+    };
+  }
+
+ private:
+  // One entry per byte of a 4 KiB page.
+  static constexpr size_t kNumEntries = 4096;
+
+  std::vector<Entry> entries_;
+
+  // Starts above the generation of the value-initialized entries.
+  uint64_t generation_ = 1;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_PROXIES_INSTRUCTION_ID_CACHE_H_
@@ -70,7 +70,11 @@ class PageDescriptorEntry<AArch64> : public BitStruct {
     kShareabilityInnerShareable = 3
   };
 
-  enum type_value { kTypeReserved = 0, kTypePage = 1 };
+  // A type of 0 is reserved in a L3 table and marks a block descriptor in a
+  // L1 or L2 table. Block descriptors otherwise share the page descriptor
+  // layout, with the output address aligned to the size of the block.
+  // Reference: ARM Architecture Reference Manual, Figure D8-14
+  enum type_value { kTypeReserved = 0, kTypeBlock = 0, kTypePage = 1 };
 
   enum uxn_value { kUxnNoEffect = 0, kUxnUnprivilegedExecuteNever = 1 };
 
@@ -18,10 +18,12 @@
 #include <cstdint>
 #include <cstring>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "./common/mapped_memory_map.h"
 #include "./common/memory_mapping.h"
 #include "./common/memory_perms.h"
@@ -32,57 +34,53 @@
 
 namespace silifuzz::proxies {
 
-// static method.
 template <typename arch>
-absl::StatusOr<PageTableCreator<arch>> MemoryStateImage<arch>::LayoutPageTable(
-    const MemoryState& memory_state, uint64_t physical_address,
-    const std::vector<ExternalMapping>& external_mappings, bool copy_data,
-    size_t data_offset, std::vector<uint8_t>& memory_image_data) {
-  PageTableCreator<arch> page_table_creator(physical_address);
+absl::StatusOr<PageTableCreator<arch>>
+MemoryStateImageBuilder<arch>::LayoutPageTable(size_t data_offset) const {
+  PageTableCreator<arch> page_table_creator(physical_address_);
   absl::Status status;
 
   // Build the page table. Assign physical addresses for mapped memory
-  // regions and optionally copy contents to memory images.
-  memory_state.mapped_memory().Iterate([&](MappedMemoryMap::Address start,
-                                           MappedMemoryMap::Address limit,
-                                           MemoryPerms perms) {
-    // Strip mapped bit or constructor below would fail.
-    perms.Clear(MemoryPerms::kMapped);
-    const MemoryMapping mapping =
-        MemoryMapping::MakeRanged(start, limit, perms);
+  // regions, which are laid out in order after the page table.
+  for (const MemoryMapping& mapping : mappings_) {
     status.Update(page_table_creator.AddContiguousMapping(
-        mapping, physical_address + data_offset));
-    if (copy_data) {
-      const std::string byte_data =
-          memory_state.memory_bytes(start, mapping.num_bytes());
-      CHECK_LE(data_offset + byte_data.size(), memory_image_data.size());
-      memcpy(&memory_image_data[data_offset], byte_data.data(),
-             byte_data.size());
-    }
+        mapping, physical_address_ + data_offset));
     data_offset += mapping.num_bytes();
-  });
+  }
 
   // Add external mappings, these have no memory contents inside the image.
-  for (const ExternalMapping& external_mapping : external_mappings) {
+  for (const ExternalMapping& external_mapping : external_mappings_) {
     status.Update(page_table_creator.AddContiguousMapping(
         external_mapping.virtual_memory_mapping,
         external_mapping.physical_start));
   }
 
   RETURN_IF_NOT_OK(status);
-
-  // If copying data, we should reach the end of memory_image_data.
-  if (copy_data) {
-    CHECK_EQ(data_offset, memory_image_data.size());
-  }
   return page_table_creator;
 }
 
-// static method.
 template <typename arch>
-absl::StatusOr<MemoryStateImage<arch>> MemoryStateImage<arch>::Build(
+absl::StatusOr<size_t> MemoryStateImageBuilder<arch>::Prepare(
     const MemoryState& memory_state, uint64_t physical_address,
     const std::vector<ExternalMapping>& external_mappings) {
+  std::vector<MemoryMapping> mappings;
+  memory_state.mapped_memory().Iterate([&](MappedMemoryMap::Address start,
+                                           MappedMemoryMap::Address limit,
+                                           MemoryPerms perms) {
+    // Strip mapped bit or constructor below would fail.
+    perms.Clear(MemoryPerms::kMapped);
+    mappings.push_back(MemoryMapping::MakeRanged(start, limit, perms));
+  });
+  if (has_layout_ && physical_address == physical_address_ &&
+      mappings == mappings_ && external_mappings == external_mappings_) {
+    return image_size_;
+  }
+
+  has_layout_ = false;
+  physical_address_ = physical_address;
+  mappings_ = std::move(mappings);
+  external_mappings_ = external_mappings;
+
   // We need to fit both the page data and contents of the virtual address
   // space in one contiguous block. We use the page table creator to create
   // a page table as a single block of memory and put the virtual address
@@ -93,43 +91,85 @@ absl::StatusOr<MemoryStateImage<arch>> MemoryStateImage<arch>::Build(
   // The first time, we just build the page table to find out its size and thus
   // the starting physical address of the virtual address contents. After we
   // have the size, we then build page table again now that we can layout the
-  // virtual address space contents.
+  // virtual address space contents. Block descriptors depend on the alignment
+  // of physical addresses, so the page table may grow once the contents are
+  // placed. In that case we retry with room for the larger table. The table
+  // is never larger than one that only uses 4KiB pages, so this terminates.
+  // Any room left after the page table is zero padding.
   //
   // There are alternatives to building the table twice.  We could add API in
   // page table creator to adjust physical addresses after a table is created
   // or we can put the virtual pages before page table. In that case page table
   // root is no longer the beginning of block.  We may need to add a header to
   // the block so that the client can find out physical address of the root.
-  std::vector<uint8_t> memory_image_data;
-  ASSIGN_OR_RETURN_IF_NOT_OK(
-      PageTableCreator<arch> page_table_size_measure,
-      LayoutPageTable(memory_state, physical_address, external_mappings,
-                      /*copy_data=*/false,
-                      /*data_offset=*/0, memory_image_data));
-
-  const uint64_t page_table_byte_size =
-      page_table_size_measure.GetBinaryData().size() * sizeof(uint64_t);
-  const size_t memory_image_size =
-      page_table_byte_size + memory_state.num_written_bytes();
-  memory_image_data.resize(memory_image_size);
-
-  // Build the page table again. Assign physical addresses for mapped memory
-  // regions and copy contents to memory images.
+  uint64_t data_offset = 0;
+  while (true) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(PageTableCreator<arch> page_table_creator,
+                               LayoutPageTable(data_offset));
+    const std::vector<uint64_t>& entries = page_table_creator.GetBinaryData();
+    const uint64_t page_table_byte_size = entries.size() * sizeof(uint64_t);
+    if (page_table_byte_size <= data_offset) {
+      page_table_.assign(data_offset, 0);
+      memcpy(page_table_.data(), entries.data(), page_table_byte_size);
+      break;
+    }
+    data_offset = page_table_byte_size;
+  }
+
+  image_size_ = data_offset;
+  for (const MemoryMapping& mapping : mappings_) {
+    image_size_ += mapping.num_bytes();
+  }
+  has_layout_ = true;
+  return image_size_;
+}
+
+template <typename arch>
+void MemoryStateImageBuilder<arch>::WriteImage(
+    const MemoryState& memory_state, absl::Span<uint8_t> buffer) const {
+  CHECK(has_layout_);
+  CHECK_EQ(buffer.size(), image_size_);
+  // All mapped memory must have contents.
+  CHECK_EQ(page_table_.size() + memory_state.num_written_bytes(),
+           image_size_);
+
+  memcpy(buffer.data(), page_table_.data(), page_table_.size());
+  size_t data_offset = page_table_.size();
+  for (const MemoryMapping& mapping : mappings_) {
+    const std::string byte_data =
+        memory_state.memory_bytes(mapping.start_address(), mapping.num_bytes());
+    memcpy(&buffer[data_offset], byte_data.data(), byte_data.size());
+    data_offset += byte_data.size();
+  }
+  CHECK_EQ(data_offset, image_size_);
+}
+
+template <typename arch>
+absl::StatusOr<MemoryStateImage<arch>> MemoryStateImageBuilder<arch>::Build(
+    const MemoryState& memory_state, uint64_t physical_address,
+    const std::vector<ExternalMapping>& external_mappings) {
   ASSIGN_OR_RETURN_IF_NOT_OK(
-      PageTableCreator<arch> page_table_creator,
-      LayoutPageTable(memory_state, physical_address, external_mappings,
-                      /*copy_data=*/true,
-                      /*data_offset=*/page_table_byte_size, memory_image_data));
-
-  CHECK_EQ(page_table_size_measure.GetBinaryData().size(),
-           page_table_creator.GetBinaryData().size());
-  memcpy(memory_image_data.data(), page_table_creator.GetBinaryData().data(),
-         page_table_byte_size);
-
-  return MemoryStateImage<arch>(physical_address, memory_image_data,
-                                physical_address);
+      size_t image_size,
+      Prepare(memory_state, physical_address, external_mappings));
+  std::vector<uint8_t> image_data(image_size);
+  WriteImage(memory_state, absl::MakeSpan(image_data));
+  return MemoryStateImage<arch>(physical_address, std::move(image_data),
+                                page_table_root());
 }
 
+// static method.
+template <typename arch>
+absl::StatusOr<MemoryStateImage<arch>> MemoryStateImage<arch>::Build(
+    const MemoryState& memory_state, uint64_t physical_address,
+    const std::vector<ExternalMapping>& external_mappings) {
+  return MemoryStateImageBuilder<arch>().Build(memory_state, physical_address,
+                                               external_mappings);
+}
+
+template class MemoryStateImageBuilder<AArch64>;
+
+template class MemoryStateImageBuilder<X86_64>;
+
 template class MemoryStateImage<AArch64>;
 
 template class MemoryStateImage<X86_64>;
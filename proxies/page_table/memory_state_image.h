@@ -17,15 +17,21 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <utility>
 #include <vector>
 
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "./common/memory_mapping.h"
 #include "./common/memory_state.h"
 #include "./proxies/page_table/page_table_creator.h"
 
 namespace silifuzz::proxies {
 
+template <typename arch>
+class MemoryStateImageBuilder;
+
 // MemoryStateImage takes a MemoryState object representing a virtual address
 // space and converts it into a contiguous block of physical memory containing
 // both the memory bytes in the virtual address space and an
@@ -44,6 +50,11 @@ class MemoryStateImage {
     MemoryMapping
         virtual_memory_mapping;  // virtual memory region and permission.
     uint64_t physical_start;     // starting physical address.
+
+    bool operator==(const ExternalMapping& other) const {
+      return virtual_memory_mapping == other.virtual_memory_mapping &&
+             physical_start == other.physical_start;
+    }
   };
 
   // Copyable and moveable
@@ -67,29 +78,23 @@ class MemoryStateImage {
   // translations will be included in the image but no physical memory
   // is allocated inside the image.  Returns a memory state image object or an
   // error.
+  // Use a MemoryStateImageBuilder to build images of many memory states.
   static absl::StatusOr<MemoryStateImage> Build(
       const MemoryState& memory_state, uint64_t physical_address,
       const std::vector<ExternalMapping>& external_mappings = {});
 
  private:
+  friend class MemoryStateImageBuilder<arch>;
+
   // Default constructor is private. Object must be created using Build() since
   // a constructor cannot report errors.
-  MemoryStateImage(uint64_t physical_address,
-                   const std::vector<uint8_t>& image_data,
+  MemoryStateImage(uint64_t physical_address, std::vector<uint8_t> image_data,
                    uint64_t page_table_root)
       : physical_address_(physical_address),
-        image_data_(image_data),
+        image_data_(std::move(image_data)),
         page_table_root_(page_table_root) {}
   MemoryStateImage() = default;
 
-  // Helper for Build() to lay out a page table. If 'copy_data' is true,
-  // contents of 'memory_state' is copied to 'memory_image_data', starting
-  // at 'data_offset' in 'memory_image_data'.
-  static absl::StatusOr<PageTableCreator<arch>> LayoutPageTable(
-      const MemoryState& memory_state, uint64_t physical_address,
-      const std::vector<ExternalMapping>& external_mappings, bool copy_data,
-      size_t data_offset, std::vector<uint8_t>& memory_image_data);
-
   // Physical address to load the image. This is also the address of the page
   // table root.
   uint64_t physical_address_;
@@ -101,6 +106,77 @@ class MemoryStateImage {
   uint64_t page_table_root_;
 };
 
+// Builds the images of a sequence of memory states. The page table of an image
+// only depends on the layout of the address space, i.e. the mapped regions,
+// their permissions, the external mappings and the load address, and not on
+// memory contents. The builder keeps the page table of the last layout, so
+// images of memory states sharing a layout, like fuzzing inputs made with the
+// same FuzzingConfig, only need their memory contents copied.
+//
+// Example:
+//   MemoryStateImageBuilder<X86_64> builder;
+//   ASSIGN_OR_RETURN_IF_NOT_OK(size_t size,
+//                              builder.Prepare(memory_state, load_address));
+//   builder.WriteImage(memory_state, absl::MakeSpan(buffer, size));
+//
+// This class is thread-compatible.
+template <typename arch>
+class MemoryStateImageBuilder {
+ public:
+  using ExternalMapping = typename MemoryStateImage<arch>::ExternalMapping;
+
+  MemoryStateImageBuilder() = default;
+  ~MemoryStateImageBuilder() = default;
+
+  // Copyable and moveable.
+  MemoryStateImageBuilder(const MemoryStateImageBuilder&) = default;
+  MemoryStateImageBuilder& operator=(const MemoryStateImageBuilder&) = default;
+  MemoryStateImageBuilder(MemoryStateImageBuilder&&) = default;
+  MemoryStateImageBuilder& operator=(MemoryStateImageBuilder&&) = default;
+
+  // Prepares to write the image of 'memory_state', to be loaded at
+  // 'physical_address' with 'external_mappings' (see MemoryStateImage::Build()
+  // for details). The page table is only rebuilt if the layout differs from
+  // that of the previous call. Returns the byte size of the image or an error.
+  absl::StatusOr<size_t> Prepare(
+      const MemoryState& memory_state, uint64_t physical_address,
+      const std::vector<ExternalMapping>& external_mappings = {});
+
+  // Writes the image of 'memory_state' into 'buffer'. 'memory_state' must have
+  // the layout of the last successful Prepare() call and 'buffer' must be of
+  // the size it returned.
+  void WriteImage(const MemoryState& memory_state,
+                  absl::Span<uint8_t> buffer) const;
+
+  // Convenience method that calls Prepare() and WriteImage() to return a new
+  // MemoryStateImage or an error.
+  absl::StatusOr<MemoryStateImage<arch>> Build(
+      const MemoryState& memory_state, uint64_t physical_address,
+      const std::vector<ExternalMapping>& external_mappings = {});
+
+  // Physical address of the page table root of the prepared layout.
+  uint64_t page_table_root() const { return physical_address_; }
+
+ private:
+  // Lays out a page table for the current layout with memory contents
+  // starting at 'data_offset' in the image.
+  absl::StatusOr<PageTableCreator<arch>> LayoutPageTable(
+      size_t data_offset) const;
+
+  // Virtual address space layout of the cached page table. 'mappings_' are
+  // the mapped regions of the memory state in address order.
+  bool has_layout_ = false;
+  uint64_t physical_address_ = 0;
+  std::vector<MemoryMapping> mappings_;
+  std::vector<ExternalMapping> external_mappings_;
+
+  // Binary page table for the layout. Memory contents follow it in the image.
+  std::vector<uint8_t> page_table_;
+
+  // Byte size of the image.
+  size_t image_size_ = 0;
+};
+
 }  // namespace silifuzz::proxies
 
 #endif  // THIRD_PARTY_SILIFUZZ_PROXIES_PAGE_TABLE_MEMORY_STATE_IMAGE_H_
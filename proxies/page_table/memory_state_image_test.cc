@@ -22,6 +22,7 @@
 
 #include "gtest/gtest.h"
 #include "absl/cleanup/cleanup.h"
+#include "absl/types/span.h"
 #include "./common/memory_mapping.h"
 #include "./common/memory_perms.h"
 #include "./common/memory_state.h"
@@ -129,7 +130,46 @@ TYPED_TEST_P(MemoryStateImageTest, BasicTest) {
   EXPECT_FALSE(is_in_range(external_addr.value()));
 }
 
-REGISTER_TYPED_TEST_SUITE_P(MemoryStateImageTest, BasicTest);
+// Images from a builder match those built from scratch, whether or not the
+// layout changes between memory states.
+TYPED_TEST_P(MemoryStateImageTest, Builder) {
+  Snapshot s(Snapshot::ArchitectureTypeToEnum<TypeParam>());
+  const Snapshot::ByteSize kPageSize = s.page_size();
+  constexpr Snapshot::Address kCodeAddr = 0x123400000;
+  constexpr Snapshot::Address kDataAddr = 0x567800000;
+  constexpr uint64_t kPhysicalAddress = 0x80000000;
+
+  auto make_memory_state = [&](Snapshot::ByteSize data_size, char fill) {
+    MemoryState memory_state;
+    memory_state.AddNewMemoryMapping(
+        MemoryMapping::MakeSized(kCodeAddr, kPageSize, MemoryPerms::X()));
+    memory_state.SetMemoryBytes(Snapshot::MemoryBytes{
+        kCodeAddr, Snapshot::ByteData(kPageSize, fill)});
+    memory_state.AddNewMemoryMapping(
+        MemoryMapping::MakeSized(kDataAddr, data_size, MemoryPerms::RW()));
+    memory_state.SetMemoryBytes(Snapshot::MemoryBytes{
+        kDataAddr, Snapshot::ByteData(data_size, fill + 1)});
+    return memory_state;
+  };
+
+  MemoryStateImageBuilder<TypeParam> builder;
+  for (const MemoryState &memory_state :
+       {make_memory_state(kPageSize, 'a'), make_memory_state(kPageSize, 'b'),
+        make_memory_state(2 * kPageSize, 'c')}) {
+    ASSERT_OK_AND_ASSIGN(MemoryStateImage<TypeParam> expected,
+                         MemoryStateImage<TypeParam>::Build(memory_state,
+                                                            kPhysicalAddress));
+    ASSERT_OK_AND_ASSIGN(size_t size,
+                         builder.Prepare(memory_state, kPhysicalAddress));
+    ASSERT_EQ(size, expected.image_data().size());
+    std::vector<uint8_t> buffer(size);
+    builder.WriteImage(memory_state, absl::MakeSpan(buffer));
+    EXPECT_EQ(buffer, expected.image_data());
+    EXPECT_EQ(builder.page_table_root(), expected.page_table_root());
+  }
+}
+
+REGISTER_TYPED_TEST_SUITE_P(MemoryStateImageTest, BasicTest, Builder);
 
 INSTANTIATE_TYPED_TEST_SUITE_P(AArch64MemoryStateImageTest,
                                MemoryStateImageTest, AArch64);
@@ -17,6 +17,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <optional>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
@@ -70,16 +72,34 @@ absl::Status PageTableCreator<arch>::AddContiguousMapping(
   bool writeable = mapping.perms().Has(MemoryPerms::kWritable);
   bool executable = mapping.perms().Has(MemoryPerms::kExecutable);
 
-  for (size_t byte_offset = 0; byte_offset < mapping.num_bytes();
-       byte_offset += kTranslationGranule) {
+  size_t byte_offset = 0;
+  while (byte_offset < mapping.num_bytes()) {
     PageTableCreator::DecodedVirtualAddress decoded_va(mapping.start_address() +
                                                        byte_offset);
-    PhysicalAddress decoded_pa(physical_addr + byte_offset);
-    RETURN_IF_NOT_OK(
-        SetupPageDescriptor(decoded_va, decoded_pa, writeable, executable));
-    // Note: We populate entries from L2 -> L0 because we need to populate
-    // next-level table pointers.
-    SetupTableDescriptor(/*level=*/2, decoded_va, writeable, executable);
+    const uint64_t pa = physical_addr + byte_offset;
+    const uint64_t num_bytes_left = mapping.num_bytes() - byte_offset;
+
+    // If an earlier mapping is already covered by a block descriptor, this
+    // mapping must match it up to the end of the block.
+    std::optional<size_t> block_level = FindBlockDescriptorLevel(decoded_va);
+    if (block_level.has_value()) {
+      const uint64_t block_size = EntrySize(*block_level);
+      const uint64_t offset_in_block = decoded_va.value % block_size;
+      RETURN_IF_NOT_OK(SetupPageDescriptor(
+          DecodedVirtualAddress(decoded_va.value - offset_in_block),
+          PhysicalAddress(pa - offset_in_block), *block_level, writeable,
+          executable));
+      byte_offset += std::min(num_bytes_left, block_size - offset_in_block);
+      continue;
+    }
+
+    const size_t level = ChooseLevel(decoded_va, pa, num_bytes_left);
+    RETURN_IF_NOT_OK(SetupPageDescriptor(decoded_va, PhysicalAddress(pa), level,
+                                         writeable, executable));
+    // Note: We populate entries from the level above -> L0 because we need to
+    // populate next-level table pointers.
+    SetupTableDescriptor(level - 1, decoded_va, writeable, executable);
+    byte_offset += EntrySize(level);
   }
   return absl::OkStatus();
 }
@@ -138,16 +158,67 @@ size_t PageTableCreator<arch>::GetPageTableEntryIndex(
   return return_value;
 }
 
+template <typename arch>
+std::optional<size_t> PageTableCreator<arch>::FindPageTableEntryIndex(
+    DecodedVirtualAddress decoded_va, size_t level) const {
+  auto entries_index =
+      page_tables_[level].find(decoded_va.starting_interval[level]);
+  if (entries_index == page_tables_[level].end()) {
+    return std::nullopt;
+  }
+  return entries_index->second + decoded_va.entry_index[level];
+}
+
+template <typename arch>
+std::optional<size_t> PageTableCreator<arch>::FindBlockDescriptorLevel(
+    DecodedVirtualAddress decoded_va) const {
+  for (size_t level = kFirstBlockLevel; level < kNumLevels - 1; ++level) {
+    std::optional<size_t> entry_index =
+        FindPageTableEntryIndex(decoded_va, level);
+    if (!entry_index.has_value()) {
+      break;
+    }
+    if (IsBlockDescriptor<arch>(entries_[*entry_index])) {
+      return level;
+    }
+  }
+  return std::nullopt;
+}
+
+template <typename arch>
+size_t PageTableCreator<arch>::ChooseLevel(DecodedVirtualAddress decoded_va,
+                                           uint64_t physical_addr,
+                                           uint64_t num_bytes) const {
+  for (size_t level = kFirstBlockLevel; level < kNumLevels - 1; ++level) {
+    const uint64_t entry_size = EntrySize(level);
+    if (decoded_va.value % entry_size != 0 ||
+        physical_addr % entry_size != 0 || num_bytes < entry_size) {
+      continue;
+    }
+    // A used entry is a table descriptor, i.e. part of the block is already
+    // mapped with smaller pages.
+    std::optional<size_t> entry_index =
+        FindPageTableEntryIndex(decoded_va, level);
+    if (!entry_index.has_value() || entries_[*entry_index] == 0) {
+      return level;
+    }
+  }
+  return kNumLevels - 1;
+}
+
 template <typename arch>
 absl::Status PageTableCreator<arch>::SetupPageDescriptor(
-    DecodedVirtualAddress decoded_va, PhysicalAddress decoded_pa,
+    DecodedVirtualAddress decoded_va, PhysicalAddress decoded_pa, size_t level,
     bool writeable, bool executable) {
-  size_t entry_index = GetPageTableEntryIndex(decoded_va, /*level=*/3);
+  size_t entry_index = GetPageTableEntryIndex(decoded_va, level);
   uint64_t existing_entry = entries_[entry_index];
   ASSIGN_OR_RETURN_IF_NOT_OK_PLUS(
       uint64_t new_entry,
-      CreatePageDescriptor<arch>(existing_entry, decoded_pa, writeable,
-                                 executable),
+      level == kNumLevels - 1
+          ? CreatePageDescriptor<arch>(existing_entry, decoded_pa, writeable,
+                                       executable)
+          : CreateBlockDescriptor<arch>(existing_entry, decoded_pa, writeable,
+                                        executable),
       absl::StrFormat("Failed to map virtual_address=0x%x", decoded_va.value));
   entries_[entry_index] = new_entry;
   return absl::OkStatus();
@@ -18,6 +18,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <optional>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
@@ -33,6 +34,12 @@ namespace silifuzz::proxies {
 // translation granule size of 4KiB. Should only be used for stage 1 address
 // translation (i.e. no intermediate physical addresses).
 //
+// Regions that are aligned to 2MiB or 1GiB both in virtual and physical
+// address space are mapped with a single block descriptor in the L2 or L1
+// table instead of a table of 4KiB pages. This keeps the page table small for
+// large mappings and shortens page walks. On x86-64 these are 2MB and 1GB
+// pages, the latter require 1GB page support (CPUID.80000001H:EDX.Page1GB).
+//
 // Example:
 //
 // Let's say we want to include a page table in an ELF's .rodata at
@@ -68,6 +75,9 @@ class PageTableCreator {
   // The permission bits of `mapping` specify whether the page table should
   // accept write and unprivileged execute accesses. Returns error if this
   // conflicts with an existing mapping.
+  //
+  // Block descriptors are only used for parts of the mapping that do not
+  // overlap the 4KiB pages of earlier mappings.
   absl::Status AddContiguousMapping(MemoryMapping mapping,
                                     uint64_t physical_addr);
 
@@ -84,6 +94,16 @@ class PageTableCreator {
   // Constant for the four-level page table.
   static constexpr size_t kNumLevels = 4;
 
+  // Highest level that can hold block descriptors. L0 entries can only be
+  // table descriptors with a 4KiB translation granule.
+  static constexpr size_t kFirstBlockLevel = 1;
+
+  // Returns the size of the virtual address interval mapped by one entry at
+  // `level`: 1GiB for L1, 2MiB for L2 and 4KiB for L3.
+  static constexpr uint64_t EntrySize(size_t level) {
+    return kTranslationGranule << (9 * (kNumLevels - 1 - level));
+  }
+
   // Decode the virtual address for easy access to the page tables.
   struct DecodedVirtualAddress {
     // Value of the virtual address.
@@ -111,15 +131,33 @@ class PageTableCreator {
   // Returns the index of the found page table entry in entries_.
   size_t GetPageTableEntryIndex(DecodedVirtualAddress decoded_va, size_t level);
 
-  // Given 4KiB-aligned `decoded_va` and `decoded_pa`, setup the L3 page
-  // descriptor entry with `writeable` and `executable` attributes.
+  // Like GetPageTableEntryIndex() but returns nullopt instead of adding a page
+  // if the page at `level` does not exist.
+  std::optional<size_t> FindPageTableEntryIndex(
+      DecodedVirtualAddress decoded_va, size_t level) const;
+
+  // Returns the level of the block descriptor that maps `decoded_va`, or
+  // nullopt if there is none.
+  std::optional<size_t> FindBlockDescriptorLevel(
+      DecodedVirtualAddress decoded_va) const;
+
+  // Returns the level of the largest entry that can map `decoded_va` to
+  // `physical_addr` as part of a contiguous mapping of `num_bytes` bytes.
+  // This is L3 unless both addresses are aligned to a block, the mapping
+  // covers the whole block and the entry for the block is unused.
+  size_t ChooseLevel(DecodedVirtualAddress decoded_va, uint64_t physical_addr,
+                     uint64_t num_bytes) const;
+
+  // Given `decoded_va` and `decoded_pa` aligned to EntrySize(level), setup the
+  // page descriptor entry at L3 or the block descriptor entry at L1 or L2
+  // with `writeable` and `executable` attributes.
   //
-  // Returns error if the L3 page table entry corresponding to the virtual
+  // Returns error if the page table entry corresponding to the virtual
   // address already contains a mapping to a different physical address or
   // with different writeable/executable permissions.
   absl::Status SetupPageDescriptor(DecodedVirtualAddress decoded_va,
-                                   PhysicalAddress decoded_pa, bool writeable,
-                                   bool executable);
+                                   PhysicalAddress decoded_pa, size_t level,
+                                   bool writeable, bool executable);
 
   // Given a 4KiB-aligned `decoded_va`, setup the specified `level` table
   // descriptor entry with pointers to the correct next table address.
@@ -143,7 +181,8 @@ class PageTableCreator {
   // in memory.
   //
   // Every 512 64-bit entries comprise a 4KiB page. L0-2 entries are next-level
-  // table descriptors while L3 entries are physical page descriptors.
+  // table descriptors while L3 entries are physical page descriptors. L1 and
+  // L2 entries can also be block descriptors. Unused entries are 0.
   std::vector<uint64_t> entries_;
 
   // These sparsely populated hash maps represent the levels of the page table.
@@ -275,13 +275,89 @@ TYPED_TEST_P(PageTableCreatorTest, MakeMappings) {
       /*writeable=*/true, /*executable=*/false));
 }
 
+TYPED_TEST_P(PageTableCreatorTest, UseBlockDescriptors) {
+  constexpr uint64_t kPageSizeInUint64s =
+      PageTableCreator<TypeParam>::kTranslationGranule / sizeof(uint64_t);
+  alignas(PageTableCreator<TypeParam>::kTranslationGranule)
+      uint64_t page_table[kPageSizeInUint64s * 4];
+  PageTableCreator<TypeParam> creator(
+      /*page_table_addr=*/absl::bit_cast<uint64_t>(&page_table));
+
+  // A 1GiB block, a 2MiB block and a 4KiB page. Only the last one needs a L3
+  // page, so the table has 1 page per level.
+  constexpr uint64_t k1GiB = uint64_t{1} << 30;
+  constexpr uint64_t k2MiB = uint64_t{1} << 21;
+  constexpr uint64_t kVirtualAddr = 0x40'0000'0000;
+  constexpr uint64_t kPhysicalAddr = 0x8000'0000;
+  constexpr size_t kSize = k1GiB + k2MiB + 0x1000;
+  ASSERT_OK(creator.AddContiguousMapping(
+      MemoryMapping::MakeSized(kVirtualAddr, kSize, MemoryPerms::RW()),
+      kPhysicalAddr));
+
+  const std::vector<uint64_t> bits = creator.GetBinaryData();
+  EXPECT_EQ(bits.size() * sizeof(uint64_t), sizeof(page_table));
+  memcpy(&page_table, bits.data(), bits.size() * sizeof(uint64_t));
+
+  for (uint64_t offset : {uint64_t{0}, k1GiB - 8, k1GiB + 0x1234,
+                          k1GiB + k2MiB + 0xFFF}) {
+    ASSERT_NO_FATAL_FAILURE(this->CheckTranslatedVirtualAddress(
+        page_table, kVirtualAddr + offset, kPhysicalAddr + offset,
+        /*writeable=*/true, /*executable=*/false));
+  }
+}
+
+TYPED_TEST_P(PageTableCreatorTest, MappingsOverlappingBlockDescriptors) {
+  constexpr uint64_t k2MiB = uint64_t{1} << 21;
+  constexpr uint64_t kVirtualAddr = 0x20'0000;
+  constexpr uint64_t kPhysicalAddr = 0x60'0000;
+
+  PageTableCreator<TypeParam> creator(/*page_table_addr=*/0);
+  ASSERT_OK(creator.AddContiguousMapping(
+      MemoryMapping::MakeSized(kVirtualAddr, k2MiB, MemoryPerms::R()),
+      kPhysicalAddr));
+  const size_t size = creator.GetBinaryData().size();
+
+  // Mappings inside the block must agree with it.
+  ASSERT_OK(creator.AddContiguousMapping(
+      MemoryMapping::MakeSized(kVirtualAddr + 0x3000, 0x2000, MemoryPerms::R()),
+      kPhysicalAddr + 0x3000));
+  EXPECT_EQ(creator.GetBinaryData().size(), size);
+  ASSERT_THAT(creator.AddContiguousMapping(
+                  MemoryMapping::MakeSized(kVirtualAddr + 0x3000, 0x2000,
+                                           MemoryPerms::R()),
+                  kPhysicalAddr),
+              StatusIs(absl::StatusCode::kAlreadyExists));
+  ASSERT_THAT(creator.AddContiguousMapping(
+                  MemoryMapping::MakeSized(kVirtualAddr + 0x3000, 0x2000,
+                                           MemoryPerms::RW()),
+                  kPhysicalAddr + 0x3000),
+              StatusIs(absl::StatusCode::kAlreadyExists));
+
+  // A block is not used over existing 4KiB pages.
+  constexpr uint64_t kVirtualAddr2 = kVirtualAddr + k2MiB;
+  constexpr uint64_t kPhysicalAddr2 = kPhysicalAddr + k2MiB;
+  ASSERT_OK(creator.AddContiguousMapping(
+      MemoryMapping::MakeSized(kVirtualAddr2, 0x1000, MemoryPerms::R()),
+      kPhysicalAddr2));
+  ASSERT_OK(creator.AddContiguousMapping(
+      MemoryMapping::MakeSized(kVirtualAddr2, k2MiB, MemoryPerms::R()),
+      kPhysicalAddr2));
+  ASSERT_THAT(creator.AddContiguousMapping(
+                  MemoryMapping::MakeSized(kVirtualAddr2 + k2MiB - 0x1000,
+                                           0x1000, MemoryPerms::R()),
+                  kPhysicalAddr),
+              StatusIs(absl::StatusCode::kAlreadyExists));
+}
+
 REGISTER_TYPED_TEST_SUITE_P(PageTableCreatorTest, UnalignedPageTableAddress,
                             UnalignedArguments, TooLargeArguments,
                             MappingEndsOutsideOfRange,
                             ConflictingMappingsDifferentAddresses,
                             ConflictingMappingsDifferentPermissions,
                             MappingsMatchingExistingMappingsIgnored,
-                            OnlyInsertPagesWhenNeeded, MakeMappings);
+                            OnlyInsertPagesWhenNeeded, MakeMappings,
+                            UseBlockDescriptors,
+                            MappingsOverlappingBlockDescriptors);
 
 INSTANTIATE_TYPED_TEST_SUITE_P(AArch64PageTableCreatorTest,
                                PageTableCreatorTest, AArch64);
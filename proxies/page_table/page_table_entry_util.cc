@@ -61,6 +61,44 @@ absl::StatusOr<uint64_t> CreatePageDescriptor<AArch64>(
   return new_descriptor.GetEncodedValue();
 }
 
+template <>
+absl::StatusOr<uint64_t> CreateBlockDescriptor<AArch64>(
+    uint64_t existing_entry, PhysicalAddress decoded_pa, bool writeable,
+    bool executable) {
+  PageDescriptorEntry<AArch64> new_descriptor;
+  new_descriptor.set_valid(true);
+  new_descriptor.set_type(PageDescriptorEntry<AArch64>::kTypeBlock);
+  new_descriptor.set_output_address(decoded_pa.physical_address_msbs());
+  if (writeable) {
+    new_descriptor.set_ap_table_write_access(
+        PageDescriptorEntry<AArch64>::kApTableWriteAccessReadWrite);
+  }
+  if (executable) {
+    new_descriptor.set_uxn(PageDescriptorEntry<AArch64>::kUxnNoEffect);
+  }
+
+  // Check that there is no conflict with the existing block descriptor entry.
+  PageDescriptorEntry<AArch64> existing_descriptor(existing_entry);
+  if (existing_descriptor.valid() &&
+      existing_entry != new_descriptor.GetEncodedValue()) {
+    PhysicalAddress decoded_existing_pa;
+    decoded_existing_pa.set_physical_address_msbs(
+        existing_descriptor.output_address());
+    return absl::AlreadyExistsError(absl::StrFormat(
+        "Mapping already exists with existing physical_addr=0x%x",
+        decoded_existing_pa.GetEncodedValue()));
+  }
+
+  return new_descriptor.GetEncodedValue();
+}
+
+template <>
+bool IsBlockDescriptor<AArch64>(uint64_t entry) {
+  PageDescriptorEntry<AArch64> descriptor(entry);
+  return descriptor.valid() &&
+         descriptor.type() == PageDescriptorEntry<AArch64>::kTypeBlock;
+}
+
 template <>
 uint64_t UpdateTableDescriptor<AArch64>(uint64_t existing_entry,
                                         PhysicalAddress next_table_pa,
@@ -123,6 +161,41 @@ absl::StatusOr<uint64_t> CheckPageDescriptor<AArch64>(uint64_t entry,
   return descriptor.output_address();
 }
 
+template <>
+absl::StatusOr<uint64_t> CheckBlockDescriptor<AArch64>(uint64_t entry,
+                                                       bool writeable,
+                                                       bool executable) {
+  PageDescriptorEntry<AArch64> descriptor(entry);
+  if (!descriptor.valid()) {
+    return absl::InvalidArgumentError("Block descriptor entry is invalid.");
+  }
+  if (descriptor.type() != PageDescriptorEntry<AArch64>::kTypeBlock) {
+    return absl::InvalidArgumentError(
+        "Descriptor entry is not for type block.");
+  }
+  if (descriptor.ap_table_unprivileged_access() !=
+      PageDescriptorEntry<AArch64>::kApTableUnprivilegedAccessPermitted) {
+    return absl::InvalidArgumentError(
+        "Block descriptor entry does not permit unprivileged access.");
+  }
+  if (descriptor.pxn() != PageDescriptorEntry<AArch64>::kPxnNoEffect) {
+    return absl::InvalidArgumentError(
+        "Block descriptor entry has effect for pxn table.");
+  }
+  if (writeable &&
+      descriptor.ap_table_write_access() !=
+          PageDescriptorEntry<AArch64>::kApTableWriteAccessReadWrite) {
+    return absl::InvalidArgumentError(
+        "Block descriptor entry is not writeable.");
+  }
+  if (executable &&
+      descriptor.uxn() != PageDescriptorEntry<AArch64>::kUxnNoEffect) {
+    return absl::InvalidArgumentError(
+        "Block descriptor entry is not executable.");
+  }
+  return descriptor.output_address();
+}
+
 template <>
 absl::StatusOr<uint64_t> CheckTableDescriptor<AArch64>(uint64_t entry,
                                                        bool writeable,
@@ -188,6 +261,40 @@ absl::StatusOr<uint64_t> CreatePageDescriptor<X86_64>(
   return new_descriptor.GetEncodedValue();
 }
 
+template <>
+absl::StatusOr<uint64_t> CreateBlockDescriptor<X86_64>(
+    uint64_t existing_entry, PhysicalAddress decoded_pa, bool writeable,
+    bool executable) {
+  PageDescriptorEntry<X86_64> new_descriptor;
+  new_descriptor.set_present(1);
+  new_descriptor.set_page_size(1);
+  new_descriptor.set_physical_address(decoded_pa.physical_address_msbs());
+  new_descriptor.set_read_write(writeable
+                                    ? PageDescriptorEntry<X86_64>::kReadWrite
+                                    : PageDescriptorEntry<X86_64>::kReadOnly);
+  new_descriptor.set_execute_disable(executable ? 0 : 1);
+
+  // Check that there is no conflict with the existing block descriptor entry.
+  PageDescriptorEntry<X86_64> existing_descriptor(existing_entry);
+  if (existing_descriptor.present() &&
+      existing_entry != new_descriptor.GetEncodedValue()) {
+    PhysicalAddress decoded_existing_pa;
+    decoded_existing_pa.set_physical_address_msbs(
+        existing_descriptor.physical_address());
+    return absl::AlreadyExistsError(absl::StrFormat(
+        "Mapping already exists with existing physical_addr=0x%x",
+        decoded_existing_pa.GetEncodedValue()));
+  }
+
+  return new_descriptor.GetEncodedValue();
+}
+
+template <>
+bool IsBlockDescriptor<X86_64>(uint64_t entry) {
+  PageDescriptorEntry<X86_64> descriptor(entry);
+  return descriptor.present() && descriptor.page_size() == 1;
+}
+
 template <>
 uint64_t UpdateTableDescriptor<X86_64>(uint64_t existing_entry,
                                        PhysicalAddress next_table_pa,
@@ -241,6 +348,37 @@ absl::StatusOr<uint64_t> CheckPageDescriptor<X86_64>(uint64_t entry,
   return descriptor.physical_address();
 }
 
+template <>
+absl::StatusOr<uint64_t> CheckBlockDescriptor<X86_64>(uint64_t entry,
+                                                      bool writeable,
+                                                      bool executable) {
+  PageDescriptorEntry<X86_64> descriptor(entry);
+  if (!descriptor.present()) {
+    return absl::InvalidArgumentError("Block descriptor entry is invalid.");
+  }
+  if (descriptor.page_size() != 1) {
+    return absl::InvalidArgumentError(
+        "Descriptor entry does not map a large page.");
+  }
+
+  if (descriptor.user_supervisor() !=
+      PageDescriptorEntry<X86_64>::kUserModeAccessAllowed) {
+    return absl::InvalidArgumentError(
+        "Block descriptor entry does not permit unprivileged access.");
+  }
+
+  if (writeable &&
+      descriptor.read_write() != PageDescriptorEntry<X86_64>::kReadWrite) {
+    return absl::InvalidArgumentError(
+        "Block descriptor entry is not writeable.");
+  }
+  if (executable && descriptor.execute_disable() != 0) {
+    return absl::InvalidArgumentError(
+        "Block descriptor entry is not executable.");
+  }
+  return descriptor.physical_address();
+}
+
 template <>
 absl::StatusOr<uint64_t> CheckTableDescriptor<X86_64>(uint64_t entry,
                                                       bool writeable,
@@ -34,6 +34,24 @@ absl::StatusOr<uint64_t> CreatePageDescriptor(uint64_t existing_entry,
                                               PhysicalAddress decoded_pa,
                                               bool writeable, bool executable);
 
+// Given the physical address that a block should point to, return the value
+// of a block descriptor entry with `writeable` and `executable` attributes.
+// A block descriptor is a leaf entry in a L1 or L2 table that maps a whole
+// 1GiB or 2MiB region, `decoded_pa` must be aligned to the size of the region.
+//
+// Returns error if existing block descriptor entry already contains a
+// conflicting mapping.
+template <typename arch>
+absl::StatusOr<uint64_t> CreateBlockDescriptor(uint64_t existing_entry,
+                                               PhysicalAddress decoded_pa,
+                                               bool writeable,
+                                               bool executable);
+
+// Returns true if `entry` of a L1 or L2 table is a valid block descriptor
+// rather than a table descriptor or an invalid entry.
+template <typename arch>
+bool IsBlockDescriptor(uint64_t entry);
+
 // Given the physical address for the next page table that a table entry
 // should point to, create or modify the existing entry.
 //
@@ -54,6 +72,13 @@ template <typename arch>
 absl::StatusOr<uint64_t> CheckPageDescriptor(uint64_t entry, bool writeable,
                                              bool executable);
 
+// Check that the given block descriptor entry is valid and appropriately
+// `writeable` and `executable`. Return the output address that the
+// descriptor points to.
+template <typename arch>
+absl::StatusOr<uint64_t> CheckBlockDescriptor(uint64_t entry, bool writeable,
+                                              bool executable);
+
 // Check that the given table descriptor entry is valid and appropriately
 // `writeable` and `executable`. Return the next table address that the
 // descriptor points to.
@@ -67,6 +92,12 @@ absl::StatusOr<uint64_t> CreatePageDescriptor<AArch64>(
     uint64_t existing_entry, PhysicalAddress decoded_pa, bool writeable,
     bool executable);
 template <>
+absl::StatusOr<uint64_t> CreateBlockDescriptor<AArch64>(
+    uint64_t existing_entry, PhysicalAddress decoded_pa, bool writeable,
+    bool executable);
+template <>
+bool IsBlockDescriptor<AArch64>(uint64_t entry);
+template <>
 uint64_t UpdateTableDescriptor<AArch64>(uint64_t existing_entry,
                                         PhysicalAddress next_table_pa,
                                         bool writeable, bool executable);
@@ -75,6 +106,10 @@ absl::StatusOr<uint64_t> CheckPageDescriptor<AArch64>(uint64_t entry,
                                                       bool writeable,
                                                       bool executable);
 template <>
+absl::StatusOr<uint64_t> CheckBlockDescriptor<AArch64>(uint64_t entry,
+                                                       bool writeable,
+                                                       bool executable);
+template <>
 absl::StatusOr<uint64_t> CheckTableDescriptor<AArch64>(uint64_t entry,
                                                        bool writeable,
                                                        bool executable);
@@ -85,6 +120,12 @@ absl::StatusOr<uint64_t> CreatePageDescriptor<X86_64>(
     uint64_t existing_entry, PhysicalAddress decoded_pa, bool writeable,
     bool executable);
 template <>
+absl::StatusOr<uint64_t> CreateBlockDescriptor<X86_64>(
+    uint64_t existing_entry, PhysicalAddress decoded_pa, bool writeable,
+    bool executable);
+template <>
+bool IsBlockDescriptor<X86_64>(uint64_t entry);
+template <>
 uint64_t UpdateTableDescriptor<X86_64>(uint64_t existing_entry,
                                        PhysicalAddress next_table_pa,
                                        bool writeable, bool executable);
@@ -93,6 +134,10 @@ absl::StatusOr<uint64_t> CheckPageDescriptor<X86_64>(uint64_t entry,
                                                      bool writeable,
                                                      bool executable);
 template <>
+absl::StatusOr<uint64_t> CheckBlockDescriptor<X86_64>(uint64_t entry,
+                                                      bool writeable,
+                                                      bool executable);
+template <>
 absl::StatusOr<uint64_t> CheckTableDescriptor<X86_64>(uint64_t entry,
                                                       bool writeable,
                                                       bool executable);
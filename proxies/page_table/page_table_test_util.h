@@ -27,10 +27,27 @@ namespace silifuzz::proxies {
 
 // Helpers for page table unit tests.
 
+// Translates `virtual_addr` through the block descriptor `entry` that maps an
+// aligned region of `block_size` bytes. Also checks that `writeable` and
+// `executable` are set properly.
+template <typename arch>
+absl::StatusOr<uint64_t> TranslateBlockAddress(uint64_t entry,
+                                               uint64_t virtual_addr,
+                                               uint64_t block_size,
+                                               bool writeable,
+                                               bool executable) {
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      uint64_t output_addr,
+      CheckBlockDescriptor<arch>(entry, writeable, executable));
+  PhysicalAddress block_pa;
+  block_pa.set_physical_address_msbs(output_addr);
+  return block_pa.GetEncodedValue() + virtual_addr % block_size;
+}
+
 // Given a starting `page_table_addr`, translates the given `virtual_addr` to
 // a physical address. Returns the physical address. Also checks that
 // `writeable` and `executable` are set properly as it traverses the page
-// table levels.
+// table levels. L1 and L2 entries may be block descriptors.
 template <typename arch>
 absl::StatusOr<uint64_t> TranslateVirtualAddress(uint64_t *page_table_addr,
                                                  uint64_t virtual_addr,
@@ -47,6 +64,11 @@ absl::StatusOr<uint64_t> TranslateVirtualAddress(uint64_t *page_table_addr,
   uint64_t *l1_entry_addr =
       reinterpret_cast<uint64_t *>(next_table_pa.GetEncodedValue()) +
       va.table_index_l1();
+  if (IsBlockDescriptor<arch>(*l1_entry_addr)) {
+    return TranslateBlockAddress<arch>(*l1_entry_addr, virtual_addr,
+                                       /*block_size=*/uint64_t{1} << 30,
+                                       writeable, executable);
+  }
 
   ASSIGN_OR_RETURN_IF_NOT_OK(
       uint64_t l2_table_addr,
@@ -55,6 +77,11 @@ absl::StatusOr<uint64_t> TranslateVirtualAddress(uint64_t *page_table_addr,
   uint64_t *l2_entry_addr =
       reinterpret_cast<uint64_t *>(next_table_pa.GetEncodedValue()) +
       va.table_index_l2();
+  if (IsBlockDescriptor<arch>(*l2_entry_addr)) {
+    return TranslateBlockAddress<arch>(*l2_entry_addr, virtual_addr,
+                                       /*block_size=*/uint64_t{1} << 21,
+                                       writeable, executable);
+  }
 
   ASSIGN_OR_RETURN_IF_NOT_OK(
       uint64_t l3_table_addr,
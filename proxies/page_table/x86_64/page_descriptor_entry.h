@@ -29,8 +29,12 @@ class PageDescriptorEntry;
 
 // Represents a page table entry intended to describe a physical page for
 // x86-64. This entry is a 4-level translation setup with 4KB translation
-// granules and 48-bit physical addresses. Although the hardware supports also
-// 2MB and 1GB page sizes, those are not supported here.
+// granules and 48-bit physical addresses.
+//
+// The same layout is used for 2MB and 1GB pages mapped directly by a
+// page-directory entry or a page-directory-pointer-table entry, with the
+// page_size bit set. In those entries the PAT bit moves to bit 12, which is
+// always 0 here since the physical address is aligned to the page size.
 //
 // Reference: Intel 64 and IA-32 Architectures Software Developer’s Manual,
 // Volume 3: System Programming Guide.
@@ -89,6 +93,11 @@ class PageDescriptorEntry<X86_64> : public BitStruct {
   // referenced by this entry.
   SILIFUZZ_PROXY_BIT_STRUCT_FIELD(page_attribute_table, 7, 7)
 
+  // Page size; in a page-directory entry or a page-directory-pointer-table
+  // entry, must be 1 to map a 2-MByte or 1-GByte page. Aliases
+  // page_attribute_table, which is only found in 4-KByte page entries.
+  SILIFUZZ_PROXY_BIT_STRUCT_FIELD(page_size, 7, 7)
+
   // Global; if CR4.PGE = 1, determines whether the translation is global;
   // ignored otherwise
   SILIFUZZ_PROXY_BIT_STRUCT_FIELD(global, 8, 8)
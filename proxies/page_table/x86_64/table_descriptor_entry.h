@@ -31,8 +31,8 @@ class TableDescriptorEntry;
 // x86-64.
 //
 // This entry is a translation setup with 4KB translation granules and 48-bit
-// physical addresses. Although the hardware supports also 2MB and 1GB page
-// sizes, those are not supported here.
+// physical addresses. Entries mapping 2MB and 1GB pages directly are
+// described by PageDescriptorEntry<X86_64> instead.
 //
 // Reference: Intel 64 and IA-32 Architectures Software Developer’s Manual,
 // Volume 3: System Programming Guide.
@@ -87,7 +87,8 @@ class TableDescriptorEntry<X86_64> : public BitStruct {
   // Ignored.
   SILIFUZZ_PROXY_BIT_STRUCT_FIELD(ignored0, 6, 6)
 
-  // Reserved/Not used for 4-kByte page size translation (must be 0).
+  // Page size; must be 0 in a table descriptor. Set in entries mapping 2-MByte
+  // and 1-GByte pages.
   SILIFUZZ_PROXY_BIT_STRUCT_FIELD(page_size, 7, 7)
 
   // Ignored.
@@ -164,10 +164,16 @@ absl::StatusOr<perf_event_type> PerfEventBuffer::NextEventType() const {
 
 absl::StatusOr<PerfEventSampleRecord> PerfEventBuffer::ReadSampleRecord() {
   PerfEventSampleRecord sample_record;
+  RETURN_IF_NOT_OK(ReadSampleRecord(sample_record));
+  return sample_record;
+}
+
+absl::Status PerfEventBuffer::ReadSampleRecord(
+    PerfEventSampleRecord& sample_record) {
   RingBufferView view = GetCurrentView();
   RETURN_IF_NOT_OK(sample_record.Parse(sample_, read_format_, view));
   CommitReads(view);
-  return sample_record;
+  return absl::OkStatus();
 }
 
 }  // namespace silifuzz
@@ -87,6 +87,12 @@ class PerfEventBuffer {
   // Reads a perf sample record or a status.
   absl::StatusOr<PerfEventSampleRecord> ReadSampleRecord();
 
+  // Like above but parses the record into 'sample_record', reusing its
+  // storage. Fields are decoded directly from the ring buffer without copying
+  // the record out first. Contents of 'sample_record' are undefined if an
+  // error is returned.
+  absl::Status ReadSampleRecord(PerfEventSampleRecord& sample_record);
+
  private:
   // Constructor is private. Clients must use factory method Create() instead.
   PerfEventBuffer(perf_event_mmap_page* mmap_page, size_t mmap_size,
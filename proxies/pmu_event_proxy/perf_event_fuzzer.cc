@@ -43,10 +43,11 @@
 #include "./proxies/pmu_event_proxy/perf_event_records.h"
 #include "./proxies/pmu_event_proxy/pmu_events.h"
 #include "./runner/driver/runner_driver.h"
+#include "./runner/driver/runner_options.h"
 #include "./runner/make_snapshot.h"
+#include "./runner/perf_counters.h"
 #include "./util/arch.h"
 #include "./util/checks.h"
-#include "external/libpfm4/include/perfmon/pfmlib.h"
 #include "external/libpfm4/include/perfmon/pfmlib_perf_event.h"
 
 namespace silifuzz {
@@ -109,16 +110,19 @@ absl::Status PerfEventGroup::Destroy(std::unique_ptr<PerfEventGroup> group) {
   return group->CloseAllEvents();
 }
 
+// static
+absl::StatusOr<perf_event_attr> PerfEventGroup::EncodePerfEvent(
+    absl::string_view event) {
+  return EncodePMUEvent(event);
+}
+
 absl::Status PerfEventGroup::AddPerfEvent(absl::string_view event) {
-  perf_event_attr attr{.size = sizeof(perf_event_attr)};
-  pfm_perf_encode_arg_t arg{.attr = &attr,
-                            .size = sizeof(pfm_perf_encode_arg_t)};
-  pfm_err_t err = pfm_get_os_event_encoding(std::string(event).c_str(),
-                                            PFM_PLM3, PFM_OS_PERF_EVENT, &arg);
-  if (err != PFM_SUCCESS) {
-    return absl::InvalidArgumentError(absl::StrCat(
-        "pfm_get_os_event_encoding(", event, ") failed: ", pfm_strerror(err)));
-  }
+  ASSIGN_OR_RETURN_IF_NOT_OK(perf_event_attr attr, EncodePerfEvent(event));
+  return AddPerfEvent(event, attr);
+}
+
+absl::Status PerfEventGroup::AddPerfEvent(absl::string_view event,
+                                          perf_event_attr attr) {
   // Count event in user context only.
   attr.exclude_kernel = 1;
   attr.exclude_hv = 1;
@@ -186,7 +190,11 @@ absl::Status PerfEventFuzzer::CallbackState::InitPerfEvents(
   EventList bad_events;
   absl::Status first_bad_status;
   for (const auto& event : events) {
-    absl::Status status = perf_event_group->AddPerfEvent(event);
+    auto it = event_attr_map->find(event);
+    CHECK(it != event_attr_map->end());
+    absl::Status status =
+        it->second.ok() ? perf_event_group->AddPerfEvent(event, *it->second)
+                        : it->second.status();
     if (!status.ok()) {
       bad_events.push_back(event);
       first_bad_status.Update(status);
@@ -240,7 +248,7 @@ absl::Status PerfEventFuzzer::CallbackState::CleanupPerfEvents() {
 
 void PerfEventFuzzer::CallbackState::UpdateEventCounts(
     const PerfEventSampleRecord& start, const PerfEventSampleRecord& end,
-    IdToCountsMap& id_to_counts_maps) {
+    GroupCounts& counts) {
   // Paranoia check: The two records should have the exact same shape.
   CHECK_EQ(start.sample_type(), end.sample_type());
   CHECK_EQ(start.v().format(), end.v().format());
@@ -256,21 +264,26 @@ void PerfEventFuzzer::CallbackState::UpdateEventCounts(
     return;
   }
 
+  // The kernel reports the values of a group in the order the events were
+  // added, which is also the order of the group's descriptors.
+  CHECK_EQ(end.v().nr(), counts.size());
   for (size_t i = 0; i < end.v().nr(); ++i) {
     const uint64_t id = end.v().id(i);
     // Paranoia check: The kernel should not re-arrange the values
     // between records.
     CHECK_EQ(start.v().id(i), id);
-    std::vector<uint64_t>& counts = id_to_counts_maps[id];
-    counts.push_back(end.v().value(i) - start.v().value(i));
+    CHECK_EQ(perf_event_group->event(i).id, id);
+    counts[i].push_back(end.v().value(i) - start.v().value(i));
   }
 }
 
 absl::Status PerfEventFuzzer::CallbackState::ProcessPerfSamples() {
-  IdToCountsMap id_to_counts_maps;
-  id_to_counts_maps.reserve(perf_event_group->size());
+  GroupCounts counts(perf_event_group->size());
 
   ssize_t record_number = 0;
+  // Records are parsed into these alternately so that their storage is
+  // reused rather than allocated for every record.
+  PerfEventSampleRecord sample_record;
   PerfEventSampleRecord start_sample_record;
   ssize_t start_record_number = -1;
   for (absl::StatusOr<perf_event_type> next_event_type =
@@ -279,22 +292,19 @@ absl::Status PerfEventFuzzer::CallbackState::ProcessPerfSamples() {
        next_event_type = perf_event_buffer->NextEventType()) {
     switch (next_event_type.value()) {
       case PERF_RECORD_SAMPLE: {
-        absl::StatusOr<PerfEventSampleRecord> sample_record =
-            perf_event_buffer->ReadSampleRecord();
-        RETURN_IF_NOT_OK(sample_record.status());
-        if (sample_record->ip() == breakpoint_code_addr_1) {
+        RETURN_IF_NOT_OK(perf_event_buffer->ReadSampleRecord(sample_record));
+        if (sample_record.ip() == breakpoint_code_addr_1) {
           // Save sample record at breakpoint_address_1 so that we can match
           // it with the next record at breakpoint_address_2.
-          start_sample_record = std::move(sample_record.value());
+          std::swap(start_sample_record, sample_record);
           start_record_number = record_number;
-        } else if (sample_record->ip() == breakpoint_code_addr_2) {
+        } else if (sample_record.ip() == breakpoint_code_addr_2) {
           // Drop this measurement if there is anything between the pair of
           // sample records.
           if (record_number < 1 || record_number != start_record_number + 1) {
             break;
           }
-          UpdateEventCounts(start_sample_record, sample_record.value(),
-                            id_to_counts_maps);
+          UpdateEventCounts(start_sample_record, sample_record, counts);
         }
         break;
       }
@@ -311,14 +321,11 @@ absl::Status PerfEventFuzzer::CallbackState::ProcessPerfSamples() {
   for (size_t i = 1 /* skip leader */; i < perf_event_group->size(); ++i) {
     const PerfEventGroup::PerfEventDescriptor& event_descriptor =
         perf_event_group->event(i);
-    // If we failed to open this perf event, counts will be an empty vector.
-    std::vector<uint64_t>& counts = id_to_counts_maps[event_descriptor.id];
     auto it = event_index_map->find(event_descriptor.event);
     CHECK(it != event_index_map->end());
     CHECK_EQ(measurements[it->second].event(), event_descriptor.event);
     measurements[it->second] =
-        PerfEventMeasurements{event_descriptor.event, std::move(counts)};
-    counts.clear();
+        PerfEventMeasurements{event_descriptor.event, std::move(counts[i])};
   }
   return absl::OkStatus();
 }
@@ -375,6 +382,8 @@ PerfEventFuzzer::CallbackState::HarnessTracerCallback(
 absl::Status PerfEventFuzzer::Init() {
   for (size_t i = 0; i < events_.size(); ++i) {
     event_index_map_[events_[i]] = i;
+    event_attr_map_.try_emplace(events_[i],
+                                PerfEventGroup::EncodePerfEvent(events_[i]));
   }
 
   if (options_.schedule_events) {
@@ -391,6 +400,90 @@ absl::Status PerfEventFuzzer::Init() {
   return absl::OkStatus();
 }
 
+absl::StatusOr<PerfEventFuzzer::PerfEventMeasurementList>
+PerfEventFuzzer::CountInRunner(const uint8_t* data, size_t size,
+                               size_t num_iterations) {
+  // No breakpoints are needed, the runner reads the counters right before and
+  // after every snapshot execution.
+  MakingConfig config = MakingConfig::Quick();
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      Snapshot made_snapshot,
+      MakeRawInstructions(
+          absl::string_view(reinterpret_cast<const char*>(data), size),
+          config));
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      RunnerDriver runner_driver,
+      RunnerDriverFromSnapshot(made_snapshot, config.runner_path));
+
+  PerfEventMeasurementList measurements;
+  measurements.reserve(events_.size());
+  for (const Event& event : events_) {
+    measurements.push_back(PerfEventMeasurements{event, {}});
+  }
+
+  for (const EventList& event_group : scheduled_events_) {
+    EventList events;
+    std::vector<RunnerOptions::PerfCounter> counters;
+    for (const Event& event : event_group) {
+      const absl::StatusOr<perf_event_attr>& attr = event_attr_map_.at(event);
+      if (!attr.ok() || attr->config1 != 0 || attr->config2 != 0) {
+        VLOG_INFO(1, "Cannot count ", event, " in the runner");
+        continue;
+      }
+      events.push_back(event);
+      counters.push_back({.type = attr->type, .config = attr->config});
+    }
+
+    // The runner opens its counters once at startup, so every chunk of a
+    // group gets a persistent runner of its own.
+    for (size_t begin = 0; begin < events.size(); begin += kMaxPerfCounters) {
+      const size_t end = std::min(events.size(), begin + kMaxPerfCounters);
+      VLOG_INFO(1, "Counting one event group: ",
+                absl::StrJoin(events.begin() + begin, events.begin() + end,
+                              ", "));
+      ASSIGN_OR_RETURN_IF_NOT_OK(
+          std::unique_ptr<RunnerDriver::PersistentSession> session,
+          runner_driver.StartPersistentSession(
+              RunnerOptions::PlayOptions(made_snapshot.id())
+                  .set_perf_counters({counters.begin() + begin,
+                                      counters.begin() + end})));
+      GroupCounts counts(end - begin);
+      for (size_t i = 0; i < num_iterations; ++i) {
+        // One iteration is one batch, so the runner reports the counts of a
+        // single execution.
+        ASSIGN_OR_RETURN_IF_NOT_OK(RunnerDriver::RunResult run_result,
+                                   session->Run(/*num_iterations=*/1, i));
+        if (!run_result.success()) {
+          return absl::InternalError("Snapshot failed to run.");
+        }
+        // Drop the measurement if the runner could not read the counters,
+        // e.g. because the group was not on the PMU.
+        const std::vector<uint64_t>& values = run_result.perf_counter_values();
+        if (run_result.perf_counter_missed_batches() != 0 ||
+            values.size() != counts.size()) {
+          continue;
+        }
+        for (size_t j = 0; j < values.size(); ++j) {
+          counts[j].push_back(values[j]);
+        }
+      }
+      for (size_t j = 0; j < counts.size(); ++j) {
+        const Event& event = events[begin + j];
+        measurements[event_index_map_.at(event)] =
+            PerfEventMeasurements{event, std::move(counts[j])};
+      }
+    }
+  }
+
+  if (std::all_of(measurements.begin(), measurements.end(),
+                  [](const PerfEventMeasurements& measurements) {
+                    return measurements.counts().empty();
+                  })) {
+    return absl::NotFoundError("No measurements found.");
+  }
+  return measurements;
+}
+
 absl::StatusOr<PerfEventFuzzer::PerfEventMeasurementList>
 PerfEventFuzzer::FuzzOneInput(const uint8_t* data, size_t size,
                               size_t num_iterations) {
@@ -399,6 +492,9 @@ PerfEventFuzzer::FuzzOneInput(const uint8_t* data, size_t size,
     return absl::FailedPreconditionError(absl::StrCat(
         "Failed to initialize PerfEventFuzzer: ", init_status_.message()));
   }
+  if (options_.count_in_runner) {
+    return CountInRunner(data, size, num_iterations);
+  }
 
   // Creates a snapshot using input data.
   // Bracket input with two breakpoints to trigger counter reading.
@@ -432,6 +528,7 @@ PerfEventFuzzer::FuzzOneInput(const uint8_t* data, size_t size,
       start_address + counter_read_trigger.code.size() + size +
       counter_read_trigger.breakpoint_code_offset;
   callback_state.event_index_map = &event_index_map_;
+  callback_state.event_attr_map = &event_attr_map_;
 
   // Construct a runner driver for the single snapshot.  The driver will be
   // re-used multiple times.
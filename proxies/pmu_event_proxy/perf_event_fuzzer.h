@@ -126,12 +126,22 @@ class PerfEventGroup {
   // Destroys 'group' and releases all resources. Returns a status.
   static absl::Status Destroy(std::unique_ptr<PerfEventGroup> group);
 
+  // Returns the perf_event_attr of 'event' as encoded by libpfm4 or a status.
+  // 'event' must be a recognized event name by libpfm4 for the current
+  // platform. Encoding parses the event name, so clients adding the same
+  // events repeatedly should encode them once.
+  static absl::StatusOr<perf_event_attr> EncodePerfEvent(
+      absl::string_view event);
+
   // Adds a non-leading 'event' to this group and returns a status.
   // 'event' must be a recognized event name by libpfm4 for the current
   // platform. The added event is only enabled for user mode. Events
   // happen in kernel or hypervisor context are not counted.
   absl::Status AddPerfEvent(absl::string_view event);
 
+  // Like above but with 'attr' of 'event' from EncodePerfEvent().
+  absl::Status AddPerfEvent(absl::string_view event, perf_event_attr attr);
+
   // Returns a const reference to the 'i'-th events of this. 'i' must be less
   // than number of events. The index is the order in which events are added,
   // with index 0 for the leader event.
@@ -183,6 +193,14 @@ class PerfEventFuzzer {
     // Schedule events to increase parallelism. This only works if
     // events belong to the native PMU of the current CPU.
     bool schedule_events;
+
+    // Count the events inside the runner with rdpmc, see
+    // RunnerOptions::set_perf_counters(), instead of sampling them at
+    // breakpoints while HarnessTracer single-steps the runner. This runs
+    // every measurement at near-native speed. The counts then include the
+    // runner's entry into and exit from the snapshot. Events with extended
+    // encodings, i.e. a non-zero config1 or config2, are not measured.
+    bool count_in_runner = false;
   };
 
   // Constructs a PerfEventFuzzer with 'events' and 'options'.
@@ -214,12 +232,18 @@ class PerfEventFuzzer {
                                           PERF_FORMAT_TOTAL_TIME_ENABLED |
                                           PERF_FORMAT_TOTAL_TIME_RUNNING;
 
-  // Maps sample ID to vector of successive counter measurements.
-  using IdToCountsMap = absl::flat_hash_map<uint64_t, std::vector<uint64_t>>;
+  // Successive counter measurements of each event in a group, indexed like
+  // the events of the group.
+  using GroupCounts = std::vector<std::vector<uint64_t>>;
 
   // Queue of event groups. Events in each group are measured together.
   using WorkQueue = std::queue<EventList>;
 
+  // Maps event names to perf_event_attr from PerfEventGroup::EncodePerfEvent()
+  // or the error encoding them.
+  using EventAttrMap =
+      absl::flat_hash_map<Event, absl::StatusOr<perf_event_attr>>;
+
   // Additional harness callback arguments and states packaged as a struct.
   struct CallbackState {
    public:
@@ -241,10 +265,10 @@ class PerfEventFuzzer {
     absl::Status CleanupPerfEvents();
 
     // Helper of ProcessPerfSamples. Computes diffs of corresponding count
-    // values in 'start' and 'end' and appends the deltas to 'id_to_counts_map'.
+    // values in 'start' and 'end' and appends the deltas to 'counts'.
     void UpdateEventCounts(const PerfEventSampleRecord& start,
                            const PerfEventSampleRecord& end,
-                           IdToCountsMap& id_to_counts_map);
+                           GroupCounts& counts);
 
     // Processes perf samples from currently in the perf event buffer and
     // and appends result to measurements
@@ -268,6 +292,9 @@ class PerfEventFuzzer {
     // Maps event names to indices to measurements.
     const absl::flat_hash_map<Event, size_t>* event_index_map;
 
+    // Maps event names to their encodings.
+    const EventAttrMap* event_attr_map;
+
     // Queue of event groups to be measured.
     WorkQueue work_queue;
 
@@ -293,6 +320,10 @@ class PerfEventFuzzer {
   // Initializes the fuzzer and returns status.
   absl::Status Init();
 
+  // Implements FuzzOneInput() with Options::count_in_runner.
+  absl::StatusOr<PerfEventMeasurementList> CountInRunner(
+      const uint8_t* data, size_t size, size_t num_iterations);
+
   // -------------------------------------------------------------------------
   // Fuzzer state that is unchanged for all inputs.
 
@@ -312,6 +343,11 @@ class PerfEventFuzzer {
   // Map events into indices in events_.
   absl::flat_hash_map<Event, size_t> event_index_map_;
 
+  // Encodings of events_. The event groups are opened again for every input
+  // because the runner process differs, but the encodings do not change.
+  // This is initialized by Init().
+  EventAttrMap event_attr_map_;
+
   // Once flag to ensure Init() is only called once.
   absl::once_flag init_once_flag_;
 };
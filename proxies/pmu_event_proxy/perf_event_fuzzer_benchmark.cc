@@ -0,0 +1,125 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Executions per second of PerfEventFuzzer::FuzzOneInput(), as used by the
+// PMU event proxy.
+//
+// To run:
+//
+// bazel run -c opt \
+//     third_party/silifuzz/proxies/pmu_event_proxy:perf_event_fuzzer_benchmark
+//
+// This needs libpfm4 support for the host CPU and access to perf events.
+// Otherwise the benchmarks are skipped with an error.
+//
+// The per-input work is measured in two cumulative stages, like
+// proxies/unicorn_proxy_benchmark.h does for the Unicorn proxies:
+//
+//   BM_MakeSnapshot   Making the snapshot, i.e. MakeRawInstructions().
+//   BM_FuzzOneInput   The whole FuzzOneInput(), i.e. making the snapshot plus
+//                     running it under the harness tracer once per event
+//                     group and collecting the counters.
+//
+// Both report items_per_second, i.e. executions per second. The difference
+// in time per execution is the time spent measuring.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "./common/snapshot.h"
+#include "./common/snapshot_test_config.h"
+#include "./common/snapshot_test_enum.h"
+#include "./proxies/pmu_event_proxy/perf_event_fuzzer.h"
+#include "./proxies/pmu_event_proxy/pmu_events.h"
+#include "./proxies/util/set_process_dumpable.h"
+#include "./runner/make_snapshot.h"
+#include "./util/arch.h"
+#include "./util/checks.h"
+#include "external/libpfm4/include/perfmon/pfmlib.h"
+
+namespace silifuzz {
+namespace {
+
+// Same as the default --num_iterations of the proxy.
+constexpr size_t kNumIterations = 10;
+
+// Sets up a fuzzer like PMUEventProxyInitialize() does.
+absl::StatusOr<PerfEventFuzzer*> CreateFuzzer() {
+  pfm_err_t init_err = pfm_initialize();
+  if (init_err != PFM_SUCCESS) {
+    return absl::InternalError(
+        absl::StrCat("Failed to initialize libpfm: ", pfm_strerror(init_err)));
+  }
+  RETURN_IF_NOT_OK(proxies::SetProcessDumpable());
+  ASSIGN_OR_RETURN_IF_NOT_OK(PMUEventList events, GetUniqueCPUCorePMUEvents());
+  return new PerfEventFuzzer(events);
+}
+
+// Returns the fuzzer shared by all benchmarks or the error creating it.
+absl::StatusOr<PerfEventFuzzer*> GetFuzzer() {
+  static const absl::StatusOr<PerfEventFuzzer*>* fuzzer =
+      new absl::StatusOr<PerfEventFuzzer*>(CreateFuzzer());
+  return *fuzzer;
+}
+
+// A recorded input that the proxy accepts.
+const std::string& Input() {
+  static const std::string* input = new std::string(
+      GetTestSnippet<Host>(TestSnapshot::kEndsAsExpected));
+  return *input;
+}
+
+void BM_MakeSnapshot(benchmark::State& state) {
+  const absl::StatusOr<PerfEventFuzzer*> fuzzer = GetFuzzer();
+  if (!fuzzer.ok()) {
+    state.SkipWithError(std::string(fuzzer.status().message()).c_str());
+    return;
+  }
+  const MakingConfig config = MakingConfig::Quick();
+  for (auto _ : state) {
+    absl::StatusOr<Snapshot> snapshot = MakeRawInstructions(Input(), config);
+    CHECK_STATUS(snapshot.status());
+    benchmark::DoNotOptimize(snapshot);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MakeSnapshot)->UseRealTime();
+
+void BM_FuzzOneInput(benchmark::State& state) {
+  const absl::StatusOr<PerfEventFuzzer*> fuzzer = GetFuzzer();
+  if (!fuzzer.ok()) {
+    state.SkipWithError(std::string(fuzzer.status().message()).c_str());
+    return;
+  }
+  const std::string& input = Input();
+  for (auto _ : state) {
+    absl::StatusOr<PerfEventFuzzer::PerfEventMeasurementList> measurements =
+        (*fuzzer)->FuzzOneInput(
+            reinterpret_cast<const uint8_t*>(input.data()), input.size(),
+            kNumIterations);
+    CHECK_STATUS(measurements.status());
+    benchmark::DoNotOptimize(measurements);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FuzzOneInput)->UseRealTime();
+
+}  // namespace
+}  // namespace silifuzz
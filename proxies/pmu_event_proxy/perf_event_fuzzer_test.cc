@@ -166,6 +166,18 @@ TEST(PerfEventGroup, BasicTest) {
   EXPECT_EQ(ioctl(sw_cpu_clock_event.fd, PERF_EVENT_IOC_ID, &id), 0);
   EXPECT_EQ(sw_cpu_clock_event.id, id);
 
+  // Add an event from a cached encoding without going through libpfm4 again.
+  constexpr absl::string_view kSWTaskClock = "PERF_COUNT_SW_TASK_CLOCK";
+  ASSERT_OK_AND_ASSIGN(perf_event_attr task_clock_attr,
+                       PerfEventGroup::EncodePerfEvent(kSWTaskClock));
+  EXPECT_OK(group.value()->AddPerfEvent(kSWTaskClock, task_clock_attr));
+  EXPECT_EQ(group.value()->size(), 3);
+  const PerfEventGroup::PerfEventDescriptor& sw_task_clock_event =
+      group.value()->event(2);
+  EXPECT_EQ(sw_task_clock_event.event, kSWTaskClock);
+  EXPECT_GE(sw_task_clock_event.fd, 0);
+  EXPECT_FALSE(PerfEventGroup::EncodePerfEvent("NO_SUCH_EVENT").ok());
+
   // Check closing events.
   EXPECT_OK(PerfEventGroup::Destroy(std::move(group.value())));
 }
@@ -208,6 +220,39 @@ TEST(PerfEventFuzzer, BasicTest) {
   EXPECT_THAT(non_zero_measurements, Gt(0));
 }
 
+TEST(PerfEventFuzzer, CountInRunner) {
+  PerfEventFuzzer::EventList events{
+      "PERF_COUNT_HW_CPU_CYCLES",
+      "PERF_COUNT_HW_INSTRUCTIONS",
+      "PERF_COUNT_HW_BRANCH_INSTRUCTIONS",
+  };
+
+  const std::string ends_as_expected =
+      GetTestSnippet<Host>(TestSnapshot::kEndsAsExpected);
+
+  PerfEventFuzzer::Options options = PerfEventFuzzer::Options::Default();
+  options.schedule_events = false;
+  options.count_in_runner = true;
+  PerfEventFuzzer fuzzer(events, options);
+  constexpr size_t kIterations = 10;
+  ASSERT_OK_AND_ASSIGN(
+      PerfEventFuzzer::PerfEventMeasurementList measurement_list,
+      fuzzer.FuzzOneInput(
+          reinterpret_cast<const uint8_t*>(ends_as_expected.data()),
+          ends_as_expected.size(), kIterations));
+  ASSERT_THAT(measurement_list, SizeIs(Eq(events.size())));
+  for (size_t i = 0; i < events.size(); ++i) {
+    const PerfEventMeasurements& measurements = measurement_list[i];
+    EXPECT_EQ(measurements.event(), events[i]);
+    EXPECT_THAT(measurements.counts(), SizeIs(Le(kIterations)));
+  }
+  // The runner executes instructions of its own between the reads, so every
+  // successful measurement of instructions is non-zero.
+  for (uint64_t count : measurement_list[1].counts()) {
+    EXPECT_THAT(count, Gt(0));
+  }
+}
+
 // This test verifies that the harness tracer callback is only called twice per
 // snapshot execution when single-stepping is not done. The perf event fuzzer
 // makes this assumption.
@@ -60,7 +60,8 @@ class PerfEventReadFormat {
   PerfEventReadFormat& operator=(const PerfEventReadFormat&) = default;
   PerfEventReadFormat& operator=(PerfEventReadFormat&&) = default;
 
-  // Parses data with 'format in 'view' and stores result in this. Returns
+  // Parses data with 'format in 'view' and stores result in this. The storage
+  // of values is reused when this is parsed into repeatedly. Returns
   // a status to tell if parsing succeeded. 'view' is updated to reflect bytes
   // consumed in parsing. If parsing failed, contents of this are undefined
   // and the tail of 'view' points to the point of failure in data.
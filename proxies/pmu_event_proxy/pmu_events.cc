@@ -14,6 +14,8 @@
 
 #include "./proxies/pmu_event_proxy/pmu_events.h"
 
+#include <linux/perf_event.h>
+
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
@@ -31,6 +33,7 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "./util/checks.h"
 #include "./util/x86_cpuid.h"
 #include "external/libpfm4/include/perfmon/pfmlib.h"
@@ -380,4 +383,18 @@ absl::StatusOr<std::vector<PMUEventList>> ScheduleEventsForCounters(
 
   return output_groups;
 }
+
+absl::StatusOr<perf_event_attr> EncodePMUEvent(absl::string_view event) {
+  RETURN_IF_NOT_OK(InitializeIfNecessary());
+  perf_event_attr attr{.size = sizeof(perf_event_attr)};
+  pfm_perf_encode_arg_t arg{.attr = &attr,
+                            .size = sizeof(pfm_perf_encode_arg_t)};
+  const pfm_err_t err = pfm_get_os_event_encoding(
+      std::string(event).c_str(), PFM_PLM3, PFM_OS_PERF_EVENT, &arg);
+  if (err != PFM_SUCCESS) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "pfm_get_os_event_encoding(", event, ") failed: ", pfm_strerror(err)));
+  }
+  return attr;
+}
 }  // namespace silifuzz
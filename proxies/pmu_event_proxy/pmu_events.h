@@ -14,10 +14,13 @@
 
 #ifndef THIRD_PARTY_SILIFUZZ_PROXIES_PMU_EVENT_PROXY_PMU_EVENTS_H_
 #define THIRD_PARTY_SILIFUZZ_PROXIES_PMU_EVENT_PROXY_PMU_EVENTS_H_
+#include <linux/perf_event.h>
+
 #include <string>
 #include <vector>
 
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 
 namespace silifuzz {
 
@@ -35,6 +38,11 @@ absl::StatusOr<PMUEventList> GetUniqueCPUCorePMUEvents();
 absl::StatusOr<std::vector<PMUEventList>> ScheduleEventsForCounters(
     const PMUEventList& events);
 
+// Returns the perf_event_attr encoding of the libpfm4 event name `event`
+// counted in user space only. Only the type, config and privilege level
+// fields are filled in.
+absl::StatusOr<perf_event_attr> EncodePMUEvent(absl::string_view event);
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_PROXIES_PMU_EVENT_PROXY_PMU_EVENTS_H_
@@ -125,5 +125,16 @@ TEST(PMUEvents, ScheduleEventsForCounters) {
   }
 }
 
+TEST(PMUEvents, EncodePMUEvent) {
+  auto events = GetUniqueCPUCorePMUEvents();
+  ASSERT_OK(events);
+  ASSERT_FALSE(events.value().empty());
+  auto attr = EncodePMUEvent(events.value()[0]);
+  ASSERT_OK(attr);
+  EXPECT_EQ(attr.value().size, sizeof(perf_event_attr));
+  EXPECT_EQ(attr.value().exclude_kernel, 1);
+  EXPECT_FALSE(EncodePMUEvent("NO_SUCH_EVENT").ok());
+}
+
 }  // namespace
 }  // namespace silifuzz
@@ -0,0 +1,124 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_PROXIES_SHARDED_BATCH_RUNNER_H_
+#define THIRD_PARTY_SILIFUZZ_PROXIES_SHARDED_BATCH_RUNNER_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/types/span.h"
+#include "./proxies/user_features.h"
+#include "./util/checks.h"
+#include "./util/thread_pool.h"
+
+namespace silifuzz {
+
+// The outcome of executing one input of a batch.
+struct ProxyInputResult {
+  // What LLVMFuzzerTestOneInput() returns for the input: 0 if it was
+  // accepted, -1 if it was rejected.
+  int result = 0;
+
+  // The user features emitted for the input, in emission order.
+  std::vector<user_feature_t> features;
+};
+
+// Executes `inputs` like consecutive LLVMFuzzerTestOneInput() calls would,
+// but spread across `num_threads` threads, and stores the outcome of
+// inputs[i] in results[i]. Each thread has its own tracer, disassembler and
+// feature generator, so one process can use several cores while loading the
+// emulator and disassembler once.
+// `results` must be as long as `inputs`.
+// Implemented by each Unicorn proxy. Not thread-safe.
+void RunProxyBatch(absl::Span<const absl::Span<const uint8_t>> inputs,
+                   int num_threads, absl::Span<ProxyInputResult> results);
+
+// Splits batches of inputs between `num_threads` Workers, one per thread.
+// Worker i always executes the same slice of a batch, and a worker's state
+// only depends on the inputs it has executed, so the results are
+// deterministic for a given number of threads. With a single thread the
+// inputs are executed on the calling thread.
+//
+// `Worker` must be default constructible and provide
+//   void Run(absl::Span<const uint8_t> input, ProxyInputResult& result);
+//
+// This class is thread-compatible.
+template <typename Worker>
+class ShardedBatchRunner {
+ public:
+  explicit ShardedBatchRunner(int num_threads) {
+    num_threads = std::max(1, num_threads);
+    workers_.reserve(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+      workers_.push_back(std::make_unique<Worker>());
+    }
+    if (num_threads > 1) {
+      pool_ = std::make_unique<ThreadPool>(num_threads);
+    }
+  }
+
+  // Not copyable or movable, the worker threads refer to the workers.
+  ShardedBatchRunner(const ShardedBatchRunner&) = delete;
+  ShardedBatchRunner& operator=(const ShardedBatchRunner&) = delete;
+
+  int num_threads() const { return workers_.size(); }
+
+  // Executes `inputs`, see RunProxyBatch().
+  void Run(absl::Span<const absl::Span<const uint8_t>> inputs,
+           absl::Span<ProxyInputResult> results) {
+    CHECK_EQ(inputs.size(), results.size());
+    if (pool_ == nullptr) {
+      RunShard(*workers_[0], inputs, results);
+      return;
+    }
+
+    const size_t num_shards = workers_.size();
+    absl::BlockingCounter done(num_shards);
+    for (size_t i = 0; i < num_shards; ++i) {
+      size_t begin = inputs.size() * i / num_shards;
+      size_t end = inputs.size() * (i + 1) / num_shards;
+      pool_->Schedule([worker = workers_[i].get(),
+                       shard_inputs = inputs.subspan(begin, end - begin),
+                       shard_results = results.subspan(begin, end - begin),
+                       &done]() {
+        RunShard(*worker, shard_inputs, shard_results);
+        done.DecrementCount();
+      });
+    }
+    done.Wait();
+  }
+
+ private:
+  static void RunShard(Worker& worker,
+                       absl::Span<const absl::Span<const uint8_t>> inputs,
+                       absl::Span<ProxyInputResult> results) {
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      worker.Run(inputs[i], results[i]);
+    }
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  // Null if there is a single worker, which then runs on the calling thread.
+  std::unique_ptr<ThreadPool> pool_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_PROXIES_SHARDED_BATCH_RUNNER_H_
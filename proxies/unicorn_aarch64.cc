@@ -12,14 +12,20 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 
 #include "absl/status/status.h"
+#include "absl/types/span.h"
 #include "absl/strings/string_view.h"
 #include "./common/proxy_config.h"
 #include "./instruction/default_disassembler.h"
 #include "./proxies/arch_feature_generator.h"
+#include "./proxies/block_disassembly_cache.h"
+#include "./proxies/instruction_id_cache.h"
+#include "./proxies/sharded_batch_runner.h"
 #include "./proxies/user_features.h"
 #include "./tracing/unicorn_tracer.h"
 #include "./util/arch.h"
@@ -32,7 +38,8 @@ namespace {
 
 // This array lives in an ELF segment that the Centipede runner will read from.
 // In practice, over 25k user features have been observed.
-USER_FEATURE_ARRAY static user_feature_t features[100000];
+constexpr size_t kNumUserFeatures = 100000;
+USER_FEATURE_ARRAY static user_feature_t features[kNumUserFeatures];
 
 // This proxy will be run on a batch of inputs to amortize the cost of creating
 // the process. The number of inputs in a batch is controlled by the caller. We
@@ -45,14 +52,40 @@ USER_FEATURE_ARRAY static user_feature_t features[100000];
 // report, etc.
 // In general, we should try to do work per-batch rather than per-input when it
 // is possible.
+// Each thread executing a sharded batch has its own BatchState, see
+// RunProxyBatch().
 class BatchState {
  public:
-  BatchState() { feature_gen.BeforeBatch(disasm.NumInstructionIDs()); }
+  BatchState()
+      : trace_blocks(getenv("SILIFUZZ_PROXY_TRACE_BLOCKS") != nullptr),
+        hashed_memory_features(
+            getenv("SILIFUZZ_PROXY_HASHED_MEMORY_FEATURES") != nullptr),
+        blocks(disasm) {
+    feature_gen.BeforeBatch(disasm.NumInstructionIDs());
+  }
+
+  // Trace basic blocks rather than instructions. This is much faster but
+  // observes registers only between blocks, so per-instruction register
+  // toggle features are not generated.
+  bool trace_blocks;
+
+  // Emit hashed features for the changed cache lines of the final memory
+  // rather than a feature for each set bit, see
+  // ArchFeatureGenerator::FinalMemoryHashed().
+  bool hashed_memory_features;
 
   DefaultDisassembler<AArch64> disasm;
   ArchFeatureGenerator<AArch64> feature_gen;
+  BlockDisassemblyCache blocks;
+  InstructionIdCache instructions;
+
+  // Reused by every input in the batch, see InitSnippetReusingEngine().
+  UnicornTracer<AArch64> tracer;
 };
 
+// Stop at an arbitrary instruction count to avoid infinite loops.
+constexpr size_t kMaxInstExecuted = 0x1000;
+
 BatchState *batch;
 
 void BeforeBatch() {
@@ -61,8 +94,14 @@ void BeforeBatch() {
 }
 
 absl::Status RunAArch64Instructions(
+    BatchState &state, user_feature_t (&features)[kNumUserFeatures],
     absl::string_view instructions,
     const FuzzingConfig<AArch64> &fuzzing_config, size_t max_inst_executed) {
+  ArchFeatureGenerator<AArch64> &feature_gen = state.feature_gen;
+  // Reset before anything can fail, so that early rejections emit no
+  // features.
+  feature_gen.BeforeInput(features);
+
   // Require at least one instruction.
   if (instructions.size() < 4) {
     return absl::InvalidArgumentError("Input too short");
@@ -72,15 +111,12 @@ absl::Status RunAArch64Instructions(
   // TODO(ncbray) why do atomic ops using the initial stack pointer not fault?
   // 1000000: 787f63fc ldumaxlh    wzr, w28, [sp]
 
-  DefaultDisassembler<AArch64> &disasm = batch->disasm;
-  ArchFeatureGenerator<AArch64> &feature_gen = batch->feature_gen;
+  DefaultDisassembler<AArch64> &disasm = state.disasm;
 
   UnicornTracerConfig<AArch64> tracer_config{.force_a72 = true};
-  UnicornTracer<AArch64> tracer;
-  RETURN_IF_NOT_OK(
-      tracer.InitSnippet(instructions, tracer_config, fuzzing_config));
-
-  feature_gen.BeforeInput(features);
+  UnicornTracer<AArch64> &tracer = state.tracer;
+  RETURN_IF_NOT_OK(tracer.InitSnippetReusingEngine(instructions, tracer_config,
+                                                   fuzzing_config));
 
   UContext<AArch64> registers;
   tracer.GetRegisters(registers);
@@ -100,10 +136,42 @@ absl::Status RunAArch64Instructions(
     }
   };
 
-  tracer.SetInstructionCallback(
-      [&](UnicornTracer<AArch64> *tracer, uint64_t address, size_t max_size) {
-        after_instruction();
+  // When tracing blocks, features are generated after each block instead.
+  BlockDisassemblyCache &blocks = state.blocks;
+  const BlockDisassemblyCache::Block *block = nullptr;
+
+  auto after_block = [&]() {
+    if (block != nullptr) {
+      tracer.GetRegisters(registers);
+      feature_gen.AfterInstructions(block->instruction_ids.data(),
+                                    block->instruction_ids.size(), registers);
+      block = nullptr;
+    }
+  };
 
+  if (state.trace_blocks) {
+    // The code differs from input to input.
+    blocks.Clear();
+    tracer.SetBlockCallback(
+        [&](UnicornTracer<AArch64> *tracer, uint64_t address, uint32_t size) {
+          after_block();
+          auto read_memory = [tracer](uint64_t address, uint8_t *buffer,
+                                      size_t size) {
+            tracer->ReadMemory(address, buffer, size);
+          };
+          block = &blocks.Get(address, size, read_memory);
+        });
+  } else {
+    // The code differs from input to input.
+    InstructionIdCache &cache = state.instructions;
+    cache.Clear();
+    tracer.SetInstructionCallback([&](UnicornTracer<AArch64> *tracer,
+                                      uint64_t address, size_t max_size) {
+      after_instruction();
+
+      if (const InstructionIdCache::Entry *entry = cache.Find(address)) {
+        instruction_id = entry->instruction_id;
+      } else {
         // Read the next instruction.
         uint8_t insn[4];
         CHECK_LE(max_size, sizeof(insn));
@@ -116,15 +184,19 @@ absl::Status RunAArch64Instructions(
         } else {
           instruction_id = kInvalidInstructionId;
         }
+        cache.Insert(address, instruction_id, max_size);
+      }
 
-        instruction_pending = true;
-      });
+      instruction_pending = true;
+    });
+  }
 
   // Stop at an arbitrary instruction count to avoid infinite loops.
   absl::Status status = tracer.Run(max_inst_executed);
 
-  // Flush the last instruction.
+  // Flush the last instruction or block.
   after_instruction();
+  after_block();
 
   feature_gen.AfterExecution();
 
@@ -132,28 +204,73 @@ absl::Status RunAArch64Instructions(
   // The initial state is zero, so we can skip the diff.
   // (The inital stack state is not entirely zero, but close enough.)
   constexpr size_t kMemBytesPerChunk = 4096;
+  // The data mappings are backed by host memory owned by the tracer, so the
+  // final memory is inspected in place.
   uint8_t mem[kMemBytesPerChunk];
+  auto final_memory = [&](uint64_t address) {
+    const uint8_t* host = tracer.HostMemory(address, kMemBytesPerChunk);
+    if (host == nullptr) {
+      tracer.ReadMemory(address, mem, kMemBytesPerChunk);
+      host = mem;
+    }
+    const auto& page =
+        *reinterpret_cast<const uint8_t(*)[kMemBytesPerChunk]>(host);
+    if (state.hashed_memory_features) {
+      static constexpr uint8_t kZeroPage[kMemBytesPerChunk] = {};
+      feature_gen.FinalMemoryHashed(address, kZeroPage, page);
+    } else {
+      feature_gen.FinalMemory(page);
+    }
+  };
 
   // Stack
-  tracer.ReadMemory(fuzzing_config.stack_range.start_address, mem,
-                    kMemBytesPerChunk);
-  feature_gen.FinalMemory(mem);
+  final_memory(fuzzing_config.stack_range.start_address);
 
   // Data 1
-  tracer.ReadMemory(fuzzing_config.data1_range.start_address, mem,
-                    kMemBytesPerChunk);
-  feature_gen.FinalMemory(mem);
+  final_memory(fuzzing_config.data1_range.start_address);
 
   // Data 2
-  tracer.ReadMemory(fuzzing_config.data2_range.start_address, mem,
-                    kMemBytesPerChunk);
-  feature_gen.FinalMemory(mem);
+  final_memory(fuzzing_config.data2_range.start_address);
 
   return status;
 }
 
+// Executes the inputs of one thread of a sharded batch.
+class ProxyWorker {
+ public:
+  void Run(absl::Span<const uint8_t> input, ProxyInputResult &result) {
+    absl::Status status = RunAArch64Instructions(
+        state_, features_,
+        absl::string_view(reinterpret_cast<const char *>(input.data()),
+                          input.size()),
+        DEFAULT_FUZZING_CONFIG<AArch64>, kMaxInstExecuted);
+    if (!status.ok()) {
+      LOG_ERROR(status.message());
+    }
+    result.result = status.ok() ? 0 : -1;
+    result.features.assign(
+        features_, features_ + state_.feature_gen.num_emitted_features());
+  }
+
+ private:
+  BatchState state_;
+
+  // Not read by the Centipede runner, copied into the results instead.
+  user_feature_t features_[kNumUserFeatures];
+};
+
 }  // namespace
 
+void RunProxyBatch(absl::Span<const absl::Span<const uint8_t>> inputs,
+                   int num_threads, absl::Span<ProxyInputResult> results) {
+  static ShardedBatchRunner<ProxyWorker> *runner = nullptr;
+  if (runner == nullptr || runner->num_threads() != std::max(1, num_threads)) {
+    delete runner;
+    runner = new ShardedBatchRunner<ProxyWorker>(num_threads);
+  }
+  runner->Run(inputs, results);
+}
+
 }  // namespace silifuzz
 
 extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv) {
@@ -162,10 +279,11 @@ extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv) {
 }
 
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
-  const size_t max_inst_executed = 0x1000;
   absl::Status status = silifuzz::RunAArch64Instructions(
+      *silifuzz::batch, silifuzz::features,
       absl::string_view(reinterpret_cast<const char *>(data), size),
-      silifuzz::DEFAULT_FUZZING_CONFIG<silifuzz::AArch64>, max_inst_executed);
+      silifuzz::DEFAULT_FUZZING_CONFIG<silifuzz::AArch64>,
+      silifuzz::kMaxInstExecuted);
   if (!status.ok()) {
     LOG_ERROR(status.message());
     return -1;
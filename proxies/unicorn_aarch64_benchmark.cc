@@ -0,0 +1,91 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Executions per second of the aarch64 Unicorn proxy, see
+// unicorn_proxy_benchmark.h for the stages measured.
+//
+// To run:
+//
+// bazel run -c opt third_party/silifuzz/proxies:unicorn_aarch64_benchmark
+//
+// The Proxy stage traces instructions by default. Set
+// SILIFUZZ_PROXY_TRACE_BLOCKS to trace blocks and compare it against
+// BM_Hooks_Block instead of BM_Hooks_Instruction.
+
+#include <cstddef>
+#include <iterator>
+
+#include "benchmark/benchmark.h"
+#include "./proxies/unicorn_proxy_benchmark.h"
+#include "./tracing/unicorn_tracer.h"
+#include "./util/arch.h"
+
+namespace silifuzz {
+namespace {
+
+// Same as the proxy.
+constexpr size_t kMaxInstExecuted = 0x1000;
+constexpr UnicornTracerConfig<AArch64> kTracerConfig{.force_a72 = true};
+
+// Inputs from unicorn_aarch64_test.cc, as little endian instruction words.
+constexpr ProxyBenchmarkInput kInputs[] = {
+    // b0b0b0c0  adrp x0, 0xffffffff62619000
+    // f2194e39  ands x25, x17, #0x7ffff8007ffff80
+    // ca5a2735  eor x21, x25, x26, lsr #9
+    {"multiple_instructions",
+     ProxyBenchmarkBytes("\xc0\xb0\xb0\xb0\x39\x4e\x19\xf2"
+                         "\x35\x27\x5a\xca")},
+    // 14000001  b .+4
+    {"trivial_branch", ProxyBenchmarkBytes("\x01\x00\x00\x14")},
+    // a9bf07e0  stp x0, x1, [sp, #-16]!
+    // a8c107e0  ldp x0, x1, [sp], #16
+    {"stack", ProxyBenchmarkBytes("\xe0\x07\xbf\xa9\xe0\x07\xc1\xa8")},
+    // f90000c0  str x0, [x6]
+    // f94000c0  ldr x0, [x6]
+    {"mem", ProxyBenchmarkBytes("\xc0\x00\x00\xf9\xc0\x00\x40\xf9")},
+    // 6e6edf5a  fmul v26.2d, v26.2d, v14.2d
+    {"floating_point", ProxyBenchmarkBytes("\x5a\xdf\x6e\x6e")},
+};
+constexpr int kNumInputs = std::size(kInputs);
+
+void BM_Init(benchmark::State& state) {
+  ProxyInitLoop<AArch64>(state, kInputs[state.range(0)], kTracerConfig);
+}
+BENCHMARK(BM_Init)->DenseRange(0, kNumInputs - 1);
+
+void BM_Emulate(benchmark::State& state) {
+  ProxyEmulateLoop<AArch64>(state, kInputs[state.range(0)], kTracerConfig,
+                            kMaxInstExecuted, ProxyBenchmarkHook::kNone);
+}
+BENCHMARK(BM_Emulate)->DenseRange(0, kNumInputs - 1);
+
+void BM_Hooks_Instruction(benchmark::State& state) {
+  ProxyEmulateLoop<AArch64>(state, kInputs[state.range(0)], kTracerConfig,
+                            kMaxInstExecuted, ProxyBenchmarkHook::kInstruction);
+}
+BENCHMARK(BM_Hooks_Instruction)->DenseRange(0, kNumInputs - 1);
+
+void BM_Hooks_Block(benchmark::State& state) {
+  ProxyEmulateLoop<AArch64>(state, kInputs[state.range(0)], kTracerConfig,
+                            kMaxInstExecuted, ProxyBenchmarkHook::kBlock);
+}
+BENCHMARK(BM_Hooks_Block)->DenseRange(0, kNumInputs - 1);
+
+void BM_Proxy(benchmark::State& state) {
+  ProxyTestOneInputLoop(state, kInputs[state.range(0)]);
+}
+BENCHMARK(BM_Proxy)->DenseRange(0, kNumInputs - 1);
+
+}  // namespace
+}  // namespace silifuzz
@@ -0,0 +1,127 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_PROXIES_UNICORN_PROXY_BENCHMARK_H_
+#define THIRD_PARTY_SILIFUZZ_PROXIES_UNICORN_PROXY_BENCHMARK_H_
+
+// Executions-per-second benchmarks shared by the Unicorn proxies.
+//
+// The proxy's per-input work is measured in cumulative stages, each a
+// separate benchmark over the same recorded input:
+//
+//   Init      InitSnippetReusingEngine() only.
+//   Emulate   Init plus running the snippet without callbacks.
+//   Hooks     Emulate plus an empty instruction or block callback.
+//   Proxy     The whole LLVMFuzzerTestOneInput(), i.e. Hooks plus
+//             disassembly and feature generation.
+//
+// Every benchmark reports items_per_second, i.e. executions per second. The
+// time of a stage is the difference between its time per execution and that
+// of the previous stage. Measuring the stages separately rather than timing
+// them inside the proxy keeps the proxy itself free of timing code.
+
+#include <cstddef>
+#include <cstdint>
+
+#include "benchmark/benchmark.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "./common/proxy_config.h"
+#include "./tracing/unicorn_tracer.h"
+#include "./util/checks.h"
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+namespace silifuzz {
+
+// A recorded input that the proxy accepts.
+struct ProxyBenchmarkInput {
+  const char *name;
+  absl::string_view bytes;
+};
+
+// Returns the bytes of string literal `s` without the terminating NUL. Unlike
+// absl::string_view(s), this keeps any NUL bytes in the input.
+template <size_t N>
+constexpr absl::string_view ProxyBenchmarkBytes(const char (&s)[N]) {
+  return absl::string_view(s, N - 1);
+}
+
+// Which callback ProxyEmulateLoop() installs.
+enum class ProxyBenchmarkHook {
+  kNone,  // the Emulate stage.
+  kInstruction,
+  kBlock,
+};
+
+// Measures the Init stage of `input`.
+template <typename Arch>
+void ProxyInitLoop(benchmark::State &state, const ProxyBenchmarkInput &input,
+                   const UnicornTracerConfig<Arch> &tracer_config) {
+  UnicornTracer<Arch> tracer;
+  for (auto _ : state) {
+    CHECK_STATUS(tracer.InitSnippetReusingEngine(
+        input.bytes, tracer_config, DEFAULT_FUZZING_CONFIG<Arch>));
+  }
+  state.SetLabel(input.name);
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Measures the Emulate stage of `input`, or the Hooks stage unless `hook` is
+// kNone.
+template <typename Arch>
+void ProxyEmulateLoop(benchmark::State &state,
+                      const ProxyBenchmarkInput &input,
+                      const UnicornTracerConfig<Arch> &tracer_config,
+                      size_t max_inst_executed, ProxyBenchmarkHook hook) {
+  UnicornTracer<Arch> tracer;
+  for (auto _ : state) {
+    // InitSnippetReusingEngine() clears the callbacks of the previous run.
+    CHECK_STATUS(tracer.InitSnippetReusingEngine(
+        input.bytes, tracer_config, DEFAULT_FUZZING_CONFIG<Arch>));
+    if (hook == ProxyBenchmarkHook::kInstruction) {
+      tracer.SetInstructionCallback(
+          [](UnicornTracer<Arch> *, uint64_t address, size_t) {
+            benchmark::DoNotOptimize(address);
+          });
+    } else if (hook == ProxyBenchmarkHook::kBlock) {
+      tracer.SetBlockCallback(
+          [](UnicornTracer<Arch> *, uint64_t address, uint32_t) {
+            benchmark::DoNotOptimize(address);
+          });
+    }
+    CHECK_STATUS(tracer.Run(max_inst_executed));
+  }
+  state.SetLabel(input.name);
+  state.SetItemsProcessed(state.iterations());
+}
+
+// Measures the Proxy stage of `input`.
+inline void ProxyTestOneInputLoop(benchmark::State &state,
+                                  const ProxyBenchmarkInput &input) {
+  // The proxy keeps its per-batch state in a global.
+  static int initialize = LLVMFuzzerInitialize(nullptr, nullptr);
+  (void)initialize;
+  const uint8_t *data = reinterpret_cast<const uint8_t *>(input.bytes.data());
+  for (auto _ : state) {
+    CHECK_EQ(LLVMFuzzerTestOneInput(data, input.bytes.size()), 0);
+  }
+  state.SetLabel(input.name);
+  state.SetItemsProcessed(state.iterations());
+}
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_PROXIES_UNICORN_PROXY_BENCHMARK_H_
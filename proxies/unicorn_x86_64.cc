@@ -15,12 +15,17 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 
 #include "absl/status/status.h"
+#include "absl/types/span.h"
 #include "absl/strings/string_view.h"
 #include "./common/proxy_config.h"
 #include "./instruction/default_disassembler.h"
 #include "./proxies/arch_feature_generator.h"
+#include "./proxies/block_disassembly_cache.h"
+#include "./proxies/instruction_id_cache.h"
+#include "./proxies/sharded_batch_runner.h"
 #include "./proxies/user_features.h"
 #include "./tracing/unicorn_tracer.h"
 #include "./util/arch.h"
@@ -32,7 +37,8 @@ namespace silifuzz {
 namespace {
 
 // This array lives in an ELF segment that the Centipede runner will read from.
-USER_FEATURE_ARRAY static user_feature_t features[100000];
+constexpr size_t kNumUserFeatures = 100000;
+USER_FEATURE_ARRAY static user_feature_t features[kNumUserFeatures];
 
 // This proxy will be run on a batch of inputs to amortize the cost of creating
 // the process. The number of inputs in a batch is controlled by the caller. We
@@ -45,14 +51,40 @@ USER_FEATURE_ARRAY static user_feature_t features[100000];
 // report, etc.
 // In general, we should try to do work per-batch rather than per-input when it
 // is possible.
+// Each thread executing a sharded batch has its own BatchState, see
+// RunProxyBatch().
 class BatchState {
  public:
-  BatchState() { feature_gen.BeforeBatch(disasm.NumInstructionIDs()); }
+  BatchState()
+      : trace_blocks(getenv("SILIFUZZ_PROXY_TRACE_BLOCKS") != nullptr),
+        hashed_memory_features(
+            getenv("SILIFUZZ_PROXY_HASHED_MEMORY_FEATURES") != nullptr),
+        blocks(disasm) {
+    feature_gen.BeforeBatch(disasm.NumInstructionIDs());
+  }
+
+  // Trace basic blocks rather than instructions. This is much faster but
+  // observes registers only between blocks, so per-instruction register
+  // toggle features are not generated.
+  bool trace_blocks;
+
+  // Emit hashed features for the changed cache lines of the final memory
+  // rather than a feature for each set bit, see
+  // ArchFeatureGenerator::FinalMemoryHashed().
+  bool hashed_memory_features;
 
   DefaultDisassembler<X86_64> disasm;
   ArchFeatureGenerator<X86_64> feature_gen;
+  BlockDisassemblyCache blocks;
+  InstructionIdCache instructions;
+
+  // Reused by every input in the batch, see InitSnippetReusingEngine().
+  UnicornTracer<X86_64> tracer;
 };
 
+// Stop at an arbitrary instruction count to avoid infinite loops.
+constexpr size_t kMaxInstExecuted = 1000;
+
 BatchState *batch;
 
 void BeforeBatch() {
@@ -60,18 +92,21 @@ void BeforeBatch() {
   batch = new BatchState();
 }
 
-absl::Status RunInstructions(absl::string_view instructions,
+absl::Status RunInstructions(BatchState &state,
+                             user_feature_t (&features)[kNumUserFeatures],
+                             absl::string_view instructions,
                              const FuzzingConfig<X86_64> &fuzzing_config,
                              size_t max_inst_executed) {
-  DefaultDisassembler<X86_64> &disasm = batch->disasm;
-  ArchFeatureGenerator<X86_64> &feature_gen = batch->feature_gen;
+  DefaultDisassembler<X86_64> &disasm = state.disasm;
+  ArchFeatureGenerator<X86_64> &feature_gen = state.feature_gen;
+  // Reset before anything can fail, so that early rejections emit no
+  // features.
+  feature_gen.BeforeInput(features);
 
   UnicornTracerConfig<X86_64> tracer_config{};
-  UnicornTracer<X86_64> tracer;
-  RETURN_IF_NOT_OK(
-      tracer.InitSnippet(instructions, tracer_config, fuzzing_config));
-
-  feature_gen.BeforeInput(features);
+  UnicornTracer<X86_64> &tracer = state.tracer;
+  RETURN_IF_NOT_OK(tracer.InitSnippetReusingEngine(instructions, tracer_config,
+                                                   fuzzing_config));
 
   UContext<X86_64> registers;
   tracer.GetRegisters(registers);
@@ -93,18 +128,56 @@ absl::Status RunInstructions(absl::string_view instructions,
 
   bool instructions_are_in_range = true;
 
-  tracer.SetInstructionCallback(
-      [&](UnicornTracer<X86_64> *tracer, uint64_t address, size_t max_size) {
-        after_instruction();
+  // When tracing blocks, features are generated after each block instead.
+  BlockDisassemblyCache &blocks = state.blocks;
+  const BlockDisassemblyCache::Block *block = nullptr;
+
+  auto after_block = [&]() {
+    if (block != nullptr) {
+      tracer.GetRegisters(registers);
+      feature_gen.AfterInstructions(block->instruction_ids.data(),
+                                    block->instruction_ids.size(), registers);
+      block = nullptr;
+    }
+  };
 
+  if (state.trace_blocks) {
+    // The code differs from input to input.
+    blocks.Clear();
+    tracer.SetBlockCallback(
+        [&](UnicornTracer<X86_64> *tracer, uint64_t address, uint32_t size) {
+          after_block();
+          auto read_memory = [tracer](uint64_t address, uint8_t *buffer,
+                                      size_t size) {
+            tracer->ReadMemory(address, buffer, size);
+          };
+          block = &blocks.Get(address, size, read_memory);
+          // See the instruction callback below.
+          instructions_are_in_range &=
+              tracer->InstructionIsInRange(address, block->num_bytes);
+        });
+  } else {
+    // The code differs from input to input.
+    InstructionIdCache &cache = state.instructions;
+    cache.Clear();
+    tracer.SetInstructionCallback([&](UnicornTracer<X86_64> *tracer,
+                                      uint64_t address, size_t max_size) {
+      after_instruction();
+
+      size_t instruction_size = 0;
+      if (const InstructionIdCache::Entry *entry = cache.Find(address)) {
+        instruction_id = entry->instruction_id;
+        instruction_size = entry->size;
+      } else {
         // Read the next instruction.
-        // 16 bytes should hold any x86-64 instruction. The actual limit should
-        // be 15 bytes, but keep things as nice powers of two.
+        // 16 bytes should hold any x86-64 instruction. The actual limit
+        // should be 15 bytes, but keep things as nice powers of two.
         uint8_t insn[16];
 
-        // Sometimes Unicorn will invoke this function with an invalid max_size
-        // when it has absolutely no idea what the instruction does. (AVX512 for
-        // example.) It appears to be some sort of error code gone wrong?
+        // Sometimes Unicorn will invoke this function with an invalid
+        // max_size when it has absolutely no idea what the instruction does.
+        // (AVX512 for example.) It appears to be some sort of error code gone
+        // wrong?
         max_size = std::min(max_size, sizeof(insn));
 
         tracer->ReadMemory(address, insn, max_size);
@@ -113,24 +186,32 @@ absl::Status RunInstructions(absl::string_view instructions,
         if (disasm.Disassemble(address, insn, max_size)) {
           instruction_id = disasm.InstructionID();
           CHECK_LT(instruction_id, disasm.NumInstructionIDs());
-          // If an instruction doesn't entirely lie within the code snippet,
-          // we're likely executing an incomplete instruction that includes
-          // bytes immediately after the snippet. We try to filter out this
-          // case because it can make the snippet hard to disassemble.
-          instructions_are_in_range &=
-              tracer->InstructionIsInRange(address, disasm.InstructionSize());
+          instruction_size = disasm.InstructionSize();
         } else {
           instruction_id = kInvalidInstructionId;
         }
-
-        instruction_pending = true;
-      });
+        cache.Insert(address, instruction_id, instruction_size);
+      }
+
+      // If an instruction doesn't entirely lie within the code snippet,
+      // we're likely executing an incomplete instruction that includes
+      // bytes immediately after the snippet. We try to filter out this
+      // case because it can make the snippet hard to disassemble.
+      if (instruction_id != kInvalidInstructionId) {
+        instructions_are_in_range &=
+            tracer->InstructionIsInRange(address, instruction_size);
+      }
+
+      instruction_pending = true;
+    });
+  }
 
   // Stop at an arbitrary instruction count to avoid infinite loops.
   absl::Status status = tracer.Run(max_inst_executed);
 
-  // Flush the last instruction.
+  // Flush the last instruction or block.
   after_instruction();
+  after_block();
 
   feature_gen.AfterExecution();
 
@@ -138,17 +219,30 @@ absl::Status RunInstructions(absl::string_view instructions,
   // The initial state is zero, so we can skip the diff.
   // (The inital stack state is not entirely zero, but close enough.)
   constexpr size_t kMemBytesPerChunk = 8192;
+  // The data mappings are backed by host memory owned by the tracer, so the
+  // final memory is inspected in place.
   uint8_t mem[kMemBytesPerChunk];
+  auto final_memory = [&](uint64_t address) {
+    const uint8_t* host = tracer.HostMemory(address, kMemBytesPerChunk);
+    if (host == nullptr) {
+      tracer.ReadMemory(address, mem, kMemBytesPerChunk);
+      host = mem;
+    }
+    const auto& page =
+        *reinterpret_cast<const uint8_t(*)[kMemBytesPerChunk]>(host);
+    if (state.hashed_memory_features) {
+      static constexpr uint8_t kZeroPage[kMemBytesPerChunk] = {};
+      feature_gen.FinalMemoryHashed(address, kZeroPage, page);
+    } else {
+      feature_gen.FinalMemory(page);
+    }
+  };
 
   // Data 1
-  tracer.ReadMemory(fuzzing_config.data1_range.start_address, mem,
-                    kMemBytesPerChunk);
-  feature_gen.FinalMemory(mem);
+  final_memory(fuzzing_config.data1_range.start_address);
 
   // Data 2
-  tracer.ReadMemory(fuzzing_config.data2_range.start_address, mem,
-                    kMemBytesPerChunk);
-  feature_gen.FinalMemory(mem);
+  final_memory(fuzzing_config.data2_range.start_address);
 
   if (!instructions_are_in_range) {
     return absl::OutOfRangeError(
@@ -158,8 +252,42 @@ absl::Status RunInstructions(absl::string_view instructions,
   return status;
 }
 
+// Executes the inputs of one thread of a sharded batch.
+class ProxyWorker {
+ public:
+  void Run(absl::Span<const uint8_t> input, ProxyInputResult &result) {
+    absl::Status status = RunInstructions(
+        state_, features_,
+        absl::string_view(reinterpret_cast<const char *>(input.data()),
+                          input.size()),
+        DEFAULT_FUZZING_CONFIG<X86_64>, kMaxInstExecuted);
+    if (!status.ok()) {
+      LOG_ERROR(status.message());
+    }
+    result.result = status.ok() ? 0 : -1;
+    result.features.assign(
+        features_, features_ + state_.feature_gen.num_emitted_features());
+  }
+
+ private:
+  BatchState state_;
+
+  // Not read by the Centipede runner, copied into the results instead.
+  user_feature_t features_[kNumUserFeatures];
+};
+
 }  // namespace
 
+void RunProxyBatch(absl::Span<const absl::Span<const uint8_t>> inputs,
+                   int num_threads, absl::Span<ProxyInputResult> results) {
+  static ShardedBatchRunner<ProxyWorker> *runner = nullptr;
+  if (runner == nullptr || runner->num_threads() != std::max(1, num_threads)) {
+    delete runner;
+    runner = new ShardedBatchRunner<ProxyWorker>(num_threads);
+  }
+  runner->Run(inputs, results);
+}
+
 }  // namespace silifuzz
 
 extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv) {
@@ -168,10 +296,11 @@ extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv) {
 }
 
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
-  const size_t max_inst_executed = 1000;
   absl::Status status = silifuzz::RunInstructions(
+      *silifuzz::batch, silifuzz::features,
       absl::string_view(reinterpret_cast<const char *>(data), size),
-      silifuzz::DEFAULT_FUZZING_CONFIG<silifuzz::X86_64>, max_inst_executed);
+      silifuzz::DEFAULT_FUZZING_CONFIG<silifuzz::X86_64>,
+      silifuzz::kMaxInstExecuted);
   if (!status.ok()) {
     LOG_ERROR(status.message());
     return -1;
@@ -0,0 +1,93 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Executions per second of the x86_64 Unicorn proxy, see
+// unicorn_proxy_benchmark.h for the stages measured.
+//
+// To run:
+//
+// bazel run -c opt third_party/silifuzz/proxies:unicorn_x86_64_benchmark
+//
+// The Proxy stage traces instructions by default. Set
+// SILIFUZZ_PROXY_TRACE_BLOCKS to trace blocks and compare it against
+// BM_Hooks_Block instead of BM_Hooks_Instruction.
+
+#include <cstddef>
+#include <iterator>
+
+#include "benchmark/benchmark.h"
+#include "./proxies/unicorn_proxy_benchmark.h"
+#include "./tracing/unicorn_tracer.h"
+#include "./util/arch.h"
+
+namespace silifuzz {
+namespace {
+
+// Same as the proxy.
+constexpr size_t kMaxInstExecuted = 1000;
+constexpr UnicornTracerConfig<X86_64> kTracerConfig{};
+
+// Inputs from unicorn_x86_64_test.cc.
+constexpr ProxyBenchmarkInput kInputs[] = {
+    // nop
+    {"nop", ProxyBenchmarkBytes("\x90")},
+    // xor rcx, rcx
+    // mov cl, 10
+    // loop .
+    {"loop10", ProxyBenchmarkBytes("\x48\x31\xC9\xB1\x0A\xE2\xFE")},
+    // movabs eax,ds:0x1000010000
+    {"read_mapped_mem",
+     ProxyBenchmarkBytes("\xA1\x00\x00\x01\x00\x10\x00\x00\x00")},
+    // mov rcx,0x5
+    // movabs rsi,0x1000010000
+    // mov rax,QWORD PTR [rsi]
+    // add rsi,0x1000
+    // loop 0x11
+    {"read_few_pages",
+     ProxyBenchmarkBytes("\x48\xC7\xC1\x05\x00\x00\x00\x48\xBE\x00\x00\x01"
+                         "\x00\x10\x00\x00\x00\x48\x8B\x06\x48\x81\xC6\x00"
+                         "\x10\x00\x00\xE2\xF4")},
+};
+constexpr int kNumInputs = std::size(kInputs);
+
+void BM_Init(benchmark::State& state) {
+  ProxyInitLoop<X86_64>(state, kInputs[state.range(0)], kTracerConfig);
+}
+BENCHMARK(BM_Init)->DenseRange(0, kNumInputs - 1);
+
+void BM_Emulate(benchmark::State& state) {
+  ProxyEmulateLoop<X86_64>(state, kInputs[state.range(0)], kTracerConfig,
+                           kMaxInstExecuted, ProxyBenchmarkHook::kNone);
+}
+BENCHMARK(BM_Emulate)->DenseRange(0, kNumInputs - 1);
+
+void BM_Hooks_Instruction(benchmark::State& state) {
+  ProxyEmulateLoop<X86_64>(state, kInputs[state.range(0)], kTracerConfig,
+                           kMaxInstExecuted, ProxyBenchmarkHook::kInstruction);
+}
+BENCHMARK(BM_Hooks_Instruction)->DenseRange(0, kNumInputs - 1);
+
+void BM_Hooks_Block(benchmark::State& state) {
+  ProxyEmulateLoop<X86_64>(state, kInputs[state.range(0)], kTracerConfig,
+                           kMaxInstExecuted, ProxyBenchmarkHook::kBlock);
+}
+BENCHMARK(BM_Hooks_Block)->DenseRange(0, kNumInputs - 1);
+
+void BM_Proxy(benchmark::State& state) {
+  ProxyTestOneInputLoop(state, kInputs[state.range(0)]);
+}
+BENCHMARK(BM_Proxy)->DenseRange(0, kNumInputs - 1);
+
+}  // namespace
+}  // namespace silifuzz
@@ -19,6 +19,8 @@
 #include <vector>
 
 #include "gtest/gtest.h"
+#include "absl/types/span.h"
+#include "./proxies/sharded_batch_runner.h"
 
 extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv);
 extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
@@ -101,4 +103,32 @@ TEST(UnicornX86_64, ReadManyPages) {
                          0x10, 0x00, 0x00, 0xE2, 0xF4});
 }
 
+TEST(UnicornX86_64, ShardedBatch) {
+  std::vector<std::vector<uint8_t>> inputs = {
+      {0x90},                                     // nop
+      {0xEB, 0xFE},                               // jmp .
+      {0x48, 0x31, 0xC9, 0xB1, 0x0A, 0xE2, 0xFE},  // Loop10
+      {0x0F, 0xFF},                               // ud0
+      {0xF4},                                     // hlt
+  };
+  std::vector<absl::Span<const uint8_t>> spans(inputs.begin(), inputs.end());
+
+  std::vector<silifuzz::ProxyInputResult> serial(inputs.size());
+  silifuzz::RunProxyBatch(spans, 1, absl::MakeSpan(serial));
+  EXPECT_EQ(serial[0].result, 0);
+  EXPECT_EQ(serial[1].result, -1);
+  EXPECT_EQ(serial[2].result, 0);
+  EXPECT_EQ(serial[3].result, -1);
+  EXPECT_EQ(serial[4].result, 0);
+  EXPECT_FALSE(serial[2].features.empty());
+
+  // Every thread produces the same features as a single one would.
+  std::vector<silifuzz::ProxyInputResult> sharded(inputs.size());
+  silifuzz::RunProxyBatch(spans, 3, absl::MakeSpan(sharded));
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    EXPECT_EQ(sharded[i].result, serial[i].result) << i;
+    EXPECT_EQ(sharded[i].features, serial[i].features) << i;
+  }
+}
+
 }  // namespace
@@ -17,6 +17,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 #include "./util/checks.h"
 
@@ -33,9 +34,19 @@
 // lower 32 bits are the feature within that domain.
 using user_feature_t = uint64_t;
 
+// Writes the user features of an input into the array read by Centipede.
+// A feature emitted several times for the same input is written once, which
+// keeps high volume domains from flooding the array and saves Centipede from
+// processing the duplicates. Features that do not fit in the array are
+// dropped and counted rather than treated as fatal.
 class UserFeatures {
  public:
-  UserFeatures() : features_(nullptr), num_features_(0), current_feature_(0) {}
+  UserFeatures()
+      : features_(nullptr),
+        num_features_(0),
+        current_feature_(0),
+        num_duplicate_features_(0),
+        num_dropped_features_(0) {}
 
   // Disallow copy and move.
   UserFeatures(const UserFeatures&) = delete;
@@ -48,6 +59,22 @@ class UserFeatures {
     features_ = features;
     num_features_ = N;
     current_feature_ = 0;
+    num_duplicate_features_ = 0;
+    num_dropped_features_ = 0;
+
+    // Forget the previous input's features. Only the used slots need to be
+    // cleared.
+    for (size_t slot : used_slots_) {
+      seen_[slot] = 0;
+    }
+    used_slots_.clear();
+    // Keep the table at most half full so probe sequences stay short.
+    size_t table_size = 1;
+    while (table_size < 2 * N) table_size *= 2;
+    if (seen_.size() < table_size) {
+      seen_.assign(table_size, 0);
+      used_slots_.reserve(N);
+    }
   }
 
   void EmitFeature(uint32_t domain, uint32_t feature) {
@@ -63,21 +90,62 @@ class UserFeatures {
     CHECK_LT(domain, 16);
     CHECK_LT(feature, 1ULL << 27);
 
-    // TODO(ncbray): remove this once we're convinced overflows do not occur.
-    CHECK_LT(current_feature_, num_features_);
-
-    // Emit the feature.
-    // Do a modulus for memory safety, but keep track of the actual number of
-    // features in case we need to print it out for debugging purposes.
-    features_[current_feature_ % num_features_] =
-        ((uint64_t)domain) << 32 | feature;
-    current_feature_++;
+    const user_feature_t value = ((uint64_t)domain) << 32 | feature;
+    if (!Insert(value)) {
+      num_duplicate_features_++;
+      return;
+    }
+    if (current_feature_ >= num_features_) {
+      num_dropped_features_++;
+      return;
+    }
+    features_[current_feature_++] = value;
   }
 
+  // Number of distinct features written since the last Reset().
+  size_t num_emitted_features() const { return current_feature_; }
+
+  // Number of features not written since the last Reset() because they had
+  // already been written.
+  size_t num_duplicate_features() const { return num_duplicate_features_; }
+
+  // Number of distinct features not written since the last Reset() because
+  // the array was full.
+  size_t num_dropped_features() const { return num_dropped_features_; }
+
  private:
+  // Adds `value` to the features seen for this input. Returns false if it was
+  // already there.
+  // `value` is never zero: domain 0 features are incremented above. Zero
+  // marks an empty slot.
+  bool Insert(user_feature_t value) {
+    const size_t mask = seen_.size() - 1;
+    // Fibonacci hashing, the table size is a power of two.
+    size_t slot = ((value * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+    while (seen_[slot] != 0) {
+      if (seen_[slot] == value) return false;
+      slot = (slot + 1) & mask;
+    }
+    // Stop remembering features once the table is half full so that probing
+    // always terminates. The array is full by then, so the feature is dropped
+    // either way.
+    if (used_slots_.size() >= seen_.size() / 2) return true;
+    seen_[slot] = value;
+    used_slots_.push_back(slot);
+    return true;
+  }
+
   user_feature_t* features_;
   size_t num_features_;
   size_t current_feature_;
+  size_t num_duplicate_features_;
+  size_t num_dropped_features_;
+
+  // Open addressing hash set of the features seen for the current input.
+  std::vector<user_feature_t> seen_;
+
+  // Slots of `seen_` that are in use.
+  std::vector<size_t> used_slots_;
 };
 
 #endif  // THIRD_PARTY_SILIFUZZ_PROXIES_USER_FEATURES_H_
@@ -0,0 +1,63 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./proxies/user_features.h"
+
+#include <cstdint>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+TEST(UserFeatures, Dedup) {
+  user_feature_t features[8];
+  UserFeatures user_features;
+  user_features.Reset(features);
+
+  user_features.EmitFeature(1, 5);
+  user_features.EmitFeature(2, 5);
+  user_features.EmitFeature(1, 5);
+  user_features.EmitFeature(0, 0);
+  user_features.EmitFeature(0, 0);
+  EXPECT_EQ(user_features.num_emitted_features(), 3);
+  EXPECT_EQ(user_features.num_duplicate_features(), 2);
+  EXPECT_EQ(user_features.num_dropped_features(), 0);
+  EXPECT_EQ(features[0], (uint64_t{1} << 32) | 5);
+  EXPECT_EQ(features[1], (uint64_t{2} << 32) | 5);
+  EXPECT_EQ(features[2], 1);
+
+  // A new input starts from scratch.
+  user_features.Reset(features);
+  user_features.EmitFeature(1, 5);
+  EXPECT_EQ(user_features.num_emitted_features(), 1);
+  EXPECT_EQ(user_features.num_duplicate_features(), 0);
+  EXPECT_EQ(features[0], (uint64_t{1} << 32) | 5);
+}
+
+TEST(UserFeatures, Overflow) {
+  user_feature_t features[4];
+  UserFeatures user_features;
+  user_features.Reset(features);
+
+  for (uint32_t i = 0; i < 100; ++i) {
+    user_features.EmitFeature(3, i);
+  }
+  EXPECT_EQ(user_features.num_emitted_features(), 4);
+  EXPECT_EQ(user_features.num_dropped_features(), 96);
+  for (uint32_t i = 0; i < 4; ++i) {
+    EXPECT_EQ(features[i], (uint64_t{3} << 32) | i);
+  }
+}
+
+}  // namespace
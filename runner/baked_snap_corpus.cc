@@ -0,0 +1,60 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// LoadCorpus() for a runner with a baked-in corpus.
+//
+// The corpus is defined by an assembly source generated by
+// `snap_tool bake_corpus` and linked into the runner. The linker has already
+// resolved all pointers in it, so the corpus is used in place without reading
+// a file or relocating it at run time.
+
+#include <cstdint>
+
+#include "./runner/default_snap_corpus.h"
+#include "./snap/snap.h"
+#include "./snap/snap_relocator.h"
+#include "./util/arch.h"
+#include "./util/checks.h"
+#include "./util/mmapped_memory_ptr.h"
+
+extern "C" const char silifuzz_baked_snap_corpus[];
+extern "C" const uint64_t silifuzz_baked_snap_corpus_size;
+
+namespace silifuzz {
+
+const SnapCorpus<Host>* LoadCorpus(const char* filename, bool verify,
+                                   int* corpus_fd, uintptr_t load_address,
+                                   bool lazy_relocation) {
+  if (filename != nullptr) {
+    LOG_FATAL("Runner has a baked-in corpus, cannot load ", filename);
+  }
+  if (corpus_fd != nullptr) {
+    *corpus_fd = -1;
+  }
+  // The checksum covers the relocatable corpus and cannot be verified after
+  // relocation. Only the header is checked.
+  SnapRelocatorError error;
+  MmappedMemoryPtr<const SnapCorpus<Host>> corpus =
+      SnapRelocator<Host>::AdoptRelocatedCorpus(
+          MakeMmappedMemoryPtr(const_cast<char*>(silifuzz_baked_snap_corpus),
+                               silifuzz_baked_snap_corpus_size),
+          /*verify=*/false, &error);
+  if (error != SnapRelocatorError::kOk) {
+    LOG_FATAL("Bad baked-in corpus, error ", static_cast<int>(error));
+  }
+  // The corpus is not mmapped, it must never be unmapped.
+  return corpus.release();
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,367 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmark of runner startup on large shards.
+//
+// Generates a relocatable shard for each combination of --num_snaps and
+// --snap_data_bytes. Every snapshot is a copy of the kEndsAsExpected test
+// snapshot plus a read-only data mapping of --snap_data_bytes distinct
+// random bytes, so that the relocatable snap generator cannot deduplicate
+// them. Each shard is then loaded --repetitions times, both in this process
+// and by the reading runner. Prints one CSV row per shard. Times are medians
+// over the repetitions, in microseconds:
+//
+//   num_snaps            Snapshots in the shard.
+//   snap_data_bytes      Bytes of the data mapping of each snapshot.
+//   corpus_bytes         Size of the shard file.
+//   read_us              Mapping and populating the file, as
+//                        LoadCorpusFromFile() does before relocating.
+//   relocate_us          SnapRelocator::RelocateCorpus() without verify.
+//   relocate_verify_us   SnapRelocator::RelocateCorpus() with verify.
+//   relocate_lazy_us     SnapRelocator::RelocateCorpusLazily().
+//   load_us              The whole LoadCorpusFromFile(), as in the runner.
+//   runner_load_us       Corpus loading as reported by the runner with
+//   runner_map_us        --report_startup_timings, see
+//   runner_verify_us     proto.RunnerStartupTimings.
+//   first_pass_us        Runner wall time after startup, i.e. executing
+//                        every snap of the shard once in sequential mode.
+//   max_rss_kb           Largest peak RSS of the runner.
+//
+// Usage: corpus_load_benchmark [flags] > results.csv
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "./common/memory_perms.h"
+#include "./common/snapshot.h"
+#include "./common/snapshot_test_enum.h"
+#include "./runner/driver/runner_driver.h"
+#include "./runner/driver/runner_options.h"
+#include "./runner/runner_provider.h"
+#include "./snap/gen/relocatable_snap_generator.h"
+#include "./snap/gen/snap_generator.h"
+#include "./snap/snap.h"
+#include "./snap/snap_corpus_util.h"
+#include "./snap/snap_relocator.h"
+#include "./snap/testing/snap_test_snapshots.h"
+#include "./util/arch.h"
+#include "./util/checks.h"
+#include "./util/mmapped_memory_ptr.h"
+#include "./util/page_util.h"
+#include "./util/path_util.h"
+
+ABSL_FLAG(std::string, runner, "",
+          "Path to the reading runner. Defaults to the runner built with the "
+          "benchmark.");
+ABSL_FLAG(std::vector<std::string>, num_snaps,
+          std::vector<std::string>({"1000", "10000"}),
+          "Numbers of snapshots per shard to benchmark.");
+ABSL_FLAG(std::vector<std::string>, snap_data_bytes,
+          std::vector<std::string>({"0", "65536"}),
+          "Sizes of the data mapping added to each snapshot. Rounded up to "
+          "whole pages.");
+ABSL_FLAG(int, repetitions, 5, "Number of times each shard is loaded.");
+
+namespace silifuzz {
+
+namespace {
+
+// Data mappings of the snapshots are placed one after another from here,
+// away from the code and stack of the test snapshot and from the runner.
+constexpr Snapshot::Address kDataMappingsAddress = 0x4000000000;
+
+// Parses a list of non-negative numbers from a flag.
+absl::StatusOr<std::vector<uint64_t>> ParseNumbers(
+    const std::vector<std::string> &values, absl::string_view flag_name) {
+  std::vector<uint64_t> result;
+  for (const std::string &value : values) {
+    uint64_t n;
+    if (!absl::SimpleAtoi(value, &n)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("--", flag_name, ": bad value ", value));
+    }
+    result.push_back(n);
+  }
+  return result;
+}
+
+// Returns `base` with ID `id` and a read-only mapping of `num_bytes` bytes at
+// `address`, Snapify()-ed. The bytes are random but the same for a given
+// `seed`.
+absl::StatusOr<Snapshot> MakeSnapshot(const Snapshot &base,
+                                      absl::string_view id,
+                                      Snapshot::Address address,
+                                      size_t num_bytes, uint64_t seed) {
+  Snapshot snapshot = base.Copy();
+  snapshot.set_id(std::string(id));
+  if (num_bytes > 0) {
+    const Snapshot::MemoryMapping mapping =
+        Snapshot::MemoryMapping::MakeSized(address, num_bytes,
+                                           MemoryPerms::R());
+    RETURN_IF_NOT_OK(snapshot.can_add_memory_mapping(mapping));
+    snapshot.add_memory_mapping(mapping);
+    // A simple LCG so that the contents are the same for every run.
+    Snapshot::ByteData data(num_bytes, 0);
+    uint64_t state = seed;
+    for (char &byte : data) {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+      byte = static_cast<char>(state >> 56);
+    }
+    Snapshot::MemoryBytes memory_bytes(address, std::move(data));
+    RETURN_IF_NOT_OK(snapshot.can_add_memory_bytes(memory_bytes));
+    snapshot.add_memory_bytes(std::move(memory_bytes));
+  }
+  return Snapify(snapshot,
+                 SnapifyOptions::V2InputRunOpts(Host::architecture_id));
+}
+
+// Writes a relocatable shard of `num_snaps` snapshots with `data_bytes` of
+// data each to a temporary file and returns its path.
+absl::StatusOr<std::string> MakeShard(const Snapshot &base, size_t num_snaps,
+                                      size_t data_bytes) {
+  std::vector<Snapshot> snapshots;
+  snapshots.reserve(num_snaps);
+  for (size_t i = 0; i < num_snaps; ++i) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        Snapshot snapshot,
+        MakeSnapshot(base, absl::StrCat("bench_", i),
+                     kDataMappingsAddress + i * data_bytes, data_bytes, i));
+    snapshots.push_back(std::move(snapshot));
+  }
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      std::string path,
+      CreateTempFile(absl::StrCat("bench_shard_", num_snaps, "_")));
+  const int fd = open(path.c_str(), O_RDWR | O_TRUNC | O_CLOEXEC);
+  if (fd < 0) {
+    const absl::Status status =
+        absl::ErrnoToStatus(errno, absl::StrCat("open ", path));
+    unlink(path.c_str());
+    return status;
+  }
+  const absl::StatusOr<size_t> size =
+      GenerateRelocatableSnapsToFile(Host::architecture_id, snapshots, fd);
+  close(fd);
+  if (!size.ok()) {
+    unlink(path.c_str());
+    return size.status();
+  }
+  return path;
+}
+
+// Maps the file at `path` privately and populates the mapping, like
+// LoadCorpusFromFile() does. Stores the time spent in `*elapsed`.
+MmappedMemoryPtr<char> ReadCorpus(const std::string &path,
+                                  absl::Duration *elapsed) {
+  const absl::Time start = absl::Now();
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  CHECK_NE(fd, -1);
+  const off_t file_size = lseek(fd, 0, SEEK_END);
+  CHECK_NE(file_size, -1);
+  void *mapped = mmap(nullptr, file_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  CHECK_NE(mapped, MAP_FAILED);
+  CHECK_EQ(close(fd), 0);
+  *elapsed = absl::Now() - start;
+  return MakeMmappedMemoryPtr<char>(static_cast<char *>(mapped), file_size);
+}
+
+// Relocates a freshly read copy of the corpus at `path` with `relocate` and
+// returns the time spent in `relocate` alone.
+template <typename Relocate>
+absl::Duration TimeRelocation(const std::string &path, Relocate relocate) {
+  absl::Duration read_time;
+  MmappedMemoryPtr<char> relocatable = ReadCorpus(path, &read_time);
+  SnapRelocatorError error;
+  const absl::Time start = absl::Now();
+  MmappedMemoryPtr<const SnapCorpus<Host>> corpus =
+      relocate(std::move(relocatable), &error);
+  const absl::Duration elapsed = absl::Now() - start;
+  CHECK(error == SnapRelocatorError::kOk);
+  return elapsed;
+}
+
+// Columns measured by each repetition, see the file comment.
+struct Sample {
+  absl::Duration read;
+  absl::Duration relocate;
+  absl::Duration relocate_verify;
+  absl::Duration relocate_lazy;
+  absl::Duration load;
+  absl::Duration runner_load;
+  absl::Duration runner_map;
+  absl::Duration runner_verify;
+  absl::Duration first_pass;
+  uint64_t max_rss_kb;
+};
+
+// Loads the corpus at `path` once in every way and returns the timings.
+absl::StatusOr<Sample> MeasureOnce(const std::string &runner,
+                                   const std::string &path) {
+  Sample sample;
+  ReadCorpus(path, &sample.read);
+  sample.relocate = TimeRelocation(
+      path, [](MmappedMemoryPtr<char> relocatable, SnapRelocatorError *error) {
+        return SnapRelocator<Host>::RelocateCorpus(std::move(relocatable),
+                                                   false, error);
+      });
+  sample.relocate_verify = TimeRelocation(
+      path, [](MmappedMemoryPtr<char> relocatable, SnapRelocatorError *error) {
+        return SnapRelocator<Host>::RelocateCorpus(std::move(relocatable),
+                                                   true, error);
+      });
+  sample.relocate_lazy = TimeRelocation(
+      path, [](MmappedMemoryPtr<char> relocatable, SnapRelocatorError *error) {
+        return SnapRelocator<Host>::RelocateCorpusLazily(
+            std::move(relocatable), false, error);
+      });
+  {
+    const absl::Time start = absl::Now();
+    MmappedMemoryPtr<const SnapCorpus<Host>> corpus =
+        LoadCorpusFromFile<Host>(path.c_str());
+    sample.load = absl::Now() - start;
+  }
+
+  RunnerDriver driver = RunnerDriver::ReadingRunner(runner, path);
+  RunnerOptions runner_options = RunnerOptions::Default();
+  runner_options.set_sequential_mode(true).set_extra_argv(
+      {"--report_startup_timings"});
+  const absl::Time start = absl::Now();
+  ASSIGN_OR_RETURN_IF_NOT_OK(RunnerDriver::RunResult result,
+                             driver.Run(runner_options));
+  const absl::Duration wall_time = absl::Now() - start;
+  if (!result.success()) {
+    return absl::InternalError(absl::StrCat("Runner failed on ", path));
+  }
+  if (!result.startup_timings().has_value()) {
+    return absl::InternalError("Runner reported no startup timings");
+  }
+  const RunnerDriver::RunResult::StartupTimings &timings =
+      *result.startup_timings();
+  sample.runner_load = timings.load_corpus;
+  sample.runner_map = timings.map_corpus;
+  sample.runner_verify = timings.verify_checksums;
+  sample.first_pass = wall_time - timings.exec - timings.load_corpus -
+                      timings.map_corpus - timings.verify_checksums;
+  sample.max_rss_kb = result.runner_max_rss_kb();
+  return sample;
+}
+
+// Returns the median of `field` over `samples`, in microseconds.
+int64_t MedianMicros(const std::vector<Sample> &samples,
+                     absl::Duration Sample::*field) {
+  std::vector<absl::Duration> values;
+  for (const Sample &sample : samples) values.push_back(sample.*field);
+  std::sort(values.begin(), values.end());
+  return absl::ToInt64Microseconds(values[values.size() / 2]);
+}
+
+}  // namespace
+
+int BenchmarkMain() {
+  absl::StatusOr<std::vector<uint64_t>> snap_counts =
+      ParseNumbers(absl::GetFlag(FLAGS_num_snaps), "num_snaps");
+  absl::StatusOr<std::vector<uint64_t>> data_sizes =
+      ParseNumbers(absl::GetFlag(FLAGS_snap_data_bytes), "snap_data_bytes");
+  const int repetitions = absl::GetFlag(FLAGS_repetitions);
+  if (!snap_counts.ok() || !data_sizes.ok() || repetitions <= 0) {
+    std::cerr << "Bad --num_snaps, --snap_data_bytes or --repetitions" << '\n';
+    return EXIT_FAILURE;
+  }
+  std::string runner = absl::GetFlag(FLAGS_runner);
+  if (runner.empty()) {
+    runner = RunnerLocation();
+  }
+  const Snapshot base =
+      MakeSnapRunnerTestSnapshot<Host>(TestSnapshot::kEndsAsExpected);
+
+  std::cout << "num_snaps,snap_data_bytes,corpus_bytes,read_us,relocate_us,"
+               "relocate_verify_us,relocate_lazy_us,load_us,runner_load_us,"
+               "runner_map_us,runner_verify_us,first_pass_us,max_rss_kb"
+            << std::endl;
+  for (uint64_t num_snaps : *snap_counts) {
+    for (uint64_t data_bytes : *data_sizes) {
+      data_bytes = RoundUpToPageAlignment(data_bytes);
+      absl::StatusOr<std::string> path =
+          MakeShard(base, num_snaps, data_bytes);
+      if (!path.ok()) {
+        std::cerr << path.status().message() << '\n';
+        return EXIT_FAILURE;
+      }
+      std::vector<Sample> samples;
+      absl::Status status = absl::OkStatus();
+      for (int i = 0; i < repetitions && status.ok(); ++i) {
+        absl::StatusOr<Sample> sample = MeasureOnce(runner, *path);
+        if (sample.ok()) {
+          samples.push_back(*sample);
+        } else {
+          status = sample.status();
+        }
+      }
+      const off_t corpus_bytes = [&path] {
+        const int fd = open(path->c_str(), O_RDONLY | O_CLOEXEC);
+        const off_t size = fd < 0 ? 0 : lseek(fd, 0, SEEK_END);
+        if (fd >= 0) close(fd);
+        return size;
+      }();
+      unlink(path->c_str());
+      if (!status.ok()) {
+        std::cerr << status.message() << '\n';
+        return EXIT_FAILURE;
+      }
+      uint64_t max_rss_kb = 0;
+      for (const Sample &sample : samples) {
+        max_rss_kb = std::max(max_rss_kb, sample.max_rss_kb);
+      }
+      std::cout << num_snaps << "," << data_bytes << "," << corpus_bytes
+                << "," << MedianMicros(samples, &Sample::read) << ","
+                << MedianMicros(samples, &Sample::relocate) << ","
+                << MedianMicros(samples, &Sample::relocate_verify) << ","
+                << MedianMicros(samples, &Sample::relocate_lazy) << ","
+                << MedianMicros(samples, &Sample::load) << ","
+                << MedianMicros(samples, &Sample::runner_load) << ","
+                << MedianMicros(samples, &Sample::runner_map) << ","
+                << MedianMicros(samples, &Sample::runner_verify) << ","
+                << MedianMicros(samples, &Sample::first_pass) << ","
+                << max_rss_kb << std::endl;
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+}  // namespace silifuzz
+
+int main(int argc, char *argv[]) {
+  absl::ParseCommandLine(argc, argv);
+  return silifuzz::BenchmarkMain();
+}
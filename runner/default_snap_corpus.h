@@ -14,6 +14,9 @@
 
 #ifndef THIRD_PARTY_SILIFUZZ_RUNNER_DEFAULT_SNAP_CORPUS_H_
 #define THIRD_PARTY_SILIFUZZ_RUNNER_DEFAULT_SNAP_CORPUS_H_
+
+#include <cstdint>
+
 #include "./snap/snap.h"
 #include "./util/arch.h"
 
@@ -29,8 +32,14 @@ namespace silifuzz {
 // ownership of this descriptor and is responsible for closing it. If the
 // backing file object does not exist, `*corpus_fd` will be -1. If `corpus_fd`
 // is NULL, no descriptor is returned.
+// If `load_address` is not 0, the corpus file has already been relocated to
+// that address. See LoadCorpusFromFile() for details.
+// If `lazy_relocation` is true, Snaps in a loaded corpus file may be left to
+// be relocated on first use by SnapRelocator::GetSnap(). The corpus is then
+// writable.
 const SnapCorpus<Host>* LoadCorpus(const char* filename, bool verify,
-                                   int* corpus_fd);
+                                   int* corpus_fd, uintptr_t load_address = 0,
+                                   bool lazy_relocation = false);
 
 }  // namespace silifuzz
 
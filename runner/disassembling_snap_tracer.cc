@@ -18,13 +18,18 @@
 #include <sys/user.h>
 
 #include <cstdint>
+#include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
 #include "./common/harness_tracer.h"
+#include "./common/memory_perms.h"
+#include "./common/snapshot.h"
 #include "./instruction/decoded_insn.h"
 #include "./util/checks.h"
 #include "./util/itoa.h"
@@ -42,7 +47,7 @@ HarnessTracer::ContinuationMode DisassemblingSnapTracer::Step(
     return HarnessTracer::kStopTracing;
   }
   // Flag indicating if regs.rip belongs to one of the snapshot memory regions.
-  bool in_snapshot = snapshot_.mapped_memory_map().Contains(regs.rip);
+  bool in_snapshot = mapped_memory_.Contains(regs.rip);
   if (in_snapshot) {
     auto r = stepper_.StepInstruction(pid, regs, reason);
     // If the SnapshotStepper callback does not wants to keep tracing then
@@ -62,6 +67,57 @@ HarnessTracer::ContinuationMode DisassemblingSnapTracer::Step(
   }
 }
 
+DisassemblingSnapTracer::SnapshotStepper::SnapshotStepper(
+    const Snapshot& snapshot, const TraceOptions& options,
+    TraceResult& trace_result)
+    : snapshot_(snapshot),
+      options_(options),
+      prev_instruction_addr_(0),
+      prev_instruction_decoding_failed_(false),
+      trace_result_(trace_result) {
+  for (const Snapshot::MemoryBytes& memory_bytes : snapshot.memory_bytes()) {
+    const Snapshot::Address start = memory_bytes.start_address();
+    const Snapshot::Address limit = memory_bytes.limit_address();
+    if (snapshot.Perms(start, limit, MemoryPerms::kAnd)
+            .Has(MemoryPerms::kExecutable) &&
+        snapshot.Perms(start, limit, MemoryPerms::kOr)
+            .HasNo(MemoryPerms::kWritable)) {
+      code_bytes_.push_back(&memory_bytes);
+    }
+  }
+}
+
+absl::StatusOr<DecodedInsn*>
+DisassemblingSnapTracer::SnapshotStepper::GetInsn(pid_t pid, uint64_t addr) {
+  if (auto it = insn_cache_.find(addr); it != insn_cache_.end()) {
+    return &it->second;
+  }
+  // The runner replaces the end state instruction with its exit sequence, so
+  // the snapshot bytes there may not be what executes.
+  const uint64_t end_state_rip =
+      snapshot_.ExtractRip(snapshot_.expected_end_states()[0].registers());
+  if (addr != end_state_rip) {
+    for (const Snapshot::MemoryBytes* memory_bytes : code_bytes_) {
+      if (addr < memory_bytes->start_address() ||
+          addr >= memory_bytes->limit_address()) {
+        continue;
+      }
+      absl::string_view data(memory_bytes->byte_values());
+      DecodedInsn insn(data.substr(addr - memory_bytes->start_address()),
+                       addr);
+      // An invalid decode may just be an instruction truncated at the end of
+      // the bytes, let the live process decide.
+      if (insn.is_valid()) {
+        return &insn_cache_.emplace(addr, std::move(insn)).first->second;
+      }
+      break;
+    }
+  }
+  ASSIGN_OR_RETURN_IF_NOT_OK(live_insn_,
+                             DecodedInsn::FromLiveProcess(pid, addr));
+  return &*live_insn_;
+}
+
 HarnessTracer::ContinuationMode
 DisassemblingSnapTracer::SnapshotStepper::StepInstruction(
     pid_t pid, const struct user_regs_struct& regs,
@@ -74,14 +130,15 @@ DisassemblingSnapTracer::SnapshotStepper::StepInstruction(
   }
 
   const uint64_t addr = regs.rip;
-  absl::StatusOr<DecodedInsn> insn_or = DecodedInsn::FromLiveProcess(pid, addr);
+  absl::StatusOr<DecodedInsn*> insn_or = GetInsn(pid, addr);
   if (!insn_or.ok()) {
     LOG_ERROR(insn_or.status().message());
     // We couldn't fetch the instruction meaning this snapshot likely causes
     // SEGV. Let HarnessTracer take care of proper signal delivery.
     return HarnessTracer::kKeepTracing;
   }
-  if (insn_or->is_valid()) {
+  DecodedInsn& insn = **insn_or;
+  if (insn.is_valid()) {
     if (prev_instruction_decoding_failed_) {
       trace_result_.early_termination_reason = absl::StrCat(
           HexStr(addr), ": Insn at ", HexStr(prev_instruction_addr_),
@@ -93,28 +150,28 @@ DisassemblingSnapTracer::SnapshotStepper::StepInstruction(
     if (prev_instruction_addr_ != addr) {
       trace_result_.disassembly.emplace_back(absl::StrCat(
           trace_result_.instructions_executed, " addr=", HexStr(addr),
-          " size=", insn_or->length(), " ", insn_or->DebugString()));
+          " size=", insn.length(), " ", insn.DebugString()));
       VLOG_INFO(1, trace_result_.disassembly.back());
     }
-    if (!insn_or->is_deterministic() &&
+    if (!insn.is_deterministic() &&
         options_.filter_non_deterministic_insn) {
       trace_result_.early_termination_reason =
-          absl::StrCat("Non-deterministic insn ", insn_or->mnemonic());
+          absl::StrCat("Non-deterministic insn ", insn.mnemonic());
       return HarnessTracer::kInjectSigusr1;
     }
-    if (options_.x86_filter_split_lock && insn_or->is_locking()) {
-      auto may_have_split_lock_or = insn_or->may_have_split_lock(regs);
+    if (options_.x86_filter_split_lock && insn.is_locking()) {
+      auto may_have_split_lock_or = insn.may_have_split_lock(regs);
       if (!may_have_split_lock_or.ok()) {
         // We cannot determine if there is a split-lock because of an internal
         // error in may_have_split_lock(). Abort tracing.
         trace_result_.early_termination_reason = absl::StrCat(
-            "may_have_split_lock() failed for insn ", insn_or->mnemonic());
+            "may_have_split_lock() failed for insn ", insn.mnemonic());
         return HarnessTracer::kInjectSigusr1;
       }
 
       if (may_have_split_lock_or.value()) {
         trace_result_.early_termination_reason =
-            absl::StrCat("Split-lock insn ", insn_or->mnemonic());
+            absl::StrCat("Split-lock insn ", insn.mnemonic());
         return HarnessTracer::kInjectSigusr1;
       }
     }
@@ -122,23 +179,23 @@ DisassemblingSnapTracer::SnapshotStepper::StepInstruction(
       constexpr uintptr_t kVSyscallRegionAddress = 0xffffffffff600000ULL;
       constexpr uintptr_t kVSyscallRegionSize = 0x800000;
       absl::StatusOr<bool> may_access_vsyscall_region_or =
-          insn_or->may_access_region(regs, kVSyscallRegionAddress,
+          insn.may_access_region(regs, kVSyscallRegionAddress,
                                      kVSyscallRegionSize);
       if (!may_access_vsyscall_region_or.ok()) {
         // We cannot determine if instruction accesses the legacy vsyscall
         // region because of an internal error in may_access_region(). Abort
         // tracing.
         trace_result_.early_termination_reason = absl::StrCat(
-            "may_access_region() failed for insn ", insn_or->mnemonic());
+            "may_access_region() failed for insn ", insn.mnemonic());
         return HarnessTracer::kInjectSigusr1;
       }
       if (may_access_vsyscall_region_or.value()) {
         trace_result_.early_termination_reason =
-            absl::StrCat("May access vsyscall region ", insn_or->mnemonic());
+            absl::StrCat("May access vsyscall region ", insn.mnemonic());
         return HarnessTracer::kInjectSigusr1;
       }
     }
-    if (options_.filter_memory_access && insn_or->may_access_memory()) {
+    if (options_.filter_memory_access && insn.may_access_memory()) {
       // We need to check if this is the ending address because on the x86,
       // the exit sequence is an indirect call.
       const uint64_t end_state_rip =
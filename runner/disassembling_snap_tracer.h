@@ -18,12 +18,18 @@
 #include <sys/types.h>
 #include <sys/user.h>
 
+#include <cstdint>
+#include <optional>
 #include <string>
 #include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/log/check.h"
+#include "absl/status/statusor.h"
 #include "./common/harness_tracer.h"
+#include "./common/mapped_memory_map.h"
 #include "./common/snapshot.h"
+#include "./instruction/decoded_insn.h"
 #include "./player/trace_options.h"
 
 namespace silifuzz {
@@ -61,7 +67,7 @@ class DisassemblingSnapTracer {
   // `snapshot` must outlive the instance of DisassemblingSnapTracer.
   DisassemblingSnapTracer(const Snapshot& snapshot,
                           const TraceOptions& options = TraceOptions::Default())
-      : snapshot_(snapshot),
+      : mapped_memory_(snapshot.mapped_memory_map()),
         was_in_snapshot_(false),
         stepper_(snapshot, options, trace_result_) {
     // In some cases, we need to access the end state. Make sure there is one
@@ -80,6 +86,12 @@ class DisassemblingSnapTracer {
   HarnessTracer::ContinuationMode Step(pid_t pid, const user_regs_struct& regs,
                                        HarnessTracer::CallbackReason reason);
 
+  // Implements HarnessTracer::StepFilter interface. Step() only needs to see
+  // instructions of the snapshot and the first one after leaving it.
+  bool WantsStep(uint64_t instruction_pointer) const {
+    return was_in_snapshot_ || mapped_memory_.Contains(instruction_pointer);
+  }
+
   // Returns result of tracing.
   // NOTE: this can only be safely called after the thread calling Step()
   // has been joined.
@@ -92,12 +104,7 @@ class DisassemblingSnapTracer {
    public:
     // `snapshot` must outlive the instance of Stepper.
     SnapshotStepper(const Snapshot& snapshot, const TraceOptions& options,
-                    TraceResult& trace_result)
-        : snapshot_(snapshot),
-          options_(options),
-          prev_instruction_addr_(0),
-          prev_instruction_decoding_failed_(false),
-          trace_result_(trace_result) {}
+                    TraceResult& trace_result);
 
     // Not movable or copyable. Not just a data container.
     SnapshotStepper(const SnapshotStepper&) = delete;
@@ -113,9 +120,25 @@ class DisassemblingSnapTracer {
         HarnessTracer::CallbackReason reason);
 
    private:
+    // Returns the instruction at `addr`. Instructions in read-only snapshot
+    // code are decoded from code_bytes_ on first use and cached for the life
+    // of the trace. Anything else is fetched from the live process `pid`
+    // every time. The result is valid until the next call.
+    absl::StatusOr<DecodedInsn*> GetInsn(pid_t pid, uint64_t addr);
+
     // The snapshot being traced.
     const Snapshot& snapshot_;
 
+    // Memory bytes of the snapshot that are executable but not writable, so
+    // the tracee cannot change them.
+    std::vector<const Snapshot::MemoryBytes*> code_bytes_;
+
+    // Instructions decoded from code_bytes_, keyed by address.
+    absl::flat_hash_map<Snapshot::Address, DecodedInsn> insn_cache_;
+
+    // Holds the last instruction GetInsn() fetched from the live process.
+    std::optional<DecodedInsn> live_insn_;
+
     // Options controlling the tracer's behavior.
     const TraceOptions options_;
 
@@ -130,7 +153,10 @@ class DisassemblingSnapTracer {
   };
 
   TraceResult trace_result_;
-  const Snapshot& snapshot_;
+
+  // Flat copy of the snapshot's mapped_memory_map(), looked up on every step.
+  const FlatMappedMemoryMap mapped_memory_;
+
   bool was_in_snapshot_;
   SnapshotStepper stepper_;
 };
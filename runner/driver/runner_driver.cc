@@ -16,21 +16,39 @@
 
 #include <fcntl.h>
 #include <signal.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
 #include <cerrno>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <iterator>
 #include <memory>
 #include <optional>
 #include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
 #include <vector>
 
+#include "absl/cleanup/cleanup.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
 #include "google/protobuf/text_format.h"
@@ -39,17 +57,490 @@
 #include "./player/player_result_proto.h"
 #include "./proto/snapshot_execution_result.pb.h"
 #include "./runner/driver/runner_options.h"
+#include "./runner/result_record.h"
+#include "./runner/stdout_markers.h"
 #include "./snap/gen/relocatable_snap_generator.h"
 #include "./util/arch.h"
-#include "./util/byte_io.h"
+#include "./util/atoi.h"
 #include "./util/checks.h"
+#include "./util/cpu_features.h"
 #include "./util/cpu_id.h"
+#include "./util/file_util.h"
 #include "./util/itoa.h"
 #include "./util/mmapped_memory_ptr.h"
+#include "./util/platform.h"
 #include "./util/subprocess.h"
 
 namespace silifuzz {
 
+namespace {
+
+// Returns the CLOCK_MONOTONIC time in nanoseconds.
+uint64_t MonotonicNanos() {
+  struct timespec ts;
+  CHECK_EQ(clock_gettime(CLOCK_MONOTONIC, &ts), 0);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Copies the reports that the runner may print in addition to a failed snap
+// from `exec_result_proto` into `result`. See HandleRunnerOutput() for
+// `spawn_monotonic_ns`.
+void CopyRunnerReports(const proto::SnapshotExecutionResult& exec_result_proto,
+                       std::optional<uint64_t> spawn_monotonic_ns,
+                       RunnerDriver::RunResult& result) {
+  result.set_snap_latency_histograms(
+      {exec_result_proto.snap_latency_histograms().begin(),
+       exec_result_proto.snap_latency_histograms().end()});
+  result.set_skipped_snapshot_ids(
+      {exec_result_proto.skipped_snapshot_ids().begin(),
+       exec_result_proto.skipped_snapshot_ids().end()});
+  result.set_perf_counters(
+      {exec_result_proto.perf_counter_values().begin(),
+       exec_result_proto.perf_counter_values().end()},
+      exec_result_proto.perf_counter_missed_batches());
+  if (exec_result_proto.has_runner_startup_timings()) {
+    const proto::RunnerStartupTimings& timings =
+        exec_result_proto.runner_startup_timings();
+    RunnerDriver::RunResult::StartupTimings startup_timings = {
+        .load_corpus = absl::Nanoseconds(timings.load_corpus_ns()),
+        .map_corpus = absl::Nanoseconds(timings.map_corpus_ns()),
+        .verify_checksums = absl::Nanoseconds(timings.verify_checksums_ns()),
+        .prefaulted_bytes = timings.prefaulted_bytes(),
+        .locked_bytes = timings.locked_bytes(),
+        .num_prefault_failures = timings.num_prefault_failures(),
+    };
+    if (spawn_monotonic_ns.has_value() &&
+        timings.main_entry_monotonic_ns() > *spawn_monotonic_ns) {
+      startup_timings.exec = absl::Nanoseconds(
+          timings.main_entry_monotonic_ns() - *spawn_monotonic_ns);
+    }
+    result.set_startup_timings(startup_timings);
+  }
+}
+
+// Parses the reports that a successful or timed out runner printed on stdout
+// into `exec_result_proto`. A timeout signal may stop the runner in the
+// middle of printing and a snap may write to stdout, so output that does not
+// parse as a whole is cut back to the end of its last top-level field that
+// parses, and the rest is ignored. Returns false if nothing parses.
+bool ParseRunnerReports(absl::string_view runner_stdout,
+                        proto::SnapshotExecutionResult& exec_result_proto) {
+  google::protobuf::TextFormat::Parser parser;
+  if (parser.ParseFromString(std::string(runner_stdout), &exec_result_proto)) {
+    return true;
+  }
+  // Candidate ends of top-level fields: closing braces and quotes, and
+  // whitespace, at nesting depth zero.
+  std::vector<size_t> field_ends;
+  auto add_field_end = [&field_ends](size_t end) {
+    if (field_ends.empty() || field_ends.back() != end) {
+      field_ends.push_back(end);
+    }
+  };
+  int depth = 0;
+  char quote = 0;
+  for (size_t i = 0; i < runner_stdout.size() && depth >= 0; ++i) {
+    const char c = runner_stdout[i];
+    if (quote != 0) {
+      if (c == '\\') {
+        ++i;
+      } else if (c == quote) {
+        quote = 0;
+        if (depth == 0) add_field_end(i + 1);
+      }
+    } else if (c == '\'' || c == '"') {
+      quote = c;
+    } else if (c == '{') {
+      ++depth;
+    } else if (c == '}') {
+      if (--depth == 0) add_field_end(i + 1);
+    } else if (depth == 0 && absl::ascii_isspace(c)) {
+      add_field_end(i);
+    }
+  }
+  // The garbage is expected at the end, so only try the last few candidates.
+  constexpr size_t kMaxAttempts = 16;
+  for (size_t attempt = 0; attempt < kMaxAttempts && !field_ends.empty();
+       ++attempt) {
+    const size_t end = field_ends.back();
+    field_ends.pop_back();
+    if (parser.ParseFromString(std::string(runner_stdout.substr(0, end)),
+                               &exec_result_proto)) {
+      LOG_ERROR("Ignored unparseable runner output [",
+                runner_stdout.substr(end), "]");
+      return true;
+    }
+  }
+  exec_result_proto.Clear();
+  return false;
+}
+
+// Reads consecutive fields of a result record. See runner/result_record.h.
+class ResultRecordReader {
+ public:
+  explicit ResultRecordReader(absl::string_view data) : data_(data) {}
+
+  // Consumes the next `size` bytes into `*out`. Returns false if the record
+  // is shorter than that.
+  bool Read(size_t size, absl::string_view* out) {
+    if (size > data_.size()) return false;
+    *out = data_.substr(0, size);
+    data_.remove_prefix(size);
+    return true;
+  }
+
+  template <typename T>
+  bool Read(T* out) {
+    absl::string_view bytes;
+    if (!Read(sizeof(T), &bytes)) return false;
+    memcpy(out, bytes.data(), sizeof(T));
+    return true;
+  }
+
+ private:
+  absl::string_view data_;
+};
+
+// Decodes one record the runner wrote to --result_fd into a RunResult.
+absl::StatusOr<RunnerDriver::RunResult> DecodeResultRecord(
+    absl::string_view record) {
+  ResultRecordReader reader(record);
+  ResultRecordHeader header;
+  absl::string_view snapshot_id, gregs, fpregs, register_checksum;
+  if (!reader.Read(&header) ||
+      !reader.Read(header.snapshot_id_size, &snapshot_id) ||
+      !reader.Read(header.gregs_size, &gregs) ||
+      !reader.Read(header.fpregs_size, &fpregs) ||
+      !reader.Read(header.register_checksum_size, &register_checksum)) {
+    return absl::InternalError("Truncated result record");
+  }
+  std::optional<Snapshot::Endpoint> endpoint;
+  switch (header.endpoint_type) {
+    case kResultRecordInstructionEndpoint:
+      endpoint.emplace(header.instruction_address);
+      break;
+    case kResultRecordSignalEndpoint:
+      endpoint.emplace(static_cast<Snapshot::Endpoint::SigNum>(header.sig_num),
+                       static_cast<Snapshot::Endpoint::SigCause>(
+                           header.sig_cause),
+                       header.sig_address, header.instruction_address);
+      break;
+    default:
+      return absl::InternalError(absl::StrCat(
+          "Result record for ", snapshot_id, " has no endpoint"));
+  }
+  Snapshot::EndState end_state(
+      *endpoint,
+      Snapshot::RegisterState(std::string(gregs), std::string(fpregs)));
+  for (uint32_t i = 0; i < header.num_memory_bytes; ++i) {
+    ResultRecordMemoryBytes memory_bytes_header;
+    absl::string_view byte_values;
+    if (!reader.Read(&memory_bytes_header) ||
+        !reader.Read(memory_bytes_header.num_bytes, &byte_values)) {
+      return absl::InternalError("Truncated result record");
+    }
+    Snapshot::MemoryBytes memory_bytes(memory_bytes_header.start_address,
+                                       std::string(byte_values));
+    RETURN_IF_NOT_OK_PLUS(end_state.can_add_memory_bytes(memory_bytes),
+                          "Can't add MemoryBytes: ");
+    end_state.add_memory_bytes(std::move(memory_bytes));
+  }
+  end_state.set_register_checksum(std::string(register_checksum));
+
+  RunnerDriver::PlayerResult player_result = {
+      .outcome = static_cast<PlaybackOutcome>(header.outcome),
+      .actual_end_state = std::move(end_state),
+      .cpu_usage = absl::ZeroDuration(),
+      .cpu_id = header.cpu_id,
+  };
+  return RunnerDriver::RunResult(player_result, snapshot_id);
+}
+
+// Decodes the complete records the runner wrote to --result_fd in the order
+// they were written. `records` is the content of the file. A record that was
+// cut short, e.g. because the runner was killed while writing it, is ignored.
+// Returns an empty vector if there is no complete record, e.g. if the runner
+// fell back to printing the result to stdout.
+absl::StatusOr<std::vector<RunnerDriver::RunResult>> DecodeResultRecords(
+    absl::string_view records) {
+  std::vector<RunnerDriver::RunResult> results;
+  while (records.size() >= sizeof(ResultRecordHeader)) {
+    ResultRecordHeader header;
+    memcpy(&header, records.data(), sizeof(header));
+    if (header.magic != kResultRecordMagic) {
+      return absl::InternalError("Bad result record magic");
+    }
+    if (header.record_size < sizeof(header) ||
+        header.record_size > records.size()) {
+      break;
+    }
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        RunnerDriver::RunResult result,
+        DecodeResultRecord(records.substr(0, header.record_size)));
+    results.push_back(std::move(result));
+    records.remove_prefix(header.record_size);
+  }
+  return results;
+}
+
+// Converts the output of a runner invoked with --max_failures greater than 1
+// that reported at least one failure. Each failure is followed by a
+// kFailureEndMarker line on stdout and its end state is either in a record in
+// `result_records` or in a text proto before the marker. The last failure is
+// returned with the others as earlier_failures(). If `timed_out`, the output
+// may have been cut short and a partial report is ignored.
+absl::StatusOr<RunnerDriver::RunResult> HandleFailureBudgetOutput(
+    absl::string_view runner_stdout, absl::string_view result_records,
+    std::optional<uint64_t> spawn_monotonic_ns, bool timed_out) {
+  ASSIGN_OR_RETURN_IF_NOT_OK(std::vector<RunnerDriver::RunResult> failures,
+                             DecodeResultRecords(result_records));
+  // Fields outside of the failures, e.g. latency histograms, may be printed
+  // anywhere in between.
+  proto::SnapshotExecutionResult reports;
+  google::protobuf::TextFormat::Parser parser;
+  for (absl::string_view chunk :
+       absl::StrSplit(runner_stdout, kFailureEndMarker)) {
+    proto::SnapshotExecutionResult exec_result_proto;
+    if (!parser.ParseFromString(std::string(chunk), &exec_result_proto)) {
+      if (timed_out) continue;
+      return absl::InternalError(absl::StrCat(
+          "couldn't parse [", chunk, "] as proto::SnapshotExecutionResult"));
+    }
+    if (exec_result_proto.has_player_result()) {
+      absl::StatusOr<RunnerDriver::PlayerResult> player_result_or =
+          PlayerResultProto::FromProto(exec_result_proto.player_result());
+      RETURN_IF_NOT_OK_PLUS(player_result_or.status(),
+                            "PlayerResultProto::FromProto: ");
+      if (!player_result_or->actual_end_state.has_value()) {
+        return absl::InternalError(
+            absl::StrCat(exec_result_proto, " has no actual_end_state"));
+      }
+      failures.emplace_back(*player_result_or, exec_result_proto.snapshot_id());
+      exec_result_proto.clear_player_result();
+      exec_result_proto.clear_snapshot_id();
+    }
+    reports.MergeFrom(exec_result_proto);
+  }
+  if (failures.empty()) {
+    return absl::InternalError(absl::StrCat(
+        "Runner reported failures but none could be decoded from [",
+        runner_stdout, "]"));
+  }
+  RunnerDriver::RunResult result = std::move(failures.back());
+  failures.pop_back();
+  result.set_earlier_failures(std::move(failures));
+  CopyRunnerReports(reports, spawn_monotonic_ns, result);
+  return result;
+}
+
+// Returns the content of `fd` mapped read-only or an empty mapping if `fd` is
+// empty.
+absl::StatusOr<MmappedMemoryPtr<char>> MapResultFile(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return absl::ErrnoToStatus(errno, "fstat");
+  }
+  if (st.st_size == 0) {
+    return MakeMmappedMemoryPtr<char>(nullptr, 0);
+  }
+  void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "mmap");
+  }
+  return MakeMmappedMemoryPtr(static_cast<char*>(data), st.st_size);
+}
+
+}  // namespace
+
+RunnerDriver::AsyncRun::~AsyncRun() {
+  if (!finished_) {
+    std::string runner_stdout;
+    runner_proc_->Communicate(&runner_stdout);
+  }
+  if (result_fd_ != -1) {
+    close(result_fd_);
+  }
+}
+
+absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::AsyncRun::Finish() {
+  CHECK(!finished_);
+  finished_ = true;
+  std::string runner_stdout;
+  int exit_status = runner_proc_->Communicate(&runner_stdout);
+  return driver_->HandleRunnerProcess(*runner_proc_, runner_stdout,
+                                      exit_status, snapshot_id_,
+                                      spawn_monotonic_ns_, result_fd_);
+}
+
+RunnerDriver::PersistentSession::~PersistentSession() {
+  if (runner_proc_ != nullptr) {
+    std::string runner_stdout;
+    Finish(&runner_stdout);
+  }
+  if (result_fd_ != -1) {
+    close(result_fd_);
+  }
+}
+
+int RunnerDriver::PersistentSession::Finish(std::string* runner_stdout) {
+  int exit_status = runner_proc_->Communicate(runner_stdout);
+  runner_proc_.reset();
+  return exit_status;
+}
+
+absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::PersistentSession::Run(
+    size_t num_iterations, uint64_t seed) {
+  if (runner_proc_ == nullptr) {
+    return absl::FailedPreconditionError("Runner process has exited");
+  }
+  std::string runner_stdout;
+  const std::string command = absl::StrCat(num_iterations, " ", seed, "\n");
+  if (!runner_proc_->WriteToStdin(command).ok() ||
+      !runner_proc_->ReadStdoutUntil(kPersistentModeEndMarker,
+                                     &runner_stdout)) {
+    // The runner has gone away. Report whatever it produced before exiting.
+    int exit_status = Finish(&runner_stdout);
+    return driver_->HandleSessionOutput(runner_stdout, exit_status,
+                                        /*snapshot_id=*/"",
+                                        /*spawn_monotonic_ns=*/std::nullopt,
+                                        result_fd_);
+  }
+  runner_stdout.resize(runner_stdout.size() -
+                       strlen(kPersistentModeEndMarker));
+
+  std::string exit_code_line;
+  uint64_t exit_code;
+  if (!runner_proc_->ReadStdoutUntil("\n", &exit_code_line) ||
+      !DecToU64(exit_code_line.data(), exit_code_line.size() - 1,
+                &exit_code) ||
+      exit_code > 255) {
+    int exit_status = Finish(&runner_stdout);
+    return absl::InternalError(absl::StrCat(
+        "Malformed persistent mode exit code [", exit_code_line,
+        "]. Exit status = ", HexStr(exit_status)));
+  }
+  // Present the result as if the runner exited with `exit_code`.
+  return driver_->HandleSessionOutput(
+      runner_stdout, W_EXITCODE(static_cast<int>(exit_code), 0),
+      /*snapshot_id=*/"", /*spawn_monotonic_ns=*/std::nullopt, result_fd_);
+}
+
+RunnerDriver::ZygoteSession::~ZygoteSession() {
+  if (zygote_proc_ != nullptr) {
+    Finish();
+  }
+  if (result_fd_ != -1) {
+    close(result_fd_);
+  }
+}
+
+int RunnerDriver::ZygoteSession::Finish() {
+  std::string zygote_stdout;
+  int exit_status = zygote_proc_->Communicate(&zygote_stdout);
+  zygote_proc_.reset();
+  return exit_status;
+}
+
+absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::ZygoteSession::Run(
+    const RunnerOptions& runner_options, absl::string_view snapshot_id) {
+  return Run(*driver_, runner_options, snapshot_id);
+}
+
+absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::ZygoteSession::MakeOne(
+    absl::string_view snap_id, size_t max_pages_to_add) {
+  return MakeOne(*driver_, snap_id, max_pages_to_add);
+}
+
+absl::StatusOr<RunnerDriver::RunResult>
+RunnerDriver::ZygoteSession::VerifyOneRepeatedly(absl::string_view snap_id,
+                                                 int num_attempts) {
+  return VerifyOneRepeatedly(*driver_, snap_id, num_attempts);
+}
+
+absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::ZygoteSession::Run(
+    const RunnerDriver& driver, const RunnerOptions& runner_options,
+    absl::string_view snapshot_id) {
+  DCHECK(driver.binary_path_ == driver_->binary_path_);
+  if (zygote_proc_ == nullptr) {
+    // The caller can start a new zygote and retry.
+    return absl::UnavailableError("Zygote process has exited");
+  }
+  if (!CanRun(runner_options)) {
+    return absl::InvalidArgumentError(
+        "disable_aslr and map_stderr_to_dev_null must match the zygote");
+  }
+  // The budgets are applied by the forked runner, the ASLR and stderr
+  // settings are inherited from the zygote, the other subprocess options are
+  // not supported.
+  std::vector<std::string> argv;
+  Subprocess::Options unused_options = Subprocess::Options::Default();
+  driver.PrepareRunnerProcess(runner_options, &argv, &unused_options,
+                              result_fd_);
+  // 0 means no limit in a request, so round the budgets up to at least 1.
+  int64_t cpu_time_budget_s = 0;
+  if (runner_options.cpu_time_budget() != absl::InfiniteDuration()) {
+    cpu_time_budget_s = std::max<int64_t>(
+        1, absl::ToInt64Seconds(runner_options.cpu_time_budget()));
+  }
+  int64_t wall_time_budget_ms = 0;
+  if (runner_options.wall_time_budget() != absl::InfiniteDuration()) {
+    wall_time_budget_ms = std::max<int64_t>(
+        1, absl::ToInt64Milliseconds(runner_options.wall_time_budget()));
+  }
+  std::string request =
+      absl::StrCat(cpu_time_budget_s, " ", wall_time_budget_ms);
+  // argv[0] is supplied by the zygote.
+  for (size_t i = 1; i < argv.size(); ++i) {
+    if (argv[i].empty() || argv[i].find_first_of(" \n") != std::string::npos) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Runner argument cannot be sent to a zygote: [",
+                       argv[i], "]"));
+    }
+    absl::StrAppend(&request, " ", argv[i]);
+  }
+  request += "\n";
+
+  std::string runner_stdout;
+  std::string wait_status_line;
+  uint64_t wait_status;
+  const uint64_t spawn_monotonic_ns = MonotonicNanos();
+  if (!zygote_proc_->WriteToStdin(request).ok() ||
+      !zygote_proc_->ReadStdoutUntil(kZygoteEndMarker, &runner_stdout) ||
+      !zygote_proc_->ReadStdoutUntil("\n", &wait_status_line) ||
+      !DecToU64(wait_status_line.data(), wait_status_line.size() - 1,
+                &wait_status) ||
+      wait_status > 0xffff) {
+    int exit_status = Finish();
+    return absl::UnavailableError(absl::StrCat(
+        "Zygote failed to run the runner [", wait_status_line,
+        "]. Exit status = ", HexStr(exit_status)));
+  }
+  runner_stdout.resize(runner_stdout.size() - strlen(kZygoteEndMarker));
+  return driver.HandleSessionOutput(runner_stdout,
+                                    static_cast<int>(wait_status), snapshot_id,
+                                    spawn_monotonic_ns, result_fd_);
+}
+
+absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::ZygoteSession::MakeOne(
+    const RunnerDriver& driver, absl::string_view snap_id,
+    size_t max_pages_to_add) {
+  CHECK(!snap_id.empty());
+  return Run(driver, RunnerOptions::MakeOptions(snap_id, max_pages_to_add),
+             snap_id);
+}
+
+absl::StatusOr<RunnerDriver::RunResult>
+RunnerDriver::ZygoteSession::VerifyOneRepeatedly(const RunnerDriver& driver,
+                                                 absl::string_view snap_id,
+                                                 int num_attempts) {
+  CHECK(!snap_id.empty());
+  auto opts = RunnerOptions::VerifyOptions(snap_id);
+  for (int i = 0; i < num_attempts - 1; ++i) {
+    RETURN_IF_NOT_OK(Run(driver, opts, snap_id).status());
+  }
+  return Run(driver, opts, snap_id);
+}
+
 absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::PlayOne(
     absl::string_view snap_id) const {
   CHECK(!snap_id.empty());
@@ -65,10 +556,65 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::MakeOne(
 
 absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::TraceOne(
     absl::string_view snap_id, HarnessTracer::Callback cb,
-    size_t num_iterations) const {
+    size_t num_iterations, std::optional<uint64_t> start_address,
+    HarnessTracer::StepFilter step_filter) const {
   CHECK(!snap_id.empty());
   return RunImpl(RunnerOptions::TraceOptions(snap_id, num_iterations), snap_id,
-                 cb);
+                 cb, start_address, std::move(step_filter));
+}
+
+absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::TraceMany(
+    absl::Span<const std::string> snap_ids, MultiTraceCallback cb,
+    absl::Span<const uint64_t> start_addresses,
+    MultiStepFilter step_filter) const {
+  CHECK(!snap_ids.empty());
+  CHECK(start_addresses.empty() || start_addresses.size() == snap_ids.size());
+
+  // The runner replays the snaps listed in an anonymous file, passed by path
+  // like the corpus in RunnerDriverFromSnapshot().
+  int memfd = memfd_create("trace_snap_ids", MFD_CLOEXEC);
+  if (memfd == -1) {
+    return absl::ErrnoToStatus(errno, "memfd_create");
+  }
+  absl::Cleanup memfd_closer = [memfd] { close(memfd); };
+  std::string replay_path = absl::StrCat("/proc/", getpid(), "/fd/", memfd);
+  std::string replay_list;
+  for (const std::string& snap_id : snap_ids) {
+    CHECK(!snap_id.empty());
+    absl::StrAppend(&replay_list, snap_id, "\n");
+  }
+  if (!SetContents(replay_path, replay_list)) {
+    return absl::InternalError(
+        absl::StrCat("Cannot write snap IDs to ", replay_path));
+  }
+
+  // Each activation of the tracer is the next snap. Only the tracer thread
+  // touches this.
+  size_t snap_index = 0;
+  bool activated = false;
+  auto on_activation = [&](HarnessTracer& tracer) {
+    if (activated) ++snap_index;
+    activated = true;
+    CHECK_LT(snap_index, snap_ids.size());
+    if (!start_addresses.empty()) {
+      tracer.SetSingleStepStartAddress(start_addresses[snap_index]);
+    }
+  };
+  HarnessTracer::Callback trace_cb =
+      [&](pid_t pid, const user_regs_struct& regs,
+          HarnessTracer::CallbackReason reason) {
+        return cb(snap_index, pid, regs, reason);
+      };
+  HarnessTracer::StepFilter trace_step_filter = nullptr;
+  if (step_filter) {
+    trace_step_filter = [&](uint64_t instruction_pointer) {
+      return step_filter(snap_index, instruction_pointer);
+    };
+  }
+  return RunImpl(
+      RunnerOptions::TraceReplayOptions(replay_path, snap_ids.size()),
+      /*snap_id=*/"", trace_cb, /*trace_start_address=*/std::nullopt,
+      std::move(trace_step_filter), on_activation);
 }
 
 absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::VerifyOneRepeatedly(
@@ -81,65 +627,254 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::VerifyOneRepeatedly(
   return RunImpl(opts, snap_id);
 }
 
+absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::VerifyOneOnCPUs(
+    absl::string_view snap_id, absl::Span<const int> cpus,
+    int num_attempts) const {
+  CHECK(!snap_id.empty());
+  CHECK(!cpus.empty());
+  CHECK_GT(num_attempts, 0);
+  // Last result of each CPU. A CPU keeps its first failure.
+  std::vector<std::optional<absl::StatusOr<RunResult>>> results(cpus.size());
+  std::atomic<bool> failed = false;
+  std::vector<std::thread> threads;
+  threads.reserve(cpus.size());
+  for (size_t i = 0; i < cpus.size(); ++i) {
+    threads.emplace_back([&, i] {
+      RunnerOptions opts = RunnerOptions::VerifyOptions(snap_id);
+      opts.set_cpu(cpus[i]);
+      for (size_t attempt = i; attempt < static_cast<size_t>(num_attempts);
+           attempt += cpus.size()) {
+        if (failed.load(std::memory_order_relaxed)) break;
+        results[i] = RunImpl(opts, snap_id);
+        if (!results[i]->ok() || !results[i]->value().success()) {
+          failed.store(true, std::memory_order_relaxed);
+          break;
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  for (std::optional<absl::StatusOr<RunResult>>& result : results) {
+    if (result.has_value() && (!result->ok() || !result->value().success())) {
+      return *std::move(result);
+    }
+  }
+  // Attempt 0 always runs on cpus[0].
+  return *std::move(results[0]);
+}
+
 absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::Run(
     const RunnerOptions& runner_options) const {
   return RunImpl(runner_options);
 }
 
-// Generic entry point for all methods that need to execute the runner binary
-// and handle its output.
-absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::RunImpl(
-    const RunnerOptions& runner_options, absl::string_view snap_id,
-    std::optional<HarnessTracer::Callback> trace_cb) const {
-  std::vector<std::string> argv = {binary_path_};
+absl::StatusOr<std::unique_ptr<RunnerDriver::PersistentSession>>
+RunnerDriver::StartPersistentSession(
+    const RunnerOptions& runner_options) const {
+  RunnerOptions persistent_options = runner_options;
+  std::vector<std::string> extra_argv = runner_options.extra_argv();
+  extra_argv.push_back("--persistent");
+  persistent_options.set_extra_argv(extra_argv);
+
+  // Receives the end states of failed snaps, see RunImpl().
+  int result_fd = -1;
+  if (runner_options.binary_result_channel()) {
+    result_fd = memfd_create("runner_result", MFD_CLOEXEC);
+    if (result_fd == -1) {
+      return absl::ErrnoToStatus(errno, "memfd_create");
+    }
+  }
+  absl::Cleanup result_fd_closer = [result_fd] {
+    if (result_fd != -1) close(result_fd);
+  };
+
+  std::vector<std::string> argv;
+  Subprocess::Options options = Subprocess::Options::Default();
+  PrepareRunnerProcess(persistent_options, &argv, &options, result_fd);
+  options.PipeStdin(true);
+
+  auto runner_proc = std::make_unique<Subprocess>(options);
+  RETURN_IF_NOT_OK(runner_proc->Start(argv));
+  std::move(result_fd_closer).Cancel();
+  return std::unique_ptr<PersistentSession>(
+      new PersistentSession(this, std::move(runner_proc), result_fd));
+}
+
+absl::StatusOr<std::unique_ptr<RunnerDriver::ZygoteSession>>
+RunnerDriver::StartZygoteSession(const RunnerOptions& zygote_options) const {
+  // Receives the end states of failed snaps, see RunImpl().
+  int result_fd = -1;
+  if (zygote_options.binary_result_channel()) {
+    result_fd = memfd_create("runner_result", MFD_CLOEXEC);
+    if (result_fd == -1) {
+      return absl::ErrnoToStatus(errno, "memfd_create");
+    }
+  }
+  absl::Cleanup result_fd_closer = [result_fd] {
+    if (result_fd != -1) close(result_fd);
+  };
+
+  // The corpus and all runner flags are passed with each request.
+  std::vector<std::string> argv = {binary_path_, "--zygote"};
   Subprocess::Options options = Subprocess::Options::Default();
-  options.DisableAslr(runner_options.disable_aslr())
+  options.SetParentDeathSignal(SIGKILL)
+      .PipeStdin(true)
+      .DisableAslr(zygote_options.disable_aslr());
+  if (zygote_options.map_stderr_to_dev_null()) {
+    options.MapStderr(Subprocess::kMapToDevNull);
+  }
+  if (result_fd != -1) {
+    options.InheritFd(result_fd);
+  }
+
+  auto zygote_proc = std::make_unique<Subprocess>(options);
+  RETURN_IF_NOT_OK(zygote_proc->Start(argv));
+  std::move(result_fd_closer).Cancel();
+  return std::unique_ptr<ZygoteSession>(
+      new ZygoteSession(this, std::move(zygote_proc), result_fd,
+                        zygote_options));
+}
+
+void RunnerDriver::PrepareRunnerProcess(const RunnerOptions& runner_options,
+                                        std::vector<std::string>* argv,
+                                        Subprocess::Options* options,
+                                        int result_fd) const {
+  *argv = {binary_path_};
+  options->DisableAslr(runner_options.disable_aslr())
       .SetParentDeathSignal(SIGKILL);
+  if (runner_options.cgroup_procs_fd() != -1) {
+    options->JoinCgroup(runner_options.cgroup_procs_fd());
+  }
   if (auto cpu_time_budget = runner_options.cpu_time_budget();
       cpu_time_budget != absl::InfiniteDuration()) {
     // Soft-cap at the runner_options.cpu_time_budget, hard-cap +1 second
     // to give the process a chance to exit gracefully.
-    options.SetRLimit(RLIMIT_CPU, absl::ToInt64Seconds(cpu_time_budget),
-                      absl::ToInt64Seconds(cpu_time_budget + absl::Seconds(1)));
+    options->SetRLimit(
+        RLIMIT_CPU, absl::ToInt64Seconds(cpu_time_budget),
+        absl::ToInt64Seconds(cpu_time_budget + absl::Seconds(1)));
   }
   if (auto wall_time_budget = runner_options.wall_time_budget();
       wall_time_budget != absl::InfiniteDuration()) {
-    options.SetITimer(ITIMER_REAL, wall_time_budget);
+    options->SetITimer(ITIMER_REAL, wall_time_budget);
   }
   if (runner_options.cpu() != kAnyCPUId) {
-    argv.push_back(absl::StrCat("--cpu=", runner_options.cpu()));
+    argv->push_back(absl::StrCat("--cpu=", runner_options.cpu()));
   }
   if (runner_options.sequential_mode()) {
-    argv.push_back("--sequential_mode");
+    argv->push_back("--sequential_mode");
+  }
+  if (runner_options.num_snap_ranges() > 1) {
+    argv->push_back(
+        absl::StrCat("--snap_range_index=", runner_options.snap_range_index()));
+    argv->push_back(
+        absl::StrCat("--num_snap_ranges=", runner_options.num_snap_ranges()));
+  }
+  if (runner_options.max_failures() > 1) {
+    argv->push_back(
+        absl::StrCat("--max_failures=", runner_options.max_failures()));
+  }
+  if (runner_options.snap_instruction_budget() != 0) {
+    argv->push_back(absl::StrCat("--snap_instruction_budget=",
+                                 runner_options.snap_instruction_budget()));
+  }
+  if (runner_options.corpus_load_address() != 0) {
+    argv->push_back(
+        absl::StrCat("--corpus_load_address=",
+                     absl::Hex(runner_options.corpus_load_address())));
+  }
+  if (!runner_options.perf_counters().empty()) {
+    argv->push_back(absl::StrCat(
+        "--perf_counters=",
+        absl::StrJoin(runner_options.perf_counters(), ",",
+                      [](std::string* out,
+                         const RunnerOptions::PerfCounter& counter) {
+                        absl::StrAppend(out, counter.type, ":0x",
+                                        absl::Hex(counter.config));
+                      })));
   }
   // Pass-thru VLOG levels to the runner.
   if (VLOG_IS_ON(1)) {
-    argv.push_back("--v=1");
+    argv->push_back("--v=1");
   } else if (VLOG_IS_ON(2)) {
-    argv.push_back("--v=2");
+    argv->push_back("--v=2");
   }
   if (!corpus_name_.empty()) {
-    argv.push_back(absl::StrCat("--corpus_name=", corpus_name_));
+    argv->push_back(absl::StrCat("--corpus_name=", corpus_name_));
+  }
+#if defined(__x86_64__)
+  if (runner_options.pass_cpu_features()) {
+    argv->push_back(
+        absl::StrCat("--cpu_features=", absl::Hex(GetX86CPUFeatureBits())));
+  }
+#endif
+  if (runner_options.pass_platform_id()) {
+    argv->push_back(
+        absl::StrCat("--platform_id=", ToInt(CurrentPlatformId())));
+  }
+  if (result_fd != -1) {
+    options->InheritFd(result_fd);
+    argv->push_back(absl::StrCat("--result_fd=", result_fd));
   }
   for (const std::string& extra : runner_options.extra_argv()) {
-    argv.push_back(extra);
+    argv->push_back(extra);
   }
 
   if (!corpus_path_.empty()) {
-    argv.push_back(corpus_path_);
+    argv->push_back(corpus_path_);
   }
 
   if (runner_options.map_stderr_to_dev_null()) {
-    options.MapStderr(Subprocess::kMapToDevNull);
+    options->MapStderr(Subprocess::kMapToDevNull);
+  }
+}
+
+// Generic entry point for all methods that need to execute the runner binary
+// and handle its output.
+absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::RunImpl(
+    const RunnerOptions& runner_options, absl::string_view snap_id,
+    std::optional<HarnessTracer::Callback> trace_cb,
+    std::optional<uint64_t> trace_start_address,
+    HarnessTracer::StepFilter trace_step_filter,
+    std::function<void(HarnessTracer&)> trace_activation_cb) const {
+  // Receives the end state of a failed snap from the runner, see --result_fd.
+  int result_fd = -1;
+  if (runner_options.binary_result_channel()) {
+    result_fd = memfd_create("runner_result", MFD_CLOEXEC);
+    if (result_fd == -1) {
+      return absl::ErrnoToStatus(errno, "memfd_create");
+    }
   }
+  absl::Cleanup result_fd_closer = [result_fd] {
+    if (result_fd != -1) close(result_fd);
+  };
+
+  std::vector<std::string> argv;
+  Subprocess::Options options = Subprocess::Options::Default();
+  PrepareRunnerProcess(runner_options, &argv, &options, result_fd);
 
   Subprocess runner_proc(options);
+  const uint64_t spawn_monotonic_ns = MonotonicNanos();
   RETURN_IF_NOT_OK(runner_proc.Start(argv));
 
   std::unique_ptr<HarnessTracer> tracer = nullptr;
   if (trace_cb.has_value()) {
     tracer = std::make_unique<HarnessTracer>(
         runner_proc.pid(), HarnessTracer::Mode::kSingleStep, trace_cb.value());
+    if (trace_start_address.has_value()) {
+      tracer->SetSingleStepStartAddress(*trace_start_address);
+    }
+    if (trace_step_filter) {
+      tracer->SetSingleStepFilter(std::move(trace_step_filter));
+    }
+    if (trace_activation_cb) {
+      tracer->SetActivationCallback(
+          [&tracer = *tracer, cb = std::move(trace_activation_cb)] {
+            cb(tracer);
+          });
+    }
     tracer->Attach();
   }
 
@@ -154,12 +889,78 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::RunImpl(
       exit_status = tracee_exit_status.value();
     }
   }
-  return HandleRunnerOutput(runner_stdout, exit_status, snap_id);
+  return HandleRunnerProcess(runner_proc, runner_stdout, exit_status, snap_id,
+                             spawn_monotonic_ns, result_fd);
+}
+
+absl::StatusOr<std::unique_ptr<RunnerDriver::AsyncRun>> RunnerDriver::StartRun(
+    const RunnerOptions& runner_options, absl::string_view snapshot_id) const {
+  // Receives the end state of a failed snap from the runner, see --result_fd.
+  int result_fd = -1;
+  if (runner_options.binary_result_channel()) {
+    result_fd = memfd_create("runner_result", MFD_CLOEXEC);
+    if (result_fd == -1) {
+      return absl::ErrnoToStatus(errno, "memfd_create");
+    }
+  }
+  absl::Cleanup result_fd_closer = [result_fd] {
+    if (result_fd != -1) close(result_fd);
+  };
+
+  std::vector<std::string> argv;
+  Subprocess::Options options = Subprocess::Options::Default();
+  PrepareRunnerProcess(runner_options, &argv, &options, result_fd);
+  options.OpenPidFd(true);
+
+  auto runner_proc = std::make_unique<Subprocess>(options);
+  const uint64_t spawn_monotonic_ns = MonotonicNanos();
+  RETURN_IF_NOT_OK(runner_proc->Start(argv));
+  std::move(result_fd_closer).Cancel();
+  return std::unique_ptr<AsyncRun>(new AsyncRun(this, std::move(runner_proc),
+                                                result_fd, spawn_monotonic_ns,
+                                                snapshot_id));
+}
+
+absl::StatusOr<std::unique_ptr<RunnerDriver::AsyncRun>>
+RunnerDriver::StartPlayOne(absl::string_view snap_id) const {
+  CHECK(!snap_id.empty());
+  return StartRun(RunnerOptions::PlayOptions(snap_id), snap_id);
+}
+
+absl::StatusOr<std::unique_ptr<RunnerDriver::AsyncRun>>
+RunnerDriver::StartMakeOne(absl::string_view snap_id,
+                           size_t max_pages_to_add) const {
+  CHECK(!snap_id.empty());
+  return StartRun(RunnerOptions::MakeOptions(snap_id, max_pages_to_add),
+                  snap_id);
+}
+
+absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::HandleRunnerProcess(
+    const Subprocess& runner_proc, absl::string_view runner_stdout,
+    int exit_status, absl::string_view snapshot_id,
+    uint64_t spawn_monotonic_ns, int result_fd) const {
+  MmappedMemoryPtr<char> result_records =
+      MakeMmappedMemoryPtr<char>(nullptr, 0);
+  if (result_fd != -1) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(result_records, MapResultFile(result_fd));
+  }
+  absl::StatusOr<RunResult> result = HandleRunnerOutput(
+      runner_stdout, exit_status, snapshot_id, spawn_monotonic_ns,
+      absl::string_view(result_records.get(),
+                        MmappedMemorySize(result_records)));
+  if (result.ok()) {
+    const struct rusage& usage = runner_proc.rusage();
+    result->set_runner_usage(absl::DurationFromTimeval(usage.ru_utime) +
+                                 absl::DurationFromTimeval(usage.ru_stime),
+                             usage.ru_maxrss);
+  }
+  return result;
 }
 
 absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::HandleRunnerOutput(
     absl::string_view runner_stdout, int exit_status,
-    absl::string_view snapshot_id) const {
+    absl::string_view snapshot_id, std::optional<uint64_t> spawn_monotonic_ns,
+    absl::string_view result_records) const {
   VLOG_INFO(3, absl::StrCat("Snapshot [", snapshot_id,
                             "] runner exit status = ", HexStr(exit_status)));
   if (WIFSIGNALED(exit_status)) {
@@ -180,7 +981,20 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::HandleRunnerOutput(
     // Successful execution
     ExitCode exit_code = static_cast<ExitCode>(WEXITSTATUS(exit_status));
     if (exit_code == ExitCode::kSuccess) {
-      return RunResult::Successful();
+      RunResult result = RunResult::Successful();
+      // The runner prints nothing on success unless it reports latency
+      // histograms, skipped snaps or startup timings.
+      if (absl::StripAsciiWhitespace(runner_stdout).empty()) {
+        return result;
+      }
+      // The snaps ran fine, so output that is not a report, e.g. written by
+      // a snap, does not make the run fail.
+      proto::SnapshotExecutionResult exec_result_proto;
+      if (!ParseRunnerReports(runner_stdout, exec_result_proto)) {
+        LOG_ERROR("Ignored unparseable runner output [", runner_stdout, "]");
+      }
+      CopyRunnerReports(exec_result_proto, spawn_monotonic_ns, result);
+      return result;
     }
     // Graceful shutdown due to timeout. Convert this to success with the
     // caveat that this can hide runners that are not making progress.
@@ -190,12 +1004,52 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::HandleRunnerOutput(
     // stdout logging). The idea is that instead of blindly converting exit
     // code 2 into Successful() we should also be checking that some progress
     // was made.
-    if (exit_code == ExitCode::kTimeout && snapshot_id.empty()) {
+    const bool timed_out =
+        exit_code == ExitCode::kTimeout && snapshot_id.empty();
+    if (absl::StrContains(runner_stdout, kFailureEndMarker) &&
+        (timed_out || exit_code == ExitCode::kFailure)) {
+      return HandleFailureBudgetOutput(runner_stdout, result_records,
+                                       spawn_monotonic_ns, timed_out);
+    }
+    if (timed_out) {
       VLOG_INFO(1, "Runner process timed out");
-      return RunResult::Successful();
+      RunResult result = RunResult::Successful();
+      // Keep whatever the runner reported before it was stopped. The output
+      // may have been cut short, so a parse failure is not an error.
+      proto::SnapshotExecutionResult exec_result_proto;
+      if (!absl::StripAsciiWhitespace(runner_stdout).empty() &&
+          ParseRunnerReports(runner_stdout, exec_result_proto)) {
+        CopyRunnerReports(exec_result_proto, spawn_monotonic_ns, result);
+      }
+      return result;
+    }
+    ASSIGN_OR_RETURN_IF_NOT_OK(std::vector<RunResult> record_results,
+                               DecodeResultRecords(result_records));
+    std::optional<RunResult> record_result;
+    if (!record_results.empty()) {
+      record_result = std::move(record_results.back());
     }
     google::protobuf::TextFormat::Parser parser;
     proto::SnapshotExecutionResult exec_result_proto;
+    if (record_result.has_value()) {
+      // The end state was written to --result_fd. stdout only carries the
+      // reports, if any.
+      if (!absl::StripAsciiWhitespace(runner_stdout).empty() &&
+          !parser.ParseFromString(std::string(runner_stdout),
+                                  &exec_result_proto)) {
+        return absl::InternalError(absl::StrCat(
+            "couldn't parse [", runner_stdout,
+            "] as proto::SnapshotExecutionResult. Exit status = ",
+            HexStr(exit_status)));
+      }
+      if (!snapshot_id.empty() && record_result->snapshot_id() != snapshot_id) {
+        return absl::InternalError(absl::StrCat(
+            "Runner misbehaved: got id [", record_result->snapshot_id(),
+            "] expected ", snapshot_id, ". Exit status = ", exit_status));
+      }
+      CopyRunnerReports(exec_result_proto, spawn_monotonic_ns, *record_result);
+      return *std::move(record_result);
+    }
     if (!parser.ParseFromString(std::string(runner_stdout),
                                 &exec_result_proto)) {
       return absl::InternalError(
@@ -203,6 +1057,14 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::HandleRunnerOutput(
                        "] as proto::SnapshotExecutionResult. Exit status = ",
                        HexStr(exit_status)));
     }
+    if (exec_result_proto.snapshot_id().empty() &&
+        !exec_result_proto.skipped_snapshot_ids().empty()) {
+      // The runner had nothing to run, e.g. the snap to make conflicts with
+      // the runner's own memory.
+      return absl::FailedPreconditionError(absl::StrCat(
+          "Runner skipped all snaps: ",
+          absl::StrJoin(exec_result_proto.skipped_snapshot_ids(), ", ")));
+    }
     if (!snapshot_id.empty() &&
         exec_result_proto.snapshot_id() != snapshot_id) {
       // This catches all runner crashes due to mmap errors etc.
@@ -218,43 +1080,195 @@ absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::HandleRunnerOutput(
       return absl::InternalError(
           absl::StrCat(exec_result_proto, " has no actual_end_state"));
     }
-    return RunResult(*player_result_or, exec_result_proto.snapshot_id());
+    RunResult result(*player_result_or, exec_result_proto.snapshot_id());
+    CopyRunnerReports(exec_result_proto, spawn_monotonic_ns, result);
+    return result;
   }
   return absl::InternalError(
       absl::StrCat("Unknown runner exit status ", exit_status));
 }
 
+absl::StatusOr<RunnerDriver::RunResult> RunnerDriver::HandleSessionOutput(
+    absl::string_view runner_stdout, int exit_status,
+    absl::string_view snapshot_id, std::optional<uint64_t> spawn_monotonic_ns,
+    int result_fd) const {
+  if (result_fd == -1) {
+    return HandleRunnerOutput(runner_stdout, exit_status, snapshot_id,
+                              spawn_monotonic_ns);
+  }
+  absl::StatusOr<RunResult> result;
+  {
+    ASSIGN_OR_RETURN_IF_NOT_OK(MmappedMemoryPtr<char> result_records,
+                               MapResultFile(result_fd));
+    result = HandleRunnerOutput(
+        runner_stdout, exit_status, snapshot_id, spawn_monotonic_ns,
+        absl::string_view(result_records.get(),
+                          MmappedMemorySize(result_records)));
+  }
+  // The runner shares the file offset of `result_fd` and is either waiting
+  // for the next command or gone, so rewinding here is not racy.
+  if (ftruncate(result_fd, 0) != 0 || lseek(result_fd, 0, SEEK_SET) != 0) {
+    return absl::ErrnoToStatus(errno, "Cannot reset result file");
+  }
+  return result;
+}
+
+AsyncRunGroup::AsyncRunGroup() : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)) {
+  CHECK_NE(epoll_fd_, -1);
+}
+
+AsyncRunGroup::~AsyncRunGroup() {
+  // The AsyncRun d-tors wait for the runners.
+  runs_.clear();
+  close(epoll_fd_);
+}
+
+void AsyncRunGroup::Watch(int fd, uint64_t data) {
+  struct epoll_event event = {.events = EPOLLIN, .data = {.u64 = data}};
+  CHECK_EQ(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event), 0);
+}
+
+void AsyncRunGroup::Unwatch(int fd) {
+  CHECK_EQ(epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr), 0);
+}
+
+void AsyncRunGroup::Add(std::unique_ptr<RunnerDriver::AsyncRun> run,
+                        uint64_t tag) {
+  const uint64_t key = next_key_++;
+  Watch(run->stdout_fd(), key << 1);
+  // Without a pidfd the exit is noticed by EOF on stdout.
+  const bool exited = run->pidfd() == -1;
+  if (!exited) {
+    Watch(run->pidfd(), (key << 1) | 1);
+  }
+  runs_.emplace(key, Entry{.run = std::move(run), .tag = tag,
+                           .exited = exited});
+}
+
+std::vector<AsyncRunGroup::Completion> AsyncRunGroup::Wait(
+    absl::Duration timeout) {
+  std::vector<Completion> completions;
+  if (runs_.empty()) return completions;
+
+  const int timeout_ms =
+      timeout == absl::InfiniteDuration()
+          ? -1
+          : static_cast<int>(absl::ToInt64Milliseconds(
+                absl::Ceil(timeout, absl::Milliseconds(1))));
+  constexpr int kMaxEvents = 64;
+  struct epoll_event events[kMaxEvents];
+  const int num_events = epoll_wait(epoll_fd_, events, kMaxEvents, timeout_ms);
+  if (num_events == -1) {
+    if (errno == EINTR) return completions;
+    LOG_FATAL("epoll_wait: ", ErrnoStr(errno));
+  }
+  for (int e = 0; e < num_events; ++e) {
+    auto it = runs_.find(events[e].data.u64 >> 1);
+    // Skip events of a run that was finished earlier in this batch.
+    if (it == runs_.end()) continue;
+    Entry& entry = it->second;
+    if (events[e].data.u64 & 1) {
+      Unwatch(entry.run->pidfd());
+      entry.exited = true;
+    } else if (!entry.run->ReadOutput()) {
+      Unwatch(entry.run->stdout_fd());
+      entry.output_done = true;
+    }
+    if (entry.output_done && entry.exited) {
+      completions.push_back(
+          Completion{.tag = entry.tag, .result = entry.run->Finish()});
+      runs_.erase(it);
+    }
+  }
+  return completions;
+}
+
+absl::StatusOr<RunnerDriver::RunResult> ZygotePool::MakeOne(
+    const RunnerDriver& driver, absl::string_view snap_id,
+    size_t max_pages_to_add) {
+  return WithZygote(RunnerOptions::MakeOptions(snap_id, max_pages_to_add),
+                    [&](RunnerDriver::ZygoteSession& session) {
+                      return session.MakeOne(driver, snap_id,
+                                             max_pages_to_add);
+                    });
+}
+
+absl::StatusOr<RunnerDriver::RunResult> ZygotePool::VerifyOneRepeatedly(
+    const RunnerDriver& driver, absl::string_view snap_id, int num_attempts) {
+  return WithZygote(RunnerOptions::VerifyOptions(snap_id),
+                    [&](RunnerDriver::ZygoteSession& session) {
+                      return session.VerifyOneRepeatedly(driver, snap_id,
+                                                         num_attempts);
+                    });
+}
+
+absl::StatusOr<RunnerDriver::RunResult> ZygotePool::WithZygote(
+    const RunnerOptions& runner_options,
+    absl::FunctionRef<absl::StatusOr<RunnerDriver::RunResult>(
+        RunnerDriver::ZygoteSession&)>
+        run) {
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      std::unique_ptr<RunnerDriver::ZygoteSession> session,
+      Acquire(runner_options));
+  absl::StatusOr<RunnerDriver::RunResult> result = run(*session);
+  if (absl::IsUnavailable(result.status())) {
+    // The zygote exited, possibly while idle in the pool. Drop it and retry
+    // once with another one.
+    ASSIGN_OR_RETURN_IF_NOT_OK(session, Acquire(runner_options));
+    result = run(*session);
+  }
+  Release(std::move(session));
+  return result;
+}
+
+absl::StatusOr<std::unique_ptr<RunnerDriver::ZygoteSession>>
+ZygotePool::Acquire(const RunnerOptions& runner_options) {
+  {
+    absl::MutexLock lock(&mu_);
+    for (auto it = idle_.rbegin(); it != idle_.rend(); ++it) {
+      if ((*it)->CanRun(runner_options)) {
+        std::unique_ptr<RunnerDriver::ZygoteSession> session = std::move(*it);
+        idle_.erase(std::next(it).base());
+        return session;
+      }
+    }
+  }
+  // Started outside of the lock, other callers can use idle zygotes meanwhile.
+  RunnerOptions zygote_options = runner_options;
+  zygote_options.set_binary_result_channel(true);
+  return zygote_driver_.StartZygoteSession(zygote_options);
+}
+
+void ZygotePool::Release(
+    std::unique_ptr<RunnerDriver::ZygoteSession> session) {
+  if (!session->alive()) return;
+  absl::MutexLock lock(&mu_);
+  idle_.push_back(std::move(session));
+}
+
 absl::StatusOr<RunnerDriver> RunnerDriverFromSnapshot(
     const Snapshot& snapshot, absl::string_view runner_path) {
-  std::vector<Snapshot> corpus;
-  corpus.push_back(snapshot.Copy());
-
-  MmappedMemoryPtr<char> buffer =
-      GenerateRelocatableSnaps(Host::architecture_id, corpus);
-  size_t buffer_size = MmappedMemorySize(buffer);
+  const Snapshot* const corpus[] = {&snapshot};
 
-  // Allocate an anonymous memfile, copy the relocatable buffer contents there,
-  // then seal the file to prevent any future writes.
-  // TODO(ksteuck): [impl] We can also augment GenerateRelocatableSnaps() API
-  // to take a buffer parameter and avoid the extra copy.
+  // Generate the relocatable corpus directly into an anonymous memfile, then
+  // seal the file to prevent any future writes.
   int memfd = memfd_create(snapshot.id().c_str(),
                            O_RDWR | MFD_ALLOW_SEALING | MFD_CLOEXEC);
   if (memfd == -1) {
     return absl::ErrnoToStatus(errno, "memfd_create");
   }
-  if (ftruncate(memfd, buffer_size) != 0) {
-    return absl::ErrnoToStatus(errno, "ftruncate");
-  }
-  // WARNING: This code uses write(2) to populate the memfd. An appealing
-  // alternative is to mmap(2) the FD and do a memcpy. Unfortunately, this
-  // approach fails in multithreaded environment if the running process forks.
-  CHECK_EQ(Write(memfd, buffer.get(), buffer_size), buffer_size);
+  absl::Cleanup memfd_closer = [memfd] { close(memfd); };
+  RETURN_IF_NOT_OK(
+      GenerateRelocatableSnapsToFile(Host::architecture_id, corpus, memfd)
+          .status());
   // Once sealed, the file's contents and size cannot be changed.  The seal
-  // itself also cannot be modified.
+  // itself also cannot be modified. The generator does not map the file, so
+  // there is no writable mapping that would make sealing fail.
   if (fcntl(memfd, F_ADD_SEALS,
             F_SEAL_SEAL | F_SEAL_WRITE | F_SEAL_SHRINK | F_SEAL_GROW) != 0) {
     return absl::ErrnoToStatus(errno, "fcntl");
   }
+  std::move(memfd_closer).Cancel();
 
   // This is a tacky way of passing the memfd to the subprocess but on the
   // upside it does not involve passing the actual FD and thus does not
@@ -16,19 +16,29 @@
 #define THIRD_PARTY_SILIFUZZ_RUNNER_DRIVER_RUNNER_DRIVER_H_
 
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "./common/harness_tracer.h"
 #include "./common/snapshot.h"
 #include "./common/snapshot_enums.h"
+#include "./proto/snapshot_execution_result.pb.h"
 #include "./runner/driver/runner_options.h"
 #include "./util/checks.h"
+#include "./util/subprocess.h"
 
 namespace silifuzz {
 
@@ -91,6 +101,91 @@ class RunnerDriver {
       return *player_result_;
     }
 
+    // Per-snap latency histograms reported by the runner. Empty unless the
+    // runner was invoked with --collect_snap_latency.
+    const std::vector<proto::SnapLatencyHistogram>& snap_latency_histograms()
+        const {
+      return snap_latency_histograms_;
+    }
+
+    void set_snap_latency_histograms(
+        std::vector<proto::SnapLatencyHistogram> snap_latency_histograms) {
+      snap_latency_histograms_ = std::move(snap_latency_histograms);
+    }
+
+    // IDs of snaps the runner skipped because they conflict with the
+    // runner's own memory mappings.
+    const std::vector<std::string>& skipped_snapshot_ids() const {
+      return skipped_snapshot_ids_;
+    }
+
+    void set_skipped_snapshot_ids(
+        std::vector<std::string> skipped_snapshot_ids) {
+      skipped_snapshot_ids_ = std::move(skipped_snapshot_ids);
+    }
+
+    // Time the runner spent in each startup phase. Only present when the
+    // runner was invoked with --report_startup_timings.
+    struct StartupTimings {
+      // From spawning the runner process until it entered main(). Zero if
+      // the runner was not spawned for this result, e.g. in persistent mode.
+      absl::Duration exec;
+
+      // See proto::RunnerStartupTimings.
+      absl::Duration load_corpus;
+      absl::Duration map_corpus;
+      absl::Duration verify_checksums;
+
+      // Only non-zero with --prefault_snap_mappings or --lock_snap_mappings.
+      uint64_t prefaulted_bytes = 0;
+      uint64_t locked_bytes = 0;
+      uint64_t num_prefault_failures = 0;
+    };
+    const std::optional<StartupTimings>& startup_timings() const {
+      return startup_timings_;
+    }
+
+    void set_startup_timings(const StartupTimings& startup_timings) {
+      startup_timings_ = startup_timings;
+    }
+
+    // Counts of the PMU events in RunnerOptions::perf_counters() over the
+    // snap batches played by the runner, and the number of batches that were
+    // not counted. Empty and zero unless perf counters were requested.
+    const std::vector<uint64_t>& perf_counter_values() const {
+      return perf_counter_values_;
+    }
+    uint64_t perf_counter_missed_batches() const {
+      return perf_counter_missed_batches_;
+    }
+
+    void set_perf_counters(std::vector<uint64_t> values,
+                           uint64_t missed_batches) {
+      perf_counter_values_ = std::move(values);
+      perf_counter_missed_batches_ = missed_batches;
+    }
+
+    // User plus system CPU time and peak RSS of the runner process that
+    // produced this result. Zero when unknown.
+    absl::Duration runner_cpu_time() const { return runner_cpu_time_; }
+    uint64_t runner_max_rss_kb() const { return runner_max_rss_kb_; }
+
+    void set_runner_usage(absl::Duration cpu_time, uint64_t max_rss_kb) {
+      runner_cpu_time_ = cpu_time;
+      runner_max_rss_kb_ = max_rss_kb;
+    }
+
+    // Failures the runner reported before this one, oldest first. Only
+    // non-empty if the runner was invoked with RunnerOptions::max_failures()
+    // greater than 1, in which case this result is the last failure.
+    const std::vector<RunResult>& earlier_failures() const {
+      return earlier_failures_;
+    }
+
+    void set_earlier_failures(std::vector<RunResult> earlier_failures) {
+      earlier_failures_ = std::move(earlier_failures);
+    }
+
    private:
     // Constructs a new RunResult with the given success status and no
     // associated `player_result`.
@@ -105,6 +200,229 @@ class RunnerDriver {
 
     // Snapshot id (if any).
     std::string snapshot_id_;
+
+    // See snap_latency_histograms().
+    std::vector<proto::SnapLatencyHistogram> snap_latency_histograms_;
+
+    // See skipped_snapshot_ids().
+    std::vector<std::string> skipped_snapshot_ids_;
+
+    // See startup_timings().
+    std::optional<StartupTimings> startup_timings_;
+
+    // See perf_counter_values() and perf_counter_missed_batches().
+    std::vector<uint64_t> perf_counter_values_;
+    uint64_t perf_counter_missed_batches_ = 0;
+
+    // See runner_cpu_time() and runner_max_rss_kb().
+    absl::Duration runner_cpu_time_;
+    uint64_t runner_max_rss_kb_ = 0;
+
+    // See earlier_failures().
+    std::vector<RunResult> earlier_failures_;
+  };
+
+  // A runner process in persistent mode. The process maps the corpus once
+  // and then executes snaps on demand without paying the process startup and
+  // corpus mapping costs again. See RunnerMainPersistent() in runner.h.
+  //
+  // The RunnerDriver that created the session must outlive it.
+  //
+  // This class is thread-compatible.
+  class PersistentSession {
+   public:
+    // Not movable or copyable, owns a running process.
+    PersistentSession(const PersistentSession&) = delete;
+    PersistentSession& operator=(const PersistentSession&) = delete;
+
+    // Closes the runner's stdin and waits for the process to exit.
+    ~PersistentSession();
+
+    // Executes `num_iterations` randomly scheduled snaps using `seed` in the
+    // runner process. The result is interpreted in the same way as
+    // RunnerDriver::Run(). Once the runner process has exited, e.g. because
+    // of a timeout or a crash, the result reflects the exit status and all
+    // subsequent calls fail.
+    absl::StatusOr<RunResult> Run(size_t num_iterations, uint64_t seed);
+
+    // Tests if the runner process is still running.
+    bool alive() const { return runner_proc_ != nullptr; }
+
+   private:
+    friend class RunnerDriver;
+
+    PersistentSession(const RunnerDriver* driver,
+                      std::unique_ptr<Subprocess> runner_proc, int result_fd)
+        : driver_(driver),
+          runner_proc_(std::move(runner_proc)),
+          result_fd_(result_fd) {}
+
+    // Consumes the remaining output of the runner and waits for it to exit.
+    // Appends the output to `runner_stdout` and returns the exit status.
+    int Finish(std::string* runner_stdout);
+
+    const RunnerDriver* driver_;
+
+    // Runner process or nullptr if it has exited.
+    std::unique_ptr<Subprocess> runner_proc_;
+
+    // File the runner writes failed snap results to as binary records, see
+    // --result_fd, or -1 if results are printed to stdout. Owned by this.
+    int result_fd_;
+  };
+
+  // A runner process started by StartRun(). The caller waits for the process
+  // with poll(2) or epoll(7) on stdout_fd() and pidfd() and collects the
+  // result with Finish(), so one thread can drive many runners.
+  //
+  // The RunnerDriver that created the run must outlive it.
+  //
+  // This class is thread-compatible.
+  class AsyncRun {
+   public:
+    // Not movable or copyable, owns a running process.
+    AsyncRun(const AsyncRun&) = delete;
+    AsyncRun& operator=(const AsyncRun&) = delete;
+
+    // Waits for the process to exit if Finish() was not called.
+    ~AsyncRun();
+
+    // The runner's stdout. Readable when there is output to ReadOutput() or
+    // at EOF.
+    int stdout_fd() const { return runner_proc_->stdout_fd(); }
+
+    // pidfd of the runner, readable once it has exited, or -1 if the kernel
+    // does not support pidfds.
+    int pidfd() const { return runner_proc_->pidfd(); }
+
+    // Reads the output available on stdout_fd(). Returns false at EOF.
+    bool ReadOutput() { return runner_proc_->ReadAvailableStdout(); }
+
+    // Consumes the remaining output, waits for the runner to exit and
+    // interprets the result in the same way as RunnerDriver::Run(). Does not
+    // block once ReadOutput() has returned false and pidfd() is readable.
+    // REQUIRES: Called at most once.
+    absl::StatusOr<RunResult> Finish();
+
+   private:
+    friend class RunnerDriver;
+
+    AsyncRun(const RunnerDriver* driver,
+             std::unique_ptr<Subprocess> runner_proc, int result_fd,
+             uint64_t spawn_monotonic_ns, absl::string_view snapshot_id)
+        : driver_(driver),
+          runner_proc_(std::move(runner_proc)),
+          result_fd_(result_fd),
+          spawn_monotonic_ns_(spawn_monotonic_ns),
+          snapshot_id_(snapshot_id) {}
+
+    const RunnerDriver* driver_;
+
+    // Runner process. Reaped by Finish().
+    std::unique_ptr<Subprocess> runner_proc_;
+
+    // See --result_fd or -1 if results are printed to stdout. Owned by this.
+    int result_fd_;
+
+    // CLOCK_MONOTONIC time in nanoseconds just before the runner was spawned.
+    uint64_t spawn_monotonic_ns_;
+
+    // The snap the runner was started for, if any. See StartRun().
+    std::string snapshot_id_;
+
+    bool finished_ = false;
+  };
+
+  // A runner process in zygote mode. The process does the runner
+  // initialization that depends on neither the corpus nor the options once
+  // and then forks a ready runner for every request, so each run costs a
+  // fork() instead of an exec() and the runner startup. See ZygoteMain() in
+  // runner.h.
+  //
+  // The RunnerDriver that created the session must outlive it.
+  //
+  // This class is thread-compatible.
+  class ZygoteSession {
+   public:
+    // Not movable or copyable, owns a running process.
+    ZygoteSession(const ZygoteSession&) = delete;
+    ZygoteSession& operator=(const ZygoteSession&) = delete;
+
+    // Closes the zygote's stdin and waits for the process to exit.
+    ~ZygoteSession();
+
+    // Like RunnerDriver::Run() but the runner is forked by the zygote.
+    // `snapshot_id` is reported in the result as in RunnerDriver::MakeOne().
+    // Tracing is not supported and the runner's CPU time and max RSS are not
+    // reported. The arguments of the runner must not contain spaces or
+    // newlines. Returns an InvalidArgument error unless CanRun()
+    // `runner_options`. Returns an Unavailable error if the zygote has exited,
+    // after which all subsequent calls fail.
+    absl::StatusOr<RunResult> Run(const RunnerOptions& runner_options,
+                                  absl::string_view snapshot_id = "");
+
+    // Same as RunnerDriver::MakeOne() but through the zygote.
+    absl::StatusOr<RunResult> MakeOne(absl::string_view snap_id,
+                                      size_t max_pages_to_add = 0);
+
+    // Same as RunnerDriver::VerifyOneRepeatedly() but through the zygote.
+    absl::StatusOr<RunResult> VerifyOneRepeatedly(absl::string_view snap_id,
+                                                  int num_attempts);
+
+    // Like the methods above but run the corpus of `driver` instead of the
+    // corpus of the RunnerDriver that created the session. This lets one
+    // zygote run corpora made on the fly, e.g. by RunnerDriverFromSnapshot().
+    // REQUIRES: `driver` wraps the same runner binary as the session.
+    absl::StatusOr<RunResult> Run(const RunnerDriver& driver,
+                                  const RunnerOptions& runner_options,
+                                  absl::string_view snapshot_id = "");
+    absl::StatusOr<RunResult> MakeOne(const RunnerDriver& driver,
+                                      absl::string_view snap_id,
+                                      size_t max_pages_to_add = 0);
+    absl::StatusOr<RunResult> VerifyOneRepeatedly(const RunnerDriver& driver,
+                                                  absl::string_view snap_id,
+                                                  int num_attempts);
+
+    // Tests if the zygote process is still running.
+    bool alive() const { return zygote_proc_ != nullptr; }
+
+    // Tests if the zygote can fork runners with `runner_options`. Runners
+    // inherit the address space randomization and stderr of the zygote, so
+    // disable_aslr() and map_stderr_to_dev_null() must match the options
+    // the zygote was started with.
+    bool CanRun(const RunnerOptions& runner_options) const {
+      return runner_options.disable_aslr() == disable_aslr_ &&
+             runner_options.map_stderr_to_dev_null() == map_stderr_to_dev_null_;
+    }
+
+   private:
+    friend class RunnerDriver;
+
+    ZygoteSession(const RunnerDriver* driver,
+                  std::unique_ptr<Subprocess> zygote_proc, int result_fd,
+                  const RunnerOptions& zygote_options)
+        : driver_(driver),
+          zygote_proc_(std::move(zygote_proc)),
+          result_fd_(result_fd),
+          disable_aslr_(zygote_options.disable_aslr()),
+          map_stderr_to_dev_null_(zygote_options.map_stderr_to_dev_null()) {}
+
+    // Closes the zygote's stdin, consumes its remaining output and waits for
+    // it to exit. Returns the exit status.
+    int Finish();
+
+    const RunnerDriver* driver_;
+
+    // Zygote process or nullptr if it has exited.
+    std::unique_ptr<Subprocess> zygote_proc_;
+
+    // File the runners write failed snap results to as binary records, see
+    // --result_fd, or -1 if results are printed to stdout. Owned by this.
+    int result_fd_;
+
+    // Options the zygote was started with, see CanRun().
+    bool disable_aslr_;
+    bool map_stderr_to_dev_null_;
   };
 
   // Creates a RunnerDriver for a binary with baked-in corpus.
@@ -148,21 +466,98 @@ class RunnerDriver {
   // Traces `snap_id` in single-step mode and invokes the provided callback for
   // every instruction of the snapshot. This runs the snapshot `num_iterations`
   // times.
-  absl::StatusOr<RunResult> TraceOne(absl::string_view snap_id,
-                                     HarnessTracer::Callback cb,
-                                     size_t num_iterations = 1) const;
+  // If `start_address` is set, the runner code leading into the snapshot runs
+  // at full speed and single-stepping starts at that address, typically the
+  // entry point of the snapshot. See
+  // HarnessTracer::SetSingleStepStartAddress().
+  // If `step_filter` is set, `cb` is only invoked for the single-step stops it
+  // accepts. See HarnessTracer::SetSingleStepFilter().
+  absl::StatusOr<RunResult> TraceOne(
+      absl::string_view snap_id, HarnessTracer::Callback cb,
+      size_t num_iterations = 1,
+      std::optional<uint64_t> start_address = std::nullopt,
+      HarnessTracer::StepFilter step_filter = nullptr) const;
+
+  // Callback of TraceMany(). Like HarnessTracer::Callback but also receives
+  // the index in `snap_ids` of the snap being traced.
+  using MultiTraceCallback = std::function<HarnessTracer::ContinuationMode(
+      size_t snap_index, pid_t, const user_regs_struct&,
+      HarnessTracer::CallbackReason)>;
+
+  // Step filter of TraceMany(). Like HarnessTracer::StepFilter but also
+  // receives the index in `snap_ids` of the snap being traced.
+  using MultiStepFilter =
+      std::function<bool(size_t snap_index, uint64_t instruction_pointer)>;
+
+  // Like TraceOne() but traces each of `snap_ids` once, in order, in a single
+  // runner process under a single tracer. The runner toggles the tracer
+  // around every snap and each activation is attributed to the next snap, so
+  // runner startup and ptrace attach are paid once for all snaps.
+  // If not empty, `start_addresses` has the start address of each snap. The
+  // runner stops at the first snap that fails and the result names it. Snaps
+  // after it are not traced.
+  // REQUIRES snap_ids is not empty and none of its elements is empty.
+  absl::StatusOr<RunResult> TraceMany(
+      absl::Span<const std::string> snap_ids, MultiTraceCallback cb,
+      absl::Span<const uint64_t> start_addresses = {},
+      MultiStepFilter step_filter = nullptr) const;
 
   // Ensures that `snap_id` replays deterministically.
   // REQUIRES snap_id is not empty.
   absl::StatusOr<RunResult> VerifyOneRepeatedly(absl::string_view snap_id,
                                                 int num_attempts) const;
 
+  // Like VerifyOneRepeatedly() but pins attempt i to cpus[i % cpus.size()]
+  // and plays the attempts of different CPUs concurrently. Attempts on the
+  // same CPU run one after another. Once an attempt fails, attempts that have
+  // not started yet are skipped. Returns the failure on the earliest CPU in
+  // `cpus` if any attempt failed.
+  // REQUIRES snap_id is not empty, cpus is not empty and num_attempts > 0.
+  absl::StatusOr<RunResult> VerifyOneOnCPUs(absl::string_view snap_id,
+                                            absl::Span<const int> cpus,
+                                            int num_attempts) const;
+
   // Runs the runner binary with the provided runner_options.
   //
   // Unlike the *One() family of methods above this is a more generic way of
   // calling the binary that is intended for screening.
   absl::StatusOr<RunResult> Run(const RunnerOptions& runner_options) const;
 
+  // Like Run() but returns once the runner has started. The result is
+  // collected with AsyncRun::Finish(). Tracing is not supported. If not
+  // empty, `snapshot_id` is the snap the runner executes and is checked
+  // against the reported one like in PlayOne().
+  absl::StatusOr<std::unique_ptr<AsyncRun>> StartRun(
+      const RunnerOptions& runner_options,
+      absl::string_view snapshot_id = "") const;
+
+  // Like PlayOne() but returns once the runner has started, see StartRun().
+  // REQUIRES snap_id is not empty.
+  absl::StatusOr<std::unique_ptr<AsyncRun>> StartPlayOne(
+      absl::string_view snap_id) const;
+
+  // Like MakeOne() but returns once the runner has started, see StartRun().
+  // REQUIRES snap_id is not empty.
+  absl::StatusOr<std::unique_ptr<AsyncRun>> StartMakeOne(
+      absl::string_view snap_id, size_t max_pages_to_add = 0) const;
+
+  // Starts the runner binary in persistent mode with the provided
+  // runner_options. CPU and wall time budgets apply to the whole session.
+  // With runner_options.binary_result_channel(), failed snaps of every
+  // command are reported through the same binary records as in Run().
+  absl::StatusOr<std::unique_ptr<PersistentSession>> StartPersistentSession(
+      const RunnerOptions& runner_options) const;
+
+  // Starts the runner binary as a zygote for runs with options like
+  // `zygote_options`. The zygote is started with zygote_options.disable_aslr()
+  // and zygote_options.map_stderr_to_dev_null(), which the forked runners
+  // inherit, see ZygoteSession::CanRun(). With
+  // zygote_options.binary_result_channel(), failed snaps of every run are
+  // reported through the same binary records as in Run(), regardless of the
+  // options of the run. The other options only apply to each run.
+  absl::StatusOr<std::unique_ptr<ZygoteSession>> StartZygoteSession(
+      const RunnerOptions& zygote_options) const;
+
  private:
   // Wraps the binary at `binary_path`. When `corpus_path` not empty, it will
   // be passed as the last argument to the binary.
@@ -196,13 +591,51 @@ class RunnerDriver {
     kFailure = 1,
     kTimeout = 2,
   };
+  // Builds the runner command line and subprocess options corresponding to
+  // `runner_options`. If not -1, `result_fd` is passed to the runner as
+  // --result_fd.
+  void PrepareRunnerProcess(const RunnerOptions& runner_options,
+                            std::vector<std::string>* argv,
+                            Subprocess::Options* options, int result_fd) const;
+
+  // If `trace_cb` is set, the runner is single-stepped starting at
+  // `trace_start_address` if set and stops are filtered by `trace_step_filter`
+  // if set, see TraceOne(). `trace_activation_cb`, if set, is invoked with the
+  // tracer each time the runner activates it, see
+  // HarnessTracer::SetActivationCallback().
   absl::StatusOr<RunResult> RunImpl(
       const RunnerOptions& runner_options, absl::string_view snap_id = "",
-      std::optional<HarnessTracer::Callback> trace_cb = std::nullopt) const;
-
+      std::optional<HarnessTracer::Callback> trace_cb = std::nullopt,
+      std::optional<uint64_t> trace_start_address = std::nullopt,
+      HarnessTracer::StepFilter trace_step_filter = nullptr,
+      std::function<void(HarnessTracer&)> trace_activation_cb = nullptr) const;
+
+  // Converts the output of a runner process to a RunResult. If the runner
+  // was spawned for this result, `spawn_monotonic_ns` is the CLOCK_MONOTONIC
+  // time in nanoseconds just before that. `result_records` is what the
+  // runner wrote to --result_fd, if anything. A failed snap is taken from
+  // there and from `runner_stdout` otherwise.
   absl::StatusOr<RunResult> HandleRunnerOutput(
       absl::string_view runner_stdout, int exit_status,
-      absl::string_view snapshot_id = "") const;
+      absl::string_view snapshot_id = "",
+      std::optional<uint64_t> spawn_monotonic_ns = std::nullopt,
+      absl::string_view result_records = "") const;
+
+  // Like HandleRunnerOutput() for a runner process that was spawned for this
+  // result and has been reaped. Reads the records from `result_fd` if not -1
+  // and adds the resource usage of `runner_proc` to the result.
+  absl::StatusOr<RunResult> HandleRunnerProcess(
+      const Subprocess& runner_proc, absl::string_view runner_stdout,
+      int exit_status, absl::string_view snapshot_id,
+      uint64_t spawn_monotonic_ns, int result_fd) const;
+
+  // Like HandleRunnerOutput() for the output of one run of a session. If not
+  // -1, `result_fd` is the session's result file, which holds the records
+  // written in this run. It is emptied for the next run.
+  absl::StatusOr<RunResult> HandleSessionOutput(
+      absl::string_view runner_stdout, int exit_status,
+      absl::string_view snapshot_id,
+      std::optional<uint64_t> spawn_monotonic_ns, int result_fd) const;
 
   // C-tor parameters.
   std::string binary_path_;
@@ -218,6 +651,142 @@ class RunnerDriver {
   std::unique_ptr<RunnerDriver, std::function<void(RunnerDriver*)>> cleanup_;
 };
 
+// Drives many RunnerDriver::AsyncRun-s from one thread. Started runs are
+// added with a caller-chosen tag and Wait() returns the results of the runs
+// that have finished. This lets a single thread keep many runners in flight
+// and prepare the next snapshots while they execute.
+//
+// The RunnerDrivers that started the runs must outlive them.
+//
+// This class is thread-compatible.
+class AsyncRunGroup {
+ public:
+  // The result of a finished run and the tag it was added with.
+  struct Completion {
+    uint64_t tag;
+    absl::StatusOr<RunnerDriver::RunResult> result;
+  };
+
+  AsyncRunGroup();
+
+  // Not movable or copyable, owns running processes.
+  AsyncRunGroup(const AsyncRunGroup&) = delete;
+  AsyncRunGroup& operator=(const AsyncRunGroup&) = delete;
+
+  // Waits for the runs still in the group to exit and drops their results.
+  ~AsyncRunGroup();
+
+  // Adds a started `run` to the group. Tags need not be unique.
+  // REQUIRES: ReadOutput() and Finish() have not been called on `run`.
+  void Add(std::unique_ptr<RunnerDriver::AsyncRun> run, uint64_t tag);
+
+  // Number of runs that have not been returned by Wait() yet.
+  size_t size() const { return runs_.size(); }
+  bool empty() const { return runs_.empty(); }
+
+  // Waits until at least one run has finished or `timeout` has passed and
+  // returns the results of all finished runs in no particular order. Returns
+  // an empty list if the group is empty, on timeout or if interrupted by a
+  // signal.
+  std::vector<Completion> Wait(
+      absl::Duration timeout = absl::InfiniteDuration());
+
+ private:
+  struct Entry {
+    std::unique_ptr<RunnerDriver::AsyncRun> run;
+    uint64_t tag;
+    // EOF on stdout was read.
+    bool output_done = false;
+    // The runner has exited. Noticed by EOF on stdout without a pidfd.
+    bool exited = false;
+  };
+
+  // Adds or removes `fd` to the fds watched by epoll_fd_.
+  void Watch(int fd, uint64_t data);
+  void Unwatch(int fd);
+
+  int epoll_fd_;
+
+  // Runs keyed by a unique number. epoll event data is the key shifted left
+  // by one. The low bit tells whether the event is for the pidfd or stdout.
+  absl::flat_hash_map<uint64_t, Entry> runs_;
+  uint64_t next_key_ = 0;
+};
+
+// A pool of zygote runners, see RunnerDriver::ZygoteSession, that runs the
+// corpora of other RunnerDrivers. Making and verifying a snapshot runs a
+// one-snap corpus several times, see RunnerDriverFromSnapshot(). Going through
+// the pool, each of those runs costs a fork() of an initialized runner instead
+// of a process spawn and the runner startup.
+//
+// Zygotes are started on demand, one per concurrent caller and per set of
+// zygote options (see ZygoteSession::CanRun()), and are kept for reuse once a
+// run is done. A zygote that has exited is dropped from the pool.
+//
+// This class is thread-safe.
+class ZygotePool {
+ public:
+  // Creates an empty pool of zygotes of the runner binary at `runner_path`.
+  explicit ZygotePool(absl::string_view runner_path)
+      : runner_path_(runner_path),
+        zygote_driver_(RunnerDriver::BakedRunner(runner_path)) {}
+
+  // Not movable or copyable, the zygotes refer to zygote_driver_.
+  ZygotePool(const ZygotePool&) = delete;
+  ZygotePool& operator=(const ZygotePool&) = delete;
+
+  // Waits for all idle zygotes to exit.
+  ~ZygotePool() = default;
+
+  // Same as driver.MakeOne() but forks the runner from a pooled zygote.
+  // REQUIRES: `driver` wraps the runner binary of this pool.
+  absl::StatusOr<RunnerDriver::RunResult> MakeOne(const RunnerDriver& driver,
+                                                  absl::string_view snap_id,
+                                                  size_t max_pages_to_add = 0);
+
+  // Same as driver.VerifyOneRepeatedly() but forks the runners from a pooled
+  // zygote.
+  // REQUIRES: `driver` wraps the runner binary of this pool.
+  absl::StatusOr<RunnerDriver::RunResult> VerifyOneRepeatedly(
+      const RunnerDriver& driver, absl::string_view snap_id, int num_attempts);
+
+  // Location of the runner binary of this pool.
+  const std::string& runner_path() const { return runner_path_; }
+
+  // Number of zygotes waiting for a caller.
+  size_t num_idle() const {
+    absl::MutexLock lock(&mu_);
+    return idle_.size();
+  }
+
+ private:
+  // Calls `run` with a zygote acquired for `runner_options` and releases it
+  // afterwards. If the zygote turns out to have exited, retries once with
+  // another zygote.
+  absl::StatusOr<RunnerDriver::RunResult> WithZygote(
+      const RunnerOptions& runner_options,
+      absl::FunctionRef<absl::StatusOr<RunnerDriver::RunResult>(
+          RunnerDriver::ZygoteSession&)>
+          run);
+
+  // Takes an idle zygote that can run `runner_options` out of the pool or
+  // starts a new one.
+  absl::StatusOr<std::unique_ptr<RunnerDriver::ZygoteSession>> Acquire(
+      const RunnerOptions& runner_options);
+
+  // Puts `session` back into the pool if its zygote is still running.
+  void Release(std::unique_ptr<RunnerDriver::ZygoteSession> session);
+
+  const std::string runner_path_;
+
+  // Starts the zygotes. Has no corpus of its own.
+  const RunnerDriver zygote_driver_;
+
+  mutable absl::Mutex mu_;
+  std::vector<std::unique_ptr<RunnerDriver::ZygoteSession>> idle_
+      ABSL_GUARDED_BY(mu_);
+};
+
 // Compiles `snapshot` into a runner binary containing exactly one snap.
 // RETURNS RunnerDriver wrapping the runner executable file or a status.
 absl::StatusOr<RunnerDriver> RunnerDriverFromSnapshot(
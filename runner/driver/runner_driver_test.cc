@@ -14,23 +14,33 @@
 
 #include "./runner/driver/runner_driver.h"
 
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/user.h>
 
+#include <cstddef>
 #include <cstdint>
 #include <filesystem>  // NOLINT
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/time/time.h"
 #include "./common/harness_tracer.h"
 #include "./common/snapshot.h"
 #include "./common/snapshot_enums.h"
 #include "./common/snapshot_test_enum.h"
+#include "./runner/driver/runner_options.h"
 #include "./runner/runner_provider.h"
 #include "./snap/testing/snap_test_snapshots.h"
 #include "./util/arch.h"
+#include "./util/cpu_id.h"
 #include "./util/data_dependency.h"
 #include "./util/itoa.h"
 #include "./util/path_util.h"
@@ -61,6 +71,15 @@ TEST(RunnerDriver, BasicRun) {
               StatusIs(absl::StatusCode::kInternal, HasSubstr("syscall")));
 }
 
+TEST(RunnerDriver, PassCpuFeatures) {
+  RunnerDriver driver = HelperDriver();
+  auto run_result_or = driver.Run(
+      RunnerOptions::PlayOptions(EnumStr(TestSnapshot::kEndsAsExpected))
+          .set_pass_cpu_features(true));
+  ASSERT_OK(run_result_or);
+  EXPECT_TRUE(run_result_or->success());
+}
+
 TEST(RunnerDriver, BasicMake) {
   RunnerDriver driver = HelperDriver();
   auto make_result_or = driver.MakeOne(EnumStr(TestSnapshot::kSigSegvRead));
@@ -71,6 +90,25 @@ TEST(RunnerDriver, BasicMake) {
   ASSERT_EQ(make_result_or->snapshot_id(), EnumStr(TestSnapshot::kSigSegvRead));
 }
 
+TEST(RunnerDriver, VerifyOnCPUs) {
+  const int cpu = GetCPUId();
+  if (cpu == kUnknownCPUId) {
+    GTEST_SKIP() << "Current CPU unknown";
+  }
+  RunnerDriver driver = HelperDriver();
+  const std::vector<int> cpus = {cpu, cpu};
+  ASSERT_OK_AND_ASSIGN(
+      RunnerDriver::RunResult result,
+      driver.VerifyOneOnCPUs(EnumStr(TestSnapshot::kEndsAsExpected), cpus, 3));
+  EXPECT_TRUE(result.success());
+
+  ASSERT_OK_AND_ASSIGN(
+      result,
+      driver.VerifyOneOnCPUs(EnumStr(TestSnapshot::kRegsMismatch), cpus, 3));
+  ASSERT_FALSE(result.success());
+  EXPECT_EQ(result.snapshot_id(), EnumStr(TestSnapshot::kRegsMismatch));
+}
+
 TEST(RunnerDriver, MaxPageToAddOption) {
   RunnerDriver driver = HelperDriver();
   auto make_result_or =
@@ -115,6 +153,59 @@ TEST(RunnerDriver, MaxPageToAddOption) {
   EXPECT_TRUE(found_new_memory_bytes);
 }
 
+// Returns `size` bytes at `address` if `end_state` has them in a single
+// MemoryBytes or an empty string otherwise.
+std::string BytesAt(const Snapshot::EndState& end_state,
+                    Snapshot::Address address, size_t size) {
+  for (const auto& memory_bytes : end_state.memory_bytes()) {
+    if (memory_bytes.start_address() <= address &&
+        address + size <= memory_bytes.limit_address()) {
+      return memory_bytes.byte_values().substr(
+          address - memory_bytes.start_address(), size);
+    }
+  }
+  return "";
+}
+
+TEST(RunnerDriver, BinaryResultChannel) {
+  RunnerDriver driver = HelperDriver();
+  RunnerOptions options = RunnerOptions::MakeOptions(
+      EnumStr(TestSnapshot::kSigSegvReadFixable), /*max_pages_to_add=*/1);
+  ASSERT_TRUE(options.binary_result_channel());
+  auto binary_result_or = driver.Run(options);
+  ASSERT_OK(binary_result_or);
+  auto text_result_or = driver.Run(options.set_binary_result_channel(false));
+  ASSERT_OK(text_result_or);
+
+  ASSERT_FALSE(binary_result_or->success());
+  EXPECT_EQ(binary_result_or->snapshot_id(), text_result_or->snapshot_id());
+  const RunnerDriver::PlayerResult& binary = binary_result_or->player_result();
+  const RunnerDriver::PlayerResult& text = text_result_or->player_result();
+  EXPECT_EQ(binary.outcome, text.outcome);
+  EXPECT_EQ(binary.cpu_id, text.cpu_id);
+  ASSERT_TRUE(binary.actual_end_state.has_value());
+  ASSERT_TRUE(text.actual_end_state.has_value());
+  const Snapshot::EndState& binary_end_state = *binary.actual_end_state;
+  const Snapshot::EndState& text_end_state = *text.actual_end_state;
+  EXPECT_EQ(binary_end_state.endpoint(), text_end_state.endpoint());
+  EXPECT_EQ(binary_end_state.registers(), text_end_state.registers());
+  EXPECT_EQ(binary_end_state.register_checksum(),
+            text_end_state.register_checksum());
+  // The text output splits memory into pages while the binary record keeps
+  // whole mappings, so compare the bytes covered.
+  size_t binary_size = 0, text_size = 0;
+  for (const auto& memory_bytes : binary_end_state.memory_bytes()) {
+    binary_size += memory_bytes.num_bytes();
+  }
+  for (const auto& memory_bytes : text_end_state.memory_bytes()) {
+    text_size += memory_bytes.num_bytes();
+    EXPECT_EQ(BytesAt(binary_end_state, memory_bytes.start_address(),
+                      memory_bytes.num_bytes()),
+              memory_bytes.byte_values());
+  }
+  EXPECT_EQ(binary_size, text_size);
+}
+
 TEST(RunnerDriver, BasicTrace) {
   RunnerDriver driver = HelperDriver();
   Snapshot endAsExpectedSnap =
@@ -139,6 +230,195 @@ TEST(RunnerDriver, BasicTrace) {
   ASSERT_TRUE(hit_initial_snap_rip);
 }
 
+TEST(RunnerDriver, TraceMany) {
+  RunnerDriver driver = HelperDriver();
+  Snapshot endAsExpectedSnap =
+      MakeSnapRunnerTestSnapshot<Host>(TestSnapshot::kEndsAsExpected);
+  GRegSet<Host> gregs;
+  ASSERT_TRUE(DeserializeGRegs(endAsExpectedSnap.registers().gregs(), &gregs));
+  const uint64_t start_address = gregs.GetInstructionPointer();
+  const std::vector<std::string> snap_ids(
+      3, EnumStr(TestSnapshot::kEndsAsExpected));
+  const std::vector<uint64_t> start_addresses(snap_ids.size(), start_address);
+
+  // Each snap is single-stepped from its start address.
+  std::vector<int> num_steps(snap_ids.size(), 0);
+  std::vector<uint64_t> first_step_address(snap_ids.size(), 0);
+  auto cb = [&](size_t snap_index, pid_t pid, const user_regs_struct& regs,
+                HarnessTracer::CallbackReason reason) {
+    if (reason == HarnessTracer::kSingleStepStop) {
+      if (num_steps[snap_index]++ == 0) {
+        first_step_address[snap_index] = GetInstructionPointer(regs);
+      }
+    }
+    return HarnessTracer::kKeepTracing;
+  };
+  auto trace_result_or = driver.TraceMany(snap_ids, cb, start_addresses);
+  ASSERT_OK(trace_result_or);
+  ASSERT_TRUE(trace_result_or->success());
+  for (size_t i = 0; i < snap_ids.size(); ++i) {
+    EXPECT_GT(num_steps[i], 0) << "snap #" << i;
+#if defined(__x86_64__)
+    // Hardware breakpoints are not implemented on aarch64, where the runner
+    // code leading into the snap is single-stepped too.
+    EXPECT_EQ(first_step_address[i], start_address) << "snap #" << i;
+#endif
+  }
+
+  // The runner stops at the first failing snap.
+  const std::vector<std::string> failing_snap_ids = {
+      EnumStr(TestSnapshot::kEndsAsExpected),
+      EnumStr(TestSnapshot::kMemoryMismatch),
+      EnumStr(TestSnapshot::kEndsAsExpected)};
+  std::vector<bool> traced(failing_snap_ids.size(), false);
+  auto failing_cb = [&](size_t snap_index, pid_t pid,
+                        const user_regs_struct& regs,
+                        HarnessTracer::CallbackReason reason) {
+    traced[snap_index] = true;
+    return HarnessTracer::kKeepTracing;
+  };
+  trace_result_or = driver.TraceMany(failing_snap_ids, failing_cb);
+  ASSERT_OK(trace_result_or);
+  ASSERT_FALSE(trace_result_or->success());
+  EXPECT_EQ(trace_result_or->snapshot_id(),
+            EnumStr(TestSnapshot::kMemoryMismatch));
+  EXPECT_TRUE(traced[0]);
+  EXPECT_TRUE(traced[1]);
+  EXPECT_FALSE(traced[2]);
+}
+
+TEST(RunnerDriver, AsyncRun) {
+  RunnerDriver driver = HelperDriver();
+  for (TestSnapshot snap :
+       {TestSnapshot::kEndsAsExpected, TestSnapshot::kMemoryMismatch}) {
+    SCOPED_TRACE(EnumStr(snap));
+    auto run_or = driver.StartRun(RunnerOptions::PlayOptions(EnumStr(snap)));
+    ASSERT_OK(run_or);
+    RunnerDriver::AsyncRun& run = **run_or;
+    struct pollfd stdout_poll = {.fd = run.stdout_fd(), .events = POLLIN};
+    do {
+      ASSERT_EQ(poll(&stdout_poll, 1, -1), 1);
+    } while (run.ReadOutput());
+    if (run.pidfd() != -1) {
+      struct pollfd pid_poll = {.fd = run.pidfd(), .events = POLLIN};
+      ASSERT_EQ(poll(&pid_poll, 1, -1), 1);
+    }
+    auto run_result_or = run.Finish();
+    ASSERT_OK(run_result_or);
+    EXPECT_EQ(run_result_or->success(), snap == TestSnapshot::kEndsAsExpected);
+    EXPECT_GT(run_result_or->runner_max_rss_kb(), 0);
+  }
+}
+
+TEST(RunnerDriver, AsyncRunGroup) {
+  RunnerDriver driver = HelperDriver();
+  const TestSnapshot snaps[] = {TestSnapshot::kEndsAsExpected,
+                                TestSnapshot::kMemoryMismatch,
+                                TestSnapshot::kEndsAsExpected};
+  AsyncRunGroup group;
+  for (size_t i = 0; i < std::size(snaps); ++i) {
+    ASSERT_OK_AND_ASSIGN(std::unique_ptr<RunnerDriver::AsyncRun> run,
+                         driver.StartPlayOne(EnumStr(snaps[i])));
+    group.Add(std::move(run), i);
+  }
+  EXPECT_EQ(group.size(), std::size(snaps));
+
+  std::vector<bool> done(std::size(snaps), false);
+  while (!group.empty()) {
+    for (AsyncRunGroup::Completion& completion : group.Wait()) {
+      ASSERT_LT(completion.tag, std::size(snaps));
+      SCOPED_TRACE(EnumStr(snaps[completion.tag]));
+      EXPECT_FALSE(done[completion.tag]);
+      done[completion.tag] = true;
+      ASSERT_OK(completion.result);
+      const bool expected_success =
+          snaps[completion.tag] == TestSnapshot::kEndsAsExpected;
+      ASSERT_EQ(completion.result->success(), expected_success);
+      if (!expected_success) {
+        EXPECT_EQ(completion.result->snapshot_id(),
+                  EnumStr(snaps[completion.tag]));
+      }
+    }
+  }
+  EXPECT_THAT(done, ::testing::Each(true));
+  EXPECT_TRUE(group.Wait(absl::ZeroDuration()).empty());
+}
+
+TEST(RunnerDriver, PersistentSession) {
+  RunnerDriver driver = HelperDriver();
+  auto session_or = driver.StartPersistentSession(
+      RunnerOptions::PlayOptions(EnumStr(TestSnapshot::kEndsAsExpected)));
+  ASSERT_OK(session_or);
+  RunnerDriver::PersistentSession& session = **session_or;
+  for (uint64_t seed = 1; seed <= 3; ++seed) {
+    auto run_result_or = session.Run(/*num_iterations=*/10, seed);
+    ASSERT_OK(run_result_or);
+    ASSERT_TRUE(run_result_or->success());
+  }
+  ASSERT_TRUE(session.alive());
+}
+
+TEST(RunnerDriver, PersistentSessionFailure) {
+  RunnerDriver driver = HelperDriver();
+  const std::string verify_id = EnumStr(TestSnapshot::kEndsAsExpected);
+  const std::string make_id = EnumStr(TestSnapshot::kSigSegvRead);
+  for (bool binary_result_channel : {true, false}) {
+    SCOPED_TRACE(binary_result_channel);
+    auto verify_session_or = driver.StartZygoteSession(
+        RunnerOptions::VerifyOptions(verify_id).set_binary_result_channel(
+            binary_result_channel));
+    ASSERT_OK(verify_session_or);
+    RunnerDriver::ZygoteSession& verify_session = **verify_session_or;
+    auto make_session_or = driver.StartZygoteSession(
+        RunnerOptions::MakeOptions(make_id).set_binary_result_channel(
+            binary_result_channel));
+    ASSERT_OK(make_session_or);
+    RunnerDriver::ZygoteSession& make_session = **make_session_or;
+    for (int i = 0; i < 2; ++i) {
+      auto run_result_or =
+          verify_session.VerifyOneRepeatedly(verify_id, /*num_attempts=*/2);
+      ASSERT_OK(run_result_or);
+      ASSERT_TRUE(run_result_or->success());
+
+      auto make_result_or = make_session.MakeOne(make_id);
+      ASSERT_OK(make_result_or);
+      ASSERT_FALSE(make_result_or->success());
+      EXPECT_EQ(make_result_or->player_result().outcome,
+                PlaybackOutcome::kExecutionMisbehave);
+      EXPECT_EQ(make_result_or->snapshot_id(), make_id);
+    }
+    // Runners inherit ASLR from the zygote, which cannot be changed per run.
+    EXPECT_THAT(verify_session.MakeOne(make_id),
+                StatusIs(absl::StatusCode::kInvalidArgument));
+    ASSERT_TRUE(verify_session.alive());
+    ASSERT_TRUE(make_session.alive());
+  }
+}
+
+TEST(ZygotePool, ReusesZygotes) {
+  RunnerDriver driver = HelperDriver();
+  ZygotePool pool(RunnerLocation());
+  EXPECT_EQ(pool.num_idle(), 0);
+  for (int i = 0; i < 2; ++i) {
+    auto verify_result_or = pool.VerifyOneRepeatedly(
+        driver, EnumStr(TestSnapshot::kEndsAsExpected), /*num_attempts=*/2);
+    ASSERT_OK(verify_result_or);
+    ASSERT_TRUE(verify_result_or->success());
+    EXPECT_EQ(pool.num_idle(), 1);
+
+    auto make_result_or =
+        pool.MakeOne(driver, EnumStr(TestSnapshot::kSigSegvRead));
+    ASSERT_OK(make_result_or);
+    ASSERT_FALSE(make_result_or->success());
+    EXPECT_EQ(make_result_or->player_result().outcome,
+              PlaybackOutcome::kExecutionMisbehave);
+    EXPECT_EQ(make_result_or->snapshot_id(),
+              EnumStr(TestSnapshot::kSigSegvRead));
+    // Making and verifying differ in ASLR and need separate zygotes.
+    EXPECT_EQ(pool.num_idle(), 2);
+  }
+}
+
 TEST(RunnerDriver, Cleanup) {
   auto tmp_binary = CreateTempFile("binary");
   ASSERT_OK(tmp_binary);
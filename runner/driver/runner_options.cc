@@ -44,6 +44,7 @@ const RunnerOptions& RunnerOptions::Default() {
 
 RunnerOptions RunnerOptions::PlayOptions(absl::string_view snap_id) {
   return RunnerOptions()
+      .set_binary_result_channel(true)
       .set_cpu_time_budget(kPerSnapPlayCpuTimeBudget)
       .set_extra_argv({"--snap_id", std::string(snap_id),
                        // TODO(b/227770288): [bug] Play more than once to ensure
@@ -54,6 +55,7 @@ RunnerOptions RunnerOptions::PlayOptions(absl::string_view snap_id) {
 RunnerOptions RunnerOptions::MakeOptions(absl::string_view snap_id,
                                          size_t max_pages_to_add) {
   return RunnerOptions()
+      .set_binary_result_channel(true)
       .set_cpu_time_budget(kPerSnapPlayCpuTimeBudget)
       .set_extra_argv({"--snap_id", std::string(snap_id), "--num_iterations",
                        "1", "--make", "--max_pages_to_add",
@@ -66,6 +68,7 @@ RunnerOptions RunnerOptions::MakeOptions(absl::string_view snap_id,
 
 RunnerOptions RunnerOptions::VerifyOptions(absl::string_view snap_id) {
   return RunnerOptions()
+      .set_binary_result_channel(true)
       .set_cpu_time_budget(kPerSnapPlayCpuTimeBudget)
       .set_extra_argv(
           {"--snap_id", std::string(snap_id), "--num_iterations", "3"})
@@ -78,11 +81,21 @@ RunnerOptions RunnerOptions::VerifyOptions(absl::string_view snap_id) {
 RunnerOptions RunnerOptions::TraceOptions(absl::string_view snap_id,
                                           size_t num_iterations) {
   return RunnerOptions()
+      .set_binary_result_channel(true)
       .set_cpu_time_budget(kPerSnapTraceCpuTimeBudget)
       .set_extra_argv({"--snap_id", std::string(snap_id), "--num_iterations",
                        absl::StrCat(num_iterations), "--enable_tracer"});
 }
 
+RunnerOptions RunnerOptions::TraceReplayOptions(absl::string_view replay_path,
+                                                size_t num_snaps) {
+  return RunnerOptions()
+      .set_binary_result_channel(true)
+      .set_cpu_time_budget(kPerSnapTraceCpuTimeBudget * num_snaps)
+      .set_extra_argv(
+          {"--replay", std::string(replay_path), "--enable_tracer"});
+}
+
 RunnerOptions& RunnerOptions::set_extra_argv(
     const std::vector<std::string>& extra_argv) {
   for (const auto& flag : extra_argv) {
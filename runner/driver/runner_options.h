@@ -16,7 +16,9 @@
 #define THIRD_PARTY_SILIFUZZ_RUNNER_DRIVER_RUNNER_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/strings/string_view.h"
@@ -33,6 +35,13 @@ class RunnerDriver;  // fwd declaration for friendship below.
 // This class is thread-compatible.
 class RunnerOptions {
  public:
+  // A PMU event as encoded in perf_event_attr. See --perf_counters in
+  // runner_flags.h.
+  struct PerfCounter {
+    uint32_t type;
+    uint64_t config;
+  };
+
   // Returns the default RunnerOptions value. See default field values below for
   // details.
   static const RunnerOptions& Default();
@@ -60,11 +69,74 @@ class RunnerOptions {
     return *this;
   }
 
+  // In sequential mode, run only range `index` of `num_ranges` contiguous
+  // ranges of snaps. See --snap_range_index in runner_flags.h.
+  RunnerOptions& set_snap_range(uint64_t index, uint64_t num_ranges) {
+    this->snap_range_index_ = index;
+    this->num_snap_ranges_ = num_ranges;
+    return *this;
+  }
+
+  // Number of failed snaps after which the runner stops. The driver returns
+  // the last one and RunResult::earlier_failures() holds the others. See
+  // --max_failures in runner_flags.h.
+  RunnerOptions& set_max_failures(uint64_t max_failures) {
+    this->max_failures_ = max_failures;
+    return *this;
+  }
+
+  // If not 0, the runner stops a snap as a runaway after it has retired this
+  // many instructions. See --snap_instruction_budget in runner_flags.h.
+  RunnerOptions& set_snap_instruction_budget(uint64_t snap_instruction_budget) {
+    this->snap_instruction_budget_ = snap_instruction_budget;
+    return *this;
+  }
+
   RunnerOptions& set_map_stderr_to_dev_null(bool map_stderr_to_dev_null) {
     this->map_stderr_to_dev_null_ = map_stderr_to_dev_null;
     return *this;
   }
 
+  RunnerOptions& set_corpus_load_address(uintptr_t corpus_load_address) {
+    this->corpus_load_address_ = corpus_load_address;
+    return *this;
+  }
+
+  RunnerOptions& set_binary_result_channel(bool binary_result_channel) {
+    this->binary_result_channel_ = binary_result_channel;
+    return *this;
+  }
+
+  // If true, the CPU features probed once by this process are passed to the
+  // runner, which then skips probing them at startup. Only for runners on
+  // this host. See --cpu_features in runner_flags.h.
+  RunnerOptions& set_pass_cpu_features(bool pass_cpu_features) {
+    this->pass_cpu_features_ = pass_cpu_features;
+    return *this;
+  }
+
+  // If true, the PlatformId of this host is passed to the runner to select
+  // the expected end state of snaps with per-platform end states. Only for
+  // runners on this host. See --platform_id in runner_flags.h.
+  RunnerOptions& set_pass_platform_id(bool pass_platform_id) {
+    this->pass_platform_id_ = pass_platform_id;
+    return *this;
+  }
+
+  RunnerOptions& set_perf_counters(std::vector<PerfCounter> perf_counters) {
+    this->perf_counters_ = std::move(perf_counters);
+    return *this;
+  }
+
+  // If not -1, the runner process joins the cgroup v2 whose cgroup.procs file
+  // is open as `cgroup_procs_fd` before it execs. Runners spawned by a zygote
+  // or a persistent session inherit the cgroup of that process. The caller
+  // keeps ownership of the fd.
+  RunnerOptions& set_cgroup_procs_fd(int cgroup_procs_fd) {
+    this->cgroup_procs_fd_ = cgroup_procs_fd;
+    return *this;
+  }
+
   int cpu() const { return cpu_; }
   absl::Duration cpu_time_budget() const { return cpu_time_budget_; }
   absl::Duration wall_time_budget() const { return wall_time_budget_; }
@@ -72,7 +144,19 @@ class RunnerOptions {
   // implementation details.
   bool disable_aslr() const { return disable_aslr_; }
   bool sequential_mode() const { return sequential_mode_; }
+  uint64_t snap_range_index() const { return snap_range_index_; }
+  uint64_t num_snap_ranges() const { return num_snap_ranges_; }
+  uint64_t max_failures() const { return max_failures_; }
+  uint64_t snap_instruction_budget() const { return snap_instruction_budget_; }
   bool map_stderr_to_dev_null() const { return map_stderr_to_dev_null_; }
+  uintptr_t corpus_load_address() const { return corpus_load_address_; }
+  bool binary_result_channel() const { return binary_result_channel_; }
+  bool pass_cpu_features() const { return pass_cpu_features_; }
+  bool pass_platform_id() const { return pass_platform_id_; }
+  const std::vector<PerfCounter>& perf_counters() const {
+    return perf_counters_;
+  }
+  int cgroup_procs_fd() const { return cgroup_procs_fd_; }
 
   RunnerOptions(const RunnerOptions&) = default;
   RunnerOptions(RunnerOptions&&) = default;
@@ -89,6 +173,10 @@ class RunnerOptions {
   static RunnerOptions VerifyOptions(absl::string_view snap_id);
   static RunnerOptions TraceOptions(absl::string_view snap_id,
                                     size_t num_iterations = 1);
+  // Traces each of the `num_snaps` snaps listed in the file at `replay_path`
+  // once, see --replay.
+  static RunnerOptions TraceReplayOptions(absl::string_view replay_path,
+                                          size_t num_snaps);
 
  private:
   friend class RunnerDriver;
@@ -118,8 +206,39 @@ class RunnerOptions {
   // If true, enumerate all corpora sequentially and then exit.
   bool sequential_mode_ = false;
 
+  // See set_snap_range().
+  uint64_t snap_range_index_ = 0;
+  uint64_t num_snap_ranges_ = 1;
+
+  // See set_max_failures().
+  uint64_t max_failures_ = 1;
+
+  // See set_snap_instruction_budget().
+  uint64_t snap_instruction_budget_ = 0;
+
   // If true, map runner's stderr to /dev/null.
   bool map_stderr_to_dev_null_ = false;
+
+  // If not 0, the corpus file has already been relocated to this address.
+  // See --corpus_load_address in runner_flags.h.
+  uintptr_t corpus_load_address_ = 0;
+
+  // If true, the runner writes the end state of a failed snap to a memfd
+  // read by RunnerDriver instead of printing it to stdout as text. See
+  // --result_fd in runner_flags.h.
+  bool binary_result_channel_ = false;
+
+  // See set_pass_cpu_features().
+  bool pass_cpu_features_ = false;
+
+  // See set_pass_platform_id().
+  bool pass_platform_id_ = false;
+
+  // PMU events the runner counts while playing snaps.
+  std::vector<PerfCounter> perf_counters_ = {};
+
+  // See set_cgroup_procs_fd().
+  int cgroup_procs_fd_ = -1;
 };
 
 }  // namespace silifuzz
@@ -0,0 +1,582 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner/kvm_snap_executor.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <linux/kvm.h>
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "./common/memory_mapping.h"
+#include "./common/memory_perms.h"
+#include "./common/memory_state.h"
+#include "./common/snapshot.h"
+#include "./common/snapshot_util.h"
+#include "./proxies/page_table/memory_state_image.h"
+#include "./snap/exit_sequence.h"
+#include "./util/checks.h"
+#include "./util/page_util.h"
+#include "./util/ucontext/ucontext_types.h"
+
+namespace silifuzz {
+
+#if defined(__x86_64__)
+
+namespace {
+
+// Guest physical address of the page mapped at kSnapExitAddress. Images are
+// loaded after it.
+constexpr uint64_t kExitPagePhysicalAddress = 0;
+
+// HLT, which exits KVM_RUN as there is no in-kernel irqchip.
+constexpr uint8_t kHltInsn = 0xf4;
+
+// Control register and EFER bits, see Intel SDM Vol. 3A, 2.2.1 and 2.5.
+constexpr uint64_t kCr0Pe = uint64_t{1} << 0;
+constexpr uint64_t kCr0Mp = uint64_t{1} << 1;
+constexpr uint64_t kCr0Et = uint64_t{1} << 4;
+constexpr uint64_t kCr0Ne = uint64_t{1} << 5;
+constexpr uint64_t kCr0Wp = uint64_t{1} << 16;
+constexpr uint64_t kCr0Pg = uint64_t{1} << 31;
+constexpr uint64_t kCr4Pae = uint64_t{1} << 5;
+constexpr uint64_t kCr4Osfxsr = uint64_t{1} << 9;
+constexpr uint64_t kCr4Osxmmexcpt = uint64_t{1} << 10;
+constexpr uint64_t kCr4Osxsave = uint64_t{1} << 18;
+constexpr uint64_t kEferLme = uint64_t{1} << 8;
+constexpr uint64_t kEferLma = uint64_t{1} << 10;
+constexpr uint64_t kEferNxe = uint64_t{1} << 11;
+
+// CPUID.01H:ECX.XSAVE.
+constexpr uint32_t kCpuidXsave = uint32_t{1} << 26;
+
+// Page table entry bits.
+constexpr uint64_t kPtePresent = uint64_t{1} << 0;
+constexpr uint64_t kPtePageSize = uint64_t{1} << 7;
+constexpr uint64_t kPteAddressMask = 0x000ffffffffff000ULL;
+
+// Offset of XSTATE_BV in the XSAVE area and its x87 and SSE bits.
+constexpr size_t kXstateBvOffset = 512;
+constexpr uint64_t kXstateBvX87Sse = 0x3;
+
+// The kvm_run of the vCPU that the current thread is running, if any.
+thread_local kvm_run* current_kvm_run = nullptr;
+
+// Signal of the run timer.
+int RunTimerSignal() { return SIGRTMIN; }
+
+// Makes the interrupted KVM_RUN, or the next one if the signal arrives just
+// before it, return EINTR.
+void RunTimerSignalHandler(int) {
+  if (current_kvm_run != nullptr) {
+    current_kvm_run->immediate_exit = 1;
+  }
+}
+
+void InstallRunTimerSignalHandler() {
+  static const bool installed = [] {
+    struct sigaction action = {};
+    action.sa_handler = &RunTimerSignalHandler;
+    sigemptyset(&action.sa_mask);
+    // No SA_RESTART, KVM_RUN must not be restarted.
+    CHECK_EQ(sigaction(RunTimerSignal(), &action, nullptr), 0);
+    return true;
+  }();
+  (void)installed;
+}
+
+// Flat 64-bit code segment at DPL 0.
+kvm_segment CodeSegment() {
+  kvm_segment segment = {};
+  segment.limit = 0xffffffff;
+  segment.selector = 0x8;
+  segment.type = 0xb;  // Execute/read, accessed.
+  segment.present = 1;
+  segment.s = 1;
+  segment.l = 1;
+  segment.g = 1;
+  return segment;
+}
+
+// Flat data segment at DPL 0 with `base`.
+kvm_segment DataSegment(uint64_t base) {
+  kvm_segment segment = {};
+  segment.base = base;
+  segment.limit = 0xffffffff;
+  segment.selector = 0x10;
+  segment.type = 0x3;  // Read/write, accessed.
+  segment.present = 1;
+  segment.db = 1;
+  segment.s = 1;
+  segment.g = 1;
+  return segment;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<KvmSnapExecutor>> KvmSnapExecutor::Create(
+    const Options& options) {
+  if (options.guest_memory_bytes % kPageSize != 0 ||
+      options.guest_memory_bytes < 2 * kPageSize) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Bad guest memory size ", options.guest_memory_bytes));
+  }
+  auto executor = absl::WrapUnique(new KvmSnapExecutor(options));
+  RETURN_IF_NOT_OK(executor->Init());
+  return executor;
+}
+
+KvmSnapExecutor::~KvmSnapExecutor() {
+  if (run_timer_created_) timer_delete(run_timer_);
+  if (vcpu_run_ != nullptr) munmap(vcpu_run_, vcpu_run_size_);
+  if (guest_memory_ != nullptr) {
+    munmap(guest_memory_, options_.guest_memory_bytes);
+  }
+  if (vcpu_fd_ >= 0) close(vcpu_fd_);
+  if (vm_fd_ >= 0) close(vm_fd_);
+  if (kvm_fd_ >= 0) close(kvm_fd_);
+}
+
+absl::Status KvmSnapExecutor::Init() {
+  kvm_fd_ = open("/dev/kvm", O_RDWR | O_CLOEXEC);
+  if (kvm_fd_ < 0) {
+    return absl::ErrnoToStatus(errno, "Cannot open /dev/kvm");
+  }
+  if (ioctl(kvm_fd_, KVM_GET_API_VERSION, 0) != KVM_API_VERSION) {
+    return absl::FailedPreconditionError("Unsupported KVM API version");
+  }
+  if (ioctl(kvm_fd_, KVM_CHECK_EXTENSION, KVM_CAP_IMMEDIATE_EXIT) <= 0) {
+    return absl::FailedPreconditionError("KVM_CAP_IMMEDIATE_EXIT missing");
+  }
+  vm_fd_ = ioctl(kvm_fd_, KVM_CREATE_VM, 0);
+  if (vm_fd_ < 0) {
+    return absl::ErrnoToStatus(errno, "KVM_CREATE_VM");
+  }
+
+  // Only pages touched by loaded images are backed by host memory.
+  void* guest_memory =
+      mmap(nullptr, options_.guest_memory_bytes, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (guest_memory == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "Cannot map guest memory");
+  }
+  guest_memory_ = static_cast<uint8_t*>(guest_memory);
+  kvm_userspace_memory_region region = {};
+  region.slot = 0;
+  region.guest_phys_addr = 0;
+  region.memory_size = options_.guest_memory_bytes;
+  region.userspace_addr = reinterpret_cast<uint64_t>(guest_memory_);
+  if (ioctl(vm_fd_, KVM_SET_USER_MEMORY_REGION, &region) != 0) {
+    return absl::ErrnoToStatus(errno, "KVM_SET_USER_MEMORY_REGION");
+  }
+
+  vcpu_fd_ = ioctl(vm_fd_, KVM_CREATE_VCPU, 0);
+  if (vcpu_fd_ < 0) {
+    return absl::ErrnoToStatus(errno, "KVM_CREATE_VCPU");
+  }
+  const int vcpu_run_size = ioctl(kvm_fd_, KVM_GET_VCPU_MMAP_SIZE, 0);
+  if (vcpu_run_size < static_cast<int>(sizeof(kvm_run))) {
+    return absl::ErrnoToStatus(errno, "KVM_GET_VCPU_MMAP_SIZE");
+  }
+  void* vcpu_run = mmap(nullptr, vcpu_run_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, vcpu_fd_, 0);
+  if (vcpu_run == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "Cannot map kvm_run");
+  }
+  vcpu_run_ = vcpu_run;
+  vcpu_run_size_ = vcpu_run_size;
+
+  // Snaps may use any CPU feature of the host, so expose all of them.
+  constexpr size_t kMaxCpuidEntries = 256;
+  std::vector<uint8_t> cpuid_buffer(
+      sizeof(kvm_cpuid2) + kMaxCpuidEntries * sizeof(kvm_cpuid_entry2));
+  kvm_cpuid2* cpuid = reinterpret_cast<kvm_cpuid2*>(cpuid_buffer.data());
+  cpuid->nent = kMaxCpuidEntries;
+  if (ioctl(kvm_fd_, KVM_GET_SUPPORTED_CPUID, cpuid) != 0) {
+    return absl::ErrnoToStatus(errno, "KVM_GET_SUPPORTED_CPUID");
+  }
+  if (ioctl(vcpu_fd_, KVM_SET_CPUID2, cpuid) != 0) {
+    return absl::ErrnoToStatus(errno, "KVM_SET_CPUID2");
+  }
+  uint64_t xcr0 = 0;
+  for (uint32_t i = 0; i < cpuid->nent; ++i) {
+    const kvm_cpuid_entry2& entry = cpuid->entries[i];
+    if (entry.function == 0x1) {
+      xsave_enabled_ = (entry.ecx & kCpuidXsave) != 0;
+    } else if (entry.function == 0xd && entry.index == 0) {
+      xcr0 = (static_cast<uint64_t>(entry.edx) << 32) | entry.eax;
+    }
+  }
+  if (xsave_enabled_) {
+    // CR4.OSXSAVE is set in Run() before XCR0 matters.
+    kvm_xcrs xcrs = {};
+    xcrs.nr_xcrs = 1;
+    xcrs.xcrs[0].xcr = 0;
+    xcrs.xcrs[0].value = xcr0;
+    if (ioctl(vcpu_fd_, KVM_SET_XCRS, &xcrs) != 0) {
+      return absl::ErrnoToStatus(errno, "KVM_SET_XCRS");
+    }
+  }
+
+  memset(guest_memory_ + kExitPagePhysicalAddress, kHltInsn, kPageSize);
+  next_image_address_ = kExitPagePhysicalAddress + kPageSize;
+  InstallRunTimerSignalHandler();
+  return absl::OkStatus();
+}
+
+absl::StatusOr<size_t> KvmSnapExecutor::Load(const Snapshot& snapshot) {
+  if (snapshot.architecture_id() != ArchitectureId::kX86_64) {
+    return absl::InvalidArgumentError("Only x86_64 snapshots are supported");
+  }
+  const MemoryState memory_state =
+      MemoryState::MakeInitial(snapshot, MemoryState::kZeroMappedBytes);
+  const std::vector<proxies::MemoryStateImage<X86_64>::ExternalMapping>
+      external_mappings = {{
+          .virtual_memory_mapping = MemoryMapping::MakeSized(
+              kSnapExitAddress, kPageSize, MemoryPerms::XR()),
+          .physical_start = kExitPagePhysicalAddress,
+      }};
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      proxies::MemoryStateImage<X86_64> image,
+      image_builder_.Build(memory_state, next_image_address_,
+                           external_mappings));
+  const std::vector<uint8_t>& image_data = image.image_data();
+  const uint64_t image_bytes = RoundUpToPageAlignment(image_data.size());
+  if (image_bytes > options_.guest_memory_bytes - next_image_address_) {
+    return absl::ResourceExhaustedError(
+        absl::StrCat("Guest memory exhausted loading ", snapshot.id()));
+  }
+  memcpy(guest_memory_ + next_image_address_, image_data.data(),
+         image_data.size());
+  next_image_address_ += image_bytes;
+
+  LoadedSnapshot loaded{.image = std::move(image)};
+  RETURN_IF_NOT_OK(ConvertRegsFromSnapshot(snapshot.registers(),
+                                           &loaded.gregs, &loaded.fpregs));
+  loaded_.push_back(std::move(loaded));
+  return loaded_.size() - 1;
+}
+
+absl::StatusOr<KvmSnapExecutor::RunResult> KvmSnapExecutor::Run(
+    size_t handle) {
+  if (handle >= loaded_.size()) {
+    return absl::InvalidArgumentError(absl::StrCat("Bad handle ", handle));
+  }
+  const LoadedSnapshot& loaded = loaded_[handle];
+
+  // Restore the initial memory. This also resets the accessed and dirty bits
+  // in the page table.
+  const std::vector<uint8_t>& image_data = loaded.image.image_data();
+  memcpy(guest_memory_ + loaded.image.physical_address(), image_data.data(),
+         image_data.size());
+  RETURN_IF_NOT_OK(SetRegisters(loaded));
+
+  kvm_run* run = static_cast<kvm_run*>(vcpu_run_);
+  run->immediate_exit = 0;
+  current_kvm_run = run;
+  RETURN_IF_NOT_OK(ArmRunTimer());
+  RunResult result;
+  absl::Status status = absl::OkStatus();
+  while (true) {
+    if (ioctl(vcpu_fd_, KVM_RUN, 0) != 0) {
+      if (errno == EINTR) {
+        result.outcome = RunResult::Outcome::kRunaway;
+      } else {
+        status = absl::ErrnoToStatus(errno, "KVM_RUN");
+      }
+      break;
+    }
+    if (run->exit_reason == KVM_EXIT_HLT) {
+      result.outcome = RunResult::Outcome::kExited;
+      break;
+    }
+    if (run->exit_reason == KVM_EXIT_SHUTDOWN) {
+      result.outcome = RunResult::Outcome::kException;
+      break;
+    }
+    status = absl::InternalError(
+        absl::StrCat("Unexpected KVM exit reason ", run->exit_reason));
+    break;
+  }
+  DisarmRunTimer();
+  current_kvm_run = nullptr;
+  RETURN_IF_NOT_OK(status);
+  RETURN_IF_NOT_OK(GetRegisters(result));
+
+  // Segment selectors are not used in the guest, report the initial ones.
+  result.gregs.cs = loaded.gregs.cs;
+  result.gregs.ss = loaded.gregs.ss;
+  result.gregs.ds = loaded.gregs.ds;
+  result.gregs.es = loaded.gregs.es;
+  result.gregs.fs = loaded.gregs.fs;
+  result.gregs.gs = loaded.gregs.gs;
+
+  if (result.outcome == RunResult::Outcome::kExited) {
+    if (result.gregs.rip != kSnapExitAddress + 1) {
+      // A HLT in the snap itself. It faults in user mode.
+      result.outcome = RunResult::Outcome::kException;
+      return result;
+    }
+    // Undo the call of the exit sequence like the runner does.
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        std::string return_address_bytes,
+        ReadMemory(handle, result.gregs.rsp, sizeof(uint64_t)));
+    uint64_t return_address;
+    memcpy(&return_address, return_address_bytes.data(),
+           sizeof(return_address));
+    result.gregs.rip = FixUpReturnAddress<X86_64>(return_address);
+    result.gregs.rsp += sizeof(uint64_t);
+  }
+  return result;
+}
+
+absl::StatusOr<std::string> KvmSnapExecutor::ReadMemory(size_t handle,
+                                                       uint64_t address,
+                                                       size_t size) const {
+  if (handle >= loaded_.size()) {
+    return absl::InvalidArgumentError(absl::StrCat("Bad handle ", handle));
+  }
+  const uint64_t page_table_root = loaded_[handle].image.page_table_root();
+  std::string bytes;
+  bytes.reserve(size);
+  while (bytes.size() < size) {
+    const uint64_t current = address + bytes.size();
+    ASSIGN_OR_RETURN_IF_NOT_OK(uint64_t physical_address,
+                               Translate(page_table_root, current));
+    const size_t chunk_size =
+        std::min<size_t>(size - bytes.size(),
+                         kPageSize - (current % kPageSize));
+    if (physical_address + chunk_size > options_.guest_memory_bytes) {
+      return absl::InternalError(
+          absl::StrCat("Bad physical address ", physical_address));
+    }
+    bytes.append(reinterpret_cast<const char*>(guest_memory_) +
+                     physical_address,
+                 chunk_size);
+  }
+  return bytes;
+}
+
+absl::StatusOr<uint64_t> KvmSnapExecutor::Translate(uint64_t page_table_root,
+                                                    uint64_t address) const {
+  uint64_t table = page_table_root;
+  for (int level = 3; level >= 0; --level) {
+    const int shift = 12 + 9 * level;
+    const uint64_t entry_address = table + ((address >> shift) & 0x1ff) * 8;
+    if (entry_address + sizeof(uint64_t) > options_.guest_memory_bytes) {
+      return absl::InternalError(
+          absl::StrCat("Bad page table entry address ", entry_address));
+    }
+    uint64_t entry;
+    memcpy(&entry, guest_memory_ + entry_address, sizeof(entry));
+    if ((entry & kPtePresent) == 0) {
+      return absl::NotFoundError(
+          absl::StrCat("Address ", absl::Hex(address), " is not mapped"));
+    }
+    const uint64_t offset_mask = (uint64_t{1} << shift) - 1;
+    if (level == 0 || (level < 3 && (entry & kPtePageSize) != 0)) {
+      return (entry & kPteAddressMask & ~offset_mask) |
+             (address & offset_mask);
+    }
+    table = entry & kPteAddressMask;
+  }
+  return absl::InternalError("Unreachable");
+}
+
+absl::Status KvmSnapExecutor::SetRegisters(const LoadedSnapshot& loaded) {
+  const GRegSet<X86_64>& gregs = loaded.gregs;
+  kvm_sregs sregs;
+  if (ioctl(vcpu_fd_, KVM_GET_SREGS, &sregs) != 0) {
+    return absl::ErrnoToStatus(errno, "KVM_GET_SREGS");
+  }
+  sregs.cr0 = kCr0Pe | kCr0Mp | kCr0Et | kCr0Ne | kCr0Wp | kCr0Pg;
+  sregs.cr3 = loaded.image.page_table_root();
+  sregs.cr4 = kCr4Pae | kCr4Osfxsr | kCr4Osxmmexcpt |
+              (xsave_enabled_ ? kCr4Osxsave : 0);
+  sregs.efer = kEferLme | kEferLma | kEferNxe;
+  sregs.cs = CodeSegment();
+  sregs.ss = DataSegment(0);
+  sregs.ds = DataSegment(0);
+  sregs.es = DataSegment(0);
+  sregs.fs = DataSegment(gregs.fs_base);
+  sregs.gs = DataSegment(gregs.gs_base);
+  sregs.tr.type = 0xb;  // Busy 64-bit TSS, required in IA-32e mode.
+  sregs.tr.present = 1;
+  sregs.tr.s = 0;
+  // An empty IDT turns every exception into a shutdown.
+  sregs.idt.base = 0;
+  sregs.idt.limit = 0;
+  if (ioctl(vcpu_fd_, KVM_SET_SREGS, &sregs) != 0) {
+    return absl::ErrnoToStatus(errno, "KVM_SET_SREGS");
+  }
+
+  kvm_regs regs = {};
+  regs.rax = gregs.rax;
+  regs.rbx = gregs.rbx;
+  regs.rcx = gregs.rcx;
+  regs.rdx = gregs.rdx;
+  regs.rsi = gregs.rsi;
+  regs.rdi = gregs.rdi;
+  regs.rsp = gregs.rsp;
+  regs.rbp = gregs.rbp;
+  regs.r8 = gregs.r8;
+  regs.r9 = gregs.r9;
+  regs.r10 = gregs.r10;
+  regs.r11 = gregs.r11;
+  regs.r12 = gregs.r12;
+  regs.r13 = gregs.r13;
+  regs.r14 = gregs.r14;
+  regs.r15 = gregs.r15;
+  regs.rip = gregs.rip;
+  regs.rflags = gregs.eflags;
+  if (ioctl(vcpu_fd_, KVM_SET_REGS, &regs) != 0) {
+    return absl::ErrnoToStatus(errno, "KVM_SET_REGS");
+  }
+
+  // FPRegSet is the legacy region of the XSAVE area. Other state components
+  // are reset to their initial state.
+  kvm_xsave xsave = {};
+  static_assert(sizeof(xsave.region) >= kXstateBvOffset + sizeof(uint64_t));
+  memcpy(xsave.region, &loaded.fpregs, sizeof(loaded.fpregs));
+  memcpy(reinterpret_cast<uint8_t*>(xsave.region) + kXstateBvOffset,
+         &kXstateBvX87Sse, sizeof(kXstateBvX87Sse));
+  if (ioctl(vcpu_fd_, KVM_SET_XSAVE, &xsave) != 0) {
+    return absl::ErrnoToStatus(errno, "KVM_SET_XSAVE");
+  }
+  return absl::OkStatus();
+}
+
+absl::Status KvmSnapExecutor::GetRegisters(RunResult& result) const {
+  kvm_regs regs;
+  if (ioctl(vcpu_fd_, KVM_GET_REGS, &regs) != 0) {
+    return absl::ErrnoToStatus(errno, "KVM_GET_REGS");
+  }
+  kvm_sregs sregs;
+  if (ioctl(vcpu_fd_, KVM_GET_SREGS, &sregs) != 0) {
+    return absl::ErrnoToStatus(errno, "KVM_GET_SREGS");
+  }
+  kvm_xsave xsave;
+  if (ioctl(vcpu_fd_, KVM_GET_XSAVE, &xsave) != 0) {
+    return absl::ErrnoToStatus(errno, "KVM_GET_XSAVE");
+  }
+
+  GRegSet<X86_64>& gregs = result.gregs;
+  memset(&gregs, 0, sizeof(gregs));
+  gregs.rax = regs.rax;
+  gregs.rbx = regs.rbx;
+  gregs.rcx = regs.rcx;
+  gregs.rdx = regs.rdx;
+  gregs.rsi = regs.rsi;
+  gregs.rdi = regs.rdi;
+  gregs.rsp = regs.rsp;
+  gregs.rbp = regs.rbp;
+  gregs.r8 = regs.r8;
+  gregs.r9 = regs.r9;
+  gregs.r10 = regs.r10;
+  gregs.r11 = regs.r11;
+  gregs.r12 = regs.r12;
+  gregs.r13 = regs.r13;
+  gregs.r14 = regs.r14;
+  gregs.r15 = regs.r15;
+  gregs.rip = regs.rip;
+  gregs.eflags = regs.rflags;
+  gregs.fs_base = sregs.fs.base;
+  gregs.gs_base = sregs.gs.base;
+  memcpy(&result.fpregs, xsave.region, sizeof(result.fpregs));
+  return absl::OkStatus();
+}
+
+absl::Status KvmSnapExecutor::ArmRunTimer() {
+  if (options_.run_timeout == absl::InfiniteDuration()) {
+    return absl::OkStatus();
+  }
+  const pid_t tid = syscall(SYS_gettid);
+  if (!run_timer_created_ || run_timer_tid_ != tid) {
+    if (run_timer_created_) {
+      timer_delete(run_timer_);
+      run_timer_created_ = false;
+    }
+    sigevent event = {};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = RunTimerSignal();
+    event._sigev_un._tid = tid;  // sigev_notify_thread_id
+    if (timer_create(CLOCK_MONOTONIC, &event, &run_timer_) != 0) {
+      return absl::ErrnoToStatus(errno, "timer_create()");
+    }
+    run_timer_created_ = true;
+    run_timer_tid_ = tid;
+  }
+  itimerspec spec = {};
+  spec.it_value = absl::ToTimespec(options_.run_timeout);
+  if (timer_settime(run_timer_, 0, &spec, nullptr) != 0) {
+    return absl::ErrnoToStatus(errno, "timer_settime()");
+  }
+  return absl::OkStatus();
+}
+
+void KvmSnapExecutor::DisarmRunTimer() {
+  if (!run_timer_created_) return;
+  const itimerspec spec = {};
+  CHECK_EQ(timer_settime(run_timer_, 0, &spec, nullptr), 0);
+}
+
+#else  // !defined(__x86_64__)
+
+absl::StatusOr<std::unique_ptr<KvmSnapExecutor>> KvmSnapExecutor::Create(
+    const Options& options) {
+  return absl::UnimplementedError("KvmSnapExecutor requires x86_64");
+}
+
+KvmSnapExecutor::~KvmSnapExecutor() = default;
+
+absl::StatusOr<size_t> KvmSnapExecutor::Load(const Snapshot& snapshot) {
+  return absl::UnimplementedError("KvmSnapExecutor requires x86_64");
+}
+
+absl::StatusOr<KvmSnapExecutor::RunResult> KvmSnapExecutor::Run(
+    size_t handle) {
+  return absl::UnimplementedError("KvmSnapExecutor requires x86_64");
+}
+
+absl::StatusOr<std::string> KvmSnapExecutor::ReadMemory(size_t handle,
+                                                       uint64_t address,
+                                                       size_t size) const {
+  return absl::UnimplementedError("KvmSnapExecutor requires x86_64");
+}
+
+#endif  // defined(__x86_64__)
+
+}  // namespace silifuzz
@@ -0,0 +1,181 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_RUNNER_KVM_SNAP_EXECUTOR_H_
+#define THIRD_PARTY_SILIFUZZ_RUNNER_KVM_SNAP_EXECUTOR_H_
+
+#include <sys/types.h>
+#include <time.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/time/time.h"
+#include "./common/snapshot.h"
+#include "./proxies/page_table/memory_state_image.h"
+#include "./util/arch.h"
+#include "./util/ucontext/ucontext_types.h"
+
+namespace silifuzz {
+
+// Executes snapshots in a KVM virtual machine instead of a runner process.
+//
+// Each loaded snapshot gets its own image in guest physical memory: its
+// memory contents and a page table built by proxies::MemoryStateImageBuilder.
+// Switching between snapshots only loads another page table root into CR3,
+// and no mmap() or mprotect() calls are made. The guest address space
+// belongs entirely to the snapshot, so snapshots can use addresses that
+// would conflict with the runner's own mappings. The only exception is the
+// page at kSnapExitAddress.
+//
+// Snapshots must be Snapify()-ed. The page at kSnapExitAddress holds a HLT
+// instruction, so the exit sequence leaves the guest at the end point. Snaps
+// run in 64-bit mode at CPL 0 with SMEP and SMAP disabled and CR0.WP set.
+// Write protection therefore works as in user mode, but privileged
+// instructions do not fault. There is no IDT, so any exception shuts down
+// the vCPU.
+//
+// One executor owns one vCPU. To run snaps in parallel, use one executor per
+// core, each in its own thread. Only x86_64 is supported. On other
+// architectures Create() returns an Unimplemented status.
+//
+// This class is thread-compatible.
+class KvmSnapExecutor {
+ public:
+  struct Options {
+    // Size of the guest physical memory that holds all loaded snapshots.
+    uint64_t guest_memory_bytes = uint64_t{256} << 20;
+
+    // A snap that runs longer than this is stopped and reported as a
+    // runaway.
+    absl::Duration run_timeout = absl::Seconds(1);
+  };
+
+  // Result of running a snap.
+  struct RunResult {
+    enum class Outcome {
+      // The snap reached its exit sequence. `gregs` and `fpregs` are the
+      // registers at the end point, as recorded by the runner's exit
+      // sequence.
+      kExited,
+      // The snap raised an exception, which shut down the vCPU. The
+      // registers are the vCPU state after the shutdown.
+      kException,
+      // The snap ran longer than Options::run_timeout.
+      kRunaway,
+    };
+    Outcome outcome;
+    GRegSet<X86_64> gregs;
+    FPRegSet<X86_64> fpregs;
+  };
+
+  // Opens /dev/kvm and creates a VM with a single vCPU.
+  static absl::StatusOr<std::unique_ptr<KvmSnapExecutor>> Create(
+      const Options& options);
+  static absl::StatusOr<std::unique_ptr<KvmSnapExecutor>> Create() {
+    return Create(Options());
+  }
+
+  // Not copyable or movable, owns the VM.
+  KvmSnapExecutor(const KvmSnapExecutor&) = delete;
+  KvmSnapExecutor& operator=(const KvmSnapExecutor&) = delete;
+
+  ~KvmSnapExecutor();
+
+  // Loads the image of `snapshot` into guest memory. Returns a handle for
+  // Run() and ReadMemory(). Fails if guest memory is exhausted.
+  // REQUIRES: `snapshot` is an x86_64 snapshot that was Snapify()-ed.
+  absl::StatusOr<size_t> Load(const Snapshot& snapshot);
+
+  // Restores the initial memory and registers of the snapshot loaded as
+  // `handle` and runs it until it exits, faults or times out.
+  absl::StatusOr<RunResult> Run(size_t handle);
+
+  // Returns `size` bytes at virtual `address` in the address space of the
+  // snapshot loaded as `handle`, as left by the last Run(). Fails if any of
+  // the bytes is not mapped.
+  absl::StatusOr<std::string> ReadMemory(size_t handle, uint64_t address,
+                                         size_t size) const;
+
+ private:
+  // A snapshot loaded into guest memory.
+  struct LoadedSnapshot {
+    proxies::MemoryStateImage<X86_64> image;
+    GRegSet<X86_64> gregs;
+    FPRegSet<X86_64> fpregs;
+  };
+
+  explicit KvmSnapExecutor(const Options& options) : options_(options) {}
+
+  // Sets up the VM, the vCPU and the exit page.
+  absl::Status Init();
+
+  // Returns the guest physical address that virtual `address` maps to in the
+  // page table at `page_table_root`, or an error if it is not mapped.
+  absl::StatusOr<uint64_t> Translate(uint64_t page_table_root,
+                                     uint64_t address) const;
+
+  // Loads the registers of `loaded` into the vCPU.
+  absl::Status SetRegisters(const LoadedSnapshot& loaded);
+
+  // Reads the registers of the vCPU into `result`.
+  absl::Status GetRegisters(RunResult& result) const;
+
+  // Arms the run timer to interrupt the calling thread after
+  // Options::run_timeout.
+  absl::Status ArmRunTimer();
+
+  // Disarms the run timer.
+  void DisarmRunTimer();
+
+  const Options options_;
+
+  int kvm_fd_ = -1;
+  int vm_fd_ = -1;
+  int vcpu_fd_ = -1;
+
+  // Shared state of the vCPU, see KVM_RUN.
+  void* vcpu_run_ = nullptr;
+  size_t vcpu_run_size_ = 0;
+
+  // Host mapping of the guest physical memory.
+  uint8_t* guest_memory_ = nullptr;
+
+  // Guest physical address where the next image is loaded.
+  uint64_t next_image_address_ = 0;
+
+  // Page table layouts are reused between snapshots with the same layout.
+  proxies::MemoryStateImageBuilder<X86_64> image_builder_;
+
+  // Indexed by handle.
+  std::vector<LoadedSnapshot> loaded_;
+
+  // True if the guest has XSAVE enabled.
+  bool xsave_enabled_ = false;
+
+  // Timer that interrupts KVM_RUN after Options::run_timeout. It signals
+  // thread `run_timer_tid_` and is recreated when Run() is called from
+  // another thread.
+  timer_t run_timer_;
+  bool run_timer_created_ = false;
+  pid_t run_timer_tid_ = 0;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_RUNNER_KVM_SNAP_EXECUTOR_H_
@@ -0,0 +1,104 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner/kvm_snap_executor.h"
+
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "./common/raw_insns_util.h"
+#include "./common/snapshot.h"
+#include "./snap/gen/snap_generator.h"
+#include "./util/arch.h"
+#include "./util/testing/status_macros.h"
+
+namespace silifuzz {
+namespace {
+
+// mov $42, %rax
+constexpr absl::string_view kMovRax42("\x48\xc7\xc0\x2a\x00\x00\x00", 7);
+
+using Outcome = KvmSnapExecutor::RunResult::Outcome;
+
+// Returns an executor, or nullptr if KVM is not available here.
+std::unique_ptr<KvmSnapExecutor> MakeExecutorOrNull() {
+  if (access("/dev/kvm", R_OK | W_OK) != 0) return nullptr;
+  absl::StatusOr<std::unique_ptr<KvmSnapExecutor>> executor =
+      KvmSnapExecutor::Create();
+  if (!executor.ok()) return nullptr;
+  return *std::move(executor);
+}
+
+// Returns a snapified snapshot of `code`.
+absl::StatusOr<Snapshot> MakeSnapshot(absl::string_view code) {
+  ASSIGN_OR_RETURN_IF_NOT_OK(Snapshot snapshot,
+                             InstructionsToSnapshot<X86_64>(code));
+  return Snapify(snapshot, SnapifyOptions::V2InputMakeOpts(
+                               ArchitectureId::kX86_64));
+}
+
+TEST(KvmSnapExecutor, Outcomes) {
+  std::unique_ptr<KvmSnapExecutor> executor = MakeExecutorOrNull();
+  if (executor == nullptr) GTEST_SKIP() << "KVM not available";
+
+  ASSERT_OK_AND_ASSIGN(Snapshot exits, MakeSnapshot(kMovRax42));
+  // jmp .
+  ASSERT_OK_AND_ASSIGN(Snapshot runaway, MakeSnapshot("\xeb\xfe"));
+  // ud2
+  ASSERT_OK_AND_ASSIGN(Snapshot faults, MakeSnapshot("\x0f\x0b"));
+  ASSERT_OK_AND_ASSIGN(size_t exits_handle, executor->Load(exits));
+  ASSERT_OK_AND_ASSIGN(size_t runaway_handle, executor->Load(runaway));
+  ASSERT_OK_AND_ASSIGN(size_t faults_handle, executor->Load(faults));
+
+  // Run each snap twice, interleaved, to check that Run() resets the state.
+  for (int i = 0; i < 2; ++i) {
+    ASSERT_OK_AND_ASSIGN(KvmSnapExecutor::RunResult result,
+                         executor->Run(exits_handle));
+    EXPECT_EQ(result.outcome, Outcome::kExited);
+    EXPECT_EQ(result.gregs.rax, uint64_t{42});
+    EXPECT_EQ(result.gregs.rip,
+              exits.expected_end_states()[0].endpoint().instruction_address());
+
+    ASSERT_OK_AND_ASSIGN(result, executor->Run(runaway_handle));
+    EXPECT_EQ(result.outcome, Outcome::kRunaway);
+
+    ASSERT_OK_AND_ASSIGN(result, executor->Run(faults_handle));
+    EXPECT_EQ(result.outcome, Outcome::kException);
+  }
+}
+
+TEST(KvmSnapExecutor, ReadMemory) {
+  std::unique_ptr<KvmSnapExecutor> executor = MakeExecutorOrNull();
+  if (executor == nullptr) GTEST_SKIP() << "KVM not available";
+
+  ASSERT_OK_AND_ASSIGN(Snapshot snapshot, MakeSnapshot(kMovRax42));
+  ASSERT_OK_AND_ASSIGN(size_t handle, executor->Load(snapshot));
+  const Snapshot::Address code_address =
+      snapshot.ExtractRip(snapshot.registers());
+  ASSERT_OK_AND_ASSIGN(
+      std::string bytes,
+      executor->ReadMemory(handle, code_address, kMovRax42.size()));
+  EXPECT_EQ(bytes, kMovRax42);
+  EXPECT_FALSE(executor->ReadMemory(handle, 0, 1).ok());
+}
+
+}  // namespace
+}  // namespace silifuzz
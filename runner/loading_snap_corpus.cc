@@ -13,6 +13,9 @@
 // limitations under the License.
 
 #include "./runner/default_snap_corpus.h"
+
+#include <cstdint>
+
 #include "./snap/snap.h"
 #include "./snap/snap_corpus_util.h"
 #include "./util/arch.h"
@@ -20,7 +23,8 @@
 namespace silifuzz {
 
 const SnapCorpus<Host>* LoadCorpus(const char* filename, bool verify,
-                                   int* corpus_fd) {
+                                   int* corpus_fd, uintptr_t load_address,
+                                   bool lazy_relocation) {
   if (filename == nullptr) {
     if (corpus_fd != nullptr) {
       *corpus_fd = -1;
@@ -29,7 +33,9 @@ const SnapCorpus<Host>* LoadCorpus(const char* filename, bool verify,
   }
   // Release the pointer -- it is ok to leak memory since the runner always
   // runs to completion and then exits.
-  return LoadCorpusFromFile<Host>(filename, true, verify, corpus_fd).release();
+  return LoadCorpusFromFile<Host>(filename, true, verify, corpus_fd,
+                                  load_address, lazy_relocation)
+      .release();
 }
 
 }  // namespace silifuzz
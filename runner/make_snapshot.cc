@@ -14,15 +14,24 @@
 
 #include "./runner/make_snapshot.h"
 
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "./common/proxy_config.h"
 #include "./common/raw_insns_util.h"
 #include "./common/snapshot.h"
 #include "./common/snapshot_enums.h"
 #include "./player/trace_options.h"
+#include "./proto/snapshot_execution_result.pb.h"
+#include "./runner/driver/runner_driver.h"
+#include "./runner/driver/runner_options.h"
 #include "./runner/runner_provider.h"
 #include "./runner/snap_maker.h"
 #include "./util/arch.h"
@@ -44,18 +53,37 @@ MakingConfig MakingConfig::Quick() {
   return config;
 }
 
-absl::StatusOr<Snapshot> MakeSnapshot(const Snapshot& snapshot,
-                                      const MakingConfig& making_config) {
+namespace {
+
+SnapMaker::Options SnapMakerOptions(const MakingConfig& making_config) {
   SnapMaker::Options opts;
   opts.runner_path = making_config.runner_path;
   opts.max_pages_to_add = making_config.max_pages_to_add;
   opts.num_verify_attempts = making_config.num_verify_attempts;
-  SnapMaker maker(opts);
+  opts.verify_cpus = making_config.verify_cpus;
+  opts.zygote_pool = making_config.zygote_pool;
+  return opts;
+}
 
-  ASSIGN_OR_RETURN_IF_NOT_OK_PLUS(Snapshot made_snapshot, maker.Make(snapshot),
-                                  "Could not make snapshot: ");
+// Adds the time since `start` to `stage` of making_config.stage_times, if
+// any.
+void AddStageTime(const MakingConfig& making_config,
+                  absl::Duration MakingStageTimes::*stage, absl::Time start) {
+  if (making_config.stage_times != nullptr) {
+    making_config.stage_times->*stage += absl::Now() - start;
+  }
+}
+
+// Records an end state of `snapshot` with `maker` and checks the result the
+// way MakeSnapshot() does.
+absl::StatusOr<Snapshot> RecordAndVerify(SnapMaker& maker, Snapshot&& snapshot,
+                                         const MakingConfig& making_config) {
+  absl::Time start = absl::Now();
+  absl::StatusOr<Snapshot> recorded_snapshot_or =
+      maker.RecordEndState(std::move(snapshot));
+  AddStageTime(making_config, &MakingStageTimes::record, start);
   ASSIGN_OR_RETURN_IF_NOT_OK_PLUS(Snapshot recorded_snapshot,
-                                  maker.RecordEndState(made_snapshot),
+                                  std::move(recorded_snapshot_or),
                                   "Could not record snapshot: ");
 
   DCHECK_EQ(recorded_snapshot.expected_end_states().size(), 1);
@@ -65,8 +93,90 @@ absl::StatusOr<Snapshot> MakeSnapshot(const Snapshot& snapshot,
     return absl::InternalError(absl::StrCat(
         "Cannot fix ", EnumStr(ep.sig_cause()), "/", EnumStr(ep.sig_num())));
   }
-  RETURN_IF_NOT_OK(maker.VerifyPlaysDeterministically(recorded_snapshot));
-  return maker.CheckTrace(recorded_snapshot, making_config.trace);
+  start = absl::Now();
+  absl::Status verified = maker.VerifyPlaysDeterministically(recorded_snapshot);
+  AddStageTime(making_config, &MakingStageTimes::verify, start);
+  RETURN_IF_NOT_OK(verified);
+  start = absl::Now();
+  absl::StatusOr<Snapshot> traced_snapshot =
+      maker.CheckTrace(std::move(recorded_snapshot), making_config.trace);
+  AddStageTime(making_config, &MakingStageTimes::trace, start);
+  return traced_snapshot;
+}
+
+}  // namespace
+
+absl::StatusOr<Snapshot> MakeSnapshot(const Snapshot& snapshot,
+                                      const MakingConfig& making_config) {
+  return MakeSnapshot(snapshot.Copy(), making_config);
+}
+
+absl::StatusOr<Snapshot> MakeSnapshot(Snapshot&& snapshot,
+                                      const MakingConfig& making_config) {
+  SnapMaker maker(SnapMakerOptions(making_config));
+
+  const absl::Time start = absl::Now();
+  absl::StatusOr<Snapshot> made_snapshot_or = maker.Make(std::move(snapshot));
+  AddStageTime(making_config, &MakingStageTimes::make, start);
+  ASSIGN_OR_RETURN_IF_NOT_OK_PLUS(Snapshot made_snapshot,
+                                  std::move(made_snapshot_or),
+                                  "Could not make snapshot: ");
+  return RecordAndVerify(maker, std::move(made_snapshot), making_config);
+}
+
+absl::StatusOr<Snapshot> RecordEndStateOfMadeSnapshot(
+    const Snapshot& snapshot, const MakingConfig& making_config) {
+  if (snapshot.expected_end_states().empty()) {
+    return absl::InvalidArgumentError("Snapshot has no end state");
+  }
+  // Keep only the endpoint so that the runner records a complete end state
+  // for this platform regardless of what was recorded elsewhere.
+  Snapshot copy = snapshot.Copy();
+  const Snapshot::EndState undef_end_state(
+      copy.expected_end_states()[0].endpoint());
+  copy.set_expected_end_states({});
+  copy.set_negative_memory_mappings({});
+  RETURN_IF_NOT_OK(copy.can_add_expected_end_state(undef_end_state));
+  copy.add_expected_end_state(undef_end_state);
+
+  SnapMaker maker(SnapMakerOptions(making_config));
+  return RecordAndVerify(maker, std::move(copy), making_config);
+}
+
+absl::StatusOr<SnapshotProfile> ProfileSnapshot(
+    const Snapshot& snapshot, int num_iterations,
+    const MakingConfig& making_config) {
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      RunnerDriver driver,
+      RunnerDriverFromSnapshot(snapshot, making_config.runner_path));
+  RunnerOptions runner_options = RunnerOptions::PlayOptions(snapshot.id());
+  runner_options.set_extra_argv(
+      {"--snap_id", snapshot.id(), "--num_iterations",
+       absl::StrCat(num_iterations), "--collect_snap_latency"});
+  ASSIGN_OR_RETURN_IF_NOT_OK(RunnerDriver::RunResult result,
+                             driver.Run(runner_options));
+  if (!result.success()) {
+    return absl::InternalError("Snapshot failed while profiling");
+  }
+  for (const proto::SnapLatencyHistogram& histogram :
+       result.snap_latency_histograms()) {
+    if (histogram.snapshot_id() != snapshot.id()) continue;
+    uint64_t num_executions = 0;
+    for (uint64_t count : histogram.bucket_counts()) num_executions += count;
+    // Find the bucket of the median execution.
+    uint64_t num_seen = 0;
+    for (int bucket = 0; bucket < histogram.bucket_counts_size(); ++bucket) {
+      num_seen += histogram.bucket_counts(bucket);
+      if (2 * num_seen >= num_executions && num_seen > 0) {
+        return SnapshotProfile{
+            .median_ticks = uint64_t{1} << bucket,
+            .runner_max_rss_kb = result.runner_max_rss_kb(),
+        };
+      }
+    }
+    break;
+  }
+  return absl::InternalError("Runner reported no latency for the snapshot");
 }
 
 absl::StatusOr<Snapshot> MakeRawInstructions(
@@ -79,7 +189,7 @@ absl::StatusOr<Snapshot> MakeRawInstructions(
   snapshot.set_id(InstructionsToSnapshotId(instructions));
 
   // Make to add the exit sequence, etc.
-  return MakeSnapshot(snapshot, making_config);
+  return MakeSnapshot(std::move(snapshot), making_config);
 }
 
 }  // namespace silifuzz
@@ -15,17 +15,30 @@
 #ifndef THIRD_PARTY_SILIFUZZ_RUNNER_MAKE_SNAPSHOT_H_
 #define THIRD_PARTY_SILIFUZZ_RUNNER_MAKE_SNAPSHOT_H_
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "./common/proxy_config.h"
 #include "./common/snapshot.h"
 #include "./player/trace_options.h"
+#include "./runner/driver/runner_driver.h"
 #include "./util/arch.h"
 
 namespace silifuzz {
 
+// Wall time spent in each step of MakeSnapshot() and
+// RecordEndStateOfMadeSnapshot(). Steps that were not reached take no time.
+struct MakingStageTimes {
+  absl::Duration make;
+  absl::Duration record;
+  absl::Duration verify;
+  absl::Duration trace;
+};
+
 struct MakingConfig {
   // Location of the runner binary.
   std::string runner_path;
@@ -39,8 +52,19 @@ struct MakingConfig {
   // value is somewhat arbitrary but it should normally be > 1.
   int num_verify_attempts = 5;
 
+  // CPUs to play the verify attempts on concurrently. See
+  // SnapMaker::Options::verify_cpus.
+  std::vector<int> verify_cpus;
+
+  // If not null, forks the runners from zygotes of this pool. See
+  // SnapMaker::Options::zygote_pool. Not owned.
+  ZygotePool* zygote_pool = nullptr;
+
   TraceOptions trace;
 
+  // If not null, the time spent in each step is added here. Not owned.
+  MakingStageTimes* stage_times = nullptr;
+
   // Config for when we are making a real Snapshot that we want to persist.
   static MakingConfig Default();
 
@@ -49,9 +73,38 @@ struct MakingConfig {
   static MakingConfig Quick();
 };
 
-// A high-level interface for making / remaking a Snapshot.
+// A high-level interface for making / remaking a Snapshot. The rvalue
+// overload consumes `snapshot` instead of copying it.
 absl::StatusOr<Snapshot> MakeSnapshot(const Snapshot& snapshot,
                                       const MakingConfig& making_config);
+absl::StatusOr<Snapshot> MakeSnapshot(Snapshot&& snapshot,
+                                      const MakingConfig& making_config);
+
+// A high-level interface for recording an end state of `snapshot` for the
+// current platform. `snapshot` must have been made by MakeSnapshot(), possibly
+// on another platform. Unlike MakeSnapshot(), this does not remake it, which
+// is cheaper and keeps its memory mappings. Returns `snapshot` with the
+// recorded end state as its only end state, verified and traced like
+// MakeSnapshot() does, or an error.
+absl::StatusOr<Snapshot> RecordEndStateOfMadeSnapshot(
+    const Snapshot& snapshot, const MakingConfig& making_config);
+
+// Execution cost of a made Snapshot measured by ProfileSnapshot().
+struct SnapshotProfile {
+  // Median latency of one execution in CPU timestamp counter ticks, rounded
+  // down to a power of 2. See proto.SnapLatencyHistogram.
+  uint64_t median_ticks = 0;
+
+  // Peak RSS of the runner process in KiB.
+  uint64_t runner_max_rss_kb = 0;
+};
+
+// Plays `snapshot`, which must have been made by MakeSnapshot(),
+// `num_iterations` times in one runner process and returns its measured
+// execution cost. The latency includes switching in and out of the snapshot.
+absl::StatusOr<SnapshotProfile> ProfileSnapshot(
+    const Snapshot& snapshot, int num_iterations,
+    const MakingConfig& making_config);
 
 // A high-level interface for making a Snapshot from raw instructions.
 absl::StatusOr<Snapshot> MakeRawInstructions(
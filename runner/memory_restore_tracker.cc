@@ -0,0 +1,62 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner/memory_restore_tracker.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "./snap/snap.h"
+
+namespace silifuzz {
+
+bool MemoryRestoreTracker::ClaimWritableMapping(
+    const SnapMemoryMapping& memory_mapping, size_t snap_index) {
+  const uint64_t start_address = memory_mapping.start_address;
+  const uint64_t limit_address = start_address + memory_mapping.num_bytes;
+  WritableMappingOwner* slot = nullptr;
+  for (size_t i = 0; i < num_owners_; ++i) {
+    WritableMappingOwner& owner = owners_[i];
+    if (owner.start_address == start_address &&
+        owner.limit_address == limit_address) {
+      slot = &owner;
+    } else if (owner.start_address < limit_address &&
+               start_address < owner.limit_address) {
+      // Partially overlapping range is about to be overwritten.
+      owner.snap_index = kNoOwner;
+    }
+  }
+  if (slot == nullptr) {
+    if (num_owners_ == kMaxWritableMappingOwners) {
+      return false;
+    }
+    slot = &owners_[num_owners_++];
+    slot->start_address = start_address;
+    slot->limit_address = limit_address;
+    slot->snap_index = kNoOwner;
+  }
+  const bool already_owned = slot->snap_index == snap_index;
+  slot->snap_index = snap_index;
+  return already_owned;
+}
+
+void MemoryRestoreTracker::ReleaseWritableMappings(size_t snap_index) {
+  for (size_t i = 0; i < num_owners_; ++i) {
+    if (owners_[i].snap_index == snap_index) {
+      owners_[i].snap_index = kNoOwner;
+    }
+  }
+}
+
+}  // namespace silifuzz
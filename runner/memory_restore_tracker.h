@@ -0,0 +1,172 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_RUNNER_MEMORY_RESTORE_TRACKER_H_
+#define THIRD_PARTY_SILIFUZZ_RUNNER_MEMORY_RESTORE_TRACKER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include "./snap/snap.h"
+
+namespace silifuzz {
+
+// Bookkeeping for incremental memory restore in the runner.
+//
+// Normally the runner rewrites every writable SnapMemoryBytes of a snap
+// before each execution. In incremental mode, the runner remembers which snap
+// last initialized each writable mapping and which of that snap's writable
+// SnapMemoryBytes were modified by executing it. If the same snap runs again
+// and nothing else has claimed its writable mappings in between, only the
+// modified SnapMemoryBytes are restored.
+//
+// A SnapMemoryBytes is considered modified if its contents differ from the
+// initial state after the first as-expected execution of the snap. Since all
+// writable memory of a snap is verified after each execution, an as-expected
+// execution always leaves the same bytes modified. Any other outcome leaves
+// the memory in an unknown state and releases ownership of the snap's
+// writable mappings so that they are fully restored next time.
+//
+// Ownership is tracked by start address of writable mappings. Snaps in a
+// corpus typically share a few writable mappings (e.g. stacks) at the same
+// addresses, so a small fixed-size table suffices. Mappings that do not fit
+// the table are always restored fully.
+//
+// The class has a trivial default constructor so that it can be a global in
+// the nolibc runner without a static initializer. Init() must be called before
+// any other method.
+class MemoryRestoreTracker {
+ public:
+  // Per-snap dirty state.
+  struct SnapState {
+    // Bit i is set if the i-th writable SnapMemoryBytes of the snap, counting
+    // across all writable mappings in order, is modified by executing the
+    // snap. SnapMemoryBytes beyond the width of the mask are always restored.
+    uint64_t dirty_mask;
+
+    // True if `dirty_mask` has been computed.
+    bool learned;
+  };
+
+  static constexpr size_t kMaxDirtyMaskBits = 64;
+  static constexpr size_t kMaxWritableMappingOwners = 64;
+
+  // Starts tracking with `snap_states`, which must point to a zero-filled
+  // array of one SnapState per snap in the corpus. The array is not owned.
+  // A nullptr disables tracking.
+  void Init(SnapState* snap_states) {
+    snap_states_ = snap_states;
+    num_owners_ = 0;
+  }
+
+  // Returns true if Init() has been called with a non-null array.
+  bool enabled() const { return snap_states_ != nullptr; }
+
+  // Forgets all mapping ownership, e.g. after mappings were created or
+  // removed. Learned dirty masks are kept.
+  void ResetOwnership() { num_owners_ = 0; }
+
+  // Prepares writable memory of `snap` at `snap_index` by calling
+  // `restore(const SnapMemoryBytes&)` for each SnapMemoryBytes that may not be
+  // in its initial state.
+  //
+  // REQUIRES: enabled().
+  template <typename Arch, typename RestoreFn>
+  void Prepare(const Snap<Arch>& snap, size_t snap_index, RestoreFn&& restore);
+
+  // Updates the state of `snap` at `snap_index` after an execution.
+  // `as_expected` tells whether the execution ended as expected.
+  // `is_modified(const SnapMemoryBytes&)` returns true if the memory differs
+  // from the initial state of the SnapMemoryBytes. It is only called for the
+  // first as-expected execution of a snap.
+  //
+  // REQUIRES: enabled().
+  template <typename Arch, typename IsModifiedFn>
+  void Update(const Snap<Arch>& snap, size_t snap_index, bool as_expected,
+              IsModifiedFn&& is_modified);
+
+ private:
+  // Index value denoting a writable mapping not owned by any snap.
+  static constexpr size_t kNoOwner = ~static_cast<size_t>(0);
+
+  // Tracks which snap last initialized a writable address range.
+  struct WritableMappingOwner {
+    uint64_t start_address;
+    uint64_t limit_address;
+    size_t snap_index;
+  };
+
+  // Records `snap_index` as the owner of `memory_mapping`. Returns true iff
+  // `snap_index` already owned the exact same address range, i.e. the range
+  // has not been touched by any other snap since `snap_index` last claimed it.
+  bool ClaimWritableMapping(const SnapMemoryMapping& memory_mapping,
+                            size_t snap_index);
+
+  // Releases all writable mappings owned by `snap_index`.
+  void ReleaseWritableMappings(size_t snap_index);
+
+  SnapState* snap_states_;
+  WritableMappingOwner owners_[kMaxWritableMappingOwners];
+  size_t num_owners_;
+};
+
+template <typename Arch, typename RestoreFn>
+void MemoryRestoreTracker::Prepare(const Snap<Arch>& snap, size_t snap_index,
+                                   RestoreFn&& restore) {
+  const SnapState& state = snap_states_[snap_index];
+  size_t bit = 0;
+  for (const auto& memory_mapping : snap.memory_mappings) {
+    if (!memory_mapping.writable()) continue;
+    // Always claim the mapping, even if the dirty mask is not yet known.
+    const bool resident =
+        ClaimWritableMapping(memory_mapping, snap_index) && state.learned;
+    for (const auto& memory_bytes : memory_mapping.memory_bytes) {
+      if (!resident || bit >= kMaxDirtyMaskBits ||
+          (state.dirty_mask & (uint64_t{1} << bit)) != 0) {
+        restore(memory_bytes);
+      }
+      ++bit;
+    }
+  }
+}
+
+template <typename Arch, typename IsModifiedFn>
+void MemoryRestoreTracker::Update(const Snap<Arch>& snap, size_t snap_index,
+                                  bool as_expected,
+                                  IsModifiedFn&& is_modified) {
+  if (!as_expected) {
+    ReleaseWritableMappings(snap_index);
+    return;
+  }
+  SnapState& state = snap_states_[snap_index];
+  if (state.learned) return;
+  uint64_t dirty_mask = 0;
+  size_t bit = 0;
+  for (const auto& memory_mapping : snap.memory_mappings) {
+    if (!memory_mapping.writable()) continue;
+    for (const auto& memory_bytes : memory_mapping.memory_bytes) {
+      if (bit >= kMaxDirtyMaskBits) break;
+      if (is_modified(memory_bytes)) {
+        dirty_mask |= uint64_t{1} << bit;
+      }
+      ++bit;
+    }
+  }
+  state.dirty_mask = dirty_mask;
+  state.learned = true;
+}
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_RUNNER_MEMORY_RESTORE_TRACKER_H_
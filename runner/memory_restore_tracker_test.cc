@@ -0,0 +1,172 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner/memory_restore_tracker.h"
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "./snap/snap.h"
+#include "./util/arch.h"
+#include "./util/checks.h"
+#include "./util/nolibc_gunit.h"
+
+namespace silifuzz {
+namespace {
+
+// Two snaps A and B share a writable mapping over `memory`, which consists of
+// two regions with one SnapMemoryBytes each. Executing A dirties region 0
+// only. Executing B does not modify any memory.
+constexpr size_t kRegionSize = 64;
+constexpr size_t kNumRegions = 2;
+uint8_t memory[kNumRegions * kRegionSize];
+
+uint64_t RegionAddress(size_t region) {
+  return reinterpret_cast<uint64_t>(&memory[region * kRegionSize]);
+}
+
+SnapMemoryBytes MakeRun(size_t region, uint8_t value) {
+  SnapMemoryBytes memory_bytes{};
+  memory_bytes.start_address = RegionAddress(region);
+  memory_bytes.flags = SnapMemoryBytes::kRepeating;
+  memory_bytes.data.byte_run.value = value;
+  memory_bytes.data.byte_run.size = kRegionSize;
+  return memory_bytes;
+}
+
+SnapMemoryMapping MakeMapping(const SnapMemoryBytes* memory_bytes) {
+  SnapMemoryMapping memory_mapping{};
+  memory_mapping.start_address = RegionAddress(0);
+  memory_mapping.num_bytes = sizeof(memory);
+  memory_mapping.perms = PROT_READ | PROT_WRITE;
+  memory_mapping.memory_bytes = {kNumRegions, memory_bytes};
+  return memory_mapping;
+}
+
+const SnapMemoryBytes kMemoryBytesA[kNumRegions] = {MakeRun(0, 0x00),
+                                                    MakeRun(1, 0x00)};
+const SnapMemoryBytes kMemoryBytesB[kNumRegions] = {MakeRun(0, 0x11),
+                                                    MakeRun(1, 0x22)};
+const SnapMemoryMapping kMappingA = MakeMapping(kMemoryBytesA);
+const SnapMemoryMapping kMappingB = MakeMapping(kMemoryBytesB);
+
+Snap<Host> MakeSnap(const SnapMemoryMapping* memory_mapping) {
+  Snap<Host> snap{};
+  snap.memory_mappings = {1, memory_mapping};
+  return snap;
+}
+
+constexpr size_t kSnapA = 0;
+constexpr size_t kSnapB = 1;
+
+// Returns true iff memory covered by `memory_bytes` has its initial contents.
+bool MatchesInitialState(const SnapMemoryBytes& memory_bytes) {
+  const uint8_t* bytes = reinterpret_cast<uint8_t*>(memory_bytes.start_address);
+  for (size_t i = 0; i < memory_bytes.size(); ++i) {
+    if (bytes[i] != memory_bytes.data.byte_run.value) return false;
+  }
+  return true;
+}
+
+// Wraps a MemoryRestoreTracker and counts the restored SnapMemoryBytes.
+class Runner {
+ public:
+  Runner() {
+    for (size_t i = 0; i < sizeof(memory); ++i) memory[i] = 0xff;
+    tracker_.Init(states_);
+  }
+
+  // Prepares `snap` and returns the number of restored SnapMemoryBytes. All
+  // memory of `snap` must be in its initial state afterwards.
+  size_t Prepare(const Snap<Host>& snap, size_t snap_index) {
+    size_t num_restored = 0;
+    auto restore = [&num_restored](const SnapMemoryBytes& memory_bytes) {
+      uint8_t* bytes = reinterpret_cast<uint8_t*>(memory_bytes.start_address);
+      for (size_t i = 0; i < memory_bytes.size(); ++i) {
+        bytes[i] = memory_bytes.data.byte_run.value;
+      }
+      ++num_restored;
+    };
+    tracker_.Prepare(snap, snap_index, restore);
+    for (const auto& memory_bytes : snap.memory_mappings[0].memory_bytes) {
+      CHECK(MatchesInitialState(memory_bytes));
+    }
+    return num_restored;
+  }
+
+  // Simulates executing the snap at `snap_index` and updates the tracker.
+  void Execute(const Snap<Host>& snap, size_t snap_index, bool as_expected) {
+    if (snap_index == kSnapA) memory[3] = 0xaa;
+    tracker_.Update(snap, snap_index, as_expected,
+                    [](const SnapMemoryBytes& memory_bytes) {
+                      return !MatchesInitialState(memory_bytes);
+                    });
+  }
+
+ private:
+  MemoryRestoreTracker::SnapState states_[2] = {};
+  MemoryRestoreTracker tracker_;
+};
+
+TEST(MemoryRestoreTracker, RestoresOnlyDirtiedMemory) {
+  const Snap<Host> snap_a = MakeSnap(&kMappingA);
+  const Snap<Host> snap_b = MakeSnap(&kMappingB);
+  Runner runner;
+
+  // Nothing is known about A before its first execution.
+  CHECK_EQ(runner.Prepare(snap_a, kSnapA), kNumRegions);
+  runner.Execute(snap_a, kSnapA, true);
+
+  // A still owns the mapping, only the region it dirtied is restored.
+  CHECK_EQ(runner.Prepare(snap_a, kSnapA), 1);
+  CHECK_EQ(memory[3], 0x00);
+  runner.Execute(snap_a, kSnapA, true);
+
+  // B must not see the byte A left behind.
+  CHECK_EQ(runner.Prepare(snap_b, kSnapB), kNumRegions);
+  runner.Execute(snap_b, kSnapB, true);
+
+  // B dirties nothing.
+  CHECK_EQ(runner.Prepare(snap_b, kSnapB), 0);
+  runner.Execute(snap_b, kSnapB, true);
+
+  // B claimed the mapping, so A gets a full restore.
+  CHECK_EQ(runner.Prepare(snap_a, kSnapA), kNumRegions);
+  runner.Execute(snap_a, kSnapA, true);
+  CHECK_EQ(runner.Prepare(snap_a, kSnapA), 1);
+}
+
+TEST(MemoryRestoreTracker, UnexpectedOutcomeForcesFullRestore) {
+  const Snap<Host> snap_a = MakeSnap(&kMappingA);
+  Runner runner;
+
+  CHECK_EQ(runner.Prepare(snap_a, kSnapA), kNumRegions);
+  runner.Execute(snap_a, kSnapA, true);
+  CHECK_EQ(runner.Prepare(snap_a, kSnapA), 1);
+
+  // A failed execution may have written anywhere.
+  runner.Execute(snap_a, kSnapA, false);
+  memory[kRegionSize] = 0x55;
+  CHECK_EQ(runner.Prepare(snap_a, kSnapA), kNumRegions);
+}
+
+}  // namespace
+}  // namespace silifuzz
+
+NOLIBC_TEST_MAIN({
+  RUN_TEST(MemoryRestoreTracker, RestoresOnlyDirtiedMemory);
+  RUN_TEST(MemoryRestoreTracker, UnexpectedOutcomeForcesFullRestore);
+})
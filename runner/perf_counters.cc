@@ -0,0 +1,182 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner/perf_counters.h"
+
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "third_party/lss/lss/linux_syscall_support.h"
+#include "./util/atoi.h"
+#include "./util/checks.h"
+#include "./util/itoa.h"
+#include "./util/page_util.h"
+#include "./util/perf_event_read.h"
+
+namespace silifuzz {
+
+namespace {
+
+// Opens `attr` for the calling thread on any CPU in the group of `group_fd`.
+// Returns the file descriptor or -1 and sets errno.
+int PerfEventOpen(perf_event_attr* attr, int group_fd) {
+#if defined(__x86_64__)
+  // linux_syscall_support.h has no wrapper for perf_event_open(2).
+  long result;
+  register long r10 asm("r10") = group_fd;
+  register long r8 asm("r8") = 0;  // flags
+  asm volatile("syscall"
+               : "=a"(result)
+               : "a"(__NR_perf_event_open), "D"(attr), "S"(0L /* self */),
+                 "d"(-1L /* any CPU */), "r"(r10), "r"(r8)
+               : "rcx", "r11", "memory");
+  if (result < 0) {
+    errno = -result;
+    return -1;
+  }
+  return result;
+#else
+  // The counters could not be read in user space anyway.
+  (void)attr;
+  (void)group_fd;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+}  // namespace
+
+int ParsePerfCounterConfigs(const char* spec,
+                            PerfCounterConfig configs[kMaxPerfCounters]) {
+  size_t num_configs = 0;
+  const char* begin = spec;
+  while (*begin != '\0') {
+    const char* end = begin;
+    while (*end != '\0' && *end != ',') ++end;
+    const char* colon =
+        static_cast<const char*>(memchr(begin, ':', end - begin));
+    uint64_t type;
+    if (num_configs == kMaxPerfCounters || colon == nullptr ||
+        !DecToU64(begin, colon - begin, &type) || type > UINT32_MAX ||
+        !HexToU64(colon + 1, end - colon - 1, &configs[num_configs].config)) {
+      return -1;
+    }
+    configs[num_configs++].type = type;
+    begin = *end == ',' ? end + 1 : end;
+  }
+  return static_cast<int>(num_configs);
+}
+
+bool PerfCounters::Open(const PerfCounterConfig* configs, size_t num_configs) {
+  CHECK_EQ(num_counters_, 0);
+  CHECK_LE(num_configs, kMaxPerfCounters);
+  for (size_t i = 0; i < num_configs; ++i) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = configs[i].type;
+    attr.config = configs[i].config;
+    // The group leader is pinned so that the group is always on the PMU or
+    // in error state, never multiplexed.
+    attr.pinned = i == 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    const int fd = PerfEventOpen(&attr, i == 0 ? -1 : fds_[0]);
+    if (fd < 0) {
+      LOG_ERROR("perf_event_open(", IntStr(configs[i].type), ":",
+                HexStr(configs[i].config), ") failed: ", ErrnoStr(errno));
+      Close();
+      return false;
+    }
+    void* page = mmap(nullptr, kPageSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (page == MAP_FAILED) {
+      LOG_ERROR("Cannot map perf event page: ", ErrnoStr(errno));
+      close(fd);
+      Close();
+      return false;
+    }
+    fds_[num_counters_] = fd;
+    pages_[num_counters_] = static_cast<const perf_event_mmap_page*>(page);
+    ++num_counters_;
+  }
+  return true;
+}
+
+bool PerfCounters::Read(uint64_t values[kMaxPerfCounters]) const {
+  for (size_t i = 0; i < num_counters_; ++i) {
+    if (!ReadPerfEventInUserSpace(pages_[i], values[i])) return false;
+  }
+  return true;
+}
+
+void PerfCounters::Close() {
+  for (size_t i = 0; i < num_counters_; ++i) {
+    munmap(const_cast<perf_event_mmap_page*>(pages_[i]), kPageSize);
+    close(fds_[i]);
+  }
+  num_counters_ = 0;
+}
+
+bool InstructionBudget::Open(const PerfCounterConfig& config,
+                             uint64_t budget) {
+  CHECK(!is_open());
+  CHECK_GT(budget, 0);
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = config.type;
+  attr.config = config.config;
+  attr.sample_period = budget;
+  // Signal on every overflow.
+  attr.wakeup_events = 1;
+  attr.pinned = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  const int fd = PerfEventOpen(&attr, -1);
+  if (fd < 0) {
+    LOG_ERROR("perf_event_open(", IntStr(config.type), ":",
+              HexStr(config.config), ") failed: ", ErrnoStr(errno));
+    return false;
+  }
+  // Deliver the overflow signal to this thread rather than to any thread of
+  // the process.
+  struct f_owner_ex owner = {.type = F_OWNER_TID, .pid = sys_gettid()};
+  if (sys_fcntl(fd, F_SETOWN_EX, reinterpret_cast<long>(&owner)) != 0 ||
+      sys_fcntl(fd, F_SETSIG, kInstructionBudgetSignal) != 0 ||
+      sys_fcntl(fd, F_SETFL, O_ASYNC) != 0) {
+    LOG_ERROR("Cannot set up the overflow signal: ", ErrnoStr(errno));
+    close(fd);
+    return false;
+  }
+  fd_ = fd;
+  budget_ = budget;
+  return true;
+}
+
+void InstructionBudget::Rearm() const {
+  // Setting the period also resets the events left until the next overflow.
+  CHECK_EQ(sys_ioctl(fd_, PERF_EVENT_IOC_PERIOD,
+                     const_cast<uint64_t*>(&budget_)),
+           0);
+}
+
+}  // namespace silifuzz
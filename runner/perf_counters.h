@@ -0,0 +1,123 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_RUNNER_PERF_COUNTERS_H_
+#define THIRD_PARTY_SILIFUZZ_RUNNER_PERF_COUNTERS_H_
+
+#include <linux/perf_event.h>
+#include <signal.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace silifuzz {
+
+// Maximum number of perf counters the runner can count at once. This is
+// about the number of general purpose counters of current CPUs.
+inline constexpr size_t kMaxPerfCounters = 8;
+
+// A PMU event as encoded in perf_event_attr.
+struct PerfCounterConfig {
+  uint32_t type;
+  uint64_t config;
+};
+
+// Parses `spec`, a comma-separated list of "<type>:<config>" with a decimal
+// type and a hexadecimal config, into `configs`. Returns the number of
+// configs or -1 if `spec` is malformed or lists more than kMaxPerfCounters.
+int ParsePerfCounterConfigs(const char* spec,
+                            PerfCounterConfig configs[kMaxPerfCounters]);
+
+// Perf counters of the calling thread in user space that are read with rdpmc,
+// i.e. without syscalls, so they can be read after the runner has entered
+// seccomp mode. The counters are opened as a single pinned group so that they
+// always count the same code.
+//
+// This class does no allocation and is usable in nolibc.
+class PerfCounters {
+ public:
+  PerfCounters() = default;
+
+  // Not copyable or movable, owns mappings.
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  // Opens counters for the `num_configs` events in `configs` and maps their
+  // first pages. Logs an error and returns false on failure, after which
+  // nothing is open. Only supported on x86-64.
+  // REQUIRES: Nothing is open and num_configs <= kMaxPerfCounters.
+  bool Open(const PerfCounterConfig* configs, size_t num_configs);
+
+  // Number of open counters.
+  size_t size() const { return num_counters_; }
+
+  // Stores the current values of the counters in `values`. Returns false if
+  // any counter cannot be read in user space, e.g. because the group is not
+  // on the PMU right now.
+  bool Read(uint64_t values[kMaxPerfCounters]) const;
+
+ private:
+  // Unmaps the pages and closes the counters opened so far.
+  void Close();
+
+  size_t num_counters_ = 0;
+  int fds_[kMaxPerfCounters];
+  const perf_event_mmap_page* pages_[kMaxPerfCounters];
+};
+
+// Signal an InstructionBudget sends when its budget runs out. Snaps cannot
+// raise it themselves because they make no syscalls.
+inline constexpr int kInstructionBudgetSignal = SIGIO;
+
+// The default event counted by InstructionBudget.
+inline constexpr PerfCounterConfig kRetiredInstructions = {
+    .type = PERF_TYPE_HARDWARE, .config = PERF_COUNT_HW_INSTRUCTIONS};
+
+// A perf counter of the calling thread that sends kInstructionBudgetSignal to
+// the thread every time a budget of events has occurred in user space since
+// the last Rearm(). Unlike PerfCounters this needs a syscall per Rearm(), so
+// seccomp must allow ioctl(2) on fd().
+//
+// This class does no allocation and is usable in nolibc.
+class InstructionBudget {
+ public:
+  InstructionBudget() = default;
+
+  // Not copyable or movable, owns a file descriptor.
+  InstructionBudget(const InstructionBudget&) = delete;
+  InstructionBudget& operator=(const InstructionBudget&) = delete;
+
+  // Opens a pinned counter of the `config` event that overflows every
+  // `budget` events. Logs an error and returns false on failure, after which
+  // nothing is open. Only supported on x86-64.
+  // REQUIRES: Nothing is open and budget > 0.
+  bool Open(const PerfCounterConfig& config, uint64_t budget);
+
+  bool is_open() const { return fd_ != -1; }
+
+  // The counter file descriptor or -1 if nothing is open.
+  int fd() const { return fd_; }
+
+  // Restarts the budget from zero.
+  // REQUIRES: is_open().
+  void Rearm() const;
+
+ private:
+  int fd_ = -1;
+  uint64_t budget_ = 0;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_RUNNER_PERF_COUNTERS_H_
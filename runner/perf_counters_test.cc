@@ -0,0 +1,105 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./runner/perf_counters.h"
+
+#include <linux/perf_event.h>
+#include <signal.h>
+
+#include <cstdint>
+
+#include "./util/checks.h"
+#include "./util/nolibc_gunit.h"
+#include "third_party/lss/lss/linux_syscall_support.h"
+
+namespace silifuzz {
+namespace {
+
+TEST(PerfCounters, ParseConfigs) {
+  PerfCounterConfig configs[kMaxPerfCounters];
+  CHECK_EQ(ParsePerfCounterConfigs("", configs), 0);
+  CHECK_EQ(ParsePerfCounterConfigs("0:1,4:0x1c2", configs), 2);
+  CHECK_EQ(configs[0].type, PERF_TYPE_HARDWARE);
+  CHECK_EQ(configs[0].config, PERF_COUNT_HW_INSTRUCTIONS);
+  CHECK_EQ(configs[1].type, PERF_TYPE_RAW);
+  CHECK_EQ(configs[1].config, 0x1c2);
+
+  CHECK_EQ(ParsePerfCounterConfigs("0", configs), -1);
+  CHECK_EQ(ParsePerfCounterConfigs("0:", configs), -1);
+  CHECK_EQ(ParsePerfCounterConfigs("x:1", configs), -1);
+  CHECK_EQ(ParsePerfCounterConfigs("0:1,,0:0", configs), -1);
+  CHECK_EQ(ParsePerfCounterConfigs("0:0,0:0,0:0,0:0,0:0,0:0,0:0,0:0,0:0",
+                                   configs),
+           -1);
+}
+
+TEST(PerfCounters, Read) {
+  PerfCounters counters;
+  const PerfCounterConfig config = {.type = PERF_TYPE_HARDWARE,
+                                    .config = PERF_COUNT_HW_INSTRUCTIONS};
+  if (!counters.Open(&config, 1)) {
+    // No PMU access, e.g. in a VM or with perf_event_paranoid > 2.
+    return;
+  }
+  CHECK_EQ(counters.size(), 1);
+  uint64_t before[kMaxPerfCounters], after[kMaxPerfCounters];
+  if (!counters.Read(before)) {
+    // rdpmc is not allowed.
+    return;
+  }
+  for (int i = 0; i < 1000; ++i) {
+    // Keeps the compiler from removing the loop.
+    asm volatile("" ::: "memory");
+  }
+  CHECK(counters.Read(after));
+  CHECK_GT(after[0], before[0]);
+}
+
+TEST(PerfCounters, InstructionBudget) {
+  // Block the signal so that the overflow is left pending instead of
+  // terminating the test.
+  kernel_sigset_t mask, old_mask, pending;
+  sys_sigemptyset(&mask);
+  sys_sigaddset(&mask, kInstructionBudgetSignal);
+  CHECK_EQ(sys_sigprocmask(SIG_BLOCK, &mask, &old_mask), 0);
+
+  InstructionBudget budget;
+  if (!budget.Open(kRetiredInstructions, 10000)) {
+    // No PMU access.
+    CHECK_EQ(sys_sigprocmask(SIG_SETMASK, &old_mask, nullptr), 0);
+    return;
+  }
+  CHECK(budget.is_open());
+  budget.Rearm();
+  for (int i = 0; i < 1000000; ++i) {
+    asm volatile("" ::: "memory");
+  }
+  CHECK_EQ(sys_sigpending(&pending), 0);
+  CHECK(sys_sigismember(&pending, kInstructionBudgetSignal));
+
+  // Drain the pending signal before restoring the mask.
+  struct kernel_sigaction ignore = {};
+  ignore.sa_handler_ = SIG_IGN;
+  CHECK_EQ(sys_sigaction(kInstructionBudgetSignal, &ignore, nullptr), 0);
+  CHECK_EQ(sys_sigprocmask(SIG_SETMASK, &old_mask, nullptr), 0);
+}
+
+}  // namespace
+}  // namespace silifuzz
+
+NOLIBC_TEST_MAIN({
+  RUN_TEST(PerfCounters, ParseConfigs);
+  RUN_TEST(PerfCounters, Read);
+  RUN_TEST(PerfCounters, InstructionBudget);
+})
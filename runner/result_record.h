@@ -0,0 +1,80 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef THIRD_PARTY_SILIFUZZ_RUNNER_RESULT_RECORD_H_
+#define THIRD_PARTY_SILIFUZZ_RUNNER_RESULT_RECORD_H_
+
+#include <cstdint>
+
+namespace silifuzz {
+
+// Binary layout of a snap execution result that the runner writes to the
+// file given by --result_fd instead of printing the end state to stdout as a
+// SnapshotExecutionResult text proto. RunnerDriver maps the file and builds
+// the end state directly from it.
+//
+// A record is a ResultRecordHeader followed by, in this order and without
+// padding:
+//   snapshot_id_size bytes of the snapshot id,
+//   gregs_size bytes of serialized GRegSet,
+//   fpregs_size bytes of serialized FPRegSet,
+//   register_checksum_size bytes of serialized register checksum,
+//   num_memory_bytes x (ResultRecordMemoryBytes, num_bytes of memory).
+// Records are appended one after another. A record whose `record_size`
+// exceeds the data available was cut short and must be ignored.
+//
+// Both sides are built from the same tree, so the layout is not versioned
+// beyond kResultRecordMagic.
+
+// "SFRESULT" in little endian.
+inline constexpr uint64_t kResultRecordMagic = 0x544c555345524653ULL;
+
+// Values of ResultRecordHeader::endpoint_type.
+inline constexpr uint32_t kResultRecordNoEndpoint = 0;
+inline constexpr uint32_t kResultRecordInstructionEndpoint = 1;
+inline constexpr uint32_t kResultRecordSignalEndpoint = 2;
+
+struct ResultRecordHeader {
+  uint64_t magic;
+  // Size of the record including this header.
+  uint64_t record_size;
+  // RunSnapOutcome, same values as proto.PlayerResult.Outcome.
+  int32_t outcome;
+  int32_t cpu_id;
+  // One of kResultRecord*Endpoint.
+  uint32_t endpoint_type;
+  // Endpoint::SigNum and Endpoint::SigCause of a signal endpoint.
+  int32_t sig_num;
+  int32_t sig_cause;
+  uint32_t snapshot_id_size;
+  // Instruction address for an instruction endpoint or
+  // sig_instruction_address for a signal endpoint.
+  uint64_t instruction_address;
+  uint64_t sig_address;
+  uint32_t gregs_size;
+  uint32_t fpregs_size;
+  uint32_t register_checksum_size;
+  uint32_t num_memory_bytes;
+};
+static_assert(sizeof(ResultRecordHeader) == 72, "Layout must have no padding");
+
+struct ResultRecordMemoryBytes {
+  uint64_t start_address;
+  uint64_t num_bytes;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_RUNNER_RESULT_RECORD_H_
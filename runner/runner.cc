@@ -16,7 +16,9 @@
 
 #include <signal.h>
 #include <sys/mman.h>
+#include <sys/prctl.h>
 #include <sys/resource.h>
+#include <sys/time.h>
 #include <ucontext.h>
 #include <unistd.h>
 
@@ -31,17 +33,25 @@
 #include "third_party/lss/lss/linux_syscall_support.h"
 #include "./common/snapshot_enums.h"
 #include "./runner/endspot.h"
+#include "./runner/memory_restore_tracker.h"
+#include "./runner/perf_counters.h"
+#include "./runner/result_record.h"
 #include "./runner/runner_main_options.h"
 #include "./runner/runner_util.h"
 #include "./runner/snap_runner_util.h"
 #include "./snap/exit_sequence.h"
 #include "./snap/snap.h"
 #include "./snap/snap_checksum.h"
+#include "./snap/snap_relocator.h"
+#include "./util/alias_table.h"
 #include "./util/arch.h"
+#include "./util/atoi.h"
+#include "./util/byte_io.h"
 #include "./util/checks.h"
 #include "./util/cpu_id.h"
 #include "./util/itoa.h"
 #include "./util/logging_util.h"
+#include "./util/lz4_block.h"
 #include "./util/mem_util.h"
 #include "./util/misc_util.h"
 #include "./util/page_util.h"
@@ -50,7 +60,9 @@
 #include "./util/reg_group_io.h"
 #include "./util/reg_group_set.h"
 #include "./util/reg_groups.h"
+#include "./util/strcat.h"
 #include "./util/text_proto_printer.h"
+#include "./util/timestamp_counter.h"
 #include "./util/ucontext/serialize.h"
 
 // Snap runner binary.
@@ -60,6 +72,24 @@
 //            text proto. In "run" mode this happens for the first failed snap,
 //            in "make" mode the proto is always printed. This is intended to
 //            be machine-readable.
+//            With --result_fd, the end state of the failed snap is written to
+//            that file descriptor as a binary record (see result_record.h)
+//            instead, and only the fields outside of it go to stdout.
+//            With --collect_snap_latency, snap_latency_histograms fields of
+//            the same proto are printed when the runner finishes.
+//            With --report_startup_timings, runner_startup_timings of the
+//            same proto is printed before the first snap is played.
+//            With --perf_counters, perf_counter_values of the same proto are
+//            printed when the runner finishes.
+//            With --max_failures greater than 1, each failed snap is
+//            reported as above followed by a kFailureEndMarker line.
+//            In "persistent" mode the output of each command is terminated by
+//            a kPersistentModeEndMarker line carrying the command's exit code.
+//            Records written to --result_fd are appended at the current file
+//            offset, which the parent may rewind between commands.
+//  stdin:    closed except in "persistent" mode, where each line is a command
+//            "<num_iterations> <seed>", and in "zygote" mode, where each line
+//            is a request to fork a runner (see ZygoteMain() in runner.h).
 //  stderr:   human-readable log messages. The verbosity is controlled by --v
 //            with the following levels.
 //             0: Quiet (default).
@@ -87,6 +117,9 @@
 //             The process will exit immediately with exit code 2 when this
 //             signal is received.
 //
+//    SIGIO:   with --snap_instruction_budget, the current snap exceeded its
+//             instruction budget and is a runaway. Ignored outside of snaps.
+//
 // This process can terminate with the following signals:
 //    SIGKILL: the process was limited by setrlimit(2) and exceeded its
 //             hard CPU bugdet or another process or the operating system
@@ -130,10 +163,38 @@ uint64_t added_page_addresses[kMaxAddedPageAddresses];
 
 constexpr int kInitialMappingProtection = PROT_READ | PROT_WRITE;
 
+// Added to the mmap(2) flags of snap memory mappings. MAP_LOCKED when
+// RunnerMainOptions::lock_snap_mappings is set.
+int snap_mapping_extra_flags = 0;
+
+// Bytes of snap memory mappings populated by PrefaultSnapMappings() or locked
+// by MAP_LOCKED, and the number of mappings where that failed.
+struct SnapMappingStats {
+  uint64_t prefaulted_bytes = 0;
+  uint64_t locked_bytes = 0;
+  uint64_t num_failures = 0;
+};
+SnapMappingStats snap_mapping_stats;
+
+// PlatformId value of the host, see RunnerMainOptions::platform_id. Selects
+// the expected end state of snaps with platform end states.
+int host_platform_id = 0;
+
+// Open iff RunnerMainOptions::snap_instruction_budget is set and the counter
+// is available. Rearmed before each snap, see ArmSnapInstructionBudget().
+InstructionBudget snap_instruction_budget;
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+
 // Attempts to recover from a SEGV fault due to missing mapping.
 // Returns true iff the fault is recoverable by adding a new mapping.
 bool TryToRecoverFromSignal(int signal, const siginfo_t* siginfo) {
-  if (signal != SIGSEGV && siginfo->si_code != SEGV_MAPERR) return false;
+  if (signal != SIGSEGV || siginfo->si_code != SEGV_MAPERR) return false;
 
   // Check to see if we have reached the max number of mapped data pages.
   size_t real_max_pages_to_add =
@@ -167,12 +228,16 @@ bool TryToRecoverFromSignal(int signal, const siginfo_t* siginfo) {
   return true;
 }
 
+// Defined below with the rest of the snap latency histogram code.
+void LogAndClearSnapLatencyHistograms();
+
 // The signal handler for the duration of the corpus execution.
 // NOTE: even though this handler is installed for SIGSYS it will be
 // ignored. See file-level comment.
 void SigAction(int signal, siginfo_t* siginfo, void* uc) {
   // SIGALRM signals deadline from the orchestrator. Exit immediately.
   if (signal == SIGALRM) {
+    LogAndClearSnapLatencyHistograms();
     _exit(2);
   }
   if (IsInsideSnap()) {
@@ -190,11 +255,17 @@ void SigAction(int signal, siginfo_t* siginfo, void* uc) {
     RunnerReentryFromSignal(*static_cast<const ucontext_t*>(uc), *siginfo);
     __builtin_unreachable();
   }
+  // The instruction budget also runs out in the runner's own code between
+  // snaps when that is longer than the budget.
+  if (signal == kInstructionBudgetSignal && snap_instruction_budget.is_open()) {
+    return;
+  }
   // A signal was not caused by any snapshot. If it is one of the
   // timeout signals we _exit(2). Otherwise crash.
   ASS_LOG_INFO("Received signal ", IntStr(signal),
                " while outside of snap. Exiting");
   if (signal == SIGXCPU) {
+    LogAndClearSnapLatencyHistograms();
     _exit(2);
   }
   // A signal occurred while executing the runner code. Most likely indicates
@@ -203,13 +274,47 @@ void SigAction(int signal, siginfo_t* siginfo, void* uc) {
   __builtin_unreachable();
 }
 
-// Returns true iff current memory contents match memory byte data.
-bool VerifyMemoryBytes(const SnapMemoryBytes& memory_bytes) {
+// Returns zero iff current memory contents match memory byte data.
+// See MemDiff() for details.
+uint64_t MemoryBytesDiff(const SnapMemoryBytes& memory_bytes) {
   const void* address = AsPtr(memory_bytes.start_address);
   const size_t size = memory_bytes.size();
   return memory_bytes.repeating()
-             ? MemAllEqualTo(address, memory_bytes.data.byte_run.value, size)
-             : MemEq(address, memory_bytes.data.byte_values.elements, size);
+             ? MemDiffFromByte(address, memory_bytes.data.byte_run.value, size)
+             : MemDiff(address, memory_bytes.data.byte_values.elements, size);
+}
+
+// Returns true iff current memory contents match memory byte data.
+bool VerifyMemoryBytes(const SnapMemoryBytes& memory_bytes) {
+  return MemoryBytesDiff(memory_bytes) == 0;
+}
+
+// Returns zero iff the current writable memory of `snap` matches
+// `end_state`. In a single pass over the writable mappings, compares the
+// end-state memory bytes and checksums the bytes between them, which must be
+// unchanged. See Snap::end_state_unchanged_memory_checksum.
+// REQUIRES: the end-state memory bytes and the memory mappings of `snap` are
+// sorted by address.
+uint64_t EndStateMemoryDiff(const Snap<Host>& snap,
+                            const SnapEndState<Host>& end_state) {
+  uint64_t diff = 0;
+  MemoryChecksumCalculator unchanged;
+  size_t i = 0;
+  for (const auto& memory_mapping : snap.memory_mappings) {
+    if (!memory_mapping.writable()) continue;
+    uint64_t address = memory_mapping.start_address;
+    const uint64_t limit = address + memory_mapping.num_bytes;
+    for (; i < end_state.memory_bytes.size &&
+           end_state.memory_bytes[i].start_address < limit;
+         ++i) {
+      const SnapMemoryBytes& memory_bytes = end_state.memory_bytes[i];
+      unchanged.AddData(AsPtr(address), memory_bytes.start_address - address);
+      diff |= MemoryBytesDiff(memory_bytes);
+      address = memory_bytes.start_address + memory_bytes.size();
+    }
+    unchanged.AddData(AsPtr(address), limit - address);
+  }
+  return diff | (unchanged.Checksum() ^ end_state.unchanged_memory_checksum);
 }
 
 // Copies memory bytes from Snap to runtime address.
@@ -218,6 +323,14 @@ void SetupMemoryBytes(const SnapMemoryBytes& memory_bytes) {
   if (memory_bytes.repeating()) {
     MemSet(target_address, memory_bytes.data.byte_run.value,
            memory_bytes.size());
+  } else if (memory_bytes.compressed()) {
+    if (!Lz4BlockDecompress(memory_bytes.data.byte_values.elements,
+                            memory_bytes.compressed_size,
+                            static_cast<uint8_t*>(target_address),
+                            memory_bytes.size())) {
+      LOG_FATAL("Corrupt compressed memory bytes at ",
+                HexStr(memory_bytes.start_address));
+    }
   } else {
     MemCopy(target_address, memory_bytes.data.byte_values.elements,
             memory_bytes.size());
@@ -247,8 +360,8 @@ bool CanDirectMap(const SnapMemoryMapping& memory_mapping) {
     return false;
   }
   const SnapMemoryBytes& memory_bytes = memory_mapping.memory_bytes[0];
-  // The bytes must be uncompressed.
-  if (memory_bytes.repeating()) {
+  // The bytes must be stored as is.
+  if (memory_bytes.repeating() || memory_bytes.compressed()) {
     return false;
   }
   // The bytes must cover the mapping completely.
@@ -264,16 +377,42 @@ SeccompOptions SeccompOptionsFromRunnerMainOptions(
     const RunnerMainOptions& options) {
   SeccompOptions seccomp_options;
   seccomp_options.allow_kill = options.enable_tracer;
+  seccomp_options.allow_ioctl_fd = snap_instruction_budget.fd();
   if (options.max_pages_to_add > 0) {
     seccomp_options.allow_mmap = true;
     seccomp_options.allow_rt_sigreturn = true;
   }
+  if (options.lazy_map_snaps) {
+    seccomp_options.allow_mmap = true;
+    seccomp_options.allow_munmap = true;
+    seccomp_options.allow_mprotect = true;
+  }
   return seccomp_options;
 }
 
+// Returns `size` bytes of zero-filled memory. The runner cannot do dynamic
+// allocation, so this is used for per-snap state allocated once before
+// entering the seccomp sandbox.
+void* AllocatePerSnapState(size_t size) {
+  void* state = mmap(nullptr, RoundUpToPageAlignment(size),
+                     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (state == MAP_FAILED) {
+    LOG_FATAL("mmap() failed: ", ErrnoStr(errno));
+  }
+  RecordRunnerMmap(AsInt(state), AsInt(state) + RoundUpToPageAlignment(size),
+                   "[per-snap state]");
+  return state;
+}
+
 }  // namespace
 
+// Does nothing after the first call, so children of a zygote inherit the
+// handlers instead of reinstalling them.
 void InstallSigHandler() {
+  static bool installed = false;
+  if (installed) return;
+  installed = true;
+
   struct kernel_sigaction action = {};  // zero-initialized.
   action.sa_sigaction_ = SigAction;
 
@@ -320,8 +459,55 @@ void InstallSigHandler() {
   }
 }
 
+namespace {
+
+// Like mmap(2) but adds snap_mapping_extra_flags. Falls back to the plain
+// `flags` if the mapping cannot be locked, e.g. due to RLIMIT_MEMLOCK.
+void* MmapSnapMapping(void* addr, size_t length, int prot, int flags, int fd,
+                      off_t offset) {
+  if (snap_mapping_extra_flags != 0) {
+    void* mapped_address = mmap(addr, length, prot,
+                                flags | snap_mapping_extra_flags, fd, offset);
+    if (mapped_address != MAP_FAILED) {
+      snap_mapping_stats.locked_bytes += length;
+      return mapped_address;
+    }
+    VLOG_INFO(1, "Cannot lock mapping ", HexStr(AsInt(addr)), ": ",
+              ErrnoStr(errno));
+    ++snap_mapping_stats.num_failures;
+  }
+  return mmap(addr, length, prot, flags, fd, offset);
+}
+
+// Final protection of adjacent anonymous snap memory mappings that is not
+// applied yet. Mappings are created with kInitialMappingProtection so that
+// their contents can be set up. Deferring the mprotect(2) lets adjacent
+// mappings with equal permissions share one call. On aarch64 the kernel
+// also cleans the data cache and invalidates the instruction cache for
+// executable pages, which is then done in one pass over the whole range.
+struct PendingProtection {
+  uint64_t start_address = 0;
+  uint64_t num_bytes = 0;
+  int perms = kInitialMappingProtection;
+};
+
+// Applies `pending` and resets it.
+void ApplyPendingProtection(PendingProtection& pending) {
+  if (pending.num_bytes == 0) return;
+  VLOG_INFO(2, "mprotect mapping ", HexStr(pending.start_address));
+  void* target_address = AsPtr(pending.start_address);
+  if (mprotect(target_address, pending.num_bytes, pending.perms) != 0) {
+    LOG_FATAL("mprotect(", HexStr(pending.start_address),
+              ") failed: ", ErrnoStr(errno));
+  }
+  pending = PendingProtection{};
+}
+
+// Creates `memory_mapping`. The final protection of an anonymous mapping may
+// be left in `pending`, to be applied by ApplyPendingProtection().
 void CreateMemoryMapping(const SnapMemoryMapping& memory_mapping, int corpus_fd,
-                         const void* corpus_mapping) {
+                         const void* corpus_mapping,
+                         PendingProtection& pending) {
   const uint64_t start_address = memory_mapping.start_address;
   VLOG_INFO(2, "Mapping ", HexStr(start_address));
 
@@ -337,16 +523,16 @@ void CreateMemoryMapping(const SnapMemoryMapping& memory_mapping, int corpus_fd,
     CHECK(IsPageAligned(offset));
 
     // Map.
-    void* mapped_address =
-        mmap(target_address, memory_mapping.num_bytes, memory_mapping.perms,
-             MAP_SHARED | MAP_FIXED, corpus_fd, offset);
+    void* mapped_address = MmapSnapMapping(
+        target_address, memory_mapping.num_bytes, memory_mapping.perms,
+        MAP_SHARED | MAP_FIXED, corpus_fd, offset);
     CheckFixedMmapOK(mapped_address, target_address);
   } else {
     // The data cannot be direct mapped.
 
-    void* mapped_address = mmap(target_address, memory_mapping.num_bytes,
-                                kInitialMappingProtection,
-                                MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    void* mapped_address = MmapSnapMapping(
+        target_address, memory_mapping.num_bytes, kInitialMappingProtection,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
     CheckFixedMmapOK(mapped_address, target_address);
 
     // Initialize the contents of the mapping.
@@ -360,24 +546,35 @@ void CreateMemoryMapping(const SnapMemoryMapping& memory_mapping, int corpus_fd,
 
     // Set the final protections.
     if (memory_mapping.perms != kInitialMappingProtection) {
-      VLOG_INFO(2, "mprotect mapping ", HexStr(start_address));
-      // mprotect should sync the data cache and invalidate the instruction
-      // cache as needed. No need to do it explicitly.
-      int mprotect_result = mprotect(target_address, memory_mapping.num_bytes,
-                                     memory_mapping.perms);
-      if (mprotect_result != 0) {
-        LOG_FATAL("mprotect(", HexStr(AsInt(target_address)),
-                  ") failed: ", ErrnoStr(errno));
+      if (pending.num_bytes > 0 &&
+          (pending.start_address + pending.num_bytes != start_address ||
+           pending.perms != memory_mapping.perms)) {
+        ApplyPendingProtection(pending);
       }
+      if (pending.num_bytes == 0) {
+        pending.start_address = start_address;
+        pending.perms = memory_mapping.perms;
+      }
+      pending.num_bytes += memory_mapping.num_bytes;
     }
   }
 }
 
-void MapSnap(const Snap<Host>& snap, int corpus_fd,
-             const void* corpus_mapping) {
-  for (const auto& memory_mapping : snap.memory_mappings) {
-    CreateMemoryMapping(memory_mapping, corpus_fd, corpus_mapping);
+}  // namespace
+
+// Creates the memory mappings of `snap`. If `premapped` is not null,
+// mapping i of the snap is skipped if premapped[i] is true.
+void MapSnap(const Snap<Host>& snap, int corpus_fd, const void* corpus_mapping,
+             const bool* premapped = nullptr) {
+  // Mappings of a snap do not overlap, so protections can be deferred until
+  // all of them exist. Mappings of different snaps may overlap.
+  PendingProtection pending;
+  for (size_t i = 0; i < snap.memory_mappings.size; ++i) {
+    if (premapped != nullptr && premapped[i]) continue;
+    CreateMemoryMapping(snap.memory_mappings[i], corpus_fd, corpus_mapping,
+                        pending);
   }
+  ApplyPendingProtection(pending);
 }
 
 // ApplyProcMapsFixups manipulates this process' memory mappings. Resizes the
@@ -399,6 +596,8 @@ void ApplyProcMapsFixups(ProcMapsEntry proc_maps_entries[],
                 HexStr(e->limit_address - orig_start_addr), " new size is ",
                 HexStr(e->limit_address - e->start_address));
     }
+    // The entries are kept in the runner memory layout so that snaps
+    // stay away from these ranges.
     if (strcmp(e->name, "[vdso]") == 0 || strcmp(e->name, "[vvar]") == 0) {
       CHECK_EQ(
           munmap(AsPtr(e->start_address), e->limit_address - e->start_address),
@@ -408,21 +607,61 @@ void ApplyProcMapsFixups(ProcMapsEntry proc_maps_entries[],
   }
 }
 
-// MapCorpus establishes memory mappings for all snaps in 'corpus'. If a
-// snap uses a memory mapping that conflicts with the runner itself (binary,
-// stack, heap and VDSO), it can crash the runner. Therefore, it performs
-// range checks before adding memory mappings into the runners address
-// space and dies if a conflict is detected.
-void MapCorpus(const SnapCorpus<Host>& corpus, int corpus_fd,
-               const void* corpus_mapping) {
+namespace {
+
+// Sets `result` to `corpus` without the snaps at indices i with excluded[i]
+// set. 'corpus' itself is read-only, so `result` gets its own compact arrays
+// of snap pointers and hot entries.
+void ExcludeSnaps(const SnapCorpus<Host>& corpus, const bool* excluded,
+                  SnapCorpus<Host>& result) {
+  const size_t num_snaps = corpus.snaps.size;
+  const Snap<Host>** snaps = static_cast<const Snap<Host>**>(
+      AllocatePerSnapState(num_snaps * sizeof(*snaps)));
+  const bool has_hot_entries = corpus.hot_entries.size == num_snaps;
+  SnapHotEntry<Host>* hot_entries =
+      has_hot_entries ? static_cast<SnapHotEntry<Host>*>(AllocatePerSnapState(
+                            num_snaps * sizeof(*hot_entries)))
+                      : nullptr;
+  size_t num_remaining = 0;
+  for (size_t i = 0; i < num_snaps; ++i) {
+    if (excluded[i]) continue;
+    snaps[num_remaining] = corpus.snaps[i];
+    if (has_hot_entries) {
+      hot_entries[num_remaining] = corpus.hot_entries[i];
+    }
+    ++num_remaining;
+  }
+
+  memcpy(&result, &corpus, sizeof(result));
+  result.snaps.size = num_remaining;
+  result.snaps.elements = snaps;
+  // The lookup indices refer to the original snaps[].
+  result.id_index = {};
+  result.code_index = {};
+  result.hot_entries = {};
+  if (has_hot_entries) {
+    result.hot_entries.size = num_remaining;
+    result.hot_entries.elements = hot_entries;
+  }
+}
+
+}  // namespace
+
+// If a snap uses a memory mapping that conflicts with the runner itself
+// (binary, stack, heap and VDSO), it can crash the runner. Therefore,
+// ExcludeConflictingSnaps() performs range checks on all snaps in 'corpus'
+// before any memory mappings are added into the runner's address space.
+// Conflicting snaps are skipped and their IDs are reported on stdout as
+// proto.SnapshotExecutionResult.skipped_snapshot_ids. Returns 'corpus' if
+// there is no conflict. Otherwise returns a corpus of the remaining snaps,
+// see ExcludeSnaps().
+const SnapCorpus<Host>* ExcludeConflictingSnaps(
+    const SnapCorpus<Host>& corpus) {
   CHECK(corpus.IsExpectedArch());
 
-  // On x86_64, we should only need 8 entries to describe all memory ranges when
-  // running a fully static runner. 20 is more than enough to avoid overflow.
-  constexpr size_t kMaxProcMapsEntries = 20;
-  ProcMapsEntry proc_maps_entries[kMaxProcMapsEntries];
-  const size_t num_proc_maps_entries =
-      ReadProcMapsEntries(proc_maps_entries, kMaxProcMapsEntries);
+  size_t num_proc_maps_entries;
+  ProcMapsEntry* proc_maps_entries =
+      GetRunnerProcMapsEntries(&num_proc_maps_entries);
 
   if (VLOG_IS_ON(1)) {
     for (size_t i = 0; i < num_proc_maps_entries; ++i) {
@@ -433,32 +672,246 @@ void MapCorpus(const SnapCorpus<Host>& corpus, int corpus_fd,
   }
   ApplyProcMapsFixups(proc_maps_entries, num_proc_maps_entries);
 
-  VLOG_INFO(1, "Creating memory mappings");
+  bool* conflicting = nullptr;
+  for (size_t i = 0; i < corpus.snaps.size; ++i) {
+    const Snap<Host>* snap = corpus.snaps[i];
+    if (!SnapOverlapsWithProcMapsEntries(*snap, proc_maps_entries,
+                                         num_proc_maps_entries)) {
+      continue;
+    }
+    if (conflicting == nullptr) {
+      conflicting = static_cast<bool*>(
+          AllocatePerSnapState(corpus.snaps.size * sizeof(*conflicting)));
+    }
+    conflicting[i] = true;
+    LOG_ERROR("Skipping snap ", snap->id);
+    TextProtoPrinter snapshot_execution_result;
+    snapshot_execution_result.String("skipped_snapshot_ids", snap->id);
+    LogToStdout(snapshot_execution_result.c_str());
+  }
+  if (conflicting == nullptr) {
+    return &corpus;
+  }
+
+  static SnapCorpus<Host> active_corpus = {};
+  ExcludeSnaps(corpus, conflicting, active_corpus);
+  return &active_corpus;
+}
+
+// Returns 'corpus' without snaps whose IDs are listed in 'tombstones', an
+// array of 'num_tombstones' IDs. Like ExcludeConflictingSnaps(), returns
+// 'corpus' itself if no snap is excluded.
+const SnapCorpus<Host>* ExcludeTombstonedSnaps(const SnapCorpus<Host>& corpus,
+                                               const char* const* tombstones,
+                                               size_t num_tombstones) {
+  if (num_tombstones == 0) {
+    return &corpus;
+  }
+  bool* tombstoned = static_cast<bool*>(
+      AllocatePerSnapState(corpus.snaps.size * sizeof(*tombstoned)));
+  size_t num_tombstoned = 0;
+  for (size_t i = 0; i < num_tombstones; ++i) {
+    const size_t index = corpus.FindIndex(tombstones[i]);
+    if (index < corpus.snaps.size && !tombstoned[index]) {
+      tombstoned[index] = true;
+      ++num_tombstoned;
+    }
+  }
+  LOG_INFO("Excluding ", IntStr(num_tombstoned), " tombstoned snaps");
+  if (num_tombstoned == 0) {
+    return &corpus;
+  }
+
+  static SnapCorpus<Host> live_corpus = {};
+  ExcludeSnaps(corpus, tombstoned, live_corpus);
+  return &live_corpus;
+}
+
+namespace {
+
+// A snap memory mapping considered for merging by MergeCorpusMappings().
+struct MergeCandidate {
+  uint64_t start_address;
+  uint64_t limit_address;
+  const SnapMemoryMapping* memory_mapping;
+  // Index of the mapping in the corpus-wide mapping order.
+  size_t order;
+  bool direct;
+};
+
+// Creates merged memory mappings for groups of overlapping or adjacent
+// anonymous mappings of different snaps in `corpus`. Most snaps map their
+// stacks at the same addresses, so mapping the group once replaces many
+// mmap(2) calls that would each replace the previous mapping.
+//
+// A group is merged only if all its mappings are anonymous, i.e. not mapped
+// directly from `corpus_fd`, and have the same permissions. Overlapping
+// read-only contents are set up in corpus order so that later snaps win as
+// with separate mappings. Groups are maximal, so the merged mappings do not
+// overlap any other mapping and can be created before all others.
+//
+// `candidates` has room for all mappings of the corpus. Sets premapped[i]
+// for the i-th mapping of the corpus if it was merged.
+void MergeCorpusMappings(const SnapCorpus<Host>& corpus, int corpus_fd,
+                         MergeCandidate* candidates, bool* premapped) {
+  size_t num_candidates = 0;
   for (const auto& snap : corpus.snaps) {
-    // TODO(dougkwan): [impl] Make this fail more gracefully. We can skip
-    // conflicting snaps. To do that we need space to store the passing
-    // snaps. One possible way to do that without additional memory
-    // allocation at runtime is to make 'corpus' writable and remove
-    // conflicting snaps found here.
-    if (SnapOverlapsWithProcMapsEntries(*snap, proc_maps_entries,
-                                        num_proc_maps_entries)) {
-      LOG_FATAL("Cannot handle overlapping mappings");
+    for (const auto& memory_mapping : snap->memory_mappings) {
+      candidates[num_candidates] = {
+          .start_address = memory_mapping.start_address,
+          .limit_address =
+              memory_mapping.start_address + memory_mapping.num_bytes,
+          .memory_mapping = &memory_mapping,
+          .order = num_candidates,
+          .direct = corpus_fd != -1 && CanDirectMap(memory_mapping),
+      };
+      ++num_candidates;
+    }
+  }
+  std::sort(candidates, candidates + num_candidates,
+            [](const MergeCandidate& a, const MergeCandidate& b) {
+              return a.start_address < b.start_address;
+            });
+
+  size_t num_merged_mappings = 0, num_merged_groups = 0;
+  size_t group_begin = 0;
+  while (group_begin < num_candidates) {
+    const int perms = candidates[group_begin].memory_mapping->perms;
+    uint64_t group_limit = candidates[group_begin].limit_address;
+    bool mergeable = !candidates[group_begin].direct;
+    size_t group_end = group_begin + 1;
+    for (; group_end < num_candidates &&
+           candidates[group_end].start_address <= group_limit;
+         ++group_end) {
+      const MergeCandidate& candidate = candidates[group_end];
+      group_limit = std::max(group_limit, candidate.limit_address);
+      mergeable = mergeable && !candidate.direct &&
+                  candidate.memory_mapping->perms == perms;
+    }
+    if (!mergeable || group_end - group_begin < 2) {
+      group_begin = group_end;
+      continue;
+    }
+
+    const uint64_t group_start = candidates[group_begin].start_address;
+    void* target_address = AsPtr(group_start);
+    void* mapped_address = MmapSnapMapping(
+        target_address, group_limit - group_start, kInitialMappingProtection,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    CheckFixedMmapOK(mapped_address, target_address);
+    if ((perms & PROT_WRITE) == 0) {
+      // Writable mappings are initialized before each snap runs.
+      std::sort(candidates + group_begin, candidates + group_end,
+                [](const MergeCandidate& a, const MergeCandidate& b) {
+                  return a.order < b.order;
+                });
+      for (size_t i = group_begin; i < group_end; ++i) {
+        for (const auto& memory_bytes :
+             candidates[i].memory_mapping->memory_bytes) {
+          SetupMemoryBytes(memory_bytes);
+        }
+      }
     }
+    PendingProtection pending = {.start_address = group_start,
+                                 .num_bytes = group_limit - group_start,
+                                 .perms = perms};
+    if (perms != kInitialMappingProtection) {
+      ApplyPendingProtection(pending);
+    }
+    for (size_t i = group_begin; i < group_end; ++i) {
+      premapped[candidates[i].order] = true;
+    }
+    num_merged_mappings += group_end - group_begin;
+    ++num_merged_groups;
+    group_begin = group_end;
+  }
+  VLOG_INFO(1, "Merged ", IntStr(num_merged_mappings), " of ",
+            IntStr(num_candidates), " mappings into ",
+            IntStr(num_merged_groups), " mappings");
+}
+
+}  // namespace
+
+const SnapCorpus<Host>* MapCorpus(const SnapCorpus<Host>& corpus,
+                                  int corpus_fd, const void* corpus_mapping) {
+  // Allocate the scratch space of MergeCorpusMappings() before checking the
+  // snaps against the runner's memory so that snaps cannot map over it.
+  size_t num_mappings = 0;
+  for (const auto& snap : corpus.snaps) {
+    num_mappings += snap->memory_mappings.size;
+  }
+  const size_t candidates_size = num_mappings * sizeof(MergeCandidate);
+  const size_t premapped_size = num_mappings * sizeof(bool);
+  MergeCandidate* candidates = nullptr;
+  bool* premapped = nullptr;
+  if (num_mappings > 0) {
+    candidates =
+        static_cast<MergeCandidate*>(AllocatePerSnapState(candidates_size));
+    premapped = static_cast<bool*>(AllocatePerSnapState(premapped_size));
+  }
+
+  const SnapCorpus<Host>* active_corpus = ExcludeConflictingSnaps(corpus);
+
+  VLOG_INFO(1, "Creating memory mappings");
+  if (num_mappings > 0) {
+    MergeCorpusMappings(*active_corpus, corpus_fd, candidates, premapped);
+  }
+  size_t first_mapping = 0;
+  for (const auto& snap : active_corpus->snaps) {
     // If any of these memory mappings overlap, the mapping earlier in this list
     // will be silently overwritten by the mapping later in this list.
     // Currently, the corpus creator should avoid overlapping RO pages, but
     // there may be zero-initialized RW pages that overlap between snaps. The
     // most obvious case will be that most Snaps will have stacks mapped in
     // exactly the same location.
-    MapSnap(*snap, corpus_fd, corpus_mapping);
+    MapSnap(*snap, corpus_fd, corpus_mapping,
+            premapped != nullptr ? premapped + first_mapping : nullptr);
+    first_mapping += snap->memory_mappings.size;
   }
   VLOG_INFO(1, "Done creating memory mappings");
 
+  // The scratch space stays in the runner memory layout, which only makes
+  // later conflict checks more conservative.
+  if (num_mappings > 0) {
+    munmap(candidates, RoundUpToPageAlignment(candidates_size));
+    munmap(premapped, RoundUpToPageAlignment(premapped_size));
+  }
+
   if (corpus_fd != -1) {
     CHECK_EQ(close(corpus_fd), 0);
   }
+  return active_corpus;
 }
 
+namespace {
+
+// Populates the page tables for all memory mappings of snaps in `corpus` so
+// that the first execution of each snap does not take page faults. Writable
+// mappings are populated for writing since they are initialized before each
+// execution. Mappings locked with MAP_LOCKED are already populated.
+void PrefaultSnapMappings(const SnapCorpus<Host>& corpus) {
+  if (snap_mapping_extra_flags & MAP_LOCKED) {
+    return;
+  }
+  for (const auto& snap : corpus.snaps) {
+    for (const auto& memory_mapping : snap->memory_mappings) {
+      const int advice = memory_mapping.writable() ? MADV_POPULATE_WRITE
+                                                   : MADV_POPULATE_READ;
+      // Fails for inaccessible mappings and on kernels older than 5.14.
+      if (madvise(AsPtr(memory_mapping.start_address),
+                  memory_mapping.num_bytes, advice) != 0) {
+        VLOG_INFO(1, "Cannot prefault mapping ",
+                  HexStr(memory_mapping.start_address), ": ", ErrnoStr(errno));
+        ++snap_mapping_stats.num_failures;
+        continue;
+      }
+      snap_mapping_stats.prefaulted_bytes += memory_mapping.num_bytes;
+    }
+  }
+}
+
+}  // namespace
+
 bool VerifySnapChecksums(const Snap<Host>& snap) {
   bool ok = true;
   for (const SnapMemoryMapping& memory_mapping : snap.memory_mappings) {
@@ -499,6 +952,18 @@ bool VerifySnapChecksums(const Snap<Host>& snap) {
       ok = false;
     }
   }
+  for (const auto& end_state : snap.platform_end_states) {
+    VLOG_INFO(1, "Checksumming ", snap.id, " platform end state registers");
+    uint32_t expected = end_state.registers_memory_checksum;
+    uint32_t actual = CalculateMemoryChecksum(*end_state.registers);
+    if (expected != actual) {
+      LOG_ERROR(snap.id, " end state registers of platforms ",
+                HexStr(end_state.platforms));
+      LOG_ERROR("    Expected checksum ", HexStr(expected), " but got ",
+                HexStr(actual));
+      ok = false;
+    }
+  }
   return ok;
 }
 
@@ -515,29 +980,49 @@ void VerifyChecksums(const SnapCorpus<Host>& corpus) {
 RunSnapOutcome EndSpotToOutcome(const Snap<Host>& snap,
                                 const EndSpot& end_spot) {
   if (end_spot.signum != 0) {
-    if (end_spot.signum == SIGXCPU || end_spot.signum == SIGALRM) {
+    if (end_spot.signum == SIGXCPU || end_spot.signum == SIGALRM ||
+        (end_spot.signum == kInstructionBudgetSignal &&
+         snap_instruction_budget.is_open())) {
       return RunSnapOutcome::kExecutionRunaway;
     }
     return RunSnapOutcome::kExecutionMisbehave;
   }
+  const SnapEndState<Host> end_state = snap.EndStateFor(host_platform_id);
+  // Fast path: compare registers and all writable memory in a single pass
+  // and branch once. This is optimized for the common as-expected case. The
+  // mismatch, if any, is classified by the checks below.
+  const uint64_t diff =
+      MemDiffT(*end_spot.gregs, end_state.registers->gregs) |
+      MemDiffT(*end_spot.fpregs, end_state.registers->fpregs) |
+      EndStateMemoryDiff(snap, end_state);
+  if (diff == 0 &&
+      (end_state.register_checksum.register_groups.Empty() ||
+       end_state.register_checksum == end_spot.register_checksum)) {
+    return RunSnapOutcome::kAsExpected;
+  }
+
   // Verify register state.
-  if (!MemEqT(*end_spot.gregs, snap.end_state_registers->gregs) ||
-      !MemEqT(*end_spot.fpregs, snap.end_state_registers->fpregs)) {
+  if (!MemEqT(*end_spot.gregs, end_state.registers->gregs) ||
+      !MemEqT(*end_spot.fpregs, end_state.registers->fpregs)) {
     return RunSnapOutcome::kRegisterStateMismatch;
   }
   // Verify register checksum if there is one in snap.
-  if (!snap.end_state_register_checksum.register_groups.Empty() &&
-      snap.end_state_register_checksum != end_spot.register_checksum) {
+  if (!end_state.register_checksum.register_groups.Empty() &&
+      end_state.register_checksum != end_spot.register_checksum) {
     return RunSnapOutcome::kRegisterStateMismatch;
   }
 
   // Verify writable memory contents after execution.
-  for (const auto& memory_bytes : snap.end_state_memory_bytes) {
+  for (const auto& memory_bytes : end_state.memory_bytes) {
     if (!VerifyMemoryBytes(memory_bytes)) {
       VLOG_INFO(1, "Memory mismatch at ", HexStr(memory_bytes.start_address));
       return RunSnapOutcome::kMemoryMismatch;
     }
   }
+  if (EndStateMemoryDiff(snap, end_state) != 0) {
+    VLOG_INFO(1, "Unchanged memory checksum mismatch");
+    return RunSnapOutcome::kMemoryMismatch;
+  }
 
   return RunSnapOutcome::kAsExpected;
 }
@@ -554,6 +1039,643 @@ void PrepareSnapMemory(const Snap<Host>& snap) {
   }
 }
 
+namespace {
+
+// Incremental memory restore state, see memory_restore_tracker.h. Enabled by
+// InitIncrementalMemoryRestore().
+MemoryRestoreTracker memory_restore_tracker;
+
+// Allocates per-snap dirty states for a corpus of `num_snaps` snaps and
+// enables incremental memory restore.
+void InitIncrementalMemoryRestore(size_t num_snaps) {
+  using SnapState = MemoryRestoreTracker::SnapState;
+  // Anonymous mappings are zero-filled, so all states start as not learned.
+  memory_restore_tracker.Init(static_cast<SnapState*>(
+      AllocatePerSnapState(num_snaps * sizeof(SnapState))));
+}
+
+// Snap latency histograms:
+//
+// With options.collect_snap_latency, the runner measures each RunSnap() call
+// with the timestamp counter and keeps a log2-scale latency histogram per
+// snap. The histograms are printed to stdout as
+// proto.SnapshotExecutionResult.snap_latency_histograms when the runner
+// finishes, or after each command in persistent mode. This helps to find slow
+// snaps that drag down corpus throughput. The measurement includes the cost
+// of switching in and out of the snap.
+//
+// When a timeout signal stops the runner, SigAction() prints the histograms
+// before exiting. The output of the interrupted code may be cut short, so
+// RunnerDriver ignores output that does not parse at the end of stdout.
+
+constexpr size_t kNumLatencyBuckets = 32;
+
+struct SnapLatencyHistogram {
+  // See proto.SnapLatencyHistogram.bucket_counts.
+  uint32_t bucket_counts[kNumLatencyBuckets];
+};
+
+// Array of per-snap latency histograms indexed by snap index in the corpus,
+// or nullptr if latency collection is disabled.
+SnapLatencyHistogram* snap_latency_histograms = nullptr;
+
+// The corpus whose snaps `snap_latency_histograms` are for.
+const SnapCorpus<Host>* snap_latency_corpus = nullptr;
+
+// True while the histograms are being printed. A timeout signal arriving
+// then does not print them again.
+volatile bool logging_snap_latency_histograms = false;
+
+// Enables latency collection for the snaps in `corpus`.
+void InitSnapLatencyHistograms(const SnapCorpus<Host>& corpus) {
+  snap_latency_histograms = static_cast<SnapLatencyHistogram*>(
+      AllocatePerSnapState(corpus.snaps.size * sizeof(SnapLatencyHistogram)));
+  snap_latency_corpus = &corpus;
+}
+
+// Records an execution of the snap at `snap_index` that took `ticks`.
+//
+// REQUIRES: InitSnapLatencyHistograms() has been called.
+void RecordSnapLatency(size_t snap_index, uint64_t ticks) {
+  size_t bucket = ticks == 0 ? 0 : 63 - __builtin_clzll(ticks);
+  if (bucket >= kNumLatencyBuckets) {
+    bucket = kNumLatencyBuckets - 1;
+  }
+  ++snap_latency_histograms[snap_index].bucket_counts[bucket];
+}
+
+// Prints `histogram` of the snap with `snapshot_id` to stdout, if it is not
+// empty, and clears it. This avoids TextProtoPrinter, whose buffer does not
+// fit on the signal stack.
+void LogAndClearSnapLatencyHistogram(const char* snapshot_id,
+                                     SnapLatencyHistogram& histogram) {
+  size_t num_buckets = kNumLatencyBuckets;
+  while (num_buckets > 0 && histogram.bucket_counts[num_buckets - 1] == 0) {
+    --num_buckets;
+  }
+  if (num_buckets == 0) return;
+  // Snapshot ids need no escaping, see Snapshot::IsValidId().
+  LogToStdout("snap_latency_histograms:{ snapshot_id:'");
+  LogToStdout(snapshot_id);
+  // Room for "' ", a bucket_counts field of up to 32 bytes per bucket and
+  // "} ".
+  char fields[2 + kNumLatencyBuckets * 32 + 3];
+  size_t size = 0;
+  auto append = [&fields, &size](const char* str) {
+    while (*str != '\0') fields[size++] = *str++;
+  };
+  append("' ");
+  for (size_t i = 0; i < num_buckets; ++i) {
+    append("bucket_counts:");
+    append(IntStr(histogram.bucket_counts[i]));
+    append(" ");
+    histogram.bucket_counts[i] = 0;
+  }
+  append("} ");
+  fields[size] = '\0';
+  LogToStdout(fields);
+}
+
+// Prints non-empty latency histograms to stdout and clears them. This is a
+// no-op if latency collection is disabled or the histograms are already being
+// printed.
+void LogAndClearSnapLatencyHistograms() {
+  if (snap_latency_histograms == nullptr || logging_snap_latency_histograms) {
+    return;
+  }
+  logging_snap_latency_histograms = true;
+  const SnapCorpus<Host>& corpus = *snap_latency_corpus;
+  for (size_t i = 0; i < corpus.snaps.size; ++i) {
+    LogAndClearSnapLatencyHistogram(corpus.snaps[i]->id,
+                                    snap_latency_histograms[i]);
+  }
+  logging_snap_latency_histograms = false;
+}
+
+// PMU counters:
+//
+// With options.perf_counters, the runner counts the given PMU events in user
+// space while it plays random schedules. The counters are read with rdpmc at
+// the start and the end of each batch, which costs no syscalls and is
+// negligible compared to playing the batch. The totals are printed to
+// stdout as proto.SnapshotExecutionResult.perf_counter_values when the runner
+// finishes, or after each command in persistent mode. The counts include the
+// runner's own work between snaps.
+
+PerfCounters perf_counters;
+
+// Sums of the counter increments over the counted batches.
+uint64_t perf_counter_totals[kMaxPerfCounters];
+
+// Number of batches that could not be counted because a counter could not
+// be read in user space.
+uint64_t perf_counter_missed_batches = 0;
+
+// Adds the increments of `perf_counters` between construction and
+// destruction to `perf_counter_totals`.
+class CountedBatch {
+ public:
+  CountedBatch()
+      : started_(perf_counters.size() > 0 && perf_counters.Read(start_)) {}
+
+  ~CountedBatch() {
+    if (perf_counters.size() == 0) return;
+    uint64_t end[kMaxPerfCounters];
+    if (!started_ || !perf_counters.Read(end)) {
+      ++perf_counter_missed_batches;
+      return;
+    }
+    for (size_t i = 0; i < perf_counters.size(); ++i) {
+      perf_counter_totals[i] += end[i] - start_[i];
+    }
+  }
+
+ private:
+  uint64_t start_[kMaxPerfCounters];
+  bool started_;
+};
+
+// Prints the counter totals to stdout and clears them. This is a no-op if no
+// counters are open.
+void LogAndClearPerfCounters() {
+  if (perf_counters.size() == 0) return;
+  TextProtoPrinter snapshot_execution_result;
+  for (size_t i = 0; i < perf_counters.size(); ++i) {
+    snapshot_execution_result.Int("perf_counter_values",
+                                  perf_counter_totals[i]);
+    perf_counter_totals[i] = 0;
+  }
+  snapshot_execution_result.Int("perf_counter_missed_batches",
+                                perf_counter_missed_batches);
+  perf_counter_missed_batches = 0;
+  LogToStdout(snapshot_execution_result.c_str());
+}
+
+// Weighted scheduling:
+//
+// By default snaps in a batch are picked uniformly from the corpus, so the
+// share of time spent in a snap is proportional to its execution cost. With
+// options.weighted_schedule, snaps are picked with probability inversely
+// proportional to their cost so that each snap gets a more even share of the
+// runner's time.
+//
+// The corpus carries no costs, so the runner measures them. Every as-expected
+// execution adds its timestamp counter ticks, which include the snap's own
+// instructions and any loops in them, to a per-snap total. The sampler is
+// rebuilt from the mean measured latencies after 4 executions per snap on
+// average and then each time the number of executions doubles. Snaps that
+// have not run successfully yet get the mean latency of those that have.
+//
+// Until the first rebuild, the cost of a snap is estimated statically from
+// the bytes of memory the runner touches for it, i.e. writable memory restored
+// before and memory verified after an execution, plus a fixed per-execution
+// overhead. This estimate knows nothing about the time spent in the snap's
+// instructions.
+
+// Fixed overhead of a snap execution, in the same unit as memory bytes. This
+// covers context switching and register checks.
+constexpr uint64_t kFixedSnapCost = 4096;
+
+// Sampler of snap indices, initialized only if weighted scheduling is enabled.
+AliasTable weighted_snap_sampler;
+
+// Measured latency of a snap.
+struct MeasuredSnapCost {
+  // Sum of the latencies of as-expected executions, in timestamp counter
+  // ticks.
+  uint64_t total_ticks;
+  uint64_t num_executions;
+};
+
+// Storage of `weighted_snap_sampler` and its inputs, indexed by snap index.
+// Kept for rebuilding the sampler while snaps run in the sandbox.
+struct WeightedSnapSamplerState {
+  size_t num_snaps;
+  AliasTable::Entry* entries;
+  uint64_t* weights;
+  size_t* scratch;
+  MeasuredSnapCost* measured_costs;
+};
+WeightedSnapSamplerState weighted_snap_sampler_state;
+
+// Returns the estimated cost of executing `snap` once.
+uint64_t EstimateSnapCost(const Snap<Host>& snap) {
+  uint64_t cost = kFixedSnapCost;
+  for (const auto& memory_mapping : snap.memory_mappings) {
+    if (memory_mapping.writable()) {
+      for (const auto& memory_bytes : memory_mapping.memory_bytes) {
+        cost += memory_bytes.size();
+      }
+      // All writable memory is verified, either against end-state memory
+      // bytes or by checksumming the unchanged bytes.
+      cost += memory_mapping.num_bytes;
+    }
+  }
+  return cost;
+}
+
+// Same as above but from the hot metadata of a snap.
+uint64_t EstimateSnapCost(const SnapHotEntry<Host>& hot_entry) {
+  uint64_t cost = kFixedSnapCost + hot_entry.writable_num_bytes;
+  for (const auto& memory_bytes : hot_entry.writable_memory_bytes) {
+    cost += memory_bytes.size();
+  }
+  return cost;
+}
+
+// Returns the sampler weight of a snap with `cost`.
+uint64_t SnapWeight(uint64_t cost) {
+  const uint64_t weight = AliasTable::kMaxWeight / std::max<uint64_t>(cost, 1);
+  return std::max<uint64_t>(weight, 1);
+}
+
+// Enables weighted scheduling of snaps in `corpus` with estimated costs.
+void InitWeightedSnapSampler(const SnapCorpus<Host>& corpus) {
+  const size_t num_snaps = corpus.snaps.size;
+  CHECK_LE(num_snaps, AliasTable::kMaxSize);
+  WeightedSnapSamplerState& state = weighted_snap_sampler_state;
+  state.num_snaps = num_snaps;
+  state.entries = static_cast<AliasTable::Entry*>(
+      AllocatePerSnapState(num_snaps * sizeof(AliasTable::Entry)));
+  state.weights = static_cast<uint64_t*>(
+      AllocatePerSnapState(num_snaps * sizeof(uint64_t)));
+  state.scratch =
+      static_cast<size_t*>(AllocatePerSnapState(num_snaps * sizeof(size_t)));
+  // Zero-filled, so nothing is measured yet.
+  state.measured_costs = static_cast<MeasuredSnapCost*>(
+      AllocatePerSnapState(num_snaps * sizeof(MeasuredSnapCost)));
+  const bool has_hot_entries = corpus.hot_entries.size == num_snaps;
+  for (size_t i = 0; i < num_snaps; ++i) {
+    state.weights[i] = SnapWeight(has_hot_entries
+                                      ? EstimateSnapCost(corpus.hot_entries[i])
+                                      : EstimateSnapCost(*corpus.snaps[i]));
+  }
+  weighted_snap_sampler.Init(state.weights, num_snaps, state.entries,
+                             state.scratch);
+}
+
+// Records an as-expected execution of the snap at `snap_index` that took
+// `ticks` if weighted scheduling is enabled.
+void RecordSnapCost(size_t snap_index, uint64_t ticks) {
+  if (weighted_snap_sampler_state.measured_costs == nullptr) return;
+  MeasuredSnapCost& cost =
+      weighted_snap_sampler_state.measured_costs[snap_index];
+  cost.total_ticks += ticks;
+  ++cost.num_executions;
+}
+
+// Rebuilds `weighted_snap_sampler` from the measured costs. Does nothing if no
+// snap has been measured yet.
+void ReweightSnapSampler() {
+  const WeightedSnapSamplerState& state = weighted_snap_sampler_state;
+  uint64_t sum_of_means = 0;
+  size_t num_measured = 0;
+  for (size_t i = 0; i < state.num_snaps; ++i) {
+    const MeasuredSnapCost& cost = state.measured_costs[i];
+    if (cost.num_executions != 0) {
+      sum_of_means += cost.total_ticks / cost.num_executions;
+      ++num_measured;
+    }
+  }
+  if (num_measured == 0) return;
+  const uint64_t unmeasured_cost = sum_of_means / num_measured;
+  for (size_t i = 0; i < state.num_snaps; ++i) {
+    const MeasuredSnapCost& cost = state.measured_costs[i];
+    state.weights[i] =
+        SnapWeight(cost.num_executions != 0
+                       ? cost.total_ticks / cost.num_executions
+                       : unmeasured_cost);
+  }
+  weighted_snap_sampler.Init(state.weights, state.num_snaps, state.entries,
+                             state.scratch);
+  VLOG_INFO(1, "Reweighted snap sampler, measured ", IntStr(num_measured),
+            " snaps");
+}
+
+// Batch composition by register usage:
+//
+// Snaps whose code uses AVX-512 state may lower the core frequency while they
+// and the snaps after them run, and the exit sequence saves more registers
+// for them. Interleaving them with snaps using only the base register groups
+// makes a batch pay for the transitions repeatedly. With
+// options.batch_mixing_percent below 100, the first snap of a batch is picked
+// as usual and each other snap is picked, with probability
+// (100 - batch_mixing_percent)%, uniformly among the snaps with the same
+// Snap::code_register_groups as the first snap.
+//
+// Snaps of corpora generated without code register groups all have 0 and
+// fall into a single class.
+
+struct SnapClasses {
+  // Maximum number of distinct code register groups tracked. Snaps with
+  // groups beyond these share the last class.
+  static constexpr size_t kMaxClasses = 16;
+
+  size_t num_classes = 0;
+
+  // Snaps of class `c` are snaps_by_class[class_begin[c]:class_begin[c+1]].
+  size_t class_begin[kMaxClasses + 1];
+
+  // Class of each snap, indexed by snap index.
+  uint8_t* snap_class = nullptr;
+
+  // Snap indices sorted by class.
+  size_t* snaps_by_class = nullptr;
+};
+
+// Initialized only if options.batch_mixing_percent is less than 100.
+SnapClasses snap_classes;
+
+// Groups snaps of `corpus` by their code register groups.
+void InitSnapClasses(const SnapCorpus<Host>& corpus) {
+  const size_t num_snaps = corpus.snaps.size;
+  uint32_t class_groups[SnapClasses::kMaxClasses];
+  size_t class_size[SnapClasses::kMaxClasses] = {};
+  snap_classes.num_classes = 0;
+  snap_classes.snap_class =
+      static_cast<uint8_t*>(AllocatePerSnapState(num_snaps));
+  snap_classes.snaps_by_class = static_cast<size_t*>(
+      AllocatePerSnapState(num_snaps * sizeof(size_t)));
+  for (size_t i = 0; i < num_snaps; ++i) {
+    const uint32_t groups = corpus.snaps[i]->code_register_groups;
+    size_t c = 0;
+    while (c < snap_classes.num_classes && class_groups[c] != groups) ++c;
+    if (c == snap_classes.num_classes) {
+      if (c < SnapClasses::kMaxClasses) {
+        class_groups[c] = groups;
+        snap_classes.num_classes++;
+      } else {
+        c = SnapClasses::kMaxClasses - 1;
+      }
+    }
+    snap_classes.snap_class[i] = c;
+    class_size[c]++;
+  }
+
+  // Counting sort of snap indices by class.
+  size_t next[SnapClasses::kMaxClasses];
+  snap_classes.class_begin[0] = 0;
+  for (size_t c = 0; c < snap_classes.num_classes; ++c) {
+    next[c] = snap_classes.class_begin[c];
+    snap_classes.class_begin[c + 1] =
+        snap_classes.class_begin[c] + class_size[c];
+  }
+  for (size_t i = 0; i < num_snaps; ++i) {
+    snap_classes.snaps_by_class[next[snap_classes.snap_class[i]]++] = i;
+  }
+  VLOG_INFO(1, "Snap classes by code register groups: ",
+            IntStr(snap_classes.num_classes));
+}
+
+// Returns a snap index picked uniformly among snaps in the same class as
+// `snap_index`.
+size_t SampleSnapInClassOf(size_t snap_index, std::mt19937_64& gen) {
+  const size_t c = snap_classes.snap_class[snap_index];
+  std::uniform_int_distribution<size_t> dist(
+      snap_classes.class_begin[c], snap_classes.class_begin[c + 1] - 1);
+  return snap_classes.snaps_by_class[dist(gen)];
+}
+
+// Lazy snap mapping:
+//
+// By default MapCorpus() maps all snaps before the first execution. With
+// options.lazy_map_snaps, the memory mappings of a snap are created when the
+// snap is first scheduled. Mapped snaps are kept in an LRU list and the least
+// recently used ones are unmapped when the total size of the address ranges
+// mapped for snaps exceeds options.max_mapped_snap_bytes. This reduces VMA
+// count, RSS and startup time for large corpora at the cost of mmap() calls
+// when an unmapped snap is scheduled.
+//
+// Snaps usually share some address ranges, e.g. the stack. A shared range is
+// counted once against the budget and stays mapped until no mapped snap uses
+// it, i.e. eviction only unmaps the parts of the evicted snap's mappings not
+// covered by other mapped snaps. Creating or
+// removing mappings invalidates the ownership of writable mappings used by
+// incremental memory restore, so it is reset whenever that happens.
+
+// Marks the ends of the LRU list.
+constexpr size_t kNoLazyMappedSnap = ~size_t{0};
+
+struct LazySnapMappingState {
+  bool mapped;
+
+  // Neighbors in the LRU list if `mapped` is true.
+  size_t more_recent;
+  size_t less_recent;
+};
+
+struct LazyCorpusMapping {
+  const SnapCorpus<Host>* corpus;
+  int corpus_fd;
+  const void* corpus_mapping;
+
+  // Verify checksums of each snap after mapping it.
+  bool strict;
+
+  // See RunnerMainOptions::max_mapped_snap_bytes. 0 means unlimited.
+  uint64_t max_mapped_bytes;
+
+  // Size of the union of address ranges of all mapped snaps.
+  uint64_t mapped_bytes;
+
+  // Ends of the LRU list.
+  size_t most_recent;
+  size_t least_recent;
+
+  // Array of per-snap states indexed by snap index in the corpus, or nullptr
+  // if lazy mapping is disabled.
+  LazySnapMappingState* states;
+};
+
+LazyCorpusMapping lazy_corpus_mapping = {.states = nullptr};
+
+// Calls `fn(start_address, limit_address)` for each maximal part of
+// [`start_address`, `limit_address`) not covered by a mapping of a snap in the
+// LRU list, in ascending address order.
+template <typename Fn>
+void ForEachRangeNotInLazyMappedSnaps(uint64_t start_address,
+                                      uint64_t limit_address, Fn&& fn) {
+  uint64_t address = start_address;
+  while (address < limit_address) {
+    // End of the mappings covering `address` and start of the first mapping
+    // above it.
+    uint64_t covered_limit = address;
+    uint64_t next_covered_start = limit_address;
+    for (size_t i = lazy_corpus_mapping.most_recent; i != kNoLazyMappedSnap;
+         i = lazy_corpus_mapping.states[i].less_recent) {
+      for (const auto& other :
+           lazy_corpus_mapping.corpus->snaps[i]->memory_mappings) {
+        const uint64_t other_limit = other.start_address + other.num_bytes;
+        if (other.start_address <= address && address < other_limit) {
+          covered_limit = std::max(covered_limit, other_limit);
+        } else if (address < other.start_address) {
+          next_covered_start = std::min(next_covered_start,
+                                        other.start_address);
+        }
+      }
+    }
+    if (covered_limit > address) {
+      address = covered_limit;
+    } else {
+      fn(address, next_covered_start);
+      address = next_covered_start;
+    }
+  }
+}
+
+// Returns the number of bytes mapping `snap` would add to the address ranges
+// of snaps in the LRU list.
+uint64_t NewlyMappedBytes(const Snap<Host>& snap) {
+  uint64_t num_bytes = 0;
+  for (const auto& memory_mapping : snap.memory_mappings) {
+    ForEachRangeNotInLazyMappedSnaps(
+        memory_mapping.start_address,
+        memory_mapping.start_address + memory_mapping.num_bytes,
+        [&num_bytes](uint64_t start_address, uint64_t limit_address) {
+          num_bytes += limit_address - start_address;
+        });
+  }
+  return num_bytes;
+}
+
+void RemoveFromLruList(size_t snap_index) {
+  LazySnapMappingState* states = lazy_corpus_mapping.states;
+  const LazySnapMappingState& state = states[snap_index];
+  if (state.more_recent == kNoLazyMappedSnap) {
+    lazy_corpus_mapping.most_recent = state.less_recent;
+  } else {
+    states[state.more_recent].less_recent = state.less_recent;
+  }
+  if (state.less_recent == kNoLazyMappedSnap) {
+    lazy_corpus_mapping.least_recent = state.more_recent;
+  } else {
+    states[state.less_recent].more_recent = state.more_recent;
+  }
+}
+
+void AddToLruListFront(size_t snap_index) {
+  LazySnapMappingState& state = lazy_corpus_mapping.states[snap_index];
+  state.more_recent = kNoLazyMappedSnap;
+  state.less_recent = lazy_corpus_mapping.most_recent;
+  if (lazy_corpus_mapping.most_recent == kNoLazyMappedSnap) {
+    lazy_corpus_mapping.least_recent = snap_index;
+  } else {
+    lazy_corpus_mapping.states[lazy_corpus_mapping.most_recent].more_recent =
+        snap_index;
+  }
+  lazy_corpus_mapping.most_recent = snap_index;
+}
+
+// Unmaps the least recently used snap.
+void EvictLeastRecentlyUsedSnap() {
+  const size_t snap_index = lazy_corpus_mapping.least_recent;
+  const Snap<Host>& snap = *lazy_corpus_mapping.corpus->snaps[snap_index];
+  VLOG_INFO(2, "Unmapping ", snap.id);
+  RemoveFromLruList(snap_index);
+  lazy_corpus_mapping.states[snap_index].mapped = false;
+  for (const auto& memory_mapping : snap.memory_mappings) {
+    ForEachRangeNotInLazyMappedSnaps(
+        memory_mapping.start_address,
+        memory_mapping.start_address + memory_mapping.num_bytes,
+        [](uint64_t start_address, uint64_t limit_address) {
+          const uint64_t num_bytes = limit_address - start_address;
+          CHECK_EQ(munmap(AsPtr(start_address), num_bytes), 0);
+          lazy_corpus_mapping.mapped_bytes -= num_bytes;
+        });
+  }
+  memory_restore_tracker.ResetOwnership();
+}
+
+// Maps the snap at `snap_index` if it is not mapped and marks it as the most
+// recently used.
+//
+// REQUIRES: InitLazyCorpusMapping() has been called.
+void EnsureSnapMapped(size_t snap_index) {
+  LazySnapMappingState& state = lazy_corpus_mapping.states[snap_index];
+  if (state.mapped) {
+    if (lazy_corpus_mapping.most_recent != snap_index) {
+      RemoveFromLruList(snap_index);
+      AddToLruListFront(snap_index);
+    }
+    return;
+  }
+
+  const Snap<Host>& snap = *lazy_corpus_mapping.corpus->snaps[snap_index];
+  // Evicting a snap that shares ranges with `snap` increases the number of
+  // bytes needed for `snap`, so it is recomputed after each eviction.
+  if (lazy_corpus_mapping.max_mapped_bytes != 0) {
+    while (lazy_corpus_mapping.least_recent != kNoLazyMappedSnap &&
+           lazy_corpus_mapping.mapped_bytes + NewlyMappedBytes(snap) >
+               lazy_corpus_mapping.max_mapped_bytes) {
+      EvictLeastRecentlyUsedSnap();
+    }
+  }
+  const uint64_t num_bytes = NewlyMappedBytes(snap);
+  // The runner may have mapped memory for itself after the corpus was
+  // checked. Mapping the snap over it would corrupt the runner.
+  size_t num_proc_maps_entries;
+  const ProcMapsEntry* proc_maps_entries =
+      GetRunnerProcMapsEntries(&num_proc_maps_entries);
+  if (SnapOverlapsWithProcMapsEntries(snap, proc_maps_entries,
+                                      num_proc_maps_entries)) {
+    LOG_FATAL("Snap ", snap.id, " conflicts with the runner's memory");
+  }
+  VLOG_INFO(2, "Mapping ", snap.id);
+  MapSnap(snap, lazy_corpus_mapping.corpus_fd,
+          lazy_corpus_mapping.corpus_mapping);
+  if (lazy_corpus_mapping.strict && !VerifySnapChecksums(snap)) {
+    LOG_FATAL("Checksum mismatch");
+  }
+  state.mapped = true;
+  AddToLruListFront(snap_index);
+  lazy_corpus_mapping.mapped_bytes += num_bytes;
+  memory_restore_tracker.ResetOwnership();
+}
+
+// Like MapCorpus() but enables lazy snap mapping instead of mapping snaps
+// in `corpus`. `corpus_fd` is kept open for mapping snaps later.
+const SnapCorpus<Host>* InitLazyCorpusMapping(
+    const SnapCorpus<Host>& corpus, int corpus_fd, const void* corpus_mapping,
+    const RunnerMainOptions& options) {
+  const SnapCorpus<Host>* active_corpus = ExcludeConflictingSnaps(corpus);
+  lazy_corpus_mapping = {
+      .corpus = active_corpus,
+      .corpus_fd = corpus_fd,
+      .corpus_mapping = corpus_mapping,
+      .strict = options.strict,
+      .max_mapped_bytes = options.max_mapped_snap_bytes,
+      .mapped_bytes = 0,
+      .most_recent = kNoLazyMappedSnap,
+      .least_recent = kNoLazyMappedSnap,
+      .states = static_cast<LazySnapMappingState*>(AllocatePerSnapState(
+          active_corpus->snaps.size * sizeof(LazySnapMappingState))),
+  };
+  return active_corpus;
+}
+
+// Logs `size` bytes at `start_address` as a proto.MemoryBytes submessage of
+// `end_state_m`. Bytes that all have the same value, like untouched zero
+// pages, are logged as a byte_run instead of verbatim.
+void LogMemoryBytes(const char* start_address, size_t size,
+                    class TextProtoPrinter::Message& end_state_m) {
+  auto memory_bytes_m = end_state_m->Message("memory_bytes");
+  memory_bytes_m->Hex("start_address", AsInt(start_address));
+  size_t num_repeated = 1;
+  while (num_repeated < size &&
+         start_address[num_repeated] == start_address[0]) {
+    ++num_repeated;
+  }
+  if (num_repeated == size) {
+    auto byte_run_m = memory_bytes_m->Message("byte_run");
+    byte_run_m->Int("value", static_cast<uint8_t>(start_address[0]));
+    byte_run_m->Int("size", size);
+  } else {
+    memory_bytes_m->Bytes("byte_values", start_address, size);
+  }
+}
+
+}  // namespace
+
 // Logs the actual memory bytes of `snap` as a series of proto.MemoryBytes
 // protos formatted as text.
 // The output may appear fragmented due to internal buffer capacity limits e.g.
@@ -575,18 +1697,114 @@ void LogSnapMemoryBytes(const Snap<Host>& snap,
         reinterpret_cast<const char*>(AsPtr(memory_mapping.start_address));
     const char* limit_address = start_address + memory_mapping.num_bytes;
     for (; start_address < limit_address; start_address += kPageSize) {
-      auto memory_bytes_m = end_state_m->Message("memory_bytes");
       size_t bytes_to_log =
           std::min<size_t>(kPageSize, limit_address - start_address);
-      memory_bytes_m->Hex("start_address", AsInt(start_address));
-      memory_bytes_m->Bytes("byte_values", start_address, bytes_to_log);
+      LogMemoryBytes(start_address, bytes_to_log, end_state_m);
     }
   }
 }
 
+namespace {
+
+// Writes `size` bytes at `data` to `fd`. Returns false on any failure.
+bool WriteAll(int fd, const void* data, size_t size) {
+  return Write(fd, data, size) == size;
+}
+
+// Writes the run result of `snap` to `fd` as a single record described in
+// result_record.h. Memory bytes are written straight from the snap's live
+// mappings. Returns false if the record could not be written in full.
+bool WriteSnapRunResultRecord(const Snap<Host>& snap,
+                              const RunSnapResult& run_result, int fd) {
+  Serialized<EndSpot::gregs_t> serialized_gregs;
+  CHECK(SerializeGRegs(*run_result.end_spot.gregs, &serialized_gregs));
+  Serialized<EndSpot::fpregs_t> serialized_fpregs;
+  CHECK(SerializeFPRegs(*run_result.end_spot.fpregs, &serialized_fpregs));
+  uint8_t checksum_buffer[256];
+  ssize_t checksum_size = Serialize(run_result.end_spot.register_checksum,
+                                    checksum_buffer, sizeof(checksum_buffer));
+  CHECK_NE(checksum_size, -1);
+
+  ResultRecordHeader header;
+  header.magic = kResultRecordMagic;
+  header.outcome = ToInt(run_result.outcome);
+  header.cpu_id = run_result.cpu_id;
+  header.endpoint_type = kResultRecordNoEndpoint;
+  header.sig_num = 0;
+  header.sig_cause = 0;
+  header.instruction_address = 0;
+  header.sig_address = 0;
+  std::optional<Endpoint> endpoint = EndSpotToEndpoint(run_result.end_spot);
+  if (endpoint.has_value()) {
+    if (endpoint->type() == EndpointType::kSignal) {
+      header.endpoint_type = kResultRecordSignalEndpoint;
+      header.sig_num = ToInt(endpoint->sig_num());
+      header.sig_cause = ToInt(endpoint->sig_cause());
+      header.instruction_address = endpoint->sig_instruction_address();
+      header.sig_address = endpoint->sig_address();
+    } else {
+      header.endpoint_type = kResultRecordInstructionEndpoint;
+      header.instruction_address = endpoint->instruction_address();
+    }
+  }
+  header.snapshot_id_size = strlen(snap.id);
+  header.gregs_size = serialized_gregs.size;
+  header.fpregs_size = serialized_fpregs.size;
+  header.register_checksum_size = checksum_size;
+
+  // Same memory as LogSnapMemoryBytes() plus the pages added during making.
+  uint64_t memory_size = num_added_pages * kPageSize;
+  header.num_memory_bytes = num_added_pages;
+  for (const auto& memory_mapping : snap.memory_mappings) {
+    if (memory_mapping.writable()) {
+      ++header.num_memory_bytes;
+      memory_size += memory_mapping.num_bytes;
+    }
+  }
+  header.record_size =
+      sizeof(header) + header.snapshot_id_size + header.gregs_size +
+      header.fpregs_size + header.register_checksum_size +
+      header.num_memory_bytes * sizeof(ResultRecordMemoryBytes) + memory_size;
+
+  if (!WriteAll(fd, &header, sizeof(header)) ||
+      !WriteAll(fd, snap.id, header.snapshot_id_size) ||
+      !WriteAll(fd, serialized_gregs.data, serialized_gregs.size) ||
+      !WriteAll(fd, serialized_fpregs.data, serialized_fpregs.size) ||
+      !WriteAll(fd, checksum_buffer, checksum_size)) {
+    return false;
+  }
+  for (const auto& memory_mapping : snap.memory_mappings) {
+    if (!memory_mapping.writable()) {
+      continue;
+    }
+    const ResultRecordMemoryBytes memory_bytes = {
+        .start_address = memory_mapping.start_address,
+        .num_bytes = memory_mapping.num_bytes,
+    };
+    if (!WriteAll(fd, &memory_bytes, sizeof(memory_bytes)) ||
+        !WriteAll(fd, AsPtr(memory_mapping.start_address),
+                  memory_mapping.num_bytes)) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < num_added_pages; ++i) {
+    const ResultRecordMemoryBytes memory_bytes = {
+        .start_address = added_page_addresses[i],
+        .num_bytes = kPageSize,
+    };
+    if (!WriteAll(fd, &memory_bytes, sizeof(memory_bytes)) ||
+        !WriteAll(fd, AsPtr(added_page_addresses[i]), kPageSize)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
 // Logs the run result of `snap` to stdout formatted as
-// proto.SnapshotExecutionResult text proto. Additionally, logs execution
-// result in human-readable format to stderr.
+// proto.SnapshotExecutionResult text proto, or to options.result_fd if set.
+// Additionally, logs execution result in human-readable format to stderr.
 void LogSnapRunResult(const Snap<Host>& snap, const RunnerMainOptions& options,
                       const RunSnapResult& run_result) {
   if (run_result.outcome != RunSnapOutcome::kAsExpected) {
@@ -594,21 +1812,21 @@ void LogSnapRunResult(const Snap<Host>& snap, const RunnerMainOptions& options,
               "] failed, outcome = ", IntStr(ToInt(run_result.outcome)));
     LOG_ERROR("Corpus   [", options.corpus_name, "]");
     if (run_result.outcome == RunSnapOutcome::kRegisterStateMismatch) {
+      const SnapEndState<Host> end_state = snap.EndStateFor(host_platform_id);
       LOG_INFO("Registers (diff vs expected end_state 0):");
       LOG_INFO("  gregs (modified only):");
       // Use instruction pointer == 0 as a proxy for undefined state. The only
       // possible case where the value is 0 is for Snaps with the undefined end
       // state.
       // See SnapGenerator::Options::allow_undefined_end_state for details.
-      bool log_diff =
-          snap.end_state_registers->gregs.GetInstructionPointer() != 0;
-      LogGRegs(*run_result.end_spot.gregs, &snap.end_state_registers->gregs,
+      bool log_diff = end_state.registers->gregs.GetInstructionPointer() != 0;
+      LogGRegs(*run_result.end_spot.gregs, &end_state.registers->gregs,
                log_diff);
       LOG_INFO("  fpregs (modified only):");
       LogFPRegs(*run_result.end_spot.fpregs, true,
-                &snap.end_state_registers->fpregs, log_diff);
+                &end_state.registers->fpregs, log_diff);
       LogRegisterChecksum(run_result.end_spot.register_checksum,
-                          &snap.end_state_register_checksum, log_diff);
+                          &end_state.register_checksum, log_diff);
     } else if (run_result.outcome == RunSnapOutcome::kMemoryMismatch) {
       LOG_INFO("Memory state mismatch (details omitted)");
     } else if (run_result.outcome == RunSnapOutcome::kExecutionMisbehave) {
@@ -619,6 +1837,12 @@ void LogSnapRunResult(const Snap<Host>& snap, const RunnerMainOptions& options,
       run_result.end_spot.Log();
     }
   }
+  // Fall back to the text proto if the binary record cannot be written, e.g.
+  // because the file descriptor is not open.
+  if (options.result_fd != -1 &&
+      WriteSnapRunResultRecord(snap, run_result, options.result_fd)) {
+    return;
+  }
   // The root message is proto.SnapshotExecutionResult
   TextProtoPrinter snapshot_execution_result;
   {
@@ -670,16 +1894,88 @@ void LogSnapRunResult(const Snap<Host>& snap, const RunnerMainOptions& options,
     LogSnapMemoryBytes(snap, actual_end_state);
     // Append additional pages mapped during making.
     for (int i = 0; i < num_added_pages; ++i) {
-      auto memory_bytes_m = actual_end_state->Message("memory_bytes");
-      const char* start_address =
-          reinterpret_cast<const char*>(AsPtr(added_page_addresses[i]));
-      memory_bytes_m->Hex("start_address", AsInt(start_address));
-      memory_bytes_m->Bytes("byte_values", start_address, kPageSize);
+      LogMemoryBytes(
+          reinterpret_cast<const char*>(AsPtr(added_page_addresses[i])),
+          kPageSize, actual_end_state);
+    }
+  }
+  LogToStdout(snapshot_execution_result.c_str());
+}
+
+uint64_t MonotonicNanos() {
+  kernel_timespec ts;
+  CHECK_EQ(sys_clock_gettime(CLOCK_MONOTONIC, &ts), 0);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+namespace {
+
+// Prints proto.SnapshotExecutionResult.runner_startup_timings to stdout.
+// `map_ns` and `verify_ns` are the time spent in mapping the corpus and in
+// verifying its checksums.
+void LogStartupTimings(const RunnerMainOptions& options, uint64_t map_ns,
+                       uint64_t verify_ns) {
+  TextProtoPrinter snapshot_execution_result;
+  {
+    auto timings_m =
+        snapshot_execution_result.Message("runner_startup_timings");
+    timings_m->Int("main_entry_monotonic_ns", options.main_entry_ns);
+    timings_m->Int("load_corpus_ns", options.load_corpus_ns);
+    timings_m->Int("map_corpus_ns", map_ns);
+    timings_m->Int("verify_checksums_ns", verify_ns);
+    if (options.prefault_snap_mappings || options.lock_snap_mappings) {
+      timings_m->Int("prefaulted_bytes", snap_mapping_stats.prefaulted_bytes);
+      timings_m->Int("locked_bytes", snap_mapping_stats.locked_bytes);
+      timings_m->Int("num_prefault_failures", snap_mapping_stats.num_failures);
     }
   }
   LogToStdout(snapshot_execution_result.c_str());
 }
 
+// Register groups checksummed at snap exits on the current platform.
+RegisterGroupSet<Host> platform_checksum_register_groups;
+
+// If true, a snap exit saves only the register groups in the end state
+// register checksum of the snap being run instead of all of
+// platform_checksum_register_groups. A snap without extension register groups
+// in its checksum then skips saving e.g. zmm and opmask registers. The maker
+// turns this off because it records the checksum of all groups.
+bool save_snap_register_groups_only = false;
+
+// Selects the register groups to save at the exit of `snap`. Snaps in a
+// corpus mostly share the same groups, so the specialized exit routines are
+// only reselected when the groups change.
+void SetSnapExitRegisterGroups(const Snap<Host>& snap) {
+  if (!save_snap_register_groups_only) return;
+  const RegisterGroupSet<Host> groups = RegisterGroupSet<Host>::Deserialize(
+      platform_checksum_register_groups.Serialize() &
+      snap.EndStateFor(host_platform_id)
+          .register_checksum.register_groups.Serialize());
+  if (groups != snap_exit_register_group_io_buffer.register_groups) {
+    SelectSnapExitRegisterGroups(groups);
+  }
+}
+
+// Initializes the process state that depends on neither the corpus nor the
+// options. Does nothing after the first call, so children of a zygote
+// (see ZygoteMain()) inherit the state instead of redoing it.
+void InitRunnerProcess() {
+  static bool initialized = false;
+  if (initialized) return;
+  initialized = true;
+
+  InitSnapExit(&SnapExitImpl);
+
+  // Initialize register checksumming.
+  InitRegisterGroupIO();
+  platform_checksum_register_groups =
+      GetCurrentPlatformChecksumRegisterGroups();
+  SelectSnapExitRegisterGroups(platform_checksum_register_groups);
+  save_snap_register_groups_only = true;
+}
+
+}  // namespace
+
 const SnapCorpus<Host>* CommonMain(const RunnerMainOptions& options) {
   // Pin CPU if pinning is requested.
   if (options.cpu != kAnyCPUId) {
@@ -691,49 +1987,119 @@ const SnapCorpus<Host>* CommonMain(const RunnerMainOptions& options) {
     }
   }
 
-  InitSnapExit(&SnapExitImpl);
-
-  // Initialize register checksumming.
-  InitRegisterGroupIO();
-  RegisterGroupSet<Host> checksum_register_group =
-      GetCurrentPlatformChecksumRegisterGroups();
-  snap_exit_register_group_io_buffer.register_groups = checksum_register_group;
+  InitRunnerProcess();
 
   // Preserve this value because the following logic might synthesize a new
   // SnapCorpus struct.
   const void* corpus_mapping = reinterpret_cast<const void*>(options.corpus);
 
-  auto corpus = [&options]() -> const SnapCorpus<Host>* {
+  const SnapCorpus<Host>* corpus = [&options]() -> const SnapCorpus<Host>* {
     static SnapCorpus<Host> one_snap_corpus = {};
     if (options.snap_id == nullptr) {
-      return options.corpus;
-    }
-    for (int i = 0; i < options.corpus->snaps.size; ++i) {
-      const Snap<Host>* snap = options.corpus->snaps[i];
-      if (strcmp(snap->id, options.snap_id) == 0) {
-        // Creates a slice of size 1 over the original corpus.
-        memcpy(&one_snap_corpus, options.corpus, sizeof(one_snap_corpus));
-        one_snap_corpus.snaps.size = 1;
-        one_snap_corpus.snaps.elements = &options.corpus->snaps[i];
-        return &one_snap_corpus;
+      return ExcludeTombstonedSnaps(*options.corpus, options.tombstones,
+                                    options.num_tombstones);
+    }
+    size_t i;
+    if (options.corpus_relocated_lazily) {
+      // Relocate only the snaps needed to find the one to run and then make
+      // the corpus read-only as it would be after eager relocation.
+      SnapRelocatorError error = SnapRelocatorError::kOk;
+      i = options.corpus->FindIndex(options.snap_id, [&](size_t index) {
+        return SnapRelocator<Host>::GetSnap(*options.corpus, index, &error);
+      });
+      if (error != SnapRelocatorError::kOk) {
+        LOG_FATAL("Failed to relocate snaps in the corpus");
       }
+      CHECK_EQ(mprotect(const_cast<SnapCorpus<Host>*>(options.corpus),
+                        options.corpus->header.num_bytes, PROT_READ),
+               0);
+    } else {
+      i = options.corpus->FindIndex(options.snap_id);
     }
-    LOG_FATAL("Snap ", options.snap_id, " not found in the corpus");
+    if (i == options.corpus->snaps.size) {
+      LOG_FATAL("Snap ", options.snap_id, " not found in the corpus");
+    }
+    // Creates a slice of size 1 over the original corpus.
+    memcpy(&one_snap_corpus, options.corpus, sizeof(one_snap_corpus));
+    one_snap_corpus.snaps.size = 1;
+    one_snap_corpus.snaps.elements = &options.corpus->snaps[i];
+    // The lookup indices refer to the original snaps[].
+    one_snap_corpus.id_index = {};
+    one_snap_corpus.code_index = {};
+    if (options.corpus->hot_entries.size == options.corpus->snaps.size) {
+      one_snap_corpus.hot_entries.size = 1;
+      one_snap_corpus.hot_entries.elements = &options.corpus->hot_entries[i];
+    }
+    return &one_snap_corpus;
   }();
-  MapCorpus(*corpus, options.corpus_fd, corpus_mapping);
-  if (options.strict) {
-    VerifyChecksums(*corpus);
+  if (options.lock_snap_mappings) {
+    snap_mapping_extra_flags = MAP_LOCKED;
+  }
+  host_platform_id = options.platform_id;
+  // Open the counters before mapping snaps so that snaps conflicting with
+  // the counter pages are skipped. Playback goes on without counters if
+  // they are not available.
+  if (options.num_perf_counters > 0) {
+    perf_counters.Open(options.perf_counters, options.num_perf_counters);
+  }
+  // Like the counters above, runaways are then only caught by the time
+  // limits if the budget counter is not available.
+  if (options.snap_instruction_budget > 0) {
+    snap_instruction_budget.Open(options.snap_instruction_budget_event,
+                                 options.snap_instruction_budget);
+  }
+  const uint64_t map_start_ns = MonotonicNanos();
+  uint64_t verify_start_ns;
+  if (options.lazy_map_snaps) {
+    // Checksums are verified as snaps get mapped.
+    corpus = InitLazyCorpusMapping(*corpus, options.corpus_fd, corpus_mapping,
+                                   options);
+    verify_start_ns = MonotonicNanos();
+  } else {
+    corpus = MapCorpus(*corpus, options.corpus_fd, corpus_mapping);
+    if (options.prefault_snap_mappings) {
+      PrefaultSnapMappings(*corpus);
+    }
+    verify_start_ns = MonotonicNanos();
+    if (options.strict) {
+      VerifyChecksums(*corpus);
+    }
+  }
+  if (options.prefault_snap_mappings || options.lock_snap_mappings) {
+    VLOG_INFO(1, "Prefaulted ", IntStr(snap_mapping_stats.prefaulted_bytes),
+              " bytes, locked ", IntStr(snap_mapping_stats.locked_bytes),
+              " bytes, ", IntStr(snap_mapping_stats.num_failures),
+              " mappings failed");
+  }
+  if (options.report_startup_timings) {
+    LogStartupTimings(options, verify_start_ns - map_start_ns,
+                      MonotonicNanos() - verify_start_ns);
+  }
+  // The end state must be checked after each execution to know what memory
+  // needs to be restored.
+  if (options.incremental_memory_restore && !options.skip_end_state_check) {
+    InitIncrementalMemoryRestore(corpus->snaps.size);
+  }
+  if (options.collect_snap_latency) {
+    InitSnapLatencyHistograms(*corpus);
+  }
+  if (options.weighted_schedule) {
+    InitWeightedSnapSampler(*corpus);
+  }
+  if (options.batch_mixing_percent < 100) {
+    InitSnapClasses(*corpus);
   }
   InstallSigHandler();
 
   return corpus;
 }
 
-void RunSnap(const Snap<Host>& snap, const RunnerMainOptions& options,
-             RunSnapResult& result) {
-  PrepareSnapMemory(snap);
-  result.cpu_id = GetCPUIdNoSyscall();
-  RunSnap(*snap.registers, options, result.end_spot);
+namespace {
+
+// Completes `result` of `snap` after the snap has finished executing.
+// `result.cpu_id` must be set to the CPU id just before the execution.
+void FinishSnapResult(const Snap<Host>& snap, const RunnerMainOptions& options,
+                      RunSnapResult& result) {
   if (result.cpu_id != GetCPUIdNoSyscall()) {
     result.cpu_id = kUnknownCPUId;
   }
@@ -742,13 +2108,117 @@ void RunSnap(const Snap<Host>& snap, const RunnerMainOptions& options,
                        : EndSpotToOutcome(snap, result.end_spot);
 }
 
+// Restarts the instruction budget, if any, for the snap about to run. The few
+// runner instructions between here and the snap entry count against it.
+void ArmSnapInstructionBudget() {
+  if (snap_instruction_budget.is_open()) {
+    snap_instruction_budget.Rearm();
+  }
+}
+
+// Returns true if snap executions must be timed for `options`.
+bool MeasureSnapLatency(const RunnerMainOptions& options) {
+  return options.collect_snap_latency || options.weighted_schedule;
+}
+
+// Executes `snap` after its memory has been prepared and stores the execution
+// result in `result`.
+void RunPreparedSnap(const Snap<Host>& snap, const RunnerMainOptions& options,
+                     RunSnapResult& result) {
+  SetSnapExitRegisterGroups(snap);
+  result.cpu_id = GetCPUIdNoSyscall();
+  ArmSnapInstructionBudget();
+  const uint64_t start_ticks =
+      MeasureSnapLatency(options) ? ReadTimestampCounter() : 0;
+  RunSnap(*snap.registers, options, result.end_spot);
+  if (MeasureSnapLatency(options)) {
+    result.latency_ticks = ReadTimestampCounter() - start_ticks;
+  }
+  FinishSnapResult(snap, options, result);
+}
+
+// Prepares memory of the snap at `snap_index` in `corpus`, which must be the
+// corpus returned by CommonMain(). Maps the snap first if lazy snap mapping is
+// enabled. Uses incremental memory restore if it is enabled.
+void PrepareCorpusSnapMemory(const SnapCorpus<Host>& corpus,
+                             size_t snap_index) {
+  const Snap<Host>& snap = *corpus.snaps[snap_index];
+  if (lazy_corpus_mapping.states != nullptr) {
+    EnsureSnapMapped(snap_index);
+  }
+  if (!memory_restore_tracker.enabled()) {
+    if (corpus.hot_entries.size == corpus.snaps.size) {
+      // Same as PrepareSnapMemory() without walking the mappings.
+      for (const auto& memory_bytes :
+           corpus.hot_entries[snap_index].writable_memory_bytes) {
+        SetupMemoryBytes(memory_bytes);
+      }
+    } else {
+      PrepareSnapMemory(snap);
+    }
+  } else {
+    memory_restore_tracker.Prepare(snap, snap_index, SetupMemoryBytes);
+  }
+}
+
+// Updates the incremental memory restore state and the latency histogram, if
+// those are enabled, after the snap at `snap_index` in `corpus` finished with
+// `result`.
+void FinishCorpusSnap(const SnapCorpus<Host>& corpus, size_t snap_index,
+                      const RunSnapResult& result) {
+  if (memory_restore_tracker.enabled()) {
+    memory_restore_tracker.Update(
+        *corpus.snaps[snap_index], snap_index,
+        result.outcome == RunSnapOutcome::kAsExpected,
+        [](const SnapMemoryBytes& memory_bytes) {
+          return !VerifyMemoryBytes(memory_bytes);
+        });
+  }
+  if (snap_latency_histograms != nullptr) {
+    RecordSnapLatency(snap_index, result.latency_ticks);
+  }
+  if (result.outcome == RunSnapOutcome::kAsExpected) {
+    RecordSnapCost(snap_index, result.latency_ticks);
+  }
+}
+
+// Like RunSnap() but for the snap at `snap_index` in `corpus`, which must be
+// the corpus returned by CommonMain().
+void RunCorpusSnap(const SnapCorpus<Host>& corpus, size_t snap_index,
+                   const RunnerMainOptions& options, RunSnapResult& result) {
+  PrepareCorpusSnapMemory(corpus, snap_index);
+  RunPreparedSnap(*corpus.snaps[snap_index], options, result);
+  FinishCorpusSnap(corpus, snap_index, result);
+}
+
+// Returns true if no snap in `corpus`, which must be returned by CommonMain(),
+// is left to run. A non-empty corpus file can be left without snaps if they
+// all conflict with the runner or are tombstoned.
+bool NoSnapsToRun(const SnapCorpus<Host>& corpus) {
+  if (corpus.snaps.size != 0) return false;
+  LOG_ERROR("All snaps were skipped, exiting");
+  return true;
+}
+
+}  // namespace
+
+void RunSnap(const Snap<Host>& snap, const RunnerMainOptions& options,
+             RunSnapResult& result) {
+  PrepareSnapMemory(snap);
+  RunPreparedSnap(snap, options, result);
+}
+
 int MakerMain(const RunnerMainOptions& options) {
   const SnapCorpus<Host>* corpus = CommonMain(options);
+  // The made snap has no end state yet. Record the checksum of all groups.
+  save_snap_register_groups_only = false;
 
   max_pages_to_add = options.max_pages_to_add;
   EnterSeccompFilterMode(SeccompOptionsFromRunnerMainOptions(options));
 
-  const Snap<Host>& snap = *corpus->snaps.at(0);
+  // There is nothing to make if the snap was skipped.
+  if (NoSnapsToRun(*corpus)) return EXIT_FAILURE;
+  const Snap<Host>& snap = *corpus->snaps[0];
   RunSnapResult run_result;
   RunSnap(snap, options, run_result);
 
@@ -760,60 +2230,402 @@ int MakerMain(const RunnerMainOptions& options) {
   return EXIT_SUCCESS;
 }
 
-int RunnerMain(const RunnerMainOptions& options) {
-  CHECK(!options.sequential_mode);
-  const SnapCorpus<Host>* corpus = CommonMain(options);
-  CHECK_GT(corpus->snaps.size, 0);
+namespace {
 
-  EnterSeccompFilterMode(SeccompOptionsFromRunnerMainOptions(options));
+// The last snaps started by RunRandomSchedule(). This is a fixed-size ring so
+// that recording costs the same for any number of iterations and needs no
+// allocation.
+struct SnapHistory {
+  // Must be a power of 2.
+  static constexpr size_t kSize = 64;
+
+  struct Entry {
+    // Index of the snap in the corpus.
+    size_t snap_index;
+
+    // Timestamp counter value when the snap started.
+    uint64_t start_ticks;
+  };
+
+  // Number of snaps recorded since the last Clear(). The last
+  // min(num_recorded, kSize) of them are in `entries`.
+  size_t num_recorded;
+  Entry entries[kSize];
+
+  void Clear() { num_recorded = 0; }
+
+  void Record(size_t snap_index) {
+    entries[num_recorded++ % kSize] = {.snap_index = snap_index,
+                                       .start_ticks = ReadTimestampCounter()};
+  }
+};
+
+SnapHistory snap_history;
+
+// Logs the snaps in `snap_history` from `corpus`, oldest first. Their IDs
+// listed in a file in the same order reproduce the failure of the last one
+// with --replay.
+void LogSnapHistory(const SnapCorpus<Host>& corpus) {
+  const size_t num_entries =
+      std::min(snap_history.num_recorded, SnapHistory::kSize);
+  const size_t first = snap_history.num_recorded - num_entries;
+  LOG_ERROR("Last ", IntStr(num_entries), " snaps, oldest first:");
+  const uint64_t first_ticks =
+      snap_history.entries[first % SnapHistory::kSize].start_ticks;
+  for (size_t i = first; i < snap_history.num_recorded; ++i) {
+    const SnapHistory::Entry& entry =
+        snap_history.entries[i % SnapHistory::kSize];
+    LOG_ERROR("  #", IntStr(i), " +", IntStr(entry.start_ticks - first_ticks),
+              " ticks [", corpus.snaps[entry.snap_index]->id, "]");
+  }
+}
+
+// Logs a failed snap execution in RunRandomSchedule().
+void LogScheduleFailure(const SnapCorpus<Host>& corpus,
+                        const Snap<Host>& snap,
+                        const RunnerMainOptions& options,
+                        const RunSnapResult& run_result,
+                        size_t snap_execution_count,
+                        const char* previous_snap_id) {
+  LogSnapRunResult(snap, options, run_result);
+  LOG_ERROR("Seed = ", IntStr(options.seed), " iteration #",
+            IntStr(snap_execution_count));
+  LOG_ERROR("CPU id = ", IntStr(run_result.cpu_id));
+  LOG_ERROR("Previous snapshot [", previous_snap_id, "]");
+  LogSnapHistory(corpus);
+  // Done last since there's a chance this can cause a fault if things
+  // have gone seriously wrong.
+  if (VerifySnapChecksums(snap)) {
+    // Print a positive message so we know it completed.
+    LOG_ERROR("Snap checksums verified");
+  }
+}
+
+// Chained schedule execution:
+//
+// With options.chain_snaps, a schedule is executed by RunSnapChain() as a
+// single chain instead of calling RunSnap() for each snap. Between two snaps
+// in the chain, NextSnapInChain() verifies the end state of the finished snap
+// and prepares memory of the next one. The end state must be verified before
+// the next snap is prepared because snaps in a corpus typically share
+// writable mappings, e.g. the stack.
+
+// State of a schedule executed as a snap chain.
+struct SnapChainSchedule {
+  const SnapCorpus<Host>* corpus;
+  const RunnerMainOptions* options;
+  std::mt19937_64* gen;
+  std::uniform_int_distribution<size_t>* schedule_dist;
+  const size_t* batch;
+
+  // Number of snaps in the schedule not yet started.
+  size_t remaining;
+
+  // Total number of snap executions, including the current one.
+  size_t snap_execution_count;
+
+  // Corpus index of the current snap.
+  size_t snap_index;
+
+  // Result of the current snap.
+  RunSnapResult run_result;
+
+  // Timestamp counter value when the current snap started if
+  // MeasureSnapLatency() is true for the options.
+  uint64_t start_ticks;
+
+  // ID of the last snap that ended as expected.
+  const char* previous_snap_id;
+};
+
+// Picks the next snap in `schedule`, prepares its memory and returns its
+// context.
+const UContext<Host>* StartSnapInChain(SnapChainSchedule& schedule) {
+  --schedule.remaining;
+  const size_t count = schedule.snap_execution_count++;
+  if ((count & (count - 1)) == 0) {
+    VLOG_INFO(1, "iter #", IntStr(count), " of ",
+              IntStr(schedule.options->num_iterations));
+  }
+  schedule.snap_index =
+      schedule.batch[(*schedule.schedule_dist)(*schedule.gen)];
+  const Snap<Host>& snap = *schedule.corpus->snaps[schedule.snap_index];
+  VLOG_INFO(3, "#", IntStr(count), " Running ", snap.id);
+  snap_history.Record(schedule.snap_index);
+  PrepareCorpusSnapMemory(*schedule.corpus, schedule.snap_index);
+  SetSnapExitRegisterGroups(snap);
+  schedule.run_result.cpu_id = GetCPUIdNoSyscall();
+  ArmSnapInstructionBudget();
+  if (MeasureSnapLatency(*schedule.options)) {
+    schedule.start_ticks = ReadTimestampCounter();
+  }
+  return snap.registers;
+}
+
+// SnapChainCallback for RunSnapChain(). `arg` points to a SnapChainSchedule.
+// Ends the chain after the schedule is done or a snap fails.
+const UContext<Host>* NextSnapInChain(void* arg, EndSpot& end_spot) {
+  SnapChainSchedule& schedule = *static_cast<SnapChainSchedule*>(arg);
+  RunSnapResult& run_result = schedule.run_result;
+  if (MeasureSnapLatency(*schedule.options)) {
+    run_result.latency_ticks = ReadTimestampCounter() - schedule.start_ticks;
+  }
+  const Snap<Host>& snap = *schedule.corpus->snaps[schedule.snap_index];
+  run_result.end_spot = end_spot;
+  FinishSnapResult(snap, *schedule.options, run_result);
+  FinishCorpusSnap(*schedule.corpus, schedule.snap_index, run_result);
+  if (run_result.outcome != RunSnapOutcome::kAsExpected) {
+    return nullptr;
+  }
+  schedule.previous_snap_id = snap.id;
+  if (schedule.remaining == 0) {
+    return nullptr;
+  }
+  return StartSnapInChain(schedule);
+}
+
+// Background corpus scrubbing:
+//
+// Strict mode verifies the checksums of all snaps once at startup. This is
+// slow for large corpora and misses corruption that happens later. With
+// options.scrub_interval, RunRandomSchedule() instead verifies a slice of the
+// snaps between schedules after every scrub_interval executions. A round
+// stops after options.scrub_budget_ns but verifies at least one snap, and the
+// next round picks up where it stopped, so the whole corpus is verified over
+// and over. Snaps not mapped under lazy snap mapping are skipped. As in
+// strict mode, a mismatch is fatal.
+
+// Index in the corpus of the next snap to verify. Kept across schedules and,
+// in persistent mode, across commands.
+size_t next_scrub_snap_index = 0;
+
+// Runs one round of scrubbing over `corpus`.
+void ScrubCorpus(const SnapCorpus<Host>& corpus,
+                 const RunnerMainOptions& options) {
+  const uint64_t deadline_ns = MonotonicNanos() + options.scrub_budget_ns;
+  bool ok = true;
+  for (size_t n = 0; n < corpus.snaps.size; ++n) {
+    if (n > 0 && MonotonicNanos() >= deadline_ns) break;
+    const size_t i = next_scrub_snap_index % corpus.snaps.size;
+    next_scrub_snap_index = i + 1;
+    if (lazy_corpus_mapping.states != nullptr &&
+        !lazy_corpus_mapping.states[i].mapped) {
+      continue;
+    }
+    ok &= VerifySnapChecksums(*corpus.snaps[i]);
+  }
+  if (!ok) {
+    LOG_FATAL("Checksum mismatch");
+  }
+}
+
+// Failure budget:
+//
+// With options.max_failures greater than 1, RunRandomSchedule() does not stop
+// at the first failed snap. Each failure is reported and followed by a
+// kFailureEndMarker line. Unless the budget is used up, the checksums of the
+// mapped snaps are then verified again, as a failure may come from corrupted
+// corpus memory rather than from the CPU, and execution goes on with the next
+// schedule.
+
+// Finishes the report of a failed snap and returns true if RunRandomSchedule()
+// should go on after the `num_failures`-th failure.
+bool ContinueAfterFailure(const SnapCorpus<Host>& corpus,
+                          const RunnerMainOptions& options,
+                          uint64_t num_failures) {
+  if (options.max_failures <= 1) return false;
+  LogToStdout(StrCat({kFailureEndMarker, "\n"}));
+  if (num_failures >= options.max_failures) {
+    LOG_ERROR("Failure budget of ", IntStr(options.max_failures), " used up");
+    return false;
+  }
+  bool ok = true;
+  for (size_t i = 0; i < corpus.snaps.size; ++i) {
+    // Snaps that are not mapped have no memory to verify.
+    if (lazy_corpus_mapping.states != nullptr &&
+        !lazy_corpus_mapping.states[i].mapped) {
+      continue;
+    }
+    ok &= VerifySnapChecksums(*corpus.snaps[i]);
+  }
+  if (!ok) {
+    LOG_ERROR("Checksum mismatch after failure, stopping");
+    return false;
+  }
+  return true;
+}
 
+// Executes snaps from `corpus` in randomly generated batches and schedules
+// according to `options`. Returns EXIT_SUCCESS if all executions end as
+// expected or EXIT_FAILURE after options.max_failures failed snaps, or after
+// the last iteration if there were fewer failures.
+int RunRandomSchedule(const SnapCorpus<Host>* corpus,
+                      const RunnerMainOptions& options) {
   std::mt19937_64 gen(options.seed);  // 64-bit Mersenne Twister engine
   VLOG_INFO(1, "Seed = ", IntStr(options.seed));
   size_t snap_execution_count = 0;
   const char* previous_snap_id = "<none>";
+  uint64_t num_failures = 0;
+  uint64_t next_scrub_execution_count = options.scrub_interval;
+  uint64_t next_reweight_execution_count = 4 * corpus->snaps.size;
+  snap_history.Clear();
   while (snap_execution_count < options.num_iterations) {
+    if (options.weighted_schedule &&
+        snap_execution_count >= next_reweight_execution_count) {
+      ReweightSnapSampler();
+      next_reweight_execution_count = 2 * snap_execution_count;
+    }
+    if (options.scrub_interval != 0 &&
+        snap_execution_count >= next_scrub_execution_count) {
+      ScrubCorpus(*corpus, options);
+      next_scrub_execution_count =
+          snap_execution_count + options.scrub_interval;
+    }
+
     // Generate Snap batch
     size_t batch[RunnerMainOptions::kMaxBatchSize];
     size_t batch_size = options.batch_size;
     CHECK_LE(batch_size, RunnerMainOptions::kMaxBatchSize);
     std::uniform_int_distribution<size_t> dist(0, corpus->snaps.size - 1);
+    std::uniform_int_distribution<uint64_t> percent_dist(0, 99);
     for (size_t i = 0; i < batch_size; ++i) {
-      batch[i] = dist(gen);
+      if (i > 0 && options.batch_mixing_percent < 100 &&
+          percent_dist(gen) >= options.batch_mixing_percent) {
+        batch[i] = SampleSnapInClassOf(batch[0], gen);
+        continue;
+      }
+      batch[i] = options.weighted_schedule ? weighted_snap_sampler.Sample(gen)
+                                           : dist(gen);
     }
 
+    const CountedBatch counted_batch;
+
     // Adjust schedule size to honor options.num_iterations.
     size_t remaining_iterations = options.num_iterations - snap_execution_count;
     size_t schedule_size =
         std::min<size_t>(options.schedule_size, remaining_iterations);
 
     std::uniform_int_distribution<size_t> schedule_dist(0, batch_size - 1);
+    if (options.chain_snaps) {
+      SnapChainSchedule schedule = {
+          .corpus = corpus,
+          .options = &options,
+          .gen = &gen,
+          .schedule_dist = &schedule_dist,
+          .batch = batch,
+          .remaining = schedule_size,
+          .snap_execution_count = snap_execution_count,
+          .previous_snap_id = previous_snap_id,
+      };
+      const UContext<Host>* first_context = StartSnapInChain(schedule);
+      RunSnapChain(*first_context, options, NextSnapInChain, &schedule);
+      if (schedule.run_result.outcome != RunSnapOutcome::kAsExpected) {
+        LogScheduleFailure(*corpus, *corpus->snaps[schedule.snap_index],
+                           options, schedule.run_result,
+                           schedule.snap_execution_count - 1,
+                           schedule.previous_snap_id);
+        if (!ContinueAfterFailure(*corpus, options, ++num_failures)) {
+          return EXIT_FAILURE;
+        }
+      }
+      // The rest of a failed schedule is dropped.
+      snap_execution_count = schedule.snap_execution_count;
+      previous_snap_id = schedule.previous_snap_id;
+      continue;
+    }
     for (size_t i = 0; i < schedule_size; ++i, ++snap_execution_count) {
       if ((snap_execution_count & (snap_execution_count - 1)) == 0) {
         VLOG_INFO(1, "iter #", IntStr(snap_execution_count), " of ",
                   IntStr(options.num_iterations));
       }
-      const Snap<Host>& snap = *(corpus->snaps[batch[schedule_dist(gen)]]);
+      const size_t snap_index = batch[schedule_dist(gen)];
+      const Snap<Host>& snap = *(corpus->snaps[snap_index]);
       VLOG_INFO(3, "#", IntStr(snap_execution_count), " Running ", snap.id);
+      snap_history.Record(snap_index);
       RunSnapResult run_result;
-      RunSnap(snap, options, run_result);
+      RunCorpusSnap(*corpus, snap_index, options, run_result);
       if (run_result.outcome != RunSnapOutcome::kAsExpected) {
-        LogSnapRunResult(snap, options, run_result);
-        LOG_ERROR("Seed = ", IntStr(options.seed), " iteration #",
-                  IntStr(snap_execution_count));
-        LOG_ERROR("CPU id = ", IntStr(run_result.cpu_id));
-        LOG_ERROR("Previous snapshot [", previous_snap_id, "]");
-        // Done last since there's a chance this can cause a fault if things
-        // have gone seriously wrong.
-        if (VerifySnapChecksums(snap)) {
-          // Print a positive message so we know it completed.
-          LOG_ERROR("Snap checksums verified");
+        LogScheduleFailure(*corpus, snap, options, run_result,
+                           snap_execution_count, previous_snap_id);
+        if (!ContinueAfterFailure(*corpus, options, ++num_failures)) {
+          return EXIT_FAILURE;
         }
-        return EXIT_FAILURE;
+        // Go on with the next schedule.
+        ++snap_execution_count;
+        break;
       }
       previous_snap_id = snap.id;
     }
   }
 
+  return num_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Reads a persistent mode command from stdin. A command is a line containing
+// the number of iterations and the random seed separated by a single space.
+// Returns false on EOF or if the command is malformed.
+bool ReadPersistentModeCommand(uint64_t& num_iterations, uint64_t& seed) {
+  char line[64];
+  size_t length = 0;
+  while (true) {
+    char c;
+    ssize_t r = read(STDIN_FILENO, &c, 1);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    if (c == '\n') break;
+    if (length == sizeof(line)) {
+      LOG_ERROR("Persistent mode command too long");
+      return false;
+    }
+    line[length++] = c;
+  }
+  const char* separator =
+      static_cast<const char*>(memchr(line, ' ', length));
+  if (separator == nullptr ||
+      !DecToU64(line, separator - line, &num_iterations) ||
+      !DecToU64(separator + 1, line + length - separator - 1, &seed)) {
+    LOG_ERROR("Malformed persistent mode command");
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int RunnerMain(const RunnerMainOptions& options) {
+  CHECK(!options.sequential_mode);
+  const SnapCorpus<Host>* corpus = CommonMain(options);
+  // Like an empty corpus file, see Main() in runner_main.cc.
+  if (NoSnapsToRun(*corpus)) return EXIT_SUCCESS;
+
+  EnterSeccompFilterMode(SeccompOptionsFromRunnerMainOptions(options));
+  const int exit_code = RunRandomSchedule(corpus, options);
+  LogAndClearSnapLatencyHistograms();
+  LogAndClearPerfCounters();
+  return exit_code;
+}
+
+int RunnerMainPersistent(const RunnerMainOptions& options) {
+  CHECK(!options.sequential_mode);
+  const SnapCorpus<Host>* corpus = CommonMain(options);
+  if (NoSnapsToRun(*corpus)) return EXIT_SUCCESS;
+
+  SeccompOptions seccomp_options = SeccompOptionsFromRunnerMainOptions(options);
+  seccomp_options.allow_read_stdin = true;
+  EnterSeccompFilterMode(seccomp_options);
+  VLOG_INFO(1, "Running in persistent mode");
+
+  RunnerMainOptions command_options = options;
+  while (ReadPersistentModeCommand(command_options.num_iterations,
+                                   command_options.seed)) {
+    const int exit_code = RunRandomSchedule(corpus, command_options);
+    LogAndClearSnapLatencyHistograms();
+    LogAndClearPerfCounters();
+    // The end marker is a text proto comment so that it does not interfere
+    // with parsing of any SnapshotExecutionResult printed before it.
+    LogToStdout(StrCat({"\n", kPersistentModeEndMarker, IntStr(exit_code),
+                        "\n"}));
+  }
   return EXIT_SUCCESS;
 }
 
@@ -824,21 +2636,197 @@ int RunnerMainSequential(const RunnerMainOptions& options) {
   EnterSeccompFilterMode(SeccompOptionsFromRunnerMainOptions(options));
   VLOG_INFO(1, "Running in sequential mode");
 
-  for (size_t i = 0; i < corpus->snaps.size; ++i) {
+  // Range boundaries are rounded down so that the ranges cover the corpus
+  // without gaps or overlap.
+  CHECK_LT(options.snap_range_index, options.num_snap_ranges);
+  const size_t begin =
+      corpus->snaps.size * options.snap_range_index / options.num_snap_ranges;
+  const size_t end = corpus->snaps.size * (options.snap_range_index + 1) /
+                     options.num_snap_ranges;
+  for (size_t i = begin; i < end; ++i) {
     const Snap<Host>& snap = *(corpus->snaps[i]);
-    if ((i & (i - 1)) == 0) {
-      VLOG_INFO(1, "iter #", IntStr(i), " of ", IntStr(corpus->snaps.size));
+    if (((i - begin) & (i - begin - 1)) == 0) {
+      VLOG_INFO(1, "iter #", IntStr(i), " of [", IntStr(begin), ", ",
+                IntStr(end), ")");
     }
     VLOG_INFO(3, "#", IntStr(i), " Running ", snap.id);
     RunSnapResult run_result;
-    RunSnap(snap, options, run_result);
+    RunCorpusSnap(*corpus, i, options, run_result);
     if (run_result.outcome != RunSnapOutcome::kAsExpected) {
       LogSnapRunResult(snap, options, run_result);
       LOG_ERROR("Id = ", snap.id, " Iteration #", IntStr(i));
+      LogAndClearSnapLatencyHistograms();
+      return EXIT_FAILURE;
+    }
+  }
+
+  LogAndClearSnapLatencyHistograms();
+  return EXIT_SUCCESS;
+}
+
+int RunnerMainReplay(const RunnerMainOptions& options) {
+  CHECK(!options.sequential_mode);
+  const SnapCorpus<Host>* corpus = CommonMain(options);
+
+  EnterSeccompFilterMode(SeccompOptionsFromRunnerMainOptions(options));
+  VLOG_INFO(1, "Replaying ", IntStr(options.num_replay_snap_ids), " snaps");
+
+  for (size_t i = 0; i < options.num_replay_snap_ids; ++i) {
+    const size_t snap_index = corpus->FindIndex(options.replay_snap_ids[i]);
+    if (snap_index == corpus->snaps.size) {
+      LOG_FATAL("Snap ", options.replay_snap_ids[i],
+                " not found in the corpus");
+    }
+    const Snap<Host>& snap = *(corpus->snaps[snap_index]);
+    VLOG_INFO(3, "#", IntStr(i), " Running ", snap.id);
+    RunSnapResult run_result;
+    RunCorpusSnap(*corpus, snap_index, options, run_result);
+    if (run_result.outcome != RunSnapOutcome::kAsExpected) {
+      LogSnapRunResult(snap, options, run_result);
+      LOG_ERROR("Id = ", snap.id, " Replay #", IntStr(i));
+      LogAndClearSnapLatencyHistograms();
       return EXIT_FAILURE;
     }
   }
 
+  LogAndClearSnapLatencyHistograms();
+  return EXIT_SUCCESS;
+}
+
+namespace {
+
+// Maximum length of a zygote request line and maximum number of arguments in
+// it.
+constexpr size_t kMaxZygoteRequestSize = 4096;
+constexpr size_t kMaxZygoteArgs = 64;
+
+// A parsed zygote request. The arguments point into `line`.
+struct ZygoteRequest {
+  uint64_t cpu_time_budget_s;
+  uint64_t wall_time_budget_ms;
+  int argc;
+  char* argv[kMaxZygoteArgs + 2];
+  char line[kMaxZygoteRequestSize + 1];
+};
+
+// Splits `length` bytes at `line` into tokens separated by single spaces,
+// NUL-terminating each. Stores up to `max_tokens` of them in `tokens` and
+// returns their number or -1 if there are more or an empty token.
+int TokenizeZygoteRequest(char* line, size_t length, char* tokens[],
+                          size_t max_tokens) {
+  size_t num_tokens = 0;
+  size_t begin = 0;
+  for (size_t i = 0; i <= length; ++i) {
+    if (i < length && line[i] != ' ') continue;
+    if (i == begin || num_tokens == max_tokens) return -1;
+    line[i] = '\0';
+    tokens[num_tokens++] = line + begin;
+    begin = i + 1;
+  }
+  return num_tokens;
+}
+
+// Reads a zygote request from stdin into `request`. `program_name` becomes
+// argv[0] of the request. Returns false on EOF or if the request is malformed.
+bool ReadZygoteRequest(const char* program_name, ZygoteRequest& request) {
+  size_t length = 0;
+  while (true) {
+    char c;
+    ssize_t r = read(STDIN_FILENO, &c, 1);
+    if (r < 0 && errno == EINTR) continue;
+    if (r <= 0) return false;
+    if (c == '\n') break;
+    if (length == kMaxZygoteRequestSize) {
+      LOG_ERROR("Zygote request too long");
+      return false;
+    }
+    request.line[length++] = c;
+  }
+  // The budgets come before the arguments.
+  char* tokens[kMaxZygoteArgs + 2];
+  const int num_tokens = TokenizeZygoteRequest(request.line, length, tokens,
+                                               kMaxZygoteArgs + 2);
+  if (num_tokens < 2 ||
+      !DecToU64(tokens[0], strlen(tokens[0]), &request.cpu_time_budget_s) ||
+      !DecToU64(tokens[1], strlen(tokens[1]), &request.wall_time_budget_ms)) {
+    LOG_ERROR("Malformed zygote request");
+    return false;
+  }
+  request.argc = num_tokens - 1;
+  request.argv[0] = const_cast<char*>(program_name);
+  for (int i = 1; i < request.argc; ++i) {
+    request.argv[i] = tokens[i + 1];
+  }
+  request.argv[request.argc] = nullptr;
+  return true;
+}
+
+// Applies the budgets of `request` to the calling process like RunnerDriver
+// does for a spawned runner, see "Signal handling" above. A budget of 0 means
+// no limit.
+void SetZygoteChildLimits(const ZygoteRequest& request) {
+  if (request.cpu_time_budget_s != 0) {
+    struct kernel_rlimit rlimit = {
+        .rlim_cur = request.cpu_time_budget_s,
+        .rlim_max = request.cpu_time_budget_s + 1,
+    };
+    if (sys_setrlimit(RLIMIT_CPU, &rlimit) != 0) {
+      LOG_FATAL("setrlimit() failed: ", ErrnoStr(errno));
+    }
+  }
+  if (request.wall_time_budget_ms != 0) {
+    struct kernel_itimerval timer = {};
+    timer.it_value.tv_sec = request.wall_time_budget_ms / 1000;
+    timer.it_value.tv_usec = (request.wall_time_budget_ms % 1000) * 1000;
+    if (sys_setitimer(ITIMER_REAL, &timer, nullptr) != 0) {
+      LOG_FATAL("setitimer() failed: ", ErrnoStr(errno));
+    }
+  }
+}
+
+}  // namespace
+
+int ZygoteMain(const char* program_name, int (*child_main)(int, char*[])) {
+  InitRunnerProcess();
+  // SigAction() treats any signal outside of a snap as fatal, so the zygote
+  // keeps SIGCHLD of its exiting children blocked. The children get the
+  // original mask back.
+  kernel_sigset_t sigchld_mask, child_mask;
+  sys_sigemptyset(&sigchld_mask);
+  sys_sigaddset(&sigchld_mask, SIGCHLD);
+  if (sys_sigprocmask(SIG_BLOCK, &sigchld_mask, &child_mask) != 0) {
+    LOG_FATAL("sigprocmask() failed: ", ErrnoStr(errno));
+  }
+  // Forked children inherit the handlers, the alternate signal stack and
+  // no_new_privs. The seccomp filter is still entered by each child as it
+  // depends on the options and must come after mapping the corpus.
+  InstallSigHandler();
+  SetNoNewPrivs();
+  VLOG_INFO(1, "Running as a zygote");
+
+  static ZygoteRequest request;
+  while (ReadZygoteRequest(program_name, request)) {
+    const pid_t pid = sys_fork();
+    if (pid < 0) {
+      LOG_FATAL("fork() failed: ", ErrnoStr(errno));
+    }
+    if (pid == 0) {
+      // Do not outlive the zygote, which is killed with its parent.
+      CHECK_EQ(prctl(PR_SET_PDEATHSIG, SIGKILL, 0, 0, 0), 0);
+      // Requests are for the zygote only.
+      close(STDIN_FILENO);
+      CHECK_EQ(sys_sigprocmask(SIG_SETMASK, &child_mask, nullptr), 0);
+      SetZygoteChildLimits(request);
+      _exit(child_main(request.argc, request.argv));
+    }
+    int status;
+    while (sys_wait4(pid, &status, 0, nullptr) < 0) {
+      if (errno != EINTR) {
+        LOG_FATAL("wait4() failed: ", ErrnoStr(errno));
+      }
+    }
+    LogToStdout(StrCat({"\n", kZygoteEndMarker, IntStr(status), "\n"}));
+  }
   return EXIT_SUCCESS;
 }
 
@@ -21,6 +21,7 @@
 
 #include "./runner/endspot.h"
 #include "./runner/runner_main_options.h"
+#include "./runner/stdout_markers.h"
 #include "./snap/snap.h"
 #include "./util/arch.h"
 
@@ -58,16 +59,35 @@ struct RunSnapResult {
   // CPU id (as in getcpu(2)) where the snapshot ran or
   // silifuzz::kUnknownCPUId if it couldn't be determined.
   int64_t cpu_id;
+
+  // Timestamp counter ticks spent in executing the snapshot. Only set when
+  // RunnerMainOptions::collect_snap_latency or weighted_schedule is true.
+  uint64_t latency_ticks = 0;
 };
 
-// Establishes memory mappings in 'corpus'.
+// Returns the CLOCK_MONOTONIC time in nanoseconds.
+uint64_t MonotonicNanos();
+
+// Establishes memory mappings in 'corpus'. Snaps that conflict with the
+// runner's own memory mappings are skipped and reported on stdout. Returns the
+// corpus of mapped snaps, which is 'corpus' itself if nothing is skipped.
 // Takes ownership of 'corpus_fd' and closes it after the corpus is mapped.
 // If the corpus is not backed by a file object, 'corpus_fd' may be -1.
 // 'corpus_mapping' points to the address where corpus_fd is mapped. This is
 // usually identical to the SnapCorpus pointer. This value can be NULL if
 // corpus_fd == -1.
-void MapCorpus(const SnapCorpus<Host>& corpus, int corpus_fd,
-               const void* corpus_mapping);
+const SnapCorpus<Host>* MapCorpus(const SnapCorpus<Host>& corpus,
+                                  int corpus_fd, const void* corpus_mapping);
+
+// Copies the initial contents of the writable memory of 'snap' into place.
+// RunSnap() calls this. Exposed for benchmarking.
+void PrepareSnapMemory(const Snap<Host>& snap);
+
+// Returns the outcome of 'snap' reaching 'end_spot' by comparing it with the
+// expected end state of 'snap'. RunSnap() calls this. Exposed for
+// benchmarking.
+RunSnapOutcome EndSpotToOutcome(const Snap<Host>& snap,
+                                const EndSpot& end_spot);
 
 // Executes 'snap' with 'options' and stores the execution result in 'result'.
 // REQUIRES: the runtime environment, including memory mapping used by 'snap'
@@ -93,13 +113,50 @@ void RunSnap(const Snap<Host>& snap, const RunnerMainOptions& options,
 //
 int RunnerMain(const RunnerMainOptions& options);
 
+// Similar to RunnerMain() but runs in "persistent" mode. See FLAGS_persistent
+// for details.
+//
+// The corpus is loaded and mapped once. The runner then reads commands from
+// stdin, one per line, each containing the number of iterations and the
+// random seed separated by a space. For each command it executes snaps as
+// RunnerMain() does and then prints kPersistentModeEndMarker followed by the
+// exit code RunnerMain() would have returned and a newline. A failed snap is
+// reported on stdout before the end marker as in RunnerMain(). The runner
+// exits on EOF of stdin.
+int RunnerMainPersistent(const RunnerMainOptions& options);
+
 // Similar to RunnerMain() but runs in "sequential" mode. See
 // FLAGS_sequential_mode for details.
 int RunnerMainSequential(const RunnerMainOptions& options);
 
+// Similar to RunnerMain() but runs the snaps in options.replay_snap_ids once
+// each in that order, as RunnerMainSequential() runs the whole corpus. Used to
+// reproduce a failure from the snap history RunnerMain() logs with it. See
+// FLAGS_replay for details.
+int RunnerMainReplay(const RunnerMainOptions& options);
+
 // Similar to RunnerMain() but runs in "make" mode. See FLAGS_make for details.
 int MakerMain(const RunnerMainOptions& options);
 
+// Runs as a zygote. See FLAGS_zygote for details.
+//
+// Does the runner initialization that depends on neither the corpus nor the
+// flags once and then reads requests from stdin, one per line. A request is
+// the CPU time budget in seconds, the wall time budget in milliseconds and
+// the runner arguments, all separated by single spaces. A budget of 0 means
+// no limit. For each request the zygote forks a child, which applies the
+// budgets and returns `child_main` called with the arguments preceded by
+// `program_name`. The child runs like a freshly started runner but skips the
+// initialization already done by the zygote, including the signal handlers
+// and no_new_privs. The seccomp filter is entered by the child as it depends
+// on the child's options.
+//
+// After the child exits the zygote prints kZygoteEndMarker followed by the
+// wait status of the child and a newline. Anything the child prints on
+// stdout comes before the end marker. The zygote exits on EOF of stdin and
+// its children are killed when it dies.
+int ZygoteMain(const char* program_name, int (*child_main)(int, char*[]));
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_RUNNER_RUNNER_H_
@@ -0,0 +1,281 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmark of the per-snap work done by the runner.
+//
+// To run:
+//
+// bazel run -c opt third_party/silifuzz/runner:runner_benchmark_nolibc \
+//     [-- <corpus file> [<snap id>...]]
+//
+// Without a corpus file argument, the test corpus in $TEST_CORPUS is used.
+// Snaps from the corpus are picked by the snap ID arguments that follow the
+// corpus file and default to the kEndsAsExpected test snap.
+//
+// Like util/mem_util_benchmark.cc, this has no gunit benchmarking support in
+// the nolibc environment and measures time itself. It reports ns/snap for
+//
+//   * PrepareSnapMemory() and EndSpotToOutcome() on synthetic snaps with one
+//     writable mapping of varying size, both with literal and with repeating
+//     memory bytes.
+//   * GetRegisterGroupsChecksum() for the checksummed register groups of the
+//     current platform.
+//   * Entering and exiting the selected corpus snaps, i.e.
+//     RestoreUContextNoSyscalls() into the snap and the snap exit sequence,
+//     including saving the checksummed register groups.
+//   * The whole RunSnap() cycle for the selected corpus snaps.
+//   * The per-snap progress logging of the runner's main loops at the default
+//     verbosity.
+//
+// release_runner_benchmark_nolibc is the same benchmark built like
+// release_reading_runner_main, i.e. with VLOG_INFO() above level 0 compiled
+// out. Comparing the two shows what the release runner saves per snap.
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "./common/snapshot_test_enum.h"
+#include "./runner/default_snap_corpus.h"
+#include "./runner/endspot.h"
+#include "./runner/runner.h"
+#include "./runner/runner_main_options.h"
+#include "./runner/snap_runner_util.h"
+#include "./snap/exit_sequence.h"
+#include "./snap/snap.h"
+#include "./snap/snap_checksum.h"
+#include "./util/arch.h"
+#include "./util/checks.h"
+#include "./util/itoa.h"
+#include "./util/page_util.h"
+#include "./util/reg_group_io.h"
+#include "./util/reg_groups.h"
+#include "./util/ucontext/ucontext_types.h"
+
+namespace silifuzz {
+namespace {
+
+// This is built for the nolibc environment, there is no memory allocator.
+// Use static buffers for the synthetic snaps.
+constexpr size_t kMaxSyntheticSnapSize = 1 << 20;
+alignas(kPageSize) char synthetic_snap_memory[kMaxSyntheticSnapSize];
+alignas(kPageSize) char synthetic_snap_data[kMaxSyntheticSnapSize];
+
+// Returns the average ns spent in one call of `func` over about 1 second.
+template <typename Func>
+uint64_t MeasureNanosPerIteration(Func func) {
+  // Estimate roughly number of iterations in 1ms.
+  constexpr uint64_t kNanosPerMilli = 1000000;
+  size_t num_iterations_in_1ms = 1;
+  uint64_t elapsed_nanos = 0;
+  for (num_iterations_in_1ms = 1; elapsed_nanos < kNanosPerMilli;
+       num_iterations_in_1ms <<= 1) {
+    const uint64_t start_nanos = MonotonicNanos();
+    for (size_t i = 0; i < num_iterations_in_1ms; ++i) {
+      func();
+    }
+    elapsed_nanos = MonotonicNanos() - start_nanos;
+  }
+
+  // Benchmark for about 1 second.
+  constexpr uint64_t kNanosPerSec = 1000000000;
+  const size_t num_iterations =
+      num_iterations_in_1ms * kNanosPerSec / (elapsed_nanos + 1) + 1;
+  const uint64_t start_nanos = MonotonicNanos();
+  for (size_t i = 0; i < num_iterations; ++i) {
+    func();
+  }
+  return (MonotonicNanos() - start_nanos) / num_iterations;
+}
+
+// Logs the result of MeasureNanosPerIteration(func) under `name`.
+template <typename Func>
+void RunBenchmark(const char* name, Func func) {
+  LOG_INFO(name, " : ", IntStr(MeasureNanosPerIteration(func)), " ns/snap");
+}
+
+// The progress logging done for every snap in RunRandomSchedule() and the
+// other main loops of the runner.
+void BenchmarkProgressLogging() {
+  uint64_t count = 0;
+  RunBenchmark("Progress logging", [&count]() {
+    ++count;
+    if ((count & (count - 1)) == 0) {
+      VLOG_INFO(1, "iter #", IntStr(count));
+    }
+    VLOG_INFO(3, "#", IntStr(count), " Running snap");
+  });
+}
+
+// A snap with a single writable mapping of `size` bytes and no code. Only
+// good for PrepareSnapMemory() and EndSpotToOutcome().
+class SyntheticSnap {
+ public:
+  // If `repeating` is true, the memory bytes are a run of zeros. Otherwise,
+  // they are literal bytes.
+  SyntheticSnap(size_t size, bool repeating) {
+    CHECK_LE(size, kMaxSyntheticSnapSize);
+    memory_bytes_.start_address =
+        reinterpret_cast<uintptr_t>(synthetic_snap_memory);
+    if (repeating) {
+      memory_bytes_.flags = SnapMemoryBytes::kRepeating;
+      memory_bytes_.data.byte_run = {.value = 0, .size = size};
+    } else {
+      memory_bytes_.data.byte_values = {
+          .size = size,
+          .elements = reinterpret_cast<const uint8_t*>(synthetic_snap_data)};
+    }
+    mapping_.start_address = memory_bytes_.start_address;
+    mapping_.num_bytes = RoundUpToPageAlignment(size);
+    mapping_.perms = PROT_READ | PROT_WRITE;
+    mapping_.memory_bytes = {.size = 1, .elements = &memory_bytes_};
+
+    memset(&registers_, 0, sizeof(registers_));
+    snap_.id = "synthetic";
+    snap_.memory_mappings = {.size = 1, .elements = &mapping_};
+    snap_.registers = &registers_;
+    snap_.end_state_registers = &registers_;
+    // The end state is the initial state so that EndSpotToOutcome() takes
+    // the fast as-expected path.
+    snap_.end_state_memory_bytes = {.size = 1, .elements = &memory_bytes_};
+    // The rest of the mapping is never written.
+    snap_.end_state_unchanged_memory_checksum = CalculateMemoryChecksum(
+        synthetic_snap_memory + size, mapping_.num_bytes - size);
+    snap_.end_state_register_checksum = {};
+    snap_.platform_end_states = {};
+
+    end_spot_gregs_ = registers_.gregs;
+    end_spot_fpregs_ = registers_.fpregs;
+    end_spot_.signum = 0;
+    end_spot_.sig_address = 0;
+    end_spot_.gregs = &end_spot_gregs_;
+    end_spot_.fpregs = &end_spot_fpregs_;
+    end_spot_.register_checksum = {};
+  }
+
+  // Not copyable or movable, snap_ points into *this.
+  SyntheticSnap(const SyntheticSnap&) = delete;
+  SyntheticSnap& operator=(const SyntheticSnap&) = delete;
+
+  const Snap<Host>& snap() const { return snap_; }
+  const EndSpot& end_spot() const { return end_spot_; }
+
+ private:
+  SnapMemoryBytes memory_bytes_;
+  SnapMemoryMapping mapping_;
+  UContext<Host> registers_;
+  Snap<Host> snap_;
+  EndSpot::gregs_t end_spot_gregs_;
+  EndSpot::fpregs_t end_spot_fpregs_;
+  EndSpot end_spot_;
+};
+
+void BenchmarkSyntheticSnaps() {
+  constexpr size_t kSizes[] = {kPageSize, 16 * kPageSize,
+                               kMaxSyntheticSnapSize};
+  for (size_t i = 0; i < sizeof(synthetic_snap_data); ++i) {
+    synthetic_snap_data[i] = i % 251;  // prime.
+  }
+  for (size_t size : kSizes) {
+    for (bool repeating : {false, true}) {
+      LOG_INFO("Synthetic snap: ", IntStr(size), "B of ",
+               repeating ? "repeating" : "literal", " bytes");
+      const SyntheticSnap synthetic(size, repeating);
+      const Snap<Host>& snap = synthetic.snap();
+      RunBenchmark("PrepareSnapMemory",
+                   [&snap]() { PrepareSnapMemory(snap); });
+      CHECK(EndSpotToOutcome(snap, synthetic.end_spot()) ==
+            RunSnapOutcome::kAsExpected);
+      RunBenchmark("EndSpotToOutcome", [&snap, &synthetic]() {
+        RunSnapOutcome outcome = EndSpotToOutcome(snap, synthetic.end_spot());
+        // Use a dummy assembly statement to avoid the call above being
+        // optimized away.
+        asm volatile("" : : "m"(outcome));
+      });
+    }
+  }
+}
+
+void BenchmarkRegisterChecksum() {
+  LOG_INFO("Register checksum");
+  static RegisterGroupIOBuffer<Host> buffer;
+  buffer.register_groups = GetCurrentPlatformChecksumRegisterGroups();
+  RunBenchmark("GetRegisterGroupsChecksum", []() {
+    RegisterChecksum<Host> checksum = GetRegisterGroupsChecksum(buffer);
+    asm volatile("" : : "m"(checksum));
+  });
+}
+
+// Benchmarks the snap with `snap_id` in `corpus`, which must end as
+// expected. There is no runaway or signal handling here, so running arbitrary
+// snaps is not safe.
+void BenchmarkCorpusSnap(const SnapCorpus<Host>& corpus, const char* snap_id) {
+  const Snap<Host>* snap = corpus.Find(snap_id);
+  if (snap == nullptr) {
+    LOG_FATAL("Cannot find snap with ID: ", snap_id);
+  }
+  const RunnerMainOptions options = RunnerMainOptions::Default();
+  RunSnapResult result;
+  RunSnap(*snap, options, result);
+  if (result.outcome != RunSnapOutcome::kAsExpected) {
+    LOG_FATAL("Snap ", snap_id, " did not end as expected");
+  }
+
+  LOG_INFO("Corpus snap: ", snap_id);
+  RunBenchmark("Enter and exit", [snap, &options]() {
+    EndSpot end_spot;
+    RunSnap(*snap->registers, options, end_spot);
+  });
+  RunBenchmark("RunSnap", [snap, &options]() {
+    RunSnapResult run_result;
+    RunSnap(*snap, options, run_result);
+  });
+}
+
+// Usage: runner_benchmark [<corpus file> [<snap id>...]]
+int BenchmarkMain(int argc, char* argv[]) {
+  InitSnapExit(&SnapExitImpl);
+  InitRegisterGroupIO();
+  SelectSnapExitRegisterGroups(GetCurrentPlatformChecksumRegisterGroups());
+
+  BenchmarkSyntheticSnaps();
+  BenchmarkRegisterChecksum();
+  BenchmarkProgressLogging();
+
+  const char* corpus_file = argc > 1 ? argv[1] : getenv("TEST_CORPUS");
+  if (corpus_file == nullptr) {
+    LOG_INFO("No corpus given, skipping corpus snaps");
+    return 0;
+  }
+  const SnapCorpus<Host>* corpus = LoadCorpus(corpus_file, true, nullptr);
+  MapCorpus(*corpus, -1, nullptr);
+  if (argc > 2) {
+    for (int i = 2; i < argc; ++i) {
+      BenchmarkCorpusSnap(*corpus, argv[i]);
+    }
+  } else {
+    BenchmarkCorpusSnap(*corpus, EnumStr(TestSnapshot::kEndsAsExpected));
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace silifuzz
+
+int main(int argc, char* argv[]) {
+  return silifuzz::BenchmarkMain(argc, argv);
+}
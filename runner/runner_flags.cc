@@ -38,9 +38,35 @@ bool FLAGS_enable_tracer = false;
 size_t FLAGS_batch_size = RunnerMainOptions::kDefaultBatchSize;
 size_t FLAGS_schedule_size = RunnerMainOptions::kDefaultScheduleSize;
 bool FLAGS_sequential_mode = false;
+uint64_t FLAGS_snap_range_index = 0;
+uint64_t FLAGS_num_snap_ranges = 1;
+uint64_t FLAGS_max_failures = 1;
 bool FLAGS_skip_end_state_check = false;
 bool FLAGS_strict = false;
+bool FLAGS_incremental_memory_restore = false;
+bool FLAGS_chain_snaps = false;
+bool FLAGS_collect_snap_latency = false;
+bool FLAGS_report_startup_timings = false;
+bool FLAGS_weighted_schedule = false;
+uint64_t FLAGS_batch_mixing_percent = 100;
+bool FLAGS_lazy_map_snaps = false;
+uint64_t FLAGS_max_mapped_snaps_mb = 0;
+uint64_t FLAGS_scrub_interval = 0;
+uint64_t FLAGS_scrub_budget_us = 100;
+bool FLAGS_prefault_snap_mappings = false;
+bool FLAGS_lock_snap_mappings = false;
+uint64_t FLAGS_corpus_load_address = 0;
+uint64_t FLAGS_cpu_features = 0;
+int FLAGS_platform_id = 0;
+bool FLAGS_persistent = false;
+bool FLAGS_zygote = false;
 uint64_t FLAGS_max_pages_to_add = 0;
+int FLAGS_result_fd = -1;
+const char* FLAGS_tombstones = nullptr;
+const char* FLAGS_replay = nullptr;
+const char* FLAGS_perf_counters = nullptr;
+uint64_t FLAGS_snap_instruction_budget = 0;
+const char* FLAGS_snap_instruction_budget_event = nullptr;
 
 // Print all flags and exit.
 void ShowUsage(const char* program_name) {
@@ -61,14 +87,90 @@ void ShowUsage(const char* program_name) {
   LOG_INFO("  --batch_size [size]\tSnap execution batch size.");
   LOG_INFO("  --schedule_size [size]\tSnap execution schedule size.");
   LOG_INFO("  --sequential_mode\tRun Snaps sequentially once.");
+  LOG_INFO(
+      "  --snap_range_index [index]\tRun only this range of snaps in "
+      "sequential mode.");
+  LOG_INFO(
+      "  --num_snap_ranges [count]\tNumber of ranges the corpus is split "
+      "into in sequential mode.");
+  LOG_INFO(
+      "  --max_failures [count]\tStop after this many failed snaps "
+      "(default 1).");
   LOG_INFO(
       "  --skip_end_state_check\tDo not check end state after snap execution.");
   LOG_INFO(
       "  --strict\tPerform additional integrity checking. May slow down "
       "execution.");
+  LOG_INFO(
+      "  --incremental_memory_restore\tRestore only memory modified by the "
+      "previous execution of a snap.");
+  LOG_INFO(
+      "  --chain_snaps\tExecute each snap schedule as a single chain of "
+      "snaps.");
+  LOG_INFO(
+      "  --collect_snap_latency\tPrint per-snap latency histograms to "
+      "stdout.");
+  LOG_INFO(
+      "  --report_startup_timings\tPrint the time spent in each startup "
+      "phase to stdout.");
+  LOG_INFO(
+      "  --weighted_schedule\tPick snaps with probability inversely "
+      "proportional to their measured latency.");
+  LOG_INFO(
+      "  --batch_mixing_percent [value]\tPercentage of snaps in a batch "
+      "picked regardless of the registers their code uses (default 100).");
+  LOG_INFO(
+      "  --lazy_map_snaps\tMap memory of snaps when they are first "
+      "scheduled.");
+  LOG_INFO(
+      "  --max_mapped_snaps_mb [value]\tMemory budget for --lazy_map_snaps. "
+      "0 means unlimited.");
+  LOG_INFO(
+      "  --scrub_interval [count]\tVerify checksums of a few snaps after "
+      "every this many snap executions. 0 (default) disables this.");
+  LOG_INFO(
+      "  --scrub_budget_us [value]\tTime budget of each round of "
+      "--scrub_interval in microseconds (default 100).");
+  LOG_INFO(
+      "  --prefault_snap_mappings\tPopulate snap memory mappings at "
+      "startup.");
+  LOG_INFO("  --lock_snap_mappings\tLock snap memory mappings in memory.");
+  LOG_INFO(
+      "  --corpus_load_address [hex value]\tAddress the corpus file has been "
+      "relocated to.");
+  LOG_INFO(
+      "  --cpu_features [hex value]\tCPU features of the host probed by the "
+      "parent process.");
+  LOG_INFO(
+      "  --platform_id [value]\tPlatformId of the host, selects the expected "
+      "end state.");
+  LOG_INFO(
+      "  --persistent\tRun commands read from stdin until EOF without "
+      "remapping the corpus.");
+  LOG_INFO(
+      "  --zygote\tFork a runner for each request read from stdin until "
+      "EOF.");
   LOG_INFO(
       "  --max_pages_to_add [value]\tMaximum number of r/w pages added in snap "
       "making.");
+  LOG_INFO(
+      "  --result_fd [value]\tWrite the end state of a failed snap to this "
+      "file descriptor in binary form.");
+  LOG_INFO(
+      "  --tombstones [file]\tFile listing IDs of snaps not to run, one per "
+      "line.");
+  LOG_INFO(
+      "  --replay [file]\tRun the snaps listed in the file, one per line, "
+      "once in order.");
+  LOG_INFO(
+      "  --perf_counters [type:config,...]\tCount these PMU events while "
+      "playing snaps.");
+  LOG_INFO(
+      "  --snap_instruction_budget [value]\tStop a snap as a runaway after "
+      "this many instructions.");
+  LOG_INFO(
+      "  --snap_instruction_budget_event [type:config]\tPMU event counted "
+      "by --snap_instruction_budget.");
   LOG_INFO("  --help\tPrint usage information.");
 }
 
@@ -148,11 +250,112 @@ int ParseRunnerFlags(int argc, char* argv[]) {
     } else if (matcher.Match("sequential_mode",
                              CommandLineFlagMatcher::kNoArgument)) {
       FLAGS_sequential_mode = true;
+    } else if (matcher.Match("snap_range_index",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      if (!DecToU64(matcher.optarg(), &FLAGS_snap_range_index)) {
+        LOG_ERROR("Invalid snap_range_index ", matcher.optarg());
+        return -1;
+      }
+    } else if (matcher.Match("num_snap_ranges",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      if (!DecToU64(matcher.optarg(), &FLAGS_num_snap_ranges) ||
+          FLAGS_num_snap_ranges == 0) {
+        LOG_ERROR("Invalid num_snap_ranges ", matcher.optarg());
+        return -1;
+      }
+    } else if (matcher.Match("max_failures",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      if (!DecToU64(matcher.optarg(), &FLAGS_max_failures) ||
+          FLAGS_max_failures == 0) {
+        LOG_ERROR("Invalid max_failures ", matcher.optarg());
+        return -1;
+      }
     } else if (matcher.Match("skip_end_state_check",
                              CommandLineFlagMatcher::kNoArgument)) {
       FLAGS_skip_end_state_check = true;
     } else if (matcher.Match("strict", CommandLineFlagMatcher::kNoArgument)) {
       FLAGS_strict = true;
+    } else if (matcher.Match("incremental_memory_restore",
+                             CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_incremental_memory_restore = true;
+    } else if (matcher.Match("chain_snaps",
+                             CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_chain_snaps = true;
+    } else if (matcher.Match("collect_snap_latency",
+                             CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_collect_snap_latency = true;
+    } else if (matcher.Match("report_startup_timings",
+                             CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_report_startup_timings = true;
+    } else if (matcher.Match("weighted_schedule",
+                             CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_weighted_schedule = true;
+    } else if (matcher.Match("batch_mixing_percent",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      if (!DecToU64(matcher.optarg(), &FLAGS_batch_mixing_percent) ||
+          FLAGS_batch_mixing_percent > 100) {
+        LOG_ERROR("Invalid batch_mixing_percent ", matcher.optarg());
+        return -1;
+      }
+    } else if (matcher.Match("lazy_map_snaps",
+                             CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_lazy_map_snaps = true;
+    } else if (matcher.Match("prefault_snap_mappings",
+                             CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_prefault_snap_mappings = true;
+    } else if (matcher.Match("lock_snap_mappings",
+                             CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_lock_snap_mappings = true;
+    } else if (matcher.Match("max_mapped_snaps_mb",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      uint64_t max_mapped_snaps_mb;
+      if (!DecToU64(matcher.optarg(), &max_mapped_snaps_mb)) {
+        LOG_ERROR("Invalid max_mapped_snaps_mb ", matcher.optarg());
+        return -1;
+      }
+      FLAGS_max_mapped_snaps_mb = max_mapped_snaps_mb;
+    } else if (matcher.Match("scrub_interval",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      if (!DecToU64(matcher.optarg(), &FLAGS_scrub_interval)) {
+        LOG_ERROR("Invalid scrub_interval ", matcher.optarg());
+        return -1;
+      }
+    } else if (matcher.Match("scrub_budget_us",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      if (!DecToU64(matcher.optarg(), &FLAGS_scrub_budget_us)) {
+        LOG_ERROR("Invalid scrub_budget_us ", matcher.optarg());
+        return -1;
+      }
+    } else if (matcher.Match("corpus_load_address",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      uint64_t corpus_load_address;
+      if (!HexToU64(matcher.optarg(), &corpus_load_address)) {
+        LOG_ERROR("Invalid corpus_load_address ", matcher.optarg());
+        return -1;
+      }
+      FLAGS_corpus_load_address = corpus_load_address;
+    } else if (matcher.Match("cpu_features",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      uint64_t cpu_features;
+      if (!HexToU64(matcher.optarg(), &cpu_features)) {
+        LOG_ERROR("Invalid cpu_features ", matcher.optarg());
+        return -1;
+      }
+      FLAGS_cpu_features = cpu_features;
+    } else if (matcher.Match("platform_id",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      uint64_t platform_id;
+      if (!silifuzz::DecToU64(matcher.optarg(), &platform_id) ||
+          platform_id >= 64) {
+        LOG_ERROR("Invalid platform_id ", matcher.optarg());
+        return -1;
+      }
+      FLAGS_platform_id = platform_id;
+    } else if (matcher.Match("persistent",
+                             CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_persistent = true;
+    } else if (matcher.Match("zygote", CommandLineFlagMatcher::kNoArgument)) {
+      FLAGS_zygote = true;
     } else if (matcher.Match("max_pages_to_add",
                              CommandLineFlagMatcher::kRequiredArgument)) {
       uint64_t max_pages_to_add;
@@ -161,6 +364,32 @@ int ParseRunnerFlags(int argc, char* argv[]) {
         return -1;
       }
       FLAGS_max_pages_to_add = max_pages_to_add;
+    } else if (matcher.Match("result_fd",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      uint64_t result_fd;
+      if (!DecToU64(matcher.optarg(), &result_fd) || result_fd > INT32_MAX) {
+        LOG_ERROR("Invalid result_fd ", matcher.optarg());
+        return -1;
+      }
+      FLAGS_result_fd = result_fd;
+    } else if (matcher.Match("tombstones",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      FLAGS_tombstones = matcher.optarg();
+    } else if (matcher.Match("replay",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      FLAGS_replay = matcher.optarg();
+    } else if (matcher.Match("perf_counters",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      FLAGS_perf_counters = matcher.optarg();
+    } else if (matcher.Match("snap_instruction_budget",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      if (!DecToU64(matcher.optarg(), &FLAGS_snap_instruction_budget)) {
+        LOG_ERROR("Invalid snap_instruction_budget ", matcher.optarg());
+        return -1;
+      }
+    } else if (matcher.Match("snap_instruction_budget_event",
+                             CommandLineFlagMatcher::kRequiredArgument)) {
+      FLAGS_snap_instruction_budget_event = matcher.optarg();
     } else {
       // Exit loop if argument is not recognized.
       break;
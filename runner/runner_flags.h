@@ -66,16 +66,129 @@ extern uint64_t FLAGS_schedule_size;
 // If true, execute Snaps sequentially once.
 extern bool FLAGS_sequential_mode;
 
+// In sequential mode, the corpus is split into `FLAGS_num_snap_ranges`
+// contiguous ranges of about the same number of snaps and only range
+// `FLAGS_snap_range_index` is executed. This lets several runners go through
+// one corpus in parallel.
+extern uint64_t FLAGS_snap_range_index;
+extern uint64_t FLAGS_num_snap_ranges;
+
+// Number of failed snaps after which the runner stops. With a value greater
+// than 1 the runner reports each failure, re-verifies the corpus checksums
+// and goes on until the budget is used up. Ignored in sequential and make
+// mode.
+extern uint64_t FLAGS_max_failures;
+
 // If true, end state is not checked after snap execution.
 extern bool FLAGS_skip_end_state_check;
 
 // If true, perform additional integrity checking. May slow down execution.
 extern bool FLAGS_strict;
 
+// If true, restore only writable memory modified by the previous execution of
+// a Snap.
+extern bool FLAGS_incremental_memory_restore;
+
+// If true, execute each schedule as a chain of snaps without saving the
+// runner's context for every snap. Cannot be used with --enable_tracer.
+extern bool FLAGS_chain_snaps;
+
+// If true, collect per-snap latency histograms and print them to stdout as
+// proto.SnapshotExecutionResult.snap_latency_histograms.
+extern bool FLAGS_collect_snap_latency;
+
+// If true, print the time spent in each startup phase to stdout as
+// proto.SnapshotExecutionResult.runner_startup_timings.
+extern bool FLAGS_report_startup_timings;
+
+// If true, pick snaps into batches with probability inversely proportional to
+// their estimated execution cost.
+extern bool FLAGS_weighted_schedule;
+
+// Percentage of snaps in a batch picked regardless of the register groups
+// their code uses. The rest use the same register groups as the first snap.
+extern uint64_t FLAGS_batch_mixing_percent;
+
+// If true, map memory of snaps when they are first scheduled and unmap least
+// recently used snaps to stay within --max_mapped_snaps_mb.
+extern bool FLAGS_lazy_map_snaps;
+
+// Memory budget in MiB for mapped snaps with --lazy_map_snaps. 0 means
+// unlimited.
+extern uint64_t FLAGS_max_mapped_snaps_mb;
+
+// If not 0, verify the checksums of a few snaps after every this many snap
+// executions so that corpus corruption is detected while running.
+extern uint64_t FLAGS_scrub_interval;
+
+// Time budget in microseconds of each round of --scrub_interval.
+extern uint64_t FLAGS_scrub_budget_us;
+
+// If true, populate the page tables of snap memory mappings at startup. This is
+// ignored with --lazy_map_snaps.
+extern bool FLAGS_prefault_snap_mappings;
+
+// If true, lock snap memory mappings in memory with MAP_LOCKED.
+extern bool FLAGS_lock_snap_mappings;
+
+// If not 0, the corpus file has already been relocated to this address, e.g.
+// by the orchestrator, and is mapped there shared if possible.
+extern uint64_t FLAGS_corpus_load_address;
+
+// If not 0, the CPU features of the host as returned by
+// GetX86CPUFeatureBits() in the process that started the runner. The runner
+// uses them instead of probing the CPU with CPUID. Ignored on non-x86 hosts.
+extern uint64_t FLAGS_cpu_features;
+
+// PlatformId value of the host as returned by CurrentPlatformId() in the
+// process that started the runner. Selects the expected end state of snaps
+// with per-platform end states. 0 (kUndefined) selects the default one.
+extern int FLAGS_platform_id;
+
+// If true, run in persistent mode. The corpus is mapped once and the runner
+// executes commands read from stdin until EOF. See RunnerMainPersistent() in
+// runner.h for the protocol.
+extern bool FLAGS_persistent;
+
+// If true, run as a zygote that forks a runner for each request read from
+// stdin until EOF. All other flags and the corpus are given per request. See
+// ZygoteMain() in runner.h for the protocol.
+extern bool FLAGS_zygote;
+
 // Maximum number of pages to be added during snap making. This option is used
 // only in snap making mode.
 extern uint64_t FLAGS_max_pages_to_add;
 
+// If not -1, write the end state of a failed snap to this file descriptor as a
+// binary record (see result_record.h) instead of printing it to stdout.
+extern int FLAGS_result_fd;
+
+// If set, a file listing IDs of snaps not to run, one per line. This removes
+// snaps from a corpus without regenerating it, e.g. to quarantine flaky snaps.
+extern const char* FLAGS_tombstones;
+
+// If set, a file listing IDs of snaps to run once each in the listed order,
+// one per line, instead of a random schedule. When a random schedule fails,
+// the runner logs the last snaps it ran, which replayed this way reproduce
+// the failure without rerunning the whole schedule.
+extern const char* FLAGS_replay;
+
+// If set, a comma-separated list of PMU events "<type>:<hex config>" as in
+// perf_event_attr to count in user space while playing random schedules. The
+// totals are printed as proto.SnapshotExecutionResult.perf_counter_values when
+// the runner finishes, or after each command in persistent mode.
+extern const char* FLAGS_perf_counters;
+
+// If not 0, a snap is stopped as a runaway once it has retired this many
+// instructions in user space, which is detected by a PMU counter overflow
+// instead of the much coarser CPU time limit. Ignored if the counter cannot
+// be opened.
+extern uint64_t FLAGS_snap_instruction_budget;
+
+// If set, a PMU event "<type>:<hex config>" as in perf_event_attr that
+// --snap_instruction_budget counts instead of retired instructions.
+extern const char* FLAGS_snap_instruction_budget_event;
+
 // Parses command line flags of runner and sets flags accordingly. 'argv[]' is
 // an array of 'argc' command line argument passed to main(). Parsing starts
 // at 'argv[1]' and stops at the first non-flag argument or end of 'argv[]'.
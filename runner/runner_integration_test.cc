@@ -18,21 +18,26 @@
 #include <cstdint>
 #include <optional>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "absl/time/time.h"
 #include "./common/snapshot.h"
 #include "./common/snapshot_enums.h"
 #include "./common/snapshot_test_config.h"
 #include "./common/snapshot_test_enum.h"
+#include "./proto/snapshot_execution_result.pb.h"
 #include "./runner/driver/runner_driver.h"
 #include "./runner/driver/runner_options.h"
 #include "./runner/runner_provider.h"
 #include "./snap/gen/relocatable_snap_generator.h"
+#include "./snap/gen/snap_generator.h"
 #include "./snap/testing/snap_test_snapshots.h"
 #include "./util/arch.h"
 #include "./util/data_dependency.h"
@@ -163,6 +168,251 @@ TEST(RunnerTest, Deadline) {
   ASSERT_TRUE(result.success());
 }
 
+TEST(RunnerTest, IncrementalMemoryRestore) {
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), GetDataDependencyFilepath("snap/testing/test_corpus"));
+  auto make_options = [](TestSnapshot test_snap_type) {
+    RunnerOptions opts = RunnerOptions::PlayOptions(EnumStr(test_snap_type));
+    opts.set_extra_argv({"--snap_id", EnumStr(test_snap_type),
+                         "--num_iterations", "10",
+                         "--incremental_memory_restore"});
+    return opts;
+  };
+  ASSERT_OK_AND_ASSIGN(
+      auto result, driver.Run(make_options(TestSnapshot::kEndsAsExpected)));
+  EXPECT_TRUE(result.success());
+
+  ASSERT_OK_AND_ASSIGN(result,
+                       driver.Run(make_options(TestSnapshot::kMemoryMismatch)));
+  ASSERT_FALSE(result.success());
+  EXPECT_EQ(result.player_result().outcome, PlaybackOutcome::kMemoryMismatch);
+}
+
+TEST(RunnerTest, ChainSnaps) {
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), GetDataDependencyFilepath("snap/testing/test_corpus"));
+  auto make_options = [](TestSnapshot test_snap_type) {
+    RunnerOptions opts = RunnerOptions::PlayOptions(EnumStr(test_snap_type));
+    opts.set_extra_argv({"--snap_id", EnumStr(test_snap_type),
+                         "--num_iterations", "250", "--chain_snaps"});
+    return opts;
+  };
+  ASSERT_OK_AND_ASSIGN(
+      auto result, driver.Run(make_options(TestSnapshot::kEndsAsExpected)));
+  EXPECT_TRUE(result.success());
+
+  ASSERT_OK_AND_ASSIGN(result,
+                       driver.Run(make_options(TestSnapshot::kMemoryMismatch)));
+  ASSERT_FALSE(result.success());
+  EXPECT_EQ(result.player_result().outcome, PlaybackOutcome::kMemoryMismatch);
+
+  // A signal ends the chain just like a snap exit does.
+  ASSERT_OK_AND_ASSIGN(
+      result, driver.Run(make_options(TestSnapshot::kSigSegvReadFixable)));
+  ASSERT_FALSE(result.success());
+  EXPECT_EQ(result.player_result().outcome,
+            PlaybackOutcome::kExecutionMisbehave);
+}
+
+TEST(RunnerTest, MaxFailures) {
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), GetDataDependencyFilepath("snap/testing/test_corpus"));
+  for (bool binary_result_channel : {false, true}) {
+    for (bool chain_snaps : {false, true}) {
+      SCOPED_TRACE(absl::StrCat("binary_result_channel=", binary_result_channel,
+                                " chain_snaps=", chain_snaps));
+      RunnerOptions opts = RunnerOptions::PlayOptions(
+          EnumStr(TestSnapshot::kMemoryMismatch));
+      std::vector<std::string> extra_argv = {
+          "--snap_id", EnumStr(TestSnapshot::kMemoryMismatch),
+          "--num_iterations", "10"};
+      if (chain_snaps) {
+        extra_argv.push_back("--chain_snaps");
+      }
+      opts.set_extra_argv(extra_argv)
+          .set_binary_result_channel(binary_result_channel)
+          .set_max_failures(3);
+      ASSERT_OK_AND_ASSIGN(auto result, driver.Run(opts));
+      ASSERT_FALSE(result.success());
+      EXPECT_EQ(result.player_result().outcome,
+                PlaybackOutcome::kMemoryMismatch);
+      ASSERT_EQ(result.earlier_failures().size(), 2);
+      for (const RunnerDriver::RunResult& failure :
+           result.earlier_failures()) {
+        ASSERT_FALSE(failure.success());
+        EXPECT_EQ(failure.snapshot_id(),
+                  EnumStr(TestSnapshot::kMemoryMismatch));
+        EXPECT_EQ(failure.player_result().outcome,
+                  PlaybackOutcome::kMemoryMismatch);
+      }
+
+      // A budget larger than the number of iterations fails every one of
+      // them.
+      opts.set_max_failures(100);
+      ASSERT_OK_AND_ASSIGN(result, driver.Run(opts));
+      ASSERT_FALSE(result.success());
+      EXPECT_EQ(result.earlier_failures().size(), 9);
+    }
+  }
+
+  // Without failures the budget changes nothing.
+  RunnerOptions opts =
+      RunnerOptions::PlayOptions(EnumStr(TestSnapshot::kEndsAsExpected));
+  opts.set_max_failures(3);
+  ASSERT_OK_AND_ASSIGN(auto result, driver.Run(opts));
+  EXPECT_TRUE(result.success());
+  EXPECT_THAT(result.earlier_failures(), IsEmpty());
+}
+
+TEST(RunnerTest, CollectSnapLatency) {
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), GetDataDependencyFilepath("snap/testing/test_corpus"));
+  for (bool chain_snaps : {false, true}) {
+    RunnerOptions opts =
+        RunnerOptions::PlayOptions(EnumStr(TestSnapshot::kEndsAsExpected));
+    std::vector<std::string> extra_argv = {
+        "--snap_id", EnumStr(TestSnapshot::kEndsAsExpected), "--num_iterations",
+        "100", "--collect_snap_latency"};
+    if (chain_snaps) {
+      extra_argv.push_back("--chain_snaps");
+    }
+    opts.set_extra_argv(extra_argv);
+    ASSERT_OK_AND_ASSIGN(auto result, driver.Run(opts));
+    ASSERT_TRUE(result.success());
+    ASSERT_EQ(result.snap_latency_histograms().size(), 1);
+    const proto::SnapLatencyHistogram& histogram =
+        result.snap_latency_histograms()[0];
+    EXPECT_EQ(histogram.snapshot_id(), EnumStr(TestSnapshot::kEndsAsExpected));
+    uint64_t num_executions = 0;
+    for (uint64_t count : histogram.bucket_counts()) {
+      num_executions += count;
+    }
+    EXPECT_EQ(num_executions, 100);
+  }
+}
+
+TEST(RunnerTest, CollectSnapLatencyOnTimeout) {
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), GetDataDependencyFilepath("snap/testing/test_corpus"));
+  RunnerOptions opts = RunnerOptions::Default();
+  opts.set_wall_time_budget(absl::Seconds(1));
+  opts.set_extra_argv({"--snap_id", EnumStr(TestSnapshot::kEndsAsExpected),
+                       "--num_iterations", "1000000000000",
+                       "--collect_snap_latency"});
+  // The runner is stopped by the wall time budget and prints the histograms
+  // on its way out.
+  ASSERT_OK_AND_ASSIGN(auto result, driver.Run(opts));
+  ASSERT_TRUE(result.success());
+  ASSERT_EQ(result.snap_latency_histograms().size(), 1);
+  uint64_t num_executions = 0;
+  for (uint64_t count : result.snap_latency_histograms()[0].bucket_counts()) {
+    num_executions += count;
+  }
+  EXPECT_GT(num_executions, 0);
+}
+
+TEST(RunnerTest, ReportStartupTimings) {
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), GetDataDependencyFilepath("snap/testing/test_corpus"));
+  auto make_options = [](TestSnapshot test_snap_type) {
+    RunnerOptions opts = RunnerOptions::PlayOptions(EnumStr(test_snap_type));
+    opts.set_extra_argv({"--snap_id", EnumStr(test_snap_type),
+                         "--num_iterations", "10", "--strict",
+                         "--report_startup_timings"});
+    return opts;
+  };
+  ASSERT_OK_AND_ASSIGN(
+      auto result, driver.Run(make_options(TestSnapshot::kEndsAsExpected)));
+  ASSERT_TRUE(result.success());
+  ASSERT_TRUE(result.startup_timings().has_value());
+  EXPECT_GT(result.startup_timings()->exec, absl::ZeroDuration());
+  EXPECT_GT(result.startup_timings()->load_corpus, absl::ZeroDuration());
+  EXPECT_GT(result.startup_timings()->map_corpus, absl::ZeroDuration());
+
+  // Timings are also reported along with a failed snap.
+  ASSERT_OK_AND_ASSIGN(result,
+                       driver.Run(make_options(TestSnapshot::kMemoryMismatch)));
+  ASSERT_FALSE(result.success());
+  EXPECT_TRUE(result.startup_timings().has_value());
+}
+
+TEST(RunnerTest, PrefaultSnapMappings) {
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), GetDataDependencyFilepath("snap/testing/test_corpus"));
+  RunnerOptions opts =
+      RunnerOptions::PlayOptions(EnumStr(TestSnapshot::kEndsAsExpected));
+  opts.set_extra_argv({"--snap_id", EnumStr(TestSnapshot::kEndsAsExpected),
+                       "--num_iterations", "10", "--prefault_snap_mappings",
+                       "--report_startup_timings"});
+  ASSERT_OK_AND_ASSIGN(auto result, driver.Run(opts));
+  ASSERT_TRUE(result.success());
+  ASSERT_TRUE(result.startup_timings().has_value());
+  // Prefaulting is best effort, e.g. it needs Linux 5.14 or later.
+  EXPECT_GT(result.startup_timings()->prefaulted_bytes +
+                result.startup_timings()->num_prefault_failures,
+            0);
+  EXPECT_EQ(result.startup_timings()->locked_bytes, 0);
+}
+
+TEST(RunnerTest, WeightedSchedule) {
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), GetDataDependencyFilepath("snap/testing/test_corpus"));
+  auto make_options = [](TestSnapshot test_snap_type) {
+    RunnerOptions opts = RunnerOptions::PlayOptions(EnumStr(test_snap_type));
+    opts.set_extra_argv({"--snap_id", EnumStr(test_snap_type),
+                         "--num_iterations", "10", "--weighted_schedule"});
+    return opts;
+  };
+  ASSERT_OK_AND_ASSIGN(
+      auto result, driver.Run(make_options(TestSnapshot::kEndsAsExpected)));
+  EXPECT_TRUE(result.success());
+
+  ASSERT_OK_AND_ASSIGN(result,
+                       driver.Run(make_options(TestSnapshot::kMemoryMismatch)));
+  ASSERT_FALSE(result.success());
+  EXPECT_EQ(result.player_result().outcome, PlaybackOutcome::kMemoryMismatch);
+}
+
+TEST(RunnerTest, BatchMixingPercent) {
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), GetDataDependencyFilepath("snap/testing/test_corpus"));
+  auto make_options = [](TestSnapshot test_snap_type) {
+    RunnerOptions opts = RunnerOptions::PlayOptions(EnumStr(test_snap_type));
+    opts.set_extra_argv({"--snap_id", EnumStr(test_snap_type),
+                         "--num_iterations", "10", "--batch_mixing_percent",
+                         "50"});
+    return opts;
+  };
+  ASSERT_OK_AND_ASSIGN(
+      auto result, driver.Run(make_options(TestSnapshot::kEndsAsExpected)));
+  EXPECT_TRUE(result.success());
+
+  ASSERT_OK_AND_ASSIGN(result,
+                       driver.Run(make_options(TestSnapshot::kMemoryMismatch)));
+  ASSERT_FALSE(result.success());
+  EXPECT_EQ(result.player_result().outcome, PlaybackOutcome::kMemoryMismatch);
+}
+
+TEST(RunnerTest, LazyMapSnaps) {
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), GetDataDependencyFilepath("snap/testing/test_corpus"));
+  auto make_options = [](TestSnapshot test_snap_type) {
+    RunnerOptions opts = RunnerOptions::PlayOptions(EnumStr(test_snap_type));
+    opts.set_extra_argv({"--snap_id", EnumStr(test_snap_type),
+                         "--num_iterations", "10", "--lazy_map_snaps",
+                         "--max_mapped_snaps_mb", "1", "--strict"});
+    return opts;
+  };
+  ASSERT_OK_AND_ASSIGN(
+      auto result, driver.Run(make_options(TestSnapshot::kEndsAsExpected)));
+  EXPECT_TRUE(result.success());
+
+  ASSERT_OK_AND_ASSIGN(result,
+                       driver.Run(make_options(TestSnapshot::kMemoryMismatch)));
+  ASSERT_FALSE(result.success());
+  EXPECT_EQ(result.player_result().outcome, PlaybackOutcome::kMemoryMismatch);
+}
+
 TEST(RunnerTest, EmptyCorpus) {
   MmappedMemoryPtr<char> buffer =
       GenerateRelocatableSnaps(Host::architecture_id, {});
@@ -182,6 +432,137 @@ TEST(RunnerTest, EmptyCorpus) {
   ASSERT_OK(driver.Run(opts));
 }
 
+TEST(RunnerTest, Tombstones) {
+  std::vector<Snapshot> corpus;
+  for (TestSnapshot type :
+       {TestSnapshot::kEndsAsExpected, TestSnapshot::kMemoryMismatch}) {
+    Snapshot snapshot = MakeSnapRunnerTestSnapshot<Host>(type);
+    ASSERT_OK_AND_ASSIGN(
+        Snapshot snapified,
+        Snapify(snapshot,
+                SnapifyOptions::V2InputRunOpts(snapshot.architecture_id())));
+    corpus.push_back(std::move(snapified));
+  }
+  MmappedMemoryPtr<char> buffer =
+      GenerateRelocatableSnaps(Host::architecture_id, corpus);
+  ASSERT_OK_AND_ASSIGN(auto path, CreateTempFile("TombstonesCorpus", ""));
+  ASSERT_TRUE(SetContents(
+      path, absl::string_view(buffer.get(), MmappedMemorySize(buffer))));
+  ASSERT_OK_AND_ASSIGN(auto tombstones_path, CreateTempFile("Tombstones", ""));
+  ASSERT_TRUE(SetContents(
+      tombstones_path,
+      absl::StrCat("unknown\n\n", EnumStr(TestSnapshot::kMemoryMismatch))));
+
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), path, "", [&path, &tombstones_path] {
+        unlink(path.c_str());
+        unlink(tombstones_path.c_str());
+      });
+  RunnerOptions opts = RunnerOptions::Default();
+  opts.set_sequential_mode(true);
+  ASSERT_OK_AND_ASSIGN(RunnerDriver::RunResult result, driver.Run(opts));
+  EXPECT_FALSE(result.success());
+
+  opts.set_extra_argv({"--tombstones", tombstones_path});
+  ASSERT_OK_AND_ASSIGN(result, driver.Run(opts));
+  EXPECT_TRUE(result.success());
+}
+
+// A corpus left without snaps to run is handled like an empty corpus file.
+// Tombstoning every snap takes the same path as every snap conflicting with
+// the runner's own memory, which cannot be set up reliably in a test.
+TEST(RunnerTest, AllSnapsSkipped) {
+  Snapshot snapshot =
+      MakeSnapRunnerTestSnapshot<Host>(TestSnapshot::kEndsAsExpected);
+  ASSERT_OK_AND_ASSIGN(
+      Snapshot snapified,
+      Snapify(snapshot,
+              SnapifyOptions::V2InputRunOpts(snapshot.architecture_id())));
+  std::vector<Snapshot> corpus;
+  corpus.push_back(std::move(snapified));
+  MmappedMemoryPtr<char> buffer =
+      GenerateRelocatableSnaps(Host::architecture_id, corpus);
+  ASSERT_OK_AND_ASSIGN(auto path, CreateTempFile("AllSkippedCorpus", ""));
+  ASSERT_TRUE(SetContents(
+      path, absl::string_view(buffer.get(), MmappedMemorySize(buffer))));
+  ASSERT_OK_AND_ASSIGN(auto tombstones_path, CreateTempFile("Tombstones", ""));
+  ASSERT_TRUE(SetContents(tombstones_path,
+                          EnumStr(TestSnapshot::kEndsAsExpected)));
+
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), path, "", [&path, &tombstones_path] {
+        unlink(path.c_str());
+        unlink(tombstones_path.c_str());
+      });
+  RunnerOptions opts = RunnerOptions::Default();
+  opts.set_extra_argv({"--tombstones", tombstones_path});
+  ASSERT_OK_AND_ASSIGN(RunnerDriver::RunResult result, driver.Run(opts));
+  EXPECT_TRUE(result.success());
+  opts.set_sequential_mode(true);
+  ASSERT_OK_AND_ASSIGN(result, driver.Run(opts));
+  EXPECT_TRUE(result.success());
+}
+
+TEST(RunnerTest, SequentialSnapRanges) {
+  std::vector<Snapshot> corpus;
+  for (TestSnapshot type :
+       {TestSnapshot::kEndsAsExpected, TestSnapshot::kMemoryMismatch}) {
+    Snapshot snapshot = MakeSnapRunnerTestSnapshot<Host>(type);
+    ASSERT_OK_AND_ASSIGN(
+        Snapshot snapified,
+        Snapify(snapshot,
+                SnapifyOptions::V2InputRunOpts(snapshot.architecture_id())));
+    corpus.push_back(std::move(snapified));
+  }
+  MmappedMemoryPtr<char> buffer =
+      GenerateRelocatableSnaps(Host::architecture_id, corpus);
+  ASSERT_OK_AND_ASSIGN(auto path, CreateTempFile("SnapRangesCorpus", ""));
+  ASSERT_TRUE(SetContents(
+      path, absl::string_view(buffer.get(), MmappedMemorySize(buffer))));
+
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), path, "", [&path] { unlink(path.c_str()); });
+  RunnerOptions opts = RunnerOptions::Default();
+  opts.set_sequential_mode(true);
+  // Each of the two ranges has one snap, so exactly one range fails.
+  int num_failures = 0;
+  for (uint64_t index = 0; index < 2; ++index) {
+    opts.set_snap_range(index, 2);
+    ASSERT_OK_AND_ASSIGN(RunnerDriver::RunResult result, driver.Run(opts));
+    num_failures += !result.success();
+  }
+  EXPECT_EQ(num_failures, 1);
+
+  // More ranges than snaps leaves some ranges empty.
+  opts.set_snap_range(0, 4);
+  ASSERT_OK_AND_ASSIGN(RunnerDriver::RunResult result, driver.Run(opts));
+  EXPECT_TRUE(result.success());
+}
+
+TEST(RunnerTest, Replay) {
+  ASSERT_OK_AND_ASSIGN(auto replay_path, CreateTempFile("Replay", ""));
+  RunnerDriver driver = RunnerDriver::ReadingRunner(
+      RunnerLocation(), GetDataDependencyFilepath("snap/testing/test_corpus"),
+      "", [&replay_path] { unlink(replay_path.c_str()); });
+  RunnerOptions opts = RunnerOptions::Default();
+  opts.set_extra_argv({"--replay", replay_path});
+
+  ASSERT_TRUE(SetContents(
+      replay_path, absl::StrCat(EnumStr(TestSnapshot::kEndsAsExpected), "\n",
+                                EnumStr(TestSnapshot::kEndsAsExpected))));
+  ASSERT_OK_AND_ASSIGN(RunnerDriver::RunResult result, driver.Run(opts));
+  EXPECT_TRUE(result.success());
+
+  ASSERT_TRUE(SetContents(
+      replay_path, absl::StrCat(EnumStr(TestSnapshot::kEndsAsExpected), "\n",
+                                EnumStr(TestSnapshot::kMemoryMismatch), "\n",
+                                EnumStr(TestSnapshot::kEndsAsExpected))));
+  ASSERT_OK_AND_ASSIGN(result, driver.Run(opts));
+  ASSERT_FALSE(result.success());
+  EXPECT_EQ(result.snapshot_id(), EnumStr(TestSnapshot::kMemoryMismatch));
+  EXPECT_EQ(result.player_result().outcome, PlaybackOutcome::kMemoryMismatch);
+}
+
 TEST(RunnerTest, UnknownFlags) {
   MmappedMemoryPtr<char> buffer =
       GenerateRelocatableSnaps(Host::architecture_id, {});
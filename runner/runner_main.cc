@@ -16,9 +16,10 @@
 //
 // SiliFuzz provides two ways to build this into a binary:
 //
-// 1) BAKED IN MODE (//third_party/silifuzz/runner:runner_main_nolibc).
-//  Link with :default_snap_corpus and define kDefaultSnapCorpus to point to
-//  the actual Snap corpus. The corpus is usually produced by :snap_generator
+// 1) BAKED IN MODE.
+//  Link with :baked_snap_corpus and the assembly source produced from a
+//  relocatable corpus by `snap_tool bake_corpus`. The corpus is used in place
+//  without reading or relocating it at run time.
 // 2) READING MODE (//third_party/silifuzz/runner:reading_runner_main_nolibc).
 //  Link with :loading_snap_corpus. Then pass the file name containing a
 //  relocatable corpus as a command line argument.
@@ -29,11 +30,14 @@
 #include "absl/base/attributes.h"
 #include "third_party/lss/lss/linux_syscall_support.h"
 #include "./runner/default_snap_corpus.h"
+#include "./runner/perf_counters.h"
 #include "./runner/runner.h"
 #include "./runner/runner_flags.h"
 #include "./runner/runner_main_options.h"
+#include "./runner/runner_util.h"
 #include "./util/arch.h"
 #include "./util/checks.h"
+#include "./util/cpu_features.h"
 #include "./util/strcat.h"
 
 namespace silifuzz {
@@ -53,6 +57,7 @@ constexpr const char* RemoveLeadingDirectory(
 }
 
 int Main(int argc, char* argv[]) {
+  const uint64_t main_entry_ns = MonotonicNanos();
   int flags_end = ParseRunnerFlags(argc, argv);
   if (flags_end == -1) {
     // Parsing failed. The flag parser already output an error message.
@@ -63,6 +68,17 @@ int Main(int argc, char* argv[]) {
     ShowUsage(argv[0]);
     return EXIT_SUCCESS;
   }
+#if defined(__x86_64__)
+  // Skip probing the CPU if the parent has done it already.
+  if (FLAGS_cpu_features != 0) {
+    SetX86CPUFeatureBits(FLAGS_cpu_features);
+  }
+#endif
+  if (FLAGS_zygote) {
+    // Children parse their own flags, which must not make them zygotes.
+    FLAGS_zygote = false;
+    return ZygoteMain(argv[0], &Main);
+  }
   if (flags_end < argc && argv[flags_end][0] == '-') {
     // There's an option that didn't parse.
     LOG_ERROR(StrCat({"Unknown flag ", argv[flags_end]}));
@@ -74,8 +90,13 @@ int Main(int argc, char* argv[]) {
   options.strict = FLAGS_strict;
 
   const char* corpus_file_name = flags_end < argc ? argv[flags_end] : nullptr;
+  // Only a single snap is used with --snap_id, so do not relocate the others.
+  options.corpus_relocated_lazily = FLAGS_snap_id != nullptr;
   options.corpus =
-      LoadCorpus(corpus_file_name, options.strict, &options.corpus_fd);
+      LoadCorpus(corpus_file_name, options.strict, &options.corpus_fd,
+                 FLAGS_corpus_load_address, options.corpus_relocated_lazily);
+  options.main_entry_ns = main_entry_ns;
+  options.load_corpus_ns = MonotonicNanos() - main_entry_ns;
   if (options.corpus == nullptr) {
     LOG_ERROR("No corpus file name was specified");
     return EXIT_FAILURE;
@@ -106,6 +127,7 @@ int Main(int argc, char* argv[]) {
   }
 
   options.cpu = FLAGS_cpu;
+  options.platform_id = FLAGS_platform_id;
   options.snap_id = FLAGS_snap_id;
   options.num_iterations = FLAGS_num_iterations;
   options.enable_tracer = FLAGS_enable_tracer;
@@ -128,16 +150,77 @@ int Main(int argc, char* argv[]) {
   options.batch_size = FLAGS_batch_size;
   options.schedule_size = FLAGS_schedule_size;
   options.sequential_mode = FLAGS_sequential_mode;
+  options.snap_range_index = FLAGS_snap_range_index;
+  options.num_snap_ranges = FLAGS_num_snap_ranges;
+  options.max_failures = FLAGS_max_failures;
+  options.incremental_memory_restore = FLAGS_incremental_memory_restore;
+  options.chain_snaps = FLAGS_chain_snaps;
+  options.collect_snap_latency = !FLAGS_make && FLAGS_collect_snap_latency;
+  options.weighted_schedule = !FLAGS_make && FLAGS_weighted_schedule;
+  options.batch_mixing_percent =
+      FLAGS_make ? 100 : FLAGS_batch_mixing_percent;
+  options.lazy_map_snaps = !FLAGS_make && FLAGS_lazy_map_snaps;
+  options.max_mapped_snap_bytes = FLAGS_max_mapped_snaps_mb << 20;
+  options.scrub_interval = FLAGS_make ? 0 : FLAGS_scrub_interval;
+  options.scrub_budget_ns = FLAGS_scrub_budget_us * 1000;
+  options.prefault_snap_mappings =
+      !options.lazy_map_snaps && FLAGS_prefault_snap_mappings;
+  options.lock_snap_mappings = FLAGS_lock_snap_mappings;
   options.max_pages_to_add = FLAGS_make ? FLAGS_max_pages_to_add : 0;
+  options.report_startup_timings = !FLAGS_make && FLAGS_report_startup_timings;
+  options.result_fd = FLAGS_result_fd;
+  if (FLAGS_tombstones != nullptr) {
+    options.tombstones =
+        ReadSnapIdList(FLAGS_tombstones, &options.num_tombstones);
+  }
+  if (FLAGS_replay != nullptr) {
+    options.replay_snap_ids =
+        ReadSnapIdList(FLAGS_replay, &options.num_replay_snap_ids);
+  }
+  if (FLAGS_perf_counters != nullptr) {
+    const int num_perf_counters =
+        ParsePerfCounterConfigs(FLAGS_perf_counters, options.perf_counters);
+    if (num_perf_counters < 0) {
+      LOG_ERROR("Invalid perf_counters ", FLAGS_perf_counters);
+      return EXIT_FAILURE;
+    }
+    options.num_perf_counters = num_perf_counters;
+  }
+  options.snap_instruction_budget = FLAGS_snap_instruction_budget;
+  if (FLAGS_snap_instruction_budget_event != nullptr) {
+    PerfCounterConfig configs[kMaxPerfCounters];
+    if (ParsePerfCounterConfigs(FLAGS_snap_instruction_budget_event,
+                                configs) != 1) {
+      LOG_ERROR("Invalid snap_instruction_budget_event ",
+                FLAGS_snap_instruction_budget_event);
+      return EXIT_FAILURE;
+    }
+    options.snap_instruction_budget_event = configs[0];
+  }
 
   // These cannot be set together.
   if (FLAGS_make && FLAGS_sequential_mode) {
     LOG_FATAL("Cannot set both make and sequential mode");
   }
+  if (FLAGS_snap_range_index >= FLAGS_num_snap_ranges) {
+    LOG_FATAL("snap_range_index must be less than num_snap_ranges");
+  }
+  if (FLAGS_chain_snaps && FLAGS_enable_tracer) {
+    LOG_FATAL("Cannot set both chain_snaps and enable_tracer");
+  }
+  if (FLAGS_persistent && (FLAGS_make || FLAGS_sequential_mode)) {
+    LOG_FATAL("Cannot set persistent mode with make or sequential mode");
+  }
+  if (FLAGS_replay != nullptr &&
+      (FLAGS_make || FLAGS_sequential_mode || FLAGS_persistent)) {
+    LOG_FATAL("Cannot set replay with make, sequential or persistent mode");
+  }
 
-  return (FLAGS_make              ? MakerMain(options)
-          : FLAGS_sequential_mode ? RunnerMainSequential(options)
-                                  : RunnerMain(options));
+  return (FLAGS_make                ? MakerMain(options)
+          : FLAGS_sequential_mode   ? RunnerMainSequential(options)
+          : FLAGS_persistent        ? RunnerMainPersistent(options)
+          : FLAGS_replay != nullptr ? RunnerMainReplay(options)
+                                    : RunnerMain(options));
 }
 
 }  // namespace
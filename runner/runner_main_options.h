@@ -20,6 +20,7 @@
 #include <cstddef>
 #include <cstdint>
 
+#include "./runner/perf_counters.h"
 #include "./snap/snap.h"
 #include "./util/arch.h"
 #include "./util/cpu_id.h"
@@ -34,6 +35,10 @@ struct RunnerMainOptions {
   // A corpus of Snaps to be executed.
   const SnapCorpus<Host>* corpus;
 
+  // If true, Snaps in `corpus` may not have been relocated yet and must be
+  // accessed through SnapRelocator::GetSnap(). See LoadCorpus().
+  bool corpus_relocated_lazily = false;
+
   // Number of main loop iterations, in each of which a Snap from the corpus is
   // picked an executed. In sequential mode, this is ignored.
   size_t num_iterations = 1000000;
@@ -100,6 +105,18 @@ struct RunnerMainOptions {
   // schedule sizes in options are ignored. This is used for Snap verification.
   bool sequential_mode = false;
 
+  // In sequential mode, the corpus is split into `num_snap_ranges`
+  // contiguous ranges of about the same size and only the snaps of range
+  // `snap_range_index` are executed. Must be less than `num_snap_ranges`.
+  uint64_t snap_range_index = 0;
+  uint64_t num_snap_ranges = 1;
+
+  // Number of failed snaps after which RunnerMain() and persistent mode
+  // commands stop. After each failure but the last one the corpus checksums
+  // are verified again and execution goes on with the next schedule. Must be
+  // greater than 0.
+  uint64_t max_failures = 1;
+
   // The FD of the corpus file, -1 if the FD is not available. The runner may
   // use the FD to create Snap mappings faster.
   int corpus_fd = -1;
@@ -108,12 +125,111 @@ struct RunnerMainOptions {
   // considered to always end as expected.
   bool skip_end_state_check = false;
 
+  // PlatformId value of the host. Selects the expected end state of snaps
+  // that have one per platform, see Snap::platform_end_states. The default
+  // end state is used if this is 0 (kUndefined).
+  int platform_id = 0;
+
   // If true, perform additional integrity checking. May slow down execution.
   bool strict;
 
+  // If true, restore only the writable memory bytes modified by the previous
+  // execution of a Snap when the same Snap runs again. This is ignored if
+  // `skip_end_state_check` is true. See "Incremental memory restore" in
+  // runner.cc for details.
+  bool incremental_memory_restore = false;
+
+  // If true, each schedule is executed as a chain of snaps that saves the
+  // runner's context only once per schedule. See "Chained schedule execution"
+  // in runner.cc for details. This is ignored in sequential and make modes.
+  // Must not be set together with `enable_tracer`.
+  bool chain_snaps = false;
+
+  // If true, collect a latency histogram for each snap and print it to stdout.
+  // See "Snap latency histograms" in runner.cc for details. This is ignored in
+  // make mode.
+  bool collect_snap_latency = false;
+
+  // If true, snaps are picked into batches with probability inversely
+  // proportional to their execution cost instead of uniformly. The cost is
+  // estimated from memory sizes at first and then measured as snaps run.
+  // See "Weighted scheduling" in runner.cc for details. This is ignored in
+  // sequential and make modes.
+  bool weighted_schedule = false;
+
+  // Percentage of snaps in a batch picked regardless of
+  // Snap::code_register_groups. The other snaps are picked from those with the
+  // same code register groups as the first snap of the batch. See "Batch
+  // composition by register usage" in runner.cc for details. This is ignored
+  // in sequential and make modes.
+  uint64_t batch_mixing_percent = 100;
+
+  // If true, memory mappings of a snap are created when the snap is first
+  // scheduled instead of mapping the whole corpus up front. See "Lazy snap
+  // mapping" in runner.cc for details. This is ignored in make mode.
+  bool lazy_map_snaps = false;
+
+  // Budget in bytes for memory mappings of snaps when `lazy_map_snaps` is
+  // true. Least recently used snaps are unmapped to stay within the budget.
+  // 0 means unlimited.
+  uint64_t max_mapped_snap_bytes = 0;
+
+  // If not 0, snap checksums are verified a few snaps at a time after every
+  // `scrub_interval` snap executions, spending at most `scrub_budget_ns` per
+  // round. See "Background corpus scrubbing" in runner.cc for details. This
+  // is ignored in sequential and make modes.
+  uint64_t scrub_interval = 0;
+  uint64_t scrub_budget_ns = 0;
+
   // The maximum number of pages to add during making. This is ignored if
   // runner is not in make mode.
   int max_pages_to_add = 0;
+
+  // If true, CommonMain() populates the page tables of all snap memory
+  // mappings after mapping the corpus so that the first execution of a snap
+  // does not take page faults. This is ignored with `lazy_map_snaps`.
+  bool prefault_snap_mappings = false;
+
+  // If true, snap memory mappings are created with MAP_LOCKED, which also
+  // populates them. Mappings that cannot be locked, e.g. due to
+  // RLIMIT_MEMLOCK, are created unlocked.
+  bool lock_snap_mappings = false;
+
+  // If true, CommonMain() prints the time spent in each startup phase to
+  // stdout as proto.SnapshotExecutionResult.runner_startup_timings. This is
+  // ignored in make mode.
+  bool report_startup_timings = false;
+
+  // MonotonicNanos() when main() was entered and the time in nanoseconds it
+  // spent loading `corpus`. Reported with `report_startup_timings`.
+  uint64_t main_entry_ns = 0;
+  uint64_t load_corpus_ns = 0;
+
+  // If not -1, LogSnapRunResult() writes the end state of a failed snap to
+  // this file descriptor as a binary record (see result_record.h) and prints
+  // it to stdout only if that fails.
+  int result_fd = -1;
+
+  // IDs of snaps in `corpus` not to run. There are `num_tombstones` of them.
+  // Unknown IDs are ignored. This is ignored if `snap_id` is set.
+  const char* const* tombstones = nullptr;
+  size_t num_tombstones = 0;
+
+  // IDs of snaps in `corpus` to run in this order by RunnerMainReplay().
+  // There are `num_replay_snap_ids` of them.
+  const char* const* replay_snap_ids = nullptr;
+  size_t num_replay_snap_ids = 0;
+
+  // PMU events counted over the schedules of RunnerMain() and
+  // RunnerMainPersistent(). There are `num_perf_counters` of them.
+  PerfCounterConfig perf_counters[kMaxPerfCounters] = {};
+  size_t num_perf_counters = 0;
+
+  // If not 0, snaps that retire more than this many of
+  // `snap_instruction_budget_event` are runaways. See
+  // --snap_instruction_budget.
+  uint64_t snap_instruction_budget = 0;
+  PerfCounterConfig snap_instruction_budget_event = kRetiredInstructions;
 };
 
 }  // namespace silifuzz
@@ -20,6 +20,7 @@
 #include <linux/filter.h>
 #include <linux/seccomp.h>  // SECCOMP constants.
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/prctl.h>
 #include <syscall.h>
 #include <unistd.h>
@@ -50,6 +51,13 @@ bool RangesOverlap(uint64_t start_1, uint64_t limit_1, uint64_t start_2,
   return min_limit > max_start;
 }
 
+// The runner memory layout cache. On x86_64, a fully static runner has about
+// 8 entries in /proc/self/maps and it adds fewer than 10 mappings of its own.
+constexpr size_t kMaxRunnerProcMapsEntries = 64;
+ProcMapsEntry runner_proc_maps_entries[kMaxRunnerProcMapsEntries];
+size_t num_runner_proc_maps_entries = 0;
+bool runner_proc_maps_entries_read = false;
+
 }  // namespace
 
 size_t ReadProcMapsEntries(ProcMapsEntry* proc_maps_entries,
@@ -70,6 +78,43 @@ size_t ReadProcMapsEntries(ProcMapsEntry* proc_maps_entries,
                        max_proc_maps_entries);
 }
 
+ProcMapsEntry* GetRunnerProcMapsEntries(size_t* num_entries) {
+  if (!runner_proc_maps_entries_read) {
+    num_runner_proc_maps_entries = ReadProcMapsEntries(
+        runner_proc_maps_entries, kMaxRunnerProcMapsEntries);
+    runner_proc_maps_entries_read = true;
+  }
+  *num_entries = num_runner_proc_maps_entries;
+  return runner_proc_maps_entries;
+}
+
+void RecordRunnerMmap(uint64_t start_address, uint64_t limit_address,
+                      const char* name) {
+  if (!runner_proc_maps_entries_read) return;
+  CHECK_LT(num_runner_proc_maps_entries, kMaxRunnerProcMapsEntries);
+  ProcMapsEntry& entry =
+      runner_proc_maps_entries[num_runner_proc_maps_entries++];
+  entry.start_address = start_address;
+  entry.limit_address = limit_address;
+  const size_t name_size = std::min(strlen(name), sizeof(entry.name) - 1);
+  memcpy(entry.name, name, name_size);
+  entry.name[name_size] = '\0';
+}
+
+void RecordRunnerMunmap(uint64_t start_address, uint64_t limit_address) {
+  if (!runner_proc_maps_entries_read) return;
+  for (size_t i = 0; i < num_runner_proc_maps_entries; ++i) {
+    const ProcMapsEntry& entry = runner_proc_maps_entries[i];
+    if (entry.start_address == start_address &&
+        entry.limit_address == limit_address) {
+      // Order does not matter, move the last entry here.
+      runner_proc_maps_entries[i] =
+          runner_proc_maps_entries[--num_runner_proc_maps_entries];
+      return;
+    }
+  }
+}
+
 bool SnapOverlapsWithProcMapsEntries(const Snap<Host>& snap,
                                      const ProcMapsEntry* proc_maps_entries,
                                      size_t num_proc_maps_entries) {
@@ -92,6 +137,46 @@ bool SnapOverlapsWithProcMapsEntries(const Snap<Host>& snap,
   return false;
 }
 
+const char* const* ReadSnapIdList(const char* filename, size_t* num_ids) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    LOG_FATAL("Cannot open ", filename, ": ", ErrnoStr(errno));
+  }
+  const off_t file_size = lseek(fd, 0, SEEK_END);
+  CHECK_NE(file_size, -1);
+  CHECK_EQ(lseek(fd, 0, SEEK_SET), 0);
+
+  // Each ID takes at least 2 bytes including its line terminator, except for
+  // an unterminated last line. The extra byte terminates that line.
+  const size_t max_ids = file_size / 2 + 1;
+  const size_t alloc_size = max_ids * sizeof(const char*) + file_size + 1;
+  void* memory = mmap(nullptr, alloc_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED) {
+    LOG_FATAL("mmap() failed: ", ErrnoStr(errno));
+  }
+  const char** ids = static_cast<const char**>(memory);
+  char* contents = reinterpret_cast<char*>(ids + max_ids);
+  if (Read(fd, contents, file_size) != file_size) {
+    LOG_FATAL("Cannot read ", filename);
+  }
+  CHECK_EQ(close(fd), 0);
+
+  // Terminate each line in place. mmap() zero-fills the last byte.
+  *num_ids = 0;
+  char* line = contents;
+  for (char* p = contents; p <= contents + file_size; ++p) {
+    if (*p == '\n' || *p == '\0') {
+      *p = '\0';
+      if (p != line) {
+        ids[(*num_ids)++] = line;
+      }
+      line = p + 1;
+    }
+  }
+  return ids;
+}
+
 void LogToStdout(const char* data) { Write(STDOUT_FILENO, data, strlen(data)); }
 
 #define ALLOW_SYSCALL(name)                                              \
@@ -112,11 +197,20 @@ void LogToStdout(const char* data) { Write(STDOUT_FILENO, data, strlen(data)); }
       BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, AUDIT_ARCH_CURRENT, 1, 0),       \
       BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_KILL)
 
-void EnterSeccompFilterMode(const SeccompOptions& options) {
-  CHECK_EQ(close(STDIN_FILENO), 0);
+void SetNoNewPrivs() {
+  static bool set = false;
+  if (set) return;
   if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) < 0) {
     LOG_FATAL("prctl(PR_SET_NO_NEW_PRIVS) failed: ", ErrnoStr(errno));
   }
+  set = true;
+}
+
+void EnterSeccompFilterMode(const SeccompOptions& options) {
+  if (!options.allow_read_stdin) {
+    CHECK_EQ(close(STDIN_FILENO), 0);
+  }
+  SetNoNewPrivs();
 
   // The below program is roughly this in pseudocode
   // k := seccomp_data.arch
@@ -151,9 +245,35 @@ void EnterSeccompFilterMode(const SeccompOptions& options) {
   constexpr sock_filter kAllowMmap[] = {
       ALLOW_SYSCALL(mmap),
   };
+  constexpr sock_filter kAllowMunmap[] = {
+      ALLOW_SYSCALL(munmap),
+  };
+  constexpr sock_filter kAllowMprotect[] = {
+      ALLOW_SYSCALL(mprotect),
+  };
   constexpr sock_filter kAllowRtSigreturn[] = {
       ALLOW_SYSCALL(rt_sigreturn),
   };
+  // Allows read(2) on stdin only.
+  constexpr sock_filter kAllowReadStdin[] = {
+      BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr)),
+      BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_read, 0, 3),
+      BPF_STMT(BPF_LD + BPF_W + BPF_ABS,
+               offsetof(struct seccomp_data, args[0])),
+      BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, STDIN_FILENO, 0, 1),
+      BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW),
+  };
+  // Loads the low 32 bits of the first argument, which is where an int is on
+  // little-endian hosts.
+  const sock_filter allow_ioctl_on_fd[] = {
+      BPF_STMT(BPF_LD + BPF_W + BPF_ABS, offsetof(struct seccomp_data, nr)),
+      BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, SYS_ioctl, 0, 3),
+      BPF_STMT(BPF_LD + BPF_W + BPF_ABS,
+               offsetof(struct seccomp_data, args[0])),
+      BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K,
+               static_cast<uint32_t>(options.allow_ioctl_fd), 0, 1),
+      BPF_STMT(BPF_RET + BPF_K, SECCOMP_RET_ALLOW),
+  };
 
   // Last filter to catch all unallowed syscalls.
   constexpr sock_filter kSockFiltersSuffix[]{
@@ -163,7 +283,9 @@ void EnterSeccompFilterMode(const SeccompOptions& options) {
   constexpr size_t kMaxSockFilters =
       ABSL_ARRAYSIZE(kSockFiltersPrefix) + ABSL_ARRAYSIZE(kAllowWrite) +
       ABSL_ARRAYSIZE(kAllowExitGroup) + ABSL_ARRAYSIZE(kAllowKill) +
-      ABSL_ARRAYSIZE(kAllowMmap) + ABSL_ARRAYSIZE(kAllowRtSigreturn) +
+      ABSL_ARRAYSIZE(kAllowMmap) + ABSL_ARRAYSIZE(kAllowMunmap) +
+      ABSL_ARRAYSIZE(kAllowMprotect) + ABSL_ARRAYSIZE(kAllowRtSigreturn) +
+      ABSL_ARRAYSIZE(kAllowReadStdin) + ABSL_ARRAYSIZE(allow_ioctl_on_fd) +
       ABSL_ARRAYSIZE(kSockFiltersSuffix);
 
   sock_filter filters[kMaxSockFilters];
@@ -189,9 +311,21 @@ void EnterSeccompFilterMode(const SeccompOptions& options) {
   if (options.allow_mmap) {
     append_filters(kAllowMmap);
   }
+  if (options.allow_munmap) {
+    append_filters(kAllowMunmap);
+  }
+  if (options.allow_mprotect) {
+    append_filters(kAllowMprotect);
+  }
   if (options.allow_rt_sigreturn) {
     append_filters(kAllowRtSigreturn);
   }
+  if (options.allow_read_stdin) {
+    append_filters(kAllowReadStdin);
+  }
+  if (options.allow_ioctl_fd != -1) {
+    append_filters(allow_ioctl_on_fd);
+  }
   append_filters(kSockFiltersSuffix);
 
   struct sock_fprog filterprog = {.len = num_filters, .filter = filters};
@@ -17,6 +17,7 @@
 
 // Helpers for runner.
 #include <cstddef>
+#include <cstdint>
 #include <optional>
 
 #include "./common/snapshot_enums.h"
@@ -32,6 +33,27 @@ namespace silifuzz {
 size_t ReadProcMapsEntries(ProcMapsEntry* proc_maps_entries,
                            size_t max_proc_maps_entries);
 
+// The runner keeps a cache of its own memory layout so that conflict checks
+// do not need to rescan /proc/self/maps. The cache is read from
+// /proc/self/maps once and then updated by the runner for the mappings it
+// creates and removes itself. Snap mappings are not part of it.
+//
+// Returns the cached entries and stores their number in 'num_entries'. Reads
+// /proc/self/maps on the first call. Callers may adjust the returned entries,
+// e.g. to reserve room for the stack to grow.
+ProcMapsEntry* GetRunnerProcMapsEntries(size_t* num_entries);
+
+// Records that the runner has mapped [start_address, limit_address) for
+// itself. 'name' is truncated to fit ProcMapsEntry::name. No-op if the cache
+// has not been read yet as /proc/self/maps will include the mapping then.
+void RecordRunnerMmap(uint64_t start_address, uint64_t limit_address,
+                      const char* name);
+
+// Records that the runner has unmapped [start_address, limit_address). Only
+// ranges recorded by RecordRunnerMmap() are removed, others are kept in the
+// cache, which errs on the side of reporting conflicts.
+void RecordRunnerMunmap(uint64_t start_address, uint64_t limit_address);
+
 // Returns true iff 'snap' conflicts with any of the memory ranges in one of the
 // 'num_proc_maps_entries' elements of 'proc_maps_entries[]'.
 bool SnapOverlapsWithProcMapsEntries(const Snap<Host>& snap,
@@ -43,6 +65,11 @@ bool SnapOverlapsWithProcMapsEntries(const Snap<Host>& snap,
 std::optional<snapshot_types::Endpoint> EndSpotToEndpoint(
     const EndSpot& actual_endspot);
 
+// Reads snap IDs listed one per line in `filename`. Empty lines are ignored.
+// Returns an array of the IDs and stores its size in `*num_ids`. The array
+// and the IDs are never freed. It dies if there is any error.
+const char* const* ReadSnapIdList(const char* filename, size_t* num_ids);
+
 // Writes a null-terminated string to the standard output.
 void LogToStdout(const char* data);
 
@@ -56,9 +83,21 @@ struct SeccompOptions {
   // Optional syscalls. These are allowed depending on how the runner is used.
   bool allow_kill = false;
   bool allow_mmap = false;
+  bool allow_munmap = false;
+  bool allow_mprotect = false;
   bool allow_rt_sigreturn = false;
+
+  // If true, stdin is kept open and read(2) is allowed on it only.
+  bool allow_read_stdin = false;
+
+  // If not -1, ioctl(2) is allowed on this file descriptor only.
+  int allow_ioctl_fd = -1;
 };
 
+// Sets no_new_privs of the calling thread, which entering a seccomp sandbox
+// requires and children inherit. Does nothing after the first call.
+void SetNoNewPrivs();
+
 // Closes unused FDs and enters a seccomp sandbox. The sandbox allows only
 // exit_group(2), write(2) by default. This sandbox configuration is similar to
 // seccomp-strict but still allows rdtsc and send SIGSYS when a blocked
@@ -56,10 +56,14 @@ SnapMaker::SnapMaker(const Options& opts) : opts_(opts) {
 }
 
 absl::StatusOr<Snapshot> SnapMaker::Make(const Snapshot& snapshot) {
+  return Make(snapshot.Copy());
+}
+
+absl::StatusOr<Snapshot> SnapMaker::Make(Snapshot&& snapshot) {
   CHECK(!snapshot.expected_end_states().empty());
-  Snapshot copy = snapshot.Copy();
+  Snapshot made = std::move(snapshot);
   snapshot_types::Address orig_endpoint_address;
-  const Snapshot::EndState& es = copy.expected_end_states()[0];
+  const Snapshot::EndState& es = made.expected_end_states()[0];
   if (es.endpoint().type() == Endpoint::kInstruction) {
     orig_endpoint_address = es.endpoint().instruction_address();
   } else {
@@ -70,15 +74,15 @@ absl::StatusOr<Snapshot> SnapMaker::Make(const Snapshot& snapshot) {
   // to repair the latter cases.
   Snapshot::EndState undef_end_state =
       Snapshot::EndState(Endpoint(orig_endpoint_address));
-  copy.set_expected_end_states({});
-  copy.set_negative_memory_mappings({});
-  RETURN_IF_NOT_OK_PLUS(copy.can_add_expected_end_state(undef_end_state),
+  made.set_expected_end_states({});
+  made.set_negative_memory_mappings({});
+  RETURN_IF_NOT_OK_PLUS(made.can_add_expected_end_state(undef_end_state),
                         "Cannot add an undef endstate:");
-  copy.add_expected_end_state(undef_end_state);
+  made.add_expected_end_state(undef_end_state);
 
   MakerStopReason stop_reason;
   ASSIGN_OR_RETURN_IF_NOT_OK(Endpoint actual_endpoint,
-                             MakeLoop(&copy, &stop_reason));
+                             MakeLoop(&made, &stop_reason));
   if (stop_reason != MakerStopReason::kEndpoint) {
     std::string msg =
         absl::StrCat(EnumStr(stop_reason), " isn't Snap-compatible.");
@@ -90,22 +94,26 @@ absl::StatusOr<Snapshot> SnapMaker::Make(const Snapshot& snapshot) {
   }
   Snapshot::EndState repaired_end_state = Snapshot::EndState(actual_endpoint);
 
-  copy.set_expected_end_states({});
-  RETURN_IF_NOT_OK(copy.can_add_expected_end_state(repaired_end_state));
-  copy.add_expected_end_state(repaired_end_state);
-  return copy;
+  made.set_expected_end_states({});
+  RETURN_IF_NOT_OK(made.can_add_expected_end_state(repaired_end_state));
+  made.add_expected_end_state(repaired_end_state);
+  return made;
 }
 
 absl::StatusOr<Snapshot> SnapMaker::RecordEndState(const Snapshot& snapshot) {
+  return RecordEndState(snapshot.Copy());
+}
+
+absl::StatusOr<Snapshot> SnapMaker::RecordEndState(Snapshot&& snapshot) {
   SnapifyOptions snapify_opts =
       SnapifyOptions::V2InputMakeOpts(snapshot.architecture_id());
   ASSIGN_OR_RETURN_IF_NOT_OK(Snapshot snapified,
-                             Snapify(snapshot, snapify_opts));
+                             Snapify(std::move(snapshot), snapify_opts));
   ASSIGN_OR_RETURN_IF_NOT_OK(
       RunnerDriver recorder,
       RunnerDriverFromSnapshot(snapified, opts_.runner_path));
   ASSIGN_OR_RETURN_IF_NOT_OK(RunnerDriver::RunResult record_result,
-                             recorder.MakeOne(snapified.id()));
+                             MakeOne(recorder, snapified.id()));
   if (record_result.success()) {
     RETURN_IF_NOT_OK(snapified.IsComplete());
     return snapified;
@@ -133,7 +141,11 @@ absl::StatusOr<Snapshot> SnapMaker::RecordEndState(const Snapshot& snapshot) {
 
 absl::StatusOr<Snapshot> SnapMaker::CheckTrace(
     const Snapshot& snapshot, const TraceOptions& trace_options) const {
-  Snapshot copy = snapshot.Copy();
+  return CheckTrace(snapshot.Copy(), trace_options);
+}
+
+absl::StatusOr<Snapshot> SnapMaker::CheckTrace(
+    Snapshot&& snapshot, const TraceOptions& trace_options) const {
   // TODO(ncbray): instruction filtering on aarch64. This will likely involve
   // static decompilation rather than dynamic tracing.
 #if defined(__x86_64__)
@@ -142,8 +154,12 @@ absl::StatusOr<Snapshot> SnapMaker::CheckTrace(
       RunnerDriverFromSnapshot(snapshot, opts_.runner_path));
 
   DisassemblingSnapTracer tracer(snapshot, trace_options);
+  // Only the snapshot's own instructions are inspected, so don't single-step
+  // the runner code leading into it nor fetch registers outside of it.
   absl::StatusOr<RunnerDriver::RunResult> trace_result_or = driver.TraceOne(
-      snapshot.id(), absl::bind_front(&DisassemblingSnapTracer::Step, &tracer));
+      snapshot.id(), absl::bind_front(&DisassemblingSnapTracer::Step, &tracer),
+      /*num_iterations=*/1, snapshot.ExtractRip(snapshot.registers()),
+      absl::bind_front(&DisassemblingSnapTracer::WantsStep, &tracer));
   DisassemblingSnapTracer::TraceResult trace_result = tracer.trace_result();
 
   if (!trace_result_or.status().ok() || !trace_result_or->success()) {
@@ -153,9 +169,9 @@ absl::StatusOr<Snapshot> SnapMaker::CheckTrace(
   Snapshot::TraceData trace_data(trace_result.instructions_executed,
                                  absl::StrJoin(trace_result.disassembly, "\n"));
   trace_data.add_platform(CurrentPlatformId());
-  copy.set_trace_data({trace_data});
+  snapshot.set_trace_data({trace_data});
 #endif
-  return copy;
+  return std::move(snapshot);
 }
 
 absl::Status SnapMaker::VerifyPlaysDeterministically(
@@ -173,9 +189,19 @@ absl::Status SnapMaker::VerifyPlaysDeterministically(
   // Current code plays the snapshot several times with ASLR enabled which
   // takes care of vDSO mappings and stack but the runner code itself is
   // always placed at the fixed address (--image-base linker arg).
-  ASSIGN_OR_RETURN_IF_NOT_OK(
-      RunnerDriver::RunResult verify_result,
-      driver.VerifyOneRepeatedly(snapified.id(), opts_.num_verify_attempts));
+  absl::StatusOr<RunnerDriver::RunResult> verify_result_or;
+  if (!opts_.verify_cpus.empty()) {
+    verify_result_or = driver.VerifyOneOnCPUs(
+        snapified.id(), opts_.verify_cpus, opts_.num_verify_attempts);
+  } else if (opts_.zygote_pool != nullptr) {
+    verify_result_or = opts_.zygote_pool->VerifyOneRepeatedly(
+        driver, snapified.id(), opts_.num_verify_attempts);
+  } else {
+    verify_result_or =
+        driver.VerifyOneRepeatedly(snapified.id(), opts_.num_verify_attempts);
+  }
+  ASSIGN_OR_RETURN_IF_NOT_OK(RunnerDriver::RunResult verify_result,
+                             std::move(verify_result_or));
   if (!verify_result.success()) {
     if (VLOG_IS_ON(1)) {
       LinePrinter lp(LinePrinter::StdErrPrinter);
@@ -188,8 +214,18 @@ absl::Status SnapMaker::VerifyPlaysDeterministically(
   return absl::OkStatus();
 }
 
+absl::StatusOr<RunnerDriver::RunResult> SnapMaker::MakeOne(
+    const RunnerDriver& driver, absl::string_view snap_id,
+    size_t max_pages_to_add) const {
+  if (opts_.zygote_pool != nullptr) {
+    return opts_.zygote_pool->MakeOne(driver, snap_id, max_pages_to_add);
+  }
+  return driver.MakeOne(snap_id, max_pages_to_add);
+}
+
 absl::Status SnapMaker::AddWritableMemoryForAddress(
-    Snapshot* snapshot, snapshot_types::Address addr) {
+    Snapshot* snapshot, snapshot_types::Address addr,
+    const SnapifyOptions& snapify_opts) {
   const uint64_t kPageSizeBytes = snapshot->page_size();
 
   // Starting address of the page containing `addr`.
@@ -200,14 +236,10 @@ absl::Status SnapMaker::AddWritableMemoryForAddress(
       Snapshot::MemoryMapping::CanMakeSized(page_address, kPageSizeBytes));
   auto m = Snapshot::MemoryMapping::MakeSized(page_address, kPageSizeBytes,
                                               MemoryPerms::RW());
-  RETURN_IF_NOT_OK(snapshot->can_add_memory_mapping(m));
   // NOTE: just because the mapping can be added to the snapshot does not
   // mean it can actually be mapped when run (e.g. 0x0 address).
-  snapshot->add_memory_mapping(m);
   Snapshot::MemoryBytes mb(page_address, std::string(kPageSizeBytes, '\0'));
-  RETURN_IF_NOT_OK(snapshot->can_add_memory_bytes(mb));
-  snapshot->add_memory_bytes(std::move(mb));
-  return absl::OkStatus();
+  return SnapifyAddedMemory(*snapshot, m, mb, snapify_opts);
 }
 
 absl::StatusOr<Endpoint> SnapMaker::MakeLoop(Snapshot* snapshot,
@@ -218,13 +250,20 @@ absl::StatusOr<Endpoint> SnapMaker::MakeLoop(Snapshot* snapshot,
   SnapifyOptions snapify_opts =
       SnapifyOptions::V2InputMakeOpts(snapshot->architecture_id());
 
+  // Snapify once. Pages added below keep the snapshot Snapify()-ed, so the
+  // loop does not redo the full pass over all of its memory for every page.
+  ASSIGN_OR_RETURN_IF_NOT_OK(*snapshot,
+                             Snapify(std::move(*snapshot), snapify_opts));
   while (true) {
-    ASSIGN_OR_RETURN_IF_NOT_OK(*snapshot, Snapify(*snapshot, snapify_opts));
     ASSIGN_OR_RETURN_IF_NOT_OK(
         RunnerDriver runner_driver,
         RunnerDriverFromSnapshot(*snapshot, opts_.runner_path));
-    ASSIGN_OR_RETURN_IF_NOT_OK(RunnerDriver::RunResult make_result,
-                               runner_driver.MakeOne(snapshot->id()));
+    // Let the runner map missing data pages itself so that a snapshot
+    // needing several pages does not take a runner invocation per page.
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        RunnerDriver::RunResult make_result,
+        MakeOne(runner_driver, snapshot->id(),
+                opts_.max_pages_to_add - pages_added));
     if (make_result.success()) {
       // In practice this can happen if the snapshot hits just the right
       // sequence of instructions to call _exit(0) either by jumping into
@@ -233,6 +272,21 @@ absl::StatusOr<Endpoint> SnapMaker::MakeLoop(Snapshot* snapshot,
           absl::StrCat("Unlikely: snapshot ", snapshot->id(),
                        " had an undefined end state yet ran successfully"));
     }
+    // Pages mapped by the runner are reported as end state memory bytes
+    // outside of the snapshot's mappings. They were zero-filled when mapped,
+    // which is what AddWritableMemoryForAddress() adds too.
+    for (const Snapshot::MemoryBytes& memory_bytes :
+         make_result.player_result().actual_end_state->memory_bytes()) {
+      if (snapshot->mapped_memory_map().Contains(
+              memory_bytes.start_address())) {
+        continue;
+      }
+      VLOG_INFO(1, "Adding a page mapped by the runner at ",
+                HexStr(memory_bytes.start_address()));
+      RETURN_IF_NOT_OK(AddWritableMemoryForAddress(
+          snapshot, memory_bytes.start_address(), snapify_opts));
+      pages_added++;
+    }
     const Snapshot::Endpoint& ep =
         make_result.player_result().actual_end_state->endpoint();
     switch (make_result.player_result().outcome) {
@@ -261,8 +315,8 @@ absl::StatusOr<Endpoint> SnapMaker::MakeLoop(Snapshot* snapshot,
                 return ep;
               }
               VLOG_INFO(1, "Adding a page for ", HexStr(ep.sig_address()));
-              RETURN_IF_NOT_OK(
-                  AddWritableMemoryForAddress(snapshot, ep.sig_address()));
+              RETURN_IF_NOT_OK(AddWritableMemoryForAddress(
+                  snapshot, ep.sig_address(), snapify_opts));
               pages_added++;
               continue;
             }
@@ -16,12 +16,16 @@
 #define THIRD_PARTY_SILIFUZZ_RUNNER_SNAP_MAKER_H_
 
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
 #include "./common/snapshot.h"
 #include "./common/snapshot_enums.h"
 #include "./player/trace_options.h"
+#include "./runner/driver/runner_driver.h"
+#include "./snap/gen/snap_generator.h"
 
 namespace silifuzz {
 
@@ -51,6 +55,19 @@ class SnapMaker {
     // value is somewhat arbitrary but it should normally be > 1.
     int num_verify_attempts = 5;
 
+    // CPUs to verify on. When not empty, Verify() pins the attempts to these
+    // CPUs round-robin and plays attempts on different CPUs concurrently.
+    // This is faster than playing all attempts in turn and also catches
+    // non-determinism that depends on the core, e.g. when listing SMT
+    // siblings or CPUs of different core types. When empty, all attempts
+    // are played in turn on whatever CPU the scheduler picks.
+    std::vector<int> verify_cpus;
+
+    // If not null, Make(), RecordEndState() and Verify() fork their runners
+    // from zygotes of this pool instead of exec'ing runner_path each time.
+    // Verify() still execs when verify_cpus is not empty. Not owned.
+    ZygotePool* zygote_pool = nullptr;
+
     absl::Status Validate() const {
       if (runner_path.empty()) {
         return absl::InvalidArgumentError("runner_path must be non-empty");
@@ -61,6 +78,15 @@ class SnapMaker {
       if (num_verify_attempts <= 0) {
         return absl::InvalidArgumentError("num_verify_attempts <= 0");
       }
+      for (int cpu : verify_cpus) {
+        if (cpu < 0) {
+          return absl::InvalidArgumentError("verify_cpus has a CPU < 0");
+        }
+      }
+      if (zygote_pool != nullptr && zygote_pool->runner_path() != runner_path) {
+        return absl::InvalidArgumentError(
+            "zygote_pool runs a different runner binary");
+      }
 
       return absl::OkStatus();
     }
@@ -87,12 +113,18 @@ class SnapMaker {
   //
   // One might want to apply both of these to the snapshot (re)made by Make():
   // RecordEndState() and Snapshot::NormalizeAll().
+  //
+  // The rvalue overloads of this, RecordEndState() and CheckTrace() consume
+  // the input instead of copying it, which saves copying all memory bytes of
+  // the snapshot when the caller does not need it afterwards.
   absl::StatusOr<Snapshot> Make(const Snapshot& snapshot);
+  absl::StatusOr<Snapshot> Make(Snapshot&& snapshot);
 
   // Records an expected end state for the input snapshot.
   // RETURNS: A snapshot with exactly one expected end state that satisfies
   // EndState::IsComplete() or an error.
   absl::StatusOr<Snapshot> RecordEndState(const Snapshot& snapshot);
+  absl::StatusOr<Snapshot> RecordEndState(Snapshot&& snapshot);
 
   // Verifies the snapshot plays deterministically i.e. reaches the same
   // expected end state when played multiple times.
@@ -110,10 +142,15 @@ class SnapMaker {
   absl::StatusOr<Snapshot> CheckTrace(
       const Snapshot& snapshot,
       const TraceOptions& trace_options = TraceOptions::Default()) const;
+  absl::StatusOr<Snapshot> CheckTrace(
+      Snapshot&& snapshot,
+      const TraceOptions& trace_options = TraceOptions::Default()) const;
 
  private:
   // Makes snapshot in a loop until hitting some stopping condition.
-  // The reason for stopping is reported in `stop_reason`.
+  // The reason for stopping is reported in `stop_reason`. Data pages that the
+  // snapshot needs are mapped by the runner during a make run where possible
+  // and then added to `snapshot`, up to Options::max_pages_to_add in total.
   //
   // RETURNS: The endpoint that the snapshot reached or error if the snapshot
   // cannot be made (e.g. makes a syscall)
@@ -122,9 +159,17 @@ class SnapMaker {
   absl::StatusOr<snapshot_types::Endpoint> MakeLoop(
       Snapshot* snapshot, snapshot_types::MakerStopReason* stop_reason);
 
-  // Adds a new writable memory page containing `addr` to the snapshot.
+  // Same as driver.MakeOne() but forks the runner from Options::zygote_pool
+  // when there is one.
+  absl::StatusOr<RunnerDriver::RunResult> MakeOne(
+      const RunnerDriver& driver, absl::string_view snap_id,
+      size_t max_pages_to_add = 0) const;
+
+  // Adds a new writable memory page containing `addr` to the snapshot, which
+  // must be Snapify()-ed with `snapify_opts` and stays so.
   absl::Status AddWritableMemoryForAddress(Snapshot* snapshot,
-                                           snapshot_types::Address addr);
+                                           snapshot_types::Address addr,
+                                           const SnapifyOptions& snapify_opts);
 
   // C-tor args.
   Options opts_;
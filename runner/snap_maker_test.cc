@@ -24,6 +24,7 @@
 #include "./runner/snap_maker_test_util.h"
 #include "./snap/testing/snap_test_snapshots.h"
 #include "./util/arch.h"
+#include "./util/cpu_id.h"
 #include "./util/testing/status_macros.h"
 #include "./util/testing/status_matchers.h"
 
@@ -57,6 +58,24 @@ TEST(SnapMaker, RandomRegsMismatch) {
                                   HasSubstr("non-deterministic")));
 }
 
+TEST(SnapMaker, VerifyOnCPUs) {
+  const int cpu = GetCPUId();
+  if (cpu == kUnknownCPUId) {
+    GTEST_SKIP() << "Current CPU unknown";
+  }
+  SnapMaker::Options options = DefaultSnapMakerOptionsForTest();
+  options.verify_cpus = {cpu, cpu};
+  auto endsAsExpectedSnap =
+      MakeSnapRunnerTestSnapshot<Host>(TestSnapshot::kEndsAsExpected);
+  ASSERT_OK(FixSnapshotInTest(endsAsExpectedSnap, options));
+
+  auto regsMismatchRandomSnap =
+      MakeSnapRunnerTestSnapshot<Host>(TestSnapshot::kRegsMismatchRandom);
+  EXPECT_THAT(FixSnapshotInTest(regsMismatchRandomSnap, options),
+              StatusIs(absl::StatusCode::kInternal,
+                       HasSubstr("non-deterministic")));
+}
+
 TEST(SnapMaker, SigSegvRead) {
   auto sigSegvReadSnap =
       MakeSnapRunnerTestSnapshot<Host>(TestSnapshot::kSigSegvReadFixable);
@@ -67,6 +86,16 @@ TEST(SnapMaker, SigSegvRead) {
   ASSERT_THAT(result.negative_memory_mappings(), IsEmpty());
 }
 
+TEST(SnapMaker, SigSegvReadNoPagesToAdd) {
+  auto sigSegvReadSnap =
+      MakeSnapRunnerTestSnapshot<Host>(TestSnapshot::kSigSegvReadFixable);
+  SnapMaker::Options options = DefaultSnapMakerOptionsForTest();
+  options.max_pages_to_add = 0;
+  EXPECT_THAT(FixSnapshotInTest(sigSegvReadSnap, options),
+              StatusIs(absl::StatusCode::kInternal,
+                       HasSubstr("isn't Snap-compatible")));
+}
+
 TEST(SnapMaker, Idempotent) {
   auto memoryMismatchSnap =
       MakeSnapRunnerTestSnapshot<Host>(TestSnapshot::kMemoryMismatch);
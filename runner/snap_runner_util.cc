@@ -25,6 +25,7 @@
 #include "./snap/exit_sequence.h"
 #include "./util/arch.h"
 #include "./util/checks.h"
+#include "./util/mem_util.h"
 #include "./util/misc_util.h"
 #include "./util/reg_group_io.h"
 #include "./util/ucontext/signal.h"
@@ -38,6 +39,21 @@ namespace silifuzz {
 UContext<Host> snap_exit_context;
 RegisterGroupIOBuffer<Host> snap_exit_register_group_io_buffer{};
 
+// Routines specialized for snap_exit_register_group_io_buffer.register_groups
+// or nullptr to use the generic ones. SnapExitImpl() calls
+// snap_exit_save_register_groups.
+extern "C" {
+SaveRegisterGroupsFunction snap_exit_save_register_groups = nullptr;
+}
+RegisterGroupsChecksumFunction snap_exit_register_groups_checksum = nullptr;
+
+void SelectSnapExitRegisterGroups(const RegisterGroupSet<Host>& groups) {
+  snap_exit_register_group_io_buffer.register_groups = groups;
+  snap_exit_save_register_groups = GetSaveRegisterGroupsFunction(groups);
+  snap_exit_register_groups_checksum =
+      GetRegisterGroupsChecksumFunction(groups);
+}
+
 namespace {
 
 // Before entering a Snap, the runner's context is saved here. After a Snap
@@ -81,6 +97,83 @@ struct SnapSignalContext {
 
 SnapSignalContext snap_signal_context(SnapSignalContext::LINKER_INITIALIZED);
 
+// State of the chain being executed by RunSnapChain(). These are globals
+// because locals modified after saving runner_return_context do not survive
+// returning to it.
+SnapChainCallback snap_chain_callback;
+void* snap_chain_arg;
+const UContext<Host>* snap_chain_next_context;
+
+#if defined(__x86_64__) && defined(SILIFUZZ_BUILD_FOR_NOLIBC)
+// The nolibc runner on x86_64 is built without vector instructions (see
+// X86_NO_VECTOR_INSN_COPTS in util/nolibc.bzl) and does not use floating
+// point, so it can run on the x87/MMX/SSE state left by a snap. A normal snap
+// exit leaves that state live and the next snap entry skips restoring fpregs
+// if they are the same. This is common when consecutive snaps do not modify
+// their fp state and share the same initial one.
+constexpr bool kKeepSnapFPRegs = true;
+#else
+[[maybe_unused]] constexpr bool kKeepSnapFPRegs = false;
+#endif
+
+// True if the live x87/MMX/SSE state is snap_exit_context.fpregs.
+bool snap_exit_fpregs_live = false;
+
+// Switches to the snap context `context`.
+[[noreturn]] void EnterSnapContext(const UContext<Host>& context) {
+#if defined(__x86_64__)
+  if (kKeepSnapFPRegs && snap_exit_fpregs_live &&
+      MemEqT(context.fpregs, snap_exit_context.fpregs)) {
+    RestoreUContextKeepFPRegsNoSyscalls(&context);
+  }
+#endif
+  RestoreUContextNoSyscalls(&context);
+}
+
+// Fills 'end_spot' with the CPU state after the Snap that has just finished
+// executing.
+void CollectEndSpot(EndSpot& end_spot) {
+  if (snap_signal_context.signal_occurred) {
+    end_spot.gregs = &signal_gregs;
+    end_spot.fpregs = &signal_fpregs;
+    ConvertGRegsFromLibC(snap_signal_context.ucontext,
+                         snap_signal_context.extra_gregs, end_spot.gregs);
+    ConvertFPRegsFromLibC(snap_signal_context.ucontext, end_spot.fpregs);
+    end_spot.signum = snap_signal_context.sig_info.si_signo;
+    end_spot.sig_address = AsInt(snap_signal_context.sig_info.si_addr);
+    ConvertSignalRegsFromLibC(snap_signal_context.ucontext, &end_spot.sigregs);
+    // TODO(dougkwan): See if we can compute a checksum after a signal. For now,
+    // we just set checksum to empty.
+    end_spot.register_checksum = {};
+  } else {
+    end_spot.signum = 0;
+    end_spot.sig_address = 0;
+    end_spot.sigregs = {};
+    end_spot.gregs = &snap_exit_context.gregs;
+    end_spot.fpregs = &snap_exit_context.fpregs;
+    // Sanitize gregs and fpregs.
+    ZeroOutGRegsPadding(end_spot.gregs);
+    ZeroOutFPRegsPadding(end_spot.fpregs);
+    end_spot.register_checksum =
+        snap_exit_register_groups_checksum != nullptr
+            ? snap_exit_register_groups_checksum(
+                  snap_exit_register_group_io_buffer)
+            : GetRegisterGroupsChecksum(snap_exit_register_group_io_buffer);
+  }
+
+#if defined(__x86_64__)
+  // When under ptrace the trap flag leaks in siginfo. Hide the flag so that
+  // we don't produce unexpected end states.
+  // This clobbers the trace flag even if it was legitimately raised by the
+  // snapshot itself.  This is not a concern because the rest of SiliFuzz infra
+  // does not expect such behavior and will bail as soon as the flag is
+  // raised.
+  // TODO(ksteuck): [as-needed] We can be more selective about when to hide the
+  // flag (e.g. do this when the process is being traced).
+  end_spot.gregs->eflags &= ~kX86TrapFlag;
+#endif
+}
+
 }  // namespace
 
 bool IsInsideSnap() { return enter_snap_context; }
@@ -122,6 +215,10 @@ extern "C" void RunnerReentry(uint64_t arg1, uint64_t stack_pointer) {
 
   // Signal to RunSnap() that we've left the Snap context
   enter_snap_context = false;
+  if (kKeepSnapFPRegs) {
+    snap_exit_fpregs_live = true;
+    RestoreUContextKeepFPRegsNoSyscalls(&runner_return_context);
+  }
   RestoreUContextNoSyscalls(&runner_return_context);
   __builtin_unreachable();
 }
@@ -154,6 +251,8 @@ void RunnerReentryFromSignal(const ucontext_t& libc_ucontext,
   SaveExtraSignalRegsNoSyscalls(&snap_signal_context.extra_gregs);
   // Signal to RunSnap() that we've left the Snap context
   enter_snap_context = false;
+  // The kernel set up a fresh fp state for the signal handler.
+  snap_exit_fpregs_live = false;
   RestoreUContextNoSyscalls(&runner_return_context);
   __builtin_unreachable();
 }
@@ -166,54 +265,44 @@ void RunSnap(const UContext<Host>& context, const RunnerMainOptions& options,
   SaveUContextNoSyscalls(&runner_return_context);
   // We reach this point either by returning from SaveUContextNoSyscalls()
   // above or from a snap exit. In the latter case, enter_snap_context is
-  // cleared. Code between here and the RestoreUContextNoSyscalls() below
-  // is executed twice.
+  // cleared. Code between here and the EnterSnapContext() below is executed
+  // twice.
 
   if (options.enable_tracer) {
     CHECK_EQ(kill(options.pid, SIGSTOP), 0);
   }
 
   if (enter_snap_context) {
-    RestoreUContextNoSyscalls(&context);
-    __builtin_unreachable();
+    EnterSnapContext(context);
   }
   // Otherwise, the snap has just finished executing
-  if (snap_signal_context.signal_occurred) {
-    end_spot.gregs = &signal_gregs;
-    end_spot.fpregs = &signal_fpregs;
-    ConvertGRegsFromLibC(snap_signal_context.ucontext,
-                         snap_signal_context.extra_gregs, end_spot.gregs);
-    ConvertFPRegsFromLibC(snap_signal_context.ucontext, end_spot.fpregs);
-    end_spot.signum = snap_signal_context.sig_info.si_signo;
-    end_spot.sig_address = AsInt(snap_signal_context.sig_info.si_addr);
-    ConvertSignalRegsFromLibC(snap_signal_context.ucontext, &end_spot.sigregs);
-    // TODO(dougkwan): See if we can compute a checksum after a signal. For now,
-    // we just set checksum to empty.
-    end_spot.register_checksum = {};
-  } else {
-    end_spot.signum = 0;
-    end_spot.sig_address = 0;
-    end_spot.sigregs = {};
-    end_spot.gregs = &snap_exit_context.gregs;
-    end_spot.fpregs = &snap_exit_context.fpregs;
-    // Sanitize gregs and fpregs.
-    ZeroOutGRegsPadding(end_spot.gregs);
-    ZeroOutFPRegsPadding(end_spot.fpregs);
-    end_spot.register_checksum =
-        GetRegisterGroupsChecksum(snap_exit_register_group_io_buffer);
-  }
+  CollectEndSpot(end_spot);
+}
 
-#if defined(__x86_64__)
-  // When under ptrace the trap flag leaks in siginfo. Hide the flag so that
-  // we don't produce unexpected end states.
-  // This clobbers the trace flag even if it was legitimately raised by the
-  // snapshot itself.  This is not a concern because the rest of SiliFuzz infra
-  // does not expect such behavior and will bail as soon as the flag is
-  // raised.
-  // TODO(ksteuck): [as-needed] We can be more selective about when to hide the
-  // flag (e.g. do this when the process is being traced).
-  end_spot.gregs->eflags &= ~kX86TrapFlag;
-#endif
+void RunSnapChain(const UContext<Host>& first_context,
+                  const RunnerMainOptions& options, SnapChainCallback callback,
+                  void* arg) {
+  CHECK(!options.enable_tracer);
+  snap_chain_callback = callback;
+  snap_chain_arg = arg;
+  snap_chain_next_context = &first_context;
+  snap_signal_context.signal_occurred = false;
+  enter_snap_context = true;
+
+  SaveUContextNoSyscalls(&runner_return_context);
+  // We reach this point once by returning from SaveUContextNoSyscalls() above
+  // and then once after each snap exit in the chain.
+  if (!enter_snap_context) {
+    EndSpot end_spot;
+    CollectEndSpot(end_spot);
+    snap_chain_next_context = snap_chain_callback(snap_chain_arg, end_spot);
+    if (snap_chain_next_context == nullptr) {
+      return;
+    }
+    snap_signal_context.signal_occurred = false;
+    enter_snap_context = true;
+  }
+  EnterSnapContext(*snap_chain_next_context);
 }
 
 }  // namespace silifuzz
@@ -64,6 +64,15 @@ extern "C" UContext<Host> snap_exit_context;
 // This stores additional register states that are not handled by UContext.
 extern "C" RegisterGroupIOBuffer<Host> snap_exit_register_group_io_buffer;
 
+// Sets the register groups saved into snap_exit_register_group_io_buffer and
+// checksummed at snap exits to `groups`. Also selects save and checksum
+// routines specialized for `groups` so that the exit path does not test them.
+// Until this is first called, the exit path uses the generic routines with the
+// groups in snap_exit_register_group_io_buffer.
+//
+// REQUIRES: Called after calling InitRegisterGroupIO().
+void SelectSnapExitRegisterGroups(const RegisterGroupSet<Host>& groups);
+
 // Returns true if the execution is currently inside a Snap. Can be used inside
 // a signal handler to determine if the signal was raised while executing a
 // Snap. See RunSnap() below.
@@ -87,6 +96,28 @@ void RunnerReentryFromSignal(const ucontext_t& libc_ucontext,
 void RunSnap(const UContext<Host>& context, const RunnerMainOptions& options,
              EndSpot& end_spot);
 
+// Callback used by RunSnapChain() below. It is called in the runner's context
+// after a Snap in the chain exits with the CPU state at the exit in
+// 'end_spot'. The EndSpot is valid until the next Snap starts. Returns the
+// context of the next Snap to execute or nullptr to end the chain. 'arg' is
+// the value passed to RunSnapChain().
+//
+// The callback must not call RunSnap() or RunSnapChain().
+using SnapChainCallback = const UContext<Host>* (*)(void* arg,
+                                                    EndSpot& end_spot);
+
+// Like RunSnap() but executes a chain of Snaps back-to-back, starting with
+// 'first_context'. The runner's context is saved only once for the whole
+// chain instead of once per Snap, which reduces per-Snap overhead. After
+// each Snap exits, 'callback' is invoked to handle the end spot and pick the
+// next Snap. RunSnapChain() returns after 'callback' returns nullptr.
+//
+// REQUIRES: Called after calling InitSnapExit().
+// REQUIRES: options.enable_tracer is false.
+void RunSnapChain(const UContext<Host>& first_context,
+                  const RunnerMainOptions& options, SnapChainCallback callback,
+                  void* arg);
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_RUNNER_SNAP_RUNNER_UTIL_H_
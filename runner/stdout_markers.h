@@ -0,0 +1,40 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_RUNNER_STDOUT_MARKERS_H_
+#define THIRD_PARTY_SILIFUZZ_RUNNER_STDOUT_MARKERS_H_
+
+namespace silifuzz {
+
+// Lines the runner prints on stdout to delimit its output. RunnerDriver looks
+// for the same strings. All are formatted as text proto comments so that the
+// output stays parseable as a SnapshotExecutionResult.
+
+// Marks the end of output for one persistent mode command. Followed by the
+// exit code of the command and a newline.
+inline constexpr char kPersistentModeEndMarker[] =
+    "# silifuzz-runner-exit-code: ";
+
+// With options.max_failures greater than 1, RunnerMain() and persistent mode
+// commands report each failed snap as usual and then print this marker on a
+// line of its own, so that the parent can tell the reports apart.
+inline constexpr char kFailureEndMarker[] = "# silifuzz-failure-end";
+
+// Marks the end of output for one zygote request. Followed by the wait status
+// of the child and a newline.
+inline constexpr char kZygoteEndMarker[] = "# silifuzz-zygote-wait-status: ";
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_RUNNER_STDOUT_MARKERS_H_
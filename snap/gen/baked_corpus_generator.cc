@@ -0,0 +1,153 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./snap/gen/baked_corpus_generator.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "./snap/snap.h"
+#include "./snap/snap_relocator.h"
+#include "./util/arch.h"
+#include "./util/checks.h"
+#include "./util/mmapped_memory_ptr.h"
+
+namespace silifuzz {
+
+namespace {
+
+// Returns a copy of `relocatable` relocated to the address of the copy.
+template <typename Arch>
+absl::StatusOr<MmappedMemoryPtr<const SnapCorpus<Arch>>> RelocatedCopy(
+    absl::string_view relocatable) {
+  MmappedMemoryPtr<char> buffer =
+      AllocateMmappedBuffer<char>(relocatable.size());
+  memcpy(buffer.get(), relocatable.data(), relocatable.size());
+  SnapRelocatorError error;
+  MmappedMemoryPtr<const SnapCorpus<Arch>> corpus =
+      SnapRelocator<Arch>::RelocateCorpus(std::move(buffer), true, &error);
+  if (error != SnapRelocatorError::kOk) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Cannot relocate corpus, error ", static_cast<int>(error)));
+  }
+  return corpus;
+}
+
+template <typename Arch>
+absl::StatusOr<std::string> GenerateBakedCorpusAssemblyImpl(
+    absl::string_view relocatable, absl::string_view symbol) {
+  // Relocate two copies of the corpus to different addresses. The pointers
+  // are the words that differ between them, everything else is the same.
+  // This finds the pointers without duplicating the traversal of the
+  // relocator.
+  ASSIGN_OR_RETURN_IF_NOT_OK(MmappedMemoryPtr<const SnapCorpus<Arch>> first,
+                             RelocatedCopy<Arch>(relocatable));
+  ASSIGN_OR_RETURN_IF_NOT_OK(MmappedMemoryPtr<const SnapCorpus<Arch>> second,
+                             RelocatedCopy<Arch>(relocatable));
+  const uintptr_t first_address = reinterpret_cast<uintptr_t>(first.get());
+  const uintptr_t second_address = reinterpret_cast<uintptr_t>(second.get());
+  const uint64_t size = relocatable.size();
+
+  std::string out = absl::StrCat(
+      "/* Generated by GenerateBakedCorpusAssembly(). Do not edit. */\n"
+      "  .section .data.rel.ro,\"aw\"\n"
+      "  .balign 4096\n"
+      "  .globl ",
+      symbol, "\n  .type ", symbol, ", %object\n  .size ", symbol, ", ",
+      size, "\n", symbol, ":\n");
+
+  // Runs of zero words, e.g. empty register groups, are emitted as one
+  // directive.
+  uint64_t num_zero_words = 0;
+  auto flush_zero_words = [&out, &num_zero_words]() {
+    if (num_zero_words > 0) {
+      absl::StrAppend(&out, "  .zero ", num_zero_words * sizeof(uint64_t),
+                      "\n");
+      num_zero_words = 0;
+    }
+  };
+  uint64_t offset = 0;
+  for (; offset + sizeof(uint64_t) <= size; offset += sizeof(uint64_t)) {
+    uint64_t first_word, second_word;
+    memcpy(&first_word, reinterpret_cast<const char*>(first_address) + offset,
+           sizeof(first_word));
+    memcpy(&second_word,
+           reinterpret_cast<const char*>(second_address) + offset,
+           sizeof(second_word));
+    if (first_word != second_word) {
+      const uint64_t target = first_word - first_address;
+      if (second_word - second_address != target || target > size) {
+        return absl::InternalError(
+            absl::StrCat("Unexpected relocation at offset ", offset));
+      }
+      flush_zero_words();
+      absl::StrAppend(&out, "  .quad ", symbol, " + 0x", absl::Hex(target),
+                      "\n");
+    } else if (first_word == 0) {
+      ++num_zero_words;
+    } else {
+      flush_zero_words();
+      absl::StrAppend(&out, "  .quad 0x", absl::Hex(first_word), "\n");
+    }
+  }
+  flush_zero_words();
+  for (; offset < size; ++offset) {
+    absl::StrAppend(
+        &out, "  .byte 0x",
+        absl::Hex(reinterpret_cast<const uint8_t*>(first_address)[offset]),
+        "\n");
+  }
+
+  absl::StrAppend(&out,
+                  "\n"
+                  "  .section .rodata\n"
+                  "  .balign 8\n"
+                  "  .globl ",
+                  symbol, "_size\n  .type ", symbol, "_size, %object\n",
+                  "  .size ", symbol, "_size, 8\n", symbol, "_size:\n",
+                  "  .quad ", size, "\n",
+                  "\n"
+                  "  .section .note.GNU-stack,\"\",%progbits\n");
+  return out;
+}
+
+}  // namespace
+
+absl::StatusOr<std::string> GenerateBakedCorpusAssembly(
+    absl::string_view relocatable, absl::string_view symbol) {
+  SnapCorpusHeader header;
+  if (relocatable.size() < sizeof(header)) {
+    return absl::InvalidArgumentError("Corpus is too small");
+  }
+  memcpy(&header, relocatable.data(), sizeof(header));
+  switch (static_cast<ArchitectureId>(header.architecture_id)) {
+    case ArchitectureId::kX86_64:
+    case ArchitectureId::kAArch64:
+      return ARCH_DISPATCH(GenerateBakedCorpusAssemblyImpl,
+                           static_cast<ArchitectureId>(header.architecture_id),
+                           relocatable, symbol);
+    default:
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unsupported corpus architecture ",
+                       static_cast<int>(header.architecture_id)));
+  }
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,47 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_SNAP_GEN_BAKED_CORPUS_GENERATOR_H_
+#define THIRD_PARTY_SILIFUZZ_SNAP_GEN_BAKED_CORPUS_GENERATOR_H_
+
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace silifuzz {
+
+// Default symbol of a baked-in corpus, see runner/baked_snap_corpus.cc.
+inline constexpr absl::string_view kBakedSnapCorpusSymbol =
+    "silifuzz_baked_snap_corpus";
+
+// Generates GNU assembler source that defines the relocatable Snap corpus in
+// `relocatable` as the contents of a global object `symbol`. Pointers in the
+// corpus are emitted as `symbol` plus their offset, so they are resolved by
+// the linker and a binary linking the object can use the corpus without
+// relocating it at run time. The source also defines `symbol`_size, a
+// uint64_t holding the size of the corpus.
+//
+// The corpus is placed in .data.rel.ro, which is read-only after relocation
+// in position independent binaries and in a static runner.
+//
+// The corpus checksum is verified before generating the source. The
+// architecture of the corpus may differ from the host's.
+absl::StatusOr<std::string> GenerateBakedCorpusAssembly(
+    absl::string_view relocatable,
+    absl::string_view symbol = kBakedSnapCorpusSymbol);
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_SNAP_GEN_BAKED_CORPUS_GENERATOR_H_
@@ -0,0 +1,136 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./snap/gen/baked_corpus_generator.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "./common/snapshot.h"
+#include "./common/snapshot_test_enum.h"
+#include "./common/snapshot_test_util.h"
+#include "./snap/gen/relocatable_snap_generator.h"
+#include "./snap/gen/snap_generator.h"
+#include "./snap/snap.h"
+#include "./snap/snap_relocator.h"
+#include "./snap/snap_util.h"
+#include "./snap/testing/snap_generator_test_lib.h"
+#include "./snap/testing/snap_test_snapshots.h"
+#include "./util/arch.h"
+#include "./util/checks.h"
+#include "./util/mmapped_memory_ptr.h"
+#include "./util/testing/status_macros.h"
+
+namespace silifuzz {
+namespace {
+
+// Plays the assembler and the linker: fills `buffer` from the data
+// directives that follow the label of `symbol` in `assembly`, resolving
+// `symbol` to the address of `buffer`. Returns the number of bytes filled.
+size_t Assemble(absl::string_view assembly, absl::string_view symbol,
+                char* buffer) {
+  const uint64_t base = reinterpret_cast<uint64_t>(buffer);
+  const std::string label = absl::StrCat(symbol, ":");
+  const std::string relocation = absl::StrCat(symbol, " + 0x");
+  bool in_data = false;
+  size_t offset = 0;
+  for (absl::string_view line : absl::StrSplit(assembly, '\n')) {
+    if (!in_data) {
+      in_data = line == label;
+      continue;
+    }
+    if (line.empty()) break;
+    uint64_t value;
+    if (absl::ConsumePrefix(&line, "  .quad ")) {
+      if (absl::ConsumePrefix(&line, relocation)) {
+        CHECK(absl::SimpleHexAtoi(line, &value));
+        value += base;
+      } else {
+        CHECK(absl::SimpleHexAtoi(line, &value));
+      }
+      memcpy(buffer + offset, &value, sizeof(value));
+      offset += sizeof(value);
+    } else if (absl::ConsumePrefix(&line, "  .zero ")) {
+      CHECK(absl::SimpleAtoi(line, &value));
+      memset(buffer + offset, 0, value);
+      offset += value;
+    } else if (absl::ConsumePrefix(&line, "  .byte ")) {
+      CHECK(absl::SimpleHexAtoi(line, &value));
+      buffer[offset++] = static_cast<char>(value);
+    } else {
+      LOG_FATAL("Unexpected line: ", line);
+    }
+  }
+  return offset;
+}
+
+template <typename>
+struct BakedCorpusGenerator : ::testing::Test {};
+using arch_typelist = ::testing::Types<ALL_ARCH_TYPES>;
+TYPED_TEST_SUITE(BakedCorpusGenerator, arch_typelist);
+
+TYPED_TEST(BakedCorpusGenerator, RoundTrip) {
+  std::vector<Snapshot> snapshots;
+  for (TestSnapshot type :
+       {TestSnapshot::kEndsAsExpected, TestSnapshot::kRegsMismatch}) {
+    Snapshot snapshot = MakeSnapRunnerTestSnapshot<TypeParam>(type);
+    SnapifyOptions snapify_options =
+        SnapifyOptions::V2InputRunOpts(snapshot.architecture_id());
+    ASSERT_OK_AND_ASSIGN(Snapshot snapified,
+                         Snapify(snapshot, snapify_options));
+    snapshots.push_back(std::move(snapified));
+  }
+  MmappedMemoryPtr<char> relocatable =
+      GenerateRelocatableSnaps(TypeParam::architecture_id, snapshots);
+  const size_t size = MmappedMemorySize(relocatable);
+  ASSERT_OK_AND_ASSIGN(
+      std::string assembly,
+      GenerateBakedCorpusAssembly(absl::string_view(relocatable.get(), size),
+                                  "test_corpus"));
+  EXPECT_TRUE(absl::StrContains(
+      assembly, absl::StrCat("test_corpus_size:\n  .quad ", size, "\n")));
+
+  MmappedMemoryPtr<char> baked = AllocateMmappedBuffer<char>(size);
+  ASSERT_EQ(Assemble(assembly, "test_corpus", baked.get()), size);
+  SnapRelocatorError error;
+  MmappedMemoryPtr<const SnapCorpus<TypeParam>> corpus =
+      SnapRelocator<TypeParam>::AdoptRelocatedCorpus(std::move(baked), false,
+                                                     &error);
+  ASSERT_EQ(error, SnapRelocatorError::kOk);
+  ASSERT_EQ(corpus->snaps.size, snapshots.size());
+  for (size_t i = 0; i < snapshots.size(); ++i) {
+    ASSERT_OK_AND_ASSIGN(Snapshot snapshot,
+                         SnapToSnapshot(*corpus->snaps.at(i),
+                                        TestSnapshotPlatform<TypeParam>()));
+    EXPECT_EQ(snapshot, snapshots[i]);
+  }
+}
+
+TEST(BakedCorpusGenerator, RejectsBadCorpus) {
+  EXPECT_FALSE(GenerateBakedCorpusAssembly("too small").ok());
+  std::string garbage(4096, 'x');
+  EXPECT_FALSE(GenerateBakedCorpusAssembly(garbage).ok());
+}
+
+}  // namespace
+}  // namespace silifuzz
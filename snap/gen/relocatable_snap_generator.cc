@@ -14,15 +14,36 @@
 
 #include "./snap/gen/relocatable_snap_generator.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <limits>
+#include <memory>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/inlined_vector.h"
 #include "absl/hash/hash.h"
 #include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "./common/memory_bytes_set.h"
 #include "./common/memory_perms.h"
+#include "./common/memory_state.h"
 #include "./common/snapshot.h"
 #include "./common/snapshot_util.h"
 #include "./snap/gen/relocatable_data_block.h"
@@ -31,11 +52,15 @@
 #include "./snap/snap_checksum.h"
 #include "./util/arch.h"
 #include "./util/checks.h"
+#include "./util/itoa.h"
+#include "./util/lz4_block.h"
 #include "./util/misc_util.h"
 #include "./util/mmapped_memory_ptr.h"
 #include "./util/page_util.h"
+#include "./util/path_util.h"
 #include "./util/reg_checksum.h"
 #include "./util/reg_checksum_util.h"
+#include "./util/thread_pool.h"
 #include "./util/ucontext/serialize.h"
 
 namespace silifuzz {
@@ -70,6 +95,559 @@ void SetRegisterState(const Snapshot::RegisterState& src,
   *memory_checksum = CalculateMemoryChecksum(*tgt);
 }
 
+// Returns the number of executable memory mappings in `snapshot`. Each of
+// them has an entry in SnapCorpus::code_index.
+size_t NumCodeIntervals(const Snapshot& snapshot) {
+  size_t num_code_intervals = 0;
+  for (const Snapshot::MemoryMapping& mapping : snapshot.memory_mappings()) {
+    if (mapping.perms().Has(MemoryPerms::kExecutable)) {
+      ++num_code_intervals;
+    }
+  }
+  return num_code_intervals;
+}
+
+// Returns the number of memory bytes in writable mappings of `snapshot`. Each
+// of them is copied into the hot metadata, see SnapCorpus::hot_entries.
+size_t NumWritableMemoryBytes(const Snapshot& snapshot) {
+  const BorrowedMappingBytesList bytes_per_mapping =
+      SplitBytesByMapping(snapshot.memory_mappings(), snapshot.memory_bytes());
+  size_t num_writable_memory_bytes = 0;
+  for (size_t i = 0; i < snapshot.memory_mappings().size(); ++i) {
+    if (snapshot.memory_mappings()[i].perms().Has(MemoryPerms::kWritable)) {
+      num_writable_memory_bytes += bytes_per_mapping[i].size();
+    }
+  }
+  return num_writable_memory_bytes;
+}
+
+// Returns the number of elements of Snap::platform_end_states generated for
+// `snapshot`. All expected end states but the first one become platform end
+// states.
+size_t NumPlatformEndStates(const Snapshot& snapshot) {
+  const size_t num_end_states = snapshot.expected_end_states().size();
+  return num_end_states > 0 ? num_end_states - 1 : 0;
+}
+
+// Returns the SnapEndState::platforms bit mask for `end_state`.
+uint64_t PlatformBits(const Snapshot::EndState& end_state) {
+  uint64_t platform_bits = 0;
+  for (PlatformId platform : end_state.platforms()) {
+    platform_bits |= uint64_t{1} << ToInt(platform);
+  }
+  return platform_bits;
+}
+
+// Returns the checksum of the writable memory of `snapshot` not covered by
+// the memory bytes of `end_state`, see
+// Snap::end_state_unchanged_memory_checksum. This is 0 unless the snapshot
+// was Snapify()-ed with SnapifyOptions::delta_end_state_memory_bytes.
+uint32_t UnchangedMemoryChecksum(const Snapshot& snapshot,
+                                 const Snapshot::EndState& end_state) {
+  // Undefined end states are never verified.
+  if (!end_state.IsComplete().ok()) return 0;
+  MemoryBytesSet unchanged;
+  for (const Snapshot::MemoryMapping& mapping : snapshot.memory_mappings()) {
+    if (mapping.perms().Has(MemoryPerms::kWritable)) {
+      unchanged.Add(mapping.start_address(), mapping.limit_address());
+    }
+  }
+  for (const Snapshot::MemoryBytes& memory_bytes : end_state.memory_bytes()) {
+    unchanged.Remove(memory_bytes.start_address(),
+                     memory_bytes.limit_address());
+  }
+  if (unchanged.empty()) return 0;
+
+  const MemoryState initial_state =
+      MemoryState::MakeInitial(snapshot, MemoryState::kZeroMappedBytes);
+  MemoryChecksumCalculator checksum;
+  unchanged.Iterate([&](Snapshot::Address start, Snapshot::Address limit) {
+    checksum.AddData(initial_state.memory_bytes(start, limit - start));
+  });
+  return checksum.Checksum();
+}
+
+// Copies `size` bytes from `src` to `dst` and returns their memory checksum.
+// Each chunk is checksummed right after it is copied, while it is still in
+// cache, so that generation reads the data from memory only once.
+uint32_t CopyAndChecksum(char* dst, const char* src, size_t size) {
+  constexpr size_t kChunkSize = 16 * 1024;
+  MemoryChecksumCalculator checksum;
+  for (size_t offset = 0; offset < size; offset += kChunkSize) {
+    const size_t chunk_size = std::min(kChunkSize, size - offset);
+    memcpy(dst + offset, src + offset, chunk_size);
+    checksum.AddData(dst + offset, chunk_size);
+  }
+  return checksum.Checksum();
+}
+
+// A range of a data block and the memory checksum of its contents.
+struct ChecksummedRange {
+  uint64_t byte_offset;
+  uint64_t size;
+  uint32_t checksum;
+};
+
+// Adds the contents of `block` and any padding up to `end` to `checksum`.
+// Contents covered by `ranges` are added by their checksums without reading
+// them. `ranges` are sorted as a side effect.
+void AddBlockChecksum(const RelocatableDataBlock& block, const char* end,
+                      std::vector<ChecksummedRange>& ranges,
+                      CorpusChecksumCalculator& checksum) {
+  std::sort(ranges.begin(), ranges.end(),
+            [](const ChecksummedRange& lhs, const ChecksummedRange& rhs) {
+              return lhs.byte_offset < rhs.byte_offset;
+            });
+  const char* const begin = block.contents();
+  uint64_t byte_offset = 0;
+  for (const ChecksummedRange& range : ranges) {
+    CHECK_LE(byte_offset, range.byte_offset);
+    checksum.AddData(begin + byte_offset, range.byte_offset - byte_offset);
+    checksum.AddChecksum(range.checksum, range.size);
+    byte_offset = range.byte_offset + range.size;
+  }
+  CHECK_LE(begin + byte_offset, end);
+  checksum.AddData(begin + byte_offset, end - (begin + byte_offset));
+}
+
+// Compresses `byte_data` into `*buffer` for
+// RelocatableSnapGeneratorOptions::compress_memory_bytes. Returns the
+// compressed size or 0 if compression does not save enough space to be worth
+// decompressing when Snaps are set up.
+size_t CompressByteData(const Snapshot::ByteData& byte_data,
+                        std::vector<uint8_t>* buffer) {
+  // SnapMemoryBytes::compressed_size is 32-bit.
+  if (byte_data.size() > std::numeric_limits<uint32_t>::max()) return 0;
+  // Require a saving of at least 1/8 of the size.
+  const size_t max_compressed_size = byte_data.size() - byte_data.size() / 8;
+  buffer->resize(max_compressed_size);
+  return Lz4BlockCompress(reinterpret_cast<const uint8_t*>(byte_data.data()),
+                          byte_data.size(), buffer->data(),
+                          max_compressed_size - 1);
+}
+
+// Returns the corpus format version for a corpus generated with `options`.
+uint8_t FormatVersion(const RelocatableSnapGeneratorOptions& options) {
+  return options.compress_memory_bytes ? kSnapCorpusCompressedFormatVersion
+                                       : 0;
+}
+
+// Returns Snap::code_register_groups of `snapshot` for `options`.
+uint32_t CodeRegisterGroups(const Snapshot& snapshot,
+                            const RelocatableSnapGeneratorOptions& options) {
+  if (!options.code_register_groups) return 0;
+  const uint64_t groups = options.code_register_groups(snapshot);
+  CHECK_EQ(groups >> 32, 0);
+  return static_cast<uint32_t>(groups);
+}
+
+// Returns a function mapping a pointer in a corpus generated into `contents`,
+// which is to be loaded at `load_address`, to the generated object it points
+// to. See FillCorpusIndex().
+auto ContentsOf(char* contents, uintptr_t load_address) {
+  return [contents, load_address](auto* ptr) {
+    using T = std::remove_const_t<std::remove_pointer_t<decltype(ptr)>>;
+    return reinterpret_cast<T*>(contents + (AsInt(ptr) - load_address));
+  };
+}
+
+// Fills the elements of the id and code address indices of generated
+// `corpus`. `contents_of` maps a pointer in the corpus to a mutable pointer
+// to the generated object it points to, see ContentsOf(). The indices are
+// computed from the generated Snaps so that all generators produce identical
+// indices for identical Snaps.
+// REQUIRES: Everything except the index elements has been generated and
+// the index arrays have the expected sizes.
+template <typename Arch, typename ContentsOfFn>
+void FillCorpusIndex(const SnapCorpus<Arch>& corpus, ContentsOfFn contents_of) {
+  std::vector<const Snap<Arch>*> snaps;
+  snaps.reserve(corpus.snaps.size);
+  for (const Snap<Arch>* snap :
+       absl::MakeConstSpan(contents_of(corpus.snaps.elements),
+                           corpus.snaps.size)) {
+    snaps.push_back(contents_of(snap));
+  }
+
+  CHECK_EQ(corpus.id_index.size, snaps.size());
+  uint32_t* id_index = contents_of(corpus.id_index.elements);
+  for (uint32_t i = 0; i < snaps.size(); ++i) {
+    id_index[i] = i;
+  }
+  std::stable_sort(id_index, id_index + snaps.size(),
+                   [&](uint32_t lhs, uint32_t rhs) {
+                     return strcmp(contents_of(snaps[lhs]->id),
+                                   contents_of(snaps[rhs]->id)) < 0;
+                   });
+
+  SnapCodeInterval* code_index = contents_of(corpus.code_index.elements);
+  size_t num_code_intervals = 0;
+  for (uint32_t i = 0; i < snaps.size(); ++i) {
+    const SnapArray<SnapMemoryMapping>& mappings = snaps[i]->memory_mappings;
+    for (const SnapMemoryMapping& mapping : absl::MakeConstSpan(
+             contents_of(mappings.elements), mappings.size)) {
+      if ((mapping.perms & PROT_EXEC) == 0) continue;
+      CHECK_LT(num_code_intervals, corpus.code_index.size);
+      code_index[num_code_intervals++] = {
+          .start_address = mapping.start_address,
+          .limit_address = mapping.start_address + mapping.num_bytes,
+          .max_limit_address = 0,
+          .snap_index = i,
+          .padding = 0,
+      };
+    }
+  }
+  CHECK_EQ(num_code_intervals, corpus.code_index.size);
+  std::sort(code_index, code_index + num_code_intervals,
+            [](const SnapCodeInterval& lhs, const SnapCodeInterval& rhs) {
+              return std::tie(lhs.start_address, lhs.snap_index) <
+                     std::tie(rhs.start_address, rhs.snap_index);
+            });
+  uint64_t max_limit_address = 0;
+  for (size_t i = 0; i < num_code_intervals; ++i) {
+    max_limit_address =
+        std::max(max_limit_address, code_index[i].limit_address);
+    code_index[i].max_limit_address = max_limit_address;
+  }
+}
+
+// Fills the elements of SnapCorpus::hot_entries of a generated corpus and
+// the copies of writable memory bytes they refer to. These are the
+// `num_writable_memory_bytes` elements at `writable_memory_bytes_address`.
+// `contents_of` is as in FillCorpusIndex(). Like the indices, entries are
+// computed from the generated Snaps.
+// REQUIRES: Everything except the hot entries and their memory bytes has been
+// generated and hot_entries has the expected size.
+template <typename Arch, typename ContentsOfFn>
+void FillCorpusHotEntries(const SnapCorpus<Arch>& corpus,
+                          ContentsOfFn contents_of,
+                          uintptr_t writable_memory_bytes_address,
+                          size_t num_writable_memory_bytes) {
+  CHECK_EQ(corpus.hot_entries.size, corpus.snaps.size);
+  const Snap<Arch>* const* snaps = contents_of(corpus.snaps.elements);
+  SnapHotEntry<Arch>* hot_entries = contents_of(corpus.hot_entries.elements);
+  const SnapMemoryBytes* writable_memory_bytes_elements =
+      reinterpret_cast<const SnapMemoryBytes*>(writable_memory_bytes_address);
+  SnapMemoryBytes* writable_memory_bytes =
+      contents_of(writable_memory_bytes_elements);
+
+  size_t num_copied = 0;
+  for (size_t i = 0; i < corpus.snaps.size; ++i) {
+    const Snap<Arch>& snap = *contents_of(snaps[i]);
+    const size_t first_copied = num_copied;
+    uint64_t writable_num_bytes = 0;
+    for (const SnapMemoryMapping& mapping :
+         absl::MakeConstSpan(contents_of(snap.memory_mappings.elements),
+                             snap.memory_mappings.size)) {
+      if (!mapping.writable()) continue;
+      writable_num_bytes += mapping.num_bytes;
+      for (const SnapMemoryBytes& memory_bytes :
+           absl::MakeConstSpan(contents_of(mapping.memory_bytes.elements),
+                               mapping.memory_bytes.size)) {
+        CHECK_LT(num_copied, num_writable_memory_bytes);
+        writable_memory_bytes[num_copied++] = memory_bytes;
+      }
+    }
+    hot_entries[i] = SnapHotEntry<Arch>{
+        .registers = snap.registers,
+        .writable_memory_bytes =
+            {
+                .size = num_copied - first_copied,
+                .elements = writable_memory_bytes_elements + first_copied,
+            },
+        .writable_num_bytes = writable_num_bytes,
+    };
+  }
+  CHECK_EQ(num_copied, num_writable_memory_bytes);
+}
+
+// Returns `address` as a pointer to T.
+template <typename T>
+T* AddressAsPointer(uint64_t address) {
+  return reinterpret_cast<T*>(AsPtr(address));
+}
+
+// Space allocated for an array of generated objects, see EmitSnap().
+struct SinkArray {
+  // Value of pointers to the array in generated objects.
+  uint64_t address = 0;
+
+  // Zero-filled buffer in which the objects are constructed. nullptr if the
+  // sink is not generating.
+  char* contents = nullptr;
+
+  // Owns `contents` for sinks that write objects out once constructed.
+  std::unique_ptr<char[]> buffer;
+};
+
+// The objects of a single Snap are generated by the Emit*() functions below
+// for both Traversal and StreamingTraversal. These differ only in where the
+// objects and data go, which is decided by the `Sink` they pass in:
+//
+//   const RelocatableSnapGeneratorOptions& options() const;
+//
+//   bool generating() const;
+//     Returns false if space is to be allocated without generating objects.
+//
+//   template <typename T> SinkArray Allocate(size_t n);
+//     Allocates an array of `n` objects of type T in the data block for T:
+//     SnapMemoryBytes, SnapMemoryMapping or char for Snap ids.
+//
+//   template <typename T> absl::Status Commit(const SinkArray& array,
+//                                             size_t n);
+//     Called once the objects of `array` are constructed.
+//
+//   absl::StatusOr<uint64_t> ProcessByteData(
+//       const Snapshot::MemoryBytes& memory_bytes);
+//     Places the byte data of `memory_bytes` and returns its address.
+//
+//   absl::StatusOr<uint64_t> ProcessCompressedByteData(
+//       const Snapshot::MemoryBytes& memory_bytes, uint32_t* compressed_size);
+//     Like ProcessByteData() but stores the data LZ4 compressed. Stores the
+//     compressed size in `*compressed_size`. Stores 0 and places nothing if
+//     the data is not worth compressing.
+//
+//   absl::StatusOr<uint64_t> ProcessRegisterState(
+//       const Snapshot::RegisterState& register_state,
+//       bool allow_empty_register_state, uint32_t* memory_checksum);
+//     Places `register_state` and returns its address. Stores the memory
+//     checksum of the generated state in `*memory_checksum`.
+//
+//   uint32_t ByteDataChecksum(const Snapshot::ByteData& byte_data);
+//     Returns the memory checksum of `byte_data`.
+//
+// As all sinks allocate data in the same order, they generate identical
+// corpora.
+
+// Emits a SnapMemoryBytes array for `memory_bytes_list` into `sink`. Byte data
+// may be stored compressed if `compressible` is true. Returns the address of
+// the array.
+template <typename Sink>
+absl::StatusOr<uint64_t> EmitMemoryBytesList(
+    Sink& sink, const BorrowedMemoryBytesList& memory_bytes_list,
+    bool compressible) {
+  const size_t n = memory_bytes_list.size();
+  SinkArray array = sink.template Allocate<SnapMemoryBytes>(n);
+  for (size_t i = 0; i < n; ++i) {
+    const Snapshot::MemoryBytes& memory_bytes = *memory_bytes_list[i];
+    const bool compress_repeating_bytes =
+        sink.options().compress_repeating_bytes &&
+        IsRepeatingByteRun(memory_bytes.byte_values());
+    uint64_t byte_data_address = 0;
+    uint32_t compressed_size = 0;
+    if (!compress_repeating_bytes) {
+      if (compressible) {
+        ASSIGN_OR_RETURN_IF_NOT_OK(
+            byte_data_address,
+            sink.ProcessCompressedByteData(memory_bytes, &compressed_size));
+      }
+      if (compressed_size == 0) {
+        ASSIGN_OR_RETURN_IF_NOT_OK(byte_data_address,
+                                   sink.ProcessByteData(memory_bytes));
+      }
+    }
+    if (!sink.generating()) continue;
+
+    void* snap_memory_bytes = array.contents + i * sizeof(SnapMemoryBytes);
+    if (compress_repeating_bytes) {
+      new (snap_memory_bytes) SnapMemoryBytes{
+          .start_address = memory_bytes.start_address(),
+          .flags = SnapMemoryBytes::kRepeating,
+          .data{.byte_run{
+              .value = memory_bytes.byte_values()[0],
+              .size = memory_bytes.num_bytes(),
+          }},
+      };
+    } else {
+      new (snap_memory_bytes) SnapMemoryBytes{
+          .start_address = memory_bytes.start_address(),
+          .flags = static_cast<uint8_t>(
+              compressed_size != 0 ? SnapMemoryBytes::kCompressed : 0),
+          .compressed_size = compressed_size,
+          .data{.byte_values{
+              .size = memory_bytes.num_bytes(),
+              .elements = AddressAsPointer<const uint8_t>(byte_data_address),
+          }},
+      };
+    }
+  }
+  RETURN_IF_NOT_OK(sink.template Commit<SnapMemoryBytes>(array, n));
+  return array.address;
+}
+
+// Emits a SnapMemoryMapping array for `memory_mappings` into `sink`.
+// `bytes_per_mapping` holds the memory bytes of each mapping. Returns the
+// address of the array.
+template <typename Sink>
+absl::StatusOr<uint64_t> EmitMemoryMappings(
+    Sink& sink, const Snapshot::MemoryMappingList& memory_mappings,
+    const BorrowedMappingBytesList& bytes_per_mapping) {
+  const size_t n = memory_mappings.size();
+  SinkArray array = sink.template Allocate<SnapMemoryMapping>(n);
+  for (size_t i = 0; i < n; ++i) {
+    const Snapshot::MemoryMapping& memory_mapping = memory_mappings[i];
+    const BorrowedMemoryBytesList& memory_bytes_list = bytes_per_mapping[i];
+    // Writable mappings are restored from memory bytes before every run, so
+    // only read-only data is compressed.
+    const bool compressible =
+        sink.options().compress_memory_bytes &&
+        !memory_mapping.perms().Has(MemoryPerms::kWritable);
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        uint64_t memory_bytes_address,
+        EmitMemoryBytesList(sink, memory_bytes_list, compressible));
+    if (!sink.generating()) continue;
+
+    MemoryChecksumCalculator checksum;
+    for (const Snapshot::MemoryBytes* memory_bytes : memory_bytes_list) {
+      checksum.AddChecksum(sink.ByteDataChecksum(memory_bytes->byte_values()),
+                           memory_bytes->byte_values().size());
+    }
+    new (array.contents + i * sizeof(SnapMemoryMapping)) SnapMemoryMapping{
+        .start_address = memory_mapping.start_address(),
+        .num_bytes = memory_mapping.num_bytes(),
+        .perms = memory_mapping.perms().ToMProtect(),
+        .memory_checksum = checksum.Checksum(),
+        .memory_bytes =
+            {
+                .size = memory_bytes_list.size(),
+                .elements = AddressAsPointer<const SnapMemoryBytes>(
+                    memory_bytes_address),
+            },
+    };
+  }
+  RETURN_IF_NOT_OK(sink.template Commit<SnapMemoryMapping>(array, n));
+  return array.address;
+}
+
+// Emits the objects of `snapshot` into `sink`. The Snap is constructed at
+// `snap_contents` and its platform end states at
+// `platform_end_states_contents`, whose address is
+// `platform_end_states_address`. The contents are not used if `sink` is not
+// generating. Nothing is emitted if `snapshot` has a bad register checksum.
+// REQUIRES: `snapshot` is snapified.
+template <typename Arch, typename Sink>
+absl::Status EmitSnap(Sink& sink, const Snapshot& snapshot,
+                      char* snap_contents,
+                      uint64_t platform_end_states_address,
+                      char* platform_end_states_contents) {
+  using RegisterState = typename Snap<Arch>::RegisterState;
+
+  CHECK_EQ(static_cast<int>(snapshot.architecture_id()),
+           static_cast<int>(Arch::architecture_id));
+  // All input snapshots should be Snapify()-ed before they can be compiled.
+  // This means one expected end state, or more with
+  // SnapifyOptions::keep_platform_end_states.
+  DCHECK_GE(snapshot.expected_end_states().size(), 1);
+  std::vector<RegisterChecksum<Arch>> register_checksums;
+  register_checksums.reserve(snapshot.expected_end_states().size());
+  for (const Snapshot::EndState& end_state : snapshot.expected_end_states()) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        RegisterChecksum<Arch> register_checksum,
+        DeserializeRegisterChecksum<Arch>(end_state.register_checksum()));
+    register_checksums.push_back(register_checksum);
+  }
+  const Snapshot::EndState& end_state = snapshot.expected_end_states()[0];
+
+  const size_t id_size = snapshot.id().size() + 1;  // NUL character terminator.
+  SinkArray id = sink.template Allocate<char>(id_size);
+  if (sink.generating()) {
+    memcpy(id.contents, snapshot.id().c_str(), id_size);
+  }
+  RETURN_IF_NOT_OK(sink.template Commit<char>(id, id_size));
+
+  BorrowedMappingBytesList bytes_per_mapping =
+      SplitBytesByMapping(snapshot.memory_mappings(), snapshot.memory_bytes());
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      uint64_t memory_mappings_address,
+      EmitMemoryMappings(sink, snapshot.memory_mappings(), bytes_per_mapping));
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      uint64_t end_state_memory_bytes_address,
+      EmitMemoryBytesList(sink,
+                          ToBorrowedMemoryBytesList(end_state.memory_bytes()),
+                          /*compressible=*/false));
+
+  uint32_t registers_memory_checksum = 0;
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      uint64_t registers_address,
+      sink.ProcessRegisterState(snapshot.registers(),
+                                /*allow_empty_register_state=*/false,
+                                &registers_memory_checksum));
+  // End state may be undefined initially in the making process.
+  uint32_t end_state_registers_memory_checksum = 0;
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      uint64_t end_state_registers_address,
+      sink.ProcessRegisterState(end_state.registers(),
+                                /*allow_empty_register_state=*/true,
+                                &end_state_registers_memory_checksum));
+
+  const size_t num_platform_end_states = NumPlatformEndStates(snapshot);
+  for (size_t i = 0; i < num_platform_end_states; ++i) {
+    const Snapshot::EndState& platform_end_state =
+        snapshot.expected_end_states()[i + 1];
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        uint64_t memory_bytes_address,
+        EmitMemoryBytesList(
+            sink, ToBorrowedMemoryBytesList(platform_end_state.memory_bytes()),
+            /*compressible=*/false));
+    uint32_t platform_registers_memory_checksum = 0;
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        uint64_t platform_registers_address,
+        sink.ProcessRegisterState(platform_end_state.registers(),
+                                  /*allow_empty_register_state=*/false,
+                                  &platform_registers_memory_checksum));
+    if (!sink.generating()) continue;
+
+    new (platform_end_states_contents + i * sizeof(SnapEndState<Arch>))
+        SnapEndState<Arch>{
+            .platforms = PlatformBits(platform_end_state),
+            .registers =
+                AddressAsPointer<RegisterState>(platform_registers_address),
+            .memory_bytes{
+                .size = platform_end_state.memory_bytes().size(),
+                .elements = AddressAsPointer<const SnapMemoryBytes>(
+                    memory_bytes_address),
+            },
+            .register_checksum = register_checksums[i + 1],
+            .registers_memory_checksum = platform_registers_memory_checksum,
+            .unchanged_memory_checksum =
+                UnchangedMemoryChecksum(snapshot, platform_end_state),
+        };
+  }
+  if (!sink.generating()) return absl::OkStatus();
+
+  // Fill in register states separately to avoid copying.
+  new (snap_contents) Snap<Arch>{
+      .id = AddressAsPointer<const char>(id.address),
+      .memory_mappings{
+          .size = snapshot.memory_mappings().size(),
+          .elements = AddressAsPointer<const SnapMemoryMapping>(
+              memory_mappings_address),
+      },
+      .registers = AddressAsPointer<RegisterState>(registers_address),
+      .end_state_instruction_address =
+          end_state.endpoint().instruction_address(),
+      .end_state_registers =
+          AddressAsPointer<RegisterState>(end_state_registers_address),
+      .end_state_memory_bytes{
+          .size = end_state.memory_bytes().size(),
+          .elements = AddressAsPointer<const SnapMemoryBytes>(
+              end_state_memory_bytes_address),
+      },
+      .end_state_unchanged_memory_checksum =
+          UnchangedMemoryChecksum(snapshot, end_state),
+      .code_register_groups = CodeRegisterGroups(snapshot, sink.options()),
+      .end_state_register_checksum = register_checksums[0],
+      .registers_memory_checksum = registers_memory_checksum,
+      .end_state_registers_memory_checksum =
+          end_state_registers_memory_checksum,
+      .platform_end_states{
+          .size = num_platform_end_states,
+          .elements = AddressAsPointer<const SnapEndState<Arch>>(
+              platform_end_states_address),
+      },
+  };
+  return absl::OkStatus();
+}
+
 // This encapsulates logic and data neccessary to build a relocatable
 // Snap corpus.
 //
@@ -107,7 +685,7 @@ class Traversal {
   // pass and then the generation pass. The generation pass must be preceded by
   // a call to  PrepareSnapGeneration().
   absl::flat_hash_map<std::string, uint64_t> Process(
-      PassType pass, const std::vector<Snapshot>& snapshots);
+      PassType pass, const std::vector<const Snapshot*>& snapshots);
 
   // Sets up content buffers and load addresses for main data block and its
   // component. This also sets up sub data blocks.
@@ -121,39 +699,108 @@ class Traversal {
   // Returns a const reference to the main block.
   const RelocatableDataBlock& main_block() const { return main_block_; }
 
+  // Sink interface for EmitSnap(). Nothing is generated in the layout pass.
+  const RelocatableSnapGeneratorOptions& options() const { return options_; }
+  bool generating() const { return pass_ == PassType::kGeneration; }
+  template <typename T>
+  SinkArray Allocate(size_t n) {
+    const RelocatableDataBlock::Ref ref =
+        BlockFor<T>().template AllocateObjectsOfType<T>(n);
+    if (!generating()) return {};
+    return {.address = ref.load_address(), .contents = ref.contents()};
+  }
+  template <typename T>
+  absl::Status Commit(const SinkArray& array, size_t n) {
+    // Objects are constructed in place.
+    return absl::OkStatus();
+  }
+  absl::StatusOr<uint64_t> ProcessByteData(
+      const Snapshot::MemoryBytes& memory_bytes);
+  absl::StatusOr<uint64_t> ProcessCompressedByteData(
+      const Snapshot::MemoryBytes& memory_bytes, uint32_t* compressed_size);
+  absl::StatusOr<uint64_t> ProcessRegisterState(
+      const Snapshot::RegisterState& register_state,
+      bool allow_empty_register_state, uint32_t* memory_checksum);
+  // The data is read only if it has not been copied or checksummed by this
+  // traversal before.
+  uint32_t ByteDataChecksum(const Snapshot::ByteData& byte_data);
+
  private:
-  // Processes the data contained in `memory_bytes` for `pass`. Allocates a ref
-  // element bytes of the generated SnapByteData. Returns element ref.
-  RelocatableDataBlock::Ref ProcessMemoryBytes(
-      PassType pass, const Snapshot::MemoryBytes& memory_bytes);
-
-  // Processes `memory_mappings` for `pass`. Allocates a ref for the
-  // elements of the SnapMemoryMapping array and returns it.
-  RelocatableDataBlock::Ref ProcessMemoryMappings(
-      PassType pass, const Snapshot::MemoryMappingList& memory_mappings,
-      const BorrowedMappingBytesList& bytes_per_mapping);
-
-  // Process a single memory mapping.
-  void ProcessMemoryMapping(PassType pass,
-                            const Snapshot::MemoryMapping& memory_mapping,
-                            const BorrowedMemoryBytesList& memory_bytes_list,
-                            RelocatableDataBlock::Ref memory_mapping_ref);
-
-  // Processes a single Snapshot::MemoryBytes object `memory_bytes` for
-  // `pass` using a preallocated ref from caller.
-  void ProcessAllocated(PassType pass,
-                        const Snapshot::MemoryBytes& memory_bytes,
-                        RelocatableDataBlock::Ref memory_bytes_ref);
-
-  // Processes a Snapshot::MemoryBytesList object `memory_bytes_list` for
-  // `pass`. `mapped_memory_map` contains information of all memory mappings
-  // in the source Snapshot. This allocates a ref the elements of the
-  // SnapMemoryBytes array and returns it.
-  RelocatableDataBlock::Ref ProcessMemoryBytesList(
-      PassType pass, const BorrowedMemoryBytesList& memory_bytes_list);
-
-  void ProcessAllocated(PassType pass, const Snapshot& snapshot,
-                        RelocatableDataBlock::Ref ref);
+  // Number of sub data blocks filled while processing individual snapshots.
+  static constexpr size_t kNumSnapshotDataBlocks = 6;
+
+  // Sizes of the sub data blocks filled while processing individual snapshots.
+  using SnapshotDataBlockSizes = std::array<size_t, kNumSnapshotDataBlocks>;
+
+  // Size and alignment of a sub data block at the end of the layout pass.
+  struct DataBlockLayout {
+    size_t size;
+    size_t alignment;
+  };
+
+  // Constructs a shard of `parent` for the parallel generation pass. The
+  // shard generates contents into the same buffer as `parent` starting from
+  // `offsets` in the sub data blocks. De-duping decisions are taken from the
+  // hash maps `parent` built in the layout pass.
+  Traversal(const Traversal& parent, const SnapshotDataBlockSizes& offsets);
+
+  // Returns the sub data blocks filled while processing individual snapshots.
+  std::array<RelocatableDataBlock*, kNumSnapshotDataBlocks>
+  SnapshotDataBlocks() {
+    return {&memory_bytes_block_, &memory_mapping_block_, &byte_data_block_,
+            &string_block_,       &register_state_block_, &page_data_block_};
+  }
+
+  // Returns the current sizes of SnapshotDataBlocks().
+  SnapshotDataBlockSizes CurrentSnapshotDataBlockSizes() {
+    SnapshotDataBlockSizes sizes;
+    const auto blocks = SnapshotDataBlocks();
+    for (size_t i = 0; i < kNumSnapshotDataBlocks; ++i) {
+      sizes[i] = blocks[i]->size();
+    }
+    return sizes;
+  }
+
+  // Generates Snaps for `snapshots` at `snaps_ref` using options_.num_threads
+  // threads. Each thread processes a consecutive range of snapshots using a
+  // shard of this.
+  // REQUIRES: Called in the generation pass with the same snapshots as the
+  // layout pass.
+  // `platform_end_states_refs` holds the ref of the platform end states of
+  // each Snap.
+  void GenerateInParallel(
+      const std::vector<const Snapshot*>& snapshots,
+      RelocatableDataBlock::Ref snaps_ref,
+      const std::vector<RelocatableDataBlock::Ref>& platform_end_states_refs);
+
+  // Returns the data block holding objects of type T, see Allocate().
+  template <typename T>
+  RelocatableDataBlock& BlockFor() {
+    if constexpr (std::is_same_v<T, SnapMemoryBytes>) {
+      return memory_bytes_block_;
+    } else if constexpr (std::is_same_v<T, SnapMemoryMapping>) {
+      return memory_mapping_block_;
+    } else {
+      static_assert(std::is_same_v<T, char>);
+      return string_block_;
+    }
+  }
+
+  // Returns the address of `ref` for generated pointers. Addresses are not
+  // known in the layout pass.
+  uint64_t AddressOf(RelocatableDataBlock::Ref ref) const {
+    return generating() ? ref.load_address() : 0;
+  }
+
+  // Returns the checksum of the generated corpus. Byte data is added by the
+  // checksums taken while copying it instead of being read again.
+  // REQUIRES: Called at the end of the generation pass.
+  uint32_t CorpusChecksum();
+
+  // Processes `snapshot` for the current pass using preallocated refs from
+  // the caller for the Snap and the elements of its platform end states.
+  void ProcessSnapshot(const Snapshot& snapshot, RelocatableDataBlock::Ref ref,
+                       RelocatableDataBlock::Ref platform_end_states_ref);
 
   // MemoryBytes de-duping: MemoryBytes are de-duped to reduce size of
   // of a relocatable corpus. MemoryBytes with the same byte values share
@@ -179,9 +826,65 @@ class Traversal {
       absl::flat_hash_map<const Snapshot::ByteData*, RelocatableDataBlock::Ref,
                           HashByteData, ByteDataEq>;
 
+  // Compressed copy of byte data. A compressed_size of 0 means that the data
+  // is not worth compressing and is stored as is.
+  struct CompressedByteDataRef {
+    RelocatableDataBlock::Ref ref;
+    uint32_t compressed_size = 0;
+  };
+
+  // Compressed byte data is de-duped separately by the uncompressed bytes as
+  // the same bytes may also be stored uncompressed for writable mappings.
+  using CompressedByteDataRefMap =
+      absl::flat_hash_map<const Snapshot::ByteData*, CompressedByteDataRef,
+                          HashByteData, ByteDataEq>;
+
+  // RegisterState de-duping: fuzzed snapshots frequently start from the same
+  // register state, so identical register states share a single generated
+  // Snap::RegisterState. This is safe because register states contain no
+  // pointers and are never modified after generation.
+  struct HashRegisterState {
+    size_t operator()(const Snapshot::RegisterState* register_state) const {
+      return absl::HashOf(register_state->gregs(), register_state->fpregs());
+    }
+  };
+
+  // Returns true iff the register states pointed by lhs and rhs are the same.
+  struct RegisterStateEq {
+    bool operator()(const Snapshot::RegisterState* lhs,
+                    const Snapshot::RegisterState* rhs) const {
+      return *lhs == *rhs;
+    }
+  };
+
+  // A generated register state and its memory checksum.
+  struct RegisterStateRef {
+    RelocatableDataBlock::Ref ref;
+    uint32_t memory_checksum = 0;
+  };
+
+  using RegisterStateRefMap =
+      absl::flat_hash_map<const Snapshot::RegisterState*, RegisterStateRef,
+                          HashRegisterState, RegisterStateEq>;
+
   // Options.
   RelocatableSnapGeneratorOptions options_;
 
+  // The current pass.
+  PassType pass_ = PassType::kLayout;
+
+  // For a shard in the parallel generation pass, the Traversal owning the
+  // de-duping hash maps. nullptr otherwise.
+  const Traversal* parent_ = nullptr;
+
+  // For parallel generation, sizes of SnapshotDataBlocks() before processing
+  // each snapshot in the layout pass.
+  std::vector<SnapshotDataBlockSizes> snapshot_data_block_offsets_;
+
+  // For parallel generation, layouts of SnapshotDataBlocks() at the end of
+  // the layout pass.
+  std::array<DataBlockLayout, kNumSnapshotDataBlocks> snapshot_data_layouts_;
+
   // The main data block covering the whole relocatable corpus.
   // Other blocks belows are merged into this.
   RelocatableDataBlock main_block_;
@@ -193,31 +896,92 @@ class Traversal {
   RelocatableDataBlock byte_data_block_;
   RelocatableDataBlock string_block_;
   RelocatableDataBlock register_state_block_;
+  RelocatableDataBlock index_block_;
   RelocatableDataBlock page_data_block_;
 
   // Hash map for de-duping byte data.
   ByteDataRefMap byte_data_ref_map_;
+
+  // Total size of byte data that was shared with an earlier identical copy
+  // instead of being stored again.
+  uint64_t deduped_byte_data_size_ = 0;
+
+  // Hash map for de-duping compressed byte data.
+  CompressedByteDataRefMap compressed_byte_data_ref_map_;
+
+  // Total number of bytes saved by compressing byte data.
+  uint64_t compressed_byte_data_savings_ = 0;
+
+  // Scratch buffer for compression.
+  std::vector<uint8_t> compression_buffer_;
+
+  // Ranges of byte_data_block_ and page_data_block_ written by this
+  // traversal in the generation pass, for CorpusChecksum().
+  std::vector<ChecksummedRange> byte_data_ranges_;
+  std::vector<ChecksummedRange> page_data_ranges_;
+
+  // Memory checksums of uncompressed byte data, for memory mapping checksums.
+  absl::flat_hash_map<const Snapshot::ByteData*, uint32_t>
+      byte_data_checksums_;
+
+  // Hash map for de-duping register states.
+  RegisterStateRefMap register_state_ref_map_;
+
+  // Total size of register states shared with an earlier identical copy.
+  uint64_t deduped_register_state_size_ = 0;
 };
 
 template <typename Arch>
-RelocatableDataBlock::Ref Traversal<Arch>::ProcessMemoryBytes(
-    PassType pass, const Snapshot::MemoryBytes& memory_bytes) {
-  const Snapshot::ByteData& byte_data = memory_bytes.byte_values();
-  // Check to see if we can de-dupe byte data.
-  static constexpr RelocatableDataBlock::Ref kNullRef;
-  auto [it, success] = byte_data_ref_map_.try_emplace(&byte_data, kNullRef);
-  auto&& [unused, ref] = *it;
+Traversal<Arch>::Traversal(const Traversal& parent,
+                           const SnapshotDataBlockSizes& offsets)
+    : options_(parent.options_),
+      pass_(PassType::kGeneration),
+      parent_(&parent),
+      memory_bytes_block_(parent.memory_bytes_block_),
+      memory_mapping_block_(parent.memory_mapping_block_),
+      byte_data_block_(parent.byte_data_block_),
+      string_block_(parent.string_block_),
+      register_state_block_(parent.register_state_block_),
+      page_data_block_(parent.page_data_block_) {
+  // The copied blocks share contents and load addresses with `parent`. Skip
+  // the parts generated by other shards.
+  const auto blocks = SnapshotDataBlocks();
+  for (size_t i = 0; i < kNumSnapshotDataBlocks; ++i) {
+    blocks[i]->ResetSizeAndAlignment();
+    blocks[i]->Allocate(offsets[i], 1);
+  }
+}
 
-  // try_emplace() above failed because byte_data is a duplicate. Return early
-  // as there is no need to do anything for the generation pass.
-  if (!success) {
-    // Check that optimization is valid during the generation pass. This is
-    // expensive for large blocks of data so is done only for debug build.
-    if (pass == PassType::kGeneration) {
-      DCHECK_EQ(memcmp(ref.contents(), byte_data.data(), byte_data.size()), 0);
-    }
-    return ref;
+template <typename Arch>
+uint32_t Traversal<Arch>::ByteDataChecksum(
+    const Snapshot::ByteData& byte_data) {
+  auto [it, inserted] = byte_data_checksums_.try_emplace(&byte_data, 0);
+  if (inserted) {
+    // Repeating byte runs, compressed data and data first copied by another
+    // shard of a parallel generation pass end up here.
+    it->second = CalculateMemoryChecksum(byte_data.data(), byte_data.size());
   }
+  return it->second;
+}
+
+template <typename Arch>
+uint32_t Traversal<Arch>::CorpusChecksum() {
+  const char* const begin = main_block_.contents();
+  const char* const end = begin + main_block_.size();
+  CorpusChecksumCalculator checksum;
+  checksum.AddData(begin, byte_data_block_.contents() - begin);
+  AddBlockChecksum(byte_data_block_, string_block_.contents(),
+                   byte_data_ranges_, checksum);
+  checksum.AddData(string_block_.contents(),
+                   page_data_block_.contents() - string_block_.contents());
+  AddBlockChecksum(page_data_block_, end, page_data_ranges_, checksum);
+  return checksum.Checksum();
+}
+
+template <typename Arch>
+absl::StatusOr<uint64_t> Traversal<Arch>::ProcessByteData(
+    const Snapshot::MemoryBytes& memory_bytes) {
+  const Snapshot::ByteData& byte_data = memory_bytes.byte_values();
 
   // The main reason for treating page aligned data separately is so we can mmap
   // it directly from the corpus file. When we process the bytes, however, we
@@ -226,217 +990,215 @@ RelocatableDataBlock::Ref Traversal<Arch>::ProcessMemoryBytes(
   // instance we don't need two byte data caches) and at most increases the
   // corpus size by less than 4kB due to fragmentation from the alignment
   // requirements.
-  bool page_aligned_data = IsPageAligned(memory_bytes.start_address()) &&
-                           IsPageAligned(memory_bytes.num_bytes());
-
-  // Allocate a new Ref as this has not be seen before.
-  if (page_aligned_data) {
-    // If the data will be page aligned in memory, we also make it page aligned
-    // inside the corpus so it can be directly mmaped if desired.
-    // Note that we're using the same cache for both data blocks, and the cache
-    // does not take alignment into account. For this to work, it must be
-    // impossible for equivilent MemoryBytes to be stored with different
-    // alignments.
-    ref = page_data_block_.Allocate(byte_data.size(), kPageSize);
+  //
+  // If the data will be page aligned in memory, we also make it page aligned
+  // inside the corpus so it can be directly mmaped if desired.
+  // Note that we're using the same cache for both data blocks, and the cache
+  // does not take alignment into account. For this to work, it must be
+  // impossible for equivilent MemoryBytes to be stored with different
+  // alignments.
+  const bool page_aligned_data = IsPageAligned(memory_bytes.start_address()) &&
+                                 IsPageAligned(memory_bytes.num_bytes());
+  RelocatableDataBlock& data_block =
+      page_aligned_data ? page_data_block_ : byte_data_block_;
+  const size_t alignment = page_aligned_data ? kPageSize : sizeof(uint64_t);
+
+  // Check to see if we can de-dupe byte data.
+  RelocatableDataBlock::Ref ref;
+  bool duplicate;
+  if (parent_ == nullptr) {
+    static constexpr RelocatableDataBlock::Ref kNullRef;
+    auto [it, success] = byte_data_ref_map_.try_emplace(&byte_data, kNullRef);
+    duplicate = !success;
+    if (!duplicate) {
+      // Allocate a new Ref as this has not be seen before.
+      it->second = data_block.Allocate(byte_data.size(), alignment);
+    }
+    ref = it->second;
   } else {
-    ref = byte_data_block_.Allocate(byte_data.size(), sizeof(uint64_t));
-  }
-  if (pass == PassType::kGeneration) {
-    memcpy(ref.contents(), byte_data.data(), byte_data.size());
+    // The layout pass has seen all byte data. The first copy was allocated by
+    // this shard iff it is not below the current end of the data block.
+    const auto it = parent_->byte_data_ref_map_.find(&byte_data);
+    CHECK(it != parent_->byte_data_ref_map_.end());
+    duplicate = it->second.byte_offset() < data_block.size();
+    if (duplicate) {
+      ref = RelocatableDataBlock::Ref(&data_block, it->second.byte_offset());
+    } else {
+      ref = data_block.Allocate(byte_data.size(), alignment);
+      DCHECK_EQ(ref.byte_offset(), it->second.byte_offset());
+    }
   }
-  return ref;
-}
-
-template <typename Arch>
-void Traversal<Arch>::ProcessMemoryMapping(
-    PassType pass, const Snapshot::MemoryMapping& memory_mapping,
-    const BorrowedMemoryBytesList& memory_bytes_list,
-    RelocatableDataBlock::Ref memory_mapping_ref) {
-  RelocatableDataBlock::Ref memory_bytes_elements_ref =
-      ProcessMemoryBytesList(pass, memory_bytes_list);
 
-  if (pass == PassType::kGeneration) {
-    MemoryChecksumCalculator checksum;
-    for (const Snapshot::MemoryBytes* memory_bytes : memory_bytes_list) {
-      checksum.AddData(memory_bytes->byte_values());
+  // Return early for a duplicate as there is no need to do anything for the
+  // generation pass.
+  if (duplicate) {
+    // Check that optimization is valid during the generation pass. This is
+    // expensive for large blocks of data so is done only for debug build.
+    // A shard cannot check this as another shard may not have written the
+    // first copy yet.
+    if (generating() && parent_ == nullptr) {
+      DCHECK_EQ(memcmp(ref.contents(), byte_data.data(), byte_data.size()), 0);
     }
-    new (memory_mapping_ref
-             .contents_as_pointer_of<SnapMemoryMapping>()) SnapMemoryMapping{
-        .start_address = memory_mapping.start_address(),
-        .num_bytes = memory_mapping.num_bytes(),
-        .perms = memory_mapping.perms().ToMProtect(),
-        .memory_checksum = checksum.Checksum(),
-        .memory_bytes =
-            {
-                .size = memory_bytes_list.size(),
-                .elements =
-                    memory_bytes_elements_ref
-                        .load_address_as_pointer_of<const SnapMemoryBytes>(),
-            },
-    };
+    deduped_byte_data_size_ += byte_data.size();
+    return AddressOf(ref);
   }
-}
 
-template <typename Arch>
-RelocatableDataBlock::Ref Traversal<Arch>::ProcessMemoryMappings(
-    PassType pass, const Snapshot::MemoryMappingList& memory_mappings,
-    const BorrowedMappingBytesList& bytes_per_mapping) {
-  // Allocate space for elements of SnapArray<MemoryMapping>.
-  const RelocatableDataBlock::Ref snap_memory_mappings_array_elements_ref =
-      memory_mapping_block_.AllocateObjectsOfType<SnapMemoryMapping>(
-          memory_mappings.size());
-
-  RelocatableDataBlock::Ref memory_mapping_ref =
-      snap_memory_mappings_array_elements_ref;
-  for (size_t i = 0; i < memory_mappings.size(); ++i) {
-    ProcessMemoryMapping(pass, memory_mappings[i], bytes_per_mapping[i],
-                         memory_mapping_ref);
-    memory_mapping_ref += sizeof(SnapMemoryMapping);
+  if (generating()) {
+    const uint32_t checksum =
+        CopyAndChecksum(ref.contents(), byte_data.data(), byte_data.size());
+    byte_data_checksums_[&byte_data] = checksum;
+    (page_aligned_data ? page_data_ranges_ : byte_data_ranges_)
+        .push_back({.byte_offset = ref.byte_offset(),
+                    .size = byte_data.size(),
+                    .checksum = checksum});
   }
-
-  return snap_memory_mappings_array_elements_ref;
+  return AddressOf(ref);
 }
 
 template <typename Arch>
-void Traversal<Arch>::ProcessAllocated(
-    PassType pass, const Snapshot::MemoryBytes& memory_bytes,
-    RelocatableDataBlock::Ref memory_bytes_ref) {
-  const bool compress_repeating_bytes =
-      options_.compress_repeating_bytes &&
-      IsRepeatingByteRun(memory_bytes.byte_values());
-  RelocatableDataBlock::Ref byte_values_elements_ref;
-  if (!compress_repeating_bytes) {
-    byte_values_elements_ref = ProcessMemoryBytes(pass, memory_bytes);
-  }
+absl::StatusOr<uint64_t> Traversal<Arch>::ProcessCompressedByteData(
+    const Snapshot::MemoryBytes& memory_bytes, uint32_t* compressed_size) {
+  const Snapshot::ByteData& byte_data = memory_bytes.byte_values();
 
-  if (pass == PassType::kGeneration) {
-    // Construct MemoryBytes in contents buffer.
-    if (compress_repeating_bytes) {
-      new (memory_bytes_ref.contents_as_pointer_of<SnapMemoryBytes>())
-          SnapMemoryBytes{
-              .start_address = memory_bytes.start_address(),
-              .flags = SnapMemoryBytes::kRepeating,
-              .data{.byte_run{
-                  .value = memory_bytes.byte_values()[0],
-                  .size = memory_bytes.num_bytes(),
-              }},
-          };
+  // Compressed data is never mmapped directly, so it always goes into the
+  // byte data block. De-duping follows ProcessByteData().
+  CompressedByteDataRef compressed_ref;
+  bool duplicate;
+  if (parent_ == nullptr) {
+    auto [it, success] = compressed_byte_data_ref_map_.try_emplace(
+        &byte_data, CompressedByteDataRef{});
+    duplicate = !success;
+    if (!duplicate) {
+      it->second.compressed_size =
+          CompressByteData(byte_data, &compression_buffer_);
+      if (it->second.compressed_size != 0) {
+        it->second.ref = byte_data_block_.Allocate(it->second.compressed_size,
+                                                   sizeof(uint64_t));
+      }
+    }
+    compressed_ref = it->second;
+  } else {
+    const auto it = parent_->compressed_byte_data_ref_map_.find(&byte_data);
+    CHECK(it != parent_->compressed_byte_data_ref_map_.end());
+    compressed_ref.compressed_size = it->second.compressed_size;
+    if (compressed_ref.compressed_size == 0) {
+      duplicate = true;
     } else {
-      new (memory_bytes_ref.contents_as_pointer_of<SnapMemoryBytes>())
-          SnapMemoryBytes{
-              .start_address = memory_bytes.start_address(),
-              .flags = 0,
-              .data{.byte_values{
-                  .size = memory_bytes.num_bytes(),
-                  .elements = byte_values_elements_ref
-                                  .load_address_as_pointer_of<const uint8_t>(),
-              }},
-          };
+      duplicate = it->second.ref.byte_offset() < byte_data_block_.size();
+      if (duplicate) {
+        compressed_ref.ref = RelocatableDataBlock::Ref(
+            &byte_data_block_, it->second.ref.byte_offset());
+      } else {
+        compressed_ref.ref = byte_data_block_.Allocate(
+            compressed_ref.compressed_size, sizeof(uint64_t));
+        DCHECK_EQ(compressed_ref.ref.byte_offset(),
+                  it->second.ref.byte_offset());
+        CHECK_EQ(CompressByteData(byte_data, &compression_buffer_),
+                 compressed_ref.compressed_size);
+      }
     }
   }
-}
 
-template <typename Arch>
-RelocatableDataBlock::Ref Traversal<Arch>::ProcessMemoryBytesList(
-    PassType pass, const BorrowedMemoryBytesList& memory_bytes_list) {
-  // Allocate space for elements of SnapArray<MemoryBytes>.
-  const RelocatableDataBlock::Ref ref =
-      memory_bytes_block_.AllocateObjectsOfType<SnapMemoryBytes>(
-          memory_bytes_list.size());
+  *compressed_size = compressed_ref.compressed_size;
+  if (compressed_ref.compressed_size == 0) {
+    return 0;
+  }
+  if (duplicate) {
+    deduped_byte_data_size_ += compressed_ref.compressed_size;
+    return AddressOf(compressed_ref.ref);
+  }
 
-  RelocatableDataBlock::Ref snap_memory_bytes_ref = ref;
-  for (const auto& memory_bytes : memory_bytes_list) {
-    ProcessAllocated(pass, *memory_bytes, snap_memory_bytes_ref);
-    snap_memory_bytes_ref += sizeof(SnapMemoryBytes);
+  compressed_byte_data_savings_ +=
+      byte_data.size() - compressed_ref.compressed_size;
+  if (generating()) {
+    // compression_buffer_ holds the data compressed above.
+    byte_data_ranges_.push_back(
+        {.byte_offset = compressed_ref.ref.byte_offset(),
+         .size = compressed_ref.compressed_size,
+         .checksum = CopyAndChecksum(
+             compressed_ref.ref.contents(),
+             reinterpret_cast<const char*>(compression_buffer_.data()),
+             compressed_ref.compressed_size)});
   }
-  return ref;
+  return AddressOf(compressed_ref.ref);
 }
 
 template <typename Arch>
-void Traversal<Arch>::ProcessAllocated(PassType pass, const Snapshot& snapshot,
-                                       RelocatableDataBlock::Ref snapshot_ref) {
+absl::StatusOr<uint64_t> Traversal<Arch>::ProcessRegisterState(
+    const Snapshot::RegisterState& register_state,
+    bool allow_empty_register_state, uint32_t* memory_checksum) {
   using RegisterState = typename Snap<Arch>::RegisterState;
 
-  CHECK_EQ(static_cast<int>(snapshot.architecture_id()),
-           static_cast<int>(Arch::architecture_id));
-  size_t id_size = snapshot.id().size() + 1;  // NUL character terminator.
-  RelocatableDataBlock::Ref id_ref = string_block_.Allocate(id_size, 1);
-
-  BorrowedMappingBytesList bytes_per_mapping =
-      SplitBytesByMapping(snapshot.memory_mappings(), snapshot.memory_bytes());
-  RelocatableDataBlock::Ref memory_mappings_elements_ref =
-      ProcessMemoryMappings(pass, snapshot.memory_mappings(),
-                            bytes_per_mapping);
-  // All input snapshots should be Snapify()-ed before they can be compiled.
-  // This means exactly one expected end state.
-  DCHECK_EQ(snapshot.expected_end_states().size(), 1);
-  const Snapshot::EndState& end_state = snapshot.expected_end_states()[0];
-  RelocatableDataBlock::Ref end_state_memory_bytes_elements_ref =
-      ProcessMemoryBytesList(
-          pass, ToBorrowedMemoryBytesList(end_state.memory_bytes()));
+  if (parent_ != nullptr) {
+    // As in ProcessByteData(), the first copy belongs to this shard iff it
+    // is not below the current end of the register state block.
+    const auto it = parent_->register_state_ref_map_.find(&register_state);
+    CHECK(it != parent_->register_state_ref_map_.end());
+    const size_t byte_offset = it->second.ref.byte_offset();
+    if (byte_offset < register_state_block_.size()) {
+      // The first copy may not be written yet, so compute the checksum from
+      // a scratch copy.
+      RegisterState scratch;
+      SetRegisterState<Arch>(register_state, &scratch, memory_checksum,
+                             allow_empty_register_state);
+      deduped_register_state_size_ += sizeof(RegisterState);
+      return RelocatableDataBlock::Ref(&register_state_block_, byte_offset)
+          .load_address();
+    }
+    RelocatableDataBlock::Ref ref =
+        register_state_block_.AllocateObjectsOfType<RegisterState>(1);
+    DCHECK_EQ(ref.byte_offset(), byte_offset);
+    SetRegisterState<Arch>(register_state,
+                           ref.contents_as_pointer_of<RegisterState>(),
+                           memory_checksum, allow_empty_register_state);
+    return ref.load_address();
+  }
 
-  RelocatableDataBlock::Ref registers_ref =
-      register_state_block_.AllocateObjectsOfType<RegisterState>(1);
-  RelocatableDataBlock::Ref end_state_registers_ref =
-      register_state_block_.AllocateObjectsOfType<RegisterState>(1);
+  auto [it, success] =
+      register_state_ref_map_.try_emplace(&register_state, RegisterStateRef{});
+  RegisterStateRef& register_state_ref = it->second;
+  if (!success) {
+    // Keep the same requirement as SetRegisterState() for shared copies.
+    CHECK(allow_empty_register_state || (!register_state.gregs().empty() &&
+                                         !register_state.fpregs().empty()));
+    deduped_register_state_size_ += sizeof(RegisterState);
+  } else {
+    RelocatableDataBlock::Ref ref =
+        register_state_block_.AllocateObjectsOfType<RegisterState>(1);
+    if (generating()) {
+      SetRegisterState<Arch>(register_state,
+                             ref.contents_as_pointer_of<RegisterState>(),
+                             &register_state_ref.memory_checksum,
+                             allow_empty_register_state);
+    }
+    register_state_ref.ref = ref;
+  }
+  if (generating()) {
+    *memory_checksum = register_state_ref.memory_checksum;
+  }
+  return AddressOf(register_state_ref.ref);
+}
 
-  if (pass == PassType::kGeneration) {
-    memcpy(id_ref.contents(), snapshot.id().c_str(), snapshot.id().size() + 1);
-
-    // Construct register state contents.
-    uint32_t registers_memory_checksum;
-    SetRegisterState<Arch>(
-        snapshot.registers(),
-        registers_ref.contents_as_pointer_of<RegisterState>(),
-        &registers_memory_checksum,
-        /*allow_empty_register_state=*/false);
-
-    // End state may be undefined initially in the making process.
-    uint32_t end_state_registers_memory_checksum;
-    SetRegisterState<Arch>(
-        end_state.registers(),
-        end_state_registers_ref.contents_as_pointer_of<RegisterState>(),
-        &end_state_registers_memory_checksum,
-        /*allow_empty_register_state=*/true);
-
-    // Construct Snap in data block content buffer.
-    // Fill in register states separately to avoid copying.
-    Snap<Arch>* snap = snapshot_ref.contents_as_pointer_of<Snap<Arch>>();
-    absl::StatusOr<RegisterChecksum<Arch>> register_checksum_or =
-        DeserializeRegisterChecksum<Arch>(end_state.register_checksum());
-    // TODO(dougkwan): Fail more gracefully.  We could report an absl::Status
-    // but that requires changing the whole relocatable snap generator.
-    CHECK_OK(register_checksum_or.status());
-    new (snap) Snap<Arch>{
-        .id = reinterpret_cast<const char*>(AsPtr(id_ref.load_address())),
-        .memory_mappings{
-            .size = snapshot.memory_mappings().size(),
-            .elements =
-                memory_mappings_elements_ref
-                    .load_address_as_pointer_of<const SnapMemoryMapping>(),
-        },
-        .registers = registers_ref.load_address_as_pointer_of<RegisterState>(),
-        .end_state_instruction_address =
-            end_state.endpoint().instruction_address(),
-        .end_state_registers =
-            end_state_registers_ref.load_address_as_pointer_of<RegisterState>(),
-        .end_state_memory_bytes{
-            .size = end_state.memory_bytes().size(),
-            .elements =
-                end_state_memory_bytes_elements_ref
-                    .load_address_as_pointer_of<const SnapMemoryBytes>(),
-        },
-        .end_state_register_checksum = register_checksum_or.value(),
-        .registers_memory_checksum = registers_memory_checksum,
-        .end_state_registers_memory_checksum =
-            end_state_registers_memory_checksum,
-    };
+template <typename Arch>
+void Traversal<Arch>::ProcessSnapshot(
+    const Snapshot& snapshot, RelocatableDataBlock::Ref snapshot_ref,
+    RelocatableDataBlock::Ref platform_end_states_ref) {
+  // TODO(dougkwan): Fail more gracefully.  We could report an absl::Status
+  // but that requires changing the whole relocatable snap generator.
+  if (!generating()) {
+    CHECK_OK(EmitSnap<Arch>(*this, snapshot, nullptr, 0, nullptr));
+    return;
   }
+  CHECK_OK(EmitSnap<Arch>(*this, snapshot, snapshot_ref.contents(),
+                          platform_end_states_ref.load_address(),
+                          platform_end_states_ref.contents()));
 }
 
 template <typename Arch>
 absl::flat_hash_map<std::string, uint64_t> Traversal<Arch>::Process(
-    PassType pass, const std::vector<Snapshot>& snapshots) {
+    PassType pass, const std::vector<const Snapshot*>& snapshots) {
+  pass_ = pass;
+
   // For compatiblity with an older Silifuzz version, we use a corpus containing
   // SnapArray<const Snap*>.  We can get rid of the redirection when we
   // change the runner to take SnapArray<Snap> later.
@@ -451,8 +1213,56 @@ absl::flat_hash_map<std::string, uint64_t> Traversal<Arch>::Process(
   // Allocate space for Snaps.
   RelocatableDataBlock::Ref snaps_ref =
       snap_block_.AllocateObjectsOfType<Snap<Arch>>(snapshots.size());
-  for (size_t i = 0; i < snapshots.size(); ++i) {
-    ProcessAllocated(pass, snapshots[i], snaps_ref + i * sizeof(Snap<Arch>));
+
+  // Allocate space for the platform end states of all Snaps.
+  size_t num_platform_end_states = 0;
+  for (const Snapshot* snapshot : snapshots) {
+    num_platform_end_states += NumPlatformEndStates(*snapshot);
+  }
+  RelocatableDataBlock::Ref all_platform_end_states_ref =
+      snap_block_.AllocateObjectsOfType<SnapEndState<Arch>>(
+          num_platform_end_states);
+  std::vector<RelocatableDataBlock::Ref> platform_end_states_refs;
+  platform_end_states_refs.reserve(snapshots.size());
+  for (const Snapshot* snapshot : snapshots) {
+    platform_end_states_refs.push_back(all_platform_end_states_ref);
+    all_platform_end_states_ref +=
+        NumPlatformEndStates(*snapshot) * sizeof(SnapEndState<Arch>);
+  }
+
+  // Allocate space for the hot metadata right after, so that it shares pages
+  // with nothing but Snaps.
+  size_t num_writable_memory_bytes = 0;
+  for (const Snapshot* snapshot : snapshots) {
+    num_writable_memory_bytes += NumWritableMemoryBytes(*snapshot);
+  }
+  RelocatableDataBlock::Ref hot_entries_ref =
+      snap_block_.AllocateObjectsOfType<SnapHotEntry<Arch>>(snapshots.size());
+  RelocatableDataBlock::Ref writable_memory_bytes_ref =
+      snap_block_.AllocateObjectsOfType<SnapMemoryBytes>(
+          num_writable_memory_bytes);
+
+  // Allocate space for the lookup indices.
+  size_t num_code_intervals = 0;
+  for (const Snapshot* snapshot : snapshots) {
+    num_code_intervals += NumCodeIntervals(*snapshot);
+  }
+  RelocatableDataBlock::Ref id_index_ref =
+      index_block_.AllocateObjectsOfType<uint32_t>(snapshots.size());
+  RelocatableDataBlock::Ref code_index_ref =
+      index_block_.AllocateObjectsOfType<SnapCodeInterval>(num_code_intervals);
+  const bool parallel_generation = options_.num_threads > 1;
+  if (pass == PassType::kGeneration && parallel_generation) {
+    GenerateInParallel(snapshots, snaps_ref, platform_end_states_refs);
+  } else {
+    for (size_t i = 0; i < snapshots.size(); ++i) {
+      if (pass == PassType::kLayout && parallel_generation) {
+        snapshot_data_block_offsets_.push_back(
+            CurrentSnapshotDataBlockSizes());
+      }
+      ProcessSnapshot(*snapshots[i], snaps_ref + i * sizeof(Snap<Arch>),
+                      platform_end_states_refs[i]);
+    }
   }
 
   // Merge component data blocks into a single main data block.
@@ -469,6 +1279,7 @@ absl::flat_hash_map<std::string, uint64_t> Traversal<Arch>::Process(
   main_block_.Allocate(byte_data_block_);
   main_block_.Allocate(string_block_);
   main_block_.Allocate(register_state_block_);
+  main_block_.Allocate(index_block_);
   main_block_.Allocate(page_data_block_);
 
   if (pass == PassType::kGeneration) {
@@ -484,6 +1295,7 @@ absl::flat_hash_map<std::string, uint64_t> Traversal<Arch>::Process(
                 .register_state_type_size =
                     sizeof(typename Snap<Arch>::RegisterState),
                 .architecture_id = static_cast<uint8_t>(Arch::architecture_id),
+                .format_version = FormatVersion(options_),
                 .padding = {},
             },
         .snaps =
@@ -493,6 +1305,24 @@ absl::flat_hash_map<std::string, uint64_t> Traversal<Arch>::Process(
                     snap_array_elements_ref
                         .load_address_as_pointer_of<const Snap<Arch>*>(),
             },
+        .id_index =
+            {
+                .size = snapshots.size(),
+                .elements =
+                    id_index_ref.load_address_as_pointer_of<const uint32_t>(),
+            },
+        .code_index =
+            {
+                .size = num_code_intervals,
+                .elements = code_index_ref.load_address_as_pointer_of<
+                    const SnapCodeInterval>(),
+            },
+        .hot_entries =
+            {
+                .size = snapshots.size(),
+                .elements = hot_entries_ref.load_address_as_pointer_of<
+                    const SnapHotEntry<Arch>>(),
+            },
     };
 
     // Create const pointer array elements.
@@ -505,12 +1335,17 @@ absl::flat_hash_map<std::string, uint64_t> Traversal<Arch>::Process(
           snap_ref.load_address_as_pointer_of<const Snap<Arch>>();
     }
 
+    const auto contents_of =
+        ContentsOf(corpus_ref.contents(), corpus_ref.load_address());
+    FillCorpusIndex(*corpus, contents_of);
+    FillCorpusHotEntries(*corpus, contents_of,
+                         writable_memory_bytes_ref.load_address(),
+                         num_writable_memory_bytes);
+
     // Calculate the final checksum.
     // The checksum calculation ignores the checksum field in the header. This
     // lets us set this field without modifying the checksum.
-    CorpusChecksumCalculator checksum;
-    checksum.AddData(corpus, corpus->header.num_bytes);
-    corpus->header.checksum = checksum.Checksum();
+    corpus->header.checksum = CorpusChecksum();
   }
 
   absl::flat_hash_map<std::string, uint64_t> block_sizes = {
@@ -521,11 +1356,77 @@ absl::flat_hash_map<std::string, uint64_t> Traversal<Arch>::Process(
       {"byte_data_block", byte_data_block_.size()},
       {"string_block", string_block_.size()},
       {"register_state_block", register_state_block_.size()},
+      {"index_block", index_block_.size()},
       {"page_data_block", page_data_block_.size()},
+      {"deduped_byte_data", deduped_byte_data_size_},
+      {"deduped_register_state", deduped_register_state_size_},
+      {"compressed_byte_data_savings", compressed_byte_data_savings_},
   };
   return block_sizes;
 }
 
+template <typename Arch>
+void Traversal<Arch>::GenerateInParallel(
+    const std::vector<const Snapshot*>& snapshots,
+    RelocatableDataBlock::Ref snaps_ref,
+    const std::vector<RelocatableDataBlock::Ref>& platform_end_states_refs) {
+  CHECK_EQ(snapshot_data_block_offsets_.size(), snapshots.size());
+
+  // Claim the final extents of the sub data blocks up front so that refs
+  // into them are valid while shards are filling them.
+  const auto blocks = SnapshotDataBlocks();
+  for (size_t i = 0; i < kNumSnapshotDataBlocks; ++i) {
+    CHECK_EQ(blocks[i]->size(), 0);
+    blocks[i]->Allocate(snapshot_data_layouts_[i].size,
+                        snapshot_data_layouts_[i].alignment);
+  }
+
+  // Use a few shards per thread to even out differences in snapshot sizes.
+  const size_t num_shards =
+      std::min<size_t>(snapshots.size(), options_.num_threads * 4);
+  std::vector<std::vector<ChecksummedRange>> shard_byte_data_ranges(
+      num_shards);
+  std::vector<std::vector<ChecksummedRange>> shard_page_data_ranges(
+      num_shards);
+  {
+    ThreadPool threads{options_.num_threads};
+    for (size_t shard = 0; shard < num_shards; ++shard) {
+      const size_t begin = snapshots.size() * shard / num_shards;
+      const size_t end = snapshots.size() * (shard + 1) / num_shards;
+      threads.Schedule([this, &snapshots, snaps_ref, &platform_end_states_refs,
+                        &shard_byte_data_ranges, &shard_page_data_ranges,
+                        shard, begin, end]() {
+        // Thread-safe: shards write disjoint parts of the content buffer and
+        // only read the de-duping hash maps of this.
+        Traversal shard_traversal(*this, snapshot_data_block_offsets_[begin]);
+        for (size_t i = begin; i < end; ++i) {
+          shard_traversal.ProcessSnapshot(*snapshots[i],
+                                          snaps_ref + i * sizeof(Snap<Arch>),
+                                          platform_end_states_refs[i]);
+        }
+        if (end < snapshots.size()) {
+          DCHECK(shard_traversal.CurrentSnapshotDataBlockSizes() ==
+                 snapshot_data_block_offsets_[end]);
+        }
+        shard_byte_data_ranges[shard] =
+            std::move(shard_traversal.byte_data_ranges_);
+        shard_page_data_ranges[shard] =
+            std::move(shard_traversal.page_data_ranges_);
+      });
+    }
+  }  // ~ThreadPool joins the threads.
+
+  // Shards cover consecutive parts of the data blocks in shard order.
+  for (size_t shard = 0; shard < num_shards; ++shard) {
+    byte_data_ranges_.insert(byte_data_ranges_.end(),
+                             shard_byte_data_ranges[shard].begin(),
+                             shard_byte_data_ranges[shard].end());
+    page_data_ranges_.insert(page_data_ranges_.end(),
+                             shard_page_data_ranges[shard].begin(),
+                             shard_page_data_ranges[shard].end());
+  }
+}
+
 template <typename Arch>
 void Traversal<Arch>::PrepareSnapGeneration(char* content_buffer,
                                             size_t content_buffer_size,
@@ -535,6 +1436,15 @@ void Traversal<Arch>::PrepareSnapGeneration(char* content_buffer,
 
   // Layouts a sub-block within the main block and then
   // resets the sub-block for the generating pass.
+  if (options_.num_threads > 1) {
+    const auto blocks = SnapshotDataBlocks();
+    for (size_t i = 0; i < kNumSnapshotDataBlocks; ++i) {
+      snapshot_data_layouts_[i] = {.size = blocks[i]->size(),
+                                   .alignment =
+                                       blocks[i]->required_alignment()};
+    }
+  }
+
   auto prepare_sub_data_block = [&](RelocatableDataBlock& block) {
     const RelocatableDataBlock::Ref ref = main_block_.Allocate(block);
     block.set_load_address(ref.load_address());
@@ -549,48 +1459,952 @@ void Traversal<Arch>::PrepareSnapGeneration(char* content_buffer,
   prepare_sub_data_block(byte_data_block_);
   prepare_sub_data_block(string_block_);
   prepare_sub_data_block(register_state_block_);
+  prepare_sub_data_block(index_block_);
   prepare_sub_data_block(page_data_block_);
 
   // Reset main block again for generation pass.
   main_block_.ResetSizeAndAlignment();
 
+  // The parallel generation pass uses the de-duping decisions and counts of
+  // the layout pass.
+  if (options_.num_threads > 1) {
+    return;
+  }
+
   // Reset byte data de-duping hash map.
   byte_data_ref_map_.clear();
+  deduped_byte_data_size_ = 0;
+  compressed_byte_data_ref_map_.clear();
+  compressed_byte_data_savings_ = 0;
+
+  // Reset register state de-duping hash map.
+  register_state_ref_map_.clear();
+  deduped_register_state_size_ = 0;
+}
+
+// Returns pointers to `snapshots` in the order they are emitted in the
+// corpus. See RelocatableSnapGeneratorOptions::sort_snaps_by_memory_layout.
+std::vector<const Snapshot*> SnapshotOrder(
+    absl::Span<const Snapshot* const> snapshots,
+    const RelocatableSnapGeneratorOptions& options) {
+  std::vector<const Snapshot*> order(snapshots.begin(), snapshots.end());
+  if (!options.sort_snaps_by_memory_layout) {
+    return order;
+  }
+
+  using MappingKey = std::tuple<Snapshot::Address, Snapshot::ByteSize, int>;
+  absl::flat_hash_map<const Snapshot*, std::vector<MappingKey>> layouts;
+  for (const Snapshot* snapshot : order) {
+    std::vector<MappingKey>& layout = layouts[snapshot];
+    for (const Snapshot::MemoryMapping& mapping :
+         snapshot->memory_mappings()) {
+      layout.emplace_back(mapping.start_address(), mapping.num_bytes(),
+                          mapping.perms().ToMProtect());
+    }
+    std::sort(layout.begin(), layout.end());
+  }
+  // Ties are broken by id to keep the output deterministic.
+  std::sort(order.begin(), order.end(),
+            [&layouts](const Snapshot* lhs, const Snapshot* rhs) {
+              const std::vector<MappingKey>& lhs_layout = layouts[lhs];
+              const std::vector<MappingKey>& rhs_layout = layouts[rhs];
+              if (lhs_layout != rhs_layout) return lhs_layout < rhs_layout;
+              return lhs->id() < rhs->id();
+            });
+  return order;
+}
+
+// Returns pointers to the elements of `snapshots`.
+std::vector<const Snapshot*> SnapshotPointers(
+    const std::vector<Snapshot>& snapshots) {
+  std::vector<const Snapshot*> pointers;
+  pointers.reserve(snapshots.size());
+  for (const Snapshot& snapshot : snapshots) {
+    pointers.push_back(&snapshot);
+  }
+  return pointers;
+}
+
+// Writes all of `data` at `offset` in `fd`.
+absl::Status PwriteAll(int fd, absl::string_view data, uint64_t offset) {
+  while (!data.empty()) {
+    const ssize_t bytes_written = pwrite(fd, data.data(), data.size(), offset);
+    if (bytes_written < 0) {
+      if (errno == EINTR) continue;
+      return absl::ErrnoToStatus(errno, "pwrite");
+    }
+    data.remove_prefix(bytes_written);
+    offset += bytes_written;
+  }
+  return absl::OkStatus();
 }
 
 }  // namespace
 
+// Runs the generation pass of `traversal` after its layout pass over
+// `snapshot_order` into `buffer`, which must be zero-filled and at least the
+// size of the main data block.
+template <typename Arch>
+void GenerateIntoBuffer(Traversal<Arch>& traversal,
+                        const std::vector<const Snapshot*>& snapshot_order,
+                        char* buffer, size_t buffer_size,
+                        const RelocatableSnapGeneratorOptions& options) {
+  // Generate contents of the relocatable corpus as if it was to be loaded
+  // at address 0. Runtime relocation can simply be done by adding the load
+  // address of the corpus to every pointers inside the corpus.
+  constexpr uintptr_t kNominalLoadAddress = 0;
+  traversal.PrepareSnapGeneration(buffer, buffer_size, kNominalLoadAddress);
+  auto counters = traversal.Process(Traversal<Arch>::PassType::kGeneration,
+                                    snapshot_order);
+  if (options.counters) {
+    *options.counters = std::move(counters);
+  }
+}
+
 template <typename Arch>
 MmappedMemoryPtr<char> GenerateRelocatableSnapsImpl(
-    const std::vector<Snapshot>& snapshots,
+    absl::Span<const Snapshot* const> snapshots,
     const RelocatableSnapGeneratorOptions& options) {
+  const std::vector<const Snapshot*> snapshot_order =
+      SnapshotOrder(snapshots, options);
   Traversal<Arch> traversal(options);
-  traversal.Process(Traversal<Arch>::PassType::kLayout, snapshots);
+  traversal.Process(Traversal<Arch>::PassType::kLayout, snapshot_order);
 
   // Check that the whole corpus has alignment requirement not exceeding page
   // size of the runner since it will be mmap()'ed by the runner.
   CHECK_LE(traversal.main_block().required_alignment(), kPageSize);
   auto buffer = AllocateMmappedBuffer<char>(traversal.main_block().size());
+  GenerateIntoBuffer(traversal, snapshot_order, buffer.get(),
+                     MmappedMemorySize(buffer), options);
+  return buffer;
+}
 
-  // Generate contents of the relocatable corpus as if it was to be loaded
-  // at address 0. Runtime relocation can simply be done by adding the load
-  // address of the corpus to every pointers inside the corpus.
-  constexpr uintptr_t kNominalLoadAddress = 0;
-  traversal.PrepareSnapGeneration(buffer.get(), MmappedMemorySize(buffer),
-                                  kNominalLoadAddress);
-  auto counters =
-      traversal.Process(Traversal<Arch>::PassType::kGeneration, snapshots);
-  if (options.counters) {
-    *options.counters = std::move(counters);
+template <typename Arch>
+absl::StatusOr<size_t> GenerateRelocatableSnapsToFileImpl(
+    absl::Span<const Snapshot* const> snapshots, int fd,
+    const RelocatableSnapGeneratorOptions& options) {
+  const std::vector<const Snapshot*> snapshot_order =
+      SnapshotOrder(snapshots, options);
+  Traversal<Arch> traversal(options);
+  traversal.Process(Traversal<Arch>::PassType::kLayout, snapshot_order);
+  CHECK_LE(traversal.main_block().required_alignment(), kPageSize);
+
+  // Generate into a private buffer and write it out rather than mapping the
+  // file. A writable shared mapping of the file would be inherited by any
+  // child forked meanwhile by another thread and keep a memfd from being
+  // sealed against writes.
+  const size_t size = traversal.main_block().size();
+  auto buffer = AllocateMmappedBuffer<char>(size);
+  GenerateIntoBuffer(traversal, snapshot_order, buffer.get(), size, options);
+  if (ftruncate(fd, size) != 0) {
+    return absl::ErrnoToStatus(errno, "ftruncate");
   }
-  return buffer;
+  RETURN_IF_NOT_OK(PwriteAll(fd, absl::string_view(buffer.get(), size), 0));
+  return size;
 }
 
 MmappedMemoryPtr<char> GenerateRelocatableSnaps(
     ArchitectureId architecture_id, const std::vector<Snapshot>& snapshots,
     const RelocatableSnapGeneratorOptions& options) {
   CHECK(architecture_id != ArchitectureId::kUndefined);
-  return ARCH_DISPATCH(GenerateRelocatableSnapsImpl, architecture_id, snapshots,
+  return ARCH_DISPATCH(GenerateRelocatableSnapsImpl, architecture_id,
+                       SnapshotPointers(snapshots), options);
+}
+
+absl::StatusOr<size_t> GenerateRelocatableSnapsToFile(
+    ArchitectureId architecture_id, const std::vector<Snapshot>& snapshots,
+    int fd, const RelocatableSnapGeneratorOptions& options) {
+  return GenerateRelocatableSnapsToFile(
+      architecture_id, SnapshotPointers(snapshots), fd, options);
+}
+
+absl::StatusOr<size_t> GenerateRelocatableSnapsToFile(
+    ArchitectureId architecture_id, absl::Span<const Snapshot* const> snapshots,
+    int fd, const RelocatableSnapGeneratorOptions& options) {
+  CHECK(architecture_id != ArchitectureId::kUndefined);
+  return ARCH_DISPATCH(GenerateRelocatableSnapsToFileImpl, architecture_id,
+                       snapshots, fd, options);
+}
+
+namespace {
+
+// Writes a corpus into a file at non-decreasing offsets, checksumming it on
+// the way. Gaps between writes are left as they are, which must be zeros.
+class CorpusFileWriter {
+ public:
+  explicit CorpusFileWriter(int fd) : fd_(fd) {}
+
+  // Not copyable or moveable.
+  CorpusFileWriter(const CorpusFileWriter&) = delete;
+  CorpusFileWriter& operator=(const CorpusFileWriter&) = delete;
+  CorpusFileWriter(CorpusFileWriter&&) = delete;
+  CorpusFileWriter& operator=(CorpusFileWriter&&) = delete;
+
+  // Writes `data` at `offset`.
+  // REQUIRES: `offset` is not below the end of any earlier write.
+  absl::Status WriteAt(uint64_t offset, absl::string_view data) {
+    AddZerosTo(offset);
+    checksum_.AddData(data);
+    size_ += data.size();
+    return PwriteAll(fd_, data, offset);
+  }
+
+  // Returns the checksum of the first `size` bytes of the file.
+  // REQUIRES: `size` is not below the end of any write.
+  uint32_t Checksum(uint64_t size) {
+    AddZerosTo(size);
+    return checksum_.Checksum();
+  }
+
+ private:
+  // Adds the zeros between the end of the last write and `offset` to the
+  // checksum.
+  void AddZerosTo(uint64_t offset) {
+    static constexpr char kZeros[4096] = {};
+    CHECK_GE(offset, size_);
+    while (size_ < offset) {
+      const size_t n = std::min<uint64_t>(offset - size_, sizeof(kZeros));
+      checksum_.AddData(kZeros, n);
+      size_ += n;
+    }
+  }
+
+  int fd_;
+
+  // Size of the file checksummed so far.
+  uint64_t size_ = 0;
+
+  CorpusChecksumCalculator checksum_;
+};
+
+// Contents of a data block generated by StreamingTraversal. Contents are
+// buffered in memory and spilled to an unlinked temporary file. Data are
+// written at non-decreasing offsets and gaps between them read as zeros.
+class SpillFile {
+ public:
+  SpillFile() = default;
+  ~SpillFile() {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  // Not copyable or moveable.
+  SpillFile(const SpillFile&) = delete;
+  SpillFile& operator=(const SpillFile&) = delete;
+  SpillFile(SpillFile&&) = delete;
+  SpillFile& operator=(SpillFile&&) = delete;
+
+  // Creates the temporary file backing this.
+  absl::Status Open() {
+    ASSIGN_OR_RETURN_IF_NOT_OK(std::string path,
+                               CreateTempFile("relocatable_snap_section"));
+    fd_ = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    const int open_errno = errno;
+    unlink(path.c_str());
+    if (fd_ < 0) {
+      return absl::InternalError(
+          absl::StrCat("open(", path, "): ", ErrnoStr(open_errno)));
+    }
+    return absl::OkStatus();
+  }
+
+  // Returns the size of the contents including buffered data.
+  uint64_t size() const { return flushed_size_ + buffer_.size(); }
+
+  // Writes `data` at `offset`.
+  // REQUIRES: `offset` >= size().
+  absl::Status WriteAt(uint64_t offset, absl::string_view data) {
+    CHECK_GE(offset, size());
+    buffer_.append(offset - size(), '\0');
+    buffer_.append(data.data(), data.size());
+    if (buffer_.size() >= kMaxBufferSize) {
+      return Flush();
+    }
+    return absl::OkStatus();
+  }
+
+  // Reads `size` bytes at `offset` into `data`.
+  // REQUIRES: `offset` + `size` <= size().
+  absl::Status ReadAt(uint64_t offset, size_t size, char* data) {
+    CHECK_LE(offset + size, this->size());
+    if (offset >= flushed_size_) {
+      memcpy(data, buffer_.data() + (offset - flushed_size_), size);
+      return absl::OkStatus();
+    }
+    RETURN_IF_NOT_OK(Flush());
+    while (size > 0) {
+      const ssize_t bytes_read = pread(fd_, data, size, offset);
+      if (bytes_read < 0) {
+        if (errno == EINTR) continue;
+        return absl::InternalError(absl::StrCat("pread: ", ErrnoStr(errno)));
+      }
+      if (bytes_read == 0) {
+        return absl::InternalError("pread: unexpected end of file");
+      }
+      data += bytes_read;
+      offset += bytes_read;
+      size -= bytes_read;
+    }
+    return absl::OkStatus();
+  }
+
+  // Writes the contents to `writer` at `offset`, a chunk at a time.
+  absl::Status CopyTo(CorpusFileWriter& writer, uint64_t offset) {
+    std::string chunk;
+    for (uint64_t copied = 0; copied < size(); copied += chunk.size()) {
+      chunk.resize(std::min<uint64_t>(size() - copied, kMaxBufferSize));
+      RETURN_IF_NOT_OK(ReadAt(copied, chunk.size(), chunk.data()));
+      RETURN_IF_NOT_OK(writer.WriteAt(offset + copied, chunk));
+    }
+    return absl::OkStatus();
+  }
+
+  // Writes all buffered data to the file.
+  absl::Status Flush() {
+    size_t written = 0;
+    absl::Status status;
+    while (written < buffer_.size()) {
+      const ssize_t bytes_written =
+          pwrite(fd_, buffer_.data() + written, buffer_.size() - written,
+                 flushed_size_ + written);
+      if (bytes_written < 0) {
+        if (errno == EINTR) continue;
+        status = absl::InternalError(absl::StrCat("pwrite: ", ErrnoStr(errno)));
+        break;
+      }
+      written += bytes_written;
+    }
+    buffer_.erase(0, written);
+    flushed_size_ += written;
+    return status;
+  }
+
+ private:
+  // Buffered data are flushed once they reach this size.
+  static constexpr size_t kMaxBufferSize = 1 << 20;
+
+  int fd_ = -1;
+
+  // Size of the data written to the file.
+  uint64_t flushed_size_ = 0;
+
+  // Data following the first `flushed_size_` bytes.
+  std::string buffer_;
+};
+
+// A data block generated by StreamingTraversal. `layout` allocates data
+// exactly like the corresponding block in Traversal while `file` holds the
+// contents.
+struct StreamedBlock {
+  RelocatableDataBlock layout;
+  SpillFile file;
+};
+
+// Returns a zero-filled buffer for `n` objects of type T. As in a content
+// buffer of a RelocatableDataBlock, objects are constructed in it with
+// placement new so that padding bytes stay zero.
+template <typename T>
+std::unique_ptr<char[]> ZeroedBufferFor(size_t n) {
+  static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+  return std::make_unique<char[]>(n * sizeof(T));
+}
+
+// A data block of the corpus held in memory by StreamingTraversal::Finalize().
+struct LoadedBlock {
+  uint64_t address;
+  uint64_t size;
+  std::unique_ptr<char[]> contents;
+};
+
+// Returns a zero-filled LoadedBlock at `address` laid out as `layout`.
+LoadedBlock ZeroedLoadedBlock(const RelocatableDataBlock& layout,
+                              uint64_t address) {
+  CHECK_LE(layout.required_alignment(), __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+  return {.address = address,
+          .size = layout.size(),
+          .contents = std::make_unique<char[]>(layout.size())};
+}
+
+// Returns a LoadedBlock at `address` with the contents of `block`.
+absl::StatusOr<LoadedBlock> LoadBlock(StreamedBlock& block, uint64_t address) {
+  LoadedBlock loaded = ZeroedLoadedBlock(block.layout, address);
+  CHECK_LE(block.file.size(), loaded.size);
+  RETURN_IF_NOT_OK(
+      block.file.ReadAt(0, block.file.size(), loaded.contents.get()));
+  return loaded;
+}
+
+// This generates a relocatable Snap corpus in a single pass. It emits Snaps
+// with EmitSnap() like Traversal and allocates data exactly as Traversal does
+// so that the results are identical. As data block addresses are not known
+// until all snapshots are seen, pointers are written as offsets within the
+// data blocks they point into and adjusted by Finalize().
+template <typename Arch>
+class StreamingTraversal : public StreamingRelocatableSnapGenerator {
+ public:
+  explicit StreamingTraversal(const RelocatableSnapGeneratorOptions& options)
+      : options_(options) {}
+  ~StreamingTraversal() override = default;
+
+  // Creates the temporary files for the data blocks.
+  absl::Status Open();
+
+  absl::Status Add(const Snapshot& snapshot) override;
+
+  size_t size() const override { return num_snaps_; }
+
+  absl::StatusOr<size_t> Finalize(int fd) override;
+
+  // Sink interface for EmitSnap(). Objects are written to the temporary files
+  // once constructed.
+  const RelocatableSnapGeneratorOptions& options() const { return options_; }
+  bool generating() const { return true; }
+  template <typename T>
+  SinkArray Allocate(size_t n) {
+    SinkArray array{
+        .address =
+            BlockFor<T>().layout.template AllocateObjectsOfType<T>(n)
+                .byte_offset(),
+        .buffer = ZeroedBufferFor<T>(n),
+    };
+    array.contents = array.buffer.get();
+    return array;
+  }
+  template <typename T>
+  absl::Status Commit(const SinkArray& array, size_t n) {
+    return BlockFor<T>().file.WriteAt(
+        array.address, absl::string_view(array.contents, n * sizeof(T)));
+  }
+  absl::StatusOr<uint64_t> ProcessByteData(
+      const Snapshot::MemoryBytes& memory_bytes);
+  absl::StatusOr<uint64_t> ProcessCompressedByteData(
+      const Snapshot::MemoryBytes& memory_bytes, uint32_t* compressed_size);
+  absl::StatusOr<uint64_t> ProcessRegisterState(
+      const Snapshot::RegisterState& register_state,
+      bool allow_empty_register_state, uint32_t* memory_checksum);
+  uint32_t ByteDataChecksum(const Snapshot::ByteData& byte_data) {
+    return CalculateMemoryChecksum(byte_data.data(), byte_data.size());
+  }
+
+ private:
+  using RegisterState = typename Snap<Arch>::RegisterState;
+
+  // Byte data may be placed in either the byte data or the page data block.
+  // Offsets into the page data block are tagged with this bit.
+  static constexpr uint64_t kPageDataTag = uint64_t{1} << 63;
+
+  // Location of byte data seen before.
+  struct ByteDataLocation {
+    uint64_t tagged_offset;
+    uint64_t size;
+  };
+
+  // Location of compressed byte data seen before.
+  struct CompressedByteDataLocation {
+    uint64_t offset;
+    uint32_t compressed_size;
+  };
+
+  // Adds `block_address` to `ptr`.
+  template <typename T>
+  static void Relocate(T*& ptr, uint64_t block_address) {
+    ptr = reinterpret_cast<T*>(AsPtr(AsInt(ptr) + block_address));
+  }
+
+  // Returns the data block holding objects of type T, see Allocate().
+  template <typename T>
+  StreamedBlock& BlockFor() {
+    if constexpr (std::is_same_v<T, SnapMemoryBytes>) {
+      return memory_bytes_block_;
+    } else if constexpr (std::is_same_v<T, SnapMemoryMapping>) {
+      return memory_mapping_block_;
+    } else {
+      static_assert(std::is_same_v<T, char>);
+      return string_block_;
+    }
+  }
+
+  // Options.
+  RelocatableSnapGeneratorOptions options_;
+
+  // Set by Finalize().
+  bool finalized_ = false;
+
+  // Number of Snaps added.
+  size_t num_snaps_ = 0;
+
+  // Number of executable memory mappings in the Snaps added.
+  size_t num_code_intervals_ = 0;
+
+  // Snap objects, in the order they were added.
+  SpillFile snaps_;
+
+  // Number of SnapEndState objects in platform_end_states_.
+  size_t num_platform_end_states_ = 0;
+
+  // Platform end states of all Snaps, in the order they were added. They
+  // follow the Snaps in the snap block.
+  SpillFile platform_end_states_;
+
+  // Number of writable memory bytes in the Snaps added. Finalize() copies
+  // them into the hot metadata, see SnapCorpus::hot_entries.
+  size_t num_writable_memory_bytes_ = 0;
+
+  // Data blocks following the snap block in the corpus. See Traversal.
+  StreamedBlock memory_bytes_block_;
+  StreamedBlock memory_mapping_block_;
+  StreamedBlock byte_data_block_;
+  StreamedBlock string_block_;
+  StreamedBlock register_state_block_;
+  StreamedBlock page_data_block_;
+
+  // De-duping indices. Only hashes and locations are kept in memory. Matches
+  // are confirmed by reading back the data.
+  absl::flat_hash_map<size_t, absl::InlinedVector<ByteDataLocation, 1>>
+      byte_data_index_;
+  absl::flat_hash_map<size_t, absl::InlinedVector<uint64_t, 1>>
+      register_state_index_;
+  // Keyed by the hash of the uncompressed data. Only data worth compressing
+  // is indexed.
+  absl::flat_hash_map<size_t,
+                      absl::InlinedVector<CompressedByteDataLocation, 1>>
+      compressed_byte_data_index_;
+
+  // Scratch buffer for reading back byte data.
+  std::string byte_data_scratch_;
+
+  // Scratch buffer for compression.
+  std::vector<uint8_t> compression_buffer_;
+
+  // See Traversal.
+  uint64_t deduped_byte_data_size_ = 0;
+  uint64_t deduped_register_state_size_ = 0;
+  uint64_t compressed_byte_data_savings_ = 0;
+};
+
+template <typename Arch>
+absl::Status StreamingTraversal<Arch>::Open() {
+  RETURN_IF_NOT_OK(snaps_.Open());
+  RETURN_IF_NOT_OK(platform_end_states_.Open());
+  for (StreamedBlock* block :
+       {&memory_bytes_block_, &memory_mapping_block_, &byte_data_block_,
+        &string_block_, &register_state_block_, &page_data_block_}) {
+    RETURN_IF_NOT_OK(block->file.Open());
+  }
+  return absl::OkStatus();
+}
+
+template <typename Arch>
+absl::StatusOr<uint64_t> StreamingTraversal<Arch>::ProcessByteData(
+    const Snapshot::MemoryBytes& memory_bytes) {
+  const Snapshot::ByteData& byte_data = memory_bytes.byte_values();
+  absl::InlinedVector<ByteDataLocation, 1>& candidates =
+      byte_data_index_[absl::HashOf(byte_data)];
+  for (const ByteDataLocation& candidate : candidates) {
+    if (candidate.size != byte_data.size()) continue;
+    const bool page_data = (candidate.tagged_offset & kPageDataTag) != 0;
+    StreamedBlock& block = page_data ? page_data_block_ : byte_data_block_;
+    byte_data_scratch_.resize(byte_data.size());
+    RETURN_IF_NOT_OK(block.file.ReadAt(candidate.tagged_offset & ~kPageDataTag,
+                                       byte_data_scratch_.size(),
+                                       byte_data_scratch_.data()));
+    if (byte_data_scratch_ == byte_data) {
+      deduped_byte_data_size_ += byte_data.size();
+      return candidate.tagged_offset;
+    }
+  }
+
+  // Same placement as Traversal::ProcessByteData().
+  const bool page_aligned_data = IsPageAligned(memory_bytes.start_address()) &&
+                                 IsPageAligned(memory_bytes.num_bytes());
+  StreamedBlock& block =
+      page_aligned_data ? page_data_block_ : byte_data_block_;
+  const uint64_t offset =
+      block.layout
+          .Allocate(byte_data.size(),
+                    page_aligned_data ? kPageSize : sizeof(uint64_t))
+          .byte_offset();
+  RETURN_IF_NOT_OK(block.file.WriteAt(offset, byte_data));
+  const uint64_t tagged_offset = page_aligned_data ? offset | kPageDataTag
+                                                   : offset;
+  candidates.push_back({.tagged_offset = tagged_offset,
+                        .size = byte_data.size()});
+  return tagged_offset;
+}
+
+template <typename Arch>
+absl::StatusOr<uint64_t> StreamingTraversal<Arch>::ProcessCompressedByteData(
+    const Snapshot::MemoryBytes& memory_bytes, uint32_t* compressed_size) {
+  const Snapshot::ByteData& byte_data = memory_bytes.byte_values();
+  // Compression is deterministic, so identical compressed data means
+  // identical uncompressed data.
+  *compressed_size = CompressByteData(byte_data, &compression_buffer_);
+  if (*compressed_size == 0) return 0;
+  const absl::string_view compressed(
+      reinterpret_cast<const char*>(compression_buffer_.data()),
+      *compressed_size);
+
+  absl::InlinedVector<CompressedByteDataLocation, 1>& candidates =
+      compressed_byte_data_index_[absl::HashOf(byte_data)];
+  for (const CompressedByteDataLocation& candidate : candidates) {
+    if (candidate.compressed_size != *compressed_size) continue;
+    byte_data_scratch_.resize(*compressed_size);
+    RETURN_IF_NOT_OK(byte_data_block_.file.ReadAt(
+        candidate.offset, byte_data_scratch_.size(),
+        byte_data_scratch_.data()));
+    if (byte_data_scratch_ == compressed) {
+      deduped_byte_data_size_ += *compressed_size;
+      return candidate.offset;
+    }
+  }
+
+  // Same placement as Traversal::ProcessCompressedByteData().
+  const uint64_t offset =
+      byte_data_block_.layout.Allocate(*compressed_size, sizeof(uint64_t))
+          .byte_offset();
+  RETURN_IF_NOT_OK(byte_data_block_.file.WriteAt(offset, compressed));
+  candidates.push_back(
+      {.offset = offset, .compressed_size = *compressed_size});
+  compressed_byte_data_savings_ += byte_data.size() - *compressed_size;
+  return offset;
+}
+
+template <typename Arch>
+absl::StatusOr<uint64_t> StreamingTraversal<Arch>::ProcessRegisterState(
+    const Snapshot::RegisterState& register_state,
+    bool allow_empty_register_state, uint32_t* memory_checksum) {
+  RegisterState generated;
+  SetRegisterState<Arch>(register_state, &generated, memory_checksum,
+                         allow_empty_register_state);
+
+  // Like Traversal, look up by the source register state.
+  absl::InlinedVector<uint64_t, 1>& candidates = register_state_index_[
+      absl::HashOf(register_state.gregs(), register_state.fpregs())];
+  for (uint64_t offset : candidates) {
+    RegisterState previous;
+    RETURN_IF_NOT_OK(register_state_block_.file.ReadAt(
+        offset, sizeof(previous), reinterpret_cast<char*>(&previous)));
+    if (memcmp(&previous, &generated, sizeof(generated)) == 0) {
+      deduped_register_state_size_ += sizeof(RegisterState);
+      return offset;
+    }
+  }
+
+  const uint64_t offset =
+      register_state_block_.layout.AllocateObjectsOfType<RegisterState>(1)
+          .byte_offset();
+  RETURN_IF_NOT_OK(register_state_block_.file.WriteAt(
+      offset, absl::string_view(reinterpret_cast<const char*>(&generated),
+                                sizeof(generated))));
+  candidates.push_back(offset);
+  return offset;
+}
+
+template <typename Arch>
+absl::Status StreamingTraversal<Arch>::Add(const Snapshot& snapshot) {
+  if (finalized_) {
+    return absl::FailedPreconditionError("Corpus already finalized");
+  }
+  if (snapshot.expected_end_states().empty()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Snapshot ", snapshot.id(), " is not snapified"));
+  }
+
+  const size_t num_platform_end_states = NumPlatformEndStates(snapshot);
+  std::unique_ptr<char[]> contents = ZeroedBufferFor<Snap<Arch>>(1);
+  std::unique_ptr<char[]> platform_end_states_contents =
+      ZeroedBufferFor<SnapEndState<Arch>>(num_platform_end_states);
+  const uint64_t platform_end_states_offset =
+      num_platform_end_states_ * sizeof(SnapEndState<Arch>);
+  RETURN_IF_NOT_OK(EmitSnap<Arch>(*this, snapshot, contents.get(),
+                                  platform_end_states_offset,
+                                  platform_end_states_contents.get()));
+  RETURN_IF_NOT_OK(platform_end_states_.WriteAt(
+      platform_end_states_offset,
+      absl::string_view(platform_end_states_contents.get(),
+                        num_platform_end_states * sizeof(SnapEndState<Arch>))));
+  num_platform_end_states_ += num_platform_end_states;
+  RETURN_IF_NOT_OK(snaps_.WriteAt(
+      num_snaps_ * sizeof(Snap<Arch>),
+      absl::string_view(contents.get(), sizeof(Snap<Arch>))));
+  ++num_snaps_;
+  num_code_intervals_ += NumCodeIntervals(snapshot);
+  num_writable_memory_bytes_ += NumWritableMemoryBytes(snapshot);
+  return absl::OkStatus();
+}
+
+template <typename Arch>
+absl::StatusOr<size_t> StreamingTraversal<Arch>::Finalize(int fd) {
+  if (finalized_) {
+    return absl::FailedPreconditionError("Corpus already finalized");
+  }
+  finalized_ = true;
+
+  // Lay out the snap block as Traversal::Process() does.
+  RelocatableDataBlock snap_block;
+  const RelocatableDataBlock::Ref corpus_ref =
+      snap_block.AllocateObjectsOfType<SnapCorpus<Arch>>(1);
+  const RelocatableDataBlock::Ref snap_array_elements_ref =
+      snap_block.AllocateObjectsOfType<const Snap<Arch>*>(num_snaps_);
+  const RelocatableDataBlock::Ref snaps_ref =
+      snap_block.AllocateObjectsOfType<Snap<Arch>>(num_snaps_);
+  const RelocatableDataBlock::Ref platform_end_states_ref =
+      snap_block.AllocateObjectsOfType<SnapEndState<Arch>>(
+          num_platform_end_states_);
+  const RelocatableDataBlock::Ref hot_entries_ref =
+      snap_block.AllocateObjectsOfType<SnapHotEntry<Arch>>(num_snaps_);
+  const RelocatableDataBlock::Ref writable_memory_bytes_ref =
+      snap_block.AllocateObjectsOfType<SnapMemoryBytes>(
+          num_writable_memory_bytes_);
+  RelocatableDataBlock index_block;
+  const RelocatableDataBlock::Ref id_index_ref =
+      index_block.AllocateObjectsOfType<uint32_t>(num_snaps_);
+  const RelocatableDataBlock::Ref code_index_ref =
+      index_block.AllocateObjectsOfType<SnapCodeInterval>(num_code_intervals_);
+
+  // Merge data blocks in the same order as Traversal::Process(). As in
+  // GenerateRelocatableSnapsImpl(), the corpus is generated for the nominal
+  // load address 0 so block offsets are also block addresses.
+  RelocatableDataBlock main_block;
+  const uint64_t snap_block_address =
+      main_block.Allocate(snap_block).byte_offset();
+  const uint64_t memory_bytes_block_address =
+      main_block.Allocate(memory_bytes_block_.layout).byte_offset();
+  const uint64_t memory_mapping_block_address =
+      main_block.Allocate(memory_mapping_block_.layout).byte_offset();
+  const uint64_t byte_data_block_address =
+      main_block.Allocate(byte_data_block_.layout).byte_offset();
+  const uint64_t string_block_address =
+      main_block.Allocate(string_block_.layout).byte_offset();
+  const uint64_t register_state_block_address =
+      main_block.Allocate(register_state_block_.layout).byte_offset();
+  const uint64_t index_block_address =
+      main_block.Allocate(index_block).byte_offset();
+  const uint64_t page_data_block_address =
+      main_block.Allocate(page_data_block_.layout).byte_offset();
+  CHECK_LE(main_block.required_alignment(), kPageSize);
+
+  // Only the blocks holding pointers or needed for the indices are loaded
+  // into memory. Byte data and register states, the bulk of a corpus, are
+  // copied from the temporary files to `fd` a chunk at a time.
+  LoadedBlock snaps_and_metadata =
+      ZeroedLoadedBlock(snap_block, snap_block_address);
+  char* const snap_block_contents = snaps_and_metadata.contents.get();
+  RETURN_IF_NOT_OK(snaps_.ReadAt(
+      0, snaps_.size(), snap_block_contents + snaps_ref.byte_offset()));
+  RETURN_IF_NOT_OK(platform_end_states_.ReadAt(
+      0, platform_end_states_.size(),
+      snap_block_contents + platform_end_states_ref.byte_offset()));
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      LoadedBlock memory_bytes_block,
+      LoadBlock(memory_bytes_block_, memory_bytes_block_address));
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      LoadedBlock memory_mapping_block,
+      LoadBlock(memory_mapping_block_, memory_mapping_block_address));
+  ASSIGN_OR_RETURN_IF_NOT_OK(LoadedBlock string_block,
+                             LoadBlock(string_block_, string_block_address));
+  LoadedBlock loaded_index_block =
+      ZeroedLoadedBlock(index_block, index_block_address);
+
+  // Turn block offsets into addresses.
+  const uint64_t snaps_address = snap_block_address + snaps_ref.byte_offset();
+  const uint64_t platform_end_states_address =
+      snap_block_address + platform_end_states_ref.byte_offset();
+  Snap<Arch>* snaps = reinterpret_cast<Snap<Arch>*>(
+      snap_block_contents + snaps_ref.byte_offset());
+  for (size_t i = 0; i < num_snaps_; ++i) {
+    Snap<Arch>& snap = snaps[i];
+    Relocate(snap.id, string_block_address);
+    Relocate(snap.memory_mappings.elements, memory_mapping_block_address);
+    Relocate(snap.registers, register_state_block_address);
+    Relocate(snap.end_state_registers, register_state_block_address);
+    Relocate(snap.end_state_memory_bytes.elements, memory_bytes_block_address);
+    Relocate(snap.platform_end_states.elements, platform_end_states_address);
+  }
+  SnapEndState<Arch>* platform_end_states =
+      reinterpret_cast<SnapEndState<Arch>*>(
+          snap_block_contents + platform_end_states_ref.byte_offset());
+  for (size_t i = 0; i < num_platform_end_states_; ++i) {
+    SnapEndState<Arch>& end_state = platform_end_states[i];
+    Relocate(end_state.registers, register_state_block_address);
+    Relocate(end_state.memory_bytes.elements, memory_bytes_block_address);
+  }
+  // The memory mapping and memory bytes blocks contain only arrays of a
+  // single type.
+  DCHECK_EQ(memory_mapping_block.size % sizeof(SnapMemoryMapping), 0);
+  SnapMemoryMapping* memory_mappings =
+      reinterpret_cast<SnapMemoryMapping*>(memory_mapping_block.contents.get());
+  for (size_t i = 0; i < memory_mapping_block.size / sizeof(SnapMemoryMapping);
+       ++i) {
+    Relocate(memory_mappings[i].memory_bytes.elements,
+             memory_bytes_block_address);
+  }
+  DCHECK_EQ(memory_bytes_block.size % sizeof(SnapMemoryBytes), 0);
+  SnapMemoryBytes* memory_bytes =
+      reinterpret_cast<SnapMemoryBytes*>(memory_bytes_block.contents.get());
+  for (size_t i = 0; i < memory_bytes_block.size / sizeof(SnapMemoryBytes);
+       ++i) {
+    if (memory_bytes[i].repeating()) continue;
+    const uint8_t*& elements = memory_bytes[i].data.byte_values.elements;
+    const uint64_t tagged_offset = AsInt(elements);
+    elements = AddressAsPointer<const uint8_t>(tagged_offset & ~kPageDataTag);
+    Relocate(elements, (tagged_offset & kPageDataTag) != 0
+                           ? page_data_block_address
+                           : byte_data_block_address);
+  }
+
+  const uint64_t snap_array_elements_address =
+      snap_block_address + snap_array_elements_ref.byte_offset();
+  SnapCorpus<Arch>* corpus =
+      new (snap_block_contents + corpus_ref.byte_offset()) SnapCorpus<Arch>{
+          .header =
+              {
+                  .magic = kSnapCorpusMagic,
+                  .header_size = sizeof(SnapCorpusHeader),
+                  .checksum = 0,
+                  .num_bytes = main_block.size(),
+                  .corpus_type_size = sizeof(SnapCorpus<Arch>),
+                  .snap_type_size = sizeof(Snap<Arch>),
+                  .register_state_type_size = sizeof(RegisterState),
+                  .architecture_id =
+                      static_cast<uint8_t>(Arch::architecture_id),
+                  .format_version = FormatVersion(options_),
+                  .padding = {},
+              },
+          .snaps =
+              {
+                  .size = num_snaps_,
+                  .elements = AddressAsPointer<const Snap<Arch>* const>(
+                      snap_array_elements_address),
+              },
+          .id_index =
+              {
+                  .size = num_snaps_,
+                  .elements = AddressAsPointer<const uint32_t>(
+                      index_block_address + id_index_ref.byte_offset()),
+              },
+          .code_index =
+              {
+                  .size = num_code_intervals_,
+                  .elements = AddressAsPointer<const SnapCodeInterval>(
+                      index_block_address + code_index_ref.byte_offset()),
+              },
+          .hot_entries =
+              {
+                  .size = num_snaps_,
+                  .elements = AddressAsPointer<const SnapHotEntry<Arch>>(
+                      snap_block_address + hot_entries_ref.byte_offset()),
+              },
+      };
+  const Snap<Arch>** snap_array_elements = reinterpret_cast<const Snap<Arch>**>(
+      snap_block_contents + snap_array_elements_ref.byte_offset());
+  for (size_t i = 0; i < num_snaps_; ++i) {
+    snap_array_elements[i] = AddressAsPointer<const Snap<Arch>>(
+        snaps_address + i * sizeof(Snap<Arch>));
+  }
+
+  const std::array<const LoadedBlock*, 5> loaded_blocks = {
+      &snaps_and_metadata, &memory_bytes_block, &memory_mapping_block,
+      &string_block, &loaded_index_block};
+  auto contents_of = [&loaded_blocks](auto* ptr) {
+    using T = std::remove_const_t<std::remove_pointer_t<decltype(ptr)>>;
+    const uint64_t address = AsInt(ptr);
+    const LoadedBlock* containing = nullptr;
+    for (const LoadedBlock* block : loaded_blocks) {
+      if (address < block->address || address - block->address > block->size) {
+        continue;
+      }
+      containing = block;
+      // An empty array may point to the end of a block. Prefer the block
+      // strictly containing the address.
+      if (address - block->address < block->size) break;
+    }
+    CHECK(containing != nullptr);
+    return reinterpret_cast<T*>(containing->contents.get() +
+                                (address - containing->address));
+  };
+  FillCorpusIndex(*corpus, contents_of);
+  FillCorpusHotEntries(
+      *corpus, contents_of,
+      snap_block_address + writable_memory_bytes_ref.byte_offset(),
+      num_writable_memory_bytes_);
+
+  // The file is extended with zeros, so only the blocks need to be written.
+  if (ftruncate(fd, main_block.size()) != 0) {
+    return absl::ErrnoToStatus(errno, "ftruncate");
+  }
+  auto contents_view = [](const LoadedBlock& block) {
+    return absl::string_view(block.contents.get(), block.size);
+  };
+  CorpusFileWriter writer(fd);
+  RETURN_IF_NOT_OK(writer.WriteAt(snap_block_address,
+                                  contents_view(snaps_and_metadata)));
+  RETURN_IF_NOT_OK(writer.WriteAt(memory_bytes_block_address,
+                                  contents_view(memory_bytes_block)));
+  RETURN_IF_NOT_OK(writer.WriteAt(memory_mapping_block_address,
+                                  contents_view(memory_mapping_block)));
+  RETURN_IF_NOT_OK(byte_data_block_.file.CopyTo(writer,
+                                                byte_data_block_address));
+  RETURN_IF_NOT_OK(
+      writer.WriteAt(string_block_address, contents_view(string_block)));
+  RETURN_IF_NOT_OK(register_state_block_.file.CopyTo(
+      writer, register_state_block_address));
+  RETURN_IF_NOT_OK(
+      writer.WriteAt(index_block_address, contents_view(loaded_index_block)));
+  RETURN_IF_NOT_OK(page_data_block_.file.CopyTo(writer,
+                                                page_data_block_address));
+
+  // The checksum calculation ignores the checksum field in the header. This
+  // lets us set this field after the rest of the corpus is written.
+  corpus->header.checksum = writer.Checksum(main_block.size());
+  RETURN_IF_NOT_OK(PwriteAll(
+      fd,
+      absl::string_view(reinterpret_cast<const char*>(&corpus->header),
+                        sizeof(corpus->header)),
+      snap_block_address + corpus_ref.byte_offset()));
+
+  if (options_.counters) {
+    *options_.counters = {
+        {"main_block", main_block.size()},
+        {"snap_block", snap_block.size()},
+        {"memory_bytes_block", memory_bytes_block_.layout.size()},
+        {"memory_mapping_block", memory_mapping_block_.layout.size()},
+        {"byte_data_block", byte_data_block_.layout.size()},
+        {"string_block", string_block_.layout.size()},
+        {"register_state_block", register_state_block_.layout.size()},
+        {"index_block", index_block.size()},
+        {"page_data_block", page_data_block_.layout.size()},
+        {"deduped_byte_data", deduped_byte_data_size_},
+        {"deduped_register_state", deduped_register_state_size_},
+        {"compressed_byte_data_savings", compressed_byte_data_savings_},
+    };
+  }
+  return main_block.size();
+}
+
+template <typename Arch>
+absl::StatusOr<std::unique_ptr<StreamingRelocatableSnapGenerator>>
+CreateStreamingRelocatableSnapGenerator(
+    const RelocatableSnapGeneratorOptions& options) {
+  if (options.sort_snaps_by_memory_layout || options.num_threads > 1) {
+    return absl::InvalidArgumentError(
+        "Streaming generation does not support sorting or multiple threads");
+  }
+  auto generator = std::make_unique<StreamingTraversal<Arch>>(options);
+  RETURN_IF_NOT_OK(generator->Open());
+  return std::unique_ptr<StreamingRelocatableSnapGenerator>(
+      std::move(generator));
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<StreamingRelocatableSnapGenerator>>
+StreamingRelocatableSnapGenerator::Create(
+    ArchitectureId architecture_id,
+    const RelocatableSnapGeneratorOptions& options) {
+  CHECK(architecture_id != ArchitectureId::kUndefined);
+  return ARCH_DISPATCH(CreateStreamingRelocatableSnapGenerator, architecture_id,
                        options);
 }
 
@@ -15,11 +15,17 @@
 #ifndef THIRD_PARTY_SILIFUZZ_SNAP_GEN_RELOCATABLE_SNAP_GENERATOR_H_
 #define THIRD_PARTY_SILIFUZZ_SNAP_GEN_RELOCATABLE_SNAP_GENERATOR_H_
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "./common/snapshot.h"
 #include "./util/arch.h"
 #include "./util/mmapped_memory_ptr.h"
@@ -93,7 +99,10 @@ namespace silifuzz {
 //
 // 6. Byte array.
 // Variable-sized part of memory bytes.  These are aligned to 64-bit boundaries
-// to speed up access.
+// to speed up access. Identical byte data is stored once and shared by all
+// MemoryBytes referencing it. SnapMemoryBytes arrays themselves are never
+// shared because relocation adjusts the pointers in them in place. LZ4
+// compressed byte data, if any, is also stored here.
 //
 // 7. String array.
 // Snapshot IDs.
@@ -101,19 +110,47 @@ namespace silifuzz {
 // 8. Snap::RegisterState array.
 // These are the registers that specify the entry and exit state of each Snap.
 // This data is stored out-of-line from the Snap structure so that relocating
-// the Snap doesn't dirty the pages containing register data.
+// the Snap doesn't dirty the pages containing register data. Identical
+// register states are stored once and shared by all Snaps using them.
 //
 // 9. Page-aligned data.
 // Page-aligned memory bytes may be put in this section if we want to mmap them
 // directly from the file when the corpus is loaded. Page-aligned data will not
 // be RLE compressed, however, so there is a tradeoff between load speed and
-// corpus size.
+// corpus size. Compressed page-aligned data is stored in the byte array
+// instead as it cannot be mmapped directly.
 
 // Options passed to relocatable Snap corpus generator.
 struct RelocatableSnapGeneratorOptions {
   // If true, apply run-length compression to memory bytes data.
   bool compress_repeating_bytes = true;
 
+  // If true, LZ4 compress the initial memory bytes of read-only mappings that
+  // are not run-length compressed. The runner decompresses them directly into
+  // the mappings, which trades load time and direct mmapping of page-aligned
+  // data for corpus size. Only data that compresses well is compressed.
+  // Corpora generated with this set need a runner that understands
+  // kSnapCorpusCompressedFormatVersion.
+  bool compress_memory_bytes = false;
+
+  // If true, Snaps are emitted ordered by their memory mapping layout rather
+  // than in the order of the input snapshots. Snaps with the same mappings,
+  // e.g. identical stack and data pages, end up next to each other, and so do
+  // their SnapMemoryBytes and the byte data first used by them. Byte data is
+  // always shared between identical MemoryBytes regardless of this option.
+  bool sort_snaps_by_memory_layout = false;
+
+  // Number of threads used to generate contents of the corpus. The layout
+  // pass is always sequential as de-duping depends on the order of snapshots.
+  // The generated corpus is byte-identical regardless of this value.
+  int num_threads = 1;
+
+  // When present, returns the register groups that the code of a snapshot may
+  // access, as serialized RegisterGroupSet bits, for
+  // Snap::code_register_groups. Otherwise snaps are not classified. Called
+  // from the generator threads, see num_threads.
+  std::function<uint64_t(const Snapshot&)> code_register_groups;
+
   // When present, this map will be populated with various _debug-only_
   // counters representing sizes of different parts of the generated corpus.
   // The keys are human-readable but are not guaranteed to be stable.
@@ -133,6 +170,75 @@ MmappedMemoryPtr<char> GenerateRelocatableSnaps(
     ArchitectureId architecture_id, const std::vector<Snapshot>& snapshots,
     const RelocatableSnapGeneratorOptions& options = {});
 
+// Like GenerateRelocatableSnaps() but writes the corpus into the file `fd`.
+// The file is resized to the size of the corpus, which is known after the
+// layout pass, and written with pwrite(2). The file is never mapped, so a
+// memfd can be sealed against writes as soon as this returns.
+//
+// RETURNS the size of the corpus or an error if `fd` cannot be resized or
+// written.
+//
+// REQUIRES: `fd` refers to an empty regular file or memfd opened for
+// writing.
+// REQUIRES: `snapshots` are snapified.
+// REQUIRES: the architecture of each snapshot matches `architecture_id`.
+//
+// This function is thread-safe.
+absl::StatusOr<size_t> GenerateRelocatableSnapsToFile(
+    ArchitectureId architecture_id, const std::vector<Snapshot>& snapshots,
+    int fd, const RelocatableSnapGeneratorOptions& options = {});
+
+// Like above but takes pointers to the snapshots, so that callers holding
+// them elsewhere, e.g. a single snapshot, need not copy them into a vector.
+absl::StatusOr<size_t> GenerateRelocatableSnapsToFile(
+    ArchitectureId architecture_id, absl::Span<const Snapshot* const> snapshots,
+    int fd, const RelocatableSnapGeneratorOptions& options = {});
+
+// Generates a relocatable Snap corpus from snapshots passed one at a time, so
+// that callers do not need to hold the whole corpus in memory. Generated
+// sections are spilled to unlinked temporary files as snapshots are added.
+// Memory use is bounded by the size of the de-duping index and the Snap
+// metadata rather than by the size of the input. The final corpus is
+// byte-identical to the one GenerateRelocatableSnaps() returns for the same
+// snapshots in the same order.
+//
+// sort_snaps_by_memory_layout and num_threads in RelocatableSnapGeneratorOptions
+// are not supported as the snapshots are processed in a single pass.
+//
+// This class is not thread-safe.
+class StreamingRelocatableSnapGenerator {
+ public:
+  // Creates a generator for `architecture_id` with `options`. The temporary
+  // files are created in $TMPDIR.
+  static absl::StatusOr<std::unique_ptr<StreamingRelocatableSnapGenerator>>
+  Create(ArchitectureId architecture_id,
+         const RelocatableSnapGeneratorOptions& options = {});
+
+  virtual ~StreamingRelocatableSnapGenerator() = default;
+
+  // Adds `snapshot` to the corpus. `snapshot` is not referenced after this
+  // returns.
+  //
+  // REQUIRES: `snapshot` is snapified.
+  // REQUIRES: the architecture of `snapshot` matches that of the generator.
+  // REQUIRES: Finalize() has not been called.
+  virtual absl::Status Add(const Snapshot& snapshot) = 0;
+
+  // Returns the number of snapshots added so far.
+  virtual size_t size() const = 0;
+
+  // Builds the relocatable corpus from all added snapshots and writes it to
+  // `fd`. Only the Snap metadata are held in memory while doing so; byte
+  // data and register states are copied from the temporary files a chunk at
+  // a time.
+  // RETURNS the size of the corpus.
+  //
+  // REQUIRES: `fd` refers to an empty regular file or memfd opened for
+  // writing.
+  // REQUIRES: Called at most once.
+  virtual absl::StatusOr<size_t> Finalize(int fd) = 0;
+};
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_SNAP_GEN_RELOCATABLE_SNAP_GENERATOR_H_
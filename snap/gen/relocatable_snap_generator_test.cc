@@ -14,13 +14,17 @@
 
 #include "./snap/gen/relocatable_snap_generator.h"
 
+#include <fcntl.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
 #include <string>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -28,11 +32,14 @@
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "./common/memory_mapping.h"
 #include "./common/memory_perms.h"
 #include "./common/snapshot.h"
 #include "./common/snapshot_test_enum.h"
 #include "./common/snapshot_test_util.h"
+#include "./common/snapshot_util.h"
 #include "./snap/gen/snap_generator.h"
 #include "./snap/snap.h"
 #include "./snap/snap_relocator.h"
@@ -42,7 +49,9 @@
 #include "./util/arch.h"
 #include "./util/checks.h"
 #include "./util/mmapped_memory_ptr.h"
+#include "./util/platform.h"
 #include "./util/testing/status_macros.h"
+#include "./util/ucontext/ucontext_types.h"
 
 namespace silifuzz {
 namespace {
@@ -63,6 +72,26 @@ MmappedMemoryPtr<const SnapCorpus<Arch>> GenerateRelocatedCorpus(
   return relocated_corpus;
 }
 
+// Finalizes `generator` into a memfd and returns the corpus written.
+absl::StatusOr<std::string> FinalizeToString(
+    StreamingRelocatableSnapGenerator& generator) {
+  const int memfd = memfd_create("FinalizeToString", O_RDWR | MFD_CLOEXEC);
+  if (memfd == -1) {
+    return absl::ErrnoToStatus(errno, "memfd_create");
+  }
+  absl::StatusOr<size_t> size = generator.Finalize(memfd);
+  std::string contents;
+  if (size.ok()) {
+    contents.resize(*size);
+    if (pread(memfd, contents.data(), *size, 0) != *size) {
+      size = absl::InternalError("short read");
+    }
+  }
+  close(memfd);
+  RETURN_IF_NOT_OK(size.status());
+  return contents;
+}
+
 template <typename>
 struct RelocatableSnapGenerator : ::testing::Test {};
 using arch_typelist = ::testing::Types<ALL_ARCH_TYPES>;
@@ -109,6 +138,42 @@ TYPED_TEST(RelocatableSnapGenerator, RoundTrip) {
   ASSERT_EQ(corpus[0], *snapshotFromSnap);
 }
 
+TYPED_TEST(RelocatableSnapGenerator, CodeRegisterGroups) {
+  Snapshot snapshot =
+      MakeSnapRunnerTestSnapshot<TypeParam>(TestSnapshot::kEndsAsExpected);
+  ASSERT_OK_AND_ASSIGN(
+      Snapshot snapified,
+      Snapify(snapshot,
+              SnapifyOptions::V2InputRunOpts(snapshot.architecture_id())));
+  std::vector<Snapshot> corpus;
+  corpus.push_back(std::move(snapified));
+
+  // Unclassified by default.
+  EXPECT_EQ(GenerateRelocatedCorpus<TypeParam>(corpus)
+                ->snaps.at(0)
+                ->code_register_groups,
+            0);
+
+  constexpr uint64_t kGroups = 0x8;
+  RelocatableSnapGeneratorOptions options;
+  options.code_register_groups = [](const Snapshot&) { return kGroups; };
+  EXPECT_EQ(GenerateRelocatedCorpus<TypeParam>(corpus, options)
+                ->snaps.at(0)
+                ->code_register_groups,
+            kGroups);
+
+  // The streaming generator classifies snaps the same way.
+  ASSERT_OK_AND_ASSIGN(auto generator,
+                       StreamingRelocatableSnapGenerator::Create(
+                           TypeParam::architecture_id, options));
+  ASSERT_OK(generator->Add(corpus[0]));
+  ASSERT_OK_AND_ASSIGN(std::string streamed, FinalizeToString(*generator));
+  auto expected =
+      GenerateRelocatableSnaps(TypeParam::architecture_id, corpus, options);
+  ASSERT_EQ(streamed.size(), MmappedMemorySize(expected));
+  EXPECT_EQ(memcmp(streamed.data(), expected.get(), streamed.size()), 0);
+}
+
 TYPED_TEST(RelocatableSnapGenerator, SupportDirectMMap) {
   std::vector<Snapshot> rle_corpus;
   {
@@ -215,6 +280,159 @@ TYPED_TEST(RelocatableSnapGenerator, AllRunnerTestSnaps) {
   }
 }
 
+TYPED_TEST(RelocatableSnapGenerator, SortSnapsByMemoryLayout) {
+  SnapifyOptions opts = SnapifyOptions::V2InputRunOpts(Host::architecture_id);
+
+  std::vector<Snapshot> snapified_corpus;
+  for (int index = 0; index < static_cast<int>(TestSnapshot::kNumTestSnapshot);
+       ++index) {
+    TestSnapshot type = static_cast<TestSnapshot>(index);
+    if (!TestSnapshotExists<TypeParam>(type)) {
+      continue;
+    }
+    Snapshot snapshot = MakeSnapRunnerTestSnapshot<TypeParam>(type);
+    ASSERT_OK_AND_ASSIGN(Snapshot snapified, Snapify(snapshot, opts));
+    snapified_corpus.push_back(std::move(snapified));
+  }
+
+  auto relocated_corpus = GenerateRelocatedCorpus<TypeParam>(
+      snapified_corpus, {.sort_snaps_by_memory_layout = true});
+
+  // Every snapshot must still be present and intact.
+  for (const Snapshot& snapshot : snapified_corpus) {
+    const Snap<TypeParam>* snap =
+        relocated_corpus->Find(snapshot.id().c_str());
+    ASSERT_NE(snap, nullptr) << snapshot.id();
+    VerifyTestSnap(snapshot, *snap, opts);
+  }
+
+  // Snaps with identical layouts must be adjacent.
+  using Layout = std::vector<std::tuple<uint64_t, uint64_t, int32_t>>;
+  absl::flat_hash_set<Layout> finished_layouts;
+  Layout previous_layout;
+  for (size_t i = 0; i < relocated_corpus->snaps.size; ++i) {
+    const Snap<TypeParam>& snap = *relocated_corpus->snaps.at(i);
+    Layout layout;
+    for (const auto& mapping : snap.memory_mappings) {
+      layout.emplace_back(mapping.start_address, mapping.num_bytes,
+                          mapping.perms);
+    }
+    std::sort(layout.begin(), layout.end());
+    if (i > 0 && layout != previous_layout) {
+      EXPECT_TRUE(finished_layouts.insert(previous_layout).second);
+      EXPECT_FALSE(finished_layouts.contains(layout)) << snap.id;
+    }
+    previous_layout = std::move(layout);
+  }
+}
+
+TYPED_TEST(RelocatableSnapGenerator, CorpusIndex) {
+  SnapifyOptions opts = SnapifyOptions::V2InputRunOpts(Host::architecture_id);
+
+  std::vector<Snapshot> snapified_corpus;
+  for (int index = 0; index < static_cast<int>(TestSnapshot::kNumTestSnapshot);
+       ++index) {
+    TestSnapshot type = static_cast<TestSnapshot>(index);
+    if (!TestSnapshotExists<TypeParam>(type)) {
+      continue;
+    }
+    Snapshot snapshot = MakeSnapRunnerTestSnapshot<TypeParam>(type);
+    ASSERT_OK_AND_ASSIGN(Snapshot snapified, Snapify(snapshot, opts));
+    snapified_corpus.push_back(std::move(snapified));
+  }
+  // Add snapshots in reverse id order so that the id index is not trivial.
+  std::reverse(snapified_corpus.begin(), snapified_corpus.end());
+
+  auto relocated_corpus =
+      GenerateRelocatedCorpus<TypeParam>(snapified_corpus, {});
+  ASSERT_EQ(relocated_corpus->id_index.size, relocated_corpus->snaps.size);
+  EXPECT_GT(relocated_corpus->code_index.size, 0);
+
+  // Lookups using the indices must agree with linear scans.
+  SnapCorpus<TypeParam> unindexed_corpus = *relocated_corpus;
+  unindexed_corpus.id_index = {};
+  unindexed_corpus.code_index = {};
+  for (size_t i = 0; i < relocated_corpus->snaps.size; ++i) {
+    const Snap<TypeParam>* snap = relocated_corpus->snaps.at(i);
+    EXPECT_EQ(relocated_corpus->FindIndex(snap->id), i);
+    EXPECT_EQ(relocated_corpus->Find(snap->id), snap);
+    for (const auto& mapping : snap->memory_mappings) {
+      for (uint64_t address :
+           {mapping.start_address - 1, mapping.start_address,
+            mapping.start_address + mapping.num_bytes - 1,
+            mapping.start_address + mapping.num_bytes}) {
+        EXPECT_EQ(relocated_corpus->FindByCodeAddress(address),
+                  unindexed_corpus.FindByCodeAddress(address));
+      }
+    }
+  }
+  EXPECT_EQ(relocated_corpus->Find("no such snap"), nullptr);
+  EXPECT_EQ(relocated_corpus->FindIndex("no such snap"),
+            relocated_corpus->snaps.size);
+  EXPECT_EQ(relocated_corpus->FindByCodeAddress(0), nullptr);
+}
+
+TYPED_TEST(RelocatableSnapGenerator, HotEntries) {
+  SnapifyOptions opts = SnapifyOptions::V2InputRunOpts(Host::architecture_id);
+
+  std::vector<Snapshot> snapified_corpus;
+  for (int index = 0; index < static_cast<int>(TestSnapshot::kNumTestSnapshot);
+       ++index) {
+    TestSnapshot type = static_cast<TestSnapshot>(index);
+    if (!TestSnapshotExists<TypeParam>(type)) {
+      continue;
+    }
+    Snapshot snapshot = MakeSnapRunnerTestSnapshot<TypeParam>(type);
+    ASSERT_OK_AND_ASSIGN(Snapshot snapified, Snapify(snapshot, opts));
+    snapified_corpus.push_back(std::move(snapified));
+  }
+
+  auto relocated_corpus =
+      GenerateRelocatedCorpus<TypeParam>(snapified_corpus, {});
+  ASSERT_EQ(relocated_corpus->hot_entries.size, relocated_corpus->snaps.size);
+  const SnapMemoryBytes* next_memory_bytes = nullptr;
+  for (size_t i = 0; i < relocated_corpus->snaps.size; ++i) {
+    const Snap<TypeParam>& snap = *relocated_corpus->snaps.at(i);
+    const SnapHotEntry<TypeParam>& hot_entry =
+        relocated_corpus->hot_entries.at(i);
+    EXPECT_EQ(hot_entry.registers, snap.registers);
+
+    // Writable memory bytes must match those of the mappings.
+    std::vector<const SnapMemoryBytes*> writable_memory_bytes;
+    uint64_t writable_num_bytes = 0;
+    for (const auto& mapping : snap.memory_mappings) {
+      if (!mapping.writable()) continue;
+      writable_num_bytes += mapping.num_bytes;
+      for (const auto& memory_bytes : mapping.memory_bytes) {
+        writable_memory_bytes.push_back(&memory_bytes);
+      }
+    }
+    EXPECT_EQ(hot_entry.writable_num_bytes, writable_num_bytes);
+    ASSERT_EQ(hot_entry.writable_memory_bytes.size,
+              writable_memory_bytes.size());
+    for (size_t j = 0; j < writable_memory_bytes.size(); ++j) {
+      const SnapMemoryBytes& expected = *writable_memory_bytes[j];
+      const SnapMemoryBytes& actual = hot_entry.writable_memory_bytes.at(j);
+      EXPECT_EQ(actual.start_address, expected.start_address);
+      EXPECT_EQ(actual.size(), expected.size());
+      EXPECT_EQ(actual.repeating(), expected.repeating());
+      if (!expected.repeating()) {
+        EXPECT_EQ(actual.data.byte_values.elements,
+                  expected.data.byte_values.elements);
+      }
+    }
+
+    // Memory bytes of all entries are adjacent and in corpus order.
+    if (hot_entry.writable_memory_bytes.size > 0) {
+      if (next_memory_bytes != nullptr) {
+        EXPECT_EQ(hot_entry.writable_memory_bytes.elements, next_memory_bytes);
+      }
+      next_memory_bytes = hot_entry.writable_memory_bytes.elements +
+                          hot_entry.writable_memory_bytes.size;
+    }
+  }
+}
+
 // Test that duplicated byte data are merged to a single copy.
 TYPED_TEST(RelocatableSnapGenerator, DedupeMemoryBytes) {
   Snapshot snapshot =
@@ -261,6 +479,7 @@ TYPED_TEST(RelocatableSnapGenerator, DedupeMemoryBytes) {
   // and ARM. "string_block" is the size of snapshot id (kEndsAsExpected) in
   // asciiz.
   EXPECT_EQ(counters["string_block"], 16);
+  EXPECT_GE(counters["deduped_byte_data"], test_byte_data.size());
 
   // Test byte data should appear twice in two MemoryBytes objects but
   // the array element addresses should be the same.
@@ -283,5 +502,355 @@ TYPED_TEST(RelocatableSnapGenerator, DedupeMemoryBytes) {
   EXPECT_EQ(addresses_seen.size(), 1);
 }
 
+// Test that identical register states are merged to a single copy.
+TYPED_TEST(RelocatableSnapGenerator, DedupeRegisterState) {
+  Snapshot snapshot =
+      CreateTestSnapshot<TypeParam>(TestSnapshot::kEndsAsExpected);
+  SnapifyOptions snapify_opts =
+      SnapifyOptions::V2InputRunOpts(snapshot.architecture_id());
+  ASSERT_OK_AND_ASSIGN(auto snapified, Snapify(snapshot, snapify_opts));
+
+  std::vector<Snapshot> snapified_corpus;
+  Snapshot copy = snapified.Copy();
+  copy.set_id("copy_of_ends_as_expected");
+  snapified_corpus.push_back(std::move(snapified));
+  snapified_corpus.push_back(std::move(copy));
+
+  absl::flat_hash_map<std::string, uint64_t> counters;
+  auto relocated_corpus = GenerateRelocatedCorpus<TypeParam>(
+      snapified_corpus, {.counters = &counters});
+  EXPECT_EQ(counters["deduped_register_state"],
+            2 * sizeof(typename Snap<TypeParam>::RegisterState));
+  EXPECT_EQ(counters["register_state_block"],
+            2 * sizeof(typename Snap<TypeParam>::RegisterState));
+
+  ASSERT_EQ(relocated_corpus->snaps.size, 2);
+  const Snap<TypeParam>& snap0 = *relocated_corpus->snaps.at(0);
+  const Snap<TypeParam>& snap1 = *relocated_corpus->snaps.at(1);
+  EXPECT_EQ(snap0.registers, snap1.registers);
+  EXPECT_EQ(snap0.end_state_registers, snap1.end_state_registers);
+  EXPECT_EQ(snap0.registers_memory_checksum, snap1.registers_memory_checksum);
+  EXPECT_EQ(snap0.end_state_registers_memory_checksum,
+            snap1.end_state_registers_memory_checksum);
+  for (const Snapshot& snapshot : snapified_corpus) {
+    const Snap<TypeParam>* snap =
+        relocated_corpus->Find(snapshot.id().c_str());
+    ASSERT_NE(snap, nullptr);
+    VerifyTestSnap(snapshot, *snap, snapify_opts);
+  }
+}
+
+// Test that parallel generation produces exactly the same corpus.
+TYPED_TEST(RelocatableSnapGenerator, ParallelGeneration) {
+  SnapifyOptions opts = SnapifyOptions::V2InputRunOpts(Host::architecture_id);
+
+  // Use several copies of each snapshot so that shards see byte data and
+  // register states first generated by other shards.
+  std::vector<Snapshot> snapified_corpus;
+  for (int copy = 0; copy < 3; ++copy) {
+    for (int index = 0;
+         index < static_cast<int>(TestSnapshot::kNumTestSnapshot); ++index) {
+      TestSnapshot type = static_cast<TestSnapshot>(index);
+      if (!TestSnapshotExists<TypeParam>(type)) {
+        continue;
+      }
+      Snapshot snapshot = MakeSnapRunnerTestSnapshot<TypeParam>(type);
+      ASSERT_OK_AND_ASSIGN(Snapshot snapified, Snapify(snapshot, opts));
+      snapified.set_id(absl::StrCat(snapified.id(), "_", copy));
+      snapified_corpus.push_back(std::move(snapified));
+    }
+  }
+
+  absl::flat_hash_map<std::string, uint64_t> counters;
+  auto sequential = GenerateRelocatableSnaps(
+      TypeParam::architecture_id, snapified_corpus, {.counters = &counters});
+  for (int num_threads : {2, 7}) {
+    absl::flat_hash_map<std::string, uint64_t> parallel_counters;
+    auto parallel = GenerateRelocatableSnaps(
+        TypeParam::architecture_id, snapified_corpus,
+        {.num_threads = num_threads, .counters = &parallel_counters});
+    ASSERT_EQ(MmappedMemorySize(parallel), MmappedMemorySize(sequential));
+    EXPECT_EQ(memcmp(parallel.get(), sequential.get(),
+                     MmappedMemorySize(sequential)),
+              0)
+        << "num_threads = " << num_threads;
+    EXPECT_EQ(parallel_counters, counters);
+  }
+}
+
+// Test that streaming generation produces exactly the same corpus.
+TYPED_TEST(RelocatableSnapGenerator, StreamingGeneration) {
+  SnapifyOptions opts = SnapifyOptions::V2InputRunOpts(Host::architecture_id);
+
+  std::vector<Snapshot> snapified_corpus;
+  for (int copy = 0; copy < 2; ++copy) {
+    for (int index = 0;
+         index < static_cast<int>(TestSnapshot::kNumTestSnapshot); ++index) {
+      TestSnapshot type = static_cast<TestSnapshot>(index);
+      if (!TestSnapshotExists<TypeParam>(type)) {
+        continue;
+      }
+      Snapshot snapshot = MakeSnapRunnerTestSnapshot<TypeParam>(type);
+      ASSERT_OK_AND_ASSIGN(Snapshot snapified, Snapify(snapshot, opts));
+      snapified.set_id(absl::StrCat(snapified.id(), "_", copy));
+      snapified_corpus.push_back(std::move(snapified));
+    }
+  }
+
+  absl::flat_hash_map<std::string, uint64_t> counters;
+  auto expected = GenerateRelocatableSnaps(
+      TypeParam::architecture_id, snapified_corpus, {.counters = &counters});
+
+  absl::flat_hash_map<std::string, uint64_t> streaming_counters;
+  ASSERT_OK_AND_ASSIGN(auto generator,
+                       StreamingRelocatableSnapGenerator::Create(
+                           TypeParam::architecture_id,
+                           {.counters = &streaming_counters}));
+  for (const Snapshot& snapshot : snapified_corpus) {
+    ASSERT_OK(generator->Add(snapshot));
+  }
+  EXPECT_EQ(generator->size(), snapified_corpus.size());
+  ASSERT_OK_AND_ASSIGN(std::string streamed, FinalizeToString(*generator));
+  ASSERT_EQ(streamed.size(), MmappedMemorySize(expected));
+  EXPECT_EQ(memcmp(streamed.data(), expected.get(), streamed.size()), 0);
+  EXPECT_EQ(streaming_counters, counters);
+
+  EXPECT_FALSE(generator->Add(snapified_corpus[0]).ok());
+  EXPECT_FALSE(FinalizeToString(*generator).ok());
+}
+
+TYPED_TEST(RelocatableSnapGenerator, GenerateToFile) {
+  SnapifyOptions opts = SnapifyOptions::V2InputRunOpts(Host::architecture_id);
+  std::vector<Snapshot> snapified_corpus;
+  for (int index = 0; index < static_cast<int>(TestSnapshot::kNumTestSnapshot);
+       ++index) {
+    TestSnapshot type = static_cast<TestSnapshot>(index);
+    if (!TestSnapshotExists<TypeParam>(type)) {
+      continue;
+    }
+    Snapshot snapshot = MakeSnapRunnerTestSnapshot<TypeParam>(type);
+    ASSERT_OK_AND_ASSIGN(Snapshot snapified, Snapify(snapshot, opts));
+    snapified_corpus.push_back(std::move(snapified));
+  }
+
+  auto expected =
+      GenerateRelocatableSnaps(TypeParam::architecture_id, snapified_corpus);
+
+  int memfd = memfd_create("GenerateToFile", O_RDWR | MFD_CLOEXEC);
+  ASSERT_NE(memfd, -1);
+  ASSERT_OK_AND_ASSIGN(
+      size_t size, GenerateRelocatableSnapsToFile(TypeParam::architecture_id,
+                                                  snapified_corpus, memfd));
+  ASSERT_EQ(size, MmappedMemorySize(expected));
+  std::string contents(size, '\0');
+  ASSERT_EQ(pread(memfd, contents.data(), size, 0), size);
+  EXPECT_EQ(memcmp(contents.data(), expected.get(), size), 0);
+  close(memfd);
+
+  // Same with pointers to the snapshots.
+  std::vector<const Snapshot*> snapshot_pointers;
+  for (const Snapshot& snapshot : snapified_corpus) {
+    snapshot_pointers.push_back(&snapshot);
+  }
+  memfd = memfd_create("GenerateToFile", O_RDWR | MFD_CLOEXEC);
+  ASSERT_NE(memfd, -1);
+  ASSERT_OK_AND_ASSIGN(
+      size, GenerateRelocatableSnapsToFile(TypeParam::architecture_id,
+                                           snapshot_pointers, memfd));
+  ASSERT_EQ(size, MmappedMemorySize(expected));
+  ASSERT_EQ(pread(memfd, contents.data(), size, 0), size);
+  EXPECT_EQ(memcmp(contents.data(), expected.get(), size), 0);
+  close(memfd);
+}
+
+// Test that compressed memory bytes round trip and that all generators
+// produce exactly the same compressed corpus.
+TYPED_TEST(RelocatableSnapGenerator, CompressMemoryBytes) {
+  SnapifyOptions opts = SnapifyOptions::V2InputRunOpts(Host::architecture_id);
+  // Keep whole code pages so that there is data worth compressing.
+  opts.support_direct_mmap = true;
+
+  std::vector<Snapshot> snapified_corpus;
+  for (int copy = 0; copy < 2; ++copy) {
+    for (int index = 0;
+         index < static_cast<int>(TestSnapshot::kNumTestSnapshot); ++index) {
+      TestSnapshot type = static_cast<TestSnapshot>(index);
+      if (!TestSnapshotExists<TypeParam>(type)) {
+        continue;
+      }
+      Snapshot snapshot = MakeSnapRunnerTestSnapshot<TypeParam>(type);
+      ASSERT_OK_AND_ASSIGN(Snapshot snapified, Snapify(snapshot, opts));
+      snapified.set_id(absl::StrCat(snapified.id(), "_", copy));
+      snapified_corpus.push_back(std::move(snapified));
+    }
+  }
+
+  absl::flat_hash_map<std::string, uint64_t> counters;
+  auto expected =
+      GenerateRelocatableSnaps(TypeParam::architecture_id, snapified_corpus,
+                               {.compress_memory_bytes = true,
+                                .counters = &counters});
+  EXPECT_GT(counters["compressed_byte_data_savings"], 0);
+
+  absl::flat_hash_map<std::string, uint64_t> parallel_counters;
+  auto parallel = GenerateRelocatableSnaps(
+      TypeParam::architecture_id, snapified_corpus,
+      {.compress_memory_bytes = true,
+       .num_threads = 3,
+       .counters = &parallel_counters});
+  ASSERT_EQ(MmappedMemorySize(parallel), MmappedMemorySize(expected));
+  EXPECT_EQ(
+      memcmp(parallel.get(), expected.get(), MmappedMemorySize(expected)), 0);
+  EXPECT_EQ(parallel_counters, counters);
+
+  absl::flat_hash_map<std::string, uint64_t> streaming_counters;
+  ASSERT_OK_AND_ASSIGN(auto generator,
+                       StreamingRelocatableSnapGenerator::Create(
+                           TypeParam::architecture_id,
+                           {.compress_memory_bytes = true,
+                            .counters = &streaming_counters}));
+  for (const Snapshot& snapshot : snapified_corpus) {
+    ASSERT_OK(generator->Add(snapshot));
+  }
+  ASSERT_OK_AND_ASSIGN(std::string streamed, FinalizeToString(*generator));
+  ASSERT_EQ(streamed.size(), MmappedMemorySize(expected));
+  EXPECT_EQ(memcmp(streamed.data(), expected.get(), streamed.size()), 0);
+  EXPECT_EQ(streaming_counters, counters);
+
+  SnapRelocatorError error;
+  auto relocated_corpus = SnapRelocator<TypeParam>::RelocateCorpus(
+      std::move(expected), true, &error);
+  ASSERT_EQ(error, SnapRelocatorError::kOk);
+  EXPECT_EQ(relocated_corpus->header.format_version,
+            kSnapCorpusCompressedFormatVersion);
+  bool found_compressed = false;
+  for (size_t i = 0; i < snapified_corpus.size(); ++i) {
+    const Snap<TypeParam>& snap = *relocated_corpus->snaps.at(i);
+    for (const SnapMemoryMapping& mapping : snap.memory_mappings) {
+      for (const SnapMemoryBytes& memory_bytes : mapping.memory_bytes) {
+        if (memory_bytes.compressed()) {
+          found_compressed = true;
+          EXPECT_FALSE(mapping.writable());
+        }
+      }
+    }
+    for (const SnapMemoryBytes& memory_bytes : snap.end_state_memory_bytes) {
+      EXPECT_FALSE(memory_bytes.compressed());
+    }
+    VerifyTestSnap(snapified_corpus[i], snap, opts);
+    ASSERT_OK_AND_ASSIGN(
+        Snapshot snapshot,
+        SnapToSnapshot(snap, TestSnapshotPlatform<TypeParam>()));
+    EXPECT_EQ(snapshot, snapified_corpus[i]);
+  }
+  EXPECT_TRUE(found_compressed);
+}
+
+// Test that end states of other platforms kept by Snapify() become platform
+// end states that all generators produce alike and that round trip.
+TYPED_TEST(RelocatableSnapGenerator, PlatformEndStates) {
+  Snapshot snapshot =
+      MakeSnapRunnerTestSnapshot<TypeParam>(TestSnapshot::kEndsAsExpected);
+  const PlatformId platform = TestSnapshotPlatform<TypeParam>();
+  const PlatformId other_platform = PlatformId::kNonExistent;
+
+  // Add an end state with a different stack pointer for another platform.
+  const Snapshot::EndState& end_state = snapshot.expected_end_states()[0];
+  GRegSet<TypeParam> gregs;
+  FPRegSet<TypeParam> fpregs;
+  ASSERT_OK(ConvertRegsFromSnapshot(end_state.registers(), &gregs, &fpregs));
+  gregs.SetStackPointer(gregs.GetStackPointer() - 16);
+  Snapshot::EndState other_end_state(end_state.endpoint(),
+                                     ConvertRegsToSnapshot(gregs, fpregs));
+  other_end_state.add_memory_bytes(end_state.memory_bytes());
+  other_end_state.set_register_checksum(end_state.register_checksum());
+  other_end_state.add_platform(other_platform);
+  ASSERT_OK(snapshot.can_add_expected_end_state(other_end_state));
+  snapshot.add_expected_end_state(other_end_state);
+
+  SnapifyOptions opts = SnapifyOptions::V2InputRunOpts(Host::architecture_id);
+  opts.platform_id = platform;
+  ASSERT_OK_AND_ASSIGN(Snapshot single, Snapify(snapshot, opts));
+  EXPECT_EQ(single.expected_end_states().size(), 1);
+
+  opts.keep_platform_end_states = true;
+  std::vector<Snapshot> snapified_corpus;
+  ASSERT_OK_AND_ASSIGN(Snapshot snapified, Snapify(snapshot, opts));
+  ASSERT_EQ(snapified.expected_end_states().size(), 2);
+  EXPECT_TRUE(snapified.expected_end_states()[0].has_platform(platform));
+  snapified_corpus.push_back(std::move(snapified));
+
+  auto expected =
+      GenerateRelocatableSnaps(TypeParam::architecture_id, snapified_corpus);
+  ASSERT_OK_AND_ASSIGN(auto generator,
+                       StreamingRelocatableSnapGenerator::Create(
+                           TypeParam::architecture_id, {}));
+  ASSERT_OK(generator->Add(snapified_corpus[0]));
+  ASSERT_OK_AND_ASSIGN(std::string streamed, FinalizeToString(*generator));
+  ASSERT_EQ(streamed.size(), MmappedMemorySize(expected));
+  EXPECT_EQ(memcmp(streamed.data(), expected.get(), streamed.size()), 0);
+
+  SnapRelocatorError error;
+  auto relocated_corpus = SnapRelocator<TypeParam>::RelocateCorpus(
+      std::move(expected), true, &error);
+  ASSERT_EQ(error, SnapRelocatorError::kOk);
+  const Snap<TypeParam>& snap = *relocated_corpus->snaps.at(0);
+  ASSERT_EQ(snap.platform_end_states.size, 1);
+  EXPECT_EQ(snap.EndStateFor(ToInt(other_platform))
+                .registers->gregs.GetStackPointer(),
+            gregs.GetStackPointer());
+  EXPECT_EQ(snap.EndStateFor(ToInt(platform)).registers,
+            snap.end_state_registers);
+  VerifyTestSnap(snapshot, snap, opts);
+  ASSERT_OK_AND_ASSIGN(Snapshot round_trip, SnapToSnapshot(snap, platform));
+  EXPECT_EQ(round_trip, snapified_corpus[0]);
+}
+
+// Test that delta end states only keep changed memory bytes and that the
+// unchanged writable memory is covered by a checksum instead.
+TYPED_TEST(RelocatableSnapGenerator, DeltaEndStateMemoryBytes) {
+  SnapifyOptions opts = SnapifyOptions::V2InputRunOpts(Host::architecture_id);
+  SnapifyOptions delta_opts = opts;
+  delta_opts.delta_end_state_memory_bytes = true;
+
+  std::vector<Snapshot> snapified_corpus;
+  std::vector<Snapshot> delta_corpus;
+  for (int index = 0; index < static_cast<int>(TestSnapshot::kNumTestSnapshot);
+       ++index) {
+    TestSnapshot type = static_cast<TestSnapshot>(index);
+    if (!TestSnapshotExists<TypeParam>(type)) {
+      continue;
+    }
+    Snapshot snapshot = MakeSnapRunnerTestSnapshot<TypeParam>(type);
+    ASSERT_OK_AND_ASSIGN(Snapshot snapified, Snapify(snapshot, opts));
+    ASSERT_OK_AND_ASSIGN(Snapshot delta, Snapify(snapshot, delta_opts));
+    const Snapshot::EndState& end_state = snapified.expected_end_states()[0];
+    const Snapshot::EndState& delta_end_state =
+        delta.expected_end_states()[0];
+    EXPECT_LE(delta_end_state.changed_memory_set().byte_size(),
+              end_state.changed_memory_set().byte_size());
+    snapified_corpus.push_back(std::move(snapified));
+    delta_corpus.push_back(std::move(delta));
+  }
+
+  auto relocated_corpus = GenerateRelocatedCorpus<TypeParam>(snapified_corpus);
+  for (const Snap<TypeParam>* snap : relocated_corpus->snaps) {
+    EXPECT_EQ(snap->end_state_unchanged_memory_checksum, 0);
+  }
+
+  auto relocated_delta_corpus =
+      GenerateRelocatedCorpus<TypeParam>(delta_corpus);
+  bool found_unchanged = false;
+  for (size_t i = 0; i < delta_corpus.size(); ++i) {
+    const Snap<TypeParam>& snap = *relocated_delta_corpus->snaps.at(i);
+    found_unchanged |= snap.end_state_unchanged_memory_checksum != 0;
+    ASSERT_OK_AND_ASSIGN(
+        Snapshot snapshot,
+        SnapToSnapshot(snap, TestSnapshotPlatform<TypeParam>()));
+    EXPECT_EQ(snapshot, delta_corpus[i]);
+  }
+  EXPECT_TRUE(found_unchanged);
+}
+
 }  // namespace
 }  // namespace silifuzz
@@ -15,6 +15,8 @@
 #include "./snap/gen/repeating_byte_runs.h"
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <optional>
 #include <string>
 #include <utility>
@@ -26,6 +28,14 @@
 #include "./common/snapshot.h"
 #include "./util/checks.h"
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+#include "./util/avx.h"
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 namespace silifuzz {
 
 namespace {
@@ -41,8 +51,97 @@ struct ByteRunInfo {
   bool repeating = false;  // whether all bytes are the same.
 };
 
+#if defined(__x86_64__)
+// Scans 64 bytes per iteration using AVX2.
+__attribute__((target("avx2"))) size_t LeadingByteRunSizeAVX2(
+    const uint8_t* data, size_t n) {
+  const __m256i pattern = _mm256_set1_epi8(data[0]);
+  size_t i = 0;
+  for (; i + 2 * sizeof(__m256i) <= n; i += 2 * sizeof(__m256i)) {
+    const __m256i lo = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(data + i));
+    const __m256i hi = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(data + i + sizeof(__m256i)));
+    const uint32_t lo_mask =
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, pattern));
+    const uint32_t hi_mask =
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, pattern));
+    if ((lo_mask & hi_mask) != 0xffffffff) {
+      // Bit k of a mask is set iff byte k matches the pattern.
+      return lo_mask != 0xffffffff
+                 ? i + __builtin_ctz(~lo_mask)
+                 : i + sizeof(__m256i) + __builtin_ctz(~hi_mask);
+    }
+  }
+  if (i + sizeof(__m256i) <= n) {
+    const __m256i v = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(data + i));
+    const uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pattern));
+    if (mask != 0xffffffff) return i + __builtin_ctz(~mask);
+    i += sizeof(__m256i);
+  }
+  while (i < n && data[i] == data[0]) ++i;
+  return i;
+}
+#elif defined(__aarch64__)
+// Scans 32 bytes per iteration using NEON. The block containing the first
+// mismatch and the tail are finished a byte at a time.
+size_t LeadingByteRunSizeNEON(const uint8_t* data, size_t n) {
+  const uint8x16_t pattern = vdupq_n_u8(data[0]);
+  size_t i = 0;
+  for (; i + 2 * sizeof(uint8x16_t) <= n; i += 2 * sizeof(uint8x16_t)) {
+    const uint8x16_t lo = vceqq_u8(vld1q_u8(data + i), pattern);
+    const uint8x16_t hi =
+        vceqq_u8(vld1q_u8(data + i + sizeof(uint8x16_t)), pattern);
+    if (vminvq_u8(vandq_u8(lo, hi)) != 0xff) break;
+  }
+  while (i < n && data[i] == data[0]) ++i;
+  return i;
+}
+#endif
+
 }  // namespace
 
+namespace internal {
+
+size_t LeadingByteRunSizeUnaccelerated(const uint8_t* data, size_t n) {
+  static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+                "Byte index computation assumes little endian");
+  const uint64_t pattern = data[0] * 0x0101010101010101ULL;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    const uint64_t diff = word ^ pattern;
+    // The lowest non-zero byte of `diff` is the first mismatch.
+    if (diff != 0) return i + __builtin_ctzll(diff) / 8;
+  }
+  while (i < n && data[i] == data[0]) ++i;
+  return i;
+}
+
+size_t LeadingByteRunSize(const uint8_t* data, size_t n) {
+  // Most runs in code and random data are shorter than a word. Catch those
+  // before paying for vector setup.
+  if (n >= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data, sizeof(word));
+    const uint64_t diff = word ^ (data[0] * 0x0101010101010101ULL);
+    if (diff != 0) return __builtin_ctzll(diff) / 8;
+  }
+#if defined(__x86_64__)
+  static const bool has_avx2 = HasAVX2();
+  return has_avx2 ? LeadingByteRunSizeAVX2(data, n)
+                  : LeadingByteRunSizeUnaccelerated(data, n);
+#elif defined(__aarch64__)
+  return LeadingByteRunSizeNEON(data, n);
+#else
+  return LeadingByteRunSizeUnaccelerated(data, n);
+#endif
+}
+
+}  // namespace internal
+
 // Split repeating byte runs in `memory_bytes` of size kMinRepeatingByteRunSize
 // or above into their own MemoryBytes objects.
 // Returns a list of memory bytes.
@@ -54,13 +153,9 @@ absl::StatusOr<MemoryBytesList> GetRepeatingByteRuns(
   const ByteData& byte_data = memory_bytes.byte_values();
   while (offset < memory_bytes.num_bytes()) {
     // Find the size of repeating byte run from the current offset.
-    const auto first_byte = byte_data[offset];
-    const size_t max_run_size = memory_bytes.num_bytes() - offset;
-    size_t run_size = 1;
-    while (run_size < max_run_size &&
-           byte_data[offset + run_size] == first_byte) {
-      ++run_size;
-    }
+    size_t run_size = internal::LeadingByteRunSize(
+        reinterpret_cast<const uint8_t*>(byte_data.data()) + offset,
+        memory_bytes.num_bytes() - offset);
 
     if (run_size >= kMinRepeatingByteRunSize) {
       // We can compress this run.
@@ -35,6 +35,21 @@ static constexpr size_t kMinRepeatingByteRunSize = 16;
 static_assert(kMinRepeatingByteRunSize >= kByteRunAlignmentSize &&
               kMinRepeatingByteRunSize % kByteRunAlignmentSize == 0);
 
+namespace internal {
+
+// Returns the length of the longest prefix of `data[0, n)` whose bytes are all
+// equal to `data[0]`. This compares a word at a time and works on any
+// platform. It is exposed for testing and benchmarking.
+//
+// REQUIRES n > 0.
+size_t LeadingByteRunSizeUnaccelerated(const uint8_t* data, size_t n);
+
+// Same as above but uses the widest vector implementation available: AVX2 on
+// x86_64 if the CPU supports it and NEON on aarch64.
+size_t LeadingByteRunSize(const uint8_t* data, size_t n);
+
+}  // namespace internal
+
 // Splits `memory bytes_list` into 8-byte aligned runs of repeating bytes and
 // non repeating bytes.
 //
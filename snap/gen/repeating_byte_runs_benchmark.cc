@@ -0,0 +1,146 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures repeating byte run detection on typical snapshot page contents.
+//
+// To run:
+//
+// bazel run -c opt third_party/silifuzz/snap/gen:repeating_byte_runs_benchmark
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "benchmark/benchmark.h"
+#include "./common/snapshot.h"
+#include "./snap/gen/repeating_byte_runs.h"
+#include "./util/checks.h"
+
+namespace silifuzz {
+namespace {
+
+constexpr size_t kPageSize = 4096;
+constexpr Snapshot::Address kStartAddress = 0x12340000;
+
+// Kinds of page contents.
+enum class PageContents {
+  kZero,    // all zeros, like bss and stack pages.
+  kRandom,  // no runs at all, like code pages.
+  kMixed,   // alternating long runs and short runs of random bytes.
+};
+
+Snapshot::ByteData MakePages(PageContents contents, size_t num_pages) {
+  Snapshot::ByteData data(num_pages * kPageSize, 0);
+  // A simple LCG so that the contents are the same for every run.
+  uint32_t seed = 1;
+  auto next_byte = [&seed]() {
+    seed = seed * 1103515245 + 12345;
+    return static_cast<char>(seed >> 24);
+  };
+  for (size_t i = 0; i < data.size(); ++i) {
+    switch (contents) {
+      case PageContents::kZero:
+        break;
+      case PageContents::kRandom:
+        data[i] = next_byte();
+        break;
+      case PageContents::kMixed:
+        // 192-byte runs of zeros followed by 64 random bytes.
+        if (i % 256 >= 192) data[i] = next_byte();
+        break;
+    }
+  }
+  return data;
+}
+
+void LeadingByteRunSizeLoop(benchmark::State& state, PageContents contents,
+                            size_t (*scan)(const uint8_t*, size_t)) {
+  const Snapshot::ByteData data = MakePages(contents, 1);
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data.data());
+  for (auto _ : state) {
+    // Scan from every aligned offset like GetRepeatingByteRuns() does.
+    for (size_t offset = 0; offset < data.size();) {
+      const size_t run_size = scan(bytes + offset, data.size() - offset);
+      benchmark::DoNotOptimize(run_size);
+      offset += (run_size + kByteRunAlignmentSize - 1) &
+                ~(kByteRunAlignmentSize - 1);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+
+void GetRepeatingByteRunsLoop(benchmark::State& state, PageContents contents) {
+  const Snapshot::MemoryBytes memory_bytes(
+      kStartAddress, MakePages(contents, state.range(0)));
+  for (auto _ : state) {
+    auto runs = GetRepeatingByteRuns(memory_bytes);
+    CHECK_STATUS(runs.status());
+    benchmark::DoNotOptimize(runs);
+  }
+  state.SetBytesProcessed(state.iterations() * memory_bytes.num_bytes());
+}
+
+void BM_LeadingByteRunSizeUnaccelerated_Zero(benchmark::State& state) {
+  LeadingByteRunSizeLoop(state, PageContents::kZero,
+                         internal::LeadingByteRunSizeUnaccelerated);
+}
+BENCHMARK(BM_LeadingByteRunSizeUnaccelerated_Zero);
+
+void BM_LeadingByteRunSize_Zero(benchmark::State& state) {
+  LeadingByteRunSizeLoop(state, PageContents::kZero,
+                         internal::LeadingByteRunSize);
+}
+BENCHMARK(BM_LeadingByteRunSize_Zero);
+
+void BM_LeadingByteRunSizeUnaccelerated_Random(benchmark::State& state) {
+  LeadingByteRunSizeLoop(state, PageContents::kRandom,
+                         internal::LeadingByteRunSizeUnaccelerated);
+}
+BENCHMARK(BM_LeadingByteRunSizeUnaccelerated_Random);
+
+void BM_LeadingByteRunSize_Random(benchmark::State& state) {
+  LeadingByteRunSizeLoop(state, PageContents::kRandom,
+                         internal::LeadingByteRunSize);
+}
+BENCHMARK(BM_LeadingByteRunSize_Random);
+
+void BM_LeadingByteRunSizeUnaccelerated_Mixed(benchmark::State& state) {
+  LeadingByteRunSizeLoop(state, PageContents::kMixed,
+                         internal::LeadingByteRunSizeUnaccelerated);
+}
+BENCHMARK(BM_LeadingByteRunSizeUnaccelerated_Mixed);
+
+void BM_LeadingByteRunSize_Mixed(benchmark::State& state) {
+  LeadingByteRunSizeLoop(state, PageContents::kMixed,
+                         internal::LeadingByteRunSize);
+}
+BENCHMARK(BM_LeadingByteRunSize_Mixed);
+
+void BM_GetRepeatingByteRuns_Zero(benchmark::State& state) {
+  GetRepeatingByteRunsLoop(state, PageContents::kZero);
+}
+BENCHMARK(BM_GetRepeatingByteRuns_Zero)->Range(1, 64);
+
+void BM_GetRepeatingByteRuns_Random(benchmark::State& state) {
+  GetRepeatingByteRunsLoop(state, PageContents::kRandom);
+}
+BENCHMARK(BM_GetRepeatingByteRuns_Random)->Range(1, 64);
+
+void BM_GetRepeatingByteRuns_Mixed(benchmark::State& state) {
+  GetRepeatingByteRunsLoop(state, PageContents::kMixed);
+}
+BENCHMARK(BM_GetRepeatingByteRuns_Mixed)->Range(1, 64);
+
+}  // namespace
+}  // namespace silifuzz
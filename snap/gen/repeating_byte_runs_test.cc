@@ -16,8 +16,11 @@
 
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -184,5 +187,30 @@ TEST(RepeatingByteRuns, IsRepeatingByteRun) {
   ByteData repeating(kMinRepeatingByteRunSize, 'D');
   EXPECT_TRUE(IsRepeatingByteRun(repeating));
 }
+
+TEST(RepeatingByteRuns, LeadingByteRunSize) {
+  // Cover every mismatch position across several vector widths so that both
+  // the vector loops and the scalar tails are exercised.
+  constexpr size_t kMaxSize = 200;
+  std::vector<uint8_t> data(kMaxSize);
+  for (size_t n = 1; n <= kMaxSize; ++n) {
+    for (size_t mismatch = 1; mismatch <= n; ++mismatch) {
+      std::fill(data.begin(), data.begin() + n, 0xa5);
+      if (mismatch < n) data[mismatch] = 0x5a;
+      EXPECT_EQ(internal::LeadingByteRunSizeUnaccelerated(data.data(), n),
+                mismatch)
+          << "n = " << n;
+      EXPECT_EQ(internal::LeadingByteRunSize(data.data(), n), mismatch)
+          << "n = " << n;
+    }
+  }
+
+  // A run is bounded by `n` even if the bytes that follow match.
+  std::fill(data.begin(), data.end(), 0);
+  EXPECT_EQ(internal::LeadingByteRunSize(data.data() + 3, 100), 100);
+  EXPECT_EQ(internal::LeadingByteRunSizeUnaccelerated(data.data() + 3, 100),
+            100);
+}
+
 }  // namespace
 }  // namespace silifuzz
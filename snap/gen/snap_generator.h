@@ -43,12 +43,25 @@ struct SnapifyOptions {
   // Use the end state for this platform.
   PlatformId platform_id = PlatformId::kAny;
 
+  // If true, also keep the complete expected end states of other platforms
+  // that end at the same endpoint. They follow the end state for
+  // `platform_id`, which stays the first one, and become
+  // Snap::platform_end_states so that one corpus serves all platforms.
+  bool keep_platform_end_states = false;
+
   // Use run-length compression for memory byte data.
   bool compress_repeating_bytes = true;
 
   // Keep executable pages uncompressed so they can be mmaped.
   bool support_direct_mmap = false;
 
+  // If true, expected end states only keep the writable memory bytes that
+  // differ from the initial state instead of all of them. The generated Snap
+  // verifies the remaining writable bytes with a checksum, see
+  // Snap::end_state_unchanged_memory_checksum. This shrinks snaps with large
+  // writable mappings that are mostly left unchanged.
+  bool delta_end_state_memory_bytes = false;
+
   // Returns Options for running snapshots produced by V2-style Maker.
   // `arch_id` specified the architecture of the snapshot. The default values
   // for SnapifyOptions may depend on the architecture being targeted.
@@ -84,10 +97,31 @@ absl::Status CanSnapify(const Snapshot &snapshot, const SnapifyOptions &opts);
 // Snap that produces the same result as the 'snapshot'. The conversion
 // includes adding an exit sequence at the end state instruction
 // address and including all writable mapping memory bytes in the end
-// state.
+// state, or only the changed ones with
+// SnapifyOptions::delta_end_state_memory_bytes.
 absl::StatusOr<Snapshot> Snapify(const Snapshot &snapshot,
                                  const SnapifyOptions &opts);
 
+// Like above but consumes `snapshot` instead of copying it. Use this when
+// the input is no longer needed, e.g. when snapifying a snapshot in place.
+absl::StatusOr<Snapshot> Snapify(Snapshot &&snapshot,
+                                 const SnapifyOptions &opts);
+
+// Adds `mapping` and its `memory_bytes` to `snapified`, which must have been
+// Snapify()-ed with `opts`, and keeps it Snapify()-ed. Unlike calling
+// Snapify() again after adding them, this only checks and splits the new
+// memory, so it is cheap for a snapshot that grows a page at a time. The
+// memory bytes may be split differently than by Snapify() at the boundary
+// with adjacent bytes, which is still a valid Snapify()-ed form.
+//
+// REQUIRES: `memory_bytes` is inside `mapping`.
+// Returns a status if the memory cannot be added, in which case `snapified`
+// is left in an undefined state.
+absl::Status SnapifyAddedMemory(Snapshot &snapified,
+                                const Snapshot::MemoryMapping &mapping,
+                                const Snapshot::MemoryBytes &memory_bytes,
+                                const SnapifyOptions &opts);
+
 
 }  // namespace silifuzz
 
@@ -18,6 +18,7 @@
 #include <sys/mman.h>
 
 #include <string>
+#include <utility>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -102,6 +103,18 @@ TEST(SnapGenerator, SnapifyIdempotent) {
   ASSERT_EQ(snapified, snapified2);
 }
 
+TEST(SnapGenerator, SnapifyMove) {
+  Snapshot snapshot = MakeSnapGeneratorTestSnapshot<Host>(
+      SnapGeneratorTestType::kBasicSnapGeneratorTest);
+
+  SnapifyOptions opts =
+      SnapifyOptions::V2InputRunOpts(snapshot.architecture_id());
+  ASSERT_OK_AND_ASSIGN(const Snapshot snapified, Snapify(snapshot, opts));
+  ASSERT_OK_AND_ASSIGN(const Snapshot moved_snapified,
+                       Snapify(std::move(snapshot), opts));
+  ASSERT_EQ(snapified, moved_snapified);
+}
+
 TEST(SnapGenerator, SnapifyMerge) {
   Snapshot original = MakeSnapGeneratorTestSnapshot<Host>(
       SnapGeneratorTestType::kBasicSnapGeneratorTest);
@@ -146,6 +159,46 @@ TEST(SnapGenerator, SnapifyMerge) {
             snapified_modified.memory_mappings());
 }
 
+TEST(SnapGenerator, SnapifyAddedMemory) {
+  Snapshot original = MakeSnapGeneratorTestSnapshot<Host>(
+      SnapGeneratorTestType::kBasicSnapGeneratorTest);
+  SnapifyOptions opts =
+      SnapifyOptions::V2InputRunOpts(original.architecture_id());
+
+  // Arbitrary address that shouldn't collide with the test snapshot.
+  Snapshot::Address aux_data_address = 0x90000000ULL;
+  size_t aux_data_size = 0x2000;
+  ASSERT_EQ(original.PermsAt(aux_data_address), MemoryPerms::None());
+  const Snapshot::MemoryMapping mapping = Snapshot::MemoryMapping::MakeSized(
+      aux_data_address, aux_data_size, MemoryPerms::RW());
+  // A run of zeros followed by literal bytes.
+  std::string data(aux_data_size, '\0');
+  for (size_t i = aux_data_size / 2; i < aux_data_size; ++i) {
+    data[i] = static_cast<char>(i % 251);
+  }
+  const Snapshot::MemoryBytes memory_bytes(aux_data_address, data);
+
+  // Snapify the snapshot with the memory added up front.
+  Snapshot expected = original.Copy();
+  expected.add_memory_mapping(mapping);
+  expected.add_memory_bytes(memory_bytes);
+  ASSERT_OK_AND_ASSIGN(const Snapshot snapified_expected,
+                       Snapify(expected, opts));
+
+  ASSERT_OK_AND_ASSIGN(Snapshot snapified, Snapify(original, opts));
+  ASSERT_OK(SnapifyAddedMemory(snapified, mapping, memory_bytes, opts));
+  EXPECT_EQ(snapified, snapified_expected);
+  EXPECT_EQ(snapified.memory_mappings(), snapified_expected.memory_mappings());
+
+  // Reserved memory cannot be added.
+  EXPECT_THAT(SnapifyAddedMemory(
+                  snapified,
+                  Snapshot::MemoryMapping::MakeSized(0, 0x1000,
+                                                     MemoryPerms::RW()),
+                  Snapshot::MemoryBytes(0, std::string(0x1000, '\0')), opts),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
 TEST(SnapGenerator, CanSnapify) {
   Snapshot snapshot = MakeSnapGeneratorTestSnapshot<Host>(
       SnapGeneratorTestType::kBasicSnapGeneratorTest);
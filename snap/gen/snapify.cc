@@ -22,6 +22,7 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "./common/mapped_memory_map.h"
+#include "./common/memory_bytes_set.h"
 #include "./common/memory_perms.h"
 #include "./common/memory_state.h"
 #include "./common/snapshot.h"
@@ -83,16 +84,17 @@ bool ShouldNeverCompress(const MemoryState &memory_state,
   return false;
 }
 
-// Helper for Snapify(). This normalizes `memory_byte_list` and then
-// breaks list elements into smaller MemoryBytes objects if necessary for
-// run-length compression. Optionally apply run-length compression on byte data.
-// Returns a status to report any errors.
+// Helper for Snapify(). This normalizes the memory bytes of `memory_state` in
+// `bytes` and then breaks list elements into smaller MemoryBytes objects if
+// necessary for run-length compression. Optionally apply run-length
+// compression on byte data. Returns a status to report any errors.
 absl::StatusOr<Snapshot::MemoryBytesList> SnapifyMemoryByteList(
-    const MemoryState &memory_state, CompressionQuery should_compress) {
+    const MemoryState &memory_state, const MemoryBytesSet &bytes,
+    CompressionQuery should_compress) {
   // Normalize memory bytes to ensure all bytes in a MemoryBytes have identical
   // permissions
   Snapshot::MemoryBytesList memory_bytes_list =
-      memory_state.memory_bytes_list(memory_state.written_memory());
+      memory_state.memory_bytes_list(bytes);
   Snapshot::NormalizeMemoryBytes(memory_state.mapped_memory(),
                                  &memory_bytes_list);
 
@@ -115,10 +117,40 @@ absl::StatusOr<Snapshot::MemoryBytesList> SnapifyMemoryByteList(
   return result;
 }
 
+// Unchanged bytes between changed ones are kept in the end state if there are
+// fewer than this many. Checking them directly is cheaper than the overhead
+// of another SnapMemoryBytes.
+constexpr Snapshot::ByteSize kMinUnchangedGap = 64;
+
+// Returns the bytes of `end_state` that differ from `initial_state` for
+// SnapifyOptions::delta_end_state_memory_bytes, with short unchanged gaps
+// between them filled in.
+MemoryBytesSet ChangedMemory(const MemoryState &initial_state,
+                             const Snapshot::EndState &end_state) {
+  MemoryBytesSet changed;
+  for (const Snapshot::MemoryBytes &delta :
+       initial_state.DeltaMemoryBytes(end_state.memory_bytes())) {
+    changed.Add(delta.start_address(), delta.limit_address());
+  }
+  MemoryBytesSet gaps;
+  bool first = true;
+  Snapshot::Address previous_limit = 0;
+  changed.Iterate([&](Snapshot::Address start, Snapshot::Address limit) {
+    if (!first && start - previous_limit < kMinUnchangedGap) {
+      gaps.Add(previous_limit, start);
+    }
+    first = false;
+    previous_limit = limit;
+  });
+  changed.Add(gaps);
+  return changed;
+}
+
 // Transforms the snapshot's MemoryBytes into Snap-compatible format.
 // Specifically, ensures that all MemoryBytes are fragmented according to `opts`
 // in both the Snapshot and all EndStates. Populates all EndStates with all
-// writable bytes from the parent Snapshot.
+// writable bytes from the parent Snapshot, or only with the changed ones if
+// opts.delta_end_state_memory_bytes is set.
 absl::Status SnapifyMemoryBytes(Snapshot &snapshot,
                                 const SnapifyOptions &opts) {
   MemoryState memory_state =
@@ -135,7 +167,8 @@ absl::Status SnapifyMemoryBytes(Snapshot &snapshot,
 
   ASSIGN_OR_RETURN_IF_NOT_OK(
       Snapshot::MemoryBytesList snapified_memory_bytes_list,
-      SnapifyMemoryByteList(memory_state, should_compress_initial));
+      SnapifyMemoryByteList(memory_state, memory_state.written_memory(),
+                            should_compress_initial));
   RETURN_IF_NOT_OK(
       snapshot.ReplaceMemoryBytes(std::move(snapified_memory_bytes_list)));
 
@@ -146,6 +179,10 @@ absl::Status SnapifyMemoryBytes(Snapshot &snapshot,
     if (end_state.IsComplete().ok()) {
       MemoryState memory_state =
           MemoryState::MakeInitial(snapshot, MemoryState::kZeroMappedBytes);
+      MemoryBytesSet changed_memory;
+      if (opts.delta_end_state_memory_bytes) {
+        changed_memory = ChangedMemory(memory_state, end_state);
+      }
       // Apply deltas from the current end state.
       memory_state.SetMemoryBytes(end_state.memory_bytes());
 
@@ -158,11 +195,16 @@ absl::Status SnapifyMemoryBytes(Snapshot &snapshot,
               memory_state.RemoveMemoryMapping(start, limit);
             }
           });
+      MemoryBytesSet end_state_bytes = memory_state.written_memory();
+      if (opts.delta_end_state_memory_bytes) {
+        end_state_bytes.Intersect(changed_memory);
+      }
       ASSIGN_OR_RETURN_IF_NOT_OK(
           Snapshot::MemoryBytesList snapified_end_state_memory_bytes_list,
-          SnapifyMemoryByteList(memory_state, opts.compress_repeating_bytes
-                                                  ? &ShouldAlwaysCompress
-                                                  : &ShouldNeverCompress));
+          SnapifyMemoryByteList(memory_state, end_state_bytes,
+                                opts.compress_repeating_bytes
+                                    ? &ShouldAlwaysCompress
+                                    : &ShouldNeverCompress));
       RETURN_IF_NOT_OK(end_state.ReplaceMemoryBytes(
           std::move(snapified_end_state_memory_bytes_list)));
     } else {
@@ -261,27 +303,106 @@ absl::Status CanSnapify(const Snapshot &snapshot, const SnapifyOptions &opts) {
 
 absl::StatusOr<Snapshot> Snapify(const Snapshot &snapshot,
                                  const SnapifyOptions &opts) {
+  return Snapify(snapshot.Copy(), opts);
+}
+
+absl::StatusOr<Snapshot> Snapify(Snapshot &&snapshot,
+                                 const SnapifyOptions &opts) {
   RETURN_IF_NOT_OK(CanSnapify(snapshot, opts));
 
-  ASSIGN_OR_RETURN_IF_NOT_OK(const Snapshot::EndState *end_state,
+  ASSIGN_OR_RETURN_IF_NOT_OK(const Snapshot::EndState *picked_end_state,
                              PickEndState(snapshot, opts));
-  const Snapshot::Endpoint &endpoint = end_state->endpoint();
+  // Take the end state out before its list is replaced below.
+  Snapshot::EndState end_state = *picked_end_state;
+  const Snapshot::Address endpoint_address =
+      end_state.endpoint().instruction_address();
 
-  Snapshot snapified = snapshot.Copy();
+  Snapshot snapified = std::move(snapshot);
 
   // Make sure adjacent memory mappings are merged.
   snapified.NormalizeMemoryMappings();
 
   // Replace potentially multiple expected end states with just the one for the
-  // requested platform.
-  snapified.set_expected_end_states({*end_state});
+  // requested platform, followed by the other platforms' if requested.
+  Snapshot::EndStateList other_end_states;
+  if (opts.keep_platform_end_states && !opts.allow_undefined_end_state) {
+    for (const Snapshot::EndState &es : snapified.expected_end_states()) {
+      if (es.endpoint() == end_state.endpoint() &&
+          !(es == end_state) && es.IsComplete().ok()) {
+        other_end_states.push_back(es);
+      }
+    }
+  }
+  snapified.set_expected_end_states({});
+  snapified.add_expected_end_state(std::move(end_state));
+  for (Snapshot::EndState &es : other_end_states) {
+    RETURN_IF_NOT_OK(snapified.can_add_expected_end_state(es));
+    snapified.add_expected_end_state(std::move(es));
+  }
 
   RETURN_IF_NOT_OK(ARCH_DISPATCH(MergeExitSequence, snapified.architecture_id(),
-                                 snapified, endpoint.instruction_address()));
+                                 snapified, endpoint_address));
 
   RETURN_IF_NOT_OK(SnapifyMemoryBytes(snapified, opts));
 
   return snapified;
 }
 
+absl::Status SnapifyAddedMemory(Snapshot &snapified,
+                                const Snapshot::MemoryMapping &mapping,
+                                const Snapshot::MemoryBytes &memory_bytes,
+                                const SnapifyOptions &opts) {
+  // The existing mappings passed this check when `snapified` was made.
+  if (OverlapReservedMemoryMappings({mapping})) {
+    return absl::InvalidArgumentError(
+        "memory mapping overlaps reserved memory mappings");
+  }
+  RETURN_IF_NOT_OK(snapified.can_add_memory_mapping(mapping));
+  if (memory_bytes.start_address() < mapping.start_address() ||
+      memory_bytes.limit_address() > mapping.limit_address()) {
+    return absl::InvalidArgumentError(
+        "memory bytes are outside of the added mapping");
+  }
+
+  // The new bytes are in a single mapping and disjoint from all existing
+  // bytes, so they are already normalized and only need splitting into runs
+  // as SnapifyMemoryBytes() would do.
+  const bool executable = mapping.perms().Has(MemoryPerms::kExecutable);
+  Snapshot::MemoryBytesList runs{memory_bytes};
+  if (opts.compress_repeating_bytes &&
+      !(opts.support_direct_mmap && executable)) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(runs, GetRepeatingByteRuns(memory_bytes));
+  }
+  snapified.add_memory_mapping(mapping);
+  for (const Snapshot::MemoryBytes &run : runs) {
+    RETURN_IF_NOT_OK(snapified.can_add_memory_bytes(run));
+    snapified.add_memory_bytes(run);
+  }
+
+  // Complete end states include all writable bytes.
+  if (mapping.perms().Has(MemoryPerms::kWritable)) {
+    Snapshot::MemoryBytesList end_state_runs{memory_bytes};
+    if (opts.compress_repeating_bytes) {
+      ASSIGN_OR_RETURN_IF_NOT_OK(end_state_runs,
+                                 GetRepeatingByteRuns(memory_bytes));
+    }
+    Snapshot::EndStateList end_states = snapified.expected_end_states();
+    snapified.set_expected_end_states({});
+    for (Snapshot::EndState &end_state : end_states) {
+      if (end_state.IsComplete().ok()) {
+        for (const Snapshot::MemoryBytes &run : end_state_runs) {
+          RETURN_IF_NOT_OK(end_state.can_add_memory_bytes(run));
+          end_state.add_memory_bytes(run);
+        }
+      }
+      RETURN_IF_NOT_OK(snapified.can_add_expected_end_state(end_state));
+      snapified.add_expected_end_state(end_state);
+    }
+  }
+
+  // Merge the new mapping with adjacent ones like Snapify() does.
+  snapified.NormalizeMemoryMappings();
+  return absl::OkStatus();
+}
+
 }  // namespace silifuzz
@@ -60,8 +60,10 @@ struct SnapArray {
 struct SnapMemoryBytes {
   // Flags
   enum {
-    kRepeating = 1 << 0,  // If set, memory bytes are repeating. This
-                          // determines how data below are interpreted.
+    kRepeating = 1 << 0,   // If set, memory bytes are repeating. This
+                           // determines how data below are interpreted.
+    kCompressed = 1 << 1,  // If set, byte_values are LZ4 block compressed.
+                           // See compressed_size below.
   };
 
   // If memory bytes are all the same value, they are stored as
@@ -74,6 +76,9 @@ struct SnapMemoryBytes {
   // Tells if memory bytes are repeating.
   bool repeating() const { return (flags & kRepeating) != 0; }
 
+  // Tells if byte_values are compressed. Never true if repeating.
+  bool compressed() const { return (flags & kCompressed) != 0; }
+
   // Returns byte size of the memory bytes.
   size_t size() const {
     return repeating() ? data.byte_run.size : data.byte_values.size;
@@ -85,6 +90,10 @@ struct SnapMemoryBytes {
   // Flags
   uint8_t flags = 0;
 
+  // Size of the LZ4 block at byte_values.elements if compressed() is true.
+  // byte_values.size is the uncompressed size in that case. Zero otherwise.
+  uint32_t compressed_size = 0;
+
   union {
     // The memory byte values to exist at start_address. This is set only when
     // repeating == false.
@@ -125,6 +134,21 @@ struct SnapMemoryMapping {
   SnapArray<SnapMemoryBytes> memory_bytes;
 };
 
+// An expected end state of a Snap that applies only to some platforms, see
+// Snap::platform_end_states. The fields are as the end_state_* fields of Snap.
+template <typename Arch>
+struct SnapEndState {
+  // Bit i is set iff this is the expected end state on the platform with
+  // PlatformId value i.
+  uint64_t platforms;
+
+  UContext<Arch>* registers;
+  SnapArray<SnapMemoryBytes> memory_bytes;
+  RegisterChecksum<Arch> register_checksum;
+  uint32_t registers_memory_checksum;
+  uint32_t unchanged_memory_checksum;
+};
+
 // A simplified snapshot representation.
 template <typename Arch>
 struct Snap {
@@ -148,8 +172,8 @@ struct Snap {
   // The state of the registers at the start of the snapshot.
   RegisterState* registers;
 
-  // The only possible expected end-state of executing the snapshot.
-  // We do not allow multiple end states.
+  // The expected end-state of executing the snapshot on platforms that have
+  // no entry in `platform_end_states`. All end states share the end point.
 
   // For now, we only support snapshots ending at instructions.
   uint64_t end_state_instruction_address;
@@ -157,15 +181,25 @@ struct Snap {
   // The expected state of the registers to exist at `endpoint`.
   RegisterState* end_state_registers;
 
-  // The expected memory state to exist at `endpoint`.
-  // These must cover all writable memory bytes not just deltas compared to
-  // the initial memory state.  This representation is optimized for checking
-  // memory writable by a snapshot.
-  //
-  // TODO(dougkwan): [as-needed] We may support other modes of memory checking
-  // like just checking only the memory that a snapshot changes.
+  // The expected memory state to exist at `endpoint`, sorted by address.
+  // These cover all writable memory bytes, or only those that differ from
+  // the initial memory state if the snapshot was Snapify()-ed with
+  // SnapifyOptions::delta_end_state_memory_bytes.
   SnapArray<SnapMemoryBytes> end_state_memory_bytes;
 
+  // Checksum of the writable memory bytes not covered by
+  // `end_state_memory_bytes`, which must be unchanged at `endpoint`. The bytes
+  // are checksummed in address order as if they were contiguous, so the
+  // checksum is 0 if `end_state_memory_bytes` cover all writable memory.
+  uint32_t end_state_unchanged_memory_checksum;
+
+  // Register groups that the code of this snap may access, as the low 32 bits
+  // of a serialized RegisterGroupSet<Arch>. Only groups that matter for
+  // scheduling snaps are recorded, currently AVX-512 on x86-64. 0 if the
+  // corpus generator did not classify the snap. This field occupies what used
+  // to be padding, so older corpora read as unclassified.
+  uint32_t code_register_groups;
+
   // Checksum for registers that are not fully recorded at the end of
   // execution.  If register group set of the checksum is empty, the checksum
   // is ignored.
@@ -180,6 +214,31 @@ struct Snap {
   // efficient, focused integrity check after snap execution fails.
   uint32_t registers_memory_checksum;
   uint32_t end_state_registers_memory_checksum;
+
+  // End states of platforms on which the end state differs from the one
+  // above. Empty in corpora made for a single platform. This lets a single
+  // corpus serve all platforms, as code, initial memory and registers are the
+  // same on all of them.
+  SnapArray<SnapEndState<Arch>> platform_end_states;
+
+  // Returns the expected end state on the platform with PlatformId value
+  // `platform_id`. The `platforms` field of the result is unspecified.
+  SnapEndState<Arch> EndStateFor(int platform_id) const {
+    if (platform_id >= 0 && platform_id < 64) {
+      const uint64_t platform_bit = uint64_t{1} << platform_id;
+      for (const SnapEndState<Arch>& end_state : platform_end_states) {
+        if ((end_state.platforms & platform_bit) != 0) return end_state;
+      }
+    }
+    return SnapEndState<Arch>{
+        .platforms = 0,
+        .registers = end_state_registers,
+        .memory_bytes = end_state_memory_bytes,
+        .register_checksum = end_state_register_checksum,
+        .registers_memory_checksum = end_state_registers_memory_checksum,
+        .unchanged_memory_checksum = end_state_unchanged_memory_checksum,
+    };
+  }
 };
 
 namespace snap_internal {
@@ -229,8 +288,55 @@ struct SnapCorpusHeader {
   // The runner should check that this equals Host::architecture_id.
   uint8_t architecture_id;
 
+  // Version of the corpus data format. Corpora that do not use any
+  // features of later versions use version 0 for compatibility with older
+  // runners.
+  uint8_t format_version;
+
+  // Make the unused space in this struct explicit.
+  uint8_t padding[2];
+};
+
+// Corpus format versions. Each version adds one feature.
+// Version 1 adds compressed SnapMemoryBytes.
+constexpr uint8_t kSnapCorpusCompressedFormatVersion = 1;
+constexpr uint8_t kSnapCorpusLatestFormatVersion =
+    kSnapCorpusCompressedFormatVersion;
+
+// An executable memory mapping of a Snap in a corpus, used by
+// SnapCorpus::code_index to find Snaps by code address.
+struct SnapCodeInterval {
+  // Address range [start_address, limit_address) of the mapping.
+  uint64_t start_address;
+  uint64_t limit_address;
+
+  // Largest limit_address of this and all preceding intervals in the index.
+  // This bounds how far back a lookup has to scan for overlapping intervals.
+  uint64_t max_limit_address;
+
+  // Index of the Snap owning the mapping in SnapCorpus::snaps.
+  uint32_t snap_index;
+
   // Make the unused space in this struct explicit.
-  uint8_t padding[3];
+  uint32_t padding;
+};
+
+// What the runner reads every time it executes a Snap, packed contiguously in
+// SnapCorpus::hot_entries so that scheduling a Snap touches a few cache lines
+// instead of chasing pointers through the Snap and all its mappings.
+template <typename Arch>
+struct SnapHotEntry {
+  // Same as Snap::registers.
+  const UContext<Arch>* registers;
+
+  // Copies of the SnapMemoryBytes of all writable mappings of the Snap in
+  // mapping order. These are what the runner restores before an execution.
+  // Byte data is shared with the mappings.
+  SnapArray<SnapMemoryBytes> writable_memory_bytes;
+
+  // Total size of the writable mappings of the Snap. All of it is verified
+  // after an execution, see Snap::end_state_unchanged_memory_checksum.
+  uint64_t writable_num_bytes;
 };
 
 template <typename Arch>
@@ -241,19 +347,125 @@ struct SnapCorpus {
   // The corpus data.
   SnapArray<const Snap<Arch>*> snaps;
 
+  // Indices into snaps[] sorted by Snap id in strcmp() order. Snaps with equal
+  // ids appear in corpus order. This is either empty or has exactly as many
+  // elements as snaps[]; if empty, Find() falls back to a linear scan.
+  SnapArray<uint32_t> id_index;
+
+  // Executable memory mappings of all Snaps sorted by start address, then by
+  // snap index. If empty, FindByCodeAddress() falls back to a linear scan.
+  SnapArray<SnapCodeInterval> code_index;
+
+  // Hot metadata of the Snaps, hot_entries[i] belongs to snaps[i]. Entries of
+  // all Snaps are adjacent and their writable memory bytes follow in the same
+  // order. This is either empty or has exactly as many elements as snaps[];
+  // if empty, the runner reads the Snaps directly.
+  SnapArray<SnapHotEntry<Arch>> hot_entries;
+
   bool IsExpectedArch() const {
     return header.architecture_id == static_cast<int>(Arch::architecture_id);
   }
 
+  // Find the index in snaps[] of a Snap with the specified id. If there are
+  // multiple Snaps with the same id, returns the first one in corpus order.
+  // Snaps are accessed through `snap_at(i)`, which returns snaps[i] or nullptr
+  // to abort the search, see SnapRelocator::GetSnap().
+  // Returns snaps.size if not found.
+  template <typename SnapAt>
+  size_t FindIndex(const char* id, SnapAt snap_at) const {
+    if (id_index.size != snaps.size) {
+      for (size_t i = 0; i < snaps.size; ++i) {
+        const Snap<Arch>* snap = snap_at(i);
+        if (snap == nullptr) return snaps.size;
+        if (strcmp(snap->id, id) == 0) {
+          return i;
+        }
+      }
+      return snaps.size;
+    }
+
+    // Lower bound binary search over id_index.
+    size_t low = 0, high = id_index.size;
+    while (low < high) {
+      const size_t mid = low + (high - low) / 2;
+      const Snap<Arch>* snap = snap_at(id_index[mid]);
+      if (snap == nullptr) return snaps.size;
+      if (strcmp(snap->id, id) < 0) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    if (low < id_index.size) {
+      const Snap<Arch>* snap = snap_at(id_index[low]);
+      if (snap != nullptr && strcmp(snap->id, id) == 0) {
+        return id_index[low];
+      }
+    }
+    return snaps.size;
+  }
+
+  size_t FindIndex(const char* id) const {
+    return FindIndex(id, [this](size_t i) { return snaps[i]; });
+  }
+
   // Find a Snap with the specified id.
   // Returns nullptr if not found.
   const Snap<Arch>* Find(const char* id) const {
-    for (const Snap<Arch>* snap : snaps) {
-      if (strcmp(snap->id, id) == 0) {
-        return snap;
+    const size_t index = FindIndex(id);
+    return index < snaps.size ? snaps[index] : nullptr;
+  }
+
+  // Find the index in snaps[] of the first Snap in corpus order that has an
+  // executable memory mapping containing `address`. Snaps are accessed
+  // through `snap_at(i)` as in FindIndex() above.
+  // Returns snaps.size if not found.
+  template <typename SnapAt>
+  size_t FindIndexByCodeAddress(uint64_t address, SnapAt snap_at) const {
+    if (code_index.size == 0) {
+      for (size_t i = 0; i < snaps.size; ++i) {
+        const Snap<Arch>* snap = snap_at(i);
+        if (snap == nullptr) return snaps.size;
+        for (const SnapMemoryMapping& mapping : snap->memory_mappings) {
+          if ((mapping.perms & PROT_EXEC) != 0 &&
+              address >= mapping.start_address &&
+              address - mapping.start_address < mapping.num_bytes) {
+            return i;
+          }
+        }
+      }
+      return snaps.size;
+    }
+
+    // Find the number of intervals starting at or below `address`.
+    size_t low = 0, high = code_index.size;
+    while (low < high) {
+      const size_t mid = low + (high - low) / 2;
+      if (code_index[mid].start_address <= address) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+
+    // Scan back while earlier intervals may still reach `address`.
+    size_t best = snaps.size;
+    for (size_t i = low; i > 0 && code_index[i - 1].max_limit_address > address;
+         --i) {
+      const SnapCodeInterval& interval = code_index[i - 1];
+      if (interval.limit_address > address && interval.snap_index < best) {
+        best = interval.snap_index;
       }
     }
-    return nullptr;
+    return best;
+  }
+
+  // Find the first Snap in corpus order that has an executable memory mapping
+  // containing `address`. Returns nullptr if not found.
+  const Snap<Arch>* FindByCodeAddress(uint64_t address) const {
+    const size_t index = FindIndexByCodeAddress(
+        address, [this](size_t i) { return snaps[i]; });
+    return index < snaps.size ? snaps[index] : nullptr;
   }
 };
 
@@ -28,6 +28,10 @@ void MemoryChecksumCalculator::AddData(const void* data, size_t size) {
   checksum_ = crc32c(checksum_, bytes, size);
 }
 
+void MemoryChecksumCalculator::AddChecksum(uint32_t checksum, size_t size) {
+  checksum_ = crc32c_combine(checksum_, checksum, size);
+}
+
 uint32_t CalculateMemoryChecksum(const void* data, size_t size) {
   MemoryChecksumCalculator checksum;
   checksum.AddData(data, size);
@@ -69,4 +73,9 @@ void CorpusChecksumCalculator::AddData(const void* data, size_t size) {
   corpus_offset_ += size;
 }
 
+void CorpusChecksumCalculator::AddChecksum(uint32_t checksum, size_t size) {
+  checksum_ = crc32c_combine(checksum_, checksum, size);
+  corpus_offset_ += size;
+}
+
 }  // namespace silifuzz
@@ -29,6 +29,10 @@ class MemoryChecksumCalculator {
   MemoryChecksumCalculator() : checksum_(0) {}
   void AddData(const void* data, size_t size);
   void AddData(absl::string_view data) { AddData(data.data(), data.size()); }
+
+  // Adds `size` bytes whose checksum is `checksum` without reading them.
+  void AddChecksum(uint32_t checksum, size_t size);
+
   uint32_t Checksum() const { return checksum_; }
 
  private:
@@ -55,6 +59,12 @@ class CorpusChecksumCalculator {
   CorpusChecksumCalculator() : corpus_offset_(0), checksum_(0) {}
   void AddData(const void* data, size_t size);
   void AddData(absl::string_view data) { AddData(data.data(), data.size()); }
+
+  // Adds `size` bytes whose memory checksum is `checksum` without reading
+  // them. This lets a generator checksum data while writing it.
+  // REQUIRES: the bytes are after the checksum field of the corpus header.
+  void AddChecksum(uint32_t checksum, size_t size);
+
   uint32_t Checksum() const { return checksum_; }
 
  private:
@@ -102,5 +102,36 @@ TEST(SnapChecksumTest, ChecksumCorpusChunked) {
   }
 }
 
+TEST(SnapChecksumTest, MemoryAddChecksum) {
+  absl::string_view data = "Split anywhere, the checksum stays the same.";
+  const uint32_t checksum = CalculateMemoryChecksum(data.data(), data.size());
+  for (size_t i = 0; i <= data.size(); ++i) {
+    MemoryChecksumCalculator calculator;
+    calculator.AddChecksum(CalculateMemoryChecksum(data.data(), i), i);
+    calculator.AddChecksum(
+        CalculateMemoryChecksum(data.data() + i, data.size() - i),
+        data.size() - i);
+    EXPECT_EQ(calculator.Checksum(), checksum) << i;
+  }
+}
+
+TEST(SnapChecksumTest, CorpusAddChecksum) {
+  absl::string_view data =
+      "Blah blah blah needs to be big enough to be interesting so I'll keep "
+      "typing on and on and on...";
+  const uint32_t checksum = ChecksumCorpusChunked(data, data.size());
+
+  // Checksumming the tail separately gives the same corpus checksum.
+  for (size_t i = offsetof(SnapCorpusHeader, num_bytes); i <= data.size();
+       ++i) {
+    CorpusChecksumCalculator calculator;
+    calculator.AddData(data.substr(0, i));
+    calculator.AddChecksum(CalculateMemoryChecksum(data.data() + i,
+                                                   data.size() - i),
+                           data.size() - i);
+    EXPECT_EQ(calculator.Checksum(), checksum) << i;
+  }
+}
+
 }  // namespace
 }  // namespace silifuzz
@@ -19,6 +19,7 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <cstdint>
 #include <cstdio>
 #include <memory>
 #include <utility>
@@ -28,17 +29,62 @@
 #include "./util/checks.h"
 #include "./util/itoa.h"
 #include "./util/misc_util.h"
+#include "./util/page_util.h"
 
 namespace silifuzz {
 
+namespace {
+
+// Size of a PMD-mapped transparent huge page with 4K base pages.
+constexpr uintptr_t kHugePageSize = 2 << 20;
+
+// Maps `file_size` bytes of `fd` privately at a kHugePageSize-aligned address
+// and advises the kernel to back the mapping with huge pages. If the file's
+// page cache uses huge pages, e.g. a memfd populated through a MADV_HUGEPAGE
+// mapping, read-only parts of the corpus can then be mapped with huge pages,
+// which reduces TLB misses when the runner reads corpus data. This is harmless
+// otherwise.
+void* MapCorpusFile(int fd, off_t file_size, bool preload) {
+  // Over-reserve address space and trim it down to an aligned range.
+  const uintptr_t reserved_size = file_size + kHugePageSize;
+  void* reserved = mmap(nullptr, reserved_size, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  CHECK_NE(reserved, MAP_FAILED);
+  const uintptr_t reserved_start = AsInt(reserved);
+  const uintptr_t reserved_limit = reserved_start + reserved_size;
+  const uintptr_t start =
+      RoundUpToPageAlignment(reserved_start, kHugePageSize);
+  const uintptr_t limit = RoundUpToPageAlignment(start + file_size);
+
+  void* relocatable =
+      mmap(AsPtr(start), file_size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_FIXED | (preload ? MAP_POPULATE : 0), fd, 0);
+  CHECK_EQ(relocatable, AsPtr(start));
+  if (start > reserved_start) {
+    CHECK_EQ(munmap(reserved, start - reserved_start), 0);
+  }
+  if (reserved_limit > limit) {
+    CHECK_EQ(munmap(AsPtr(limit), reserved_limit - limit), 0);
+  }
+
+  // This only fails if the kernel does not support transparent huge pages,
+  // which is not an error.
+  madvise(relocatable, file_size, MADV_HUGEPAGE);
+  return relocatable;
+}
+
+}  // namespace
+
 template <typename Arch>
 MmappedMemoryPtr<const SnapCorpus<Arch>> LoadCorpusFromFile(
-    const char* filename, bool preload, bool verify, int* corpus_fd) {
+    const char* filename, bool preload, bool verify, int* corpus_fd,
+    uintptr_t load_address, bool lazy_relocation) {
   // MAP_POPULATE interferes with memory sharing. Using it causes read
   // only portion of a corpus to be copied in each runner.
   constexpr char kProcPrefix[] = "/proc/";
   constexpr char kDevShmPrefix[] = "/dev/shm/";
-  if (strncmp(filename, kProcPrefix, strlen(kProcPrefix)) == 0 ||
+  if (lazy_relocation ||
+      strncmp(filename, kProcPrefix, strlen(kProcPrefix)) == 0 ||
       strncmp(filename, kDevShmPrefix, strlen(kDevShmPrefix)) == 0) {
     preload = false;
   }
@@ -51,16 +97,38 @@ MmappedMemoryPtr<const SnapCorpus<Arch>> LoadCorpusFromFile(
   off_t file_size = lseek(fd, 0, SEEK_END);
   CHECK_NE(file_size, -1);
   VLOG_INFO(1, "Corpus size (bytes) ", IntStr(file_size));
-  void* relocatable = mmap(nullptr, file_size, PROT_READ | PROT_WRITE,
-                           MAP_PRIVATE | (preload ? MAP_POPULATE : 0), fd, 0);
-  CHECK_NE(relocatable, MAP_FAILED);
-  VLOG_INFO(1, "Mapped corpus at ", HexStr(AsInt(relocatable)));
-  auto mapped = MakeMmappedMemoryPtr<char>(reinterpret_cast<char*>(relocatable),
-                                           file_size);
 
   SnapRelocatorError error;
-  MmappedMemoryPtr<const SnapCorpus<Arch>> corpus =
-      SnapRelocator<Arch>::RelocateCorpus(std::move(mapped), verify, &error);
+  MmappedMemoryPtr<const SnapCorpus<Arch>> corpus;
+  if (load_address != 0) {
+    // Try to use the pre-relocated image in place. Unlike MAP_FIXED,
+    // MAP_FIXED_NOREPLACE never clobbers existing mappings. Kernels not
+    // knowing the flag treat the address as a hint, which is caught below.
+    void* shared = mmap(AsPtr(load_address), file_size, PROT_READ,
+                        MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    if (shared == AsPtr(load_address)) {
+      VLOG_INFO(1, "Mapped shared relocated corpus at ", HexStr(load_address));
+      corpus = SnapRelocator<Arch>::AdoptRelocatedCorpus(
+          MakeMmappedMemoryPtr<char>(reinterpret_cast<char*>(shared),
+                                     file_size),
+          verify, &error);
+    } else if (shared != MAP_FAILED) {
+      CHECK_EQ(munmap(shared, file_size), 0);
+    }
+  }
+  if (corpus == nullptr) {
+    void* relocatable = MapCorpusFile(fd, file_size, preload);
+    VLOG_INFO(1, "Mapped corpus at ", HexStr(AsInt(relocatable)));
+    auto mapped = MakeMmappedMemoryPtr<char>(
+        reinterpret_cast<char*>(relocatable), file_size);
+    if (lazy_relocation && load_address == 0) {
+      corpus = SnapRelocator<Arch>::RelocateCorpusLazily(std::move(mapped),
+                                                         verify, &error);
+    } else {
+      corpus = SnapRelocator<Arch>::RelocateCorpus(std::move(mapped), verify,
+                                                   &error, load_address);
+    }
+  }
   CHECK(error == SnapRelocatorError::kOk);
   VLOG_INFO(1, "Corpus size (snapshots) ", IntStr(corpus->snaps.size));
 
@@ -74,11 +142,13 @@ MmappedMemoryPtr<const SnapCorpus<Arch>> LoadCorpusFromFile(
 }
 
 template MmappedMemoryPtr<const SnapCorpus<X86_64>> LoadCorpusFromFile<X86_64>(
-    const char* filename, bool preload, bool verify, int* corpus_fd);
+    const char* filename, bool preload, bool verify, int* corpus_fd,
+    uintptr_t load_address, bool lazy_relocation);
 
 template MmappedMemoryPtr<const SnapCorpus<AArch64>>
 LoadCorpusFromFile<AArch64>(const char* filename, bool preload, bool verify,
-                            int* corpus_fd);
+                            int* corpus_fd, uintptr_t load_address,
+                            bool lazy_relocation);
 
 ArchitectureId CorpusFileArchitecture(const char* filename) {
   ArchitectureId arch = ArchitectureId::kUndefined;
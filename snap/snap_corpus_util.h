@@ -15,6 +15,8 @@
 #ifndef THIRD_PARTY_SILIFUZZ_SNAP_SNAP_CORPUS_UTIL_H_
 #define THIRD_PARTY_SILIFUZZ_SNAP_SNAP_CORPUS_UTIL_H_
 
+#include <cstdint>
+
 #include "./snap/snap.h"
 #include "./util/mmapped_memory_ptr.h"
 
@@ -27,10 +29,20 @@ namespace silifuzz {
 // except for files in /proc and /dev/shm.
 // When `corpus_fd` is not NULL, passes ownership of the corpus FD to the caller
 // rather than closing it.
+// When `load_address` is not 0, the file is expected to contain a corpus
+// already relocated to `load_address`, e.g. by an orchestrator sharing one
+// relocated corpus between runners. The file is then mapped shared and
+// read-only at that address so that all runners use the same physical pages.
+// If the address is not available, the file is mapped privately elsewhere and
+// relocated from `load_address`.
+// When `lazy_relocation` is true and the corpus needs relocation, Snaps are
+// relocated on first use, see SnapRelocator::RelocateCorpusLazily(). This
+// disables preloading, which would copy the whole corpus.
 template <typename Arch>
 MmappedMemoryPtr<const SnapCorpus<Arch>> LoadCorpusFromFile(
     const char* filename, bool preload = true, bool verify = true,
-    int* corpus_fd = nullptr);
+    int* corpus_fd = nullptr, uintptr_t load_address = 0,
+    bool lazy_relocation = false);
 
 // Snoop the file on disk to determine which architecture it is for.
 ArchitectureId CorpusFileArchitecture(const char* filename);
@@ -14,6 +14,7 @@
 
 #include "./snap/snap_corpus_util.h"
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
@@ -24,8 +25,12 @@
 #include "./common/snapshot.h"
 #include "./snap/gen/relocatable_snap_generator.h"
 #include "./snap/gen/snap_generator.h"
+#include "./snap/snap.h"
+#include "./snap/snap_checksum.h"
+#include "./snap/snap_relocator.h"
 #include "./snap/testing/snap_test_snapshots.h"
 #include "./snap/testing/snap_test_types.h"
+#include "./util/arch.h"
 #include "./util/file_util.h"
 #include "./util/mmapped_memory_ptr.h"
 #include "./util/path_util.h"
@@ -60,6 +65,55 @@ TEST(SnapCorpusUtilTest, LoadCorpusFromFile) {
   EXPECT_EQ(loaded_corpus->snaps.at(0)->id, snapified_corpus[0].id());
 }
 
+TEST(SnapCorpusUtilTest, LoadRelocatedCorpusFromFile) {
+  std::vector<Snapshot> snapified_corpus;
+  {
+    Snapshot snapshot =
+        MakeSnapRunnerTestSnapshot<Host>(TestSnapshot::kEndsAsExpected);
+    SnapifyOptions opts =
+        SnapifyOptions::V2InputRunOpts(snapshot.architecture_id());
+    ASSERT_OK_AND_ASSIGN(Snapshot snapified, Snapify(snapshot, opts));
+    snapified_corpus.emplace_back(std::move(snapified));
+  }
+
+  // Relocate the corpus in memory and save the relocated image with an updated
+  // checksum, like the orchestrator does for shared corpora.
+  std::string contents;
+  uintptr_t load_address;
+  {
+    SnapRelocatorError error;
+    MmappedMemoryPtr<const SnapCorpus<Host>> relocated =
+        SnapRelocator<Host>::RelocateCorpus(
+            GenerateRelocatableSnaps(Host::architecture_id, snapified_corpus),
+            /* verify = */ true, &error);
+    ASSERT_TRUE(error == SnapRelocatorError::kOk);
+    load_address = reinterpret_cast<uintptr_t>(relocated.get());
+    contents.assign(reinterpret_cast<const char*>(relocated.get()),
+                    MmappedMemorySize(relocated));
+  }
+  CorpusChecksumCalculator checksum;
+  checksum.AddData(contents);
+  reinterpret_cast<SnapCorpusHeader*>(contents.data())->checksum =
+      checksum.Checksum();
+  auto tmpfile = CreateTempFile(
+      UnitTest::GetInstance()->current_test_info()->test_case_name());
+  ASSERT_TRUE(SetContents(*tmpfile, contents));
+
+  // The address has been unmapped above, so the file is mapped there.
+  auto shared_corpus = LoadCorpusFromFile<Host>(
+      tmpfile->c_str(), false, true, nullptr, load_address);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(shared_corpus.get()), load_address);
+  ASSERT_EQ(shared_corpus->snaps.size, 1);
+  EXPECT_EQ(shared_corpus->snaps.at(0)->id, snapified_corpus[0].id());
+
+  // The address is now taken, so the file is relocated elsewhere.
+  auto private_corpus = LoadCorpusFromFile<Host>(
+      tmpfile->c_str(), false, true, nullptr, load_address);
+  EXPECT_NE(reinterpret_cast<uintptr_t>(private_corpus.get()), load_address);
+  ASSERT_EQ(private_corpus->snaps.size, 1);
+  EXPECT_EQ(private_corpus->snaps.at(0)->id, snapified_corpus[0].id());
+}
+
 TEST(SnapCorpusUtilTest, LoadEmptyCorpus) {
   std::vector<Snapshot> snapified_corpus;
   MmappedMemoryPtr<char> buffer =
@@ -112,11 +112,13 @@ template <typename Arch>
 template <typename T>
 SnapRelocatorError SnapRelocator<Arch>::AdjustPointer(T*& ptr) {
   // A pointer in a relocatable Snap corpus offset is just offset from the
-  // start of the corpus. The actual run time address of the pointed object
-  // is recovered by simply adding the start address of the corpus.
-  uintptr_t adjusted_address;
-  if (__builtin_add_overflow(start_address_, reinterpret_cast<uintptr_t>(ptr),
-                             &adjusted_address)) {
+  // nominal load address of the corpus. The actual run time address of the
+  // pointed object is recovered by adding the offset to the start address of
+  // the corpus.
+  uintptr_t offset, adjusted_address;
+  if (__builtin_sub_overflow(reinterpret_cast<uintptr_t>(ptr), nominal_address_,
+                             &offset) ||
+      __builtin_add_overflow(start_address_, offset, &adjusted_address)) {
     return SnapRelocatorError::kOutOfBound;
   }
   RETURN_IF_RELOCATION_FAILED(ValidateRelocatedAddress<T>(adjusted_address));
@@ -155,19 +157,32 @@ SnapRelocatorError SnapRelocator<Arch>::AdjustArray(SnapArray<T>& array) {
 
 template <typename Arch>
 SnapRelocatorError SnapRelocator<Arch>::RelocateMemoryBytesArray(
-    SnapArray<SnapMemoryBytes>& memory_bytes_array) {
+    SnapArray<SnapMemoryBytes>& memory_bytes_array, bool allow_compressed) {
   RETURN_IF_RELOCATION_FAILED(AdjustArray(memory_bytes_array));
   for (SnapMemoryBytes& memory_byte : RelocationIterator(memory_bytes_array)) {
-    if (!memory_byte.repeating()) {
-      RETURN_IF_RELOCATION_FAILED(
-          AdjustPointer(memory_byte.data.byte_values.elements));
+    if (memory_byte.repeating()) continue;
+    RETURN_IF_RELOCATION_FAILED(
+        AdjustPointer(memory_byte.data.byte_values.elements));
+    if (memory_byte.compressed()) {
+      if (!allow_compressed) return SnapRelocatorError::kBadData;
+      // The whole compressed block must be within the corpus as the runner
+      // decompresses it without further checks.
+      uintptr_t address_after_last_byte;
+      if (__builtin_add_overflow(
+              reinterpret_cast<uintptr_t>(
+                  read_once(memory_byte.data.byte_values.elements)),
+              read_once(memory_byte.compressed_size),
+              &address_after_last_byte) ||
+          address_after_last_byte > limit_address_) {
+        return SnapRelocatorError::kOutOfBound;
+      }
     }
   }
   return SnapRelocatorError::kOk;
 }
 
 template <typename Arch>
-SnapRelocatorError SnapRelocator<Arch>::RelocateCorpus(bool verify) {
+SnapRelocatorError SnapRelocator<Arch>::CheckHeader(bool verify) {
   // We know the pointer is in bounds, but check that the struct fits in memory
   // and is aligned.
   RETURN_IF_RELOCATION_FAILED(
@@ -186,6 +201,10 @@ SnapRelocatorError SnapRelocator<Arch>::RelocateCorpus(bool verify) {
   if (corpus.header.header_size != sizeof(SnapCorpusHeader)) {
     return SnapRelocatorError::kBadData;
   }
+  // Corpora from a newer generator may use features we do not understand.
+  if (corpus.header.format_version > kSnapCorpusLatestFormatVersion) {
+    return SnapRelocatorError::kBadData;
+  }
   // If the corpus file isn't the same number of bytes it was when it was
   // created, it likely is corrupt.
   if (corpus.header.num_bytes != limit_address_ - start_address_) {
@@ -220,31 +239,156 @@ SnapRelocatorError SnapRelocator<Arch>::RelocateCorpus(bool verify) {
       sizeof(typename Snap<Arch>::RegisterState)) {
     return SnapRelocatorError::kBadData;
   }
+  return SnapRelocatorError::kOk;
+}
 
-  RETURN_IF_RELOCATION_FAILED(AdjustArray(corpus.snaps));
-  for (const Snap<Arch>*& snap_ptr : RelocationIterator(corpus.snaps)) {
-    // Adjust the pointer in the array.
-    RETURN_IF_RELOCATION_FAILED(AdjustPointer(snap_ptr));
-
-    // Adjust pointers in this Snap.
-    Snap<Arch>& snap = *const_cast<Snap<Arch>*>(read_once(snap_ptr));
-    RETURN_IF_RELOCATION_FAILED(AdjustPointer(snap.id));
-
-    RETURN_IF_RELOCATION_FAILED(AdjustArray(snap.memory_mappings));
-    for (SnapMemoryMapping& mapping :
-         RelocationIterator(snap.memory_mappings)) {
-      // Adjust memory bytes for initial mappings.
-      RETURN_IF_RELOCATION_FAILED(
-          RelocateMemoryBytesArray(mapping.memory_bytes));
+template <typename Arch>
+SnapRelocatorError SnapRelocator<Arch>::RelocateSnap(
+    const Snap<Arch>*& snap_ptr) {
+  // Adjust the pointer in the array.
+  RETURN_IF_RELOCATION_FAILED(AdjustPointer(snap_ptr));
+
+  // Adjust pointers in this Snap.
+  Snap<Arch>& snap = *const_cast<Snap<Arch>*>(read_once(snap_ptr));
+  RETURN_IF_RELOCATION_FAILED(AdjustPointer(snap.id));
+
+  // Only the initial contents of read-only mappings may be compressed.
+  // Writable mappings are restored and verified in place on every run.
+  const bool allow_compressed =
+      reinterpret_cast<const SnapCorpus<Arch>*>(start_address_)
+          ->header.format_version >= kSnapCorpusCompressedFormatVersion;
+  RETURN_IF_RELOCATION_FAILED(AdjustArray(snap.memory_mappings));
+  for (SnapMemoryMapping& mapping : RelocationIterator(snap.memory_mappings)) {
+    // Adjust memory bytes for initial mappings.
+    RETURN_IF_RELOCATION_FAILED(RelocateMemoryBytesArray(
+        mapping.memory_bytes, allow_compressed && !mapping.writable()));
+  }
+
+  // Adjust register pointers.
+  RETURN_IF_RELOCATION_FAILED(AdjustPointer(snap.registers));
+  RETURN_IF_RELOCATION_FAILED(AdjustPointer(snap.end_state_registers));
+
+  // Adjust memory bytes for end state.
+  RETURN_IF_RELOCATION_FAILED(RelocateMemoryBytesArray(
+      snap.end_state_memory_bytes, /*allow_compressed=*/false));
+
+  // Adjust the platform end states likewise.
+  RETURN_IF_RELOCATION_FAILED(AdjustArray(snap.platform_end_states));
+  for (SnapEndState<Arch>& end_state :
+       RelocationIterator(snap.platform_end_states)) {
+    RETURN_IF_RELOCATION_FAILED(AdjustPointer(end_state.registers));
+    RETURN_IF_RELOCATION_FAILED(RelocateMemoryBytesArray(
+        end_state.memory_bytes, /*allow_compressed=*/false));
+  }
+  return SnapRelocatorError::kOk;
+}
+
+template <typename Arch>
+template <typename T>
+SnapRelocatorError SnapRelocator<Arch>::CheckRelocatedArray(
+    const SnapArray<T>& array) {
+  const size_t size = read_once(array.size);
+  if (size == 0) return SnapRelocatorError::kOk;
+  const uintptr_t address =
+      reinterpret_cast<uintptr_t>(read_once(array.elements));
+  RETURN_IF_RELOCATION_FAILED(ValidateRelocatedAddress<T>(address));
+  uintptr_t elements_byte_size, address_after_last_byte;
+  if (__builtin_mul_overflow(size, sizeof(T), &elements_byte_size) ||
+      __builtin_add_overflow(address, elements_byte_size,
+                             &address_after_last_byte) ||
+      address_after_last_byte > limit_address_) {
+    return SnapRelocatorError::kOutOfBound;
+  }
+  return SnapRelocatorError::kOk;
+}
+
+template <typename Arch>
+SnapRelocatorError SnapRelocator<Arch>::CheckRelocatedCorpus(bool verify) {
+  RETURN_IF_RELOCATION_FAILED(CheckHeader(verify));
+  const SnapCorpus<Arch>& corpus =
+      *reinterpret_cast<const SnapCorpus<Arch>*>(start_address_);
+
+  // Users index these arrays without further checks, so they must be within
+  // the corpus even if it is trusted.
+  RETURN_IF_RELOCATION_FAILED(CheckRelocatedArray(corpus.snaps));
+  RETURN_IF_RELOCATION_FAILED(CheckRelocatedArray(corpus.id_index));
+  RETURN_IF_RELOCATION_FAILED(CheckRelocatedArray(corpus.code_index));
+  RETURN_IF_RELOCATION_FAILED(CheckRelocatedArray(corpus.hot_entries));
+  const size_t num_snaps = read_once(corpus.snaps.size);
+  const size_t id_index_size = read_once(corpus.id_index.size);
+  const size_t hot_entries_size = read_once(corpus.hot_entries.size);
+  if ((id_index_size != 0 && id_index_size != num_snaps) ||
+      (hot_entries_size != 0 && hot_entries_size != num_snaps)) {
+    return SnapRelocatorError::kBadData;
+  }
+  if (!verify) return SnapRelocatorError::kOk;
+
+  for (size_t i = 0; i < num_snaps; ++i) {
+    RETURN_IF_RELOCATION_FAILED(ValidateRelocatedAddress<Snap<Arch>>(
+        reinterpret_cast<uintptr_t>(read_once(corpus.snaps.elements[i]))));
+  }
+  for (size_t i = 0; i < id_index_size; ++i) {
+    if (read_once(corpus.id_index.elements[i]) >= num_snaps) {
+      return SnapRelocatorError::kBadData;
     }
+  }
+  const size_t code_index_size = read_once(corpus.code_index.size);
+  for (size_t i = 0; i < code_index_size; ++i) {
+    if (read_once(corpus.code_index.elements[i].snap_index) >= num_snaps) {
+      return SnapRelocatorError::kBadData;
+    }
+  }
+  return SnapRelocatorError::kOk;
+}
 
-    // Adjust register pointers.
-    RETURN_IF_RELOCATION_FAILED(AdjustPointer(snap.registers));
-    RETURN_IF_RELOCATION_FAILED(AdjustPointer(snap.end_state_registers));
+template <typename Arch>
+SnapRelocatorError SnapRelocator<Arch>::RelocateCorpus(bool verify,
+                                                       bool lazy) {
+  RETURN_IF_RELOCATION_FAILED(CheckHeader(verify));
+  SnapCorpus<Arch>& corpus =
+      *reinterpret_cast<SnapCorpus<Arch>*>(start_address_);
 
-    // Adjust memory bytes for end state.
-    RETURN_IF_RELOCATION_FAILED(
-        RelocateMemoryBytesArray(snap.end_state_memory_bytes));
+  RETURN_IF_RELOCATION_FAILED(AdjustArray(corpus.snaps));
+  const size_t num_snaps = read_once(corpus.snaps.size);
+  if (!lazy) {
+    for (const Snap<Arch>*& snap_ptr : RelocationIterator(corpus.snaps)) {
+      RETURN_IF_RELOCATION_FAILED(RelocateSnap(snap_ptr));
+    }
+  }
+
+  // Adjust the lookup indices. Index entries refer to snaps[] so make sure
+  // they are in range, otherwise lookups could go out of bounds. Lazily
+  // relocated corpora skip this as GetSnap() checks the index.
+  if (corpus.id_index.size != 0 && corpus.id_index.size != num_snaps) {
+    return SnapRelocatorError::kBadData;
+  }
+  RETURN_IF_RELOCATION_FAILED(AdjustArray(corpus.id_index));
+  RETURN_IF_RELOCATION_FAILED(AdjustArray(corpus.code_index));
+  if (lazy) {
+    // Relocating the hot metadata would touch memory bytes of all Snaps.
+    // Drop it so that users read the Snaps from GetSnap() instead.
+    corpus.hot_entries = {};
+    return SnapRelocatorError::kOk;
+  }
+  if (corpus.hot_entries.size != 0 && corpus.hot_entries.size != num_snaps) {
+    return SnapRelocatorError::kBadData;
+  }
+  RETURN_IF_RELOCATION_FAILED(AdjustArray(corpus.hot_entries));
+  for (SnapHotEntry<Arch>& hot_entry : RelocationIterator(corpus.hot_entries)) {
+    RETURN_IF_RELOCATION_FAILED(AdjustPointer(hot_entry.registers));
+    RETURN_IF_RELOCATION_FAILED(RelocateMemoryBytesArray(
+        hot_entry.writable_memory_bytes, /*allow_compressed=*/false));
+  }
+  for (const uint32_t& snap_index : RelocationIterator(corpus.id_index)) {
+    if (read_once(snap_index) >= num_snaps) {
+      return SnapRelocatorError::kBadData;
+    }
+  }
+  for (const SnapCodeInterval& interval :
+       RelocationIterator(corpus.code_index)) {
+    if (read_once(interval.snap_index) >= num_snaps) {
+      return SnapRelocatorError::kBadData;
+    }
   }
   return SnapRelocatorError::kOk;
 }
@@ -252,8 +396,8 @@ SnapRelocatorError SnapRelocator<Arch>::RelocateCorpus(bool verify) {
 // static
 template <typename Arch>
 MmappedMemoryPtr<const SnapCorpus<Arch>> SnapRelocator<Arch>::RelocateCorpus(
-    MmappedMemoryPtr<char> relocatable, bool verify,
-    SnapRelocatorError* error) {
+    MmappedMemoryPtr<char> relocatable, bool verify, SnapRelocatorError* error,
+    uintptr_t nominal_address) {
   const size_t byte_size = MmappedMemorySize(relocatable);
   if (byte_size == 0) {
     *error = SnapRelocatorError::kEmptyCorpus;
@@ -262,10 +406,10 @@ MmappedMemoryPtr<const SnapCorpus<Arch>> SnapRelocator<Arch>::RelocateCorpus(
 
   uintptr_t start_address = reinterpret_cast<uintptr_t>(relocatable.get());
   uintptr_t limit_address = start_address + byte_size;
-  SnapRelocator relocator(start_address, limit_address);
+  SnapRelocator relocator(start_address, limit_address, nominal_address);
 
   // Relocate corpus
-  *error = relocator.RelocateCorpus(verify);
+  *error = relocator.RelocateCorpus(verify, /*lazy=*/false);
   if (*error != SnapRelocatorError::kOk) return make_null_corpus<Arch>();
 
   // mprotect corpus after relocation.
@@ -282,18 +426,133 @@ MmappedMemoryPtr<const SnapCorpus<Arch>> SnapRelocator<Arch>::RelocateCorpus(
   return MakeMmappedMemoryPtr(corpus, byte_size);
 }
 
+// static
+template <typename Arch>
+MmappedMemoryPtr<const SnapCorpus<Arch>>
+SnapRelocator<Arch>::AdoptRelocatedCorpus(MmappedMemoryPtr<char> relocated,
+                                          bool verify,
+                                          SnapRelocatorError* error) {
+  const size_t byte_size = MmappedMemorySize(relocated);
+  if (byte_size == 0) {
+    *error = SnapRelocatorError::kEmptyCorpus;
+    return make_null_corpus<Arch>();
+  }
+
+  uintptr_t start_address = reinterpret_cast<uintptr_t>(relocated.get());
+  uintptr_t limit_address = start_address + byte_size;
+  SnapRelocator relocator(start_address, limit_address, start_address);
+  *error = relocator.CheckRelocatedCorpus(verify);
+  if (*error != SnapRelocatorError::kOk) return make_null_corpus<Arch>();
+
+  auto corpus = reinterpret_cast<const SnapCorpus<Arch>*>(relocated.release());
+  return MakeMmappedMemoryPtr(corpus, byte_size);
+}
+
+// static
+template <typename Arch>
+MmappedMemoryPtr<const SnapCorpus<Arch>>
+SnapRelocator<Arch>::RelocateCorpusLazily(MmappedMemoryPtr<char> relocatable,
+                                          bool verify,
+                                          SnapRelocatorError* error) {
+  const size_t byte_size = MmappedMemorySize(relocatable);
+  if (byte_size == 0) {
+    *error = SnapRelocatorError::kEmptyCorpus;
+    return make_null_corpus<Arch>();
+  }
+
+  // GetSnap() tells relocated Snap pointers from unrelocated ones, which are
+  // offsets from the nominal address 0, by their value. This only works if
+  // the two ranges are disjoint.
+  uintptr_t start_address = reinterpret_cast<uintptr_t>(relocatable.get());
+  if (start_address < byte_size) {
+    return RelocateCorpus(std::move(relocatable), verify, error);
+  }
+  uintptr_t limit_address = start_address + byte_size;
+  SnapRelocator relocator(start_address, limit_address, 0);
+  *error = relocator.RelocateCorpus(verify, /*lazy=*/true);
+  if (*error != SnapRelocatorError::kOk) return make_null_corpus<Arch>();
+
+  auto corpus =
+      reinterpret_cast<const SnapCorpus<Arch>*>(relocatable.release());
+  return MakeMmappedMemoryPtr(corpus, byte_size);
+}
+
+// static
+template <typename Arch>
+const Snap<Arch>* SnapRelocator<Arch>::GetSnap(const SnapCorpus<Arch>& corpus,
+                                               size_t index,
+                                               SnapRelocatorError* error) {
+  if (index >= corpus.snaps.size) {
+    *error = SnapRelocatorError::kOutOfBound;
+    return nullptr;
+  }
+  const uintptr_t start_address = reinterpret_cast<uintptr_t>(&corpus);
+  const uintptr_t limit_address = start_address + corpus.header.num_bytes;
+  const Snap<Arch>*& snap_ptr =
+      const_cast<const Snap<Arch>*&>(corpus.snaps.elements[index]);
+  const uintptr_t snap_address = reinterpret_cast<uintptr_t>(snap_ptr);
+  if (snap_address < start_address || snap_address >= limit_address) {
+    SnapRelocator relocator(start_address, limit_address, 0);
+    *error = relocator.RelocateSnap(snap_ptr);
+    if (*error != SnapRelocatorError::kOk) return nullptr;
+  }
+  return snap_ptr;
+}
+
 template
     // static
     MmappedMemoryPtr<const SnapCorpus<X86_64>>
     SnapRelocator<X86_64>::RelocateCorpus(MmappedMemoryPtr<char> relocatable,
                                           bool verify,
-                                          SnapRelocatorError* error);
+                                          SnapRelocatorError* error,
+                                          uintptr_t nominal_address);
 
 template
     // static
     MmappedMemoryPtr<const SnapCorpus<AArch64>>
     SnapRelocator<AArch64>::RelocateCorpus(MmappedMemoryPtr<char> relocatable,
                                            bool verify,
-                                           SnapRelocatorError* error);
+                                           SnapRelocatorError* error,
+                                           uintptr_t nominal_address);
+
+template
+    // static
+    MmappedMemoryPtr<const SnapCorpus<X86_64>>
+    SnapRelocator<X86_64>::AdoptRelocatedCorpus(
+        MmappedMemoryPtr<char> relocated, bool verify,
+        SnapRelocatorError* error);
+
+template
+    // static
+    MmappedMemoryPtr<const SnapCorpus<AArch64>>
+    SnapRelocator<AArch64>::AdoptRelocatedCorpus(
+        MmappedMemoryPtr<char> relocated, bool verify,
+        SnapRelocatorError* error);
+
+template
+    // static
+    MmappedMemoryPtr<const SnapCorpus<X86_64>>
+    SnapRelocator<X86_64>::RelocateCorpusLazily(
+        MmappedMemoryPtr<char> relocatable, bool verify,
+        SnapRelocatorError* error);
+
+template
+    // static
+    MmappedMemoryPtr<const SnapCorpus<AArch64>>
+    SnapRelocator<AArch64>::RelocateCorpusLazily(
+        MmappedMemoryPtr<char> relocatable, bool verify,
+        SnapRelocatorError* error);
+
+template
+    // static
+    const Snap<X86_64>* SnapRelocator<X86_64>::GetSnap(
+        const SnapCorpus<X86_64>& corpus, size_t index,
+        SnapRelocatorError* error);
+
+template
+    // static
+    const Snap<AArch64>* SnapRelocator<AArch64>::GetSnap(
+        const SnapCorpus<AArch64>& corpus, size_t index,
+        SnapRelocatorError* error);
 
 }  // namespace silifuzz
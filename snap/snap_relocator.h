@@ -34,27 +34,66 @@ enum class [[nodiscard]] SnapRelocatorError {
 };
 
 // SnapRelocator relocates a relocatable Snap corpus loaded at an address
-// different from the nominal load address of 0. Relocation involves adding
-// the start address of the Snap corpus to every pointer inside the corpus.
+// different from its nominal load address, which is 0 for corpus files.
+// Relocation involves adding the difference between the start address of the
+// Snap corpus and the nominal load address to every pointer inside the corpus.
 template <typename Arch>
 class SnapRelocator {
  public:
   // Relocates a relocatable Snap corpus pointed by `relocatable` and then
-  // mprotect the memory to be read-only.
+  // mprotect the memory to be read-only. Pointers in the corpus are relative
+  // to `nominal_address`. This is non-zero for a corpus that has already been
+  // relocated to `nominal_address`, see AdoptRelocatedCorpus().
   // Performs additional integrity checks if `verify` is set.
   // RETURNS: A mmapped memory pointer to the relocated corpus and an error
   // code indicating if relocation succeeded. If relocation failed, the return
   // contents are undefined.
   static MmappedMemoryPtr<const SnapCorpus<Arch>> RelocateCorpus(
+      MmappedMemoryPtr<char> relocatable, bool verify,
+      SnapRelocatorError* error, uintptr_t nominal_address = 0);
+
+  // Checks a corpus in `relocated` that has already been relocated to the
+  // address it is mapped at and returns it as a corpus without touching any
+  // pointers. This allows sharing a read-only pre-relocated corpus between
+  // processes. The header and the top-level arrays are always checked to be
+  // within `relocated`. The checksum, the Snap pointers and the lookup indices
+  // are only checked if `verify` is set.
+  // RETURNS: A mmapped memory pointer to the corpus and an error code
+  // indicating if the checks passed.
+  static MmappedMemoryPtr<const SnapCorpus<Arch>> AdoptRelocatedCorpus(
+      MmappedMemoryPtr<char> relocated, bool verify, SnapRelocatorError* error);
+
+  // Like RelocateCorpus() with a nominal address of 0 but only relocates the
+  // corpus object itself. Each Snap is relocated when first accessed through
+  // GetSnap(), so that loading takes constant time and only metadata pages of
+  // Snaps actually used are modified. This keeps the rest of a MAP_PRIVATE
+  // corpus mapping shared with the page cache. The elements of snaps[] must
+  // only be accessed through GetSnap(), e.g. by passing it to
+  // SnapCorpus::FindIndex(). The corpus is left writable and can be
+  // mprotect()'ed by the caller once all Snaps needed have been relocated.
+  // If the corpus is mapped at an address too low to tell relocated from
+  // unrelocated pointers apart, this falls back to RelocateCorpus().
+  static MmappedMemoryPtr<const SnapCorpus<Arch>> RelocateCorpusLazily(
       MmappedMemoryPtr<char> relocatable, bool verify,
       SnapRelocatorError* error);
 
+  // Returns corpus.snaps[index] of a corpus returned by any of the functions
+  // above, relocating the Snap first if it has not been relocated yet.
+  // RETURNS: The relocated Snap or nullptr with `*error` set if `index` is out
+  // of bounds or relocation failed.
+  static const Snap<Arch>* GetSnap(const SnapCorpus<Arch>& corpus, size_t index,
+                                   SnapRelocatorError* error);
+
  private:
   // Constructs a SnapRelocator object for a relocatable Snap corpus in
-  // memory region [start_address, limit_address).
+  // memory region [start_address, limit_address) with pointers relative to
+  // `nominal_address`.
   // Constructor is private as relocation is done using a static function.
-  SnapRelocator(uintptr_t start_address, uintptr_t limit_address)
-      : start_address_(start_address), limit_address_(limit_address) {}
+  SnapRelocator(uintptr_t start_address, uintptr_t limit_address,
+                uintptr_t nominal_address)
+      : start_address_(start_address),
+        limit_address_(limit_address),
+        nominal_address_(nominal_address) {}
 
   // Not copyable or moveable. Once a corpus is relocated. It cannot be
   // relocated again. It is generally not meaningful to copy a relocator.
@@ -70,9 +109,9 @@ class SnapRelocator {
   template <typename T>
   SnapRelocatorError ValidateRelocatedAddress(uintptr_t address);
 
-  // Adjusts a relocatable pointer in place. This adds the start address
-  // of the relocatable corpus to a pointer, which is a relative
-  // offset from the start address to the address of the pointed object.
+  // Adjusts a relocatable pointer in place. This turns a pointer, which is
+  // relative to the nominal load address, into an address relative to the
+  // start address of the corpus.
   // This also checks that the relocated pointer is still within the
   // relocatable corpus and is properly aligned for type T.
   //
@@ -90,26 +129,50 @@ class SnapRelocator {
   template <typename T>
   SnapRelocatorError AdjustArray(SnapArray<T>& array);
 
-  // Relocates a SnapArray<SnapMemoryBytes>.
+  // Relocates a SnapArray<SnapMemoryBytes>. Compressed memory bytes are
+  // rejected unless `allow_compressed` is true.
   //
   // RETURNS: whether relocation succeeded. If it failed, contents of
   // `memory_byte_array` are undefined.
   SnapRelocatorError RelocateMemoryBytesArray(
-      SnapArray<SnapMemoryBytes>& memory_bytes_array);
+      SnapArray<SnapMemoryBytes>& memory_bytes_array, bool allow_compressed);
+
+  // Checks the corpus header. If `verify` is true, also calculates and
+  // verifies the corpus checksum.
+  SnapRelocatorError CheckHeader(bool verify);
+
+  // Similar to AdjustArray() but only checks `array` of a corpus that has
+  // already been relocated to the start address of this.
+  template <typename T>
+  SnapRelocatorError CheckRelocatedArray(const SnapArray<T>& array);
 
-  // Relocates corpus by adjusting all pointers inside the corpus.
+  // Checks a corpus that has already been relocated to the start address of
+  // this without modifying it, see AdoptRelocatedCorpus().
+  SnapRelocatorError CheckRelocatedCorpus(bool verify);
+
+  // Relocates a Snap and the pointer to it in place.
+  //
+  // RETURNS: whether relocation succeeded. If it failed, contents of the Snap
+  // are undefined.
+  SnapRelocatorError RelocateSnap(const Snap<Arch>*& snap_ptr);
+
+  // Relocates corpus by adjusting all pointers inside the corpus. If `lazy` is
+  // true, Snaps are left to be relocated by GetSnap().
   // If `verify` is true, calculate and verify the corpus checksum before
   // relocation.
   // REQUIRES: Only called once.
   // RETURNS: whether relocation succeeded. If it failed, contents of
   // corpus are undefined.
-  SnapRelocatorError RelocateCorpus(bool verify);
+  SnapRelocatorError RelocateCorpus(bool verify, bool lazy);
 
   // Address of the beginning of the corpus.
   uintptr_t start_address_;
 
   // Address after the last byte of the corpus.
   uintptr_t limit_address_;
+
+  // Address that pointers in the corpus are relative to.
+  uintptr_t nominal_address_;
 };
 
 }  // namespace silifuzz
@@ -14,9 +14,13 @@
 
 #include "./snap/snap_relocator.h"
 
+#include <sys/mman.h>
+
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <limits>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -81,6 +85,114 @@ TYPED_TEST(SnapRelocatorTest, CanRelocateGoodCorpus) {
   this->ExpectRelocationResultIs(SnapRelocatorError::kOk);
 }
 
+TYPED_TEST(SnapRelocatorTest, RelocateFromNominalAddress) {
+  const size_t byte_size = MmappedMemorySize(this->relocatable_);
+  SnapRelocatorError error;
+  MmappedMemoryPtr<const SnapCorpus<TypeParam>> relocated =
+      SnapRelocator<TypeParam>::RelocateCorpus(std::move(this->relocatable_),
+                                               true, &error);
+  ASSERT_EQ(error, SnapRelocatorError::kOk);
+  const uintptr_t nominal_address =
+      reinterpret_cast<uintptr_t>(relocated.get());
+
+  // A copy of a relocated corpus can be adopted where it was relocated to and
+  // relocated again elsewhere.
+  MmappedMemoryPtr<char> copy = AllocateMmappedBuffer<char>(byte_size);
+  memcpy(copy.get(), relocated.get(), byte_size);
+  const uintptr_t copy_address = reinterpret_cast<uintptr_t>(copy.get());
+  MmappedMemoryPtr<const SnapCorpus<TypeParam>> relocated_copy =
+      SnapRelocator<TypeParam>::RelocateCorpus(std::move(copy), false, &error,
+                                               nominal_address);
+  ASSERT_EQ(error, SnapRelocatorError::kOk);
+  ASSERT_EQ(relocated_copy->snaps.size, relocated->snaps.size);
+  const uintptr_t snap_address =
+      reinterpret_cast<uintptr_t>(relocated_copy->snaps[0]);
+  EXPECT_GE(snap_address, copy_address);
+  EXPECT_LT(snap_address, copy_address + byte_size);
+  EXPECT_STREQ(relocated_copy->snaps[0]->id, relocated->snaps[0]->id);
+
+  auto adopted = SnapRelocator<TypeParam>::AdoptRelocatedCorpus(
+      MakeMmappedMemoryPtr(
+          reinterpret_cast<char*>(
+              const_cast<SnapCorpus<TypeParam>*>(relocated.release())),
+          byte_size),
+      false, &error);
+  ASSERT_EQ(error, SnapRelocatorError::kOk);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(adopted.get()), nominal_address);
+}
+
+TYPED_TEST(SnapRelocatorTest, AdoptChecksTopLevelArraysWithoutVerify) {
+  const size_t byte_size = MmappedMemorySize(this->relocatable_);
+  SnapRelocatorError error;
+  MmappedMemoryPtr<const SnapCorpus<TypeParam>> relocated =
+      SnapRelocator<TypeParam>::RelocateCorpus(std::move(this->relocatable_),
+                                               true, &error);
+  ASSERT_EQ(error, SnapRelocatorError::kOk);
+  char* bytes = reinterpret_cast<char*>(
+      const_cast<SnapCorpus<TypeParam>*>(relocated.release()));
+  MmappedMemoryPtr<char> writable = MakeMmappedMemoryPtr(bytes, byte_size);
+  ASSERT_EQ(mprotect(bytes, byte_size, PROT_READ | PROT_WRITE), 0);
+
+  // Point the snaps array past the end of the corpus.
+  auto corpus = reinterpret_cast<SnapCorpus<TypeParam>*>(bytes);
+  corpus->snaps.elements =
+      reinterpret_cast<const Snap<TypeParam>* const*>(bytes + byte_size);
+  SnapRelocator<TypeParam>::AdoptRelocatedCorpus(std::move(writable), false,
+                                                  &error);
+  EXPECT_EQ(error, SnapRelocatorError::kOutOfBound);
+}
+
+TYPED_TEST(SnapRelocatorTest, RelocateLazily) {
+  const size_t byte_size = MmappedMemorySize(this->relocatable_);
+  MmappedMemoryPtr<char> copy = AllocateMmappedBuffer<char>(byte_size);
+  memcpy(copy.get(), this->relocatable_.get(), byte_size);
+  SnapRelocatorError error;
+  MmappedMemoryPtr<const SnapCorpus<TypeParam>> eager =
+      SnapRelocator<TypeParam>::RelocateCorpus(std::move(copy), true, &error);
+  ASSERT_EQ(error, SnapRelocatorError::kOk);
+
+  MmappedMemoryPtr<const SnapCorpus<TypeParam>> lazy =
+      SnapRelocator<TypeParam>::RelocateCorpusLazily(
+          std::move(this->relocatable_), true, &error);
+  ASSERT_EQ(error, SnapRelocatorError::kOk);
+  ASSERT_EQ(lazy->snaps.size, eager->snaps.size);
+
+  // Lazily relocated snaps end up where eager relocation puts them relative
+  // to the corpus start. Getting a snap again does not relocate it twice.
+  const uintptr_t eager_address = reinterpret_cast<uintptr_t>(eager.get());
+  const uintptr_t lazy_address = reinterpret_cast<uintptr_t>(lazy.get());
+  for (size_t i = 0; i < lazy->snaps.size; ++i) {
+    const Snap<TypeParam>* snap =
+        SnapRelocator<TypeParam>::GetSnap(*lazy, i, &error);
+    ASSERT_EQ(error, SnapRelocatorError::kOk);
+    ASSERT_NE(snap, nullptr);
+    EXPECT_EQ(SnapRelocator<TypeParam>::GetSnap(*lazy, i, &error), snap);
+    const Snap<TypeParam>* expected = eager->snaps[i];
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(snap) - lazy_address,
+              reinterpret_cast<uintptr_t>(expected) - eager_address);
+    EXPECT_STREQ(snap->id, expected->id);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(snap->registers) - lazy_address,
+              reinterpret_cast<uintptr_t>(expected->registers) -
+                  eager_address);
+    ASSERT_EQ(snap->memory_mappings.size, expected->memory_mappings.size);
+    for (size_t j = 0; j < snap->memory_mappings.size; ++j) {
+      EXPECT_EQ(snap->memory_mappings[j].start_address,
+                expected->memory_mappings[j].start_address);
+    }
+  }
+
+  // Lookups work with lazily relocated snaps.
+  const size_t index = lazy->FindIndex(eager->snaps[0]->id, [&](size_t i) {
+    return SnapRelocator<TypeParam>::GetSnap(*lazy, i, &error);
+  });
+  EXPECT_EQ(index, 0);
+
+  EXPECT_EQ(
+      SnapRelocator<TypeParam>::GetSnap(*lazy, lazy->snaps.size, &error),
+      nullptr);
+  EXPECT_EQ(error, SnapRelocatorError::kOutOfBound);
+}
+
 TYPED_TEST(SnapRelocatorTest, UnalignedSnapPointer) {
   SnapCorpus<TypeParam>* corpus = this->corpus_;
   const Snap<TypeParam>* const bad_pointer =
@@ -120,6 +232,56 @@ TYPED_TEST(SnapRelocatorTest, ArrayElementAddressOverflow) {
   this->ExpectRelocationResultIs(SnapRelocatorError::kOutOfBound);
 }
 
+TYPED_TEST(SnapRelocatorTest, IdIndexSizeMismatch) {
+  // The id index must be either empty or cover all snaps.
+  this->corpus_->id_index.size = this->corpus_->snaps.size + 1;
+  this->ExpectRelocationResultIs(SnapRelocatorError::kBadData);
+}
+
+TYPED_TEST(SnapRelocatorTest, CodeIndexSnapIndexOutOfBound) {
+  SnapCorpus<TypeParam>* corpus = this->corpus_;
+  ASSERT_GT(corpus->code_index.size, 0);
+  // The corpus is generated for nominal load address 0 so pointers are
+  // offsets into relocatable_.
+  SnapCodeInterval* code_index = reinterpret_cast<SnapCodeInterval*>(
+      this->relocatable_.get() +
+      reinterpret_cast<uintptr_t>(corpus->code_index.elements));
+  code_index[0].snap_index = corpus->snaps.size;
+  this->ExpectRelocationResultIs(SnapRelocatorError::kBadData);
+}
+
+TYPED_TEST(SnapRelocatorTest, UnsupportedFormatVersion) {
+  this->corpus_->header.format_version = kSnapCorpusLatestFormatVersion + 1;
+  this->ExpectRelocationResultIs(SnapRelocatorError::kBadData);
+}
+
+TYPED_TEST(SnapRelocatorTest, CompressedBytesNeedFormatVersion) {
+  ASSERT_EQ(this->corpus_->header.format_version, 0);
+  // The corpus is generated for nominal load address 0 so pointers are
+  // offsets into relocatable_.
+  auto contents_of = [this](auto* ptr) {
+    using T = std::remove_const_t<std::remove_pointer_t<decltype(ptr)>>;
+    return reinterpret_cast<T*>(this->relocatable_.get() +
+                                reinterpret_cast<uintptr_t>(ptr));
+  };
+  const Snap<TypeParam>* snap =
+      contents_of(*contents_of(this->corpus_->snaps.elements));
+  SnapMemoryBytes* memory_bytes = nullptr;
+  for (size_t i = 0; i < snap->memory_mappings.size; ++i) {
+    const SnapMemoryMapping& mapping =
+        contents_of(snap->memory_mappings.elements)[i];
+    for (size_t j = 0; j < mapping.memory_bytes.size; ++j) {
+      SnapMemoryBytes& candidate =
+          contents_of(mapping.memory_bytes.elements)[j];
+      if (!candidate.repeating()) memory_bytes = &candidate;
+    }
+  }
+  ASSERT_NE(memory_bytes, nullptr);
+  memory_bytes->flags |= SnapMemoryBytes::kCompressed;
+  memory_bytes->compressed_size = 1;
+  this->ExpectRelocationResultIs(SnapRelocatorError::kBadData);
+}
+
 }  // namespace
 
 }  // namespace silifuzz
@@ -14,24 +14,38 @@
 
 #include "./snap/snap_util.h"
 
+#include <cstdint>
+
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "./common/memory_mapping.h"
 #include "./common/memory_perms.h"
 #include "./common/snapshot.h"
 #include "./common/snapshot_util.h"
 #include "./snap/snap.h"
 #include "./util/checks.h"
+#include "./util/lz4_block.h"
 #include "./util/platform.h"
 
 namespace silifuzz {
 
-namespace {
-
-// Creates a Snapshot::ByteData from a SnapMemoryBytes `memory_bytes`.
-Snapshot::ByteData SnapMemoryBytesData(const SnapMemoryBytes& memory_bytes) {
+absl::StatusOr<Snapshot::ByteData> SnapMemoryBytesData(
+    const SnapMemoryBytes& memory_bytes) {
   if (memory_bytes.repeating()) {
     return Snapshot::ByteData(memory_bytes.size(),
                               memory_bytes.data.byte_run.value);
+  } else if (memory_bytes.compressed()) {
+    Snapshot::ByteData data(memory_bytes.size(), 0);
+    if (!Lz4BlockDecompress(memory_bytes.data.byte_values.elements,
+                            memory_bytes.compressed_size,
+                            reinterpret_cast<uint8_t*>(data.data()),
+                            data.size())) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Corrupt compressed memory bytes at 0x",
+                       absl::Hex(memory_bytes.start_address)));
+    }
+    return data;
   } else {
     return Snapshot::ByteData(
         reinterpret_cast<const char*>(memory_bytes.data.byte_values.elements),
@@ -39,6 +53,27 @@ Snapshot::ByteData SnapMemoryBytesData(const SnapMemoryBytes& memory_bytes) {
   }
 }
 
+namespace {
+
+// Converts an expected end state of a Snap ending at `instruction_address`
+// into a Snapshot::EndState without platforms.
+template <typename Arch>
+absl::StatusOr<Snapshot::EndState> SnapEndStateToSnapshot(
+    uint64_t instruction_address, const UContext<Arch>& registers,
+    const SnapArray<SnapMemoryBytes>& memory_bytes) {
+  Snapshot::EndState es(
+      Snapshot::Endpoint(instruction_address),
+      ConvertRegsToSnapshot(registers.gregs, registers.fpregs));
+  for (const SnapMemoryBytes& snap_mb : memory_bytes) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(Snapshot::ByteData data,
+                               SnapMemoryBytesData(snap_mb));
+    Snapshot::MemoryBytes mb = {snap_mb.start_address, data};
+    RETURN_IF_NOT_OK(es.can_add_memory_bytes(mb));
+    es.add_memory_bytes(mb);
+  }
+  return es;
+}
+
 }  // namespace
 
 template <typename Arch>
@@ -53,7 +88,8 @@ absl::StatusOr<Snapshot> SnapToSnapshot(const Snap<Arch>& snap,
     RETURN_IF_NOT_OK(snapshot.can_add_memory_mapping(mapping));
     snapshot.add_memory_mapping(mapping);
     for (const SnapMemoryBytes& snap_mb : m.memory_bytes) {
-      Snapshot::ByteData data = SnapMemoryBytesData(snap_mb);
+      ASSIGN_OR_RETURN_IF_NOT_OK(Snapshot::ByteData data,
+                                 SnapMemoryBytesData(snap_mb));
       Snapshot::MemoryBytes mb = {snap_mb.start_address, data};
       RETURN_IF_NOT_OK(snapshot.can_add_memory_bytes(mb));
       snapshot.add_memory_bytes(mb);
@@ -63,21 +99,28 @@ absl::StatusOr<Snapshot> SnapToSnapshot(const Snap<Arch>& snap,
       ConvertRegsToSnapshot(snap.registers->gregs, snap.registers->fpregs);
   snapshot.set_registers(rs);
 
-  Snapshot::EndState es(
-      Snapshot::Endpoint(snap.end_state_instruction_address),
-      ConvertRegsToSnapshot(snap.end_state_registers->gregs,
-                            snap.end_state_registers->fpregs));
-  for (const SnapMemoryBytes& snap_mb : snap.end_state_memory_bytes) {
-    Snapshot::ByteData data = SnapMemoryBytesData(snap_mb);
-    Snapshot::MemoryBytes mb = {snap_mb.start_address, data};
-    RETURN_IF_NOT_OK(es.can_add_memory_bytes(mb));
-    es.add_memory_bytes(mb);
-  }
-
+  ASSIGN_OR_RETURN_IF_NOT_OK(
+      Snapshot::EndState es,
+      SnapEndStateToSnapshot(snap.end_state_instruction_address,
+                             *snap.end_state_registers,
+                             snap.end_state_memory_bytes));
   es.add_platform(platform);
-
   RETURN_IF_NOT_OK(snapshot.can_add_expected_end_state(es));
   snapshot.add_expected_end_state(es);
+
+  for (const SnapEndState<Arch>& snap_es : snap.platform_end_states) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(
+        Snapshot::EndState platform_es,
+        SnapEndStateToSnapshot(snap.end_state_instruction_address,
+                               *snap_es.registers, snap_es.memory_bytes));
+    for (int i = 0; i <= ToInt(kMaxPlatformId); ++i) {
+      if ((snap_es.platforms & (uint64_t{1} << i)) != 0) {
+        platform_es.add_platform(static_cast<PlatformId>(i));
+      }
+    }
+    RETURN_IF_NOT_OK(snapshot.can_add_expected_end_state(platform_es));
+    snapshot.add_expected_end_state(platform_es);
+  }
   return snapshot;
 }
 
@@ -26,8 +26,14 @@
 
 namespace silifuzz {
 
+// Creates a Snapshot::ByteData from a SnapMemoryBytes `memory_bytes`,
+// expanding byte runs and decompressing as needed.
+absl::StatusOr<Snapshot::ByteData> SnapMemoryBytesData(
+    const SnapMemoryBytes& memory_bytes);
+
 // Converts Snap into Snapshot with `platform` representing the platform for the
-// only expected end state in `snap`.
+// default expected end state in `snap`. Platform end states of `snap` become
+// additional expected end states for the platforms they apply to.
 // TODO(ksteuck): [impl] There should be metadata in the corpus file or the Snap
 // to describe the target platform.
 template <typename Arch>
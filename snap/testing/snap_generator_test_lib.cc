@@ -16,6 +16,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <vector>
 
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
@@ -27,7 +28,9 @@
 #include "./snap/gen/snap_generator.h"
 #include "./snap/snap.h"
 #include "./util/checks.h"
+#include "./util/lz4_block.h"
 #include "./util/mem_util.h"
+#include "./util/platform.h"
 #include "./util/reg_checksum.h"
 #include "./util/reg_checksum_util.h"
 #include "./util/ucontext/serialize.h"
@@ -92,6 +95,16 @@ void VerifySnapMemoryBytes(const Snapshot::MemoryBytes& memory_bytes,
   if (snap_memory_bytes.repeating()) {
     VerifyByteRun("byte_run", memory_bytes.byte_values(),
                   snap_memory_bytes.data.byte_run);
+  } else if (snap_memory_bytes.compressed()) {
+    // Compression is only used for read-only data.
+    CHECK(perms.HasNo(MemoryPerms::kWritable));
+    std::vector<uint8_t> decompressed(snap_memory_bytes.size());
+    CHECK(Lz4BlockDecompress(snap_memory_bytes.data.byte_values.elements,
+                             snap_memory_bytes.compressed_size,
+                             decompressed.data(), decompressed.size()));
+    VerifyByteData("byte_values", memory_bytes.byte_values(),
+                   {.size = decompressed.size(),
+                    .elements = decompressed.data()});
   } else {
     VerifyByteData("byte_values", memory_bytes.byte_values(),
                    snap_memory_bytes.data.byte_values);
@@ -170,7 +183,8 @@ void VerifyTestSnap(const Snapshot& snapshot, const Snap<Arch>& snap,
   }
   VerifySnapRegisterState<Arch>(snapified_snapshot.registers(),
                                 *snap.registers);
-  CHECK_EQ(snapified_snapshot.expected_end_states().size(), 1);
+  CHECK_EQ(snapified_snapshot.expected_end_states().size(),
+           1 + snap.platform_end_states.size);
   const Snapshot::EndState& end_state =
       snapified_snapshot.expected_end_states()[0];
   const Snapshot::Endpoint& endpoint = end_state.endpoint();
@@ -178,18 +192,32 @@ void VerifyTestSnap(const Snapshot& snapshot, const Snap<Arch>& snap,
   VerifySnapField("end_state_instruction_address",
                   endpoint.instruction_address(),
                   snap.end_state_instruction_address);
-  VerifySnapRegisterState<Arch>(end_state.registers(),
-                                *snap.end_state_registers);
-
-  VerifySnapMemoryBytesArray(
-      "memory_bytes", ToBorrowedMemoryBytesList(end_state.memory_bytes()),
-      snap.end_state_memory_bytes, snapified_snapshot.mapped_memory_map());
-  absl::StatusOr<RegisterChecksum<Arch>> register_checksum_or =
-      DeserializeRegisterChecksum<Arch>(end_state.register_checksum());
-  CHECK_STATUS(register_checksum_or.status());
-  RegisterChecksum<Arch> register_checksum = register_checksum_or.value();
-  // CHECK_EQ() does not work with RegisterGroupSet.
-  CHECK(register_checksum == snap.end_state_register_checksum);
+
+  // Verifies `snap_end_state` against the expected end state `es`.
+  auto verify_end_state = [&](const Snapshot::EndState& es,
+                              const SnapEndState<Arch>& snap_end_state) {
+    CHECK(es.endpoint() == endpoint);
+    VerifySnapRegisterState<Arch>(es.registers(), *snap_end_state.registers);
+    VerifySnapMemoryBytesArray(
+        "memory_bytes", ToBorrowedMemoryBytesList(es.memory_bytes()),
+        snap_end_state.memory_bytes, snapified_snapshot.mapped_memory_map());
+    absl::StatusOr<RegisterChecksum<Arch>> register_checksum_or =
+        DeserializeRegisterChecksum<Arch>(es.register_checksum());
+    CHECK_STATUS(register_checksum_or.status());
+    RegisterChecksum<Arch> register_checksum = register_checksum_or.value();
+    // CHECK_EQ() does not work with RegisterGroupSet.
+    CHECK(register_checksum == snap_end_state.register_checksum);
+  };
+  verify_end_state(end_state, snap.EndStateFor(ToInt(PlatformId::kUndefined)));
+  for (size_t i = 0; i < snap.platform_end_states.size; ++i) {
+    const Snapshot::EndState& es =
+        snapified_snapshot.expected_end_states()[i + 1];
+    const SnapEndState<Arch>& snap_end_state = snap.platform_end_states[i];
+    for (PlatformId platform : es.platforms()) {
+      CHECK((snap_end_state.platforms >> ToInt(platform)) & 1);
+    }
+    verify_end_state(es, snap_end_state);
+  }
 }
 
 template void VerifyTestSnap(const Snapshot& snapshot, const Snap<X86_64>& snap,
@@ -0,0 +1,92 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_TOOL_LIBS_BOUNDED_QUEUE_H_
+#define THIRD_PARTY_SILIFUZZ_TOOL_LIBS_BOUNDED_QUEUE_H_
+
+#include <cstddef>
+#include <deque>
+#include <optional>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+
+namespace silifuzz {
+
+// A blocking multi-producer multi-consumer FIFO queue holding at most
+// `capacity` elements, for passing work between the stages of a pipeline.
+// A full queue blocks producers, which keeps a fast stage from running
+// arbitrarily far ahead of a slow one.
+//
+// Producers Close() the queue when they are done. Consumers then drain the
+// remaining elements, after which Pop() returns std::nullopt.
+//
+// This class is thread-safe.
+template <typename T>
+class BoundedQueue {
+ public:
+  // REQUIRES: capacity > 0.
+  explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+  // Not copyable or moveable -- shared between threads.
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue(BoundedQueue&&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(BoundedQueue&&) = delete;
+
+  // Appends `value`, waiting while the queue is full. Returns false and drops
+  // `value` if the queue is closed.
+  bool Push(T value) ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    mu_.Await(absl::Condition(this, &BoundedQueue::CanPush));
+    if (closed_) return false;
+    elements_.push_back(std::move(value));
+    return true;
+  }
+
+  // Removes the first element, waiting while the queue is empty and open.
+  // Returns std::nullopt once the queue is closed and empty.
+  std::optional<T> Pop() ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    mu_.Await(absl::Condition(this, &BoundedQueue::CanPop));
+    if (elements_.empty()) return std::nullopt;
+    T value = std::move(elements_.front());
+    elements_.pop_front();
+    return value;
+  }
+
+  // Wakes up all waiters. Later Push()es fail.
+  void Close() ABSL_LOCKS_EXCLUDED(mu_) {
+    absl::MutexLock lock(&mu_);
+    closed_ = true;
+  }
+
+ private:
+  bool CanPush() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return closed_ || elements_.size() < capacity_;
+  }
+  bool CanPop() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return closed_ || !elements_.empty();
+  }
+
+  const size_t capacity_;
+  absl::Mutex mu_;
+  std::deque<T> elements_ ABSL_GUARDED_BY(mu_);
+  bool closed_ ABSL_GUARDED_BY(mu_) = false;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_TOOL_LIBS_BOUNDED_QUEUE_H_
@@ -0,0 +1,81 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tool_libs/bounded_queue.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace silifuzz {
+namespace {
+
+TEST(BoundedQueue, FifoAndClose) {
+  BoundedQueue<std::string> queue(2);
+  EXPECT_TRUE(queue.Push("a"));
+  EXPECT_TRUE(queue.Push("b"));
+  EXPECT_EQ(queue.Pop(), "a");
+  queue.Close();
+  EXPECT_FALSE(queue.Push("c"));
+  // Elements pushed before Close() are still delivered.
+  EXPECT_EQ(queue.Pop(), "b");
+  EXPECT_EQ(queue.Pop(), std::nullopt);
+}
+
+TEST(BoundedQueue, CloseWakesBlockedPush) {
+  BoundedQueue<int> queue(1);
+  EXPECT_TRUE(queue.Push(1));
+  std::thread producer([&queue] { EXPECT_FALSE(queue.Push(2)); });
+  queue.Close();
+  producer.join();
+  EXPECT_EQ(queue.Pop(), 1);
+  EXPECT_EQ(queue.Pop(), std::nullopt);
+}
+
+TEST(BoundedQueue, ManyProducersAndConsumers) {
+  constexpr int kNumThreads = 4;
+  constexpr int kValuesPerProducer = 1000;
+  BoundedQueue<int> queue(3);
+  std::atomic<int> num_producers = kNumThreads;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&queue, &num_producers] {
+      for (int value = 1; value <= kValuesPerProducer; ++value) {
+        ASSERT_TRUE(queue.Push(value));
+      }
+      // The last producer closes the queue.
+      if (num_producers.fetch_sub(1) == 1) queue.Close();
+    });
+  }
+  std::vector<int64_t> sums(kNumThreads);
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&queue, &sum = sums[i]] {
+      while (std::optional<int> value = queue.Pop()) sum += *value;
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  int64_t total = 0;
+  for (int64_t sum : sums) total += sum;
+  EXPECT_EQ(total, kNumThreads * kValuesPerProducer *
+                       (kValuesPerProducer + 1) / 2);
+}
+
+}  // namespace
+}  // namespace silifuzz
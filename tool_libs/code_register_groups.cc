@@ -0,0 +1,58 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tool_libs/code_register_groups.h"
+
+#include <cstdint>
+
+#include "./common/memory_perms.h"
+#include "./common/snapshot.h"
+#include "./instruction/xed_util.h"
+#include "./util/arch.h"
+#include "./util/reg_group_set.h"
+
+namespace silifuzz {
+
+template <>
+RegisterGroupSet<X86_64> CodeRegisterGroups(const Snapshot& snapshot) {
+  InitXedIfNeeded();
+  RegisterGroupSet<X86_64> groups;
+  DecodedInstructionBuffer decoded;
+  for (const Snapshot::MemoryMapping& mapping : snapshot.memory_mappings()) {
+    if (!mapping.perms().Has(MemoryPerms::kExecutable)) continue;
+    for (const Snapshot::MemoryBytes& memory_bytes : snapshot.memory_bytes()) {
+      if (memory_bytes.start_address() < mapping.start_address() ||
+          memory_bytes.start_address() >= mapping.limit_address()) {
+        continue;
+      }
+      const Snapshot::ByteData& bytes = memory_bytes.byte_values();
+      DecodeInstructionBuffer(reinterpret_cast<const uint8_t*>(bytes.data()),
+                              bytes.size(), decoded);
+      for (uint8_t attributes : decoded.attributes) {
+        if (attributes & kInsnUsesAVX512State) {
+          return groups.SetAVX512(true);
+        }
+      }
+    }
+  }
+  return groups;
+}
+
+template <>
+RegisterGroupSet<AArch64> CodeRegisterGroups(const Snapshot& snapshot) {
+  // Nothing on AArch64 affects scheduling yet.
+  return RegisterGroupSet<AArch64>();
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,34 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_TOOL_LIBS_CODE_REGISTER_GROUPS_H_
+#define THIRD_PARTY_SILIFUZZ_TOOL_LIBS_CODE_REGISTER_GROUPS_H_
+
+#include "./common/snapshot.h"
+#include "./util/reg_group_set.h"
+
+namespace silifuzz {
+
+// Returns the register groups that the code of `snapshot` may access, for
+// Snap::code_register_groups. The executable memory bytes are decoded back to
+// back, so bytes that are never executed may add groups. Only groups that
+// matter for scheduling snaps are reported, currently AVX-512 on x86-64.
+//
+// This function is thread-safe.
+template <typename Arch>
+RegisterGroupSet<Arch> CodeRegisterGroups(const Snapshot& snapshot);
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_TOOL_LIBS_CODE_REGISTER_GROUPS_H_
@@ -0,0 +1,52 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tool_libs/code_register_groups.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "./common/raw_insns_util.h"
+#include "./common/snapshot.h"
+#include "./util/arch.h"
+#include "./util/reg_group_set.h"
+#include "./util/testing/status_macros.h"
+
+namespace silifuzz {
+namespace {
+
+TEST(CodeRegisterGroups, X86_64) {
+  // vpxor ymm0, ymm0, ymm0
+  const std::string avx = {'\xc5', '\xfd', '\xef', '\xc0'};
+  ASSERT_OK_AND_ASSIGN(Snapshot avx_snapshot,
+                       InstructionsToSnapshot<X86_64>(avx));
+  EXPECT_FALSE(CodeRegisterGroups<X86_64>(avx_snapshot).GetAVX512());
+
+  // vpxord zmm0, zmm0, zmm0
+  const std::string avx512 = {'\x62', '\xf1', '\x7d', '\x48', '\xef', '\xc0'};
+  ASSERT_OK_AND_ASSIGN(Snapshot avx512_snapshot,
+                       InstructionsToSnapshot<X86_64>(avx512));
+  EXPECT_TRUE(CodeRegisterGroups<X86_64>(avx512_snapshot).GetAVX512());
+}
+
+TEST(CodeRegisterGroups, AArch64) {
+  // add x0, x0, #1
+  const std::string code = {'\x00', '\x04', '\x00', '\x91'};
+  ASSERT_OK_AND_ASSIGN(Snapshot snapshot,
+                       InstructionsToSnapshot<AArch64>(code));
+  EXPECT_TRUE(CodeRegisterGroups<AArch64>(snapshot).Empty());
+}
+
+}  // namespace
+}  // namespace silifuzz
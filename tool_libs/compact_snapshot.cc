@@ -0,0 +1,55 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tool_libs/compact_snapshot.h"
+
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "./common/snapshot.h"
+#include "./common/snapshot_proto.h"
+#include "./proto/snapshot.pb.h"
+#include "./util/checks.h"
+#include "./util/zstd_util.h"
+
+namespace silifuzz {
+
+// static
+absl::StatusOr<CompactSnapshot> CompactSnapshot::Create(
+    const Snapshot& snapshot, int level) {
+  proto::Snapshot proto;
+  SnapshotProto::ToProto(snapshot, &proto);
+  std::string serialized;
+  if (!proto.SerializeToString(&serialized)) {
+    return absl::InternalError("Cannot serialize snapshot");
+  }
+  ASSIGN_OR_RETURN_IF_NOT_OK(std::string compressed,
+                             ZstdCompress(serialized, level));
+  compressed.shrink_to_fit();
+  return CompactSnapshot(SnapshotSummary(snapshot), std::move(compressed));
+}
+
+absl::StatusOr<Snapshot> CompactSnapshot::ToSnapshot() const {
+  ASSIGN_OR_RETURN_IF_NOT_OK(std::string serialized,
+                             ZstdDecompress(compressed_proto_));
+  proto::Snapshot proto;
+  if (!proto.ParseFromString(serialized)) {
+    return absl::InternalError("Cannot parse snapshot");
+  }
+  return SnapshotProto::FromProto(std::move(proto));
+}
+
+}  // namespace silifuzz
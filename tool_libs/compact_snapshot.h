@@ -0,0 +1,82 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_TOOL_LIBS_COMPACT_SNAPSHOT_H_
+#define THIRD_PARTY_SILIFUZZ_TOOL_LIBS_COMPACT_SNAPSHOT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "absl/status/statusor.h"
+#include "./common/snapshot.h"
+#include "./tool_libs/snap_group.h"
+
+namespace silifuzz {
+
+// A read-only, compressed form of a Snapshot for tools that hold a whole
+// corpus in memory. Only the SnapshotGroup::SnapshotSummary of the snapshot,
+// which is all that partitioning needs, is kept uncompressed. The rest is
+// kept as a zstd-compressed snapshot proto. Memory bytes of snapshots are
+// mostly zero-filled pages, so this is typically many times smaller than the
+// Snapshot itself. Use ToSnapshot() to get a Snapshot that can be modified.
+//
+// This class is thread-compatible.
+class CompactSnapshot {
+ public:
+  using SnapshotSummary = SnapshotGroup::SnapshotSummary;
+
+  // Compresses `snapshot` using zstd compression `level`.
+  static absl::StatusOr<CompactSnapshot> Create(const Snapshot& snapshot,
+                                                int level = 1);
+
+  ~CompactSnapshot() = default;
+
+  // Movable, but not copyable (like Snapshot).
+  CompactSnapshot(const CompactSnapshot&) = delete;
+  CompactSnapshot(CompactSnapshot&&) = default;
+  CompactSnapshot& operator=(const CompactSnapshot&) = delete;
+  CompactSnapshot& operator=(CompactSnapshot&&) = default;
+
+  const Snapshot::Id& id() const { return summary_.id(); }
+  const SnapshotSummary& summary() const { return summary_; }
+
+  // Replaces SnapshotSummary::execution_cost() of summary(), e.g. with a
+  // measured cost.
+  void set_execution_cost(uint64_t execution_cost) {
+    summary_ = SnapshotSummary(summary_.id(), summary_.memory_mappings(),
+                               summary_.sort_key(), summary_.size_in_bytes(),
+                               execution_cost);
+  }
+
+  // Returns the number of bytes used by the compressed snapshot proto.
+  size_t compressed_size() const { return compressed_proto_.size(); }
+
+  // Returns the snapshot this was created from.
+  absl::StatusOr<Snapshot> ToSnapshot() const;
+
+ private:
+  CompactSnapshot(const SnapshotSummary& summary, std::string compressed_proto)
+      : summary_(summary), compressed_proto_(std::move(compressed_proto)) {}
+
+  SnapshotSummary summary_;
+
+  // Serialized proto::Snapshot compressed by ZstdCompress().
+  std::string compressed_proto_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_TOOL_LIBS_COMPACT_SNAPSHOT_H_
@@ -0,0 +1,45 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tool_libs/compact_snapshot.h"
+
+#include "gtest/gtest.h"
+#include "./common/snapshot.h"
+#include "./common/snapshot_test_enum.h"
+#include "./common/snapshot_test_util.h"
+#include "./tool_libs/snap_group.h"
+#include "./util/arch.h"
+#include "./util/testing/status_macros.h"
+
+namespace silifuzz {
+namespace {
+
+TEST(CompactSnapshot, RoundTrip) {
+  Snapshot snapshot = CreateTestSnapshot<Host>(TestSnapshot::kEndsAsExpected);
+  ASSERT_OK_AND_ASSIGN(CompactSnapshot compact,
+                       CompactSnapshot::Create(snapshot));
+  EXPECT_EQ(compact.id(), snapshot.id());
+
+  const SnapshotGroup::SnapshotSummary expected_summary(snapshot);
+  EXPECT_EQ(compact.summary(), expected_summary);
+  EXPECT_EQ(compact.summary().memory_mappings(), snapshot.memory_mappings());
+  EXPECT_EQ(compact.summary().size_in_bytes(),
+            expected_summary.size_in_bytes());
+
+  ASSERT_OK_AND_ASSIGN(Snapshot restored, compact.ToSnapshot());
+  EXPECT_EQ(restored, snapshot);
+}
+
+}  // namespace
+}  // namespace silifuzz
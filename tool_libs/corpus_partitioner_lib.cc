@@ -16,6 +16,8 @@
 
 #include <stdint.h>
 
+#include <cstddef>
+
 #include "absl/algorithm/container.h"
 #include "./tool_libs/snap_group.h"
 #include "./util/checks.h"
@@ -24,7 +26,8 @@ namespace silifuzz {
 
 SnapshotPartition PartitionCorpus(
     int32_t num_groups, int32_t num_iterations,
-    SnapshotGroup::SnapshotSummaryList& ungrouped) {
+    SnapshotGroup::SnapshotSummaryList& ungrouped,
+    SnapshotPartition::Balance balance) {
   // Sort summaries to make output deterministic.
   absl::c_sort(ungrouped);
 
@@ -33,7 +36,11 @@ SnapshotPartition PartitionCorpus(
   SnapshotPartition partition(num_groups,
                               SnapshotGroup::kAllowWriteConflictsWithSamePerm);
   for (int32_t i = 0; i < num_iterations && !ungrouped.empty(); ++i) {
-    partition.PartitionSnapshots(ungrouped);
+    const size_t num_ungrouped = ungrouped.size();
+    partition.PartitionSnapshotsIndexed(ungrouped, balance);
+    // Leftovers conflict with every group that has room, so further
+    // iterations cannot place them.
+    if (ungrouped.size() == num_ungrouped) break;
   }
 
   if (!ungrouped.empty()) {
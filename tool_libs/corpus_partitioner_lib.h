@@ -22,13 +22,21 @@
 namespace silifuzz {
 
 // Creates a corpus partition of `num_groups` groups using summary information
-// in `ungrouped`. Partitioning is done iteratively using a heuristic that
-// removes entries in `ungrouped` until `ungrouped` is empty or `num_iterations`
-// attempts has been made. When partitioning finishes, `ungrouped` contains any
-// remaining Snaps that cannot be placed due to conflicts.
+// in `ungrouped`. The groups are balanced on the total size and total
+// estimated execution cost of their Snaps. Partitioning is done iteratively
+// using SnapshotPartition::PartitionSnapshotsIndexed(), which removes entries
+// in `ungrouped` until `ungrouped` is empty, an iteration makes no progress or
+// `num_iterations` attempts has been made. When partitioning finishes,
+// `ungrouped` contains any remaining Snaps that cannot be placed due to
+// conflicts.
+// Partitions `ungrouped` into `num_groups` groups of non-conflicting snapshots
+// balanced as described by `balance`, making up to `num_iterations` passes.
+// Snapshots that cannot be placed are left in `ungrouped`.
 SnapshotPartition PartitionCorpus(
     int32_t num_groups, int32_t num_iterations,
-    SnapshotGroup::SnapshotSummaryList& ungrouped);
+    SnapshotGroup::SnapshotSummaryList& ungrouped,
+    SnapshotPartition::Balance balance =
+        SnapshotPartition::Balance::kSizeAndCost);
 
 }  // namespace silifuzz
 
@@ -95,6 +95,95 @@ TEST(CorpusPartitionerLib, IsDeterministic) {
   }
 }
 
+// Returns a summary of a snapshot with a single read-only code page at
+// `page_number`.
+SnapshotGroup::SnapshotSummary MakeSummary(const std::string& id,
+                                           Snapshot::Address page_number,
+                                           uint64_t size_in_bytes,
+                                           uint64_t execution_cost) {
+  constexpr Snapshot::Address kPageSize = 0x1000;
+  return SnapshotGroup::SnapshotSummary(
+      id,
+      {MemoryMapping::MakeSized(page_number * kPageSize, kPageSize,
+                                MemoryPerms::XR())},
+      0, size_in_bytes, execution_cost);
+}
+
+TEST(CorpusPartitionerLib, BalancesSize) {
+  SnapshotGroup::SnapshotSummaryList list = {
+      MakeSummary("a", 0x2000, 600, 0), MakeSummary("b", 0x2001, 100, 0),
+      MakeSummary("c", 0x2002, 100, 0), MakeSummary("d", 0x2003, 100, 0),
+      MakeSummary("e", 0x2004, 100, 0)};
+  SnapshotPartition partition = PartitionCorpus(2, 1, list);
+  EXPECT_TRUE(list.empty());
+  const auto& groups = partition.snapshot_groups();
+  ASSERT_EQ(groups.size(), 2);
+  EXPECT_THAT(groups[0].id_list(), UnorderedElementsAreArray({"a"}));
+  EXPECT_THAT(groups[1].id_list(),
+              UnorderedElementsAreArray({"b", "c", "d", "e"}));
+  EXPECT_EQ(groups[0].size_in_bytes(), 600);
+  EXPECT_EQ(groups[1].size_in_bytes(), 400);
+}
+
+TEST(CorpusPartitionerLib, BalancesExecutionCost) {
+  SnapshotGroup::SnapshotSummaryList list = {
+      MakeSummary("a", 0x2000, 0, 3000), MakeSummary("b", 0x2001, 0, 1000),
+      MakeSummary("c", 0x2002, 0, 1000), MakeSummary("d", 0x2003, 0, 1000)};
+  SnapshotPartition partition = PartitionCorpus(2, 1, list);
+  EXPECT_TRUE(list.empty());
+  const auto& groups = partition.snapshot_groups();
+  ASSERT_EQ(groups.size(), 2);
+  EXPECT_EQ(groups[0].execution_cost(), 3000);
+  EXPECT_EQ(groups[1].execution_cost(), 3000);
+  EXPECT_EQ(groups[1].size(), 3);
+}
+
+TEST(CorpusPartitionerLib, BalancesRespectConflicts) {
+  // "c" overlaps "b", so it goes to the more loaded group.
+  SnapshotGroup::SnapshotSummaryList list = {
+      MakeSummary("a", 0x2000, 1000, 0), MakeSummary("b", 0x2001, 100, 0),
+      MakeSummary("c", 0x2001, 100, 0)};
+  SnapshotPartition partition = PartitionCorpus(2, 1, list);
+  EXPECT_TRUE(list.empty());
+  const auto& groups = partition.snapshot_groups();
+  ASSERT_EQ(groups.size(), 2);
+  EXPECT_THAT(groups[0].id_list(), UnorderedElementsAreArray({"a", "c"}));
+  EXPECT_THAT(groups[1].id_list(), UnorderedElementsAreArray({"b"}));
+}
+
+TEST(CorpusPartitionerLib, StableHashKeepsAssignments) {
+  constexpr int32_t kNumGroups = 10;
+  SnapshotGroup::SnapshotSummaryList list = GenTestSnapshotSummaryList(100);
+  SnapshotGroup::SnapshotSummaryList grown = GenTestSnapshotSummaryList(120);
+  SnapshotPartition partition = PartitionCorpus(
+      kNumGroups, 1, list, SnapshotPartition::Balance::kStableHash);
+  SnapshotPartition grown_partition = PartitionCorpus(
+      kNumGroups, 1, grown, SnapshotPartition::Balance::kStableHash);
+  EXPECT_TRUE(list.empty());
+  EXPECT_TRUE(grown.empty());
+
+  // Adding snapshots without conflicts leaves existing ones in place.
+  for (int32_t i = 0; i < kNumGroups; ++i) {
+    for (const std::string& id : partition.snapshot_groups()[i].id_list()) {
+      EXPECT_TRUE(grown_partition.snapshot_groups()[i].contains(id)) << id;
+    }
+  }
+}
+
+TEST(CorpusPartitionerLib, StableHashSpillsConflicts) {
+  // Snapshots mapping the same page never share a group.
+  SnapshotGroup::SnapshotSummaryList list;
+  for (int i = 0; i < 4; ++i) {
+    list.push_back(MakeSummary(absl::StrCat("s", i), 0x2000, 100, 0));
+  }
+  SnapshotPartition partition =
+      PartitionCorpus(4, 1, list, SnapshotPartition::Balance::kStableHash);
+  EXPECT_TRUE(list.empty());
+  for (const auto& group : partition.snapshot_groups()) {
+    EXPECT_EQ(group.size(), 1);
+  }
+}
+
 }  // namespace
 
 }  // namespace silifuzz
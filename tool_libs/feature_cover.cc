@@ -0,0 +1,83 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tool_libs/feature_cover.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/types/span.h"
+
+namespace silifuzz {
+
+std::vector<size_t> GreedyFeatureCover(
+    absl::Span<const std::vector<uint64_t>> features) {
+  // Lazy greedy: the number of new features of an input only decreases as
+  // features are covered, so a stale count in the queue is an upper bound.
+  // An input whose recounted number is still at least the next best bound
+  // is the best input.
+  struct Candidate {
+    size_t num_new_features;
+    size_t index;
+
+    // Most new features first, then lowest index.
+    bool operator<(const Candidate& other) const {
+      if (num_new_features != other.num_new_features) {
+        return num_new_features < other.num_new_features;
+      }
+      return index > other.index;
+    }
+  };
+
+  // Sorted sets without duplicates so that counts are exact.
+  std::vector<std::vector<uint64_t>> sets(features.begin(), features.end());
+  std::priority_queue<Candidate> candidates;
+  absl::flat_hash_set<uint64_t> all_features;
+  for (size_t i = 0; i < sets.size(); ++i) {
+    std::vector<uint64_t>& set = sets[i];
+    std::sort(set.begin(), set.end());
+    set.erase(std::unique(set.begin(), set.end()), set.end());
+    if (set.empty()) continue;
+    all_features.insert(set.begin(), set.end());
+    candidates.push({set.size(), i});
+  }
+
+  absl::flat_hash_set<uint64_t> covered;
+  covered.reserve(all_features.size());
+  std::vector<size_t> cover;
+  while (!candidates.empty() && covered.size() < all_features.size()) {
+    Candidate candidate = candidates.top();
+    candidates.pop();
+    const std::vector<uint64_t>& set = sets[candidate.index];
+    candidate.num_new_features = std::count_if(
+        set.begin(), set.end(),
+        [&covered](uint64_t feature) { return !covered.contains(feature); });
+    if (candidate.num_new_features == 0) continue;
+    if (!candidates.empty() && candidate < candidates.top()) {
+      // Another input may be better.
+      candidates.push(candidate);
+      continue;
+    }
+    covered.insert(set.begin(), set.end());
+    cover.push_back(candidate.index);
+  }
+  std::sort(cover.begin(), cover.end());
+  return cover;
+}
+
+}  // namespace silifuzz
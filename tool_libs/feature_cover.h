@@ -0,0 +1,39 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_TOOL_LIBS_FEATURE_COVER_H_
+#define THIRD_PARTY_SILIFUZZ_TOOL_LIBS_FEATURE_COVER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "absl/types/span.h"
+
+namespace silifuzz {
+
+// Returns the indices of a subset of `features` whose union is the union of
+// all of `features`, in increasing order. features[i] is the set of features,
+// e.g. proxy user features, of input i, in any order. Duplicates are allowed.
+//
+// The subset is chosen greedily: the input covering the most features not
+// covered yet is taken first, ties are broken by the lower index. This is
+// the classic approximation of a minimum set cover. Inputs without features
+// are never taken.
+std::vector<size_t> GreedyFeatureCover(
+    absl::Span<const std::vector<uint64_t>> features);
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_TOOL_LIBS_FEATURE_COVER_H_
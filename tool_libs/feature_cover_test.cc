@@ -0,0 +1,90 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tool_libs/feature_cover.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace silifuzz {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+TEST(GreedyFeatureCover, Empty) {
+  EXPECT_THAT(GreedyFeatureCover({}), IsEmpty());
+  EXPECT_THAT(GreedyFeatureCover({{}, {}}), IsEmpty());
+}
+
+TEST(GreedyFeatureCover, DropsRedundantInputs) {
+  const std::vector<std::vector<uint64_t>> features = {
+      {1, 2},           // Covered by input 2.
+      {},               // No features.
+      {1, 2, 3, 4},     //
+      {4, 5},           //
+      {5, 4, 5},        // Duplicate of input 3.
+      {3},              // Covered by input 2.
+  };
+  EXPECT_THAT(GreedyFeatureCover(features), ElementsAre(2, 3));
+}
+
+TEST(GreedyFeatureCover, Greedy) {
+  // The largest set is taken first even though the two others alone cover
+  // everything.
+  const std::vector<std::vector<uint64_t>> features = {
+      {1, 2, 3, 4},
+      {1, 2, 3, 4, 5, 6},
+      {5, 6, 7, 8},
+      {7, 8},
+  };
+  EXPECT_THAT(GreedyFeatureCover(features), ElementsAre(1, 2));
+}
+
+TEST(GreedyFeatureCover, TiesPickLowestIndex) {
+  const std::vector<std::vector<uint64_t>> features = {
+      {1},
+      {2, 3},
+      {3, 4},
+      {2, 4},
+  };
+  // Input 1 goes first, then input 2 and 3 both add feature 4.
+  EXPECT_THAT(GreedyFeatureCover(features), ElementsAre(0, 1, 2));
+}
+
+TEST(GreedyFeatureCover, CoversAllFeatures) {
+  std::vector<std::vector<uint64_t>> features(100);
+  for (size_t i = 0; i < features.size(); ++i) {
+    for (uint64_t feature = i % 7; feature < 300; feature += 1 + i % 13) {
+      features[i].push_back(feature);
+    }
+  }
+  std::vector<bool> all(300), covered(300);
+  for (const auto& set : features) {
+    for (uint64_t feature : set) all[feature] = true;
+  }
+  const std::vector<size_t> cover = GreedyFeatureCover(features);
+  EXPECT_LT(cover.size(), features.size());
+  for (size_t index : cover) {
+    for (uint64_t feature : features[index]) covered[feature] = true;
+  }
+  EXPECT_EQ(covered, all);
+}
+
+}  // namespace
+}  // namespace silifuzz
@@ -14,8 +14,10 @@
 
 #include "./tool_libs/fix_tool_common.h"
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
@@ -35,23 +37,33 @@
 #include "./util/platform.h"
 #include "./util/ucontext/ucontext_types.h"
 
+#if defined(__x86_64__)
+#include "./instruction/decoded_insn.h"
+#endif
+
 namespace silifuzz {
 namespace fix_tool_internal {
 namespace {
 
-// Runs `snapshot` through the maker to construct end state and verifies
-// the remade snapshot to filter out any problematic snapshot.
-// Returns the remade snapshot or an error status.
-absl::StatusOr<Snapshot> RemakeAndVerify(const Snapshot& snapshot,
-                                         const FixupSnapshotOptions& options) {
+// Returns the MakingConfig for fixing up snapshots with `options`.
+MakingConfig MakingConfigFor(const FixupSnapshotOptions& options) {
   MakingConfig config = MakingConfig::Default();
   config.runner_path = RunnerLocation();
   config.trace.x86_filter_split_lock = options.x86_filter_split_lock;
   config.trace.x86_filter_vsyscall_region_access =
       options.x86_filter_vsyscall_region_access;
   config.trace.filter_memory_access = options.filter_memory_access;
+  config.stage_times = options.stage_times;
+  config.zygote_pool = options.zygote_pool;
+  return config;
+}
 
-  return MakeSnapshot(snapshot, config);
+// Runs `snapshot` through the maker to construct end state and verifies
+// the remade snapshot to filter out any problematic snapshot.
+// Returns the remade snapshot or an error status.
+absl::StatusOr<Snapshot> RemakeAndVerify(Snapshot&& snapshot,
+                                         const FixupSnapshotOptions& options) {
+  return MakeSnapshot(std::move(snapshot), MakingConfigFor(options));
 }
 
 }  // namespace
@@ -140,6 +152,40 @@ bool RewriteInitialState(Snapshot& snapshot, FixToolCounters* counters) {
                        snapshot, counters);
 }
 
+bool PrefilterInstructions(absl::string_view code,
+                           const FixupSnapshotOptions& options,
+                           FixToolCounters* counters) {
+#if defined(__x86_64__)
+  // Longest possible x86 instruction. A shorter tail that does not decode may
+  // be a truncated instruction that decodes once followed by the exit
+  // sequence, so it is not a reason to reject.
+  constexpr size_t kMaxX86InsnLength = 15;
+  absl::string_view reason;
+  while (!code.empty()) {
+    DecodedInsn insn(code);
+    if (!insn.is_valid()) {
+      if (code.size() >= kMaxX86InsnLength) reason = "undecodable";
+      break;
+    }
+    if (!insn.is_deterministic()) {
+      reason = "non-deterministic";
+      break;
+    }
+    if (options.filter_memory_access && insn.may_access_memory()) {
+      reason = "memory-access";
+      break;
+    }
+    if (insn.may_branch()) break;
+    code.remove_prefix(insn.length());
+  }
+  if (!reason.empty()) {
+    counters->Increment(absl::StrCat("silifuzz-ERROR-Prefilter:", reason));
+    return false;
+  }
+#endif
+  return true;
+}
+
 std::string SnapshotOrigin(const Snapshot& input) {
   if (input.metadata().origin() == Snapshot::Metadata::Origin::kUseString) {
     return std::string(input.metadata().origin_string());
@@ -150,13 +196,20 @@ std::string SnapshotOrigin(const Snapshot& input) {
 absl::StatusOr<Snapshot> FixupSnapshot(const Snapshot& input,
                                        const FixupSnapshotOptions& options,
                                        PlatformFixToolCounters* counters) {
+  return FixupSnapshot(input.Copy(), options, counters);
+}
+
+absl::StatusOr<Snapshot> FixupSnapshot(Snapshot&& input,
+                                       const FixupSnapshotOptions& options,
+                                       PlatformFixToolCounters* counters) {
   const std::string origin = SnapshotOrigin(input);
 
   // Count the number of inputs so we can easily normalize the counters that
   // come after this - both per-origin and aggregated counters.
   counters->IncOriginCounter(origin, "INFO-INPUT");
 
-  absl::StatusOr<Snapshot> remade_snapshot_or = RemakeAndVerify(input, options);
+  absl::StatusOr<Snapshot> remade_snapshot_or =
+      RemakeAndVerify(std::move(input), options);
   if (!remade_snapshot_or.ok()) {
     counters->IncOriginCounter(
         origin, "ERROR-Make:", remade_snapshot_or.status().message());
@@ -189,5 +242,39 @@ absl::StatusOr<Snapshot> FixupSnapshot(const Snapshot& input,
   return remade_snapshot_or;
 }
 
+absl::StatusOr<Snapshot> RecordCurrentPlatformEndState(
+    const Snapshot& input, const FixupSnapshotOptions& options,
+    PlatformFixToolCounters* counters) {
+  const std::string origin = SnapshotOrigin(input);
+  counters->IncOriginCounter(origin, "INFO-RECORD-INPUT");
+
+  absl::StatusOr<Snapshot> recorded_snapshot_or =
+      RecordEndStateOfMadeSnapshot(input, MakingConfigFor(options));
+  if (!recorded_snapshot_or.ok()) {
+    counters->IncOriginCounter(
+        origin, "ERROR-Record:", recorded_snapshot_or.status().message());
+    return recorded_snapshot_or.status();
+  }
+  recorded_snapshot_or->NormalizeAll();
+  counters->IncOriginCounter(origin, "INFO-RECORD-OK");
+  return recorded_snapshot_or;
+}
+
+absl::Status MergeEndStates(Snapshot& snapshot, const Snapshot& other) {
+  if (snapshot.id() != other.id()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "Cannot merge end states of ", other.id(), " into ", snapshot.id()));
+  }
+  for (const Snapshot::EndState& end_state : other.expected_end_states()) {
+    if (int i = snapshot.FindExpectedEndState(end_state); i != -1) {
+      snapshot.add_platforms_to_expected_end_state(i, end_state);
+      continue;
+    }
+    RETURN_IF_NOT_OK(snapshot.can_add_expected_end_state(end_state));
+    snapshot.add_expected_end_state(end_state);
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace fix_tool_internal
 }  // namespace silifuzz
@@ -20,10 +20,13 @@
 #include <cstdint>
 #include <string>
 
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
 #include "./common/snapshot.h"
+#include "./runner/driver/runner_driver.h"
+#include "./runner/make_snapshot.h"
 
 namespace silifuzz {
 namespace fix_tool_internal {
@@ -117,16 +120,55 @@ struct FixupSnapshotOptions {
   // by FixupSnapshot. Note that the snap exit instruction is exempted. This
   // option is x86-only currently and has no effect on other platforms.
   bool filter_memory_access = false;
+
+  // If not null, the time spent in each step of making a snapshot is added
+  // here. Not owned.
+  MakingStageTimes* stage_times = nullptr;
+
+  // If not null, the runners are forked from zygotes of this pool, which must
+  // run RunnerLocation(). Not owned.
+  ZygotePool* zygote_pool = nullptr;
 };
 
+// Cheaply checks raw instructions `code` for reasons FixupSnapshot() with
+// `options` would reject a snapshot made from them, without running anything.
+// Only instructions that certainly run are checked: those from the start of
+// `code` up to the first one that may branch. If one of those is not reached,
+// an earlier one ends the snapshot with a signal, which FixupSnapshot() also
+// rejects. Updates fix tool statistics in `*counters` with the reason of a
+// rejection. Returns true iff `code` passes. This is x86-only and passes
+// everything on other platforms.
+bool PrefilterInstructions(absl::string_view code,
+                           const FixupSnapshotOptions& options,
+                           FixToolCounters* counters);
+
 // Fixes up `input` and updates fix tool statistics in `*counters`.
 // If `x86_filter_split_lock` is true, snapshots containing instructions that
 // access memory across cache line boundaries are filtered. This option is
 // x86-only and has no effect on other platforms.
 // Returns the fixed-up snapshot or an error status.
+// The rvalue overload consumes `input` instead of copying it.
 absl::StatusOr<Snapshot> FixupSnapshot(const Snapshot& input,
                                        const FixupSnapshotOptions& options,
                                        PlatformFixToolCounters* counters);
+absl::StatusOr<Snapshot> FixupSnapshot(Snapshot&& input,
+                                       const FixupSnapshotOptions& options,
+                                       PlatformFixToolCounters* counters);
+
+// Records an end state of `input` for the current platform and updates fix
+// tool statistics in `*counters`. `input` must have been fixed up by
+// FixupSnapshot(), typically on another platform. It is not remade, but the
+// recorded end state is verified and traced like FixupSnapshot() does using
+// `options`. Returns `input` with the recorded end state as its only end
+// state, or an error status.
+absl::StatusOr<Snapshot> RecordCurrentPlatformEndState(
+    const Snapshot& input, const FixupSnapshotOptions& options,
+    PlatformFixToolCounters* counters);
+
+// Merges the expected end states of `other` into `snapshot`, which must have
+// the same ID. An end state equal to one of `snapshot` in all but platforms
+// adds its platforms to that one. Any other end state is added as is.
+absl::Status MergeEndStates(Snapshot& snapshot, const Snapshot& other);
 
 }  // namespace fix_tool_internal
 }  // namespace silifuzz
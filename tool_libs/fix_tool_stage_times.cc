@@ -0,0 +1,103 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tool_libs/fix_tool_stage_times.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/numeric/bits.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+
+namespace silifuzz::fix_tool_internal {
+
+absl::Duration FixToolStageTimes::Stage::Quantile(double fraction) const {
+  if (count == 0) return absl::ZeroDuration();
+  uint64_t num_seen = 0;
+  for (int bucket = 0; bucket < kNumBuckets; ++bucket) {
+    num_seen += buckets[bucket];
+    if (num_seen >= fraction * count && num_seen > 0) {
+      return std::min(absl::Microseconds(uint64_t{1} << bucket), max);
+    }
+  }
+  return max;
+}
+
+void FixToolStageTimes::Record(absl::string_view stage,
+                               absl::Duration duration) {
+  Stage& s = stages_[stage];
+  ++s.count;
+  s.total += duration;
+  s.max = std::max(s.max, duration);
+  const uint64_t micros = absl::ToInt64Microseconds(duration);
+  const int bucket =
+      std::min<int>(micros == 0 ? 0 : absl::bit_width(micros), kNumBuckets - 1);
+  ++s.buckets[bucket];
+}
+
+void FixToolStageTimes::RecordMakeThroughput(size_t num_blobs,
+                                             absl::Duration duration) {
+  num_blobs_made_ += num_blobs;
+  make_wall_time_ += duration;
+}
+
+void FixToolStageTimes::Merge(const FixToolStageTimes& other) {
+  for (const auto& [name, other_stage] : other.stages_) {
+    Stage& stage = stages_[name];
+    stage.count += other_stage.count;
+    stage.total += other_stage.total;
+    stage.max = std::max(stage.max, other_stage.max);
+    for (int bucket = 0; bucket < kNumBuckets; ++bucket) {
+      stage.buckets[bucket] += other_stage.buckets[bucket];
+    }
+  }
+  RecordMakeThroughput(other.num_blobs_made_, other.make_wall_time_);
+}
+
+const FixToolStageTimes::Stage* FixToolStageTimes::GetStage(
+    absl::string_view stage) const {
+  auto it = stages_.find(stage);
+  return it != stages_.end() ? &it->second : nullptr;
+}
+
+double FixToolStageTimes::BlobsPerSecond() const {
+  const double seconds = absl::ToDoubleSeconds(make_wall_time_);
+  return seconds > 0 ? num_blobs_made_ / seconds : 0.0;
+}
+
+std::vector<std::string> FixToolStageTimes::Report() const {
+  std::vector<std::string> lines;
+  for (const auto& [name, stage] : stages_) {
+    lines.push_back(absl::StrFormat(
+        "%s: count %d total %s mean %s p50 %s p90 %s p99 %s max %s", name,
+        stage.count, absl::FormatDuration(stage.total),
+        absl::FormatDuration(stage.total / std::max<uint64_t>(stage.count, 1)),
+        absl::FormatDuration(stage.Quantile(0.5)),
+        absl::FormatDuration(stage.Quantile(0.9)),
+        absl::FormatDuration(stage.Quantile(0.99)),
+        absl::FormatDuration(stage.max)));
+  }
+  lines.push_back(absl::StrFormat("blobs made: %d in %s, %.2f blobs/s",
+                                  num_blobs_made_,
+                                  absl::FormatDuration(make_wall_time_),
+                                  BlobsPerSecond()));
+  return lines;
+}
+
+}  // namespace silifuzz::fix_tool_internal
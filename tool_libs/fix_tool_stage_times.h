@@ -0,0 +1,94 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_TOOL_LIBS_FIX_TOOL_STAGE_TIMES_H_
+#define THIRD_PARTY_SILIFUZZ_TOOL_LIBS_FIX_TOOL_STAGE_TIMES_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/container/btree_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+
+namespace silifuzz::fix_tool_internal {
+
+// Histograms of the wall time spent in each stage of the fix tool, e.g.
+// making a snapshot or writing a shard, plus the overall rate at which blobs
+// are made. This tells which stage to optimize first and how many blobs a
+// machine fixes per second.
+//
+// Like SimpleFixToolCounters, each worker thread records into its own object
+// and the objects are merged when the workers are done.
+//
+// This class is thread-compatible.
+class FixToolStageTimes {
+ public:
+  // Bucket i of a histogram counts durations in [2^(i-1), 2^i) microseconds.
+  // Bucket 0 counts durations below 1us and the last bucket also counts all
+  // longer durations.
+  static constexpr int kNumBuckets = 40;
+
+  struct Stage {
+    uint64_t count = 0;
+    absl::Duration total;
+    absl::Duration max;
+    std::array<uint64_t, kNumBuckets> buckets = {};
+
+    // Returns the upper bound of the bucket containing the `fraction`
+    // quantile, e.g. 0.5 for the median. Returns zero if count is 0.
+    absl::Duration Quantile(double fraction) const;
+  };
+
+  FixToolStageTimes() = default;
+  ~FixToolStageTimes() = default;
+
+  // Copyable and movable.
+  FixToolStageTimes(const FixToolStageTimes&) = default;
+  FixToolStageTimes(FixToolStageTimes&&) = default;
+  FixToolStageTimes& operator=(const FixToolStageTimes&) = default;
+  FixToolStageTimes& operator=(FixToolStageTimes&&) = default;
+
+  // Records one run of `stage` that took `duration`.
+  void Record(absl::string_view stage, absl::Duration duration);
+
+  // Records that `num_blobs` blobs were made in wall time `duration` by all
+  // workers together.
+  void RecordMakeThroughput(size_t num_blobs, absl::Duration duration);
+
+  // Adds the times recorded in `other`.
+  void Merge(const FixToolStageTimes& other);
+
+  // Returns the histogram of `stage` or nullptr if it was never recorded.
+  const Stage* GetStage(absl::string_view stage) const;
+
+  // Returns the blobs made per second of wall time.
+  double BlobsPerSecond() const;
+
+  // Returns a human-readable report with one line per stage, in order of
+  // stage names, and one line for the blob rate.
+  std::vector<std::string> Report() const;
+
+ private:
+  absl::btree_map<std::string, Stage> stages_;
+  size_t num_blobs_made_ = 0;
+  absl::Duration make_wall_time_;
+};
+
+}  // namespace silifuzz::fix_tool_internal
+
+#endif  // THIRD_PARTY_SILIFUZZ_TOOL_LIBS_FIX_TOOL_STAGE_TIMES_H_
@@ -0,0 +1,83 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tool_libs/fix_tool_stage_times.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/time/time.h"
+
+namespace silifuzz {
+namespace fix_tool_internal {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::HasSubstr;
+
+TEST(FixToolStageTimes, Record) {
+  FixToolStageTimes times;
+  EXPECT_EQ(times.GetStage("make"), nullptr);
+  times.Record("make", absl::Microseconds(3));
+  times.Record("make", absl::Microseconds(100));
+  times.Record("make", absl::Microseconds(100));
+  const FixToolStageTimes::Stage* stage = times.GetStage("make");
+  ASSERT_NE(stage, nullptr);
+  EXPECT_EQ(stage->count, 3);
+  EXPECT_EQ(stage->total, absl::Microseconds(203));
+  EXPECT_EQ(stage->max, absl::Microseconds(100));
+  EXPECT_EQ(stage->buckets[2], 1);
+  EXPECT_EQ(stage->buckets[7], 2);
+  EXPECT_EQ(stage->Quantile(0.3), absl::Microseconds(4));
+  EXPECT_EQ(stage->Quantile(0.5), absl::Microseconds(100));
+  EXPECT_EQ(stage->Quantile(1), absl::Microseconds(100));
+}
+
+TEST(FixToolStageTimes, LongDurationsGoToLastBucket) {
+  FixToolStageTimes times;
+  times.Record("write", absl::Hours(1000));
+  const FixToolStageTimes::Stage* stage = times.GetStage("write");
+  ASSERT_NE(stage, nullptr);
+  EXPECT_EQ(stage->buckets[FixToolStageTimes::kNumBuckets - 1], 1);
+}
+
+TEST(FixToolStageTimes, Merge) {
+  FixToolStageTimes times1;
+  times1.Record("make", absl::Milliseconds(1));
+  times1.RecordMakeThroughput(10, absl::Seconds(1));
+  FixToolStageTimes times2;
+  times2.Record("make", absl::Milliseconds(2));
+  times2.Record("snapify", absl::Milliseconds(3));
+  times2.RecordMakeThroughput(30, absl::Seconds(1));
+
+  times1.Merge(times2);
+  EXPECT_EQ(times1.GetStage("make")->count, 2);
+  EXPECT_EQ(times1.GetStage("make")->max, absl::Milliseconds(2));
+  EXPECT_EQ(times1.GetStage("snapify")->count, 1);
+  EXPECT_DOUBLE_EQ(times1.BlobsPerSecond(), 20.0);
+}
+
+TEST(FixToolStageTimes, Report) {
+  FixToolStageTimes times;
+  times.Record("snapify", absl::Milliseconds(1));
+  times.Record("make", absl::Milliseconds(1));
+  times.RecordMakeThroughput(5, absl::Seconds(2));
+  EXPECT_THAT(times.Report(),
+              ElementsAre(HasSubstr("make: count 1"),
+                          HasSubstr("snapify: count 1"),
+                          HasSubstr("2.50 blobs/s")));
+}
+
+}  // namespace
+}  // namespace fix_tool_internal
+}  // namespace silifuzz
@@ -16,12 +16,22 @@
 
 #include <sys/types.h>
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <set>
 #include <thread>  // NOLINT(build/c++11)
+#include <tuple>
 #include <vector>
 
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/container/inlined_vector.h"
 #include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "./common/mapped_memory_map.h"
 #include "./common/memory_perms.h"
 #include "./common/snapshot.h"
@@ -38,35 +48,29 @@ absl::Status SnapshotGroup::CanAddSnapshot(
   }
 
   // Check mappings of snap for conflicts with existing mappings.
-  for (const auto& mapping : snapshot_summary.memory_mappings()) {
-    // Writable mapping can overlap with mappings having exactly the same
-    // permissions if conflict resolution permits.
-    if (conflict_resolution_ == kAllowWriteConflictsWithSamePerm &&
-        mapping.perms().Has(MemoryPerms::kWritable)) {
-      MemoryPerms mapped_perms = mapping.perms().Plus(MemoryPerms::kMapped);
-      bool can_add_writable_mapping = true;
-      auto check_existing_perms = [&can_add_writable_mapping, mapped_perms](
-                                      Snapshot::Address start,
-                                      Snapshot::Address limit,
-                                      MemoryPerms perms) {
-        if (perms != mapped_perms) {
-          can_add_writable_mapping = false;
-        }
-      };
-      mapped_memory_map_.Iterate(check_existing_perms, mapping.start_address(),
-                                 mapping.limit_address());
-
-      // If the range contains existing mappings, the existing mappings must
-      // all have the same permission as the new mapping.
-      if (!can_add_writable_mapping) {
-        return absl::AlreadyExistsError("writable mapping conflict");
-      }
-    } else {
-      if (mapped_memory_map_.Overlaps(mapping.start_address(),
-                                      mapping.limit_address())) {
-        return absl::AlreadyExistsError("mapping conflict");
-      }
-    }
+  const Snapshot::MemoryMappingList& mappings =
+      snapshot_summary.memory_mappings();
+  bool writable_conflict = false;
+  const bool no_conflicts = mapped_memory_map_.IterateOverlapping(
+      mappings, [this, &mappings, &writable_conflict](
+                    size_t index, Snapshot::Address start,
+                    Snapshot::Address limit, MemoryPerms perms) {
+        const Snapshot::MemoryMapping& mapping = mappings[index];
+        // Writable mapping can overlap with mappings having exactly the same
+        // permissions if conflict resolution permits.
+        const bool can_overlap =
+            conflict_resolution_ == kAllowWriteConflictsWithSamePerm &&
+            mapping.perms().Has(MemoryPerms::kWritable);
+        const MemoryPerms mapped_perms =
+            mapping.perms().Plus(MemoryPerms::kMapped);
+        if (can_overlap && perms == mapped_perms) return true;
+        writable_conflict = can_overlap;
+        return false;
+      });
+  if (!no_conflicts) {
+    return absl::AlreadyExistsError(writable_conflict
+                                        ? "writable mapping conflict"
+                                        : "mapping conflict");
   }
   return absl::OkStatus();
 }
@@ -79,13 +83,16 @@ void SnapshotGroup::AddSnapshot(const SnapshotSummary& snapshot_summary) {
                            mapping.perms().Plus(MemoryPerms::kMapped));
   }
   id_set_.insert(snapshot_summary.id());
+  size_in_bytes_ += snapshot_summary.size_in_bytes();
+  execution_cost_ += snapshot_summary.execution_cost();
 }
 
 // ----------------------------------------------------------------------- //
 
 SnapshotPartition::SnapshotPartition(
     size_t num_groups, SnapshotGroup::ConflictResolution conflict_resolution,
-    const MappedMemoryMap& conflict_mapped_memory) {
+    const MappedMemoryMap& conflict_mapped_memory)
+    : persistent_mappings_(conflict_resolution, conflict_mapped_memory) {
   for (size_t i = 0; i < num_groups; ++i) {
     snapshot_groups_.emplace_back(conflict_resolution, conflict_mapped_memory);
   }
@@ -153,10 +160,296 @@ void SnapshotPartition::PartitionSnapshots(SnapshotSummaryList& summaries) {
   summaries.erase(last_ungrouped_it, summaries.end());
 }
 
+namespace {
+
+// Set of group indices stored as a bitset of 64-bit words.
+class GroupSet {
+ public:
+  GroupSet() = default;
+  explicit GroupSet(size_t num_groups) : words_((num_groups + 63) / 64, 0) {}
+
+  // Copyable and movable by default.
+
+  bool Contains(size_t group) const {
+    return (words_[group / 64] & Bit(group)) != 0;
+  }
+  void Insert(size_t group) { words_[group / 64] |= Bit(group); }
+  void Erase(size_t group) { words_[group / 64] &= ~Bit(group); }
+
+  bool IsEmpty() const {
+    for (uint64_t word : words_) {
+      if (word != 0) return false;
+    }
+    return true;
+  }
+
+  // Returns the first group in this set at or after `start`, wrapping around
+  // to the beginning, or std::nullopt if this set is empty.
+  // REQUIRES: `start` is less than the number of groups.
+  std::optional<size_t> NextFrom(size_t start) const {
+    const size_t start_word = start / 64;
+    const uint64_t start_mask = ~uint64_t{0} << start % 64;
+    // Revisit the start word at the end to pick up groups before `start`.
+    for (size_t i = 0; i <= words_.size(); ++i) {
+      const size_t w = (start_word + i) % words_.size();
+      uint64_t word = words_[w];
+      if (i == 0) {
+        word &= start_mask;
+      } else if (i == words_.size()) {
+        word &= ~start_mask;
+      }
+      if (word != 0) return w * 64 + __builtin_ctzll(word);
+    }
+    return std::nullopt;
+  }
+
+ private:
+  static uint64_t Bit(size_t group) { return uint64_t{1} << (group % 64); }
+
+  std::vector<uint64_t> words_;
+};
+
+// Returns the 64-bit FNV-1a hash of `id`. Unlike absl::Hash, the value is the
+// same in every process and every build.
+uint64_t StableIdHash(absl::string_view id) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (char c : id) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+// Number, total size and total execution cost of a collection of snapshots.
+struct SnapshotLoad {
+  void Add(const SnapshotGroup::SnapshotSummary& summary) {
+    ++num_snapshots;
+    size_in_bytes += summary.size_in_bytes();
+    execution_cost += summary.execution_cost();
+  }
+
+  void Add(const SnapshotGroup& group) {
+    num_snapshots += group.size();
+    size_in_bytes += group.size_in_bytes();
+    execution_cost += group.execution_cost();
+  }
+
+  // Returns the larger of the shares of total size and of total execution
+  // cost in `total` taken by this.
+  double ShareOf(const SnapshotLoad& total) const {
+    auto share = [](uint64_t part, uint64_t whole) {
+      if (whole == 0) return 0.0;
+      return static_cast<double>(part) / static_cast<double>(whole);
+    };
+    return std::max(share(size_in_bytes, total.size_in_bytes),
+                    share(execution_cost, total.execution_cost));
+  }
+
+  uint64_t num_snapshots = 0;
+  uint64_t size_in_bytes = 0;
+  uint64_t execution_cost = 0;
+};
+
+// Page-granular index of the memory mappings of all groups in a partition.
+// For every page mapped in some group, this records the groups mapping the
+// page and their permissions. This finds all groups a snapshot conflicts with
+// by looking up each page of the snapshot once.
+class PageConflictIndex {
+ public:
+  // The index works at this granularity regardless of architecture. Snapshot
+  // mappings are aligned to it. Unaligned ranges are widened, which can only
+  // make conflict checks stricter.
+  static constexpr Snapshot::Address kPageSize = 4096;
+
+  explicit PageConflictIndex(
+      SnapshotGroup::ConflictResolution conflict_resolution)
+      : conflict_resolution_(conflict_resolution) {}
+
+  // Records that `group` maps [start, limit) with `perms`.
+  void Add(size_t group, Snapshot::Address start, Snapshot::Address limit,
+           MemoryPerms perms) {
+    for (Snapshot::Address page = start / kPageSize;
+         page < (limit + kPageSize - 1) / kPageSize; ++page) {
+      PageMappings& mappings = pages_[page];
+      auto it = absl::c_find_if(
+          mappings, [group](const GroupPerms& m) { return m.group == group; });
+      if (it != mappings.end()) {
+        it->perms.Add(perms);
+      } else {
+        mappings.push_back({static_cast<uint32_t>(group), perms});
+      }
+    }
+  }
+
+  // Removes from `groups` all groups with mappings conflicting with those of
+  // `summary`. This applies the same rules as SnapshotGroup::CanAddSnapshot().
+  void RemoveConflictingGroups(const SnapshotGroup::SnapshotSummary& summary,
+                               GroupSet& groups) const {
+    for (const auto& mapping : summary.memory_mappings()) {
+      const bool can_share =
+          conflict_resolution_ ==
+              SnapshotGroup::kAllowWriteConflictsWithSamePerm &&
+          mapping.perms().Has(MemoryPerms::kWritable);
+      const MemoryPerms mapped_perms =
+          mapping.perms().Plus(MemoryPerms::kMapped);
+      for (Snapshot::Address page = mapping.start_address() / kPageSize;
+           page < (mapping.limit_address() + kPageSize - 1) / kPageSize;
+           ++page) {
+        auto it = pages_.find(page);
+        if (it == pages_.end()) continue;
+        for (const GroupPerms& m : it->second) {
+          if (!can_share || m.perms != mapped_perms) groups.Erase(m.group);
+        }
+      }
+    }
+  }
+
+ private:
+  struct GroupPerms {
+    uint32_t group;
+    MemoryPerms perms;
+  };
+
+  // Most pages are mapped by a single group.
+  using PageMappings = absl::InlinedVector<GroupPerms, 1>;
+
+  SnapshotGroup::ConflictResolution conflict_resolution_;
+
+  // Keyed by page number.
+  absl::flat_hash_map<Snapshot::Address, PageMappings> pages_;
+};
+
+}  // namespace
+
+void SnapshotPartition::PartitionSnapshotsIndexed(
+    SnapshotSummaryList& summaries, Balance balance) {
+  const size_t num_groups = snapshot_groups_.size();
+  SnapshotLoad total_load;
+  for (const auto& group : snapshot_groups_) {
+    total_load.Add(group);
+  }
+  for (const auto& summary : summaries) {
+    total_load.Add(summary);
+  }
+  const size_t target_group_size =
+      balance == Balance::kCount
+          ? (total_load.num_snapshots + num_groups - 1) / num_groups
+          : std::numeric_limits<size_t>::max();
+
+  // Index mappings already in the groups, leaving out the persistent ones.
+  PageConflictIndex index(persistent_mappings_.conflict_resolution());
+  GroupSet open_groups(num_groups);
+  std::vector<size_t> group_sizes(num_groups);
+  // For Balance::kSizeAndCost: groups ordered by load, then by number of
+  // snapshots and then by index.
+  std::vector<SnapshotLoad> group_loads(num_groups);
+  using LoadKey = std::tuple<double, uint64_t, size_t>;
+  auto load_key = [&](size_t group) {
+    return LoadKey(group_loads[group].ShareOf(total_load),
+                   group_loads[group].num_snapshots, group);
+  };
+  std::set<LoadKey> groups_by_load;
+  for (size_t i = 0; i < num_groups; ++i) {
+    const SnapshotGroup& group = snapshot_groups_[i];
+    MappedMemoryMap snapshot_mappings = group.mapped_memory_map().Copy();
+    snapshot_mappings.RemoveRangesOf(persistent_mappings_.mapped_memory_map());
+    snapshot_mappings.Iterate(
+        [&index, i](Snapshot::Address start, Snapshot::Address limit,
+                    MemoryPerms perms) { index.Add(i, start, limit, perms); });
+    group_sizes[i] = group.size();
+    if (group_sizes[i] < target_group_size) open_groups.Insert(i);
+    group_loads[i].Add(group);
+    groups_by_load.insert(load_key(i));
+  }
+
+  // Decide placements sequentially so that the result is deterministic.
+  // Summaries are referenced by their indices in `summaries`.
+  std::vector<std::vector<size_t>> placements(num_groups);
+  std::vector<absl::flat_hash_set<absl::string_view>> placed_ids(num_groups);
+  size_t next_group = 0;
+  for (size_t i = 0; i < summaries.size() && !open_groups.IsEmpty(); ++i) {
+    const SnapshotSummary& summary = summaries[i];
+    if (!persistent_mappings_.CanAddSnapshot(summary).ok()) continue;
+    GroupSet candidates = open_groups;
+    index.RemoveConflictingGroups(summary, candidates);
+
+    // A snapshot cannot be added twice to the same group.
+    auto has_id = [&](size_t group) {
+      return snapshot_groups_[group].contains(summary.id()) ||
+             placed_ids[group].contains(summary.id());
+    };
+    std::optional<size_t> group;
+    if (balance == Balance::kCount || balance == Balance::kStableHash) {
+      const size_t start = balance == Balance::kCount
+                               ? next_group
+                               : StableIdHash(summary.id()) % num_groups;
+      while ((group = candidates.NextFrom(start)).has_value() &&
+             has_id(*group)) {
+        candidates.Erase(*group);
+      }
+    } else {
+      // Usually the least loaded group is a candidate, so this rarely visits
+      // more than a few groups.
+      for (const auto& [share, num_snapshots, g] : groups_by_load) {
+        if (candidates.Contains(g) && !has_id(g)) {
+          group = g;
+          break;
+        }
+      }
+    }
+    if (!group.has_value()) continue;
+
+    for (const auto& mapping : summary.memory_mappings()) {
+      index.Add(*group, mapping.start_address(), mapping.limit_address(),
+                mapping.perms().Plus(MemoryPerms::kMapped));
+    }
+    placements[*group].push_back(i);
+    placed_ids[*group].insert(summary.id());
+    if (++group_sizes[*group] == target_group_size) open_groups.Erase(*group);
+    next_group = (*group + 1) % num_groups;
+    groups_by_load.erase(load_key(*group));
+    group_loads[*group].Add(summary);
+    groups_by_load.insert(load_key(*group));
+  }
+
+  // Groups are independent, so add placed snapshots to them in parallel.
+  {
+    const int kNumCores =
+        static_cast<int>(std::thread::hardware_concurrency()) * 2;
+    ThreadPool threads{kNumCores};
+    for (size_t i = 0; i < num_groups; ++i) {
+      if (placements[i].empty()) continue;
+      threads.Schedule([&summaries, &group = snapshot_groups_[i],
+                        &indices = placements[i]]() {
+        for (size_t j : indices) {
+          group.AddSnapshot(summaries[j]);
+        }
+      });
+    }
+  }  // ~ThreadPool joins the threads.
+
+  // Discard placed summaries, preserving the order of the rest.
+  const SnapshotSummary kNullSummary{};
+  for (const auto& indices : placements) {
+    for (size_t j : indices) {
+      summaries[j] = kNullSummary;
+    }
+  }
+  const auto last_ungrouped_it =
+      std::remove(summaries.begin(), summaries.end(), kNullSummary);
+  summaries.erase(last_ungrouped_it, summaries.end());
+}
+
 SnapshotGroup::SnapshotSummary::SnapshotSummary(const Snapshot& snapshot)
     : id_(snapshot.id()),
       memory_mappings_(snapshot.memory_mappings()),
       sort_key_(0) {
+  for (const auto& memory_bytes : snapshot.memory_bytes()) {
+    size_in_bytes_ += memory_bytes.num_bytes();
+  }
+  for (const auto& trace_data : snapshot.trace_data()) {
+    execution_cost_ = std::max(execution_cost_, trace_data.num_instructions());
+  }
   int num_end_states = snapshot.expected_end_states().size();
   if (num_end_states == 1) {
     // Bucket by platforms. Empirically, this helps group snapshots that have
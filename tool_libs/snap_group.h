@@ -16,6 +16,7 @@
 #define THIRD_PARTY_SILIFUZZ_TOOL_LIBS_SNAP_GROUP_H_
 
 #include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -67,11 +68,9 @@ class SnapshotGroup {
 
   // This class contains all necessary information about a Snap that is required
   // for grouping. This is used to reduce memory footprint when a big corpus is
-  // read into memory for grouping.
-  //
-  // Note: at some point, we may include other summary information than
-  // mapping information. For example, we might want to have some measure of
-  // snapshot size here to let us create equally-sized groups.
+  // read into memory for grouping. Besides mapping information, a summary
+  // carries a size and an execution cost estimate of the Snap so that groups
+  // can be balanced on those.
   class SnapshotSummary {
    public:
     using MemoryMappingList = Snapshot::MemoryMappingList;
@@ -83,8 +82,13 @@ class SnapshotGroup {
 
     // Constructs Summary instance from bits.
     SnapshotSummary(const Id& id, const MemoryMappingList& memory_mappings,
-                    int sort_key)
-        : id_(id), memory_mappings_(memory_mappings), sort_key_(sort_key) {}
+                    int sort_key, uint64_t size_in_bytes = 0,
+                    uint64_t execution_cost = 0)
+        : id_(id),
+          memory_mappings_(memory_mappings),
+          sort_key_(sort_key),
+          size_in_bytes_(size_in_bytes),
+          execution_cost_(execution_cost) {}
     ~SnapshotSummary() = default;
 
     // Copyable and movable by default.
@@ -94,6 +98,8 @@ class SnapshotGroup {
       return memory_mappings_;
     }
     int sort_key() const { return sort_key_; }
+    uint64_t size_in_bytes() const { return size_in_bytes_; }
+    uint64_t execution_cost() const { return execution_cost_; }
 
     // Comparison friend operators.
     friend bool operator<(const SnapshotSummary& lhs,
@@ -117,6 +123,16 @@ class SnapshotGroup {
 
     // Sort key used to stably order snapshots.
     int sort_key_ = 0;
+
+    // Total size of the memory bytes of the Snap.
+    uint64_t size_in_bytes_ = 0;
+
+    // Estimated cost of executing the Snap once. This is the largest number
+    // of instructions recorded in the Snap's trace data or 0 if unknown.
+    // Tools may replace it with a measured cost, see
+    // CompactSnapshot::set_execution_cost(), as long as all Snaps that are
+    // partitioned together use the same unit.
+    uint64_t execution_cost_ = 0;
   };
 
   using SnapshotSummaryList = std::vector<SnapshotSummary>;
@@ -153,6 +169,26 @@ class SnapshotGroup {
   // Returns number of Snaps in this group.
   size_t size() const { return id_set_.size(); }
 
+  // Returns the sum of SnapshotSummary::size_in_bytes() of Snaps in this group.
+  uint64_t size_in_bytes() const { return size_in_bytes_; }
+
+  // Returns the sum of SnapshotSummary::execution_cost() of Snaps in this
+  // group.
+  uint64_t execution_cost() const { return execution_cost_; }
+
+  // Returns true iff a Snap with `id` is in this group.
+  bool contains(const Id& id) const { return id_set_.contains(id); }
+
+  ConflictResolution conflict_resolution() const {
+    return conflict_resolution_;
+  }
+
+  // Returns the union of memory mappings of Snaps in this group and those
+  // passed to the constructor.
+  const MappedMemoryMap& mapped_memory_map() const {
+    return mapped_memory_map_;
+  }
+
  private:
   // Conflict resolution.
   ConflictResolution conflict_resolution_;
@@ -163,6 +199,10 @@ class SnapshotGroup {
   // Union of memory mappings used by Snaps in this group.
   // All mappings in mapped_memory_map_ have permission kMapped set.
   MappedMemoryMap mapped_memory_map_;
+
+  // See size_in_bytes() and execution_cost().
+  uint64_t size_in_bytes_ = 0;
+  uint64_t execution_cost_ = 0;
 };
 
 // In some usage, we want to break a set of snapshots into a number of
@@ -221,7 +261,51 @@ class SnapshotPartition {
   //
   void PartitionSnapshots(SnapshotSummaryList& summaries);
 
+  // What PartitionSnapshotsIndexed() balances across groups.
+  enum class Balance {
+    // Each snapshot goes to the next group in round-robin order that it does
+    // not conflict with and that has fewer than
+    // ceil(total snapshots / number of groups) snapshots.
+    kCount,
+
+    // Each snapshot goes to the least loaded group that it does not conflict
+    // with. The load of a group is the larger of its shares of the total
+    // SnapshotSummary::size_in_bytes() and of the total
+    // SnapshotSummary::execution_cost() of all snapshots in the partition and
+    // in `summaries`. Among equally loaded groups, the one with the fewest
+    // snapshots is picked. Groups have no size limit.
+    kSizeAndCost,
+
+    // Each snapshot goes to a preferred group picked by a hash of its id that
+    // is stable across runs and releases, or, if it conflicts with that group,
+    // to the next non-conflicting group in round-robin order. Groups have no
+    // size limit. Adding snapshots to a corpus then changes only the groups
+    // they land in and those their conflicts spill into, so successive corpus
+    // versions share most of their shards.
+    kStableHash,
+  };
+
+  // Like PartitionSnapshots() but rather than offering each snapshot to a
+  // single pre-assigned group, picks a non-conflicting group according to
+  // `balance`. Conflicts with all groups are found at once using a
+  // page-granular index of the groups' mappings, so the cost of finding
+  // conflicts is proportional to the number of pages a snapshot maps and not
+  // to the number of groups. The index is rebuilt on each call, which takes
+  // time proportional to the number of pages mapped by snapshots already in
+  // the groups.
+  //
+  // A snapshot left in `summaries` conflicts with every group that still has
+  // room, so calling this again with the same leftovers adds nothing. The
+  // result is deterministic for a given input order.
+  void PartitionSnapshotsIndexed(SnapshotSummaryList& summaries,
+                                 Balance balance = Balance::kCount);
+
  private:
+  // An empty group containing only the `conflict_mapped_memory` shared by all
+  // groups. These mappings can be large, so PartitionSnapshotsIndexed() checks
+  // them here once per snapshot instead of indexing them.
+  SnapshotGroup persistent_mappings_;
+
   std::vector<SnapshotGroup> snapshot_groups_;
 };
 
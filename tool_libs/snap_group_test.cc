@@ -15,6 +15,7 @@
 #include "./tool_libs/snap_group.h"
 
 #include <cstddef>
+#include <cstdint>
 #include <string>
 #include <utility>
 #include <vector>
@@ -43,6 +44,7 @@ using ::testing::Contains;
 using ::testing::HasSubstr;
 using ::testing::IsEmpty;
 using ::testing::Not;
+using ::testing::SizeIs;
 
 const std::vector<Snapshot>& TestSnapshots() {
   static std::vector<Snapshot>* snapshots = [] {
@@ -118,6 +120,28 @@ TEST(SnapshotSummary, ConstructFromSnapshot) {
   SnapshotGroup::SnapshotSummary memory_summary(snapshot);
   EXPECT_EQ(memory_summary.id(), snapshot.id());
   EXPECT_EQ(memory_summary.memory_mappings(), snapshot.memory_mappings());
+  uint64_t size_in_bytes = 0;
+  for (const auto& memory_bytes : snapshot.memory_bytes()) {
+    size_in_bytes += memory_bytes.num_bytes();
+  }
+  EXPECT_EQ(memory_summary.size_in_bytes(), size_in_bytes);
+  EXPECT_GT(memory_summary.size_in_bytes(), 0);
+}
+
+TEST(SnapshotGroup, SizeAndExecutionCost) {
+  SnapshotGroup snapshot_group(SnapshotGroup::kNoConflictAllowed);
+  SnapshotGroup::SnapshotSummary summary_1(
+      "snap1",
+      {MemoryMapping::MakeSized(0x1000000ULL, 0x1000, MemoryPerms::R())},
+      0, 100, 10);
+  SnapshotGroup::SnapshotSummary summary_2(
+      "snap2",
+      {MemoryMapping::MakeSized(0x2000000ULL, 0x1000, MemoryPerms::R())},
+      0, 200, 20);
+  snapshot_group.AddSnapshot(summary_1);
+  snapshot_group.AddSnapshot(summary_2);
+  EXPECT_EQ(snapshot_group.size_in_bytes(), 300);
+  EXPECT_EQ(snapshot_group.execution_cost(), 30);
 }
 
 TEST(SnapshotGroup, CanAddSnapshotIntoEmptyGroup) {
@@ -238,6 +262,129 @@ TEST(SnapshotGroup, PartitionTooFewGroupsToFit) {
   EXPECT_THAT(summaries, Not(IsEmpty()));
 }
 
+// Returns OkStatus() iff snapshots in `partition` are disjoint and each group
+// can be rebuilt by adding its snapshots one by one.
+absl::Status CheckPartition(const SnapshotPartition& partition,
+                            const SnapshotGroup::SnapshotSummaryList& all) {
+  absl::flat_hash_set<SnapshotGroup::Id> seen;
+  for (const auto& group : partition.snapshot_groups()) {
+    SnapshotGroup rebuilt(group.conflict_resolution());
+    for (const auto& summary : all) {
+      if (!group.contains(summary.id())) continue;
+      if (!seen.insert(summary.id()).second) {
+        return absl::InternalError("snapshot in more than one group");
+      }
+      RETURN_IF_NOT_OK(rebuilt.CanAddSnapshot(summary));
+      rebuilt.AddSnapshot(summary);
+    }
+    if (rebuilt.size() != group.size()) {
+      return absl::InternalError("unknown snapshot in group");
+    }
+  }
+  return absl::OkStatus();
+}
+
+TEST(SnapPartition, IndexedOneSnapPerGroup) {
+  SnapshotGroup::SnapshotSummaryList summaries = TestSummaries();
+  SnapshotPartition partition(summaries.size(),
+                              SnapshotGroup::kAllowWriteConflictsWithSamePerm);
+  partition.PartitionSnapshotsIndexed(summaries);
+  EXPECT_THAT(summaries, IsEmpty());
+  for (const auto& group : partition.snapshot_groups()) {
+    EXPECT_EQ(group.size(), 1);
+  }
+}
+
+TEST(SnapPartition, IndexedSmallExample) {
+  const SnapshotGroup::SnapshotSummaryList kSummaries = TestSummaries();
+  constexpr int kNumGroups = 3;
+  const size_t group_size_upper_bound =
+      (kSummaries.size() + kNumGroups - 1) / kNumGroups;
+
+  SnapshotPartition partition(kNumGroups,
+                              SnapshotGroup::kAllowWriteConflictsWithSamePerm);
+  auto summaries = kSummaries;
+  partition.PartitionSnapshotsIndexed(summaries);
+  EXPECT_TRUE(summaries.empty());
+  for (const auto& group : partition.snapshot_groups()) {
+    EXPECT_LE(group.size(), group_size_upper_bound);
+  }
+  EXPECT_OK(CheckPartition(partition, kSummaries));
+}
+
+TEST(SnapPartition, IndexedNoConflictAllowed) {
+  const SnapshotGroup::SnapshotSummaryList kSummaries = TestSummaries();
+  // snap1 and snap4 share a writable mapping with the same permissions. They
+  // cannot be in the same group without kAllowWriteConflictsWithSamePerm.
+  SnapshotPartition partition(1, SnapshotGroup::kNoConflictAllowed);
+  SnapshotGroup::SnapshotSummaryList summaries = {kSummaries[0],
+                                                  kSummaries[3]};
+  partition.PartitionSnapshotsIndexed(summaries);
+  ASSERT_THAT(summaries, SizeIs(1));
+  EXPECT_EQ(summaries[0].id(), kSummaries[3].id());
+
+  SnapshotPartition sharing_partition(
+      1, SnapshotGroup::kAllowWriteConflictsWithSamePerm);
+  summaries = {kSummaries[0], kSummaries[3]};
+  sharing_partition.PartitionSnapshotsIndexed(summaries);
+  EXPECT_THAT(summaries, IsEmpty());
+}
+
+TEST(SnapPartition, IndexedTooFewGroupsToFit) {
+  const SnapshotGroup::SnapshotSummaryList kSummaries = TestSummaries();
+  constexpr int kNumGroups = 2;
+  SnapshotPartition partition(kNumGroups,
+                              SnapshotGroup::kAllowWriteConflictsWithSamePerm);
+  auto summaries = kSummaries;
+  partition.PartitionSnapshotsIndexed(summaries);
+  EXPECT_THAT(summaries, Not(IsEmpty()));
+  EXPECT_OK(CheckPartition(partition, kSummaries));
+
+  // Leftovers conflict with every group that has room.
+  const size_t num_leftovers = summaries.size();
+  partition.PartitionSnapshotsIndexed(summaries);
+  EXPECT_EQ(summaries.size(), num_leftovers);
+}
+
+TEST(SnapPartition, IndexedPersistentConflict) {
+  MappedMemoryMap m;
+  m.AddNew(0ULL, ~0ULL, MemoryPerms::AllPlusMapped());
+  SnapshotPartition partition(2, SnapshotGroup::kNoConflictAllowed, m);
+  SnapshotGroup::SnapshotSummaryList summaries = TestSummaries();
+  partition.PartitionSnapshotsIndexed(summaries);
+  EXPECT_EQ(summaries, TestSummaries());
+}
+
+TEST(SnapPartition, IndexedAfterPartitionSnapshots) {
+  const SnapshotGroup::SnapshotSummaryList kSummaries = TestSummaries();
+  SnapshotPartition partition(3,
+                              SnapshotGroup::kAllowWriteConflictsWithSamePerm);
+  // Fill the groups partially using the other method first. The index must
+  // pick up what is already there.
+  SnapshotGroup::SnapshotSummaryList summaries = {kSummaries[0], kSummaries[1]};
+  partition.PartitionSnapshots(summaries);
+  ASSERT_THAT(summaries, IsEmpty());
+  // snap5 conflicts with snap1 and snap2 so it must go into the empty group.
+  summaries = {kSummaries[4], kSummaries[2], kSummaries[3]};
+  partition.PartitionSnapshotsIndexed(summaries);
+  EXPECT_THAT(summaries, IsEmpty());
+  EXPECT_OK(CheckPartition(partition, kSummaries));
+}
+
+TEST(SnapPartition, IndexedRejectsDuplicateIds) {
+  // Copies of a snapshot with only a writable mapping do not conflict by
+  // mappings, but a group cannot have the same id twice.
+  const SnapshotGroup::SnapshotSummary summary(
+      "writable_only",
+      {MemoryMapping::MakeSized(0x1000000ULL, 0x1000, MemoryPerms::RW())}, 0);
+  SnapshotPartition partition(1,
+                              SnapshotGroup::kAllowWriteConflictsWithSamePerm);
+  SnapshotGroup::SnapshotSummaryList summaries = {summary, summary};
+  partition.PartitionSnapshotsIndexed(summaries);
+  EXPECT_THAT(summaries, SizeIs(1));
+  EXPECT_EQ(partition.snapshot_groups()[0].size(), 1);
+}
+
 TEST(SnapshotGroup, LessThan) {
   SnapshotGroup::SnapshotSummary snapshot_summary_1(TestSnapshots()[0]);
   SnapshotGroup::SnapshotSummary snapshot_summary_2(TestSnapshots()[1]);
@@ -31,7 +31,8 @@ absl::StatusOr<SnapshotGroup::SnapshotSummary> SnapshotSummaryProto::FromProto(
     memory_mappings.emplace_back(m);
   }
   return SnapshotGroup::SnapshotSummary(proto.id(), memory_mappings,
-                                        proto.sort_key());
+                                        proto.sort_key(), proto.size_in_bytes(),
+                                        proto.execution_cost());
 }
 
 void SnapshotSummaryProto::ToProto(
@@ -39,6 +40,8 @@ void SnapshotSummaryProto::ToProto(
     proto::SnapshotSummary* summary_proto) {
   summary_proto->set_id(summary.id());
   summary_proto->set_sort_key(summary.sort_key());
+  summary_proto->set_size_in_bytes(summary.size_in_bytes());
+  summary_proto->set_execution_cost(summary.execution_cost());
   for (const MemoryMapping& m : summary.memory_mappings()) {
     SnapshotProto::ToProto(m, summary_proto->add_memory_mappings());
   }
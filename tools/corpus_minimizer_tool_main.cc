@@ -0,0 +1,132 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Minimizes a corpus of raw instruction blobs by proxy coverage.
+//
+// Usage:
+//   corpus_minimizer_tool_main --output=<blob file> [--parallelism=N] \
+//     <corpus_0> .. <corpus_n>
+//
+// Every unique blob of the input Centipede corpus files is executed by the
+// Unicorn proxy of the host architecture, which produces the same user
+// features that guide Centipede. Blobs that the proxy rejects are dropped.
+// Of the rest, a subset that covers all their features is chosen with
+// GreedyFeatureCover() and written to the output blob file.
+//
+// The proxy only approximates what a snap exercises on hardware, so the
+// minimized corpus should still be fixed with simple_fix_tool_main.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <thread>  // NOLINT(build/c++11)
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/log/initialize.h"
+#include "absl/status/status.h"
+#include "absl/types/span.h"
+#include "external/com_google_fuzztest/centipede/blob_file.h"
+#include "./proxies/sharded_batch_runner.h"
+#include "./tool_libs/feature_cover.h"
+#include "./tool_libs/simple_fix_tool_counters.h"
+#include "./tools/simple_fix_tool.h"
+#include "./util/checks.h"
+
+ABSL_FLAG(std::string, output, "", "Path of the output blob file.");
+
+ABSL_FLAG(int, parallelism, 0,
+          "Number of threads reading inputs and executing the proxy. If it is "
+          "0, the maximum hardware parallelism is used.");
+
+namespace silifuzz {
+namespace {
+
+absl::Status WriteBlobs(const std::vector<std::string>& blobs,
+                        const std::vector<size_t>& indices,
+                        const std::string& output) {
+  auto writer = centipede::DefaultBlobFileWriterFactory();
+  RETURN_IF_NOT_OK(writer->Open(output, "w"));
+  for (size_t index : indices) {
+    const std::string& blob = blobs[index];
+    RETURN_IF_NOT_OK(writer->Write(absl::Span<const uint8_t>(
+        reinterpret_cast<const uint8_t*>(blob.data()), blob.size())));
+  }
+  return writer->Close();
+}
+
+int CorpusMinimizerToolMain(int argc, char* argv[]) {
+  auto non_flag_args = absl::ParseCommandLine(argc, argv);
+  absl::InitializeLog();
+
+  CHECK_GT(non_flag_args.size(), 0);
+  const std::vector<std::string> inputs(non_flag_args.begin() + 1,
+                                        non_flag_args.end());
+  const std::string output = absl::GetFlag(FLAGS_output);
+  if (inputs.empty() || output.empty()) {
+    LOG_ERROR("Expected --output and at least one input corpus");
+    return EXIT_FAILURE;
+  }
+
+  SimpleFixToolOptions options;
+  options.parallelism = absl::GetFlag(FLAGS_parallelism);
+  if (options.parallelism == 0) {
+    options.parallelism = std::thread::hardware_concurrency();
+  }
+  fix_tool_internal::SimpleFixToolCounters counters;
+  const std::vector<std::string> blobs =
+      fix_tool_internal::ReadUniqueCentipedeBlobs(options, inputs, &counters);
+
+  // Extract features of all blobs in parallel. Each proxy thread has its own
+  // tracer and feature generator.
+  std::vector<absl::Span<const uint8_t>> proxy_inputs;
+  proxy_inputs.reserve(blobs.size());
+  for (const std::string& blob : blobs) {
+    proxy_inputs.emplace_back(reinterpret_cast<const uint8_t*>(blob.data()),
+                              blob.size());
+  }
+  std::vector<ProxyInputResult> results(blobs.size());
+  RunProxyBatch(proxy_inputs, options.parallelism, absl::MakeSpan(results));
+
+  // Rejected blobs keep no features and are never part of the cover.
+  std::vector<std::vector<uint64_t>> features(blobs.size());
+  size_t num_rejected = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    if (results[i].result != 0) {
+      ++num_rejected;
+      continue;
+    }
+    features[i] = std::move(results[i].features);
+  }
+  const std::vector<size_t> cover = GreedyFeatureCover(features);
+
+  absl::Status status = WriteBlobs(blobs, cover, output);
+  if (!status.ok()) {
+    LOG_ERROR("Cannot write ", output, ": ", status.message());
+    return EXIT_FAILURE;
+  }
+  LOG_INFO("Read ", blobs.size(), " unique blobs, ", num_rejected,
+           " rejected by the proxy, wrote ", cover.size(), " to ", output);
+  return EXIT_SUCCESS;
+}
+
+}  // namespace
+}  // namespace silifuzz
+
+int main(int argc, char* argv[]) {
+  return silifuzz::CorpusMinimizerToolMain(argc, argv);
+}
@@ -14,17 +14,93 @@
 
 #include "./tools/fuzz_filter_tool.h"
 
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
+#include "absl/base/internal/endian.h"
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "./runner/driver/runner_driver.h"
 #include "./runner/make_snapshot.h"
 
 namespace silifuzz {
 
+namespace {
+
+// Reads exactly `size` bytes into `buffer`. Returns the number of bytes read,
+// which is less than `size` only at EOF, or -1 on error.
+ssize_t ReadFully(int fd, char* buffer, size_t size) {
+  size_t bytes_read = 0;
+  while (bytes_read < size) {
+    ssize_t n = read(fd, buffer + bytes_read, size - bytes_read);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (n == 0) break;
+    bytes_read += n;
+  }
+  return bytes_read;
+}
+
+bool WriteFully(int fd, absl::string_view data) {
+  while (!data.empty()) {
+    ssize_t n = write(fd, data.data(), data.size());
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data.remove_prefix(n);
+  }
+  return true;
+}
+
+}  // namespace
+
 // Kept as a separate function so that we can test this exact config.
 absl::Status FilterToolMain(absl::string_view raw_insns_bytes) {
-  return MakeRawInstructions(raw_insns_bytes, MakingConfig::Quick()).status();
+  return FilterToolMain(raw_insns_bytes, MakingConfig::Quick());
+}
+
+absl::Status FilterToolMain(absl::string_view raw_insns_bytes,
+                            const MakingConfig& making_config) {
+  return MakeRawInstructions(raw_insns_bytes, making_config).status();
+}
+
+absl::Status FilterToolBatchMain(int input_fd, int output_fd) {
+  MakingConfig making_config = MakingConfig::Quick();
+  // Forking the runners of all inputs from zygotes is much cheaper than
+  // exec'ing a runner for each of them.
+  ZygotePool zygote_pool(making_config.runner_path);
+  making_config.zygote_pool = &zygote_pool;
+  std::string input;
+  for (uint64_t num_inputs = 0;; ++num_inputs) {
+    char size_bytes[sizeof(uint32_t)];
+    ssize_t n = ReadFully(input_fd, size_bytes, sizeof(size_bytes));
+    if (n == 0) return absl::OkStatus();
+    if (n != sizeof(size_bytes)) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Cannot read size of input ", num_inputs));
+    }
+    const uint32_t size = absl::little_endian::Load32(size_bytes);
+    input.resize(size);
+    if (ReadFully(input_fd, input.data(), size) != size) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Cannot read input ", num_inputs));
+    }
+    const char verdict = FilterToolMain(input, making_config).ok()
+                             ? kFilterAccept
+                             : kFilterReject;
+    if (!WriteFully(output_fd, absl::string_view(&verdict, 1))) {
+      return absl::InternalError(
+          absl::StrCat("Cannot write verdict of input ", num_inputs));
+    }
+  }
 }
 
 }  // namespace silifuzz
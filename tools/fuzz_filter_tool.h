@@ -26,10 +26,31 @@
 
 #include "absl/status/status.h"
 #include "absl/strings/string_view.h"
+#include "./runner/make_snapshot.h"
 
 namespace silifuzz {
 
+// Returns OK iff `raw_insns_bytes` can be made into a Snapshot with
+// `making_config`. The overload without a config uses MakingConfig::Quick().
 absl::Status FilterToolMain(absl::string_view raw_insns_bytes);
-}
+absl::Status FilterToolMain(absl::string_view raw_insns_bytes,
+                            const MakingConfig& making_config);
+
+// Filters a stream of inputs read from `input_fd` until EOF and writes a
+// verdict for each of them to `output_fd`, in order.
+//
+// Each input is a 4-byte little-endian length followed by that many bytes of
+// raw instructions. Each verdict is a single byte, kFilterAccept or
+// kFilterReject. This amortizes the startup cost of the tool and of
+// MakingConfig::Quick() over many inputs. Every input is still made in fresh
+// runner processes, forked from zygotes shared by all inputs.
+//
+// Returns an error if reading or writing fails or the input stream ends in
+// the middle of an input. Rejected inputs are not errors.
+inline constexpr char kFilterAccept = '1';
+inline constexpr char kFilterReject = '0';
+absl::Status FilterToolBatchMain(int input_fd, int output_fd);
+
+}  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_TOOLS_FUZZ_FILTER_TOOL_H_
@@ -17,9 +17,16 @@
 // SiliFuzz Snapshot.
 // The bytes are converted into Snapshot using InstructionsToSnapshot() which
 // is the same as what our fuzzers and the fix pipeline use.
+//
+// With --batch, the tool instead reads a stream of inputs from stdin and
+// writes a verdict for each of them to stdout, see FilterToolBatchMain().
+
+#include <unistd.h>
 
+#include <string>
 #include <vector>
 
+#include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
@@ -27,8 +34,22 @@
 #include "./util/checks.h"
 #include "./util/tool_util.h"
 
+ABSL_FLAG(bool, batch, false,
+          "Filter length-prefixed inputs from stdin and write verdicts to "
+          "stdout instead of filtering a single input file.");
+
 int main(int argc, char** argv) {
   std::vector<char*> non_flag_args = absl::ParseCommandLine(argc, argv);
+  if (absl::GetFlag(FLAGS_batch)) {
+    if (non_flag_args.size() != 1) {
+      LOG_ERROR("Expected no input file with --batch");
+      return 1;
+    }
+    absl::Status s =
+        silifuzz::FilterToolBatchMain(STDIN_FILENO, STDOUT_FILENO);
+    if (!s.ok()) LOG_ERROR(s.message());
+    return silifuzz::ToExitCode(s.ok());
+  }
   if (non_flag_args.size() != 2) {
     LOG_ERROR("Expected exactly 1 input file");
     return 1;
@@ -24,11 +24,14 @@
 #include "./tools/fuzz_filter_tool.h"
 
 #include <stdint.h>
+#include <unistd.h>
 
 #include <string>
 #include <vector>
 
 #include "gtest/gtest.h"
+#include "absl/base/internal/endian.h"
+#include "absl/strings/string_view.h"
 #include "./common/snapshot_test_config.h"
 #include "./common/snapshot_test_enum.h"
 #include "./util/arch.h"
@@ -66,6 +69,60 @@ TEST(FuzzFilterTool, Syscall) {
   EXPECT_FILTER_REJECT(GetTestSnippet<Host>(TestSnapshot::kSyscall));
 }
 
+// Returns `inputs` in the input format of FilterToolBatchMain().
+std::string BatchInput(const std::vector<std::string>& inputs) {
+  std::string batch;
+  for (const std::string& input : inputs) {
+    char size_bytes[sizeof(uint32_t)];
+    absl::little_endian::Store32(size_bytes, input.size());
+    batch.append(size_bytes, sizeof(size_bytes));
+    batch.append(input);
+  }
+  return batch;
+}
+
+// Runs FilterToolBatchMain() on `batch` and returns the verdicts.
+std::string RunBatch(absl::string_view batch, bool* ok) {
+  int input_pipe[2], output_pipe[2];
+  EXPECT_EQ(pipe(input_pipe), 0);
+  EXPECT_EQ(pipe(output_pipe), 0);
+  // Small enough to fit into the pipe buffers.
+  EXPECT_EQ(write(input_pipe[1], batch.data(), batch.size()),
+            static_cast<ssize_t>(batch.size()));
+  close(input_pipe[1]);
+  *ok = FilterToolBatchMain(input_pipe[0], output_pipe[1]).ok();
+  close(input_pipe[0]);
+  close(output_pipe[1]);
+  std::string verdicts;
+  char buffer[64];
+  ssize_t n;
+  while ((n = read(output_pipe[0], buffer, sizeof(buffer))) > 0) {
+    verdicts.append(buffer, n);
+  }
+  close(output_pipe[0]);
+  return verdicts;
+}
+
+TEST(FuzzFilterTool, Batch) {
+  const std::string batch =
+      BatchInput({GetTestSnippet<Host>(TestSnapshot::kEndsAsExpected),
+                  GetTestSnippet<Host>(TestSnapshot::kBreakpoint),
+                  GetTestSnippet<Host>(TestSnapshot::kEndsAsExpected)});
+  bool ok;
+  EXPECT_EQ(RunBatch(batch, &ok), std::string({kFilterAccept, kFilterReject,
+                                               kFilterAccept}));
+  EXPECT_TRUE(ok);
+
+  // Empty stream.
+  EXPECT_EQ(RunBatch("", &ok), "");
+  EXPECT_TRUE(ok);
+
+  // Truncated input.
+  EXPECT_EQ(RunBatch(batch.substr(0, batch.size() - 1), &ok),
+            std::string({kFilterAccept, kFilterReject}));
+  EXPECT_FALSE(ok);
+}
+
 #if defined(__x86_64__)
 
 // Mostly to check that FromBytes can produce something that will be accepted.
@@ -14,16 +14,25 @@
 
 #include "./tools/simple_fix_tool.h"
 
+#include <fcntl.h>
 #include <stdint.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <array>
 #include <atomic>
+#include <cerrno>
 #include <cstddef>
+#include <cstring>
 #include <fstream>
 #include <functional>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <memory>
+#include <optional>
 #include <string>
 #include <thread>  // NOLINT(build/c++11)
 #include <utility>
@@ -32,38 +41,80 @@
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/meta/type_traits.h"
+#include "absl/numeric/int128.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "external/com_google_fuzztest/centipede/blob_file.h"
 #include "external/com_google_fuzztest/centipede/defs.h"
+#include "google/protobuf/text_format.h"
+#include "third_party/cityhash/city.h"
 #include "./common/raw_insns_util.h"
 #include "./common/snapshot.h"
+#include "./common/snapshot_proto.h"
+#include "./proto/corpus_metadata.pb.h"
+#include "./proto/fix_tool_checkpoint.pb.h"
+#include "./runner/driver/runner_driver.h"
+#include "./runner/make_snapshot.h"
+#include "./runner/runner_provider.h"
 #include "./snap/gen/relocatable_snap_generator.h"
 #include "./snap/gen/snap_generator.h"
+#include "./tool_libs/bounded_queue.h"
+#include "./tool_libs/code_register_groups.h"
+#include "./tool_libs/compact_snapshot.h"
 #include "./tool_libs/corpus_partitioner_lib.h"
 #include "./tool_libs/fix_tool_common.h"
+#include "./tool_libs/fix_tool_stage_times.h"
 #include "./tool_libs/simple_fix_tool_counters.h"
 #include "./tool_libs/snap_group.h"
 #include "./util/arch.h"
 #include "./util/checks.h"
-#include "./util/mmapped_memory_ptr.h"
+#include "./util/path_util.h"
 #include "./util/platform.h"
-#include "./util/span_util.h"
+#include "./util/zstd_util.h"
 
 namespace silifuzz {
 namespace fix_tool_internal {
 namespace {
 
-// Counter the number of blobs processed by workers, including ones that are
-// rejected. This is used for tracking progress of simple fix tool. This is a
-// global atomic variable so accessing it can create cache contention among
-// workers. Contention is alleviated by updating this infrequently.
-std::atomic<size_t> num_blobs_processed = 0;
+// Number of blobs a worker claims at a time. Blobs vary a lot in the time
+// they take to make, so workers claim few at a time to keep the tail short.
+// Claiming is cheap compared to making even one snapshot.
+constexpr size_t kBlobsPerClaim = 4;
+
+// Number of blobs processed by a worker, including ones that are rejected.
+// This is used for tracking progress of simple fix tool. Each worker has its
+// own counter on a separate cache line so that updating it does not cause
+// contention.
+struct alignas(64) WorkerProgress {
+  std::atomic<size_t> num_blobs_processed = 0;
+};
+
+// Queues between the stages of pipelined making, see
+// SimpleFixToolOptions::pipeline_fixup_threads. Each stage closes its output
+// queue when its last thread exits.
+struct MakePipeline {
+  MakePipeline(size_t queue_size, int num_prepare_threads,
+               int num_fixup_threads)
+      : prepared(queue_size),
+        fixed_up(queue_size),
+        num_preparing(num_prepare_threads),
+        num_fixing_up(num_fixup_threads) {}
+
+  // Normalized snapshots waiting for the maker.
+  BoundedQueue<Snapshot> prepared;
+  // Made snapshots waiting to be snapified.
+  BoundedQueue<Snapshot> fixed_up;
+  // Threads still running in the prepare and fixup stages.
+  std::atomic<int> num_preparing;
+  std::atomic<int> num_fixing_up;
+};
 
 // Arguments for a make worker thread.
 // This is used for both input and output.
@@ -71,61 +122,246 @@ struct FixToolWorkerArgs {
   // A worker needs to reference simple fix tool options.
   // The worker does not own the option.
   const SimpleFixToolOptions* options;
+  // All blobs to be made. Workers claim them in chunks of kBlobsPerClaim
+  // using `next_blob`, which is shared by all workers.
   absl::Span<const std::string> blobs;
-  std::vector<Snapshot> good_snapshots;
+  std::atomic<size_t>* next_blob;
+  // Progress of this worker. Not owned.
+  WorkerProgress* progress;
+  // Checkpoint to record outcomes in or nullptr. Not owned.
+  FixToolCheckpoint* checkpoint;
+  // Queues of pipelined making or nullptr. Not owned.
+  MakePipeline* pipeline = nullptr;
+  // Zygotes shared by all workers to fork runners from. Not owned.
+  ZygotePool* zygote_pool = nullptr;
+  std::vector<CompactSnapshot> good_snapshots;
   SimpleFixToolCounters counters;
+  FixToolStageTimes stage_times;
 };
 
-void FixToolWorker(FixToolWorkerArgs& args) {
+// Appends the compact form of `snapshot` to `snapshots`. Updates statistics
+// in `counters`.
+void AppendCompactSnapshot(const Snapshot& snapshot,
+                           std::vector<CompactSnapshot>& snapshots,
+                           SimpleFixToolCounters* counters) {
+  absl::StatusOr<CompactSnapshot> compact = CompactSnapshot::Create(snapshot);
+  if (!compact.ok()) {
+    counters->Increment("silifuzz-ERROR-Compact:create-failed");
+    return;
+  }
+  snapshots.push_back(*std::move(compact));
+}
+
+// Records in `args.checkpoint` that the blob of `snapshot_id` was made into
+// `snapshot` or rejected if `snapshot` is nullptr, and keeps a made
+// `snapshot` in `args.good_snapshots`. Only rejections that do not depend on
+// the run, e.g. a failed make or non-determinism, are recorded. A blob that
+// failed for a transient reason, see IsTransientFailure(), is left out of the
+// checkpoint so that a rerun retries it.
+void RecordBlobOutcome(absl::string_view snapshot_id, const Snapshot* snapshot,
+                       bool transient_failure, FixToolWorkerArgs& args) {
+  if (transient_failure) {
+    args.counters.Increment("silifuzz-INFO-Checkpoint:transient-failures");
+    return;
+  }
+  if (args.checkpoint != nullptr &&
+      !args.checkpoint->Append(snapshot_id, snapshot).ok()) {
+    args.counters.Increment("silifuzz-ERROR-Checkpoint:append-failed");
+  }
+  if (snapshot != nullptr) {
+    AppendCompactSnapshot(*snapshot, args.good_snapshots, &args.counters);
+  }
+}
+
+// The steps of MakeSnapshotFromBlob(). Each returns the snapshot for the
+// next step or std::nullopt if the blob is rejected, and updates statistics
+// in `args.counters` and stage times in `args.stage_times`. Only the runners
+// of FixupPreparedSnapshot() can fail for transient reasons.
+//
+// Converts `blob` into a normalized snapshot. Runs no runner.
+std::optional<Snapshot> PrepareSnapshotFromBlob(const std::string& blob,
+                                                FixToolWorkerArgs& args) {
+  FixupSnapshotOptions options;
+  // Reject what can be rejected statically before spawning any runner.
+  if (!PrefilterInstructions(blob, options, &args.counters)) {
+    return std::nullopt;
+  }
+  // Only the code differs between blobs, share the rest of the snapshot.
+  static const InstructionsSnapshotTemplate<Host>* const snapshot_template =
+      new InstructionsSnapshotTemplate<Host>();
+  absl::Time start = absl::Now();
+  absl::StatusOr<Snapshot> snapshot = snapshot_template->ToSnapshot(blob);
+  args.stage_times.Record("instructions-to-snapshot", absl::Now() - start);
+  if (!snapshot.ok()) {
+    args.counters.Increment(
+        "silifuzz-ERROR-FixToolWorker:instructions-to-snapshot-failed");
+    return std::nullopt;
+  }
+  snapshot->set_id(InstructionsToSnapshotId(blob));
+  start = absl::Now();
+  const bool normalized = NormalizeSnapshot(snapshot.value(), &args.counters);
+  args.stage_times.Record("normalize", absl::Now() - start);
+  if (!normalized) {
+    return std::nullopt;
+  }
+  RewriteInitialState(snapshot.value(), &args.counters);
+  return *std::move(snapshot);
+}
+
+// Makes, records, verifies and traces `snapshot` in runners. Mostly waits
+// for the runners. Also updates `platform_counters`. On failure, sets
+// `transient_failure` to whether the failure is transient, see
+// IsTransientFailure().
+std::optional<Snapshot> FixupPreparedSnapshot(
+    Snapshot snapshot, FixToolWorkerArgs& args,
+    PlatformFixToolCounters& platform_counters, bool& transient_failure) {
+  MakingStageTimes making_times;
+  FixupSnapshotOptions options;
+  options.stage_times = &making_times;
+  options.zygote_pool = args.zygote_pool;
+  auto remade_snapshot_or =
+      FixupSnapshot(std::move(snapshot), options, &platform_counters);
+  // Steps after a failed one are not run and not recorded.
+  for (const auto& [stage, duration] :
+       {std::pair{"fixup-make", making_times.make},
+        std::pair{"fixup-record", making_times.record},
+        std::pair{"fixup-verify", making_times.verify},
+        std::pair{"fixup-trace", making_times.trace}}) {
+    if (duration > absl::ZeroDuration()) {
+      args.stage_times.Record(stage, duration);
+    }
+  }
+  if (!remade_snapshot_or.ok()) {
+    transient_failure = IsTransientFailure(remade_snapshot_or.status());
+    return std::nullopt;
+  }
+  return *std::move(remade_snapshot_or);
+}
+
+// Snapifies a made `snapshot`.
+std::optional<Snapshot> FinishSnapshot(Snapshot snapshot,
+                                       FixToolWorkerArgs& args) {
+  // Snaps need to be snapified before GenerateRelocatableSnaps.
+  // If they are not, executable pages may not be RLE compressed.
+  const ArchitectureId architecture_id = snapshot.architecture_id();
+  const absl::Time start = absl::Now();
+  absl::StatusOr<Snapshot> snapified =
+      Snapify(std::move(snapshot),
+              SnapifyOptions::V2InputRunOpts(architecture_id));
+  args.stage_times.Record("snapify", absl::Now() - start);
+  if (!snapified.ok()) {
+    return std::nullopt;
+  }
+  args.counters.Increment("silifuzz-INFO-FixToolWorker:success");
+  return *std::move(snapified);
+}
+
+// Makes `blob` into a snapshot. Returns the snapshot or std::nullopt if the
+// blob is rejected, in which case `transient_failure` tells whether the
+// failure is transient. Updates statistics in `args.counters` and
+// `platform_counters` and stage times in `args.stage_times`.
+std::optional<Snapshot> MakeSnapshotFromBlob(
+    const std::string& blob, FixToolWorkerArgs& args,
+    PlatformFixToolCounters& platform_counters, bool& transient_failure) {
+  transient_failure = false;
+  std::optional<Snapshot> snapshot = PrepareSnapshotFromBlob(blob, args);
+  if (!snapshot.has_value()) return std::nullopt;
+  snapshot = FixupPreparedSnapshot(*std::move(snapshot), args,
+                                   platform_counters, transient_failure);
+  if (!snapshot.has_value()) return std::nullopt;
+  return FinishSnapshot(*std::move(snapshot), args);
+}
+
+PlatformFixToolCounters CurrentPlatformCounters(
+    SimpleFixToolCounters* counters) {
   auto current_platform = CurrentPlatformId();
   CHECK(current_platform != PlatformId::kUndefined);
-  PlatformFixToolCounters platform_counters(ShortPlatformName(current_platform),
-                                            &args.counters);
-  // To reduce contention of the global blob count, we batch the update.
-  // We update the global count for at least this amount.
-  constexpr size_t kMinCountUpdateSize = 100;
-  size_t count_update = 0;
-
-  for (const std::string& blob : args.blobs) {
-    // Update global blobs count.
-    if (++count_update >= kMinCountUpdateSize) {
-      num_blobs_processed.fetch_add(count_update);
-      count_update = 0;
-    }
+  return PlatformFixToolCounters(ShortPlatformName(current_platform),
+                                 counters);
+}
 
-    absl::StatusOr<Snapshot> snapshot = InstructionsToSnapshot<Host>(blob);
-    if (!snapshot.ok()) {
-      args.counters.Increment(
-          "silifuzz-ERROR-FixToolWorker:instructions-to-snapshot-failed");
-      continue;
-    }
-    snapshot->set_id(InstructionsToSnapshotId(blob));
-    if (!NormalizeSnapshot(snapshot.value(), &args.counters)) {
-      continue;
+void FixToolWorker(FixToolWorkerArgs& args) {
+  PlatformFixToolCounters platform_counters =
+      CurrentPlatformCounters(&args.counters);
+
+  while (true) {
+    const size_t begin = args.next_blob->fetch_add(kBlobsPerClaim);
+    if (begin >= args.blobs.size()) break;
+    const size_t end = std::min(begin + kBlobsPerClaim, args.blobs.size());
+    for (const std::string& blob : args.blobs.subspan(begin, end - begin)) {
+      bool transient_failure;
+      std::optional<Snapshot> snapshot = MakeSnapshotFromBlob(
+          blob, args, platform_counters, transient_failure);
+      RecordBlobOutcome(InstructionsToSnapshotId(blob),
+                        snapshot.has_value() ? &*snapshot : nullptr,
+                        transient_failure, args);
     }
-    RewriteInitialState(snapshot.value(), &args.counters);
-    const FixupSnapshotOptions options;
-    auto remade_snapshot_or =
-        FixupSnapshot(snapshot.value(), options, &platform_counters);
-    if (!remade_snapshot_or.ok()) {
-      continue;
+    args.progress->num_blobs_processed.fetch_add(end - begin,
+                                                 std::memory_order_relaxed);
+  }
+}
+
+// Stage workers of pipelined making. A blob counts towards the progress of
+// the worker of the stage where it leaves the pipeline, made or rejected.
+//
+// Claims blobs like FixToolWorker() and passes the prepared snapshots to
+// the fixup stage.
+void PrepareStageWorker(FixToolWorkerArgs& args) {
+  MakePipeline& pipeline = *args.pipeline;
+  while (true) {
+    const size_t begin = args.next_blob->fetch_add(kBlobsPerClaim);
+    if (begin >= args.blobs.size()) break;
+    const size_t end = std::min(begin + kBlobsPerClaim, args.blobs.size());
+    for (const std::string& blob : args.blobs.subspan(begin, end - begin)) {
+      std::optional<Snapshot> snapshot = PrepareSnapshotFromBlob(blob, args);
+      // The queue is closed only after all prepare workers exit.
+      if (snapshot.has_value() &&
+          pipeline.prepared.Push(*std::move(snapshot))) {
+        continue;
+      }
+      RecordBlobOutcome(InstructionsToSnapshotId(blob), nullptr,
+                        /*transient_failure=*/false, args);
+      args.progress->num_blobs_processed.fetch_add(1,
+                                                   std::memory_order_relaxed);
     }
-    // Snaps need to be snapified before GenerateRelocatableSnaps.
-    // If they are not, executable pages may not be RLE compressed.
-    remade_snapshot_or =
-        Snapify(remade_snapshot_or.value(),
-                SnapifyOptions::V2InputRunOpts(snapshot->architecture_id()));
-    if (!remade_snapshot_or.ok()) {
+  }
+  if (pipeline.num_preparing.fetch_sub(1) == 1) pipeline.prepared.Close();
+}
+
+void FixupStageWorker(FixToolWorkerArgs& args) {
+  MakePipeline& pipeline = *args.pipeline;
+  PlatformFixToolCounters platform_counters =
+      CurrentPlatformCounters(&args.counters);
+  while (std::optional<Snapshot> snapshot = pipeline.prepared.Pop()) {
+    const std::string snapshot_id = snapshot->id();
+    bool transient_failure = false;
+    snapshot = FixupPreparedSnapshot(*std::move(snapshot), args,
+                                     platform_counters, transient_failure);
+    if (snapshot.has_value() && pipeline.fixed_up.Push(*std::move(snapshot))) {
       continue;
     }
-    args.good_snapshots.push_back(std::move(remade_snapshot_or.value()));
-    args.counters.Increment("silifuzz-INFO-FixToolWorker:success");
+    RecordBlobOutcome(snapshot_id, nullptr, transient_failure, args);
+    args.progress->num_blobs_processed.fetch_add(1, std::memory_order_relaxed);
   }
+  if (pipeline.num_fixing_up.fetch_sub(1) == 1) pipeline.fixed_up.Close();
+}
 
-  num_blobs_processed.fetch_add(count_update);
+void FinishStageWorker(FixToolWorkerArgs& args) {
+  while (std::optional<Snapshot> snapshot = args.pipeline->fixed_up.Pop()) {
+    const std::string snapshot_id = snapshot->id();
+    snapshot = FinishSnapshot(*std::move(snapshot), args);
+    RecordBlobOutcome(snapshot_id, snapshot.has_value() ? &*snapshot : nullptr,
+                      /*transient_failure=*/false, args);
+    args.progress->num_blobs_processed.fetch_add(1, std::memory_order_relaxed);
+  }
 }
 
-void MakeProgressMonitor(size_t num_blobs, std::atomic<bool>& stop) {
+// Prints progress of making `num_blobs` blobs by workers with `progress`
+// until `stop` is set. Besides the overall count, this reports the slowest
+// and fastest per-worker throughput since start.
+void MakeProgressMonitor(size_t num_blobs,
+                         absl::Span<const WorkerProgress> progress,
+                         std::atomic<bool>& stop) {
   absl::Time start = absl::Now();
   absl::Duration interval = absl::Seconds(1);
   absl::Time next_checkpoint = start + interval;
@@ -134,8 +370,24 @@ void MakeProgressMonitor(size_t num_blobs, std::atomic<bool>& stop) {
     const bool stop_monitoring = stop.load();
     // Print progress at checkpoint or exit.
     if (stop_monitoring || absl::Now() >= next_checkpoint) {
-      std::cout << "Make snapshot count: " << num_blobs_processed.load()
-                << " of " << num_blobs << '\n';
+      const double elapsed_seconds =
+          std::max(absl::ToDoubleSeconds(absl::Now() - start), 1.0);
+      size_t num_blobs_processed = 0;
+      size_t min_worker_blobs = std::numeric_limits<size_t>::max();
+      size_t max_worker_blobs = 0;
+      for (const WorkerProgress& worker_progress : progress) {
+        const size_t worker_blobs =
+            worker_progress.num_blobs_processed.load(std::memory_order_relaxed);
+        num_blobs_processed += worker_blobs;
+        min_worker_blobs = std::min(min_worker_blobs, worker_blobs);
+        max_worker_blobs = std::max(max_worker_blobs, worker_blobs);
+      }
+      std::cout << absl::StrFormat(
+          "Make snapshot count: %d of %d, per-worker blobs/s min %.2f max "
+          "%.2f\n",
+          num_blobs_processed, num_blobs,
+          progress.empty() ? 0.0 : min_worker_blobs / elapsed_seconds,
+          max_worker_blobs / elapsed_seconds);
       if (stop_monitoring) {
         break;  // exit progress monitor.
       } else {
@@ -147,64 +399,284 @@ void MakeProgressMonitor(size_t num_blobs, std::atomic<bool>& stop) {
   }
 }
 
+// Returns a 128-bit non-cryptographic hash of `blob` used to de-dupe blobs.
+// This is much cheaper than InstructionsToSnapshotId(), which is only
+// computed for the unique blobs when snapshots are made from them. With 128
+// bits, a collision that drops a unique blob is practically impossible.
+absl::uint128 BlobHash(absl::string_view blob) {
+  const uint128 hash = CityHash128(blob.data(), blob.size());
+  return absl::MakeUint128(Uint128High64(hash), Uint128Low64(hash));
+}
+
+// A set of blob hashes shared by blob reader threads. Hashes are spread over
+// independently locked shards so that readers rarely contend.
+class BlobHashSet {
+ public:
+  BlobHashSet() = default;
+  ~BlobHashSet() = default;
+
+  // Not copyable or movable.
+  BlobHashSet(const BlobHashSet&) = delete;
+  BlobHashSet& operator=(const BlobHashSet&) = delete;
+
+  // Inserts `hash` into this set. Returns true iff `hash` was not in the set.
+  bool Insert(absl::uint128 hash) {
+    // The hash is already uniformly distributed.
+    Shard& shard = shards_[absl::Uint128Low64(hash) % kNumShards];
+    absl::MutexLock l(&shard.mu);
+    return shard.hashes.insert(hash).second;
+  }
+
+ private:
+  static constexpr size_t kNumShards = 64;
+
+  struct Shard {
+    absl::Mutex mu;
+    absl::flat_hash_set<absl::uint128> hashes ABSL_GUARDED_BY(mu);
+  };
+
+  std::array<Shard, kNumShards> shards_;
+};
+
+// Reads blobs from the Centipede blob file `input`. Appends those with hashes
+// not yet in `hash_seen` to `blobs` and adds their hashes to `hash_seen`.
+// Updates statistics in `counters`.
+void ReadUniqueCentipedeBlobsFromFile(const std::string& input,
+                                      BlobHashSet& hash_seen,
+                                      std::vector<std::string>& blobs,
+                                      SimpleFixToolCounters* counters) {
+  auto reader = centipede::DefaultBlobFileReaderFactory();
+  if (!reader->Open(input).ok()) {
+    counters->Increment("silifuzz-ERROR-Read:open-blob-reader-failed");
+    return;
+  }
+
+  absl::Status status;
+  centipede::ByteSpan blob;
+  while ((status = reader->Read(blob)).ok()) {
+    const absl::string_view blob_view(
+        reinterpret_cast<const char*>(blob.data()), blob.size());
+    // Only unique blobs are copied. `blob` is not valid beyond the next Read().
+    if (hash_seen.Insert(BlobHash(blob_view))) {
+      blobs.emplace_back(blob_view);
+    } else {
+      counters->Increment("silifuzz-INFO-Read:duplicate-blobs");
+    }
+  }
+
+  // Log if loop exited not because of EOF.
+  if (!absl::IsOutOfRange(status)) {
+    counters->Increment("silifuzz-ERROR-Read:read-blob-failed");
+  }
+
+  if (!reader->Close().ok()) {
+    counters->Increment("silifuzz-ERROR-Read:close-blob-reader-failed");
+  }
+}
+
 }  // namespace
 
+// Returns true iff making a snapshot failed with `status` for a reason that
+// may go away in a rerun, e.g. the runner could not be started, rather than
+// because of what the snapshot does.
+bool IsTransientFailure(const absl::Status& status) {
+  switch (status.code()) {
+    case absl::StatusCode::kAborted:
+    case absl::StatusCode::kCancelled:
+    case absl::StatusCode::kDeadlineExceeded:
+    case absl::StatusCode::kResourceExhausted:
+    case absl::StatusCode::kUnavailable:
+      return true;
+    default:
+      return false;
+  }
+}
+
 std::vector<std::string> ReadUniqueCentipedeBlobs(
+    const SimpleFixToolOptions& options,
     const std::vector<std::string>& inputs, SimpleFixToolCounters* counters) {
-  std::vector<std::string> blobs;
-
   // Centipede generates fuzzing corpus using multiple workers in parallel.
   // It is common for the generated corpus to have duplicates.
-  // Record unique snapshot names seen so far to de-dupe blobs.
-  absl::flat_hash_set<Snapshot::Id> id_seen;
-
-  for (const std::string& input : inputs) {
-    auto reader = centipede::DefaultBlobFileReaderFactory();
-    if (!reader->Open(input).ok()) {
-      counters->Increment("silifuzz-ERROR-Read:open-blob-reader-failed");
-      continue;
-    }
+  // Record hashes of the blobs seen so far to de-dupe blobs.
+  BlobHashSet hash_seen;
 
-    // TODO(dougkwan): Parallelize this to speed up blob reading.
-    absl::Status status;
-    centipede::ByteSpan blob;
-    while ((status = reader->Read(blob)).ok()) {
-      const std::string id = InstructionsToSnapshotId(
-          {reinterpret_cast<const char*>(blob.data()), blob.size()});
-      auto [_, inserted] = id_seen.insert(id);
-      if (inserted) {
-        blobs.push_back(std::string(blob.begin(), blob.end()));
-      } else {
-        counters->Increment("silifuzz-INFO-Read:duplicate-blobs");
+  // Files are handed out to workers one at a time as they vary in size.
+  std::atomic<size_t> next_input = 0;
+  std::vector<std::vector<std::string>> blobs_per_input(inputs.size());
+  const size_t num_workers = std::min<size_t>(
+      options.parallelism ? options.parallelism
+                          : std::thread::hardware_concurrency(),
+      inputs.size());
+  std::vector<SimpleFixToolCounters> worker_counters(num_workers);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers.emplace_back([&, &thread_counters = worker_counters[i]] {
+      size_t input_index;
+      while ((input_index = next_input.fetch_add(1)) < inputs.size()) {
+        ReadUniqueCentipedeBlobsFromFile(inputs[input_index], hash_seen,
+                                         blobs_per_input[input_index],
+                                         &thread_counters);
       }
-    }
+    });
+  }
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers[i].join();
+    counters->Merge(worker_counters[i]);
+  }
+
+  size_t num_blobs = 0;
+  for (const auto& input_blobs : blobs_per_input) {
+    num_blobs += input_blobs.size();
+  }
+
+  std::vector<std::string> blobs;
+  blobs.reserve(num_blobs);
+  for (auto& input_blobs : blobs_per_input) {
+    std::move(input_blobs.begin(), input_blobs.end(),
+              std::back_inserter(blobs));
+  }
+  return blobs;
+}
+
+absl::StatusOr<std::unique_ptr<FixToolCheckpoint>> FixToolCheckpoint::Open(
+    absl::string_view path) {
+  const int fd = open(std::string(path).c_str(),
+                      O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", path, ")"));
+  }
+  std::unique_ptr<FixToolCheckpoint> checkpoint(new FixToolCheckpoint(fd));
+  RETURN_IF_NOT_OK(checkpoint->ReadRecords());
+  return checkpoint;
+}
+
+FixToolCheckpoint::~FixToolCheckpoint() { close(fd_); }
+
+bool FixToolCheckpoint::Contains(absl::string_view snapshot_id) const {
+  absl::MutexLock lock(&mu_);
+  return snapshot_ids_.contains(snapshot_id);
+}
+
+std::vector<Snapshot> FixToolCheckpoint::TakeSnapshots() {
+  absl::MutexLock lock(&mu_);
+  std::vector<Snapshot> snapshots;
+  snapshots.swap(snapshots_);
+  return snapshots;
+}
 
-    // Log if loop exited not because of EOF.
-    if (!absl::IsOutOfRange(status)) {
-      counters->Increment("silifuzz-ERROR-Read:read-blob-failed");
+absl::Status FixToolCheckpoint::Append(absl::string_view snapshot_id,
+                                       const Snapshot* snapshot) {
+  proto::FixToolCheckpointRecord record;
+  record.set_snapshot_id(std::string(snapshot_id));
+  if (snapshot != nullptr) {
+    SnapshotProto::ToProto(*snapshot, record.mutable_snapshot());
+  }
+  std::string payload;
+  if (!record.SerializeToString(&payload)) {
+    return absl::InternalError("Cannot serialize checkpoint record");
+  }
+  // The size and the record go out in a single write so that records appended
+  // concurrently by other processes, if any, do not interleave.
+  const uint64_t size = payload.size();
+  std::string data(reinterpret_cast<const char*>(&size), sizeof(size));
+  data.append(payload);
+
+  absl::MutexLock lock(&mu_);
+  absl::string_view remaining = data;
+  while (!remaining.empty()) {
+    const ssize_t bytes_written =
+        write(fd_, remaining.data(), remaining.size());
+    if (bytes_written == -1) {
+      if (errno == EINTR) continue;
+      return absl::ErrnoToStatus(errno, "Cannot append checkpoint record");
     }
+    remaining.remove_prefix(bytes_written);
+  }
+  snapshot_ids_.emplace(snapshot_id);
+  return absl::OkStatus();
+}
 
-    if (!reader->Close().ok()) {
-      counters->Increment("silifuzz-ERROR-Read:close-blob-reader-failed");
+absl::Status FixToolCheckpoint::ReadRecords() {
+  std::string contents;
+  char buffer[1 << 16];
+  while (true) {
+    const ssize_t bytes_read =
+        pread(fd_, buffer, sizeof(buffer), contents.size());
+    if (bytes_read == -1) {
+      if (errno == EINTR) continue;
+      return absl::ErrnoToStatus(errno, "Cannot read checkpoint");
     }
+    if (bytes_read == 0) break;
+    contents.append(buffer, bytes_read);
   }
 
-  return blobs;
+  absl::MutexLock lock(&mu_);
+  size_t offset = 0;
+  uint64_t size;
+  // All supported architectures are little-endian.
+  while (contents.size() - offset >= sizeof(size)) {
+    memcpy(&size, contents.data() + offset, sizeof(size));
+    if (contents.size() - offset - sizeof(size) < size) break;
+    proto::FixToolCheckpointRecord record;
+    if (!record.ParseFromArray(contents.data() + offset + sizeof(size),
+                               static_cast<int>(size))) {
+      break;
+    }
+    if (record.has_snapshot()) {
+      ASSIGN_OR_RETURN_IF_NOT_OK(
+          Snapshot snapshot,
+          SnapshotProto::FromProto(std::move(*record.mutable_snapshot())));
+      snapshots_.push_back(std::move(snapshot));
+    }
+    snapshot_ids_.insert(record.snapshot_id());
+    offset += sizeof(size) + size;
+  }
+  if (offset != contents.size() && ftruncate(fd_, offset) == -1) {
+    return absl::ErrnoToStatus(errno, "Cannot truncate checkpoint");
+  }
+  return absl::OkStatus();
 }
 
-std::vector<Snapshot> MakeSnapshotsFromBlobs(
+std::vector<CompactSnapshot> MakeSnapshotsFromBlobs(
     const SimpleFixToolOptions& options, const std::vector<std::string>& blobs,
-    SimpleFixToolCounters* counters) {
-  const size_t num_workers = options.parallelism
-                                 ? options.parallelism
-                                 : std::thread::hardware_concurrency();
-  const std::vector<absl::Span<const std::string>> blob_spans =
-      PartitionEvenly(blobs, num_workers);
+    SimpleFixToolCounters* counters, FixToolCheckpoint* checkpoint,
+    FixToolStageTimes* stage_times) {
+  const absl::Time start = absl::Now();
+  // Pipelined making runs one thread per worker in each stage, the prepare
+  // stage first. See SimpleFixToolOptions::pipeline_fixup_threads.
+  std::optional<MakePipeline> pipeline;
+  std::vector<void (*)(FixToolWorkerArgs&)> worker_functions;
+  if (options.pipeline_fixup_threads > 0) {
+    const int num_prepare = std::max(options.pipeline_prepare_threads, 1);
+    const int num_fixup = options.pipeline_fixup_threads;
+    const int num_finish = std::max(options.pipeline_finish_threads, 1);
+    pipeline.emplace(std::max(options.pipeline_queue_size, 1), num_prepare,
+                     num_fixup);
+    worker_functions.insert(worker_functions.end(), num_prepare,
+                            PrepareStageWorker);
+    worker_functions.insert(worker_functions.end(), num_fixup,
+                            FixupStageWorker);
+    worker_functions.insert(worker_functions.end(), num_finish,
+                            FinishStageWorker);
+  } else {
+    worker_functions.assign(options.parallelism
+                                ? options.parallelism
+                                : std::thread::hardware_concurrency(),
+                            FixToolWorker);
+  }
+  const size_t num_workers = worker_functions.size();
+  // Workers claim blobs dynamically as the time to make a blob varies widely.
+  std::atomic<size_t> next_blob = 0;
+  std::vector<WorkerProgress> progress(num_workers);
+  // Forking a runner from a zygote is much cheaper than exec'ing one, which
+  // matters as each blob takes several runners to make.
+  ZygotePool zygote_pool(RunnerLocation());
 
   // Start progress monitor.
   std::atomic<bool> stop_progress_monitor = false;
-  std::thread progress_monitor = std::thread(MakeProgressMonitor, blobs.size(),
-                                             std::ref(stop_progress_monitor));
+  std::thread progress_monitor = std::thread(
+      MakeProgressMonitor, blobs.size(), absl::MakeConstSpan(progress),
+      std::ref(stop_progress_monitor));
 
   // Prepare args.
   std::vector<FixToolWorkerArgs> worker_args;
@@ -212,14 +684,19 @@ std::vector<Snapshot> MakeSnapshotsFromBlobs(
   for (size_t i = 0; i < num_workers; ++i) {
     FixToolWorkerArgs args;
     args.options = &options;
-    args.blobs = blob_spans[i];
+    args.blobs = blobs;
+    args.next_blob = &next_blob;
+    args.progress = &progress[i];
+    args.checkpoint = checkpoint;
+    args.pipeline = pipeline.has_value() ? &*pipeline : nullptr;
+    args.zygote_pool = &zygote_pool;
     worker_args.push_back(std::move(args));
   }
 
   // Start workers.
   std::vector<std::thread> workers;
   for (size_t i = 0; i < num_workers; ++i) {
-    workers.emplace_back(FixToolWorker, std::ref(worker_args[i]));
+    workers.emplace_back(worker_functions[i], std::ref(worker_args[i]));
   }
 
   size_t num_good_snapshots = 0;
@@ -229,11 +706,17 @@ std::vector<Snapshot> MakeSnapshotsFromBlobs(
 
     // It is now safe to access worker args for this worker.
     counters->Merge(worker_args[i].counters);
+    if (stage_times != nullptr) {
+      stage_times->Merge(worker_args[i].stage_times);
+    }
     num_good_snapshots += worker_args[i].good_snapshots.size();
   }
+  if (stage_times != nullptr) {
+    stage_times->RecordMakeThroughput(blobs.size(), absl::Now() - start);
+  }
 
   // Collect made snapshots and bad snapshot id.
-  std::vector<Snapshot> made_snapshots;
+  std::vector<CompactSnapshot> made_snapshots;
   made_snapshots.reserve(num_good_snapshots);
   for (auto& work_arg : worker_args) {
     std::move(work_arg.good_snapshots.begin(), work_arg.good_snapshots.end(),
@@ -247,19 +730,65 @@ std::vector<Snapshot> MakeSnapshotsFromBlobs(
   return made_snapshots;
 }
 
-std::vector<std::vector<Snapshot>> PartitionSnapshots(
+void ProfileSnapshots(const SimpleFixToolOptions& options,
+                      std::vector<CompactSnapshot>& snapshots,
+                      SimpleFixToolCounters* counters) {
+  const size_t num_workers = options.parallelism
+                                 ? options.parallelism
+                                 : std::thread::hardware_concurrency();
+  const MakingConfig making_config = MakingConfig::Default();
+  // Workers claim snapshots one at a time. Each writes only the snapshots it
+  // claimed.
+  std::atomic<size_t> next_snapshot = 0;
+  std::vector<SimpleFixToolCounters> worker_counters(num_workers);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers.emplace_back([&, &thread_counters = worker_counters[i]] {
+      size_t index;
+      while ((index = next_snapshot.fetch_add(1)) < snapshots.size()) {
+        CompactSnapshot& compact = snapshots[index];
+        absl::StatusOr<SnapshotProfile> profile;
+        if (absl::StatusOr<Snapshot> snapshot = compact.ToSnapshot();
+            snapshot.ok()) {
+          profile = ProfileSnapshot(*snapshot, options.profile_iterations,
+                                    making_config);
+        } else {
+          profile = snapshot.status();
+        }
+        if (!profile.ok()) {
+          VLOG_INFO(1, "Cannot profile ", compact.id(), ": ",
+                    profile.status().message());
+          thread_counters.Increment("silifuzz-ERROR-Profile:failed");
+          compact.set_execution_cost(0);
+          continue;
+        }
+        thread_counters.Increment("silifuzz-INFO-Profile:profiled");
+        compact.set_execution_cost(profile->median_ticks);
+      }
+    });
+  }
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers[i].join();
+    counters->Merge(worker_counters[i]);
+  }
+}
+
+std::vector<std::vector<CompactSnapshot>> PartitionSnapshots(
     const SimpleFixToolOptions& options, int num_groups,
-    std::vector<Snapshot>& snapshots) {
-  // Create snapshot summaries for partitioner.
+    std::vector<CompactSnapshot>& snapshots) {
+  // Collect snapshot summaries for partitioner.
   SnapshotGroup::SnapshotSummaryList ungrouped;
   ungrouped.reserve(snapshots.size());
-  for (auto& snapshot : snapshots) {
-    ungrouped.emplace_back(snapshot);
+  for (const auto& snapshot : snapshots) {
+    ungrouped.push_back(snapshot.summary());
   }
 
   // Run iterative partitioner.
   auto partitions = PartitionCorpus(
-      num_groups, options.num_partitioning_iterations, ungrouped);
+      num_groups, options.num_partitioning_iterations, ungrouped,
+      options.stable_partitioning
+          ? SnapshotPartition::Balance::kStableHash
+          : SnapshotPartition::Balance::kSizeAndCost);
 
   // Build Snapshot ID -> Group index map.
   absl::flat_hash_map<Snapshot::Id, int> group_map;
@@ -273,12 +802,12 @@ std::vector<std::vector<Snapshot>> PartitionSnapshots(
   }
 
   // Reserve memory in output.
-  std::vector<std::vector<Snapshot>> groups(
+  std::vector<std::vector<CompactSnapshot>> groups(
       partitions.snapshot_groups().size());
   for (int i = 0; i < partitions.snapshot_groups().size(); ++i) {
     groups[i].reserve(partitions.snapshot_groups()[i].size());
   }
-  std::vector<Snapshot> ungrouped_snapshots;
+  std::vector<CompactSnapshot> ungrouped_snapshots;
   ungrouped_snapshots.reserve(ungrouped.size());
 
   // Move grouped snapshots to output.
@@ -295,46 +824,337 @@ std::vector<std::vector<Snapshot>> PartitionSnapshots(
   return groups;
 }
 
-void WriteOutputFiles(const std::vector<std::vector<Snapshot>>& shards,
+void WriteOutputFiles(const SimpleFixToolOptions& options,
+                      std::vector<std::vector<CompactSnapshot>> shards,
                       absl::string_view output_path_prefix,
-                      SimpleFixToolCounters* counters) {
+                      SimpleFixToolCounters* counters,
+                      proto::CorpusMetadata* metadata,
+                      FixToolStageTimes* stage_times) {
+  FixToolStageTimes unused_stage_times;
+  if (stage_times == nullptr) {
+    stage_times = &unused_stage_times;
+  }
   for (int i = 0; i < shards.size(); ++i) {
-    auto relocatable =
-        GenerateRelocatableSnaps(Host::architecture_id, shards[i]);
-    const std::string file_name =
-        absl::StrFormat("%s.%05d", output_path_prefix, i);
-    std::ofstream os(file_name);
-    if (!os.is_open()) {
+    absl::Time start = absl::Now();
+    // Classify snaps so that the runner can batch them by register usage.
+    RelocatableSnapGeneratorOptions generator_options;
+    generator_options.code_register_groups = [](const Snapshot& snapshot) {
+      return CodeRegisterGroups<Host>(snapshot).Serialize();
+    };
+    absl::StatusOr<std::unique_ptr<StreamingRelocatableSnapGenerator>>
+        generator_or = StreamingRelocatableSnapGenerator::Create(
+            Host::architecture_id, generator_options);
+    if (!generator_or.ok()) {
+      counters->Increment("silifuzz-ERROR-Output:generate-failed");
+      continue;
+    }
+    StreamingRelocatableSnapGenerator& generator = **generator_or;
+    size_t num_snaps = 0;
+    // Snaps in a shard do not conflict but usually share some mappings, e.g.
+    // the stack. Count those once.
+    absl::flat_hash_set<std::pair<Snapshot::Address, Snapshot::ByteSize>>
+        mappings;
+    uint64_t mapped_bytes = 0;
+    bool add_failed = false;
+    {
+      // The shard is owned here and freed at the end of this scope, before
+      // the corpus is finalized.
+      const std::vector<CompactSnapshot> shard = std::move(shards[i]);
+      num_snaps = shard.size();
+      for (const CompactSnapshot& compact : shard) {
+        absl::StatusOr<Snapshot> snapshot = compact.ToSnapshot();
+        if (!snapshot.ok() || !generator.Add(*snapshot).ok()) {
+          add_failed = true;
+          break;
+        }
+        for (const auto& mapping : snapshot->memory_mappings()) {
+          if (mappings.emplace(mapping.start_address(), mapping.num_bytes())
+                  .second) {
+            mapped_bytes += mapping.num_bytes();
+          }
+        }
+      }
+    }
+    if (add_failed) {
+      stage_times->Record("generate", absl::Now() - start);
+      counters->Increment("silifuzz-ERROR-Output:generate-failed");
+      continue;
+    }
+
+    // An uncompressed corpus is streamed straight into the output file. A
+    // compressed one is streamed into an unlinked temporary file first.
+    std::string file_name = absl::StrFormat("%s.%05d", output_path_prefix, i);
+    const bool compress = options.zstd_level != 0;
+    std::string corpus_path = file_name;
+    if (compress) {
+      absl::StatusOr<std::string> temp_path_or =
+          CreateTempFile("simple_fix_tool_corpus");
+      if (!temp_path_or.ok()) {
+        counters->Increment("silifuzz-ERROR-Output:open-failed");
+        continue;
+      }
+      corpus_path = *std::move(temp_path_or);
+    }
+    int fd = open(corpus_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    if (compress) {
+      unlink(corpus_path.c_str());
+    }
+    if (fd < 0) {
       counters->Increment("silifuzz-ERROR-Output:open-failed");
       continue;
     }
-    os.write(relocatable.get(), MmappedMemorySize(relocatable));
-    if (os.fail()) {
+    absl::StatusOr<size_t> corpus_size_or = generator.Finalize(fd);
+    stage_times->Record("generate", absl::Now() - start);
+    if (!corpus_size_or.ok()) {
+      close(fd);
+      if (!compress) {
+        unlink(corpus_path.c_str());
+      }
+      counters->Increment("silifuzz-ERROR-Output:generate-failed");
+      continue;
+    }
+    const size_t corpus_size = *corpus_size_or;
+    proto::ShardMetadata shard_metadata;
+    shard_metadata.set_name(file_name.substr(file_name.rfind('/') + 1));
+    shard_metadata.set_num_snaps(num_snaps);
+    shard_metadata.set_uncompressed_size_bytes(corpus_size);
+    shard_metadata.set_expected_runner_rss_bytes(corpus_size + mapped_bytes);
+    if (compress) {
+      start = absl::Now();
+      // The corpus is read through the page cache of the temporary file
+      // rather than an anonymous copy.
+      void* corpus =
+          mmap(nullptr, corpus_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (corpus == MAP_FAILED) {
+        counters->Increment("silifuzz-ERROR-Output:compress-failed");
+        continue;
+      }
+      absl::StatusOr<std::string> compressed_or = ZstdCompress(
+          absl::string_view(reinterpret_cast<const char*>(corpus),
+                            corpus_size),
+          options.zstd_level);
+      munmap(corpus, corpus_size);
+      stage_times->Record("compress", absl::Now() - start);
+      if (!compressed_or.ok()) {
+        counters->Increment("silifuzz-ERROR-Output:compress-failed");
+        continue;
+      }
+      start = absl::Now();
+      absl::StrAppend(&file_name, kZstdExtension);
+      std::ofstream os(file_name);
+      if (!os.is_open()) {
+        counters->Increment("silifuzz-ERROR-Output:open-failed");
+        continue;
+      }
+      os.write(compressed_or->data(), compressed_or->size());
+      if (os.fail()) {
+        counters->Increment("silifuzz-ERROR-Output:write-failed.");
+        continue;
+      }
+      os.close();
+      stage_times->Record("write", absl::Now() - start);
+    } else if (close(fd) != 0) {
       counters->Increment("silifuzz-ERROR-Output:write-failed.");
+      continue;
+    }
+    if (metadata != nullptr) {
+      *metadata->add_shards() = std::move(shard_metadata);
     }
-    os.close();
+  }
+}
+
+void WriteCorpusMetadata(const proto::CorpusMetadata& metadata,
+                         const std::string& path,
+                         SimpleFixToolCounters* counters) {
+  std::string text;
+  if (!google::protobuf::TextFormat::PrintToString(metadata, &text)) {
+    counters->Increment("silifuzz-ERROR-Output:metadata-print-failed");
+    return;
+  }
+  std::ofstream os(path);
+  os.write(text.data(), text.size());
+  if (!os.is_open() || os.fail()) {
+    counters->Increment("silifuzz-ERROR-Output:metadata-write-failed");
+  }
+}
+
+void MergePlatformCheckpoint(absl::string_view path,
+                             std::vector<CompactSnapshot>& snapshots,
+                             SimpleFixToolCounters* counters) {
+  absl::StatusOr<std::unique_ptr<FixToolCheckpoint>> checkpoint_or =
+      FixToolCheckpoint::Open(path);
+  if (!checkpoint_or.ok()) {
+    LOG_ERROR("Cannot open ", path, ": ", checkpoint_or.status().message());
+    counters->Increment("silifuzz-ERROR-Merge:open-failed");
+    return;
+  }
+  absl::flat_hash_map<Snapshot::Id, Snapshot> recorded;
+  for (Snapshot& snapshot : (*checkpoint_or)->TakeSnapshots()) {
+    Snapshot::Id id = snapshot.id();
+    recorded.emplace(std::move(id), std::move(snapshot));
+  }
+  for (CompactSnapshot& compact : snapshots) {
+    auto it = recorded.find(compact.id());
+    if (it == recorded.end()) {
+      counters->Increment("silifuzz-ERROR-Merge:no-end-state");
+      continue;
+    }
+    absl::StatusOr<Snapshot> snapshot = compact.ToSnapshot();
+    if (!snapshot.ok() || !MergeEndStates(*snapshot, it->second).ok()) {
+      counters->Increment("silifuzz-ERROR-Merge:merge-failed");
+      continue;
+    }
+    absl::StatusOr<CompactSnapshot> merged = CompactSnapshot::Create(*snapshot);
+    if (!merged.ok()) {
+      counters->Increment("silifuzz-ERROR-Merge:merge-failed");
+      continue;
+    }
+    compact = *std::move(merged);
+    counters->Increment("silifuzz-INFO-Merge:merged");
   }
 }
 
 }  // namespace fix_tool_internal
 
+using fix_tool_internal::FixToolCheckpoint;
+
+void RecordPlatformEndStates(
+    const SimpleFixToolOptions& options,
+    absl::string_view input_checkpoint_path,
+    fix_tool_internal::SimpleFixToolCounters* counters) {
+  CHECK(!options.checkpoint_path.empty());
+  absl::StatusOr<std::unique_ptr<FixToolCheckpoint>> input_or =
+      FixToolCheckpoint::Open(input_checkpoint_path);
+  CHECK_STATUS(input_or.status());
+  std::vector<Snapshot> snapshots = (*input_or)->TakeSnapshots();
+  absl::StatusOr<std::unique_ptr<FixToolCheckpoint>> output_or =
+      FixToolCheckpoint::Open(options.checkpoint_path);
+  CHECK_STATUS(output_or.status());
+  FixToolCheckpoint& output = **output_or;
+
+  const size_t num_snapshots = snapshots.size();
+  snapshots.erase(std::remove_if(snapshots.begin(), snapshots.end(),
+                                 [&output](const Snapshot& snapshot) {
+                                   return output.Contains(snapshot.id());
+                                 }),
+                  snapshots.end());
+  counters->IncrementBy("silifuzz-INFO-Checkpoint:skipped-snapshots",
+                        num_snapshots - snapshots.size());
+
+  const size_t num_workers = options.parallelism
+                                 ? options.parallelism
+                                 : std::thread::hardware_concurrency();
+  std::atomic<size_t> next_snapshot = 0;
+  std::vector<fix_tool_internal::SimpleFixToolCounters> worker_counters(
+      num_workers);
+  std::vector<std::thread> workers;
+  workers.reserve(num_workers);
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers.emplace_back([&, i] {
+      fix_tool_internal::PlatformFixToolCounters platform_counters(
+          ShortPlatformName(CurrentPlatformId()), &worker_counters[i]);
+      const fix_tool_internal::FixupSnapshotOptions fixup_options;
+      for (size_t j = next_snapshot.fetch_add(1); j < snapshots.size();
+           j = next_snapshot.fetch_add(1)) {
+        absl::StatusOr<Snapshot> recorded =
+            fix_tool_internal::RecordCurrentPlatformEndState(
+                snapshots[j], fixup_options, &platform_counters);
+        // Snapify like made snapshots so that end states compare equal when
+        // merged.
+        if (recorded.ok()) {
+          recorded =
+              Snapify(*recorded, SnapifyOptions::V2InputRunOpts(
+                                     recorded->architecture_id()));
+        }
+        const Snapshot* snapshot = recorded.ok() ? &*recorded : nullptr;
+        if (!output.Append(snapshots[j].id(), snapshot).ok()) {
+          worker_counters[i].Increment(
+              "silifuzz-ERROR-Checkpoint:append-failed");
+        }
+      }
+    });
+  }
+  for (size_t i = 0; i < num_workers; ++i) {
+    workers[i].join();
+    counters->Merge(worker_counters[i]);
+  }
+}
+
 void FixupCorpus(const SimpleFixToolOptions& options,
                  const std::vector<std::string>& inputs,
                  absl::string_view output_path_prefix, size_t num_output_shards,
-                 fix_tool_internal::SimpleFixToolCounters* counters) {
-  const std::vector<std::string> blobs =
-      ReadUniqueCentipedeBlobs(inputs, counters);
-  std::vector<Snapshot> made_snapshots =
-      MakeSnapshotsFromBlobs(options, blobs, counters);
+                 fix_tool_internal::SimpleFixToolCounters* counters,
+                 fix_tool_internal::FixToolStageTimes* stage_times) {
+  fix_tool_internal::FixToolStageTimes unused_stage_times;
+  if (stage_times == nullptr) {
+    stage_times = &unused_stage_times;
+  }
+  absl::Time start = absl::Now();
+  std::vector<std::string> blobs =
+      ReadUniqueCentipedeBlobs(options, inputs, counters);
+  stage_times->Record("read", absl::Now() - start);
+  std::unique_ptr<FixToolCheckpoint> checkpoint;
+  std::vector<CompactSnapshot> made_snapshots;
+  if (!options.checkpoint_path.empty()) {
+    // Without a working checkpoint a long run could not be resumed, so do not
+    // start one.
+    absl::StatusOr<std::unique_ptr<FixToolCheckpoint>> checkpoint_or =
+        FixToolCheckpoint::Open(options.checkpoint_path);
+    CHECK_STATUS(checkpoint_or.status());
+    checkpoint = *std::move(checkpoint_or);
+    std::vector<Snapshot> checkpointed = checkpoint->TakeSnapshots();
+    counters->IncrementBy("silifuzz-INFO-Checkpoint:snapshots",
+                          checkpointed.size());
+    made_snapshots.reserve(checkpointed.size());
+    for (Snapshot& snapshot : checkpointed) {
+      fix_tool_internal::AppendCompactSnapshot(snapshot, made_snapshots,
+                                               counters);
+      Snapshot released = std::move(snapshot);  // Frees memory held by it.
+    }
+    const size_t num_blobs = blobs.size();
+    blobs.erase(std::remove_if(blobs.begin(), blobs.end(),
+                               [&checkpoint](const std::string& blob) {
+                                 return checkpoint->Contains(
+                                     InstructionsToSnapshotId(blob));
+                               }),
+                blobs.end());
+    counters->IncrementBy("silifuzz-INFO-Checkpoint:skipped-blobs",
+                          num_blobs - blobs.size());
+  }
+  std::vector<CompactSnapshot> new_snapshots =
+      MakeSnapshotsFromBlobs(options, blobs, counters, checkpoint.get(),
+                             stage_times);
+  made_snapshots.insert(made_snapshots.end(),
+                        std::make_move_iterator(new_snapshots.begin()),
+                        std::make_move_iterator(new_snapshots.end()));
+  new_snapshots.clear();
+  for (const std::string& path : options.platform_checkpoint_paths) {
+    fix_tool_internal::MergePlatformCheckpoint(path, made_snapshots, counters);
+  }
 
-  std::vector<std::vector<Snapshot>> shards =
+  if (options.profile_iterations > 0) {
+    start = absl::Now();
+    fix_tool_internal::ProfileSnapshots(options, made_snapshots, counters);
+    stage_times->Record("profile", absl::Now() - start);
+  }
+
+  start = absl::Now();
+  std::vector<std::vector<CompactSnapshot>> shards =
       fix_tool_internal::PartitionSnapshots(options, num_output_shards,
                                             made_snapshots);
+  stage_times->Record("partition", absl::Now() - start);
   counters->IncrementBy("silifuzz-ERROR-Partition:cannot-group",
                         made_snapshots.size());
   made_snapshots.clear();  // discard any left-over snapshots.
 
-  WriteOutputFiles(shards, output_path_prefix, counters);
+  proto::CorpusMetadata metadata;
+  WriteOutputFiles(options, std::move(shards), output_path_prefix, counters,
+                   &metadata, stage_times);
+  if (!options.corpus_metadata_path.empty()) {
+    WriteCorpusMetadata(metadata, options.corpus_metadata_path, counters);
+  }
 }
 
 }  // namespace silifuzz
@@ -25,11 +25,20 @@
 #define THIRD_PARTY_SILIFUZZ_TOOLS_SIMPLE_FIX_TOOL_H_
 
 #include <cstddef>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "./common/snapshot.h"
+#include "./proto/corpus_metadata.pb.h"
+#include "./tool_libs/compact_snapshot.h"
+#include "./tool_libs/fix_tool_stage_times.h"
 #include "./tool_libs/simple_fix_tool_counters.h"
 
 namespace silifuzz {
@@ -42,10 +51,32 @@ struct SimpleFixToolOptions {
   // Number of corpus partitioning iterations.
   int num_partitioning_iterations = 10;
 
+  // If true, snapshots are assigned to shards by a stable hash of their ids
+  // rather than to balance shard sizes and costs, so that a corpus built from
+  // a superset of the inputs of a previous one changes only a few shards.
+  // See SnapshotPartition::Balance::kStableHash.
+  bool stable_partitioning = false;
+
   // Number of parallel worker threads.  If it is 0, the maximum hardware
   // parallelism is used.
   int parallelism = 0;
 
+  // If `pipeline_fixup_threads` is not 0, blobs are made by a pipeline of
+  // three stages connected by bounded queues instead of by `parallelism`
+  // workers that each take a blob through all steps. Prepare threads
+  // prefilter blobs and convert them into normalized snapshots, fixup threads
+  // make, record, verify and trace the snapshots in runners, and finish
+  // threads snapify and checkpoint the made snapshots. A fixup thread keeps
+  // one runner busy at a time, so there are typically as many of them as
+  // CPUs. The CPU-bound prepare and finish stages then need only a few
+  // threads, which run while the fixup threads wait for their runners.
+  int pipeline_prepare_threads = 1;
+  int pipeline_fixup_threads = 0;
+  int pipeline_finish_threads = 1;
+
+  // Capacity of each queue between two stages of the pipeline.
+  int pipeline_queue_size = 64;
+
   // If true, filter Snap containing lock instructions that access memory
   // across cache line boundary. This has no effect on platforms other than x86.
   bool x86_filter_split_lock = true;
@@ -57,6 +88,35 @@ struct SimpleFixToolOptions {
   // If true, tracer injects a signal when an instruction accesses memory. This
   // has no effect on non-x86 platforms.
   bool filter_memory_access = false;
+
+  // If not 0, output shards are compressed with zstd at this level and get a
+  // ".zst" extension.
+  int zstd_level = 0;
+
+  // If not empty, path of a checkpoint file recording every blob made, see
+  // FixToolCheckpoint. Blobs already in the checkpoint are not made again and
+  // their snapshots are taken from the checkpoint instead. This lets a rerun
+  // after a crash resume where the previous run stopped. Running with new
+  // inputs and an existing checkpoint makes only the new blobs and outputs a
+  // corpus containing snapshots of both.
+  std::string checkpoint_path;
+
+  // Checkpoints written by RecordPlatformEndStates() on other platforms. End
+  // states recorded in them are merged into the made snapshots before the
+  // snapshots are partitioned, so the output corpus works on all of these
+  // platforms.
+  std::vector<std::string> platform_checkpoint_paths;
+
+  // If not 0, every made snapshot is played this many times in a runner
+  // before partitioning and its measured median latency replaces its
+  // estimated execution cost, so that shards are balanced on measured costs.
+  // See ProfileSnapshots().
+  int profile_iterations = 0;
+
+  // If not empty, path of a proto::CorpusMetadata text proto describing the
+  // output shards, for the orchestrator to size the corpus without loading
+  // it.
+  std::string corpus_metadata_path;
 };
 
 // Converts raw instructions blobs in `inputs` into snapshots of the
@@ -64,46 +124,159 @@ struct SimpleFixToolOptions {
 // end states for them. Partitions successfully made snapshots into
 // `num_output_shards` shards and outputs snapified snapshots as a sharded
 // relocatable corpus. pdates fix tool statistics in
-// `counters`.
+// `counters`. If `stage_times` is not nullptr, adds the time spent in each
+// stage to it.
 void FixupCorpus(const SimpleFixToolOptions& options,
                  const std::vector<std::string>& inputs,
                  absl::string_view output_path_prefix, size_t num_output_shards,
-                 fix_tool_internal::SimpleFixToolCounters* counters);
+                 fix_tool_internal::SimpleFixToolCounters* counters,
+                 fix_tool_internal::FixToolStageTimes* stage_times = nullptr);
+
+// Records end states for the current platform of all snapshots in the
+// checkpoint at `input_checkpoint_path` and appends them to the checkpoint at
+// `options.checkpoint_path`, which must not be empty. The input checkpoint is
+// written by FixupCorpus() on another platform. This lets a single fix run
+// produce a corpus for several platforms: copy its checkpoint to one machine
+// of each other platform, run this there, and pass the resulting checkpoints
+// to a rerun of FixupCorpus() as `options.platform_checkpoint_paths`. Only
+// end states are recorded, so this is much cheaper than fixing the inputs on
+// each platform. Snapshots already in the output checkpoint are skipped.
+// Updates fix tool statistics in `counters`.
+void RecordPlatformEndStates(
+    const SimpleFixToolOptions& options,
+    absl::string_view input_checkpoint_path,
+    fix_tool_internal::SimpleFixToolCounters* counters);
 
 // ----------------------- implementation details ------------------
 namespace fix_tool_internal {
 
 // Read unique blobs from files in `inputs`. Returns a vector of blobs. This
 // reads as many blobs as possible.  It there is an error while reading a blob
-// file, the rest of the file is ignored and reading continues. Updates
-// statistics in `counters`.
+// file, the rest of the file is ignored and reading continues. Files are read
+// in parallel using up to `options.parallelism` threads. Blobs are grouped by
+// the input file they are returned from, in the order of `inputs`, but a blob
+// present in several files may come from any of them. Updates statistics in
+// `counters`.
 std::vector<std::string> ReadUniqueCentipedeBlobs(
+    const SimpleFixToolOptions& options,
     const std::vector<std::string>& inputs, SimpleFixToolCounters* counters);
 
+// An append-only file recording the outcome of making each blob, keyed by
+// the ID of the snapshot made from the blob. Records are appended as blobs
+// are made, so a crash loses at most the blobs being made at the time.
+//
+// Each record is a little-endian 64-bit size followed by a serialized
+// proto::FixToolCheckpointRecord of that size. When the file is opened, it is
+// read up to the first record that is incomplete or does not parse, which is
+// what a crash while appending leaves behind, and truncated there.
+//
+// This class is thread-safe.
+class FixToolCheckpoint {
+ public:
+  // Opens the checkpoint at `path`, creating an empty one if it does not
+  // exist, and reads all records in it.
+  static absl::StatusOr<std::unique_ptr<FixToolCheckpoint>> Open(
+      absl::string_view path);
+
+  ~FixToolCheckpoint();
+
+  // Not copyable or movable.
+  FixToolCheckpoint(const FixToolCheckpoint&) = delete;
+  FixToolCheckpoint& operator=(const FixToolCheckpoint&) = delete;
+
+  // Returns true iff there is a record for `snapshot_id`.
+  bool Contains(absl::string_view snapshot_id) const
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns snapshots made by previous runs, i.e. those recorded in the file
+  // when it was opened, and releases them from this.
+  std::vector<Snapshot> TakeSnapshots() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Records that the blob of `snapshot_id` was made into `snapshot` or that
+  // it was rejected if `snapshot` is nullptr.
+  absl::Status Append(absl::string_view snapshot_id, const Snapshot* snapshot)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  explicit FixToolCheckpoint(int fd) : fd_(fd) {}
+
+  // Reads records from fd_ and truncates a torn record at the end if any.
+  absl::Status ReadRecords() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Checkpoint file, opened for appending.
+  const int fd_;
+
+  mutable absl::Mutex mu_;
+
+  // IDs of all recorded blobs.
+  absl::flat_hash_set<std::string> snapshot_ids_ ABSL_GUARDED_BY(mu_);
+
+  // Snapshots read from the file, see TakeSnapshots().
+  std::vector<Snapshot> snapshots_ ABSL_GUARDED_BY(mu_);
+};
+
+// Returns true iff making a snapshot failed with `status` for a reason that
+// may go away in a rerun, e.g. the runner could not be started, rather than
+// because of what the snapshot does.
+bool IsTransientFailure(const absl::Status& status);
+
 // Makes `blobs` with `parallelism` into complete snapshots with end states
 // for the current platform on which this runs. Return a vector of made
-// snapshots. The make process is controlled by `options`. Updates fix tool
-// statistics in `counters`.
-std::vector<Snapshot> MakeSnapshotsFromBlobs(
+// snapshots in compact form, so that a large corpus fits in memory. The make
+// process is controlled by `options`. Workers claim blobs
+// a few at a time as they become idle, so the order of made snapshots is not
+// deterministic. If `checkpoint` is not nullptr, the outcome of each blob is
+// appended to it unless making the blob failed for a transient reason, see
+// IsTransientFailure(). Updates fix tool statistics in `counters`. If
+// `stage_times` is not nullptr, adds the time spent in each step of making a
+// blob and the overall blob rate to it.
+std::vector<CompactSnapshot> MakeSnapshotsFromBlobs(
     const SimpleFixToolOptions& options, const std::vector<std::string>& blobs,
-    SimpleFixToolCounters* counters);
+    SimpleFixToolCounters* counters, FixToolCheckpoint* checkpoint = nullptr,
+    FixToolStageTimes* stage_times = nullptr);
+
+// Measures the execution cost of each of `snapshots` with ProfileSnapshot()
+// playing it `options.profile_iterations` times, and sets it as the
+// snapshot's execution cost. Snapshots are profiled in parallel by
+// `options.parallelism` workers, one runner process per snapshot. The cost of
+// a snapshot that cannot be profiled is set to 0 (unknown) so that all costs
+// are in the same unit. Updates fix tool statistics in `counters`.
+void ProfileSnapshots(const SimpleFixToolOptions& options,
+                      std::vector<CompactSnapshot>& snapshots,
+                      SimpleFixToolCounters* counters);
 
 // Partitions and moves `snapshots` into `num_groups` groups,
 // each of which contains snapshots with no memory mapping conflicts.
 // The partition process is controlled by `options`.
-// Returns a vector of groups (vector<Snapshot>). Snapshots that
+// Returns a vector of groups (vector<CompactSnapshot>). Snapshots that
 // cannot be grouped and moved will remain in `snapshots`. Also updates fix
 // tool statistics in `counters`.
-std::vector<std::vector<Snapshot>> PartitionSnapshots(
+std::vector<std::vector<CompactSnapshot>> PartitionSnapshots(
     const SimpleFixToolOptions& options, int num_groups,
-    std::vector<Snapshot>& snapshots);
+    std::vector<CompactSnapshot>& snapshots);
 
 // Writes snapshots in `shards` into relocatable corpora. Each corpus has
-// a path `output_path_prefix` + '.' + <shard index>. Updates fix tool
-// statistics in `counters`.
-void WriteOutputFiles(const std::vector<std::vector<Snapshot>>& shards,
+// a path `output_path_prefix` + '.' + <shard index>, followed by a compression
+// extension if `options` asks for compression. Takes ownership of `shards` and
+// frees each shard once its snapshots are added to a corpus, so that memory
+// use goes down while shards are written. Corpora are streamed to files
+// instead of being built in memory. Updates fix tool statistics in
+// `counters`. If `metadata` is not nullptr, adds the metadata of each shard
+// written to it. If `stage_times` is not nullptr, adds the time spent
+// generating, compressing and writing each shard to it.
+void WriteOutputFiles(const SimpleFixToolOptions& options,
+                      std::vector<std::vector<CompactSnapshot>> shards,
                       absl::string_view output_path_prefix,
-                      SimpleFixToolCounters* counters);
+                      SimpleFixToolCounters* counters,
+                      proto::CorpusMetadata* metadata = nullptr,
+                      FixToolStageTimes* stage_times = nullptr);
+
+// Merges end states recorded by RecordPlatformEndStates() in the checkpoint at
+// `path` into `snapshots`. Snapshots without a recorded end state are left as
+// they are. Updates fix tool statistics in `counters`.
+void MergePlatformCheckpoint(absl::string_view path,
+                             std::vector<CompactSnapshot>& snapshots,
+                             SimpleFixToolCounters* counters);
 
 }  // namespace fix_tool_internal
 
@@ -19,6 +19,10 @@
 // Usage:
 //   simple_fix_tool_main [optional flags] <corpus_0> .. <corpus_n>
 //
+// or, to record end states for another platform of a fix run:
+//   simple_fix_tool_main --checkpoint=<output checkpoint> \
+//     --record_end_states_from=<checkpoint of the fix run>
+//
 // To list flags, use simple_fix_tool_main --help.
 #include <cstdlib>
 #include <string>
@@ -28,6 +32,7 @@
 #include "absl/flags/parse.h"
 #include "absl/log/initialize.h"
 #include "absl/strings/string_view.h"
+#include "./tool_libs/fix_tool_stage_times.h"
 #include "./tool_libs/simple_fix_tool_counters.h"
 #include "./tools/simple_fix_tool.h"
 #include "./util/checks.h"
@@ -40,10 +45,27 @@ ABSL_FLAG(int, num_output_shards, 1, "number of shards in the output corpus");
 ABSL_FLAG(int, num_partitioning_iterations, 10,
           "Number of times the corpus partitioner runs");
 
+ABSL_FLAG(bool, stable_partitioning, false,
+          "If true, assign snapshots to shards by a stable hash of their ids "
+          "instead of balancing shard sizes and costs, so that successive "
+          "corpus versions change only a few shards.");
+
 ABSL_FLAG(int, parallelism, 0,
           "Number of parallel worker threads.  If it is 0, the simple fix tool "
           "uses the maximum hardware parallelism.");
 
+ABSL_FLAG(int, pipeline_fixup_threads, 0,
+          "If not 0, make blobs in a pipeline of prepare, fixup and finish "
+          "stages with this many fixup threads, each driving one runner at a "
+          "time, instead of with --parallelism workers.");
+
+ABSL_FLAG(int, pipeline_prepare_threads, 1,
+          "Threads converting blobs to snapshots with "
+          "--pipeline_fixup_threads.");
+
+ABSL_FLAG(int, pipeline_finish_threads, 1,
+          "Threads snapifying made snapshots with --pipeline_fixup_threads.");
+
 ABSL_FLAG(bool, x86_filter_split_lock, true,
           "On x86, filter snaps with lock instructions accessing memory across "
           "cache line boundaries.");
@@ -54,6 +76,38 @@ ABSL_FLAG(bool, x86_filter_vsyscall_region_access, true,
 ABSL_FLAG(bool, filter_memory_access, false,
           "Filter snaps with memory accesses Currently x86-only.");
 
+ABSL_FLAG(int, zstd_level, 0,
+          "If not 0, compress output shards with zstd at this level. A .zst "
+          "extension is appended to each output shard file.");
+
+ABSL_FLAG(std::string, checkpoint, "",
+          "If not empty, path of a checkpoint file recording every blob made. "
+          "Blobs recorded there are not made again, so a rerun resumes an "
+          "interrupted one and a run with new inputs makes only new blobs.");
+
+ABSL_FLAG(std::vector<std::string>, platform_checkpoints, {},
+          "Comma-separated checkpoints written with --record_end_states_from "
+          "on other platforms. Their end states are merged into the output "
+          "corpus.");
+
+ABSL_FLAG(std::string, record_end_states_from, "",
+          "If not empty, instead of fixing inputs, record end states for this "
+          "platform of the snapshots in this checkpoint written on another "
+          "platform, and append them to --checkpoint.");
+
+ABSL_FLAG(int, profile_iterations, 0,
+          "If not 0, play each made snapshot this many times and balance "
+          "output shards on the measured latencies instead of estimated "
+          "costs.");
+
+ABSL_FLAG(bool, profile_stages, false,
+          "If true, log histograms of the time spent in each stage of fixing "
+          "and the rate at which blobs are made.");
+
+ABSL_FLAG(std::string, corpus_metadata_file, "",
+          "If not empty, write a silifuzz.proto.CorpusMetadata text proto "
+          "describing the output shards to this file.");
+
 namespace silifuzz {
 namespace {
 
@@ -66,23 +120,47 @@ int SimpleFixToolMain(int argc, char* argv[]) {
   CHECK_GT(non_flag_args.size(), 0);
   const std::vector<std::string> inputs(non_flag_args.begin() + 1,
                                         non_flag_args.end());
-  if (inputs.empty()) {
+  const std::string record_end_states_from =
+      absl::GetFlag(FLAGS_record_end_states_from);
+  if (record_end_states_from.empty() && inputs.empty()) {
     LOG_ERROR("No input corpus specified");
     return EXIT_FAILURE;
   }
+  if (!record_end_states_from.empty() &&
+      absl::GetFlag(FLAGS_checkpoint).empty()) {
+    LOG_ERROR("--record_end_states_from requires --checkpoint");
+    return EXIT_FAILURE;
+  }
 
   SimpleFixToolOptions options;
   options.num_partitioning_iterations =
       absl::GetFlag(FLAGS_num_partitioning_iterations);
+  options.stable_partitioning = absl::GetFlag(FLAGS_stable_partitioning);
   options.parallelism = absl::GetFlag(FLAGS_parallelism);
+  options.pipeline_prepare_threads =
+      absl::GetFlag(FLAGS_pipeline_prepare_threads);
+  options.pipeline_fixup_threads = absl::GetFlag(FLAGS_pipeline_fixup_threads);
+  options.pipeline_finish_threads =
+      absl::GetFlag(FLAGS_pipeline_finish_threads);
   options.x86_filter_split_lock = absl::GetFlag(FLAGS_x86_filter_split_lock);
   options.x86_filter_vsyscall_region_access =
       absl::GetFlag(FLAGS_x86_filter_vsyscall_region_access);
   options.filter_memory_access = absl::GetFlag(FLAGS_filter_memory_access);
+  options.zstd_level = absl::GetFlag(FLAGS_zstd_level);
+  options.checkpoint_path = absl::GetFlag(FLAGS_checkpoint);
+  options.platform_checkpoint_paths = absl::GetFlag(FLAGS_platform_checkpoints);
+  options.corpus_metadata_path = absl::GetFlag(FLAGS_corpus_metadata_file);
+  options.profile_iterations = absl::GetFlag(FLAGS_profile_iterations);
 
   fix_tool_internal::SimpleFixToolCounters counters;
-  FixupCorpus(options, inputs, absl::GetFlag(FLAGS_output_path_prefix),
-              absl::GetFlag(FLAGS_num_output_shards), &counters);
+  fix_tool_internal::FixToolStageTimes stage_times;
+  if (!record_end_states_from.empty()) {
+    RecordPlatformEndStates(options, record_end_states_from, &counters);
+  } else {
+    FixupCorpus(options, inputs, absl::GetFlag(FLAGS_output_path_prefix),
+                absl::GetFlag(FLAGS_num_output_shards), &counters,
+                &stage_times);
+  }
 
   // Dump counters.
   std::vector<std::string> counter_names = counters.GetCounterNames();
@@ -90,6 +168,11 @@ int SimpleFixToolMain(int argc, char* argv[]) {
   for (const std::string& counter_name : counter_names) {
     LOG_INFO(counter_name, " ", counters.GetValue(counter_name));
   }
+  if (absl::GetFlag(FLAGS_profile_stages)) {
+    for (const std::string& line : stage_times.Report()) {
+      LOG_INFO(line);
+    }
+  }
 
   return EXIT_SUCCESS;
 }
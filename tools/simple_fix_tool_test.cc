@@ -19,7 +19,10 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <cerrno>
 #include <filesystem>  // NOLINT(build/c++17)
+#include <fstream>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <utility>
@@ -28,23 +31,32 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/cleanup/cleanup.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "external/com_google_fuzztest/centipede/blob_file.h"
+#include "google/protobuf/text_format.h"
+#include "./common/raw_insns_util.h"
 #include "./common/snapshot.h"
+#include "./proto/corpus_metadata.pb.h"
 #include "./snap/snap.h"
 #include "./snap/snap_relocator.h"
+#include "./tool_libs/compact_snapshot.h"
+#include "./tool_libs/fix_tool_stage_times.h"
 #include "./tool_libs/simple_fix_tool_counters.h"
 #include "./util/arch.h"
 #include "./util/checks.h"
+#include "./util/platform.h"
 #include "./util/mmapped_memory_ptr.h"
 #include "./util/path_util.h"
 #include "./util/testing/status_macros.h"
 
 using centipede::DefaultBlobFileWriterFactory;
+using testing::IsEmpty;
 using testing::SizeIs;
 using testing::UnorderedElementsAre;
 
@@ -101,9 +113,42 @@ TEST(SimpleFixTool, ReadUniqueCentipedeBlobs) {
 
   const std::vector inputs{blob_file_1, blob_file_2};
   SimpleFixToolCounters counters;
-  std::vector<std::string> blobs = ReadUniqueCentipedeBlobs(inputs, &counters);
+  std::vector<std::string> blobs =
+      ReadUniqueCentipedeBlobs({}, inputs, &counters);
   EXPECT_THAT(blobs, SizeIs(3));
   EXPECT_THAT(blobs, UnorderedElementsAre("one", "two", "three"));
+  EXPECT_EQ(counters.GetValue("silifuzz-INFO-Read:duplicate-blobs"), 2);
+}
+
+// Test that reading many files in parallel de-dupes across files.
+TEST(SimpleFixTool, ReadUniqueCentipedeBlobsInParallel) {
+  constexpr int kNumFiles = 16;
+  constexpr int kNumBlobsPerFile = 100;
+  std::vector<std::string> inputs;
+  absl::Cleanup delete_files = absl::MakeCleanup([&inputs] {
+    for (const std::string& input : inputs) std::filesystem::remove(input);
+  });
+  for (int i = 0; i < kNumFiles; ++i) {
+    // Half of the blobs in each file are also in the next file.
+    std::vector<std::string> file_blobs;
+    for (int j = 0; j < kNumBlobsPerFile; ++j) {
+      file_blobs.push_back(absl::StrCat("blob_", i * kNumBlobsPerFile / 2 + j));
+    }
+    ASSERT_OK_AND_ASSIGN(std::string blob_file, CreateTempBlobFile(file_blobs));
+    inputs.push_back(blob_file);
+  }
+
+  SimpleFixToolOptions options;
+  options.parallelism = 4;
+  SimpleFixToolCounters counters;
+  std::vector<std::string> blobs =
+      ReadUniqueCentipedeBlobs(options, inputs, &counters);
+  constexpr int kNumUniqueBlobs = (kNumFiles + 1) * kNumBlobsPerFile / 2;
+  EXPECT_THAT(blobs, SizeIs(kNumUniqueBlobs));
+  EXPECT_EQ(absl::flat_hash_set<std::string>(blobs.begin(), blobs.end()).size(),
+            kNumUniqueBlobs);
+  EXPECT_EQ(counters.GetValue("silifuzz-INFO-Read:duplicate-blobs"),
+            kNumFiles * kNumBlobsPerFile - kNumUniqueBlobs);
 }
 
 // Test snapshot making.
@@ -118,9 +163,250 @@ TEST(SimpleFixTool, MakeSnapshotsFromBlobs) {
   }
 
   SimpleFixToolCounters counters;
-  std::vector<Snapshot> made_snapshots =
+  std::vector<CompactSnapshot> made_snapshots =
+      MakeSnapshotsFromBlobs({}, blobs, &counters);
+  EXPECT_THAT(made_snapshots, SizeIs(kNumBlobs));
+}
+
+TEST(SimpleFixTool, MakeSnapshotsFromBlobsStageTimes) {
+  const std::string nop = GetNOP();
+  constexpr int kNumBlobs = 3;
+  std::string insns;
+  std::vector<std::string> blobs;
+  for (int i = 0; i < kNumBlobs; ++i, insns += nop) {
+    blobs.push_back(insns);
+  }
+
+  SimpleFixToolCounters counters;
+  FixToolStageTimes stage_times;
+  std::vector<CompactSnapshot> made_snapshots = MakeSnapshotsFromBlobs(
+      {}, blobs, &counters, /*checkpoint=*/nullptr, &stage_times);
+  EXPECT_THAT(made_snapshots, SizeIs(kNumBlobs));
+  for (const char* stage : {"instructions-to-snapshot", "normalize",
+                            "fixup-make", "fixup-record", "fixup-verify",
+                            "fixup-trace", "snapify"}) {
+    const FixToolStageTimes::Stage* times = stage_times.GetStage(stage);
+    ASSERT_NE(times, nullptr) << stage;
+    EXPECT_EQ(times->count, kNumBlobs) << stage;
+  }
+  EXPECT_GT(stage_times.BlobsPerSecond(), 0);
+}
+
+// Test snapshot making with more workers than blobs.
+TEST(SimpleFixTool, MakeSnapshotsFromBlobsWithIdleWorkers) {
+  const std::string nop = GetNOP();
+  const std::vector<std::string> blobs{nop, nop + nop};
+  SimpleFixToolOptions options;
+  options.parallelism = 8;
+  SimpleFixToolCounters counters;
+  std::vector<CompactSnapshot> made_snapshots =
+      MakeSnapshotsFromBlobs(options, blobs, &counters);
+  EXPECT_THAT(made_snapshots, SizeIs(blobs.size()));
+  EXPECT_EQ(counters.GetValue("silifuzz-INFO-FixToolWorker:success"),
+            blobs.size());
+}
+
+// Test that blobs rejected statically never reach the runner.
+TEST(SimpleFixTool, MakeSnapshotsFromBlobsPrefilter) {
+#if !defined(__x86_64__)
+  GTEST_SKIP() << "Prefilter implemented only on x86_64.";
+#endif
+  const std::string nop = GetNOP();
+  const std::string rdtsc = "\x0f\x31";
+  const std::vector<std::string> blobs{nop, nop + rdtsc, rdtsc + "\xc3"};
+  SimpleFixToolCounters counters;
+  std::vector<CompactSnapshot> made_snapshots =
       MakeSnapshotsFromBlobs({}, blobs, &counters);
+  EXPECT_THAT(made_snapshots, SizeIs(1));
+  EXPECT_EQ(counters.GetValue("silifuzz-ERROR-Prefilter:non-deterministic"),
+            2);
+}
+
+// Test pipelined snapshot making with queues smaller than the number of
+// blobs.
+TEST(SimpleFixTool, MakeSnapshotsFromBlobsPipelined) {
+  const std::string nop = GetNOP();
+  constexpr int kNumBlobs = 6;
+  std::string insns;
+  std::vector<std::string> blobs;
+  for (int i = 0; i < kNumBlobs; ++i, insns += nop) {
+    blobs.push_back(insns);
+  }
+  SimpleFixToolOptions options;
+  options.pipeline_prepare_threads = 2;
+  options.pipeline_fixup_threads = 3;
+  options.pipeline_finish_threads = 2;
+  options.pipeline_queue_size = 1;
+  SimpleFixToolCounters counters;
+  FixToolStageTimes stage_times;
+  std::vector<CompactSnapshot> made_snapshots = MakeSnapshotsFromBlobs(
+      options, blobs, &counters, /*checkpoint=*/nullptr, &stage_times);
   EXPECT_THAT(made_snapshots, SizeIs(kNumBlobs));
+  EXPECT_EQ(counters.GetValue("silifuzz-INFO-FixToolWorker:success"),
+            kNumBlobs);
+  for (const char* stage : {"instructions-to-snapshot", "fixup-make",
+                            "snapify"}) {
+    const FixToolStageTimes::Stage* times = stage_times.GetStage(stage);
+    ASSERT_NE(times, nullptr) << stage;
+    EXPECT_EQ(times->count, kNumBlobs) << stage;
+  }
+}
+
+// Test that a checkpoint keeps the outcome of every blob across reopening.
+TEST(SimpleFixTool, ProfileSnapshots) {
+  const std::string nop = GetNOP();
+  const std::vector<std::string> blobs{nop, nop + nop};
+  SimpleFixToolCounters counters;
+  std::vector<CompactSnapshot> made_snapshots =
+      MakeSnapshotsFromBlobs({}, blobs, &counters);
+  ASSERT_THAT(made_snapshots, SizeIs(blobs.size()));
+
+  SimpleFixToolOptions options;
+  options.parallelism = 2;
+  options.profile_iterations = 10;
+  ProfileSnapshots(options, made_snapshots, &counters);
+  EXPECT_EQ(counters.GetValue("silifuzz-INFO-Profile:profiled"),
+            blobs.size());
+  for (const CompactSnapshot& snapshot : made_snapshots) {
+    EXPECT_GT(snapshot.summary().execution_cost(), 0);
+  }
+}
+
+TEST(SimpleFixTool, Checkpoint) {
+  ASSERT_OK_AND_ASSIGN(const std::string path,
+                       CreateTempFile("SimpleFixToolCheckpoint"));
+  absl::Cleanup remove_checkpoint = [&path] { std::filesystem::remove(path); };
+  const std::string nop = GetNOP();
+  const std::vector<std::string> blobs{nop, nop + nop};
+  {
+    ASSERT_OK_AND_ASSIGN(std::unique_ptr<FixToolCheckpoint> checkpoint,
+                         FixToolCheckpoint::Open(path));
+    EXPECT_FALSE(checkpoint->Contains(InstructionsToSnapshotId(nop)));
+    SimpleFixToolCounters counters;
+    EXPECT_THAT(MakeSnapshotsFromBlobs({}, blobs, &counters, checkpoint.get()),
+                SizeIs(blobs.size()));
+    ASSERT_OK(checkpoint->Append("rejected", nullptr));
+  }
+
+  // Leave a torn record behind like a crash while appending would.
+  {
+    std::ofstream os(path, std::ios::app);
+    os.write("\x10\x00", 2);
+  }
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FixToolCheckpoint> checkpoint,
+                       FixToolCheckpoint::Open(path));
+  for (const std::string& blob : blobs) {
+    EXPECT_TRUE(checkpoint->Contains(InstructionsToSnapshotId(blob)));
+  }
+  EXPECT_TRUE(checkpoint->Contains("rejected"));
+  EXPECT_THAT(checkpoint->TakeSnapshots(), SizeIs(blobs.size()));
+  EXPECT_THAT(checkpoint->TakeSnapshots(), IsEmpty());
+
+  // The torn record is gone, so new records can be read back.
+  ASSERT_OK(checkpoint->Append("appended", nullptr));
+  checkpoint.reset();
+  ASSERT_OK_AND_ASSIGN(checkpoint, FixToolCheckpoint::Open(path));
+  EXPECT_TRUE(checkpoint->Contains("appended"));
+  EXPECT_THAT(checkpoint->TakeSnapshots(), SizeIs(blobs.size()));
+}
+
+// Test that only failures unrelated to the snapshot are retried.
+TEST(SimpleFixTool, IsTransientFailure) {
+  EXPECT_TRUE(IsTransientFailure(absl::ErrnoToStatus(EAGAIN, "vfork")));
+  EXPECT_TRUE(IsTransientFailure(absl::ErrnoToStatus(ENOMEM, "memfd_create")));
+  EXPECT_TRUE(IsTransientFailure(absl::UnavailableError("Zygote has exited")));
+  EXPECT_FALSE(
+      IsTransientFailure(absl::InternalError("Snapshot made a syscall")));
+  EXPECT_FALSE(IsTransientFailure(
+      absl::InternalError("Verify() failed, non-deterministic snapshot?")));
+}
+
+// Test that a rerun with a checkpoint makes only blobs not made before.
+TEST(SimpleFixTool, FixCorpusWithCheckpoint) {
+  ASSERT_OK_AND_ASSIGN(const std::string checkpoint_path,
+                       CreateTempFile("SimpleFixToolCheckpoint"));
+  absl::Cleanup remove_checkpoint = [&checkpoint_path] {
+    std::filesystem::remove(checkpoint_path);
+  };
+  const std::string nop = GetNOP();
+  std::vector<std::string> old_blobs{nop, nop + nop};
+  std::vector<std::string> new_blobs{nop + nop + nop};
+  std::vector<std::string> blob_files;
+  absl::Cleanup remove_blob_files = [&blob_files] {
+    for (const auto& blob_file : blob_files) {
+      std::filesystem::remove(blob_file);
+    }
+  };
+  ASSERT_OK_AND_ASSIGN(std::string blob_file, CreateTempBlobFile(old_blobs));
+  blob_files.push_back(blob_file);
+
+  const std::string output_path_prefix = absl::StrCat(
+      Dirname(checkpoint_path), "/simple_fix_tool_checkpoint_test-", getpid());
+  absl::Cleanup remove_output = [&output_path_prefix] {
+    std::filesystem::remove(absl::StrCat(output_path_prefix, ".00000"));
+  };
+  SimpleFixToolOptions options;
+  options.checkpoint_path = checkpoint_path;
+  SimpleFixToolCounters counters;
+  FixupCorpus(options, blob_files, output_path_prefix, 1, &counters);
+  EXPECT_EQ(counters.GetValue("silifuzz-INFO-FixToolWorker:success"),
+            old_blobs.size());
+
+  ASSERT_OK_AND_ASSIGN(blob_file, CreateTempBlobFile(new_blobs));
+  blob_files.push_back(blob_file);
+  SimpleFixToolCounters rerun_counters;
+  FixupCorpus(options, blob_files, output_path_prefix, 1, &rerun_counters);
+  EXPECT_EQ(rerun_counters.GetValue("silifuzz-INFO-Checkpoint:skipped-blobs"),
+            old_blobs.size());
+  EXPECT_EQ(rerun_counters.GetValue("silifuzz-INFO-Checkpoint:snapshots"),
+            old_blobs.size());
+  EXPECT_EQ(rerun_counters.GetValue("silifuzz-INFO-FixToolWorker:success"),
+            new_blobs.size());
+}
+
+// Test recording end states of a fix run and merging them back. Both happen
+// on the same platform here, so merging only adds platforms.
+TEST(SimpleFixTool, RecordAndMergePlatformEndStates) {
+  ASSERT_OK_AND_ASSIGN(const std::string fix_checkpoint_path,
+                       CreateTempFile("SimpleFixToolCheckpoint"));
+  ASSERT_OK_AND_ASSIGN(const std::string platform_checkpoint_path,
+                       CreateTempFile("SimpleFixToolPlatformCheckpoint"));
+  absl::Cleanup remove_checkpoints = [&] {
+    std::filesystem::remove(fix_checkpoint_path);
+    std::filesystem::remove(platform_checkpoint_path);
+  };
+  const std::string nop = GetNOP();
+  const std::vector<std::string> blobs{nop, nop + nop};
+  {
+    ASSERT_OK_AND_ASSIGN(std::unique_ptr<FixToolCheckpoint> checkpoint,
+                         FixToolCheckpoint::Open(fix_checkpoint_path));
+    SimpleFixToolCounters counters;
+    MakeSnapshotsFromBlobs({}, blobs, &counters, checkpoint.get());
+  }
+
+  SimpleFixToolOptions options;
+  options.checkpoint_path = platform_checkpoint_path;
+  SimpleFixToolCounters counters;
+  RecordPlatformEndStates(options, fix_checkpoint_path, &counters);
+  EXPECT_EQ(counters.GetValue(absl::StrCat(
+                "silifuzz-", ShortPlatformName(CurrentPlatformId()),
+                "-ALL-INFO-RECORD-OK")),
+            blobs.size());
+
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<FixToolCheckpoint> checkpoint,
+                       FixToolCheckpoint::Open(fix_checkpoint_path));
+  std::vector<CompactSnapshot> snapshots;
+  for (const Snapshot& snapshot : checkpoint->TakeSnapshots()) {
+    ASSERT_OK_AND_ASSIGN(CompactSnapshot compact,
+                         CompactSnapshot::Create(snapshot));
+    snapshots.push_back(std::move(compact));
+  }
+  MergePlatformCheckpoint(platform_checkpoint_path, snapshots, &counters);
+  EXPECT_EQ(counters.GetValue("silifuzz-INFO-Merge:merged"), blobs.size());
+  for (const CompactSnapshot& compact : snapshots) {
+    ASSERT_OK_AND_ASSIGN(Snapshot snapshot, compact.ToSnapshot());
+    EXPECT_THAT(snapshot.expected_end_states(), SizeIs(1));
+  }
 }
 
 }  // namespace
@@ -157,18 +443,32 @@ TEST(SimpleFixTool, FixCorpus) {
   const std::string output_path_prefix =
       absl::StrCat(tmpdir, "/simple_fix_tool_test-", getpid());
   constexpr int kNumShards = 4;
+  SimpleFixToolOptions options;
+  options.corpus_metadata_path = absl::StrCat(output_path_prefix, ".metadata");
   fix_tool_internal::SimpleFixToolCounters counters;
-  FixupCorpus({}, blob_files, output_path_prefix, kNumShards, &counters);
+  FixupCorpus(options, blob_files, output_path_prefix, kNumShards, &counters);
 
   auto shard_file_name = [&output_path_prefix](int i) {
     return absl::StrFormat("%s.%05d", output_path_prefix, i);
   };
 
-  absl::Cleanup delete_output_files = absl::MakeCleanup([&shard_file_name] {
-    for (int i = 0; i < kNumShards; ++i) {
-      std::filesystem::remove(shard_file_name(i));
-    }
-  });
+  absl::Cleanup delete_output_files =
+      absl::MakeCleanup([&shard_file_name, &options] {
+        for (int i = 0; i < kNumShards; ++i) {
+          std::filesystem::remove(shard_file_name(i));
+        }
+        std::filesystem::remove(options.corpus_metadata_path);
+      });
+
+  std::ifstream metadata_stream(options.corpus_metadata_path);
+  ASSERT_TRUE(metadata_stream.is_open());
+  const std::string metadata_text(
+      (std::istreambuf_iterator<char>(metadata_stream)),
+      std::istreambuf_iterator<char>());
+  proto::CorpusMetadata metadata;
+  ASSERT_TRUE(
+      google::protobuf::TextFormat::ParseFromString(metadata_text, &metadata));
+  ASSERT_EQ(metadata.shards_size(), kNumShards);
 
   // Read relocatable corpus
   int num_snaps = 0;
@@ -188,6 +488,14 @@ TEST(SimpleFixTool, FixCorpus) {
         SnapRelocator<Host>::RelocateCorpus(std::move(mapped), true, &error);
     ASSERT_TRUE(error == SnapRelocatorError::kOk);
     num_snaps += corpus->snaps.size;
+
+    const proto::ShardMetadata& shard_metadata = metadata.shards(i);
+    EXPECT_EQ(shard_metadata.name(), Basename(shard_file_name(i)));
+    EXPECT_EQ(shard_metadata.num_snaps(), corpus->snaps.size);
+    EXPECT_EQ(shard_metadata.uncompressed_size_bytes(),
+              static_cast<uint64_t>(file_size));
+    EXPECT_GT(shard_metadata.expected_runner_rss_bytes(),
+              shard_metadata.uncompressed_size_bytes());
   }
 
   // Snapshots are NOP sequences of different lengths.  There should not be any
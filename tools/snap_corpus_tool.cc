@@ -19,36 +19,57 @@
 //  # Extract snapshot with id my_snap and write it to output.pb
 //  snap_corpus_tool extract <corpus_file> <my_snap> <output.pb>
 //
+//  # Extract snapshots with ids my_snap1 and my_snap2 and write them to
+//  # <output_dir>/<id>.pb
+//  snap_corpus_tool extract_many <corpus_file> <output_dir> my_snap1 my_snap2
+//
+//  # Extract all snapshots in the corpus and write them to <output_dir>/<id>.pb
+//  snap_corpus_tool extract_all <corpus_file> <output_dir>
+//
 //  # Print diff of actual vs expected end state
 //  snap_corpus_tool end_state_diff <corpus_file> <BinaryLogEntry.pb>
 //
+//  # Group all failures in a binary log by snapshot and outcome and print an
+//  # end state diff for each group
+//  snap_corpus_tool bulk_end_state_diff <corpus_file> <binary_log_file>
+//
 //  # List all snaps in the corpus
 //  snap_corpus_tool list_snaps <corpus_file>
 //
-#include <sys/mman.h>
+#include <fcntl.h>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <memory>
 #include <optional>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "absl/container/btree_set.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
 #include "absl/strings/string_view.h"
 #include "./common/snapshot.h"
 #include "./common/snapshot_file_util.h"
 #include "./common/snapshot_printer.h"
+#include "./orchestrator/binary_log_channel.h"
 #include "./player/player_result_proto.h"
 #include "./proto/binary_log_entry.pb.h"
+#include "./proto/player_result.pb.h"
 #include "./proto/snapshot_execution_result.pb.h"
 #include "./snap/snap.h"
 #include "./snap/snap_corpus_util.h"
+#include "./snap/snap_relocator.h"
 #include "./snap/snap_util.h"
 #include "./util/arch.h"
 #include "./util/checks.h"
@@ -58,10 +79,14 @@
 #include "./util/mmapped_memory_ptr.h"
 #include "./util/platform.h"
 #include "./util/proto_util.h"
+#include "./util/thread_pool.h"
 
 ABSL_FLAG(silifuzz::PlatformId, target_platform,
           silifuzz::PlatformId::kUndefined,
           "Target platform for commands like extract");
+ABSL_FLAG(int, num_threads, 1,
+          "Number of threads bulk_end_state_diff uses to print diffs and "
+          "extract_many and extract_all use to convert and write snapshots.");
 
 namespace silifuzz {
 namespace {
@@ -74,30 +99,59 @@ absl::string_view ConsumeArg(std::vector<char*>& args) {
   return rv;
 }
 
+// The corpus is relocated lazily so that only the snaps used are relocated.
+// All snaps must be accessed through GetSnap().
+template <typename Arch>
+absl::StatusOr<const Snap<Arch>*> GetSnap(const SnapCorpus<Arch>* corpus,
+                                          size_t index) {
+  SnapRelocatorError error;
+  const Snap<Arch>* snap = SnapRelocator<Arch>::GetSnap(*corpus, index, &error);
+  if (snap == nullptr) {
+    return absl::InternalError(
+        absl::StrCat("Cannot relocate snap ", index, ": error ", static_cast<int>(error)));
+  }
+  return snap;
+}
+
+// Returns a function for SnapCorpus::FindIndex() that relocates snaps and
+// records the first error in `*status`.
+template <typename Arch>
+auto SnapAt(const SnapCorpus<Arch>* corpus, absl::Status* status) {
+  return [corpus, status](size_t index) -> const Snap<Arch>* {
+    absl::StatusOr<const Snap<Arch>*> snap = GetSnap(corpus, index);
+    if (!snap.ok()) {
+      status->Update(snap.status());
+      return nullptr;
+    }
+    return *snap;
+  };
+}
+
 template <typename Arch>
 absl::StatusOr<const Snap<Arch>*> FindSnap(const SnapCorpus<Arch>* corpus,
                                            absl::string_view snap_id) {
-  const Snap<Arch>* snap = corpus->Find(snap_id.data());
-  if (snap == nullptr) {
+  absl::Status status;
+  const size_t index = corpus->FindIndex(std::string(snap_id).c_str(),
+                                         SnapAt(corpus, &status));
+  RETURN_IF_NOT_OK(status);
+  if (index == corpus->snaps.size) {
     return absl::NotFoundError(absl::StrCat("Snap ", snap_id, " not found"));
   }
-  return snap;
+  return GetSnap(corpus, index);
 }
 
 template <typename Arch>
 absl::StatusOr<const Snap<Arch>*> FindSnapByCodeAddress(
     const SnapCorpus<Arch>* corpus, uint64_t address) {
-  for (const Snap<Arch>* snap : corpus->snaps) {
-    for (const auto& mapping : snap->memory_mappings) {
-      if (address >= mapping.start_address &&
-          address < mapping.start_address + mapping.num_bytes &&
-          (mapping.perms & PROT_EXEC) != 0) {
-        return snap;
-      }
-    }
+  absl::Status status;
+  const size_t index =
+      corpus->FindIndexByCodeAddress(address, SnapAt(corpus, &status));
+  RETURN_IF_NOT_OK(status);
+  if (index >= corpus->snaps.size) {
+    return absl::NotFoundError(
+        absl::StrCat("Address ", HexStr(address), " not found"));
   }
-  return absl::NotFoundError(
-      absl::StrCat("Address ", HexStr(address), " not found"));
+  return GetSnap(corpus, index);
 }
 
 template <typename Arch>
@@ -110,12 +164,183 @@ PlatformId GetTargetPlatform() {
   return platform_id;
 }
 
+// Failures of one snapshot with one outcome, see ReadFailureGroups().
+struct FailureGroup {
+  std::string snapshot_id;
+  proto::PlayerResult::Outcome outcome;
+
+  // Number of failures, including those reported as repeat counts.
+  uint64_t count = 0;
+
+  // CPUs the failures happened on.
+  absl::btree_set<int64_t> cpu_ids;
+
+  // The first fully reported result of the group with an actual end state.
+  std::optional<proto::SnapshotExecutionResult> representative;
+};
+
+// Reads all snapshot execution results from the binary log `log_file` and
+// groups them by snapshot and outcome. Returns the groups with the most
+// failures first.
+absl::StatusOr<std::vector<FailureGroup>> ReadFailureGroups(
+    absl::string_view log_file) {
+  const int fd = open(std::string(log_file).c_str(), O_RDONLY);
+  if (fd == -1) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(", log_file, ")"));
+  }
+  BinaryLogConsumer consumer(fd);
+  std::vector<FailureGroup> groups;
+  absl::flat_hash_map<std::pair<std::string, int>, size_t> group_index;
+  while (true) {
+    absl::StatusOr<proto::BinaryLogEntry> entry = consumer.Receive();
+    if (!entry.ok()) {
+      if (IsEndOfChannelError(entry.status())) break;
+      return entry.status();
+    }
+    if (!entry->has_snapshot_execution_result()) continue;
+    const proto::SnapshotExecutionResult& result =
+        entry->snapshot_execution_result();
+    if (!result.has_player_result()) continue;
+    const proto::PlayerResult& player_result = result.player_result();
+    auto [it, inserted] = group_index.try_emplace(
+        std::pair<std::string, int>(result.snapshot_id(),
+                                    player_result.outcome()),
+        groups.size());
+    if (inserted) {
+      groups.push_back({.snapshot_id = result.snapshot_id(),
+                        .outcome = player_result.outcome()});
+    }
+    FailureGroup& group = groups[it->second];
+    group.count += result.has_repeat_count() ? result.repeat_count() : 1;
+    group.cpu_ids.insert(player_result.cpu_id());
+    if (!group.representative.has_value() && !result.has_repeat_count() &&
+        player_result.has_actual_end_state()) {
+      group.representative = result;
+    }
+  }
+  std::stable_sort(groups.begin(), groups.end(),
+                   [](const FailureGroup& a, const FailureGroup& b) {
+                     return a.count > b.count;
+                   });
+  return groups;
+}
+
+// Prints `group` and the end state diff of its representative to `lp`.
+// `snap` is the snap of the group, nullptr if the corpus does not have it.
+template <typename Arch>
+void PrintFailureGroup(const FailureGroup& group, const Snap<Arch>* snap,
+                       LinePrinter& lp) {
+  lp.Line("Outcome = ", proto::PlayerResult::Outcome_Name(group.outcome),
+          " snapshot = ", group.snapshot_id, " count = ", group.count,
+          " on CPUs ", absl::StrJoin(group.cpu_ids, ","));
+  lp.Indent();
+  if (snap == nullptr) {
+    lp.Line("Snapshot is not in the corpus");
+  } else if (!group.representative.has_value()) {
+    lp.Line("No actual end state reported");
+  } else {
+    absl::StatusOr<Snapshot> snapshot =
+        SnapToSnapshot(*snap, GetTargetPlatform<Arch>());
+    absl::StatusOr<PlayerResultProto::PlayerResult> player_result =
+        PlayerResultProto::FromProto(group.representative->player_result());
+    if (!snapshot.ok()) {
+      lp.Line(snapshot.status().ToString());
+    } else if (!player_result.ok()) {
+      lp.Line(player_result.status().ToString());
+    } else {
+      lp.Line("Diff of the result on CPU ", player_result->cpu_id, ":");
+      SnapshotPrinter printer(&lp);
+      printer.PrintActualEndState(*snapshot, *player_result->actual_end_state);
+    }
+  }
+  lp.Unindent();
+}
+
+// Implements the bulk_end_state_diff command. The groups are printed in
+// parallel into per-group buffers which are then output in order, so the
+// output does not depend on the number of threads.
+template <typename Arch>
+absl::Status BulkEndStateDiff(const SnapCorpus<Arch>* corpus,
+                              absl::string_view log_file, LinePrinter& lp) {
+  ASSIGN_OR_RETURN_IF_NOT_OK(std::vector<FailureGroup> groups,
+                             ReadFailureGroups(log_file));
+  // Snaps are looked up up front because lazy relocation is not thread-safe.
+  std::vector<const Snap<Arch>*> snaps(groups.size(), nullptr);
+  for (size_t i = 0; i < groups.size(); ++i) {
+    absl::StatusOr<const Snap<Arch>*> snap =
+        FindSnap(corpus, groups[i].snapshot_id);
+    if (snap.ok()) {
+      snaps[i] = *snap;
+    } else if (!absl::IsNotFound(snap.status())) {
+      return snap.status();
+    }
+  }
+
+  std::vector<std::vector<std::string>> outputs(groups.size());
+  {
+    ThreadPool pool(std::max(1, absl::GetFlag(FLAGS_num_threads)));
+    for (size_t i = 0; i < groups.size(); ++i) {
+      pool.Schedule([&, i] {
+        std::vector<std::string>& lines = outputs[i];
+        LinePrinter buffer_lp([&lines](absl::string_view text_line) {
+          lines.emplace_back(text_line);
+        });
+        PrintFailureGroup(groups[i], snaps[i], buffer_lp);
+      });
+    }
+  }  // Waits for all groups to be printed.
+
+  uint64_t num_failures = 0;
+  for (size_t i = 0; i < groups.size(); ++i) {
+    for (const std::string& line : outputs[i]) {
+      lp.Line(line);
+    }
+    num_failures += groups[i].count;
+  }
+  lp.Line("Total ", num_failures, " failures in ", groups.size(), " groups");
+  return absl::OkStatus();
+}
+
+// Converts `snaps` to snapshots and writes each of them to
+// <output_dir>/<id>.pb. The snaps are converted and written in parallel. They
+// must have been relocated already because lazy relocation is not
+// thread-safe.
+template <typename Arch>
+absl::Status ExtractSnaps(const std::vector<const Snap<Arch>*>& snaps,
+                          absl::string_view output_dir) {
+  const PlatformId platform_id = GetTargetPlatform<Arch>();
+  std::vector<absl::Status> statuses(snaps.size());
+  {
+    ThreadPool pool(std::max(1, absl::GetFlag(FLAGS_num_threads)));
+    for (size_t i = 0; i < snaps.size(); ++i) {
+      pool.Schedule([&, i] {
+        absl::StatusOr<Snapshot> snapshot =
+            SnapToSnapshot(*snaps[i], platform_id);
+        if (!snapshot.ok()) {
+          statuses[i] = snapshot.status();
+          return;
+        }
+        statuses[i] = WriteSnapshotToFile(
+            *snapshot, absl::StrCat(output_dir, "/", snaps[i]->id, ".pb"));
+      });
+    }
+  }  // Waits for all snapshots to be written.
+  for (const absl::Status& status : statuses) {
+    RETURN_IF_NOT_OK(status);
+  }
+  LOG_INFO("Wrote ", snaps.size(), " snaps to ", output_dir);
+  return absl::OkStatus();
+}
+
 template <typename Arch>
 absl::Status ToolMainImpl(absl::string_view command,
                           absl::string_view corpus_file,
                           std::vector<char*>& args) {
   MmappedMemoryPtr<const SnapCorpus<Arch>> corpus =
-      LoadCorpusFromFile<Arch>(corpus_file.data(), /* preload = */ false);
+      LoadCorpusFromFile<Arch>(corpus_file.data(), /* preload = */ false,
+                               /* verify = */ true, /* corpus_fd = */ nullptr,
+                               /* load_address = */ 0,
+                               /* lazy_relocation = */ true);
 
   LinePrinter lp(LinePrinter::StdErrPrinter);
 
@@ -132,6 +357,34 @@ absl::Status ToolMainImpl(absl::string_view command,
     absl::string_view output_file = ConsumeArg(args);
     RETURN_IF_NOT_OK(WriteSnapshotToFile(*snapshot, output_file));
     LOG_INFO("Wrote snap to ", output_file);
+  } else if (command == "extract_many") {
+    if (args.size() < 2) {
+      return absl::InvalidArgumentError("Too few arguments");
+    }
+    absl::string_view output_dir = ConsumeArg(args);
+    // IDs are looked up by binary search over the sorted snap IDs, which
+    // relocates only the snaps on the search paths.
+    std::vector<const Snap<Arch>*> snaps;
+    snaps.reserve(args.size());
+    while (!args.empty()) {
+      ASSIGN_OR_RETURN_IF_NOT_OK(const Snap<Arch>* snap,
+                                 FindSnap(corpus.get(), ConsumeArg(args)));
+      snaps.push_back(snap);
+    }
+    RETURN_IF_NOT_OK(ExtractSnaps(snaps, output_dir));
+  } else if (command == "extract_all") {
+    if (args.empty()) {
+      return absl::InvalidArgumentError("Too few arguments");
+    }
+    absl::string_view output_dir = ConsumeArg(args);
+    std::vector<const Snap<Arch>*> snaps;
+    snaps.reserve(corpus->snaps.size);
+    for (size_t i = 0; i < corpus->snaps.size; ++i) {
+      ASSIGN_OR_RETURN_IF_NOT_OK(const Snap<Arch>* snap,
+                                 GetSnap(corpus.get(), i));
+      snaps.push_back(snap);
+    }
+    RETURN_IF_NOT_OK(ExtractSnaps(snaps, output_dir));
   } else if (command == "extract_code_address") {
     if (args.size() < 2) {
       return absl::InvalidArgumentError("Too few arguments");
@@ -172,8 +425,15 @@ absl::Status ToolMainImpl(absl::string_view command,
         result.player_result().Outcome_Name(result.player_result().outcome()),
         " snapshot = ", result.snapshot_id(), " on CPU ", player_result.cpu_id);
     printer.PrintActualEndState(snapshot, *player_result.actual_end_state);
+  } else if (command == "bulk_end_state_diff") {
+    if (args.empty()) {
+      return absl::InvalidArgumentError("Too few arguments");
+    }
+    RETURN_IF_NOT_OK(BulkEndStateDiff(corpus.get(), ConsumeArg(args), lp));
   } else if (command == "list_snaps") {
-    for (const Snap<Arch>* snap : corpus->snaps) {
+    for (size_t i = 0; i < corpus->snaps.size; ++i) {
+      ASSIGN_OR_RETURN_IF_NOT_OK(const Snap<Arch>* snap,
+                                 GetSnap(corpus.get(), i));
       lp.Line(snap->id);
     }
     lp.Line("Total ", corpus->snaps.size);
@@ -40,6 +40,24 @@ function extract_test() {
   rm -f "${OUTPUT}"
 }
 
+function extract_many_test() {
+  OUTPUT_DIR="$(mktemp -d)"
+  "${TOOL}" extract_many "${CORPUS}" "${OUTPUT_DIR}" kEndsAsExpected \
+    kSigSegvRead 2>&1 | grep -q 'Wrote 2 snaps to' \
+    || die "extract_many test failed"
+  [[ -s "${OUTPUT_DIR}/kEndsAsExpected.pb" ]] \
+    || die "extract_many test failed"
+  rm -rf "${OUTPUT_DIR}"
+}
+
+function extract_all_test() {
+  OUTPUT_DIR="$(mktemp -d)"
+  "${TOOL}" --num_threads=4 extract_all "${CORPUS}" "${OUTPUT_DIR}" 2>&1 \
+    | grep -q -e 'Wrote [1-2][0-9] snaps to' \
+    || die "extract_all test failed"
+  rm -rf "${OUTPUT_DIR}"
+}
+
 function extract_code_address_test() {
   OUTPUT="$(mktemp)"
   CODE_ADDRESS=0x12355000
@@ -51,6 +69,8 @@ function extract_code_address_test() {
 
 snap_corpus_tool_test
 extract_test
+extract_many_test
+extract_all_test
 extract_code_address_test
 
 echo "PASS"
@@ -16,9 +16,12 @@
 // snapshot proto files.
 
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cerrno>
+#include <cstddef>
 #include <cstdint>
 #include <optional>
 #include <string>
@@ -36,14 +39,17 @@
 #include "absl/strings/string_view.h"
 #include "./common/memory_state.h"
 #include "./common/snapshot.h"
+#include "./common/snapshot_container.h"
 #include "./common/snapshot_file_util.h"
 #include "./common/snapshot_printer.h"
 #include "./common/snapshot_util.h"
 #include "./runner/driver/runner_driver.h"
 #include "./runner/make_snapshot.h"
 #include "./runner/runner_provider.h"
+#include "./snap/gen/baked_corpus_generator.h"
 #include "./snap/gen/relocatable_snap_generator.h"
 #include "./snap/gen/snap_generator.h"
+#include "./tool_libs/code_register_groups.h"
 #include "./util/arch.h"
 #include "./util/checks.h"
 #include "./util/enum_flag.h"
@@ -53,9 +59,11 @@
 #include "./util/line_printer.h"
 #include "./util/mmapped_memory_ptr.h"
 #include "./util/platform.h"
+#include "./util/thread_pool.h"
 #include "./util/tool_util.h"
 #include "./util/ucontext/serialize.h"
 #include "./util/ucontext/ucontext_types.h"
+#include "./util/zstd_util.h"
 
 namespace silifuzz {  // for ADL
 DEFINE_ENUM_FLAG(SnapshotPrinter::RegsMode);
@@ -96,6 +104,25 @@ ABSL_FLAG(bool, endpoints_only, false, "Whether to only print the endpoints.");
 ABSL_FLAG(silifuzz::PlatformId, target_platform,
           silifuzz::PlatformId::kUndefined,
           "Target platform for commands like generate_corpus");
+ABSL_FLAG(int, zstd_level, 0,
+          "If not 0, generate_corpus compresses the corpus with zstd at this "
+          "level.");
+ABSL_FLAG(bool, sort_snaps_by_memory_layout, false,
+          "If true, generate_corpus groups snaps with identical memory "
+          "mappings next to each other.");
+ABSL_FLAG(int, num_threads, 1,
+          "Number of threads generate_corpus uses to load, snapify and "
+          "generate the corpus.");
+ABSL_FLAG(bool, compress_memory_bytes, false,
+          "If true, generate_corpus LZ4 compresses read-only memory bytes. "
+          "The corpus needs a runner that supports compressed corpora.");
+ABSL_FLAG(bool, keep_platform_end_states, false,
+          "If true, generate_corpus keeps the end states of platforms other "
+          "than --target_platform, so that the corpus can run on all of "
+          "them. The runner needs --platform_id to select the end state.");
+ABSL_FLAG(bool, delta_end_state_memory_bytes, false,
+          "If true, generate_corpus only stores the end-state memory bytes "
+          "that differ from the initial state and checksums the rest.");
 
 // ========================================================================= //
 
@@ -149,6 +176,13 @@ absl::StatusOr<Snapshot> LoadSnapshot(absl::string_view filename, bool raw) {
              : ReadSnapshotFromFile(filename);
 }
 
+// Returns CodeRegisterGroups() of `snapshot` serialized, see
+// RelocatableSnapGeneratorOptions::code_register_groups.
+template <typename Arch>
+uint64_t SerializedCodeRegisterGroups(const Snapshot& snapshot) {
+  return CodeRegisterGroups<Arch>(snapshot).Serialize();
+}
+
 // Implements `generate_corpus` command.
 absl::Status GenerateCorpus(const std::vector<std::string>& input_protos,
                             bool raw, PlatformId platform_id, int out_fd,
@@ -160,19 +194,66 @@ absl::Status GenerateCorpus(const std::vector<std::string>& input_protos,
   ArchitectureId arch_id = PlatformArchitecture(platform_id);
   SnapifyOptions opts = SnapifyOptions::V2InputRunOpts(arch_id);
   opts.platform_id = platform_id;
+  opts.keep_platform_end_states =
+      absl::GetFlag(FLAGS_keep_platform_end_states);
+  opts.delta_end_state_memory_bytes =
+      absl::GetFlag(FLAGS_delta_end_state_memory_bytes);
+
+  // Snapshot containers are expanded into their records, which are parsed
+  // straight from the mapped container by the loading threads.
+  struct Input {
+    std::string name;
+    const SnapshotContainerReader* container = nullptr;
+    size_t record = 0;
+  };
+  std::vector<SnapshotContainerReader> containers;
+  containers.reserve(input_protos.size());
+  std::vector<Input> inputs;
+  for (const std::string& input_proto : input_protos) {
+    if (raw || !SnapshotContainerReader::IsSnapshotContainer(input_proto)) {
+      inputs.push_back({.name = input_proto});
+      continue;
+    }
+    ASSIGN_OR_RETURN_IF_NOT_OK(SnapshotContainerReader container,
+                               SnapshotContainerReader::Open(input_proto));
+    containers.push_back(std::move(container));
+    for (size_t i = 0; i < containers.back().size(); ++i) {
+      inputs.push_back({.name = absl::StrCat(input_proto, "[", i, "]"),
+                        .container = &containers.back(),
+                        .record = i});
+    }
+  }
 
-  std::vector<Snapshot> snapified_corpus;
+  // Snapshots are loaded and snapified in parallel. Results are kept in input
+  // order so that the corpus does not depend on the number of threads.
+  std::vector<absl::Status> load_status(inputs.size());
+  std::vector<absl::StatusOr<Snapshot>> snapified(inputs.size());
+  {
+    ThreadPool pool(std::max(1, absl::GetFlag(FLAGS_num_threads)));
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      pool.Schedule([&, i] {
+        const Input& input = inputs[i];
+        absl::StatusOr<Snapshot> snapshot =
+            input.container != nullptr ? input.container->Get(input.record)
+                                       : LoadSnapshot(input.name, raw);
+        load_status[i] = snapshot.status();
+        if (snapshot.ok()) {
+          snapified[i] = Snapify(*snapshot, opts);
+        }
+      });
+    }
+  }  // Waits for all loading to finish.
 
-  for (const std::string& proto_path : input_protos) {
-    ASSIGN_OR_RETURN_IF_NOT_OK_PLUS(
-        auto snapshot, LoadSnapshot(proto_path, raw), "Cannot read snapshot");
-    auto snapified_or = Snapify(snapshot, opts);
-    if (!snapified_or.ok()) {
-      line_printer->Line("Skipping ", proto_path, ": ",
-                         snapified_or.status().message());
+  std::vector<Snapshot> snapified_corpus;
+  snapified_corpus.reserve(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    RETURN_IF_NOT_OK_PLUS(load_status[i], "Cannot read snapshot");
+    if (!snapified[i].ok()) {
+      line_printer->Line("Skipping ", inputs[i].name, ": ",
+                         snapified[i].status().message());
       continue;
     }
-    snapified_corpus.push_back(std::move(snapified_or).value());
+    snapified_corpus.push_back(*std::move(snapified[i]));
   }
   if (snapified_corpus.empty()) {
     return absl::InvalidArgumentError("No usable Snapshots found");
@@ -181,15 +262,65 @@ absl::Status GenerateCorpus(const std::vector<std::string>& input_protos,
   // TODO(ksteuck): Call PartitionSnapshots() to ensure there are no conflicts.
 
   RelocatableSnapGeneratorOptions options;
+  options.sort_snaps_by_memory_layout =
+      absl::GetFlag(FLAGS_sort_snaps_by_memory_layout);
+  options.num_threads = absl::GetFlag(FLAGS_num_threads);
+  options.compress_memory_bytes = absl::GetFlag(FLAGS_compress_memory_bytes);
+  options.code_register_groups = [arch_id](const Snapshot& snapshot) {
+    return ARCH_DISPATCH(SerializedCodeRegisterGroups, arch_id, snapshot);
+  };
+  const int zstd_level = absl::GetFlag(FLAGS_zstd_level);
+  // An uncompressed corpus going to a regular file is generated in place.
+  struct stat out_stat;
+  if (zstd_level == 0 && fstat(out_fd, &out_stat) == 0 &&
+      S_ISREG(out_stat.st_mode) && out_stat.st_size == 0 &&
+      (fcntl(out_fd, F_GETFL) & O_ACCMODE) == O_RDWR) {
+    return GenerateRelocatableSnapsToFile(arch_id, snapified_corpus, out_fd,
+                                          options)
+        .status();
+  }
   MmappedMemoryPtr<char> buffer =
       GenerateRelocatableSnaps(arch_id, snapified_corpus, options);
   absl::string_view buf(buffer.get(), MmappedMemorySize(buffer));
+  std::string compressed;
+  if (zstd_level != 0) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(compressed, ZstdCompress(buf, zstd_level));
+    buf = compressed;
+  }
   if (!WriteToFileDescriptor(out_fd, buf)) {
     return absl::InternalError("WriteToFileDescriptor failed");
   }
   return absl::OkStatus();
 }
 
+// Implements `make_container` command. The inputs are copied into the
+// container as they are, without parsing them.
+absl::Status MakeContainer(const std::vector<std::string>& input_protos,
+                           absl::string_view out_path) {
+  SnapshotContainerWriter writer;
+  RETURN_IF_NOT_OK(writer.Open(out_path));
+  for (const std::string& input_proto : input_protos) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(std::string serialized,
+                               GetFileContents(input_proto));
+    RETURN_IF_NOT_OK(writer.AddSerialized(serialized));
+  }
+  return writer.Finish();
+}
+
+// Implements `bake_corpus` command. Writes assembly source that defines the
+// uncompressed relocatable corpus in `input_corpus` for linking into a runner
+// with :baked_snap_corpus.
+absl::Status BakeCorpus(absl::string_view input_corpus, int out_fd) {
+  ASSIGN_OR_RETURN_IF_NOT_OK(std::string relocatable,
+                             GetFileContents(input_corpus));
+  ASSIGN_OR_RETURN_IF_NOT_OK(std::string assembly,
+                             GenerateBakedCorpusAssembly(relocatable));
+  if (!WriteToFileDescriptor(out_fd, assembly)) {
+    return absl::InternalError("WriteToFileDescriptor failed");
+  }
+  return absl::OkStatus();
+}
+
 absl::Status GetInstructions(const Snapshot& snapshot, int out_fd) {
   ASSIGN_OR_RETURN_IF_NOT_OK(std::string instructions,
                              GetInstructionBytesFromSnapshot(snapshot));
@@ -247,7 +378,8 @@ absl::StatusOr<Snapshot> SetInstructionPointerImpl(const Snapshot& snapshot,
 absl::StatusOr<int> OpenOutput() {
   std::optional<std::string> out = absl::GetFlag(FLAGS_out);
   if (out.has_value()) {
-    int fd = open(out.value().c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+    // Readable too so that a corpus can be generated into a mapping of it.
+    int fd = open(out.value().c_str(), O_RDWR | O_CREAT | O_TRUNC,
                   S_IRUSR | S_IWUSR);
     if (fd == -1) {
       return absl::UnknownError(
@@ -281,8 +413,9 @@ bool SnapToolMain(std::vector<char*>& args) {
   if (args.size() < 2) {
     line_printer.Line(
         "Expected one of "
-        "{print,set_id,set_end,make,play,generate_corpus,get_instructions,"
-        "trace,set_bytes,set_pc} and a snapshot file name(s).");
+        "{print,set_id,set_end,make,play,generate_corpus,make_container,"
+        "bake_corpus,get_instructions,trace,set_bytes,set_pc} and a snapshot "
+        "file name(s).");
     return false;
   } else {
     command = ConsumeArg(args);
@@ -296,6 +429,61 @@ bool SnapToolMain(std::vector<char*>& args) {
     platform_id = CurrentPlatformId();
   }
 
+  // Commands that take many snapshot files load them themselves.
+  // generate_corpus also accepts snapshot containers.
+  if (command == "generate_corpus") {
+    std::vector<std::string> inputs({snapshot_file});
+    for (const auto& a : args) {
+      inputs.push_back(a);
+    }
+    absl::StatusOr<int> out_fd = OpenOutput();
+    if (!out_fd.ok()) {
+      line_printer.Line(out_fd.status().ToString());
+      return false;
+    }
+    absl::Status s =
+        GenerateCorpus(inputs, raw, platform_id, out_fd.value(), &line_printer);
+    close(out_fd.value());
+    if (!s.ok()) {
+      line_printer.Line("Cannot generate corpus: ", s.message());
+      return false;
+    }
+    return true;
+  }
+  if (command == "make_container") {
+    std::vector<std::string> inputs({snapshot_file});
+    for (const auto& a : args) {
+      inputs.push_back(a);
+    }
+    std::optional<std::string> out = absl::GetFlag(FLAGS_out);
+    if (!out.has_value()) {
+      line_printer.Line("make_container requires --out");
+      return false;
+    }
+    absl::Status s = MakeContainer(inputs, *out);
+    if (!s.ok()) {
+      line_printer.Line("Cannot make container: ", s.message());
+      return false;
+    }
+    return true;
+  }
+
+  if (command == "bake_corpus") {
+    if (ExtraArgs(args)) return false;
+    absl::StatusOr<int> out_fd = OpenOutput();
+    if (!out_fd.ok()) {
+      line_printer.Line(out_fd.status().ToString());
+      return false;
+    }
+    absl::Status s = BakeCorpus(snapshot_file, out_fd.value());
+    close(out_fd.value());
+    if (!s.ok()) {
+      line_printer.Line("Cannot bake corpus: ", s.message());
+      return false;
+    }
+    return true;
+  }
+
   // Load the snapshot
   absl::StatusOr<Snapshot> snapshot_or = LoadSnapshot(snapshot_file, raw);
   if (!snapshot_or.ok()) {
@@ -308,7 +496,10 @@ bool SnapToolMain(std::vector<char*>& args) {
   if (command == "print") {
     if (ExtraArgs(args)) return false;
 
-    PrintSnapshot(snapshot, &line_printer);
+    // Snapshots with many end states print many lines, so buffer them
+    // rather than writing each to stderr separately.
+    LinePrinter print_printer(LinePrinter::FdPrinter(STDERR_FILENO));
+    PrintSnapshot(snapshot, &print_printer);
   } else if (command == "set_id") {
     if (args.size() != 1) {
       line_printer.Line("Expected one snapshot id value argument.");
@@ -394,23 +585,6 @@ bool SnapToolMain(std::vector<char*>& args) {
     line_printer.Line("Re-made snapshot succefully.");
     OutputSnapshotOrDie(std::move(recorded_snapshot).value(),
                         OutputPath(snapshot_file), &line_printer);
-  } else if (command == "generate_corpus") {
-    std::vector<std::string> inputs({snapshot_file});
-    for (const auto& a : args) {
-      inputs.push_back(a);
-    }
-    absl::StatusOr<int> out_fd = OpenOutput();
-    if (!out_fd.ok()) {
-      line_printer.Line(out_fd.status().ToString());
-      return false;
-    }
-    absl::Status s =
-        GenerateCorpus(inputs, raw, platform_id, out_fd.value(), &line_printer);
-    close(out_fd.value());
-    if (!s.ok()) {
-      line_printer.Line("Cannot generate corpus: ", s.message());
-      return false;
-    }
   } else if (command == "set_bytes") {
     // Overwrite bytes in existing memory mappings of the snapshot.
     //
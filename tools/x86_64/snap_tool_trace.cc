@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <optional>
 #include <string>
 
 #include "absl/functional/bind_front.h"
@@ -48,8 +49,10 @@ absl::Status Trace(const Snapshot& snapshot, PlatformId platform_id,
   trace_options.filter_non_deterministic_insn = false;
   DisassemblingSnapTracer tracer(snapshot, trace_options);
   auto trace_fn = absl::bind_front(&DisassemblingSnapTracer::Step, &tracer);
-  absl::StatusOr<RunnerDriver::RunResult> trace_result =
-      runner.TraceOne(snapshot.id(), trace_fn);
+  absl::StatusOr<RunnerDriver::RunResult> trace_result = runner.TraceOne(
+      snapshot.id(), trace_fn, /*num_iterations=*/1,
+      /*start_address=*/std::nullopt,
+      absl::bind_front(&DisassemblingSnapTracer::WantsStep, &tracer));
   DisassemblingSnapTracer::TraceResult trace_data = tracer.trace_result();
   for (const std::string& s : trace_data.disassembly) {
     line_printer->Line(s);
@@ -15,35 +15,61 @@
 #include "./tracing/analysis.h"
 
 #include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <string>
+#include <vector>
 
 #include "absl/status/status.h"
+#include "absl/synchronization/blocking_counter.h"
 #include "./tracing/execution_trace.h"
 #include "./tracing/unicorn_tracer.h"
 #include "./util/checks.h"
+#include "./util/thread_pool.h"
 #include "./util/ucontext/ucontext_types.h"
 
 namespace silifuzz {
 
 namespace {
 
-// An extremely simple fault model is to skip a specific instruction in the
-// trace. All you need to know is the size of the instruction, and you don't
-// need to model its side effects.
+// Injects a fault at every `stride`-th instruction of the snippet, starting
+// with instruction `first`, and records in `fault_detected` whether the
+// outcome differed from the expected one. The snippet must execute
+// `num_instructions` instructions. Uses a tracer of its own, so calls with
+// disjoint sets of instructions can run in parallel.
 template <typename Arch>
-absl::Status TraceSnippetWithSkip(const std::string& instructions,
-                                  size_t max_instructions, size_t skip,
-                                  size_t& instructions_executed,
-                                  UContext<Arch>& ucontext,
-                                  uint32_t& memory_checksum) {
+absl::Status InjectFaults(const std::string& instructions,
+                          size_t num_instructions, size_t max_instructions,
+                          const UContext<Arch>& expected_ucontext,
+                          uint32_t expected_memory_checksum, size_t first,
+                          size_t stride, std::vector<uint8_t>& fault_detected) {
+  // Run the snippet once and save checkpoints along the way, so that each
+  // run with an injected fault can start from the last checkpoint before the
+  // fault rather than from the start of the snippet. Saving a checkpoint
+  // every sqrt(n) instructions balances the cost of saving them against the
+  // instructions executed again after restoring one.
   UnicornTracer<Arch> tracer;
   RETURN_IF_NOT_OK(tracer.InitSnippet(instructions));
+  tracer.EnableCheckpoints();
+  const size_t checkpoint_interval =
+      std::max<size_t>(1, std::sqrt(static_cast<double>(num_instructions)));
+  std::vector<typename UnicornTracer<Arch>::Checkpoint> checkpoints;
 
-  instructions_executed = 0;
+  // An extremely simple fault model is to skip a specific instruction in the
+  // trace. All you need to know is the size of the instruction, and you don't
+  // need to model its side effects.
+  constexpr size_t kNoSkip = std::numeric_limits<size_t>::max();
+  size_t skip = kNoSkip;
+  size_t instructions_executed = 0;
   tracer.SetInstructionCallback(
       [&](UnicornTracer<Arch>* tracer, uint64_t address, size_t max_size) {
-        if (instructions_executed == skip) {
+        if (skip == kNoSkip) {
+          if (instructions_executed % checkpoint_interval == 0) {
+            checkpoints.push_back(tracer->SaveCheckpoint());
+          }
+        } else if (instructions_executed == skip) {
           // Relies on the instruction size for Unicorn being precise.
           // For ptrace we'll need to disassemble the instruction.
           tracer->SetCurrentInstructionPointer(address + max_size);
@@ -51,8 +77,33 @@ absl::Status TraceSnippetWithSkip(const std::string& instructions,
         instructions_executed++;
       });
   RETURN_IF_NOT_OK(tracer.Run(max_instructions));
-  tracer.GetRegisters(ucontext);
-  memory_checksum = tracer.PartialChecksumOfMutableMemory();
+  if (instructions_executed != num_instructions) {
+    return absl::InternalError("snippet did not execute as traced");
+  }
+
+  // See if skipping an instruction results in a different outcome.
+  for (skip = first; skip < num_instructions; skip += stride) {
+    if (first == 0 && skip / stride % 100 == 0) {
+      VLOG_INFO(1, 100 * skip / num_instructions, "%");
+    }
+    const typename UnicornTracer<Arch>::Checkpoint& checkpoint =
+        checkpoints[skip / checkpoint_interval];
+    tracer.RestoreCheckpoint(checkpoint);
+    instructions_executed = checkpoint.num_instructions;
+    absl::Status status = tracer.Resume(max_instructions);
+    UContext<Arch> ucontext;
+    tracer.GetRegisters(ucontext);
+    uint32_t actual_memory_checksum = tracer.PartialChecksumOfMutableMemory();
+    // If the status is not OK, this indicates the trace did not behave like a
+    // valid Silifuzz test - it segfaulted, got stuck in an infinite loop, or
+    // similar. Because the unmodified trace as OK, this indicates the injected
+    // fault changed the behavior in a detectible way.
+    // TODO(ncbray): compare memory.
+    fault_detected[skip] = !status.ok() ||
+                           ucontext.gregs != expected_ucontext.gregs ||
+                           ucontext.fpregs != expected_ucontext.fpregs ||
+                           actual_memory_checksum != expected_memory_checksum;
+  }
   return absl::OkStatus();
 }
 
@@ -61,33 +112,45 @@ absl::Status TraceSnippetWithSkip(const std::string& instructions,
 template <typename Arch>
 absl::StatusOr<FaultInjectionResult> AnalyzeSnippetWithFaultInjection(
     const std::string& instructions, ExecutionTrace<Arch>& execution_trace,
-    uint32_t expected_memory_checksum) {
+    uint32_t expected_memory_checksum, int num_threads) {
   size_t expected_instructions_executed = execution_trace.NumInstructions();
   UContext<Arch> expected_ucontext = execution_trace.LastContext();
 
-  // See if skipping an instruction results in a different outcome.
-  size_t num_faults_detected = 0;
-  for (size_t skip = 0; skip < expected_instructions_executed; ++skip) {
-    if (skip % 100 == 0) {
-      VLOG_INFO(1, 100 * skip / expected_instructions_executed, "%");
+  // Thread i injects faults at instructions i, i + num_threads, ... Faults
+  // late in the snippet are cheaper to test, interleaving spreads them evenly.
+  // Each flag is written by a single thread, results do not depend on the
+  // number of threads.
+  const size_t num_shards = std::clamp<size_t>(
+      num_threads, 1, std::max<size_t>(expected_instructions_executed, 1));
+  std::vector<uint8_t> fault_detected(expected_instructions_executed);
+  std::vector<absl::Status> statuses(num_shards);
+  auto run_shard = [&](size_t shard) {
+    statuses[shard] = InjectFaults<Arch>(
+        instructions, expected_instructions_executed,
+        execution_trace.MaxInstructions(), expected_ucontext,
+        expected_memory_checksum, shard, num_shards, fault_detected);
+  };
+  if (num_shards == 1) {
+    run_shard(0);
+  } else {
+    ThreadPool pool(num_shards);
+    absl::BlockingCounter done(num_shards);
+    for (size_t shard = 0; shard < num_shards; ++shard) {
+      pool.Schedule([&run_shard, &done, shard]() {
+        run_shard(shard);
+        done.DecrementCount();
+      });
     }
-    size_t instructions_executed = 0;
-    uint32_t actual_memory_checksum = 0;
-    UContext<Arch> ucontext;
-    absl::Status status = TraceSnippetWithSkip(
-        instructions, execution_trace.MaxInstructions(), skip,
-        instructions_executed, ucontext, actual_memory_checksum);
-    // If the status is not OK, this indicates the trace did not behave like a
-    // valid Silifuzz test - it segfaulted, got stuck in an infinite loop, or
-    // similar. Because the unmodified trace as OK, this indicates the injected
-    // fault changed the behavior in a detectible way.
-    // TODO(ncbray): compare memory.
-    bool fault_detected = !status.ok() ||
-                          ucontext.gregs != expected_ucontext.gregs ||
-                          ucontext.fpregs != expected_ucontext.fpregs ||
-                          actual_memory_checksum != expected_memory_checksum;
-    execution_trace.Info(skip).critical = fault_detected;
-    if (fault_detected) {
+    done.Wait();
+  }
+  for (const absl::Status& status : statuses) {
+    RETURN_IF_NOT_OK(status);
+  }
+
+  size_t num_faults_detected = 0;
+  for (size_t i = 0; i < expected_instructions_executed; ++i) {
+    execution_trace.Info(i).critical = fault_detected[i];
+    if (fault_detected[i]) {
       num_faults_detected++;
     }
   }
@@ -104,10 +167,10 @@ absl::StatusOr<FaultInjectionResult> AnalyzeSnippetWithFaultInjection(
 template absl::StatusOr<FaultInjectionResult>
 AnalyzeSnippetWithFaultInjection<X86_64>(
     const std::string& instructions, ExecutionTrace<X86_64>& execution_trace,
-    uint32_t expected_memory_checksum);
+    uint32_t expected_memory_checksum, int num_threads);
 template absl::StatusOr<FaultInjectionResult>
 AnalyzeSnippetWithFaultInjection<AArch64>(
     const std::string& instructions, ExecutionTrace<AArch64>& execution_trace,
-    uint32_t expected_memory_checksum);
+    uint32_t expected_memory_checksum, int num_threads);
 
 }  // namespace silifuzz
@@ -38,10 +38,12 @@ struct FaultInjectionResult {
 // faults.
 // If successful, this function returns aggregate statistics about the fault
 // injection.
+// The faults are injected on `num_threads` threads, each with its own tracer.
+// The results do not depend on the number of threads.
 template <typename Arch>
 absl::StatusOr<FaultInjectionResult> AnalyzeSnippetWithFaultInjection(
     const std::string& instructions, ExecutionTrace<Arch>& execution_trace,
-    uint32_t expected_memory_checksum);
+    uint32_t expected_memory_checksum, int num_threads = 1);
 
 }  // namespace silifuzz
 
@@ -0,0 +1,213 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tracing/batch_trace.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/types/span.h"
+#include "external/com_google_fuzztest/centipede/blob_file.h"
+#include "external/com_google_fuzztest/centipede/defs.h"
+#include "./common/snapshot.h"
+#include "./instruction/default_disassembler.h"
+#include "./snap/snap.h"
+#include "./snap/snap_corpus_util.h"
+#include "./snap/snap_util.h"
+#include "./tracing/execution_trace.h"
+#include "./tracing/unicorn_tracer.h"
+#include "./util/arch.h"
+#include "./util/checks.h"
+#include "./util/mmapped_memory_ptr.h"
+#include "./util/page_util.h"
+#include "./util/thread_pool.h"
+#include "./util/ucontext/ucontext_types.h"
+
+namespace silifuzz {
+
+namespace {
+
+// Traces every `stride`-th snippet, starting with snippet `first`, and adds
+// the instructions they execute to `stats`. Uses a tracer and a disassembler
+// of its own, so calls with different `first` can run concurrently.
+template <typename Arch>
+void TraceSnippetShard(absl::Span<const std::string> snippets,
+                       size_t max_instructions, size_t first, size_t stride,
+                       SnippetBatchStats& stats) {
+  UnicornTracer<Arch> tracer;
+  DefaultDisassembler<Arch> disasm;
+  stats.instruction_counts.assign(disasm.NumInstructionIDs(), 0);
+  InstructionInfo<Arch> info;
+  for (size_t i = first; i < snippets.size(); i += stride) {
+    ++stats.num_snippets;
+    if (!tracer.InitSnippetReusingEngine(snippets[i]).ok()) {
+      ++stats.num_failed;
+      continue;
+    }
+    const uint64_t code_page_start =
+        RoundDownToPageAlignment(tracer.GetCurrentInstructionPointer());
+    bool insn_out_of_bounds = false;
+    tracer.SetInstructionCallback([&](UnicornTracer<Arch>* tracer,
+                                      uint64_t address, size_t max_size) {
+      memset(&info, 0, sizeof(info));
+      if (!FetchInstruction(tracer, disasm, code_page_start, address,
+                            max_size, info)) {
+        tracer->Stop();
+        insn_out_of_bounds = true;
+      }
+      ++stats.num_instructions;
+      ++stats.instruction_counts[info.instruction_id];
+      stats.num_loads += info.can_load;
+      stats.num_stores += info.can_store;
+      stats.num_branches += info.can_branch;
+    });
+    if (!tracer.Run(max_instructions).ok() || insn_out_of_bounds) {
+      ++stats.num_failed;
+    }
+  }
+}
+
+}  // namespace
+
+void SnippetBatchStats::Merge(const SnippetBatchStats& other) {
+  num_snippets += other.num_snippets;
+  num_failed += other.num_failed;
+  num_instructions += other.num_instructions;
+  num_loads += other.num_loads;
+  num_stores += other.num_stores;
+  num_branches += other.num_branches;
+  if (instruction_counts.size() < other.instruction_counts.size()) {
+    instruction_counts.resize(other.instruction_counts.size(), 0);
+  }
+  for (size_t i = 0; i < other.instruction_counts.size(); ++i) {
+    instruction_counts[i] += other.instruction_counts[i];
+  }
+}
+
+template <typename Arch>
+SnippetBatchStats TraceSnippetBatch(absl::Span<const std::string> snippets,
+                                    size_t max_instructions, int num_threads) {
+  // Thread i traces snippets i, i + num_threads, ... which spreads long and
+  // short snippets evenly when a corpus is sorted in some way.
+  const size_t num_shards = std::clamp<size_t>(
+      num_threads, 1, std::max<size_t>(snippets.size(), 1));
+  std::vector<SnippetBatchStats> shard_stats(num_shards);
+  auto run_shard = [&](size_t shard) {
+    TraceSnippetShard<Arch>(snippets, max_instructions, shard, num_shards,
+                            shard_stats[shard]);
+  };
+  if (num_shards == 1) {
+    run_shard(0);
+  } else {
+    ThreadPool pool(num_shards);
+    absl::BlockingCounter done(num_shards);
+    for (size_t shard = 0; shard < num_shards; ++shard) {
+      pool.Schedule([&run_shard, &done, shard]() {
+        run_shard(shard);
+        done.DecrementCount();
+      });
+    }
+    done.Wait();
+  }
+
+  SnippetBatchStats stats;
+  for (const SnippetBatchStats& s : shard_stats) {
+    stats.Merge(s);
+  }
+  return stats;
+}
+
+template <typename Arch>
+absl::StatusOr<std::string> SnapToInstructions(const Snap<Arch>& snap) {
+  const uint64_t begin = snap.registers->gregs.GetInstructionPointer();
+  const uint64_t end = snap.end_state_instruction_address;
+  if (end < begin) {
+    return absl::InvalidArgumentError(
+        absl::StrCat(snap.id, ": end state precedes the entry point"));
+  }
+  for (const SnapMemoryMapping& mapping : snap.memory_mappings) {
+    if ((mapping.perms & PROT_EXEC) == 0) continue;
+    for (const SnapMemoryBytes& memory_bytes : mapping.memory_bytes) {
+      if (begin < memory_bytes.start_address ||
+          end > memory_bytes.start_address + memory_bytes.size()) {
+        continue;
+      }
+      ASSIGN_OR_RETURN_IF_NOT_OK(Snapshot::ByteData data,
+                                 SnapMemoryBytesData(memory_bytes));
+      return data.substr(begin - memory_bytes.start_address, end - begin);
+    }
+  }
+  return absl::InvalidArgumentError(
+      absl::StrCat(snap.id, ": no executable memory bytes hold the code"));
+}
+
+template <typename Arch>
+absl::StatusOr<std::vector<std::string>> ReadSnippetsFromCorpus(
+    const std::string& path) {
+  MmappedMemoryPtr<const SnapCorpus<Arch>> corpus =
+      LoadCorpusFromFile<Arch>(path.c_str(), /*preload=*/false);
+  std::vector<std::string> snippets;
+  snippets.reserve(corpus->snaps.size);
+  for (const Snap<Arch>* snap : corpus->snaps) {
+    ASSIGN_OR_RETURN_IF_NOT_OK(std::string snippet, SnapToInstructions(*snap));
+    snippets.push_back(std::move(snippet));
+  }
+  return snippets;
+}
+
+absl::StatusOr<std::vector<std::string>> ReadSnippetsFromBlobFile(
+    const std::string& path) {
+  auto reader = centipede::DefaultBlobFileReaderFactory();
+  RETURN_IF_NOT_OK(reader->Open(path));
+  std::vector<std::string> snippets;
+  absl::Status status;
+  centipede::ByteSpan blob;
+  while ((status = reader->Read(blob)).ok()) {
+    snippets.emplace_back(reinterpret_cast<const char*>(blob.data()),
+                          blob.size());
+  }
+  // Read() reports the end of the file as out of range.
+  if (!absl::IsOutOfRange(status)) return status;
+  RETURN_IF_NOT_OK(reader->Close());
+  return snippets;
+}
+
+// Instantiate concrete instances of exported functions.
+template SnippetBatchStats TraceSnippetBatch<X86_64>(
+    absl::Span<const std::string> snippets, size_t max_instructions,
+    int num_threads);
+template SnippetBatchStats TraceSnippetBatch<AArch64>(
+    absl::Span<const std::string> snippets, size_t max_instructions,
+    int num_threads);
+template absl::StatusOr<std::string> SnapToInstructions<X86_64>(
+    const Snap<X86_64>& snap);
+template absl::StatusOr<std::string> SnapToInstructions<AArch64>(
+    const Snap<AArch64>& snap);
+template absl::StatusOr<std::vector<std::string>>
+ReadSnippetsFromCorpus<X86_64>(const std::string& path);
+template absl::StatusOr<std::vector<std::string>>
+ReadSnippetsFromCorpus<AArch64>(const std::string& path);
+
+}  // namespace silifuzz
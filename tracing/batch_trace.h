@@ -0,0 +1,82 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_TRACING_BATCH_TRACE_H_
+#define THIRD_PARTY_SILIFUZZ_TRACING_BATCH_TRACE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "./snap/snap.h"
+
+namespace silifuzz {
+
+// Instruction mix statistics aggregated over a batch of snippets.
+struct SnippetBatchStats {
+  // Number of snippets traced.
+  uint64_t num_snippets = 0;
+
+  // Number of snippets that could not be set up or did not run to their end,
+  // e.g. because they faulted or ran for too long. The instructions they
+  // executed before stopping are still counted.
+  uint64_t num_failed = 0;
+
+  // Number of instructions executed.
+  uint64_t num_instructions = 0;
+
+  // Number of executed instructions of a type that can access memory or
+  // branch. See InstructionInfo.
+  uint64_t num_loads = 0;
+  uint64_t num_stores = 0;
+  uint64_t num_branches = 0;
+
+  // Number of times each instruction ID was executed, indexed by the ID of
+  // the default disassembler of the architecture. Includes the invalid ID.
+  std::vector<uint64_t> instruction_counts;
+
+  // Adds the counts of `other` to these.
+  void Merge(const SnippetBatchStats& other);
+};
+
+// Traces each of `snippets` for at most `max_instructions` instructions and
+// returns the aggregated statistics. The snippets are spread across
+// `num_threads` threads, each reusing one tracer and one disassembler for all
+// its snippets. The results do not depend on the number of threads.
+template <typename Arch>
+SnippetBatchStats TraceSnippetBatch(absl::Span<const std::string> snippets,
+                                    size_t max_instructions, int num_threads);
+
+// Returns the code snippet a proxy-generated Snap was made from, i.e. the
+// bytes from the initial instruction pointer to the end state address.
+template <typename Arch>
+absl::StatusOr<std::string> SnapToInstructions(const Snap<Arch>& snap);
+
+// Returns the snippets of all Snaps in the relocatable corpus `path`. The
+// corpus must be for `Arch`. CHECK-fails if the corpus cannot be loaded, see
+// LoadCorpusFromFile().
+template <typename Arch>
+absl::StatusOr<std::vector<std::string>> ReadSnippetsFromCorpus(
+    const std::string& path);
+
+// Returns the snippets in the Centipede blob file `path`.
+absl::StatusOr<std::vector<std::string>> ReadSnippetsFromBlobFile(
+    const std::string& path);
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_TRACING_BATCH_TRACE_H_
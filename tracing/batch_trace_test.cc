@@ -0,0 +1,86 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tracing/batch_trace.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "./common/snapshot_test_config.h"
+#include "./common/snapshot_test_enum.h"
+#include "./instruction/default_disassembler.h"
+#include "./util/arch.h"
+
+namespace silifuzz {
+
+namespace {
+
+template <class>
+struct BatchTraceTest : ::testing::Test {};
+using arch_typelist = ::testing::Types<X86_64, AArch64>;
+TYPED_TEST_SUITE(BatchTraceTest, arch_typelist);
+
+TYPED_TEST(BatchTraceTest, AggregatesAcrossThreads) {
+  using Arch = TypeParam;
+  const std::string three =
+      GetTestSnippet<Arch>(TestSnapshot::kSetThreeRegisters);
+  const std::string runaway = GetTestSnippet<Arch>(TestSnapshot::kRunaway);
+  std::vector<std::string> snippets;
+  for (int i = 0; i < 5; ++i) {
+    snippets.push_back(three);
+    snippets.push_back(runaway);
+  }
+  constexpr size_t kMaxInstructions = 10;
+
+  SnippetBatchStats stats =
+      TraceSnippetBatch<Arch>(snippets, kMaxInstructions, 1);
+  EXPECT_EQ(stats.num_snippets, 10);
+  // The runaway snippets execute too many instructions.
+  EXPECT_EQ(stats.num_failed, 5);
+  EXPECT_EQ(stats.num_instructions, 5 * 3 + 5 * kMaxInstructions);
+
+  // All three instructions of the first snippet are adds.
+  DefaultDisassembler<Arch> disasm;
+  ASSERT_EQ(stats.instruction_counts.size(), disasm.NumInstructionIDs());
+  uint64_t num_adds = 0;
+  for (size_t i = 0; i < stats.instruction_counts.size(); ++i) {
+    if (disasm.InstructionIDName(i) == "add") {
+      num_adds += stats.instruction_counts[i];
+    }
+  }
+  EXPECT_GE(num_adds, 5 * 3);
+
+  SnippetBatchStats threaded_stats =
+      TraceSnippetBatch<Arch>(snippets, kMaxInstructions, 3);
+  EXPECT_EQ(threaded_stats.num_snippets, stats.num_snippets);
+  EXPECT_EQ(threaded_stats.num_failed, stats.num_failed);
+  EXPECT_EQ(threaded_stats.num_instructions, stats.num_instructions);
+  EXPECT_EQ(threaded_stats.num_loads, stats.num_loads);
+  EXPECT_EQ(threaded_stats.num_stores, stats.num_stores);
+  EXPECT_EQ(threaded_stats.num_branches, stats.num_branches);
+  EXPECT_EQ(threaded_stats.instruction_counts, stats.instruction_counts);
+}
+
+TYPED_TEST(BatchTraceTest, EmptyBatch) {
+  SnippetBatchStats stats = TraceSnippetBatch<TypeParam>({}, 10, 4);
+  EXPECT_EQ(stats.num_snippets, 0);
+  EXPECT_EQ(stats.num_instructions, 0);
+}
+
+}  // namespace
+
+}  // namespace silifuzz
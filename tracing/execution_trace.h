@@ -15,6 +15,7 @@
 #ifndef THIRD_PARTY_SILIFUZZ_TRACING_EXECUTION_TRACE_H_
 #define THIRD_PARTY_SILIFUZZ_TRACING_EXECUTION_TRACE_H_
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -63,49 +64,73 @@ struct InstructionInfo {
   // The longest valid instruction on x86 is 15 bytes, so 16 bytes should hold
   // all possible instructions on all arches.
   uint8_t bytes[16];
-
-  // The architectural state after the instruction has executed.
-  UContext<Arch> ucontext;
 };
 
 // A trace of all instructions in a test.
 // Assumes that the trace exits normally and does not fault.
-// This is intended to be a reusable, fixed-sized buffer for instruction
-// information. It is expected this will almost always be generated with
-// CaptureTrace. Afterwards it is expected that most clients will access its
-// contents with the ForEach method.
+// This is intended to be a reusable buffer for instruction information. It is
+// expected this will almost always be generated with CaptureTrace. Afterwards
+// it is expected that most clients will access its contents with the ForEach
+// method.
+//
+// The architectural state before and after each instruction is delta-encoded:
+// only the 64-bit words of the UContext that an instruction changed are
+// stored, plus a full copy every kKeyframeInterval instructions for random
+// access. Most instructions change a couple of registers, so this takes a few
+// dozen bytes per instruction rather than the size of a UContext.
 template <typename Arch>
 class ExecutionTrace {
  public:
   ExecutionTrace(size_t max_instructions)
       : info_(max_instructions), num_instructions_(0) {}
 
-  void Reset() { num_instructions_ = 0; }
+  void Reset() {
+    num_instructions_ = 0;
+    keyframes_.clear();
+    delta_end_.clear();
+    deltas_.clear();
+  }
 
   // The address the trace starts at.
   uint64_t EntryAddress() const {
-    // first_ is initialized indirectly.
     // The first time LastContext() is called (when there are no instructions,
-    // yet), it will return a reference to first_. The initial state will be
-    // written to first_, and the instruction pointer of the initial state will
-    // be the entry point of the test.
-    return first_.gregs.GetInstructionPointer();
+    // yet), it will return a reference to the first context. The initial state
+    // will be written to it, and the instruction pointer of the initial state
+    // will be the entry point of the test.
+    return FirstContext().gregs.GetInstructionPointer();
   }
 
   // The architectural state immediately before the trace begins.
-  UContext<Arch>& FirstContext() { return first_; }
+  const UContext<Arch>& FirstContext() const {
+    return num_instructions_ == 0 ? last_ : keyframes_[0];
+  }
 
-  // The architectural state immediately after the end of the trace.
-  UContext<Arch>& LastContext() { return PrevContext(num_instructions_); }
+  // The architectural state immediately after the end of the trace. Can be
+  // written until the next call to NextInfo().
+  UContext<Arch>& LastContext() { return last_; }
+
+  // Returns the architectural state before the i-th instruction of the trace
+  // executed, or after the trace if `i` is NumInstructions().
+  UContext<Arch> Context(size_t i) const {
+    CHECK_LE(i, num_instructions_);
+    if (i == num_instructions_) return last_;
+    UContext<Arch> ucontext = keyframes_[i / kKeyframeInterval];
+    for (size_t step = i - i % kKeyframeInterval + 1; step <= i; ++step) {
+      ApplyDelta(step, ucontext);
+    }
+    return ucontext;
+  }
 
   InstructionInfo<Arch>& Info(size_t i) {
     CHECK_LT(i, num_instructions_);
     return info_[i];
   }
 
-  // Allocate a struct to store data about the next instruction.
+  // Allocate a struct to store data about the next instruction. The context
+  // before the instruction must have been written to LastContext().
   InstructionInfo<Arch>& NextInfo() {
     CHECK(num_instructions_ < info_.size());
+    AppendContext();
     InstructionInfo<Arch>& tmp = info_[num_instructions_];
     num_instructions_++;
     memset(&tmp, 0, sizeof(tmp));
@@ -121,29 +146,123 @@ class ExecutionTrace {
   // For each instruction invoke the callback with the following arguments:
   // The index of the instruction in the trace.
   // The register context before the instruction was executed.
+  // The register context after the instruction was executed.
   // Information about the instruction and its execution.
   template <typename F>
   void ForEach(F&& f) {
+    if (num_instructions_ == 0) return;
+    UContext<Arch> prev = keyframes_[0];
+    UContext<Arch> next;
     for (size_t i = 0; i < num_instructions_; ++i) {
-      f(i, PrevContext(i), info_[i]);
+      if (i + 1 == num_instructions_) {
+        next = last_;
+      } else if ((i + 1) % kKeyframeInterval == 0) {
+        next = keyframes_[(i + 1) / kKeyframeInterval];
+      } else {
+        next = prev;
+        ApplyDelta(i + 1, next);
+      }
+      f(i, prev, next, info_[i]);
+      prev = next;
     }
   }
 
  private:
-  std::vector<InstructionInfo<Arch>> info_;
-  size_t num_instructions_;
-  UContext<Arch> first_;
+  // A 64-bit word of a UContext that differs from the previous context.
+  struct ContextDelta {
+    uint32_t word;
+    uint64_t value;
+  };
+
+  // Number of contexts between full copies. Bounds the number of deltas
+  // applied by Context().
+  static constexpr size_t kKeyframeInterval = 64;
+
+  static constexpr size_t kNumContextWords =
+      sizeof(UContext<Arch>) / sizeof(uint64_t);
+  static_assert(sizeof(UContext<Arch>) % sizeof(uint64_t) == 0);
+
+  // Applies the deltas of the context before instruction `step` to
+  // `ucontext`, which must hold the context before instruction `step` - 1.
+  void ApplyDelta(size_t step, UContext<Arch>& ucontext) const {
+    char* words = reinterpret_cast<char*>(&ucontext);
+    for (size_t d = delta_end_[step - 1]; d < delta_end_[step]; ++d) {
+      memcpy(words + deltas_[d].word * sizeof(uint64_t), &deltas_[d].value,
+             sizeof(uint64_t));
+    }
+  }
 
-  UContext<Arch>& PrevContext(size_t i) {
-    CHECK_LE(i, num_instructions_);
-    if (i == 0) {
-      return first_;
+  // Appends `last_`, the context before instruction `num_instructions_`, to
+  // the encoded contexts.
+  void AppendContext() {
+    if (num_instructions_ % kKeyframeInterval == 0) {
+      keyframes_.push_back(last_);
     } else {
-      return info_[i - 1].ucontext;
+      const char* prev = reinterpret_cast<const char*>(&prev_);
+      const char* next = reinterpret_cast<const char*>(&last_);
+      for (size_t word = 0; word < kNumContextWords; ++word) {
+        const size_t offset = word * sizeof(uint64_t);
+        if (memcmp(prev + offset, next + offset, sizeof(uint64_t)) != 0) {
+          ContextDelta& delta =
+              deltas_.emplace_back(ContextDelta{static_cast<uint32_t>(word)});
+          memcpy(&delta.value, next + offset, sizeof(uint64_t));
+        }
+      }
     }
+    delta_end_.push_back(deltas_.size());
+    prev_ = last_;
   }
+
+  std::vector<InstructionInfo<Arch>> info_;
+  size_t num_instructions_;
+
+  // The context after the last instruction, not encoded yet.
+  UContext<Arch> last_;
+
+  // The last encoded context, the one before instruction
+  // num_instructions_ - 1.
+  UContext<Arch> prev_;
+
+  // The context before instruction i * kKeyframeInterval.
+  std::vector<UContext<Arch>> keyframes_;
+
+  // The deltas of the context before instruction i are
+  // deltas_[delta_end_[i - 1], delta_end_[i]). Keyframes have no deltas.
+  std::vector<size_t> delta_end_;
+  std::vector<ContextDelta> deltas_;
 };
 
+// Reads and disassembles the instruction at `address` into `info`. Only
+// reads memory inside the executable page starting at `code_page_start`.
+// Returns false if `address` is outside that page, in which case the
+// instruction bytes are left zeroed.
+template <typename Tracer, typename Disassembler, typename Arch>
+bool FetchInstruction(Tracer* tracer, Disassembler& disasm,
+                      uint64_t code_page_start, uint64_t address,
+                      size_t max_size, InstructionInfo<Arch>& info) {
+  // Be careful and only fetch memory inside the expected executable page.
+  // This could be a rogue jump that will end in a fault. If execution does
+  // fault by going out of bounds, it doesn't matter that we didn't read
+  // exactly the same memory as the tracer tried to.
+  bool in_bounds =
+      address >= code_page_start && address - code_page_start < kPageSize;
+  if (in_bounds) {
+    max_size = std::min(max_size, kPageSize - (address - code_page_start));
+    tracer->ReadMemory(address, info.bytes, max_size);
+  }
+
+  // Disassemble the instruction
+  disasm.Disassemble(address, info.bytes, max_size);
+
+  info.address = address;
+  info.instruction_id = disasm.InstructionID();
+  info.size = disasm.InstructionSize();
+  info.can_branch = disasm.CanBranch();
+  info.can_load = disasm.CanLoad();
+  info.can_store = disasm.CanStore();
+  return in_bounds;
+}
+
 // Run the tracer and record each instruction.
 // `execution_trace` is an output parameter rather than a return value so that
 // it can be reused multiple times without being reallocated.
@@ -162,29 +281,11 @@ absl::Status CaptureTrace(Tracer& tracer, Disassembler& disasm,
     tracer->GetRegisters(execution_trace.LastContext());
 
     InstructionInfo<Arch>& info = execution_trace.NextInfo();
-
-    // Fetch the instruction.
-    // Be careful and only fetch memory inside the expected executable page.
-    // This could be a rogue jump that will end in a fault. If execution does
-    // fault by going out of bounds, it doesn't matter that we didn't read
-    // exactly the same memory as the tracer tried to.
-    if (address >= code_page_start && address - code_page_start < kPageSize) {
-      max_size = std::min(max_size, kPageSize - (address - code_page_start));
-      tracer->ReadMemory(address, info.bytes, max_size);
-    } else {
+    if (!FetchInstruction(tracer, disasm, code_page_start, address, max_size,
+                          info)) {
       tracer->Stop();
       insn_out_of_bounds = true;
     }
-
-    // Disassemble the instruction
-    disasm.Disassemble(address, info.bytes, max_size);
-
-    info.address = address;
-    info.instruction_id = disasm.InstructionID();
-    info.size = disasm.InstructionSize();
-    info.can_branch = disasm.CanBranch();
-    info.can_load = disasm.CanLoad();
-    info.can_store = disasm.CanStore();
   });
   absl::Status result = tracer.Run(execution_trace.MaxInstructions());
   // Capture the final state.
@@ -40,44 +40,47 @@ using silifuzz::testing::StatusIs;
 template <typename Arch>
 void CheckInstructionInfo(Disassembler& disasm, size_t i,
                           const UContext<Arch>& prev,
+                          const UContext<Arch>& next,
                           InstructionInfo<Arch>& info);
 
 template <>
 void CheckInstructionInfo(Disassembler& disasm, size_t i,
                           const UContext<X86_64>& prev,
+                          const UContext<X86_64>& next,
                           InstructionInfo<X86_64>& info) {
   EXPECT_EQ(disasm.InstructionIDName(info.instruction_id), "add");
 
   // rdx transitions 0 => 2 on the first instruction.
   EXPECT_EQ(prev.gregs.rdx, i <= 0 ? 0 : 2);
-  EXPECT_EQ(info.ucontext.gregs.rdx, 2);
+  EXPECT_EQ(next.gregs.rdx, 2);
 
   // rcx transitions 0 => 3 on the second instruction.
   EXPECT_EQ(prev.gregs.rcx, i <= 1 ? 0 : 3);
-  EXPECT_EQ(info.ucontext.gregs.rcx, i < 1 ? 0 : 3);
+  EXPECT_EQ(next.gregs.rcx, i < 1 ? 0 : 3);
 
   // rdx transitions 0 => 4 on the third instruction.
   EXPECT_EQ(prev.gregs.r8, 0);
-  EXPECT_EQ(info.ucontext.gregs.r8, i < 2 ? 0 : 4);
+  EXPECT_EQ(next.gregs.r8, i < 2 ? 0 : 4);
 }
 
 template <>
 void CheckInstructionInfo(Disassembler& disasm, size_t i,
                           const UContext<AArch64>& prev,
+                          const UContext<AArch64>& next,
                           InstructionInfo<AArch64>& info) {
   EXPECT_EQ(disasm.InstructionIDName(info.instruction_id), "add");
 
   // x2 transitions 0 => 2 on the first instruction.
   EXPECT_EQ(prev.gregs.x[2], i <= 0 ? 0 : 2);
-  EXPECT_EQ(info.ucontext.gregs.x[2], 2);
+  EXPECT_EQ(next.gregs.x[2], 2);
 
   // x3 transitions 0 => 3 on the second instruction.
   EXPECT_EQ(prev.gregs.x[3], i <= 1 ? 0 : 3);
-  EXPECT_EQ(info.ucontext.gregs.x[3], i < 1 ? 0 : 3);
+  EXPECT_EQ(next.gregs.x[3], i < 1 ? 0 : 3);
 
   // x4 transitions 0 => 4 on the third instruction.
   EXPECT_EQ(prev.gregs.x[4], 0);
-  EXPECT_EQ(info.ucontext.gregs.x[4], i < 2 ? 0 : 4);
+  EXPECT_EQ(next.gregs.x[4], i < 2 ? 0 : 4);
 }
 
 // Typed test boilerplate
@@ -116,7 +119,8 @@ TYPED_TEST(ExecutionTraceTest, Simple) {
 
   // Check the trace.
   size_t count = 0;
-  execution_trace.ForEach([&](size_t i, UContext<Arch>& prev,
+  execution_trace.ForEach([&](size_t i, const UContext<Arch>& prev,
+                              const UContext<Arch>& next,
                               InstructionInfo<Arch>& info) {
     // Check it's in bounds.
     ASSERT_LT(i, 3);
@@ -134,7 +138,11 @@ TYPED_TEST(ExecutionTraceTest, Simple) {
               0);
 
     // Check the registers.
-    CheckInstructionInfo(disasm, i, prev, info);
+    CheckInstructionInfo(disasm, i, prev, next, info);
+
+    // Random access agrees with iteration.
+    EXPECT_EQ(execution_trace.Context(i).gregs, prev.gregs);
+    EXPECT_EQ(execution_trace.Context(i + 1).gregs, next.gregs);
   });
   EXPECT_EQ(count, 3);
 
@@ -164,6 +172,40 @@ TYPED_TEST(ExecutionTraceTest, Runaway) {
   EXPECT_EQ(execution_trace.NumInstructions(), kTraceLength);
 }
 
+TYPED_TEST(ExecutionTraceTest, RandomAccessAcrossKeyframes) {
+  using Arch = typename TypeParam::first_type;
+  using ConcreteDisassembler = typename TypeParam::second_type;
+
+  std::string instructions = GetTestSnippet<Arch>(TestSnapshot::kRunaway);
+
+  UnicornTracer<Arch> tracer;
+  ASSERT_THAT(tracer.InitSnippet(instructions), IsOk());
+
+  // Long enough to span several keyframes.
+  const size_t kTraceLength = 200;
+
+  ConcreteDisassembler disasm;
+  ExecutionTrace<Arch> execution_trace(kTraceLength);
+  EXPECT_THAT(CaptureTrace(tracer, disasm, execution_trace),
+              StatusIs(absl::StatusCode::kInternal));
+  ASSERT_EQ(execution_trace.NumInstructions(), kTraceLength);
+
+  size_t count = 0;
+  execution_trace.ForEach([&](size_t i, const UContext<Arch>& prev,
+                              const UContext<Arch>& next,
+                              InstructionInfo<Arch>& info) {
+    EXPECT_EQ(i, count);
+    count++;
+    UContext<Arch> before = execution_trace.Context(i);
+    EXPECT_EQ(before.gregs, prev.gregs);
+    EXPECT_EQ(before.fpregs, prev.fpregs);
+    UContext<Arch> after = execution_trace.Context(i + 1);
+    EXPECT_EQ(after.gregs, next.gregs);
+    EXPECT_EQ(after.fpregs, next.fpregs);
+  });
+  EXPECT_EQ(count, kTraceLength);
+}
+
 }  // namespace
 
 }  // namespace silifuzz
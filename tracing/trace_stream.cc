@@ -0,0 +1,86 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tracing/trace_stream.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "./util/arch.h"
+#include "./util/checks.h"
+
+namespace silifuzz {
+
+namespace trace_stream_internal {
+
+void AppendVarint(uint64_t value, std::string& out) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+absl::StatusOr<uint64_t> ReadVarint(std::FILE* file) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = getc(file);
+    if (c == EOF) return absl::DataLossError("truncated trace stream");
+    value |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if ((c & 0x80) == 0) return value;
+  }
+  return absl::InvalidArgumentError("varint too long in trace stream");
+}
+
+absl::Status ReadBytes(std::FILE* file, void* data, size_t size) {
+  if (fread(data, 1, size, file) != size) {
+    return absl::DataLossError("truncated trace stream");
+  }
+  return absl::OkStatus();
+}
+
+void AppendHeader(ArchitectureId arch, std::string& out) {
+  out.append(kMagic, sizeof(kMagic));
+  out.push_back(kVersion);
+  out.push_back(static_cast<char>(arch));
+}
+
+}  // namespace trace_stream_internal
+
+absl::StatusOr<ArchitectureId> ReadTraceStreamHeader(std::FILE* file) {
+  char magic[sizeof(trace_stream_internal::kMagic)];
+  RETURN_IF_NOT_OK(
+      trace_stream_internal::ReadBytes(file, magic, sizeof(magic)));
+  if (memcmp(magic, trace_stream_internal::kMagic, sizeof(magic)) != 0) {
+    return absl::InvalidArgumentError("not a trace stream");
+  }
+  uint8_t version_and_arch[2];
+  RETURN_IF_NOT_OK(trace_stream_internal::ReadBytes(
+      file, version_and_arch, sizeof(version_and_arch)));
+  if (version_and_arch[0] != trace_stream_internal::kVersion) {
+    return absl::InvalidArgumentError("unsupported trace stream version");
+  }
+  ArchitectureId arch = static_cast<ArchitectureId>(version_and_arch[1]);
+  if (arch != ArchitectureId::kX86_64 && arch != ArchitectureId::kAArch64) {
+    return absl::InvalidArgumentError("unknown architecture in trace stream");
+  }
+  return arch;
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,348 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_TRACING_TRACE_STREAM_H_
+#define THIRD_PARTY_SILIFUZZ_TRACING_TRACE_STREAM_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "./tracing/execution_trace.h"
+#include "./util/arch.h"
+#include "./util/checks.h"
+#include "./util/page_util.h"
+#include "./util/ucontext/ucontext.h"
+
+namespace silifuzz {
+
+// A compact binary encoding of an execution trace that is written while the
+// code executes, so that traces of millions of instructions can be captured
+// without keeping them in memory and piped into other tools.
+//
+// The stream starts with a header:
+//   "SFTR" magic, a version byte and an ArchitectureId byte
+//   the raw bytes of the UContext before the first instruction
+// followed by one record per executed instruction:
+//   kInstructionRecord
+//   varint: zigzag of the address minus the end of the previous instruction
+//   varint: instruction ID
+//   byte: instruction size, followed by that many instruction bytes
+//   byte: kCanLoad / kCanStore / kCanBranch flags
+//   context delta: the changes since the previous record
+// and ends with an end record:
+//   kEndRecord
+//   context delta: the changes made by the last instruction
+// A context delta is a varint number of changed 64-bit words of the UContext,
+// followed by a varint gap to the previous changed word and the new value of
+// the word for each of them.
+// Words are written in host byte order, which is little-endian on all
+// supported arches.
+
+// Constants and helpers shared by the writer and the reader.
+namespace trace_stream_internal {
+
+inline constexpr char kMagic[4] = {'S', 'F', 'T', 'R'};
+inline constexpr uint8_t kVersion = 1;
+
+inline constexpr uint8_t kInstructionRecord = 1;
+inline constexpr uint8_t kEndRecord = 2;
+
+inline constexpr uint8_t kCanLoad = 1 << 0;
+inline constexpr uint8_t kCanStore = 1 << 1;
+inline constexpr uint8_t kCanBranch = 1 << 2;
+
+// Appends `value` to `out` as a LEB128 varint.
+void AppendVarint(uint64_t value, std::string& out);
+
+// Reads a LEB128 varint from `file`.
+absl::StatusOr<uint64_t> ReadVarint(std::FILE* file);
+
+// Reads exactly `size` bytes from `file`.
+absl::Status ReadBytes(std::FILE* file, void* data, size_t size);
+
+// Appends the header up to and excluding the initial context.
+void AppendHeader(ArchitectureId arch, std::string& out);
+
+}  // namespace trace_stream_internal
+
+// Reads the header of the trace stream in `file` up to and excluding the
+// initial context, and returns the architecture of the trace. The rest of the
+// stream can then be decoded with a TraceStreamReader of that architecture.
+absl::StatusOr<ArchitectureId> ReadTraceStreamHeader(std::FILE* file);
+
+// Encodes a trace stream into `file`, see above.
+//
+// This class is thread-compatible.
+template <typename Arch>
+class TraceStreamWriter {
+ public:
+  // Does not take ownership of `file`.
+  explicit TraceStreamWriter(std::FILE* file) : file_(file) {}
+
+  // Not copyable or movable, buffers unwritten data.
+  TraceStreamWriter(const TraceStreamWriter&) = delete;
+  TraceStreamWriter& operator=(const TraceStreamWriter&) = delete;
+
+  // Records that the instruction described by `info` executed starting from
+  // `ucontext`.
+  void AddInstruction(const UContext<Arch>& ucontext,
+                      const InstructionInfo<Arch>& info) {
+    if (!started_) Start(ucontext);
+    buffer_.push_back(trace_stream_internal::kInstructionRecord);
+    // Linear execution encodes as a single zero byte.
+    int64_t skip = static_cast<int64_t>(info.address - expected_address_);
+    trace_stream_internal::AppendVarint(
+        (static_cast<uint64_t>(skip) << 1) ^ static_cast<uint64_t>(skip >> 63),
+        buffer_);
+    trace_stream_internal::AppendVarint(info.instruction_id, buffer_);
+    const uint8_t size = std::min<size_t>(info.size, sizeof(info.bytes));
+    buffer_.push_back(size);
+    buffer_.append(reinterpret_cast<const char*>(info.bytes), size);
+    uint8_t flags = 0;
+    if (info.can_load) flags |= trace_stream_internal::kCanLoad;
+    if (info.can_store) flags |= trace_stream_internal::kCanStore;
+    if (info.can_branch) flags |= trace_stream_internal::kCanBranch;
+    buffer_.push_back(flags);
+    AppendDelta(ucontext);
+    expected_address_ = info.address + info.size;
+    if (buffer_.size() >= kFlushThreshold) Flush();
+  }
+
+  // Records that the trace ended in `ucontext` and writes out everything.
+  // Returns an error if writing to the file failed at any point.
+  absl::Status Finish(const UContext<Arch>& ucontext) {
+    if (!started_) Start(ucontext);
+    buffer_.push_back(trace_stream_internal::kEndRecord);
+    AppendDelta(ucontext);
+    Flush();
+    if (write_failed_ || fflush(file_) != 0) {
+      return absl::InternalError("failed to write the trace stream");
+    }
+    return absl::OkStatus();
+  }
+
+ private:
+  // Buffered bytes are written out once there are at least this many.
+  static constexpr size_t kFlushThreshold = 1 << 16;
+
+  static constexpr size_t kNumContextWords =
+      sizeof(UContext<Arch>) / sizeof(uint64_t);
+  static_assert(sizeof(UContext<Arch>) % sizeof(uint64_t) == 0);
+
+  void Start(const UContext<Arch>& ucontext) {
+    trace_stream_internal::AppendHeader(Arch::architecture_id, buffer_);
+    buffer_.append(reinterpret_cast<const char*>(&ucontext), sizeof(ucontext));
+    prev_ = ucontext;
+    expected_address_ = ucontext.gregs.GetInstructionPointer();
+    started_ = true;
+  }
+
+  // Appends the words of `ucontext` that differ from `prev_`.
+  void AppendDelta(const UContext<Arch>& ucontext) {
+    const char* prev = reinterpret_cast<const char*>(&prev_);
+    const char* next = reinterpret_cast<const char*>(&ucontext);
+    size_t changed[kNumContextWords];
+    size_t num_changed = 0;
+    for (size_t word = 0; word < kNumContextWords; ++word) {
+      const size_t offset = word * sizeof(uint64_t);
+      if (memcmp(prev + offset, next + offset, sizeof(uint64_t)) != 0) {
+        changed[num_changed++] = word;
+      }
+    }
+    trace_stream_internal::AppendVarint(num_changed, buffer_);
+    size_t next_word = 0;
+    for (size_t i = 0; i < num_changed; ++i) {
+      trace_stream_internal::AppendVarint(changed[i] - next_word, buffer_);
+      buffer_.append(next + changed[i] * sizeof(uint64_t), sizeof(uint64_t));
+      next_word = changed[i] + 1;
+    }
+    prev_ = ucontext;
+  }
+
+  void Flush() {
+    if (fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size()) {
+      write_failed_ = true;
+    }
+    buffer_.clear();
+  }
+
+  std::FILE* file_;
+  std::string buffer_;
+  bool started_ = false;
+  bool write_failed_ = false;
+
+  // The context and the expected address of the previous record.
+  UContext<Arch> prev_;
+  uint64_t expected_address_ = 0;
+};
+
+// Decodes a trace stream written by TraceStreamWriter<Arch> from a file
+// positioned right after the part of the header read by
+// ReadTraceStreamHeader().
+//
+// This class is thread-compatible.
+template <typename Arch>
+class TraceStreamReader {
+ public:
+  // Does not take ownership of `file`.
+  explicit TraceStreamReader(std::FILE* file) : file_(file) {}
+
+  // Not copyable or movable.
+  TraceStreamReader(const TraceStreamReader&) = delete;
+  TraceStreamReader& operator=(const TraceStreamReader&) = delete;
+
+  // Decodes the rest of the stream and, for each instruction, invokes the
+  // callback with the same arguments as ExecutionTrace<Arch>::ForEach(). The
+  // `critical` field of the InstructionInfo is always false.
+  // Returns an error if the stream is truncated or malformed.
+  template <typename F>
+  absl::Status ForEach(F&& f) {
+    RETURN_IF_NOT_OK(
+        trace_stream_internal::ReadBytes(file_, &first_, sizeof(first_)));
+    UContext<Arch> prev = first_;
+    UContext<Arch> next = first_;
+    uint64_t expected_address = first_.gregs.GetInstructionPointer();
+    InstructionInfo<Arch> info;
+    size_t num_instructions = 0;
+    while (true) {
+      int tag = getc(file_);
+      if (tag == trace_stream_internal::kEndRecord) {
+        RETURN_IF_NOT_OK(ReadDelta(next));
+        if (num_instructions > 0) f(num_instructions - 1, prev, next, info);
+        last_ = next;
+        num_instructions_ = num_instructions;
+        return absl::OkStatus();
+      }
+      if (tag != trace_stream_internal::kInstructionRecord) {
+        return tag == EOF ? absl::DataLossError("truncated trace stream")
+                          : absl::InvalidArgumentError(
+                                "unknown record in trace stream");
+      }
+      // The context before this instruction completes the previous one.
+      InstructionInfo<Arch> next_info;
+      RETURN_IF_NOT_OK(ReadInstruction(expected_address, next_info));
+      RETURN_IF_NOT_OK(ReadDelta(next));
+      if (num_instructions > 0) f(num_instructions - 1, prev, next, info);
+      prev = next;
+      info = next_info;
+      expected_address = info.address + info.size;
+      ++num_instructions;
+    }
+  }
+
+  // The architectural state before and after the trace. Valid after
+  // ForEach() succeeded.
+  const UContext<Arch>& FirstContext() const { return first_; }
+  const UContext<Arch>& LastContext() const { return last_; }
+
+  // The number of instructions in the trace. Valid after ForEach() succeeded.
+  size_t NumInstructions() const { return num_instructions_; }
+
+ private:
+  static constexpr size_t kNumContextWords =
+      sizeof(UContext<Arch>) / sizeof(uint64_t);
+
+  absl::Status ReadInstruction(uint64_t expected_address,
+                               InstructionInfo<Arch>& info) {
+    memset(&info, 0, sizeof(info));
+    ASSIGN_OR_RETURN_IF_NOT_OK(uint64_t zigzag,
+                               trace_stream_internal::ReadVarint(file_));
+    info.address = expected_address + ((zigzag >> 1) ^ -(zigzag & 1));
+    ASSIGN_OR_RETURN_IF_NOT_OK(uint64_t instruction_id,
+                               trace_stream_internal::ReadVarint(file_));
+    info.instruction_id = instruction_id;
+    uint8_t size;
+    RETURN_IF_NOT_OK(trace_stream_internal::ReadBytes(file_, &size, 1));
+    if (size > sizeof(info.bytes)) {
+      return absl::InvalidArgumentError("bad instruction size in trace stream");
+    }
+    info.size = size;
+    RETURN_IF_NOT_OK(trace_stream_internal::ReadBytes(file_, info.bytes, size));
+    uint8_t flags;
+    RETURN_IF_NOT_OK(trace_stream_internal::ReadBytes(file_, &flags, 1));
+    info.can_load = flags & trace_stream_internal::kCanLoad;
+    info.can_store = flags & trace_stream_internal::kCanStore;
+    info.can_branch = flags & trace_stream_internal::kCanBranch;
+    return absl::OkStatus();
+  }
+
+  // Applies a context delta to `ucontext`.
+  absl::Status ReadDelta(UContext<Arch>& ucontext) {
+    char* words = reinterpret_cast<char*>(&ucontext);
+    ASSIGN_OR_RETURN_IF_NOT_OK(uint64_t num_changed,
+                               trace_stream_internal::ReadVarint(file_));
+    uint64_t word = 0;
+    for (uint64_t i = 0; i < num_changed; ++i) {
+      ASSIGN_OR_RETURN_IF_NOT_OK(uint64_t gap,
+                                 trace_stream_internal::ReadVarint(file_));
+      word += gap;
+      if (word >= kNumContextWords) {
+        return absl::InvalidArgumentError("bad context word in trace stream");
+      }
+      RETURN_IF_NOT_OK(trace_stream_internal::ReadBytes(
+          file_, words + word * sizeof(uint64_t), sizeof(uint64_t)));
+      ++word;
+    }
+    return absl::OkStatus();
+  }
+
+  std::FILE* file_;
+  UContext<Arch> first_;
+  UContext<Arch> last_;
+  size_t num_instructions_ = 0;
+};
+
+// Runs the tracer for at most `max_instructions` instructions and writes each
+// one to `writer` as it executes. Like CaptureTrace(), but the memory used
+// does not depend on the length of the trace.
+template <typename Tracer, typename Disassembler, typename Arch>
+absl::Status StreamTrace(Tracer& tracer, Disassembler& disasm,
+                         size_t max_instructions,
+                         TraceStreamWriter<Arch>& writer) {
+  const uint64_t code_page_start =
+      RoundDownToPageAlignment(tracer.GetCurrentInstructionPointer());
+  bool insn_out_of_bounds = false;
+  UContext<Arch> ucontext;
+  InstructionInfo<Arch> info;
+  tracer.SetInstructionCallback([&](Tracer* tracer, uint64_t address,
+                                    size_t max_size) {
+    // The instruction hasn't executed yet, capture the previous state.
+    tracer->GetRegisters(ucontext);
+    memset(&info, 0, sizeof(info));
+    if (!FetchInstruction(tracer, disasm, code_page_start, address, max_size,
+                          info)) {
+      tracer->Stop();
+      insn_out_of_bounds = true;
+    }
+    writer.AddInstruction(ucontext, info);
+  });
+  absl::Status result = tracer.Run(max_instructions);
+  // Capture the final state.
+  tracer.GetRegisters(ucontext);
+  RETURN_IF_NOT_OK(writer.Finish(ucontext));
+  if (result.ok() && insn_out_of_bounds) {
+    result = absl::OutOfRangeError("instruction fetch was out of bounds");
+  }
+  return result;
+}
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_TRACING_TRACE_STREAM_H_
@@ -0,0 +1,146 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./tracing/trace_stream.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "./common/snapshot_test_config.h"
+#include "./common/snapshot_test_enum.h"
+#include "./instruction/capstone_disassembler.h"
+#include "./tracing/execution_trace.h"
+#include "./tracing/unicorn_tracer.h"
+#include "./util/arch.h"
+#include "./util/testing/status_matchers.h"
+#include "./util/ucontext/ucontext_types.h"
+
+namespace silifuzz {
+
+namespace {
+
+using silifuzz::testing::IsOk;
+using silifuzz::testing::StatusIs;
+
+template <class>
+struct TraceStreamTest : ::testing::Test {};
+using arch_typelist = ::testing::Types<X86_64, AArch64>;
+TYPED_TEST_SUITE(TraceStreamTest, arch_typelist);
+
+// Streams the execution of `snippet` into a temporary file and checks that it
+// decodes to the same trace CaptureTrace() records.
+template <typename Arch>
+void CheckStreamMatchesCapture(TestSnapshot snippet, size_t max_instructions) {
+  std::string instructions = GetTestSnippet<Arch>(snippet);
+  CapstoneDisassembler<Arch> disasm;
+
+  UnicornTracer<Arch> capture_tracer;
+  ASSERT_THAT(capture_tracer.InitSnippet(instructions), IsOk());
+  ExecutionTrace<Arch> execution_trace(max_instructions);
+  absl::Status capture_status =
+      CaptureTrace(capture_tracer, disasm, execution_trace);
+
+  std::FILE* file = tmpfile();
+  ASSERT_NE(file, nullptr);
+  UnicornTracer<Arch> stream_tracer;
+  ASSERT_THAT(stream_tracer.InitSnippet(instructions), IsOk());
+  TraceStreamWriter<Arch> writer(file);
+  EXPECT_EQ(StreamTrace(stream_tracer, disasm, max_instructions, writer),
+            capture_status);
+
+  rewind(file);
+  absl::StatusOr<ArchitectureId> arch = ReadTraceStreamHeader(file);
+  ASSERT_THAT(arch, IsOk());
+  EXPECT_EQ(*arch, Arch::architecture_id);
+  TraceStreamReader<Arch> reader(file);
+  size_t count = 0;
+  ASSERT_THAT(reader.ForEach([&](size_t i, const UContext<Arch>& prev,
+                                 const UContext<Arch>& next,
+                                 InstructionInfo<Arch>& info) {
+    ASSERT_EQ(i, count);
+    count++;
+    ASSERT_LT(i, execution_trace.NumInstructions());
+    const InstructionInfo<Arch>& expected = execution_trace.Info(i);
+    EXPECT_EQ(info.address, expected.address);
+    EXPECT_EQ(info.instruction_id, expected.instruction_id);
+    EXPECT_EQ(info.size, expected.size);
+    EXPECT_EQ(info.can_branch, expected.can_branch);
+    EXPECT_EQ(info.can_load, expected.can_load);
+    EXPECT_EQ(info.can_store, expected.can_store);
+    EXPECT_EQ(memcmp(info.bytes, expected.bytes, info.size), 0);
+    UContext<Arch> expected_prev = execution_trace.Context(i);
+    UContext<Arch> expected_next = execution_trace.Context(i + 1);
+    EXPECT_EQ(prev.gregs, expected_prev.gregs);
+    EXPECT_EQ(prev.fpregs, expected_prev.fpregs);
+    EXPECT_EQ(next.gregs, expected_next.gregs);
+    EXPECT_EQ(next.fpregs, expected_next.fpregs);
+  }),
+              IsOk());
+  EXPECT_EQ(count, execution_trace.NumInstructions());
+  EXPECT_EQ(reader.NumInstructions(), execution_trace.NumInstructions());
+  EXPECT_EQ(reader.FirstContext().gregs,
+            execution_trace.FirstContext().gregs);
+  EXPECT_EQ(reader.LastContext().gregs, execution_trace.LastContext().gregs);
+  fclose(file);
+}
+
+TYPED_TEST(TraceStreamTest, MatchesCapture) {
+  CheckStreamMatchesCapture<TypeParam>(TestSnapshot::kSetThreeRegisters, 3);
+}
+
+TYPED_TEST(TraceStreamTest, MatchesCaptureOfRunaway) {
+  CheckStreamMatchesCapture<TypeParam>(TestSnapshot::kRunaway, 200);
+}
+
+TYPED_TEST(TraceStreamTest, Truncated) {
+  using Arch = TypeParam;
+  std::string instructions =
+      GetTestSnippet<Arch>(TestSnapshot::kSetThreeRegisters);
+  UnicornTracer<Arch> tracer;
+  ASSERT_THAT(tracer.InitSnippet(instructions), IsOk());
+  CapstoneDisassembler<Arch> disasm;
+
+  std::FILE* file = tmpfile();
+  ASSERT_NE(file, nullptr);
+  TraceStreamWriter<Arch> writer(file);
+  ASSERT_THAT(StreamTrace(tracer, disasm, 3, writer), IsOk());
+
+  // Drop the last byte of the end record.
+  std::string stream(ftell(file), '\0');
+  rewind(file);
+  ASSERT_EQ(fread(stream.data(), 1, stream.size(), file), stream.size());
+  fclose(file);
+  file = tmpfile();
+  ASSERT_NE(file, nullptr);
+  fwrite(stream.data(), 1, stream.size() - 1, file);
+  rewind(file);
+
+  ASSERT_THAT(ReadTraceStreamHeader(file), IsOk());
+  TraceStreamReader<Arch> reader(file);
+  EXPECT_THAT(reader.ForEach([](size_t, const UContext<Arch>&,
+                                const UContext<Arch>&,
+                                InstructionInfo<Arch>&) {}),
+              StatusIs(absl::StatusCode::kDataLoss));
+  fclose(file);
+}
+
+}  // namespace
+
+}  // namespace silifuzz
@@ -12,8 +12,13 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <iterator>
 #include <optional>
 #include <string>
 #include <vector>
@@ -27,8 +32,11 @@
 #include "absl/types/span.h"
 #include "./instruction/default_disassembler.h"
 #include "./instruction/disassembler.h"
+#include "./snap/snap_corpus_util.h"
 #include "./tracing/analysis.h"
+#include "./tracing/batch_trace.h"
 #include "./tracing/execution_trace.h"
+#include "./tracing/trace_stream.h"
 #include "./tracing/unicorn_tracer.h"
 #include "./util/arch.h"
 #include "./util/bitops.h"
@@ -48,6 +56,15 @@ ABSL_FLAG(std::optional<std::string>, snippet, std::nullopt,
 ABSL_FLAG(size_t, max_instructions, 0x1000,
           "The maximum number of instructions that should be executed");
 
+ABSL_FLAG(std::optional<std::string>, stream_trace, std::nullopt,
+          "If set, print writes a binary trace stream to this path (- for "
+          "stdout) as the snippet executes instead of printing the trace. "
+          "Decode it with the decode subcommand");
+
+ABSL_FLAG(int, num_threads, 1,
+          "Number of threads used to inject faults when analyzing a snippet, "
+          "or to trace snippets in batch mode");
+
 namespace silifuzz {
 
 namespace {
@@ -58,63 +75,85 @@ void PrintRegister(void* arg, const char* str1, const char* str2,
   out.Line(absl::StrCat("    ", str1, str2, str3, str4));
 }
 
+// Displays instructions of a trace one at a time in a human-readable format
+// with a bunch of metadata.
+template <typename Arch>
+class TraceLogger {
+ public:
+  TraceLogger(Disassembler& disasm, bool fault_injection, LinePrinter& out)
+      : disasm_(disasm), fault_injection_(fault_injection), out_(out) {}
+
+  // Logs an instruction, see ExecutionTrace::ForEach() for the arguments.
+  void Log(size_t index, const UContext<Arch>& prev, const UContext<Arch>& next,
+           const InstructionInfo<Arch>& info) {
+    if (index == 0) entry_address_ = prev.gregs.GetInstructionPointer();
+    bool valid = info.instruction_id != disasm_.InvalidInstructionID();
+
+    // Did we see something other than linear execution?
+    if (last_valid_ && info.address != expected_next_) {
+      out_.Line("    branch");
+    }
+
+    // Note: we disassemble the instruction a second time to recover the full
+    // textual disassembly. In most cases we don't store this because it's only
+    // needed for human-readable output.
+    disasm_.Disassemble(info.address, info.bytes, info.size);
+
+    // Display information about the next instruction.
+    // Note: formatting assumes the code addresses are in the lower 4GB so that
+    // it can omit 8 leading zeros and be a bit prettier.
+    std::string metadata = absl::StrCat(
+        absl::Dec(index, absl::kZeroPad4),
+        " addr=", absl::Hex(info.address, absl::kZeroPad8),
+        " offset=", absl::Dec(info.address - entry_address_, absl::kZeroPad4),
+        " size=", absl::Dec(info.size, absl::kZeroPad2), " ",
+        info.can_load ? "L" : "-", info.can_store ? "S" : "-",
+        info.can_branch ? "B" : "-");
+
+    // How many bits changed?
+    UContext<Arch> diff;
+    BitDiff(prev, next, diff);
+    // Ignore instruction pointer changes.
+    diff.gregs.SetInstructionPointer(0);
+    absl::StrAppend(&metadata,
+                    " diff=", absl::Dec(PopCount(diff), absl::kZeroPad3));
+
+    // Fault injection metrics.
+    if (fault_injection_) {
+      absl::StrAppend(&metadata, " crit=", info.critical);
+    }
+    out_.Line(metadata, "    ", disasm_.FullText());
+
+    // Print the contents of any registers that changed.
+    diff = prev;
+    // Avoid printing a diff for the instruction pointer, this is assumed.
+    diff.gregs.SetInstructionPointer(next.gregs.GetInstructionPointer());
+    LogGRegs(next.gregs, PrintRegister, &out_, &diff.gregs);
+    LogFPRegs(next.fpregs, true, PrintRegister, &out_, &diff.fpregs);
+
+    last_valid_ = valid;
+    expected_next_ = info.address + info.size;
+  }
+
+ private:
+  Disassembler& disasm_;
+  bool fault_injection_;
+  LinePrinter& out_;
+
+  uint64_t entry_address_ = 0;
+  uint64_t expected_next_ = 0;
+  bool last_valid_ = false;
+};
+
 // Display the trace in a human-readable format with a bunch of metadata.
 template <typename Arch>
 void LogTrace(Disassembler& disasm, ExecutionTrace<Arch>& execution_trace,
               bool fault_injection, LinePrinter& out) {
-  uint64_t expected_next = execution_trace.EntryAddress();
-  bool last_valid = false;
+  TraceLogger<Arch> logger(disasm, fault_injection, out);
   execution_trace.ForEach(
-      [&](size_t index, UContext<Arch>& prev, InstructionInfo<Arch>& info) {
-        bool valid = info.instruction_id != disasm.InvalidInstructionID();
-
-        // Did we see something other than linear execution?
-        if (last_valid && info.address != expected_next) {
-          out.Line("    branch");
-        }
-
-        // Note: we disassemble the instruction a second time to recover the
-        // full textual disassembly. In most cases we don't store this because
-        // it's only needed for human-readable output.
-        disasm.Disassemble(info.address, info.bytes, info.size);
-
-        // Display information about the next instruction.
-        // Note: formatting assumes the code addresses are in the lower 4GB so
-        // that it can omit 8 leading zeros and be a bit prettier.
-        std::string metadata = absl::StrCat(
-            absl::Dec(index, absl::kZeroPad4),
-            " addr=", absl::Hex(info.address, absl::kZeroPad8), " offset=",
-            absl::Dec(info.address - execution_trace.EntryAddress(),
-                      absl::kZeroPad4),
-            " size=", absl::Dec(info.size, absl::kZeroPad2), " ",
-            info.can_load ? "L" : "-", info.can_store ? "S" : "-",
-            info.can_branch ? "B" : "-");
-
-        // How many bits changed?
-        UContext<Arch> diff;
-        BitDiff(prev, info.ucontext, diff);
-        // Ignore instruction pointer changes.
-        diff.gregs.SetInstructionPointer(0);
-        absl::StrAppend(&metadata,
-                        " diff=", absl::Dec(PopCount(diff), absl::kZeroPad3));
-
-        // Fault injection metrics.
-        if (fault_injection) {
-          absl::StrAppend(&metadata, " crit=", info.critical);
-        }
-        out.Line(metadata, "    ", disasm.FullText());
-
-        // Print the contents of any registers that changed.
-        diff = prev;
-        // Avoid printing a diff for the instruction pointer, this is assumed.
-        diff.gregs.SetInstructionPointer(
-            info.ucontext.gregs.GetInstructionPointer());
-        LogGRegs(info.ucontext.gregs, PrintRegister, &out, &diff.gregs);
-        LogFPRegs(info.ucontext.fpregs, true, PrintRegister, &out,
-                  &diff.fpregs);
-
-        last_valid = valid;
-        expected_next = info.address + info.size;
+      [&](size_t index, const UContext<Arch>& prev,
+          const UContext<Arch>& next, InstructionInfo<Arch>& info) {
+        logger.Log(index, prev, next, info);
       });
 }
 
@@ -126,8 +165,9 @@ struct OpInfo {
   size_t critical;
   size_t count;
 
-  void AddOp(UContext<Arch>& prev, InstructionInfo<Arch>& info) {
-    AccumulateToggle(prev, info.ucontext, zero_one, one_zero);
+  void AddOp(const UContext<Arch>& prev, const UContext<Arch>& next,
+             const InstructionInfo<Arch>& info) {
+    AccumulateToggle(prev, next, zero_one, one_zero);
     if (info.critical) {
       critical++;
     }
@@ -152,6 +192,20 @@ struct TraceOpInfo {
     memset(&op_infos[0], 0, op_infos.size() * sizeof(op_infos[0]));
     ClearBits(all_info);
   }
+
+  void AddOp(const UContext<Arch>& prev, const UContext<Arch>& next,
+             const InstructionInfo<Arch>& info) {
+    op_infos[info.instruction_id].AddOp(prev, next, info);
+    all_info.AddOp(prev, next, info);
+  }
+
+  // Post process as needed.
+  void Finalize() {
+    for (OpInfo<Arch>& info : op_infos) {
+      info.Finalize();
+    }
+    all_info.Finalize();
+  }
 };
 
 // Gather stats from a trace.
@@ -162,27 +216,18 @@ TraceOpInfo<Arch> GatherTraceOpInfo(Disassembler& disasm,
 
   // Gather information from the trace.
   execution_trace.ForEach(
-      [&](size_t index, UContext<Arch>& prev, InstructionInfo<Arch>& info) {
-        trace_info.op_infos[info.instruction_id].AddOp(prev, info);
-        trace_info.all_info.AddOp(prev, info);
+      [&](size_t index, const UContext<Arch>& prev,
+          const UContext<Arch>& next, InstructionInfo<Arch>& info) {
+        trace_info.AddOp(prev, next, info);
       });
-
-  // Post process as needed.
-  for (OpInfo<Arch>& info : trace_info.op_infos) {
-    info.Finalize();
-  }
-  trace_info.all_info.Finalize();
-
+  trace_info.Finalize();
   return trace_info;
 }
 
 // Display stats for a trace in a human-readable format.
 template <typename Arch>
-void LogTraceOpInfo(Disassembler& disasm, ExecutionTrace<Arch>& execution_trace,
+void LogTraceOpInfo(Disassembler& disasm, const TraceOpInfo<Arch>& trace_info,
                     bool fault_injection, LinePrinter& out) {
-  // Summarize the trace.
-  TraceOpInfo<Arch> trace_info = GatherTraceOpInfo(disasm, execution_trace);
-
   // Print the header.
   out.Line();
   std::string text =
@@ -207,7 +252,7 @@ void LogTraceOpInfo(Disassembler& disasm, ExecutionTrace<Arch>& execution_trace,
 
   // Print the summary for each type of op.
   for (size_t i = 0; i < trace_info.op_infos.size(); ++i) {
-    OpInfo<Arch>& info = trace_info.op_infos[i];
+    const OpInfo<Arch>& info = trace_info.op_infos[i];
     if (info.count > 0) {
       std::string name = disasm.InstructionIDName(i);
       log_info(name, info);
@@ -230,7 +275,8 @@ absl::Status PrintTrace(UnicornTracer<Arch>& tracer, size_t max_instructions,
   absl::Status result = CaptureTrace(tracer, disasm, execution_trace);
 
   LogTrace(disasm, execution_trace, false, out);
-  LogTraceOpInfo(disasm, execution_trace, false, out);
+  LogTraceOpInfo(disasm, GatherTraceOpInfo(disasm, execution_trace), false,
+                 out);
   out.Line();
   UContext<Arch> diff;
   BitDiff(execution_trace.FirstContext(), execution_trace.LastContext(), diff);
@@ -238,12 +284,40 @@ absl::Status PrintTrace(UnicornTracer<Arch>& tracer, size_t max_instructions,
   return result;
 }
 
+// Write a binary trace stream to `file` as the code executes. Unlike
+// PrintTrace(), the memory used does not depend on the length of the trace.
+template <typename Arch>
+absl::Status StreamTraceToFile(UnicornTracer<Arch>& tracer,
+                               size_t max_instructions, std::FILE* file) {
+  DefaultDisassembler<Arch> disasm;
+  TraceStreamWriter<Arch> writer(file);
+  return StreamTrace(tracer, disasm, max_instructions, writer);
+}
+
 template <typename Arch>
 absl::Status PrintSnippetTrace(std::string& instructions,
-                               size_t max_instructions, LinePrinter& out) {
+                               size_t max_instructions,
+                               const std::optional<std::string>& stream_path,
+                               LinePrinter& out) {
   UnicornTracer<Arch> tracer;
   RETURN_IF_NOT_OK(tracer.InitSnippet(instructions));
-  return PrintTrace(tracer, max_instructions, out);
+  if (!stream_path.has_value()) {
+    return PrintTrace(tracer, max_instructions, out);
+  }
+  if (*stream_path == "-") {
+    return StreamTraceToFile(tracer, max_instructions, stdout);
+  }
+  std::FILE* file = fopen(stream_path->c_str(), "wb");
+  if (file == nullptr) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Could not open ", *stream_path));
+  }
+  absl::Status result = StreamTraceToFile(tracer, max_instructions, file);
+  if (fclose(file) != 0 && result.ok()) {
+    result =
+        absl::InternalError(absl::StrCat("Could not write ", *stream_path));
+  }
+  return result;
 }
 
 absl::StatusOr<int> Print(std::vector<char*>& positional_args, LinePrinter& out,
@@ -261,7 +335,8 @@ absl::StatusOr<int> Print(std::vector<char*>& positional_args, LinePrinter& out,
     ASSIGN_OR_RETURN_IF_NOT_OK(std::string instructions,
                                GetFileContents(snippet_path.value()));
     RETURN_IF_NOT_OK(ARCH_DISPATCH(PrintSnippetTrace, arch, instructions,
-                                   max_instructions, out));
+                                   max_instructions,
+                                   absl::GetFlag(FLAGS_stream_trace), out));
     return EXIT_SUCCESS;
   } else {
     return absl::InvalidArgumentError("Must specify an input.");
@@ -270,7 +345,8 @@ absl::StatusOr<int> Print(std::vector<char*>& positional_args, LinePrinter& out,
 
 template <typename Arch>
 absl::Status AnalyzeSnippet(const std::string& instructions,
-                            size_t max_instructions, LinePrinter& out) {
+                            size_t max_instructions, int num_threads,
+                            LinePrinter& out) {
   DefaultDisassembler<Arch> disasm;
   ExecutionTrace<Arch> execution_trace(max_instructions);
   UnicornTracer<Arch> tracer;
@@ -280,13 +356,15 @@ absl::Status AnalyzeSnippet(const std::string& instructions,
 
   ASSIGN_OR_RETURN_IF_NOT_OK(FaultInjectionResult result,
                              AnalyzeSnippetWithFaultInjection<Arch>(
-                                 instructions, execution_trace, checksum));
+                                 instructions, execution_trace, checksum,
+                                 num_threads));
   out.Line("Detected ", result.fault_detection_count, "/",
            result.fault_injection_count, " faults - ",
            static_cast<int>(100 * result.sensitivity), "% sensitive");
 
   LogTrace(disasm, execution_trace, true, out);
-  LogTraceOpInfo(disasm, execution_trace, true, out);
+  LogTraceOpInfo(disasm, GatherTraceOpInfo(disasm, execution_trace), true,
+                 out);
 
   return absl::OkStatus();
 }
@@ -305,14 +383,144 @@ absl::StatusOr<int> Analyze(std::vector<char*>& positional_args,
     size_t max_instructions = absl::GetFlag(FLAGS_max_instructions);
     ASSIGN_OR_RETURN_IF_NOT_OK(std::string instructions,
                                GetFileContents(snippet_path.value()));
+    int num_threads = absl::GetFlag(FLAGS_num_threads);
     RETURN_IF_NOT_OK(ARCH_DISPATCH(AnalyzeSnippet, arch, instructions,
-                                   max_instructions, out));
+                                   max_instructions, num_threads, out));
     return EXIT_SUCCESS;
   } else {
     return absl::InvalidArgumentError("Must specify an input.");
   }
 }
 
+// Trace every snippet in `inputs` and print how often each instruction ran.
+template <typename Arch>
+absl::Status TraceBatch(const std::vector<std::string>& inputs,
+                        size_t max_instructions, int num_threads,
+                        LinePrinter& out) {
+  std::vector<std::string> snippets;
+  for (const std::string& input : inputs) {
+    std::vector<std::string> input_snippets;
+    if (CorpusFileArchitecture(input.c_str()) != ArchitectureId::kUndefined) {
+      ASSIGN_OR_RETURN_IF_NOT_OK(input_snippets,
+                                 ReadSnippetsFromCorpus<Arch>(input));
+    } else {
+      ASSIGN_OR_RETURN_IF_NOT_OK(input_snippets,
+                                 ReadSnippetsFromBlobFile(input));
+    }
+    snippets.insert(snippets.end(),
+                    std::make_move_iterator(input_snippets.begin()),
+                    std::make_move_iterator(input_snippets.end()));
+  }
+
+  SnippetBatchStats stats =
+      TraceSnippetBatch<Arch>(snippets, max_instructions, num_threads);
+
+  DefaultDisassembler<Arch> disasm;
+  std::vector<uint32_t> ids;
+  for (uint32_t i = 0; i < stats.instruction_counts.size(); ++i) {
+    if (stats.instruction_counts[i] > 0) ids.push_back(i);
+  }
+  std::sort(ids.begin(), ids.end(), [&](uint32_t a, uint32_t b) {
+    return stats.instruction_counts[a] > stats.instruction_counts[b];
+  });
+  const double total = std::max<uint64_t>(stats.num_instructions, 1);
+  out.Line(absl::StrFormat("%-12s %10s %7s", "op", "exec", "%"));
+  out.Line();
+  for (uint32_t id : ids) {
+    out.Line(absl::StrFormat("%-12s %10d %7.3f", disasm.InstructionIDName(id),
+                             stats.instruction_counts[id],
+                             100.0 * stats.instruction_counts[id] / total));
+  }
+  out.Line();
+  out.Line("Snippets: ", stats.num_snippets, " (", stats.num_failed,
+           " did not run to completion)");
+  out.Line("Instructions: ", stats.num_instructions);
+  out.Line(absl::StrFormat("Loads: %.3f%% Stores: %.3f%% Branches: %.3f%%",
+                           100.0 * stats.num_loads / total,
+                           100.0 * stats.num_stores / total,
+                           100.0 * stats.num_branches / total));
+  return absl::OkStatus();
+}
+
+absl::StatusOr<int> Batch(std::vector<char*>& positional_args,
+                          LinePrinter& out, LinePrinter& err) {
+  if (positional_args.empty()) {
+    return absl::InvalidArgumentError(
+        "Expected relocatable corpora or Centipede blob files.");
+  }
+  std::vector<std::string> inputs(positional_args.begin(),
+                                  positional_args.end());
+  positional_args.clear();
+
+  // Corpora know their architecture, blob files need --arch.
+  ArchitectureId arch = absl::GetFlag(FLAGS_arch);
+  for (const std::string& input : inputs) {
+    if (access(input.c_str(), R_OK) != 0) {
+      return absl::InvalidArgumentError(absl::StrCat("Could not open ", input));
+    }
+    ArchitectureId input_arch = CorpusFileArchitecture(input.c_str());
+    if (input_arch == ArchitectureId::kUndefined) continue;
+    if (arch != ArchitectureId::kUndefined && arch != input_arch) {
+      return absl::InvalidArgumentError(
+          absl::StrCat(input, " is for another architecture."));
+    }
+    arch = input_arch;
+  }
+  if (arch == ArchitectureId::kUndefined) {
+    return absl::InvalidArgumentError("--arch is required for blob files.");
+  }
+
+  size_t max_instructions = absl::GetFlag(FLAGS_max_instructions);
+  int num_threads = absl::GetFlag(FLAGS_num_threads);
+  RETURN_IF_NOT_OK(ARCH_DISPATCH(TraceBatch, arch, inputs, max_instructions,
+                                 num_threads, out));
+  return EXIT_SUCCESS;
+}
+
+// Print a trace stream written by `print --stream_trace` like `print` would
+// have printed the trace, one instruction at a time.
+template <typename Arch>
+absl::Status DecodeTraceStream(std::FILE* file, LinePrinter& out) {
+  DefaultDisassembler<Arch> disasm;
+  TraceLogger<Arch> logger(disasm, false, out);
+  TraceOpInfo<Arch> trace_info(disasm.NumInstructionIDs());
+  TraceStreamReader<Arch> reader(file);
+  RETURN_IF_NOT_OK(reader.ForEach(
+      [&](size_t index, const UContext<Arch>& prev,
+          const UContext<Arch>& next, InstructionInfo<Arch>& info) {
+        logger.Log(index, prev, next, info);
+        trace_info.AddOp(prev, next, info);
+      }));
+  trace_info.Finalize();
+  LogTraceOpInfo(disasm, trace_info, false, out);
+  out.Line();
+  UContext<Arch> diff;
+  BitDiff(reader.FirstContext(), reader.LastContext(), diff);
+  out.Line("Final register hamming distance: ", PopCount(diff));
+  return absl::OkStatus();
+}
+
+absl::StatusOr<int> Decode(std::vector<char*>& positional_args,
+                           LinePrinter& out, LinePrinter& err) {
+  if (positional_args.size() != 1) {
+    return absl::InvalidArgumentError(
+        "Expected the path of a trace stream, or - for stdin.");
+  }
+  std::string path = ConsumeArg(positional_args);
+  std::FILE* file = path == "-" ? stdin : fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return absl::InvalidArgumentError(absl::StrCat("Could not open ", path));
+  }
+  absl::StatusOr<ArchitectureId> arch = ReadTraceStreamHeader(file);
+  absl::Status result = arch.status();
+  if (result.ok()) {
+    result = ARCH_DISPATCH(DecodeTraceStream, *arch, file, out);
+  }
+  if (file != stdin) fclose(file);
+  RETURN_IF_NOT_OK(result);
+  return EXIT_SUCCESS;
+}
+
 constexpr Subcommand subcommands[] = {
     {
         .name = "print",
@@ -322,6 +530,14 @@ constexpr Subcommand subcommands[] = {
         .name = "analyze",
         .func = Analyze,
     },
+    {
+        .name = "decode",
+        .func = Decode,
+    },
+    {
+        .name = "batch",
+        .func = Batch,
+    },
 };
 
 }  // namespace
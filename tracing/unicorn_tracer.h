@@ -15,24 +15,36 @@
 #ifndef THIRD_PARTY_SILIFUZZ_TRACING_UNICORN_TRACER_H_
 #define THIRD_PARTY_SILIFUZZ_TRACING_UNICORN_TRACER_H_
 
+#include <sys/mman.h>
+
 #include <algorithm>
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/crc/crc32c.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "./common/memory_perms.h"
 #include "./common/proxy_config.h"
 #include "./common/raw_insns_util.h"
 #include "./common/snapshot.h"
 #include "./common/snapshot_util.h"
 #include "./tracing/unicorn_util.h"
 #include "./util/arch.h"
+#include "./util/arch_mem.h"
 #include "./util/checks.h"
 #include "./util/itoa.h"
+#include "./util/page_util.h"
 #include "./util/ucontext/ucontext.h"
 #include "third_party/unicorn/unicorn.h"
 
@@ -64,13 +76,33 @@ template <typename Arch>
 class UnicornTracer {
  public:
   UnicornTracer() : uc_(nullptr), start_of_code_(0), end_of_code_(0) {}
-  ~UnicornTracer() { Destroy(); }
+  ~UnicornTracer() {
+    Destroy();
+    for (const HostRegion& region : host_regions_) {
+      munmap(region.memory, region.num_bytes);
+    }
+  }
 
   void Destroy() {
+    if (initial_context_ != nullptr) {
+      uc_context_free(initial_context_);
+      initial_context_ = nullptr;
+    }
     if (uc_ != nullptr) {
       uc_close(uc_);
       uc_ = nullptr;
     }
+    hook_code_added_ = false;
+    hook_block_added_ = false;
+    code_mappings_.clear();
+    code_bytes_.clear();
+    dirty_pages_.clear();
+    checkpoints_enabled_ = false;
+    original_pages_.clear();
+    // Keep the host memory for the next snippet.
+    for (HostRegion& region : host_regions_) {
+      region.mapped = false;
+    }
   }
 
   // Prepare Unicorn to run a code snippet.
@@ -82,13 +114,7 @@ class UnicornTracer {
     ASSIGN_OR_RETURN_IF_NOT_OK(
         Snapshot snapshot,
         InstructionsToSnapshot<Arch>(instructions, fuzzing_config));
-
-    UContext<Arch> ucontext;
-    absl::Status status = ConvertRegsFromSnapshot(
-        snapshot.registers(), &ucontext.gregs, &ucontext.fpregs);
-    if (!status.ok()) {
-      LOG_FATAL("Failed to deserialize registers - ", status.message());
-    }
+    UContext<Arch> ucontext = InitialUContext(snapshot);
 
     InitUnicorn(tracer_config);
 
@@ -99,12 +125,93 @@ class UnicornTracer {
     start_of_code_ = GetCurrentInstructionPointer();
     end_of_code_ = GetExitPoint(snapshot);
 
-    // Hook instruction execution so that we can always count the number of
-    // instructions executed. This is what Unicorn does internally when you try
-    // to limit the number of instructions executed. Doing it outside Unicorn
-    // allows us to know when we hit the limit.
-    UNICORN_CHECK(uc_hook_add(uc_, &hook_code_, UC_HOOK_CODE,
-                              (void*)&DispatchHookCode, this, 1, 0));
+    return absl::OkStatus();
+  }
+
+  // Like InitSnippet(), but keeps the Unicorn engine, the data mappings and
+  // the translated code alive from one snippet to the next. Creating the engine
+  // and mapping memory dominates the cost of running a short snippet, so this
+  // is much faster when running many snippets.
+  // The first call initializes the tracer like InitSnippet() and saves the CPU
+  // state. Later calls restore that CPU state, zero the pages written since the
+  // previous call and swap in the new code page. If the code range of
+  // `fuzzing_config` is a single page, every snippet has the same code address
+  // and only the code bytes that changed are rewritten and retranslated.
+  // Pages written by the snippets are tracked with a memory write hook, which
+  // slows down emulated stores.
+  // The instruction and block callbacks are cleared by each call.
+  // REQUIRES: every call passes the same configs and the tracer is not
+  // initialized with InitSnippet().
+  absl::Status InitSnippetReusingEngine(
+      absl::string_view instructions,
+      const UnicornTracerConfig<Arch>& tracer_config =
+          UnicornTracerConfig<Arch>{},
+      const FuzzingConfig<Arch>& fuzzing_config =
+          DEFAULT_FUZZING_CONFIG<Arch>) {
+    if (uc_ == nullptr) {
+      RETURN_IF_NOT_OK(
+          InitSnippet(instructions, tracer_config, fuzzing_config));
+      UNICORN_CHECK(uc_context_alloc(uc_, &initial_context_));
+      UNICORN_CHECK(uc_context_save(uc_, initial_context_));
+      UNICORN_CHECK(uc_hook_add(uc_, &hook_mem_write_, UC_HOOK_MEM_WRITE,
+                                (void*)&DispatchHookMemWrite, this, 1, 0));
+      snapshot_template_.emplace(fuzzing_config);
+      // Rediscover what SetupSnippetMemory() did to the memory.
+      ASSIGN_OR_RETURN_IF_NOT_OK(Snapshot snapshot,
+                                 snapshot_template_->ToSnapshot(instructions));
+      RecordCodeMappings(snapshot);
+      WriteCode(snapshot, /*incremental=*/false);
+      WriteInitialMemory(snapshot, InitialUContext(snapshot),
+                         /*write=*/false);
+      return absl::OkStatus();
+    }
+
+    ASSIGN_OR_RETURN_IF_NOT_OK(Snapshot snapshot,
+                               snapshot_template_->ToSnapshot(instructions));
+    UContext<Arch> ucontext = InitialUContext(snapshot);
+
+    UNICORN_CHECK(uc_context_restore(uc_, initial_context_));
+
+    // Every mapping but the code was zero when it was mapped.
+    static constexpr uint8_t kZeroPage[kPageSize] = {};
+    for (uint64_t page : dirty_pages_) {
+      if (uint8_t* host = MutableHostMemory(page, kPageSize)) {
+        memset(host, 0, kPageSize);
+      } else {
+        UNICORN_CHECK(uc_mem_write(uc_, page, kZeroPage, kPageSize));
+      }
+    }
+    dirty_pages_.clear();
+
+    // Snippets share a code address only if the code range of the config is
+    // a single page. The code page is then kept so that code translated from
+    // the bytes the snippets have in common is reused. Otherwise drop the old
+    // code page along with any code translated from it, as a later snippet may
+    // map different code at the same address.
+    std::vector<Snapshot::MemoryMapping> old_code_mappings =
+        std::move(code_mappings_);
+    RecordCodeMappings(snapshot);
+    const bool keep_code = code_mappings_ == old_code_mappings;
+    if (!keep_code) {
+      for (const Snapshot::MemoryMapping& mm : old_code_mappings) {
+        UNICORN_CHECK(
+            uc_ctl_remove_cache(uc_, mm.start_address(), mm.limit_address()));
+        UNICORN_CHECK(uc_mem_unmap(uc_, mm.start_address(), mm.num_bytes()));
+      }
+      for (const Snapshot::MemoryMapping& mm : code_mappings_) {
+        MapMemory(mm.start_address(), mm.num_bytes(),
+                  MemoryPermsToUnicorn(mm.perms()));
+      }
+    }
+    WriteCode(snapshot, /*incremental=*/keep_code);
+    WriteInitialMemory(snapshot, ucontext, /*write=*/true);
+
+    SetInitialRegisters(ucontext);
+
+    start_of_code_ = GetCurrentInstructionPointer();
+    end_of_code_ = GetExitPoint(snapshot);
+    instruction_callback_ = nullptr;
+    block_callback_ = nullptr;
 
     return absl::OkStatus();
   }
@@ -113,64 +220,115 @@ class UnicornTracer {
                                    uint64_t address, uint32_t size);
 
   // Ask the tracer to invoke `callback` before each instruction is executed.
+  // This adds an instruction hook, which makes the tracer count the executed
+  // instructions itself instead of leaving the limit to Unicorn.
   // F should be compatible with InstructionCallback.
   // This method should not be called more than once.
   template <typename F>
   void SetInstructionCallback(F&& callback) {
     CHECK(!instruction_callback_);
     instruction_callback_ = callback;
+    AddCodeHook();
+  }
+
+  using BlockCallback = void(UnicornTracer<Arch>* tracer, uint64_t address,
+                             uint32_t size);
+
+  // Ask the tracer to invoke `callback` before each basic block is executed.
+  // `size` is the size of the block in bytes. This is cheaper than an
+  // instruction callback, but a block may stop executing part way through,
+  // for example when it faults or hits the instruction limit.
+  // F should be compatible with BlockCallback.
+  // This method should not be called more than once.
+  template <typename F>
+  void SetBlockCallback(F&& callback) {
+    CHECK(!block_callback_);
+    block_callback_ = callback;
+    if (!hook_block_added_) {
+      UNICORN_CHECK(uc_hook_add(uc_, &hook_block_, UC_HOOK_BLOCK,
+                                (void*)&DispatchHookBlock, this, 1, 0));
+      hook_block_added_ = true;
+    }
   }
 
   // Run the code snippet. Execution will stop after `max_insn_executed`
   // instructions to help avoid infinite loops.
   absl::Status Run(size_t max_insn_executed) {
     num_instructions_ = 0;
-    max_instructions_ = max_insn_executed;
-    should_be_stopped_ = false;
-
-    // Unicorn can hang due to bugs in QEMU.
-    // Halt execution if it exceeds 1 seconds of wall clock time.
-    // This value is arbitrary and may need to be tuned.
-    // We don't want this value to be so small that machine load can easily
-    // cause the deadline to be missed.
-    // We don't want this value to be so large that fault injection will take
-    // forever when we hit a degenerate case.
-    // Empirically, 1 second is about 20x-30x longer than execution takes in the
-    // worst case on an unloaded machine.
-    uint64_t timeout_microseconds = 1000000;
-    uc_err err = uc_emu_start(uc_, start_of_code_, end_of_code_,
-                              timeout_microseconds, 0);
-
-    // Check if the emulator stopped cleanly.
-    if (err) {
-      return absl::InternalError(absl::StrCat(
-          "uc_emu_start() returned ", IntStr(err), ": ", uc_strerror(err)));
-    }
+    return Emulate(start_of_code_, max_insn_executed);
+  }
 
-    // We only stop emulation when we see more instructions than the limit.
-    // Exactly at the limit is not an error.
-    if (num_instructions_ > max_instructions_) {
-      return absl::InternalError("emulator executed too many instructions");
-    }
+  struct UcContextDeleter {
+    void operator()(uc_context* context) const { uc_context_free(context); }
+  };
+
+  // The state of a snippet part way through its execution. Running a snippet
+  // again from a checkpoint is much cheaper than from the start when only the
+  // end of the execution differs, e.g. for fault injection.
+  struct Checkpoint {
+    // Number of instructions executed before the checkpoint was saved.
+    size_t num_instructions = 0;
+
+    // CPU state.
+    std::unique_ptr<uc_context, UcContextDeleter> context;
+
+    // Contents of the pages written since EnableCheckpoints(), keyed by
+    // address. Other pages still hold their original contents.
+    absl::flat_hash_map<uint64_t, std::string> pages;
+  };
+
+  // Starts tracking the pages written by the snippet so that checkpoints can
+  // be saved and restored. The original contents of a page are saved when the
+  // snippet first writes it. This adds a memory write hook, which slows down
+  // emulated stores.
+  // REQUIRES: the snippet is initialized and has not been run yet.
+  void EnableCheckpoints() {
+    CHECK(!checkpoints_enabled_);
+    UNICORN_CHECK(uc_hook_add(uc_, &hook_checkpoint_write_, UC_HOOK_MEM_WRITE,
+                              (void*)&DispatchHookCheckpointWrite, this, 1, 0));
+    checkpoints_enabled_ = true;
+  }
 
-    // Check if the timeout fired.
-    size_t result;
-    UNICORN_CHECK(uc_query(uc_, UC_QUERY_TIMEOUT, &result));
-    if (result) {
-      return absl::InternalError("execution timed out");
+  // Saves the current state of the snippet. When called from an instruction
+  // callback, resuming from the checkpoint starts with that instruction.
+  // REQUIRES: EnableCheckpoints() was called.
+  Checkpoint SaveCheckpoint() {
+    CHECK(checkpoints_enabled_);
+    Checkpoint checkpoint;
+    checkpoint.num_instructions = num_instructions_;
+    uc_context* context;
+    UNICORN_CHECK(uc_context_alloc(uc_, &context));
+    checkpoint.context.reset(context);
+    UNICORN_CHECK(uc_context_save(uc_, context));
+    for (const auto& [page, original] : original_pages_) {
+      std::string& bytes = checkpoint.pages[page];
+      bytes.resize(kPageSize);
+      ReadMemory(page, bytes.data(), kPageSize);
     }
+    return checkpoint;
+  }
 
-    // Check if the emulator stopped at the right address.
-    // Generally, this should not be an issue if we did not hit the instruction
-    // count limit or the time limit.
-    uint64_t pc = GetCurrentInstructionPointer();
-    if (pc != end_of_code_) {
-      return absl::InternalError("execution did not reach end of code snippet");
+  // Puts the snippet back in the state saved in `checkpoint`. The callbacks
+  // are kept. Use Resume() to continue the execution.
+  // Should not be invoked inside callbacks from Run() or Resume().
+  void RestoreCheckpoint(const Checkpoint& checkpoint) {
+    CHECK(checkpoints_enabled_);
+    UNICORN_CHECK(uc_context_restore(uc_, checkpoint.context.get()));
+    for (const auto& [page, original] : original_pages_) {
+      auto saved = checkpoint.pages.find(page);
+      const std::string& bytes =
+          saved != checkpoint.pages.end() ? saved->second : original;
+      WriteMemory(page, bytes.data(), kPageSize);
     }
+    num_instructions_ = checkpoint.num_instructions;
+  }
 
-    RETURN_IF_NOT_OK(ValidateArchEndState());
-
-    return absl::OkStatus();
+  // Like Run(), but continues from the current state, typically restored with
+  // RestoreCheckpoint(). The instructions executed before the checkpoint count
+  // towards `max_insn_executed`. Checkpoints are saved from instruction
+  // callbacks, so the instruction count is known here.
+  absl::Status Resume(size_t max_insn_executed) {
+    return Emulate(GetCurrentInstructionPointer(), max_insn_executed);
   }
 
   // Should only be invoked inside callbacks from Run()
@@ -205,10 +363,13 @@ class UnicornTracer {
         uint64_t end_offset =
             std::min(8 * 4096UL, regions[i].end - regions[i].begin + 1);
         CHECK_EQ(end_offset % sizeof(data), 0);
+        if (const uint8_t* host = HostMemory(regions[i].begin, end_offset)) {
+          checksum = absl::ExtendCrc32c(
+              checksum, absl::string_view(reinterpret_cast<const char*>(host),
+                                          end_offset));
+          continue;
+        }
         for (uint64_t offset = 0; offset < end_offset; offset += sizeof(data)) {
-          // Note: if we originally mapped this memory with uc_mem_map_ptr then
-          // we could read it directly and avoid a copy. For a small number of
-          // pages, however, this doesn't offer a huge performance improvement.
           UNICORN_CHECK(
               uc_mem_read(uc_, regions[i].begin + offset, data, sizeof(data)));
           checksum = absl::ExtendCrc32c(checksum,
@@ -234,9 +395,28 @@ class UnicornTracer {
   void SetRegisters(const UContext<Arch>& ucontext);
 
   void ReadMemory(uint64_t address, void* buffer, size_t size) {
+    if (const uint8_t* host = HostMemory(address, size)) {
+      memcpy(buffer, host, size);
+      return;
+    }
     UNICORN_CHECK(uc_mem_read(uc_, address, buffer, size));
   }
 
+  // Returns the host memory backing [address, address + size) or nullptr if
+  // the range is not inside a single region backed by host memory. Data
+  // mappings of snippets are backed by host memory owned by the tracer, so
+  // their current contents can be inspected without a copy. The pointer is
+  // valid until the next snippet is initialized.
+  const uint8_t* HostMemory(uint64_t address, size_t size) const {
+    for (const HostRegion& region : host_regions_) {
+      if (region.mapped && address >= region.start_address &&
+          address - region.start_address + size <= region.num_bytes) {
+        return region.memory + (address - region.start_address);
+      }
+    }
+    return nullptr;
+  }
+
   // HACK so X86_64 can check it isn't executing an instruction that dangles
   // past the end of code. This can happens if the fuzzing input ends with a
   // partial instruction that depends on the bytes that come after the test.
@@ -245,6 +425,182 @@ class UnicornTracer {
   }
 
  private:
+  // Adds the instruction hook if it has not been added yet. The hook stays
+  // for the lifetime of the engine, even if the callback is later cleared.
+  void AddCodeHook() {
+    if (!hook_code_added_) {
+      UNICORN_CHECK(uc_hook_add(uc_, &hook_code_, UC_HOOK_CODE,
+                                (void*)&DispatchHookCode, this, 1, 0));
+      hook_code_added_ = true;
+    }
+  }
+
+  // Runs the snippet from `begin` until the end of the code.
+  absl::Status Emulate(uint64_t begin, size_t max_insn_executed) {
+    max_instructions_ = max_insn_executed;
+    should_be_stopped_ = false;
+
+    // Without an instruction hook, pass the remaining budget to Unicorn so
+    // that it stops after that many instructions. A count of 0 means no limit
+    // to Unicorn, so an exhausted budget is enforced by the hook instead.
+    const size_t remaining = max_instructions_ > num_instructions_
+                                 ? max_instructions_ - num_instructions_
+                                 : 0;
+    if (remaining == 0) AddCodeHook();
+    const size_t engine_count = hook_code_added_ ? 0 : remaining;
+
+    // Unicorn can hang due to bugs in QEMU.
+    // Halt execution if it exceeds 1 seconds of wall clock time.
+    // This value is arbitrary and may need to be tuned.
+    // We don't want this value to be so small that machine load can easily
+    // cause the deadline to be missed.
+    // We don't want this value to be so large that fault injection will take
+    // forever when we hit a degenerate case.
+    // Empirically, 1 second is about 20x-30x longer than execution takes in the
+    // worst case on an unloaded machine.
+    uint64_t timeout_microseconds = 1000000;
+    uc_err err = uc_emu_start(uc_, begin, end_of_code_, timeout_microseconds,
+                              engine_count);
+
+    // Check if the emulator stopped cleanly.
+    if (err) {
+      return absl::InternalError(absl::StrCat(
+          "uc_emu_start() returned ", IntStr(err), ": ", uc_strerror(err)));
+    }
+
+    // We only stop emulation when we see more instructions than the limit.
+    // Exactly at the limit is not an error.
+    if (num_instructions_ > max_instructions_) {
+      return absl::InternalError("emulator executed too many instructions");
+    }
+
+    // Check if the timeout fired.
+    size_t result;
+    UNICORN_CHECK(uc_query(uc_, UC_QUERY_TIMEOUT, &result));
+    if (result) {
+      return absl::InternalError("execution timed out");
+    }
+
+    // Check if the emulator stopped at the right address.
+    // Generally, this should not be an issue if we did not hit the instruction
+    // count limit or the time limit. When Unicorn enforces the limit, stopping
+    // anywhere else means the limit was hit.
+    uint64_t pc = GetCurrentInstructionPointer();
+    if (pc != end_of_code_) {
+      if (engine_count != 0 && !should_be_stopped_) {
+        return absl::InternalError("emulator executed too many instructions");
+      }
+      return absl::InternalError("execution did not reach end of code snippet");
+    }
+
+    RETURN_IF_NOT_OK(ValidateArchEndState());
+
+    return absl::OkStatus();
+  }
+
+
+  // Returns the initial register state of a snippet turned into `snapshot`.
+  static UContext<Arch> InitialUContext(const Snapshot& snapshot) {
+    UContext<Arch> ucontext;
+    absl::Status status = ConvertRegsFromSnapshot(
+        snapshot.registers(), &ucontext.gregs, &ucontext.fpregs);
+    if (!status.ok()) {
+      LOG_FATAL("Failed to deserialize registers - ", status.message());
+    }
+    return ucontext;
+  }
+
+  // Remembers the executable mappings of `snapshot`. These are the only
+  // mappings that differ between snippets.
+  void RecordCodeMappings(const Snapshot& snapshot) {
+    code_mappings_.clear();
+    for (const Snapshot::MemoryMapping& mm : snapshot.memory_mappings()) {
+      if (mm.perms().Has(MemoryPerms::kExecutable)) {
+        code_mappings_.push_back(mm);
+      }
+    }
+  }
+
+  bool IsCodeAddress(uint64_t address) const {
+    for (const Snapshot::MemoryMapping& mm : code_mappings_) {
+      if (address >= mm.start_address() && address < mm.limit_address()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Adds the pages overlapping [address, address + size) to dirty_pages_
+  // unless they hold code.
+  void MarkDirty(uint64_t address, uint64_t size) {
+    if (size == 0) return;
+    for (uint64_t page = RoundDownToPageAlignment(address);
+         page < address + size; page += kPageSize) {
+      if (!IsCodeAddress(page)) dirty_pages_.insert(page);
+    }
+  }
+
+  // Writes the code of `snapshot` and remembers it. If `incremental`, the code
+  // mappings hold the code of the previous snippet and only the bytes that
+  // differ from it are written, so that code translated from the other bytes
+  // stays cached.
+  void WriteCode(const Snapshot& snapshot, bool incremental) {
+    std::vector<Snapshot::MemoryBytes> old_code = std::move(code_bytes_);
+    code_bytes_.clear();
+    for (const Snapshot::MemoryBytes& mb : snapshot.memory_bytes()) {
+      if (!IsCodeAddress(mb.start_address())) continue;
+      const Snapshot::ByteData& data = mb.byte_values();
+      auto old = std::find_if(
+          old_code.begin(), old_code.end(),
+          [&mb](const Snapshot::MemoryBytes& old_mb) {
+            return old_mb.start_address() == mb.start_address() &&
+                   old_mb.num_bytes() == mb.num_bytes();
+          });
+      if (incremental && old != old_code.end()) {
+        const Snapshot::ByteData& old_data = old->byte_values();
+        size_t begin = 0;
+        while (begin < data.size() && data[begin] == old_data[begin]) ++begin;
+        size_t end = data.size();
+        while (end > begin && data[end - 1] == old_data[end - 1]) --end;
+        if (begin < end) {
+          // Writing memory may not drop translations of it.
+          UNICORN_CHECK(uc_ctl_remove_cache(uc_, mb.start_address() + begin,
+                                            mb.start_address() + end));
+          UNICORN_CHECK(uc_mem_write(uc_, mb.start_address() + begin,
+                                     data.data() + begin, end - begin));
+        }
+      } else {
+        UNICORN_CHECK(
+            uc_mem_write(uc_, mb.start_address(), data.data(), data.size()));
+      }
+      code_bytes_.push_back(mb);
+    }
+  }
+
+  // Writes the initial memory contents, other than the code, that
+  // SetupSnippetMemory() writes after mapping memory and marks the pages as
+  // dirty. If `write` is false, only marks the pages.
+  void WriteInitialMemory(const Snapshot& snapshot,
+                          const UContext<Arch>& ucontext, bool write) {
+    for (const Snapshot::MemoryBytes& mb : snapshot.memory_bytes()) {
+      if (IsCodeAddress(mb.start_address())) continue;
+      const Snapshot::ByteData& data = mb.byte_values();
+      if (write) {
+        WriteMemory(mb.start_address(), data.data(), data.size());
+      }
+      MarkDirty(mb.start_address(), data.size());
+    }
+
+    // Simulate the effect RestoreUContext could have on the stack.
+    std::string stack_bytes = RestoreUContextStackBytes(ucontext.gregs);
+    uint64_t stack_address =
+        ucontext.gregs.GetStackPointer() - stack_bytes.size();
+    if (write) {
+      WriteMemory(stack_address, stack_bytes.data(), stack_bytes.size());
+    }
+    MarkDirty(stack_address, stack_bytes.size());
+  }
+
   // Initialize Unicorn and put it in a state that it can execute code snippets
   // and Snapshots. This may involve setting system registers, etc.
   void InitUnicorn(const UnicornTracerConfig<Arch>& tracer_config);
@@ -259,6 +615,55 @@ class UnicornTracer {
     }
   }
 
+  // Like MapMemory(), but backs the mapping with host memory owned by the
+  // tracer. Host memory of an earlier snippet with the same address and size
+  // is reused and zeroed with madvise(MADV_DONTNEED), which only costs
+  // the pages the earlier snippet touched. Host memory is only used for
+  // mappings that are not executable, so writing it directly never leaves
+  // stale translated code behind.
+  void MapHostMemory(uint64_t addr, uint64_t size, uint32_t prot) {
+    HostRegion* region = nullptr;
+    for (HostRegion& r : host_regions_) {
+      if (!r.mapped && r.start_address == addr && r.num_bytes == size) {
+        region = &r;
+        break;
+      }
+    }
+    if (region == nullptr) {
+      void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (memory == MAP_FAILED) {
+        LOG_FATAL("mmap(", HexStr(size), ") failed: ", ErrnoStr(errno));
+      }
+      region = &host_regions_.emplace_back(
+          HostRegion{.start_address = addr,
+                     .num_bytes = size,
+                     .memory = static_cast<uint8_t*>(memory)});
+    } else if (madvise(region->memory, size, MADV_DONTNEED) != 0) {
+      LOG_FATAL("madvise() failed: ", ErrnoStr(errno));
+    }
+    uc_err err = uc_mem_map_ptr(uc_, addr, size, prot, region->memory);
+    if (err != UC_ERR_OK) {
+      LOG_FATAL("mapping ", HexStr(addr), " + ", HexStr(size), " failed with ",
+                IntStr(err), ": ", uc_strerror(err));
+    }
+    region->mapped = true;
+  }
+
+  uint8_t* MutableHostMemory(uint64_t address, size_t size) {
+    return const_cast<uint8_t*>(HostMemory(address, size));
+  }
+
+  // Writes `size` bytes at `data` to `address`. Writes to host memory are a
+  // plain memcpy().
+  void WriteMemory(uint64_t address, const void* data, size_t size) {
+    if (uint8_t* host = MutableHostMemory(address, size)) {
+      memcpy(host, data, size);
+      return;
+    }
+    UNICORN_CHECK(uc_mem_write(uc_, address, data, size));
+  }
+
   // Setup the memory mappings and memory contents for a snippet that has been
   // turned into a Snapshot with InstructionsToSnapshot.
   void SetupSnippetMemory(const Snapshot& snapshot,
@@ -307,18 +712,113 @@ class UnicornTracer {
     tracer->HookCode(address, size);
   }
 
+  void HookBlock(uint64_t address, uint32_t size) {
+    // Like HookCode(), suppress callbacks once the limit has been reached or
+    // Stop() has been called.
+    if (num_instructions_ < max_instructions_ && !should_be_stopped_ &&
+        block_callback_) {
+      block_callback_(this, address, size);
+    }
+  }
+
+  static void DispatchHookBlock(uc_engine* uc, uint64_t address, uint32_t size,
+                                void* user_data) {
+    UnicornTracer<Arch>* tracer = static_cast<UnicornTracer<Arch>*>(user_data);
+    tracer->HookBlock(address, size);
+  }
+
+  // Saves the original contents of the mapped pages overlapping
+  // [address, address + size) that have not been written yet.
+  void SaveOriginalPages(uint64_t address, uint64_t size) {
+    if (size == 0) return;
+    for (uint64_t page = RoundDownToPageAlignment(address);
+         page < address + size; page += kPageSize) {
+      auto [it, inserted] = original_pages_.try_emplace(page);
+      if (!inserted) continue;
+      it->second.resize(kPageSize);
+      if (uc_mem_read(uc_, page, it->second.data(), kPageSize) != UC_ERR_OK) {
+        // Not mapped, the write will fault.
+        original_pages_.erase(it);
+      }
+    }
+  }
+
+  static void DispatchHookCheckpointWrite(uc_engine* uc, uc_mem_type type,
+                                          uint64_t address, int size,
+                                          int64_t value, void* user_data) {
+    UnicornTracer<Arch>* tracer = static_cast<UnicornTracer<Arch>*>(user_data);
+    tracer->SaveOriginalPages(address, size);
+  }
+
+  static void DispatchHookMemWrite(uc_engine* uc, uc_mem_type type,
+                                   uint64_t address, int size, int64_t value,
+                                   void* user_data) {
+    UnicornTracer<Arch>* tracer = static_cast<UnicornTracer<Arch>*>(user_data);
+    tracer->MarkDirty(address, size);
+  }
+
   uc_engine* uc_;
 
+  // Host memory backing a data mapping, see MapHostMemory().
+  struct HostRegion {
+    uint64_t start_address;
+    uint64_t num_bytes;
+    uint8_t* memory;
+    // Whether the region is mapped into uc_.
+    bool mapped = false;
+  };
+
+  // Kept across snippets so that its memory is reused.
+  std::vector<HostRegion> host_regions_;
+
+  // The following members are only used by InitSnippetReusingEngine().
+
+  // CPU state right after the first snippet was initialized.
+  uc_context* initial_context_ = nullptr;
+
+  // Makes the snapshots of the snippets for the fuzzing config of the first
+  // snippet.
+  std::optional<InstructionsSnapshotTemplate<Arch>> snapshot_template_;
+
+  // Executable mappings of the current snippet.
+  std::vector<Snapshot::MemoryMapping> code_mappings_;
+
+  // Contents of code_mappings_.
+  std::vector<Snapshot::MemoryBytes> code_bytes_;
+
+  // Start addresses of the pages that may differ from their initial state.
+  absl::flat_hash_set<uint64_t> dirty_pages_;
+
+  uc_hook hook_mem_write_;
+
+  // The following members are only used by checkpoints.
+
+  bool checkpoints_enabled_ = false;
+  uc_hook hook_checkpoint_write_;
+
+  // Original contents of the pages written since EnableCheckpoints(), keyed
+  // by address.
+  absl::flat_hash_map<uint64_t, std::string> original_pages_;
+
   uint64_t start_of_code_;
   uint64_t end_of_code_;
 
+  // The instruction hook is only added once an instruction callback is set
+  // or the instruction budget is already exhausted when the snippet runs.
+  bool hook_code_added_ = false;
   uc_hook hook_code_;
 
+  // Only counted by the instruction hook.
   size_t num_instructions_;
   size_t max_instructions_;
   bool should_be_stopped_;
 
   std::function<InstructionCallback> instruction_callback_;
+
+  // The block hook is only added once a block callback is set.
+  bool hook_block_added_ = false;
+  uc_hook hook_block_;
+  std::function<BlockCallback> block_callback_;
 };
 
 }  // namespace silifuzz
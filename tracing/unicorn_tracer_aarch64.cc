@@ -19,6 +19,7 @@
 #include <string>
 
 #include "absl/status/status.h"
+#include "./common/memory_perms.h"
 #include "./common/proxy_config.h"
 #include "./common/snapshot.h"
 #include "./tracing/unicorn_tracer.h"
@@ -281,27 +282,32 @@ void UnicornTracer<AArch64>::SetupSnippetMemory(
     const Snapshot &snapshot, const UContext<AArch64> &ucontext,
     const FuzzingConfig<AArch64> &fuzzing_config) {
   for (const Snapshot::MemoryMapping &mm : snapshot.memory_mappings()) {
-    MapMemory(mm.start_address(), mm.num_bytes(),
-              MemoryPermsToUnicorn(mm.perms()));
+    if (mm.perms().Has(MemoryPerms::kExecutable)) {
+      MapMemory(mm.start_address(), mm.num_bytes(),
+                MemoryPermsToUnicorn(mm.perms()));
+    } else {
+      MapHostMemory(mm.start_address(), mm.num_bytes(),
+                    MemoryPermsToUnicorn(mm.perms()));
+    }
   }
 
+  // These mappings are currently not represented in the Snapshot.
+  MapHostMemory(fuzzing_config.data1_range.start_address,
+                fuzzing_config.data1_range.num_bytes,
+                UC_PROT_READ | UC_PROT_WRITE);
+  MapHostMemory(fuzzing_config.data2_range.start_address,
+                fuzzing_config.data2_range.num_bytes,
+                UC_PROT_READ | UC_PROT_WRITE);
+
   for (const Snapshot::MemoryBytes &mb : snapshot.memory_bytes()) {
     const Snapshot::ByteData &data = mb.byte_values();
-    UNICORN_CHECK(
-        uc_mem_write(uc_, mb.start_address(), data.data(), data.size()));
+    WriteMemory(mb.start_address(), data.data(), data.size());
   }
 
-  // These mappings are currently not represented in the Snapshot.
-  MapMemory(fuzzing_config.data1_range.start_address,
-            fuzzing_config.data1_range.num_bytes, UC_PROT_READ | UC_PROT_WRITE);
-  MapMemory(fuzzing_config.data2_range.start_address,
-            fuzzing_config.data2_range.num_bytes, UC_PROT_READ | UC_PROT_WRITE);
-
   // Simulate the effect RestoreUContext could have on the stack.
   std::string stack_bytes = RestoreUContextStackBytes(ucontext.gregs);
-  UNICORN_CHECK(
-      uc_mem_write(uc_, ucontext.gregs.GetStackPointer() - stack_bytes.size(),
-                   stack_bytes.data(), stack_bytes.size()));
+  WriteMemory(ucontext.gregs.GetStackPointer() - stack_bytes.size(),
+              stack_bytes.data(), stack_bytes.size());
 }
 
 template <>
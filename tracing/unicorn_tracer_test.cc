@@ -17,10 +17,13 @@
 #include <cstdint>
 #include <cstdlib>
 #include <string>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "./common/proxy_config.h"
 #include "./common/snapshot_test_config.h"
 #include "./common/snapshot_test_enum.h"
 #include "./util/arch.h"
@@ -33,6 +36,8 @@ namespace silifuzz {
 namespace {
 
 using silifuzz::testing::IsOk;
+using silifuzz::testing::StatusIs;
+using ::testing::HasSubstr;
 using ::testing::Not;
 
 // Check the registers are what we expect after executing the SimpleTestSnippet.
@@ -78,7 +83,30 @@ TYPED_TEST(UnicornTracerTest, StoppedEarly) {
       GetTestSnippet<TypeParam>(TestSnapshot::kSetThreeRegisters);
   UnicornTracer<TypeParam> tracer;
   ASSERT_THAT(tracer.InitSnippet(instructions), IsOk());
-  ASSERT_THAT(tracer.Run(2), Not(IsOk()));
+  EXPECT_THAT(tracer.Run(2), StatusIs(absl::StatusCode::kInternal,
+                                      HasSubstr("too many instructions")));
+}
+
+TYPED_TEST(UnicornTracerTest, InstructionLimit) {
+  std::string instructions =
+      GetTestSnippet<TypeParam>(TestSnapshot::kSetThreeRegisters);
+  UnicornTracer<TypeParam> tracer;
+  ASSERT_THAT(tracer.InitSnippet(instructions), IsOk());
+  // Without callbacks Unicorn enforces the limit. Exactly at the limit is not
+  // an error.
+  ASSERT_THAT(tracer.Run(3), IsOk());
+  UContext<TypeParam> ucontext;
+  tracer.GetRegisters(ucontext);
+  CheckRegisters(ucontext);
+
+  // The same limit enforced by the instruction hook.
+  UnicornTracer<TypeParam> hooked_tracer;
+  ASSERT_THAT(hooked_tracer.InitSnippet(instructions), IsOk());
+  hooked_tracer.SetInstructionCallback(
+      [](UnicornTracer<TypeParam>* tracer, uint64_t address, uint32_t size) {});
+  EXPECT_THAT(hooked_tracer.Run(2),
+              StatusIs(absl::StatusCode::kInternal,
+                       HasSubstr("too many instructions")));
 }
 
 TYPED_TEST(UnicornTracerTest, InstructionCallback) {
@@ -103,6 +131,30 @@ TYPED_TEST(UnicornTracerTest, InstructionCallback) {
   CheckRegisters(ucontext);
 }
 
+TYPED_TEST(UnicornTracerTest, BlockCallback) {
+  std::string instructions =
+      GetTestSnippet<TypeParam>(TestSnapshot::kSetThreeRegisters);
+  UnicornTracer<TypeParam> tracer;
+  ASSERT_THAT(tracer.InitSnippet(instructions), IsOk());
+
+  uint64_t block_count = 0;
+  uint64_t block_bytes = 0;
+  tracer.SetBlockCallback(
+      [&](UnicornTracer<TypeParam>* tracer, uint64_t address, uint32_t size) {
+        block_count++;
+        block_bytes += size;
+      });
+
+  // The snippet is straight-line code, but Unicorn may split it into several
+  // blocks.
+  ASSERT_THAT(tracer.Run(3), IsOk());
+  EXPECT_GE(block_count, 1);
+  EXPECT_GE(block_bytes, instructions.size());
+  UContext<TypeParam> ucontext;
+  tracer.GetRegisters(ucontext);
+  CheckRegisters(ucontext);
+}
+
 TYPED_TEST(UnicornTracerTest, SkipInstruction) {
   std::string instructions =
       GetTestSnippet<TypeParam>(TestSnapshot::kSetThreeRegisters);
@@ -132,6 +184,140 @@ TYPED_TEST(UnicornTracerTest, SkipInstruction) {
   }
 }
 
+TYPED_TEST(UnicornTracerTest, Checkpoints) {
+  std::string instructions =
+      GetTestSnippet<TypeParam>(TestSnapshot::kSetThreeRegisters);
+  UnicornTracer<TypeParam> tracer;
+  ASSERT_THAT(tracer.InitSnippet(instructions), IsOk());
+  tracer.EnableCheckpoints();
+
+  // Save a checkpoint before each instruction.
+  std::vector<typename UnicornTracer<TypeParam>::Checkpoint> checkpoints;
+  bool record = true;
+  int skip = -1;
+  int instruction = 0;
+  tracer.SetInstructionCallback(
+      [&](UnicornTracer<TypeParam>* tracer, uint64_t address, uint32_t size) {
+        if (record) {
+          checkpoints.push_back(tracer->SaveCheckpoint());
+        } else if (instruction == skip) {
+          tracer->SetCurrentInstructionPointer(address + size);
+        }
+        instruction++;
+      });
+  ASSERT_THAT(tracer.Run(3), IsOk());
+  ASSERT_EQ(checkpoints.size(), 3);
+  record = false;
+  const uint32_t checksum = tracer.PartialChecksumOfMutableMemory();
+
+  // Resuming from any checkpoint gives the same result as running from the
+  // start, with or without skipping an instruction after the checkpoint.
+  for (int i = 0; i < 3; ++i) {
+    for (skip = -1; skip < 3; ++skip) {
+      if (skip >= 0 && skip < i) continue;
+      tracer.RestoreCheckpoint(checkpoints[i]);
+      instruction = i;
+      ASSERT_THAT(tracer.Resume(3), IsOk());
+      EXPECT_EQ(instruction, 3);
+      UContext<TypeParam> ucontext;
+      tracer.GetRegisters(ucontext);
+      CheckRegisters(ucontext, skip);
+      EXPECT_EQ(tracer.PartialChecksumOfMutableMemory(), checksum);
+    }
+  }
+
+  // The instructions executed before the checkpoint count towards the limit.
+  tracer.RestoreCheckpoint(checkpoints[1]);
+  EXPECT_THAT(tracer.Resume(2), Not(IsOk()));
+}
+
+TYPED_TEST(UnicornTracerTest, ReuseEngine) {
+  std::string instructions =
+      GetTestSnippet<TypeParam>(TestSnapshot::kSetThreeRegisters);
+  UnicornTracer<TypeParam> tracer;
+
+  // Alternate between snippets so that the code page is swapped. The
+  // registers would not be as expected if state leaked between runs.
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_THAT(tracer.InitSnippetReusingEngine(""), IsOk());
+    ASSERT_THAT(tracer.Run(0), IsOk());
+
+    ASSERT_THAT(tracer.InitSnippetReusingEngine(instructions), IsOk());
+    uint64_t instruction_count = 0;
+    tracer.SetInstructionCallback(
+        [&](UnicornTracer<TypeParam>* tracer, uint64_t address, uint32_t size) {
+          instruction_count++;
+        });
+    ASSERT_THAT(tracer.Run(3), IsOk());
+    EXPECT_EQ(instruction_count, 3);
+    UContext<TypeParam> ucontext;
+    tracer.GetRegisters(ucontext);
+    CheckRegisters(ucontext);
+
+    UnicornTracer<TypeParam> fresh_tracer;
+    ASSERT_THAT(fresh_tracer.InitSnippet(instructions), IsOk());
+    ASSERT_THAT(fresh_tracer.Run(3), IsOk());
+    EXPECT_EQ(tracer.PartialChecksumOfMutableMemory(),
+              fresh_tracer.PartialChecksumOfMutableMemory());
+  }
+}
+
+TYPED_TEST(UnicornTracerTest, ReuseEngineWithFixedCodeAddress) {
+  // Every snippet is placed at the start of a single-page code range.
+  FuzzingConfig<TypeParam> fuzzing_config = DEFAULT_FUZZING_CONFIG<TypeParam>;
+  fuzzing_config.code_range.num_bytes = 0x1000;
+
+  std::string instructions =
+      GetTestSnippet<TypeParam>(TestSnapshot::kSetThreeRegisters);
+  // Both test snippets use 4-byte instructions. Drop the last one.
+  std::string prefix = instructions.substr(0, instructions.size() - 4);
+  UnicornTracer<TypeParam> tracer;
+
+  // The registers would not be as expected if stale translations of the code
+  // were executed.
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_THAT(
+        tracer.InitSnippetReusingEngine(instructions, {}, fuzzing_config),
+        IsOk());
+    ASSERT_THAT(tracer.Run(3), IsOk());
+    UContext<TypeParam> ucontext;
+    tracer.GetRegisters(ucontext);
+    CheckRegisters(ucontext);
+
+    ASSERT_THAT(tracer.InitSnippetReusingEngine(prefix, {}, fuzzing_config),
+                IsOk());
+    ASSERT_THAT(tracer.Run(2), IsOk());
+    tracer.GetRegisters(ucontext);
+    CheckRegisters(ucontext, /*skip=*/2);
+  }
+}
+
+TYPED_TEST(UnicornTracerTest, HostMemory) {
+  const FuzzingConfig<TypeParam>& fuzzing_config =
+      DEFAULT_FUZZING_CONFIG<TypeParam>;
+  UnicornTracer<TypeParam> tracer;
+  for (int i = 0; i < 2; ++i) {
+    tracer.Destroy();
+    ASSERT_THAT(tracer.InitSnippet(GetTestSnippet<TypeParam>(
+                    TestSnapshot::kSetThreeRegisters)),
+                IsOk());
+    ASSERT_THAT(tracer.Run(3), IsOk());
+
+    // Data mappings are backed by host memory, code is not.
+    const uint64_t data1 = fuzzing_config.data1_range.start_address;
+    const uint8_t* host = tracer.HostMemory(data1, 16);
+    ASSERT_NE(host, nullptr);
+    EXPECT_EQ(host, tracer.HostMemory(data1 + 8, 8) - 8);
+    EXPECT_EQ(
+        tracer.HostMemory(fuzzing_config.code_range.start_address, 1),
+        nullptr);
+
+    uint64_t value;
+    tracer.ReadMemory(data1, &value, sizeof(value));
+    EXPECT_EQ(value, 0);
+  }
+}
+
 // Unicorn doesn't provide access to some registers, zero them out to make the
 // test work.
 template <typename Arch>
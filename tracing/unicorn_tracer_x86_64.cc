@@ -238,23 +238,23 @@ void UnicornTracer<X86_64>::SetupSnippetMemory(
               MemoryPermsToUnicorn(mm.perms()));
   }
 
+  // These mappings are currently not represented in the Snapshot.
+  MapHostMemory(fuzzing_config.data1_range.start_address,
+                fuzzing_config.data1_range.num_bytes,
+                UC_PROT_READ | UC_PROT_WRITE);
+  MapHostMemory(fuzzing_config.data2_range.start_address,
+                fuzzing_config.data2_range.num_bytes,
+                UC_PROT_READ | UC_PROT_WRITE);
+
   for (const Snapshot::MemoryBytes &mb : snapshot.memory_bytes()) {
     const Snapshot::ByteData &data = mb.byte_values();
-    UNICORN_CHECK(
-        uc_mem_write(uc_, mb.start_address(), data.data(), data.size()));
+    WriteMemory(mb.start_address(), data.data(), data.size());
   }
 
-  // These mappings are currently not represented in the Snapshot.
-  MapMemory(fuzzing_config.data1_range.start_address,
-            fuzzing_config.data1_range.num_bytes, UC_PROT_READ | UC_PROT_WRITE);
-  MapMemory(fuzzing_config.data2_range.start_address,
-            fuzzing_config.data2_range.num_bytes, UC_PROT_READ | UC_PROT_WRITE);
-
   // Simulate the effect RestoreUContext could have on the stack.
   std::string stack_bytes = RestoreUContextStackBytes(ucontext.gregs);
-  UNICORN_CHECK(
-      uc_mem_write(uc_, ucontext.gregs.GetStackPointer() - stack_bytes.size(),
-                   stack_bytes.data(), stack_bytes.size()));
+  WriteMemory(ucontext.gregs.GetStackPointer() - stack_bytes.size(),
+              stack_bytes.data(), stack_bytes.size());
 }
 
 template <>
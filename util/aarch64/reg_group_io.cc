@@ -35,4 +35,14 @@ RegisterChecksum<AArch64> GetRegisterGroupsChecksum(
   return {};
 }
 
+SaveRegisterGroupsFunction GetSaveRegisterGroupsFunction(
+    const RegisterGroupSet<AArch64>& groups) {
+  return &SaveRegisterGroupsToBuffer;
+}
+
+RegisterGroupsChecksumFunction GetRegisterGroupsChecksumFunction(
+    const RegisterGroupSet<AArch64>& groups) {
+  return &GetRegisterGroupsChecksum;
+}
+
 }  // namespace silifuzz
@@ -0,0 +1,79 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "./util/alias_table.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "./util/checks.h"
+
+namespace silifuzz {
+
+void AliasTable::Init(const uint64_t* weights, size_t n, Entry* entries,
+                      size_t* scratch) {
+  CHECK_GT(n, 0);
+  CHECK_LE(n, kMaxSize);
+  uint64_t total_weight = 0;
+  for (size_t i = 0; i < n; ++i) {
+    CHECK_LE(weights[i], kMaxWeight);
+    total_weight += weights[i];
+  }
+  CHECK_GT(total_weight, 0);
+
+  // Scale weights by n so that the average column holds exactly
+  // `total_weight`. This does not overflow because of the limits on weights
+  // and n. The scaled weights are kept in the thresholds while building.
+  // `scratch` holds indices of columns below the average at the front and
+  // columns at or above the average at the back.
+  size_t num_small = 0;
+  size_t large_begin = n;
+  for (size_t i = 0; i < n; ++i) {
+    entries[i].threshold = weights[i] * n;
+    entries[i].alias = i;
+    if (entries[i].threshold < total_weight) {
+      scratch[num_small++] = i;
+    } else {
+      scratch[--large_begin] = i;
+    }
+  }
+
+  // Fill each small column up to the average using a large one.
+  while (num_small > 0 && large_begin < n) {
+    const size_t small = scratch[--num_small];
+    const size_t large = scratch[large_begin];
+    entries[small].alias = large;
+    entries[large].threshold -= total_weight - entries[small].threshold;
+    if (entries[large].threshold < total_weight) {
+      // The large column becomes small. Move it from the back to the front.
+      ++large_begin;
+      scratch[num_small++] = large;
+    }
+  }
+
+  // The remaining columns are full up to rounding.
+  while (large_begin < n) {
+    entries[scratch[large_begin++]].threshold = total_weight;
+  }
+  while (num_small > 0) {
+    entries[scratch[--num_small]].threshold = total_weight;
+  }
+
+  entries_ = entries;
+  size_ = n;
+  total_weight_ = total_weight;
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,88 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef THIRD_PARTY_SILIFUZZ_UTIL_ALIAS_TABLE_H_
+#define THIRD_PARTY_SILIFUZZ_UTIL_ALIAS_TABLE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+namespace silifuzz {
+
+// Walker's alias method for sampling indices from a discrete distribution in
+// O(1) time per sample. The table is built in O(n) time.
+//
+// This class does not allocate memory and uses only integer arithmetic so that
+// it is usable in the nolibc runner. The caller provides storage for the
+// table entries.
+//
+// This class is thread-compatible.
+class AliasTable {
+ public:
+  // Largest supported weight.
+  static constexpr uint64_t kMaxWeight = uint64_t{1} << 32;
+
+  // Maximum number of weights.
+  static constexpr size_t kMaxSize = size_t{1} << 31;
+
+  // A column of the alias table.
+  struct Entry {
+    // The column's own index is picked if a uniform random number in
+    // [0, total weight) is below this threshold. Otherwise `alias` is picked.
+    uint64_t threshold;
+    size_t alias;
+  };
+
+  // Constructs an empty table. Sample() must not be called on it.
+  AliasTable() : entries_(nullptr), size_(0), total_weight_(0) {}
+
+  // Not copyable, does not own its storage.
+  AliasTable(const AliasTable&) = delete;
+  AliasTable& operator=(const AliasTable&) = delete;
+
+  // Builds the table for `weights[0..n)` in `entries[0..n)`. `scratch` must
+  // have room for n elements and is not used after Init() returns. Index i is
+  // sampled with probability weights[i] / (sum of all weights).
+  //
+  // REQUIRES: 0 < n <= kMaxSize.
+  // REQUIRES: all weights are <= kMaxWeight and at least one is non-zero.
+  void Init(const uint64_t* weights, size_t n, Entry* entries,
+            size_t* scratch);
+
+  // Returns a random index using `gen`.
+  // REQUIRES: Init() has been called.
+  template <typename URBG>
+  size_t Sample(URBG& gen) const {
+    std::uniform_int_distribution<size_t> column_dist(0, size_ - 1);
+    std::uniform_int_distribution<uint64_t> threshold_dist(0,
+                                                           total_weight_ - 1);
+    const size_t column = column_dist(gen);
+    return threshold_dist(gen) < entries_[column].threshold
+               ? column
+               : entries_[column].alias;
+  }
+
+  size_t size() const { return size_; }
+
+ private:
+  const Entry* entries_;
+  size_t size_;
+  uint64_t total_weight_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_UTIL_ALIAS_TABLE_H_
@@ -0,0 +1,96 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "./util/alias_table.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+
+#include "./util/checks.h"
+#include "./util/nolibc_gunit.h"
+
+// ========================================================================= //
+
+namespace silifuzz {
+namespace {
+
+TEST(AliasTable, Thresholds) {
+  constexpr size_t kNumWeights = 4;
+  const uint64_t weights[kNumWeights] = {1, 2, 3, 2};
+  AliasTable::Entry entries[kNumWeights];
+  size_t scratch[kNumWeights];
+  AliasTable table;
+  table.Init(weights, kNumWeights, entries, scratch);
+  CHECK_EQ(table.size(), kNumWeights);
+
+  // The probability mass of each index summed over all columns must be
+  // proportional to its weight.
+  constexpr uint64_t kTotalWeight = 8;
+  uint64_t mass[kNumWeights] = {};
+  for (size_t i = 0; i < kNumWeights; ++i) {
+    CHECK_LE(entries[i].threshold, kTotalWeight);
+    mass[i] += entries[i].threshold;
+    mass[entries[i].alias] += kTotalWeight - entries[i].threshold;
+  }
+  for (size_t i = 0; i < kNumWeights; ++i) {
+    CHECK_EQ(mass[i], weights[i] * kNumWeights);
+  }
+}
+
+TEST(AliasTable, Sample) {
+  constexpr size_t kNumWeights = 3;
+  const uint64_t weights[kNumWeights] = {0, 1, 3};
+  AliasTable::Entry entries[kNumWeights];
+  size_t scratch[kNumWeights];
+  AliasTable table;
+  table.Init(weights, kNumWeights, entries, scratch);
+
+  std::mt19937_64 gen(1);
+  constexpr size_t kNumSamples = 40000;
+  size_t counts[kNumWeights] = {};
+  for (size_t i = 0; i < kNumSamples; ++i) {
+    const size_t index = table.Sample(gen);
+    CHECK_LT(index, kNumWeights);
+    ++counts[index];
+  }
+  // Zero weight is never sampled. Others are sampled at about 1:3.
+  CHECK_EQ(counts[0], 0);
+  CHECK_GT(counts[1], kNumSamples / 4 - kNumSamples / 40);
+  CHECK_LT(counts[1], kNumSamples / 4 + kNumSamples / 40);
+}
+
+TEST(AliasTable, SingleWeight) {
+  const uint64_t weights[1] = {AliasTable::kMaxWeight};
+  AliasTable::Entry entries[1];
+  size_t scratch[1];
+  AliasTable table;
+  table.Init(weights, 1, entries, scratch);
+  std::mt19937_64 gen(1);
+  for (int i = 0; i < 10; ++i) {
+    CHECK_EQ(table.Sample(gen), 0);
+  }
+}
+
+}  // namespace
+}  // namespace silifuzz
+
+// ========================================================================= //
+
+NOLIBC_TEST_MAIN({
+  RUN_TEST(AliasTable, Thresholds);
+  RUN_TEST(AliasTable, Sample);
+  RUN_TEST(AliasTable, SingleWeight);
+})
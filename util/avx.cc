@@ -81,5 +81,17 @@ AVX512Info GetAVX512Info() {
 
 bool HasAVX512Registers() { return GetAVX512Info() == AVX512Info::kAvailable; }
 
+bool __attribute__((target("xsave"))) HasAVX2() {
+  if (!HasX86CPUFeature(X86CPUFeatures::kOSXSAVE) ||
+      !HasX86CPUFeature(X86CPUFeatures::kAVX) ||
+      !HasX86CPUFeature(X86CPUFeatures::kAVX2)) {
+    return false;
+  }
+
+  // Check that the OS has enabled xmm and ymm state.
+  constexpr uint64_t kXCR0_YMM_MASK = 0x6;  // 110b
+  return (_xgetbv(0) & kXCR0_YMM_MASK) == kXCR0_YMM_MASK;
+}
+
 }  // namespace silifuzz
 #endif  // __x86_64__
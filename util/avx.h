@@ -26,6 +26,11 @@ namespace silifuzz {
 // do so without function name mangling.
 extern "C" bool HasAVX512Registers();
 
+// Returns true iff AVX2 instruction set is supported and registers ymm0-ymm15
+// are accessible. The result is not cached, callers on hot paths should cache
+// it themselves.
+bool HasAVX2();
+
 // Clears AVX-512 registers zmm16 to zmm31 and also opmask registers k0 to k7.
 // This is part of AVX-512 state that can only be cleared using AVX-512F. The
 // lower 16 AVX registers can be cleared using AVX instruction vzeroupper.
@@ -88,6 +88,11 @@ TEST(AVX, HasAVX512Registers) {
   }
 }
 
+TEST(AVX, HasAVX2) {
+  // The compiler runtime also checks that the OS enables ymm state.
+  EXPECT_EQ(HasAVX2(), __builtin_cpu_supports("avx2") != 0);
+}
+
 TEST(AVX, ClearAVX512OnlyState) {
   // We can only run this test on machines with AVX-512F or above.
   // Treat testing as passing if we cannot run test.
@@ -19,6 +19,12 @@
 #include <cstdint>
 #include <cstring>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 namespace silifuzz {
 
 // WARNING: the functions in this file treat the contents of data structures as
@@ -143,6 +149,103 @@ void AccumulateToggle(const void* a, const void* b, void* zero_one,
   }
 }
 
+// Accumulates bit toggles for one vector's worth of bytes, the same way
+// AccumulateToggle() does. kToggleVectorSize is the number of bytes, or zero
+// if there is no vector implementation for this architecture.
+#if defined(__AVX2__)
+inline constexpr size_t kToggleVectorSize = sizeof(__m256i);
+
+inline void AccumulateToggleVector(const uint8_t* a, const uint8_t* b,
+                                   uint8_t* zero_one, uint8_t* one_zero) {
+  // Unaligned loads and stores may alias anything.
+  const __m256i a_vec = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+  const __m256i b_vec = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+  __m256i* zero_one_vec = reinterpret_cast<__m256i*>(zero_one);
+  __m256i* one_zero_vec = reinterpret_cast<__m256i*>(one_zero);
+  // _mm256_andnot_si256(x, y) is ~x & y.
+  _mm256_storeu_si256(zero_one_vec,
+                      _mm256_or_si256(_mm256_loadu_si256(zero_one_vec),
+                                      _mm256_andnot_si256(a_vec, b_vec)));
+  _mm256_storeu_si256(one_zero_vec,
+                      _mm256_or_si256(_mm256_loadu_si256(one_zero_vec),
+                                      _mm256_andnot_si256(b_vec, a_vec)));
+}
+#elif defined(__x86_64__)
+// SSE2 is part of the x86-64 baseline.
+inline constexpr size_t kToggleVectorSize = sizeof(__m128i);
+
+inline void AccumulateToggleVector(const uint8_t* a, const uint8_t* b,
+                                   uint8_t* zero_one, uint8_t* one_zero) {
+  // Unaligned loads and stores may alias anything.
+  const __m128i a_vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+  const __m128i b_vec = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+  __m128i* zero_one_vec = reinterpret_cast<__m128i*>(zero_one);
+  __m128i* one_zero_vec = reinterpret_cast<__m128i*>(one_zero);
+  // _mm_andnot_si128(x, y) is ~x & y.
+  _mm_storeu_si128(zero_one_vec, _mm_or_si128(_mm_loadu_si128(zero_one_vec),
+                                              _mm_andnot_si128(a_vec, b_vec)));
+  _mm_storeu_si128(one_zero_vec, _mm_or_si128(_mm_loadu_si128(one_zero_vec),
+                                              _mm_andnot_si128(b_vec, a_vec)));
+}
+#elif defined(__aarch64__)
+inline constexpr size_t kToggleVectorSize = sizeof(uint8x16_t);
+
+inline void AccumulateToggleVector(const uint8_t* a, const uint8_t* b,
+                                   uint8_t* zero_one, uint8_t* one_zero) {
+  const uint8x16_t a_vec = vld1q_u8(a);
+  const uint8x16_t b_vec = vld1q_u8(b);
+  // vbicq_u8(x, y) is x & ~y.
+  vst1q_u8(zero_one, vorrq_u8(vld1q_u8(zero_one), vbicq_u8(b_vec, a_vec)));
+  vst1q_u8(one_zero, vorrq_u8(vld1q_u8(one_zero), vbicq_u8(a_vec, b_vec)));
+}
+#else
+inline constexpr size_t kToggleVectorSize = 0;
+#endif
+
+// Like AccumulateToggle(), but processes as much of the N bytes as possible
+// with vector instructions. Worthwhile for large blocks of memory such as a
+// UContext, which holds the floating point and vector registers.
+template <size_t N>
+void AccumulateToggleVectorized(const void* a, const void* b, void* zero_one,
+                                void* one_zero) {
+  if constexpr (kToggleVectorSize == 0) {
+    AccumulateToggle<N>(a, b, zero_one, one_zero);
+  } else {
+    constexpr size_t kVectorBytes = N - N % kToggleVectorSize;
+    const uint8_t* a_bytes = reinterpret_cast<const uint8_t*>(a);
+    const uint8_t* b_bytes = reinterpret_cast<const uint8_t*>(b);
+    uint8_t* zero_one_bytes = reinterpret_cast<uint8_t*>(zero_one);
+    uint8_t* one_zero_bytes = reinterpret_cast<uint8_t*>(one_zero);
+    for (size_t i = 0; i < kVectorBytes; i += kToggleVectorSize) {
+      AccumulateToggleVector(&a_bytes[i], &b_bytes[i], &zero_one_bytes[i],
+                             &one_zero_bytes[i]);
+    }
+    if constexpr (kVectorBytes < N) {
+      AccumulateToggle<N - kVectorBytes>(
+          &a_bytes[kVectorBytes], &b_bytes[kVectorBytes],
+          &zero_one_bytes[kVectorBytes], &one_zero_bytes[kVectorBytes]);
+    }
+  }
+}
+
+// Calculate "result = a | b" for a N byte block of memory.
+template <size_t N>
+void BitOr(const void* a, const void* b, void* result) {
+  using Granularity = decltype(BestIntType<N>());
+  const uint8_t* a_bytes = reinterpret_cast<const uint8_t*>(a);
+  const uint8_t* b_bytes = reinterpret_cast<const uint8_t*>(b);
+  uint8_t* result_bytes = reinterpret_cast<uint8_t*>(result);
+
+  for (size_t i = 0; i < N; i += sizeof(Granularity)) {
+    Granularity a_tmp, b_tmp, result_tmp;
+    // See notes in the file on memcpy.
+    memcpy(&a_tmp, &a_bytes[i], sizeof(Granularity));
+    memcpy(&b_tmp, &b_bytes[i], sizeof(Granularity));
+    result_tmp = a_tmp | b_tmp;
+    memcpy(&result_bytes[i], &result_tmp, sizeof(Granularity));
+  }
+}
+
 // Invoke a callback for each bit in N bytes.
 template <size_t N, typename F>
 inline void ForEachBit(const void* bitmap, F f) {
@@ -241,7 +344,22 @@ void BitDiff(const T& a, const T& b, T& result) {
 // Assumes that struct padding of the inputs has been zeroed.
 template <typename T>
 void AccumulateToggle(const T& a, const T& b, T& zero_one, T& one_zero) {
-  bitops_internal::AccumulateToggle<sizeof(T)>(&a, &b, &zero_one, &one_zero);
+  // Below a few vectors' worth of data, the setup isn't worth it.
+  if constexpr (sizeof(T) >= 4 * bitops_internal::kToggleVectorSize &&
+                bitops_internal::kToggleVectorSize != 0) {
+    bitops_internal::AccumulateToggleVectorized<sizeof(T)>(&a, &b, &zero_one,
+                                                           &one_zero);
+  } else {
+    bitops_internal::AccumulateToggle<sizeof(T)>(&a, &b, &zero_one, &one_zero);
+  }
+}
+
+// Set `result` to the bits that are set in either `a` or `b`. `result` may be
+// the same object as `a` or `b`.
+// Assumes that struct padding of the inputs has been zeroed.
+template <typename T>
+void BitOr(const T& a, const T& b, T& result) {
+  bitops_internal::BitOr<sizeof(T)>(&a, &b, &result);
 }
 
 // Note: the following functions invoke callbacks where one of the arguments is
@@ -14,7 +14,9 @@
 
 #include "./util/bitops.h"
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #include "gtest/gtest.h"
 
@@ -128,6 +130,41 @@ TYPED_TEST(Bitops, Toggle) {
   EXPECT_EQ(baseline, PopCount(one_zero));
 }
 
+TYPED_TEST(Bitops, Or) {
+  TypeParam a, b, result;
+  memset(&a, 0x0f, sizeof(a));
+  memset(&b, 0x3c, sizeof(b));
+  BitOr(a, b, result);
+  EXPECT_EQ(6 * sizeof(result), PopCount(result));
+
+  // The result may alias an input.
+  ClearBits(b);
+  memset(&b, 0xf0, 1);
+  BitOr(a, b, a);
+  EXPECT_EQ(4 * sizeof(a) + 4, PopCount(a));
+}
+
+// A size that isn't a multiple of any vector size.
+struct OddStruct {
+  uint8_t data[1027];
+};
+
+TEST(Bitops, ToggleMatchesScalar) {
+  OddStruct a, b;
+  for (size_t i = 0; i < sizeof(a.data); ++i) {
+    a.data[i] = i * 37;
+    b.data[i] = i * 101 + 7;
+  }
+  OddStruct zero_one, one_zero;
+  memset(&zero_one, 0x01, sizeof(zero_one));
+  memset(&one_zero, 0x80, sizeof(one_zero));
+  AccumulateToggle(a, b, zero_one, one_zero);
+  for (size_t i = 0; i < sizeof(a.data); ++i) {
+    EXPECT_EQ(zero_one.data[i], 0x01 | (~a.data[i] & b.data[i])) << i;
+    EXPECT_EQ(one_zero.data[i], 0x80 | (a.data[i] & ~b.data[i])) << i;
+  }
+}
+
 TYPED_TEST(Bitops, ForEachBit) {
   TypeParam data;
   memset(&data, 0x20, sizeof(data));
@@ -109,10 +109,23 @@
 
 // VLOG_INFO() is like LOG_INFO() but modulated by a verbosity level.
 // VLOG_IS_ON() is for explicit VLOG() level testing.
-#if defined(SILIFUZZ_BUILD_FOR_NOLIBC)
-#define VLOG_IS_ON(level) ((level) <= ::silifuzz::checks_internal::vlog_level)
+//
+// A build can define SILIFUZZ_MAX_VLOG_LEVEL to compile out VLOG_INFO() with
+// a constant level above it, arguments included, regardless of the verbosity
+// set at run time.
+#ifndef SILIFUZZ_MAX_VLOG_LEVEL
+#define SILIFUZZ_MAX_VLOG_LEVEL 0x7fffffff
 #endif
+#if defined(SILIFUZZ_BUILD_FOR_NOLIBC)
+#define VLOG_IS_ON(level)                  \
+  ((level) <= SILIFUZZ_MAX_VLOG_LEVEL &&   \
+   (level) <= ::silifuzz::checks_internal::vlog_level)
 #define VLOG_INFO(level, ...) LOG_INFO_IF(VLOG_IS_ON(level), __VA_ARGS__)
+#else
+#define VLOG_INFO(level, ...)                                         \
+  LOG_INFO_IF((level) <= SILIFUZZ_MAX_VLOG_LEVEL && VLOG_IS_ON(level), \
+              __VA_ARGS__)
+#endif
 
 // Conditional logging variants.
 #define LOG_ERROR_IF(cond, ...)                           \
@@ -15,6 +15,8 @@
 #ifndef THIRD_PARTY_SILIFUZZ_UTIL_CPU_FEATURES_H_
 #define THIRD_PARTY_SILIFUZZ_UTIL_CPU_FEATURES_H_
 
+#include <cstdint>
+
 #include "./util/itoa.h"
 
 namespace silifuzz {
@@ -25,8 +27,11 @@ enum class X86CPUFeatures {
   kBegin = 0,
   kAMX_TILE = kBegin,  // for accessing tile and tileconfig registers.
   kAVX,                // for accessing ymm registers.
+  kAVX2,               // for 256-bit integer vector instructions.
   kAVX512BW,           // for accessing upper 48 bits of opmask registers.
   kAVX512F,  // for accessing zmm and lower 16 bits of opmask registers.
+  kERMS,     // Enhanced REP MOVSB/STOSB.
+  kFSRM,     // Fast short REP MOVSB.
   kOSXSAVE,  // OS provides processor extended state management.
   kSSE,      // for accessing SSE registers.
   kSSE4_2,   // for CRC32 instructions.
@@ -50,6 +55,15 @@ extern const char*
 // may return cached information.
 bool HasX86CPUFeature(X86CPUFeatures feature);
 
+// Returns the features of the current CPU in an opaque non-zero encoding that
+// can be passed to SetX86CPUFeatureBits(), e.g. in a child process.
+uint64_t GetX86CPUFeatureBits();
+
+// Makes HasX86CPUFeature() report the features in `bits`, which were returned
+// by GetX86CPUFeatureBits() on the same host, instead of probing the CPU with
+// CPUID. Does nothing if the features are already known.
+void SetX86CPUFeatureBits(uint64_t bits);
+
 #endif  // __x86_64__
 
 }  // namespace silifuzz
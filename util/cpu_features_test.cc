@@ -25,8 +25,11 @@ TEST(X86CPUFeatures, EnumStr) {
 #define CHECK_ENUM(name) EXPECT_STREQ(EnumStr(X86CPUFeatures::k##name), #name);
   CHECK_ENUM(AMX_TILE);
   CHECK_ENUM(AVX);
+  CHECK_ENUM(AVX2);
   CHECK_ENUM(AVX512BW);
   CHECK_ENUM(AVX512F);
+  CHECK_ENUM(ERMS);
+  CHECK_ENUM(FSRM);
   CHECK_ENUM(OSXSAVE);
   CHECK_ENUM(SSE);
   CHECK_ENUM(SSE4_2);
@@ -49,6 +49,116 @@ uint32_t crc32c_unaccelerated(uint32_t seed, const uint8_t* data, size_t n);
 
 namespace {
 
+// Bit-reflected CRC-32C polynomial.
+constexpr uint32_t kCrc32cPolynomial = 0x82F63B78;
+
+// Returns a(x) * b(x) modulo the CRC-32C polynomial in the bit-reflected
+// representation used by CRC-32C, in which x^0 is 1 << 31.
+// REQUIRES: a != 0.
+constexpr uint32_t MultiplyModPolynomial(uint32_t a, uint32_t b) {
+  uint32_t m = 1U << 31;
+  uint32_t product = 0;
+  for (;;) {
+    if (a & m) {
+      product ^= b;
+      if ((a & (m - 1)) == 0) break;
+    }
+    m >>= 1;
+    b = (b & 1) ? (b >> 1) ^ kCrc32cPolynomial : b >> 1;
+  }
+  return product;
+}
+
+// Returns x^(8 * n) modulo the CRC-32C polynomial. Multiplying the CRC of
+// some data by this appends n zero bytes to the data as far as the CRC goes.
+constexpr uint32_t ZeroBytesOperator(size_t n) {
+  uint32_t result = 1U << 31;  // x^0
+  uint32_t square = 1U << 23;  // x^8, i.e. x^(2^3)
+  for (; n != 0; n >>= 1) {
+    if (n & 1) result = MultiplyModPolynomial(square, result);
+    square = MultiplyModPolynomial(square, square);
+  }
+  return result;
+}
+
+// Large inputs are processed in blocks of kInterleavedLanes lanes of equal
+// size. CRC32C instructions on both x86_64 and aarch64 have a latency of
+// several cycles but a throughput of one per cycle, so computing independent
+// CRCs of the lanes in an interleaved loop and combining them afterwards is
+// about three times as fast as a single dependency chain on one core.
+//
+// Two lane sizes are used. Big lanes amortize the combination cost over bulk
+// data. Small lanes cover inputs of a few KB like the saved register groups
+// checksummed at every snap exit, for which combining once per 384 bytes
+// is still cheap compared to the 48 dependent CRC32C instructions it
+// replaces.
+constexpr size_t kInterleavedLanes = 3;
+constexpr size_t kBigInterleavedLaneSize = 4096;
+constexpr size_t kSmallInterleavedLaneSize = 128;
+
+// Lookup tables for multiplying a CRC by a constant operator one byte at a
+// time, which is much faster than MultiplyModPolynomial(). Multiplication
+// distributes over XOR, so the product is the XOR of the entries of the four
+// bytes of the CRC.
+struct MultiplicationTable {
+  uint32_t entries[4][256];
+};
+
+constexpr MultiplicationTable MakeMultiplicationTable(uint32_t op) {
+  MultiplicationTable table{};
+  for (size_t i = 0; i < 4; ++i) {
+    for (uint32_t byte = 0; byte < 256; ++byte) {
+      table.entries[i][byte] = MultiplyModPolynomial(op, byte << (8 * i));
+    }
+  }
+  return table;
+}
+
+// Appends kLaneSize zero bytes to a CRC.
+template <size_t kLaneSize>
+constexpr MultiplicationTable kInterleavedLaneTable =
+    MakeMultiplicationTable(ZeroBytesOperator(kLaneSize));
+
+template <size_t kLaneSize>
+inline uint32_t ShiftByInterleavedLane(uint32_t crc) {
+  const MultiplicationTable& table = kInterleavedLaneTable<kLaneSize>;
+  return table.entries[0][crc & 0xff] ^ table.entries[1][(crc >> 8) & 0xff] ^
+         table.entries[2][(crc >> 16) & 0xff] ^ table.entries[3][crc >> 24];
+}
+
+// Updates the intermediate CRC `value` with as many blocks of
+// kInterleavedLanes lanes of kLaneSize bytes as there are in the `n` bytes
+// at `data`. Advances `data` and decrements `n` past the consumed blocks.
+// REQUIRES: `data` is 64-bit aligned.
+template <size_t kLaneSize, typename CRC32CFunctions>
+SSE4_2_TARGET_ATTRIBUTE inline uint32_t crc32c_interleaved_blocks(
+    uint32_t value, const uint8_t*& data, size_t& n) {
+  static_assert(kInterleavedLanes == 3);
+  static_assert(kLaneSize % sizeof(uint64_t) == 0);
+  constexpr size_t kLaneWords = kLaneSize / sizeof(uint64_t);
+  while (n >= kInterleavedLanes * kLaneSize) {
+    const uint64_t* lane0 = reinterpret_cast<const uint64_t*>(data);
+    const uint64_t* lane1 = lane0 + kLaneWords;
+    const uint64_t* lane2 = lane1 + kLaneWords;
+    // Lanes 1 and 2 are computed as CRCs with seed 0.
+    uint32_t value1 = 0xffffffffU;
+    uint32_t value2 = 0xffffffffU;
+    for (size_t i = 0; i < kLaneWords; ++i) {
+      value = CRC32CFunctions::crc32c_uint64(value, lane0[i]);
+      value1 = CRC32CFunctions::crc32c_uint64(value1, lane1[i]);
+      value2 = CRC32CFunctions::crc32c_uint64(value2, lane2[i]);
+    }
+    // CRC(AB) = CRC(A) * x^(8 * |B|) + CRC(B) for CRCs of the final value.
+    uint32_t crc = value ^ 0xffffffffU;
+    crc = ShiftByInterleavedLane<kLaneSize>(crc) ^ value1 ^ 0xffffffffU;
+    crc = ShiftByInterleavedLane<kLaneSize>(crc) ^ value2 ^ 0xffffffffU;
+    value = crc ^ 0xffffffffU;
+    n -= kInterleavedLanes * kLaneSize;
+    data += kInterleavedLanes * kLaneSize;
+  }
+  return value;
+}
+
 // Compute CRC32C using hardware acceleration. This is optimized for the
 // case when both 'data' and 'n' are 64-bit aligned.
 template <typename CRC32CFunctions>
@@ -72,6 +182,13 @@ SSE4_2_TARGET_ATTRIBUTE uint32_t crc32c_accelerated_impl(uint32_t seed,
     data += bytes;
   }
 
+  // Process large inputs in interleaved lanes. See kInterleavedLanes above.
+  value = crc32c_interleaved_blocks<kBigInterleavedLaneSize, CRC32CFunctions>(
+      value, data, n);
+  value =
+      crc32c_interleaved_blocks<kSmallInterleavedLaneSize, CRC32CFunctions>(
+          value, data, n);
+
   while (n > sizeof(uint64_t)) {
     value = CRC32CFunctions::crc32c_uint64(
         value, *reinterpret_cast<const uint64_t*>(data));
@@ -242,4 +359,10 @@ uint32_t crc32c_unaccelerated(uint32_t seed, const uint8_t* data, size_t n) {
 
 }  // namespace internal
 
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2) {
+  return internal::MultiplyModPolynomial(internal::ZeroBytesOperator(len2),
+                                         crc1) ^
+         crc2;
+}
+
 }  // namespace silifuzz
@@ -45,6 +45,11 @@ inline uint32_t crc32c(uint32_t seed, const uint8_t* data, size_t n) {
                                                                        data, n);
 }
 
+// Returns the CRC32C checksum of the concatenation of two blocks of data A and
+// B, given `crc1` of A, `crc2` of B and `len2` the size of B in bytes. This
+// allows checksums of independent chunks of data to be computed in parallel.
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, size_t len2);
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_UTIL_CRC32C_H_
@@ -64,6 +64,50 @@ TEST(crc32c, IncrementalUpdateUnaccelerated) {
   IncrementalUpdateTestImpl<internal::crc32c_unaccelerated>();
 }
 
+// Fills `buffer` of `n` bytes with a deterministic pseudo-random pattern.
+void FillBuffer(uint8_t* buffer, size_t n) {
+  uint32_t x = 1;
+  for (size_t i = 0; i < n; ++i) {
+    x = x * 1103515245 + 12345;
+    buffer[i] = x >> 16;
+  }
+}
+
+// Large enough to cover interleaved processing in the accelerated version.
+constexpr size_t kLargeInputSize = 64 * 1024;
+alignas(sizeof(uint64_t)) uint8_t large_input[kLargeInputSize];
+
+TEST(crc32c, LargeInput) {
+  FillBuffer(large_input, kLargeInputSize);
+  // Try sizes around the block sizes of the interleaved loops, the sizes of
+  // the checksummed x86_64 register groups and different alignments.
+  constexpr size_t kSizes[] = {0,     1,     383,   384,   385,
+                               512,   2048,  2112,  4095,  12287,
+                               12288, 12289, 12672, 3 * 12288,
+                               40000, kLargeInputSize - 8};
+  for (size_t size : kSizes) {
+    for (size_t offset = 0; offset < sizeof(uint64_t); ++offset) {
+      CHECK_EQ(crc32c(0, large_input + offset, size),
+               internal::crc32c_unaccelerated(0, large_input + offset, size));
+    }
+  }
+}
+
+TEST(crc32c, Combine) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(kInput);
+  const size_t n = sizeof(kInput) - 1;
+  for (size_t i = 0; i <= n; ++i) {
+    CHECK_EQ(crc32c_combine(crc32c(0, p, i), crc32c(0, p + i, n - i), n - i),
+             kInputChecksum);
+  }
+
+  FillBuffer(large_input, kLargeInputSize);
+  const size_t half = kLargeInputSize / 2;
+  CHECK_EQ(crc32c_combine(crc32c(0, large_input, half),
+                          crc32c(0, large_input + half, half), half),
+           crc32c(0, large_input, kLargeInputSize));
+}
+
 }  // namespace
 }  // namespace silifuzz
 
@@ -74,4 +118,6 @@ NOLIBC_TEST_MAIN({
   RUN_TEST(crc32c, BasicTestUnaccelerated);
   RUN_TEST(crc32c, IncrementalUpdateBestCrcImpl);
   RUN_TEST(crc32c, IncrementalUpdateUnaccelerated);
+  RUN_TEST(crc32c, LargeInput);
+  RUN_TEST(crc32c, Combine);
 })
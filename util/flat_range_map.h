@@ -0,0 +1,179 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_UTIL_FLAT_RANGE_MAP_H_
+#define THIRD_PARTY_SILIFUZZ_UTIL_FLAT_RANGE_MAP_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "./util/checks.h"
+#include "./util/range_map.h"
+
+namespace silifuzz {
+
+// FlatRangeMap<Key, Value, Methods> is an immutable snapshot of a
+// RangeMap<Key, Value, Methods> with the same query API: LowerBound(),
+// UpperBound(), Find(), FindAt() and Covers().
+//
+// The ranges are kept in sorted contiguous arrays and looked up by binary
+// search over the range starts, which avoids the pointer chasing of the
+// std::map behind RangeMap. Use it for maps that are built once and then
+// queried many times.
+//
+// This class is thread-compatible.
+template <typename Key, typename Value, typename MethodsArg>
+class FlatRangeMap {
+ public:
+  using Methods = MethodsArg;
+  using SourceMap = RangeMap<Key, Value, Methods>;
+  using size_type = size_t;
+
+  // Iterates over the ranges in Methods::Compare() order. Has the accessors
+  // of RangeMap<>::const_iterator.
+  class const_iterator {
+   public:
+    const_iterator() : map_(nullptr), index_(0) {}
+
+    const Key& start() const { return map_->starts_[index_]; }
+    const Key& limit() const { return map_->limits_[index_]; }
+    const Value& value() const { return map_->values_[index_]; }
+
+    const_iterator& operator++() {
+      ++index_;
+      return *this;
+    }
+    const_iterator& operator--() {
+      --index_;
+      return *this;
+    }
+    bool operator==(const const_iterator& x) const {
+      return map_ == x.map_ && index_ == x.index_;
+    }
+    bool operator!=(const const_iterator& x) const { return !(*this == x); }
+
+   private:
+    friend class FlatRangeMap;
+    const_iterator(const FlatRangeMap* map, size_t index)
+        : map_(map), index_(index) {}
+
+    const FlatRangeMap* map_;
+    size_t index_;
+  };
+
+  // A [,) range of iterators as in RangeMap<>.
+  using ConstIteratorRange = std::pair<const_iterator, const_iterator>;
+
+  FlatRangeMap() = default;
+
+  // Freezes the current contents of `range_map`.
+  explicit FlatRangeMap(const SourceMap& range_map) {
+    starts_.reserve(range_map.size());
+    limits_.reserve(range_map.size());
+    values_.reserve(range_map.size());
+    for (auto i = range_map.begin(); i != range_map.end(); ++i) {
+      starts_.push_back(i.start());
+      limits_.push_back(i.limit());
+      values_.push_back(i.value());
+    }
+  }
+
+  // Copyable and movable.
+  FlatRangeMap(const FlatRangeMap&) = default;
+  FlatRangeMap(FlatRangeMap&&) = default;
+  FlatRangeMap& operator=(const FlatRangeMap&) = default;
+  FlatRangeMap& operator=(FlatRangeMap&&) = default;
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, size()); }
+
+  size_type size() const { return starts_.size(); }
+  bool empty() const { return starts_.empty(); }
+
+  bool operator==(const FlatRangeMap& x) const {
+    return starts_ == x.starts_ && limits_ == x.limits_ &&
+           values_ == x.values_;
+  }
+
+  // Same as RangeMap<>::LowerBound(): the first range that overlaps or
+  // starts after `k`.
+  const_iterator LowerBound(const Key& k) const {
+    // Ranges do not overlap, so limits are sorted too.
+    auto it = std::upper_bound(limits_.begin(), limits_.end(), k, KeyLess);
+    return const_iterator(this, it - limits_.begin());
+  }
+
+  // Same as RangeMap<>::UpperBound(): the range after the last range that
+  // overlaps or ends before `k`.
+  const_iterator UpperBound(const Key& k) const {
+    auto it = std::lower_bound(starts_.begin(), starts_.end(), k, KeyLess);
+    return const_iterator(this, it - starts_.begin());
+  }
+
+  // Same as RangeMap<>::Find().
+  // REQUIRES: start <= limit (wrt Methods::Compare)
+  ConstIteratorRange Find(const Key& start, const Key& limit) const {
+    int cmp = Methods::Compare(start, limit);
+    CHECK_LE(cmp, 0);
+    if (cmp >= 0) return {end(), end()};
+    return {LowerBound(start), UpperBound(limit)};
+  }
+
+  ConstIteratorRange FindAll() const { return {begin(), end()}; }
+
+  // Same as RangeMap<>::FindAt(): the range containing `key` or end().
+  const_iterator FindAt(const Key& key) const {
+    auto it = std::upper_bound(starts_.begin(), starts_.end(), key, KeyLess);
+    if (it == starts_.begin()) return end();
+    const size_t index = it - starts_.begin() - 1;
+    if (Methods::Compare(limits_[index], key) <= 0) return end();
+    return const_iterator(this, index);
+  }
+
+  // Same as RangeMap<>::Covers().
+  bool Covers(const Key& start, const Key& limit,
+              std::function<bool(const_iterator i)> accumulator) const {
+    ConstIteratorRange range = Find(start, limit);
+    if (range.first == range.second) {
+      return Methods::Compare(start, limit) == 0;
+    }
+    bool result = true;
+    Key prev = start;
+    for (const_iterator i = range.first; i != range.second; ++i) {
+      if (Methods::Compare(i.start(), prev) > 0) result = false;  // gap
+      if (!accumulator(i)) result = false;
+      prev = i.limit();
+    }
+    if (Methods::Compare(prev, limit) < 0) result = false;  // gap
+    return result;
+  }
+
+ private:
+  static bool KeyLess(const Key& x, const Key& y) {
+    return Methods::Compare(x, y) < 0;
+  }
+
+  // The ranges in Methods::Compare() order, as parallel arrays so that the
+  // binary searches only touch the keys they compare.
+  std::vector<Key> starts_;
+  std::vector<Key> limits_;
+  std::vector<Value> values_;
+};
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_UTIL_FLAT_RANGE_MAP_H_
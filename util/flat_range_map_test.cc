@@ -0,0 +1,167 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./util/flat_range_map.h"
+
+#include <cstdint>
+#include <utility>
+
+#include "gtest/gtest.h"
+#include "absl/random/random.h"
+#include "./util/range_map.h"
+
+namespace silifuzz {
+namespace {
+
+// Sums the values of overlapping ranges and merges equal neighbors.
+class IntMethods {
+ public:
+  typedef int Value;
+  typedef int32_t Key;
+  typedef int Size;
+
+  static int Compare(const Key& x, const Key& y) { return x - y; }
+
+  static Size Usage(const std::pair<const std::pair<Key, Key>, Value>* range) {
+    return range->first.second - range->first.first;
+  }
+
+  static const Value& Slice(const Key& start, const Key& limit, const Value& v,
+                            const Key& s, const Key& l) {
+    return v;
+  }
+
+  static bool AddTo(Value* dest, const Value& v, bool* empty) {
+    *dest += v;
+    *empty = *dest == 0;
+    return v != 0;
+  }
+
+  static bool RemoveFrom(Value* dest, const Value& v, bool* empty) {
+    *dest -= v;
+    *empty = *dest == 0;
+    return true;
+  }
+
+  static bool CanMerge(const Value& v1, const Value& v2) { return v1 == v2; }
+
+  static void Merge(Value* dest, const Value& v) {}
+
+  static void MakeIntersection(Value* dest, const Value& v1, const Value& v2,
+                               bool* empty) {
+    *dest = v1 < v2 ? v1 : v2;
+    *empty = *dest == 0;
+  }
+
+  static void MakeDifference(Value* dest, const Value& v1, const Value& v2,
+                             bool* empty) {
+    *dest = v1 - v2;
+    *empty = *dest == 0;
+  }
+};
+
+typedef RangeMap<IntMethods::Key, IntMethods::Value, IntMethods> IntRangeMap;
+typedef FlatRangeMap<IntMethods::Key, IntMethods::Value, IntMethods>
+    IntFlatRangeMap;
+
+// Returns the start of `i` or -1 for end().
+template <typename Map>
+int StartOrEnd(const Map& map, typename Map::const_iterator i) {
+  return i == map.end() ? -1 : i.start();
+}
+
+TEST(FlatRangeMap, Empty) {
+  IntFlatRangeMap map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.begin(), map.end());
+  EXPECT_EQ(map.FindAt(0), map.end());
+  EXPECT_TRUE(map.Covers(3, 3, [](auto) { return true; }));
+  EXPECT_FALSE(map.Covers(3, 4, [](auto) { return true; }));
+}
+
+TEST(FlatRangeMap, Freeze) {
+  IntRangeMap range_map;
+  range_map.Add(10, 20, 1);
+  range_map.Add(15, 30, 1);
+  range_map.Add(40, 50, 3);
+  IntFlatRangeMap map(range_map);
+  ASSERT_EQ(map.size(), range_map.size());
+  auto j = range_map.begin();
+  for (auto i = map.begin(); i != map.end(); ++i, ++j) {
+    EXPECT_EQ(i.start(), j.start());
+    EXPECT_EQ(i.limit(), j.limit());
+    EXPECT_EQ(i.value(), j.value());
+  }
+  EXPECT_EQ(map.FindAt(9), map.end());
+  EXPECT_EQ(map.FindAt(10).value(), 1);
+  EXPECT_EQ(map.FindAt(15).value(), 2);
+  EXPECT_EQ(map.FindAt(29).value(), 1);
+  EXPECT_EQ(map.FindAt(30), map.end());
+  EXPECT_EQ(map.FindAt(49).value(), 3);
+  EXPECT_TRUE(map.Covers(10, 30, [](auto) { return true; }));
+  EXPECT_FALSE(map.Covers(10, 41, [](auto) { return true; }));
+  EXPECT_EQ(map, IntFlatRangeMap(range_map));
+}
+
+// Checks every query against RangeMap on random maps.
+TEST(FlatRangeMap, MatchesRangeMap) {
+  absl::BitGen gen;
+  constexpr int kMaxKey = 200;
+  for (int iter = 0; iter < 100; ++iter) {
+    IntRangeMap range_map;
+    const int num_ranges = absl::Uniform(gen, 0, 20);
+    for (int i = 0; i < num_ranges; ++i) {
+      const int start = absl::Uniform(gen, 0, kMaxKey);
+      const int limit = absl::Uniform(gen, start + 1, kMaxKey + 1);
+      range_map.Add(start, limit, absl::Uniform(gen, 1, 4));
+    }
+    const IntFlatRangeMap map(range_map);
+    ASSERT_EQ(map.size(), range_map.size());
+
+    for (int k = -1; k <= kMaxKey + 1; ++k) {
+      SCOPED_TRACE(k);
+      EXPECT_EQ(StartOrEnd(map, map.LowerBound(k)),
+                StartOrEnd(range_map, range_map.LowerBound(k)));
+      EXPECT_EQ(StartOrEnd(map, map.UpperBound(k)),
+                StartOrEnd(range_map, range_map.UpperBound(k)));
+      EXPECT_EQ(StartOrEnd(map, map.FindAt(k)),
+                StartOrEnd(range_map, range_map.FindAt(k)));
+    }
+
+    for (int i = 0; i < 100; ++i) {
+      const int start = absl::Uniform(gen, -1, kMaxKey + 2);
+      const int limit = absl::Uniform(gen, start, kMaxKey + 2);
+      SCOPED_TRACE(start);
+      SCOPED_TRACE(limit);
+      auto flat_range = map.Find(start, limit);
+      auto range = range_map.Find(start, limit);
+      EXPECT_EQ(StartOrEnd(map, flat_range.first),
+                StartOrEnd(range_map, range.first));
+      EXPECT_EQ(StartOrEnd(map, flat_range.second),
+                StartOrEnd(range_map, range.second));
+      const int value = absl::Uniform(gen, 1, 4);
+      EXPECT_EQ(map.Covers(start, limit,
+                           [value](IntFlatRangeMap::const_iterator i) {
+                             return i.value() >= value;
+                           }),
+                range_map.Covers(start, limit,
+                                 [value](IntRangeMap::const_iterator i) {
+                                   return i.value() >= value;
+                                 }));
+    }
+  }
+}
+
+}  // namespace
+}  // namespace silifuzz
@@ -14,7 +14,12 @@
 
 #include "./util/line_printer.h"
 
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
 #include <cstdio>
+#include <memory>
 #include <string>
 
 #include "absl/strings/str_cat.h"
@@ -55,6 +60,63 @@ LinePrinter::Printer LinePrinter::StringPrinter(std::string* dest) {
 
 // ----------------------------------------------------------------------- //
 
+namespace {
+
+// The output buffer shared by all copies of a FdPrinter().
+class FdBuffer {
+ public:
+  FdBuffer(int fd, size_t capacity) : fd_(fd), capacity_(capacity) {
+    data_.reserve(capacity);
+  }
+  ~FdBuffer() { Flush(); }
+
+  // Not copyable or movable (no need).
+  FdBuffer(const FdBuffer&) = delete;
+  FdBuffer& operator=(const FdBuffer&) = delete;
+
+  void AppendLine(absl::string_view text_line) {
+    if (data_.size() + text_line.size() + 1 > capacity_) Flush();
+    if (text_line.size() + 1 > capacity_) {
+      // Too long to buffer.
+      Write(text_line);
+      Write("\n");
+      return;
+    }
+    data_.append(text_line);
+    data_.push_back('\n');
+  }
+
+  void Flush() {
+    Write(data_);
+    data_.clear();
+  }
+
+ private:
+  void Write(absl::string_view data) {
+    while (!data.empty()) {
+      ssize_t bytes_written = write(fd_, data.data(), data.size());
+      if (bytes_written < 0) {
+        if (errno == EINTR) continue;
+        return;
+      }
+      data.remove_prefix(bytes_written);
+    }
+  }
+
+  const int fd_;
+  const size_t capacity_;
+  std::string data_;
+};
+
+}  // namespace
+
+LinePrinter::Printer LinePrinter::FdPrinter(int fd, size_t buffer_size) {
+  auto buffer = std::make_shared<FdBuffer>(fd, buffer_size);
+  return [buffer](absl::string_view text_line) {
+    buffer->AppendLine(text_line);
+  };
+}
+
 LinePrinter::LinePrinter(const Printer& line_printer, int initial_indent)
     : line_printer_(line_printer),
       indent_str_(DCHECK_AND_USE(initial_indent >= 0, initial_indent), ' ') {}
@@ -15,6 +15,7 @@
 #ifndef THIRD_PARTY_SILIFUZZ_UTIL_LINE_PRINTER_H_
 #define THIRD_PARTY_SILIFUZZ_UTIL_LINE_PRINTER_H_
 
+#include <cstddef>
 #include <functional>
 #include <string>
 #include <utility>
@@ -41,6 +42,15 @@ class LinePrinter {
   static void LogErrorPrinter(absl::string_view text_line);
   static Printer StringPrinter(std::string* dest);
 
+  // Returns a `Printer` that writes lines to `fd` through a buffer of at most
+  // `buffer_size` bytes. The buffer is flushed when it is full and when the
+  // last copy of the `Printer`, e.g. the one in a LinePrinter, is destroyed.
+  // Unlike StdErrPrinter(), this does not write every line separately, nor
+  // does it hold the whole output like StringPrinter(). Write errors are
+  // ignored.
+  static constexpr size_t kDefaultFdBufferSize = 64 << 10;
+  static Printer FdPrinter(int fd, size_t buffer_size = kDefaultFdBufferSize);
+
   // *this will print via line_printer.
   explicit LinePrinter(const Printer& line_printer, int initial_indent = 0);
 
@@ -0,0 +1,203 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./util/lz4_block.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "./util/mem_util.h"
+
+namespace silifuzz {
+
+namespace {
+
+// Constants of the LZ4 block format.
+constexpr size_t kMinMatch = 4;
+// The last kLastLiterals bytes of a block are always literals.
+constexpr size_t kLastLiterals = 5;
+// The last match must start at least kMatchFindLimit bytes before the end.
+constexpr size_t kMatchFindLimit = 12;
+constexpr size_t kMaxOffset = 65535;
+// Length values in a token at or above this are continued in extra bytes.
+constexpr size_t kRunMask = 15;
+
+// Number of bits in compressor hash table indices.
+constexpr int kHashLog = 12;
+
+inline uint32_t Read32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | static_cast<uint32_t>(p[1]) << 8 |
+         static_cast<uint32_t>(p[2]) << 16 | static_cast<uint32_t>(p[3]) << 24;
+}
+
+inline uint32_t Hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashLog);
+}
+
+// Appends LZ4 output to a bounded buffer.
+class Lz4Writer {
+ public:
+  Lz4Writer(uint8_t* dst, size_t capacity)
+      : begin_(dst), current_(dst), limit_(dst + capacity) {}
+
+  // Returns the number of bytes written or 0 if the output did not fit.
+  size_t size() const { return ok_ ? current_ - begin_ : 0; }
+
+  // Writes a sequence of `literals_size` bytes at `literals` followed by a
+  // match of `match_size` bytes at `offset` bytes back. A `match_size` of 0
+  // writes the last sequence, which has literals only.
+  void WriteSequence(const uint8_t* literals, size_t literals_size,
+                     size_t offset, size_t match_size) {
+    uint8_t* const token = current_;
+    if (!Reserve(1)) return;
+    const size_t match_code = match_size != 0 ? match_size - kMinMatch : 0;
+    *token = (Min(literals_size, kRunMask) << 4) | Min(match_code, kRunMask);
+    WriteLength(literals_size);
+    if (!Reserve(literals_size)) return;
+    MemCopy(current_ - literals_size, literals, literals_size);
+    if (match_size == 0) return;
+    if (!Reserve(2)) return;
+    current_[-2] = offset & 0xff;
+    current_[-1] = offset >> 8;
+    WriteLength(match_code);
+  }
+
+ private:
+  static size_t Min(size_t a, size_t b) { return a < b ? a : b; }
+
+  // Advances the output by `n` bytes. Returns false if they do not fit.
+  bool Reserve(size_t n) {
+    if (!ok_ || static_cast<size_t>(limit_ - current_) < n) {
+      ok_ = false;
+      return false;
+    }
+    current_ += n;
+    return true;
+  }
+
+  // Writes the extra length bytes of a token length value.
+  void WriteLength(size_t length) {
+    if (length < kRunMask) return;
+    length -= kRunMask;
+    for (; length >= 255; length -= 255) {
+      if (!Reserve(1)) return;
+      current_[-1] = 255;
+    }
+    if (!Reserve(1)) return;
+    current_[-1] = length;
+  }
+
+  uint8_t* begin_;
+  uint8_t* current_;
+  uint8_t* limit_;
+  bool ok_ = true;
+};
+
+// Reads the extra bytes of a token length value into `*length`. Returns false
+// if the input ends first.
+inline bool ReadLength(const uint8_t*& ip, const uint8_t* ip_end,
+                       size_t* length) {
+  if (*length != kRunMask) return true;
+  uint8_t byte;
+  do {
+    if (ip == ip_end) return false;
+    byte = *ip++;
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+}  // namespace
+
+size_t Lz4BlockCompress(const uint8_t* src, size_t src_size, uint8_t* dst,
+                        size_t dst_capacity) {
+  Lz4Writer writer(dst, dst_capacity);
+  size_t anchor = 0;
+  if (src_size > kMatchFindLimit) {
+    // Positions plus one of the last sequence seen for each hash value.
+    uint32_t table[1 << kHashLog];
+    for (uint32_t& entry : table) entry = 0;
+    // Matches must end before the last literals.
+    const size_t match_limit = src_size - kLastLiterals;
+    size_t pos = 0;
+    while (pos + kMatchFindLimit < src_size) {
+      const uint32_t sequence = Read32(src + pos);
+      uint32_t& entry = table[Hash(sequence)];
+      const size_t candidate = entry;
+      entry = pos + 1;
+      if (candidate == 0 || pos - (candidate - 1) > kMaxOffset ||
+          Read32(src + candidate - 1) != sequence) {
+        ++pos;
+        continue;
+      }
+      const size_t match = candidate - 1;
+      size_t match_size = kMinMatch;
+      while (pos + match_size < match_limit &&
+             src[match + match_size] == src[pos + match_size]) {
+        ++match_size;
+      }
+      writer.WriteSequence(src + anchor, pos - anchor, pos - match,
+                           match_size);
+      pos += match_size;
+      anchor = pos;
+    }
+  }
+  writer.WriteSequence(src + anchor, src_size - anchor, 0, 0);
+  return writer.size();
+}
+
+bool Lz4BlockDecompress(const uint8_t* src, size_t src_size, uint8_t* dst,
+                        size_t dst_size) {
+  const uint8_t* ip = src;
+  const uint8_t* const ip_end = src + src_size;
+  uint8_t* op = dst;
+  uint8_t* const op_end = dst + dst_size;
+  while (ip < ip_end) {
+    const uint8_t token = *ip++;
+
+    size_t literals_size = token >> 4;
+    if (!ReadLength(ip, ip_end, &literals_size) ||
+        literals_size > static_cast<size_t>(ip_end - ip) ||
+        literals_size > static_cast<size_t>(op_end - op)) {
+      return false;
+    }
+    MemCopy(op, ip, literals_size);
+    ip += literals_size;
+    op += literals_size;
+    // The last sequence has no match.
+    if (ip == ip_end) break;
+
+    if (ip_end - ip < 2) return false;
+    const size_t offset = ip[0] | static_cast<size_t>(ip[1]) << 8;
+    ip += 2;
+    size_t match_size = token & kRunMask;
+    if (!ReadLength(ip, ip_end, &match_size)) return false;
+    match_size += kMinMatch;
+    if (offset == 0 || offset > static_cast<size_t>(op - dst) ||
+        match_size > static_cast<size_t>(op_end - op)) {
+      return false;
+    }
+    const uint8_t* match = op - offset;
+    if (offset >= match_size) {
+      MemCopy(op, match, match_size);
+      op += match_size;
+    } else {
+      // Overlapping matches repeat the last `offset` bytes.
+      for (uint8_t* const end = op + match_size; op < end;) *op++ = *match++;
+    }
+  }
+  return op == op_end;
+}
+
+}  // namespace silifuzz
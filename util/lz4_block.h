@@ -0,0 +1,55 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_UTIL_LZ4_BLOCK_H_
+#define THIRD_PARTY_SILIFUZZ_UTIL_LZ4_BLOCK_H_
+#include <cstddef>
+#include <cstdint>
+
+namespace silifuzz {
+
+// LZ4 block format compression and decompression.
+//
+// This implements the raw LZ4 block format without the frame format, see
+// https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md. Output of the
+// compressor can be decompressed by the reference implementation and vice
+// versa. The code has no dependencies so that the runner can decompress data
+// directly into snap memory.
+
+// Returns the maximum compressed size of `size` bytes of input.
+constexpr size_t Lz4BlockCompressBound(size_t size) {
+  return size + size / 255 + 16;
+}
+
+// Compresses `src_size` bytes at `src` into `dst`, which has `dst_capacity`
+// bytes. The output is deterministic for a given input.
+//
+// RETURNS: the compressed size or 0 if the output does not fit in `dst`.
+// Output never fits if `dst_capacity` is 0. It always fits if `dst_capacity`
+// is at least Lz4BlockCompressBound(src_size).
+size_t Lz4BlockCompress(const uint8_t* src, size_t src_size, uint8_t* dst,
+                        size_t dst_capacity);
+
+// Decompresses the LZ4 block of `src_size` bytes at `src` into `dst_size`
+// bytes at `dst`.
+//
+// RETURNS: true iff the block is well-formed and decompresses to exactly
+// `dst_size` bytes. Neither `src` nor `dst` are accessed out of bounds even
+// for malformed input.
+bool Lz4BlockDecompress(const uint8_t* src, size_t src_size, uint8_t* dst,
+                        size_t dst_size);
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_UTIL_LZ4_BLOCK_H_
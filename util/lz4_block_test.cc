@@ -0,0 +1,146 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./util/lz4_block.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#include "./util/checks.h"
+#include "./util/nolibc_gunit.h"
+
+namespace silifuzz {
+namespace {
+
+constexpr size_t kMaxInputSize = 8192;
+
+// Compresses `size` bytes at `input`, checks that the output decompresses to
+// the same bytes and returns the compressed size.
+size_t CheckRoundTrip(const uint8_t* input, size_t size) {
+  CHECK_LE(size, kMaxInputSize);
+  static uint8_t compressed[Lz4BlockCompressBound(kMaxInputSize)];
+  static uint8_t decompressed[kMaxInputSize];
+  const size_t compressed_size = Lz4BlockCompress(
+      input, size, compressed, Lz4BlockCompressBound(size));
+  CHECK_NE(compressed_size, 0);
+  CHECK_LE(compressed_size, Lz4BlockCompressBound(size));
+  CHECK(Lz4BlockDecompress(compressed, compressed_size, decompressed, size));
+  for (size_t i = 0; i < size; ++i) CHECK_EQ(decompressed[i], input[i]);
+  return compressed_size;
+}
+
+// Fills `size` bytes at `buffer` with pseudo-random bytes.
+void FillRandom(uint8_t* buffer, size_t size) {
+  uint32_t state = 12345;
+  for (size_t i = 0; i < size; ++i) {
+    state = state * 1103515245 + 12345;
+    buffer[i] = state >> 16;
+  }
+}
+
+TEST(Lz4Block, Empty) {
+  uint8_t compressed[Lz4BlockCompressBound(0)];
+  CHECK_EQ(Lz4BlockCompress(nullptr, 0, compressed, 0), 0);
+  const size_t compressed_size =
+      Lz4BlockCompress(nullptr, 0, compressed, sizeof(compressed));
+  CHECK_EQ(compressed_size, 1);
+  CHECK(Lz4BlockDecompress(compressed, compressed_size, nullptr, 0));
+}
+
+TEST(Lz4Block, ShortInputs) {
+  uint8_t input[32];
+  for (size_t i = 0; i < sizeof(input); ++i) input[i] = i % 3;
+  for (size_t size = 1; size <= sizeof(input); ++size) {
+    CheckRoundTrip(input, size);
+  }
+}
+
+TEST(Lz4Block, Repetitive) {
+  static uint8_t input[kMaxInputSize];
+  for (size_t i = 0; i < kMaxInputSize; ++i) input[i] = "abcab"[i % 5];
+  CHECK_LT(CheckRoundTrip(input, kMaxInputSize), kMaxInputSize / 16);
+
+  // Long runs of a single byte produce overlapping matches.
+  for (size_t i = 0; i < kMaxInputSize; ++i) input[i] = i < 5000 ? 0 : 0x90;
+  CHECK_LT(CheckRoundTrip(input, kMaxInputSize), 100);
+}
+
+TEST(Lz4Block, Incompressible) {
+  static uint8_t input[kMaxInputSize];
+  FillRandom(input, kMaxInputSize);
+  CHECK_LE(CheckRoundTrip(input, kMaxInputSize),
+           Lz4BlockCompressBound(kMaxInputSize));
+
+  // Compression fails cleanly if the output does not fit.
+  static uint8_t compressed[kMaxInputSize];
+  CHECK_EQ(Lz4BlockCompress(input, kMaxInputSize, compressed, kMaxInputSize),
+           0);
+}
+
+TEST(Lz4Block, Mixed) {
+  static uint8_t input[kMaxInputSize];
+  FillRandom(input, kMaxInputSize);
+  // Copies of earlier parts of the input at various distances.
+  for (size_t i = 1024; i < kMaxInputSize; i += 1024) {
+    for (size_t j = 0; j < 100; ++j) input[i + j] = input[i / 2 + j];
+  }
+  CHECK_LT(CheckRoundTrip(input, kMaxInputSize),
+           Lz4BlockCompressBound(kMaxInputSize));
+}
+
+TEST(Lz4Block, RejectsMalformedInput) {
+  static uint8_t input[1024];
+  for (size_t i = 0; i < sizeof(input); ++i) input[i] = i % 7;
+  uint8_t compressed[Lz4BlockCompressBound(sizeof(input))];
+  const size_t compressed_size =
+      Lz4BlockCompress(input, sizeof(input), compressed, sizeof(compressed));
+  CHECK_NE(compressed_size, 0);
+  static uint8_t output[sizeof(input) + 1];
+
+  // Wrong output sizes.
+  CHECK(!Lz4BlockDecompress(compressed, compressed_size, output,
+                            sizeof(input) - 1));
+  CHECK(!Lz4BlockDecompress(compressed, compressed_size, output,
+                            sizeof(input) + 1));
+
+  // Every truncation is detected.
+  for (size_t size = 0; size < compressed_size; ++size) {
+    CHECK(!Lz4BlockDecompress(compressed, size, output, sizeof(input)));
+  }
+
+  // A match before the start of the output.
+  const uint8_t bad_offset[] = {0x10, 'a', 0x02, 0x00, 0x00};
+  CHECK(!Lz4BlockDecompress(bad_offset, sizeof(bad_offset), output, 5));
+  // A zero offset.
+  const uint8_t zero_offset[] = {0x10, 'a', 0x00, 0x00, 0x00};
+  CHECK(!Lz4BlockDecompress(zero_offset, sizeof(zero_offset), output, 5));
+  // Valid: 'a' followed by a 4 byte match at offset 1.
+  const uint8_t valid[] = {0x10, 'a', 0x01, 0x00, 0x00};
+  CHECK(Lz4BlockDecompress(valid, sizeof(valid), output, 5));
+  for (size_t i = 0; i < 5; ++i) CHECK_EQ(output[i], 'a');
+}
+
+}  // namespace
+}  // namespace silifuzz
+
+// ========================================================================= //
+
+NOLIBC_TEST_MAIN({
+  RUN_TEST(Lz4Block, Empty);
+  RUN_TEST(Lz4Block, ShortInputs);
+  RUN_TEST(Lz4Block, Repetitive);
+  RUN_TEST(Lz4Block, Incompressible);
+  RUN_TEST(Lz4Block, Mixed);
+  RUN_TEST(Lz4Block, RejectsMalformedInput);
+})
@@ -14,13 +14,117 @@
 
 #include "./util/mem_util.h"
 
-#include <strings.h>
-
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "./util/cpu_features.h"
+
 namespace silifuzz {
 
+namespace {
+
+// MemCopy() and MemSet() switch to string instructions or DC ZVA at this size,
+// where their startup cost is amortized.
+constexpr size_t kStringOpMinSize = 2048;
+
+// Above this size the destination is unlikely to stay in the cache anyway, so
+// large copies bypass it with non-temporal stores instead of evicting
+// everything else.
+constexpr size_t kNonTemporalMinSize = 512 * 1024;
+
+// How far ahead of the copy the source is prefetched.
+constexpr size_t kPrefetchDistance = 512;
+
+// Number of uint64_t words in a cache line.
+constexpr size_t kU64sPerCacheLine = 64 / sizeof(uint64_t);
+
+// A uint64_t at any address. Loads through it compile to plain word loads on
+// x86_64 and aarch64.
+typedef uint64_t UnalignedU64 __attribute__((aligned(1), may_alias));
+
+// All the helpers below use general purpose registers only, see mem_util.h.
+
+#if defined(__x86_64__)
+
+// Returns true if REP MOVSB and REP STOSB are faster than a word loop.
+inline bool HasFastStringOps() {
+  return HasX86CPUFeature(X86CPUFeatures::kERMS) ||
+         HasX86CPUFeature(X86CPUFeatures::kFSRM);
+}
+
+inline void RepMovsb(void* dest, const void* src, size_t n) {
+  asm volatile("rep movsb" : "+D"(dest), "+S"(src), "+c"(n) : : "memory");
+}
+
+inline void RepStosb(void* dest, uint8_t c, size_t n) {
+  asm volatile("rep stosb" : "+D"(dest), "+c"(n) : "a"(c) : "memory");
+}
+
+// Stores `value` at `dest` with MOVNTI.
+inline void StoreNonTemporal(uint64_t* dest, uint64_t value) {
+  asm volatile("movnti %1, %0" : "=m"(*dest) : "r"(value));
+}
+
+// Orders the non-temporal stores before any later store.
+inline void NonTemporalFence() { asm volatile("sfence" : : : "memory"); }
+
+#elif defined(__aarch64__)
+
+// Stores the pair `v0`, `v1` at `dest` with STNP.
+inline void StoreNonTemporal(uint64_t* dest, uint64_t v0, uint64_t v1) {
+  asm volatile("stnp %1, %2, [%0]" : : "r"(dest), "r"(v0), "r"(v1) : "memory");
+}
+
+// STNP is only a hint and needs no fence, but the barrier keeps the
+// contract of the x86_64 version.
+inline void NonTemporalFence() { asm volatile("dmb ishst" : : : "memory"); }
+
+// Returns the size of the block zeroed by DC ZVA or 0 if DC ZVA is prohibited.
+inline size_t DCZVABlockSize() {
+  uint64_t dczid;
+  asm("mrs %0, dczid_el0" : "=r"(dczid));
+  // DCZID_EL0.DZP[bit 4] prohibits DC ZVA, BS[bits 3:0] is log2 of the block
+  // size in words.
+  if (dczid & (1 << 4)) return 0;
+  return sizeof(uint32_t) << (dczid & 0xf);
+}
+
+#endif
+
+#if defined(__x86_64__) || defined(__aarch64__)
+
+// Copies `num_u64s` words with non-temporal stores, prefetching the source.
+void NonTemporalCopy(uint64_t* dest, const uint64_t* src, size_t num_u64s)
+    __attribute__((no_builtin("memcpy"))) /* see MemCopy() below */ {
+  size_t i = 0;
+  for (; i + kU64sPerCacheLine <= num_u64s; i += kU64sPerCacheLine) {
+    // Prefetches never fault, so running past the end of `src` is fine.
+    __builtin_prefetch(&src[i + kPrefetchDistance / sizeof(uint64_t)]);
+#if defined(__x86_64__)
+    for (size_t j = 0; j < kU64sPerCacheLine; ++j) {
+      StoreNonTemporal(&dest[i + j], src[i + j]);
+    }
+#else
+    for (size_t j = 0; j < kU64sPerCacheLine; j += 2) {
+      StoreNonTemporal(&dest[i + j], src[i + j], src[i + j + 1]);
+    }
+#endif
+  }
+  NonTemporalFence();
+  for (; i < num_u64s; ++i) {
+    dest[i] = src[i];
+  }
+}
+
+#endif
+
+}  // namespace
+
 // The no_builtin attribute tells a compiler not replace any part of this
 // function with a call to memcpy(). An optimizing compiler can recognize
 // the uint64_t copying loop below and replace that with a call to memcpy(),
@@ -42,6 +146,18 @@ void MemCopy(void* dest, const void* src, size_t n)
   const size_t num_u64s = n / sizeof(uint64_t);
   uint64_t* dest_u64 = reinterpret_cast<uint64_t*>(dest);
   const uint64_t* src_u64 = reinterpret_cast<const uint64_t*>(src);
+#if defined(__x86_64__) || defined(__aarch64__)
+  if (n >= kNonTemporalMinSize) {
+    NonTemporalCopy(dest_u64, src_u64, num_u64s);
+    return;
+  }
+#endif
+#if defined(__x86_64__)
+  if (n >= kStringOpMinSize && HasFastStringOps()) {
+    RepMovsb(dest, src, n);
+    return;
+  }
+#endif
   for (size_t i = 0; i < num_u64s; ++i) {
     dest_u64[i] = src_u64[i];
   }
@@ -59,9 +175,33 @@ void MemSet(void* dest, uint8_t c, size_t n)
     return;
   }
 
-  const size_t num_u64s = n / sizeof(uint64_t);
+  size_t num_u64s = n / sizeof(uint64_t);
   uint64_t* dest_u64 = reinterpret_cast<uint64_t*>(dest);
   const uint64_t c_u64 = c * 0x0101010101010101ULL;  // replicate 8 times.
+#if defined(__x86_64__)
+  if (n >= kStringOpMinSize && HasFastStringOps()) {
+    RepStosb(dest, c, n);
+    return;
+  }
+#elif defined(__aarch64__)
+  // Zero whole blocks with DC ZVA, the head and tail with the loop below.
+  const size_t block_size =
+      c == 0 && n >= kStringOpMinSize ? DCZVABlockSize() : 0;
+  const uintptr_t start = reinterpret_cast<uintptr_t>(dest);
+  const uintptr_t limit = start + n;
+  const uintptr_t block_start = (start + block_size - 1) & ~(block_size - 1);
+  const uintptr_t block_limit = limit & ~(block_size - 1);
+  if (block_size != 0 && block_start < block_limit) {
+    for (uintptr_t p = block_start; p < block_limit; p += block_size) {
+      asm volatile("dc zva, %0" : : "r"(p) : "memory");
+    }
+    for (uintptr_t p = start; p < block_start; p += sizeof(uint64_t)) {
+      *reinterpret_cast<uint64_t*>(p) = 0;
+    }
+    dest_u64 = reinterpret_cast<uint64_t*>(block_limit);
+    num_u64s = (limit - block_limit) / sizeof(uint64_t);
+  }
+#endif
   for (size_t i = 0; i < num_u64s; ++i) {
     dest_u64[i] = c_u64;
   }
@@ -69,51 +209,54 @@ void MemSet(void* dest, uint8_t c, size_t n)
 
 bool MemEq(const void* s1, const void* s2, size_t n)
     __attribute__((no_builtin("memcmp"))) /* See MemCopy() above */ {
-  // Optimize only if s1, s2 and n are all 8-byte aligned.
-  if (reinterpret_cast<uintptr_t>(s1) % sizeof(uint64_t) != 0 ||
-      reinterpret_cast<uintptr_t>(s2) % sizeof(uint64_t) != 0 ||
-      n % sizeof(uint64_t) != 0) {
-    return bcmp(s1, s2, n) == 0;
-  }
+  return MemDiff(s1, s2, n) == 0;
+}
+
+// This is used in the runner to check that memory contents are
+// equal. It is optimized for the positive case.
+bool MemAllEqualTo(const void* src, uint8_t c, size_t n) {
+  return MemDiffFromByte(src, c, n) == 0;
+}
 
-  // This is used in the runner to check that memory contents are
-  // equal. It is optimized for the positive case. We accumulate pair-wise
-  // XOR results and OR them together to check at the end.  This reduces
-  // the number of branch instructions executed by the CPU.
+// This is used in the runner to check that memory contents are
+// equal. It is optimized for the positive case. We accumulate pair-wise
+// XOR results and OR them together to check at the end.  This reduces
+// the number of branch instructions executed by the CPU.
+uint64_t MemDiff(const void* s1, const void* s2, size_t n)
+    __attribute__((no_builtin("memcmp"))) /* See MemCopy() above */ {
+  // Unaligned word loads are cheap on x86_64 and aarch64, so the word loop
+  // handles any alignment. Only the tail of a size not divisible by 8 is
+  // compared byte by byte.
   const size_t num_u64s = n / sizeof(uint64_t);
-  const uint64_t* u1 = reinterpret_cast<const uint64_t*>(s1);
-  const uint64_t* u2 = reinterpret_cast<const uint64_t*>(s2);
+  const UnalignedU64* u1 = reinterpret_cast<const UnalignedU64*>(s1);
+  const UnalignedU64* u2 = reinterpret_cast<const UnalignedU64*>(s2);
   uint64_t diff = 0;
   for (size_t i = 0; i < num_u64s; ++i) {
     diff |= u1[i] ^ u2[i];
   }
-  return diff == 0;
+  const uint8_t* tail1 = reinterpret_cast<const uint8_t*>(&u1[num_u64s]);
+  const uint8_t* tail2 = reinterpret_cast<const uint8_t*>(&u2[num_u64s]);
+  for (size_t i = 0; i < n % sizeof(uint64_t); ++i) {
+    diff |= tail1[i] ^ tail2[i];
+  }
+  return diff;
 }
 
-// This is used in the runner to check that memory contents are
-// equal. It is optimized for the positive case.
-bool MemAllEqualTo(const void* src, uint8_t c, size_t n) {
-  // Optimize only if src and n are both 8-byte aligned.
-  if (reinterpret_cast<uintptr_t>(src) % sizeof(uint64_t) == 0 &&
-      n % sizeof(uint64_t) == 0) {
-    const size_t num_u64s = n / sizeof(uint64_t);
-    const uint64_t* src_u64 = reinterpret_cast<const uint64_t*>(src);
-    const uint64_t c_u64 = c * 0x0101010101010101ULL;  // replicate 8 times.
-    uint64_t diff = 0;
-    for (size_t i = 0; i < num_u64s; ++i) {
-      diff |= src_u64[i] ^ c_u64;
-    }
-    return diff == 0;
-  } else {
-    // Simple byte loop for the non-optimized case.
-    const uint8_t* src_u8 = reinterpret_cast<const uint8_t*>(src);
-    for (size_t i = 0; i < n; ++i) {
-      if (src_u8[i] != c) {
-        return false;
-      }
-    }
-    return true;
+uint64_t MemDiffFromByte(const void* src, uint8_t c, size_t n) {
+  // Like MemDiff(), compares whole words at any alignment and the tail
+  // bytes one by one.
+  const size_t num_u64s = n / sizeof(uint64_t);
+  const UnalignedU64* src_u64 = reinterpret_cast<const UnalignedU64*>(src);
+  const uint64_t c_u64 = c * 0x0101010101010101ULL;  // replicate 8 times.
+  uint64_t diff = 0;
+  for (size_t i = 0; i < num_u64s; ++i) {
+    diff |= src_u64[i] ^ c_u64;
+  }
+  const uint8_t* tail = reinterpret_cast<const uint8_t*>(&src_u64[num_u64s]);
+  for (size_t i = 0; i < n % sizeof(uint64_t); ++i) {
+    diff |= tail[i] ^ c;
   }
+  return diff;
 }
 
 }  // namespace silifuzz
@@ -27,6 +27,9 @@ namespace silifuzz {
 // Copies n bytes from address src to address dest. This is similar to memcpy()
 // but is optimized for the case that dest, src and n are all aligned by 8.
 // Performance may degrade significantly for all other cases.
+// Large aligned copies use REP MOVSB on CPUs with fast string instructions
+// and non-temporal stores beyond that, so `dest` may not be in the cache
+// afterwards.
 //
 // REQUIRES: [dest, dest+n) and [src, src+n) do not overlap.
 void MemCopy(void* dest, const void* src, size_t n);
@@ -34,12 +37,13 @@ void MemCopy(void* dest, const void* src, size_t n);
 // Sets n bytes at address dest to the same value c. This is similar to memset()
 // in lib C but is optimized for the case that dest and n are both aligned by 8.
 // Performance may degrade significantly for all other cases.
+// Large aligned fills use REP STOSB on x86_64 CPUs with fast string
+// instructions and DC ZVA for zero fills on aarch64.
 void MemSet(void* dest, uint8_t c, size_t n);
 
 // Compares bytes in address ranges [s1,s1+n) and [s2,s2+n) and returns true iff
-// the ranges are the same. This is similar to bcmp() but is optimized for the
-// case that s1, s2 and n are all aligned by 8. Performance may degrade
-// significantly for all other cases.
+// the ranges are the same. This is similar to bcmp() but always compares
+// whole words, see MemDiff().
 bool MemEq(const void* s1, const void* s2, size_t n);
 
 // Byte-wise comparison of the two PODs of type T.
@@ -53,6 +57,25 @@ inline bool MemEqT(const T& s1, const T& s2) {
 // Performance may degrade significantly for all other cases.
 bool MemAllEqualTo(const void* src, uint8_t c, size_t n);
 
+// Returns a value that is zero iff the ranges [s1,s1+n) and [s2,s2+n) are the
+// same. The value is the bitwise OR of the XOR of all corresponding words
+// in the ranges. Unlike MemEq(), this allows the caller to combine multiple
+// comparisons with bitwise OR and branch only once, which is faster when
+// the comparisons are expected to succeed. Compares a word at a time at any
+// alignment, only the last n % 8 bytes are compared one by one.
+uint64_t MemDiff(const void* s1, const void* s2, size_t n);
+
+// Like MemDiff() for the two PODs of type T.
+template <typename T>
+inline uint64_t MemDiffT(const T& s1, const T& s2) {
+  return MemDiff(&s1, &s2, sizeof(T));
+}
+
+// Like MemDiff() but compares the n bytes at src against byte value c. The
+// result is zero iff MemAllEqualTo(src, c, n) is true. Compares a word at a
+// time like MemDiff().
+uint64_t MemDiffFromByte(const void* src, uint8_t c, size_t n);
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_UTIL_MEM_UTIL_H_
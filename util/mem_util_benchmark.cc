@@ -107,6 +107,7 @@
 // This file is compiled with "-mno-sse" by default. So we have to force
 // AVX512F target via a function attribute.
 #define AVX512F_FUNCTION __attribute__((target("avx512f")))
+#define AVX2_FUNCTION __attribute__((target("avx2")))
 
 #endif
 
@@ -228,6 +229,68 @@ AVX512F_FUNCTION bool MemEqAVX512F(const void* s1, const void* s2, size_t n)
 }
 #endif
 
+#ifdef __x86_64__
+// Vector versions of MemAllEqualTo(). Like the other vector functions here,
+// these are for comparison only: the runner does not touch vector registers
+// on x86_64.
+AVX2_FUNCTION bool MemAllEqualToAVX2(const void* src, uint8_t c, size_t n) {
+  // Optimize only if n is 32-byte aligned.
+  if (n % sizeof(__m256i) != 0) {
+    return MemAllEqualTo(src, c, n);
+  }
+  const char* char_ptr = reinterpret_cast<const char*>(src);
+  const __m256i c_m256i = _mm256_set1_epi8(c);
+  __m256i diff = _mm256_setzero_si256();
+  for (size_t i = 0; i < n; i += sizeof(__m256i)) {
+    diff = _mm256_or_si256(
+        diff,
+        _mm256_xor_si256(_mm256_loadu_si256(
+                             reinterpret_cast<const __m256i*>(&char_ptr[i])),
+                         c_m256i));
+  }
+  return _mm256_testz_si256(diff, diff);
+}
+
+AVX512F_FUNCTION bool MemAllEqualToAVX512F(const void* src, uint8_t c,
+                                           size_t n) {
+  // Optimize only if n is 8-byte aligned.
+  if (n % sizeof(uint64_t) != 0) {
+    return MemAllEqualTo(src, c, n);
+  }
+  const char* char_ptr = reinterpret_cast<const char*>(src);
+  const __m512i c_m512i = _mm512_set1_epi8(c);
+  __m512i diff = _mm512_setzero_epi32();
+  size_t i;
+  for (i = 0; i + sizeof(__m512i) <= n; i += sizeof(__m512i)) {
+    diff = _mm512_or_epi64(
+        diff, _mm512_xor_epi64(_mm512_loadu_epi64(&char_ptr[i]), c_m512i));
+  }
+  if (i < n) {
+    const size_t remaining_epi64s = (n - i) / sizeof(uint64_t);
+    const __mmask8 mask = static_cast<__mmask8>((1 << remaining_epi64s) - 1);
+    diff = _mm512_or_epi64(
+        diff, _mm512_maskz_xor_epi64(
+                  mask, _mm512_maskz_loadu_epi64(mask, &char_ptr[i]), c_m512i));
+  }
+  return _mm512_test_epi64_mask(diff, diff) == 0;
+}
+#endif
+
+// Word-at-a-time MemAllEqualTo() for comparison with the NEON version in
+// mem_util.cc.
+bool MemAllEqualToScalar(const void* src, uint8_t c, size_t n) {
+  if (n % sizeof(uint64_t) != 0) {
+    return MemAllEqualTo(src, c, n);
+  }
+  const uint64_t* src_u64 = reinterpret_cast<const uint64_t*>(src);
+  const uint64_t c_u64 = c * 0x0101010101010101ULL;
+  uint64_t diff = 0;
+  for (size_t i = 0; i < n / sizeof(uint64_t); ++i) {
+    diff |= src_u64[i] ^ c_u64;
+  }
+  return diff == 0;
+}
+
 void MemcpyAdaptor(void* dest, const void* src, size_t n) {
   memcpy(dest, src, n);
 }
@@ -372,6 +435,18 @@ int BenchmarkMain() {
   // function.
   RunBenchmark(AllEqualToOneIteration, "MemAllEqualTo", MemAllEqualTo,
                /*should_memset=*/true);
+  RunBenchmark(AllEqualToOneIteration, "MemAllEqualToScalar",
+               MemAllEqualToScalar, /*should_memset=*/true);
+#ifdef __x86_64__
+  if (HasAVX2()) {
+    RunBenchmark(AllEqualToOneIteration, "MemAllEqualToAVX2",
+                 MemAllEqualToAVX2, /*should_memset=*/true);
+  }
+  if (HasAVX512Registers()) {
+    RunBenchmark(AllEqualToOneIteration, "MemAllEqualToAVX512F",
+                 MemAllEqualToAVX512F, /*should_memset=*/true);
+  }
+#endif
   return 0;
 }
 
@@ -178,6 +178,49 @@ TEST(MemSet, BasicTest) {
   MemSetTestHelper(sizeof(uint64_t) * 2 - 1, 1);
 }
 
+// Large enough for the string instruction, DC ZVA and non-temporal paths.
+constexpr size_t kLargeBufferSize = 640 * 1024;
+alignas(4096) char large_buffer_1[kLargeBufferSize + 2 * sizeof(uint64_t)];
+alignas(4096) char large_buffer_2[kLargeBufferSize + 2 * sizeof(uint64_t)];
+
+TEST(MemCopy, LargeSizes) {
+  for (size_t i = 0; i < sizeof(large_buffer_1); ++i) {
+    large_buffer_1[i] = i * 7 + 1;
+  }
+  // Below and above each size threshold, with and without page alignment.
+  constexpr size_t kSizes[] = {2040, 2048, 4096 + 8, 512 * 1024 - 8,
+                               512 * 1024, kLargeBufferSize};
+  for (size_t size : kSizes) {
+    for (size_t offset : {size_t{0}, sizeof(uint64_t)}) {
+      memset(large_buffer_2, 0, sizeof(large_buffer_2));
+      char* dest = large_buffer_2 + offset;
+      MemCopy(dest, large_buffer_1, size);
+      CHECK(MemEq(dest, large_buffer_1, size));
+      // Check no overwrite.
+      if (offset != 0) CHECK_EQ(dest[-1], 0);
+      CHECK_EQ(dest[size], 0);
+    }
+  }
+}
+
+TEST(MemSet, LargeSizes) {
+  constexpr size_t kSizes[] = {2040, 2048, 4096 + 8, 512 * 1024,
+                               kLargeBufferSize};
+  for (size_t size : kSizes) {
+    for (size_t offset : {size_t{0}, sizeof(uint64_t)}) {
+      for (uint8_t value : {uint8_t{0}, uint8_t{0xa5}}) {
+        memset(large_buffer_1, 0x11, sizeof(large_buffer_1));
+        char* dest = large_buffer_1 + offset;
+        MemSet(dest, value, size);
+        CHECK(MemAllEqualTo(dest, value, size));
+        // Check no overwrite.
+        if (offset != 0) CHECK_EQ(dest[-1], 0x11);
+        CHECK_EQ(dest[size], 0x11);
+      }
+    }
+  }
+}
+
 TEST(MemAllEqualTo, BasicTest) {
   TestBuffer buffer;
 
@@ -193,14 +236,16 @@ TEST(MemAllEqualTo, BasicTest) {
     size_t size;
   };
 
-  constexpr size_t kNumTestCase = 7;
+  constexpr size_t kNumTestCase = 9;
   constexpr TestCase test_cases[kNumTestCase] = {
       // 0 byte case should be a no-op.
       {1, 0},
 
       // aligned test cases.
-      {0, 8},   // small size
-      {0, 64},  // big size to test unrolling.
+      {0, 8},    // small size
+      {0, 64},   // big size to test unrolling.
+      {0, 104},  // unrolled loop plus a tail.
+      {8, 96},
 
       // mis-aligned test cases.
       {1, 8},
@@ -227,6 +272,37 @@ TEST(MemAllEqualTo, BasicTest) {
   }
 }
 
+TEST(MemDiff, BasicTest) {
+  TestBuffer buffer1, buffer2;
+
+  auto MemDiffTestHelper = [&buffer1, &buffer2](size_t size, size_t offset) {
+    char* ptr1 = buffer1.Generate(size, 0);
+    char* ptr2 = buffer2.Generate(size, offset);
+    CHECK_EQ(MemDiff(ptr1, ptr2, size), 0);
+    CHECK_EQ(MemDiffFromByte(ptr1, 0, 0), 0);
+
+    ptr1[size / 2] ^= 0x10;
+    CHECK_NE(MemDiff(ptr1, ptr2, size), 0);
+    // Differences can be combined across comparisons.
+    CHECK_NE(MemDiff(ptr2, ptr2, size) | MemDiff(ptr1, ptr2, size), 0);
+
+    constexpr uint8_t kData = 0x5a;
+    memset(ptr1, kData, size);
+    CHECK_EQ(MemDiffFromByte(ptr1, kData, size), 0);
+    ptr1[size - 1] ^= 0x01;
+    CHECK_NE(MemDiffFromByte(ptr1, kData, size), 0);
+  };
+
+  // Address and size are aligned.
+  MemDiffTestHelper(sizeof(uint64_t) * 2, 0);
+  // Only size is aligned.
+  MemDiffTestHelper(sizeof(uint64_t) * 2, 1);
+  // Size is not aligned.
+  MemDiffTestHelper(sizeof(uint64_t) * 2 - 1, 0);
+  // Neither is aligned, with whole words and a tail.
+  MemDiffTestHelper(sizeof(uint64_t) * 4 + 3, 5);
+}
+
 }  // namespace
 }  // namespace silifuzz
 
@@ -236,6 +312,9 @@ NOLIBC_TEST_MAIN({
   RUN_TEST(Memeq, Equal);
   RUN_TEST(Memeq, NotEqual);
   RUN_TEST(MemCopy, BasicTest);
+  RUN_TEST(MemCopy, LargeSizes);
   RUN_TEST(MemSet, BasicTest);
+  RUN_TEST(MemSet, LargeSizes);
   RUN_TEST(MemAllEqualTo, BasicTest);
+  RUN_TEST(MemDiff, BasicTest);
 })
@@ -0,0 +1,65 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_UTIL_PERF_EVENT_READ_H_
+#define THIRD_PARTY_SILIFUZZ_UTIL_PERF_EVENT_READ_H_
+
+#include <linux/perf_event.h>
+
+#include <cstdint>
+
+namespace silifuzz {
+
+// Reads the counter of the perf event whose first page is mapped at `page`
+// with rdpmc under the seqlock protocol described in perf_event_open(2) and
+// stores it in `value`. The event must have been opened for the calling
+// thread. Returns false if the counter cannot be read in user space, e.g.
+// when the event is not on a hardware counter right now, when
+// /sys/bus/event_source/devices/cpu/rdpmc is 0 or on architectures other than
+// x86-64. This makes no syscalls and is thus usable inside the runner.
+inline bool ReadPerfEventInUserSpace(const perf_event_mmap_page* page,
+                                     uint64_t& value) {
+#if defined(__x86_64__)
+  const volatile perf_event_mmap_page* volatile_page = page;
+  uint32_t seq;
+  do {
+    seq = volatile_page->lock;
+    // The kernel only updates the page on the CPU the thread runs on, so a
+    // compiler barrier is enough.
+    asm volatile("" ::: "memory");
+    // 'index' is 0 if the event is not currently on a hardware counter.
+    const uint32_t index = volatile_page->index;
+    if (!volatile_page->cap_user_rdpmc || index == 0) return false;
+    const int64_t count = volatile_page->offset;
+    const uint16_t width = volatile_page->pmc_width;
+    uint32_t low, high;
+    asm volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(index - 1));
+    // Sign extend the raw counter value, it is only 'width' bits wide.
+    int64_t pmc = static_cast<int64_t>(static_cast<uint64_t>(high) << 32 | low);
+    pmc <<= 64 - width;
+    pmc >>= 64 - width;
+    value = count + pmc;
+    asm volatile("" ::: "memory");
+  } while (volatile_page->lock != seq);
+  return true;
+#else
+  (void)page;
+  (void)value;
+  return false;
+#endif
+}
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_UTIL_PERF_EVENT_READ_H_
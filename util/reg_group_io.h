@@ -101,6 +101,22 @@ extern "C" void SaveRegisterGroupsToBuffer(RegisterGroupIOBuffer<Host>& buffer);
 RegisterChecksum<Host> GetRegisterGroupsChecksum(
     const RegisterGroupIOBuffer<Host>& buffer);
 
+// Signatures of SaveRegisterGroupsToBuffer() and GetRegisterGroupsChecksum().
+using SaveRegisterGroupsFunction = void (*)(RegisterGroupIOBuffer<Host>&);
+using RegisterGroupsChecksumFunction =
+    RegisterChecksum<Host> (*)(const RegisterGroupIOBuffer<Host>&);
+
+// Return versions of SaveRegisterGroupsToBuffer() and
+// GetRegisterGroupsChecksum() specialized for buffers whose register_groups
+// are `groups`. The specializations test neither the register groups nor CPU
+// features, and do nothing for an empty set. They can be selected once per
+// set of groups to take these tests off the snap exit path.
+// REQUIRES: InitRegisterGroupIO() has been called.
+SaveRegisterGroupsFunction GetSaveRegisterGroupsFunction(
+    const RegisterGroupSet<Host>& groups);
+RegisterGroupsChecksumFunction GetRegisterGroupsChecksumFunction(
+    const RegisterGroupSet<Host>& groups);
+
 }  // namespace silifuzz
 
 #endif  // THIRD_PARTY_SILIFUZZ_UTIL_REG_GROUP_IO_H_
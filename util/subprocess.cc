@@ -20,12 +20,12 @@
 #include <sys/personality.h>
 #include <sys/prctl.h>  // prctl(), PR_SET_PDEATHSIG
 #include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <cstring>
-#include <memory>
 #include <string>
 #include <vector>
 
@@ -34,6 +34,7 @@
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
 #include "./util/checks.h"
 #include "./util/itoa.h"
 #include "./util/signals.h"
@@ -42,10 +43,18 @@ namespace silifuzz {
 
 namespace {
 ABSL_CONST_INIT absl::once_flag global_init_once_;
+
+// /dev/null opened once by GlobalInit() for kMapToDevNull.
+int dev_null_fd = -1;
 }  // namespace
 
 Subprocess::Subprocess(const Options& options)
-    : child_pid_(-1), child_stdout_(-1), options_(options) {
+    : child_pid_(-1),
+      child_stdout_(-1),
+      child_stdin_(-1),
+      pidfd_(-1),
+      rusage_{},
+      options_(options) {
   absl::call_once(global_init_once_, GlobalInit);
 }
 
@@ -53,25 +62,50 @@ Subprocess::~Subprocess() {
   if (child_stdout_ != -1) {
     close(child_stdout_);
   }
+  if (pidfd_ != -1) {
+    close(pidfd_);
+  }
+  CloseStdin();
 }
 
 absl::Status Subprocess::Start(const std::vector<std::string>& argv) {
   VLOG_INFO(1, "Running ", absl::StrJoin(argv, " "));
-  // Note that we assume that there are no other threads, thus we don't have to
-  // do crazy stuff like using socket pairs or avoiding libc locks.
+  // Other threads may be starting their own subprocesses concurrently. All
+  // descriptors are created with O_CLOEXEC so that they don't leak into those
+  // children, which would delay EOF on our stdout pipe until they all exit.
+  // dup2() clears O_CLOEXEC on the copies installed as stdin/stdout/stderr.
+  //
+  // The child is started with vfork() rather than posix_spawn() because the
+  // latter cannot apply setitimer(2), personality(2) and PR_SET_PDEATHSIG.
+  // Both share the parent's memory and avoid copying page tables.
 
   // [0] is read end, [1] is write end.
   int stdout_pipe[2] = {-1, -1};
-  CHECK_NE(pipe(stdout_pipe), -1);
+  CHECK_NE(pipe2(stdout_pipe, O_CLOEXEC), -1);
+  int stdin_pipe[2] = {-1, -1};
+  if (options_.pipe_stdin_) {
+    CHECK_NE(pipe2(stdin_pipe, O_CLOEXEC), -1);
+  }
+  stdout_buffer_.clear();
 
-  auto argv_exec = std::make_unique<const char*[]>(argv.size() + 1);
-  for (int argc = 0; argc < argv.size(); ++argc) {
-    argv_exec[argc] = argv[argc].c_str();
+  // Reuses the allocation from the previous Start().
+  argv_exec_.clear();
+  for (const std::string& arg : argv) {
+    argv_exec_.push_back(arg.c_str());
   }
-  argv_exec[argv.size()] = nullptr;
+  argv_exec_.push_back(nullptr);
+  const char* const* argv_exec = argv_exec_.data();
   child_pid_ = vfork();
   if (child_pid_ == -1) {
-    return absl::InternalError(absl::StrCat("vfork: ", strerror(errno)));
+    const int vfork_errno = errno;
+    close(stdout_pipe[0]);
+    close(stdout_pipe[1]);
+    if (options_.pipe_stdin_) {
+      close(stdin_pipe[0]);
+      close(stdin_pipe[1]);
+    }
+    // E.g. EAGAIN or ENOMEM, which callers may want to retry.
+    return absl::ErrnoToStatus(vfork_errno, "vfork");
   }
 
   if (child_pid_ == 0) {
@@ -92,7 +126,19 @@ absl::Status Subprocess::Start(const std::vector<std::string>& argv) {
     if (options_.parent_death_signal_ > 0) {
       CHECK_EQ(prctl(PR_SET_PDEATHSIG, options_.parent_death_signal_), 0);
     }
+    if (options_.cgroup_procs_fd_ != -1) {
+      // "0" stands for the writing process.
+      CHECK_EQ(write(options_.cgroup_procs_fd_, "0", 1), 1);
+    }
+    // Only the child's copy of the descriptor table is changed here.
+    for (int fd : options_.inherited_fds_) {
+      CHECK_EQ(fcntl(fd, F_SETFD, 0), 0);
+    }
+    // The pipe ends themselves are closed by execv().
     dup2(stdout_pipe[1], STDOUT_FILENO);
+    if (options_.pipe_stdin_) {
+      dup2(stdin_pipe[0], STDIN_FILENO);
+    }
     switch (options_.map_stderr_) {
       case kNoMapping:
         // Same stderr as the parent.
@@ -100,19 +146,12 @@ absl::Status Subprocess::Start(const std::vector<std::string>& argv) {
       case kMapToStdout:
         dup2(stdout_pipe[1], STDERR_FILENO);
         break;
-      case kMapToDevNull: {
-        int dev_null = open("/dev/null", O_RDWR | O_APPEND);
-        CHECK_NE(dev_null, -1);
-        CHECK_GE(dup2(dev_null, STDERR_FILENO), 0);
-        close(dev_null);
+      case kMapToDevNull:
+        CHECK_GE(dup2(dev_null_fd, STDERR_FILENO), 0);
         break;
-      }
     }
 
-    close(stdout_pipe[0]);
-    close(stdout_pipe[1]);
-
-    execv(argv_exec[0], const_cast<char**>(argv_exec.get()));
+    execv(argv_exec[0], const_cast<char**>(argv_exec));
     // Can only reach here if exec didn't succeed.
 
     // Write directly to STDERR_FILENO to avoid stdio code paths that may do
@@ -131,6 +170,18 @@ absl::Status Subprocess::Start(const std::vector<std::string>& argv) {
     // Parent
     close(stdout_pipe[1]);
     child_stdout_ = stdout_pipe[0];
+    if (options_.pipe_stdin_) {
+      close(stdin_pipe[0]);
+      child_stdin_ = stdin_pipe[1];
+    }
+    if (options_.open_pidfd_) {
+      // pidfds are always O_CLOEXEC. Callers fall back to waiting for EOF
+      // on stdout if the kernel does not support them.
+      pidfd_ = syscall(SYS_pidfd_open, child_pid_, 0);
+      if (pidfd_ == -1) {
+        VLOG_INFO(1, "pidfd_open: ", strerror(errno));
+      }
+    }
     return absl::OkStatus();
   }
 }
@@ -139,6 +190,10 @@ int Subprocess::Communicate(std::string* stdout_output) {
   if (child_pid_ == -1 || child_stdout_ == -1) {
     LOG_FATAL("Must call Start() first.");
   }
+  // Let the child see EOF on stdin so that it does not wait for input.
+  CloseStdin();
+  stdout_output->append(stdout_buffer_);
+  stdout_buffer_.clear();
 
   while (true) {
     char buffer[4096] = {0};
@@ -158,9 +213,14 @@ int Subprocess::Communicate(std::string* stdout_output) {
   }
   close(child_stdout_);
   child_stdout_ = -1;
+  if (pidfd_ != -1) {
+    close(pidfd_);
+    pidfd_ = -1;
+  }
 
   int status = 0;
-  while (waitpid(child_pid_, &status, 0) == -1) {
+  rusage_ = {};
+  while (wait4(child_pid_, &status, 0, &rusage_) == -1) {
     if (errno == EINTR) {
       continue;
     }
@@ -168,7 +228,7 @@ int Subprocess::Communicate(std::string* stdout_output) {
       // Someone else snagged the status before we could
       break;
     } else {
-      LOG_FATAL("waitpid: ", strerror(errno));
+      LOG_FATAL("wait4: ", strerror(errno));
     }
   }
 
@@ -176,9 +236,97 @@ int Subprocess::Communicate(std::string* stdout_output) {
   return status;
 }
 
+absl::Status Subprocess::WriteToStdin(absl::string_view data) {
+  if (child_stdin_ == -1) {
+    return absl::FailedPreconditionError("stdin pipe is not open");
+  }
+  while (!data.empty()) {
+    ssize_t n = write(child_stdin_, data.data(), data.size());
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return absl::InternalError(absl::StrCat("write: ", strerror(errno)));
+    }
+    data.remove_prefix(n);
+  }
+  return absl::OkStatus();
+}
+
+void Subprocess::CloseStdin() {
+  if (child_stdin_ != -1) {
+    close(child_stdin_);
+    child_stdin_ = -1;
+  }
+}
+
+bool Subprocess::ReadStdoutUntil(absl::string_view delimiter,
+                                 std::string* output) {
+  if (child_pid_ == -1 || child_stdout_ == -1) {
+    LOG_FATAL("Must call Start() first.");
+  }
+
+  // Only the tail of the buffer that may contain a new delimiter needs to
+  // be searched after each read.
+  size_t search_start = 0;
+  while (true) {
+    size_t pos =
+        absl::string_view(stdout_buffer_).find(delimiter, search_start);
+    if (pos != absl::string_view::npos) {
+      const size_t end = pos + delimiter.size();
+      output->append(stdout_buffer_, 0, end);
+      stdout_buffer_.erase(0, end);
+      return true;
+    }
+    if (stdout_buffer_.size() >= delimiter.size()) {
+      search_start = stdout_buffer_.size() - delimiter.size() + 1;
+    }
+
+    char buffer[4096];
+    int n = read(child_stdout_, buffer, sizeof(buffer));
+    if (n == 0) {
+      // We've reached a EOF.
+      output->append(stdout_buffer_);
+      stdout_buffer_.clear();
+      return false;
+    }
+    if (n > 0) {
+      stdout_buffer_.append(buffer, n);
+    } else {
+      if (errno == EINTR) {
+        continue;
+      }
+      LOG_FATAL("read: ", strerror(errno));
+    }
+  }
+}
+
+bool Subprocess::ReadAvailableStdout() {
+  if (child_pid_ == -1 || child_stdout_ == -1) {
+    LOG_FATAL("Must call Start() first.");
+  }
+  while (true) {
+    char buffer[4096];
+    int n = read(child_stdout_, buffer, sizeof(buffer));
+    if (n > 0) {
+      stdout_buffer_.append(buffer, n);
+      return true;
+    }
+    if (n == 0) {
+      // We've reached a EOF.
+      return false;
+    }
+    if (errno != EINTR) {
+      LOG_FATAL("read: ", strerror(errno));
+    }
+  }
+}
+
 void Subprocess::GlobalInit() {
   // Make sure SIGPIPE is disabled so that if the child dies it doesn't kill us.
   IgnoreSignal(SIGPIPE);
+  dev_null_fd = open("/dev/null", O_RDWR | O_APPEND | O_CLOEXEC);
+  CHECK_NE(dev_null_fd, -1);
 }
 
 }  // namespace silifuzz
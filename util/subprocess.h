@@ -15,6 +15,7 @@
 #ifndef THIRD_PARTY_SILIFUZZ_UTIL_SUBPROCESS_H_
 #define THIRD_PARTY_SILIFUZZ_UTIL_SUBPROCESS_H_
 
+#include <sys/resource.h>
 #include <sys/time.h>
 #include <sys/types.h>
 
@@ -22,12 +23,14 @@
 #include <vector>
 
 #include "absl/status/status.h"
+#include "absl/strings/string_view.h"
 #include "absl/time/time.h"
 
 namespace silifuzz {
 
 // Minimalistic utility class for launching sub-processes and collecting
-// stdout.
+// stdout. Optionally, the child's stdin can be connected to a pipe
+// for interactive use.
 // This class is thread-compatible.
 class Subprocess {
  public:
@@ -82,6 +85,34 @@ class Subprocess {
       return *this;
     }
 
+    // If true, connects the child's stdin to a pipe written by
+    // WriteToStdin(). Otherwise the child inherits the parent's stdin.
+    Options& PipeStdin(bool v) {
+      pipe_stdin_ = v;
+      return *this;
+    }
+
+    // If true, Start() opens a pidfd for the child, see pidfd().
+    Options& OpenPidFd(bool v) {
+      open_pidfd_ = v;
+      return *this;
+    }
+
+    // Keeps `fd` open in the child under the same number. All other
+    // descriptors created by this process with O_CLOEXEC are closed by exec.
+    Options& InheritFd(int fd) {
+      inherited_fds_.push_back(fd);
+      return *this;
+    }
+
+    // Moves the child into a cgroup before exec by writing "0" to
+    // `cgroup_procs_fd`, an open cgroup.procs file of a cgroup v2 directory.
+    // Everything the child does after exec is accounted to that cgroup.
+    Options& JoinCgroup(int cgroup_procs_fd) {
+      cgroup_procs_fd_ = cgroup_procs_fd;
+      return *this;
+    }
+
    private:
     friend class Subprocess;  // for rlimit_tuples_ and itimer_vals_ access.
 
@@ -96,6 +127,18 @@ class Subprocess {
     // process dies.
     int parent_death_signal_ = 0;
 
+    // Connect child's stdin to a pipe.
+    bool pipe_stdin_ = false;
+
+    // Open a pidfd for the child.
+    bool open_pidfd_ = false;
+
+    // File descriptors to keep open across exec.
+    std::vector<int> inherited_fds_;
+
+    // If not -1, cgroup.procs file of the cgroup to move the child into.
+    int cgroup_procs_fd_ = -1;
+
     // Represents setrlimit(2) args.
     struct RLimitTuple {
       int resource = 0;
@@ -132,9 +175,44 @@ class Subprocess {
   // Returns the process exit status.
   int Communicate(std::string* stdout_output);
 
+  // Writes `data` to the stdin of the child process. Requires
+  // Options::PipeStdin(true).
+  absl::Status WriteToStdin(absl::string_view data);
+
+  // Closes our end of the child's stdin pipe. The child sees an EOF.
+  // This is a no-op if the pipe is already closed.
+  void CloseStdin();
+
+  // Reads stdout of the child until `delimiter` is seen and stores everything
+  // up to and including the delimiter in `output`. Any data read past the
+  // delimiter is retained for subsequent reads or Communicate().
+  // Returns false if EOF is reached before the delimiter. In that case all
+  // remaining output is stored in `output`.
+  bool ReadStdoutUntil(absl::string_view delimiter, std::string* output);
+
+  // Reads the stdout of the child once and retains the data for
+  // ReadStdoutUntil() or Communicate(). Returns false once EOF is reached.
+  // Blocks if no data is available, so call this when stdout_fd() is
+  // readable, e.g. as reported by epoll(7).
+  bool ReadAvailableStdout();
+
   // Returns the child process PID or -1 when no process is running.
   pid_t pid() const { return child_pid_; }
 
+  // Returns our end of the child's stdout pipe or -1 when no process is
+  // running. Only for polling, use ReadAvailableStdout() to read from it.
+  int stdout_fd() const { return child_stdout_; }
+
+  // Returns a pidfd(2) of the child or -1. The descriptor becomes readable
+  // once the child has exited, after which Communicate() does not block on
+  // the exit status. Only available with Options::OpenPidFd(true) on kernels
+  // that support pidfd_open(2) and closed by Communicate().
+  int pidfd() const { return pidfd_; }
+
+  // Returns the resource usage of the child reaped by the last Communicate()
+  // as reported by wait4(2). All zeros if someone else reaped the child.
+  const struct rusage& rusage() const { return rusage_; }
+
  private:
   static void GlobalInit();
   // PID of the child process.
@@ -143,6 +221,21 @@ class Subprocess {
   // File descriptor for our end of the child's stdout pipe.
   int child_stdout_;
 
+  // File descriptor for our end of the child's stdin pipe or -1.
+  int child_stdin_;
+
+  // See pidfd().
+  int pidfd_;
+
+  // Data read from stdout by ReadStdoutUntil() but not yet consumed.
+  std::string stdout_buffer_;
+
+  // See rusage().
+  struct rusage rusage_;
+
+  // NULL-terminated argv for execv(2), kept to reuse its allocation.
+  std::vector<const char*> argv_exec_;
+
   // C-tor parameter.
   Options options_;
 };
@@ -0,0 +1,79 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Measures how many subprocesses per second Subprocess can launch and reap.
+//
+// To run:
+//
+// bazel run -c opt third_party/silifuzz/util:subprocess_benchmark
+
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "absl/time/time.h"
+#include "./util/checks.h"
+#include "./util/subprocess.h"
+
+namespace silifuzz {
+namespace {
+
+void LaunchLoop(benchmark::State& state, const Subprocess::Options& options) {
+  const std::vector<std::string> argv = {"/bin/true"};
+  std::string stdout;
+  for (auto _ : state) {
+    Subprocess sp(options);
+    CHECK_STATUS(sp.Start(argv));
+    stdout.clear();
+    CHECK_EQ(sp.Communicate(&stdout), 0);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+void BM_Launch(benchmark::State& state) {
+  LaunchLoop(state, Subprocess::Options::Default());
+}
+BENCHMARK(BM_Launch)->UseRealTime();
+
+// Options RunnerDriver uses for every runner launch.
+void BM_LaunchRunnerOptions(benchmark::State& state) {
+  Subprocess::Options options = Subprocess::Options::Default();
+  options.DisableAslr(true)
+      .SetParentDeathSignal(SIGKILL)
+      .SetRLimit(RLIMIT_CPU, 10, 11)
+      .SetITimer(ITIMER_REAL, absl::Seconds(10))
+      .MapStderr(Subprocess::kMapToDevNull);
+  LaunchLoop(state, options);
+}
+BENCHMARK(BM_LaunchRunnerOptions)->UseRealTime();
+
+void BM_LaunchPipeStdin(benchmark::State& state) {
+  Subprocess::Options options = Subprocess::Options::Default();
+  options.PipeStdin(true);
+  LaunchLoop(state, options);
+}
+BENCHMARK(BM_LaunchPipeStdin)->UseRealTime();
+
+// Launches from several threads at once like the orchestrator does.
+void BM_LaunchConcurrent(benchmark::State& state) {
+  LaunchLoop(state, Subprocess::Options::Default());
+}
+BENCHMARK(BM_LaunchConcurrent)->ThreadRange(1, 8)->UseRealTime();
+
+}  // namespace
+}  // namespace silifuzz
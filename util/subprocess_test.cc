@@ -14,9 +14,12 @@
 
 #include "./util/subprocess.h"
 
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <sys/resource.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 #include <cstdio>
 #include <cstdlib>
@@ -26,6 +29,7 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
 #include "./util/testing/status_macros.h"
@@ -124,6 +128,124 @@ TEST(Subprocess, ParentDeath) {
   ASSERT_EQ(WTERMSIG(status), SIGKILL);
 }
 
+TEST(Subprocess, PipeStdin) {
+  Subprocess::Options opts = Subprocess::Options::Default();
+  opts.PipeStdin(true);
+  Subprocess sp(opts);
+  ASSERT_OK(sp.Start({"/bin/sh", "-c",
+                      "while read line; do echo \"got $line\"; done"}));
+  ASSERT_OK(sp.WriteToStdin("foo\n"));
+  std::string output;
+  ASSERT_TRUE(sp.ReadStdoutUntil("\n", &output));
+  EXPECT_EQ(output, "got foo\n");
+  ASSERT_OK(sp.WriteToStdin("bar\nbaz\n"));
+  output.clear();
+  ASSERT_TRUE(sp.ReadStdoutUntil("bar\n", &output));
+  EXPECT_EQ(output, "got bar\n");
+  // Communicate() closes stdin and returns any unconsumed output.
+  std::string stdout;
+  EXPECT_EQ(sp.Communicate(&stdout), 0);
+  EXPECT_EQ(stdout, "got baz\n");
+}
+
+TEST(Subprocess, NoDescriptorLeaks) {
+  Subprocess::Options opts = Subprocess::Options::Default();
+  opts.PipeStdin(true);
+  Subprocess cat(opts);
+  ASSERT_OK(cat.Start({"/bin/cat"}));
+  // Would inherit the write end of cat's stdin if it leaked.
+  Subprocess sleeper;
+  ASSERT_OK(sleeper.Start({"/bin/sleep", "3"}));
+
+  absl::Time start = absl::Now();
+  std::string stdout;
+  EXPECT_EQ(cat.Communicate(&stdout), 0);
+  EXPECT_LT(absl::Now() - start, absl::Seconds(2));
+  EXPECT_EQ(sleeper.Communicate(&stdout), 0);
+}
+
+TEST(Subprocess, InheritFd) {
+  int fds[2];
+  ASSERT_EQ(pipe2(fds, O_CLOEXEC), 0);
+  Subprocess::Options opts = Subprocess::Options::Default();
+  opts.InheritFd(fds[1]);
+  Subprocess sp(opts);
+  ASSERT_OK(sp.Start(
+      {"/bin/sh", "-c", absl::StrCat("echo -n inherited >&", fds[1])}));
+  close(fds[1]);
+  std::string stdout;
+  EXPECT_EQ(sp.Communicate(&stdout), 0);
+  char buf[16] = {};
+  EXPECT_EQ(read(fds[0], buf, sizeof(buf)), 9);
+  EXPECT_STREQ(buf, "inherited");
+  close(fds[0]);
+}
+
+TEST(Subprocess, JoinCgroup) {
+  // A pipe stands in for cgroup.procs to see what the child writes.
+  int fds[2];
+  ASSERT_EQ(pipe2(fds, O_CLOEXEC), 0);
+  Subprocess::Options opts = Subprocess::Options::Default();
+  opts.JoinCgroup(fds[1]);
+  Subprocess sp(opts);
+  ASSERT_OK(sp.Start({"/bin/true"}));
+  close(fds[1]);
+  std::string stdout;
+  EXPECT_EQ(sp.Communicate(&stdout), 0);
+  char buf[16] = {};
+  EXPECT_EQ(read(fds[0], buf, sizeof(buf)), 1);
+  EXPECT_STREQ(buf, "0");
+  close(fds[0]);
+}
+
+TEST(Subprocess, ReadStdoutUntilEof) {
+  Subprocess sp;
+  ASSERT_OK(sp.Start({"/bin/sh", "-c", "echo -n partial"}));
+  std::string output;
+  EXPECT_FALSE(sp.ReadStdoutUntil("\n", &output));
+  EXPECT_EQ(output, "partial");
+  std::string stdout;
+  EXPECT_EQ(sp.Communicate(&stdout), 0);
+  EXPECT_THAT(stdout, IsEmpty());
+}
+
+TEST(Subprocess, PollPidFd) {
+  Subprocess::Options opts = Subprocess::Options::Default();
+  opts.OpenPidFd(true);
+  Subprocess sp(opts);
+  ASSERT_OK(
+      sp.Start({"/bin/sh", "-c", "echo -n first; sleep 1; echo -n last"}));
+  if (sp.pidfd() == -1) {
+    GTEST_SKIP() << "pidfd_open(2) is not supported";
+  }
+  struct pollfd pid_poll = {.fd = sp.pidfd(), .events = POLLIN};
+  EXPECT_EQ(poll(&pid_poll, 1, 0), 0);
+
+  // Drain stdout the way an event loop would and then wait for the exit.
+  while (sp.ReadAvailableStdout()) {
+  }
+  ASSERT_EQ(poll(&pid_poll, 1, -1), 1);
+  std::string stdout;
+  EXPECT_EQ(sp.Communicate(&stdout), 0);
+  EXPECT_EQ(stdout, "firstlast");
+  EXPECT_EQ(sp.pidfd(), -1);
+  EXPECT_EQ(sp.stdout_fd(), -1);
+}
+
+TEST(Subprocess, RUsage) {
+  Subprocess::Options opts = Subprocess::Options::Default();
+  opts.SetRLimit(RLIMIT_CPU, 1, 2);
+
+  Subprocess sp(opts);
+  ASSERT_OK(sp.Start({"/bin/sh", "-c", "while :; do :; done"}));
+  std::string stdout;
+  sp.Communicate(&stdout);
+  EXPECT_GT(sp.rusage().ru_maxrss, 0);
+  EXPECT_GE(absl::DurationFromTimeval(sp.rusage().ru_utime) +
+                absl::DurationFromTimeval(sp.rusage().ru_stime),
+            absl::Milliseconds(500));
+}
+
 TEST(Subprocess, SetRLimit) {
   Subprocess::Options opts = Subprocess::Options::Default();
   // 1sec soft limit on CPU  that should trigger a SIGXCPU
@@ -55,6 +55,10 @@ off_t lseek(int fd, off_t offset, int whence) {
   return sys_lseek(fd, offset, whence);
 }
 
+int madvise(void *addr, size_t length, int advice) {
+  return sys_madvise(addr, length, advice);
+}
+
 void *mmap(void *addr, size_t length, int prot, int flags, int fd,
            off_t offset) {
   return sys_mmap(addr, length, prot, flags, fd, offset);
@@ -123,6 +123,24 @@ TEST(Syscalls, lseek) {
   CHECK_EQ(sys_unlink(temp.path()), 0);
 }
 
+TEST(Syscalls, madvise) {
+  size_t page_size = getpagesize();
+  void* ptr = sys_mmap(nullptr, page_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  CHECK_NE(ptr, MAP_FAILED);
+
+  errno = 0;
+  CHECK_EQ(madvise(ptr, page_size, MADV_DONTNEED), 0);
+  CHECK_EQ(errno, 0);
+
+  // Advice with an unaligned address should return EINVAL.
+  errno = 0;
+  CHECK_EQ(madvise(static_cast<char*>(ptr) + 1, 1, MADV_DONTNEED), -1);
+  CHECK_EQ(errno, EINVAL);
+
+  CHECK_EQ(sys_munmap(ptr, page_size), 0);
+}
+
 TEST(Syscalls, mmap) {
   // mapping a length of 0 should return EINVAL.
   errno = 0;
@@ -353,6 +371,7 @@ NOLIBC_TEST_MAIN({
   RUN_TEST(Syscalls, getpid);
   RUN_TEST(Syscalls, kill);
   RUN_TEST(Syscalls, lseek);
+  RUN_TEST(Syscalls, madvise);
   RUN_TEST(Syscalls, mmap);
   RUN_TEST(Syscalls, mprotect);
   RUN_TEST(Syscalls, munmap);
@@ -16,27 +16,48 @@
 #ifndef THIRD_PARTY_SILIFUZZ_UTIL_THREAD_POOL_H_
 #define THIRD_PARTY_SILIFUZZ_UTIL_THREAD_POOL_H_
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
-#include <functional>
-#include <queue>
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <thread>  // NOLINT(build/c++11)
 #include <utility>
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/functional/any_invocable.h"
+#include "absl/functional/function_ref.h"
 #include "absl/synchronization/mutex.h"
 #include "./util/checks.h"
 
 namespace silifuzz {
 
-// A simple ThreadPool implementation.
+// A work-stealing ThreadPool.
+//
+// Each thread owns a deque of tasks. Tasks scheduled by a pool thread go to
+// its own deque and other tasks are spread over the deques round-robin. A
+// thread runs tasks from the front of its deque and steals from the back of
+// the other deques when its own is empty, so Schedule() and taking tasks
+// mostly lock different mutexes. Idle threads sleep until there is work.
+//
+// The destructor runs all scheduled tasks before joining the threads.
+//
+// This class is thread-safe.
 class ThreadPool {
  public:
+  // REQUIRES: num_threads > 0.
   explicit ThreadPool(int num_threads) {
-    threads_.reserve(num_threads);
+    CHECK_GT(num_threads, 0);
+    workers_.reserve(num_threads);
+    for (int i = 0; i < num_threads; ++i) {
+      workers_.push_back(std::make_unique<Worker>());
+    }
+    // Start the threads after all workers exist as they steal from each
+    // other.
     for (int i = 0; i < num_threads; ++i) {
-      threads_.emplace_back(&ThreadPool::WorkLoop, this);
+      workers_[i]->thread = std::thread(&ThreadPool::WorkLoop, this, i);
     }
   }
 
@@ -44,48 +65,205 @@ class ThreadPool {
   ThreadPool &operator=(const ThreadPool &) = delete;
 
   ~ThreadPool() {
+    Wait();
     {
-      absl::MutexLock lock{&mu_};
-      for (size_t i = 0; i < threads_.size(); ++i) {
-        queue_.push(nullptr);  // Shutdown signal.
-      }
+      absl::MutexLock lock{&sleep_mu_};
+      shutdown_ = true;
     }
-    for (auto &thread : threads_) {
-      thread.join();
+    for (auto &worker : workers_) {
+      worker->thread.join();
     }
   }
 
+  int num_threads() const { return static_cast<int>(workers_.size()); }
+
   // Schedule a function to be run on a ThreadPool thread immediately.
   void Schedule(absl::AnyInvocable<void()> func) {
     CHECK(func != nullptr);
-    absl::MutexLock lock{&mu_};
-    queue_.emplace(std::move(func));
+    outstanding_.fetch_add(1, std::memory_order_relaxed);
+    const CurrentThreadInfo &current = CurrentThread();
+    const size_t index =
+        current.pool == this
+            ? current.index
+            : next_worker_.fetch_add(1, std::memory_order_relaxed) %
+                  workers_.size();
+    Worker &worker = *workers_[index];
+    {
+      absl::MutexLock lock{&worker.mu};
+      worker.tasks.push_back(std::move(func));
+    }
+    // A sleeping thread increments num_sleeping_ before checking queued_.
+    // Sequential consistency of both sides guarantees that either it sees
+    // the new task or we see it sleeping.
+    queued_.fetch_add(1, std::memory_order_seq_cst);
+    if (num_sleeping_.load(std::memory_order_seq_cst) > 0) {
+      // Releasing sleep_mu_ makes the sleeping threads re-evaluate their
+      // wakeup condition.
+      absl::MutexLock lock{&sleep_mu_};
+    }
+  }
+
+  // Blocks until all scheduled tasks, including those scheduled by tasks
+  // while waiting, have finished.
+  // REQUIRES: Not called from a thread of this pool.
+  void Wait() {
+    CHECK(CurrentThread().pool != this);
+    absl::MutexLock lock{&done_mu_};
+    done_mu_.Await(absl::Condition{this, &ThreadPool::AllTasksDone});
+  }
+
+  // Calls `func(chunk_begin, chunk_end)` for consecutive chunks of at most
+  // `grain` elements that cover [`begin`, `end`). The chunks are processed in
+  // parallel by the pool threads and the calling thread. Returns when all of
+  // them are done. Unlike Wait(), this can be called from a pool thread.
+  // REQUIRES: grain > 0.
+  void ParallelFor(size_t begin, size_t end, size_t grain,
+                   absl::FunctionRef<void(size_t, size_t)> func) {
+    CHECK_GT(grain, 0);
+    if (begin >= end) return;
+    const size_t num_chunks = (end - begin - 1) / grain + 1;
+    auto state = std::make_shared<ParallelForState>(begin, end, grain,
+                                                    num_chunks, func);
+    // Helpers that start after all chunks are claimed return immediately.
+    // They never call `func`, which may be gone by then.
+    const size_t num_helpers = std::min(num_chunks - 1, workers_.size());
+    for (size_t i = 0; i < num_helpers; ++i) {
+      Schedule([state]() { state->RunChunks(); });
+    }
+    state->RunChunks();
+    absl::MutexLock lock{&state->mu};
+    state->mu.Await(absl::Condition{state.get(), &ParallelForState::Done});
   }
 
  private:
-  bool WorkAvailable() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
-    return !queue_.empty();
+  struct Worker {
+    absl::Mutex mu;
+    std::deque<absl::AnyInvocable<void()>> tasks ABSL_GUARDED_BY(mu);
+    std::thread thread;
+  };
+
+  // The pool and worker index of the current thread if it is a pool thread.
+  struct CurrentThreadInfo {
+    const ThreadPool *pool = nullptr;
+    size_t index = 0;
+  };
+
+  // Shared by the calling thread and the helper tasks of a ParallelFor().
+  struct ParallelForState {
+    ParallelForState(size_t begin, size_t end, size_t grain, size_t num_chunks,
+                     absl::FunctionRef<void(size_t, size_t)> func)
+        : begin(begin),
+          end(end),
+          grain(grain),
+          num_chunks(num_chunks),
+          func(func),
+          chunks_left(num_chunks) {}
+
+    // Claims and runs chunks until all of them are claimed.
+    void RunChunks() {
+      size_t chunk;
+      while ((chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) <
+             num_chunks) {
+        const size_t chunk_begin = begin + chunk * grain;
+        func(chunk_begin, chunk_begin + std::min(grain, end - chunk_begin));
+        if (chunks_left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+          // Wake up the calling thread.
+          absl::MutexLock lock{&mu};
+        }
+      }
+    }
+
+    bool Done() const {
+      return chunks_left.load(std::memory_order_acquire) == 0;
+    }
+
+    const size_t begin;
+    const size_t end;
+    const size_t grain;
+    const size_t num_chunks;
+    const absl::FunctionRef<void(size_t, size_t)> func;
+    std::atomic<size_t> next_chunk = 0;
+    std::atomic<size_t> chunks_left;
+    absl::Mutex mu;
+  };
+
+  static CurrentThreadInfo &CurrentThread() {
+    static thread_local CurrentThreadInfo info;
+    return info;
   }
 
-  void WorkLoop() {
-    while (true) {
-      absl::AnyInvocable<void()> func;
-      {
-        absl::MutexLock lock{&mu_};
-        mu_.Await(absl::Condition{this, &ThreadPool::WorkAvailable});
-        func = std::move(queue_.front());
-        queue_.pop();
+  bool AllTasksDone() const {
+    return outstanding_.load(std::memory_order_acquire) == 0;
+  }
+
+  bool WorkAvailable() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(sleep_mu_) {
+    return queued_.load(std::memory_order_seq_cst) > 0 || shutdown_;
+  }
+
+  // Takes a task from the front of the deque of worker `index` or steals one
+  // from the back of another deque. Returns nullptr if there is none.
+  absl::AnyInvocable<void()> TakeTask(size_t index) {
+    if (queued_.load(std::memory_order_relaxed) <= 0) return nullptr;
+    absl::AnyInvocable<void()> func;
+    for (size_t i = 0; i < workers_.size() && func == nullptr; ++i) {
+      Worker &worker = *workers_[(index + i) % workers_.size()];
+      absl::MutexLock lock{&worker.mu};
+      if (worker.tasks.empty()) continue;
+      if (i == 0) {
+        func = std::move(worker.tasks.front());
+        worker.tasks.pop_front();
+      } else {
+        func = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
       }
-      if (func == nullptr) {  // Shutdown signal.
-        break;
+      // Decrement under the lock so that queued_ never exceeds the number
+      // of tasks in the deques.
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return func;
+  }
+
+  void WorkLoop(size_t index) {
+    CurrentThread() = {.pool = this, .index = index};
+    while (true) {
+      absl::AnyInvocable<void()> func = TakeTask(index);
+      if (func == nullptr) {
+        absl::MutexLock lock{&sleep_mu_};
+        num_sleeping_.fetch_add(1, std::memory_order_seq_cst);
+        sleep_mu_.Await(absl::Condition{this, &ThreadPool::WorkAvailable});
+        num_sleeping_.fetch_sub(1, std::memory_order_relaxed);
+        if (shutdown_) break;
+        continue;
       }
       func();
+      // Destroy the captured state before the task counts as done.
+      func = nullptr;
+      if (outstanding_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        // Releasing done_mu_ makes Wait() re-evaluate its condition.
+        absl::MutexLock lock{&done_mu_};
+      }
     }
   }
 
-  absl::Mutex mu_;
-  std::queue<absl::AnyInvocable<void()>> queue_ ABSL_GUARDED_BY(mu_);
-  std::vector<std::thread> threads_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  // Round-robin index of the deque for tasks scheduled by other threads.
+  std::atomic<size_t> next_worker_ = 0;
+
+  // Number of tasks in the deques. May briefly be smaller than that, or
+  // negative, while Schedule() is running.
+  std::atomic<int64_t> queued_ = 0;
+
+  // Number of tasks scheduled but not finished yet.
+  std::atomic<size_t> outstanding_ = 0;
+
+  // Idle threads sleep on this.
+  absl::Mutex sleep_mu_;
+  std::atomic<int> num_sleeping_ = 0;
+  bool shutdown_ ABSL_GUARDED_BY(sleep_mu_) = false;
+
+  // Wait() sleeps on this.
+  absl::Mutex done_mu_;
 };
 
 }  // namespace silifuzz
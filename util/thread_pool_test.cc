@@ -0,0 +1,93 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./util/thread_pool.h"
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace silifuzz {
+namespace {
+
+TEST(ThreadPool, Wait) {
+  ThreadPool pool(4);
+  std::atomic<int> count = 0;
+  for (int i = 0; i < 1000; ++i) {
+    pool.Schedule([&count]() { ++count; });
+  }
+  pool.Wait();
+  EXPECT_EQ(count, 1000);
+
+  // Tasks scheduled by tasks are waited for too.
+  for (int i = 0; i < 10; ++i) {
+    pool.Schedule([&pool, &count]() {
+      for (int j = 0; j < 10; ++j) {
+        pool.Schedule([&count]() { ++count; });
+      }
+    });
+  }
+  pool.Wait();
+  EXPECT_EQ(count, 1100);
+}
+
+TEST(ThreadPool, DestructorRunsAllTasks) {
+  std::atomic<int> count = 0;
+  {
+    ThreadPool pool(3);
+    for (int i = 0; i < 1000; ++i) {
+      pool.Schedule([&count]() { ++count; });
+    }
+  }
+  EXPECT_EQ(count, 1000);
+}
+
+TEST(ThreadPool, ParallelFor) {
+  ThreadPool pool(4);
+  for (size_t grain : {1, 7, 100, 1000, 5000}) {
+    SCOPED_TRACE(grain);
+    std::vector<std::atomic<int>> hits(1000);
+    pool.ParallelFor(0, hits.size(), grain, [&hits, grain](size_t begin,
+                                                           size_t end) {
+      EXPECT_LT(begin, end);
+      EXPECT_LE(end - begin, grain);
+      for (size_t i = begin; i < end; ++i) {
+        ++hits[i];
+      }
+    });
+    for (const auto& hit : hits) {
+      EXPECT_EQ(hit, 1);
+    }
+  }
+
+  // An empty range does nothing.
+  pool.ParallelFor(5, 5, 1, [](size_t, size_t) { ADD_FAILURE(); });
+}
+
+TEST(ThreadPool, NestedParallelFor) {
+  ThreadPool pool(2);
+  std::atomic<size_t> count = 0;
+  // Every pool thread blocks in ParallelFor() at the same time.
+  pool.ParallelFor(0, 8, 1, [&pool, &count](size_t, size_t) {
+    pool.ParallelFor(0, 100, 3, [&count](size_t begin, size_t end) {
+      count += end - begin;
+    });
+  });
+  EXPECT_EQ(count, 800);
+}
+
+}  // namespace
+}  // namespace silifuzz
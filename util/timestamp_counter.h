@@ -0,0 +1,44 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef THIRD_PARTY_SILIFUZZ_UTIL_TIMESTAMP_COUNTER_H_
+#define THIRD_PARTY_SILIFUZZ_UTIL_TIMESTAMP_COUNTER_H_
+
+#include <cstdint>
+
+namespace silifuzz {
+
+// Returns the current value of the free-running timestamp counter of the CPU,
+// i.e. TSC on x86_64 and CNTVCT_EL0 on aarch64. This does not make any
+// syscalls and is thus usable inside the runner. The read is not serializing,
+// so it is only suitable for measuring intervals much longer than the
+// pipeline depth. The counter frequency is CPU-specific.
+inline uint64_t ReadTimestampCounter() {
+#if defined(__x86_64__)
+  uint32_t low, high;
+  asm volatile("rdtsc" : "=a"(low), "=d"(high));
+  return (static_cast<uint64_t>(high) << 32) | low;
+#elif defined(__aarch64__)
+  uint64_t value;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(value));
+  return value;
+#else
+#error "Unsupported architecture"
+#endif
+}
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_UTIL_TIMESTAMP_COUNTER_H_
@@ -144,11 +144,16 @@ template <typename Arch>
 inline ABSL_MUST_USE_RESULT bool SerializeGRegs(const GRegSet<Arch>& src,
                                                 std::string* dst) {
   CHECK(dst->empty());
-  Serialized<GRegSet<Arch>> tmp;
-  if (!SerializeGRegs(src, &tmp)) {
+  // Serialize in place rather than through a Serialized<> buffer to save a
+  // copy. This runs for every snapshot in bulk pipelines.
+  dst->resize(serialize_internal::SerializedSizeMax<GRegSet<Arch>>());
+  ssize_t sz =
+      serialize_internal::SerializeGRegs(src, dst->data(), dst->size());
+  if (sz < 0) {
+    dst->clear();
     return false;
   }
-  dst->append(tmp.data, tmp.size);
+  dst->resize(sz);
   return true;
 }
 
@@ -173,11 +178,14 @@ template <typename Arch>
 inline ABSL_MUST_USE_RESULT bool SerializeFPRegs(const FPRegSet<Arch>& src,
                                                  std::string* dst) {
   CHECK(dst->empty());
-  Serialized<FPRegSet<Arch>> tmp;
-  if (!SerializeFPRegs(src, &tmp)) {
+  dst->resize(serialize_internal::SerializedSizeMax<FPRegSet<Arch>>());
+  ssize_t sz =
+      serialize_internal::SerializeFPRegs(src, dst->data(), dst->size());
+  if (sz < 0) {
+    dst->clear();
     return false;
   }
-  dst->append(tmp.data, tmp.size);
+  dst->resize(sz);
   return true;
 }
 
@@ -91,6 +91,11 @@ TYPED_TEST(SerializeTest, StringGRegs) {
   ASSERT_TRUE(SerializeGRegs(original, &tmp));
   ASSERT_TRUE(MayBeSerializedGRegs<TypeParam>(tmp));
 
+  // Same bytes as the buffer form.
+  Serialized<decltype(original)> expected;
+  ASSERT_TRUE(SerializeGRegs(original, &expected));
+  EXPECT_EQ(tmp, std::string(expected.data, expected.size));
+
   GRegSet<TypeParam> bounced;
   ASSERT_TRUE(DeserializeGRegs(tmp, &bounced));
   EXPECT_EQ(original, bounced);
@@ -172,6 +177,11 @@ TYPED_TEST(SerializeTest, StringFPRegs) {
   ASSERT_TRUE(SerializeFPRegs(original, &tmp));
   ASSERT_TRUE(MayBeSerializedFPRegs<TypeParam>(tmp));
 
+  // Same bytes as the buffer form.
+  Serialized<decltype(original)> expected;
+  ASSERT_TRUE(SerializeFPRegs(original, &expected));
+  EXPECT_EQ(tmp, std::string(expected.data, expected.size));
+
   FPRegSet<TypeParam> bounced;
   ASSERT_TRUE(DeserializeFPRegs(tmp, &bounced));
   EXPECT_EQ(original, bounced);
@@ -88,6 +88,18 @@ extern "C" void RestoreUContextNoSyscalls(
     const silifuzz::UContext<silifuzz::Host>* ucontext)
     __attribute__((__noreturn__));
 
+#if defined(__x86_64__)
+// Similar to RestoreUContextNoSyscalls() but leaves the live x87/MMX/SSE
+// state as is instead of restoring ucontext->fpregs. The upper parts of the
+// ymm registers and the AVX-512 only state are still cleared.
+//
+// For callers that know the live state already matches ucontext->fpregs or
+// do not care about it, e.g. code built without x87 and vector instructions.
+extern "C" void RestoreUContextKeepFPRegsNoSyscalls(
+    const silifuzz::UContext<silifuzz::Host>* ucontext)
+    __attribute__((__noreturn__));
+#endif
+
 // ========================================================================= //
 
 namespace silifuzz {
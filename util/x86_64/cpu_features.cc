@@ -69,6 +69,14 @@ uint64_t GetX86CPUFeatures() {
   }
 
   X86CPUID(7, &cpuid_result);
+  // CPUID.0x7.0:EBX.AVX2[bit 5]
+  if (IsBitSet(cpuid_result.ebx, 5)) {
+    features |= X86CPUFeatureBitmask(X86CPUFeatures::kAVX2);
+  }
+  // CPUID.0x7.0:EBX.ERMS[bit 9]
+  if (IsBitSet(cpuid_result.ebx, 9)) {
+    features |= X86CPUFeatureBitmask(X86CPUFeatures::kERMS);
+  }
   // CPUID.0x7.0:EBX.AVX512F[bit 16]
   if (IsBitSet(cpuid_result.ebx, 16)) {
     features |= X86CPUFeatureBitmask(X86CPUFeatures::kAVX512F);
@@ -77,6 +85,10 @@ uint64_t GetX86CPUFeatures() {
   if (IsBitSet(cpuid_result.ebx, 30)) {
     features |= X86CPUFeatureBitmask(X86CPUFeatures::kAVX512BW);
   }
+  // CPUID.0x7.0:EDX.FSRM[bit 4]
+  if (IsBitSet(cpuid_result.edx, 4)) {
+    features |= X86CPUFeatureBitmask(X86CPUFeatures::kFSRM);
+  }
   // CPUID.0x7.0:EDX.AMXTILE[bit 24]
   if (IsBitSet(cpuid_result.edx, 24)) {
     features |= X86CPUFeatureBitmask(X86CPUFeatures::kAMX_TILE);
@@ -84,24 +96,40 @@ uint64_t GetX86CPUFeatures() {
   return features;
 }
 
-}  // namespace
+// Stores `new_features` unless the features are already initialized.
+// Returns the stored features.
+uint64_t InitX86CPUFeatures(uint64_t new_features) {
+  uint64_t features = x86_cpu_features.load(std::memory_order_relaxed);
+  // If CAS failed, 'features' holds the current value. Check whether it is
+  // already initialized.
+  while ((features & kInitializedBitMask) == 0) {
+    if (x86_cpu_features.compare_exchange_weak(features, new_features)) {
+      return new_features;
+    }
+  }
+  return features;
+}
 
-bool HasX86CPUFeature(X86CPUFeatures feature) {
+// Returns the features of the current CPU, probing them on first use.
+uint64_t CurrentX86CPUFeatures() {
   uint64_t features = x86_cpu_features.load(std::memory_order_relaxed);
   if (features & kInitializedBitMask) {
-    return (features & X86CPUFeatureBitmask(feature)) != 0;
+    return features;
   }
+  // GetX86CPUFeatures() should always return the same result.
+  return InitX86CPUFeatures(GetX86CPUFeatures());
+}
 
-  const uint64_t new_features = GetX86CPUFeatures();
+}  // namespace
 
-  // If CAS failed, 'features' holds the current value. Check whether it is
-  // already initialized.
-  while (!x86_cpu_features.compare_exchange_weak(features, new_features) &&
-         (features & kInitializedBitMask) == 0) {
-  }
+bool HasX86CPUFeature(X86CPUFeatures feature) {
+  return (CurrentX86CPUFeatures() & X86CPUFeatureBitmask(feature)) != 0;
+}
 
-  // GetX86CPUFeatures() should always return the same result.
-  return (new_features & X86CPUFeatureBitmask(feature));
+uint64_t GetX86CPUFeatureBits() { return CurrentX86CPUFeatures(); }
+
+void SetX86CPUFeatureBits(uint64_t bits) {
+  InitX86CPUFeatures(bits | kInitializedBitMask);
 }
 
 }  // namespace silifuzz
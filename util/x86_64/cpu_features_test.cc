@@ -15,6 +15,7 @@
 #include "./util/cpu_features.h"
 
 #include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <set>
 #include <string>
@@ -38,6 +39,16 @@ TEST(CPUFeatures, CanCheckAllFeatures) {
   }
 }
 
+TEST(CPUFeatures, FeatureBits) {
+  const uint64_t bits = GetX86CPUFeatureBits();
+  EXPECT_NE(bits, 0);
+  // The features are known by now, so this must not change them.
+  SetX86CPUFeatureBits(0);
+  EXPECT_EQ(GetX86CPUFeatureBits(), bits);
+  EXPECT_EQ(HasX86CPUFeature(X86CPUFeatures::kSSE),
+            (bits >> static_cast<int>(X86CPUFeatures::kSSE)) & 1);
+}
+
 // Checks if our results agree with information in /proc/cpuinfo.
 TEST(CPUFeatures, VerifyAgainstCPUInfo) {
   // Extract flags in /proc/cpuinfo
@@ -65,8 +76,11 @@ TEST(CPUFeatures, VerifyAgainstCPUInfo) {
 
   verify_features(X86CPUFeatures::kAMX_TILE, "amx_tile");
   verify_features(X86CPUFeatures::kAVX, "avx");
+  verify_features(X86CPUFeatures::kAVX2, "avx2");
   verify_features(X86CPUFeatures::kAVX512BW, "avx512bw");
   verify_features(X86CPUFeatures::kAVX512F, "avx512f");
+  verify_features(X86CPUFeatures::kERMS, "erms");
+  verify_features(X86CPUFeatures::kFSRM, "fsrm");
   verify_features(X86CPUFeatures::kSSE, "sse");
   verify_features(X86CPUFeatures::kSSE, "sse4_2");
   verify_features(X86CPUFeatures::kXSAVE, "xsave");
@@ -29,6 +29,47 @@ namespace silifuzz {
 // save_registers_groups_to_buffer and set by InitRegisterGroupIO.
 extern "C" bool reg_group_io_opmask_is_64_bit;
 
+// Specializations of SaveRegisterGroupsToBuffer() defined in
+// save_register_groups_to_buffer.S.
+extern "C" void SaveAVXRegisterGroupToBuffer(
+    RegisterGroupIOBuffer<X86_64>& buffer);
+extern "C" void SaveAVX512RegisterGroupToBuffer16(
+    RegisterGroupIOBuffer<X86_64>& buffer);
+extern "C" void SaveAVX512RegisterGroupToBuffer64(
+    RegisterGroupIOBuffer<X86_64>& buffer);
+
+namespace {
+
+void SaveNoRegisterGroupsToBuffer(RegisterGroupIOBuffer<X86_64>& buffer) {}
+
+// GetRegisterGroupsChecksum() for buffers with the AVX group iff `kAVX` and
+// the AVX512 group iff `kAVX512`.
+template <bool kAVX, bool kAVX512>
+RegisterChecksum<X86_64> GetRegisterGroupsChecksumImpl(
+    const RegisterGroupIOBuffer<X86_64>& buffer) {
+  uint32_t crc = 0;
+  RegisterChecksum<X86_64> register_checksum;
+
+  if constexpr (kAVX) {
+    crc = crc32c(crc, reinterpret_cast<const uint8_t*>(buffer.ymm),
+                 sizeof(buffer.ymm));
+    register_checksum.register_groups.SetAVX(true);
+  }
+
+  if constexpr (kAVX512) {
+    crc = crc32c(crc, reinterpret_cast<const uint8_t*>(buffer.zmm),
+                 sizeof(buffer.zmm));
+    crc = crc32c(crc, reinterpret_cast<const uint8_t*>(buffer.opmask),
+                 sizeof(buffer.opmask));
+    register_checksum.register_groups.SetAVX512(true);
+  }
+
+  register_checksum.checksum = crc;
+  return register_checksum;
+}
+
+}  // namespace
+
 void InitRegisterGroupIO() {
   // SaveRegisterGroupsToBuffer() needs to tell if AVX512BW is supported.
   reg_group_io_opmask_is_64_bit = HasX86CPUFeature(X86CPUFeatures::kAVX512BW);
@@ -48,26 +89,30 @@ void InitRegisterGroupIO() {
 // registers.
 RegisterChecksum<X86_64> GetRegisterGroupsChecksum(
     const RegisterGroupIOBuffer<X86_64>& buffer) {
-  uint32_t crc = 0;
-  RegisterChecksum<X86_64> register_checksum;
+  return GetRegisterGroupsChecksumFunction(buffer.register_groups)(buffer);
+}
 
-  const RegisterGroupSet<X86_64>& groups = buffer.register_groups;
-  if (groups.GetAVX()) {
-    crc = crc32c(crc, reinterpret_cast<const uint8_t*>(buffer.ymm),
-                 sizeof(buffer.ymm));
-    register_checksum.register_groups.SetAVX(true);
+SaveRegisterGroupsFunction GetSaveRegisterGroupsFunction(
+    const RegisterGroupSet<X86_64>& groups) {
+  if (groups.GetAVX() && groups.GetAVX512()) {
+    return &SaveRegisterGroupsToBuffer;
+  } else if (groups.GetAVX()) {
+    return &SaveAVXRegisterGroupToBuffer;
+  } else if (groups.GetAVX512()) {
+    return reg_group_io_opmask_is_64_bit ? &SaveAVX512RegisterGroupToBuffer64
+                                         : &SaveAVX512RegisterGroupToBuffer16;
   }
+  return &SaveNoRegisterGroupsToBuffer;
+}
 
-  if (groups.GetAVX512()) {
-    crc = crc32c(crc, reinterpret_cast<const uint8_t*>(buffer.zmm),
-                 sizeof(buffer.zmm));
-    crc = crc32c(crc, reinterpret_cast<const uint8_t*>(buffer.opmask),
-                 sizeof(buffer.opmask));
-    register_checksum.register_groups.SetAVX512(true);
+RegisterGroupsChecksumFunction GetRegisterGroupsChecksumFunction(
+    const RegisterGroupSet<X86_64>& groups) {
+  if (groups.GetAVX()) {
+    return groups.GetAVX512() ? &GetRegisterGroupsChecksumImpl<true, true>
+                              : &GetRegisterGroupsChecksumImpl<true, false>;
   }
-
-  register_checksum.checksum = crc;
-  return register_checksum;
+  return groups.GetAVX512() ? &GetRegisterGroupsChecksumImpl<false, true>
+                            : &GetRegisterGroupsChecksumImpl<false, false>;
 }
 
 }  // namespace silifuzz
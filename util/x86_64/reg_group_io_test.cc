@@ -18,6 +18,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #include "./util/arch.h"
 #include "./util/checks.h"
@@ -100,6 +101,32 @@ TEST(RegisterGroupIO, AVX512Checksum) {
   CHECK_EQ(register_checksum.checksum, expected_crc);
 }
 
+TEST(RegisterGroupIO, SpecializedChecksums) {
+  InitRegisterGroupIO();
+  RegisterGroupIOBuffer<X86_64> buffer;
+  FillTestPattern(reinterpret_cast<uint8_t*>(&buffer), sizeof(buffer));
+  for (int avx = 0; avx < 2; ++avx) {
+    for (int avx512 = 0; avx512 < 2; ++avx512) {
+      RegisterGroupSet<X86_64> groups;
+      groups.SetAVX(avx).SetAVX512(avx512);
+      buffer.register_groups = groups;
+      RegisterChecksum<X86_64> expected = GetRegisterGroupsChecksum(buffer);
+      // Specializations ignore the groups in the buffer.
+      buffer.register_groups = RegisterGroupSet<X86_64>();
+      CHECK(GetRegisterGroupsChecksumFunction(groups)(buffer) == expected);
+    }
+  }
+}
+
+TEST(RegisterGroupIO, SaveNoRegisterGroups) {
+  InitRegisterGroupIO();
+  RegisterGroupIOBuffer<X86_64> buffer;
+  FillTestPattern(reinterpret_cast<uint8_t*>(&buffer), sizeof(buffer));
+  RegisterGroupIOBuffer<X86_64> expected = buffer;
+  GetSaveRegisterGroupsFunction(RegisterGroupSet<X86_64>())(buffer);
+  CHECK_EQ(memcmp(&buffer, &expected, sizeof(buffer)), 0);
+}
+
 }  // namespace
 }  // namespace silifuzz
 
@@ -108,4 +135,6 @@ TEST(RegisterGroupIO, AVX512Checksum) {
 NOLIBC_TEST_MAIN({
   RUN_TEST(RegisterGroupIO, AVXChecksum);
   RUN_TEST(RegisterGroupIO, AVX512Checksum);
+  RUN_TEST(RegisterGroupIO, SpecializedChecksums);
+  RUN_TEST(RegisterGroupIO, SaveNoRegisterGroups);
 })
@@ -15,6 +15,7 @@
 
 #include <immintrin.h>
 
+#include <atomic>
 #include <cstdint>
 
 #include "./util/arch.h"
@@ -23,8 +24,17 @@
 
 namespace silifuzz {
 
+namespace {
+
+// Result of ProbePlatformRegisterGroups() serialized with kCachedBit set, or
+// 0 before the first call. A function scope static does not work in the
+// nolibc environment. Racing callers store the same value.
+constexpr uint64_t kCachedBit = uint64_t{1} << 63;
+std::atomic<uint64_t> cached_platform_register_groups;
+static_assert(cached_platform_register_groups.is_always_lock_free);
+
 __attribute__((target("xsave"))) RegisterGroupSet<X86_64>
-GetCurrentPlatformRegisterGroups() {
+ProbePlatformRegisterGroups() {
   // We assume SSE is at least supported by default.
   RegisterGroupSet<X86_64> groups;
   groups.SetGPR(true).SetFPRAndSSE(true);
@@ -49,6 +59,18 @@ GetCurrentPlatformRegisterGroups() {
   return groups;
 }
 
+}  // namespace
+
+RegisterGroupSet<X86_64> GetCurrentPlatformRegisterGroups() {
+  uint64_t cached =
+      cached_platform_register_groups.load(std::memory_order_relaxed);
+  if (cached == 0) {
+    cached = ProbePlatformRegisterGroups().Serialize() | kCachedBit;
+    cached_platform_register_groups.store(cached, std::memory_order_relaxed);
+  }
+  return RegisterGroupSet<X86_64>::Deserialize(cached & ~kCachedBit);
+}
+
 RegisterGroupSet<X86_64> GetCurrentPlatformChecksumRegisterGroups() {
   RegisterGroupSet<X86_64> groups = GetCurrentPlatformRegisterGroups();
 
@@ -0,0 +1,60 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./util/zstd_util.h"
+
+#include <cstddef>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "zstd.h"
+
+namespace silifuzz {
+
+absl::StatusOr<std::string> ZstdCompress(absl::string_view data, int level) {
+  std::string compressed(ZSTD_compressBound(data.size()), '\0');
+  const size_t compressed_size = ZSTD_compress(
+      compressed.data(), compressed.size(), data.data(), data.size(), level);
+  if (ZSTD_isError(compressed_size)) {
+    return absl::InternalError(absl::StrCat(
+        "ZSTD_compress() failed: ", ZSTD_getErrorName(compressed_size)));
+  }
+  compressed.resize(compressed_size);
+  return compressed;
+}
+
+absl::StatusOr<std::string> ZstdDecompress(absl::string_view compressed) {
+  const auto content_size = ZSTD_getFrameContentSize(compressed.data(),
+                                                     compressed.size());
+  if (content_size == ZSTD_CONTENTSIZE_ERROR ||
+      content_size == ZSTD_CONTENTSIZE_UNKNOWN) {
+    return absl::InvalidArgumentError(
+        "Not a zstd frame with a known content size");
+  }
+  std::string decompressed(content_size, '\0');
+  const size_t decompressed_size =
+      ZSTD_decompress(decompressed.data(), decompressed.size(),
+                      compressed.data(), compressed.size());
+  if (ZSTD_isError(decompressed_size)) {
+    return absl::InternalError(absl::StrCat(
+        "ZSTD_decompress() failed: ", ZSTD_getErrorName(decompressed_size)));
+  }
+  decompressed.resize(decompressed_size);
+  return decompressed;
+}
+
+}  // namespace silifuzz
@@ -0,0 +1,43 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef THIRD_PARTY_SILIFUZZ_UTIL_ZSTD_UTIL_H_
+#define THIRD_PARTY_SILIFUZZ_UTIL_ZSTD_UTIL_H_
+
+#include <string>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+
+namespace silifuzz {
+
+// File name extension of zstd compressed files.
+inline constexpr absl::string_view kZstdExtension = ".zst";
+
+// Compresses `data` into a single zstd frame using compression `level`.
+// Zstd decompresses several times faster than xz at a slightly lower
+// compression ratio. See https://facebook.github.io/zstd/ for valid levels.
+//
+// RETURNS the compressed data or an error status.
+absl::StatusOr<std::string> ZstdCompress(absl::string_view data, int level);
+
+// Decompresses `compressed`, a single zstd frame with a known content size
+// like those made by ZstdCompress().
+//
+// RETURNS the decompressed data or an error status.
+absl::StatusOr<std::string> ZstdDecompress(absl::string_view compressed);
+
+}  // namespace silifuzz
+
+#endif  // THIRD_PARTY_SILIFUZZ_UTIL_ZSTD_UTIL_H_
@@ -0,0 +1,66 @@
+// Copyright 2024 The SiliFuzz Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "./util/zstd_util.h"
+
+#include <cstddef>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "./util/testing/status_macros.h"
+#include "zstd.h"
+
+namespace silifuzz {
+namespace {
+
+TEST(ZstdUtil, Compress) {
+  std::string data;
+  for (int i = 0; i < 10000; ++i) {
+    data += "The quick brown fox jumps over the lazy dog. ";
+  }
+  ASSERT_OK_AND_ASSIGN(std::string compressed, ZstdCompress(data, 3));
+  EXPECT_LT(compressed.size(), data.size());
+
+  std::string decompressed(data.size(), '\0');
+  const size_t decompressed_size =
+      ZSTD_decompress(decompressed.data(), decompressed.size(),
+                      compressed.data(), compressed.size());
+  ASSERT_FALSE(ZSTD_isError(decompressed_size));
+  decompressed.resize(decompressed_size);
+  EXPECT_EQ(decompressed, data);
+}
+
+TEST(ZstdUtil, CompressEmpty) {
+  ASSERT_OK_AND_ASSIGN(std::string compressed, ZstdCompress("", 3));
+  EXPECT_EQ(ZSTD_getFrameContentSize(compressed.data(), compressed.size()), 0);
+}
+
+TEST(ZstdUtil, Decompress) {
+  std::string data;
+  for (int i = 0; i < 10000; ++i) {
+    data += "The quick brown fox jumps over the lazy dog. ";
+  }
+  ASSERT_OK_AND_ASSIGN(std::string compressed, ZstdCompress(data, 3));
+  ASSERT_OK_AND_ASSIGN(std::string decompressed, ZstdDecompress(compressed));
+  EXPECT_EQ(decompressed, data);
+
+  ASSERT_OK_AND_ASSIGN(compressed, ZstdCompress("", 3));
+  ASSERT_OK_AND_ASSIGN(decompressed, ZstdDecompress(compressed));
+  EXPECT_EQ(decompressed, "");
+
+  EXPECT_FALSE(ZstdDecompress("not zstd").ok());
+}
+
+}  // namespace
+}  // namespace silifuzz